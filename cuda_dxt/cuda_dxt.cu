@@ -750,13 +750,14 @@ static int dxt_launch(const void * src, void * out, int sx, int sy, cudaStream_t
     const dim3 tsiz(16, 16);
     const dim3 gsiz((sx + tsiz.x - 1) / tsiz.x, (sy + tsiz.y - 1) / tsiz.y);
     
-    // launch kernel, sync and check the result
+    // launch kernel and check the launch result (the kernel runs
+    // asynchronously, execution errors are reported by a subsequent sync)
     if(mirrored) {
         dxt_kernel<YUV_TO_RGB, true, DXT_TYPE><<<gsiz, tsiz, 0, str>>>(src, out, sx, sy);
     } else {
         dxt_kernel<YUV_TO_RGB, false, DXT_TYPE><<<gsiz, tsiz, 0, str>>>(src, out, sx, sy);
     }
-    return cudaSuccess != cudaStreamSynchronize(str) ? -3 : 0;
+    return cudaSuccess != cudaGetLastError() ? -3 : 0;
 }
 
 CUDA_DLL_API int cuda_yuv422_to_yuv444(const void * src, void * out,
@@ -766,7 +767,7 @@ CUDA_DLL_API int cuda_yuv422_to_yuv444(const void * src, void * out,
     int thread_count = pix_count / 4; // we process block of 4 pixels
     const dim3 gsiz((thread_count + tsiz.x - 1) / tsiz.x, 1);
     yuv422_to_yuv444_kernel<<<gsiz, tsiz, 0, (cudaStream_t) str>>>(src, out, pix_count);
-    return cudaSuccess != cudaStreamSynchronize((cudaStream_t) str) ? -3 : 0;
+    return cudaSuccess != cudaGetLastError() ? -3 : 0;
 }
 
 /// CUDA DXT1 compression (only RGB without alpha).
@@ -778,6 +779,8 @@ CUDA_DLL_API int cuda_yuv422_to_yuv444(const void * src, void * out,
 /// @param size_x  Width of the input image (must be divisible by 4).
 /// @param size_y  Height of the input image (must be divisible by 4).
 /// @param stream  CUDA stream to run in, or 0 for default stream.
+///                (Returns once the kernel is enqueued, the caller must
+///                synchronize with the stream before reading the output.)
 /// @return 0 if OK, nonzero if failed.
 CUDA_DLL_API int cuda_rgb_to_dxt1(const void * src, void * out,
                 int size_x, int size_y, cuda_wrapper_stream_t stream) {
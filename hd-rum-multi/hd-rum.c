@@ -1,40 +1,68 @@
+#define _GNU_SOURCE 1
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/select.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
 #include <netdb.h>
-#define __USE_GNU 1
+#include <poll.h>
 #include <pthread.h>
 #include <fcntl.h>
 #include <sched.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <netinet/udp.h>
+#endif
 
 
 #define SIZE    10000
+#define MAX_PORTS 16      /* input ports */
+#define MAX_WORKERS 64
+#define BATCH 64          /* packets received/sent with one syscall */
+#define SPIN_COUNT 256    /* iterations before a thread parks on a condition */
+#define GSO_MAX_SEGS 64
+#define GSO_MAX_LEN 65000
 
 struct replica {
     const char *host;
-    unsigned short port;
-    int sock;
+    unsigned short port;     /* destination port for the first input port */
+    int sock[MAX_PORTS];     /* connected socket for every input port */
 };
 
 
 struct item {
     struct item *next;
     long size;
+    int port_idx;            /* index of the input port the packet came from */
     char buf[SIZE];
 };
 
+/*
+ * Every worker sends to replicas with index % nworkers == worker index and
+ * reads the queue with its own cursor. Queue item can be reused by the
+ * receiver only after all workers have passed it.
+ */
+struct worker {
+    pthread_t thread;
+    int index;
+    int cpu;                 /* CPU to pin to, -1 if not pinned */
+    int gso;                 /* UDP GSO (UDP_SEGMENT) usable */
+    _Atomic(struct item *) head;
+};
+
 static struct item *queue;
-static struct item *qhead;
-static struct item *qtail;
-static int qempty = 1;
-static int qfull = 0;
+static _Atomic(struct item *) qtail;
+/* threads park on the condition only if spinning didn't help, the other side
+ * takes the mutex only if someone is parked */
+static atomic_int writers_waiting;
+static atomic_bool receiver_waiting;
 static pthread_mutex_t qempty_mtx = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t qfull_mtx = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t qempty_cond = PTHREAD_COND_INITIALIZER;
@@ -43,10 +71,20 @@ static pthread_cond_t qfull_cond = PTHREAD_COND_INITIALIZER;
 struct replica *replicas;
 int count;
 
+static struct worker workers[MAX_WORKERS];
+static int nworkers = 1;
+
+static unsigned short ports[MAX_PORTS];
+static int nports;
+
 void qinit(int qsize)
 {
     int i;
 
+    if (qsize < 2) {
+        qsize = 2;
+    }
+
     printf("initializing packet queue for %d items\n", qsize);
 
     queue = (struct item *) calloc(qsize, sizeof(struct item));
@@ -59,7 +97,7 @@ void qinit(int qsize)
         queue[i].next = queue + i + 1;
     queue[qsize - 1].next = queue;
 
-    qhead = qtail = queue;
+    atomic_init(&qtail, queue);
 }
 
 
@@ -124,51 +162,388 @@ int output_socket(unsigned short port, const char *host, int bufsize)
         exit(2);
     }
 
+    freeaddrinfo(res);
+
     return s;
 }
 
 
-void *writer(void *arg)
+int input_socket(unsigned short port, int bufsize)
+{
+    struct sockaddr_in addr;
+    int s;
+
+    if ((s = socket(PF_INET, SOCK_DGRAM, 0)) == -1) {
+        perror("input socket");
+        exit(2);
+    }
+
+    if (buffer_size(s, SO_RCVBUF, bufsize))
+        exit(2);
+
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(s, (struct sockaddr *) &addr, sizeof(struct sockaddr_in))) {
+        perror("bind");
+        exit(2);
+    }
+
+    fcntl(s, F_SETFL, O_NONBLOCK);
+
+    printf("listening on *:%d\n", port);
+
+    return s;
+}
+
+
+static int gso_supported(int sock)
+{
+#ifdef UDP_SEGMENT
+    int val = 0;
+    socklen_t len = sizeof val;
+    /* succeeds only if the kernel knows UDP_SEGMENT (Linux 4.18+) */
+    return getsockopt(sock, SOL_UDP, UDP_SEGMENT, &val, &len) == 0;
+#else
+    (void) sock;
+    return 0;
+#endif
+}
+
+
+/* waits until the receiver passes the cursor */
+static void wait_for_packets(struct item *head)
 {
     int i;
 
-    while (1) {
-        while (qhead != qtail) {
-            for (i = 0; i < count; i++)
-                write(replicas[i].sock, qhead->buf, qhead->size);
+    for (i = 0; i < SPIN_COUNT; i++) {
+        if (atomic_load_explicit(&qtail, memory_order_acquire) != head)
+            return;
+        sched_yield();
+    }
 
-            qhead = qhead->next;
+    pthread_mutex_lock(&qempty_mtx);
+    atomic_fetch_add(&writers_waiting, 1); /* seq_cst - pairs with publish() */
+    while (atomic_load(&qtail) == head)
+        pthread_cond_wait(&qempty_cond, &qempty_mtx);
+    atomic_fetch_sub(&writers_waiting, 1);
+    pthread_mutex_unlock(&qempty_mtx);
+}
 
-            pthread_mutex_lock(&qfull_mtx);
-            qfull = 0;
-            pthread_cond_signal(&qfull_cond);
-            pthread_mutex_unlock(&qfull_mtx);
-        }
 
+static void publish(struct item *tail)
+{
+    atomic_store(&qtail, tail);
+    if (atomic_load(&writers_waiting) > 0) {
         pthread_mutex_lock(&qempty_mtx);
-        if (qempty)
-            pthread_cond_wait(&qempty_cond, &qempty_mtx);
-        qempty = 1;
         pthread_mutex_unlock(&qempty_mtx);
+        pthread_cond_broadcast(&qempty_cond);
+    }
+}
+
+
+static void advance_cursor(struct worker *w, struct item *head)
+{
+    atomic_store(&w->head, head);
+    if (atomic_load(&receiver_waiting)) {
+        pthread_mutex_lock(&qfull_mtx);
+        pthread_mutex_unlock(&qfull_mtx);
+        pthread_cond_signal(&qfull_cond);
+    }
+}
+
+
+static int is_head(struct item *it)
+{
+    int i;
+
+    for (i = 0; i < nworkers; i++)
+        if (atomic_load(&workers[i].head) == it)
+            return 1;
+    return 0;
+}
+
+
+/* returns number of items (up to max) following the tail that can be filled */
+static int writable(int max)
+{
+    struct item *it = atomic_load_explicit(&qtail, memory_order_relaxed);
+    int n = 0;
+
+    while (n < max && !is_head(it->next)) {
+        it = it->next;
+        n++;
+    }
+    return n;
+}
+
+
+static void wait_for_space(void)
+{
+    int i;
+
+    for (i = 0; i < SPIN_COUNT; i++) {
+        if (writable(1) > 0)
+            return;
+        sched_yield();
+    }
+
+    pthread_mutex_lock(&qfull_mtx);
+    atomic_store(&receiver_waiting, 1); /* seq_cst - pairs with advance_cursor() */
+    while (writable(1) == 0)
+        pthread_cond_wait(&qfull_cond, &qfull_mtx);
+    atomic_store(&receiver_waiting, 0);
+    pthread_mutex_unlock(&qfull_mtx);
+}
+
+
+/*
+ * Sends the packets to a connected socket. With GSO, runs of equally-sized
+ * packets (the last of a run may be shorter) are coalesced into one
+ * datagram segmented by the kernel/NIC.
+ */
+static void send_group(struct worker *w, int sock, struct item **items, int n)
+{
+#ifdef __linux__
+    struct mmsghdr msgs[BATCH];
+    struct iovec iov[BATCH];
+#ifdef UDP_SEGMENT
+    char cmsg[BATCH][CMSG_SPACE(sizeof(uint16_t))];
+#endif
+    int m = 0;
+    int sent = 0;
+    int i = 0;
+
+    memset(msgs, 0, n * sizeof msgs[0]);
+    while (i < n) {
+        int start = i;
+        long seg = items[i]->size;
+        long total = 0;
+
+        msgs[m].msg_hdr.msg_iov = &iov[i];
+        while (i < n && i - start < GSO_MAX_SEGS && (w->gso || i == start)) {
+            long len = items[i]->size;
+            if (len > seg || total + len > GSO_MAX_LEN)
+                break;
+            iov[i].iov_base = items[i]->buf;
+            iov[i].iov_len = len;
+            total += len;
+            i++;
+            if (len < seg) /* only the last segment can be shorter */
+                break;
+        }
+        msgs[m].msg_hdr.msg_iovlen = i - start;
+#ifdef UDP_SEGMENT
+        if (i - start > 1) {
+            struct cmsghdr *cm;
+            uint16_t gso_size = seg;
+
+            msgs[m].msg_hdr.msg_control = cmsg[m];
+            msgs[m].msg_hdr.msg_controllen = sizeof cmsg[m];
+            cm = CMSG_FIRSTHDR(&msgs[m].msg_hdr);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof gso_size);
+            memcpy(CMSG_DATA(cm), &gso_size, sizeof gso_size);
+        }
+#endif
+        m++;
+    }
+
+    while (sent < m) {
+        int ret = sendmmsg(sock, msgs + sent, m - sent, 0);
+        if (ret > 0) {
+            sent += ret;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        if (msgs[sent].msg_hdr.msg_iovlen > 1) {
+            /* eg. EIO if the device doesn't support checksum offload */
+            int first = msgs[sent].msg_hdr.msg_iov - iov;
+            fprintf(stderr, "UDP GSO failed (%s), disabling\n", strerror(errno));
+            w->gso = 0;
+            send_group(w, sock, items + first, n - first);
+            return;
+        }
+        sent++; /* drop the packet (eg. ECONNREFUSED), as write() did */
+    }
+#else
+    int i;
+
+    (void) w;
+    for (i = 0; i < n; i++)
+        send(sock, items[i]->buf, items[i]->size, 0);
+#endif
+}
+
+
+static void send_to_replica(struct worker *w, struct replica *r, struct item **items, int n)
+{
+    int start = 0;
+    int i;
+
+    /* packets from different input ports go to different destination ports */
+    for (i = 1; i <= n; i++) {
+        if (i == n || items[i]->port_idx != items[start]->port_idx) {
+            send_group(w, r->sock[items[start]->port_idx], items + start, i - start);
+            start = i;
+        }
+    }
+}
+
+
+void *writer(void *arg)
+{
+    struct worker *w = (struct worker *) arg;
+    struct item *head = atomic_load(&w->head);
+    int i;
+
+#ifdef __linux__
+    if (w->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof set, &set) != 0)
+            fprintf(stderr, "cannot pin writer %d to CPU %d\n", w->index, w->cpu);
+    }
+#endif
+
+    while (1) {
+        struct item *tail;
+
+        wait_for_packets(head);
+        tail = atomic_load_explicit(&qtail, memory_order_acquire);
+
+        while (head != tail) {
+            struct item *batch[BATCH];
+            struct item *it;
+            int n = 0;
+
+            for (it = head; it != tail && n < BATCH; it = it->next)
+                batch[n++] = it;
+
+            for (i = w->index; i < count; i += nworkers)
+                send_to_replica(w, &replicas[i], batch, n);
+
+            head = it;
+            advance_cursor(w, head);
+        }
     }
 
     return NULL;
 }
 
 
+/*
+ * Receives all pending packets from the socket into the queue.
+ * Returns 0 on success (EAGAIN), -1 on error.
+ */
+static int receive(int sock, int port_idx)
+{
+    while (1) {
+        struct item *items[BATCH];
+        struct item *it;
+        int avail;
+        int n;
+        int i;
+
+        if ((avail = writable(BATCH)) == 0) {
+            wait_for_space();
+            avail = writable(BATCH);
+        }
+
+        it = atomic_load_explicit(&qtail, memory_order_relaxed);
+        for (i = 0; i < avail; i++) {
+            items[i] = it;
+            it = it->next;
+        }
+
+#ifdef __linux__
+        struct mmsghdr msgs[BATCH];
+        struct iovec iov[BATCH];
+
+        memset(msgs, 0, avail * sizeof msgs[0]);
+        for (i = 0; i < avail; i++) {
+            iov[i].iov_base = items[i]->buf;
+            iov[i].iov_len = SIZE;
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        n = recvmmsg(sock, msgs, avail, MSG_DONTWAIT, NULL);
+        for (i = 0; i < n; i++)
+            items[i]->size = msgs[i].msg_len;
+#else
+        for (n = 0; n < avail; n++) {
+            long size = recv(sock, items[n]->buf, SIZE, MSG_DONTWAIT);
+            if (size < 0)
+                break;
+            items[n]->size = size;
+        }
+        if (n == 0)
+            n = -1;
+#endif
+        if (n <= 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                return 0;
+            return -1;
+        }
+
+        for (i = 0; i < n; i++)
+            items[i]->port_idx = port_idx;
+        publish(items[n - 1]->next);
+    }
+}
+
+
+static void usage(const char *progname)
+{
+    fprintf(stderr, "%s [-t writers] [-a cpu[,cpu...]] buffer_size port[,port...] host...\n"
+            "\t-t - number of writer threads (default 1)\n"
+            "\t-a - CPUs to pin the writer threads to\n", progname);
+}
+
+
 int main(int argc, char **argv)
 {
-    unsigned short port;
     int qsize;
     int bufsize;
-    struct sockaddr_in addr;
-    int sock_in;
-    pthread_t thread;
-    int err = 0;
-    int i;
+    int sock_in[MAX_PORTS];
+    int cpus[MAX_WORKERS];
+    int ncpus = 0;
+    int opt;
+    int i, j;
+    char *item, *save_ptr;
+
+    while ((opt = getopt(argc, argv, "+t:a:h")) != -1) {
+        switch (opt) {
+        case 't':
+            nworkers = atoi(optarg);
+            if (nworkers < 1 || nworkers > MAX_WORKERS) {
+                fprintf(stderr, "number of writers must be between 1 and %d\n", MAX_WORKERS);
+                return 1;
+            }
+            break;
+        case 'a':
+            for (item = strtok_r(optarg, ",", &save_ptr); item && ncpus < MAX_WORKERS;
+                 item = strtok_r(NULL, ",", &save_ptr))
+                cpus[ncpus++] = atoi(item);
+#ifndef __linux__
+            fprintf(stderr, "CPU pinning is not supported on this platform, ignoring\n");
+            ncpus = 0;
+#endif
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
 
     if (argc < 4) {
-        fprintf(stderr, "%s buffer_size port host...\n", argv[0]);
+        usage(argv[-(optind - 1)]);
         return 1;
     }
 
@@ -192,32 +567,24 @@ int main(int argc, char **argv)
 
     printf("using UDP send and receive buffer size of %d bytes\n", bufsize);
 
-    if ((port = atoi(argv[2])) <= 0) {
-        fprintf(stderr, "invalid port: %d\n", port);
-        return 1;
+    for (item = strtok_r(argv[2], ",", &save_ptr); item; item = strtok_r(NULL, ",", &save_ptr)) {
+        int port = atoi(item);
+        if (port <= 0 || port > 65535) {
+            fprintf(stderr, "invalid port: %s\n", item);
+            return 1;
+        }
+        if (nports == MAX_PORTS) {
+            fprintf(stderr, "at most %d ports supported\n", MAX_PORTS);
+            return 1;
+        }
+        ports[nports++] = port;
     }
 
     qinit(qsize);
 
-    /* input socket */
-    if ((sock_in = socket(PF_INET, SOCK_DGRAM, 0)) == -1) {
-        perror("input socket");
-        return 2;
-    }
-
-    if (buffer_size(sock_in, SO_RCVBUF, bufsize))
-        exit(2);
-
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(port);
-    if (bind(sock_in, (struct sockaddr *) &addr,
-             sizeof(struct sockaddr_in))) {
-        perror("bind");
-        return 2;
-    }
-
-    printf("listening on *:%d\n", port);
+    /* input socket(s) */
+    for (i = 0; i < nports; i++)
+        sock_in[i] = input_socket(ports[i], bufsize);
 
     /* output socket(s) */
     count = argc - 3;
@@ -233,53 +600,84 @@ int main(int argc, char **argv)
         if (i > 0 && strcmp(replicas[i - 1].host, replicas[i].host) == 0)
             replicas[i].port = replicas[i - 1].port + 1;
         else
-            replicas[i].port = port;
+            replicas[i].port = ports[0];
 
-        replicas[i].sock = output_socket(replicas[i].port, replicas[i].host,
-                                         bufsize);
+        /* other input ports keep their offset from the first one */
+        for (j = 0; j < nports; j++)
+            replicas[i].sock[j] = output_socket(replicas[i].port + (ports[j] - ports[0]),
+                                                replicas[i].host, bufsize);
     }
 
-    if (pthread_create(&thread, NULL, writer, NULL)) {
-        fprintf(stderr, "cannot create writer thread\n");
-        return 2;
+    for (i = 0; i < nworkers; i++) {
+        workers[i].index = i;
+        workers[i].cpu = ncpus > 0 ? cpus[i % ncpus] : -1;
+        workers[i].gso = gso_supported(replicas[0].sock[0]);
+        atomic_init(&workers[i].head, queue);
     }
+    if (workers[0].gso)
+        printf("using UDP GSO\n");
 
-    /* main loop */
-    while (1) {
-        fcntl(sock_in, F_SETFL, O_NONBLOCK);
-
-        while (qtail->next != qhead
-               && ((qtail->size = read(sock_in, qtail->buf, SIZE)) > 0
-                   || (err = errno) == EAGAIN)) {
+    for (i = 0; i < nworkers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, writer, &workers[i])) {
+            fprintf(stderr, "cannot create writer thread\n");
+            return 2;
+        }
+    }
 
-            if (qtail->size <= 0) {
-                sched_yield();
-            }
-            else {
-                qtail = qtail->next;
+    /* main loop */
+#ifdef __linux__
+    int epfd = epoll_create1(0);
+    if (epfd == -1) {
+        perror("epoll_create1");
+        return 2;
+    }
+    for (i = 0; i < nports; i++) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = i };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, sock_in[i], &ev) == -1) {
+            perror("epoll_ctl");
+            return 2;
+        }
+    }
 
-                pthread_mutex_lock(&qempty_mtx);
-                qempty = 0;
-                pthread_cond_signal(&qempty_cond);
-                pthread_mutex_unlock(&qempty_mtx);
+    while (1) {
+        struct epoll_event events[MAX_PORTS];
+        int n = epoll_wait(epfd, events, MAX_PORTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            return 2;
+        }
+        for (i = 0; i < n; i++) {
+            int idx = events[i].data.u32;
+            if (receive(sock_in[idx], idx) != 0) {
+                printf("read: %s\n", strerror(errno));
+                return 2;
             }
         }
-
-        if (qtail->size <= 0)
-            break;
-
-        pthread_mutex_lock(&qfull_mtx);
-        if (qfull)
-            pthread_cond_wait(&qfull_cond, &qfull_mtx);
-        qfull = 1;
-        pthread_mutex_unlock(&qfull_mtx);
+    }
+#else
+    struct pollfd fds[MAX_PORTS];
+    for (i = 0; i < nports; i++) {
+        fds[i].fd = sock_in[i];
+        fds[i].events = POLLIN;
     }
 
-    if (qtail->size < 0) {
-        printf("read: %s\n", strerror(err));
-        return 2;
+    while (1) {
+        if (poll(fds, nports, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            return 2;
+        }
+        for (i = 0; i < nports; i++) {
+            if ((fds[i].revents & POLLIN) && receive(sock_in[i], i) != 0) {
+                printf("read: %s\n", strerror(errno));
+                return 2;
+            }
+        }
     }
+#endif
 
     return 0;
 }
-
@@ -110,59 +110,29 @@ char *xor_using_sse2 (char *source, char *dest, int packet_size)
     return dest;
 }
 
-CUDA_DLL_API void gpu_encode_upgrade (char * source_data,int *OUTBUF, int * PCM,int param_k,int param_m,int w_f,int packet_size ,int buf_size)
+CUDA_DLL_API void gpu_encode_upgrade (char * source_data,int *OUTBUF, int * PCM,int param_k,int param_m,int w_f,int packet_size ,int buf_size, cudaStream_t stream)
 {
-
-    // cudaError_t error;
+    // the data are already being uploaded to OUTBUF in the stream, parity is
+    // computed (including the staircase) on the GPU and downloaded back
     int blocksize = packet_size/sizeof(int);
-    // printf("blocksize: %d\npacket size: %d\n",blocksize,packet_size );
     if(blocksize>256){
         if(blocksize>1024)  blocksize=1024;
-        // puts("big one");
-        frame_encode_int_big <<< param_m, blocksize, packet_size >>> (OUTBUF,PCM, param_k, param_m, w_f, packet_size);
+        frame_encode_int_big <<< param_m, blocksize, packet_size, stream >>> (OUTBUF,PCM, param_k, param_m, w_f, packet_size);
         cuda_check_error("frame_encode_int_big");
-
-        frame_encode_staircase<<< 1, blocksize, packet_size >>> (OUTBUF, PCM, param_k, param_m, w_f, packet_size);
-        cuda_check_error("frame_encode_staircase");
-
-        cudaMemcpy(source_data + param_k*packet_size,OUTBUF + (param_k*packet_size)/4, param_m*packet_size,cudaMemcpyDeviceToHost );
-        // // cudaMemcpy(source_data,OUTBUF, buf_size,cudaMemcpyDeviceToHost );
-        cuda_check_error("memcpy out_buf");
-
-
-        //     gettimeofday(&t0, 0);
-        // for ( int m = 1; m < param_m; ++m)
-        // {
-        //     char *prev_parity = (char *) source_data + (param_k + m - 1) * packet_size;
-        //     char *parity_packet = (char *) source_data + (param_k + m) * packet_size;
-        //     xor_using_sse2(prev_parity, parity_packet, packet_size);
-
-        // }
-        // gettimeofday(&t1, 0);
-        // long elapsed = (t1.tv_sec - t0.tv_sec) * 1000000 + t1.tv_usec - t0.tv_usec;
-        // printf("time staircase: %f\n",elapsed/1000.0 );
-
     }
     else{
-        // puts("chudy soused");
-        frame_encode_int <<< param_m, blocksize, packet_size >>> (OUTBUF,PCM, param_k, param_m, w_f, packet_size);
+        frame_encode_int <<< param_m, blocksize, packet_size, stream >>> (OUTBUF,PCM, param_k, param_m, w_f, packet_size);
         cuda_check_error("frame_encode_int");
-
-        cudaMemcpy(source_data + param_k*packet_size,OUTBUF + (param_k*packet_size)/4, param_m*packet_size,cudaMemcpyDeviceToHost );
-        // cudaMemcpy(source_data,OUTBUF, buf_size,cudaMemcpyDeviceToHost );
-        cuda_check_error("memcpyu out_buf");
-
-        for ( int m = 1; m < param_m; ++m)
-        {
-            char *prev_parity = (char *) source_data + (param_k + m - 1) * packet_size;
-            char *parity_packet = (char *) source_data + (param_k + m) * packet_size;
-            xor_using_sse2(prev_parity, parity_packet, packet_size);
-
-        }
-
     }
 
+    frame_encode_staircase<<< 1, blocksize, packet_size, stream >>> (OUTBUF, PCM, param_k, param_m, w_f, packet_size);
+    cuda_check_error("frame_encode_staircase");
+
+    cudaMemcpyAsync(source_data + param_k*packet_size,OUTBUF + (param_k*packet_size)/4, param_m*packet_size,cudaMemcpyDeviceToHost, stream);
+    cuda_check_error("memcpy out_buf");
 
+    cudaStreamSynchronize(stream);
+    cuda_check_error("cudaStreamSynchronize");
 
     // cudaEvent_t start, stop;
     // float time;
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <cuda_runtime.h> // cudaStream_t
 
 // CUDA check error
 #define cuda_check_error(msg) \
@@ -25,7 +26,7 @@ extern "C" {
 #define CUDA_DLL_API
 #endif
 
-CUDA_DLL_API void gpu_encode_upgrade (char* source_data,int *OUTBUF, int * PCM,int param_k,int param_m,int w_f,int packet_size ,int buf_size);
+CUDA_DLL_API void gpu_encode_upgrade (char* source_data,int *OUTBUF, int * PCM,int param_k,int param_m,int w_f,int packet_size ,int buf_size, cudaStream_t stream);
 
 CUDA_DLL_API void gpu_decode_upgrade(char *data, int * PCM,int* SYNC_VEC,int* ERROR_VEC, int not_done, int *frame_size,int *, int*,int M,int K,int w_f,int buf_size,int packet_size);
 
@@ -16,17 +16,29 @@
  * =====================================================================================
  */
 
+#include <algorithm>
 #include <stdlib.h>
 #include <stdio.h>
 #if defined __SSE2__ || _M_IX86_FP == 2
 #include <emmintrin.h>
 #endif
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#define HAVE_LDGM_AVX2 1
+#endif
+#if defined __aarch64__ && defined __ARM_NEON
+#include <arm_neon.h>
+#endif
 #include <string.h>
 #include <time.h>
 
 #include "ldgm-session-cpu.h"
 #include "timer-util.h"
 
+/// width of a symbol stripe decoded at once (all symbols' stripes of
+/// a frame should fit into L2 cache)
+#define DECODE_STRIPE 512
+
 using namespace std;
 
 #ifdef _WIN32
@@ -134,6 +146,64 @@ xor_using_sse (char* source, char* dest, int packet_size)
     return dest;
 }
 
+#ifdef HAVE_LDGM_AVX2
+__attribute__((target("avx2")))
+static char*
+xor_using_avx2 (char* source, char* dest, int packet_size)
+{
+    int i = 0;
+    for ( ; i + 64 <= packet_size; i += 64) {
+        __m256i s0 = _mm256_loadu_si256((const __m256i *)(void *)(source + i));
+        __m256i s1 = _mm256_loadu_si256((const __m256i *)(void *)(source + i + 32));
+        __m256i d0 = _mm256_loadu_si256((const __m256i *)(void *)(dest + i));
+        __m256i d1 = _mm256_loadu_si256((const __m256i *)(void *)(dest + i + 32));
+        _mm256_storeu_si256((__m256i *)(void *)(dest + i), _mm256_xor_si256(s0, d0));
+        _mm256_storeu_si256((__m256i *)(void *)(dest + i + 32), _mm256_xor_si256(s1, d1));
+    }
+    if ( i < packet_size ) {
+        xor_using_sse(source + i, dest + i, packet_size - i);
+    }
+    return dest;
+}
+#endif // defined HAVE_LDGM_AVX2
+
+#if defined __aarch64__ && defined __ARM_NEON
+static char*
+xor_using_neon (char* source, char* dest, int packet_size)
+{
+    int i = 0;
+    for ( ; i + 16 <= packet_size; i += 16) {
+        uint8x16_t s = vld1q_u8((const uint8_t *)(source + i));
+        uint8x16_t d = vld1q_u8((const uint8_t *)(dest + i));
+        vst1q_u8((uint8_t *)(dest + i), veorq_u8(s, d));
+    }
+    if ( i < packet_size ) {
+        xor_using_sse(source + i, dest + i, packet_size - i);
+    }
+    return dest;
+}
+#endif // defined __aarch64__ && defined __ARM_NEON
+
+typedef char *(*xor_t)(char* source, char* dest, int packet_size);
+
+/// selects the widest XOR supported by the CPU that runs the code
+static xor_t
+select_xor ()
+{
+#ifdef HAVE_LDGM_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return xor_using_avx2;
+    }
+#endif
+#if defined __aarch64__ && defined __ARM_NEON
+    return xor_using_neon;
+#endif
+    return xor_using_sse;
+}
+
+static const xor_t xor_impl = select_xor();
+
 void *
 LDGM_session_cpu::alloc_buf (int buf_size)
 {
@@ -174,7 +244,7 @@ LDGM_session_cpu::encode ( char* data_ptr, char* parity_ptr )
             if (idx > -1 && idx < param_k) {
 //		printf ( "xoring idx: %d\n", idx );
                 char *ptr = data_ptr + idx*packet_size;
-                parity_packet = xor_using_sse(ptr, parity_packet, packet_size);
+                parity_packet = xor_impl(ptr, parity_packet, packet_size);
             }
         }
 
@@ -240,177 +310,121 @@ LDGM_session_cpu::encode_naive ( char* data_ptr, char* parity_ptr )
     return ;
 }		/* -----  end of method LDGM_session_cpu::encode  ----- */
 
-void iterate ( Tanner_graph *g);
+void
+LDGM_session_cpu::build_constraints ()
+{
+    constraints.assign(param_m, vector<int>());
+    for ( int m = 0; m < param_m; ++m) {
+        for ( int k = 0; k < max_row_weight+2; ++k ) {
+            int idx = pcm [ m*(max_row_weight+2) + k];
+            if( idx > -1 ) {
+                constraints[m].push_back(idx);
+            }
+        }
+        // ascending order - the XORed symbols are then read sequentially
+        sort(constraints[m].begin(), constraints[m].end());
+    }
+}
+
+namespace {
+struct decode_stripes_data {
+    char *received;
+    int p_size;
+    const vector<vector<int> > *constraints;
+    const vector<pair<int, int> > *steps;
+};
+
+/**
+ * Executes the recovery schedule on byte stripes <begin*DECODE_STRIPE,
+ * end*DECODE_STRIPE) of all symbols - each stripe is independent and the
+ * symbols' stripes touched by the schedule fit into the cache.
+ */
+void decode_stripes ( void *udata, size_t begin, size_t end )
+{
+    auto *d = (struct decode_stripes_data *) udata;
+    int off = begin * DECODE_STRIPE;
+    int len = min<int>(end * DECODE_STRIPE, d->p_size) - off;
+    for ( auto const &step : *d->steps ) {
+        char *r_data = d->received + step.second * d->p_size + off;
+        memset(r_data, 0, len);
+        for ( int idx : (*d->constraints)[step.first] ) {
+            if ( idx != step.second ) {
+                xor_impl(d->received + idx * d->p_size + off, r_data, len);
+            }
+        }
+    }
+}
+} // end of anonymous namespace
 
 char*
 LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
                                  std::map<int, int> valid_data )
 {
-//    printf ( "buf_size: %d\n", buf_size );
-
     Timer_util interval;
     interval.start();
 
-
-    Tanner_graph graph;
-
     int p_size = buf_size/(param_m+param_k);
     this->packet_size = p_size;
-//    printf ( "p_size %d\n", p_size );
-    graph.set_data_size(p_size);
-
-    //Timer_util timer;
-
-    int i;
-    int index = 0;
-
-
-//    while ( i < (param_k + param_m)*p_size)
-//    {
-//	printf ( "%2d|", (unsigned char)received[i++] );
-//    }
 
-    //one variable node per each data packet in block K
-    for ( i = 0; i < param_k; ++i )
-        graph.add_node(Node::variable_node, index++, received + i*p_size);
-
-    //one variable node per each parity packet in block M
-    for ( i = 0; i < param_m; ++i)
-        graph.add_node(Node::variable_node, index++, received + (i + param_k)*p_size);
-
-    //one constraint node per each row of generation matrix
-    for ( i = 0; i < param_m; ++i)
-        graph.add_node(Node::constraint_node, index++, NULL);
-
-    create_edges(&graph);
-
-//    printf("Graph created in: %.3f s\n", t);
-
-    /*      printf ( "graf\n" );
-     *     for(map<int, Node>::iterator it = graph.nodes.begin(); it != graph.nodes.end(); ++it) {
-     *      Node n = it->second;
-     *      for ( int i = 0; i < p_size; ++i)
-     *          printf("%2d|", *(unsigned char *)(n.getDataPtr() + i));
-     *      printf ( "---\n" );
-     *      }
-     */
-
-    /*      for(map<int, Node>::iterator it = graph.nodes.begin(); it != graph.nodes.end(); ++it) {
-     *      Node n = it->second;
-     *      printf ( "neigbours of %d (count %lu): ", it->first, (it->second).neighbours.size() );
-     *      for(vector<int>::iterator itr = n.neighbours.begin(); itr != n.neighbours.end(); ++itr)
-     *          printf ( "%d ", *itr );
-     *      printf ( "\n" );
-     *     }
-     */
+    if ( constraints.empty() ) {
+        build_constraints();
+    }
 
     //We need to merge intervals in the valid data vector
     map <int, int> merged_intervals;
-    map<int,int>::iterator map_it;
+    for ( auto map_it = valid_data.begin(); map_it != valid_data.end(); ) {
+        int start = map_it->first;
+        int length = map_it->second;
+        while ( ++map_it != valid_data.end() && start + length == map_it->first )
+            length += map_it->second;
+        merged_intervals.insert ( pair<int, int> (start, length) );
+    }
 
-    if ( valid_data.size() != 0 )
-    {
-        for ( map_it = valid_data.begin(); map_it != valid_data.end(); )
-        {
-            int start = map_it->first;
-            int length = map_it->second;
-            while ( start + length == (++map_it)->first )
-                length += map_it->second;
-            merged_intervals.insert ( pair<int, int> (start, length) );
+    //a symbol is done if it is covered by some interval
+    done.assign(param_k + param_m, 0);
+    for ( int i = 0; i < param_k + param_m; ++i ) {
+        int node_offset = i * p_size;
+        auto map_it = merged_intervals.upper_bound(node_offset);
+        if ( map_it != merged_intervals.begin() ) {
+            --map_it;
+            done[i] = map_it->first + map_it->second >= node_offset + p_size;
+        }
+        if ( i < param_k && !done[i] ) {
+            memset(received + node_offset, 0, p_size);
         }
     }
-    /*     printf ( "Valid data: \n" );
-     *     for ( map_it = valid_data.begin(); map_it != valid_data.end(); ++map_it)
-     *     {
-     * 	printf ( "|%d-%d| ", map_it->first, map_it->second );
-     *     }
-     *     printf ( "\n" );
-     *
-     *     printf ( "Merged intervals: \n" );
-     *     for ( map_it = merged_intervals.begin(); map_it != merged_intervals.end(); ++map_it)
-     *     {
-     * 	printf ( "|%d-%d| ", map_it->first, map_it->second );
-     *     }
-     *     printf ( "\n" );
-     *
-     */
-
-
-
-    map<int, Node>::iterator it;
-    if ( merged_intervals.size() != 0)
-    {
-        it = graph.nodes.find(0);
-        while (it != graph.nodes.find(param_k+param_m)) {
-            (*it).second.setDone(false);
-            int node_offset = (*it).second.getDataPtr() - received;
-//	    printf ( "offset: %d\n", node_offset );
-
-            map_it = merged_intervals.begin();
-            //Find the offset in valid data which is equal, or the first offset which is
-            //lower than node offset
-            bool found = false;
-            while ( (map_it->first <= node_offset) && map_it != merged_intervals.end() )
-            {
-                map_it++;
-                found = true;
+
+    //find out which symbols can be recovered and in which order (without
+    //touching the data), the schedule is then executed by stripes
+    steps.clear();
+    int undecoded = count(done.begin(), done.begin() + param_k, 0);
+    for ( int iter = 0; undecoded > 0 && iter < 4; ++iter ) {
+        for ( int c = 0; c < param_m; ++c ) {
+            int missing = -1;
+            int missing_count = 0;
+            for ( int idx : constraints[c] ) {
+                if ( !done[idx] ) {
+                    missing = idx;
+                    missing_count++;
+                }
             }
-            if ( found )
-                map_it--;
-
-            //Next, find out if some interval covers this symbol
-            if ( found && (map_it->first + map_it->second) >=
-                    (node_offset + p_size) )
-            {
-                (*it).second.setDone(true);
-//		printf ( "setting node %d with offset %d and size %d as done\n", it->first,
-//			node_offset, p_size);
+            if ( missing_count == 1 && constraints[c].size() > 1 ) {
+                steps.push_back(pair<int, int>(c, missing));
+                done[missing] = 1;
+                undecoded -= missing < param_k;
             }
-
-            ++it;
         }
     }
 
-    //int not_done = 0;
-    for ( it = graph.nodes.begin(); it != graph.nodes.find(param_k); it++)
-    {
-        if ( !it->second.isDone())
-        {
-            memset(it->second.getDataPtr(), 0, p_size);
-//	    printf ( "resetting node: %d\n", it->first );
-            //not_done++;
+    if ( !steps.empty() ) {
+        struct decode_stripes_data d = { received, p_size, &constraints, &steps };
+        size_t stripe_count = (p_size + DECODE_STRIPE - 1) / DECODE_STRIPE;
+        if ( parallel_for != nullptr ) {
+            parallel_for(stripe_count, 1, decode_stripes, &d);
+        } else {
+            decode_stripes(&d, 0, stripe_count);
         }
     }
-//    printf ( "not done: %d\n", not_done );
-    /*     srand(time(NULL));
-     *     for ( int j = 0; j < 100; j++)
-     *     {
-     * 	it = graph.nodes.find(rand()%(param_k+param_m));
-     * 	(*it).second.setDone(false);
-     *     }
-     */
-    int iter = 0;
-
-    while ( needs_decoding(&graph) && iter < 4) {
-//	printf ( "iteratin\n" );
-        iterate(&graph);
-        iter++;
-    }
-
-//    printf("decoding process: %.3f s\n", t);
-
-    //printf ( "iterations: %d\n", iter );
-
-    int undecoded = 0;
-    it = graph.nodes.find(0);
-    while ( it != graph.nodes.find(param_k) ) {
-        if (!(*it).second.isDone())
-            undecoded++;
-        ++it;
-    }
-//    printf ( "Number of not recovered data packets: %d\n", undecoded );
-
-    //    printf("rest: %.3f s\n", t);
 
     if ( undecoded == 0 )
     {
@@ -425,95 +439,9 @@ LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
     else
         *frame_size = 0;
 
-
     interval.end();
-    //printf("time: %e\n",elapsed/1000.0 );
     this->elapsed_sum2 += interval.elapsed_time_ms();
     this->no_frames2++;
 
-    if(this->no_frames==150){
-        //printf("TIME: %f ms\n",this->elapsed_sum/(double)this->no_frames );
-    }
-
     return received + LDGM_session::HEADER_SIZE;
 }		/* -----  end ofmethod LDGM_session_cpu::decode  ----- */
-
-
-void
-LDGM_session_cpu::iterate ( Tanner_graph *graph )
-{
-    map<int, Node>::iterator it_c;
-    vector<int> vec;
-
-    //static int recovered = 0;
-
-    //select the first constraint node
-    it_c = graph->nodes.find ( param_k + param_m );
-
-    //iterate through constraint nodes
-    while ( it_c != graph->nodes.end() ) {
-        //iterate the node's neighbours to find out how many of them are not decoded
-        map<int, Node>::iterator it_v;
-        for(vector<int>::iterator j = it_c->second.neighbours.begin();
-                j != it_c->second.neighbours.end(); ++j) {
-            it_v = graph->nodes.find(*j);
-            if ( !it_v->second.isDone() )
-                vec.push_back(*j);
-        }
-//	printf ( "node %d has %d undecoded neighbours\n", it_c->first, vec.size() );
-
-        //we can restore the missing packet
-        if ( vec.size() == 1)
-        {
-            int r_index = vec.front();
-
-//	    if ( r_index == 0 )
-//	    {
-//		printf ( "repairing first block\n" );
-//	    }
-            it_v = graph->nodes.find(r_index);
-            memset(it_v->second.getDataPtr(), 0, packet_size);
-            char *r_data = it_v->second.getDataPtr();
-            //find other nodes connected to this constraint node and XOR their values
-            int count = 0;
-            for(vector<int>::iterator j = it_c->second.neighbours.begin();
-                    j != it_c->second.neighbours.end(); ++j)
-            {
-                if ( *j != r_index )
-                {
-//		    printf ( "decode, packet_size: %d\n", packet_size );
-                    char *g_data = (graph->nodes.find(*j))->second.getDataPtr();
-                    //XOR
-                    xor_using_sse(g_data, r_data, packet_size);
-                    count++;
-                }
-            }
-            /*           //validate recovered packet
-             *          for ( int i = 0; i < param_k; ++i) {
-             *              if(!memcmp(r_data, lost_ptr + i*packet_size, packet_size)) {
-             *                  printf ( "packet ok\n" );
-             *                  break;
-             *              }
-             *          }
-             */
-            if ( count > 0 )
-                it_v->second.setDone(true);
-            //recovered++;
-            /*           printf ( "restored data: \n" );
-             *          for ( int  i = 0; i < packet_size; ++i)
-             *              printf ( "%2d|", (unsigned char)(*(it_v->second.getDataPtr() + i)) );
-             *          printf ( "---\n" );
-             */
-
-
-        }
-        vec.clear();
-
-        ++it_c;
-    }
-//    printf ( "recovered: %d\n", recovered );
-
-    return;
-
-}
-
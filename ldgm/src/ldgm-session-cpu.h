@@ -20,9 +20,15 @@
 #ifndef  LDGM_SESSION_CPU_INC
 #define  LDGM_SESSION_CPU_INC
 
+#include <stddef.h>
+#include <vector>
+
 #include "ldgm-session.h"
 //#include "timer-util.h"
 
+/// same signature as task_run_parallel_for() from UltraGrid utils/worker.h
+typedef void (*ldgm_parallel_for_t)(size_t count, size_t grain, void (*body)(void *udata, size_t begin, size_t end), void *udata);
+
 /*
  * =====================================================================================
  *        Class:  LDGM_session_cpu
@@ -52,8 +58,9 @@ class LDGM_session_cpu : public LDGM_session
 	    decode_frame ( char* received_data, int buf_size, int* frame_size,
 		    std::map<int, int> valid_data );
 
+	/// decoding is split to byte stripes of the symbols that are processed by parallel_for (if set)
 	void
-	    iterate ( Tanner_graph *graph);
+	    set_parallel_for ( ldgm_parallel_for_t pf ) { parallel_for = pf; }
 
 	void
 	    free_out_buf (char *buf);
@@ -65,10 +72,19 @@ class LDGM_session_cpu : public LDGM_session
 	/* ====================  DATA MEMBERS  ======================================= */
 
     private:
+	void
+	    build_constraints ();
+
 	/* ====================  DATA MEMBERS  ======================================= */
     double elapsed_sum;
 	long no_frames;
 
+	ldgm_parallel_for_t parallel_for = nullptr;
+	std::vector<std::vector<int> > constraints; ///< sorted variable nodes of each parity equation
+	std::vector<char> done; ///< per variable node (K data + M parity)
+	/// recovery schedule - constraint index and the node recovered by it
+	std::vector<std::pair<int, int> > steps;
+
 }; /* -----  end of class LDGM_session_cpu  ----- */
 
 #endif   /* ----- #ifndef LDGM_SESSION_CPU_INC  ----- */
@@ -55,6 +55,9 @@ LDGM_session_gpu::LDGM_session_gpu() {
 
     OUTBUF_SIZE=0;
     OUTBUF=NULL;
+    cudaStreamCreate(&stream);
+    device_data_offset=-1;
+    device_data_len=0;
 }
 
 LDGM_session_gpu::~LDGM_session_gpu () {
@@ -78,10 +81,19 @@ LDGM_session_gpu::~LDGM_session_gpu () {
 
     cudaFree(ERROR_VEC);
     cudaFree(SYNC_VEC);
+    cudaFree(OUTBUF);
+    cudaStreamDestroy(stream);
 }                           /* destructor       */
 
 void *LDGM_session_gpu::alloc_buf (int buf_size)
 {
+    if (buf_size > OUTBUF_SIZE) {
+        cudaFree(OUTBUF);
+        cudaMalloc((void **) &OUTBUF, buf_size);
+        cuda_check_error("cudaMalloc OUTBUF");
+        OUTBUF_SIZE = buf_size;
+    }
+
     // printf("cudaHostAlloc %d %d\n",this->indexMemoryPool,index);
     // printf("buf_size %d, bufferSize %d\n",buf_size,this->memoryPoolSize[index] );
     while (!freeBuffers.empty()) {
@@ -106,6 +118,30 @@ void *LDGM_session_gpu::alloc_buf (int buf_size)
     return buf;
 }
 
+/**
+ * Buffers are uploaded to OUTBUF as they are being filled by encode_hdr_frame
+ * (the previous encode() synchronized the stream so OUTBUF is free).
+ */
+void LDGM_session_gpu::data_written ( char *out_buf, int offset, int len )
+{
+    if (len <= 0) {
+        return;
+    }
+    assert(offset + len <= OUTBUF_SIZE);
+    cudaMemcpyAsync((char *) OUTBUF + offset, out_buf + offset, len, cudaMemcpyHostToDevice, stream);
+    cuda_check_error("cudaMemcpyAsync H2D");
+}
+
+bool LDGM_session_gpu::copy_device_data ( char * /* out_buf */, int offset, const char *src, int len )
+{
+    assert(offset + len <= OUTBUF_SIZE);
+    cudaMemcpyAsync((char *) OUTBUF + offset, src, len, cudaMemcpyDeviceToDevice, stream);
+    cuda_check_error("cudaMemcpyAsync D2D");
+    device_data_offset = offset;
+    device_data_len = len;
+    return true;
+}
+
 void LDGM_session_gpu::free_out_buf ( char *buf)
 {
     if ( buf != NULL ) {
@@ -122,26 +158,16 @@ void LDGM_session_gpu::encode ( char *source_data, char *parity )
 
     cudaError_t error;
 
-    // error = cudaHostGetDevicePointer( &(out_buf_d), source_data, 0);
-    // cuda_check_error("out_buf_d");
+    // the data were already uploaded to OUTBUF (allocated by alloc_buf) by data_written()
+    assert((int) buf_size <= OUTBUF_SIZE);
 
-    if(OUTBUF==NULL){
-        // puts("cudaMalloc");
-        cudaMalloc((void **) &OUTBUF,buf_size);
-        OUTBUF_SIZE=buf_size;
-    }
-    if((int)buf_size>OUTBUF_SIZE){
-        // puts("cudaMalloc");
-        cudaFree(OUTBUF);
-        cudaMalloc((void **) &OUTBUF,buf_size);
-        OUTBUF_SIZE=buf_size;
+    if (device_data_offset >= 0) { // the frame resides only in OUTBUF
+        cudaMemcpyAsync(source_data + device_data_offset, (char *) OUTBUF + device_data_offset,
+                device_data_len, cudaMemcpyDeviceToHost, stream);
+        cuda_check_error("cudaMemcpyAsync D2H");
+        device_data_offset = -1;
     }
 
-        cudaMemcpy((void *) OUTBUF,source_data,buf_size,cudaMemcpyHostToDevice);
-    cuda_check_error("memcpy OUTBUF");
-
-
-
     if (PCM == NULL)
     {   
         // puts("cudaMalloc");      
@@ -156,7 +182,7 @@ void LDGM_session_gpu::encode ( char *source_data, char *parity )
 
 
 
-    gpu_encode_upgrade(source_data,OUTBUF , PCM, param_k, param_m, w_f, packet_size, buf_size);
+    gpu_encode_upgrade(source_data,OUTBUF , PCM, param_k, param_m, w_f, packet_size, buf_size, stream);
 
     // puts("end");
 
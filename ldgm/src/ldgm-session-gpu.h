@@ -70,6 +70,12 @@ class LDGM_session_gpu : public LDGM_session
 	 void *
 		alloc_buf(int size);
 
+	void
+	    data_written ( char *out_buf, int offset, int len );
+
+	bool
+	    copy_device_data ( char *out_buf, int offset, const char *src, int len );
+
 	char * decode_frame ( char* received_data, int buf_size, int* frame_size, std::map<int, int> valid_data );
 	void set_data_fname(char fname[32]) { strncpy(data_fname, fname, 32); }
 
@@ -84,7 +90,10 @@ class LDGM_session_gpu : public LDGM_session
         std::map<char *, size_t> bufferSizes;
 
 	int OUTBUF_SIZE;
-	int * OUTBUF;
+	int * OUTBUF; ///< device copy of the buffer being encoded
+	struct CUstream_st *stream; ///< cudaStream_t for the encoder transfers and kernels
+	int device_data_offset; ///< frame copied with copy_device_data() to be downloaded, -1 if none
+	int device_data_len;
 
 	int * error_vec;
 	int * sync_vec;
@@ -25,6 +25,8 @@
 #include "ldgm-session.h"
 #include "timer-util.h"
 
+#define COPY_CHUNK_SIZE (4 * 1024 * 1024)
+
 constexpr const int MAX_W = 128;
 
 using namespace std;
@@ -160,6 +162,7 @@ LDGM_session::encode_frame ( char* frame, int frame_size, int* out_buf_size )
     *hdr = frame_size;
 
     memcpy( ((char*)out_buf) + header_size, frame, frame_size);
+    data_written((char *) out_buf, 0, param_k*ps);
 
     //Timer_util t;
     //printf("2buf_size %d\n",buf_size);
@@ -222,7 +225,8 @@ LDGM_session::encode_frame ( char* frame, int frame_size, int* out_buf_size )
 }
 
 char*
-LDGM_session::encode_hdr_frame ( char *my_hdr, int my_hdr_size, char* frame, int frame_size, int* out_buf_size )
+LDGM_session::encode_hdr_frame ( char *my_hdr, int my_hdr_size, char* frame, int frame_size, int* out_buf_size,
+        bool frame_on_device )
 {
     int buf_size;
     int ps;
@@ -249,15 +253,32 @@ LDGM_session::encode_hdr_frame ( char *my_hdr, int my_hdr_size, char* frame, int
         printf ( "Unable to allocate aligned memory\n" );
         return NULL;
     }
-    memset(out_buf, 0, buf_size);
-
-    //Insert frame size and copy input data into buffer
+    //Insert frame size and copy input data into buffer (by chunks so that
+    //the GPU session can upload a chunk while the next one is being copied),
+    //only the padding needs to be zeroed - the parity is overwritten
 
     int32_t *hdr = (int32_t*)out_buf;
     *hdr = overall_size;
 
+    int frame_offset = header_size + my_hdr_size;
     memcpy( ((char*)out_buf) + header_size, my_hdr, my_hdr_size);
-    memcpy( ((char*)out_buf) + header_size + my_hdr_size, frame, frame_size);
+    data_written((char *) out_buf, 0, frame_offset);
+    if (frame_on_device) {
+        if (!copy_device_data((char *) out_buf, frame_offset, frame, frame_size)) {
+            printf ( "Frame in device memory is not supported by this LDGM session\n" );
+            free_out_buf((char *) out_buf);
+            return NULL;
+        }
+    } else {
+        for (int off = 0; off < frame_size; off += COPY_CHUNK_SIZE) {
+            int len = frame_size - off < COPY_CHUNK_SIZE ? frame_size - off : COPY_CHUNK_SIZE;
+            memcpy( ((char*)out_buf) + frame_offset + off, frame + off, len);
+            data_written((char *) out_buf, frame_offset + off, len);
+        }
+    }
+    int padding_offset = frame_offset + frame_size;
+    memset(((char*)out_buf) + padding_offset, 0, param_k*ps - padding_offset);
+    data_written((char *) out_buf, padding_offset, param_k*ps - padding_offset);
 
 #if 0
     int my_frame_size=my_hdr_size+frame_size;
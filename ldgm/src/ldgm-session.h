@@ -72,8 +72,10 @@ class LDGM_session : public Coding_session
 	char*
 	    encode_frame ( char* frame, int frame_size, int* out_buf_size );
 
+	/// @param frame_on_device  frame is in the CUDA device memory (supported only by the GPU session)
 	char*
-	    encode_hdr_frame( char *hdr, int hdr_size, char* frame, int frame_size, int* out_buf_size );
+	    encode_hdr_frame( char *hdr, int hdr_size, char* frame, int frame_size, int* out_buf_size,
+		    bool frame_on_device = false );
 
 	virtual void
 	    encode ( char* data, char* parity ) = 0;
@@ -101,6 +103,16 @@ class LDGM_session : public Coding_session
 
         virtual void
             free_out_buf (char *buf) = 0;
+
+	/// called when bytes <offset, offset+len) of out_buf have been filled
+	/// (before encode()), the GPU session starts uploading them
+	virtual void
+	    data_written ( char * /* out_buf */, int /* offset */, int /* len */ ) {}
+
+	/// copies frame residing in the device memory to out_buf
+	/// @retval false if not supported
+	virtual bool
+	    copy_device_data ( char * /* out_buf */, int /* offset */, const char * /* src */, int /* len */ ) { return false; }
 		    
 
     protected:
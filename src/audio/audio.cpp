@@ -91,6 +91,7 @@
 #include "pdb.h"
 #include "ug_runtime_error.hpp"
 #include "utils/color_out.h"
+#include "utils/macros.h"
 #include "utils/net.h"
 #include "utils/sdp.h"
 #include "utils/thread.h"
@@ -288,16 +289,17 @@ int audio_init(struct state_audio **ret, struct module *parent,
         s->exporter = exporter;
 
         if (opt->echo_cancellation) {
-#ifdef HAVE_SPEEXDSP
-                s->echo_state = echo_cancellation_init();
-                fprintf(stderr, "Echo cancellation is currently experimental "
-                                "and may not work as expected.");
-                goto error;
+#if defined HAVE_SPEEXDSP || defined HAVE_WEBRTC_AEC
+                s->echo_state = echo_cancellation_init(parent);
+                if (s->echo_state == nullptr) {
+                        goto error;
+                }
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Echo cancellation is currently experimental "
+                                "and may not work as expected.\n");
 #else
-                fprintf(stderr, "Speex not compiled in. Could not enable echo cancellation.\n");
-                delete s;
+                fprintf(stderr, "Neither Speex nor WebRTC audio processing compiled in. Could not enable echo cancellation.\n");
                 goto error;
-#endif /* HAVE_SPEEXDSP */
+#endif /* defined HAVE_SPEEXDSP || defined HAVE_WEBRTC_AEC */
         } else {
                 s->echo_state = NULL;
         }
@@ -374,9 +376,6 @@ int audio_init(struct state_audio **ret, struct module *parent,
                         retval = ret;
                         goto error;
                 }
-                size_t len = sizeof(struct rtp *);
-                audio_playback_ctl(s->audio_playback_device, AUDIO_PLAYBACK_PUT_NETWORK_DEVICE,
-                                        &s->audio_network_device, &len);
 
                 s->audio_tx_mode |= MODE_RECEIVER;
         } else {
@@ -391,6 +390,11 @@ int audio_init(struct state_audio **ret, struct module *parent,
                         goto error;
                 }
         }
+        if ((s->audio_tx_mode & MODE_RECEIVER) != 0U) { // network device must exist already
+                size_t len = sizeof(struct rtp *);
+                audio_playback_ctl(s->audio_playback_device, AUDIO_PLAYBACK_PUT_NETWORK_DEVICE,
+                                        &s->audio_network_device, &len);
+        }
 
         if ((s->audio_tx_mode & MODE_SENDER) && strcasecmp(opt->proto, "sdp") == 0) {
                 if (sdp_add_audio(rtp_is_ipv6(s->audio_network_device), opt->send_port, IF_NOT_NULL_ELSE(get_audio_codec_sample_rate(opt->codec_cfg), 48000),
@@ -445,6 +449,9 @@ error:
         }
 
         audio_codec_done(s->audio_encoder);
+#if defined HAVE_SPEEXDSP || defined HAVE_WEBRTC_AEC
+        echo_cancellation_destroy(s->echo_state);
+#endif
         delete s;
         return retval;
 }
@@ -528,6 +535,9 @@ void audio_done(struct state_audio *s)
         free(s->audio_network_parameters.mcast_if);
 
         audio_codec_done(s->audio_encoder);
+#if defined HAVE_SPEEXDSP || defined HAVE_WEBRTC_AEC
+        echo_cancellation_destroy(s->echo_state);
+#endif
 
         delete s;
 }
@@ -669,10 +679,43 @@ static void audio_update_recv_buf(struct state_audio *s, size_t curr_frame_len)
         }
 }
 
+#define ADAPTIVE_MIN_DELAY_MS 5
+#define ADAPTIVE_MAX_DELAY_MS 200
+ADD_TO_PARAM("audio-jitter-buffer", "* audio-jitter-buffer=fixed|<min_ms>:<max_ms>\n"
+                "  Audio playout delay follows the network jitter within the bounds (default " TOSTRING(ADAPTIVE_MIN_DELAY_MS) ":" TOSTRING(ADAPTIVE_MAX_DELAY_MS) " ms,\n"
+                "  min. 1 ms for low-latency-audio=ultra), \"fixed\" uses static playout delay\n");
+
+/**
+ * Sets up the playout delay of a participant - adaptive for the UltraGrid
+ * native transport (90 kHz RTP TS), fixed otherwise or if requested.
+ */
+static void audio_set_playout_delay(struct pbuf *playout_buffer, bool native)
+{
+        const char *low_latency = get_commandline_param("low-latency-audio");
+        if (low_latency != nullptr) {
+                pbuf_set_playout_delay(playout_buffer, strcmp(low_latency, "ultra") == 0 ? 0.001 :0.005);
+        }
+        const char *cfg = get_commandline_param("audio-jitter-buffer");
+        if (!native || (cfg != nullptr && strcmp(cfg, "fixed") == 0)) {
+                return;
+        }
+        double min_ms = low_latency != nullptr && strcmp(low_latency, "ultra") == 0 ? 1 : ADAPTIVE_MIN_DELAY_MS;
+        double max_ms = ADAPTIVE_MAX_DELAY_MS;
+        if (cfg != nullptr) {
+                min_ms = atof(cfg);
+                if (strchr(cfg, ':') != nullptr) {
+                        max_ms = atof(strchr(cfg, ':') + 1);
+                }
+        }
+        pbuf_set_adaptive_delay(playout_buffer, 90000, min_ms / 1000, max_ms / 1000);
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Adaptive playout delay " << min_ms << "-" << max_ms << " ms\n";
+}
+
 static void *audio_receiver_thread(void *arg)
 {
         set_thread_name(__func__);
         struct state_audio *s = (struct state_audio *) arg;
+        module_set_mem_owner(s->audio_receiver_module.get());
         // rtp variables
         struct pdb_e *cp;
         struct audio_desc device_desc{};
@@ -731,9 +774,7 @@ static void *audio_receiver_thread(void *arg)
                                                 pdb_iter_done(&it);
                                         }
 
-                                        if (get_commandline_param("low-latency-audio")) {
-                                                pbuf_set_playout_delay(cp->playout_buffer, strcmp(get_commandline_param("low-latency-audio"), "ultra") == 0 ? 0.001 :0.005);
-                                        }
+                                        audio_set_playout_delay(cp->playout_buffer, s->receiver == NET_NATIVE);
                                         cp->decoder_state = audio_decoder_state_create(s);
                                         if (!cp->decoder_state) {
                                                 exit_uv(1);
@@ -800,7 +841,7 @@ static void *audio_receiver_thread(void *arg)
                         audio_update_recv_buf(s, current_pbuf->frame_size);
 
                         if(s->echo_state) {
-#ifdef HAVE_SPEEXDSP
+#if defined HAVE_SPEEXDSP || defined HAVE_WEBRTC_AEC
                                 echo_play(s->echo_state, &current_pbuf->buffer);
 #endif
                         }
@@ -828,6 +869,7 @@ static void *audio_receiver_thread(void *arg)
         free(jack_pbuf.buffer.data);
 #endif
 
+        module_set_mem_owner(NULL);
         return NULL;
 }
 
@@ -938,6 +980,9 @@ static struct response *audio_sender_process_message(struct state_audio *s, stru
                                 }
                         }
                         break;
+                case SENDER_MSG_ADD_CLIENT:
+                case SENDER_MSG_REMOVE_CLIENT:
+                        return new_response(RESPONSE_NOT_IMPL, NULL);
         }
         return new_response(RESPONSE_OK, NULL);
 }
@@ -1032,6 +1077,7 @@ static void *audio_sender_thread(void *arg)
                 exit_uv(1);
                 return NULL;
         }
+        module_set_mem_owner(s->audio_sender_module.get());
 
         printf("Audio sending started.\n");
 
@@ -1058,7 +1104,7 @@ static void *audio_sender_thread(void *arg)
                 buffer = audio_capture_read(s->audio_capture_device);
                 if(buffer) {
                         if(s->echo_state) {
-#ifdef HAVE_SPEEXDSP
+#if defined HAVE_SPEEXDSP || defined HAVE_WEBRTC_AEC
                                 buffer = echo_cancel(s->echo_state, buffer);
                                 if(!buffer)
                                         continue;
@@ -1120,6 +1166,7 @@ static void *audio_sender_thread(void *arg)
                 }
         }
 
+        module_set_mem_owner(NULL);
         return NULL;
 }
 
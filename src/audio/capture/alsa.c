@@ -70,6 +70,7 @@
 struct state_alsa_capture {
         snd_pcm_t *handle;
         struct audio_frame frame;
+        char *data_buf; ///< owned frame buffer, frame.data may point to the mmap area instead
         char *tmp_data;
 
         snd_pcm_uframes_t frames;
@@ -79,6 +80,9 @@ struct state_alsa_capture {
         long long int captured_samples;
 
         bool non_interleaved;
+        bool mmap;
+        snd_pcm_uframes_t mmap_offset;
+        snd_pcm_uframes_t mmap_pending; ///< frames of the mmap area lent in frame.data, committed by next read
 };
 
 static void audio_cap_alsa_probe(struct device_info **available_devices, int *count, void (**deleter)(void *))
@@ -99,6 +103,7 @@ static void audio_cap_alsa_help(void)
         color_printf(TERM_BOLD "\t-s alsa:opts=<opts>\n\n" TERM_RESET);
         color_printf(TERM_BOLD "\t<opts>" TERM_RESET " can be in format key1=value1:key2=value2, options are:\n");
         color_printf(TERM_BOLD "\t\tframes=<frames>" TERM_RESET " number of audio frames captured at a moment\n");
+        color_printf(TERM_BOLD "\t\tmmap" TERM_RESET " read directly from the mmapped device buffer (interleaved only)\n");
 
         printf("\nAvailable ALSA capture devices\n");
         audio_alsa_list_devices();
@@ -154,6 +159,8 @@ static void * audio_cap_alsa_init(struct module *parent, const char *cfg)
                 while ((item = strtok_r(opts, ":", &save_ptr)) != NULL) {
                         if (strncmp(item, "frames=", strlen("frames=")) == 0) {
                                 s->frames = atoi(item + strlen("frames="));
+                        } else if (strcmp(item, "mmap") == 0) {
+                                s->mmap = true;
                         } else {
                                 fprintf(stderr, "[ALSA cap.] Unknown option: %s\n", item);
                                 goto error;
@@ -228,10 +235,16 @@ static void * audio_cap_alsa_init(struct module *parent, const char *cfg)
 
         }
 
+        if (s->mmap && (s->non_interleaved ||
+                                snd_pcm_hw_params_test_access(s->handle, params, SND_PCM_ACCESS_MMAP_INTERLEAVED) != 0)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Interleaved mmap access not supported by the device, using read access.\n");
+                s->mmap = false;
+        }
+
         /* Set the desired hardware parameters. */
 
         /* Access mode */
-        rc = snd_pcm_hw_params_set_access(s->handle, params,
+        rc = snd_pcm_hw_params_set_access(s->handle, params, s->mmap ? SND_PCM_ACCESS_MMAP_INTERLEAVED :
                 s->non_interleaved ? SND_PCM_ACCESS_RW_NONINTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED);
         if (rc < 0) {
                 fprintf(stderr, MOD_NAME "unable to set interleaved mode: %s\n",
@@ -305,7 +318,7 @@ static void * audio_cap_alsa_init(struct module *parent, const char *cfg)
         /* Use a buffer large enough to hold one period */
         snd_pcm_hw_params_get_period_size(params, &s->frames, &dir);
         s->frame.max_size = s->frames  * s->frame.ch_count * s->frame.bps;
-        s->frame.data = (char *) malloc(s->frame.max_size);
+        s->frame.data = s->data_buf = (char *) malloc(s->frame.max_size);
 
         s->tmp_data = malloc(s->frames  * s->min_device_channels * s->frame.bps);
 
@@ -323,6 +336,78 @@ error:
         return NULL;
 }
 
+/**
+ * Reads one period from the mmap area. If no conversion is needed, the frame
+ * data points directly to the area that is then committed by the next call.
+ * Otherwise the converted samples are written to the frame buffer.
+ *
+ * @returns number of frames read or a negative error code
+ */
+static snd_pcm_sframes_t read_mmap(struct state_alsa_capture *s)
+{
+        if (s->mmap_pending > 0) {
+                snd_pcm_uframes_t pending = s->mmap_pending;
+                s->mmap_pending = 0;
+                s->frame.data = s->data_buf;
+                snd_pcm_sframes_t rc = snd_pcm_mmap_commit(s->handle, s->mmap_offset, pending);
+                if (rc < 0) {
+                        return rc;
+                }
+                if ((snd_pcm_uframes_t) rc != pending) {
+                        return -EPIPE;
+                }
+        }
+        if (snd_pcm_state(s->handle) == SND_PCM_STATE_PREPARED) {
+                int rc = snd_pcm_start(s->handle);
+                if (rc < 0) {
+                        return rc;
+                }
+        }
+
+        snd_pcm_sframes_t avail;
+        while ((avail = snd_pcm_avail_update(s->handle)) < (snd_pcm_sframes_t) s->frames) {
+                if (avail < 0) {
+                        return avail;
+                }
+                int rc = snd_pcm_wait(s->handle, 1000);
+                if (rc <= 0) {
+                        return rc == 0 ? -EAGAIN : rc;
+                }
+        }
+
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t frames = s->frames;
+        int rc = snd_pcm_mmap_begin(s->handle, &areas, &offset, &frames);
+        if (rc < 0) {
+                return rc;
+        }
+        char *src = (char *) areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+        const bool demux = (int) s->min_device_channels > s->frame.ch_count && s->frame.ch_count == 1;
+
+        if (!demux && s->frame.bps != 1) {
+                s->frame.data = src;
+                s->mmap_offset = offset;
+                s->mmap_pending = frames;
+                return frames;
+        }
+
+        int data_len = frames * s->frame.bps * s->frame.ch_count;
+        if (demux) {
+                demux_channel(s->data_buf, src, s->frame.bps, frames * s->frame.bps * s->min_device_channels,
+                                s->min_device_channels, 0);
+                src = s->data_buf;
+        }
+        if (s->frame.bps == 1) {
+                signed2unsigned(s->data_buf, src, data_len);
+        }
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit(s->handle, offset, frames);
+        if (committed < 0) {
+                return committed;
+        }
+        return (snd_pcm_uframes_t) committed == frames ? (snd_pcm_sframes_t) frames : -EPIPE;
+}
+
 static struct audio_frame *audio_cap_alsa_read(void *state)
 {
         struct state_alsa_capture *s = (struct state_alsa_capture *) state;
@@ -335,7 +420,9 @@ static struct audio_frame *audio_cap_alsa_read(void *state)
                 read_ptr[0] = s->tmp_data;
         }
 
-        if (s->non_interleaved) {
+        if (s->mmap) {
+                rc = read_mmap(s);
+        } else if (s->non_interleaved) {
                 assert(s->frame.ch_count == 1);
                 discard_data = (char *) alloca(s->frames * s->frame.bps * (s->min_device_channels-1));
                 for (unsigned int i = 1; i < s->min_device_channels; ++i) {
@@ -348,6 +435,7 @@ static struct audio_frame *audio_cap_alsa_read(void *state)
         if (rc == -EPIPE) {
                 /* EPIPE means overrun */
                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "overrun occurred\n");
+                s->mmap_pending = 0;
                 snd_pcm_prepare(s->handle);
         } else if (rc < 0) {
 		log_msg(LOG_LEVEL_WARNING, MOD_NAME "error from read: %s\n", snd_strerror(rc));
@@ -360,7 +448,11 @@ static struct audio_frame *audio_cap_alsa_read(void *state)
                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "short read, read %d frames\n", rc);
         }
 
-        if(rc > 0) {
+        if (rc > 0 && s->mmap) { // already converted
+                s->frame.data_len = rc * s->frame.bps * s->frame.ch_count;
+                s->captured_samples += rc;
+                return &s->frame;
+        } else if (rc > 0) {
                 if ((int) s->min_device_channels > s->frame.ch_count && s->frame.ch_count == 1) {
                         demux_channel(s->frame.data, (char *) s->tmp_data, s->frame.bps,
                                         rc * s->frame.bps * s->min_device_channels,
@@ -391,7 +483,7 @@ static void audio_cap_alsa_done(void *state)
                         s->captured_samples / tv_diff(t, s->start_time));
         snd_pcm_drop(s->handle);
         snd_pcm_close(s->handle);
-        free(s->frame.data);
+        free(s->data_buf);
         free(s->tmp_data);
         free(s);
 }
@@ -56,6 +56,7 @@
 #include "utils/macros.h"
 
 #include <jack/jack.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -69,10 +70,10 @@ struct state_jack_capture {
         struct audio_frame frame;
         jack_client_t *client;
         jack_port_t *input_ports[MAX_PORTS];
-        char *tmp;
 
         sem_t data_sem;
         struct ring_buffer *data;
+        atomic_int overflows; ///< counted by the process callback, reported by read
         bool can_process;
         bool should_exit;
 
@@ -88,22 +89,45 @@ static int jack_samplerate_changed_callback(jack_nframes_t nframes, void *arg)
         return 0;
 }
 
+/**
+ * Real-time thread - must not block, allocate or log. The port buffers are
+ * interleaved directly into the write regions of the lock-free ring, the
+ * conversion to integers is done by the reader.
+ */
 static int jack_process_callback(jack_nframes_t nframes, void *arg)
 {
         struct state_jack_capture *s = (struct state_jack_capture *) arg;
-        int i;
-        int channel_size = nframes * sizeof(int32_t);
+        const int frame_size = s->frame.ch_count * sizeof(float);
+        const int len = nframes * frame_size;
 
         if (!s->can_process) {
                 return 0;
         }
 
-        for (i = 0; i < s->frame.ch_count; ++i) {
-                jack_default_audio_sample_t *in = s->libjack->port_get_buffer(s->input_ports[i], nframes);
-                mux_channel(s->tmp, (char *) in, sizeof(int32_t), channel_size, s->frame.ch_count, i, 1.0);
+        if (ring_get_available_write_size(s->data) < len) {
+                atomic_fetch_add_explicit(&s->overflows, 1, memory_order_relaxed);
+                return 0;
+        }
+
+        const char *in[MAX_PORTS];
+        for (int i = 0; i < s->frame.ch_count; ++i) {
+                in[i] = s->libjack->port_get_buffer(s->input_ports[i], nframes);
         }
 
-        ring_buffer_write(s->data, s->tmp, channel_size * s->frame.ch_count);
+        // regions are split at a frame boundary - the ring holds whole frames
+        void *ptr1;
+        int size1;
+        void *ptr2;
+        int size2;
+        ring_get_write_regions(s->data, len, &ptr1, &size1, &ptr2, &size2);
+        planar2interleaved(ptr1, in, sizeof(float), size1 / frame_size, s->frame.ch_count);
+        if (ptr2 != NULL) {
+                for (int i = 0; i < s->frame.ch_count; ++i) {
+                        in[i] += size1 / s->frame.ch_count;
+                }
+                planar2interleaved(ptr2, in, sizeof(float), size2 / frame_size, s->frame.ch_count);
+        }
+        ring_advance_write_idx(s->data, len);
         platform_sem_post(&s->data_sem);
 
         return 0;
@@ -234,8 +258,6 @@ static void * audio_cap_jack_init(struct module *parent, const char *cfg)
 
         platform_sem_init(&s->data_sem, 0, 0);
 
-        s->tmp = malloc(s->frame.max_size);
-
         s->data = ring_buffer_init(s->frame.max_size);
         
         if (s->libjack->set_sample_rate_callback(s->client, jack_samplerate_changed_callback, (void *) s)) {
@@ -289,6 +311,11 @@ static struct audio_frame *audio_cap_jack_read(void *state)
 
         platform_sem_wait(&s->data_sem);
 
+        int overflows = atomic_exchange_explicit(&s->overflows, 0, memory_order_relaxed);
+        if (overflows > 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Ring buffer overflow, dropped %d periods.\n", overflows);
+        }
+
         int read_avail = ring_get_current_size(s->data);
         s->frame.data_len = ring_buffer_read(s->data, s->frame.data, s->frame.max_size);
         if(read_avail > s->frame.data_len){
@@ -311,7 +338,6 @@ static void audio_cap_jack_done(void *state)
         struct state_jack_capture *s = (struct state_jack_capture *) state;
 
         s->libjack->client_close(s->client);
-        free(s->tmp);
         ring_buffer_destroy(s->data);
         free(s->frame.data);
         platform_sem_destroy(&s->data_sem);
@@ -45,6 +45,7 @@
 #include "audio/utils.h"
 #include "debug.h"
 #include "utils/misc.h"
+#include "utils/worker.h"
 
 #include "lib_common.h"
 #include "rang.hpp"
@@ -75,9 +76,15 @@ static const unordered_map<audio_codec_t, audio_codec_info_t, hash<int>> audio_c
 static struct audio_codec_state *audio_codec_init_real(const char *audio_codec_cfg,
                 audio_codec_direction_t direction, bool try_init);
 
+/// codecs with at least this number of channels are (de)compressed in parallel
+#define PARALLEL_MIN_CHANNELS 2
+
 struct audio_codec_state {
         void **state;
         int state_count;
+        audio_channel *in;   ///< per-channel input of the current frame (state_count items)
+        audio_channel **out; ///< per-channel output of the current frame (state_count items)
+        bool flush;          ///< compress called without a frame
         const struct audio_compress_info *funcs;
         audio_desc desc;
         audio_codec_direction_t direction;
@@ -176,6 +183,8 @@ static struct audio_codec_state *audio_codec_init_real(const char *audio_codec_c
         s->state = (void **) calloc(1, sizeof(void*));
         s->state[0] = state;
         s->state_count = 1;
+        s->in = (audio_channel *) calloc(1, sizeof(audio_channel));
+        s->out = (audio_channel **) calloc(1, sizeof(audio_channel *));
         s->funcs = aci;
         s->desc.codec = audio_codec;
         s->direction = direction;
@@ -194,6 +203,56 @@ struct audio_codec_state *audio_codec_reconfigure(struct audio_codec_state *old,
         return audio_codec_init(audio_codec, direction);
 }
 
+/// ensures that there is a codec state for each of ch_count channels
+static bool audio_codec_ensure_states(struct audio_codec_state *s, int ch_count, int bitrate)
+{
+        if (s->state_count >= ch_count) {
+                return true;
+        }
+        s->state = (void **) realloc(s->state, sizeof(void *) * ch_count);
+        s->in = (audio_channel *) realloc(s->in, sizeof(audio_channel) * ch_count);
+        s->out = (audio_channel **) realloc(s->out, sizeof(audio_channel *) * ch_count);
+        for (int i = s->state_count; i < ch_count; ++i) {
+                s->state[i] = s->funcs->init(s->desc.codec, s->direction, false, bitrate);
+                if (s->state[i] == nullptr) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Error: initialization of audio codec failed!\n";
+                        s->state_count = i;
+                        return false;
+                }
+        }
+        s->state_count = ch_count;
+        return true;
+}
+
+static void compress_channels(void *udata, size_t begin, size_t end)
+{
+        auto *s = static_cast<struct audio_codec_state *>(udata);
+        for (size_t i = begin; i < end; ++i) {
+                s->out[i] = s->funcs->compress(s->state[i], s->flush ? nullptr : &s->in[i]);
+        }
+}
+
+static void decompress_channels(void *udata, size_t begin, size_t end)
+{
+        auto *s = static_cast<struct audio_codec_state *>(udata);
+        for (size_t i = begin; i < end; ++i) {
+                s->out[i] = s->funcs->decompress(s->state[i], &s->in[i]);
+        }
+}
+
+/**
+ * Runs body over all channels - the codec states are independent, so the
+ * channels are processed in parallel if there are more of them.
+ */
+static void audio_codec_run_channels(struct audio_codec_state *s, int ch_count, parallel_for_body_t body)
+{
+        if (ch_count >= PARALLEL_MIN_CHANNELS && s->desc.codec != AC_PCM) {
+                task_run_parallel_for(ch_count, 1, body, s);
+        } else {
+                body(s, 0, ch_count);
+        }
+}
+
 /**
  * Audio_codec_compress compresses given audio frame.
  *
@@ -207,16 +266,8 @@ struct audio_codec_state *audio_codec_reconfigure(struct audio_codec_state *old,
 audio_frame2 audio_codec_compress(struct audio_codec_state *s, const audio_frame2 *frame)
 {
         if (frame != nullptr) {
-                if (s->state_count < frame->get_channel_count()) {
-                        s->state = (void **) realloc(s->state, sizeof(void *) * frame->get_channel_count());
-                        for (int i = s->state_count; i < frame->get_channel_count(); ++i) {
-                                s->state[i] = s->funcs->init(s->desc.codec, s->direction, false, s->bitrate);
-                                if (s->state[i] == nullptr) {
-                                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Error: initialization of audio codec failed!\n";
-                                        return {};
-                                }
-                        }
-                        s->state_count = frame->get_channel_count();
+                if (!audio_codec_ensure_states(s, frame->get_channel_count(), s->bitrate)) {
+                        return {};
                 }
 
                 s->desc.ch_count = frame->get_channel_count();
@@ -226,15 +277,15 @@ audio_frame2 audio_codec_compress(struct audio_codec_state *s, const audio_frame
 
         audio_frame2 res;
 
-        audio_channel channel;
+        s->flush = frame == nullptr;
+        for (int i = 0; frame != nullptr && i < s->desc.ch_count; ++i) {
+                audio_channel_demux(frame, i, &s->in[i]);
+        }
+        audio_codec_run_channels(s, s->desc.ch_count, compress_channels);
+
         int nonzero_channels = 0;
         for (int i = 0; i < s->desc.ch_count; ++i) {
-                audio_channel *encode_channel = NULL;
-                if(frame) {
-                        audio_channel_demux(frame, i, &channel);
-                        encode_channel = &channel;
-                }
-                audio_channel *out = s->funcs->compress(s->state[i], encode_channel);
+                audio_channel *out = s->out[i];
                 if (out == nullptr) {
                         continue;
                 }
@@ -257,16 +308,8 @@ audio_frame2 audio_codec_compress(struct audio_codec_state *s, const audio_frame
 
 audio_frame2 audio_codec_decompress(struct audio_codec_state *s, audio_frame2 *frame)
 {
-        if (s->state_count < frame->get_channel_count()) {
-                s->state = (void **) realloc(s->state, sizeof(void *) * frame->get_channel_count());
-                for(int i = s->state_count; i < frame->get_channel_count(); ++i) {
-                        s->state[i] = s->funcs->init(s->desc.codec, s->direction, false, 0);
-                        if(s->state[i] == NULL) {
-                                        fprintf(stderr, "Error: initialization of audio codec failed!\n");
-                                        return {};
-                        }
-                }
-                s->state_count = frame->get_channel_count();
+        if (!audio_codec_ensure_states(s, frame->get_channel_count(), 0)) {
+                return {};
         }
 
 #if 0
@@ -276,12 +319,15 @@ audio_frame2 audio_codec_decompress(struct audio_codec_state *s, audio_frame2 *f
 #endif
 
         audio_frame2 ret;
-        audio_channel channel;
+        for (int i = 0; i < frame->get_channel_count(); ++i) {
+                audio_channel_demux(frame, i, &s->in[i]);
+        }
+        audio_codec_run_channels(s, frame->get_channel_count(), decompress_channels);
+
         int nonzero_channels = 0;
         bool out_frame_initialized = false;
         for (int i = 0; i < frame->get_channel_count(); ++i) {
-                audio_channel_demux(frame, i, &channel);
-                audio_channel *out = s->funcs->decompress(s->state[i], &channel);
+                audio_channel *out = s->out[i];
                 if (out) {
                         if (!out_frame_initialized) {
                                 ret.init(frame->get_channel_count(), AC_PCM, out->bps, out->sample_rate);
@@ -328,6 +374,8 @@ void audio_codec_done(struct audio_codec_state *s)
                 s->funcs->done(s->state[i]);
         }
         free(s->state);
+        free(s->in);
+        free(s->out);
 
         free(s);
 }
@@ -4,7 +4,7 @@
  * @author Martin Piatka    <piatka@cesnet.cz>
  */
 /*
- * Copyright (c) 2012-2021 CESNET z.s.p.o.
+ * Copyright (c) 2012-2026 CESNET z.s.p.o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -44,21 +44,37 @@
 
 #include "audio/utils.h"
 #include "audio/export.h"
+#include "control_socket.h"
 #include "debug.h"
 #include "echo.h"
 
+#ifdef HAVE_SPEEXDSP
 #include <speex/speex_echo.h>
+#endif
+#ifdef HAVE_WEBRTC_AEC
+#include <modules/audio_processing/include/audio_processing.h>
+#endif
 
 #include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <mutex>
 #include <memory>
 #include <algorithm>
 #include <chrono>
+#include <thread>
+#include <vector>
 #include "utils/ring_buffer.h"
+#include "utils/thread.h"
 #include "host.h"
+#include "module.h"
 
-#define SAMPLES_PER_FRAME (1 << 9) //512, about 10ms at 48kHz, power of two for easy FFT
+#define SPEEX_SAMPLES_PER_FRAME (1 << 9) //512, about 10ms at 48kHz, power of two for easy FFT
 #define DEFAULT_FILTER_LENGTH (48 * 500)
+#define DEFAULT_BUDGET_US 2000
+#define RINGBUF_SAMPLES (2 << 15)
 
 #define MOD_NAME "[Echo cancel] "
 
@@ -71,50 +87,119 @@ namespace {
                 void operator()(ring_buffer_t* ring) { ring_buffer_destroy(ring); }
         };
 
+        struct Export_state_deleter{
+                void operator()(struct audio_export* e) { audio_export_destroy(e); }
+        };
+
+        /// echo canceller processing mono 16-bit frames of a fixed size
+        struct echo_backend {
+                virtual ~echo_backend() = default;
+                /// @returns frame size in samples
+                virtual int configure(int sample_rate) = 0;
+                virtual void process(const int16_t *near, const int16_t *far, int16_t *out) = 0;
+        };
+
+#ifdef HAVE_SPEEXDSP
         struct Echo_state_deleter{
                 void operator()(SpeexEchoState* echo) { speex_echo_state_destroy(echo); }
         };
 
-        struct Export_state_deleter{
-                void operator()(struct audio_export* e) { audio_export_destroy(e); }
+        struct speex_backend final : public echo_backend {
+                explicit speex_backend(int filter_length)
+                        : echo_state(speex_echo_state_init(SPEEX_SAMPLES_PER_FRAME, filter_length)) {}
+                int configure(int sample_rate) override {
+                        speex_echo_ctl(echo_state.get(), SPEEX_ECHO_SET_SAMPLING_RATE, &sample_rate); // should the 3rd parameter be int?
+                        return SPEEX_SAMPLES_PER_FRAME;
+                }
+                void process(const int16_t *near, const int16_t *far, int16_t *out) override {
+                        speex_echo_cancellation(echo_state.get(), near, far, out);
+                }
+                std::unique_ptr<SpeexEchoState, Echo_state_deleter> echo_state;
+        };
+#endif
+
+#ifdef HAVE_WEBRTC_AEC
+        /// WebRTC audio processing module (AEC3), estimates the far end delay itself
+        struct webrtc_backend final : public echo_backend {
+                webrtc_backend() : apm(webrtc::AudioProcessingBuilder().Create()) {
+                        webrtc::AudioProcessing::Config config;
+                        config.echo_canceller.enabled = true;
+                        config.echo_canceller.mobile_mode = false;
+                        config.high_pass_filter.enabled = true;
+                        apm->ApplyConfig(config);
+                }
+                int configure(int sample_rate) override {
+                        stream = webrtc::StreamConfig(sample_rate, 1);
+                        apm->Initialize();
+                        reverse_out.resize(sample_rate / 100);
+                        return sample_rate / 100; // APM processes 10 ms chunks
+                }
+                void process(const int16_t *near, const int16_t *far, int16_t *out) override {
+                        apm->ProcessReverseStream(far, stream, stream, reverse_out.data());
+                        apm->set_stream_delay_ms(0);
+                        apm->ProcessStream(near, stream, stream, out);
+                }
+                rtc::scoped_refptr<webrtc::AudioProcessing> apm;
+                webrtc::StreamConfig stream;
+                std::vector<int16_t> reverse_out;
         };
+#endif
 }
 
+/**
+ * The cancellation itself runs in a dedicated (real-time priority if
+ * permitted) thread. Captured (near end) and played (far end) samples are
+ * passed to it through SPSC ring buffers, processed samples are returned the
+ * same way. echo_cancel() waits for the processing of the just submitted
+ * samples at most for the budget, so a processing hiccup delays the audio
+ * by a bounded time and the output is then sent with the next capture.
+ */
 struct echo_cancellation {
-        std::unique_ptr<SpeexEchoState, Echo_state_deleter> echo_state;
+        std::unique_ptr<echo_backend> backend;
 
-        std::unique_ptr<ring_buffer_t, Ring_buf_deleter> near_end_ringbuf;
-        std::unique_ptr<ring_buffer_t, Ring_buf_deleter> far_end_ringbuf;
+        std::unique_ptr<ring_buffer_t, Ring_buf_deleter> near_end_ringbuf; ///< capture -> worker
+        std::unique_ptr<ring_buffer_t, Ring_buf_deleter> far_end_ringbuf;  ///< playback -> worker
+        std::unique_ptr<ring_buffer_t, Ring_buf_deleter> out_ringbuf;      ///< worker -> capture
 
-        std::unique_ptr<spx_int16_t[]> frame_data;
+        std::vector<int16_t> frame_data;
         struct audio_frame frame;
 
-        int requested_delay;
-        int prefill;
+        int requested_delay = 0;
+        std::atomic<int> prefill{0};           ///< far end prefill (samples) requested by the capture side
+        std::atomic<bool> drop_far{false};
+        std::atomic<int> sample_rate{0};       ///< near end sample rate, worker reconfigures on change
+        std::atomic<int> frame_samples{0};     ///< backend frame size
         time_point next_expected_near;
+        std::chrono::microseconds budget{DEFAULT_BUDGET_US};
 
-        std::unique_ptr<struct audio_export, Export_state_deleter> exporter;
-
+        std::thread worker;
         std::mutex lock;
+        std::condition_variable work_cv;
+        std::condition_variable done_cv;
+        unsigned long long submitted = 0;      ///< guarded by lock
+        unsigned long long completed = 0;      ///< guarded by lock
+        bool should_exit = false;              ///< guarded by lock
+
+        // worker only
+        std::unique_ptr<struct audio_export, Export_state_deleter> exporter;
+        struct control_state *control = nullptr;
+        time_point last_report;
+        long long proc_ns_sum = 0;
+        long long proc_ns_max = 0;
+        long long proc_frames = 0;
+        long long late_batches = 0;
 };
 
 ADD_TO_PARAM("echo-cancel-dump-audio", "* echo-cancel-dump-audio\n"
                 "  Dump near end, far end and output samples in separate channels to a wav file.\n");
 
-static void reconfigure_echo (struct echo_cancellation *s, int sample_rate, int bps);
-
-static void reconfigure_echo (struct echo_cancellation *s, int sample_rate, int bps)
+static void reconfigure_echo (struct echo_cancellation *s, int sample_rate)
 {
-        UNUSED(bps);
+        s->frame_samples = s->backend->configure(sample_rate);
 
-        s->frame.bps = 2;
-        s->frame.ch_count = 1;
-        s->frame.sample_rate = sample_rate;
-
-        ring_buffer_flush(s->far_end_ringbuf.get());
-        ring_buffer_flush(s->near_end_ringbuf.get());
-
-        speex_echo_ctl(s->echo_state.get(), SPEEX_ECHO_SET_SAMPLING_RATE, &sample_rate); // should the 3rd parameter be int?
+        // the worker is the reader of both, so it may drop the contents
+        ring_advance_read_idx(s->far_end_ringbuf.get(), ring_get_current_size(s->far_end_ringbuf.get()));
+        ring_advance_read_idx(s->near_end_ringbuf.get(), ring_get_current_size(s->near_end_ringbuf.get()));
 
         if(get_commandline_param("echo-cancel-dump-audio")){
                 s->exporter.reset(nullptr); //previous file gets closed
@@ -123,20 +208,150 @@ static void reconfigure_echo (struct echo_cancellation *s, int sample_rate, int
         }
 }
 
+static void report_stats(struct echo_cancellation *s)
+{
+        auto now = steady_clock::now();
+        if (now - s->last_report < std::chrono::seconds(1)) {
+                return;
+        }
+        if (s->proc_frames > 0 && control_stats_enabled(s->control)) {
+                const struct control_stat_field fields[] = {
+                        { "proc_avg_us", (double) (s->proc_ns_sum / s->proc_frames / 1000) },
+                        { "proc_max_us", (double) (s->proc_ns_max / 1000) },
+                        { "budget_us", (double) s->budget.count() },
+                        { "late", (double) s->late_batches } };
+                control_report_stats_fields(s->control, "AEC", fields, sizeof fields / sizeof fields[0]);
+        }
+        if (s->late_batches > 0) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Processing exceeded the %lld us budget %lld times.\n",
+                                (long long) s->budget.count(), s->late_batches);
+        }
+        s->last_report = now;
+        s->proc_ns_sum = s->proc_ns_max = s->proc_frames = s->late_batches = 0;
+}
+
+/// processes all whole frames available in the near end buffer
+static void process_available(struct echo_cancellation *s, std::vector<int16_t> &near_arr,
+                std::vector<int16_t> &far_arr, std::vector<int16_t> &out_arr)
+{
+        const int frame_samples = s->frame_samples;
+        const int frame_bytes = frame_samples * 2;
+        auto batch_start = steady_clock::now();
+        while (frame_bytes > 0 && ring_get_current_size(s->near_end_ringbuf.get()) >= frame_bytes) {
+                if (ring_get_available_write_size(s->out_ringbuf.get()) < frame_bytes) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Output ringbuf overflow!\n");
+                        break;
+                }
+                ring_buffer_read(s->near_end_ringbuf.get(), reinterpret_cast<char *>(near_arr.data()), frame_bytes);
+
+                const void *export_channels[] = {near_arr.data(), far_arr.data(), out_arr.data(), nullptr};
+                if (ring_get_current_size(s->far_end_ringbuf.get()) >= frame_bytes) {
+                        ring_buffer_read(s->far_end_ringbuf.get(), reinterpret_cast<char *>(far_arr.data()), frame_bytes);
+
+                        auto t0 = steady_clock::now();
+                        s->backend->process(near_arr.data(), far_arr.data(), out_arr.data());
+                        long long proc_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now() - t0).count();
+                        s->proc_ns_sum += proc_ns;
+                        s->proc_ns_max = std::max(s->proc_ns_max, proc_ns);
+                        s->proc_frames += 1;
+                        ring_buffer_write(s->out_ringbuf.get(), reinterpret_cast<char *>(out_arr.data()), frame_bytes);
+                } else {
+                        ring_buffer_write(s->out_ringbuf.get(), reinterpret_cast<char *>(near_arr.data()), frame_bytes);
+                        export_channels[1] = export_channels[2] = near_arr.data();
+                }
+
+                if(s->exporter){
+                        audio_export_raw_ch(s->exporter.get(), export_channels, frame_samples);
+                }
+        }
+        if (steady_clock::now() - batch_start > s->budget) {
+                s->late_batches += 1;
+        }
+}
+
+static void echo_worker(struct echo_cancellation *s)
+{
+        set_thread_name("echo_cancel");
+        if (!set_thread_realtime_priority()) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Cannot set real-time priority of the processing thread.\n");
+        }
+
+        std::vector<int16_t> near_arr, far_arr, out_arr;
+        int configured_rate = 0;
+        while (true) {
+                unsigned long long taken = 0;
+                {
+                        std::unique_lock lk(s->lock);
+                        s->work_cv.wait(lk, [s] { return s->should_exit || s->submitted != s->completed; });
+                        if (s->should_exit) {
+                                return;
+                        }
+                        taken = s->submitted;
+                }
+
+                if (int rate = s->sample_rate; rate != configured_rate) {
+                        reconfigure_echo(s, rate);
+                        configured_rate = rate;
+                        near_arr.resize(s->frame_samples);
+                        far_arr.resize(s->frame_samples);
+                        out_arr.resize(s->frame_samples);
+                }
+                if (s->drop_far.exchange(false)) {
+                        int frame_bytes = s->frame_samples * 2;
+                        int current = ring_get_current_size(s->far_end_ringbuf.get());
+                        //drop only whole frames
+                        ring_advance_read_idx(s->far_end_ringbuf.get(), current / frame_bytes * frame_bytes);
+                }
+
+                process_available(s, near_arr, far_arr, out_arr);
+
+                {
+                        std::lock_guard lk(s->lock);
+                        s->completed = taken;
+                }
+                s->done_cv.notify_all();
+                report_stats(s);
+        }
+}
+
 #define TEXTIFY(a) TEXTIFY2(a)
 #define TEXTIFY2(a) #a
 
 ADD_TO_PARAM("echo-cancel-filter-length", "* echo-cancel-filter-length=<samples>\n"
                 "  Echo cancellation filter length in samples, should be the third of the room's impulse response length. (default "
-                TEXTIFY(DEFAULT_FILTER_LENGTH) ").\n");
+                TEXTIFY(DEFAULT_FILTER_LENGTH) ", Speex only).\n");
 
 ADD_TO_PARAM("echo-cancel-delay", "* echo-cancel-delay=<samples>\n"
                 "  Echo cancellation additional delay added to far end in samples, should be slightly less than output device latency.\n");
 
-struct echo_cancellation * echo_cancellation_init(void)
+ADD_TO_PARAM("echo-cancel-backend", "* echo-cancel-backend=speex|webrtc\n"
+                "  Echo cancellation implementation (default speex if compiled in).\n");
+
+ADD_TO_PARAM("echo-cancel-budget", "* echo-cancel-budget=<us>\n"
+                "  Maximal time the sending waits for the echo cancellation of captured samples (default "
+                TEXTIFY(DEFAULT_BUDGET_US) " us), otherwise they are sent with the next frame.\n");
+
+static std::unique_ptr<echo_backend> create_backend(const char *name, int filter_length)
 {
-        struct echo_cancellation *s = new echo_cancellation();
+#ifdef HAVE_SPEEXDSP
+        if (name == nullptr || strcmp(name, "speex") == 0) {
+                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Speex echo cancellation initialized with filter length %d samples.\n", filter_length);
+                return std::make_unique<speex_backend>(filter_length);
+        }
+#endif
+#ifdef HAVE_WEBRTC_AEC
+        if (name == nullptr || strcmp(name, "webrtc") == 0) {
+                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "WebRTC echo cancellation initialized.\n");
+                return std::make_unique<webrtc_backend>();
+        }
+#endif
+        UNUSED(filter_length);
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Echo cancellation backend %s not available!\n", name);
+        return {};
+}
 
+struct echo_cancellation * echo_cancellation_init(struct module *parent)
+{
         int filter_length = DEFAULT_FILTER_LENGTH;
         if(const char *param = get_commandline_param("echo-cancel-filter-length"); param != nullptr){
                 char *end;
@@ -145,45 +360,86 @@ struct echo_cancellation * echo_cancellation_init(void)
                         filter_length = len;
         }
 
+        std::unique_ptr<echo_backend> backend = create_backend(get_commandline_param("echo-cancel-backend"), filter_length);
+        if (!backend) {
+                return nullptr;
+        }
+
+        struct echo_cancellation *s = new echo_cancellation();
+        s->backend = std::move(backend);
+
         if(const char *param = get_commandline_param("echo-cancel-delay"); param != nullptr){
                 char *end;
                 int len = strtol(param, &end, 10);
                 if(end != param)
                         s->requested_delay = len;
         }
-
-        s->echo_state.reset(speex_echo_state_init(SAMPLES_PER_FRAME, filter_length));
+        if(const char *param = get_commandline_param("echo-cancel-budget"); param != nullptr){
+                s->budget = std::chrono::microseconds(atoi(param));
+        }
 
         s->frame.data = NULL;
         s->frame.sample_rate = s->frame.bps = 0;
 
-        const int ringbuf_sample_count = 2 << 15; //should be divisable by SAMPLES_PER_FRAME
         constexpr int bps = 2; //TODO: assuming bps to be 2
 
-        s->far_end_ringbuf.reset(ring_buffer_init(ringbuf_sample_count * bps));
-        s->near_end_ringbuf.reset(ring_buffer_init(ringbuf_sample_count * bps));
+        s->far_end_ringbuf.reset(ring_buffer_init(RINGBUF_SAMPLES * bps));
+        s->near_end_ringbuf.reset(ring_buffer_init(RINGBUF_SAMPLES * bps));
+        s->out_ringbuf.reset(ring_buffer_init(RINGBUF_SAMPLES * bps));
 
-        s->frame_data = std::make_unique<spx_int16_t[]>(ringbuf_sample_count);
-        s->frame.data = reinterpret_cast<char *>(s->frame_data.get());
-        s->frame.max_size = ringbuf_sample_count * sizeof(s->frame_data[0]);
+        s->frame_data.resize(RINGBUF_SAMPLES);
+        s->frame.data = reinterpret_cast<char *>(s->frame_data.data());
+        s->frame.max_size = RINGBUF_SAMPLES * sizeof(s->frame_data[0]);
         static_assert(sizeof(s->frame_data[0]) == bps);
 
-        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Echo cancellation initialized with filter length %d samples.\n", filter_length);
-
-        s->prefill = 0;
+        s->control = (struct control_state *) get_module(get_root_module(parent), "control");
+        s->last_report = steady_clock::now();
+        s->worker = std::thread(echo_worker, s);
 
         return s;
 }
 
 void echo_cancellation_destroy(struct echo_cancellation *s)
 {
+        if (!s) {
+                return;
+        }
+        {
+                std::lock_guard lk(s->lock);
+                s->should_exit = true;
+        }
+        s->work_cv.notify_one();
+        s->worker.join();
         delete s;
 }
 
-void echo_play(struct echo_cancellation *s, struct audio_frame *frame)
+/**
+ * Writes samples converted to 16 bits to the ring buffer.
+ * @param samples count of samples to be written (may be less than in frame)
+ */
+static void write_converted(ring_buffer_t *ring, const struct audio_frame *frame, size_t samples)
 {
-        std::lock_guard lk(s->lock);
+        if(frame->bps == 2) {
+                ring_buffer_write(ring, frame->data, samples * 2);
+                return;
+        }
+        void *ptr1;
+        int size1;
+        void *ptr2;
+        int size2;
+        ring_get_write_regions(ring, samples * 2, &ptr1, &size1, &ptr2, &size2);
+
+        assert(size1 % 2 == 0);
+        int in_bytes1 = (size1 / 2) * frame->bps;
+        change_bps(static_cast<char *>(ptr1), 2, frame->data, frame->bps, in_bytes1);
+        if(ptr2){
+                change_bps(static_cast<char *>(ptr2), 2, frame->data + in_bytes1, frame->bps, samples * frame->bps - in_bytes1);
+        }
+        ring_advance_write_idx(ring, samples * 2);
+}
 
+void echo_play(struct echo_cancellation *s, struct audio_frame *frame)
+{
         if(frame->ch_count != 1) {
                 static int prints = 0;
                 if(prints++ % 100 == 0) {
@@ -193,16 +449,16 @@ void echo_play(struct echo_cancellation *s, struct audio_frame *frame)
                 return;
         }
 
-        if(s->prefill){
-                int target = std::max(SAMPLES_PER_FRAME, (s->prefill / SAMPLES_PER_FRAME) * SAMPLES_PER_FRAME);
-                int current = ring_get_current_size(s->far_end_ringbuf.get());
-                //buffer can contain small remainder (<SAMPLES_PER_FRAME)
+        if(int prefill = s->prefill.exchange(0); prefill > 0){
+                int frame_samples = std::max<int>(s->frame_samples, 1);
+                int target = std::max(frame_samples, (prefill / frame_samples) * frame_samples);
+                int current = ring_get_current_size(s->far_end_ringbuf.get()) / 2;
+                //buffer can contain small remainder (<frame size)
                 int to_fill = target - current;
-                s->prefill = 0;
                 if(to_fill < 0){
                         log_msg(LOG_LEVEL_WARNING, MOD_NAME "Pre fill requested to %d, but the buffer is already %d!\n", target, current);
                 } else {
-                        ring_advance_write_idx(s->far_end_ringbuf.get(), to_fill);
+                        ring_fill(s->far_end_ringbuf.get(), 0, to_fill * 2);
                         log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Pre filling far end with %d samples\n", to_fill);
                 }
         }
@@ -215,33 +471,11 @@ void echo_play(struct echo_cancellation *s, struct audio_frame *frame)
                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "Far end ringbuf overflow!\n");
         }
 
-        if(frame->bps != 2) {
-                void *ptr1;
-                int size1;
-                void *ptr2;
-                int size2;
-                ring_get_write_regions(s->far_end_ringbuf.get(), samples * 2,
-                                &ptr1, &size1, &ptr2, &size2);
-
-                assert(size1 % 2 == 0);
-                int in_bytes1 = (size1 / 2) * frame->bps;
-                change_bps(static_cast<char *>(ptr1), 2, frame->data, frame->bps, in_bytes1);
-                if(ptr2){
-                        change_bps(static_cast<char *>(ptr2), 2, frame->data + in_bytes1, frame->bps, frame->data_len - in_bytes1);
-                }
-
-                ring_advance_write_idx(s->far_end_ringbuf.get(), samples * 2);
-        } else {
-                ring_buffer_write(s->far_end_ringbuf.get(), frame->data, samples * 2);
-        }
+        write_converted(s->far_end_ringbuf.get(), frame, samples);
 }
 
 struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame *frame)
 {
-        struct audio_frame *res;
-
-        std::lock_guard lk(s->lock);
-
         if(frame->ch_count != 1) {
                 static int prints = 0;
                 if(prints++ % 100 == 0)
@@ -250,13 +484,15 @@ struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame
                 return frame;
         }
 
-
-        if(frame->sample_rate != s->frame.sample_rate ||
-                        frame->bps != s->frame.bps) {
-                reconfigure_echo(s, frame->sample_rate, frame->bps);
+        if(frame->sample_rate != s->frame.sample_rate) {
+                s->frame.bps = 2;
+                s->frame.ch_count = 1;
+                s->frame.sample_rate = frame->sample_rate;
+                // we are the reader of the output, the worker flushes the rest
+                ring_advance_read_idx(s->out_ringbuf.get(), ring_get_current_size(s->out_ringbuf.get()));
+                s->sample_rate = frame->sample_rate;
         }
 
-
         size_t in_frame_samples = frame->data_len / frame->bps;
 
         size_t ringbuf_free_samples = ring_get_available_write_size(s->near_end_ringbuf.get()) / 2;
@@ -275,32 +511,11 @@ struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame
                 auto diff = steady_clock::now() - s->next_expected_near;
                 long long delay = std::chrono::duration_cast<std::chrono::microseconds>(diff).count();
                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "Near samples late by %lldus\n", delay);
-
-                int current = ring_get_current_size(s->far_end_ringbuf.get());
-                //drop only whole frames
-                current = (current / SAMPLES_PER_FRAME) * SAMPLES_PER_FRAME;
-                ring_advance_read_idx(s->far_end_ringbuf.get(), current);
+                s->drop_far = true;
         }
         s->next_expected_near = steady_clock::now() + std::chrono::seconds(1);
 
-        if(frame->bps != 2){
-                //Need to change bps, put whole incoming frame into ringbuf
-                void *ptr1;
-                int size1;
-                void *ptr2;
-                int size2;
-                ring_get_write_regions(s->near_end_ringbuf.get(), in_frame_samples * 2,
-                                &ptr1, &size1, &ptr2, &size2);
-
-                int in_bytes1 = (size1 / 2) * frame->bps;
-                change_bps(static_cast<char *>(ptr1), 2, frame->data, frame->bps, in_bytes1);
-                if(ptr2){
-                        change_bps(static_cast<char *>(ptr2), 2, frame->data + in_bytes1, frame->bps, frame->data_len - in_bytes1);
-                }
-                ring_advance_write_idx(s->near_end_ringbuf.get(), in_frame_samples * 2);
-        } else {
-                ring_buffer_write(s->near_end_ringbuf.get(), frame->data, frame->data_len);
-        }
+        write_converted(s->near_end_ringbuf.get(), frame, in_frame_samples);
 
         size_t near_end_samples = ring_get_current_size(s->near_end_ringbuf.get()) / 2;
         size_t far_end_samples = ring_get_current_size(s->far_end_ringbuf.get()) / 2;
@@ -313,43 +528,21 @@ struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame
                 s->prefill = in_frame_samples + s->requested_delay;
         }
 
-        size_t frames_to_process = near_end_samples / SAMPLES_PER_FRAME;
-        if(!frames_to_process){
-                return NULL;
+        unsigned long long seq = 0;
+        {
+                std::lock_guard lk(s->lock);
+                seq = ++s->submitted;
         }
-
-        size_t out_size = frames_to_process * SAMPLES_PER_FRAME * 2;
-        assert(static_cast<size_t>(s->frame.max_size) >= out_size);
-        s->frame.data_len = out_size;
-        res = &s->frame;
-
-        spx_int16_t *out_ptr = (spx_int16_t *)(void *) s->frame.data;
-        for(size_t i = 0; i < frames_to_process; i++){
-                spx_int16_t near_arr[SAMPLES_PER_FRAME];
-                spx_int16_t far_arr[SAMPLES_PER_FRAME];
-
-                const void *export_channels[] = {near_arr, far_arr, out_ptr, nullptr};
-                if(far_end_samples >= SAMPLES_PER_FRAME){
-                        ring_buffer_read(s->far_end_ringbuf.get(), reinterpret_cast<char *>(far_arr), SAMPLES_PER_FRAME * 2);
-                        ring_buffer_read(s->near_end_ringbuf.get(), reinterpret_cast<char *>(near_arr), SAMPLES_PER_FRAME * 2);
-
-                        speex_echo_cancellation(s->echo_state.get(), near_arr, far_arr, out_ptr); 
-                        far_end_samples -= SAMPLES_PER_FRAME;
-
-                } else {
-                        ring_buffer_read(s->near_end_ringbuf.get(), reinterpret_cast<char *>(out_ptr), SAMPLES_PER_FRAME * 2);
-                        export_channels[0] = out_ptr;
-                        export_channels[1] = out_ptr;
-                        export_channels[2] = out_ptr;
-                }
-
-                if(s->exporter){
-                        audio_export_raw_ch(s->exporter.get(), export_channels, SAMPLES_PER_FRAME);
-                }
-
-                out_ptr += SAMPLES_PER_FRAME;
+        s->work_cv.notify_one();
+        {
+                std::unique_lock lk(s->lock);
+                s->done_cv.wait_for(lk, s->budget, [s, seq] { return s->completed >= seq; });
         }
 
-        return res;
+        int out_size = ring_get_current_size(s->out_ringbuf.get()) / 2 * 2;
+        if(out_size == 0){
+                return NULL;
+        }
+        s->frame.data_len = ring_buffer_read(s->out_ringbuf.get(), s->frame.data, std::min(out_size, s->frame.max_size));
+        return &s->frame;
 }
-
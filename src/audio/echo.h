@@ -55,10 +55,11 @@ extern "C" {
 
 struct audio_frame;
 struct echo_cancellation;
+struct module;
 
 typedef struct echo_cancellation echo_cancellation_t;
 
-struct echo_cancellation * echo_cancellation_init(void);
+struct echo_cancellation * echo_cancellation_init(struct module *parent);
 void echo_cancellation_destroy(struct echo_cancellation *state);
 void echo_play(struct echo_cancellation *state, struct audio_frame *frame);
 
@@ -110,6 +110,8 @@ struct state_alsa_playback {
         snd_config_t * local_config;
 
         bool non_interleaved;
+        bool mmap; ///< samples are written directly to the mmap area (alsa-playback-mmap)
+        snd_pcm_uframes_t start_threshold; ///< the stream must be started explicitly if mmap
         playback_mode_t playback_mode;
 
         snd_pcm_uframes_t period_size;
@@ -429,6 +431,8 @@ ADD_TO_PARAM("alsa-playback-buffer", "* alsa-playback-buffer=<len>\n"
                                 "  Buffer length. Can be used to balance robustness and latency, in microseconds.\n");
 ADD_TO_PARAM("alsa-play-period-size", "* alsa-play-period-size=<frames>\n"
                                     "  ALSA playback period size in frames (default is device minimum) .\n");
+ADD_TO_PARAM("alsa-playback-mmap", "* alsa-playback-mmap\n"
+                                    "  Write samples directly to the mmapped ALSA buffer (interleaved only).\n");
 /**
  * @todo
  * Consider using snd_pcm_hw_params_set_buffer_time_first() by default, it works fine
@@ -484,22 +488,37 @@ static int audio_play_alsa_reconfigure(void *state, struct audio_desc desc)
 
         /* Set the desired hardware parameters. */
 
+        s->mmap = false;
+        if (get_commandline_param("alsa-playback-mmap") != NULL) {
+                rc = snd_pcm_hw_params_set_access(s->handle, params,
+                                SND_PCM_ACCESS_MMAP_INTERLEAVED);
+                if (rc < 0) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "cannot set mmap hw access: %s\n",
+                                        snd_strerror(rc));
+                } else {
+                        s->mmap = true;
+                        s->non_interleaved = false;
+                }
+        }
+
         /* Interleaved mode */
-        rc = snd_pcm_hw_params_set_access(s->handle, params,
-                        SND_PCM_ACCESS_RW_INTERLEAVED);
-        if (rc < 0) {
-                log_msg(LOG_LEVEL_ERROR, MOD_NAME "cannot set interleaved hw access: %s\n",
-                        snd_strerror(rc));
+        if (!s->mmap) {
                 rc = snd_pcm_hw_params_set_access(s->handle, params,
-                                SND_PCM_ACCESS_RW_NONINTERLEAVED);
+                                SND_PCM_ACCESS_RW_INTERLEAVED);
                 if (rc < 0) {
-                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "cannot set non-interleaved hw access: %s\n",
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "cannot set interleaved hw access: %s\n",
                                         snd_strerror(rc));
-                        return FALSE;
+                        rc = snd_pcm_hw_params_set_access(s->handle, params,
+                                        SND_PCM_ACCESS_RW_NONINTERLEAVED);
+                        if (rc < 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "cannot set non-interleaved hw access: %s\n",
+                                                snd_strerror(rc));
+                                return FALSE;
+                        }
+                        s->non_interleaved = true;
+                } else {
+                        s->non_interleaved = false;
                 }
-                s->non_interleaved = true;
-        } else {
-                s->non_interleaved = false;
         }
 
         if (desc.bps > 4 || desc.bps < 1) {
@@ -605,6 +624,13 @@ static int audio_play_alsa_reconfigure(void *state, struct audio_desc desc)
         snd_pcm_hw_params_current(s->handle, params);
         snd_pcm_hw_params_get_buffer_size(params, &s->buffer_size);
 
+        snd_pcm_sw_params_t *cur_sw_params;
+        snd_pcm_sw_params_alloca(&cur_sw_params);
+        if (snd_pcm_sw_params_current(s->handle, cur_sw_params) != 0 ||
+                        snd_pcm_sw_params_get_start_threshold(cur_sw_params, &s->start_threshold) != 0) {
+                s->start_threshold = 1;
+        }
+
         if (s->playback_mode == THREAD || s->playback_mode == ASYNC) {
 #ifdef USE_SPEEX_JITTER_BUFFER
 		jitter_buffer_reset(s->buf);
@@ -634,6 +660,7 @@ static int audio_play_alsa_reconfigure(void *state, struct audio_desc desc)
                 CHECK_OK(snd_pcm_sw_params_set_avail_min(s->handle, sw_params, s->period_size));
                 CHECK_OK(snd_pcm_sw_params(s->handle, sw_params));
                 snd_pcm_sw_params_free (sw_params);
+                s->start_threshold = s->buffer_size - s->period_size;
 
                 EXIT_IF_FAILED(snd_async_add_pcm_handler(&s->pcm_callback, s->handle, alsa_play_async_callback, s), "Add async handler");
 
@@ -677,6 +704,8 @@ static void audio_play_alsa_help(void) {
         color_printf("\t\tset buffer max and optionally max (thread and async API only)\n");
         color_printf(TERM_BOLD "\taudio-buffer-len=<ablen>\n" TERM_RESET);
         color_printf("\t\tlength of UG internal ALSA buffer (in milliseconds)\n");
+        color_printf(TERM_BOLD "\talsa-playback-mmap\n" TERM_RESET);
+        color_printf("\t\twrite directly to the mmapped device buffer (for short periods)\n");
         printf("\n");
 
         printf("Available ALSA playback devices:\n");
@@ -945,6 +974,73 @@ static int write_samples(snd_pcm_t *handle, const char *data, int bps, int ch_co
         return written;
 }
 
+/**
+ * Copies interleaved samples directly to the mmap area (converting 8-bit
+ * samples to unsigned), waiting for free space unless the mode is SYNC
+ * (non-blocking). As with snd_pcm_writei(), the stream is started once
+ * start_threshold frames are queued.
+ *
+ * @returns number of written frames or a negative error code
+ */
+static int write_samples_mmap(struct state_alsa_playback *s, const char *data, int bps, int ch_count, int frames)
+{
+        const int frame_len = bps * ch_count;
+        int written = 0;
+        while (written < frames) {
+                snd_pcm_sframes_t avail = snd_pcm_avail_update(s->handle);
+                if (avail < 0) {
+                        return avail;
+                }
+                if (avail == 0) {
+                        if (snd_pcm_state(s->handle) == SND_PCM_STATE_PREPARED) { // full buffer below threshold
+                                int rc = snd_pcm_start(s->handle);
+                                if (rc < 0) {
+                                        return rc;
+                                }
+                        }
+                        if (s->playback_mode == SYNC) {
+                                return written > 0 ? written : -EAGAIN;
+                        }
+                        int rc = snd_pcm_wait(s->handle, 1000);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                        continue;
+                }
+
+                const snd_pcm_channel_area_t *areas;
+                snd_pcm_uframes_t offset;
+                snd_pcm_uframes_t count = frames - written;
+                int rc = snd_pcm_mmap_begin(s->handle, &areas, &offset, &count);
+                if (rc < 0) {
+                        return rc;
+                }
+                char *dst = (char *) areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+                if (bps == 1) {
+                        signed2unsigned(dst, data + written * frame_len, count * frame_len);
+                } else {
+                        memcpy(dst, data + written * frame_len, count * frame_len);
+                }
+                snd_pcm_sframes_t committed = snd_pcm_mmap_commit(s->handle, offset, count);
+                if (committed < 0) {
+                        return committed;
+                }
+                if ((snd_pcm_uframes_t) committed != count) {
+                        return -EPIPE;
+                }
+                written += count;
+
+                if (snd_pcm_state(s->handle) == SND_PCM_STATE_PREPARED &&
+                                s->buffer_size - snd_pcm_avail_update(s->handle) >= s->start_threshold) {
+                        rc = snd_pcm_start(s->handle);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                }
+        }
+        return written;
+}
+
 static void audio_play_alsa_write_frame(void *state, const struct audio_frame *frame)
 {
         struct state_alsa_playback *s = (struct state_alsa_playback *) state;
@@ -957,7 +1053,8 @@ static void audio_play_alsa_write_frame(void *state, const struct audio_frame *f
 #endif
 
         int frames = frame->data_len / (frame->bps * frame->ch_count);
-        rc = write_samples(s->handle, frame->data, frame->bps, frame->ch_count, frames, s->non_interleaved, s->playback_mode, s->scratchpad);
+        rc = s->mmap ? write_samples_mmap(s, frame->data, frame->bps, frame->ch_count, frames)
+                : write_samples(s->handle, frame->data, frame->bps, frame->ch_count, frames, s->non_interleaved, s->playback_mode, s->scratchpad);
         if (rc == -EPIPE) {
                 /* EPIPE means underrun */
                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "underrun occurred\n");
@@ -968,7 +1065,8 @@ static void audio_play_alsa_write_frame(void *state, const struct audio_frame *f
                         if (f + frames > s->buffer_size) {
                                 frames_to_write = s->buffer_size - frames;
                         }
-                        int rc = write_samples(s->handle, frame->data, frame->bps, frame->ch_count, frames_to_write, s->non_interleaved, s->playback_mode, s->scratchpad);
+                        int rc = s->mmap ? write_samples_mmap(s, frame->data, frame->bps, frame->ch_count, frames_to_write)
+                                : write_samples(s->handle, frame->data, frame->bps, frame->ch_count, frames_to_write, s->non_interleaved, s->playback_mode, s->scratchpad);
                         if(rc < 0) {
                                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "error from writei: %s\n",
                                                 snd_strerror(rc));
@@ -58,6 +58,7 @@
 #include "jack_common.h"
 
 #include <jack/jack.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -77,6 +78,7 @@ struct state_jack_playback {
         void *data; // audio buffer
         struct audio_buffer_api *buffer_fns;
         char *tmp; ///< temporary buffer used to demux data
+        atomic_int underflows; ///< counted by the process callback, reported by put_frame
 
         long int first_channel;
 };
@@ -103,6 +105,10 @@ static int jack_samplerate_changed_callback(jack_nframes_t nframes, void *arg)
         return 0;
 }
 
+/**
+ * Real-time thread - must not block, allocate or log. The samples are read
+ * from the lock-free buffer and deinterleaved to all port buffers at once.
+ */
 static int jack_process_callback(jack_nframes_t nframes, void *arg)
 {
         struct state_jack_playback *s = (struct state_jack_playback *) arg;
@@ -112,15 +118,19 @@ static int jack_process_callback(jack_nframes_t nframes, void *arg)
 
         len = s->buffer_fns->read(s->data, s->tmp, req_len);
         if (len != req_len) {
-                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Buffer underflow detected.\n");
+                atomic_fetch_add_explicit(&s->underflows, 1, memory_order_relaxed);
                 nframes_available = len / s->desc.ch_count / sizeof(float);
         }
 
+        char *out[MAX_PORTS];
+        for (int i = 0; i < s->desc.ch_count; ++i) {
+                out[i] = s->libjack->port_get_buffer (s->output_port[i], nframes);
+                assert(out[i] != NULL);
+        }
+        interleaved2planar(out, s->tmp, sizeof(float), nframes_available, s->desc.ch_count);
         for (int i = 0; i < s->desc.ch_count; ++i) {
-                jack_default_audio_sample_t *out =
-                        s->libjack->port_get_buffer (s->output_port[i], nframes_available);
-                assert(out != NULL);
-                demux_channel((char *) out, s->tmp, sizeof(float), len, s->desc.ch_count, i);
+                // silence instead of stale port buffer content on underflow
+                memset(out[i] + nframes_available * sizeof(float), 0, (nframes - nframes_available) * sizeof(float));
         }
 
         return 0;
@@ -380,6 +390,11 @@ static void audio_play_jack_put_frame(void *state, const struct audio_frame *fra
         assert(frame->bps == 4);
         int len = frame->data_len;
 
+        int underflows = atomic_exchange_explicit(&s->underflows, 0, memory_order_relaxed);
+        if (underflows > 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Buffer underflow detected (%d times).\n", underflows);
+        }
+
         if (len >= s->max_channel_len * frame->ch_count) {
                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "Long frame: %d!\n", frame->data_len);
                 len = s->max_channel_len * frame->ch_count;
@@ -52,7 +52,11 @@
 #include "rtp/rtp.h"
 #include "transmit.h"
 #include "utils/audio_buffer.h"
+#include "utils/cpu_features.h"
+#include "utils/macros.h"
 #include "utils/thread.h"
+#include "utils/worker.h"
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <map>
@@ -60,9 +64,14 @@
 #include <thread>
 #include <vector>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define SAMPLE_RATE 48000
 #define BPS     2 /// @todo 4?
-#define CHANNELS 1
+#define DEFAULT_CHANNELS 1
+#define MAX_CHANNELS 8
 #define FRAMES_PER_SEC 25
 static_assert(SAMPLE_RATE % FRAMES_PER_SEC == 0, "Sample rate not divisible by frames per sec!");
 #define SAMPLES_PER_FRAME (SAMPLE_RATE / FRAMES_PER_SEC)
@@ -122,9 +131,9 @@ static void mixer_dummy_rtp_callback(struct rtp *session [[gnu::unused]], rtp_ev
 }
 
 struct am_participant {
-        am_participant(struct socket_udp_local *l, struct sockaddr_storage *ss, string const & audio_codec) {
+        am_participant(struct socket_udp_local *l, struct sockaddr_storage *ss, string const & audio_codec, int ch_count) {
                 assert(l != nullptr && ss != nullptr);
-                m_buffer = audio_buffer_init(SAMPLE_RATE, BPS, CHANNELS, get_commandline_param("low-latency-audio") ? 50 : 5);
+                m_buffer = audio_buffer_init(SAMPLE_RATE, BPS, ch_count, get_commandline_param("low-latency-audio") ? 50 : 5);
                 assert(m_buffer != NULL);
                 struct sockaddr *sa = (struct sockaddr *) ss;
                 assert(ss->ss_family == AF_INET || ss->ss_family == AF_INET6);
@@ -177,34 +186,23 @@ struct am_participant {
         chrono::steady_clock::time_point last_seen;
 };
 
-template<typename source_t, typename intermediate_t>
-class generic_mix_algo {
-public:
-        virtual ~generic_mix_algo() {}
-        virtual intermediate_t add_to_mix(intermediate_t dst, source_t sample) {
-                return dst + sample;
-        }
-
-        virtual intermediate_t get_mixed_without_source_sample(intermediate_t mix, source_t source_sample) {
-                return mix - source_sample;
-        }
-
-        virtual intermediate_t normalize(intermediate_t sample) = 0;
-};
-
 /**
  * In this mixer, no normalization takes place. After mixing and substracting each
  * participant signal, values are clamped (there is no point doing it prior that -
  * non-normalized mixed value can be out-of-bounds while resulting value with
  * substracted with substracted source may be ok.
  */
-template<typename source_t, typename intermediate_t>
-class linear_mix_algo : public generic_mix_algo<source_t, intermediate_t> {
-public:
-        intermediate_t normalize(intermediate_t sample) override {
+struct linear_mix_algo {
+        static sample_type_source normalize(sample_type_mixed sample) {
                 // clamp the value since linear mixer doesn't normalize values
-                return min<intermediate_t>(max<intermediate_t>(sample, numeric_limits<source_t>::min()), numeric_limits<source_t>::max());
+                return min<sample_type_mixed>(max<sample_type_mixed>(sample, numeric_limits<sample_type_source>::min()), numeric_limits<sample_type_source>::max());
         }
+#ifdef __SSE2__
+        /// normalizes 8 samples (4 in each of lo and hi), packed signed saturation is the clamping
+        static __m128i normalize(__m128i lo, __m128i hi) {
+                return _mm_packs_epi32(lo, hi);
+        }
+#endif
 };
 
 /**
@@ -214,23 +212,97 @@ public:
  * http://www.voidcn.com/blog/caohongfei881/article/p-3815311.html
  * Threshold is 0.5.
  */
-template<typename source_t, typename intermediate_t>
-class logarithmic_mix_algo : public generic_mix_algo<source_t, intermediate_t> {
-public:
+struct logarithmic_mix_algo {
         static constexpr double t = 0.5;
         static constexpr double alpha = 5.71144;
-        intermediate_t normalize(intermediate_t sample) override {
-		if (sample >= numeric_limits<source_t>::min() / 2 &&
-				sample <= numeric_limits<source_t>::max() / 2) {
+        static sample_type_source normalize(sample_type_mixed sample) {
+		if (sample >= numeric_limits<sample_type_source>::min() / 2 &&
+				sample <= numeric_limits<sample_type_source>::max() / 2) {
 			return sample;
 		} else {
-                        double sample_norm = (double) sample / numeric_limits<source_t>::max();
-                        double ret = sample_norm / fabs(sample_norm) * (t + (1.0 - t) * log(1.0 + alpha * (fabs(sample_norm) - t) / (2 - t)) / log(1.0 + alpha)) * numeric_limits<source_t>::max();
-                        return ret;
+                        double sample_norm = (double) sample / numeric_limits<sample_type_source>::max();
+                        double ret = sample_norm / fabs(sample_norm) * (t + (1.0 - t) * log(1.0 + alpha * (fabs(sample_norm) - t) / (2 - t)) / log(1.0 + alpha)) * numeric_limits<sample_type_source>::max();
+                        return (sample_type_mixed) ret;
                 }
         }
+#ifdef __SSE2__
+        static __m128i normalize(__m128i lo, __m128i hi) {
+                const __m128i min_lin = _mm_set1_epi32(numeric_limits<sample_type_source>::min() / 2);
+                const __m128i max_lin = _mm_set1_epi32(numeric_limits<sample_type_source>::max() / 2);
+                __m128i out_of_range = _mm_or_si128(
+                                _mm_or_si128(_mm_cmplt_epi32(lo, min_lin), _mm_cmpgt_epi32(lo, max_lin)),
+                                _mm_or_si128(_mm_cmplt_epi32(hi, min_lin), _mm_cmpgt_epi32(hi, max_lin)));
+                if (_mm_movemask_epi8(out_of_range) == 0) { // the common case - linear part
+                        return _mm_packs_epi32(lo, hi);
+                }
+                alignas(16) sample_type_mixed in[8];
+                alignas(16) sample_type_source out[8];
+                _mm_store_si128((__m128i *)(void *) in, lo);
+                _mm_store_si128((__m128i *)(void *) (in + 4), hi);
+                for (int i = 0; i < 8; ++i) {
+                        out[i] = normalize(in[i]);
+                }
+                return _mm_load_si128((__m128i *)(void *) out);
+        }
+#endif
 };
 
+/**
+ * Mixes the sources together and replaces each source with the mix of all
+ * the others (N-1 mix), normalized with algo::normalize().
+ *
+ * The algorithm is a template parameter so that there are no indirect calls
+ * in the per-sample loops.
+ *
+ * @param sources      participant signals (interleaved), overwritten by the output
+ * @param sample_count samples in each source (all channels)
+ * @param mixed        scratch buffer for sample_count samples
+ */
+template<typename algo>
+static void mix_n_minus_one(vector<sample_type_source *> const &sources, int sample_count, sample_type_mixed *mixed)
+{
+        fill(mixed, mixed + sample_count, 0);
+#ifdef __SSE2__
+        const int simd_count = cpu_has(CPU_FEATURE_SSE2) ? sample_count : 0;
+#endif
+        for (sample_type_source *src : sources) {
+                int i = 0;
+#ifdef __SSE2__
+                for ( ; i + 8 <= simd_count; i += 8) {
+                        __m128i in = _mm_loadu_si128((__m128i const *)(void *) (src + i));
+                        // sign-extend to 32 bits
+                        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+                        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16);
+                        __m128i *dst = (__m128i *)(void *) (mixed + i);
+                        _mm_storeu_si128(dst, _mm_add_epi32(_mm_loadu_si128(dst), lo));
+                        _mm_storeu_si128(dst + 1, _mm_add_epi32(_mm_loadu_si128(dst + 1), hi));
+                }
+#endif
+                for ( ; i < sample_count; ++i) {
+                        mixed[i] += src[i];
+                }
+        }
+
+        // substract each source signal from the mix coming to that participant
+        for (sample_type_source *part : sources) {
+                int i = 0;
+#ifdef __SSE2__
+                for ( ; i + 8 <= simd_count; i += 8) {
+                        __m128i in = _mm_loadu_si128((__m128i const *)(void *) (part + i));
+                        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+                        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16);
+                        __m128i const *mix = (__m128i const *)(void *) (mixed + i);
+                        lo = _mm_sub_epi32(_mm_loadu_si128(mix), lo);
+                        hi = _mm_sub_epi32(_mm_loadu_si128(mix + 1), hi);
+                        _mm_storeu_si128((__m128i *)(void *) (part + i), algo::normalize(lo, hi));
+                }
+#endif
+                for ( ; i < sample_count; ++i) {
+                        part[i] = algo::normalize(mixed[i] - part[i]);
+                }
+        }
+}
+
 struct state_audio_mixer final {
         state_audio_mixer(const char *cfg) {
                 if (cfg) {
@@ -244,13 +316,19 @@ struct state_audio_mixer final {
                                 } else if (strncmp(item, "algo=", strlen("algo=")) == 0) {
                                         string algo = item + strlen("algo=");
                                         if (algo == "linear") {
-                                                mixing_algorithm = decltype(mixing_algorithm)(new linear_mix_algo<sample_type_source, sample_type_mixed>());
+                                                mix = mix_n_minus_one<linear_mix_algo>;
                                         } else if (algo == "logarithmic") {
-                                                mixing_algorithm = decltype(mixing_algorithm)(new logarithmic_mix_algo<sample_type_source, sample_type_mixed>());
+                                                mix = mix_n_minus_one<logarithmic_mix_algo>;
                                         } else {
                                                 LOG(LOG_LEVEL_ERROR) << "Unknown mixing algorithm: " << algo << "\n";
                                                 throw 1;
                                         }
+                                } else if (strncmp(item, "channels=", strlen("channels=")) == 0) {
+                                        ch_count = atoi(item + strlen("channels="));
+                                        if (ch_count < 1 || ch_count > MAX_CHANNELS) {
+                                                LOG(LOG_LEVEL_ERROR) << "Channel count must be 1-" << MAX_CHANNELS << "!\n";
+                                                throw 1;
+                                        }
                                 } else {
                                         LOG(LOG_LEVEL_ERROR) << "Unknown option: " << item << "\n";
                                         throw 1;
@@ -267,6 +345,7 @@ struct state_audio_mixer final {
                 } else {
                         audio_codec_done(audio_coder);
                 }
+                mixed.resize(SAMPLES_PER_FRAME * ch_count);
 
                 thread_id = thread(&state_audio_mixer::worker, this);
         }
@@ -277,20 +356,29 @@ struct state_audio_mixer final {
         state_audio_mixer(state_audio_mixer const&)            = delete;
         state_audio_mixer& operator=(state_audio_mixer const&) = delete;
         void worker();
+        void encode_and_send(size_t i);
 
         map<sockaddr_storage, am_participant, sockaddr_storage_less> participants;
         mutex participants_lock;
 
         struct socket_udp_local *recv_socket{};
         string audio_codec{"PCM"};
+        int ch_count = DEFAULT_CHANNELS;
 private:
         thread thread_id;
-        unique_ptr<generic_mix_algo<sample_type_source, sample_type_mixed>> mixing_algorithm{new linear_mix_algo<sample_type_source, sample_type_mixed>()};
+        void (*mix)(vector<sample_type_source *> const &sources, int sample_count, sample_type_mixed *mixed) = mix_n_minus_one<linear_mix_algo>;
+
+        // worker buffers, kept across frames (grow only with participant count)
+        vector<sample_type_mixed> mixed;
+        vector<sample_type_source> source_buf;
+        vector<sample_type_source *> sources;
+        vector<am_participant *> active; ///< participants snapshot corresponding to sources
+        vector<audio_frame2> participant_frames;
 };
 
 void state_audio_mixer::worker()
 {
-        set_thread_name(__func__);
+        set_thread_name("audio_mixer");
         chrono::steady_clock::time_point next_frame_time = chrono::steady_clock::now();
 
         static_assert(SAMPLES_PER_FRAME * 1000ll % SAMPLE_RATE == 0, "Sample rate is not evenly divisible by number of samples in frame");
@@ -318,64 +406,61 @@ void state_audio_mixer::worker()
                         }
                 }
 
-                size_t data_len_source = SAMPLES_PER_FRAME * sizeof(sample_type_source) * CHANNELS;
-                vector<sample_type_mixed> mixed(SAMPLES_PER_FRAME * CHANNELS);
-                vector<audio_frame2> participant_frames(participants.size());
-                int participant_index = 0;
-
-                // mix all together
-                for (auto & p : participants) {
-                        participant_frames[participant_index].init(CHANNELS, AC_PCM, BPS, SAMPLE_RATE);
-                        static_assert(CHANNELS == 1, "Currently only one channel is implemented here.");
-                        participant_frames[participant_index].resize(0, data_len_source);
-                        char *particip_data = participant_frames[participant_index].get_data(0);
-                        int ret = audio_buffer_read(p.second.m_buffer, particip_data, data_len_source);
-                        memset(particip_data, 0, data_len_source - ret);
-
-                        sample_type_source *src = (sample_type_source *)(void *) particip_data;
-                        auto dst = mixed.begin();
-                        for (int i = 0; i < SAMPLES_PER_FRAME * CHANNELS; ++i) {
-                                *dst = mixing_algorithm->add_to_mix(*dst, *src);
-                                ++dst;
-                                ++src;
-                        }
-                        participant_index++;
+                const int sample_count = SAMPLES_PER_FRAME * ch_count;
+                const size_t data_len_source = sample_count * sizeof(sample_type_source);
+                source_buf.resize(max(source_buf.size(), participants.size() * sample_count));
+                while (participant_frames.size() < participants.size()) {
+                        participant_frames.emplace_back();
+                        participant_frames.back().init(ch_count, AC_PCM, BPS, SAMPLE_RATE);
                 }
 
-                // substract each source signal from the mix coming to that participant
-                for (auto & pb : participant_frames) {
-                        auto mix = mixed.begin();
-                        sample_type_source *part = (sample_type_source *)(void *) pb.get_data(0);
-                        for (int i = 0; i < SAMPLES_PER_FRAME * CHANNELS; ++i) {
-                                *part = mixing_algorithm->normalize(mixing_algorithm->get_mixed_without_source_sample(*mix, *part));
-                                ++mix;
-                                ++part;
-                        }
+                sources.clear();
+                active.clear();
+                for (auto & p : participants) {
+                        sample_type_source *src = source_buf.data() + sources.size() * sample_count;
+                        int ret = audio_buffer_read(p.second.m_buffer, (char *) src, data_len_source);
+                        memset((char *) src + ret, 0, data_len_source - ret);
+                        sources.push_back(src);
+                        active.push_back(&p.second);
                 }
+                // participants are removed only by this thread, so the snapshot
+                // stays valid while put_frame() adds new ones
+                plk.unlock();
 
-                // send
-                participant_index = 0;
-                for (auto & p : participants) {
-                        audio_frame2 *uncompressed = &participant_frames[participant_index];
-                        while (audio_frame2 compressed = audio_codec_compress(p.second.m_audio_coder, uncompressed)) {
-                                audio_tx_send(p.second.m_tx_session, p.second.m_network_device, &compressed);
-                                uncompressed = nullptr;
-                        }
+                mix(sources, sample_count, mixed.data());
 
+                // participants have own encoder and TX session - encode and send in parallel
+                task_run_parallel_for(active.size(), 1, [](void *udata, size_t begin, size_t end) {
+                                auto *s = static_cast<state_audio_mixer *>(udata);
+                                for (size_t i = begin; i < end; ++i) {
+                                        s->encode_and_send(i);
+                                }
+                        }, this);
+        }
+}
 
-                        participant_index++;
-                }
-                plk.unlock();
+/// encodes and sends the mix for i-th participant of the current snapshot (see worker())
+void state_audio_mixer::encode_and_send(size_t i)
+{
+        am_participant *p = active[i];
+        audio_frame2 *uncompressed = &participant_frames[i];
+        const sample_type_source *mix_out = sources[i];
+        uncompressed->set_interleaved((const char *) mix_out, SAMPLES_PER_FRAME * ch_count * sizeof(sample_type_source));
+        while (audio_frame2 compressed = audio_codec_compress(p->m_audio_coder, uncompressed)) {
+                audio_tx_send(p->m_tx_session, p->m_network_device, &compressed);
+                uncompressed = nullptr;
         }
 }
 
 static void audio_play_mixer_help()
 {
         printf("Usage:\n"
-               "\t%s -r mixer[:codec=<codec>][:algo={linear|logarithmic}]\n"
+               "\t%s -r mixer[:codec=<codec>][:algo={linear|logarithmic}][:channels=<n>]\n"
                "\n"
                "<codec>\n"
                "\taudio codec to use\n"
+               "<n>\n"
+               "\tnumber of mixed channels (default " TOSTRING(DEFAULT_CHANNELS) ", max " TOSTRING(MAX_CHANNELS) ")\n"
                "linear\n"
                "\tlinear sum of signals (with clamping)\n"
                "logarithmic\n"
@@ -423,7 +508,7 @@ static void audio_play_mixer_put_frame(void *state, const struct audio_frame *fr
         auto ss = *(struct sockaddr_storage *) frame->network_source;
 
         if (s->participants.find(ss) == s->participants.end()) {
-                s->participants.emplace(ss, am_participant{s->recv_socket, &ss, s->audio_codec});
+                s->participants.emplace(ss, am_participant{s->recv_socket, &ss, s->audio_codec, s->ch_count});
         }
 
         audio_buffer_write(s->participants.at(ss).m_buffer, frame->data, frame->data_len);
@@ -445,7 +530,7 @@ static bool audio_play_mixer_ctl(void *state, int request, void *data, size_t *l
         switch (request) {
         case AUDIO_PLAYBACK_CTL_QUERY_FORMAT:
                 if (*len >= sizeof(struct audio_desc)) {
-                        struct audio_desc desc { BPS, SAMPLE_RATE, CHANNELS, AC_PCM };
+                        struct audio_desc desc { BPS, SAMPLE_RATE, s->ch_count, AC_PCM };
                         memcpy(data, &desc, sizeof desc);
                         *len = sizeof desc;
                         return true;
@@ -473,9 +558,10 @@ static bool audio_play_mixer_ctl(void *state, int request, void *data, size_t *l
         }
 }
 
-static int audio_play_mixer_reconfigure(void *state [[gnu::unused]], struct audio_desc desc)
+static int audio_play_mixer_reconfigure(void *state, struct audio_desc desc)
 {
-        audio_desc requested{BPS, SAMPLE_RATE, CHANNELS, AC_PCM};
+        struct state_audio_mixer *s = (struct state_audio_mixer *) state;
+        audio_desc requested{BPS, SAMPLE_RATE, s->ch_count, AC_PCM};
         assert(desc == requested);
         return TRUE;
 }
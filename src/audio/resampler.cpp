@@ -42,6 +42,8 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <cctype>
+
 #include "audio/resampler.hpp"
 #include "audio/types.h"
 #include "audio/utils.h"
@@ -61,6 +63,8 @@
 #endif // HAVE_SOXR
 
 #define DEFAULT_SPEEX_RESAMPLE_QUALITY 10 // in range [0,10] - 10 best
+#define DEFAULT_SOXR_QUALITY "high"
+#define DEFAULT_SOXR_THREADS 1
 #define MOD_NAME "[audio_resampler] "
 
 using namespace std;
@@ -93,6 +97,12 @@ struct resample_prop {
 #ifdef HAVE_SOXR
 class soxr_resampler : public audio_frame2_resampler::impl {
 public:
+        /**
+         * @param recipe  SOXR_QQ..SOXR_VHQ
+         * @param threads soxr runtime threads, 0 - automatic (effective only
+         *                if soxr was built with OpenMP)
+         */
+        soxr_resampler(unsigned long recipe, unsigned threads) : recipe(recipe), threads(threads) {}
         tuple<bool, audio_frame2> resample(audio_frame2 &a, vector<audio_frame2::channel> &new_channels, int new_sample_rate_num, int new_sample_rate_den) override;
         const int *get_supported_bps() override {
                 static const int ret[] = { 2, 4, 0 };
@@ -107,7 +117,11 @@ public:
 private:
         bool check_reconfigure(uint32_t original_sample_rate, uint32_t new_sample_rate_num, uint32_t new_sample_rate_den, size_t nb_channels, unsigned bps);
 
+        unsigned long recipe;
+        unsigned threads;
         soxr_t resampler{nullptr};
+        /// created as variable-rate (only when drift compensation changes the ratio, fixed-rate is cheaper)
+        bool variable_rate{false};
         struct resample_prop prop;
 };
 
@@ -124,17 +138,26 @@ private:
  * @return false Initialisation of the resampler failed
  */
 bool soxr_resampler::check_reconfigure(uint32_t original_sample_rate, uint32_t new_sample_rate_num, uint32_t new_sample_rate_den, size_t nb_channels, unsigned bps) {
+        const bool rate_changed = original_sample_rate != prop.rate_from
+                || new_sample_rate_num != prop.rate_to_num
+                || new_sample_rate_den != prop.rate_to_den;
         if (resampler != nullptr && nb_channels == prop.ch_count && bps == prop.bps) {
-                if (original_sample_rate != prop.rate_from
-                                || new_sample_rate_num != prop.rate_to_num
-                                || new_sample_rate_den != prop.rate_to_den) {
+                if (!rate_changed) {
+                        return true;
+                }
+                if (variable_rate) {
                         // Update the resampler numerator and denomintors
                         prop.rate_from = original_sample_rate;
                         prop.rate_to_num = new_sample_rate_num;
                         prop.rate_to_den = new_sample_rate_den;
                         soxr_set_io_ratio(resampler, ((double)prop.rate_from / ((double)new_sample_rate_num / (double)new_sample_rate_den)), 0);
+                        return true;
+                }
+                if (original_sample_rate == prop.rate_from) {
+                        // the output rate is being adjusted - drift compensation, keep variable-rate from now on
+                        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Output rate changing, switching Soxr to variable-rate\n";
+                        variable_rate = true;
                 }
-                return true;
         }
 
         if (this->resampler) {
@@ -142,9 +165,11 @@ bool soxr_resampler::check_reconfigure(uint32_t original_sample_rate, uint32_t n
         }
         this->resampler = nullptr;
 
+        // fractional rate is set by the drift compensation
+        variable_rate = variable_rate || new_sample_rate_den != 1;
         /* When creating a var-rate resampler, q_spec must be set as follows: */
-        soxr_quality_spec_t q_spec = soxr_quality_spec(SOXR_HQ, SOXR_VR);
-        soxr_runtime_spec_t const runtime_spec = soxr_runtime_spec(1);
+        soxr_quality_spec_t q_spec = soxr_quality_spec(recipe, variable_rate ? SOXR_VR : 0);
+        soxr_runtime_spec_t const runtime_spec = soxr_runtime_spec(threads);
         soxr_io_spec_t io_spec;
         if(bps == 2) {
                 io_spec = soxr_io_spec(SOXR_INT16_S, SOXR_INT16_S);
@@ -158,17 +183,24 @@ bool soxr_resampler::check_reconfigure(uint32_t original_sample_rate, uint32_t n
         }
 
         soxr_error_t error;
-        /* The ratio of the given input rate and output rates must equate to the
-         * maximum I/O ratio that will be used. A resample rate of 2 to 1 would be excessive,
-           but provides a sensible ceiling */
-        this->resampler = soxr_create(2, 1, nb_channels, &error, &io_spec, &q_spec, &runtime_spec);
+        if (variable_rate) {
+                /* The ratio of the given input rate and output rates must equate to the
+                 * maximum I/O ratio that will be used. A resample rate of 2 to 1 would be excessive,
+                   but provides a sensible ceiling */
+                this->resampler = soxr_create(2, 1, nb_channels, &error, &io_spec, &q_spec, &runtime_spec);
+        } else {
+                this->resampler = soxr_create(original_sample_rate, (double) new_sample_rate_num / new_sample_rate_den,
+                                nb_channels, &error, &io_spec, &q_spec, &runtime_spec);
+        }
 
         if (error) {
                 LOG(LOG_LEVEL_ERROR) << "[audio_frame2_resampler] Cannot initialize resampler: " << soxr_strerror(error) << "\n";
                 return false;
         }
-        // Immediately change the resample rate to be the correct value for the audio frame
-        soxr_set_io_ratio((soxr_t)this->resampler, ((double)original_sample_rate / ((double)new_sample_rate_num / (double)new_sample_rate_den)), 0);
+        if (variable_rate) {
+                // Immediately change the resample rate to be the correct value for the audio frame
+                soxr_set_io_ratio((soxr_t)this->resampler, ((double)original_sample_rate / ((double)new_sample_rate_num / (double)new_sample_rate_den)), 0);
+        }
 
         // Setup resampler values
         this->prop.rate_from = original_sample_rate;
@@ -176,7 +208,8 @@ bool soxr_resampler::check_reconfigure(uint32_t original_sample_rate, uint32_t n
         this->prop.rate_to_den = new_sample_rate_den;
         this->prop.ch_count = nb_channels;
         this->prop.bps = bps;
-        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Soxr resampler (re)made at " << new_sample_rate_num / new_sample_rate_den << "\n";
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Soxr " << (variable_rate ? "variable" : "fixed") << "-rate resampler (re)made at "
+                << new_sample_rate_num / new_sample_rate_den << ", " << threads << " thread(s)\n";
         return true;
 }
 
@@ -349,8 +382,28 @@ tuple<bool, audio_frame2> speex_resampler::resample(audio_frame2 &a, vector<audi
 }
 #endif // defined HAVE_SPEEXDSP
 
-ADD_TO_PARAM("resampler", "* resampler=[speex|soxr][[:]quality=[0-10]]\n"
-                "  Select resampler; set quality for Speex in range 0 (worst) and 10 (best), default " TOSTRING(DEFAULT_SPEEX_RESAMPLE_QUALITY) "\n");
+ADD_TO_PARAM("resampler", "* resampler=[speex|soxr][[:]quality=[0-10]|<soxr_q>][:threads=<n>]\n"
+                "  Select resampler; set quality for Speex in range 0 (worst) and 10 (best), default " TOSTRING(DEFAULT_SPEEX_RESAMPLE_QUALITY) "\n"
+                "  or Soxr quality quick|low|medium|high|very-high, default " DEFAULT_SOXR_QUALITY "; threads - Soxr threads\n"
+                "  (0 - automatic, needs Soxr with OpenMP), default " TOSTRING(DEFAULT_SOXR_THREADS) "\n");
+
+#ifdef HAVE_SOXR
+static unsigned long get_soxr_recipe(string_view name) {
+        const struct { const char *name; unsigned long recipe; } recipes[] = {
+                { "quick", SOXR_QQ },
+                { "low", SOXR_LQ },
+                { "medium", SOXR_MQ },
+                { "high", SOXR_HQ },
+                { "very-high", SOXR_VHQ },
+        };
+        for (const auto &r : recipes) {
+                if (name == r.name) {
+                        return r.recipe;
+                }
+        }
+        throw ug_runtime_error("Unknown Soxr quality: "s + string(name));
+}
+#endif // defined HAVE_SOXR
 
 audio_frame2_resampler::audio_frame2_resampler()
 {
@@ -358,6 +411,8 @@ audio_frame2_resampler::audio_frame2_resampler()
         const char *cfg_c = get_commandline_param("resampler");
         std::string_view sv = cfg_c ? cfg_c : "";
         int quality = DEFAULT_SPEEX_RESAMPLE_QUALITY;
+        [[maybe_unused]] string soxr_quality = DEFAULT_SOXR_QUALITY;
+        [[maybe_unused]] unsigned soxr_threads = DEFAULT_SOXR_THREADS;
         while (!sv.empty()) {
                 const auto &tok = tokenize(sv, ':');
                 if (tok == "speex") {
@@ -365,10 +420,21 @@ audio_frame2_resampler::audio_frame2_resampler()
                 } else if (tok == "soxr") {
                         resampler_type = RESAMPLER_SOXR;
                 } else if (tok.compare(0, "quality="sv.length(), "quality=") == 0) {
-                        quality = stoi(string(tok.substr("quality="sv.length())));
-                        if (quality < 0 || quality > 10) {
-                                throw ug_runtime_error("Quality " + to_string(quality) + " out of range 0-10"s);
+                        const auto val = tok.substr("quality="sv.length());
+                        if (!val.empty() && isdigit(val[0])) {
+                                quality = stoi(string(val));
+                                if (quality < 0 || quality > 10) {
+                                        throw ug_runtime_error("Quality " + to_string(quality) + " out of range 0-10"s);
+                                }
+                        } else {
+                                soxr_quality = val;
+                        }
+                } else if (tok.compare(0, "threads="sv.length(), "threads=") == 0) {
+                        const int threads = stoi(string(tok.substr("threads="sv.length())));
+                        if (threads < 0) {
+                                throw ug_runtime_error("Wrong thread count " + to_string(threads));
                         }
+                        soxr_threads = threads;
                 } else {
                         throw ug_runtime_error("Unknown resampler option: "s + string(tok));
                 }
@@ -378,7 +444,7 @@ audio_frame2_resampler::audio_frame2_resampler()
 #ifdef HAVE_SPEEXDSP
                         m_impl = unique_ptr<audio_frame2_resampler::impl>(new speex_resampler(quality));
 #elif defined HAVE_SOXR
-                        m_impl = unique_ptr<audio_frame2_resampler::impl>(new soxr_resampler());
+                        m_impl = unique_ptr<audio_frame2_resampler::impl>(new soxr_resampler(get_soxr_recipe(soxr_quality), soxr_threads));
 #endif
                         break;
                 case RESAMPLER_SPEEX:
@@ -390,7 +456,7 @@ audio_frame2_resampler::audio_frame2_resampler()
                         break;
                 case RESAMPLER_SOXR:
 #if defined HAVE_SOXR
-                        m_impl = unique_ptr<audio_frame2_resampler::impl>(new soxr_resampler());
+                        m_impl = unique_ptr<audio_frame2_resampler::impl>(new soxr_resampler(get_soxr_recipe(soxr_quality), soxr_threads));
                         break;
 #else
                         throw ug_runtime_error("Soxr not compiled in!");
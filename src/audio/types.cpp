@@ -47,6 +47,7 @@
 #include "audio/utils.h"
 #include "debug.h"
 #include "host.h"
+#include "module.h"
 #include "utils/macros.h"
 
 #include <sstream>
@@ -75,6 +76,21 @@ audio_desc::operator string() const
         return oss.str();
 }
 
+void audio_frame2::channel_data_deleter::operator()(char *ptr) const
+{
+        module_mem_add(owner, -(long long) bytes);
+        module_mem_release(owner);
+        delete [] ptr;
+}
+
+/// allocates channel data accounted to the memory owner of the calling thread
+audio_frame2::channel_data audio_frame2::alloc_channel_data(size_t len)
+{
+        channel_data_deleter deleter{module_mem_acquire_owner(), len};
+        module_mem_add(deleter.owner, (long long) len);
+        return channel_data(new char[len], deleter);
+}
+
 /**
  * @brief Creates empty audio_frame2
  */
@@ -92,12 +108,23 @@ audio_frame2::audio_frame2(const struct audio_frame *old) :
                 codec(old ? AC_PCM : AC_NONE), duration(0.0)
 {
         if (old) {
-                for (int i = 0; i < old->ch_count; i++) {
-                        resize(i, old->data_len / old->ch_count);
-                        char *data = channels[i].data.get();
-                        demux_channel(data, old->data, old->bps, old->data_len, old->ch_count, i);
-                }
+                set_interleaved(old->data, old->data_len);
+        }
+}
+
+/**
+ * Replaces the content of all channels with the interleaved data (bps and
+ * channel count remain unchanged).
+ */
+void audio_frame2::set_interleaved(const char *data, size_t len)
+{
+        const int ch_count = channels.size();
+        vector<char *> planes(ch_count);
+        for (int i = 0; i < ch_count; i++) {
+                resize(i, len / ch_count);
+                planes[i] = channels[i].data.get();
         }
+        interleaved2planar(planes.data(), data, bps, len / ch_count / bps, ch_count);
 }
 
 bool audio_frame2::operator!() const
@@ -168,7 +195,7 @@ void audio_frame2::reserve(size_t length)
 void audio_frame2::reserve(int channel, size_t length)
 {
         if (channels[channel].max_len < length) {
-                unique_ptr<char []> new_data(new char[length]);
+                channel_data new_data = alloc_channel_data(length);
                 copy(channels[channel].data.get(), channels[channel].data.get() +
                                 channels[channel].len, new_data.get());
 
@@ -295,7 +322,7 @@ audio_frame2 audio_frame2::copy_with_bps_change(audio_frame2 const &frame, int n
 
         for (size_t i = 0; i < ret.channels.size(); i++) {
                 ret.channels[i].len = frame.get_data_len(i) / frame.get_bps() * new_bps;
-                ret.channels[i].data = unique_ptr<char []>(new char[ret.channels[i].len]);
+                ret.channels[i].data = alloc_channel_data(ret.channels[i].len);
                 ::change_bps(ret.channels[i].data.get(), new_bps, frame.get_data(i), frame.get_bps(),
                                 frame.get_data_len(i));
         }
@@ -313,7 +340,7 @@ void  audio_frame2::change_bps(int new_bps)
 
         for (size_t i = 0; i < channels.size(); i++) {
                 size_t new_size = channels[i].len / bps * new_bps;
-                new_channels[i] = {unique_ptr<char []>(new char[new_size]), new_size, new_size, {}};
+                new_channels[i] = {alloc_channel_data(new_size), new_size, new_size, {}};
         }
 
         for (size_t i = 0; i < channels.size(); i++) {
@@ -332,7 +359,7 @@ tuple<bool, audio_frame2> audio_frame2::resample_fake(audio_frame2_resampler & r
                 // allocate new storage + 10 ms headroom
                 size_t new_size = (long long) channels[i].len * new_sample_rate_num / sample_rate / new_sample_rate_den
                         + new_sample_rate_num * this->bps / 100 / new_sample_rate_den;
-                new_channels[i] = {unique_ptr<char []>(new char[new_size]), new_size, new_size, {}};
+                new_channels[i] = {alloc_channel_data(new_size), new_size, new_size, {}};
         }
 
         auto [ret, remainder] = resampler_state.resample(*this, new_channels, new_sample_rate_num, new_sample_rate_den);
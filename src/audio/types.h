@@ -141,6 +141,7 @@ public:
         void replace(int channel, size_t offset, const char *data, size_t length);
         void reserve(size_t len);
         void resize(int channel, size_t len);
+        void set_interleaved(const char *data, size_t len);
         void reset();
         int get_bps() const;
         audio_codec_t get_codec() const;
@@ -176,8 +177,17 @@ public:
         ///@ resamples to new sample rate while keeping nominal sample rate intact
         std::tuple<bool, audio_frame2> resample_fake(audio_frame2_resampler & resampler_state, int new_sample_rate_num, int new_sample_rate_den);
 private:
+        /// releases the memory accounting charge of the channel data (see module_set_mem_owner()),
+        /// value-initialized (no charge) when default-constructed
+        struct channel_data_deleter {
+                struct module_mem *owner;
+                size_t bytes;
+                void operator()(char *ptr) const;
+        };
+        using channel_data = std::unique_ptr<char [], channel_data_deleter>;
+        static channel_data alloc_channel_data(size_t len);
         struct channel {
-                std::unique_ptr<char []> data;
+                channel_data data;
                 size_t len;
                 size_t max_len;
                 struct fec_desc fec_params;
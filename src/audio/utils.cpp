@@ -47,7 +47,13 @@
 #include <cassert>
 #include <climits>
 #include <cmath>
+#include <cstdlib>
 #include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "audio/codec.h"
 #include "audio/types.h"
@@ -77,14 +83,11 @@ template<> int32_t load_sample<2>(const char *data) {
 }
 
 template<> int32_t load_sample<3>(const char *data) {
-        int32_t in_value = 0;
-        memcpy(&in_value, data, 3);
-
-        if ((in_value & 1U<<23U) != 0U) { // negative
-                in_value |= 0xFF000000U;
-        }
-
-        return in_value;
+        // compose in the upper 3 bytes and sign-extend by the arithmetic
+        // shift - branchless and without a partial store to memory
+        const auto *bytes = reinterpret_cast<const unsigned char *>(data);
+        uint32_t in_value = (uint32_t) bytes[0] << 8U | (uint32_t) bytes[1] << 16U | (uint32_t) bytes[2] << 24U;
+        return static_cast<int32_t>(in_value) >> 8;
 }
 
 template<> int32_t load_sample<4>(const char *data) {
@@ -267,49 +270,123 @@ void change_bps(char *out, int out_bps, const char *in, int in_bps, int in_len /
         change_bps2(out, out_bps, in, in_bps, in_len, dither);
 }
 
-void change_bps2(char *out, int out_bps, const char *in, int in_bps, int in_len /* bytes */, bool dither)
+#ifdef __SSE2__
+/// 32-bit multiplication (low part) - SSE2 lacks _mm_mullo_epi32
+static inline __m128i mullo_epi32(__m128i a, __m128i b)
 {
-        assert ((unsigned int) out_bps <= sizeof(int32_t));
-        static_assert(-2>>1 == -1, "Implementation-defined behavior doesn't work as expected by the implementation.");
+        __m128i even = _mm_mul_epu32(a, b);
+        __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                        _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
 
-        if (in_bps == out_bps ) {
-                memcpy(out, in, in_len);
-                return;
+/// @returns count of converted samples (multiple of 8)
+static int change_bps_16_to_32(char *out, const char *in, int count)
+{
+        const __m128i zero = _mm_setzero_si128();
+        int i = 0;
+        for ( ; i + 8 <= count; i += 8) {
+                __m128i val = _mm_loadu_si128((const __m128i *)(const void *) (in + i * 2));
+                _mm_storeu_si128((__m128i *)(void *) (out + i * 4), _mm_unpacklo_epi16(zero, val));
+                _mm_storeu_si128((__m128i *)(void *) (out + i * 4 + 16), _mm_unpackhi_epi16(zero, val));
         }
+        return i;
+}
 
-        if (in_bps < out_bps ) {
-                for (int i = 0; i < in_len / in_bps; i++) {
-                        int32_t in_value = format_from_in_bps(in, in_bps);
-                        int32_t out_value = in_value << (out_bps * 8 - in_bps * 8);
-                        format_to_out_bps(out, out_bps, out_value);
-                        in += in_bps;
-                        out += out_bps;
+/**
+ * Vector variant of downshift_with_dither() with 4 independent random
+ * generators (the sequence thus differs from the scalar one).
+ * @returns count of converted samples (multiple of 8)
+ */
+static int change_bps_32_to_16(char *out, const char *in, int count, bool dither)
+{
+        constexpr int shift = 16;
+        static thread_local uint32_t lane_rand[4] = { 1, 2, 3, 4 };
+        __m128i rand = _mm_loadu_si128((const __m128i *)(const void *) lane_rand);
+        const __m128i rand_mul = _mm_set1_epi32(1664525);
+        const __m128i rand_add = _mm_set1_epi32(1013904223);
+        const __m128i half = _mm_set1_epi32(1 << (shift - 1));
+        const __m128i trunc_bias = _mm_set1_epi32((1 << shift) - 1);
+        const __m128i overflow_thr = _mm_set1_epi32(INT32_MAX - ((1 << shift) - 1 + (1 << (shift - 1))));
+
+        // C division by 1<<shift (rounds towards zero)
+        auto div = [&](__m128i val) {
+                return _mm_srai_epi32(_mm_add_epi32(val, _mm_and_si128(_mm_srai_epi32(val, 31), trunc_bias)), shift);
+        };
+        auto convert = [&](__m128i val) {
+                if (!dither) {
+                        return _mm_srai_epi32(val, shift);
                 }
-                return;
+                rand = _mm_add_epi32(mullo_epi32(rand, rand_mul), rand_add);
+                __m128i triangle = _mm_srli_epi32(rand, 32 - shift);
+                rand = _mm_add_epi32(mullo_epi32(rand, rand_mul), rand_add);
+                triangle = _mm_sub_epi32(triangle, _mm_srli_epi32(rand, 32 - shift));
+
+                __m128i sign = _mm_srai_epi32(val, 31);
+                __m128i abs = _mm_sub_epi32(_mm_xor_si128(val, sign), sign);
+                __m128i rounded = _mm_add_epi32(val, _mm_sub_epi32(_mm_xor_si128(half, sign), sign));
+                __m128i dithered = div(_mm_add_epi32(rounded, triangle));
+                __m128i overflow = _mm_cmpgt_epi32(abs, overflow_thr);
+                return _mm_or_si128(_mm_and_si128(overflow, div(val)), _mm_andnot_si128(overflow, dithered));
+        };
+
+        int i = 0;
+        for ( ; i + 8 <= count; i += 8) {
+                __m128i lo = convert(_mm_loadu_si128((const __m128i *)(const void *) (in + i * 4)));
+                __m128i hi = convert(_mm_loadu_si128((const __m128i *)(const void *) (in + i * 4 + 16)));
+                _mm_storeu_si128((__m128i *)(void *) (out + i * 2), _mm_packs_epi32(lo, hi));
         }
+        _mm_storeu_si128((__m128i *)(void *) lane_rand, rand);
+        return i;
+}
+#endif // defined __SSE2__
 
-        // downsampling
-        if (dither) {
-                const int downshift = in_bps * 8 - out_bps * 8;
-                for (int i = 0; i < in_len / in_bps; i++) {
-                        int32_t in_value = format_from_in_bps(in, in_bps);
-                        int32_t out_value = downshift_with_dither(in_value, downshift);
-                        format_to_out_bps(out, out_bps, out_value);
-                        in += in_bps;
-                        out += out_bps;
-                }
+template<int IN_BPS, int OUT_BPS>
+static void change_bps_samples(char *out, const char *in, int count, bool dither)
+{
+        int i = 0;
+        if constexpr (IN_BPS == OUT_BPS) {
+                memcpy(out, in, (size_t) count * IN_BPS);
                 return;
-        }
-        // no dithering
-        for (int i = 0; i < in_len / in_bps; i++) {
-                int32_t in_value = format_from_in_bps(in, in_bps);
-                int32_t out_value = in_value >> (in_bps * 8 - out_bps * 8);
-                format_to_out_bps(out, out_bps, out_value);
-                in += in_bps;
-                out += out_bps;
+        } else if constexpr (IN_BPS < OUT_BPS) {
+#ifdef __SSE2__
+                if constexpr (IN_BPS == 2 && OUT_BPS == 4) {
+                        i = change_bps_16_to_32(out, in, count);
+                }
+#endif
+                for ( ; i < count; ++i) {
+                        store_sample<OUT_BPS>(out + i * OUT_BPS, load_sample<IN_BPS>(in + i * IN_BPS) << ((OUT_BPS - IN_BPS) * 8));
+                }
+        } else {
+#ifdef __SSE2__
+                if constexpr (IN_BPS == 4 && OUT_BPS == 2) {
+                        i = change_bps_32_to_16(out, in, count, dither);
+                }
+#endif
+                constexpr int downshift = (IN_BPS - OUT_BPS) * 8;
+                for ( ; i < count; ++i) {
+                        int32_t in_value = load_sample<IN_BPS>(in + i * IN_BPS);
+                        store_sample<OUT_BPS>(out + i * OUT_BPS, dither ? downshift_with_dither(in_value, downshift) : in_value >> downshift);
+                }
         }
 }
 
+void change_bps2(char *out, int out_bps, const char *in, int in_bps, int in_len /* bytes */, bool dither)
+{
+        assert ((unsigned int) out_bps <= sizeof(int32_t));
+        static_assert(-2>>1 == -1, "Implementation-defined behavior doesn't work as expected by the implementation.");
+
+        using change_bps_t = void (*)(char *, const char *, int, bool);
+        static const change_bps_t funcs[4][4] = {
+                { change_bps_samples<1, 1>, change_bps_samples<1, 2>, change_bps_samples<1, 3>, change_bps_samples<1, 4> },
+                { change_bps_samples<2, 1>, change_bps_samples<2, 2>, change_bps_samples<2, 3>, change_bps_samples<2, 4> },
+                { change_bps_samples<3, 1>, change_bps_samples<3, 2>, change_bps_samples<3, 3>, change_bps_samples<3, 4> },
+                { change_bps_samples<4, 1>, change_bps_samples<4, 2>, change_bps_samples<4, 3>, change_bps_samples<4, 4> },
+        };
+        assert(in_bps >= 1 && in_bps <= 4 && out_bps >= 1);
+        funcs[in_bps - 1][out_bps - 1](out, in, in_len / in_bps, dither);
+}
+
 void copy_channel(char *out, const char *in, int bps, int in_len /* bytes */, int out_channel_count)
 {
         int samples = in_len / bps;
@@ -338,21 +415,30 @@ void audio_frame_multiply_channel(struct audio_frame *frame, int new_channel_cou
         copy_channel(frame->data, frame->data, frame->bps, frame->data_len, new_channel_count);
 }
 
+/// fixed-size copies let the compiler use a single load/store per sample
+template<int BPS>
+static void demux_channel_samples(char *out, const char *in, int samples, int in_stream_channels)
+{
+        const size_t stride = (size_t) in_stream_channels * BPS;
+        for (int i = 0; i < samples; ++i) {
+                memcpy(out + i * BPS, in + i * stride, BPS);
+        }
+}
+
 void demux_channel(char *out, char *in, int bps, int in_len, int in_stream_channels, int pos_in_stream)
 {
         int samples = in_len / (in_stream_channels * bps);
-        int i;
 
         assert (bps <= 4);
 
         in += pos_in_stream * bps;
 
-        for (i = 0; i < samples; ++i) {
-                memcpy(out, in, bps);
-
-                out += bps;
-                in += in_stream_channels * bps;
-
+        switch (bps) {
+        case 1: demux_channel_samples<1>(out, in, samples, in_stream_channels); break;
+        case 2: demux_channel_samples<2>(out, in, samples, in_stream_channels); break;
+        case 3: demux_channel_samples<3>(out, in, samples, in_stream_channels); break;
+        case 4: demux_channel_samples<4>(out, in, samples, in_stream_channels); break;
+        default: abort();
         }
 }
 
@@ -375,34 +461,37 @@ void remux_channel(char *out, const char *in, int bps, int in_len, int in_stream
         }
 }
 
+template<int BPS>
+static void mux_channel_samples(char *out, const char *in, int samples, int out_stream_channels, double scale)
+{
+        const size_t stride = (size_t) out_stream_channels * BPS;
+        if (scale == 1.0) {
+                for (int i = 0; i < samples; ++i) {
+                        memcpy(out + i * stride, in + i * BPS, BPS);
+                }
+                return;
+        }
+        for (int i = 0; i < samples; ++i) {
+                int32_t in_value = load_sample<BPS>(in + i * BPS);
+                in_value *= scale;
+                store_sample<BPS>(out + i * stride, in_value);
+        }
+}
+
 void mux_channel(char *out, const char *in, int bps, int in_len, int out_stream_channels, int pos_in_stream, double scale)
 {
         int samples = in_len / bps;
-        int i;
-        
+
         assert (bps <= 4);
 
         out += pos_in_stream * bps;
 
-        if(scale == 1.0) {
-                for (i = 0; i < samples; ++i) {
-                        memcpy(out, in, bps);
-
-                        in += bps;
-                        out += out_stream_channels * bps;
-
-                }
-        } else {
-                for (i = 0; i < samples; ++i) {
-                        int32_t in_value = format_from_in_bps(in, bps);
-
-                        in_value *= scale;
-
-                        format_to_out_bps(out, bps, in_value);
-
-                        in += bps;
-                        out += out_stream_channels * bps;
-                }
+        switch (bps) {
+        case 1: mux_channel_samples<1>(out, in, samples, out_stream_channels, scale); break;
+        case 2: mux_channel_samples<2>(out, in, samples, out_stream_channels, scale); break;
+        case 3: mux_channel_samples<3>(out, in, samples, out_stream_channels, scale); break;
+        case 4: mux_channel_samples<4>(out, in, samples, out_stream_channels, scale); break;
+        default: abort();
         }
 }
 
@@ -470,6 +559,15 @@ void float2int(char *out, const char *in, int len)
         int32_t *outi = (int32_t *)(void *) out;
         int items = len / sizeof(int32_t);
 
+#ifdef __SSE2__
+        const __m128 one = _mm_set1_ps(1.0F);
+        const __m128 minus_one = _mm_set1_ps(-1.0F);
+        const __m128 scale = _mm_set1_ps(INT_MAX_FLT);
+        for ( ; items >= 4; items -= 4, inf += 4, outi += 4) {
+                __m128 sample = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(inf), one), minus_one);
+                _mm_storeu_si128((__m128i *)(void *) outi, _mm_cvttps_epi32(_mm_mul_ps(sample, scale)));
+        }
+#endif
         while(items-- > 0) {
                 float sample = *inf++;
                 if(sample > 1.0) sample = 1.0;
@@ -484,6 +582,13 @@ void int2float(char *out, const char *in, int len)
         float *outf = (float *)(void *) out;
         int items = len / sizeof(int32_t);
 
+#ifdef __SSE2__
+        const __m128 div = _mm_set1_ps((float) INT_MAX);
+        for ( ; items >= 4; items -= 4, ini += 4, outf += 4) {
+                __m128 sample = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(const void *) ini));
+                _mm_storeu_ps(outf, _mm_div_ps(sample, div));
+        }
+#endif
         while(items-- > 0) {
                 *outf++ = (float) *ini++ / (float) INT_MAX;
         }
@@ -556,15 +661,125 @@ void interleaved2noninterleaved(char *out, const char *in, int bps, int in_len,
         for (int i = 0; i < channel_count; ++i) {
                 out_ch[i] = out + in_len / channel_count * i;
         }
+        interleaved2planar(out_ch.data(), in, bps, in_len / bps / channel_count, channel_count);
+}
 
-        int offset = 0;
-        int index = 0;
-        while (offset < in_len) {
-                memcpy(out_ch[index], in, bps);
-                out_ch[index] += bps;
-                index = (index + 1) % channel_count;
-                in += bps;
-                offset += bps;
+#ifdef __SSE2__
+/// transposes 8x8 matrix of 16-bit values (rows <-> columns)
+static inline void transpose8x8_epi16(__m128i r[8])
+{
+        __m128i t[8];
+        for (int i = 0; i < 4; ++i) {
+                t[2 * i] = _mm_unpacklo_epi16(r[2 * i], r[2 * i + 1]);
+                t[2 * i + 1] = _mm_unpackhi_epi16(r[2 * i], r[2 * i + 1]);
+        }
+        __m128i u[8];
+        for (int i = 0; i < 2; ++i) {
+                u[4 * i] = _mm_unpacklo_epi32(t[4 * i], t[4 * i + 2]);
+                u[4 * i + 1] = _mm_unpackhi_epi32(t[4 * i], t[4 * i + 2]);
+                u[4 * i + 2] = _mm_unpacklo_epi32(t[4 * i + 1], t[4 * i + 3]);
+                u[4 * i + 3] = _mm_unpackhi_epi32(t[4 * i + 1], t[4 * i + 3]);
+        }
+        for (int i = 0; i < 4; ++i) {
+                r[2 * i] = _mm_unpacklo_epi64(u[i], u[i + 4]);
+                r[2 * i + 1] = _mm_unpackhi_epi64(u[i], u[i + 4]);
+        }
+}
+
+/// transposes 4x4 matrix of 32-bit values
+static inline void transpose4x4_epi32(__m128i r[4])
+{
+        __m128i t0 = _mm_unpacklo_epi32(r[0], r[1]);
+        __m128i t1 = _mm_unpacklo_epi32(r[2], r[3]);
+        __m128i t2 = _mm_unpackhi_epi32(r[0], r[1]);
+        __m128i t3 = _mm_unpackhi_epi32(r[2], r[3]);
+        r[0] = _mm_unpacklo_epi64(t0, t1);
+        r[1] = _mm_unpackhi_epi64(t0, t1);
+        r[2] = _mm_unpacklo_epi64(t2, t3);
+        r[3] = _mm_unpackhi_epi64(t2, t3);
+}
+
+/**
+ * Transposes blocks of N samples x N channels (N = 16 B / BPS) from the
+ * interleaved to planar layout (or vice versa if to_planar is false).
+ * @returns number of processed samples (multiple of N)
+ */
+template<int BPS, bool to_planar>
+static int transpose_blocks(char *interleaved, char * const *planes, int sample_count, int channel_count)
+{
+        constexpr int N = 16 / BPS;
+        if (channel_count % N != 0) {
+                return 0;
+        }
+        const int stride = channel_count * BPS;
+        int s = 0;
+        for ( ; s + N <= sample_count; s += N) {
+                for (int c = 0; c < channel_count; c += N) {
+                        __m128i r[N];
+                        for (int i = 0; i < N; ++i) {
+                                r[i] = to_planar ? _mm_loadu_si128((const __m128i *)(const void *) (interleaved + (s + i) * stride + c * BPS))
+                                        : _mm_loadu_si128((const __m128i *)(const void *) (planes[c + i] + s * BPS));
+                        }
+                        if constexpr (BPS == 2) {
+                                transpose8x8_epi16(r);
+                        } else {
+                                transpose4x4_epi32(r);
+                        }
+                        for (int i = 0; i < N; ++i) {
+                                if (to_planar) {
+                                        _mm_storeu_si128((__m128i *)(void *) (planes[c + i] + s * BPS), r[i]);
+                                } else {
+                                        _mm_storeu_si128((__m128i *)(void *) (interleaved + (s + i) * stride + c * BPS), r[i]);
+                                }
+                        }
+                }
+        }
+        return s;
+}
+#endif // defined __SSE2__
+
+template<int BPS, bool to_planar>
+static void transpose_samples(char *interleaved, char * const *planes, int sample_count, int channel_count)
+{
+        int s = 0;
+#ifdef __SSE2__
+        if constexpr (BPS == 2 || BPS == 4) {
+                s = transpose_blocks<BPS, to_planar>(interleaved, planes, sample_count, channel_count);
+        }
+#endif
+        for ( ; s < sample_count; ++s) {
+                char *frame = interleaved + (size_t) s * channel_count * BPS;
+                for (int c = 0; c < channel_count; ++c) {
+                        if (to_planar) {
+                                memcpy(planes[c] + s * BPS, frame + c * BPS, BPS);
+                        } else {
+                                memcpy(frame + c * BPS, planes[c] + s * BPS, BPS);
+                        }
+                }
+        }
+}
+
+void interleaved2planar(char * const *out, const char *in, int bps, int sample_count, int channel_count)
+{
+        char *interleaved = const_cast<char *>(in); // not written if to_planar
+        switch (bps) {
+        case 1: transpose_samples<1, true>(interleaved, out, sample_count, channel_count); break;
+        case 2: transpose_samples<2, true>(interleaved, out, sample_count, channel_count); break;
+        case 3: transpose_samples<3, true>(interleaved, out, sample_count, channel_count); break;
+        case 4: transpose_samples<4, true>(interleaved, out, sample_count, channel_count); break;
+        default: abort();
+        }
+}
+
+void planar2interleaved(char *out, const char * const *in, int bps, int sample_count, int channel_count)
+{
+        char * const *planes = const_cast<char * const *>(in); // not written if !to_planar
+        switch (bps) {
+        case 1: transpose_samples<1, false>(out, planes, sample_count, channel_count); break;
+        case 2: transpose_samples<2, false>(out, planes, sample_count, channel_count); break;
+        case 3: transpose_samples<3, false>(out, planes, sample_count, channel_count); break;
+        case 4: transpose_samples<4, false>(out, planes, sample_count, channel_count); break;
+        default: abort();
         }
 }
 
@@ -105,6 +105,17 @@ void remux_channel(char *out, const char *in, int bps, int in_len, int in_stream
 
 void interleaved2noninterleaved(char *out, const char *in, int bps, int in_len /* bytes */, int channel_count);
 
+/**
+ * Splits interleaved stream to channel planes (out[i] for channel i) in one
+ * pass over the input. Unlike calling demux_channel() for every channel, the
+ * input is read just once, which matters for high channel counts.
+ */
+void interleaved2planar(char * const *out, const char *in, int bps, int sample_count, int channel_count);
+/**
+ * Inverse to interleaved2planar() - interleaves channel planes in[i] to out.
+ */
+void planar2interleaved(char *out, const char * const *in, int bps, int sample_count, int channel_count);
+
 /*
  * Additional function that allosw mixing channels
  *
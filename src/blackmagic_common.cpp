@@ -54,10 +54,15 @@
 #include "host.h"
 #include "DeckLinkAPIVersion.h"
 #include "utils/color_out.h"
+#include "utils/cpu_features.h"
 #include "utils/macros.h"
 #include "utils/windows.h"
 #include "utils/worker.h"
 
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#endif
+
 #define MOD_NAME "[DeckLink] "
 
 using namespace std;
@@ -704,12 +709,48 @@ bool bmd_option::option_write(IDeckLinkConfiguration *deckLinkConfiguration, BMD
         return true;
 }
 
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+/**
+ * Processes 8 R10k pixels per iteration, the LUT is looked up with a gather.
+ * @returns number of bytes processed
+ */
+__attribute__((target("avx2"))) static size_t
+apply_r10k_lut_avx2(const unsigned char *in, unsigned char *out, size_t len, const unsigned int *lut)
+{
+        const __m256i bswap = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+                                3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12));
+        const __m256i mask = _mm256_set1_epi32(0x3FF);
+        const int *l = (const int *) lut;
+        size_t done = 0;
+        for ( ; len - done >= 32; done += 32) {
+                __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) (in + done)), bswap);
+                __m256i r = _mm256_srli_epi32(v, 22);
+                __m256i g = _mm256_and_si256(_mm256_srli_epi32(v, 12), mask);
+                __m256i b = _mm256_and_si256(_mm256_srli_epi32(v, 2), mask);
+                r = _mm256_i32gather_epi32(l, r, 4);
+                g = _mm256_i32gather_epi32(l, g, 4);
+                b = _mm256_i32gather_epi32(l, b, 4);
+                v = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(r, 22), _mm256_slli_epi32(g, 12)),
+                                _mm256_slli_epi32(b, 2));
+                _mm256_storeu_si256((__m256i *) (out + done), _mm256_shuffle_epi8(v, bswap));
+        }
+        return done;
+}
+#endif
+
 static void apply_r10k_lut(void *i, void *o, size_t len, void *udata)
 {
         auto lut = (const unsigned int * __restrict) udata;
         auto *in = (const unsigned char *) i;
         auto *out = (unsigned char *) o;
         const unsigned char *in_end = in + len;
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+        if (cpu_has(CPU_FEATURE_AVX2)) {
+                size_t done = apply_r10k_lut_avx2(in, out, len, lut);
+                in += done;
+                out += done;
+        }
+#endif
         while (in < in_end) {
                 unsigned r = in[0] << 2U | in[1] >> 6U;
                 unsigned g = (in[1] & 0x3FU) << 4U | in[2] >> 4U;
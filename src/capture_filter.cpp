@@ -41,13 +41,22 @@
 #include "config_win32.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <cstring>
+#include <vector>
+
 #include "capture_filter.h"
 #include "debug.h"
+#include "host.h"
 #include "lib_common.h"
 #include "module.h"
 #include "utils/color_out.h"
 #include "utils/list.h"
+#include "utils/vf_split.h"
+#include "utils/worker.h"
 #include "video.h"
+#include "video_codec.h"
+
+#define FUSED_ROWS_PER_TASK 32
 
 using namespace std;
 
@@ -59,6 +68,8 @@ struct capture_filter {
 struct capture_filter_instance {
         const struct capture_filter_info *functions;
         void *state;
+        char name[128];
+        bool cuda_download_reported; ///< the filter got a CUDA_MEM frame that was downloaded
 };
 
 static int create_filter(struct capture_filter *s, char *cfg)
@@ -75,8 +86,9 @@ static int create_filter(struct capture_filter *s, char *cfg)
                 auto capture_filter_info = static_cast<const struct capture_filter_info*>(item.second);
                 if(strcasecmp(item.first.c_str(), filter_name) == 0) {
                         struct capture_filter_instance *instance = (struct capture_filter_instance *)
-                                malloc(sizeof(struct capture_filter_instance));
+                                calloc(1, sizeof(struct capture_filter_instance));
                         instance->functions = capture_filter_info;
+                        snprintf(instance->name, sizeof instance->name, "%s", item.first.c_str());
                         int ret = capture_filter_info->init(&s->mod, options, &instance->state);
                         if(ret < 0) {
                                 fprintf(stderr, "Unable to initialize capture filter: %s\n",
@@ -209,8 +221,100 @@ static struct response *process_message(struct capture_filter *s, struct msg_uni
         return new_response(RESPONSE_OK, NULL);
 }
 
+namespace {
+struct fused_pass {
+        std::vector<struct capture_filter_instance *> filters;
+        bool flip = false;
+        codec_t codec;
+        int width;
+        int height;
+        int linesize;
+        const unsigned char *in;
+        unsigned char *out;
+};
+} // end of anonymous namespace
+
+static bool can_fuse(struct capture_filter_instance *inst, struct video_frame *frame)
+{
+        const struct capture_filter_line_kernel *k = inst->functions->line_kernel;
+        return k != nullptr && frame->mem_location == CPU_MEM && frame->tile_count == 1 && !codec_is_planar(frame->color_spec)
+                && k->supports(inst->state, frame->color_spec);
+}
+
+static void fused_pass_rows(void *arg, size_t begin, size_t end)
+{
+        auto *p = static_cast<struct fused_pass *>(arg);
+        for (size_t y = begin; y < end; ++y) {
+                const size_t src_y = p->flip ? p->height - 1 - y : y;
+                const unsigned char *src = p->in + src_y * p->linesize;
+                unsigned char *dst = p->out + y * p->linesize;
+                for (auto *inst : p->filters) {
+                        const struct capture_filter_line_kernel *k = inst->functions->line_kernel;
+                        if (k->process != nullptr) {
+                                k->process(inst->state, p->codec, src, dst, p->width);
+                                src = dst;
+                        }
+                }
+                if (src != dst) { // only line reordering filters
+                        memcpy(dst, src, p->linesize);
+                }
+        }
+}
+
+/**
+ * Runs the line kernels of the filters in one pass - the input frame is read
+ * once, every line is then processed in place in the output frame while it is
+ * still in cache.
+ */
+static struct video_frame *run_fused(struct fused_pass *p, struct video_frame *in)
+{
+        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in));
+        out->tiles[0].data = (char *) malloc(out->tiles[0].data_len);
+        out->callbacks.data_deleter = vf_data_deleter;
+        out->callbacks.dispose = vf_free;
+
+        p->codec = in->color_spec;
+        p->width = in->tiles[0].width;
+        p->height = in->tiles[0].height;
+        p->linesize = vc_get_linesize(p->width, p->codec);
+        p->in = (const unsigned char *) in->tiles[0].data;
+        p->out = (unsigned char *) out->tiles[0].data;
+        for (auto *inst : p->filters) {
+                p->flip ^= inst->functions->line_kernel->flip_vertical;
+        }
+        task_run_parallel_for(p->height, FUSED_ROWS_PER_TASK, fused_pass_rows, p);
+
+        VIDEO_FRAME_DISPOSE(in);
+        return out;
+}
+
+/**
+ * Passes a frame in CUDA memory to the filter, downloading it first if the
+ * filter cannot process it on the device.
+ */
+static struct video_frame *run_filter_cuda(struct capture_filter_instance *inst, struct video_frame *frame)
+{
+        if (inst->functions->filter_cuda != nullptr) {
+                return inst->functions->filter_cuda(inst->state, frame);
+        }
+        if (!inst->cuda_download_reported) {
+                log_msg(LOG_LEVEL_WARNING, "[cap. filter] %s cannot process frames in CUDA memory, downloading them to the host.\n",
+                                inst->name);
+                inst->cuda_download_reported = true;
+        }
+        struct video_frame *host_frame = vf_download_cuda(frame);
+        VIDEO_FRAME_DISPOSE(frame);
+        if (host_frame == nullptr) {
+                return nullptr;
+        }
+        return inst->functions->filter(inst->state, host_frame);
+}
+
+ADD_TO_PARAM("cfilter-no-fuse", "* cfilter-no-fuse\n"
+                "  Run each capture filter separately instead of fusing the per-line ones into a single pass.\n");
 struct video_frame *capture_filter(struct capture_filter *state, struct video_frame *frame) {
         struct capture_filter *s = state;
+        static const bool fuse_disabled = get_commandline_param("cfilter-no-fuse") != nullptr;
 
         struct message *msg;
         while ((msg = check_message(&s->mod))) {
@@ -222,7 +326,22 @@ struct video_frame *capture_filter(struct capture_filter *state, struct video_fr
                         it != NULL;
            ) {
                 struct capture_filter_instance *inst = (struct capture_filter_instance *) simple_linked_list_it_next(&it);
-                frame = inst->functions->filter(inst->state, frame);
+                if (can_fuse(inst, frame) && !fuse_disabled) {
+                        fused_pass pass;
+                        pass.filters.push_back(inst);
+                        while (it != NULL && can_fuse((struct capture_filter_instance *) simple_linked_list_it_peek_next(it), frame)) {
+                                pass.filters.push_back((struct capture_filter_instance *) simple_linked_list_it_next(&it));
+                        }
+                        if (pass.filters.size() > 1) {
+                                frame = run_fused(&pass, frame);
+                                continue;
+                        }
+                }
+                if (frame->mem_location == CUDA_MEM) {
+                        frame = run_filter_cuda(inst, frame);
+                } else {
+                        frame = inst->functions->filter(inst->state, vf_make_contiguous(frame));
+                }
                 if(!frame)
                         return NULL;
         }
@@ -38,7 +38,13 @@
 #ifndef CAPTURE_FILTER_H_
 #define CAPTURE_FILTER_H_
 
-#define CAPTURE_FILTER_ABI_VERSION 2
+#include "types.h"
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#define CAPTURE_FILTER_ABI_VERSION 4
 
 #ifdef __cplusplus
 extern "C" {
@@ -46,6 +52,25 @@ extern "C" {
 
 struct module;
 
+/**
+ * Optional description of a filter that operates on each line separately
+ * without changing the video properties. Consecutive filters providing
+ * a line kernel are fused by capture_filter() into one parallel pass over
+ * the frame, so that the frame is read and written only once.
+ */
+struct capture_filter_line_kernel {
+        /// @returns true if the kernel can process the codec (must be an
+        ///          interleaved one), otherwise capture_filter_info::filter
+        ///          is used for the frame
+        bool (*supports)(void *state, codec_t codec);
+        /// @brief processes one line
+        /// The result must not depend on the line position. in and out are
+        /// either the same (in-place operation) or non-overlapping.
+        /// May be NULL if the filter only reorders lines (see flip_vertical).
+        void (*process)(void *state, codec_t codec, const unsigned char *in, unsigned char *out, int width);
+        bool flip_vertical; ///< output line y is produced from input line height - 1 - y
+};
+
 struct capture_filter_info {
         /// @brief Initializes capture filter
         /// @param      parent parent module
@@ -67,6 +92,14 @@ struct capture_filter_info {
         /// This behavior may change towards use of shared_ptr<video_frame>
         /// in future.
         struct video_frame *(*filter)(void *state, struct video_frame *f);
+        const struct capture_filter_line_kernel *line_kernel; ///< may be NULL
+        /// @brief Performs filtering of a frame in CUDA device memory (CUDA_MEM)
+        /// Same semantics as capture_filter_info::filter, the output should
+        /// also reside in device memory so that subsequent filters and the
+        /// compression may process it without a round trip over PCIe.
+        /// May be NULL - capture_filter() then downloads the frame to host
+        /// memory before calling capture_filter_info::filter.
+        struct video_frame *(*filter_cuda)(void *state, struct video_frame *f);
 };
 
 struct capture_filter;
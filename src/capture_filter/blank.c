@@ -270,22 +270,25 @@ static struct video_frame *filter(void *state, struct video_frame *in)
 
         int orig_stride = vc_get_linesize(in->tiles[0].width, in->color_spec);
         char *orig = in->tiles[0].data + x * bpp + y * orig_stride;
-        int tmp_stride = vc_get_linesize(width / FACTOR, in->color_spec);
-        size_t tmp_len = tmp_stride * (height / FACTOR);
-        uint8_t *tmp = (uint8_t *) malloc(tmp_len);
-        if (s->black) {
-                if (codec == UYVY) {
-                        unsigned char pattern[] = { 127, 0 };
-
-                        for (size_t i = 0; i < tmp_len; i += get_bpp(codec)) {
-                                memcpy(tmp + i, pattern, get_bpp(codec));
+        if (s->black) { // fill the rectangle directly, no need to scale a black image
+                int line_len = vc_get_linesize(width, in->color_spec);
+                for (int i = 0; i < height; ++i) {
+                        char *line = orig + (size_t) i * orig_stride;
+                        if (codec == UYVY) {
+                                for (int j = 0; j < line_len; j += 2) {
+                                        line[j] = 127;
+                                        line[j + 1] = 0;
+                                }
+                        } else {
+                                memset(line, 0, line_len);
                         }
-                } else {
-                        memset(tmp, 0, tmp_len);
                 }
-        } else {
-                sws_scale(s->ctx_downscale, (const uint8_t * const *) &orig, &orig_stride, 0, height, &tmp, &tmp_stride);
+                return in;
         }
+        int tmp_stride = vc_get_linesize(width / FACTOR, in->color_spec);
+        size_t tmp_len = tmp_stride * (height / FACTOR);
+        uint8_t *tmp = (uint8_t *) malloc(tmp_len);
+        sws_scale(s->ctx_downscale, (const uint8_t * const *) &orig, &orig_stride, 0, height, &tmp, &tmp_stride);
         sws_scale(s->ctx_upscale, (const uint8_t * const *) &tmp, &tmp_stride, 0, height / FACTOR, (uint8_t **) &orig, &orig_stride);
 
         free(tmp);
@@ -0,0 +1,136 @@
+/**
+ * @file   capture_filter/cuda_upload.cpp
+ * @brief  Uploads captured frames to CUDA device memory
+ *
+ * Subsequent capture filters providing capture_filter_info::filter_cuda and
+ * the GPU compressions (GPUJPEG, CUDA DXT) then process the frame on the
+ * device, so that it is transferred over PCIe only once.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <algorithm>
+#include <exception>
+
+#include "capture_filter.h"
+#include "cuda_wrapper.h"
+#include "debug.h"
+#include "lib_common.h"
+#include "utils/color_out.h"
+#include "utils/video_frame_pool.h"
+#include "video.h"
+
+#define MOD_NAME "[cuda_upload] "
+
+struct state_cuda_upload {
+        video_frame_pool pool{0, cuda_data_allocator()};
+};
+
+static int init(struct module *parent, const char *cfg, void **state)
+{
+        UNUSED(parent);
+        if (strlen(cfg) > 0) {
+                color_printf(TRED(TBOLD("cuda_upload")) " capture filter uploads the frame to CUDA device memory, takes no arguments\n\n");
+                color_printf("Following filters without CUDA support get the frame downloaded back to the host, example of a GPU-resident chain:\n");
+                color_printf(TBOLD("\t--capture-filter cuda_upload,flip,gamma:2.2 -c GPUJPEG") "\n");
+                return strcmp(cfg, "help") == 0 ? 1 : -1;
+        }
+        *state = new state_cuda_upload();
+        return 0;
+}
+
+static void done(void *state)
+{
+        delete static_cast<state_cuda_upload *>(state);
+}
+
+static struct video_frame *filter(void *state, struct video_frame *in)
+{
+        auto *s = static_cast<state_cuda_upload *>(state);
+        size_t max_len = 0;
+        for (unsigned int i = 0; i < in->tile_count; ++i) {
+                max_len = std::max<size_t>(max_len, in->tiles[i].data_len);
+        }
+        struct video_frame *out = nullptr;
+        try {
+                s->pool.reconfigure(video_desc_from_frame(in), max_len);
+                out = s->pool.get_disposable_frame();
+        } catch (std::exception &e) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot allocate CUDA frame: %s\n", e.what());
+                VIDEO_FRAME_DISPOSE(in);
+                return nullptr;
+        }
+        vf_copy_metadata(out, in);
+        out->mem_location = CUDA_MEM;
+
+        for (unsigned int i = 0; i < in->tile_count; ++i) {
+                out->tiles[i].data_len = in->tiles[i].data_len;
+                if (cuda_wrapper_memcpy(out->tiles[i].data, in->tiles[i].data, in->tiles[i].data_len,
+                                        CUDA_WRAPPER_MEMCPY_HOST_TO_DEVICE) != CUDA_WRAPPER_SUCCESS) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot copy frame to CUDA memory: %s\n",
+                                        cuda_wrapper_last_error_string());
+                        VIDEO_FRAME_DISPOSE(out);
+                        out = nullptr;
+                        break;
+                }
+        }
+
+        VIDEO_FRAME_DISPOSE(in);
+
+        return out;
+}
+
+/// frame is already in the device memory
+static struct video_frame *filter_cuda(void *state, struct video_frame *in)
+{
+        UNUSED(state);
+        return in;
+}
+
+static const struct capture_filter_info capture_filter_cuda_upload = {
+        .init = init,
+        .done = done,
+        .filter = filter,
+        .line_kernel = nullptr,
+        .filter_cuda = filter_cuda,
+};
+
+REGISTER_MODULE(cuda_upload, &capture_filter_cuda_upload, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
+
+/* vim: set expandtab sw=8: */
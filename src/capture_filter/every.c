@@ -132,6 +132,7 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         struct video_frame *frame = vf_alloc_desc(video_desc_from_frame(in));
         memcpy(frame->tiles, in->tiles, in->tile_count * sizeof(struct tile));
         frame->fps /= (double) s->num / s->denom;
+        frame->mem_location = in->mem_location;
 
         frame->callbacks.dispose = dispose_frame;
         frame->callbacks.dispose_udata = in;
@@ -143,6 +144,7 @@ static const struct capture_filter_info capture_filter_every = {
         .init = init,
         .done = done,
         .filter = filter,
+        .filter_cuda = filter, // only references the input data
 };
 
 REGISTER_MODULE(every, &capture_filter_every, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -42,9 +42,13 @@
 #endif /* HAVE_CONFIG_H */
 
 #include "capture_filter.h"
+#ifdef HAVE_CUDA
+#include "cuda_wrapper.h"
+#endif
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_codec.h"
 #include "vo_postprocess/capture_filter_wrapper.h"
@@ -55,6 +59,7 @@ static struct video_frame *filter(void *state, struct video_frame *in);
 
 struct state_flip {
         char *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+        void *cuda_pool; ///< output frames for CUDA_MEM input, created on first such frame
 };
 
 static int init(struct module *parent, const char *cfg, void **state)
@@ -70,7 +75,11 @@ static int init(struct module *parent, const char *cfg, void **state)
 
 static void done(void *state)
 {
-        free(state);
+        struct state_flip *s = state;
+        if (s->cuda_pool != NULL) {
+                video_frame_pool_destroy(s->cuda_pool);
+        }
+        free(s);
 }
 
 static struct video_frame *filter(void *state, struct video_frame *in)
@@ -98,16 +107,64 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         return out;
 }
 
+#ifdef HAVE_CUDA
+static struct video_frame *filter_cuda(void *state, struct video_frame *in)
+{
+        struct state_flip *s = state;
+        struct video_desc desc = video_desc_from_frame(in);
+        if (s->cuda_pool == NULL) {
+                s->cuda_pool = video_frame_pool_init_cuda(desc, 0);
+        } else {
+                video_frame_pool_reconfigure(s->cuda_pool, desc, SIZE_MAX);
+        }
+        struct video_frame *out = video_frame_pool_get_disposable_frame(s->cuda_pool);
+        if (out == NULL) {
+                log_msg(LOG_LEVEL_ERROR, "[flip] Cannot allocate CUDA frame!\n");
+                VIDEO_FRAME_DISPOSE(in);
+                return NULL;
+        }
+        out->mem_location = CUDA_MEM;
+
+        if (cuda_wrapper_flip_lines(out->tiles[0].data, in->tiles[0].data, vc_get_linesize(in->tiles[0].width, in->color_spec),
+                                in->tiles[0].height, NULL) != CUDA_WRAPPER_SUCCESS
+                        || cuda_wrapper_stream_synchronize(NULL) != CUDA_WRAPPER_SUCCESS) {
+                log_msg(LOG_LEVEL_ERROR, "[flip] CUDA error: %s\n", cuda_wrapper_last_error_string());
+                VIDEO_FRAME_DISPOSE(out);
+                out = NULL;
+        }
+
+        VIDEO_FRAME_DISPOSE(in);
+
+        return out;
+}
+#endif
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         struct state_flip *s = state;
         s->vo_pp_out_buffer = buffer;
 }
 
+static bool supports(void *state, codec_t codec)
+{
+        UNUSED(state);
+        return !codec_is_planar(codec);
+}
+
+static const struct capture_filter_line_kernel flip_line_kernel = {
+        .supports = supports,
+        .process = NULL,
+        .flip_vertical = true,
+};
+
 static const struct capture_filter_info capture_filter_flip = {
         .init = init,
         .done = done,
         .filter = filter,
+        .line_kernel = &flip_line_kernel,
+#ifdef HAVE_CUDA
+        .filter_cuda = filter_cuda,
+#endif
 };
 
 REGISTER_MODULE(flip, &capture_filter_flip, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -47,10 +47,16 @@
 #include <vector>
 
 #include "capture_filter.h"
+#ifdef HAVE_CUDA
+#include "cuda_wrapper.h"
+#endif
 #include "debug.h"
 #include "lib_common.h"
 #include "rang.hpp"
 #include "utils/color_out.h"
+#ifdef HAVE_CUDA
+#include "utils/video_frame_pool.h"
+#endif
 #include "utils/worker.h"
 #include "video.h"
 #include "video_codec.h"
@@ -70,6 +76,10 @@ public:
         int out_depth; ///< 0, 8 or 16 (0 menas keep)
         void *vo_pp_out_buffer{}; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
 
+#ifdef HAVE_CUDA
+        video_frame_pool cuda_pool{0, cuda_data_allocator()}; ///< output frames for CUDA_MEM input
+#endif
+
         explicit state_capture_filter_gamma(double gamma, int out_depth) : out_depth(out_depth) {
                 for (int i = 0; i <= numeric_limits<uint8_t>::max(); ++i) { // 8->8
                         lut8.push_back(pow(static_cast<double>(i)
@@ -107,7 +117,50 @@ public:
                 }
         }
 
+#ifdef HAVE_CUDA
+        ~state_capture_filter_gamma() {
+                for (void *lut : cuda_lut) {
+                        cuda_wrapper_free(lut);
+                }
+        }
+
+        /// applies the gamma to data in device memory, the LUTs are uploaded on first use
+        bool apply_gamma_cuda(int in_depth, int out_depth, size_t in_len, void const *in, void *out) {
+                if (cuda_lut[0] == nullptr && (!upload_lut(lut8, &cuda_lut[0]) || !upload_lut(lut16, &cuda_lut[1])
+                                        || !upload_lut(lut8_16, &cuda_lut[2]) || !upload_lut(lut16_8, &cuda_lut[3]))) {
+                        return false;
+                }
+                const void *lut = nullptr;
+                if (in_depth == CHAR_BIT) {
+                        lut = out_depth == CHAR_BIT ? cuda_lut[0] : cuda_lut[2];
+                } else {
+                        lut = out_depth == CHAR_BIT ? cuda_lut[3] : cuda_lut[1];
+                }
+                const int in_bytes = in_depth / CHAR_BIT;
+                return cuda_wrapper_apply_lut(out, in, in_len / in_bytes, in_bytes, out_depth / CHAR_BIT, lut, nullptr) == CUDA_WRAPPER_SUCCESS
+                        && cuda_wrapper_stream_synchronize(nullptr) == CUDA_WRAPPER_SUCCESS;
+        }
+#endif
+
+        /// applies the LUT in place (or out of place) for in_depth == out_depth
+        void apply_gamma_line(int depth, size_t len, void const *in, void *out) {
+                if (depth == CHAR_BIT) {
+                        apply_lut_line<uint8_t>(len, lut8, in, out);
+                } else {
+                        apply_lut_line<uint16_t>(len, lut16, in, out);
+                }
+        }
+
 private:
+        template<typename T>
+        static void apply_lut_line(size_t len, const vector<T> &lut, void const *in, void *out) {
+                auto *in_data = static_cast<const T *>(in);
+                auto *out_data = static_cast<T *>(out);
+                for (size_t i = 0; i < len / sizeof(T); ++i) {
+                        out_data[i] = lut[in_data[i]];
+                }
+        }
+
         template<typename inT, typename outT>
         struct data {
                 size_t len;
@@ -144,6 +197,17 @@ private:
                 }
         }
 
+#ifdef HAVE_CUDA
+        template<typename T>
+        static bool upload_lut(const vector<T> &lut, void **cuda_buf) {
+                return cuda_wrapper_malloc(cuda_buf, lut.size() * sizeof(T)) == CUDA_WRAPPER_SUCCESS
+                        && cuda_wrapper_memcpy(*cuda_buf, lut.data(), lut.size() * sizeof(T),
+                                        CUDA_WRAPPER_MEMCPY_HOST_TO_DEVICE) == CUDA_WRAPPER_SUCCESS;
+        }
+
+        void *cuda_lut[4]{}; ///< lut8, lut16, lut8_16 and lut16_8 in device memory
+#endif
+
         vector<uint8_t>  lut8;
         vector<uint16_t> lut16;
         vector<uint8_t>  lut16_8;
@@ -227,16 +291,78 @@ static auto filter(void *state, struct video_frame *in) -> video_frame *
         return out;
 }
 
+#ifdef HAVE_CUDA
+static auto filter_cuda(void *state, struct video_frame *in) -> video_frame *
+{
+        if ((in->color_spec != RGB && in->color_spec != RG48) || in->tile_count != 1) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Unable to apply lut on: " << get_codec_name(in->color_spec) << "\n";
+                VIDEO_FRAME_DISPOSE(in);
+                return nullptr;
+        }
+
+        auto *s = static_cast<state_capture_filter_gamma *>(state);
+        struct video_desc out_desc = video_desc_from_frame(in);
+        if (s->out_depth != 0) {
+                out_desc.color_spec = s->out_depth == 8 ? RGB : RG48;
+        }
+        struct video_frame *out = nullptr;
+        try {
+                s->cuda_pool.reconfigure(out_desc);
+                out = s->cuda_pool.get_disposable_frame();
+        } catch (std::exception &e) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Cannot allocate CUDA frame: " << e.what() << "\n";
+                VIDEO_FRAME_DISPOSE(in);
+                return nullptr;
+        }
+        out->mem_location = CUDA_MEM;
+
+        if (!s->apply_gamma_cuda(get_bits_per_component(in->color_spec), get_bits_per_component(out_desc.color_spec), in->tiles[0].data_len, in->tiles[0].data, out->tiles[0].data)) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "CUDA error: " << cuda_wrapper_last_error_string() << "\n";
+                VIDEO_FRAME_DISPOSE(out);
+                out = nullptr;
+        }
+
+        VIDEO_FRAME_DISPOSE(in);
+
+        return out;
+}
+#endif
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         auto *s = (state_capture_filter_gamma *) state;
         s->vo_pp_out_buffer = buffer;
 }
 
+static bool supports(void *state, codec_t codec)
+{
+        auto *s = static_cast<state_capture_filter_gamma *>(state);
+        return (codec == RGB || codec == RG48)
+                && (s->out_depth == 0 || s->out_depth == get_bits_per_component(codec));
+}
+
+static void process_line(void *state, codec_t codec, const unsigned char *in, unsigned char *out, int width)
+{
+        auto *s = static_cast<state_capture_filter_gamma *>(state);
+        s->apply_gamma_line(get_bits_per_component(codec), vc_get_linesize(width, codec), in, out);
+}
+
+static const struct capture_filter_line_kernel gamma_line_kernel = {
+        .supports = supports,
+        .process = process_line,
+        .flip_vertical = false,
+};
+
 static const struct capture_filter_info capture_filter_gamma = {
         .init = init,
         .done = done,
         .filter = filter,
+        .line_kernel = &gamma_line_kernel,
+#ifdef HAVE_CUDA
+        .filter_cuda = filter_cuda,
+#else
+        .filter_cuda = nullptr,
+#endif
 };
 
 REGISTER_MODULE(gamma, &capture_filter_gamma, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -73,6 +73,16 @@ static void done(void *state)
         free(state);
 }
 
+/// in and out may be the same buffer
+static void grayscale_UYVY(unsigned char *out_data, const unsigned char *in_data, size_t pixels)
+{
+        for (size_t i = 0; i < pixels; ++i) {
+                *out_data++ = 127;
+                in_data++;
+                *out_data++ = *in_data++;
+        }
+}
+
 static struct video_frame *filter(void *state, struct video_frame *in)
 {
         struct state_grayscale *s = state;
@@ -90,14 +100,8 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         }
         out->callbacks.dispose = vf_free;
 
-        unsigned char *in_data = (unsigned char *) in->tiles[0].data;
-        unsigned char *out_data = (unsigned char *) out->tiles[0].data;
-
-        for (unsigned int i = 0; i < in->tiles[0].width * in->tiles[0].height; ++i) {
-                *out_data++ = 127;
-                in_data++;
-                *out_data++ = *in_data++;
-        }
+        grayscale_UYVY((unsigned char *) out->tiles[0].data, (unsigned char *) in->tiles[0].data,
+                        in->tiles[0].width * in->tiles[0].height);
 
         VIDEO_FRAME_DISPOSE(in);
 
@@ -111,10 +115,28 @@ static void vo_pp_set_out_buffer(void *state, char *buffer)
 }
 
 
+static bool supports(void *state, codec_t codec)
+{
+        UNUSED(state);
+        return codec == UYVY;
+}
+
+static void process_line(void *state, codec_t codec, const unsigned char *in, unsigned char *out, int width)
+{
+        UNUSED(state), UNUSED(codec);
+        grayscale_UYVY(out, in, width);
+}
+
+static const struct capture_filter_line_kernel grayscale_line_kernel = {
+        .supports = supports,
+        .process = process_line,
+};
+
 static const struct capture_filter_info capture_filter_grayscale = {
         .init = init,
         .done = done,
         .filter = filter,
+        .line_kernel = &grayscale_line_kernel,
 };
 
 REGISTER_MODULE(grayscale, &capture_filter_grayscale, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
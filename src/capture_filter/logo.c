@@ -45,6 +45,7 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/macros.h"
+#include "utils/overlay.h"
 #include "utils/pam.h"
 #include "video.h"
 #include "video_codec.h"
@@ -57,6 +58,8 @@ struct state_capture_filter_logo {
         unsigned int height;
         int x;
         int y;
+        struct overlay *overlay; ///< logo pre-rendered in overlay_codec
+        codec_t overlay_codec;
 };
 
 static int init(struct module *parent, const char *cfg, void **state);
@@ -146,6 +149,7 @@ static void done(void *state)
 {
         struct state_capture_filter_logo *s = (struct state_capture_filter_logo *)
                 state;
+        overlay_destroy(s->overlay);
         free(s->logo);
         free(s);
 }
@@ -155,14 +159,8 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         struct state_capture_filter_logo *s = (struct state_capture_filter_logo *)
                 state;
         decoder_t decoder, coder;
-        decoder = get_decoder_from_to(in->color_spec, RGB);
-        coder = get_decoder_from_to(RGB, in->color_spec);
         int rect_x = s->x;
         int rect_y = s->y;
-        assert(coder != NULL && decoder != NULL);
-
-        if (decoder == NULL || coder == NULL)
-                return in;
 
         if (rect_x < 0 || rect_x + s->width > in->tiles[0].width) {
                 rect_x = in->tiles[0].width - s->width;
@@ -177,6 +175,24 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         if (rect_x < 0 || rect_y < 0)
                 return in;
 
+        if (overlay_codec_supported(in->color_spec)) {
+                if (s->overlay == NULL || s->overlay_codec != in->color_spec) {
+                        overlay_destroy(s->overlay);
+                        s->overlay = overlay_create(s->logo, s->width, s->height, in->color_spec);
+                        s->overlay_codec = in->color_spec;
+                }
+                overlay_blend(s->overlay, in->tiles[0].data, vc_get_linesize(in->tiles[0].width, in->color_spec),
+                                rect_x, rect_y);
+                return in;
+        }
+
+        decoder = get_decoder_from_to(in->color_spec, RGB);
+        coder = get_decoder_from_to(RGB, in->color_spec);
+        assert(coder != NULL && decoder != NULL);
+
+        if (decoder == NULL || coder == NULL)
+                return in;
+
         int dec_width = s->width;
         dec_width = (dec_width  + 1) / get_pf_block_bytes(in->color_spec) * get_pf_block_bytes(in->color_spec);
         int linesize = dec_width * 3;
@@ -220,6 +236,8 @@ static const struct capture_filter_info capture_filter_logo = {
         init,
         done,
         filter,
+        NULL,
+        NULL,
 };
 
 REGISTER_MODULE(logo, &capture_filter_logo, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -0,0 +1,366 @@
+/**
+ * @file   capture_filter/lut3d.cpp
+ * @brief  3D LUT (.cube) application and HDR (PQ/HLG) to SDR tone mapping
+ *
+ * The tone mapping is baked to a 3D LUT together with an optional .cube
+ * file so that every pixel costs one interpolation regardless of the
+ * configuration. Frames in CUDA memory are processed on the GPU.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include "capture_filter.h"
+#ifdef HAVE_CUDA
+#include "cuda_wrapper.h"
+#endif
+#include "debug.h"
+#include "lib_common.h"
+#include "utils/color_out.h"
+#include "utils/lut3d.hpp"
+#ifdef HAVE_CUDA
+#include "utils/video_frame_pool.h"
+#endif
+#include "utils/worker.h"
+#include "video.h"
+#include "video_codec.h"
+
+#define MOD_NAME "[lut3d cap. f.] "
+#define DEFAULT_TONEMAP_LUT_SIZE 65
+#define ROWS_PER_TASK 32
+
+using std::string;
+
+struct state_lut3d {
+        lut3d lut;
+#ifdef HAVE_CUDA
+        video_frame_pool cuda_pool{0, cuda_data_allocator()}; ///< output frames for CUDA_MEM input
+        float *cuda_table = nullptr; ///< lut.table in device memory, uploaded on first use
+
+        ~state_lut3d() {
+                cuda_wrapper_free(cuda_table);
+        }
+#endif
+};
+
+static void usage()
+{
+        color_printf("Applies a 3D LUT and/or converts HDR video to SDR.\n\n"
+                        "usage:\n");
+        color_printf(TBOLD("\t--capture-filter lut3d[:file=<lut>.cube][:tonemap=pq|hlg[:peak=<nits>][:ref=<nits>]][:size=<n>]") "\n");
+        color_printf("where:\n");
+        color_printf(TBOLD("\tfile") " - 3D LUT in .cube format, applied after the tone mapping\n");
+        color_printf(TBOLD("\ttonemap") " - converts BT.2100 PQ or HLG RGB to BT.709 SDR RGB\n");
+        color_printf(TBOLD("\tpeak") " - luminance mapped to the SDR white (PQ mastering or HLG display peak, default %.0f)\n",
+                        tonemap_params().peak_nits);
+        color_printf(TBOLD("\tref") " - HDR reference white (default %.0f)\n", tonemap_params().ref_nits);
+        color_printf(TBOLD("\tsize") " - points per axis of the generated LUT (default %d or the .cube size)\n",
+                        DEFAULT_TONEMAP_LUT_SIZE);
+        color_printf("\nSupported codecs: RGB, RGBA, RG48, R10k (RGB, RGBA and RG48 in CUDA memory).\n");
+}
+
+static int init(struct module *parent, const char *cfg, void **state)
+{
+        UNUSED(parent);
+        if (strlen(cfg) == 0 || strcmp(cfg, "help") == 0) {
+                usage();
+                return 1;
+        }
+
+        string file;
+        bool tonemap = false;
+        struct tonemap_params tm;
+        int size = 0;
+        string cfg_c = cfg;
+        char *item = nullptr;
+        char *save_ptr = nullptr;
+        char *tmp = &cfg_c[0];
+        while ((item = strtok_r(tmp, ":", &save_ptr)) != nullptr) {
+                tmp = nullptr;
+                if (strstr(item, "file=") == item) {
+                        file = strchr(item, '=') + 1;
+                } else if (strcasecmp(item, "tonemap=pq") == 0 || strcasecmp(item, "tonemap=hlg") == 0) {
+                        tonemap = true;
+                        tm.transfer = strcasecmp(item, "tonemap=pq") == 0 ? TONEMAP_PQ : TONEMAP_HLG;
+                } else if (strstr(item, "peak=") == item) {
+                        tm.peak_nits = atof(strchr(item, '=') + 1);
+                } else if (strstr(item, "ref=") == item) {
+                        tm.ref_nits = atof(strchr(item, '=') + 1);
+                } else if (strstr(item, "size=") == item) {
+                        size = atoi(strchr(item, '=') + 1);
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", item);
+                        return -1;
+                }
+        }
+        if (file.empty() && !tonemap) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Either a LUT file or tone mapping must be given!\n");
+                return -1;
+        }
+        if (tm.peak_nits <= 0.0F || tm.ref_nits <= 0.0F || tm.ref_nits > tm.peak_nits
+                        || (size != 0 && (size < 2 || size > 256))) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong peak, ref or size value!\n");
+                return -1;
+        }
+
+        auto s = std::make_unique<state_lut3d>();
+        if (!file.empty() && !s->lut.load_cube(file.c_str())) {
+                return -1;
+        }
+        if (tonemap) {
+                lut3d cube = std::move(s->lut);
+                if (size == 0) {
+                        size = std::max(cube.size, DEFAULT_TONEMAP_LUT_SIZE);
+                }
+                s->lut = lut3d::generate(size, [&](const float *in, float *out) {
+                        tonemap_hdr_to_sdr(tm, in, out);
+                        if (cube.size != 0) {
+                                float sdr[3] = { out[0], out[1], out[2] };
+                                cube.sample(sdr, out);
+                        }
+                });
+        } else if (size != 0 && size != s->lut.size) {
+                lut3d cube = std::move(s->lut);
+                s->lut = lut3d::generate(size, [&](const float *in, float *out) { cube.sample(in, out); });
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using %d^3 LUT.\n", s->lut.size);
+
+        *state = s.release();
+        return 0;
+}
+
+static void done(void *state)
+{
+        delete static_cast<state_lut3d *>(state);
+}
+
+template<typename T>
+static inline T to_component(float val)
+{
+        constexpr float maxval = std::numeric_limits<T>::max();
+        return static_cast<T>(std::min(std::max(val, 0.0F), 1.0F) * maxval + 0.5F);
+}
+
+/// in and out may be the same (the pixel is read before it is written)
+template<typename T, int channels>
+static void process_line_interleaved(const lut3d &lut, const unsigned char *in, unsigned char *out, int width)
+{
+        constexpr float maxval = std::numeric_limits<T>::max();
+        const auto *src = reinterpret_cast<const T *>(in);
+        auto *dst = reinterpret_cast<T *>(out);
+        for (int x = 0; x < width; ++x) {
+                const float rgb[3] = { src[0] / maxval, src[1] / maxval, src[2] / maxval };
+                float res[3];
+                lut.sample(rgb, res);
+                const T alpha = channels == 4 ? src[3] : 0;
+                for (int c = 0; c < 3; ++c) {
+                        dst[c] = to_component<T>(res[c]);
+                }
+                if (channels == 4) {
+                        dst[3] = alpha;
+                }
+                src += channels;
+                dst += channels;
+        }
+}
+
+/// R10k - R9-R2 | R1-R0 G9-G4 | G3-G0 B9-B6 | B5-B0 XX
+static void process_line_r10k(const lut3d &lut, const unsigned char *in, unsigned char *out, int width)
+{
+        constexpr float maxval = 1023.0F;
+        for (int x = 0; x < width; ++x) {
+                const unsigned r = in[0] << 2U | in[1] >> 6U;
+                const unsigned g = (in[1] & 0x3FU) << 4U | in[2] >> 4U;
+                const unsigned b = (in[2] & 0xFU) << 6U | in[3] >> 2U;
+                const float rgb[3] = { r / maxval, g / maxval, b / maxval };
+                float res[3];
+                lut.sample(rgb, res);
+                unsigned o[3];
+                for (int c = 0; c < 3; ++c) {
+                        o[c] = static_cast<unsigned>(std::min(std::max(res[c], 0.0F), 1.0F) * maxval + 0.5F);
+                }
+                out[0] = o[0] >> 2U;
+                out[1] = (o[0] & 0x3U) << 6U | o[1] >> 4U;
+                out[2] = (o[1] & 0xFU) << 4U | o[2] >> 6U;
+                out[3] = (o[2] & 0x3FU) << 2U | 0x3U;
+                in += 4;
+                out += 4;
+        }
+}
+
+static bool supports(void *state, codec_t codec)
+{
+        UNUSED(state);
+        return codec == RGB || codec == RGBA || codec == RG48 || codec == R10k;
+}
+
+static void process_line(void *state, codec_t codec, const unsigned char *in, unsigned char *out, int width)
+{
+        const lut3d &lut = static_cast<state_lut3d *>(state)->lut;
+        switch (codec) {
+        case RGB:
+                process_line_interleaved<uint8_t, 3>(lut, in, out, width);
+                break;
+        case RGBA:
+                process_line_interleaved<uint8_t, 4>(lut, in, out, width);
+                break;
+        case RG48:
+                process_line_interleaved<uint16_t, 3>(lut, in, out, width);
+                break;
+        case R10k:
+                process_line_r10k(lut, in, out, width);
+                break;
+        default:
+                abort();
+        }
+}
+
+struct lut3d_pass {
+        void *state;
+        codec_t codec;
+        int width;
+        size_t linesize;
+        const unsigned char *in;
+        unsigned char *out;
+};
+
+static void process_rows(void *arg, size_t begin, size_t end)
+{
+        auto *p = static_cast<struct lut3d_pass *>(arg);
+        for (size_t y = begin; y < end; ++y) {
+                process_line(p->state, p->codec, p->in + y * p->linesize, p->out + y * p->linesize, p->width);
+        }
+}
+
+static struct video_frame *filter(void *state, struct video_frame *in)
+{
+        if (!supports(state, in->color_spec)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported codec %s!\n", get_codec_name(in->color_spec));
+                VIDEO_FRAME_DISPOSE(in);
+                return nullptr;
+        }
+        struct video_frame *out = vf_alloc_desc_data(video_desc_from_frame(in));
+        out->callbacks.dispose = vf_free;
+
+        for (unsigned int i = 0; i < in->tile_count; ++i) {
+                struct lut3d_pass pass{ state, in->color_spec, (int) in->tiles[i].width,
+                        (size_t) vc_get_linesize(in->tiles[i].width, in->color_spec),
+                        (const unsigned char *) in->tiles[i].data, (unsigned char *) out->tiles[i].data };
+                task_run_parallel_for(in->tiles[i].height, ROWS_PER_TASK, process_rows, &pass);
+        }
+
+        VIDEO_FRAME_DISPOSE(in);
+        return out;
+}
+
+#ifdef HAVE_CUDA
+static struct video_frame *filter_cuda(void *state, struct video_frame *in)
+{
+        auto *s = static_cast<state_lut3d *>(state);
+        if ((in->color_spec != RGB && in->color_spec != RGBA && in->color_spec != RG48) || in->tile_count != 1) {
+                struct video_frame *host_frame = vf_download_cuda(in);
+                VIDEO_FRAME_DISPOSE(in);
+                return host_frame != nullptr ? filter(state, host_frame) : nullptr;
+        }
+
+        if (s->cuda_table == nullptr) {
+                const size_t len = s->lut.table.size() * sizeof(float);
+                if (cuda_wrapper_malloc((void **) &s->cuda_table, len) != CUDA_WRAPPER_SUCCESS
+                                || cuda_wrapper_memcpy(s->cuda_table, s->lut.table.data(), len,
+                                        CUDA_WRAPPER_MEMCPY_HOST_TO_DEVICE) != CUDA_WRAPPER_SUCCESS) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot upload the LUT: %s\n", cuda_wrapper_last_error_string());
+                        cuda_wrapper_free(s->cuda_table);
+                        s->cuda_table = nullptr;
+                        VIDEO_FRAME_DISPOSE(in);
+                        return nullptr;
+                }
+        }
+
+        struct video_frame *out = nullptr;
+        try {
+                s->cuda_pool.reconfigure(video_desc_from_frame(in));
+                out = s->cuda_pool.get_disposable_frame();
+        } catch (std::exception &e) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot allocate CUDA frame: %s\n", e.what());
+                VIDEO_FRAME_DISPOSE(in);
+                return nullptr;
+        }
+        out->mem_location = CUDA_MEM;
+
+        const int channels = in->color_spec == RGBA ? 4 : 3;
+        const int bytes = in->color_spec == RG48 ? 2 : 1;
+        if (cuda_wrapper_apply_lut3d(out->tiles[0].data, in->tiles[0].data, (size_t) in->tiles[0].width * in->tiles[0].height,
+                                bytes, channels, s->cuda_table, s->lut.size, nullptr) != CUDA_WRAPPER_SUCCESS
+                        || cuda_wrapper_stream_synchronize(nullptr) != CUDA_WRAPPER_SUCCESS) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "CUDA error: %s\n", cuda_wrapper_last_error_string());
+                VIDEO_FRAME_DISPOSE(out);
+                out = nullptr;
+        }
+
+        VIDEO_FRAME_DISPOSE(in);
+        return out;
+}
+#endif
+
+static const struct capture_filter_line_kernel lut3d_line_kernel = {
+        .supports = supports,
+        .process = process_line,
+        .flip_vertical = false,
+};
+
+static const struct capture_filter_info capture_filter_lut3d = {
+        .init = init,
+        .done = done,
+        .filter = filter,
+        .line_kernel = &lut3d_line_kernel,
+#ifdef HAVE_CUDA
+        .filter_cuda = filter_cuda,
+#else
+        .filter_cuda = nullptr,
+#endif
+};
+
+REGISTER_MODULE(lut3d, &capture_filter_lut3d, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
+
+/* vim: set expandtab sw=8: */
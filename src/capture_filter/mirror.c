@@ -41,6 +41,8 @@
 #include "config_win32.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <string.h>
+
 #include "capture_filter.h"
 #include "debug.h"
 #include "lib_common.h"
@@ -73,22 +75,17 @@ static void done(void *state)
         free(state);
 }
 
+/// in and out may be the same line
 static void mirror_line_UYVY(unsigned char *dst, const unsigned char *src, int linesize)
 {
-        dst = dst + linesize;
-        while (linesize > 3) {
-                unsigned char u, y1, v, y2;
-                u = *src++;
-                y1 = *src++;
-                v = *src++;
-                y2 = *src++;
-
-                *--dst = y1;
-                *--dst = v;
-                *--dst = y2;
-                *--dst = u;
-
-                linesize -= 4;
+        const int count = linesize / 4;
+        for (int i = 0; i < (count + 1) / 2; ++i) {
+                const unsigned char *l = src + 4 * i;
+                const unsigned char *r = src + 4 * (count - 1 - i);
+                unsigned char left[4] = { r[0], r[3], r[2], r[1] };
+                unsigned char right[4] = { l[0], l[3], l[2], l[1] };
+                memcpy(dst + 4 * i, left, 4);
+                memcpy(dst + 4 * (count - 1 - i), right, 4);
         }
 }
 
@@ -129,10 +126,28 @@ static void vo_pp_set_out_buffer(void *state, char *buffer)
         s->vo_pp_out_buffer = buffer;
 }
 
+static bool supports(void *state, codec_t codec)
+{
+        UNUSED(state);
+        return codec == UYVY;
+}
+
+static void process_line(void *state, codec_t codec, const unsigned char *in, unsigned char *out, int width)
+{
+        UNUSED(state);
+        mirror_line_UYVY(out, in, vc_get_linesize(width, codec));
+}
+
+static const struct capture_filter_line_kernel mirror_line_kernel = {
+        .supports = supports,
+        .process = process_line,
+};
+
 static const struct capture_filter_info capture_filter_mirror = {
         .init = init,
         .done = done,
         .filter = filter,
+        .line_kernel = &mirror_line_kernel,
 };
 
 REGISTER_MODULE(mirror, &capture_filter_mirror, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -85,6 +85,7 @@ static const struct capture_filter_info capture_filter_none = {
         .init = init,
         .done = done,
         .filter = filter,
+        .filter_cuda = filter,
 };
 
 REGISTER_HIDDEN_MODULE(none, &capture_filter_none, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
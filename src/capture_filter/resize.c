@@ -53,6 +53,7 @@
 
 #include "capture_filter.h"
 #include "capture_filter/resize_utils.h"
+#include "capture_filter/resize_yuv.h"
 #include "debug.h"
 #include "lib_common.h"
 #include "video.h"
@@ -89,6 +90,7 @@ struct state_resize {
     struct video_desc saved_desc;
     struct video_desc out_desc;
     char *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+    struct resize_yuv *yuv; ///< resizer of YUV formats keeping the pixel format
 };
 
 static void usage() {
@@ -177,6 +179,7 @@ static int init(struct module * parent, const char *cfg, void **state)
 
     struct state_resize *s = calloc(1, sizeof(struct state_resize));
     s->param = param;
+    s->yuv = resize_yuv_init();
 
     *state = s;
     return 0;
@@ -184,7 +187,9 @@ static int init(struct module * parent, const char *cfg, void **state)
 
 static void done(void *state)
 {
-    free(state);
+    struct state_resize *s = state;
+    resize_yuv_done(s->yuv);
+    free(s);
 }
 
 static struct video_frame *filter(void *state, struct video_frame *in)
@@ -201,7 +206,8 @@ static struct video_frame *filter(void *state, struct video_frame *in)
             desc.width = in->tiles[0].width * s->param.num / s->param.denom;
             desc.height = in->tiles[0].height * s->param.num / s->param.denom;
         }
-        desc.color_spec = RGB;
+        // YUV formats are resized natively, others are converted to RGB by OpenCV
+        desc.color_spec = resize_yuv_supported(desc.color_spec) ? desc.color_spec : RGB;
         if (s->param.force_interlaced) {
                 desc.interlacing = INTERLACED_MERGED;
         } else if (s->param.force_progressive) {
@@ -221,7 +227,9 @@ static struct video_frame *filter(void *state, struct video_frame *in)
 
     for (unsigned int i = 0; i < frame->tile_count; i++) {
         int res;
-        if (s->param.mode == USE_DIMENSIONS) {
+        if (resize_yuv_supported(in->color_spec)) {
+            res = resize_yuv_frame(s->yuv, in->tiles[i].data, in->color_spec, frame->tiles[i].data, in->tiles[i].width, in->tiles[i].height, s->out_desc.width, s->out_desc.height);
+        } else if (s->param.mode == USE_DIMENSIONS) {
             res = resize_frame(in->tiles[i].data, in->color_spec, frame->tiles[i].data, in->tiles[i].width, in->tiles[i].height, s->param.target_width, s->param.target_height);
         } else {
             res = resize_frame_factor(in->tiles[i].data, in->color_spec, frame->tiles[i].data, in->tiles[i].width, in->tiles[i].height, (double)s->param.num/s->param.denom);
@@ -252,6 +260,8 @@ static struct capture_filter_info capture_filter_resize = {
     init,
     done,
     filter,
+    NULL,
+    NULL,
 };
 
 REGISTER_MODULE(resize, &capture_filter_resize, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
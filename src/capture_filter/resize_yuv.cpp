@@ -0,0 +1,445 @@
+/**
+ * @file   capture_filter/resize_yuv.cpp
+ * @brief  separable resize of YUV frames in their native subsampling and depth
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "capture_filter/resize_yuv.h"
+#include "utils/macros.h"
+#include "utils/worker.h"
+#include "video_codec.h"
+
+#define COEF_BITS 14 ///< fixed-point precision of the filter coefficients
+#define ROWS_PER_TASK 16
+
+using std::max;
+using std::min;
+using std::pair;
+using std::vector;
+
+namespace {
+/// filter of one axis - every output position reads taps consecutive source samples
+struct filter_taps {
+        int taps = 0;
+        vector<int> start; ///< first source sample of each output position
+        vector<int16_t> coefs; ///< taps coefficients for each output position
+};
+
+struct plane {
+        int width = 0;
+        int height = 0;
+        vector<uint16_t> data; ///< 16-bit samples regardless of the source depth
+        uint16_t *row(int y) { return data.data() + (size_t) y * width; }
+};
+
+struct rect {
+        int x, y, width, height;
+};
+
+template<typename F>
+void parallel_rows(int count, F &&f) {
+        task_run_parallel_for(count, ROWS_PER_TASK, [](void *udata, size_t begin, size_t end) {
+                        (*static_cast<F *>(udata))((int) begin, (int) end);
+                }, &f);
+}
+
+/**
+ * Computes triangle (linear) filter taps. When downscaling, the filter is
+ * widened to the scale ratio so that all source samples contribute (no
+ * aliasing while decimating, eg. for 4K->1080p).
+ */
+filter_taps compute_taps(int in_len, int out_len) {
+        filter_taps f;
+        const double scale = (double) in_len / out_len;
+        const double support = max(1.0, scale);
+        f.taps = min(in_len, (int) ceil(support * 2) + 1);
+        f.start.resize(out_len);
+        f.coefs.resize((size_t) out_len * f.taps);
+        vector<double> w(f.taps);
+        for (int x = 0; x < out_len; ++x) {
+                const double center = (x + 0.5) * scale - 0.5;
+                int first = (int) floor(center - support) + 1;
+                first = max(0, min(first, in_len - f.taps));
+                double sum = 0;
+                for (int k = 0; k < f.taps; ++k) {
+                        w[k] = max(0.0, 1.0 - fabs(first + k - center) / support);
+                        sum += w[k];
+                }
+                if (sum == 0) { // center far out of the source (only with tiny sources)
+                        w[min(max(0, (int) lround(center) - first), f.taps - 1)] = sum = 1;
+                }
+                int16_t *c = &f.coefs[(size_t) x * f.taps];
+                int total = 0;
+                int largest = 0;
+                for (int k = 0; k < f.taps; ++k) {
+                        c[k] = (int16_t) lround(w[k] / sum * (1 << COEF_BITS));
+                        total += c[k];
+                        largest = c[k] > c[largest] ? k : largest;
+                }
+                c[largest] += (1 << COEF_BITS) - total; // coefficients must sum to 1 exactly
+                f.start[x] = first;
+        }
+        return f;
+}
+
+struct format_info {
+        int h_sub; ///< chroma horizontal subsampling
+        int v_sub; ///< chroma vertical subsampling
+        int planes; ///< Y, Cb, Cr [, A]
+};
+
+format_info get_format_info(codec_t codec) {
+        switch (codec) {
+        case UYVY:
+        case v210:
+                return { 2, 1, 3 };
+        case I420:
+                return { 2, 2, 3 };
+        case Y416:
+                return { 1, 1, 4 };
+        default:
+                return { 0, 0, 0 };
+        }
+}
+
+inline uint16_t to8(uint16_t val) {
+        return min((val + 128) >> 8, 255);
+}
+
+inline uint16_t to10(uint16_t val) {
+        return min((val + 32) >> 6, 1023);
+}
+
+/// converts row y of the frame to planes
+void unpack_row(codec_t codec, const char *in, int width, int height, int y, plane *p) {
+        uint16_t *Y = p[0].row(y);
+        switch (codec) {
+        case UYVY: {
+                auto *src = (const unsigned char *) in + (size_t) y * vc_get_linesize(width, UYVY);
+                uint16_t *Cb = p[1].row(y);
+                uint16_t *Cr = p[2].row(y);
+                for (int x = 0; x < p[1].width; ++x) {
+                        Cb[x] = src[4 * x] << 8;
+                        Y[2 * x] = src[4 * x + 1] << 8;
+                        Cr[x] = src[4 * x + 2] << 8;
+                        if (2 * x + 1 < width) {
+                                Y[2 * x + 1] = src[4 * x + 3] << 8;
+                        }
+                }
+                break;
+        }
+        case v210: {
+                const char *src = in + (size_t) y * vc_get_linesize(width, v210);
+                uint16_t *dst[] = { p[1].row(y), Y, p[2].row(y), Y }; // component order Cb Y Cr Y
+                int idx[4] = { 0, 0, 0, 0 }; // Cb, Y, Cr, (Y)
+                const int len[] = { p[1].width, width, p[2].width };
+                for (int comp = 0; idx[1] < width || idx[2] < len[2]; src += 4) {
+                        uint32_t word = 0;
+                        memcpy(&word, src, sizeof word);
+                        for (int i = 0; i < 3; ++i, comp = (comp + 1) % 4, word >>= 10) {
+                                int type = comp % 2 == 1 ? 1 : comp;
+                                if (idx[type] < len[type]) {
+                                        dst[comp][idx[type]++] = (word & 0x3ff) << 6;
+                                }
+                        }
+                }
+                break;
+        }
+        case I420: {
+                const auto *src = (const unsigned char *) in;
+                const size_t chroma_size = (size_t) p[1].width * p[1].height;
+                const unsigned char *src_y = src + (size_t) y * width;
+                for (int x = 0; x < width; ++x) {
+                        Y[x] = src_y[x] << 8;
+                }
+                if (y < p[1].height) {
+                        const unsigned char *src_cb = src + (size_t) width * height + (size_t) y * p[1].width;
+                        const unsigned char *src_cr = src_cb + chroma_size;
+                        uint16_t *Cb = p[1].row(y);
+                        uint16_t *Cr = p[2].row(y);
+                        for (int x = 0; x < p[1].width; ++x) {
+                                Cb[x] = src_cb[x] << 8;
+                                Cr[x] = src_cr[x] << 8;
+                        }
+                }
+                break;
+        }
+        case Y416: {
+                const char *src = in + (size_t) y * vc_get_linesize(width, Y416);
+                uint16_t *Cb = p[1].row(y);
+                uint16_t *Cr = p[2].row(y);
+                uint16_t *A = p[3].row(y);
+                for (int x = 0; x < width; ++x) {
+                        uint16_t px[4];
+                        memcpy(px, src + 8 * x, sizeof px);
+                        Cb[x] = px[0];
+                        Y[x] = px[1];
+                        Cr[x] = px[2];
+                        A[x] = px[3];
+                }
+                break;
+        }
+        default:
+                abort();
+        }
+}
+
+/// converts row y of the planes to the frame
+void pack_row(codec_t codec, plane *p, int width, int height, int y, char *out) {
+        const uint16_t *Y = p[0].row(y);
+        switch (codec) {
+        case UYVY: {
+                auto *dst = (unsigned char *) out + (size_t) y * vc_get_linesize(width, UYVY);
+                const uint16_t *Cb = p[1].row(y);
+                const uint16_t *Cr = p[2].row(y);
+                for (int x = 0; x < p[1].width; ++x) {
+                        dst[4 * x] = to8(Cb[x]);
+                        dst[4 * x + 1] = to8(Y[2 * x]);
+                        dst[4 * x + 2] = to8(Cr[x]);
+                        dst[4 * x + 3] = to8(Y[min(2 * x + 1, width - 1)]);
+                }
+                break;
+        }
+        case v210: {
+                char *dst = out + (size_t) y * vc_get_linesize(width, v210);
+                const uint16_t *src[] = { p[1].row(y), Y, p[2].row(y), Y };
+                int idx[3] = { 0, 0, 0 };
+                const int len[] = { p[1].width, width, p[2].width };
+                char *line_end = dst + vc_get_linesize(width, v210);
+                int comp = 0;
+                for ( ; idx[1] < width || idx[2] < len[2]; dst += 4) {
+                        uint32_t word = 0;
+                        for (int i = 0; i < 3; ++i, comp = (comp + 1) % 4) {
+                                int type = comp % 2 == 1 ? 1 : comp;
+                                uint16_t val = src[comp][min(idx[type], len[type] - 1)];
+                                idx[type] += 1;
+                                word |= (uint32_t) to10(val) << (10 * i);
+                        }
+                        memcpy(dst, &word, sizeof word);
+                }
+                memset(dst, 0, line_end - dst);
+                break;
+        }
+        case I420: {
+                auto *dst = (unsigned char *) out;
+                const size_t chroma_size = (size_t) p[1].width * p[1].height;
+                unsigned char *dst_y = dst + (size_t) y * width;
+                for (int x = 0; x < width; ++x) {
+                        dst_y[x] = to8(Y[x]);
+                }
+                if (y < p[1].height) {
+                        unsigned char *dst_cb = dst + (size_t) width * height + (size_t) y * p[1].width;
+                        unsigned char *dst_cr = dst_cb + chroma_size;
+                        const uint16_t *Cb = p[1].row(y);
+                        const uint16_t *Cr = p[2].row(y);
+                        for (int x = 0; x < p[1].width; ++x) {
+                                dst_cb[x] = to8(Cb[x]);
+                                dst_cr[x] = to8(Cr[x]);
+                        }
+                }
+                break;
+        }
+        case Y416: {
+                char *dst = out + (size_t) y * vc_get_linesize(width, Y416);
+                const uint16_t *Cb = p[1].row(y);
+                const uint16_t *Cr = p[2].row(y);
+                const uint16_t *A = p[3].row(y);
+                for (int x = 0; x < width; ++x) {
+                        uint16_t px[4] = { Cb[x], Y[x], Cr[x], A[x] };
+                        memcpy(dst + 8 * x, px, sizeof px);
+                }
+                break;
+        }
+        default:
+                abort();
+        }
+}
+} // end of anonymous namespace
+
+struct resize_yuv {
+        plane in[4];
+        plane out[4];
+        vector<uint16_t> tmp; ///< horizontally resized plane
+        std::map<pair<int, int>, filter_taps> taps_cache; ///< indexed by (in_len, out_len)
+
+        const filter_taps &get_taps(int in_len, int out_len) {
+                auto it = taps_cache.find({ in_len, out_len });
+                if (it == taps_cache.end()) {
+                        it = taps_cache.emplace(pair<int, int>{ in_len, out_len }, compute_taps(in_len, out_len)).first;
+                }
+                return it->second;
+        }
+
+        /// resizes src to the area r of dst
+        void resize_plane(plane &src, plane &dst, rect r) {
+                const filter_taps &h = get_taps(src.width, r.width);
+                const filter_taps &v = get_taps(src.height, r.height);
+                tmp.resize((size_t) src.height * r.width);
+
+                parallel_rows(src.height, [&](int begin, int end) {
+                        for (int y = begin; y < end; ++y) {
+                                const uint16_t *in_row = src.row(y);
+                                uint16_t *out_row = tmp.data() + (size_t) y * r.width;
+                                for (int x = 0; x < r.width; ++x) {
+                                        const uint16_t *s = in_row + h.start[x];
+                                        const int16_t *c = &h.coefs[(size_t) x * h.taps];
+                                        int32_t acc = 1 << (COEF_BITS - 1);
+                                        for (int k = 0; k < h.taps; ++k) {
+                                                acc += c[k] * s[k];
+                                        }
+                                        out_row[x] = acc >> COEF_BITS;
+                                }
+                        }
+                });
+
+                parallel_rows(r.height, [&](int begin, int end) {
+                        vector<int32_t> acc(r.width);
+                        for (int y = begin; y < end; ++y) {
+                                std::fill(acc.begin(), acc.end(), 1 << (COEF_BITS - 1));
+                                for (int k = 0; k < v.taps; ++k) {
+                                        const int32_t c = v.coefs[(size_t) y * v.taps + k];
+                                        const uint16_t *s = tmp.data() + (size_t) (v.start[y] + k) * r.width;
+                                        int32_t *a = acc.data();
+                                        OPTIMIZED_FOR (int x = 0; x < r.width; ++x) {
+                                                a[x] += c * s[x];
+                                        }
+                                }
+                                uint16_t *out_row = dst.row(r.y + y) + r.x;
+                                OPTIMIZED_FOR (int x = 0; x < r.width; ++x) {
+                                        out_row[x] = acc[x] >> COEF_BITS;
+                                }
+                        }
+                });
+        }
+};
+
+struct resize_yuv *resize_yuv_init(void)
+{
+        return new resize_yuv();
+}
+
+void resize_yuv_done(struct resize_yuv *s)
+{
+        delete s;
+}
+
+bool resize_yuv_supported(codec_t codec)
+{
+        return get_format_info(codec).planes != 0;
+}
+
+static void set_plane_sizes(plane *p, format_info fmt, int width, int height)
+{
+        for (int i = 0; i < fmt.planes; ++i) {
+                const bool chroma = i == 1 || i == 2;
+                p[i].width = chroma ? (width + fmt.h_sub - 1) / fmt.h_sub : width;
+                p[i].height = chroma ? (height + fmt.v_sub - 1) / fmt.v_sub : height;
+                p[i].data.resize((size_t) p[i].width * p[i].height);
+        }
+}
+
+/**
+ * Resizes the frame keeping its pixel format. If the aspect ratio differs,
+ * the picture is centered and the remaining area is filled with black.
+ *
+ * The samples are processed with 16-bit precision, so 10-bit and 16-bit
+ * formats keep their depth. Chroma planes are resized separately in their
+ * subsampled resolution.
+ *
+ * @retval 0 on success
+ */
+int resize_yuv_frame(struct resize_yuv *s, const char *indata, codec_t codec, char *outdata,
+                unsigned int width, unsigned int height, unsigned int target_width, unsigned int target_height)
+{
+        const format_info fmt = get_format_info(codec);
+        if (indata == NULL || outdata == NULL || fmt.planes == 0 || width == 0 || height == 0
+                        || target_width == 0 || target_height == 0) {
+                return 1;
+        }
+
+        // placement of the picture, aligned to the chroma subsampling
+        rect r{ 0, 0, (int) target_width, (int) target_height };
+        if ((long long) width * target_height > (long long) target_width * height) {
+                r.height = max<int>(fmt.v_sub, (long long) target_width * height / width / fmt.v_sub * fmt.v_sub);
+                r.y = ((int) target_height - r.height) / 2 / fmt.v_sub * fmt.v_sub;
+        } else if ((long long) width * target_height < (long long) target_width * height) {
+                r.width = max<int>(fmt.h_sub, (long long) target_height * width / height / fmt.h_sub * fmt.h_sub);
+                r.x = ((int) target_width - r.width) / 2 / fmt.h_sub * fmt.h_sub;
+        }
+
+        set_plane_sizes(s->in, fmt, width, height);
+        set_plane_sizes(s->out, fmt, target_width, target_height);
+
+        parallel_rows(height, [&](int begin, int end) {
+                for (int y = begin; y < end; ++y) {
+                        unpack_row(codec, indata, width, height, y, s->in);
+                }
+        });
+
+        for (int i = 0; i < fmt.planes; ++i) {
+                const bool chroma = i == 1 || i == 2;
+                rect pr = r;
+                if (chroma) {
+                        pr = { r.x / fmt.h_sub, r.y / fmt.v_sub,
+                                min((r.width + fmt.h_sub - 1) / fmt.h_sub, s->out[i].width - r.x / fmt.h_sub),
+                                min((r.height + fmt.v_sub - 1) / fmt.v_sub, s->out[i].height - r.y / fmt.v_sub) };
+                }
+                if (pr.width != s->out[i].width || pr.height != s->out[i].height) {
+                        const uint16_t black = i == 0 ? 16 << 8 : i == 3 ? 0xffff : 128 << 8;
+                        std::fill(s->out[i].data.begin(), s->out[i].data.end(), black);
+                }
+                s->resize_plane(s->in[i], s->out[i], pr);
+        }
+
+        parallel_rows(target_height, [&](int begin, int end) {
+                for (int y = begin; y < end; ++y) {
+                        pack_row(codec, s->out, target_width, target_height, y, outdata);
+                }
+        });
+        return 0;
+}
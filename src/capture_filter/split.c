@@ -100,6 +100,11 @@ static void done(void *state)
         free(state);
 }
 
+static void dispose_frame(struct video_frame *f) {
+        VIDEO_FRAME_DISPOSE((struct video_frame *) f->callbacks.dispose_udata);
+        vf_free(f);
+}
+
 static struct video_frame *filter(void *state, struct video_frame *in)
 {
         struct state_split *s = state;
@@ -108,11 +113,11 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         desc.tile_count = s->x * s->y;
         desc.width /= s->x;
         desc.height /= s->y;
-        struct video_frame *out = vf_alloc_desc_data(desc);
-        vf_split(out, in, s->x, s->y, 0);
-        out->callbacks.dispose = vf_free;
+        struct video_frame *out = vf_alloc_desc(desc);
+        vf_split_view(out, in, s->x, s->y);
+        out->callbacks.dispose = dispose_frame;
+        out->callbacks.dispose_udata = in;
 
-        VIDEO_FRAME_DISPOSE(in);
         return out;
 }
 
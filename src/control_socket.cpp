@@ -44,12 +44,13 @@
 #include "control_socket.h"
 #include "compat/platform_pipe.h"
 
-#include <condition_variable>
-#include <mutex>
-#include <queue>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <stdio.h>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "debug.h"
 #include "host.h"
@@ -57,6 +58,8 @@
 #include "module.h"
 #include "rtp/net_udp.h" // socket_error
 #include "tv.h"
+#include "utils/lockfree_queue.h"
+#include "utils/metrics.h"
 #include "utils/net.h"
 #include "utils/thread.h"
 
@@ -75,6 +78,11 @@ struct client {
         char buff[1024];
         int buff_len;
 
+        vector<string> subscriptions; ///< names of the wanted stats/events ("stats"/"event" for all of a type), empty - all
+        bool json = false; ///< stats and events are sent as JSON objects
+        string out; ///< output not yet written to the (non-blocking) socket
+        unsigned long dropped = 0; ///< stats/events dropped because the client didn't keep up
+
         struct client *prev;
         struct client *next;
 };
@@ -84,7 +92,18 @@ enum connection_type {
         CLIENT
 };
 
-#define MAX_STAT_EVENT_QUEUE 100
+#define MAX_STAT_EVENT_QUEUE 256
+#define MAX_CLIENT_BACKLOG (256 * 1024) ///< max pending stats bytes of a client, newer records are dropped
+#define STAT_NAME_LEN 32
+
+/// stats or event record passed from the reporters to the control thread
+struct stat_record {
+        bool event = false;
+        char name[STAT_NAME_LEN] = "";
+        int field_count = 0;
+        struct control_stat_field fields[CONTROL_STAT_MAX_FIELDS]{};
+        string text; ///< free-form rest of the line of text reports
+};
 
 struct control_state {
         struct module mod;
@@ -94,17 +113,14 @@ struct control_state {
         int network_port;
         struct module *root_module;
 
-        std::mutex stats_lock;
-
         enum connection_type connection_type;
 
         fd_t socket_fd = INVALID_SOCKET;
 
         bool started;
 
-        thread stat_event_thread_id;
-        condition_variable stat_event_cv;
-        queue<string> stat_event_queue;
+        lockfree_queue<stat_record, MAX_STAT_EVENT_QUEUE> stat_queue;
+        atomic<bool> stat_wakeup{false}; ///< control thread has been woken up to send the queued records
 
         bool stats_on;
 };
@@ -116,8 +132,7 @@ static bool parse_msg(char *buffer, int buffer_len, /* out */ char *message, int
 static int process_msg(struct control_state *s, fd_t client_fd, char *message, struct client *clients);
 static ssize_t write_all(fd_t fd, const void *buf, size_t count);
 static void * control_thread(void *args);
-static void * stat_event_thread(void *args);
-static void send_response(fd_t fd, struct response *resp);
+static void send_response(struct control_state *s, struct client *client, fd_t fd, struct response *resp);
 static void print_control_help();
 
 #ifndef MSG_NOSIGNAL
@@ -295,7 +310,6 @@ void control_start(struct control_state *s)
         platform_pipe_init(s->internal_fd);
 
         s->control_thread_id = thread(control_thread, s);
-        s->stat_event_thread_id = thread(stat_event_thread, s);
 
         log_msg(LOG_LEVEL_NOTICE, "Control socket listening on port %d\n",
                         socket_get_recv_port(s->socket_fd));
@@ -306,6 +320,154 @@ void control_start(struct control_state *s)
 #define suffix(x,y) x + strlen(y)
 #define is_internal_port(x) (x == s->internal_fd[0])
 
+/// writes as much of the pending output of the client as the socket accepts
+static void client_flush(struct client *c)
+{
+        while (!c->out.empty()) {
+                ssize_t ret = send(c->fd, c->out.data(), c->out.size(), MSG_NOSIGNAL);
+                if (ret <= 0) {
+                        break;
+                }
+                c->out.erase(0, ret);
+        }
+}
+
+/**
+ * @param droppable the data are stats/event record that is dropped if the
+ *                  client backlog is full (responses are never dropped)
+ * @retval false    the data were dropped
+ */
+static bool client_write(struct client *c, const char *data, size_t len, bool droppable)
+{
+        if (droppable && c->out.size() + len > MAX_CLIENT_BACKLOG) {
+                c->dropped += 1;
+                return false;
+        }
+        c->out.append(data, len);
+        client_flush(c);
+        return true;
+}
+
+static void reply(struct control_state *s, struct client *client, fd_t fd, const char *data, size_t len)
+{
+        if (client != nullptr && !is_internal_port(fd)) {
+                client_write(client, data, len, false);
+                return;
+        }
+        if (write_all(fd, data, len) != (ssize_t) len) {
+                socket_error("Unable to write response");
+        }
+}
+
+static bool client_subscribed(const struct client *c, const struct stat_record &rec)
+{
+        if (c->subscriptions.empty()) {
+                return true;
+        }
+        for (auto const &name : c->subscriptions) {
+                if (name == rec.name || name == (rec.event ? "event" : "stats")) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+static string format_text(const struct stat_record &rec)
+{
+        string line = rec.event ? "event " : "stats ";
+        line += rec.name;
+        char buf[128];
+        for (int i = 0; i < rec.field_count; ++i) {
+                double val = rec.fields[i].value;
+                // integers exactly, others as the iostreams did for the text reports
+                snprintf(buf, sizeof buf, std::isfinite(val) && val == std::floor(val) && std::fabs(val) < 1e15 ? " %s %.0f" : " %s %g",
+                                rec.fields[i].key, val);
+                line += buf;
+        }
+        if (!rec.text.empty()) {
+                line += " " + rec.text;
+        }
+        return line + "\r\n";
+}
+
+static void append_json_string(string &out, const char *str)
+{
+        out += '"';
+        for ( ; *str != '\0'; ++str) {
+                if (*str == '"' || *str == '\\') {
+                        out += '\\';
+                        out += *str;
+                } else if ((unsigned char) *str < 0x20) {
+                        char buf[8];
+                        snprintf(buf, sizeof buf, "\\u%04x", (unsigned char) *str);
+                        out += buf;
+                } else {
+                        out += *str;
+                }
+        }
+        out += '"';
+}
+
+static string format_json(const struct stat_record &rec)
+{
+        string line = rec.event ? "{\"type\":\"event\",\"name\":" : "{\"type\":\"stats\",\"name\":";
+        append_json_string(line, rec.name);
+        if (rec.field_count > 0) {
+                line += ",\"fields\":{";
+                for (int i = 0; i < rec.field_count; ++i) {
+                        if (i > 0) {
+                                line += ',';
+                        }
+                        append_json_string(line, rec.fields[i].key);
+                        char buf[32] = "null";
+                        if (std::isfinite(rec.fields[i].value)) {
+                                snprintf(buf, sizeof buf, "%.17g", rec.fields[i].value);
+                        }
+                        line += ':';
+                        line += buf;
+                }
+                line += '}';
+        }
+        if (!rec.text.empty()) {
+                line += ",\"text\":";
+                append_json_string(line, rec.text.c_str());
+        }
+        return line + "}\r\n";
+}
+
+/**
+ * Sends the queued stats and events to the subscribed remote clients. Every
+ * record is formatted only once per format and only if some client wants it.
+ */
+static void send_stat_records(struct control_state *s, struct client *clients)
+{
+        s->stat_wakeup.store(false);
+        stat_record rec;
+        while (s->stat_queue.try_pop(rec)) {
+                string text;
+                string json;
+                for (struct client *cur = clients; cur != nullptr; cur = cur->next) {
+                        if (is_internal_port(cur->fd) || !client_subscribed(cur, rec)) {
+                                continue;
+                        }
+                        if (cur->dropped > 0 && cur->out.size() < MAX_CLIENT_BACKLOG / 2) {
+                                string msg = "event dropped " + to_string(cur->dropped) + "\r\n";
+                                if (cur->json) {
+                                        msg = "{\"type\":\"event\",\"name\":\"dropped\",\"fields\":{\"count\":"
+                                                + to_string(cur->dropped) + "}}\r\n";
+                                }
+                                cur->dropped = 0;
+                                client_write(cur, msg.c_str(), msg.length(), false);
+                        }
+                        string &line = cur->json ? json : text;
+                        if (line.empty()) {
+                                line = cur->json ? format_json(rec) : format_text(rec);
+                        }
+                        client_write(cur, line.c_str(), line.length(), true);
+                }
+        }
+}
+
 /**
   * @retval -1 exit thread
   * @retval -2 close handle
@@ -313,6 +475,10 @@ void control_start(struct control_state *s)
 static int process_msg(struct control_state *s, fd_t client_fd, char *message, struct client *clients)
 {
         int ret = 0;
+        struct client *client = clients;
+        while (client != nullptr && client->fd != client_fd) {
+                client = client->next;
+        }
         struct response *resp = NULL;
         char path[1024] = ""; // path for msg receiver (usually video)
         char path_audio[1024] = ""; // auxiliary buffer used when we need to signalize both audio
@@ -361,44 +527,29 @@ static int process_msg(struct control_state *s, fd_t client_fd, char *message, s
                 return ret;
         } else if (strcasecmp(message, "noop") == 0) {
                 return ret;
-        } else if (prefix_matches(message, "stats ") || prefix_matches(message, "event ")) {
-                if (is_internal_port(client_fd)) {
-                        struct client *cur = clients;
-                        char *new_msg = NULL;
-
-                        while (cur) {
-                                if(is_internal_port(cur->fd)) { // skip local FD
-                                        cur = cur->next;
-                                        continue;
-                                }
-                                if (!new_msg) {
-                                        // append <CR><LF> again
-                                        new_msg = (char *) malloc(strlen(message) + 1 + 2);
-                                        strcpy(new_msg, message);
-                                        new_msg[strlen(message)] = '\r';
-                                        new_msg[strlen(message) + 1] = '\n';
-                                        new_msg[strlen(message) + 2] = '\0';
-                                }
-
-                                int ret = write_all(cur->fd, new_msg, strlen(new_msg));
-                                if (ret != (int) strlen(new_msg)) {
-                                        log_msg(LOG_LEVEL_WARNING, "Cannot write stats/event!\n");
-                                }
-                                cur = cur->next;
-                        }
-                        free(new_msg);
-                        return ret;
-                } else if (prefix_matches(message, "stats ")) {
-                        const char *toggle = suffix(message, "stats ");
-                        if (strcasecmp(toggle, "on") == 0) {
-                                s->stats_on = true;
-                                resp = new_response(RESPONSE_OK, NULL);
-                        } else if (strcasecmp(toggle, "off") == 0) {
-                                s->stats_on = false;
-                                resp = new_response(RESPONSE_OK, NULL);
-                        } else {
-                                resp = new_response(RESPONSE_BAD_REQUEST, NULL);
+        } else if (prefix_matches(message, "stats ")) {
+                const char *toggle = suffix(message, "stats ");
+                if (strcasecmp(toggle, "on") == 0) {
+                        s->stats_on = true;
+                        resp = new_response(RESPONSE_OK, NULL);
+                } else if (strcasecmp(toggle, "off") == 0) {
+                        s->stats_on = false;
+                        resp = new_response(RESPONSE_OK, NULL);
+                } else if (client != nullptr && (strcasecmp(toggle, "subscribe") == 0 || prefix_matches(toggle, "subscribe "))) {
+                        client->subscriptions.clear();
+                        char *names = strdup(toggle + strlen("subscribe"));
+                        char *save_ptr = nullptr;
+                        for (char *name = strtok_r(names, " ", &save_ptr); name != nullptr; name = strtok_r(nullptr, " ", &save_ptr)) {
+                                client->subscriptions.emplace_back(name);
                         }
+                        free(names);
+                        s->stats_on = true;
+                        resp = new_response(RESPONSE_OK, NULL);
+                } else if (client != nullptr && (strcasecmp(toggle, "format text") == 0 || strcasecmp(toggle, "format json") == 0)) {
+                        client->json = strcasecmp(toggle, "format json") == 0;
+                        resp = new_response(RESPONSE_OK, NULL);
+                } else {
+                        resp = new_response(RESPONSE_BAD_REQUEST, NULL);
                 }
         } else if (prefix_matches(message, "sender-port ")) {
                 struct msg_sender *msg = (struct msg_sender *)
@@ -597,6 +748,28 @@ static int process_msg(struct control_state *s, fd_t client_fd, char *message, s
         } else if(strcmp(message, "dump-tree") == 0) {
                 dump_tree(s->root_module, 0);
                 resp = new_response(RESPONSE_OK, NULL);
+        } else if (strcmp(message, "mem") == 0) {
+                std::string text;
+                module_foreach(s->root_module, [](struct module *mod, void *udata) {
+                        long long current = 0;
+                        long long peak = 0;
+                        char path[1024];
+                        if (!module_get_mem_usage(mod, &current, &peak) || !module_get_path_str(mod, path, sizeof path)) {
+                                return;
+                        }
+                        *static_cast<std::string *>(udata) += std::string(path) + " current " + std::to_string(current)
+                                + " peak " + std::to_string(peak) + "\r\n";
+                }, &text);
+                reply(s, client, client_fd, text.c_str(), text.length());
+                resp = new_response(RESPONSE_OK, NULL);
+        } else if (strcmp(message, "metrics") == 0 || prefix_matches(message, "metrics ")) {
+                std::string text = metrics_format(message[strlen("metrics")] == ' ' ? message + strlen("metrics ") : nullptr);
+                reply(s, client, client_fd, text.c_str(), text.length());
+                resp = new_response(RESPONSE_OK, NULL);
+        } else if (prefix_matches(message, "session ")) {
+                auto *msg = (struct msg_universal *) new_message(sizeof(struct msg_universal));
+                strncpy(msg->text, suffix(message, "session "), sizeof msg->text - 1);
+                resp = send_message_sync(s->root_module, "session", (struct message *) msg, 30000, SEND_MESSAGE_FLAG_NO_STORE);
         } else { // assume message in format "path message"
                 struct msg_universal *msg = (struct msg_universal *)
                         new_message(sizeof(struct msg_universal));
@@ -616,12 +789,12 @@ static int process_msg(struct control_state *s, fd_t client_fd, char *message, s
                 snprintf(buf, sizeof(buf), "(unknown path: %s)", path);
                 resp = new_response(RESPONSE_INT_SERV_ERR, buf);
         }
-        send_response(client_fd, resp);
+        send_response(s, client, client_fd, resp);
 
         return ret;
 }
 
-static void send_response(fd_t fd, struct response *resp)
+static void send_response(struct control_state *s, struct client *client, fd_t fd, struct response *resp)
 {
         char buffer[1024];
 
@@ -634,10 +807,7 @@ static void send_response(fd_t fd, struct response *resp)
         }
         strcat(buffer, "\r\n");
 
-        ssize_t ret = write_all(fd, buffer, strlen(buffer));
-        if (ret < 0) {
-                socket_error("Unable to write response");
-        }
+        reply(s, client, fd, buffer, strlen(buffer));
 
         free_response(resp);
 }
@@ -678,8 +848,7 @@ static bool parse_msg(char *buffer, int buffer_len, /* out */ char *message, int
  * prepends itself at the head of the list
  */
 static struct client *add_client(struct client *clients, fd_t fd) {
-        struct client *new_client = (struct client *)
-                malloc(sizeof(struct client));
+        struct client *new_client = new client();
         new_client->fd = fd;
         new_client->prev = NULL;
         new_client->next = clients;
@@ -758,10 +927,13 @@ static void * control_thread(void *args)
 
         while(!should_exit) {
                 process_messages(s);
+                send_stat_records(s, clients);
 
                 fd_t max_fd = 0;
                 fd_set fds;
+                fd_set write_fds;
                 FD_ZERO(&fds);
+                FD_ZERO(&write_fds);
                 if (s->connection_type == SERVER) {
                         FD_SET(s->socket_fd, &fds);
                         max_fd = s->socket_fd + 1;
@@ -771,6 +943,9 @@ static void * control_thread(void *args)
 
                 while(cur) {
                         FD_SET(cur->fd, &fds);
+                        if (!cur->out.empty()) {
+                                FD_SET(cur->fd, &write_fds);
+                        }
                         if(cur->fd + 1 > max_fd) {
                                 max_fd = cur->fd + 1;
                         }
@@ -788,7 +963,7 @@ static void * control_thread(void *args)
 
                 int rc;
 
-                if ((rc = select(max_fd, &fds, NULL, NULL, timeout_ptr)) >= 1) {
+                if ((rc = select(max_fd, &fds, &write_fds, NULL, timeout_ptr)) >= 1) {
                         if(s->connection_type == SERVER && FD_ISSET(s->socket_fd, &fds)) {
                                 fd_t fd = accept(s->socket_fd, (struct sockaddr *) &client_addr, &len);
                                 if (fd == INVALID_SOCKET) {
@@ -817,6 +992,9 @@ static void * control_thread(void *args)
                         struct client *cur = clients;
 
                         while(cur) {
+                                if (FD_ISSET(cur->fd, &write_fds)) {
+                                        client_flush(cur);
+                                }
                                 if(FD_ISSET(cur->fd, &fds)) {
                                         ssize_t ret = PLATFORM_PIPE_READ(cur->fd, cur->buff + cur->buff_len,
                                                         sizeof(cur->buff) - cur->buff_len);
@@ -835,7 +1013,7 @@ static void * control_thread(void *args)
                                                         cur->next->prev = cur->prev;
                                                 }
                                                 next = cur->next;
-                                                free(cur);
+                                                delete cur;
                                                 cur = next;
                                                 continue;
                                         }
@@ -879,7 +1057,7 @@ static void * control_thread(void *args)
                 }
                 CLOSESOCKET(cur->fd);
                 cur = cur->next;
-                free(tmp);
+                delete tmp;
         }
 
         platform_pipe_close(s->internal_fd[0]);
@@ -887,30 +1065,6 @@ static void * control_thread(void *args)
         return NULL;
 }
 
-static void *stat_event_thread(void *args)
-{
-        set_thread_name(__func__);
-        struct control_state *s = (struct control_state *) args;
-
-        while (1) {
-                std::unique_lock<std::mutex> lk(s->stats_lock);
-                s->stat_event_cv.wait(lk, [s] { return s->stat_event_queue.size() > 0; });
-                string &line = s->stat_event_queue.front();
-
-                if (line.empty()) {
-                        break;
-                }
-
-                int ret = write_all(s->internal_fd[1], line.c_str(), line.length());
-                s->stat_event_queue.pop();
-                if (ret <= 0) {
-                        fprintf(stderr, "Cannot write stat line!\n");
-                }
-        }
-
-        return NULL;
-}
-
 void control_done(struct control_state *s)
 {
         if(!s) {
@@ -920,12 +1074,6 @@ void control_done(struct control_state *s)
         module_done(&s->mod);
 
         if(s->started) {
-                s->stats_lock.lock();
-                s->stat_event_queue.push({});
-                s->stats_lock.unlock();
-                s->stat_event_cv.notify_one();
-                s->stat_event_thread_id.join();
-
                 int ret = write_all(s->internal_fd[1], "quit\r\n", 6);
                 if (ret > 0) {
                         s->control_thread_id.join();
@@ -943,17 +1091,29 @@ void control_done(struct control_state *s)
         delete s;
 }
 
-static void control_report_stats_event(struct control_state *s, const std::string &report_line)
+static void push_stat_record(struct control_state *s, stat_record &rec)
 {
-        std::unique_lock<std::mutex> lk(s->stats_lock);
+        if (!s->stat_queue.try_push(rec)) {
+                s->stat_queue.count_drop();
+                log_msg(LOG_LEVEL_WARNING, "Cannot write stats/event - queue full!!!\n");
+                return;
+        }
+        if (s->started && !s->stat_wakeup.exchange(true)) {
+                write_all(s->internal_fd[1], "noop\r\n", 6);
+        }
+}
 
-        if (s->stat_event_queue.size() < MAX_STAT_EVENT_QUEUE) {
-                s->stat_event_queue.push(report_line);
-        } else {
-                log_msg(LOG_LEVEL_WARNING, "Cannot write stats/event - queue full!!!");
+/// splits the legacy text report to the name (first word) and the rest
+static void control_report_stats_event(struct control_state *s, bool event, const std::string &report_line)
+{
+        stat_record rec;
+        rec.event = event;
+        size_t name_len = report_line.find(' ');
+        strncpy(rec.name, report_line.substr(0, name_len).c_str(), sizeof rec.name - 1);
+        if (name_len != string::npos) {
+                rec.text = report_line.substr(name_len + 1);
         }
-        lk.unlock();
-        s->stat_event_cv.notify_one();
+        push_stat_record(s, rec);
 }
 
 void control_report_stats(struct control_state *s, const std::string &report_line)
@@ -962,7 +1122,7 @@ void control_report_stats(struct control_state *s, const std::string &report_lin
                 return;
         }
 
-        control_report_stats_event(s, "stats " + report_line + "\r\n");
+        control_report_stats_event(s, false, report_line);
 }
 
 void control_report_event(struct control_state *s, const std::string &report_line)
@@ -971,7 +1131,19 @@ void control_report_event(struct control_state *s, const std::string &report_lin
                 return;
         }
 
-        control_report_stats_event(s, "event " + report_line + "\r\n");
+        control_report_stats_event(s, true, report_line);
+}
+
+void control_report_stats_fields(struct control_state *s, const char *name, const struct control_stat_field *fields, int count)
+{
+        if (!s || !s->stats_on) {
+                return;
+        }
+        stat_record rec;
+        strncpy(rec.name, name, sizeof rec.name - 1);
+        rec.field_count = std::min(count, CONTROL_STAT_MAX_FIELDS);
+        std::copy(fields, fields + rec.field_count, rec.fields);
+        push_stat_record(s, rec);
 }
 
 bool control_stats_enabled(struct control_state *s)
@@ -995,7 +1167,17 @@ static void print_control_help() {
                         "\tmute\n"
                                 "\t\tthe three items above apply to receiver\n"
                         "\tpostprocess <new_postprocess>|flush\n"
-                        "\tdump-tree\n");
+                        "\tdump-tree\n"
+                        "\tstats {on|off} - stream (all) stats and events to this connection\n"
+                        "\tstats subscribe [<name>...] - stream only the given stats/events, eg. \"ARECV\"\n"
+                        "\t\t(\"stats\" or \"event\" for all of a type), no name - everything\n"
+                        "\tstats format {text|json} - format of the streamed stats/events of this connection\n"
+                        "\tmetrics [<prefix>] - print statistics in Prometheus text format, eg. \"metrics ug_queue\"\n"
+                        "\t\tfor depth and blocking time of the processing queues\n"
+                        "\tmem - current and peak memory (in bytes) of frames and packets held by the modules\n"
+                        "\tsession create <name> <args> - start a session with the given command-line (--daemon only)\n"
+                        "\tsession destroy <name> | list - stop a session / list the sessions\n"
+                        "\tsession <name> <path> <msg> - send a command to a module of the session\n");
         printf("\nOther commands can be issued directly to individual "
                         "modules (see \"dump-tree\"), eg.:\n"
                         "\tcapture.filter mirror\n"
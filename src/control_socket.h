@@ -57,6 +57,24 @@ void control_report_stats(struct control_state *state, const std::string & stat_
 void control_report_event(struct control_state *state, const std::string & event_line);
 bool control_stats_enabled(struct control_state *state);
 
+#define CONTROL_STAT_MAX_FIELDS 16
+
+struct control_stat_field {
+        const char *key; ///< must be a static string
+        double value;
+};
+
+/**
+ * Reports stats as numeric fields - cheaper than control_report_stats() for
+ * frequent reports because the record is formatted (as text or JSON) only
+ * in the control thread and only for the clients subscribed to the name.
+ *
+ * @param name   stats name (eg. "ARECV"), truncated to 31 characters
+ * @param count  number of fields, at most CONTROL_STAT_MAX_FIELDS are used
+ */
+void control_report_stats_fields(struct control_state *state, const char *name,
+                const struct control_stat_field *fields, int count);
+
 
 #endif // control_socket_h_
 
@@ -51,6 +51,7 @@ bool crc32file(char *name, uint32_t *crc, long *charcnt);
 uint32_t crc32buf(const char *buf, size_t len);
 
 uint32_t crc32buf_with_oldcrc(const char *buf, size_t len, uint32_t oldcrc);
+const char *crc32_impl_name(void); ///< name of the CRC-32 implementation selected for this CPU
 
 /*
 **  File: CHECKSUM.C
@@ -6,7 +6,18 @@
 #endif // HAVE_CONFIG_H
 
 #include <stdio.h>
+#include <string.h>
 #include "crc.h"
+#include "utils/cpu_features.h"
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#define HAVE_CRC32_PCLMUL 1
+#endif
+#if defined __aarch64__ && defined __ARM_FEATURE_CRC32
+#include <arm_acle.h>
+#define HAVE_CRC32_ARMV8 1
+#endif
 
 #ifdef __TURBOC__
  #pragma warn -cln
@@ -159,18 +170,165 @@ bool crc32file(char *name, uint32_t *crc, long *charcnt)
       return true;
 }
 
-uint32_t crc32buf_with_oldcrc(const char *buf, size_t len, uint32_t old_crc)
-{
-      register uint32_t oldcrc32;
-
-      oldcrc32 = ~old_crc;
+/// updates the (non-inverted) CRC register with the buffer
+typedef uint32_t (*crc32_update_t)(uint32_t crc, const unsigned char *buf, size_t len);
 
+static uint32_t crc32_update_table(uint32_t crc, const unsigned char *buf, size_t len)
+{
       for ( ; len; --len, ++buf)
       {
-            oldcrc32 = UPDC32(*buf, oldcrc32);
+            crc = UPDC32(*buf, crc);
+      }
+      return crc;
+}
+
+#ifdef HAVE_CRC32_PCLMUL
+/*
+ * Folding with carry-less multiplication as described in Intel's "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction" (2009),
+ * the constants are the bit-reflected ones for the polynomial 0xedb88320.
+ * Processes 4 x 128 bits in parallel, the remainder (less than 16 B) is
+ * handled by the table.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_update_pclmul(uint32_t crc, const unsigned char *buf, size_t len)
+{
+      static const uint64_t k1k2[] __attribute__((aligned(16))) = { 0x0154442bd4, 0x01c6e41596 };
+      static const uint64_t k3k4[] __attribute__((aligned(16))) = { 0x01751997d0, 0x00ccaa009e };
+      static const uint64_t k5k0[] __attribute__((aligned(16))) = { 0x0163cd6124, 0x0000000000 };
+      static const uint64_t poly[] __attribute__((aligned(16))) = { 0x01db710641, 0x01f7011641 };
+
+      if (len < 64) {
+            return crc32_update_table(crc, buf, len);
+      }
+
+      __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+      x1 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x00));
+      x2 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x10));
+      x3 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x20));
+      x4 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x30));
+      x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc));
+      x0 = _mm_load_si128((const __m128i *)(const void *) k1k2);
+      buf += 64;
+      len -= 64;
+
+      // fold 4 x 128 bits by 512 bits
+      while (len >= 64) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+            x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+            x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x00)));
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x10)));
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x20)));
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x30)));
+            buf += 64;
+            len -= 64;
+      }
+
+      // fold the 4 values into one
+      x0 = _mm_load_si128((const __m128i *)(const void *) k3k4);
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+      // fold remaining whole 128-bit blocks
+      while (len >= 16) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(const void *) buf));
+            buf += 16;
+            len -= 16;
+      }
+
+      // 128 -> 64 bits
+      x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+      x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+      x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+      x0 = _mm_loadl_epi64((const __m128i *)(const void *) k5k0);
+      x2 = _mm_srli_si128(x1, 4);
+      x1 = _mm_and_si128(x1, x3);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x1 = _mm_xor_si128(x1, x2);
+
+      // Barrett reduction to 32 bits
+      x0 = _mm_load_si128((const __m128i *)(const void *) poly);
+      x2 = _mm_and_si128(x1, x3);
+      x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+      x2 = _mm_and_si128(x2, x3);
+      x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+      x1 = _mm_xor_si128(x1, x2);
+      crc = (uint32_t) _mm_extract_epi32(x1, 1);
+
+      return crc32_update_table(crc, buf, len);
+}
+#endif // defined HAVE_CRC32_PCLMUL
+
+#ifdef HAVE_CRC32_ARMV8
+/// ARMv8 CRC32 instructions use the same (non-Castagnoli) polynomial
+static uint32_t crc32_update_armv8(uint32_t crc, const unsigned char *buf, size_t len)
+{
+      for ( ; len > 0 && ((uintptr_t) buf & 7) != 0; --len) {
+            crc = __crc32b(crc, *buf++);
+      }
+      for ( ; len >= 8; len -= 8, buf += 8) {
+            uint64_t val;
+            memcpy(&val, buf, sizeof val);
+            crc = __crc32d(crc, val);
+      }
+      for ( ; len > 0; --len) {
+            crc = __crc32b(crc, *buf++);
       }
+      return crc;
+}
+#endif // defined HAVE_CRC32_ARMV8
+
+static crc32_update_t crc32_update = crc32_update_table;
+static const char *crc32_update_name = "table";
 
-      return ~oldcrc32;
+static void crc32_select(void)
+{
+      crc32_update = crc32_update_table;
+      crc32_update_name = "table";
+#ifdef HAVE_CRC32_PCLMUL
+      if (cpu_has(CPU_FEATURE_PCLMUL | CPU_FEATURE_SSE41)) {
+            crc32_update = crc32_update_pclmul;
+            crc32_update_name = "PCLMUL";
+      }
+#endif
+#ifdef HAVE_CRC32_ARMV8
+      if (cpu_has(CPU_FEATURE_ARMV8_CRC)) {
+            crc32_update = crc32_update_armv8;
+            crc32_update_name = "ARMv8 CRC";
+      }
+#endif
+}
+
+static void crc32_init(void) __attribute__((constructor));
+static void crc32_init(void)
+{
+      cpu_features_register(crc32_select);
+}
+
+const char *crc32_impl_name(void)
+{
+      return crc32_update_name;
+}
+
+uint32_t crc32buf_with_oldcrc(const char *buf, size_t len, uint32_t old_crc)
+{
+      return ~crc32_update(~old_crc, (const unsigned char *) buf, len);
 }
 
 uint32_t crc32buf(const char *buf, size_t len)
@@ -41,6 +41,154 @@
 #include "debug.h"
 #include "crypt_aes_impl.h"
 #include "crypt_aes.h"
+#include "utils/cpu_features.h"
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#define HAVE_AES_NI 1
+#endif
+
+#ifdef HAVE_AES_NI
+/*
+ * AES-NI versions of the ECB and CBC modes. The key schedules are the ones
+ * of rijndaelKeySetupEnc() and rijndaelKeySetupDec() (the latter is already
+ * in the form of the equivalent inverse cipher that AESDEC expects) only
+ * stored as bytes, so the output is identical to the table implementation.
+ * Independent blocks are processed 4 at a time to hide the instruction
+ * latency.
+ */
+static bool aes_ni;
+
+static void crypt_aes_select(void)
+{
+        aes_ni = cpu_has(CPU_FEATURE_AES | CPU_FEATURE_SSE2);
+}
+
+static void crypt_aes_init(void) __attribute__((constructor));
+static void crypt_aes_init(void)
+{
+        cpu_features_register(crypt_aes_select);
+}
+
+#define AESNI_FN __attribute__((target("aes,sse2")))
+
+AESNI_FN static void aesni_load_rk(const keyInstance *key, __m128i *rk)
+{
+        for (int i = 0; i <= key->Nr; ++i) {
+                rk[i] = _mm_loadu_si128((const __m128i *)(const void *) (key->rk_bytes + 16 * i));
+        }
+}
+
+AESNI_FN static inline __m128i aesni_enc1(const __m128i *rk, int Nr, __m128i b)
+{
+        b = _mm_xor_si128(b, rk[0]);
+        for (int r = 1; r < Nr; ++r) {
+                b = _mm_aesenc_si128(b, rk[r]);
+        }
+        return _mm_aesenclast_si128(b, rk[Nr]);
+}
+
+AESNI_FN static inline __m128i aesni_dec1(const __m128i *rk, int Nr, __m128i b)
+{
+        b = _mm_xor_si128(b, rk[0]);
+        for (int r = 1; r < Nr; ++r) {
+                b = _mm_aesdec_si128(b, rk[r]);
+        }
+        return _mm_aesdeclast_si128(b, rk[Nr]);
+}
+
+#define AESNI_ROUNDS4(op, oplast, rk, Nr, b) do { \
+        for (int j = 0; j < 4; ++j) { \
+                (b)[j] = _mm_xor_si128((b)[j], (rk)[0]); \
+        } \
+        for (int r = 1; r < (Nr); ++r) { \
+                for (int j = 0; j < 4; ++j) { \
+                        (b)[j] = op((b)[j], (rk)[r]); \
+                } \
+        } \
+        for (int j = 0; j < 4; ++j) { \
+                (b)[j] = oplast((b)[j], (rk)[Nr]); \
+        } \
+} while (0)
+
+AESNI_FN static void aesni_ecb_encrypt(const keyInstance *key, const BYTE *in, BYTE *out, int numBlocks)
+{
+        __m128i rk[MAXNR + 1];
+        aesni_load_rk(key, rk);
+        for ( ; numBlocks >= 4; numBlocks -= 4, in += 64, out += 64) {
+                __m128i b[4];
+                for (int j = 0; j < 4; ++j) {
+                        b[j] = _mm_loadu_si128((const __m128i *)(const void *) (in + 16 * j));
+                }
+                AESNI_ROUNDS4(_mm_aesenc_si128, _mm_aesenclast_si128, rk, key->Nr, b);
+                for (int j = 0; j < 4; ++j) {
+                        _mm_storeu_si128((__m128i *)(void *) (out + 16 * j), b[j]);
+                }
+        }
+        for ( ; numBlocks > 0; numBlocks -= 1, in += 16, out += 16) {
+                __m128i b = _mm_loadu_si128((const __m128i *)(const void *) in);
+                _mm_storeu_si128((__m128i *)(void *) out, aesni_enc1(rk, key->Nr, b));
+        }
+}
+
+AESNI_FN static void aesni_cbc_encrypt(const keyInstance *key, const BYTE *iv, const BYTE *in, BYTE *out, int numBlocks)
+{
+        __m128i rk[MAXNR + 1];
+        aesni_load_rk(key, rk);
+        __m128i prev = _mm_loadu_si128((const __m128i *)(const void *) iv);
+        for ( ; numBlocks > 0; numBlocks -= 1, in += 16, out += 16) {
+                __m128i b = _mm_loadu_si128((const __m128i *)(const void *) in);
+                prev = aesni_enc1(rk, key->Nr, _mm_xor_si128(b, prev));
+                _mm_storeu_si128((__m128i *)(void *) out, prev);
+        }
+}
+
+AESNI_FN static void aesni_ecb_decrypt(const keyInstance *key, const BYTE *in, BYTE *out, int numBlocks)
+{
+        __m128i rk[MAXNR + 1];
+        aesni_load_rk(key, rk);
+        for ( ; numBlocks >= 4; numBlocks -= 4, in += 64, out += 64) {
+                __m128i b[4];
+                for (int j = 0; j < 4; ++j) {
+                        b[j] = _mm_loadu_si128((const __m128i *)(const void *) (in + 16 * j));
+                }
+                AESNI_ROUNDS4(_mm_aesdec_si128, _mm_aesdeclast_si128, rk, key->Nr, b);
+                for (int j = 0; j < 4; ++j) {
+                        _mm_storeu_si128((__m128i *)(void *) (out + 16 * j), b[j]);
+                }
+        }
+        for ( ; numBlocks > 0; numBlocks -= 1, in += 16, out += 16) {
+                __m128i b = _mm_loadu_si128((const __m128i *)(const void *) in);
+                _mm_storeu_si128((__m128i *)(void *) out, aesni_dec1(rk, key->Nr, b));
+        }
+}
+
+/// works in place, iv is updated to the last ciphertext block
+AESNI_FN static void aesni_cbc_decrypt(const keyInstance *key, BYTE *iv, const BYTE *in, BYTE *out, int numBlocks)
+{
+        __m128i rk[MAXNR + 1];
+        aesni_load_rk(key, rk);
+        __m128i prev = _mm_loadu_si128((const __m128i *)(const void *) iv);
+        for ( ; numBlocks >= 4; numBlocks -= 4, in += 64, out += 64) {
+                __m128i c[4], b[4];
+                for (int j = 0; j < 4; ++j) {
+                        b[j] = c[j] = _mm_loadu_si128((const __m128i *)(const void *) (in + 16 * j));
+                }
+                AESNI_ROUNDS4(_mm_aesdec_si128, _mm_aesdeclast_si128, rk, key->Nr, b);
+                _mm_storeu_si128((__m128i *)(void *) out, _mm_xor_si128(b[0], prev));
+                for (int j = 1; j < 4; ++j) {
+                        _mm_storeu_si128((__m128i *)(void *) (out + 16 * j), _mm_xor_si128(b[j], c[j - 1]));
+                }
+                prev = c[3];
+        }
+        for ( ; numBlocks > 0; numBlocks -= 1, in += 16, out += 16) {
+                __m128i c = _mm_loadu_si128((const __m128i *)(const void *) in);
+                _mm_storeu_si128((__m128i *)(void *) out, _mm_xor_si128(aesni_dec1(rk, key->Nr, c), prev));
+                prev = c;
+        }
+        _mm_storeu_si128((__m128i *)(void *) iv, prev);
+}
+#endif // defined HAVE_AES_NI
 
 int makeKey(keyInstance * key, BYTE direction, int keyLen, char *keyMaterial)
 {
@@ -101,6 +249,12 @@ int makeKey(keyInstance * key, BYTE direction, int keyLen, char *keyMaterial)
                 key->Nr = rijndaelKeySetupDec(key->rk, cipherKey, keyLen);
         }
         rijndaelKeySetupEnc(key->ek, cipherKey, keyLen);
+        for (i = 0; i < 4 * (key->Nr + 1); i++) {
+                key->rk_bytes[4 * i] = key->rk[i] >> 24;
+                key->rk_bytes[4 * i + 1] = key->rk[i] >> 16;
+                key->rk_bytes[4 * i + 2] = key->rk[i] >> 8;
+                key->rk_bytes[4 * i + 3] = key->rk[i];
+        }
         return TRUE;
 }
 
@@ -159,6 +313,17 @@ int blockEncrypt(cipherInstance * cipher, keyInstance * key,
 
         numBlocks = inputLen / 128;
 
+#ifdef HAVE_AES_NI
+        if (aes_ni && cipher->mode == MODE_ECB) {
+                aesni_ecb_encrypt(key, input, outBuffer, numBlocks);
+                return 128 * numBlocks;
+        }
+        if (aes_ni && cipher->mode == MODE_CBC) {
+                aesni_cbc_encrypt(key, cipher->IV, input, outBuffer, numBlocks);
+                return 128 * numBlocks;
+        }
+#endif
+
         switch (cipher->mode) {
         case MODE_ECB:
                 for (i = numBlocks; i > 0; i--) {
@@ -189,7 +354,8 @@ int blockEncrypt(cipherInstance * cipher, keyInstance * key,
         case MODE_CFB1:
                 iv = cipher->IV;
                 for (i = numBlocks; i > 0; i--) {
-                        memcpy(outBuffer, input, 16);
+                        
+memcpy(outBuffer, input, 16);
                         for (k = 0; k < 128; k++) {
                                 rijndaelEncrypt(key->ek, key->Nr, iv, block);
                                 outBuffer[k >> 3] ^=
@@ -302,6 +468,17 @@ int blockDecrypt(cipherInstance * cipher, keyInstance * key,
 
         numBlocks = inputLen / 128;
 
+#ifdef HAVE_AES_NI
+        if (aes_ni && cipher->mode == MODE_ECB) {
+                aesni_ecb_decrypt(key, input, outBuffer, numBlocks);
+                return 128 * numBlocks;
+        }
+        if (aes_ni && cipher->mode == MODE_CBC) {
+                aesni_cbc_decrypt(key, cipher->IV, input, outBuffer, numBlocks);
+                return 128 * numBlocks;
+        }
+#endif
+
         switch (cipher->mode) {
         case MODE_ECB:
                 for (i = numBlocks; i > 0; i--) {
@@ -330,7 +507,8 @@ int blockDecrypt(cipherInstance * cipher, keyInstance * key,
                 iv = cipher->IV;
                 for (i = numBlocks; i > 0; i--) {
                         memcpy(outBuffer, input, 16);
-                        for (k = 0; k < 128; k++) {
+                        
+for (k = 0; k < 128; k++) {
                                 rijndaelEncrypt(key->ek, key->Nr, iv, block);
                                 for (t = 0; t < 15; t++) {
                                         iv[t] = (iv[t] << 1) | (iv[t + 1] >> 7);
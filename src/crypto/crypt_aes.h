@@ -78,6 +78,7 @@ typedef struct {
 	int   Nr;                       /* key-length-dependent number of rounds */
 	u32   rk[4*(MAXNR + 1)];        /* key schedule */
 	u32   ek[4*(MAXNR + 1)];        /* CFB1 key schedule (encryption only) */
+	u8    rk_bytes[16*(MAXNR + 1)]; /* rk as bytes in memory order (AES-NI) */
 } keyInstance;
 
 /*  The structure for cipher information */
@@ -88,6 +89,10 @@ typedef struct {                    /* changed order of the components */
 
 /*  Function prototypes  */
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 int makeKey(keyInstance *key, BYTE direction, int keyLen, char *keyMaterial);
 
 int cipherInit(cipherInstance *cipher, BYTE mode, char *IV);
@@ -107,4 +112,8 @@ int padDecrypt(cipherInstance *cipher, keyInstance *key,
 int cipherUpdateRounds(cipherInstance *cipher, keyInstance *key,
         BYTE *input, int inputLen, BYTE *outBuffer, int Rounds);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* __RIJNDAEL_API_FST_H */
@@ -43,6 +43,7 @@
 #endif // HAVE_CONFIG_H
 
 
+#include <stdbool.h>
 #include <string.h>
 #ifdef HAVE_WOLFSSL
 #define OPENSSL_EXTRA
@@ -63,12 +64,25 @@
 #include "crypto/openssl_encrypt.h" // get_cipher
 #include "debug.h"
 #include "lib_common.h"
+#include "utils/worker.h"
 
 #define GCM_TAG_LEN 16
+#define MIN_PKTS_PER_WORKER 8
 #define MOD_NAME "[decrypt] "
 
-struct openssl_decrypt {
+struct decrypt_worker {
         EVP_CIPHER_CTX *ctx;
+        enum openssl_mode ctx_mode; ///< mode ctx is initialized (keyed) for
+
+        // currently assigned job
+        struct openssl_decrypt *s;
+        struct openssl_decrypt_pkt *pkts;
+        int count;
+};
+
+struct openssl_decrypt {
+        struct decrypt_worker *workers;
+        int worker_count;
         unsigned char key_hash[16];
 
         unsigned char ivec[AES_BLOCK_SIZE];
@@ -76,6 +90,30 @@ struct openssl_decrypt {
         unsigned int num;
 };
 
+/**
+ * Ensures that at least count workers (each with own cipher context) exist.
+ */
+static bool ensure_workers(struct openssl_decrypt *s, int count)
+{
+        if (count <= s->worker_count) {
+                return true;
+        }
+        struct decrypt_worker *workers = realloc(s->workers, count * sizeof *workers);
+        if (workers == NULL) {
+                return false;
+        }
+        s->workers = workers;
+        for ( ; s->worker_count < count; ++s->worker_count) {
+                struct decrypt_worker *w = &s->workers[s->worker_count];
+                memset(w, 0, sizeof *w);
+                w->s = s;
+                if ((w->ctx = EVP_CIPHER_CTX_new()) == NULL) {
+                        return false;
+                }
+        }
+        return true;
+}
+
 static int openssl_decrypt_init(struct openssl_decrypt **state,
                                 const char *passphrase)
 {
@@ -89,7 +127,11 @@ static int openssl_decrypt_init(struct openssl_decrypt **state,
                         strlen(passphrase));
         MD5Final(s->key_hash, &context);
 
-        s->ctx = EVP_CIPHER_CTX_new();
+        if (!ensure_workers(s, 1)) {
+                free(s->workers);
+                free(s);
+                return -1;
+        }
         log_msg(LOG_LEVEL_INFO, MOD_NAME "Enabled stream decryption.\n");
 
         *state = s;
@@ -101,13 +143,16 @@ static void openssl_decrypt_destroy(struct openssl_decrypt *s)
         if(!s) {
                 return;
         }
-        EVP_CIPHER_CTX_free(s->ctx);
+        for (int i = 0; i < s->worker_count; ++i) {
+                EVP_CIPHER_CTX_free(s->workers[i].ctx);
+        }
+        free(s->workers);
         free(s);
 }
 
 #define CHECK(action, errmsg) do { int rc = action; if (rc != 1) { log_msg(LOG_LEVEL_ERROR, MOD_NAME errmsg ": %s\n", ERR_error_string(ERR_get_error(), NULL)); return 0; } } while(0)
 #pragma GCC diagnostic ignored "-Wcast-qual"
-static int openssl_decrypt(struct openssl_decrypt *decrypt,
+static int decrypt_pkt(struct decrypt_worker *w,
                 const char *ciphertext, int ciphertext_len,
                 const char *aad, int aad_len,
                 char *plaintext, enum openssl_mode mode)
@@ -125,24 +170,30 @@ static int openssl_decrypt(struct openssl_decrypt *decrypt,
         ciphertext += 16;
         ciphertext_len -= 20;
 
-        CHECK(EVP_CipherInit(decrypt->ctx, cipher, decrypt->key_hash, iv, 0), "Unable to initialize cipher");
-        CHECK(EVP_CIPHER_CTX_ctrl(decrypt->ctx, EVP_CTRL_GCM_SET_IVLEN, 16, NULL), "set IV len"); // default IV len is presumably 12 bytes
+        if (w->ctx_mode != mode) {
+                CHECK(EVP_CipherInit(w->ctx, cipher, w->s->key_hash, NULL, 0), "Unable to initialize cipher");
+                if (mode == MODE_AES128_GCM) {
+                        CHECK(EVP_CIPHER_CTX_ctrl(w->ctx, EVP_CTRL_GCM_SET_IVLEN, 16, NULL), "set IV len"); // default IV len is presumably 12 bytes
+                }
+                w->ctx_mode = mode;
+        }
+        CHECK(EVP_CipherInit(w->ctx, NULL, NULL, iv, 0), "Unable to set IV");
 
         int out_len = 0;
         if (mode == MODE_AES128_GCM) {
                 ciphertext_len -= GCM_TAG_LEN;
                 if (aad && aad_len > 0) {
-                        if (!EVP_DecryptUpdate(decrypt->ctx, NULL, &out_len, (void *) aad, aad_len)) {
+                        if (!EVP_DecryptUpdate(w->ctx, NULL, &out_len, (void *) aad, aad_len)) {
                                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "AAD processing: %s\n", ERR_error_string(ERR_get_error(), NULL));
                         }
                 }
         }
-        CHECK(EVP_CipherUpdate(decrypt->ctx, (unsigned char *) plaintext, &out_len, (const unsigned char *) ciphertext, ciphertext_len), "EVP_CipherUpdate");
+        CHECK(EVP_CipherUpdate(w->ctx, (unsigned char *) plaintext, &out_len, (const unsigned char *) ciphertext, ciphertext_len), "EVP_CipherUpdate");
         int total_len = out_len;
         if (mode == MODE_AES128_GCM) {
-                CHECK(EVP_CIPHER_CTX_ctrl(decrypt->ctx, EVP_CTRL_GCM_SET_TAG, GCM_TAG_LEN, (void *) (ciphertext + ciphertext_len)), "GCM set tag");
+                CHECK(EVP_CIPHER_CTX_ctrl(w->ctx, EVP_CTRL_GCM_SET_TAG, GCM_TAG_LEN, (void *) (ciphertext + ciphertext_len)), "GCM set tag");
         }
-        CHECK(EVP_CipherFinal(decrypt->ctx, (unsigned char *) plaintext + out_len, &out_len), "EVP_CipherFinal");
+        CHECK(EVP_CipherFinal(w->ctx, (unsigned char *) plaintext + out_len, &out_len), "EVP_CipherFinal");
         total_len += out_len;
 
         if (mode != MODE_AES128_GCM) {
@@ -160,10 +211,58 @@ static int openssl_decrypt(struct openssl_decrypt *decrypt,
         return data_len;
 }
 
+static int openssl_decrypt(struct openssl_decrypt *decrypt,
+                const char *ciphertext, int ciphertext_len,
+                const char *aad, int aad_len,
+                char *plaintext, enum openssl_mode mode)
+{
+        return decrypt_pkt(&decrypt->workers[0], ciphertext, ciphertext_len,
+                        aad, aad_len, plaintext, mode);
+}
+
+static void *decrypt_worker_run(void *arg)
+{
+        struct decrypt_worker *w = arg;
+        for (int i = 0; i < w->count; ++i) {
+                struct openssl_decrypt_pkt *pkt = &w->pkts[i];
+                if (pkt->ciphertext == NULL) {
+                        continue;
+                }
+                pkt->plaintext_len = decrypt_pkt(w, pkt->ciphertext, pkt->ciphertext_len,
+                                pkt->aad, pkt->aad_len, pkt->plaintext, pkt->mode);
+        }
+        return NULL;
+}
+
+static void openssl_decrypt_batch(struct openssl_decrypt *s,
+                struct openssl_decrypt_pkt *pkts, int count, int threads)
+{
+        if (count / MIN_PKTS_PER_WORKER < threads) {
+                threads = count / MIN_PKTS_PER_WORKER;
+        }
+        if (threads < 1) {
+                threads = 1;
+        }
+        if (!ensure_workers(s, threads)) {
+                threads = s->worker_count;
+        }
+
+        int start = 0;
+        for (int i = 0; i < threads; ++i) {
+                struct decrypt_worker *w = &s->workers[i];
+                w->pkts = pkts + start;
+                w->count = count / threads + (i < count % threads);
+                start += w->count;
+        }
+
+        task_run_parallel(decrypt_worker_run, threads, s->workers, sizeof s->workers[0], NULL);
+}
+
 static const struct openssl_decrypt_info functions = {
         openssl_decrypt_init,
         openssl_decrypt_destroy,
         openssl_decrypt,
+        openssl_decrypt_batch,
 };
 
 REGISTER_MODULE(openssl_decrypt, &functions, LIBRARY_CLASS_UNDEFINED, OPENSSL_DECRYPT_ABI_VERSION);
@@ -40,10 +40,21 @@
 
 #include "crypto/openssl_encrypt.h" // enum openssl_mode
 
-#define OPENSSL_DECRYPT_ABI_VERSION 1
+#define OPENSSL_DECRYPT_ABI_VERSION 2
 
 struct openssl_decrypt;
 
+/// packet description for openssl_decrypt_info::decrypt_batch
+struct openssl_decrypt_pkt {
+        const char *ciphertext; ///< packet is skipped if NULL
+        int ciphertext_len;
+        const char *aad;
+        int aad_len;
+        char *plaintext;      ///< must hold ciphertext_len bytes
+        enum openssl_mode mode;
+        int plaintext_len;    ///< [out] length of output plaintext, 0 on error
+};
+
 struct openssl_decrypt_info {
         /**
          * Creates decryption state
@@ -77,6 +88,17 @@ struct openssl_decrypt_info {
                         const char *ciphertext, int ciphertext_len,
                         const char *aad, int aad_len,
                         char *plaintext, enum openssl_mode mode);
+        /**
+         * Decrypts count packets, equivalent to calling decrypt() for each of
+         * them, but the packets are split among (up to) threads workers.
+         *
+         * @param[in]     decrypt decrypt state
+         * @param[in,out] pkts    packets to be decrypted, plaintext_len is set
+         * @param[in]     count   number of packets
+         * @param[in]     threads maximal number of workers to be used
+         */
+        void (*decrypt_batch)(struct openssl_decrypt *decrypt,
+                        struct openssl_decrypt_pkt *pkts, int count, int threads);
 };
 
 #endif //  OPENSSL_DECRYPT_H_
@@ -45,6 +45,13 @@
  *
  * Encryption algorithm is set in transmit.cpp, detected on receiver. Required
  * algorightms are currently GCM (default) and CBC.
+ *
+ * The IV is derived from a 64-bit packet counter starting at a random value
+ * (upper 8 bytes, lower 8 bytes zero so that CTR block counters of subsequent
+ * packets never overlap). For CBC and CFB, which require unpredictable IVs,
+ * the counter block is additionally encrypted with AES-ECB (NIST SP 800-38A,
+ * appendix C). Each worker keeps its own cipher context initialized with the
+ * key, so only the IV is set per packet.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -53,6 +60,8 @@
 #include "config_win32.h"
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #ifdef HAVE_WOLFSSL
 #define OPENSSL_EXTRA
@@ -74,15 +83,34 @@
 #include "crypto/openssl_encrypt.h"
 #include "debug.h"
 #include "lib_common.h"
+#include "utils/worker.h"
 
 #define GCM_TAG_LEN 16
+#define MIN_PKTS_PER_WORKER 8
 #define MOD_NAME "[encrypt] "
 
+struct openssl_encrypt;
+
+struct encrypt_worker {
+        EVP_CIPHER_CTX *ctx;    ///< initialized with cipher and key, only IV is set per packet
+        EVP_CIPHER_CTX *iv_ctx; ///< AES-ECB to derive unpredictable IVs (CBC, CFB)
+
+        // currently assigned job
+        struct openssl_encrypt *s;
+        struct openssl_encrypt_pkt *pkts;
+        int count;
+        uint64_t first_iv;
+        int encrypted;
+};
+
 struct openssl_encrypt {
-        EVP_CIPHER_CTX *ctx;
         const EVP_CIPHER *cipher;
         enum openssl_mode mode;
         unsigned char key_hash[16];
+        uint64_t iv_counter; ///< IV counter value of the next packet
+
+        struct encrypt_worker *workers;
+        int worker_count;
 };
 
 const void *get_cipher(enum openssl_mode mode) {
@@ -114,6 +142,65 @@ const void *get_cipher(enum openssl_mode mode) {
         return NULL;
 }
 
+static bool worker_init(struct openssl_encrypt *s, struct encrypt_worker *w)
+{
+        memset(w, 0, sizeof *w);
+        w->ctx = EVP_CIPHER_CTX_new();
+        if (w->ctx == NULL) {
+                return false;
+        }
+        if (EVP_CipherInit(w->ctx, s->cipher, s->key_hash, NULL, 1) != 1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot initialize cipher: %s\n", ERR_error_string(ERR_get_error(), NULL));
+                return false;
+        }
+        /* Set IV length if default 12 bytes (96 bits) is not appropriate */
+        if (s->mode == MODE_AES128_GCM && EVP_CIPHER_CTX_ctrl(w->ctx, EVP_CTRL_GCM_SET_IVLEN, 16, NULL) != 1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "set IV len: %s\n", ERR_error_string(ERR_get_error(), NULL));
+                return false;
+        }
+        if (s->mode == MODE_AES128_CBC || s->mode == MODE_AES128_CFB) {
+                const EVP_CIPHER *ecb = get_cipher(MODE_AES128_ECB);
+                if (ecb == NULL) { // random IVs are used instead
+                        return true;
+                }
+                w->iv_ctx = EVP_CIPHER_CTX_new();
+                if (w->iv_ctx == NULL || EVP_CipherInit(w->iv_ctx, ecb, s->key_hash, NULL, 1) != 1) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot initialize IV cipher: %s\n", ERR_error_string(ERR_get_error(), NULL));
+                        return false;
+                }
+                EVP_CIPHER_CTX_set_padding(w->iv_ctx, 0);
+        }
+        return true;
+}
+
+static void worker_done(struct encrypt_worker *w)
+{
+        EVP_CIPHER_CTX_free(w->ctx);
+        EVP_CIPHER_CTX_free(w->iv_ctx);
+}
+
+/**
+ * Ensures that at least count workers are initialized.
+ */
+static bool ensure_workers(struct openssl_encrypt *s, int count)
+{
+        if (count <= s->worker_count) {
+                return true;
+        }
+        struct encrypt_worker *workers = realloc(s->workers, count * sizeof *workers);
+        if (workers == NULL) {
+                return false;
+        }
+        s->workers = workers;
+        for ( ; s->worker_count < count; ++s->worker_count) {
+                if (!worker_init(s, &s->workers[s->worker_count])) {
+                        worker_done(&s->workers[s->worker_count]);
+                        return false;
+                }
+        }
+        return true;
+}
+
 static int openssl_encrypt_init(struct openssl_encrypt **state, const char *passphrase,
                 enum openssl_mode mode)
 {
@@ -134,8 +221,17 @@ static int openssl_encrypt_init(struct openssl_encrypt **state, const char *pass
                 return -1;
         }
 
-        s->ctx = EVP_CIPHER_CTX_new();
         s->mode = mode;
+        if (RAND_bytes((unsigned char *) &s->iv_counter, sizeof s->iv_counter) != 1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot generate random bytes!\n");
+                free(s);
+                return -1;
+        }
+        if (!ensure_workers(s, 1)) {
+                free(s->workers);
+                free(s);
+                return -1;
+        }
         log_msg(LOG_LEVEL_INFO, MOD_NAME "Encryption set to mode %d\n", (int) mode);
 
         *state = s;
@@ -144,53 +240,126 @@ static int openssl_encrypt_init(struct openssl_encrypt **state, const char *pass
 
 static void openssl_encrypt_destroy(struct openssl_encrypt *s)
 {
-        EVP_CIPHER_CTX_free(s->ctx);
+        for (int i = 0; i < s->worker_count; ++i) {
+                worker_done(&s->workers[i]);
+        }
+        free(s->workers);
         free(s);
 }
 
 #define CHECK(action, errmsg) do { int rc = action; if (rc != 1) { log_msg(LOG_LEVEL_ERROR, MOD_NAME errmsg ": %s\n", ERR_error_string(ERR_get_error(), NULL)); return 0; } } while(0)
 
-static int openssl_encrypt(struct openssl_encrypt *encryption,
-                char *plaintext, int data_len, char *aad, int aad_len, char *ciphertext)
+static bool make_iv(struct encrypt_worker *w, enum openssl_mode mode, uint64_t n,
+                unsigned char *ivec)
+{
+        memset(ivec, 0, 16);
+        for (int i = 0; i < 8; ++i) {
+                ivec[i] = n >> (56 - 8 * i);
+        }
+        if (mode != MODE_AES128_CBC && mode != MODE_AES128_CFB) {
+                return true;
+        }
+        if (w->iv_ctx == NULL) {
+                return RAND_bytes(ivec, 16) == 1;
+        }
+        int out_len = 0;
+        return EVP_EncryptUpdate(w->iv_ctx, ivec, &out_len, ivec, 16) == 1 && out_len == 16;
+}
+
+static int encrypt_pkt(struct openssl_encrypt *encryption, struct encrypt_worker *w,
+                uint64_t iv_n, char *plaintext, int data_len, char *aad, int aad_len,
+                char *ciphertext)
 {
         memcpy(ciphertext, &data_len, sizeof(uint32_t));
         int total_len = sizeof(uint32_t);
 
         unsigned char ivec[16];
-        if (RAND_bytes(ivec, 8) < 0) {
-                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot generate random bytes!\n");
+        if (!make_iv(w, encryption->mode, iv_n, ivec)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot generate IV!\n");
                 return 0;
         }
         memcpy(ciphertext + total_len, ivec, sizeof ivec);
         total_len += sizeof ivec;
 
-        CHECK(EVP_CipherInit(encryption->ctx, encryption->cipher, encryption->key_hash, ivec, 1), "Cannot initialize cipher");
-        /* Set IV length if default 12 bytes (96 bits) is not appropriate */
-        CHECK(EVP_CIPHER_CTX_ctrl(encryption->ctx, EVP_CTRL_GCM_SET_IVLEN, sizeof ivec, NULL), "set IV len");
+        CHECK(EVP_CipherInit(w->ctx, NULL, NULL, ivec, 1), "Cannot set IV");
         int out_len = 0;
         if (encryption->mode == MODE_AES128_GCM) {
                 if (aad_len > 0) {
-                        EVP_EncryptUpdate(encryption->ctx, NULL, &out_len, (unsigned char *) aad, aad_len);
+                        EVP_EncryptUpdate(w->ctx, NULL, &out_len, (unsigned char *) aad, aad_len);
                 }
         }
-        CHECK(EVP_CipherUpdate(encryption->ctx, (unsigned char *) ciphertext + total_len, &out_len, (unsigned char *) plaintext, data_len), "EVP_CipherUpdate");
+        CHECK(EVP_CipherUpdate(w->ctx, (unsigned char *) ciphertext + total_len, &out_len, (unsigned char *) plaintext, data_len), "EVP_CipherUpdate");
         total_len += out_len;
         if (encryption->mode != MODE_AES128_GCM) {
                 uint32_t crc = crc32buf(aad, aad_len);
                 crc = crc32buf_with_oldcrc(plaintext, data_len, crc);
-                CHECK(EVP_CipherUpdate(encryption->ctx, (unsigned char *) ciphertext + total_len, &out_len, (unsigned char *) &crc, sizeof crc), "EVP_CipherUpdate CRC");
+                CHECK(EVP_CipherUpdate(w->ctx, (unsigned char *) ciphertext + total_len, &out_len, (unsigned char *) &crc, sizeof crc), "EVP_CipherUpdate CRC");
                 total_len += out_len;
         }
-        CHECK(EVP_CipherFinal(encryption->ctx, (unsigned char *) ciphertext + total_len, &out_len), "EVP_CipherFinal");
+        CHECK(EVP_CipherFinal(w->ctx, (unsigned char *) ciphertext + total_len, &out_len), "EVP_CipherFinal");
         total_len += out_len;
         if (encryption->mode == MODE_AES128_GCM) {
-                CHECK(EVP_CIPHER_CTX_ctrl(encryption->ctx, EVP_CTRL_GCM_GET_TAG, GCM_TAG_LEN, ciphertext + total_len), "GCM get tag");
+                CHECK(EVP_CIPHER_CTX_ctrl(w->ctx, EVP_CTRL_GCM_GET_TAG, GCM_TAG_LEN, ciphertext + total_len), "GCM get tag");
                 total_len += GCM_TAG_LEN;
         }
 
         return total_len;
 }
 
+static int openssl_encrypt(struct openssl_encrypt *encryption,
+                char *plaintext, int data_len, char *aad, int aad_len, char *ciphertext)
+{
+        return encrypt_pkt(encryption, &encryption->workers[0], encryption->iv_counter++,
+                        plaintext, data_len, aad, aad_len, ciphertext);
+}
+
+static void *encrypt_worker_run(void *arg)
+{
+        struct encrypt_worker *w = arg;
+        w->encrypted = 0;
+        for (int i = 0; i < w->count; ++i) {
+                struct openssl_encrypt_pkt *pkt = &w->pkts[i];
+                pkt->ciphertext_len = encrypt_pkt(w->s, w, w->first_iv + i,
+                                pkt->plaintext, pkt->plaintext_len,
+                                pkt->aad, pkt->aad_len, pkt->ciphertext);
+                w->encrypted += pkt->ciphertext_len > 0;
+        }
+        return NULL;
+}
+
+static int openssl_encrypt_batch(struct openssl_encrypt *s,
+                struct openssl_encrypt_pkt *pkts, int count, int threads)
+{
+        if (count / MIN_PKTS_PER_WORKER < threads) {
+                threads = count / MIN_PKTS_PER_WORKER;
+        }
+        if (threads < 1) {
+                threads = 1;
+        }
+        if (!ensure_workers(s, threads)) {
+                threads = s->worker_count;
+        }
+
+        int start = 0;
+        for (int i = 0; i < threads; ++i) {
+                struct encrypt_worker *w = &s->workers[i];
+                w->s = s;
+                w->pkts = pkts + start;
+                w->count = count / threads + (i < count % threads);
+                w->first_iv = s->iv_counter + start;
+                start += w->count;
+        }
+        s->iv_counter += count;
+
+        task_run_parallel(encrypt_worker_run, threads, s->workers, sizeof s->workers[0], NULL);
+
+        int encrypted = 0;
+        for (int i = 0; i < threads; ++i) {
+                encrypted += s->workers[i].encrypted;
+        }
+        return encrypted;
+}
+
 static int openssl_get_overhead(struct openssl_encrypt *s)
 {
         return sizeof(uint32_t) /* data_len */ +
@@ -203,6 +372,7 @@ static const struct openssl_encrypt_info functions = {
         openssl_encrypt_destroy,
         openssl_encrypt,
         openssl_get_overhead,
+        openssl_encrypt_batch,
 };
 
 REGISTER_MODULE(openssl_encrypt, &functions, LIBRARY_CLASS_UNDEFINED, OPENSSL_ENCRYPT_ABI_VERSION);
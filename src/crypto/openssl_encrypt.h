@@ -57,7 +57,17 @@ const void *get_cipher(enum openssl_mode mode);
 #define MAX_CRYPTO_PAD 15 // ECB needs to be padded
 #define MAX_CRYPTO_EXCEED (MAX_CRYPTO_EXTRA_DATA + MAX_CRYPTO_PAD)
 
-#define OPENSSL_ENCRYPT_ABI_VERSION 1
+#define OPENSSL_ENCRYPT_ABI_VERSION 2
+
+/// packet description for openssl_encrypt_info::encrypt_batch
+struct openssl_encrypt_pkt {
+        char *plaintext;
+        int plaintext_len;
+        char *aad;
+        int aad_len;
+        char *ciphertext;   ///< must hold plaintext_len + MAX_CRYPTO_EXCEED bytes
+        int ciphertext_len; ///< [out] size of written ciphertext, 0 on error
+};
 
 struct openssl_encrypt_info {
         /**
@@ -99,6 +109,18 @@ struct openssl_encrypt_info {
          * @returns max overhead (must be <= MAX_CRYPTO_EXCEED)
          */
         int (*get_overhead)(struct openssl_encrypt *encryption);
+        /**
+         * Encrypts count packets, equivalent to calling encrypt() for each of
+         * them, but the packets are split among (up to) threads workers.
+         *
+         * @param[in]     encryption state
+         * @param[in,out] pkts       packets to be encrypted, ciphertext_len is set
+         * @param[in]     count      number of packets
+         * @param[in]     threads    maximal number of workers to be used
+         * @returns   number of successfully encrypted packets
+         */
+        int (*encrypt_batch)(struct openssl_encrypt *encryption,
+                        struct openssl_encrypt_pkt *pkts, int count, int threads);
 };
 
 #endif // OPENSSL_ENCRYPT_H_
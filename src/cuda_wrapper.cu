@@ -42,11 +42,13 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "cuda_runtime.h"
 #include "cuda_wrapper.h"
+#include "utils/lut3d_sample.h"
 
 typedef void *cuda_wrapper_stream_t;
 
@@ -67,6 +69,7 @@ static inline enum cudaMemcpyKind map_cuda_memcpy_kind(int our_kind) {
         struct kind_mapping mapping[] = {
                 { cudaMemcpyHostToDevice, CUDA_WRAPPER_MEMCPY_HOST_TO_DEVICE },
                 { cudaMemcpyDeviceToHost, CUDA_WRAPPER_MEMCPY_DEVICE_TO_HOST },
+                { cudaMemcpyDeviceToDevice, CUDA_WRAPPER_MEMCPY_DEVICE_TO_DEVICE },
         };
 
         int i;
@@ -112,6 +115,38 @@ CUDA_DLL_API int cuda_wrapper_memcpy(void *dst, const void *src,
                                 map_cuda_memcpy_kind(kind)));
 }
 
+/**
+ * Enqueues the copy to the stream. Host memory must be page-locked (see
+ * cuda_wrapper_malloc_host()) for the copy to be really asynchronous.
+ */
+CUDA_DLL_API int cuda_wrapper_memcpy_async(void *dst, const void *src,
+                size_t count, int kind, cuda_wrapper_stream_t stream)
+{
+        return map_cuda_error(
+                        cudaMemcpyAsync(dst, src, count,
+                                map_cuda_memcpy_kind(kind),
+                                (cudaStream_t) stream));
+}
+
+/// creates a stream that doesn't synchronize with the default stream
+CUDA_DLL_API int cuda_wrapper_stream_create(cuda_wrapper_stream_t *stream)
+{
+        cudaStream_t str = NULL;
+        cudaError_t ret = cudaStreamCreateWithFlags(&str, cudaStreamNonBlocking);
+        *stream = (cuda_wrapper_stream_t) str;
+        return map_cuda_error(ret);
+}
+
+CUDA_DLL_API int cuda_wrapper_stream_destroy(cuda_wrapper_stream_t stream)
+{
+        return map_cuda_error(cudaStreamDestroy((cudaStream_t) stream));
+}
+
+CUDA_DLL_API int cuda_wrapper_stream_synchronize(cuda_wrapper_stream_t stream)
+{
+        return map_cuda_error(cudaStreamSynchronize((cudaStream_t) stream));
+}
+
 CUDA_DLL_API const char *cuda_wrapper_last_error_string(void)
 {
         return cudaGetErrorString(cudaGetLastError());
@@ -164,3 +199,95 @@ CUDA_DLL_API void cuda_wrapper_print_devices_info(void)
     }
 }
 
+#define KERNEL_BLOCK_SIZE 256
+
+template<typename in_t, typename out_t>
+__global__ void lut_kernel(out_t *dst, const in_t *src, size_t count, const out_t *lut)
+{
+        size_t i = blockIdx.x * (size_t) blockDim.x + threadIdx.x;
+        if (i < count) {
+                dst[i] = lut[src[i]];
+        }
+}
+
+/**
+ * Maps each of count samples of src through the lookup table (all in device
+ * memory) and writes the result to dst. Samples are 1 or 2 bytes wide (the
+ * lookup table has 256 or 65536 entries of out_bytes width).
+ */
+CUDA_DLL_API int cuda_wrapper_apply_lut(void *dst, const void *src, size_t count,
+                int in_bytes, int out_bytes, const void *lut, cuda_wrapper_stream_t stream)
+{
+        unsigned int grid = (count + KERNEL_BLOCK_SIZE - 1) / KERNEL_BLOCK_SIZE;
+        cudaStream_t str = (cudaStream_t) stream;
+        if (in_bytes == 1 && out_bytes == 1) {
+                lut_kernel<<<grid, KERNEL_BLOCK_SIZE, 0, str>>>((uint8_t *) dst, (const uint8_t *) src, count, (const uint8_t *) lut);
+        } else if (in_bytes == 2 && out_bytes == 2) {
+                lut_kernel<<<grid, KERNEL_BLOCK_SIZE, 0, str>>>((uint16_t *) dst, (const uint16_t *) src, count, (const uint16_t *) lut);
+        } else if (in_bytes == 1 && out_bytes == 2) {
+                lut_kernel<<<grid, KERNEL_BLOCK_SIZE, 0, str>>>((uint16_t *) dst, (const uint8_t *) src, count, (const uint16_t *) lut);
+        } else if (in_bytes == 2 && out_bytes == 1) {
+                lut_kernel<<<grid, KERNEL_BLOCK_SIZE, 0, str>>>((uint8_t *) dst, (const uint16_t *) src, count, (const uint8_t *) lut);
+        } else {
+                return map_cuda_error(cudaErrorInvalidValue);
+        }
+        return map_cuda_error(cudaGetLastError());
+}
+
+template<typename T>
+__global__ void lut3d_kernel(T *dst, const T *src, size_t pixels, int channels, float maxval,
+                const float *lut, int lut_size)
+{
+        size_t i = blockIdx.x * (size_t) blockDim.x + threadIdx.x;
+        if (i >= pixels) {
+                return;
+        }
+        const T *in = src + i * channels;
+        T *out = dst + i * channels;
+        float rgb[3];
+        lut3d_sample(lut, lut_size, in[0] / maxval, in[1] / maxval, in[2] / maxval, rgb);
+        for (int c = 0; c < 3; ++c) {
+                out[c] = (T) (fminf(fmaxf(rgb[c], 0.0F), 1.0F) * maxval + 0.5F);
+        }
+        if (channels == 4) {
+                out[3] = in[3];
+        }
+}
+
+/**
+ * Applies a 3D LUT (see lut3d_sample()) to interleaved RGB(A) pixels with
+ * 1 or 2 bytes per component, all buffers in device memory. Alpha is copied.
+ */
+CUDA_DLL_API int cuda_wrapper_apply_lut3d(void *dst, const void *src, size_t pixels,
+                int bytes, int channels, const float *lut, int lut_size, cuda_wrapper_stream_t stream)
+{
+        unsigned int grid = (pixels + KERNEL_BLOCK_SIZE - 1) / KERNEL_BLOCK_SIZE;
+        cudaStream_t str = (cudaStream_t) stream;
+        if (bytes == 1) {
+                lut3d_kernel<<<grid, KERNEL_BLOCK_SIZE, 0, str>>>((uint8_t *) dst, (const uint8_t *) src, pixels, channels, 255.0F, lut, lut_size);
+        } else if (bytes == 2) {
+                lut3d_kernel<<<grid, KERNEL_BLOCK_SIZE, 0, str>>>((uint16_t *) dst, (const uint16_t *) src, pixels, channels, 65535.0F, lut, lut_size);
+        } else {
+                return map_cuda_error(cudaErrorInvalidValue);
+        }
+        return map_cuda_error(cudaGetLastError());
+}
+
+__global__ void flip_kernel(unsigned char *dst, const unsigned char *src, size_t linesize, size_t height)
+{
+        size_t x = blockIdx.x * (size_t) blockDim.x + threadIdx.x;
+        size_t y = blockIdx.y;
+        if (x < linesize) {
+                dst[(height - 1 - y) * linesize + x] = src[y * linesize + x];
+        }
+}
+
+/// copies height lines of src to dst in reverse order (vertical flip), buffers must not overlap
+CUDA_DLL_API int cuda_wrapper_flip_lines(void *dst, const void *src, size_t linesize,
+                size_t height, cuda_wrapper_stream_t stream)
+{
+        dim3 grid((linesize + KERNEL_BLOCK_SIZE - 1) / KERNEL_BLOCK_SIZE, height);
+        flip_kernel<<<grid, KERNEL_BLOCK_SIZE, 0, (cudaStream_t) stream>>>((unsigned char *) dst,
+                        (const unsigned char *) src, linesize, height);
+        return map_cuda_error(cudaGetLastError());
+}
@@ -61,6 +61,7 @@ extern "C" {
 /// @{
 #define CUDA_WRAPPER_MEMCPY_HOST_TO_DEVICE 0
 #define CUDA_WRAPPER_MEMCPY_DEVICE_TO_HOST 1
+#define CUDA_WRAPPER_MEMCPY_DEVICE_TO_DEVICE 2
 /// @}
 
 typedef void *cuda_wrapper_stream_t;
@@ -72,12 +73,24 @@ CUDA_DLL_API int cuda_wrapper_malloc(void **buffer, size_t data_len);
 CUDA_DLL_API int cuda_wrapper_malloc_host(void **buffer, size_t data_len);
 CUDA_DLL_API int cuda_wrapper_memcpy(void *dst, const void *src,
                 size_t count, int kind);
+CUDA_DLL_API int cuda_wrapper_memcpy_async(void *dst, const void *src,
+                size_t count, int kind, cuda_wrapper_stream_t stream);
+CUDA_DLL_API int cuda_wrapper_stream_create(cuda_wrapper_stream_t *stream);
+CUDA_DLL_API int cuda_wrapper_stream_destroy(cuda_wrapper_stream_t stream);
+CUDA_DLL_API int cuda_wrapper_stream_synchronize(cuda_wrapper_stream_t stream);
 CUDA_DLL_API const char *cuda_wrapper_last_error_string(void);
 CUDA_DLL_API int cuda_wrapper_set_device(int index);
 CUDA_DLL_API int cuda_wrapper_get_last_error(void);
 CUDA_DLL_API const char * cuda_wrapper_get_error_string(int error);
 CUDA_DLL_API void cuda_wrapper_print_devices_info(void);
 
+CUDA_DLL_API int cuda_wrapper_apply_lut(void *dst, const void *src, size_t count,
+                int in_bytes, int out_bytes, const void *lut, cuda_wrapper_stream_t stream);
+CUDA_DLL_API int cuda_wrapper_apply_lut3d(void *dst, const void *src, size_t pixels,
+                int bytes, int channels, const float *lut, int lut_size, cuda_wrapper_stream_t stream);
+CUDA_DLL_API int cuda_wrapper_flip_lines(void *dst, const void *src, size_t linesize,
+                size_t height, cuda_wrapper_stream_t stream);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
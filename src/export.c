@@ -339,8 +339,17 @@ void export_audio(struct exporter *s, struct audio_frame *frame)
 }
 
 void export_video(struct exporter *s, struct video_frame *frame)
+{
+        export_video_ref(s, frame, NULL, NULL);
+}
+
+void export_video_ref(struct exporter *s, struct video_frame *frame,
+                void (*release)(void *udata), void *udata)
 {
         if(!s){
+                if (release) {
+                        release(udata);
+                }
                 return;
         }
 
@@ -348,7 +357,9 @@ void export_video(struct exporter *s, struct video_frame *frame)
 
         pthread_mutex_lock(&s->lock);
         if (s->exporting) {
-                video_export(s->video_export, frame);
+                video_export_ref(s->video_export, frame, release, udata);
+        } else if (release) {
+                release(udata);
         }
         if (s->limit > 0) {
                 if (--s->limit == 0) {
@@ -55,6 +55,9 @@ struct exporter *export_init(struct module *parent, const char *cfg, bool should
 void export_destroy(struct exporter *state);
 void export_audio(struct exporter *state, struct audio_frame *frame);
 void export_video(struct exporter *state, struct video_frame *frame);
+/// same as export_video() but the frame data may be referenced until release(udata) is called
+void export_video_ref(struct exporter *state, struct video_frame *frame,
+                void (*release)(void *udata), void *udata);
 
 #ifdef __cplusplus
 }
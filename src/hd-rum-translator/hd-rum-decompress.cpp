@@ -67,6 +67,7 @@
 #include "video_display/pipe.hpp"
 #include "video_rxtx/ultragrid_rtp.h"
 
+#include "utils/macros.h"
 #include "utils/profile_timer.hpp"
 
 static constexpr int MAX_QUEUE_SIZE = 2;
@@ -134,8 +135,18 @@ ssize_t hd_rum_decompress_write(void *state, void *buf, size_t count)
 {
         struct state_transcoder_decompress *s = (struct state_transcoder_decompress *) state;
 
+#ifdef WIN32 // no multithreaded receiving, pass it through the loopback
         return rtp_send_raw_rtp_data(s->video_rxtx->m_network_devices[0],
                         (char *) buf, count);
+#else
+        int ret = rtp_inject_packet(s->video_rxtx->m_network_devices[0],
+                        (const char *) buf, count);
+        if (ret < 0 && errno == ENOBUFS) { // decoder too slow, reported only once instead of per packet
+                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('H', 'R', 'D', 'Q'), "Hd-rum-decompress receive queue full, dropping packets!\n");
+                return 0;
+        }
+        return ret;
+#endif
 }
 
 void state_transcoder_decompress::worker()
@@ -179,7 +190,7 @@ void *hd_rum_decompress_init(struct module *parent, struct hd_rum_output_conf co
 
         switch(conf.mode){
         case NORMAL:
-                snprintf(cfg, sizeof cfg, "%p", s);
+                snprintf(cfg, sizeof cfg, "%p%s", s, conf.gpu ? ":gpu" : "");
                 ret = initialize_video_display(parent, "pipe", cfg, 0, NULL, &s->display);
                 break;
         case BLEND:
@@ -36,6 +36,10 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -47,6 +51,7 @@ enum hd_rum_mode_t {NORMAL, BLEND, CONFERENCE};
 struct hd_rum_output_conf{
         enum hd_rum_mode_t mode;
         const char *arg;
+        bool gpu; ///< decode to CUDA memory (NORMAL mode only)
 };
 
 ssize_t hd_rum_decompress_write(void *state, void *buf, size_t count);
@@ -47,6 +47,7 @@
 
 #include <cinttypes>
 #include <chrono>
+#include <cstring>
 #include <memory>
 #include <thread>
 #include <string>
@@ -54,11 +55,14 @@
 
 #include "hd-rum-translator/hd-rum-recompress.h"
 
+#include "capture_filter.h"
 #include "debug.h"
 #include "host.h"
 #include "rtp/rtp.h"
 #include "tv.h"
+#include "utils/synchronized_queue.h"
 #include "video_compress.h"
+#include "video_frame.h"
 
 #include "video_rxtx/ultragrid_rtp.h"
 #include "utils/profile_timer.hpp"
@@ -87,13 +91,26 @@ struct recompress_output_port {
         bool active;
 };
 
+/**
+ * One transcoding branch - ports sharing the same compression and capture
+ * filter (eg. resize). Branches with a filter run it on their own thread so
+ * that multiple output profiles are produced from one decoded frame in
+ * parallel.
+ */
 struct recompress_worker_ctx {
         std::string compress_cfg;
+        std::string filter_cfg;
         std::unique_ptr<compress_state, compress_state_deleter> compress;
 
+        struct capture_filter *filter = nullptr;
+        synchronized_queue<std::shared_ptr<video_frame>, 1> filter_queue;
+        std::thread filter_thread;
+
         std::mutex ports_mut;
         std::vector<recompress_output_port> ports;
 
+        bool cuda_input = false; ///< frames in CUDA memory can be passed to compress as-is
+
         std::thread thread;
 };
 
@@ -187,18 +204,76 @@ static void recompress_worker(struct recompress_worker_ctx *ctx){
         }
 }
 
-static int move_port_to_worker(struct state_recompress *s, const char *compress,
-                recompress_output_port&& port)
+static void recompress_filter_worker(struct recompress_worker_ctx *ctx){
+        PROFILE_FUNC;
+
+        while (auto frame = ctx->filter_queue.pop()) {
+                // the frame is shared with other branches, filters may modify it in place
+                struct video_frame *f = vf_get_copy(frame.get());
+                f->callbacks.dispose = vf_free;
+                frame.reset();
+                f = capture_filter(ctx->filter, f);
+                if (f == nullptr) {
+                        continue;
+                }
+                auto deleter = f->callbacks.dispose ? f->callbacks.dispose : vf_free;
+                compress_frame(ctx->compress.get(), shared_ptr<video_frame>(f, deleter));
+        }
+        //poison compress
+        compress_frame(ctx->compress.get(), nullptr);
+}
+
+static std::string worker_key(const char *filter, const char *compress)
+{
+        if (filter == nullptr || strlen(filter) == 0) {
+                return compress;
+        }
+        return std::string(filter) + "|" + compress;
+}
+
+static void worker_stop(recompress_worker_ctx& worker)
 {
-        auto& worker = s->workers[compress];
+        if (worker.filter) {
+                worker.filter_queue.push({});
+                worker.filter_thread.join();
+                capture_filter_destroy(worker.filter);
+                worker.filter = nullptr;
+        } else {
+                //poison compress
+                compress_frame(worker.compress.get(), nullptr);
+        }
+        worker.thread.join();
+}
+
+static int move_port_to_worker(struct state_recompress *s, const char *filter,
+                const char *compress, recompress_output_port&& port)
+{
+        std::string key = worker_key(filter, compress);
+        auto& worker = s->workers[key];
         if(!worker.compress){
                 worker.compress_cfg = compress;
                 compress_state *cmp = nullptr;
                 int ret = compress_init(s->parent, compress, &cmp);
-                if(ret != 0)
+                if(ret != 0) {
+                        s->workers.erase(key);
                         return -1;
+                }
                 worker.compress.reset(cmp);
 
+                if (key != compress) {
+                        worker.filter_cfg = filter;
+                        if (capture_filter_init(s->parent, filter, &worker.filter) != 0) {
+                                log_msg(LOG_LEVEL_ERROR, "Unable to initialize capture filter %s!\n", filter);
+                                worker.compress.reset();
+                                s->workers.erase(key);
+                                return -1;
+                        }
+                        worker.filter_queue.set_name(("hd_rum_filter:" + key).c_str());
+                        worker.filter_thread = std::thread(recompress_filter_worker, &worker);
+                }
+                // capture filters process the frame in host memory
+                worker.cuda_input = worker.filter == nullptr && compress_accepts_cuda_frames(compress);
+
                 worker.thread = std::thread(recompress_worker, &worker);
         }
 
@@ -210,7 +285,7 @@ static int move_port_to_worker(struct state_recompress *s, const char *compress,
 }
 
 int recompress_add_port(struct state_recompress *s, struct module *parent_rep,
-		const char *host, const char *compress, unsigned short rx_port,
+		const char *host, const char *compress, const char *filter, unsigned short rx_port,
 		unsigned short tx_port, int mtu, const char *fec, long long bitrate)
 {
         recompress_output_port port;
@@ -223,12 +298,12 @@ int recompress_add_port(struct state_recompress *s, struct module *parent_rep,
         }
 
         std::lock_guard<std::mutex> lock(s->mut);
-        int index_in_worker = move_port_to_worker(s, compress, std::move(port));
+        int index_in_worker = move_port_to_worker(s, filter, compress, std::move(port));
         if(index_in_worker < 0)
                 return -1;
 
         int index_of_port = s->index_to_port.size();
-        s->index_to_port.emplace_back(compress, index_in_worker);
+        s->index_to_port.emplace_back(worker_key(filter, compress), index_in_worker);
 
         return index_of_port;
 }
@@ -245,9 +320,8 @@ static void extract_port(struct state_recompress *s,
                 worker.ports.erase(worker.ports.begin() + i);
 
                 if(worker.ports.empty()){
-                        //poison compress
-                        compress_frame(worker.compress.get(), nullptr);
-                        worker.thread.join();
+                        worker_stop(worker);
+                        lock.unlock();
                         s->workers.erase(compress_cfg);
                 }
         }
@@ -288,21 +362,24 @@ bool recompress_port_change_compress(struct state_recompress *s, int index,
                 const char *new_compress)
 {
         std::lock_guard<std::mutex> lock(s->mut);
-        auto [old_compress, i] = s->index_to_port[index];
+        auto [old_key, i] = s->index_to_port[index];
+        // the capture filter of the port is kept
+        std::string filter = s->workers[old_key].filter_cfg;
+        std::string new_key = worker_key(filter.c_str(), new_compress);
 
-        if(old_compress == new_compress)
+        if(old_key == new_key)
                 return true;
 
         recompress_output_port port;
-        extract_port(s, old_compress, i, &port);
-        int index_in_worker = move_port_to_worker(s, new_compress, std::move(port));
+        extract_port(s, old_key, i, &port);
+        int index_in_worker = move_port_to_worker(s, filter.c_str(), new_compress, std::move(port));
 
         if(index_in_worker < 0){
                 s->index_to_port.erase(s->index_to_port.begin() + index);
                 return false;
         }
 
-        s->index_to_port[index] = {new_compress, index_in_worker};
+        s->index_to_port[index] = {new_key, index_in_worker};
 
         return true;
 }
@@ -339,9 +416,35 @@ struct state_recompress *recompress_init(struct module *parent) {
 void recompress_process_async(state_recompress *s, std::shared_ptr<video_frame> frame){
         PROFILE_FUNC;
         std::lock_guard<std::mutex> lock(s->mut);
-        for(const auto& worker : s->workers){
-                if(worker_get_num_active_ports(worker.second) > 0)
-                        compress_frame(worker.second.compress.get(), frame);
+        // frame decoded to CUDA memory is downloaded at most once for all
+        // branches that cannot take it from the device
+        shared_ptr<video_frame> host_frame;
+        bool host_frame_failed = false;
+        for(auto& worker : s->workers){
+                if(worker_get_num_active_ports(worker.second) == 0) {
+                        continue;
+                }
+                auto branch_frame = frame;
+                if (frame->mem_location == CUDA_MEM && !worker.second.cuda_input) {
+                        if (!host_frame && !host_frame_failed) {
+                                struct video_frame *f = vf_download_cuda(frame.get());
+                                host_frame = f != nullptr ? shared_ptr<video_frame>(f, vf_free) : nullptr;
+                                host_frame_failed = !host_frame;
+                        }
+                        if (!host_frame) {
+                                continue;
+                        }
+                        branch_frame = host_frame;
+                }
+                if (worker.second.filter == nullptr) {
+                        compress_frame(worker.second.compress.get(), branch_frame);
+                } else if (worker.second.filter_queue.size() == 0) {
+                        worker.second.filter_queue.push(branch_frame);
+                } else {
+                        worker.second.filter_queue.count_drop();
+                        log_msg(LOG_LEVEL_VERBOSE, "[0x%08" PRIx32 "->%s] Branch busy, dropping frame.\n",
+                                        frame->ssrc, worker.first.c_str());
+                }
         }
 }
 
@@ -349,10 +452,7 @@ void recompress_done(struct state_recompress *s) {
         {
                 std::lock_guard<std::mutex> lock(s->mut);
                 for(auto& worker : s->workers){
-                        //poison compress
-                        compress_frame(worker.second.compress.get(), nullptr);
-
-                        worker.second.thread.join();
+                        worker_stop(worker.second);
                 }
         }
         delete s;
@@ -58,7 +58,7 @@ uint32_t recompress_get_port_ssrc(struct state_recompress *s, int idx);
 
 
 int recompress_add_port(struct state_recompress *s, struct module *parent_rep,
-		const char *host, const char *compress, unsigned short rx_port,
+		const char *host, const char *compress, const char *filter, unsigned short rx_port,
 		unsigned short tx_port, int mtu, const char *fec, long long bitrate);
 
 void recompress_remove_port(struct state_recompress *s, int index);
@@ -68,12 +68,19 @@
 #include "module.h"
 #include "rtp/net_udp.h"
 #include "utils/color_out.h" // format_in_si_units, unit_evaluate
+#include "utils/lockfree_queue.h" // LOCKFREE_QUEUE_RELAX
 #include "utils/misc.h" // format_in_si_units, unit_evaluate
 #include "tv.h"
 #include "utils/net.h"
 
+#include <atomic>
+#include <cerrno>
 #include <cinttypes>
+#include <deque>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -132,6 +139,44 @@ struct replica {
     };
     enum type_t type;
     socket_udp *sock;
+
+    /// forwarded packets that couldn't be sent without blocking, see forward_batch()
+    deque<vector<char>> backlog;
+    std::atomic<unsigned> backlog_len{0};
+    std::atomic<unsigned long long> dropped{0};
+    std::atomic<unsigned long long> send_errors{0};
+
+    unsigned decimation = 1; ///< forward only every n-th frame, see decimate_batch()
+    struct {
+        bool started = false;
+        bool frame_end = false;  ///< the last packet had the marker bit set
+        unsigned count = 0;      ///< frames seen
+        uint32_t ts[2]{};        ///< RTP timestamp of the current and previous frame
+        bool forward[2]{};       ///< whether the current and previous frame is forwarded
+    } decim;
+};
+
+enum replica_drop_policy {
+    DROP_OLDEST, ///< drop the oldest queued packet
+    DROP_FRAME,  ///< drop queued packets up to the end (RTP marker) of the oldest frame
+};
+
+#define DEFAULT_REPLICA_QUEUE_LEN 512
+#define BACKLOG_RETRY_NS (NS_IN_SEC / 1000) ///< backlog resend interval if there are no new packets
+
+struct hd_rum_translator_state;
+
+/**
+ * Additional writer thread that sends packets to a subset of forwarding
+ * replicas (those with index % writer_count == index). It reads the packet
+ * queue with its own cursor, the queue item can be reused by the receiver
+ * only after all writers have passed it.
+ */
+struct writer_shard {
+    struct hd_rum_translator_state *s;
+    unsigned index;
+    std::atomic<struct item *> head;
+    pthread_t thread;
 };
 
 struct hd_rum_translator_state {
@@ -153,16 +198,24 @@ struct hd_rum_translator_state {
     int bufsize = 0;
     struct control_state *control_state = nullptr;
     struct item *queue = nullptr;
-    struct item *qhead = nullptr;
-    struct item *qtail = nullptr;
-    int qempty = 1;
-    int qfull = 0;
+    std::atomic<struct item *> qhead{nullptr}; ///< main writer cursor
+    std::atomic<struct item *> qtail{nullptr}; ///< receiver cursor
+    /// writers and receiver park on the cond only if spinning didn't help,
+    /// the other side locks the mutex only if there is someone parked
+    std::atomic<int> writers_waiting{0};
+    std::atomic<bool> receiver_waiting{false};
     pthread_mutex_t qempty_mtx;
     pthread_mutex_t qfull_mtx;
     pthread_cond_t qempty_cond;
     pthread_cond_t qfull_cond;
 
     vector<replica *> replicas;
+    /// held exclusively by the main writer when modifying replicas, shared by shards
+    std::shared_mutex replicas_lock;
+    vector<unique_ptr<writer_shard>> shards; ///< writers except the main one
+    unsigned replica_queue_len = DEFAULT_REPLICA_QUEUE_LEN; ///< 0 - blocking sends, no backlog
+    enum replica_drop_policy drop_policy = DROP_OLDEST;
+    time_ns_t last_stats_report = 0;
     void *decompress = nullptr;
     struct state_recompress *recompress = nullptr;
 };
@@ -173,6 +226,9 @@ struct hd_rum_translator_state {
 static struct item *qinit(int qsize);
 static void qdestroy(struct item *queue);
 static void *writer(void *arg);
+#ifndef WIN32
+static void *shard_writer(void *arg);
+#endif
 static void signal_handler(int signal);
 
 static void signal_handler(int signal)
@@ -264,6 +320,34 @@ static void qdestroy(struct item *queue)
     free(queue);
 }
 
+static string replica_stats(struct replica *r)
+{
+    ostringstream oss;
+    oss << "queue " << r->backlog_len.load(std::memory_order_relaxed)
+        << " dropped " << r->dropped.load(std::memory_order_relaxed)
+        << " errors " << r->send_errors.load(std::memory_order_relaxed);
+    return oss.str();
+}
+
+#define REPLICA_STATS_INTERVAL (5 * NS_IN_SEC)
+/// reports backlog depth and drop counters of forwarding replicas to control socket
+static void report_replica_stats(struct hd_rum_translator_state *s)
+{
+    if (!control_stats_enabled(s->control_state)) {
+        return;
+    }
+    time_ns_t now = get_time_in_ns();
+    if (now - s->last_stats_report < REPLICA_STATS_INTERVAL) {
+        return;
+    }
+    s->last_stats_report = now;
+    for (auto *r : s->replicas) {
+        if (r->type == replica::type_t::USE_SOCK) {
+            control_report_stats(s->control_state, string("replica ") + r->mod.name + " " + replica_stats(r));
+        }
+    }
+}
+
 #define prefix_matches(x,y) strncasecmp(x, y, strlen(y)) == 0
 static struct response *change_replica_type(struct hd_rum_translator_state *s,
         struct module *mod, struct message *msg, int index)
@@ -278,6 +362,14 @@ static struct response *change_replica_type(struct hd_rum_translator_state *s,
     } else if (strcasecmp(data->text, "recompress") == 0) {
         r->type = replica::type_t::RECOMPRESS;
         log_msg(LOG_LEVEL_NOTICE, "Output port %d is now transcoding.\n", index);
+    } else if (prefix_matches(data->text, "decimate ")) {
+        int n = atoi(data->text + strlen("decimate "));
+        if (n < 1) {
+            return new_response(RESPONSE_BAD_REQUEST, "decimation must be at least 1");
+        }
+        r->decimation = n;
+        log_msg(LOG_LEVEL_NOTICE, "Output port %d now forwards every %d. frame.\n", index, n);
+        return new_response(RESPONSE_OK, NULL);
     } else if (prefix_matches(data->text, "compress ")) {
         if(recompress_port_change_compress(s->recompress, index, data->text + strlen("compress "))){
             log_msg(LOG_LEVEL_NOTICE, "Output port %d compression changed.\n", index);
@@ -309,7 +401,7 @@ static VOID CALLBACK wsa_deleter(DWORD /* dwErrorCode */,
 
 static int create_output_port(struct hd_rum_translator_state *s,
         const char *addr, int rx_port, int tx_port, int bufsize, int force_ip_version,
-        const char *compression, int mtu, const char *fec, int bitrate)
+        const char *compression, const char *filter, int mtu, const char *fec, int bitrate)
 {
         struct replica *rep;
         try {
@@ -324,7 +416,7 @@ static int create_output_port(struct hd_rum_translator_state *s,
 
         rep->type = compression ? replica::type_t::RECOMPRESS : replica::type_t::USE_SOCK;
         int idx = recompress_add_port(s->recompress, &rep->mod,
-                addr, compression ? compression : "none",
+                addr, compression ? compression : "none", compression ? filter : nullptr,
                 0, tx_port, mtu, fec, bitrate);
         if (idx < 0) {
             fprintf(stderr, "Initializing output port '%s' compression failed!\n", addr);
@@ -341,16 +433,297 @@ static int create_output_port(struct hd_rum_translator_state *s,
         return idx;
 }
 
+#define QUEUE_SPIN_COUNT 256 ///< iterations before parking when the packet queue is empty/full
+
+/**
+ * waits until the receiver passes cursor head
+ * @param timeout_ns  maximal wait duration, -1 for infinite
+ * @returns           false on timeout
+ */
+static bool wait_for_packets(struct hd_rum_translator_state *s, struct item *head, long long timeout_ns = -1)
+{
+    for (int i = 0; i < QUEUE_SPIN_COUNT; ++i) {
+        if (s->qtail.load(std::memory_order_acquire) != head) {
+            return true;
+        }
+        LOCKFREE_QUEUE_RELAX();
+    }
+    struct timespec deadline{};
+    if (timeout_ns >= 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        long long nsec = deadline.tv_nsec + timeout_ns;
+        deadline.tv_sec += nsec / NS_IN_SEC;
+        deadline.tv_nsec = nsec % NS_IN_SEC;
+    }
+    pthread_mutex_lock(&s->qempty_mtx);
+    s->writers_waiting.fetch_add(1); // seq_cst - pairs with publish_packet()
+    int rc = 0;
+    while (s->qtail.load() == head && rc != ETIMEDOUT) {
+        rc = timeout_ns >= 0 ? pthread_cond_timedwait(&s->qempty_cond, &s->qempty_mtx, &deadline)
+            : pthread_cond_wait(&s->qempty_cond, &s->qempty_mtx);
+    }
+    s->writers_waiting.fetch_sub(1);
+    bool ret = s->qtail.load() != head;
+    pthread_mutex_unlock(&s->qempty_mtx);
+    return ret;
+}
+
+/// makes the items up to (excluding) tail available to the writers
+static void publish_packet(struct hd_rum_translator_state *s, struct item *tail)
+{
+    s->qtail.store(tail);
+    if (s->writers_waiting.load() > 0) {
+        pthread_mutex_lock(&s->qempty_mtx);
+        pthread_mutex_unlock(&s->qempty_mtx);
+        pthread_cond_broadcast(&s->qempty_cond);
+    }
+}
+
+/// moves the writer cursor and lets the receiver reuse the passed items
+static void advance_cursor(struct hd_rum_translator_state *s, std::atomic<struct item *> *cursor, struct item *pos)
+{
+    cursor->store(pos);
+    if (s->receiver_waiting.load()) {
+        pthread_mutex_lock(&s->qfull_mtx);
+        pthread_mutex_unlock(&s->qfull_mtx);
+        pthread_cond_signal(&s->qfull_cond);
+    }
+}
+
+static bool queue_full(struct hd_rum_translator_state *s);
+
+/// waits until all writers pass the item following the receiver cursor
+static void wait_for_space(struct hd_rum_translator_state *s)
+{
+    for (int i = 0; i < QUEUE_SPIN_COUNT; ++i) {
+        if (!queue_full(s)) {
+            return;
+        }
+        LOCKFREE_QUEUE_RELAX();
+    }
+    pthread_mutex_lock(&s->qfull_mtx);
+    s->receiver_waiting.store(true); // seq_cst - pairs with advance_cursor()
+    while (queue_full(s)) {
+        pthread_cond_wait(&s->qfull_cond, &s->qfull_mtx);
+    }
+    s->receiver_waiting.store(false);
+    pthread_mutex_unlock(&s->qfull_mtx);
+}
+
+#ifndef WIN32
+#define FANOUT_BATCH 64 ///< max packets forwarded to a replica with one sendmmsg()
+
+/**
+ * Collects up to FANOUT_BATCH queued packets starting from head.
+ * @returns number of collected packets, stops before the poisoned pill
+ */
+static int collect_batch(struct item *head, struct item *tail, char **bufs, int *lens)
+{
+    int count = 0;
+    for (struct item *it = head; it != tail && count < FANOUT_BATCH; it = it->next) {
+        if (it->size == 0) {
+            break;
+        }
+        bufs[count] = it->buf;
+        lens[count] = it->size;
+        count += 1;
+    }
+    return count;
+}
+
+/// @returns true if the packet is the last packet of a frame (RTP marker bit set)
+static bool is_frame_end(const char *buf, int len)
+{
+    if (len < 2 || ((unsigned char) buf[0] >> 6) != 2) {
+        return false;
+    }
+    unsigned char pt = (unsigned char) buf[1];
+    bool rtcp = pt >= 192 && pt <= 223;
+    return !rtcp && (pt & 0x80) != 0;
+}
+
+/**
+ * Selects packets of every r->decimation-th frame. A new frame starts when
+ * the RTP timestamp changes or after a packet with the marker bit. Late
+ * packets of the previous frame follow its decision, RTCP and non-RTP
+ * packets are always kept.
+ * @returns number of selected packets (stored to out_bufs/out_lens)
+ */
+static int decimate_batch(struct replica *r, char **bufs, int *lens, int count, char **out_bufs, int *out_lens)
+{
+    auto &d = r->decim;
+    int out_count = 0;
+    for (int i = 0; i < count; ++i) {
+        const unsigned char *pkt = (const unsigned char *) bufs[i];
+        bool keep = true;
+        if (lens[i] >= 12 && (pkt[0] >> 6) == 2 && !(pkt[1] >= 192 && pkt[1] <= 223)) {
+            uint32_t ts = (uint32_t) pkt[4] << 24 | pkt[5] << 16 | pkt[6] << 8 | pkt[7];
+            if (d.started && ts == d.ts[1] && ts != d.ts[0]) {
+                keep = d.forward[1];
+            } else {
+                if (!d.started || ts != d.ts[0] || d.frame_end) {
+                    d.ts[1] = d.ts[0];
+                    d.forward[1] = d.forward[0];
+                    d.ts[0] = ts;
+                    d.forward[0] = d.count++ % r->decimation == 0;
+                    d.started = true;
+                }
+                keep = d.forward[0];
+                d.frame_end = (pkt[1] & 0x80) != 0;
+            }
+        }
+        if (keep) {
+            out_bufs[out_count] = bufs[i];
+            out_lens[out_count++] = lens[i];
+        }
+    }
+    return out_count;
+}
+
+static void backlog_push(struct hd_rum_translator_state *s, struct replica *r, const char *buf, int len)
+{
+    if (r->backlog.size() >= s->replica_queue_len) {
+        if (s->drop_policy == DROP_FRAME) {
+            bool frame_end = false;
+            while (!r->backlog.empty() && !frame_end) {
+                frame_end = is_frame_end(r->backlog.front().data(), r->backlog.front().size());
+                r->backlog.pop_front();
+                r->dropped++;
+            }
+        } else {
+            r->backlog.pop_front();
+            r->dropped++;
+        }
+    }
+    r->backlog.emplace_back(buf, buf + len);
+}
+
+/**
+ * Sends (part of) the backlog without blocking.
+ * @returns true if the backlog was emptied
+ */
+static bool backlog_flush(struct replica *r)
+{
+    while (!r->backlog.empty()) {
+        char *bufs[FANOUT_BATCH];
+        int lens[FANOUT_BATCH];
+        int count = 0;
+        for (auto it = r->backlog.begin(); it != r->backlog.end() && count < FANOUT_BATCH; ++it) {
+            bufs[count] = it->data();
+            lens[count++] = it->size();
+        }
+        int ret = udp_send_multi(r->sock, bufs, lens, count, true);
+        r->backlog.erase(r->backlog.begin(), r->backlog.begin() + ret);
+        if (ret < count) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
+            }
+            r->send_errors++;
+            r->backlog.pop_front();
+        }
+    }
+    return true;
+}
+
+/**
+ * Sends the packets to a replica without blocking. Packets that cannot be
+ * sent now are queued to the replica backlog, so that a congested receiver
+ * doesn't stall the others. If the backlog is full, packets are dropped
+ * according to the drop policy.
+ */
+static void forward_to_replica(struct hd_rum_translator_state *s, struct replica *r, char **bufs, int *lens, int count)
+{
+    int sent = 0;
+    if (s->replica_queue_len == 0) { // blocking
+        while (sent < count) {
+            int ret = udp_send_multi(r->sock, bufs + sent, lens + sent, count - sent, false);
+            if (ret == count - sent) {
+                break;
+            }
+            perror("Hd-rum-translator send");
+            r->send_errors++;
+            sent += ret + 1; // skip the failed one
+        }
+        return;
+    }
+
+    if (backlog_flush(r)) {
+        while (sent < count) {
+            int ret = udp_send_multi(r->sock, bufs + sent, lens + sent, count - sent, true);
+            sent += ret;
+            if (sent == count || errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            r->send_errors++;
+            sent += 1; // skip the failed one
+        }
+    }
+    for ( ; sent < count; ++sent) {
+        backlog_push(s, r, bufs[sent], lens[sent]);
+    }
+    r->backlog_len.store(r->backlog.size(), std::memory_order_relaxed);
+}
+
+/**
+ * Sends the packets to the forwarding replicas of the shard (index % (shards + 1) == shard).
+ * @returns true if some replica of the shard has a non-empty backlog
+ */
+static bool forward_batch(struct hd_rum_translator_state *s, unsigned shard, char **bufs, int *lens, int count)
+{
+    const unsigned stride = s->shards.size() + 1;
+    bool pending = false;
+    for (unsigned int i = shard; i < s->replicas.size(); i += stride) {
+        if (s->replicas[i]->type == replica::type_t::USE_SOCK) {
+            if (s->replicas[i]->decimation > 1) {
+                char *sel_bufs[FANOUT_BATCH];
+                int sel_lens[FANOUT_BATCH];
+                int sel_count = decimate_batch(s->replicas[i], bufs, lens, count, sel_bufs, sel_lens);
+                forward_to_replica(s, s->replicas[i], sel_bufs, sel_lens, sel_count);
+            } else {
+                forward_to_replica(s, s->replicas[i], bufs, lens, count);
+            }
+            pending = pending || !s->replicas[i]->backlog.empty();
+        }
+    }
+    return pending;
+}
+
+/**
+ * Retries sending the backlogs of the shard replicas if there are no new packets.
+ * @returns true if some backlog is still non-empty
+ */
+static bool flush_backlogs(struct hd_rum_translator_state *s, unsigned shard)
+{
+    const unsigned stride = s->shards.size() + 1;
+    bool pending = false;
+    for (unsigned int i = shard; i < s->replicas.size(); i += stride) {
+        struct replica *r = s->replicas[i];
+        if (r->backlog.empty()) {
+            continue;
+        }
+        if (r->type != replica::type_t::USE_SOCK) {
+            r->backlog.clear();
+        } else {
+            pending = !backlog_flush(r) || pending;
+        }
+        r->backlog_len.store(r->backlog.size(), std::memory_order_relaxed);
+    }
+    return pending;
+}
+#endif
+
 static void *writer(void *arg)
 {
     struct hd_rum_translator_state *s =
         (struct hd_rum_translator_state *) arg;
+    bool backlog_pending = false;
 
     while (1) {
         // first check messages
         for (unsigned int i = 0; i < s->replicas.size(); i++) {
             struct message *msg;
             while ((msg = check_message(&s->replicas[i]->mod))) {
+                unique_lock<shared_mutex> lk(s->replicas_lock);
                 struct response *r = change_replica_type(s, &s->replicas[i]->mod, msg, i);
                 free_message(msg, r);
             }
@@ -358,6 +731,7 @@ static void *writer(void *arg)
 
         struct msg_universal *msg;
         while ((msg = (struct msg_universal *) check_message(&s->mod))) {
+            unique_lock<shared_mutex> lk(s->replicas_lock);
             struct response *r = NULL;
             if (strncasecmp(msg->text, "delete-port ", strlen("delete-port ")) == 0) {
                 char *port_spec = msg->text + strlen("delete-port ");
@@ -422,7 +796,7 @@ static void *writer(void *arg)
 
                 int idx = create_output_port(s,
                         host, 0, tx_port, s->bufsize, false,
-                        compress, 1500, nullptr, RATE_UNLIMITED);
+                        compress, nullptr, 1500, nullptr, RATE_UNLIMITED);
 
                 if(idx < 0) {
                     free_message((struct message *) msg, new_response(RESPONSE_INT_SERV_ERR, "Cannot create output port."));
@@ -441,22 +815,26 @@ static void *writer(void *arg)
             free_message((struct message *) msg, r ? r : new_response(RESPONSE_OK, NULL));
         }
 
+        report_replica_stats(s);
+
         // then process incoming packets
-        while (s->qhead != s->qtail) {
-            if(s->qhead->size == 0) { // poisoned pill
+        struct item *head = s->qhead.load(std::memory_order_relaxed);
+        struct item *tail;
+        while (head != (tail = s->qtail.load(std::memory_order_acquire))) {
+#ifdef WIN32
+            if(head->size == 0) { // poisoned pill
                 return NULL;
             }
 
             // pass it for transcoding if needed
             if (recompress_get_num_active_ports(s->recompress) > 0) {
-                ssize_t ret = hd_rum_decompress_write(s->decompress, s->qhead->buf, s->qhead->size);
+                ssize_t ret = hd_rum_decompress_write(s->decompress, head->buf, head->size);
                 if (ret < 0) {
                     perror("hd_rum_decompress_write");
                 }
             }
 
             // distribute it to output ports that don't need transcoding
-#ifdef WIN32
             // send it asynchronously in MSW (performance optimalization)
             SleepEx(0, TRUE); // allow system to call our completion routines in APC
             int ref = 0;
@@ -465,15 +843,15 @@ static void *writer(void *arg)
                     ref++;
                 }
             }
-            struct wsa_aux_storage *aux = (struct wsa_aux_storage *)(void *) ((char *) s->qhead->buf + OFFSET);
+            struct wsa_aux_storage *aux = (struct wsa_aux_storage *)(void *) ((char *) head->buf + OFFSET);
             memset(aux, 0, sizeof *aux);
             aux->overlapped = (WSAOVERLAPPED *) calloc(ref, sizeof(WSAOVERLAPPED));
             aux->ref = ref;
             int overlapped_idx = 0;
             for (unsigned int i = 0; i < s->replicas.size(); i++) {
                 if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
-                    aux->overlapped[overlapped_idx].hEvent = s->qhead->buf;
-                    ssize_t ret = udp_send_wsa_async(s->replicas[i]->sock, s->qhead->buf, s->qhead->size, wsa_deleter, &aux->overlapped[overlapped_idx]);
+                    aux->overlapped[overlapped_idx].hEvent = head->buf;
+                    ssize_t ret = udp_send_wsa_async(s->replicas[i]->sock, head->buf, head->size, wsa_deleter, &aux->overlapped[overlapped_idx]);
                     if (ret < 0) {
                         perror("Hd-rum-translator send");
                     }
@@ -481,34 +859,104 @@ static void *writer(void *arg)
                 }
             }
             // reallocate the buffer since the last one will be freeed automaticaly
-            s->qhead->buf = (char *) malloc(SIZE);
+            head->buf = (char *) malloc(SIZE);
+            head = head->next;
 #else
-            for (unsigned int i = 0; i < s->replicas.size(); i++) {
-                if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
-                    ssize_t ret = udp_send(s->replicas[i]->sock, s->qhead->buf, s->qhead->size);
+            char *bufs[FANOUT_BATCH];
+            int lens[FANOUT_BATCH];
+            int count = collect_batch(head, tail, bufs, lens);
+            if (count == 0) { // poisoned pill
+                return NULL;
+            }
+
+            // pass it for transcoding if needed
+            if (recompress_get_num_active_ports(s->recompress) > 0) {
+                for (int i = 0; i < count; ++i) {
+                    ssize_t ret = hd_rum_decompress_write(s->decompress, bufs[i], lens[i]);
                     if (ret < 0) {
-                        perror("Hd-rum-translator send");
+                        perror("hd_rum_decompress_write");
                     }
                 }
             }
+
+            // distribute it to output ports that don't need transcoding,
+            // replicas of the other shards are served by shard_writer()
+            backlog_pending = forward_batch(s, 0, bufs, lens, count);
+            for (int i = 0; i < count; ++i) {
+                head = head->next;
+            }
 #endif
-            s->qhead = s->qhead->next;
 
-            pthread_mutex_lock(&s->qfull_mtx);
-            s->qfull = 0;
-            pthread_cond_signal(&s->qfull_cond);
-            pthread_mutex_unlock(&s->qfull_mtx);
+            advance_cursor(s, &s->qhead, head);
         }
 
-        pthread_mutex_lock(&s->qempty_mtx);
-        if (s->qempty)
-            pthread_cond_wait(&s->qempty_cond, &s->qempty_mtx);
-        s->qempty = 1;
-        pthread_mutex_unlock(&s->qempty_mtx);
+        if (!backlog_pending) {
+            wait_for_packets(s, head);
+#ifndef WIN32
+        } else if (!wait_for_packets(s, head, BACKLOG_RETRY_NS)) {
+            backlog_pending = flush_backlogs(s, 0);
+#endif
+        }
+    }
+
+    return NULL;
+}
+
+#ifndef WIN32
+static void *shard_writer(void *arg)
+{
+    auto *w = (struct writer_shard *) arg;
+    struct hd_rum_translator_state *s = w->s;
+
+    bool backlog_pending = false;
+
+    while (1) {
+        if (backlog_pending) {
+            if (!wait_for_packets(s, w->head.load(std::memory_order_relaxed), BACKLOG_RETRY_NS)) {
+                shared_lock<shared_mutex> lk(s->replicas_lock);
+                backlog_pending = flush_backlogs(s, w->index);
+                continue;
+            }
+        } else {
+            wait_for_packets(s, w->head.load(std::memory_order_relaxed));
+        }
+        struct item *tail = s->qtail.load(std::memory_order_acquire);
+
+        // replicas are locked for the whole batch, not per packet
+        shared_lock<shared_mutex> lk(s->replicas_lock);
+        for (struct item *it = w->head.load(std::memory_order_relaxed); it != tail; ) {
+            char *bufs[FANOUT_BATCH];
+            int lens[FANOUT_BATCH];
+            int count = collect_batch(it, tail, bufs, lens);
+            if (count == 0) { // poisoned pill
+                return NULL;
+            }
+            backlog_pending = forward_batch(s, w->index, bufs, lens, count);
+            for (int i = 0; i < count; ++i) {
+                it = it->next;
+            }
+            advance_cursor(s, &w->head, it);
+        }
     }
 
     return NULL;
 }
+#endif // !defined WIN32
+
+/// @returns true if the receiver cannot overwrite next item because some writer hasn't sent it yet
+static bool queue_full(struct hd_rum_translator_state *s)
+{
+    struct item *next = s->qtail.load(std::memory_order_relaxed)->next;
+    if (next == s->qhead.load()) {
+        return true;
+    }
+    for (auto const &w : s->shards) {
+        if (w->head.load() == next) {
+            return true;
+        }
+    }
+    return false;
+}
 
 static void usage(const char *progname) {
         col() << SBOLD(SRED(progname) <<
@@ -519,22 +967,34 @@ static void usage(const char *progname) {
                 SBOLD("\t\t--conference <width>:<height>[:fps]") << " - enable combining of multiple inputs, increases latency\n" <<
                 SBOLD("\t\t--conference-compression <compression>") << " - compression for conference participants\n" <<
                 SBOLD("\t\t--capture-filter <cfg_string>") << " - apply video capture filter to incoming video\n" <<
+                SBOLD("\t\t--gpu-frames") << " - keep decoded frames in CUDA memory (GPUJPEG decoder, hosts with GPUJPEG\n"
+                        "\t\t\tcompression encode them without copying to host memory)\n" <<
+                SBOLD("\t\t--writers <n>") << " - number of threads sending to forwarding hosts (default 1)\n" <<
+                SBOLD("\t\t--replica-queue <packets>[:frame]") << " - backlog of a congested forwarding host (default " << DEFAULT_REPLICA_QUEUE_LEN << ", 0 - blocking send),\n"
+                        "\t\t\tif full, the oldest packet (or with :frame the rest of the oldest frame) is dropped\n" <<
                 SBOLD("\t\t--param") << " - additional parameters\n" <<
                 SBOLD("\t\t--help\n") <<
                 SBOLD("\t\t--verbose\n") <<
                 SBOLD("\t\t-v") << " - print version\n";
         col() << "\tand " << SUNDERLINE("hostX_options") << " may be:\n" <<
                 SBOLD("\t\t-P [<rx_port>:]<tx_port>") << " - TX port to be used (optionally also RX)\n" <<
+                SBOLD("\t\t-d <n>") << " - forward only every n-th frame (whole RTP frames are dropped, not with '-c')\n" <<
                 SBOLD("\t\t-c <compression>") << " - compression\n" <<
                 "\t\tFollowing options will be used only if " << SUNDERLINE("'-c'") << " parameter is set:\n" <<
                 SBOLD("\t\t-m <mtu>") << " - MTU size\n" <<
                 SBOLD("\t\t-l <limiting_bitrate>") << " - bitrate to be shaped to\n" <<
                 SBOLD("\t\t-f <fec>") << " - FEC that will be used for transmission.\n" <<
+                SBOLD("\t\t-F <capture_filter>") << " - capture filter (eg. resize) applied only for this host\n" <<
                 SBOLD("\t\t-4/-6") << " - force IPv4/IPv6\n";
         printf("\tPlease note that blending and capture filter is used only for host for which\n"
                "\tcompression is specified (transcoding is active). If compression is not\n"
                "\tset, simple packet retransmission is used. Compression can be also 'none'\n"
-               "\tfor uncompressed transmission (see 'uv -c help' for list).\n");
+               "\tfor uncompressed transmission (see 'uv -c help' for list).\n"
+               "\tThe stream is decoded once, hosts with the same compression and host\n"
+               "\tcapture filter share one encoder, different ones are encoded in parallel\n"
+               "\t(eg. '-F resize:1280x720 -c libavcodec:encoder=libx264 host').\n"
+               "\tA forwarding host can be also a multicast group - the packet is then\n"
+               "\tsent (and replicated by the kernel/network) only once for all members.\n");
 }
 
 struct host_opts {
@@ -544,8 +1004,10 @@ struct host_opts {
     int mtu;
     char *compression;
     char *fec;
+    char *filter;
     int64_t bitrate;
     int force_ip_version;
+    int decimation;
 };
 
 struct cmdline_parameters {
@@ -555,12 +1017,17 @@ struct cmdline_parameters {
     int host_count;
     int control_port = -1;
     int control_connection_type = 0;
-    struct hd_rum_output_conf out_conf = {NORMAL, NULL};
+    struct hd_rum_output_conf out_conf = {NORMAL, NULL, false};
     const char *capture_filter = NULL;
     bool verbose = false;
     char *conference_compression = nullptr;
+    int writers = 1;
+    int replica_queue_len = DEFAULT_REPLICA_QUEUE_LEN;
+    enum replica_drop_policy drop_policy = DROP_OLDEST;
 };
 
+#define MAX_WRITERS 64
+
 static bool needs_argument(const char *opt) {
     return strcmp(opt, "-4") != 0 && strcmp(opt, "-6") != 0;
 }
@@ -598,6 +1065,34 @@ static int parse_fmt(int argc, char **argv, struct cmdline_parameters *parsed)
             parsed->conference_compression = item;
         } else if(strcmp(argv[start_index], "--capture-filter") == 0) {
             parsed->capture_filter = argv[++start_index];
+        } else if(strcmp(argv[start_index], "--gpu-frames") == 0) {
+            parsed->out_conf.gpu = true;
+        } else if(strcmp(argv[start_index], "--writers") == 0 && start_index < argc - 1) {
+            parsed->writers = atoi(argv[++start_index]);
+            if (parsed->writers < 1 || parsed->writers > MAX_WRITERS) {
+                LOG(LOG_LEVEL_FATAL) << MOD_NAME << "Number of writers must be between 1 and " << MAX_WRITERS << "!\n";
+                return -1;
+            }
+#ifdef WIN32
+            if (parsed->writers > 1) {
+                LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Multiple writers are not supported in MSW, using one.\n";
+                parsed->writers = 1;
+            }
+#endif
+        } else if(strcmp(argv[start_index], "--replica-queue") == 0 && start_index < argc - 1) {
+            char *item = argv[++start_index];
+            parsed->replica_queue_len = atoi(item);
+            if (strchr(item, ':') != nullptr) {
+                if (strcmp(strchr(item, ':') + 1, "frame") != 0) {
+                    LOG(LOG_LEVEL_FATAL) << MOD_NAME << "Unknown drop policy: " << strchr(item, ':') + 1 << "\n";
+                    return -1;
+                }
+                parsed->drop_policy = DROP_FRAME;
+            }
+            if (parsed->replica_queue_len < 0) {
+                LOG(LOG_LEVEL_FATAL) << MOD_NAME << "Wrong replica queue length: " << item << "\n";
+                return -1;
+            }
         } else if(strcmp(argv[start_index], "-h") == 0 || strcmp(argv[start_index], "--help") == 0) {
             usage(argv[0]);
             return 1;
@@ -615,6 +1110,11 @@ static int parse_fmt(int argc, char **argv, struct cmdline_parameters *parsed)
         start_index++;
     }
 
+    if (parsed->out_conf.gpu && (parsed->out_conf.mode != NORMAL || parsed->capture_filter != nullptr)) {
+        LOG(LOG_LEVEL_FATAL) << MOD_NAME << "GPU frames cannot be combined with blending, conference or capture filter!\n";
+        return -1;
+    }
+
     if (argc < start_index + 2) {
         LOG(LOG_LEVEL_FATAL) << MOD_NAME << "Missing mandatory parameters!\n\n";
         usage(argv[0]);
@@ -660,6 +1160,7 @@ static int parse_fmt(int argc, char **argv, struct cmdline_parameters *parsed)
     for(int i = 0; i < parsed->host_count; ++i) {
         parsed->hosts[i].bitrate = RATE_UNLIMITED;
         parsed->hosts[i].mtu = 1500;
+        parsed->hosts[i].decimation = 1;
     }
 
     int host_idx = 0;
@@ -683,6 +1184,16 @@ static int parse_fmt(int argc, char **argv, struct cmdline_parameters *parsed)
                 case 'f':
                     parsed->hosts[host_idx].fec = argv[i + 1];
                     break;
+                case 'd':
+                    parsed->hosts[host_idx].decimation = atoi(argv[i + 1]);
+                    if (parsed->hosts[host_idx].decimation < 1) {
+                        LOG(LOG_LEVEL_FATAL) << MOD_NAME << "Error: wrong decimation - " << argv[i + 1] << "\n";
+                        exit(EXIT_FAIL_USAGE);
+                    }
+                    break;
+                case 'F':
+                    parsed->hosts[host_idx].filter = argv[i + 1];
+                    break;
                 case 'l':
                     if (strcmp(argv[i + 1], "unlimited") == 0) {
                         parsed->hosts[host_idx].bitrate = RATE_UNLIMITED;
@@ -825,6 +1336,8 @@ int main(int argc, char **argv)
     if (params.verbose) {
         log_level = LOG_LEVEL_VERBOSE;
     }
+    state.replica_queue_len = params.replica_queue_len;
+    state.drop_policy = params.drop_policy;
 
     if ((state.bufsize = atoi(params.bufsize)) <= 0) {
         fprintf(stderr, "invalid buffer size: %s\n", params.bufsize);
@@ -851,8 +1364,9 @@ int main(int argc, char **argv)
         EXIT(EXIT_FAIL_USAGE);
     }
 
-    state.qhead = state.qtail = state.queue = qinit(qsize);
-    if (!state.qhead) {
+    state.queue = qinit(qsize);
+    state.qhead = state.qtail = state.queue;
+    if (!state.queue) {
         EXIT(EXIT_FAILURE);
     }
 
@@ -901,16 +1415,39 @@ int main(int argc, char **argv)
 
         int idx = create_output_port(&state,
                 h.addr, rx_port, tx_port, state.bufsize, h.force_ip_version,
-                h.compression, h.mtu, h.compression ? h.fec : nullptr, h.bitrate);
+                h.compression, h.filter, h.mtu, h.compression ? h.fec : nullptr, h.bitrate);
         if(idx < 0) {
             EXIT(EXIT_FAILURE);
         }
+        if (h.decimation > 1 && h.compression != nullptr) {
+            LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Decimation is applied only to forwarded (not transcoded) streams.\n";
+        }
+        state.replicas[idx]->decimation = h.decimation;
     }
 
+    // shards must be set up before any writer starts
+    for (i = 1; i < params.writers; i++) {
+        auto w = make_unique<writer_shard>();
+        w->s = &state;
+        w->index = i;
+        w->head = state.queue;
+        state.shards.push_back(std::move(w));
+    }
     if (pthread_create(&thread, NULL, writer, (void *) &state)) {
         fprintf(stderr, "cannot create writer thread\n");
         EXIT(2);
     }
+#ifndef WIN32
+    for (auto &w : state.shards) {
+        if (pthread_create(&w->thread, NULL, shard_writer, w.get())) {
+            fprintf(stderr, "cannot create writer thread\n");
+            EXIT(2);
+        }
+    }
+#endif
+    if (!state.shards.empty()) {
+        LOG(LOG_LEVEL_INFO) << MOD_NAME << "Using " << params.writers << " writer threads.\n";
+    }
 
     uint64_t received_data = 0;
     struct timeval t0;
@@ -924,13 +1461,14 @@ int main(int argc, char **argv)
     register_should_exit_callback(&state.mod, hd_rum_translator_should_exit_callback, const_cast<bool *>(&should_exit));
     /* main loop */
     while (!should_exit) {
-        while (state.qtail->next != state.qhead && !should_exit) {
+        while (!queue_full(&state) && !should_exit) {
+            struct item *tail = state.qtail.load(std::memory_order_relaxed);
             struct timeval timeout = { 1, 0 };
 
             struct sockaddr_storage sin = {};
             socklen_t addrlen = sizeof(sin);
-            state.qtail->size = udp_recvfrom_timeout(sock_in, state.qtail->buf, SIZE, &timeout, (sockaddr *) &sin, &addrlen);
-            if(state.qtail->size <= 0)
+            tail->size = udp_recvfrom_timeout(sock_in, tail->buf, SIZE, &timeout, (sockaddr *) &sin, &addrlen);
+            if(tail->size <= 0)
                 break;
 
             struct timeval t;
@@ -997,14 +1535,9 @@ int main(int argc, char **argv)
                     }
             }
 
-            received_data += state.qtail->size;
+            received_data += tail->size;
 
-            state.qtail = state.qtail->next;
-
-            pthread_mutex_lock(&state.qempty_mtx);
-            state.qempty = 0;
-            pthread_cond_signal(&state.qempty_cond);
-            pthread_mutex_unlock(&state.qempty_mtx);
+            publish_packet(&state, tail->next);
 
             double seconds = tv_diff(t, t0);
             if (seconds > 5.0) {
@@ -1022,32 +1555,26 @@ int main(int argc, char **argv)
             }
         }
 
-        if (state.qtail->size <= 0)
+        if (state.qtail.load()->size <= 0)
             continue;
 
-        pthread_mutex_lock(&state.qfull_mtx);
-        if (state.qfull)
-            pthread_cond_wait(&state.qfull_cond, &state.qfull_mtx);
-        state.qfull = 1;
-        pthread_mutex_unlock(&state.qfull_mtx);
+        wait_for_space(&state);
     }
 
-    if (state.qtail->size < 0 && !should_exit) {
+    if (state.qtail.load()->size < 0 && !should_exit) {
         printf("read: %s\n", strerror(err));
         EXIT(2);
     }
 
     // pass poisoned pill to the worker
-    state.qtail->size = 0;
-    state.qtail = state.qtail->next;
-
-    pthread_mutex_lock(&state.qempty_mtx);
-    state.qempty = 0;
-    pthread_cond_signal(&state.qempty_cond);
-    pthread_mutex_unlock(&state.qempty_mtx);
+    state.qtail.load()->size = 0;
+    publish_packet(&state, state.qtail.load()->next);
 
     alarm(5);
     pthread_join(thread, NULL);
+    for (auto &w : state.shards) {
+        pthread_join(w->thread, NULL);
+    }
 
     hd_rum_translator_deinit(&state);
     udp_exit(sock_in);
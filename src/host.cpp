@@ -64,6 +64,7 @@
 #include "messaging.h"
 #include "module.h"
 #include "utils/color_out.h"
+#include "utils/fs.h"
 #include "utils/misc.h" // unit_evaluate
 #include "utils/string.h"
 #include "utils/string_view_utils.hpp"
@@ -76,8 +77,10 @@
 #include "capture_filter.h"
 #include "video.h"
 
+#include <algorithm>
 #include <array>
 #include <chrono>
+#include <ctime>
 #include <getopt.h>
 #include <iomanip>
 #include <iostream>
@@ -99,6 +102,7 @@
 #endif
 
 #ifdef __linux__
+#include <dirent.h>
 #include <mcheck.h>
 #endif
 
@@ -447,9 +451,7 @@ struct state_root {
                         platform_pipe_close(should_exit_pipe[0]);
                 }
         }
-        static void deleter(struct module *m) {
-                delete (state_root*) m->priv_data;
-        }
+        static void deleter(struct module *m);
 
         static void should_exit_watcher(state_root *s) {
                 set_thread_name(__func__);
@@ -507,19 +509,32 @@ private:
 
 static state_root * volatile state_root_static; ///< used by exit_uv() called from signal handler
 
+void state_root::deleter(struct module *m) {
+        if (state_root_static == m->priv_data) {
+                state_root_static = nullptr;
+        }
+        delete (state_root*) m->priv_data;
+}
+
 /**
  * Initializes root module
  *
  * This the root module is also responsible for regiestering and broadcasting
  * should_exit events (see register_should_exit_callback) called by exit_uv().
+ *
+ * More root modules may exist at once (sessions of the daemon mode), exit_uv()
+ * applies to the first one (the process), exit_uv_root() to a particular one.
  */
 void init_root_module(struct module *root_mod) {
         module_init_default(root_mod);
         root_mod->cls = MODULE_CLASS_ROOT;
         root_mod->new_message = state_root::new_message;
         root_mod->deleter = state_root::deleter;
-        state_root_static = new state_root();
-        root_mod->priv_data = state_root_static;
+        auto *s = new state_root();
+        root_mod->priv_data = s;
+        if (state_root_static == nullptr) {
+                state_root_static = s;
+        }
 }
 
 /**
@@ -530,11 +545,20 @@ void init_root_module(struct module *root_mod) {
 void exit_uv(int status) {
         if (!state_root_static) {
                 log_msg(LOG_LEVEL_WARNING, "%s called witout state registered.\n", __func__);
+                return;
         }
         state_root_static->exit_status = status;
         state_root_static->broadcast_should_exit();
 }
 
+/// exit_uv() of the tree given by root_mod only
+void exit_uv_root(struct module *root_mod, int status) {
+        assert(root_mod->cls == MODULE_CLASS_ROOT);
+        auto *s = static_cast<state_root *>(root_mod->priv_data);
+        s->exit_status = status;
+        s->broadcast_should_exit();
+}
+
 int get_exit_status(struct module *root_mod) {
         assert(root_mod->cls == MODULE_CLASS_ROOT);
         return static_cast<state_root *>(root_mod->priv_data)->exit_status;
@@ -557,7 +581,7 @@ static void print_device(std::string purpose, std::string mod, const device_info
                         break;
                 }
                 if (j > 0) {
-                        printf(", ");
+                        std::cout << ", ";
                 }
                 std::cout << "{\"name\":" << std::quoted(device.modes[j].name) << ", "
                         "\"opts\":" << device.modes[j].id << "}";
@@ -570,7 +594,7 @@ static void print_device(std::string purpose, std::string mod, const device_info
                         break;
                 }
                 if (j > 0) {
-                        printf(", ");
+                        std::cout << ", ";
                 }
                 cout << "{"
                     "\"display_name\":" << std::quoted(device.options[j].display_name) << ", "
@@ -680,14 +704,173 @@ const static struct {
                 [](std::string name, const void *m){ probe_device<const audio_playback_info *>("audio_play", name, m); }},
 };
 
+ADD_TO_PARAM("capabilities-cache", "* capabilities-cache[=<sec>]\n"
+                "  Reuse the device probe results of --capabilities for <sec> seconds (default 600)\n"
+                "  unless UltraGrid, its modules or the connected devices (Linux only) change\n");
+
+#define CAPABILITY_CACHE_HEADER "ultragrid-capabilities 1"
+#define CAPABILITY_CACHE_DEFAULT_TTL 600
+
+namespace {
+/**
+ * On-disk cache of the --capabilities probe output of the modules. Entries
+ * are invalidated when UltraGrid binary or a module library changes or (on
+ * Linux) when a device node or an USB/PCI device appears or disappears.
+ */
+class capability_cache {
+public:
+        capability_cache();
+        ~capability_cache();
+        bool enabled() const { return ttl > 0; }
+        bool find(std::string_view cap_str, const std::string &name, std::string *output) const;
+        void store(std::string_view cap_str, const std::string &name, std::string output);
+
+private:
+        struct entry {
+                long long time;
+                std::string output;
+        };
+        static std::string get_key();
+
+        std::string file;
+        std::string key;
+        long long ttl = 0;
+        std::map<std::string, entry> entries; ///< indexed by "<cap_str> <module>"
+        bool modified = false;
+};
+
+std::string capability_cache::get_key()
+{
+        std::string ret = get_version_details();
+        char exec_path[MAX_PATH_SIZE];
+        struct stat st{};
+        if (get_exec_path(exec_path) && stat(exec_path, &st) == 0) {
+                ret += " " + to_string(st.st_size) + " " + to_string(st.st_mtime);
+        }
+        ret += get_modules_build_id();
+#ifdef __linux__
+        for (const char *dir : { "/dev", "/dev/snd", "/dev/dri", "/sys/bus/usb/devices", "/sys/bus/pci/devices" }) {
+                DIR *d = opendir(dir);
+                if (d == nullptr) {
+                        continue;
+                }
+                std::vector<std::string> names;
+                while (struct dirent *e = readdir(d)) {
+                        names.emplace_back(e->d_name);
+                }
+                closedir(d);
+                sort(names.begin(), names.end());
+                ret += dir;
+                for (const auto &n : names) {
+                        ret += " " + n;
+                }
+        }
+#endif
+        std::ostringstream oss;
+        oss << std::hex << std::hash<std::string>{}(ret);
+        return oss.str();
+}
+
+capability_cache::capability_cache()
+{
+        const char *ttl_str = get_commandline_param("capabilities-cache");
+        const char *cache_dir = get_cache_dir();
+        if (ttl_str == nullptr || cache_dir == nullptr) {
+                return;
+        }
+        ttl = strlen(ttl_str) > 0 ? atoll(ttl_str) : CAPABILITY_CACHE_DEFAULT_TTL;
+        file = std::string(cache_dir) + "capabilities";
+        key = get_key();
+
+        std::ifstream in(file, std::ios::binary);
+        std::string line;
+        if (!getline(in, line) || line != CAPABILITY_CACHE_HEADER " " + key) {
+                return;
+        }
+        const long long now = time(nullptr);
+        while (getline(in, line)) {
+                std::istringstream iss(line);
+                std::string type;
+                entry e{};
+                size_t len = 0;
+                std::string mod_key;
+                if (!(iss >> type >> e.time >> len) || type != "entry" || !getline(iss >> std::ws, mod_key)) {
+                        break;
+                }
+                e.output.resize(len);
+                if (!in.read(&e.output[0], len)) {
+                        break;
+                }
+                if (now - e.time < ttl) {
+                        entries[mod_key] = std::move(e);
+                }
+        }
+}
+
+capability_cache::~capability_cache()
+{
+        if (!modified) {
+                return;
+        }
+        std::string tmp_file = file + "." + to_string(getpid());
+        std::ofstream out(tmp_file, std::ios::binary);
+        out << CAPABILITY_CACHE_HEADER " " << key << "\n";
+        for (const auto &e : entries) {
+                out << "entry " << e.second.time << " " << e.second.output.size() << " " << e.first << "\n" << e.second.output;
+        }
+        out.close();
+        if (!out || rename(tmp_file.c_str(), file.c_str()) != 0) {
+                unlink(tmp_file.c_str());
+                log_msg(LOG_LEVEL_WARNING, "Cannot write capability cache %s\n", file.c_str());
+        }
+}
+
+bool capability_cache::find(std::string_view cap_str, const std::string &name, std::string *output) const
+{
+        auto it = entries.find(std::string(cap_str) + " " + name);
+        if (it == entries.end()) {
+                return false;
+        }
+        *output = it->second.output;
+        return true;
+}
+
+void capability_cache::store(std::string_view cap_str, const std::string &name, std::string output)
+{
+        if (!enabled()) {
+                return;
+        }
+        entries[std::string(cap_str) + " " + name] = { (long long) time(nullptr), std::move(output) };
+        modified = true;
+}
+} // end of anonymous namespace
+
+static void probe_cached(capability_cache &cache, std::string_view cap_str,
+                void (*probe_print)(std::string name, const void *), const std::string &name, const void *mod)
+{
+        if (!cache.enabled()) {
+                probe_print(name, mod);
+                return;
+        }
+        std::string output;
+        if (!cache.find(cap_str, name, &output)) {
+                std::ostringstream oss;
+                auto *orig = std::cout.rdbuf(oss.rdbuf());
+                probe_print(name, mod);
+                std::cout.rdbuf(orig);
+                output = oss.str();
+                cache.store(cap_str, name, output);
+        }
+        std::cout << output;
+}
 
-static void probe_all(std::map<enum library_class, module_info_map>& class_mod_map)
+static void probe_all(std::map<enum library_class, module_info_map>& class_mod_map, capability_cache &cache)
 {
         for(const auto& mod_class : mod_classes){
                 for(const auto& mod : class_mod_map[mod_class.cls]){
                         if(!mod_class.probe_print)
                                 continue;
-                        mod_class.probe_print(mod.first, mod.second);
+                        probe_cached(cache, mod_class.cap_str, mod_class.probe_print, mod.first, mod.second);
                 }
         }
 }
@@ -722,7 +905,8 @@ void print_capabilities(const char *cfg)
                 print_modules(class_mod_map);
         } else if(conf.empty()){
                 print_modules(class_mod_map);
-                probe_all(class_mod_map);
+                capability_cache cache;
+                probe_all(class_mod_map, cache);
         } else {
                 auto class_sv = tokenize(conf, ':');
                 auto mod_sv = tokenize(conf, ':');
@@ -749,8 +933,10 @@ void print_capabilities(const char *cfg)
                         return;
                 }
 
-                if(probe_print)
-                        probe_print(std::string(mod_sv), modinfo->second);
+                if(probe_print) {
+                        capability_cache cache;
+                        probe_cached(cache, class_sv, probe_print, std::string(mod_sv), modinfo->second);
+                }
 
         }
 
@@ -881,6 +1067,7 @@ bool parse_params(const char *optarg, bool preinit)
         if (!preinit && strcmp(optarg, "help") == 0) {
                 puts("Use of params below is experimental and should be used with a caution and a knowledge of consequences and affected functionality!\n");
                 puts("Params can be one or more (separated by comma) of following:");
+                open_all_lazy();
                 print_param_doc();
                 return false;
         }
@@ -899,6 +1086,9 @@ bool parse_params(const char *optarg, bool preinit)
                         if (preinit) {
                                 continue;
                         }
+                        open_all_lazy(); // param may be defined by a not yet opened module
+                }
+                if (!validate_param(key_cstr)) {
                         LOG(LOG_LEVEL_ERROR) << "Unknown parameter: " << key_cstr << "\n";
                         LOG(LOG_LEVEL_INFO) << "Type '" << uv_argv[0] << " --param help' for list.\n";
                         return false;
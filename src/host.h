@@ -133,6 +133,7 @@ void common_cleanup(struct init_data *init_data);
 void init_root_module(struct module *root_mod);
 void register_should_exit_callback(struct module *mod, void (*callback)(void *), void *udata);
 void exit_uv(int status);
+void exit_uv_root(struct module *root_mod, int status);
 int get_exit_status(struct module *root_mod);
 
 void print_capabilities(const char *cfg);
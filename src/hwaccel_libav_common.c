@@ -47,12 +47,15 @@
 #include "config_win32.h"
 #endif
 
+#include "debug.h"
+#include "host.h"
 #include "hwaccel_libav_common.h"
 #include "libavcodec/lavc_common.h"
 
 void hwaccel_state_init(struct hw_accel_state *hwaccel){
         hwaccel->type = HWACCEL_NONE;
         hwaccel->copy = false;
+        hwaccel->map = get_commandline_param("lavd-hw-map") != NULL;
         hwaccel->uninit = NULL;
         hwaccel->tmp_frame = NULL;
         hwaccel->uninit = NULL;
@@ -121,6 +124,22 @@ int create_hw_frame_ctx(AVBufferRef *device_ref,
 }
 
 void transfer_frame(struct hw_accel_state *s, AVFrame *frame){
+        if (s->map) {
+                s->tmp_frame->format = AV_PIX_FMT_NONE; // let the hwcontext pick the sw format
+                int ret = av_hwframe_map(s->tmp_frame, frame, AV_HWFRAME_MAP_READ);
+                if (ret == 0) {
+                        av_frame_copy_props(s->tmp_frame, frame);
+                        // the mapped frame keeps its own reference to the surface
+                        av_frame_unref(frame);
+                        av_frame_move_ref(frame, s->tmp_frame);
+                        return;
+                }
+                log_msg(LOG_LEVEL_WARNING, "[hw accel] Cannot map hw frame: %s, copying it instead.\n",
+                                av_err2str(ret));
+                av_frame_unref(s->tmp_frame);
+                s->map = false;
+        }
+
         av_hwframe_transfer_data(s->tmp_frame, frame, 0);
 
         av_frame_copy_props(s->tmp_frame, frame);
@@ -74,6 +74,7 @@ struct hw_accel_state {
         enum hw_accel_type type;
 
         bool copy; ///< Specifies whether to use the copy mode
+        bool map;  ///< In copy mode, try to map the hw frame instead of transferring it
         AVFrame *tmp_frame; ///< Temporary frame used when copying
 
         void (*uninit)(struct hw_accel_state*); ///< Optional uninit function ptr
@@ -119,6 +120,9 @@ int create_hw_frame_ctx(AVBufferRef *device_ref,
 /**
  * @brief Transfers hw frame from hw memory
  *
+ * If hw_accel_state::map is set, the frame is mapped with av_hwframe_map()
+ * first. Only if the mapping is not supported, the frame is copied.
+ *
  * @param frame Contains hw frame. After calling this function it will contain 
  *              a sw frame
  */
@@ -46,6 +46,7 @@
 
 #include "debug.h"
 #include "hwaccel_videotoolbox.h"
+#include "video_frame.h"
 
 #include <libavutil/pixdesc.h>
 
@@ -83,7 +84,6 @@ int videotoolbox_init(struct AVCodecContext *s,
                 struct hw_accel_state *state,
                 codec_t out_codec)
 {
-        (void) out_codec;
         AVBufferRef *device_ref = NULL;
         int ret = create_hw_device_ctx(AV_HWDEVICE_TYPE_VIDEOTOOLBOX, &device_ref);
         if(ret < 0)
@@ -95,10 +95,17 @@ int videotoolbox_init(struct AVCodecContext *s,
 #endif // P210_PRESENT
                 AV_PIX_FMT_AYUV64,
         };
-        sort_codecs(s->sw_pix_fmt, sizeof probe_formats / sizeof probe_formats[0] - 1, probe_formats + 1);
+        unsigned probe_count = sizeof probe_formats / sizeof probe_formats[0];
+        sort_codecs(s->sw_pix_fmt, probe_count - 1, probe_formats + 1);
+        // frames passed to the display as they are (bound as NV12 IOSurface textures)
+        const bool passthrough = out_codec == HW_VIDEOTOOLBOX;
+        if (passthrough) {
+                probe_formats[0] = AV_PIX_FMT_NV12;
+                probe_count = 1;
+        }
 
         AVBufferRef *hw_frames_ctx = NULL;
-        for (unsigned i = 0; i < sizeof probe_formats / sizeof probe_formats[0]; ++i) {
+        for (unsigned i = 0; i < probe_count; ++i) {
                 log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Trying SW pixel format: %s\n", av_get_pix_fmt_name(probe_formats[i]));
                 ret = create_hw_frame_ctx(device_ref,
                                 s->coded_width,
@@ -124,7 +131,7 @@ int videotoolbox_init(struct AVCodecContext *s,
         }
 
         state->type = HWACCEL_VIDEOTOOLBOX;
-        state->copy = true;
+        state->copy = !passthrough;
         state->tmp_frame = frame;
 
         s->hw_frames_ctx = hw_frames_ctx;
@@ -138,3 +145,21 @@ fail:
         av_buffer_unref(&hw_frames_ctx);
         return ret;
 }
+
+void hw_videotoolbox_recycle_callback(struct video_frame *frame)
+{
+        for (unsigned i = 0; i < frame->tile_count; i++) {
+                hw_videotoolbox_frame *vt_frame = (hw_videotoolbox_frame *)(void *) frame->tiles[i].data;
+                av_frame_free(&vt_frame->av_frame);
+        }
+
+        frame->callbacks.recycle = NULL;
+}
+
+void hw_videotoolbox_copy_callback(struct video_frame *frame)
+{
+        for (unsigned i = 0; i < frame->tile_count; i++) {
+                hw_videotoolbox_frame *vt_frame = (hw_videotoolbox_frame *)(void *) frame->tiles[i].data;
+                vt_frame->av_frame = av_frame_clone(vt_frame->av_frame);
+        }
+}
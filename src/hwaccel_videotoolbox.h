@@ -38,6 +38,8 @@
 #ifndef HWACCEL_VIDEOTOOLBOX_H_FB662D24_EA6D_4723_9F06_F9EABB79D0A6
 #define HWACCEL_VIDEOTOOLBOX_H_FB662D24_EA6D_4723_9F06_F9EABB79D0A6
 
+#ifdef HWACC_VIDEOTOOLBOX
+
 #include "hwaccel_libav_common.h"
 #include "types.h"
 
@@ -45,11 +47,27 @@
 extern "C" {
 #endif
 
+struct video_frame;
+
+/**
+ * Tile data of HW_VIDEOTOOLBOX frames. The AVFrame (AV_PIX_FMT_VIDEOTOOLBOX)
+ * holds a reference to the decoded CVPixelBuffer (data[3]), which is backed
+ * by an IOSurface so that it can be bound as a texture without download.
+ */
+typedef struct hw_videotoolbox_frame {
+        struct AVFrame *av_frame;
+} hw_videotoolbox_frame;
+
 int videotoolbox_init(struct AVCodecContext *s, struct hw_accel_state *state, codec_t out_codec);
 
+void hw_videotoolbox_recycle_callback(struct video_frame *frame);
+void hw_videotoolbox_copy_callback(struct video_frame *frame);
+
 #ifdef __cplusplus
 }
 #endif
 
+#endif // defined HWACC_VIDEOTOOLBOX
+
 #endif // ! defined HWACCEL_VIDEOTOOLBOX_H_FB662D24_EA6D_4723_9F06_F9EABB79D0A6
 
@@ -47,13 +47,20 @@
 #include <libgen.h>
 #endif
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <sstream>
+#include <utility>
+#include <vector>
 
 #include "debug.h"
 #include "host.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
+#include "utils/fs.h"
 
 using namespace std;
 
@@ -78,6 +85,41 @@ const map<enum library_class, library_class_info_t> library_class_info = {
 
 static map<string, string> lib_errors;
 
+struct lib_info {
+        const void *data;
+        int abi_version;
+        bool hidden;
+};
+
+// http://stackoverflow.com/questions/1801892/making-mapfind-operation-case-insensitive
+/************************************************************************/
+/* Comparator for case-insensitive comparison in STL assos. containers  */
+/************************************************************************/
+struct ci_less
+{
+        // case-independent (ci) compare_less binary function
+        struct nocase_compare
+        {
+                bool operator() (const unsigned char& c1, const unsigned char& c2) const {
+                        return tolower (c1) < tolower (c2);
+                }
+        };
+        bool operator() (const std::string & s1, const std::string & s2) const {
+                return std::lexicographical_compare
+                        (s1.begin (), s1.end (),   // source range
+                         s2.begin (), s2.end (),   // dest range
+                         nocase_compare ());  // comparison
+        }
+};
+
+static auto& get_libmap(){
+        /* This is needed because register_library() may be called before global
+         * static members are initialized (it is __attribute__((constructor)))
+         */
+        static map<enum library_class, map<string, lib_info, ci_less>> libraries;
+        return libraries;
+}
+
 #ifdef BUILD_LIBRARIES
 static void push_basename_entry(char ***binarynames, const char *bnc, size_t * templates) {
 	char * alt_v0 = strdup(bnc);
@@ -171,6 +213,205 @@ static int running_from_path(char * uv_argv[]) {
 }
 #endif
 
+#ifdef BUILD_LIBRARIES
+ADD_TO_PARAM("lib-load-all", "* lib-load-all\n"
+                "  Open all module libraries at startup instead of only the used ones (ignores module manifest)\n");
+
+#define MODULE_MANIFEST_HEADER "ultragrid-modules 1"
+
+namespace {
+/**
+ * Libraries opened on demand. The modules registered by each library are
+ * recorded in a manifest in the cache directory when all libraries are
+ * opened, next time only the libraries providing the used modules are opened.
+ */
+struct lazy_libraries {
+        recursive_mutex lock;
+        vector<string> paths; ///< not yet opened libraries, opened ones are emptied
+        map<enum library_class, map<string, size_t, ci_less>> index; ///< module -> index to paths
+        list<void *> handles; ///< lazily opened libraries, closed at process exit
+        vector<pair<enum library_class, string>> *registered = nullptr; ///< modules registered by the library being opened
+        string build_id;
+};
+
+struct manifest_lib {
+        string stat; ///< size and mtime
+        vector<pair<enum library_class, string>> modules;
+        string error;
+};
+
+lazy_libraries &get_lazy_libs() {
+        static lazy_libraries lazy;
+        return lazy;
+}
+
+string get_file_stat(const char *path) {
+        struct stat st{};
+        if (stat(path, &st) != 0) {
+                return {};
+        }
+        return to_string(st.st_size) + " " + to_string(st.st_mtime);
+}
+
+string get_manifest_path(const string &lib_glob) {
+        const char *cache_dir = get_cache_dir();
+        if (cache_dir == nullptr) {
+                return {};
+        }
+        ostringstream oss;
+        oss << cache_dir << "modules-" << hex << hash<string>{}(lib_glob) << ".manifest";
+        return oss.str();
+}
+
+/// @returns name of the library file (for lib_errors)
+string lib_filename(const string &path) {
+        size_t pos = path.rfind('/');
+        return pos == string::npos ? path : path.substr(pos + 1);
+}
+
+/**
+ * Loads the manifest if it is up-to-date with the binary and with the
+ * libraries in paths.
+ */
+bool load_manifest(const string &file, const string &header, const vector<string> &paths, map<string, manifest_lib> &libs) {
+        ifstream in(file);
+        string line;
+        if (!getline(in, line) || line != header) {
+                return false;
+        }
+        manifest_lib *cur = nullptr;
+        while (getline(in, line)) {
+                istringstream iss(line);
+                string type;
+                iss >> type;
+                if (type == "lib") {
+                        string size, mtime, path;
+                        iss >> size >> mtime;
+                        getline(iss >> ws, path);
+                        cur = &libs[path];
+                        cur->stat = size + " " + mtime;
+                } else if (type == "mod" && cur != nullptr) {
+                        int cls = 0;
+                        string name;
+                        iss >> cls >> name;
+                        cur->modules.emplace_back(static_cast<enum library_class>(cls), name);
+                } else if (type == "err" && cur != nullptr) {
+                        getline(iss >> ws, cur->error);
+                } else {
+                        return false;
+                }
+        }
+        if (libs.size() != paths.size()) {
+                return false;
+        }
+        for (const auto &path : paths) {
+                auto it = libs.find(path);
+                if (it == libs.end() || it->second.stat != get_file_stat(path.c_str())) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+void save_manifest(const string &file, const string &header, const map<string, manifest_lib> &libs) {
+        string tmp_file = file + "." + to_string(getpid());
+        ofstream out(tmp_file);
+        out << header << "\n";
+        for (const auto &lib : libs) {
+                out << "lib " << lib.second.stat << " " << lib.first << "\n";
+                for (const auto &mod : lib.second.modules) {
+                        out << "mod " << mod.first << " " << mod.second << "\n";
+                }
+                if (!lib.second.error.empty()) {
+                        string error = lib.second.error;
+                        replace(error.begin(), error.end(), '\n', ' ');
+                        out << "err " << error << "\n";
+                }
+        }
+        out.close();
+        if (!out || rename(tmp_file.c_str(), file.c_str()) != 0) {
+                unlink(tmp_file.c_str());
+                verbose_msg("Cannot write module manifest %s\n", file.c_str());
+        }
+}
+
+void *open_library(const char *path, string *error) {
+        void *handle = dlopen(path, RTLD_NOW|RTLD_GLOBAL);
+        if (!handle) {
+                const char *err = dlerror();
+                verbose_msg("Library %s opening warning: %s \n", path, err);
+                if (err) {
+                        lib_errors.emplace(lib_filename(path), err);
+                        *error = err;
+                }
+        }
+        return handle;
+}
+
+/// opens lazy library with given index to lazy_libraries::paths, must be called with lock held
+void open_lazy_library(size_t idx) {
+        auto &lazy = get_lazy_libs();
+        if (lazy.paths.at(idx).empty()) {
+                return;
+        }
+        string path = std::move(lazy.paths.at(idx));
+        lazy.paths.at(idx).clear();
+        for (auto &cls : lazy.index) {
+                for (auto it = cls.second.begin(); it != cls.second.end(); ) {
+                        it = it->second == idx ? cls.second.erase(it) : next(it);
+                }
+        }
+        string error;
+        if (void *handle = open_library(path.c_str(), &error)) {
+                lazy.handles.push_back(handle);
+        }
+}
+
+/// opens all not yet opened libraries providing modules of given class
+void open_lazy_class(enum library_class cls) {
+        auto &lazy = get_lazy_libs();
+        lock_guard<recursive_mutex> lk(lazy.lock);
+        auto it = lazy.index.find(cls);
+        while (it != lazy.index.end() && !it->second.empty()) {
+                open_lazy_library(it->second.begin()->second);
+        }
+}
+} // end of anonymous namespace
+#endif // defined BUILD_LIBRARIES
+
+/**
+ * Opens libraries that were not opened yet because of lazy loading (see
+ * open_all()), eg. if some module is looked up by other means than by name.
+ */
+void open_all_lazy()
+{
+#ifdef BUILD_LIBRARIES
+        auto &lazy = get_lazy_libs();
+        lock_guard<recursive_mutex> lk(lazy.lock);
+        for (size_t i = 0; i < lazy.paths.size(); ++i) {
+                open_lazy_library(i);
+        }
+#endif
+}
+
+/**
+ * @returns identifier changing with any change of the module libraries
+ * (empty if modules are not built as libraries)
+ */
+string get_modules_build_id()
+{
+#ifdef BUILD_LIBRARIES
+        return get_lazy_libs().build_id;
+#else
+        return {};
+#endif
+}
+
+/**
+ * Opens the module libraries matching pattern. If there is an up-to-date
+ * manifest of the modules provided by the libraries, the libraries are
+ * only indexed and opened lazily when a module is requested.
+ */
 void open_all(const char *pattern, list<void *> &libs) {
 #ifdef BUILD_LIBRARIES
         char path[512];
@@ -187,66 +428,69 @@ void open_all(const char *pattern, list<void *> &libs) {
         }
 
         glob(path, 0, NULL, &glob_buf);
+        vector<string> paths(glob_buf.gl_pathv, glob_buf.gl_pathv + glob_buf.gl_pathc);
+        globfree(&glob_buf);
 
-        for(unsigned int i = 0; i < glob_buf.gl_pathc; ++i) {
-                void *handle = dlopen(glob_buf.gl_pathv[i], RTLD_NOW|RTLD_GLOBAL);
-                if (!handle) {
-                        char *error = dlerror();
-                        verbose_msg("Library %s opening warning: %s \n", glob_buf.gl_pathv[i],
-                                        error);
-                        char *filename = basename(glob_buf.gl_pathv[i]);
-                        if (filename && error) {
-                                lib_errors.emplace(filename, error);
+        char exec_path[MAX_PATH_SIZE];
+        string header = string(MODULE_MANIFEST_HEADER " ") + (get_exec_path(exec_path) ? get_file_stat(exec_path) : "");
+        string manifest_file = get_manifest_path(path);
+        map<string, manifest_lib> manifest;
+        auto &lazy = get_lazy_libs();
+        lock_guard<recursive_mutex> lk(lazy.lock);
+
+        if (!manifest_file.empty() && get_commandline_param("lib-load-all") == nullptr
+                        && load_manifest(manifest_file, header, paths, manifest)) {
+                for (const auto &path : paths) {
+                        const manifest_lib &lib = manifest.at(path);
+                        lazy.build_id += lib.stat + " " + path + "\n";
+                        if (!lib.error.empty()) {
+                                lib_errors.emplace(lib_filename(path), lib.error);
+                                continue;
+                        }
+                        if (lib.modules.empty()) { // may register modules conditionally (REGISTER_MODULE_WITH_FUNC)
+                                string error;
+                                if (void *handle = open_library(path.c_str(), &error)) {
+                                        libs.push_back(handle);
+                                }
+                                continue;
                         }
-                        continue;
+                        for (const auto &mod : lib.modules) {
+                                lazy.index[mod.first][mod.second] = lazy.paths.size();
+                        }
+                        lazy.paths.push_back(path);
                 }
-                libs.push_back(handle);
+                verbose_msg("Using module manifest %s, %zu libraries to be opened on demand\n",
+                                manifest_file.c_str(), lazy.paths.size());
+                return;
         }
 
-        globfree(&glob_buf);
+        for (const auto &path : paths) {
+                manifest_lib &lib = manifest[path];
+                lib.stat = get_file_stat(path.c_str());
+                lazy.build_id += lib.stat + " " + path + "\n";
+                lazy.registered = &lib.modules;
+                void *handle = open_library(path.c_str(), &lib.error);
+                lazy.registered = nullptr;
+                if (handle) {
+                        libs.push_back(handle);
+                }
+        }
+        if (!manifest_file.empty()) {
+                save_manifest(manifest_file, header, manifest);
+        }
 #else
         UNUSED(libs);
         UNUSED(pattern);
 #endif
 }
 
-struct lib_info {
-        const void *data;
-        int abi_version;
-        bool hidden;
-};
-
-// http://stackoverflow.com/questions/1801892/making-mapfind-operation-case-insensitive
-/************************************************************************/
-/* Comparator for case-insensitive comparison in STL assos. containers  */
-/************************************************************************/
-struct ci_less
-{
-        // case-independent (ci) compare_less binary function
-        struct nocase_compare
-        {
-                bool operator() (const unsigned char& c1, const unsigned char& c2) const {
-                        return tolower (c1) < tolower (c2);
-                }
-        };
-        bool operator() (const std::string & s1, const std::string & s2) const {
-                return std::lexicographical_compare
-                        (s1.begin (), s1.end (),   // source range
-                         s2.begin (), s2.end (),   // dest range
-                         nocase_compare ());  // comparison
-        }
-};
-
-static auto& get_libmap(){
-        /* This is needed because register_library() may be called before global
-         * static members are initialized (it is __attribute__((constructor)))
-         */
-        static map<enum library_class, map<string, lib_info, ci_less>> libraries;
-        return libraries;
-}
-
 void register_library(const char *name, const void *data, enum library_class cls, int abi_version, int hidden)
 {
+#ifdef BUILD_LIBRARIES
+        if (get_lazy_libs().registered != nullptr) {
+                get_lazy_libs().registered->emplace_back(cls, name);
+        }
+#endif
         auto& map = get_libmap()[cls];
         if (map.find(name) != map.end()) {
                 LOG(LOG_LEVEL_ERROR) << "Module \"" << name << "\" (class " << cls << ") multiple initialization!\n";
@@ -254,7 +498,7 @@ void register_library(const char *name, const void *data, enum library_class cls
         map[name] = {data, abi_version, static_cast<bool>(hidden)};
 }
 
-const void *load_library(const char *name, enum library_class cls, int abi_version)
+static const void *find_library(const char *name, enum library_class cls, int abi_version)
 {
         auto it_cls = get_libmap().find(cls);
         if (it_cls != get_libmap().end()) {
@@ -269,6 +513,27 @@ const void *load_library(const char *name, enum library_class cls, int abi_versi
                         }
                 }
         }
+        return nullptr;
+}
+
+const void *load_library(const char *name, enum library_class cls, int abi_version)
+{
+#ifdef BUILD_LIBRARIES
+        {
+                auto &lazy = get_lazy_libs();
+                lock_guard<recursive_mutex> lk(lazy.lock);
+                auto it_cls = lazy.index.find(cls);
+                if (it_cls != lazy.index.end()) {
+                        auto it_module = it_cls->second.find(name);
+                        if (it_module != it_cls->second.end()) {
+                                open_lazy_library(it_module->second);
+                        }
+                }
+        }
+#endif
+        if (const void *ret = find_library(name, cls, abi_version)) {
+                return ret;
+        }
 
         // Library was not found or was not loaded due to unsatisfied
         // dependencies. If the latter one, display reason why dlopen() failed.
@@ -305,6 +570,7 @@ void list_modules(enum library_class cls, int abi_version, bool full) {
  */
 bool list_all_modules() {
         bool ret = true;
+        open_all_lazy();
 
         auto& libraries = get_libmap();
         for (auto cls_it = library_class_info.begin(); cls_it != library_class_info.end();
@@ -334,6 +600,9 @@ bool list_all_modules() {
 map<string, const void *> get_libraries_for_class(enum library_class cls, int abi_version, bool include_hidden)
 {
         map<string, const void *> ret;
+#ifdef BUILD_LIBRARIES
+        open_lazy_class(cls);
+#endif
         auto& libraries = get_libmap();
         auto it = libraries.find(cls);
         if (it != libraries.end()) {
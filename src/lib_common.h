@@ -64,7 +64,10 @@
 
 #ifdef __cplusplus
 #include <list>
+#include <string>
 void open_all(const char *pattern, std::list<void *> &libs);
+void open_all_lazy();
+std::string get_modules_build_id();
 #endif
 
 #ifdef __cplusplus
@@ -60,6 +60,7 @@
 #include "host.h"
 #include "hwaccel_vdpau.h"
 #include "hwaccel_rpi4.h"
+#include "hwaccel_videotoolbox.h"
 #include "libavcodec/from_lavc_vid_conv.h"
 #include "libavcodec/lavc_common.h"
 #include "utils/macros.h" // OPTIMIZED_FOR
@@ -68,6 +69,9 @@
 #ifdef __SSE3__
 #include "pmmintrin.h"
 #endif
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
 
 #define MOD_NAME "[from_lavc_vid_conv] "
 
@@ -90,7 +94,19 @@ static void nv12_to_uyvy(char * __restrict dst_buffer, AVFrame * __restrict in_f
                 char *src_cbcr = (char *) in_frame->data[1] + in_frame->linesize[1] * (y / 2);
                 char *dst = dst_buffer + pitch * y;
 
-                OPTIMIZED_FOR (int x = 0; x < width / 2; ++x) {
+                int x = 0;
+#ifdef __ARM_NEON
+                for ( ; x < width / 2 - 7; x += 8) {
+                        uint8x8x2_t luma = vld2_u8((const uint8_t *) src_y);
+                        uint8x8x2_t cbcr = vld2_u8((const uint8_t *) src_cbcr);
+                        uint8x8x4_t out = {{ cbcr.val[0], luma.val[0], cbcr.val[1], luma.val[1] }};
+                        vst4_u8((uint8_t *) dst, out);
+                        src_y += 16;
+                        src_cbcr += 16;
+                        dst += 32;
+                }
+#endif
+                OPTIMIZED_FOR ( ; x < width / 2; ++x) {
                         *dst++ = *src_cbcr++;
                         *dst++ = *src_y++;
                         *dst++ = *src_cbcr++;
@@ -771,6 +787,23 @@ static void yuv420p_to_uyvy(char * __restrict dst_buffer, AVFrame * __restrict i
                         _mm_storeu_si128((__m128i *)(void *) dst2, out2h);
                         dst2 += 16;
                 }
+#elif defined __ARM_NEON
+                for (; x < width - 15; x += 16) {
+                        uint8x8x2_t y1 = vld2_u8((const uint8_t *) src_y1);
+                        uint8x8x2_t y2 = vld2_u8((const uint8_t *) src_y2);
+                        uint8x8_t u = vld1_u8((const uint8_t *) src_cb);
+                        uint8x8_t v = vld1_u8((const uint8_t *) src_cr);
+                        uint8x8x4_t out1 = {{ u, y1.val[0], v, y1.val[1] }};
+                        uint8x8x4_t out2 = {{ u, y2.val[0], v, y2.val[1] }};
+                        vst4_u8((uint8_t *) dst1, out1);
+                        vst4_u8((uint8_t *) dst2, out2);
+                        src_y1 += 16;
+                        src_y2 += 16;
+                        src_cb += 8;
+                        src_cr += 8;
+                        dst1 += 32;
+                        dst2 += 32;
+                }
 #endif
 
 
@@ -1005,6 +1038,66 @@ static void yuv444p_to_v210(char * __restrict dst_buffer, AVFrame * __restrict i
         }
 }
 
+#ifdef __ARM_NEON
+/// computes one 8-bit RGB component of 8 pixels with the same integer arithmetic as the scalar code
+static inline uint8x8_t ycbcr_to_rgb_comp_neon(const int32x4_t y[2], const int32x4_t cb[2], const int32x4_t cr[2],
+                comp_type_t cb_coef, comp_type_t cr_coef)
+{
+        int32x4_t lo = vmlaq_n_s32(vmlaq_n_s32(y[0], cb[0], cb_coef), cr[0], cr_coef);
+        int32x4_t hi = vmlaq_n_s32(vmlaq_n_s32(y[1], cb[1], cb_coef), cr[1], cr_coef);
+        uint8x8_t ret = vqmovun_s16(vcombine_s16(vqmovn_s32(vshrq_n_s32(lo, COMP_BASE)), vqmovn_s32(vshrq_n_s32(hi, COMP_BASE))));
+        return vmax_u8(vmin_u8(ret, vdup_n_u8(FULL_HEAD(8))), vdup_n_u8(FULL_FOOT(8)));
+}
+
+static inline void chroma_to_s32_neon(uint8x8_t c, int32x4_t out[2])
+{
+        int16x8_t c16 = vreinterpretq_s16_u16(vsubl_u8(c, vdup_n_u8(128)));
+        out[0] = vmovl_s16(vget_low_s16(c16));
+        out[1] = vmovl_s16(vget_high_s16(c16));
+}
+
+/**
+ * Converts 16 pixels of 8-bit BT.709 limited range YCbCr (8 chroma samples,
+ * each shared by 2 pixels) to RGB or RGBA (alpha at the highest byte).
+ */
+static inline void yuv8_to_rgb_16px_neon(unsigned char *dst, const unsigned char *src_y, uint8x8_t cb8, uint8x8_t cr8, bool rgba)
+{
+        uint8x8x2_t luma = vld2_u8(src_y);
+        int32x4_t cb[2];
+        int32x4_t cr[2];
+        chroma_to_s32_neon(cb8, cb);
+        chroma_to_s32_neon(cr8, cr);
+        uint8x8_t r[2];
+        uint8x8_t g[2];
+        uint8x8_t b[2];
+        for (int i = 0; i < 2; ++i) { // even and odd pixels
+                int16x8_t y16 = vreinterpretq_s16_u16(vsubl_u8(luma.val[i], vdup_n_u8(16)));
+                int32x4_t y[2] = { vmull_n_s16(vget_low_s16(y16), Y_SCALE), vmull_n_s16(vget_high_s16(y16), Y_SCALE) };
+                r[i] = ycbcr_to_rgb_comp_neon(y, cb, cr, 0, SCALED(R_CR(KR_709, KB_709)));
+                g[i] = ycbcr_to_rgb_comp_neon(y, cb, cr, SCALED(G_CB(KR_709, KB_709)), SCALED(G_CR(KR_709, KB_709)));
+                b[i] = ycbcr_to_rgb_comp_neon(y, cb, cr, SCALED(B_CB(KR_709, KB_709)), 0);
+        }
+        uint8x8x2_t rz = vzip_u8(r[0], r[1]);
+        uint8x8x2_t gz = vzip_u8(g[0], g[1]);
+        uint8x8x2_t bz = vzip_u8(b[0], b[1]);
+        for (int i = 0; i < 2; ++i) {
+                if (rgba) {
+                        uint8x8x4_t out = {{ rz.val[i], gz.val[i], bz.val[i], vdup_n_u8(0xFF) }};
+                        vst4_u8(dst + 32 * i, out);
+                } else {
+                        uint8x8x3_t out = {{ rz.val[i], gz.val[i], bz.val[i] }};
+                        vst3_u8(dst + 24 * i, out);
+                }
+        }
+}
+
+/// NEON code writes RGBA in the default channel order only
+static inline bool rgb_neon_supported(const int *rgb_shift, bool rgba)
+{
+        return !rgba || (rgb_shift[R] == DEFAULT_R_SHIFT && rgb_shift[G] == DEFAULT_G_SHIFT && rgb_shift[B] == DEFAULT_B_SHIFT);
+}
+#endif // defined __ARM_NEON
+
 /**
  * Changes pixel format from planar YUV 422 to packed RGB/A.
  * Color space is assumed ITU-T Rec. 609. YUV is expected to be full scale (aka in JPEG).
@@ -1026,7 +1119,19 @@ static inline void nv12_to_rgb(char * __restrict dst_buffer, AVFrame * __restric
                 unsigned char *src_cbcr = (unsigned char *) in_frame->data[1] + in_frame->linesize[1] * (y / 2);
                 unsigned char *dst = (unsigned char *) dst_buffer + pitch * y;
 
-                OPTIMIZED_FOR (int x = 0; x < width / 2; ++x) {
+                int x = 0;
+#ifdef __ARM_NEON
+                if (rgb_neon_supported(rgb_shift, rgba)) {
+                        for ( ; x < width / 2 - 7; x += 8) {
+                                uint8x8x2_t cbcr = vld2_u8(src_cbcr);
+                                yuv8_to_rgb_16px_neon(dst, src_y, cbcr.val[0], cbcr.val[1], rgba);
+                                src_y += 16;
+                                src_cbcr += 16;
+                                dst += 16 * (rgba ? 4 : 3);
+                        }
+                }
+#endif
+                OPTIMIZED_FOR ( ; x < width / 2; ++x) {
                         comp_type_t cb = *src_cbcr++ - 128;
                         comp_type_t cr = *src_cbcr++ - 128;
                         comp_type_t y = (*src_y++ - 16) * Y_SCALE;
@@ -1043,6 +1148,9 @@ static inline void nv12_to_rgb(char * __restrict dst_buffer, AVFrame * __restric
                         }
 
                         y = (*src_y++ - 16) * Y_SCALE;
+                        r = YCBCR_TO_R_709_SCALED(y, cb, cr) >> COMP_BASE;
+                        g = YCBCR_TO_G_709_SCALED(y, cb, cr) >> COMP_BASE;
+                        b = YCBCR_TO_B_709_SCALED(y, cb, cr) >> COMP_BASE;
                         if (rgba) {
                                 *((uint32_t *)(void *) dst) = FORMAT_RGBA(r, g, b, alpha_mask, 8);
                                 dst += 4;
@@ -1114,7 +1222,30 @@ static inline void yuv8p_to_rgb(int subsampling, char * __restrict dst_buffer, A
                                 }\
                         }\
 
-                OPTIMIZED_FOR (int x = 0; x < width / 2; ++x) {
+                int x = 0;
+#ifdef __ARM_NEON
+                if (rgb_neon_supported(rgb_shift, rgba)) {
+                        for ( ; x < width / 2 - 7; x += 8) {
+                                uint8x8_t cb = vld1_u8(src_cb1);
+                                uint8x8_t cr = vld1_u8(src_cr1);
+                                yuv8_to_rgb_16px_neon(dst1, src_y1, cb, cr, rgba);
+                                if (subsampling == 422) {
+                                        cb = vld1_u8(src_cb2);
+                                        cr = vld1_u8(src_cr2);
+                                        src_cb2 += 8;
+                                        src_cr2 += 8;
+                                }
+                                yuv8_to_rgb_16px_neon(dst2, src_y2, cb, cr, rgba);
+                                src_y1 += 16;
+                                src_y2 += 16;
+                                src_cb1 += 8;
+                                src_cr1 += 8;
+                                dst1 += 16 * (rgba ? 4 : 3);
+                                dst2 += 16 * (rgba ? 4 : 3);
+                        }
+                }
+#endif
+                OPTIMIZED_FOR ( ; x < width / 2; ++x) {
                         comp_type_t cb = *src_cb1++ - 128;
                         comp_type_t cr = *src_cr1++ - 128;
                         comp_type_t y = (*src_y1++ - 16) * Y_SCALE;
@@ -2030,6 +2161,25 @@ static void av_vdpau_to_ug_vdpau(char * __restrict dst_buffer, AVFrame * __restr
 }
 #endif
 
+#ifdef HWACC_VIDEOTOOLBOX
+static void av_videotoolbox_to_ug_vtb(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
+                int width, int height, int pitch, const int * __restrict rgb_shift)
+{
+        UNUSED(width);
+        UNUSED(height);
+        UNUSED(pitch);
+        UNUSED(rgb_shift);
+
+        struct video_frame_callbacks *callbacks = in_frame->opaque;
+
+        hw_videotoolbox_frame *out = (hw_videotoolbox_frame *)(void *) dst_buffer;
+        out->av_frame = av_frame_clone(in_frame);
+
+        callbacks->recycle = hw_videotoolbox_recycle_callback;
+        callbacks->copy = hw_videotoolbox_copy_callback;
+}
+#endif
+
 #ifdef HWACC_RPI4
 static void av_rpi4_8_to_ug(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
                 int width, int height, int pitch, const int * __restrict rgb_shift)
@@ -2323,9 +2473,15 @@ static const struct av_to_uv_conversion av_to_uv_conversions[] = {
         // HW acceleration
         {AV_PIX_FMT_VDPAU, HW_VDPAU, av_vdpau_to_ug_vdpau},
 #endif
-#ifdef HWACC_RPI4
+#ifdef HWACC_VIDEOTOOLBOX
+        {AV_PIX_FMT_VIDEOTOOLBOX, HW_VIDEOTOOLBOX, av_videotoolbox_to_ug_vtb},
+#endif
+#ifdef HWACC_RPI4_MMAL
         {AV_PIX_FMT_RPI4_8, RPI4_8, av_rpi4_8_to_ug},
 #endif
+#ifdef HWACC_RPI4_DRM
+        {AV_PIX_FMT_DRM_PRIME, RPI4_8, av_rpi4_8_to_ug},
+#endif
 };
 #define AV_TO_UV_CONVERSION_COUNT (sizeof av_to_uv_conversions / sizeof av_to_uv_conversions[0])
 static const struct av_to_uv_conversion *av_to_uv_conversions_end = av_to_uv_conversions + AV_TO_UV_CONVERSION_COUNT;
@@ -57,6 +57,7 @@
 #include "compat/qsort_s.h"
 #include "host.h"
 #include "libavcodec/to_lavc_vid_conv.h"
+#include "utils/cpu_features.h"
 #include "utils/macros.h" // OPTIMIZED_FOR
 #include "utils/parallel_conv.h"
 #include "utils/worker.h"
@@ -65,6 +66,14 @@
 #ifdef __SSE3__
 #include "pmmintrin.h"
 #endif
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#define HAVE_TO_LAVC_AVX2 1
+#endif
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#define HAVE_TO_LAVC_NEON 1
+#endif
 
 #define MOD_NAME "[to_lavc_vid_conv] "
 
@@ -78,6 +87,46 @@
 #pragma GCC diagnostic ignored "-Wunknown-pragmas"
 #pragma clang diagnostic warning "-Wpass-failed"
 
+/// converts width pixels of 2 UYVY lines (chroma averaged)
+static inline void uyvy_to_yuv420p_line2(const unsigned char * __restrict src, const unsigned char * __restrict src2,
+                unsigned char * __restrict dst_y, unsigned char * __restrict dst_y2,
+                unsigned char * __restrict dst_cb, unsigned char * __restrict dst_cr, int width)
+{
+        int x;
+        OPTIMIZED_FOR (x = 0; x < width - 1; x += 2) {
+                *dst_cb++ = (*src++ + *src2++) / 2;
+                *dst_y++ = *src++;
+                *dst_y2++ = *src2++;
+                *dst_cr++ = (*src++ + *src2++) / 2;
+                *dst_y++ = *src++;
+                *dst_y2++ = *src2++;
+        }
+        if (x < width) {
+                *dst_cb++ = (*src++ + *src2++) / 2;
+                *dst_y++ = *src++;
+                *dst_y2++ = *src2++;
+                *dst_cr++ = (*src++ + *src2++) / 2;
+        }
+}
+
+/// converts last line of odd-height picture
+static inline void uyvy_to_yuv420p_line(const unsigned char * __restrict src, unsigned char * __restrict dst_y,
+                unsigned char * __restrict dst_cb, unsigned char * __restrict dst_cr, int width)
+{
+        int x;
+        OPTIMIZED_FOR (x = 0; x < width - 1; x += 2) {
+                *dst_cb++ = *src++;
+                *dst_y++ = *src++;
+                *dst_cr++ = *src++;
+                *dst_y++ = *src++;
+        }
+        if (x < width) {
+                *dst_cb++ = *src++;
+                *dst_y++ = *src++;
+                *dst_cr++ = *src++;
+        }
+}
+
 static void uyvy_to_yuv420p(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
 {
         int y;
@@ -90,40 +139,14 @@ static void uyvy_to_yuv420p(AVFrame * __restrict out_frame, const unsigned char
                 unsigned char *dst_y2 = out_frame->data[0] + out_frame->linesize[0] * (y + 1);
                 unsigned char *dst_cb = out_frame->data[1] + out_frame->linesize[1] * (y / 2);
                 unsigned char *dst_cr = out_frame->data[2] + out_frame->linesize[2] * (y / 2);
-
-                int x;
-                OPTIMIZED_FOR (x = 0; x < width - 1; x += 2) {
-                        *dst_cb++ = (*src++ + *src2++) / 2;
-                        *dst_y++ = *src++;
-                        *dst_y2++ = *src2++;
-                        *dst_cr++ = (*src++ + *src2++) / 2;
-                        *dst_y++ = *src++;
-                        *dst_y2++ = *src2++;
-                }
-                if (x < width) {
-                        *dst_cb++ = (*src++ + *src2++) / 2;
-                        *dst_y++ = *src++;
-                        *dst_y2++ = *src2++;
-                        *dst_cr++ = (*src++ + *src2++) / 2;
-                }
+                uyvy_to_yuv420p_line2(src, src2, dst_y, dst_y2, dst_cb, dst_cr, width);
         }
         if (y < height) {
                 const unsigned char *src = in_data + y * (((width + 1) & ~1) * 2);
                 unsigned char *dst_y = out_frame->data[0] + out_frame->linesize[0] * y;
                 unsigned char *dst_cb = out_frame->data[1] + out_frame->linesize[1] * (y / 2);
                 unsigned char *dst_cr = out_frame->data[2] + out_frame->linesize[2] * (y / 2);
-                int x;
-                OPTIMIZED_FOR (x = 0; x < width - 1; x += 2) {
-                        *dst_cb++ = *src++;
-                        *dst_y++ = *src++;
-                        *dst_cr++ = *src++;
-                        *dst_y++ = *src++;
-                }
-                if (x < width) {
-                        *dst_cb++ = *src++;
-                        *dst_y++ = *src++;
-                        *dst_cr++ = *src++;
-                }
+                uyvy_to_yuv420p_line(src, dst_y, dst_cb, dst_cr, width);
         }
 }
 
@@ -182,6 +205,81 @@ static void uyvy_to_yuv444p(AVFrame * __restrict out_frame, const unsigned char
         }
 }
 
+/// converts width pixels of 2 UYVY lines (chroma averaged)
+static inline void uyvy_to_nv12_line2(const unsigned char * __restrict src, const unsigned char * __restrict src2,
+                unsigned char * __restrict dst_y, unsigned char * __restrict dst_y2,
+                unsigned char * __restrict dst_cbcr, int width)
+{
+        int x = 0;
+#ifdef __SSE3__
+        __m128i yuv;
+        __m128i yuv2;
+        __m128i y1;
+        __m128i y2;
+        __m128i y3;
+        __m128i y4;
+        __m128i uv;
+        __m128i uv2;
+        __m128i uv3;
+        __m128i uv4;
+        __m128i ymask = _mm_set1_epi32(0xFF00FF00);
+        __m128i dsty;
+        __m128i dsty2;
+        __m128i dstuv;
+
+        for (; x < (width - 15); x += 16){
+                yuv = _mm_lddqu_si128((__m128i const*)(const void *) src);
+                yuv2 = _mm_lddqu_si128((__m128i const*)(const void *) src2);
+                src += 16;
+                src2 += 16;
+
+                y1 = _mm_and_si128(ymask, yuv);
+                y1 = _mm_bsrli_si128(y1, 1);
+                y2 = _mm_and_si128(ymask, yuv2);
+                y2 = _mm_bsrli_si128(y2, 1);
+
+                uv = _mm_andnot_si128(ymask, yuv);
+                uv2 = _mm_andnot_si128(ymask, yuv2);
+
+                uv = _mm_avg_epu8(uv, uv2);
+
+                yuv = _mm_lddqu_si128((__m128i const*)(const void *) src);
+                yuv2 = _mm_lddqu_si128((__m128i const*)(const void *) src2);
+                src += 16;
+                src2 += 16;
+
+                y3 = _mm_and_si128(ymask, yuv);
+                y3 = _mm_bsrli_si128(y3, 1);
+                y4 = _mm_and_si128(ymask, yuv2);
+                y4 = _mm_bsrli_si128(y4, 1);
+
+                uv3 = _mm_andnot_si128(ymask, yuv);
+                uv4 = _mm_andnot_si128(ymask, yuv2);
+
+                uv3 = _mm_avg_epu8(uv3, uv4);
+
+                dsty = _mm_packus_epi16(y1, y3);
+                dsty2 = _mm_packus_epi16(y2, y4);
+                dstuv = _mm_packus_epi16(uv, uv3);
+                _mm_storeu_si128((__m128i *)(void *) dst_y, dsty);
+                _mm_storeu_si128((__m128i *)(void *) dst_y2, dsty2);
+                _mm_storeu_si128((__m128i *)(void *) dst_cbcr, dstuv);
+                dst_y += 16;
+                dst_y2 += 16;
+                dst_cbcr += 16;
+        }
+#endif
+
+        OPTIMIZED_FOR (; x < width - 1; x += 2) {
+                *dst_cbcr++ = (*src++ + *src2++) / 2;
+                *dst_y++ = *src++;
+                *dst_y2++ = *src2++;
+                *dst_cbcr++ = (*src++ + *src2++) / 2;
+                *dst_y++ = *src++;
+                *dst_y2++ = *src2++;
+        }
+}
+
 static void uyvy_to_nv12(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
 {
         for(int y = 0; y < height; y += 2) {
@@ -192,75 +290,7 @@ static void uyvy_to_nv12(AVFrame * __restrict out_frame, const unsigned char * _
                 unsigned char *dst_y = out_frame->data[0] + out_frame->linesize[0] * y;
                 unsigned char *dst_y2 = out_frame->data[0] + out_frame->linesize[0] * (y + 1);
                 unsigned char *dst_cbcr = out_frame->data[1] + out_frame->linesize[1] * y / 2;
-
-                int x = 0;
-#ifdef __SSE3__
-                __m128i yuv;
-                __m128i yuv2;
-                __m128i y1;
-                __m128i y2;
-                __m128i y3;
-                __m128i y4;
-                __m128i uv;
-                __m128i uv2;
-                __m128i uv3;
-                __m128i uv4;
-                __m128i ymask = _mm_set1_epi32(0xFF00FF00);
-                __m128i dsty;
-                __m128i dsty2;
-                __m128i dstuv;
-
-                for (; x < (width - 15); x += 16){
-                        yuv = _mm_lddqu_si128((__m128i const*)(const void *) src);
-                        yuv2 = _mm_lddqu_si128((__m128i const*)(const void *) src2);
-                        src += 16;
-                        src2 += 16;
-
-                        y1 = _mm_and_si128(ymask, yuv);
-                        y1 = _mm_bsrli_si128(y1, 1);
-                        y2 = _mm_and_si128(ymask, yuv2);
-                        y2 = _mm_bsrli_si128(y2, 1);
-
-                        uv = _mm_andnot_si128(ymask, yuv);
-                        uv2 = _mm_andnot_si128(ymask, yuv2);
-
-                        uv = _mm_avg_epu8(uv, uv2);
-
-                        yuv = _mm_lddqu_si128((__m128i const*)(const void *) src);
-                        yuv2 = _mm_lddqu_si128((__m128i const*)(const void *) src2);
-                        src += 16;
-                        src2 += 16;
-
-                        y3 = _mm_and_si128(ymask, yuv);
-                        y3 = _mm_bsrli_si128(y3, 1);
-                        y4 = _mm_and_si128(ymask, yuv2);
-                        y4 = _mm_bsrli_si128(y4, 1);
-
-                        uv3 = _mm_andnot_si128(ymask, yuv);
-                        uv4 = _mm_andnot_si128(ymask, yuv2);
-
-                        uv3 = _mm_avg_epu8(uv3, uv4);
-
-                        dsty = _mm_packus_epi16(y1, y3);
-                        dsty2 = _mm_packus_epi16(y2, y4);
-                        dstuv = _mm_packus_epi16(uv, uv3);
-                        _mm_storeu_si128((__m128i *)(void *) dst_y, dsty);
-                        _mm_storeu_si128((__m128i *)(void *) dst_y2, dsty2);
-                        _mm_storeu_si128((__m128i *)(void *) dst_cbcr, dstuv);
-                        dst_y += 16;
-                        dst_y2 += 16;
-                        dst_cbcr += 16;
-                }
-#endif
-
-                OPTIMIZED_FOR (; x < width - 1; x += 2) {
-                        *dst_cbcr++ = (*src++ + *src2++) / 2;
-                        *dst_y++ = *src++;
-                        *dst_y2++ = *src2++;
-                        *dst_cbcr++ = (*src++ + *src2++) / 2;
-                        *dst_y++ = *src++;
-                        *dst_y2++ = *src2++;
-                }
+                uyvy_to_nv12_line2(src, src2, dst_y, dst_y2, dst_cbcr, width);
         }
 }
 
@@ -331,6 +361,35 @@ static void v210_to_yuv420p10le(AVFrame * __restrict out_frame, const unsigned c
         }
 }
 
+/// converts given count of 6-pixel v210 blocks of one line
+static inline void v210_to_yuv422p10le_line(const uint32_t * __restrict src, uint16_t * __restrict dst_y,
+                uint16_t * __restrict dst_cb, uint16_t * __restrict dst_cr, int blocks)
+{
+        OPTIMIZED_FOR (int x = 0; x < blocks; ++x) {
+                uint32_t w0_0, w0_1, w0_2, w0_3;
+
+                w0_0 = *src++;
+                w0_1 = *src++;
+                w0_2 = *src++;
+                w0_3 = *src++;
+
+                *dst_y++ = (w0_0 >> 10) & 0x3ff;
+                *dst_y++ = w0_1 & 0x3ff;
+                *dst_y++ = (w0_1 >> 20) & 0x3ff;
+                *dst_y++ = (w0_2 >> 10) & 0x3ff;
+                *dst_y++ = w0_3 & 0x3ff;
+                *dst_y++ = (w0_3 >> 20) & 0x3ff;
+
+                *dst_cb++ = w0_0 & 0x3ff;
+                *dst_cb++ = (w0_1 >> 10) & 0x3ff;
+                *dst_cb++ = (w0_2 >> 20) & 0x3ff;
+
+                *dst_cr++ = (w0_0 >> 20) & 0x3ff;
+                *dst_cr++ = w0_2 & 0x3ff;
+                *dst_cr++ = (w0_3 >> 10) & 0x3ff;
+        }
+}
+
 static void v210_to_yuv422p10le(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
 {
         assert((uintptr_t) in_data % 4 == 0);
@@ -343,30 +402,7 @@ static void v210_to_yuv422p10le(AVFrame * __restrict out_frame, const unsigned c
                 uint16_t *dst_y = (uint16_t *)(void *) (out_frame->data[0] + out_frame->linesize[0] * y);
                 uint16_t *dst_cb = (uint16_t *)(void *) (out_frame->data[1] + out_frame->linesize[1] * y);
                 uint16_t *dst_cr = (uint16_t *)(void *) (out_frame->data[2] + out_frame->linesize[2] * y);
-
-                OPTIMIZED_FOR (int x = 0; x < width / 6; ++x) {
-                        uint32_t w0_0, w0_1, w0_2, w0_3;
-
-                        w0_0 = *src++;
-                        w0_1 = *src++;
-                        w0_2 = *src++;
-                        w0_3 = *src++;
-
-                        *dst_y++ = (w0_0 >> 10) & 0x3ff;
-                        *dst_y++ = w0_1 & 0x3ff;
-                        *dst_y++ = (w0_1 >> 20) & 0x3ff;
-                        *dst_y++ = (w0_2 >> 10) & 0x3ff;
-                        *dst_y++ = w0_3 & 0x3ff;
-                        *dst_y++ = (w0_3 >> 20) & 0x3ff;
-
-                        *dst_cb++ = w0_0 & 0x3ff;
-                        *dst_cb++ = (w0_1 >> 10) & 0x3ff;
-                        *dst_cb++ = (w0_2 >> 20) & 0x3ff;
-
-                        *dst_cr++ = (w0_0 >> 20) & 0x3ff;
-                        *dst_cr++ = w0_2 & 0x3ff;
-                        *dst_cr++ = (w0_3 >> 10) & 0x3ff;
-                }
+                v210_to_yuv422p10le_line(src, dst_y, dst_cb, dst_cr, width / 6);
         }
 }
 
@@ -543,22 +579,11 @@ static void y416_to_xv30(AVFrame * __restrict out_frame, const unsigned char * _
         }
 }
 
-static void v210_to_p010le(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+/// converts given count of 6-pixel v210 blocks of 2 lines (chroma averaged)
+static inline void v210_to_p010le_line2(const uint32_t * __restrict src, const uint32_t * __restrict src2,
+                uint16_t * __restrict dst_y, uint16_t * __restrict dst_y2, uint16_t * __restrict dst_cbcr, int blocks)
 {
-        assert((uintptr_t) in_data % 4 == 0);
-        assert((uintptr_t) out_frame->linesize[0] % 2 == 0);
-        assert((uintptr_t) out_frame->linesize[1] % 2 == 0);
-
-        for(int y = 0; y < height; y += 2) {
-                /*  every even row */
-                const uint32_t *src = (const uint32_t *)(const void *) (in_data + y * vc_get_linesize(width, v210));
-                /*  every odd row */
-                const uint32_t *src2 = (const uint32_t *)(const void *) (in_data + (y + 1) * vc_get_linesize(width, v210));
-                uint16_t *dst_y = (uint16_t *)(void *) (out_frame->data[0] + out_frame->linesize[0] * y);
-                uint16_t *dst_y2 = (uint16_t *)(void *) (out_frame->data[0] + out_frame->linesize[0] * (y + 1));
-                uint16_t *dst_cbcr = (uint16_t *)(void *) (out_frame->data[1] + out_frame->linesize[1] * y / 2);
-
-                OPTIMIZED_FOR (int x = 0; x < width / 6; ++x) {
+        OPTIMIZED_FOR (int x = 0; x < blocks; ++x) {
 			//block 1, bits  0 -  9: U0+0
 			//block 1, bits 10 - 19: Y0
 			//block 1, bits 20 - 29: V0+1
@@ -571,39 +596,56 @@ static void v210_to_p010le(AVFrame * __restrict out_frame, const unsigned char *
 			//block 4, bits  0 -  9: Y4
 			//block 4, bits 10 - 19: V4+5
 			//block 4, bits 20 - 29: Y5
-                        uint32_t w0_0, w0_1, w0_2, w0_3;
-                        uint32_t w1_0, w1_1, w1_2, w1_3;
-
-                        w0_0 = *src++;
-                        w0_1 = *src++;
-                        w0_2 = *src++;
-                        w0_3 = *src++;
-                        w1_0 = *src2++;
-                        w1_1 = *src2++;
-                        w1_2 = *src2++;
-                        w1_3 = *src2++;
+                uint32_t w0_0, w0_1, w0_2, w0_3;
+                uint32_t w1_0, w1_1, w1_2, w1_3;
+
+                w0_0 = *src++;
+                w0_1 = *src++;
+                w0_2 = *src++;
+                w0_3 = *src++;
+                w1_0 = *src2++;
+                w1_1 = *src2++;
+                w1_2 = *src2++;
+                w1_3 = *src2++;
+
+                *dst_y++ = ((w0_0 >> 10) & 0x3ff) << 6;
+                *dst_y++ = (w0_1 & 0x3ff) << 6;
+                *dst_y++ = ((w0_1 >> 20) & 0x3ff) << 6;
+                *dst_y++ = ((w0_2 >> 10) & 0x3ff) << 6;
+                *dst_y++ = (w0_3 & 0x3ff) << 6;
+                *dst_y++ = ((w0_3 >> 20) & 0x3ff) << 6;
+
+                *dst_y2++ = ((w1_0 >> 10) & 0x3ff) << 6;
+                *dst_y2++ = (w1_1 & 0x3ff) << 6;
+                *dst_y2++ = ((w1_1 >> 20) & 0x3ff) << 6;
+                *dst_y2++ = ((w1_2 >> 10) & 0x3ff) << 6;
+                *dst_y2++ = (w1_3 & 0x3ff) << 6;
+                *dst_y2++ = ((w1_3 >> 20) & 0x3ff) << 6;
+
+                *dst_cbcr++ = (((w0_0 & 0x3ff) + (w1_0 & 0x3ff)) / 2) << 6; // Cb
+                *dst_cbcr++ = ((((w0_0 >> 20) & 0x3ff) + ((w1_0 >> 20) & 0x3ff)) / 2) << 6; // Cr
+                *dst_cbcr++ = ((((w0_1 >> 10) & 0x3ff) + ((w1_1 >> 10) & 0x3ff)) / 2) << 6; // Cb
+                *dst_cbcr++ = (((w0_2 & 0x3ff) + (w1_2 & 0x3ff)) / 2) << 6; // Cr
+                *dst_cbcr++ = ((((w0_2 >> 20) & 0x3ff) + ((w1_2 >> 20) & 0x3ff)) / 2) << 6; // Cb
+                *dst_cbcr++ = ((((w0_3 >> 10) & 0x3ff) + ((w1_3 >> 10) & 0x3ff)) / 2) << 6; // Cr
+        }
+}
 
-                        *dst_y++ = ((w0_0 >> 10) & 0x3ff) << 6;
-                        *dst_y++ = (w0_1 & 0x3ff) << 6;
-                        *dst_y++ = ((w0_1 >> 20) & 0x3ff) << 6;
-                        *dst_y++ = ((w0_2 >> 10) & 0x3ff) << 6;
-                        *dst_y++ = (w0_3 & 0x3ff) << 6;
-                        *dst_y++ = ((w0_3 >> 20) & 0x3ff) << 6;
+static void v210_to_p010le(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+{
+        assert((uintptr_t) in_data % 4 == 0);
+        assert((uintptr_t) out_frame->linesize[0] % 2 == 0);
+        assert((uintptr_t) out_frame->linesize[1] % 2 == 0);
 
-                        *dst_y2++ = ((w1_0 >> 10) & 0x3ff) << 6;
-                        *dst_y2++ = (w1_1 & 0x3ff) << 6;
-                        *dst_y2++ = ((w1_1 >> 20) & 0x3ff) << 6;
-                        *dst_y2++ = ((w1_2 >> 10) & 0x3ff) << 6;
-                        *dst_y2++ = (w1_3 & 0x3ff) << 6;
-                        *dst_y2++ = ((w1_3 >> 20) & 0x3ff) << 6;
-
-                        *dst_cbcr++ = (((w0_0 & 0x3ff) + (w1_0 & 0x3ff)) / 2) << 6; // Cb
-                        *dst_cbcr++ = ((((w0_0 >> 20) & 0x3ff) + ((w1_0 >> 20) & 0x3ff)) / 2) << 6; // Cr
-                        *dst_cbcr++ = ((((w0_1 >> 10) & 0x3ff) + ((w1_1 >> 10) & 0x3ff)) / 2) << 6; // Cb
-                        *dst_cbcr++ = (((w0_2 & 0x3ff) + (w1_2 & 0x3ff)) / 2) << 6; // Cr
-                        *dst_cbcr++ = ((((w0_2 >> 20) & 0x3ff) + ((w1_2 >> 20) & 0x3ff)) / 2) << 6; // Cb
-                        *dst_cbcr++ = ((((w0_3 >> 10) & 0x3ff) + ((w1_3 >> 10) & 0x3ff)) / 2) << 6; // Cr
-                }
+        for(int y = 0; y < height; y += 2) {
+                /*  every even row */
+                const uint32_t *src = (const uint32_t *)(const void *) (in_data + y * vc_get_linesize(width, v210));
+                /*  every odd row */
+                const uint32_t *src2 = (const uint32_t *)(const void *) (in_data + (y + 1) * vc_get_linesize(width, v210));
+                uint16_t *dst_y = (uint16_t *)(void *) (out_frame->data[0] + out_frame->linesize[0] * y);
+                uint16_t *dst_y2 = (uint16_t *)(void *) (out_frame->data[0] + out_frame->linesize[0] * (y + 1));
+                uint16_t *dst_cbcr = (uint16_t *)(void *) (out_frame->data[1] + out_frame->linesize[1] * y / 2);
+                v210_to_p010le_line2(src, src2, dst_y, dst_y2, dst_cbcr, width / 6);
         }
 }
 
@@ -719,6 +761,30 @@ static void r10k_to_yuv422p10le(AVFrame * __restrict out_frame, const unsigned c
 /**
  * Converts to yuv444p 10/12/14 le
  */
+#if defined __GNUC__
+static inline void r10k_to_yuv444pXXle_line(int depth, const unsigned char * __restrict src, uint16_t * __restrict dst_y,
+                uint16_t * __restrict dst_cb, uint16_t * __restrict dst_cr, int width)
+        __attribute__((always_inline));
+#endif
+static inline void r10k_to_yuv444pXXle_line(int depth, const unsigned char * __restrict src, uint16_t * __restrict dst_y,
+                uint16_t * __restrict dst_cb, uint16_t * __restrict dst_cr, int width)
+{
+        OPTIMIZED_FOR(int x = 0; x < width; x++){
+                comp_type_t r = src[0] << 2 | src[1] >> 6;
+                comp_type_t g = (src[1] & 0x3F ) << 4 | src[2] >> 4;
+                comp_type_t b = (src[2] & 0x0F) << 6 | src[3] >> 2;
+
+                comp_type_t res_y = (RGB_TO_Y_709_SCALED(r, g, b) >> (COMP_BASE+10-depth)) + (1<<(depth-4));
+                comp_type_t res_cb = (RGB_TO_CB_709_SCALED(r, g, b) >> (COMP_BASE+10-depth)) + (1<<(depth-1));
+                comp_type_t res_cr = (RGB_TO_CR_709_SCALED(r, g, b) >> (COMP_BASE+10-depth)) + (1<<(depth-1));
+
+                *dst_y++ = CLAMP(res_y, 1<<(depth-4), 235 * (1<<(depth-8)));
+                *dst_cb++ = CLAMP(res_cb, 1<<(depth-4), 240 * (1<<(depth-8)));
+                *dst_cr++ = CLAMP(res_cr, 1<<(depth-4), 240 * (1<<(depth-8)));
+                src += 4;
+        }
+}
+
 #if defined __GNUC__
 static inline void r10k_to_yuv444pXXle(int depth, AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
         __attribute__((always_inline));
@@ -735,20 +801,7 @@ static inline void r10k_to_yuv444pXXle(int depth, AVFrame * __restrict out_frame
                 uint16_t *dst_cb = (uint16_t *)(void *) (out_frame->data[1] + out_frame->linesize[1] * y);
                 uint16_t *dst_cr = (uint16_t *)(void *) (out_frame->data[2] + out_frame->linesize[2] * y);
                 const unsigned char *src = in_data + y * src_linesize;
-                OPTIMIZED_FOR(int x = 0; x < width; x++){
-                        comp_type_t r = src[0] << 2 | src[1] >> 6;
-                        comp_type_t g = (src[1] & 0x3F ) << 4 | src[2] >> 4;
-                        comp_type_t b = (src[2] & 0x0F) << 6 | src[3] >> 2;
-
-                        comp_type_t res_y = (RGB_TO_Y_709_SCALED(r, g, b) >> (COMP_BASE+10-depth)) + (1<<(depth-4));
-                        comp_type_t res_cb = (RGB_TO_CB_709_SCALED(r, g, b) >> (COMP_BASE+10-depth)) + (1<<(depth-1));
-                        comp_type_t res_cr = (RGB_TO_CR_709_SCALED(r, g, b) >> (COMP_BASE+10-depth)) + (1<<(depth-1));
-
-                        *dst_y++ = CLAMP(res_y, 1<<(depth-4), 235 * (1<<(depth-8)));
-                        *dst_cb++ = CLAMP(res_cb, 1<<(depth-4), 240 * (1<<(depth-8)));
-                        *dst_cr++ = CLAMP(res_cr, 1<<(depth-4), 240 * (1<<(depth-8)));
-                        src += 4;
-                }
+                r10k_to_yuv444pXXle_line(depth, src, dst_y, dst_cb, dst_cr, width);
         }
 }
 
@@ -1074,6 +1127,25 @@ static void rgba_to_bgra(AVFrame * __restrict out_frame, const unsigned char * _
         }
 }
 
+#if defined __GNUC__
+static inline void r10k_to_gbrpXXle_line(const unsigned char * __restrict src, uint16_t * __restrict dst_g,
+                uint16_t * __restrict dst_b, uint16_t * __restrict dst_r, int width, unsigned int depth)
+        __attribute__((always_inline));
+#endif
+static inline void r10k_to_gbrpXXle_line(const unsigned char * __restrict src, uint16_t * __restrict dst_g,
+                uint16_t * __restrict dst_b, uint16_t * __restrict dst_r, int width, unsigned int depth)
+{
+        OPTIMIZED_FOR (int x = 0; x < width; ++x) {
+                unsigned char w0 = *src++;
+                unsigned char w1 = *src++;
+                unsigned char w2 = *src++;
+                unsigned char w3 = *src++;
+                *dst_r++ = (w0 << 2U | w1 >> 6U) << (depth - 10U);
+                *dst_g++ = ((w1 & 0x3FU) << 4U | w2 >> 4U) << (depth - 10U);
+                *dst_b++ = ((w2 & 0xFU) << 6U | w3 >> 2U) << (depth - 10U);
+        }
+}
+
 #if defined __GNUC__
 static inline void r10k_to_gbrpXXle(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height, unsigned int depth)
         __attribute__((always_inline));
@@ -1090,16 +1162,7 @@ static inline void r10k_to_gbrpXXle(AVFrame * __restrict out_frame, const unsign
                 uint16_t *dst_g = (uint16_t *)(void *) (out_frame->data[0] + out_frame->linesize[0] * y);
                 uint16_t *dst_b = (uint16_t *)(void *) (out_frame->data[1] + out_frame->linesize[1] * y);
                 uint16_t *dst_r = (uint16_t *)(void *) (out_frame->data[2] + out_frame->linesize[2] * y);
-
-                OPTIMIZED_FOR (int x = 0; x < width; ++x) {
-                        unsigned char w0 = *src++;
-                        unsigned char w1 = *src++;
-                        unsigned char w2 = *src++;
-                        unsigned char w3 = *src++;
-                        *dst_r++ = (w0 << 2U | w1 >> 6U) << (depth - 10U);
-                        *dst_g++ = ((w1 & 0x3FU) << 4U | w2 >> 4U) << (depth - 10U);
-                        *dst_b++ = ((w2 & 0xFU) << 6U | w3 >> 2U) << (depth - 10U);
-                }
+                r10k_to_gbrpXXle_line(src, dst_g, dst_b, dst_r, width, depth);
         }
 }
 
@@ -1238,6 +1301,362 @@ static void rg48_to_gbrp12le(AVFrame * __restrict out_frame, const unsigned char
         }
 }
 
+#ifdef HAVE_TO_LAVC_AVX2
+/*
+ * AVX2 versions of the most used conversions. They convert whole vector
+ * blocks of each line and leave the rest of the line to the scalar line
+ * function, so the output is identical to the scalar conversion. Stores don't
+ * exceed the data written by the scalar function so that the parallel
+ * conversion of adjacent frame parts isn't affected. Selected by
+ * select_pixfmt_callback() if the CPU supports AVX2. (UYVY->NV12 is omitted,
+ * its SSE3 path is already memory bound.)
+ */
+#define AVX2_FN __attribute__((target("avx2")))
+#define LANE_MASK(...) _mm256_broadcastsi128_si256(_mm_setr_epi8(__VA_ARGS__))
+#define LOADU256(ptr) _mm256_loadu_si256((const __m256i *)(const void *) (ptr))
+#define STOREU256(ptr, val) _mm256_storeu_si256((__m256i *)(void *) (ptr), val)
+#define PACK_ORDER 0xD8 ///< _mm256_permute4x64_epi64() order restoring sequence after 2 lane-wise packs
+
+/// stores first 12 B of each lane as 24 contiguous B
+static inline AVX2_FN void store_24(void *dst, __m256i v)
+{
+        v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+        _mm_storeu_si128((__m128i *) dst, _mm256_castsi256_si128(v));
+        _mm_storel_epi64((__m128i *)(void *) ((char *) dst + 16), _mm256_extracti128_si256(v, 1));
+}
+
+/// splits 16 UYVY pixels to 16-bit luma and chroma
+static inline AVX2_FN void uyvy_split(const unsigned char *src, __m256i *luma, __m256i *chroma)
+{
+        __m256i w = LOADU256(src);
+        *luma = _mm256_srli_epi16(w, 8);
+        *chroma = _mm256_and_si256(w, _mm256_set1_epi16(0xFF));
+}
+
+static AVX2_FN void uyvy_to_yuv420p_avx2(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+{
+        const __m256i lo16 = _mm256_set1_epi32(0xFFFF);
+        const __m256i chroma_order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        int y;
+        for (y = 0; y < height - 1; y += 2) {
+                const unsigned char *src = in_data + y * (((width + 1) & ~1) * 2);
+                const unsigned char *src2 = in_data + (y + 1) * (((width + 1) & ~1) * 2);
+                unsigned char *dst_y = out_frame->data[0] + out_frame->linesize[0] * y;
+                unsigned char *dst_y2 = out_frame->data[0] + out_frame->linesize[0] * (y + 1);
+                unsigned char *dst_cb = out_frame->data[1] + out_frame->linesize[1] * (y / 2);
+                unsigned char *dst_cr = out_frame->data[2] + out_frame->linesize[2] * (y / 2);
+
+                int x = 0;
+                for ( ; x < width - 31; x += 32) {
+                        __m256i y0, y1, y2, y3, uv0, uv1, uv2, uv3;
+                        uyvy_split(src, &y0, &uv0);
+                        uyvy_split(src + 32, &y1, &uv1);
+                        uyvy_split(src2, &y2, &uv2);
+                        uyvy_split(src2 + 32, &y3, &uv3);
+                        STOREU256(dst_y + x, _mm256_permute4x64_epi64(_mm256_packus_epi16(y0, y1), PACK_ORDER));
+                        STOREU256(dst_y2 + x, _mm256_permute4x64_epi64(_mm256_packus_epi16(y2, y3), PACK_ORDER));
+                        __m256i c0 = _mm256_srli_epi16(_mm256_add_epi16(uv0, uv2), 1);
+                        __m256i c1 = _mm256_srli_epi16(_mm256_add_epi16(uv1, uv3), 1);
+                        __m256i cb = _mm256_packus_epi32(_mm256_and_si256(c0, lo16), _mm256_and_si256(c1, lo16));
+                        __m256i cr = _mm256_packus_epi32(_mm256_srli_epi32(c0, 16), _mm256_srli_epi32(c1, 16));
+                        __m256i cbcr = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(cb, cr), chroma_order);
+                        _mm_storeu_si128((__m128i *)(void *) (dst_cb + x / 2), _mm256_castsi256_si128(cbcr));
+                        _mm_storeu_si128((__m128i *)(void *) (dst_cr + x / 2), _mm256_extracti128_si256(cbcr, 1));
+                        src += 64;
+                        src2 += 64;
+                }
+                uyvy_to_yuv420p_line2(src, src2, dst_y + x, dst_y2 + x, dst_cb + x / 2, dst_cr + x / 2, width - x);
+        }
+        if (y < height) {
+                const unsigned char *src = in_data + y * (((width + 1) & ~1) * 2);
+                unsigned char *dst_y = out_frame->data[0] + out_frame->linesize[0] * y;
+                unsigned char *dst_cb = out_frame->data[1] + out_frame->linesize[1] * (y / 2);
+                unsigned char *dst_cr = out_frame->data[2] + out_frame->linesize[2] * (y / 2);
+                uyvy_to_yuv420p_line(src, dst_y, dst_cb, dst_cr, width);
+        }
+}
+
+/**
+ * unpacks v210 words to 16-bit samples (shifted to MSB) - first and second
+ * component of each word to ab, the third one to the lower half of c
+ */
+static inline AVX2_FN void v210_unpack(__m256i w, __m256i *ab, __m256i *c)
+{
+        const __m256i lo = _mm256_set1_epi32(0xFFC0);
+        *ab = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(w, 6), lo),
+                        _mm256_and_si256(_mm256_slli_epi32(w, 12), _mm256_slli_epi32(lo, 16)));
+        *c = _mm256_and_si256(_mm256_srli_epi32(w, 14), lo);
+}
+
+/// shuffles luma of an unpacked v210 block to first 12 B of each lane
+static inline AVX2_FN __m256i v210_luma(__m256i ab, __m256i c)
+{
+        const __m256i y_ab = LANE_MASK(2, 3, 4, 5, -1, -1, 10, 11, 12, 13, -1, -1, -1, -1, -1, -1);
+        const __m256i y_c = LANE_MASK(-1, -1, -1, -1, 4, 5, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1);
+        return _mm256_or_si256(_mm256_shuffle_epi8(ab, y_ab), _mm256_shuffle_epi8(c, y_c));
+}
+
+static AVX2_FN void v210_to_p010le_avx2(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+{
+        assert((uintptr_t) in_data % 4 == 0);
+        assert((uintptr_t) out_frame->linesize[0] % 2 == 0);
+        assert((uintptr_t) out_frame->linesize[1] % 2 == 0);
+
+        const __m256i cbcr_ab = LANE_MASK(0, 1, -1, -1, 6, 7, 8, 9, -1, -1, 14, 15, -1, -1, -1, -1);
+        const __m256i cbcr_c = LANE_MASK(-1, -1, 0, 1, -1, -1, -1, -1, 8, 9, -1, -1, -1, -1, -1, -1);
+        const __m256i msb10 = _mm256_set1_epi16((short) 0xFFC0);
+        for(int y = 0; y < height; y += 2) {
+                const uint32_t *src = (const uint32_t *)(const void *) (in_data + y * vc_get_linesize(width, v210));
+                const uint32_t *src2 = (const uint32_t *)(const void *) (in_data + (y + 1) * vc_get_linesize(width, v210));
+                uint16_t *dst_y = (uint16_t *)(void *) (out_frame->data[0] + out_frame->linesize[0] * y);
+                uint16_t *dst_y2 = (uint16_t *)(void *) (out_frame->data[0] + out_frame->linesize[0] * (y + 1));
+                uint16_t *dst_cbcr = (uint16_t *)(void *) (out_frame->data[1] + out_frame->linesize[1] * y / 2);
+
+                int blocks = width / 6;
+                for ( ; blocks >= 2; blocks -= 2) {
+                        __m256i ab, c, ab2, c2;
+                        v210_unpack(LOADU256(src), &ab, &c);
+                        v210_unpack(LOADU256(src2), &ab2, &c2);
+                        store_24(dst_y, v210_luma(ab, c));
+                        store_24(dst_y2, v210_luma(ab2, c2));
+                        // vertical average truncated to 10 bits as in the scalar version
+                        ab = _mm256_and_si256(_mm256_avg_epu16(ab, ab2), msb10);
+                        c = _mm256_and_si256(_mm256_avg_epu16(c, c2), msb10);
+                        store_24(dst_cbcr, _mm256_or_si256(_mm256_shuffle_epi8(ab, cbcr_ab), _mm256_shuffle_epi8(c, cbcr_c)));
+                        src += 8;
+                        src2 += 8;
+                        dst_y += 12;
+                        dst_y2 += 12;
+                        dst_cbcr += 12;
+                }
+                v210_to_p010le_line2(src, src2, dst_y, dst_y2, dst_cbcr, blocks);
+        }
+}
+
+static AVX2_FN void v210_to_yuv422p10le_avx2(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+{
+        assert((uintptr_t) in_data % 4 == 0);
+        assert((uintptr_t) out_frame->linesize[0] % 2 == 0);
+        assert((uintptr_t) out_frame->linesize[1] % 2 == 0);
+        assert((uintptr_t) out_frame->linesize[2] % 2 == 0);
+
+        // chroma of blocks 0 and 2 (lo) or 1 and 3 (hi) to the first 12 B of each lane
+        const __m256i cb_ab_lo = LANE_MASK(0, 1, 6, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i cb_c_lo = LANE_MASK(-1, -1, -1, -1, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i cb_ab_hi = LANE_MASK(-1, -1, -1, -1, -1, -1, 0, 1, 6, 7, -1, -1, -1, -1, -1, -1);
+        const __m256i cb_c_hi = LANE_MASK(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 8, 9, -1, -1, -1, -1);
+        const __m256i cr_ab_lo = LANE_MASK(-1, -1, 8, 9, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i cr_c_lo = LANE_MASK(0, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i cr_ab_hi = LANE_MASK(-1, -1, -1, -1, -1, -1, -1, -1, 8, 9, 14, 15, -1, -1, -1, -1);
+        const __m256i cr_c_hi = LANE_MASK(-1, -1, -1, -1, -1, -1, 0, 1, -1, -1, -1, -1, -1, -1, -1, -1);
+        for(int y = 0; y < height; y += 1) {
+                const uint32_t *src = (const uint32_t *)(const void *) (in_data + y * vc_get_linesize(width, v210));
+                uint16_t *dst_y = (uint16_t *)(void *) (out_frame->data[0] + out_frame->linesize[0] * y);
+                uint16_t *dst_cb = (uint16_t *)(void *) (out_frame->data[1] + out_frame->linesize[1] * y);
+                uint16_t *dst_cr = (uint16_t *)(void *) (out_frame->data[2] + out_frame->linesize[2] * y);
+
+                int blocks = width / 6;
+                for ( ; blocks >= 4; blocks -= 4) {
+                        __m256i ab0, c0, ab1, c1;
+                        v210_unpack(LOADU256(src), &ab0, &c0);
+                        v210_unpack(LOADU256(src + 8), &ab1, &c1);
+                        ab0 = _mm256_srli_epi16(ab0, 6);
+                        c0 = _mm256_srli_epi16(c0, 6);
+                        ab1 = _mm256_srli_epi16(ab1, 6);
+                        c1 = _mm256_srli_epi16(c1, 6);
+                        store_24(dst_y, v210_luma(ab0, c0));
+                        store_24(dst_y + 12, v210_luma(ab1, c1));
+                        __m256i ab_02 = _mm256_permute2x128_si256(ab0, ab1, 0x20);
+                        __m256i ab_13 = _mm256_permute2x128_si256(ab0, ab1, 0x31);
+                        __m256i c_02 = _mm256_permute2x128_si256(c0, c1, 0x20);
+                        __m256i c_13 = _mm256_permute2x128_si256(c0, c1, 0x31);
+                        store_24(dst_cb, _mm256_or_si256(
+                                                _mm256_or_si256(_mm256_shuffle_epi8(ab_02, cb_ab_lo), _mm256_shuffle_epi8(c_02, cb_c_lo)),
+                                                _mm256_or_si256(_mm256_shuffle_epi8(ab_13, cb_ab_hi), _mm256_shuffle_epi8(c_13, cb_c_hi))));
+                        store_24(dst_cr, _mm256_or_si256(
+                                                _mm256_or_si256(_mm256_shuffle_epi8(ab_02, cr_ab_lo), _mm256_shuffle_epi8(c_02, cr_c_lo)),
+                                                _mm256_or_si256(_mm256_shuffle_epi8(ab_13, cr_ab_hi), _mm256_shuffle_epi8(c_13, cr_c_hi))));
+                        src += 16;
+                        dst_y += 24;
+                        dst_cb += 12;
+                        dst_cr += 12;
+                }
+                v210_to_yuv422p10le_line(src, dst_y, dst_cb, dst_cr, blocks);
+        }
+}
+
+/// unpacks 8 R10k pixels to 32-bit components
+static inline AVX2_FN void r10k_unpack(const unsigned char *src, __m256i *r, __m256i *g, __m256i *b)
+{
+        const __m256i bswap = LANE_MASK(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        const __m256i mask = _mm256_set1_epi32(0x3FF);
+        __m256i w = _mm256_shuffle_epi8(LOADU256(src), bswap);
+        *r = _mm256_srli_epi32(w, 22);
+        *g = _mm256_and_si256(_mm256_srli_epi32(w, 12), mask);
+        *b = _mm256_and_si256(_mm256_srli_epi32(w, 2), mask);
+}
+
+/// packs 2x8 non-negative 32-bit values to 16 16-bit values (in order)
+static inline AVX2_FN __m256i pack_32_to_16(__m256i a, __m256i b)
+{
+        return _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), PACK_ORDER);
+}
+
+static inline AVX2_FN void r10k_to_gbrpXXle_avx2(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height, unsigned int depth)
+{
+        assert((uintptr_t) out_frame->linesize[0] % 2 == 0);
+        assert((uintptr_t) out_frame->linesize[1] % 2 == 0);
+        assert((uintptr_t) out_frame->linesize[2] % 2 == 0);
+
+        const __m128i shift = _mm_cvtsi32_si128(depth - 10U);
+        int src_linesize = vc_get_linesize(width, R10k);
+        for (int y = 0; y < height; ++y) {
+                const unsigned char *src = in_data + y * src_linesize;
+                uint16_t *dst_g = (uint16_t *)(void *) (out_frame->data[0] + out_frame->linesize[0] * y);
+                uint16_t *dst_b = (uint16_t *)(void *) (out_frame->data[1] + out_frame->linesize[1] * y);
+                uint16_t *dst_r = (uint16_t *)(void *) (out_frame->data[2] + out_frame->linesize[2] * y);
+
+                int x = 0;
+                for ( ; x < width - 15; x += 16) {
+                        __m256i r0, g0, b0, r1, g1, b1;
+                        r10k_unpack(src, &r0, &g0, &b0);
+                        r10k_unpack(src + 32, &r1, &g1, &b1);
+                        STOREU256(dst_r + x, _mm256_sll_epi16(pack_32_to_16(r0, r1), shift));
+                        STOREU256(dst_g + x, _mm256_sll_epi16(pack_32_to_16(g0, g1), shift));
+                        STOREU256(dst_b + x, _mm256_sll_epi16(pack_32_to_16(b0, b1), shift));
+                        src += 64;
+                }
+                r10k_to_gbrpXXle_line(src, dst_g + x, dst_b + x, dst_r + x, width - x, depth);
+        }
+}
+
+static AVX2_FN void r10k_to_gbrp10le_avx2(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+{
+        r10k_to_gbrpXXle_avx2(out_frame, in_data, width, height, 10U);
+}
+
+static AVX2_FN void r10k_to_gbrp16le_avx2(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+{
+        r10k_to_gbrpXXle_avx2(out_frame, in_data, width, height, 16U);
+}
+
+/// computes one Y'CbCr component of 8 pixels exactly as the scalar r10k_to_yuv444pXXle_line()
+static inline AVX2_FN __m256i rgb_to_comp_avx2(__m256i r, __m256i g, __m256i b, comp_type_t coef_r, comp_type_t coef_g,
+                comp_type_t coef_b, __m128i shift, int offset, int lo, int hi)
+{
+        __m256i v = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(r, _mm256_set1_epi32(coef_r)),
+                                _mm256_mullo_epi32(g, _mm256_set1_epi32(coef_g))),
+                        _mm256_mullo_epi32(b, _mm256_set1_epi32(coef_b)));
+        v = _mm256_add_epi32(_mm256_sra_epi32(v, shift), _mm256_set1_epi32(offset));
+        return _mm256_min_epi32(_mm256_max_epi32(v, _mm256_set1_epi32(lo)), _mm256_set1_epi32(hi));
+}
+
+static inline AVX2_FN void r10k_to_yuv444pXXle_avx2(int depth, AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+{
+        assert((uintptr_t) out_frame->linesize[0] % 2 == 0);
+        assert((uintptr_t) out_frame->linesize[1] % 2 == 0);
+        assert((uintptr_t) out_frame->linesize[2] % 2 == 0);
+
+        static_assert(sizeof(comp_type_t) == 4, "AVX2 conversion computes in 32 bits");
+        const __m128i shift = _mm_cvtsi32_si128(COMP_BASE + 10 - depth);
+        const int lo = 1 << (depth - 4);
+        const int y_hi = 235 * (1 << (depth - 8));
+        const int c_hi = 240 * (1 << (depth - 8));
+        const int src_linesize = vc_get_linesize(width, R10k);
+        for(int y = 0; y < height; y++) {
+                uint16_t *dst_y = (uint16_t *)(void *) (out_frame->data[0] + out_frame->linesize[0] * y);
+                uint16_t *dst_cb = (uint16_t *)(void *) (out_frame->data[1] + out_frame->linesize[1] * y);
+                uint16_t *dst_cr = (uint16_t *)(void *) (out_frame->data[2] + out_frame->linesize[2] * y);
+                const unsigned char *src = in_data + y * src_linesize;
+
+                int x = 0;
+                for ( ; x < width - 15; x += 16) {
+                        __m256i r0, g0, b0, r1, g1, b1;
+                        r10k_unpack(src, &r0, &g0, &b0);
+                        r10k_unpack(src + 32, &r1, &g1, &b1);
+                        STOREU256(dst_y + x, pack_32_to_16(
+                                                rgb_to_comp_avx2(r0, g0, b0, Y_R, Y_G, Y_B, shift, lo, lo, y_hi),
+                                                rgb_to_comp_avx2(r1, g1, b1, Y_R, Y_G, Y_B, shift, lo, lo, y_hi)));
+                        STOREU256(dst_cb + x, pack_32_to_16(
+                                                rgb_to_comp_avx2(r0, g0, b0, CB_R, CB_G, CB_B, shift, 1 << (depth - 1), lo, c_hi),
+                                                rgb_to_comp_avx2(r1, g1, b1, CB_R, CB_G, CB_B, shift, 1 << (depth - 1), lo, c_hi)));
+                        STOREU256(dst_cr + x, pack_32_to_16(
+                                                rgb_to_comp_avx2(r0, g0, b0, CR_R, CR_G, CR_B, shift, 1 << (depth - 1), lo, c_hi),
+                                                rgb_to_comp_avx2(r1, g1, b1, CR_R, CR_G, CR_B, shift, 1 << (depth - 1), lo, c_hi)));
+                        src += 64;
+                }
+                r10k_to_yuv444pXXle_line(depth, src, dst_y + x, dst_cb + x, dst_cr + x, width - x);
+        }
+}
+
+static AVX2_FN void r10k_to_yuv444p10le_avx2(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+{
+        r10k_to_yuv444pXXle_avx2(10, out_frame, in_data, width, height);
+}
+#endif // defined HAVE_TO_LAVC_AVX2
+
+#ifdef HAVE_TO_LAVC_NEON
+/*
+ * NEON versions of the UYVY to 4:2:0 conversions, bit-identical to scalar
+ * ones (the chroma average is truncated).
+ */
+static void uyvy_to_yuv420p_neon(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+{
+        int y;
+        for (y = 0; y < height - 1; y += 2) {
+                const unsigned char *src = in_data + y * (((width + 1) & ~1) * 2);
+                const unsigned char *src2 = in_data + (y + 1) * (((width + 1) & ~1) * 2);
+                unsigned char *dst_y = out_frame->data[0] + out_frame->linesize[0] * y;
+                unsigned char *dst_y2 = out_frame->data[0] + out_frame->linesize[0] * (y + 1);
+                unsigned char *dst_cb = out_frame->data[1] + out_frame->linesize[1] * (y / 2);
+                unsigned char *dst_cr = out_frame->data[2] + out_frame->linesize[2] * (y / 2);
+
+                int x = 0;
+                for ( ; x < width - 31; x += 32) {
+                        uint8x16x4_t a = vld4q_u8(src); // U, Y0, V, Y1
+                        uint8x16x4_t b = vld4q_u8(src2);
+                        vst2q_u8(dst_y + x, (uint8x16x2_t) {{ a.val[1], a.val[3] }});
+                        vst2q_u8(dst_y2 + x, (uint8x16x2_t) {{ b.val[1], b.val[3] }});
+                        vst1q_u8(dst_cb + x / 2, vhaddq_u8(a.val[0], b.val[0]));
+                        vst1q_u8(dst_cr + x / 2, vhaddq_u8(a.val[2], b.val[2]));
+                        src += 64;
+                        src2 += 64;
+                }
+                uyvy_to_yuv420p_line2(src, src2, dst_y + x, dst_y2 + x, dst_cb + x / 2, dst_cr + x / 2, width - x);
+        }
+        if (y < height) {
+                const unsigned char *src = in_data + y * (((width + 1) & ~1) * 2);
+                unsigned char *dst_y = out_frame->data[0] + out_frame->linesize[0] * y;
+                unsigned char *dst_cb = out_frame->data[1] + out_frame->linesize[1] * (y / 2);
+                unsigned char *dst_cr = out_frame->data[2] + out_frame->linesize[2] * (y / 2);
+                uyvy_to_yuv420p_line(src, dst_y, dst_cb, dst_cr, width);
+        }
+}
+
+static void uyvy_to_nv12_neon(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+{
+        for(int y = 0; y < height; y += 2) {
+                const unsigned char *src = in_data + y * (width * 2);
+                const unsigned char *src2 = in_data + (y + 1) * (width * 2);
+                unsigned char *dst_y = out_frame->data[0] + out_frame->linesize[0] * y;
+                unsigned char *dst_y2 = out_frame->data[0] + out_frame->linesize[0] * (y + 1);
+                unsigned char *dst_cbcr = out_frame->data[1] + out_frame->linesize[1] * y / 2;
+
+                int x = 0;
+                for ( ; x < width - 31; x += 32) {
+                        uint8x16x4_t a = vld4q_u8(src); // U, Y0, V, Y1
+                        uint8x16x4_t b = vld4q_u8(src2);
+                        vst2q_u8(dst_y + x, (uint8x16x2_t) {{ a.val[1], a.val[3] }});
+                        vst2q_u8(dst_y2 + x, (uint8x16x2_t) {{ b.val[1], b.val[3] }});
+                        vst2q_u8(dst_cbcr + x, (uint8x16x2_t) {{ vhaddq_u8(a.val[0], b.val[0]), vhaddq_u8(a.val[2], b.val[2]) }});
+                        src += 64;
+                        src2 += 64;
+                }
+                uyvy_to_nv12_line2(src, src2, dst_y + x, dst_y2 + x, dst_cbcr + x, width - x);
+        }
+}
+#endif // defined HAVE_TO_LAVC_NEON
+
 static void to_lavc_memcpy_data(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height) __attribute__((unused)); // defined below
 
 //
@@ -1386,6 +1805,38 @@ static decoder_t get_decoder_from_uv_to_uv(codec_t in, enum AVPixelFormat av, co
 
 decoder_t (*testable_get_decoder_from_uv_to_uv)(codec_t in, enum AVPixelFormat av, codec_t *out) = get_decoder_from_uv_to_uv; // external linkage for test
 
+#ifdef HAVE_TO_LAVC_AVX2
+/// subset of uv_to_av_conversions with AVX2 implementation, same termination
+static const struct uv_to_av_conversion uv_to_av_conversions_avx2[] = {
+        { v210, AV_PIX_FMT_YUV422P10LE, v210_to_yuv422p10le_avx2 },
+        { v210, AV_PIX_FMT_P010LE,      v210_to_p010le_avx2 },
+        { UYVY, AV_PIX_FMT_YUV420P,     uyvy_to_yuv420p_avx2 },
+        { UYVY, AV_PIX_FMT_YUVJ420P,    uyvy_to_yuv420p_avx2 },
+        { R10k, AV_PIX_FMT_GBRP10LE,    r10k_to_gbrp10le_avx2 },
+        { R10k, AV_PIX_FMT_GBRP16LE,    r10k_to_gbrp16le_avx2 },
+        { R10k, AV_PIX_FMT_YUV444P10LE, r10k_to_yuv444p10le_avx2 },
+        { VIDEO_CODEC_NONE, AV_PIX_FMT_NONE, 0 }
+};
+#endif
+#ifdef HAVE_TO_LAVC_NEON
+/// subset of uv_to_av_conversions with NEON implementation, same termination
+static const struct uv_to_av_conversion uv_to_av_conversions_neon[] = {
+        { UYVY, AV_PIX_FMT_YUV420P,     uyvy_to_yuv420p_neon },
+        { UYVY, AV_PIX_FMT_YUVJ420P,    uyvy_to_yuv420p_neon },
+        { UYVY, AV_PIX_FMT_NV12,        uyvy_to_nv12_neon },
+        { VIDEO_CODEC_NONE, AV_PIX_FMT_NONE, 0 }
+};
+#endif
+
+static pixfmt_callback_t find_pixfmt_callback(const struct uv_to_av_conversion *conversions, enum AVPixelFormat fmt, codec_t src) {
+        for (const struct uv_to_av_conversion *c = conversions; c->src != VIDEO_CODEC_NONE; c++) {
+                if (c->src == src && c->dst == fmt) {
+                        return c->func;
+                }
+        }
+        return NULL;
+}
+
 static pixfmt_callback_t select_pixfmt_callback(enum AVPixelFormat fmt, codec_t src) {
         // no conversion needed
         if (get_ug_to_av_pixfmt(src) != AV_PIX_FMT_NONE
@@ -1393,10 +1844,21 @@ static pixfmt_callback_t select_pixfmt_callback(enum AVPixelFormat fmt, codec_t
                 return NULL;
         }
 
-        for (const struct uv_to_av_conversion *c = get_uv_to_av_conversions(); c->src != VIDEO_CODEC_NONE; c++) { // FFMPEG conversion needed
-                if (c->src == src && c->dst == fmt) {
-                        return c->func;
-                }
+        pixfmt_callback_t ret = NULL;
+#ifdef HAVE_TO_LAVC_AVX2
+        if (cpu_has(CPU_FEATURE_AVX2)) {
+                ret = find_pixfmt_callback(uv_to_av_conversions_avx2, fmt, src);
+        }
+#elif defined HAVE_TO_LAVC_NEON
+        if (cpu_has(CPU_FEATURE_NEON)) {
+                ret = find_pixfmt_callback(uv_to_av_conversions_neon, fmt, src);
+        }
+#endif
+        if (ret == NULL) { // FFMPEG conversion needed
+                ret = find_pixfmt_callback(get_uv_to_av_conversions(), fmt, src);
+        }
+        if (ret != NULL) {
+                return ret;
         }
 
         log_msg(LOG_LEVEL_FATAL, "[lavc] Cannot find conversion to any of encoder supported pixel format.\n");
@@ -1552,6 +2014,28 @@ static void to_lavc_memcpy_data(AVFrame * __restrict out_frame, const unsigned c
         }
 }
 
+/// sets s->out_frame_parts to slices of frame
+static void set_out_frame_parts(struct to_lavc_vid_conv *s, AVFrame *frame)
+{
+        for (ptrdiff_t i = 0; i < s->thread_count; ++i) {
+                int chunk_size = frame->height / s->thread_count & ~1;
+                s->out_frame_parts[i]->data[0] = frame->data[0] + i * frame->linesize[0] *
+                        chunk_size;
+
+                if (av_pix_fmt_desc_get(frame->format)->log2_chroma_h == 1) { // eg. 4:2:0
+                        chunk_size /= 2;
+                }
+                s->out_frame_parts[i]->data[1] = frame->data[1] + i * frame->linesize[1] *
+                        chunk_size;
+                s->out_frame_parts[i]->data[2] = frame->data[2] + i * frame->linesize[2] *
+                        chunk_size;
+                s->out_frame_parts[i]->linesize[0] = frame->linesize[0];
+                s->out_frame_parts[i]->linesize[1] = frame->linesize[1];
+                s->out_frame_parts[i]->linesize[2] = frame->linesize[2];
+                s->out_frame_parts[i]->opaque = s;
+        }
+}
+
 struct to_lavc_vid_conv *to_lavc_vid_conv_init(codec_t in_pixfmt, int width, int height, enum AVPixelFormat out_pixfmt, int thread_count) {
         int ret = 0;
         struct to_lavc_vid_conv *s = (struct to_lavc_vid_conv *) calloc(1, sizeof *s);
@@ -1583,27 +2067,6 @@ struct to_lavc_vid_conv *to_lavc_vid_conv_init(codec_t in_pixfmt, int width, int
                 return NULL;
         }
 
-        // conversion needed
-        if (get_ug_to_av_pixfmt(in_pixfmt) == AV_PIX_FMT_NONE
-                        || get_ug_to_av_pixfmt(in_pixfmt) != out_pixfmt) {
-                for (ptrdiff_t i = 0; i < thread_count; ++i) {
-                        int chunk_size = height / s->thread_count & ~1;
-                        s->out_frame_parts[i]->data[0] = s->out_frame->data[0] + i * s->out_frame->linesize[0] *
-                                chunk_size;
-
-                        if (av_pix_fmt_desc_get(out_pixfmt)->log2_chroma_h == 1) { // eg. 4:2:0
-                                chunk_size /= 2;
-                        }
-                        s->out_frame_parts[i]->data[1] = s->out_frame->data[1] + i * s->out_frame->linesize[1] *
-                                chunk_size;
-                        s->out_frame_parts[i]->data[2] = s->out_frame->data[2] + i * s->out_frame->linesize[2] *
-                                chunk_size;
-                        s->out_frame_parts[i]->linesize[0] = s->out_frame->linesize[0];
-                        s->out_frame_parts[i]->linesize[1] = s->out_frame->linesize[1];
-                        s->out_frame_parts[i]->linesize[2] = s->out_frame->linesize[2];
-                }
-        }
-
         if (get_ug_to_av_pixfmt(in_pixfmt) != AV_PIX_FMT_NONE
                         && out_pixfmt == get_ug_to_av_pixfmt(in_pixfmt)) {
                 s->decoded_codec = in_pixfmt;
@@ -1662,15 +2125,13 @@ static void *pixfmt_conv_task(void *arg) {
         return NULL;
 }
 
-/// @return AVFrame with converted data (if needed); valid until next to_lavc_vid_conv()
-///         call or to_lavc_vid_conv_destroy()
-struct AVFrame *to_lavc_vid_conv(struct to_lavc_vid_conv *s, char *in_data) {
-        int ret = 0;
+/**
+ * Converts in_data to dst (with the dimensions and format of s->out_frame).
+ *
+ * @returns dst or s->tmp_frame wrapping in_data if no conversion was needed
+ */
+static struct AVFrame *convert_to(struct to_lavc_vid_conv *s, char *in_data, struct AVFrame *dst) {
         unsigned char *decoded = NULL;
-        if ((ret = av_frame_make_writable(s->out_frame)) != 0) {
-                print_libav_error(LOG_LEVEL_ERROR, MOD_NAME "Cannot make frame writable", ret);
-                return NULL;
-        }
 
         time_ns_t t0 = get_time_in_ns();
         if (s->decoder != vc_memcpy) {
@@ -1683,8 +2144,9 @@ struct AVFrame *to_lavc_vid_conv(struct to_lavc_vid_conv *s, char *in_data) {
         }
 
         time_ns_t t1 = get_time_in_ns();
-        AVFrame *frame = s->out_frame;
+        AVFrame *frame = dst;
         if (s->pixfmt_conv_callback != NULL) {
+                set_out_frame_parts(s, dst);
                 struct pixfmt_conv_task_data data[s->thread_count];
                 for(int i = 0; i < s->thread_count; ++i) {
                         data[i].callback = s->pixfmt_conv_callback;
@@ -1703,7 +2165,7 @@ struct AVFrame *to_lavc_vid_conv(struct to_lavc_vid_conv *s, char *in_data) {
                 }
                 task_run_parallel(pixfmt_conv_task, s->thread_count, data, sizeof data[0], NULL);
         } else { // no pixel format conversion needed
-                if (codec_is_planar(s->decoded_codec) && !same_linesizes(s->decoded_codec, s->out_frame)) {
+                if (codec_is_planar(s->decoded_codec) && !same_linesizes(s->decoded_codec, dst)) {
                         assert(get_bits_per_component(s->decoded_codec) == 8);
                         int sub[8];
                         codec_get_planes_subsampling(s->decoded_codec, sub);
@@ -1715,13 +2177,13 @@ struct AVFrame *to_lavc_vid_conv(struct to_lavc_vid_conv *s, char *in_data) {
                                 int linesize = (s->out_frame->width + sub[2 * i] - 1) / sub[2 * i];
                                 int lines = (s->out_frame->height + sub[2 * i + 1] - 1) / sub[2 * i + 1];
                                 for (ptrdiff_t y = 0; y < lines; ++y) {
-                                        memcpy(s->out_frame->data[i] + y * s->out_frame->linesize[i], in, linesize);
+                                        memcpy(dst->data[i] + y * dst->linesize[i], in, linesize);
                                         in += linesize;
                                 }
                         }
                 } else { // just set pointers to input buffer
                         frame = s->tmp_frame;
-                        memcpy(frame->linesize, s->out_frame->linesize, sizeof frame->linesize);
+                        memcpy(frame->linesize, dst->linesize, sizeof frame->linesize);
                         if (codec_is_planar(s->decoded_codec)) {
                                 buf_get_planes(s->out_frame->width, s->out_frame->height, s->decoded_codec, (char *) decoded, (char **) frame->data);
                         } else {
@@ -1733,7 +2195,34 @@ struct AVFrame *to_lavc_vid_conv(struct to_lavc_vid_conv *s, char *in_data) {
         log_msg(LOG_LEVEL_DEBUG2, MOD_NAME "duration uv pixfmt change: %f ms, av foramt change: %f ms\n",
                 (t1 - t0) / MS_IN_SEC_DBL, (t2 - t1) / MS_IN_SEC_DBL);
         return frame;
-};
+}
+
+/// @return AVFrame with converted data (if needed); valid until next to_lavc_vid_conv()
+///         call or to_lavc_vid_conv_destroy()
+struct AVFrame *to_lavc_vid_conv(struct to_lavc_vid_conv *s, char *in_data) {
+        int ret = 0;
+        if ((ret = av_frame_make_writable(s->out_frame)) != 0) {
+                print_libav_error(LOG_LEVEL_ERROR, MOD_NAME "Cannot make frame writable", ret);
+                return NULL;
+        }
+        return convert_to(s, in_data, s->out_frame);
+}
+
+bool to_lavc_vid_conv_to_frame(struct to_lavc_vid_conv *s, char *in_data, struct AVFrame *out_frame) {
+        if (out_frame->format != s->out_frame->format
+                        || out_frame->width != s->out_frame->width
+                        || out_frame->height != s->out_frame->height) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Output frame properties mismatch!\n");
+                return false;
+        }
+        struct AVFrame *frame = convert_to(s, in_data, out_frame);
+        if (frame != out_frame) { // input passed through - copy it
+                av_image_copy(out_frame->data, out_frame->linesize,
+                                (const uint8_t **) frame->data, frame->linesize,
+                                out_frame->format, out_frame->width, out_frame->height);
+        }
+        return true;
+}
 
 void to_lavc_vid_conv_destroy(struct to_lavc_vid_conv **s_p) {
         struct to_lavc_vid_conv *s = *s_p;
@@ -48,6 +48,11 @@ extern "C" {
 struct to_lavc_vid_conv;
 struct to_lavc_vid_conv *to_lavc_vid_conv_init(codec_t in_pixfmt, int width, int height, enum AVPixelFormat out_pixfmt, int thread_count);
 struct AVFrame *to_lavc_vid_conv(struct to_lavc_vid_conv *state, char *in_data);
+/**
+ * Converts directly to caller-provided out_frame (eg. a mapped HW surface)
+ * that must match format and dimensions of the converter output.
+ */
+bool to_lavc_vid_conv_to_frame(struct to_lavc_vid_conv *state, char *in_data, struct AVFrame *out_frame);
 void to_lavc_vid_conv_destroy(struct to_lavc_vid_conv **state);
 
 struct to_lavc_req_prop {
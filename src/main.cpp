@@ -64,6 +64,7 @@
 
 #include <array>
 #include <chrono>
+#include <condition_variable>
 #include <cstdlib>
 #ifndef _WIN32
 #include <execinfo.h>
@@ -94,11 +95,16 @@
 #include "rtsp/rtsp_utils.h"
 #include "tv.h"
 #include "ug_runtime_error.hpp"
+#include "utils/benchmark.hpp"
 #include "utils/color_out.h"
+#include "utils/cpu_features.h"
+#include "utils/init_graph.hpp"
+#include "utils/metrics.h"
 #include "utils/misc.h"
 #include "utils/nat.h"
 #include "utils/net.h"
 #include "utils/sdp.h"
+#include "utils/session_manager.hpp"
 #include "utils/string.h"
 #include "utils/string_view_utils.hpp"
 #include "utils/thread.h"
@@ -131,9 +137,11 @@ static constexpr const char *DEFAULT_AUDIO_CODEC = "PCM";
 #define OPT_AUDIO_PROTOCOL (('A' << 8) | 'P')
 #define OPT_AUDIO_SCALE (('a' << 8) | 's')
 #define OPT_AUDIO_FILTER (('a' << 8) | 'f')
+#define OPT_BENCHMARK (('B' << 8) | 'M')
 #define OPT_CAPABILITIES (('C' << 8) | 'C')
 #define OPT_CONTROL_PORT (('C' << 8) | 'P')
 #define OPT_CUDA_DEVICE (('C' << 8) | 'D')
+#define OPT_DAEMON (('D' << 8) | 'M')
 #define OPT_ECHO_CANCELLATION (('E' << 8) | 'C')
 #define OPT_ENCRYPTION (('E' << 8) | 'N')
 #define OPT_FULLHELP (('F' << 8u) | 'H')
@@ -284,6 +292,10 @@ static void usage(const char *exec_path, bool full = false)
                 print_help_item("-F|--capture-filter <filter> | help",
                                 {"capture filter(s), must be given before capture device"});
                 print_help_item("--param <params> | help", {"additional advanced parameters, use help for list"});
+                print_help_item("--benchmark <format>[:<compression>] | help", {"run the video pipeline locally and",
+                                "report frame rate, latency and CPU time"});
+                print_help_item("--daemon", {"host sessions created with the control socket",
+                                "command \"session create <name> <args>\""});
                 print_help_item("--pix-fmts", {"list of pixel formats"});
                 print_help_item("--conv-policy [cds]{3} | help", {"pixel format conversion policy"});
                 print_help_item("--video-codecs", {"list of video codecs"});
@@ -595,6 +607,11 @@ struct ug_options {
         char *nat_traverse_config = nullptr;
 
         unsigned int video_rxtx_mode = 0;
+
+        bool benchmark = false;
+        struct benchmark_options benchmark_opts;
+
+        bool daemon = false;
 };
 
 static bool parse_port(char *optarg, struct ug_options *opt) {
@@ -689,6 +706,8 @@ static int parse_options(int argc, char *argv[], struct ug_options *opt) {
                 {"audio-delay", required_argument, 0, OPT_AUDIO_DELAY},
                 {"list-modules", no_argument, 0, OPT_LIST_MODULES},
                 {"start-paused", no_argument, 0, OPT_START_PAUSED},
+                {"benchmark", required_argument, 0, OPT_BENCHMARK},
+                {"daemon", no_argument, 0, OPT_DAEMON},
                 {"audio-protocol", required_argument, 0, OPT_AUDIO_PROTOCOL},
                 {"video-protocol", required_argument, 0, OPT_VIDEO_PROTOCOL},
                 {"protocol", required_argument, 0, OPT_PROTOCOL},
@@ -947,6 +966,15 @@ static int parse_options(int argc, char *argv[], struct ug_options *opt) {
                 case OPT_START_PAUSED:
                         opt->start_paused = true;
                         break;
+                case OPT_BENCHMARK:
+                        if (int ret = benchmark_parse(optarg, &opt->benchmark_opts)) {
+                                return ret < 0 ? -EXIT_FAIL_USAGE : 1;
+                        }
+                        opt->benchmark = true;
+                        break;
+                case OPT_DAEMON:
+                        opt->daemon = true;
+                        break;
                 case OPT_PARAM:
                         if (!parse_params(optarg, false)) {
                                 return 1;
@@ -982,6 +1010,12 @@ static int parse_options(int argc, char *argv[], struct ug_options *opt) {
                 }
         }
 
+        if (const char *cpu_cfg = get_commandline_param("cpu-features")) {
+                if (int ret = cpu_features_configure(cpu_cfg)) {
+                        return ret < 0 ? -EXIT_FAIL_USAGE : 1;
+                }
+        }
+
         argc -= optind;
         argv += optind;
 
@@ -1000,6 +1034,21 @@ static int parse_options(int argc, char *argv[], struct ug_options *opt) {
 
 static int adjust_params(struct ug_options *opt) {
         unsigned int audio_rxtx_mode = 0;
+        if (opt->benchmark) {
+                if (strcmp("none", vidcap_params_get_driver(opt->vidcap_params_head)) == 0) {
+                        vidcap_params_set_device(opt->vidcap_params_tail, opt->benchmark_opts.capture.c_str());
+                }
+                if (strcmp(opt->requested_display, "none") == 0) {
+                        opt->requested_display = "dummy";
+                }
+                if (!opt->benchmark_opts.compression.empty()) {
+                        opt->requested_compression = opt->benchmark_opts.compression.c_str();
+                }
+                if (opt->benchmark_opts.loopback) {
+                        opt->video_protocol = "loopback";
+                }
+                commandline_params["frame-trace"] = string();
+        }
         if (opt->is_server) {
                 commandline_params["udp-disable-multi-socket"] = string();
                 if (opt->requested_receiver != nullptr) {
@@ -1226,88 +1275,65 @@ static bool help_in_argv(char **argv) {
 
 #define EXIT(expr) { int rc = expr; common_cleanup(init); return rc; }
 
-int main(int argc, char *argv[])
+ADD_TO_PARAM("init-serial", "* init-serial\n"
+                "  Initialize the audio, capture, display and compression one after another instead of concurrently\n");
+/**
+ * Runs the pipeline configured by opt until exit.
+ *
+ * Sessions of the daemon mode (session != nullptr) don't use the process-wide
+ * facilities (control socket, metrics server, signal handlers) and run the
+ * display in a new thread.
+ *
+ * @param kc  keyboard control to be started, may be nullptr
+ * @returns   exit status
+ */
+static int run_pipeline(struct state_uv *uv_ptr, struct ug_options *opt_ptr, int argc, char *argv[],
+                struct session *session, keyboard_control *kc)
 {
-
-        struct init_data *init = nullptr;
+        struct state_uv &uv = *uv_ptr;
+        struct ug_options &opt = *opt_ptr;
 #if defined HAVE_SCHED_SETSCHEDULER && defined USE_RT
         struct sched_param sp;
 #endif
-        ug_options opt{};
-
         pthread_t receiver_thread_id,
                   capture_thread_id;
         bool receiver_thread_started = false,
              capture_thread_started = false;
+        bool display_started = false;
         unsigned display_flags = 0;
         struct control_state *control = NULL;
         struct exporter *exporter = NULL;
+        struct benchmark *benchmark = nullptr;
         int ret;
 
         time_ns_t start_time = get_time_in_ns();
 
         struct ug_nat_traverse *nat_traverse = nullptr;
-
-#ifndef WIN32
-        signal(SIGQUIT, crash_signal_handler);
-#endif
-        signal(SIGABRT, crash_signal_handler);
-        signal(SIGFPE, crash_signal_handler);
-        signal(SIGILL, crash_signal_handler);
-        signal(SIGSEGV, crash_signal_handler);
-
-        if ((init = common_preinit(argc, argv)) == nullptr) {
-                log_msg(LOG_LEVEL_FATAL, "common_preinit() failed!\n");
-                EXIT(EXIT_FAILURE);
-        }
-
-        struct state_uv uv{};
-        keyboard_control kc{&uv.root_module};
-        bool show_help = help_in_argv(uv_argv);
-
-        print_version();
-        printf("\n");
-
-        try {
-                if (int ret = parse_options(argc, argv, &opt)) {
-                        EXIT(ret < 0 ? -ret : EXIT_SUCCESS);
-                }
-        } catch (invalid_argument &e) {
-                if (strcmp(e.what(), "stoi") == 0) {
-                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Non-numeric value passed to option expecting a number!\n";
-                } else {
-                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Invalid argument: " << e.what() << "!\n";
-                }
-                return -1;
-        }
-
-        if (int ret = adjust_params(&opt)) {
-                EXIT(ret);
-        }
-
-        if (!show_help) {
-                col() << TBOLD("Display device   : ") << opt.requested_display << "\n";
-                col() << TBOLD("Capture device   : ") << vidcap_params_get_driver(opt.vidcap_params_head) << "\n";
-                col() << TBOLD("Audio capture    : ") << opt.audio.send_cfg << "\n";
-                col() << TBOLD("Audio playback   : ") << opt.audio.recv_cfg << "\n";
-                col() << TBOLD("MTU              : ") << opt.requested_mtu << " B\n";
-                col() << TBOLD("Video compression: ") << opt.requested_compression << "\n";
-                col() << TBOLD("Audio codec      : ") << get_name_to_audio_codec(get_audio_codec(opt.audio.codec_cfg)) << "\n";
-                col() << TBOLD("Network protocol : ") << video_rxtx::get_long_name(opt.video_protocol) << "\n";
-                col() << TBOLD("Audio FEC        : ") << opt.audio.fec_cfg << "\n";
-                col() << TBOLD("Video FEC        : ") << opt.requested_video_fec << "\n";
-                col() << "\n";
-        }
+        init_graph startup(get_commandline_param("init-serial") == nullptr);
+        init_graph::step_t audio_step = 0;
+        init_graph::step_t capture_step = 0;
+        init_graph::step_t display_step = 0;
 
         exporter = export_init(&uv.root_module, opt.export_opts, opt.should_export);
         if (!exporter) {
                 log_msg(LOG_LEVEL_ERROR, "Export initialization failed.\n");
-                EXIT(EXIT_FAILURE);
+                return EXIT_FAILURE;
         }
 
-        if (control_init(opt.control_port, opt.connection_type, &control, &uv.root_module, opt.force_ip_version) != 0) {
-                LOG(LOG_LEVEL_FATAL) << "Error: Unable to initialize remote control!\n";
-                EXIT(EXIT_FAIL_CONTROL_SOCK);
+        if (session == nullptr) {
+                if (control_init(opt.control_port, opt.connection_type, &control, &uv.root_module, opt.force_ip_version) != 0) {
+                        LOG(LOG_LEVEL_FATAL) << "Error: Unable to initialize remote control!\n";
+                        export_destroy(exporter);
+                        return EXIT_FAIL_CONTROL_SOCK;
+                }
+
+                if (const char *port = get_commandline_param("metrics-port")) {
+                        if (!metrics_server_start(atoi(port))) {
+                                control_done(control);
+                                export_destroy(exporter);
+                                return EXIT_FAILURE;
+                        }
+                }
         }
 
         if(!opt.nat_traverse_config
@@ -1319,33 +1345,6 @@ int main(int argc, char *argv[])
                 }
         }
 
-        ret = audio_init (&uv.audio, &uv.root_module, &opt.audio,
-                        opt.requested_encryption,
-                        opt.force_ip_version, opt.requested_mcast_if,
-                        opt.bitrate, &audio_offset, start_time,
-                        opt.requested_mtu, opt.requested_ttl, exporter);
-        if (ret != 0) {
-                exit_uv(ret < 0 ? EXIT_FAIL_AUDIO : 0);
-                goto cleanup;
-        }
-
-        display_flags |= audio_get_display_flags(uv.audio);
-
-        // Display initialization should be prior to modules that may use graphic card (eg. GLSL) in order
-        // to initalize shared resource (X display) first
-        ret =
-             initialize_video_display(&uv.root_module, opt.requested_display, opt.display_cfg, display_flags, opt.postprocess, &uv.display_device);
-        if (ret < 0) {
-                printf("Unable to open display device: %s\n",
-                       opt.requested_display);
-                exit_uv(EXIT_FAIL_DISPLAY);
-                goto cleanup;
-        } else if(ret > 0) {
-                exit_uv(EXIT_SUCCESS);
-                goto cleanup;
-        }
-        log_msg(LOG_LEVEL_DEBUG, "Display initialized-%s\n", opt.requested_display);
-
         /* Pass embedded/analog/AESEBU flags to selected vidcap
          * device. */
         if (audio_capture_get_vidcap_flags(opt.audio.send_cfg)) {
@@ -1367,23 +1366,51 @@ int main(int argc, char *argv[])
                 }
         }
 
-        ret = initialize_video_capture(&uv.root_module, opt.vidcap_params_head, &uv.capture_device);
+        // the devices are initialized concurrently, the capture is checked after the compression
+        audio_step = startup.add("audio", [&] {
+                return audio_init(&uv.audio, &uv.root_module, &opt.audio,
+                                opt.requested_encryption,
+                                opt.force_ip_version, opt.requested_mcast_if,
+                                opt.bitrate, &audio_offset, start_time,
+                                opt.requested_mtu, opt.requested_ttl, exporter);
+        });
+        capture_step = startup.add("capture", [&] {
+                return initialize_video_capture(&uv.root_module, opt.vidcap_params_head, &uv.capture_device);
+        });
+        // Display initialization should be prior to modules that may use graphic card (eg. GLSL) in order
+        // to initalize shared resource (X display) first. Some displays also need to be initialized in
+        // the main thread.
+        display_step = startup.run("display", [&] {
+                display_flags |= audio_get_display_flags(uv.audio);
+                return initialize_video_display(&uv.root_module, opt.requested_display, opt.display_cfg,
+                                display_flags, opt.postprocess, &uv.display_device);
+        }, { audio_step });
+
+        ret = startup.wait(audio_step);
+        if (ret != 0) {
+                exit_uv(ret < 0 ? EXIT_FAIL_AUDIO : 0);
+                goto cleanup;
+        }
+
+        ret = startup.wait(display_step);
         if (ret < 0) {
-                printf("Unable to open capture device: %s\n",
-                                vidcap_params_get_driver(opt.vidcap_params_head));
-                exit_uv(EXIT_FAIL_CAPTURE);
+                printf("Unable to open display device: %s\n",
+                       opt.requested_display);
+                exit_uv(EXIT_FAIL_DISPLAY);
                 goto cleanup;
         } else if(ret > 0) {
                 exit_uv(EXIT_SUCCESS);
                 goto cleanup;
         }
-        log_msg(LOG_LEVEL_DEBUG, "Video capture initialized-%s\n", vidcap_params_get_driver(opt.vidcap_params_head));
+        log_msg(LOG_LEVEL_DEBUG, "Display initialized-%s\n", opt.requested_display);
 
-        signal(SIGINT, signal_handler);
-        signal(SIGTERM, signal_handler);
+        if (session == nullptr) {
+                signal(SIGINT, signal_handler);
+                signal(SIGTERM, signal_handler);
 #ifndef WIN32
-        signal(SIGHUP, signal_handler);
+                signal(SIGHUP, signal_handler);
 #endif
+        }
 
 #ifdef USE_RT
 #ifdef HAVE_SCHED_SETSCHEDULER
@@ -1407,6 +1434,9 @@ int main(int argc, char *argv[])
                 params["paused"].b = opt.start_paused;
 
                 // iHDTV
+                if (strcmp(opt.video_protocol, "ihdtv") == 0) {
+                        startup.wait(capture_step); // the result is checked below
+                }
                 params["argc"].i = argc;
                 params["argv"].ptr = argv;
                 params["capture_device"].ptr = (opt.video_rxtx_mode & MODE_SENDER) != 0U ? uv.capture_device : nullptr;
@@ -1466,6 +1496,18 @@ int main(int argc, char *argv[])
                         }
                 }
 
+                ret = startup.wait(capture_step);
+                if (ret < 0) {
+                        printf("Unable to open capture device: %s\n",
+                                        vidcap_params_get_driver(opt.vidcap_params_head));
+                        exit_uv(EXIT_FAIL_CAPTURE);
+                        goto cleanup;
+                } else if(ret > 0) {
+                        exit_uv(EXIT_SUCCESS);
+                        goto cleanup;
+                }
+                log_msg(LOG_LEVEL_DEBUG, "Video capture initialized-%s\n", vidcap_params_get_driver(opt.vidcap_params_head));
+
                 if ((opt.video_rxtx_mode & MODE_RECEIVER) != 0U) {
                         if (!uv.state_video_rxtx->supports_receiving()) {
                                 fprintf(stderr, "Selected RX/TX mode doesn't support receiving.\n");
@@ -1513,9 +1555,20 @@ int main(int argc, char *argv[])
                 audio_start(uv.audio);
 
                 control_start(control);
-                kc.start();
+                if (kc != nullptr) {
+                        kc->start();
+                }
+
+                if (opt.benchmark) {
+                        benchmark = benchmark_start(&uv.root_module, opt.benchmark_opts);
+                }
 
-                display_run_mainloop(uv.display_device);
+                if (session == nullptr) {
+                        display_run_mainloop(uv.display_device);
+                } else {
+                        display_run_new_thread(uv.display_device);
+                        display_started = true;
+                }
 
         } catch (ug_no_error const &e) {
                 exit_uv(0);
@@ -1536,6 +1589,7 @@ int main(int argc, char *argv[])
         }
 
 cleanup:
+        startup.wait_all();
         if (strcmp("none", opt.requested_display) != 0 &&
                         receiver_thread_started)
                 pthread_join(receiver_thread_id, NULL);
@@ -1549,16 +1603,19 @@ cleanup:
         audio_join(uv.audio);
         if (uv.state_video_rxtx)
                 uv.state_video_rxtx->join();
+        benchmark_done(benchmark); // after the pipeline exited, the benchmark triggers the exit
 
         export_destroy(exporter);
 
-        signal(SIGINT, SIG_DFL);
-        signal(SIGTERM, SIG_DFL);
+        if (session == nullptr) {
+                signal(SIGINT, SIG_DFL);
+                signal(SIGTERM, SIG_DFL);
 #ifndef WIN32
-        signal(SIGHUP, SIG_DFL);
-        signal(SIGALRM, hang_signal_handler);
+                signal(SIGHUP, SIG_DFL);
+                signal(SIGALRM, hang_signal_handler);
 #endif
-        alarm(5); // prevent exit hangs
+                alarm(5); // prevent exit hangs
+        }
 
         if(uv.audio)
                 audio_done(uv.audio);
@@ -1566,19 +1623,182 @@ cleanup:
 
         if (uv.capture_device)
                 vidcap_done(uv.capture_device);
+        if (display_started)
+                display_join(uv.display_device);
         if (uv.display_device)
                 display_done(uv.display_device);
 
         stop_nat_traverse(nat_traverse);
 
-        kc.stop();
+        if (kc != nullptr) {
+                kc->stop();
+        }
+        if (session == nullptr) {
+                metrics_server_stop();
+        }
         control_done(control);
 
+        return get_exit_status(&uv.root_module);
+}
+
+
+/**
+ * Runs a session of the daemon mode (session_run_t)
+ */
+static int run_session(int argc, char *argv[], struct session *s)
+{
+        ug_options opt{};
+        struct state_uv uv{};
+        {
+                static mutex getopt_lock; // getopt_long() keeps a global state
+                lock_guard<mutex> lk(getopt_lock);
+#ifdef __GLIBC__
+                optind = 0; // full reinitialization
+#else
+                optind = 1;
+#endif
+                try {
+                        if (int ret = parse_options(argc, argv, &opt)) {
+                                return ret < 0 ? -ret : EXIT_SUCCESS;
+                        }
+                } catch (exception const &e) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Invalid argument: " << e.what() << "!\n";
+                        return EXIT_FAIL_USAGE;
+                }
+                if (opt.daemon) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Session cannot be a daemon!\n";
+                        return EXIT_FAIL_USAGE;
+                }
+                if (int ret = adjust_params(&opt)) {
+                        return ret;
+                }
+        }
+        session_started(s, &uv.root_module);
+        int ret = run_pipeline(&uv, &opt, argc, argv, s, nullptr);
+        session_stopped(s);
+        return ret;
+}
+
+struct daemon_exit_wait {
+        mutex lock;
+        condition_variable cv;
+        bool should_exit = false;
+        static void should_exit_callback(void *udata) {
+                auto *w = (daemon_exit_wait *) udata;
+                lock_guard<mutex> lk(w->lock);
+                w->should_exit = true;
+                w->cv.notify_one();
+        }
+};
+
+/**
+ * Hosts the sessions created with the control socket ("session create") until
+ * exit (signal or the control command "exit").
+ */
+static int run_daemon(struct state_uv *uv, struct ug_options *opt)
+{
+        struct control_state *control = nullptr;
+        if (control_init(opt->control_port, opt->connection_type, &control, &uv->root_module, opt->force_ip_version) != 0) {
+                LOG(LOG_LEVEL_FATAL) << "Error: Unable to initialize remote control!\n";
+                return EXIT_FAIL_CONTROL_SOCK;
+        }
+        if (const char *port = get_commandline_param("metrics-port")) {
+                if (!metrics_server_start(atoi(port))) {
+                        control_done(control);
+                        return EXIT_FAILURE;
+                }
+        }
+        struct session_manager *sm = session_manager_init(&uv->root_module, run_session);
+
+        daemon_exit_wait wait;
+        register_should_exit_callback(&uv->root_module, daemon_exit_wait::should_exit_callback, &wait);
+        signal(SIGINT, signal_handler);
+        signal(SIGTERM, signal_handler);
+#ifndef WIN32
+        signal(SIGHUP, signal_handler);
+#endif
+        control_start(control);
+        LOG(LOG_LEVEL_NOTICE) << MOD_NAME << "Running as a daemon, use the control socket command \"session create <name> <args>\" to start a session.\n";
+
+        unique_lock<mutex> lk(wait.lock);
+        wait.cv.wait(lk, [&wait] { return wait.should_exit; });
+        lk.unlock();
+
+        session_manager_done(sm);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+#ifndef WIN32
+        signal(SIGHUP, SIG_DFL);
+#endif
+        metrics_server_stop();
+        control_done(control);
+        return get_exit_status(&uv->root_module);
+}
+
+int main(int argc, char *argv[])
+{
+
+        struct init_data *init = nullptr;
+        ug_options opt{};
+
+#ifndef WIN32
+        signal(SIGQUIT, crash_signal_handler);
+#endif
+        signal(SIGABRT, crash_signal_handler);
+        signal(SIGFPE, crash_signal_handler);
+        signal(SIGILL, crash_signal_handler);
+        signal(SIGSEGV, crash_signal_handler);
+
+        if ((init = common_preinit(argc, argv)) == nullptr) {
+                log_msg(LOG_LEVEL_FATAL, "common_preinit() failed!\n");
+                EXIT(EXIT_FAILURE);
+        }
+
+        struct state_uv uv{};
+        keyboard_control kc{&uv.root_module};
+        bool show_help = help_in_argv(uv_argv);
+
+        print_version();
+        printf("\n");
+
+        try {
+                if (int ret = parse_options(argc, argv, &opt)) {
+                        EXIT(ret < 0 ? -ret : EXIT_SUCCESS);
+                }
+        } catch (invalid_argument &e) {
+                if (strcmp(e.what(), "stoi") == 0) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Non-numeric value passed to option expecting a number!\n";
+                } else {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Invalid argument: " << e.what() << "!\n";
+                }
+                return -1;
+        }
+
+        if (int ret = adjust_params(&opt)) {
+                EXIT(ret);
+        }
+
+        if (!show_help && !opt.daemon) {
+                col() << TBOLD("Display device   : ") << opt.requested_display << "\n";
+                col() << TBOLD("Capture device   : ") << vidcap_params_get_driver(opt.vidcap_params_head) << "\n";
+                col() << TBOLD("Audio capture    : ") << opt.audio.send_cfg << "\n";
+                col() << TBOLD("Audio playback   : ") << opt.audio.recv_cfg << "\n";
+                col() << TBOLD("MTU              : ") << opt.requested_mtu << " B\n";
+                col() << TBOLD("Video compression: ") << opt.requested_compression << "\n";
+                col() << TBOLD("Audio codec      : ") << get_name_to_audio_codec(get_audio_codec(opt.audio.codec_cfg)) << "\n";
+                col() << TBOLD("Network protocol : ") << video_rxtx::get_long_name(opt.video_protocol) << "\n";
+                col() << TBOLD("Audio FEC        : ") << opt.audio.fec_cfg << "\n";
+                col() << TBOLD("Video FEC        : ") << opt.requested_video_fec << "\n";
+                col() << "\n";
+        }
+
+        int ret = opt.daemon ? run_daemon(&uv, &opt) : run_pipeline(&uv, &opt, argc, argv, nullptr, &kc);
+
         common_cleanup(init);
 
         printf("Exit\n");
 
-        return get_exit_status(&uv.root_module);
+        return ret;
 }
 
 /* vim: set expandtab sw=8: */
@@ -96,6 +96,19 @@ struct pair_msg_path {
 };
 }
 
+/**
+ * Pushes the message to the receiver inbox. Lock-free, may be called by
+ * multiple senders concurrently.
+ */
+static void inbox_push(struct module *receiver, struct message *msg)
+{
+        msg->next = __atomic_load_n(&receiver->msg_inbox, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&receiver->msg_inbox, &msg->next, msg, true,
+                                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+        __atomic_fetch_add(&receiver->msg_count, 1, __ATOMIC_RELEASE);
+}
+
 void free_message_for_child(void *m, struct response *r) {
         struct pair_msg_path *mp = (struct pair_msg_path *) m;
         free_message(mp->msg, r);
@@ -202,17 +215,12 @@ static struct response *send_message_common(struct module *root, const char *con
 
         //pthread_mutex_guard guard(receiver->lock, lock_guard_retain_ownership_t());
 
-        pthread_mutex_lock(&receiver->msg_queue_lock);
-        int size = simple_linked_list_size(receiver->msg_queue);
-        pthread_mutex_unlock(&receiver->msg_queue_lock);
-        if (size >= MAX_MESSAGES) {
-                struct message *m = (struct message *) simple_linked_list_pop(receiver->msg_queue);
+        if (__atomic_load_n(&receiver->msg_count, __ATOMIC_RELAXED) >= MAX_MESSAGES) {
+                struct message *m = check_message(receiver);
                 free_message(m, new_response(RESPONSE_INT_SERV_ERR, "Too many unprocessed messages"));
                 printf("Dropping some messages for %s - queue full.\n", const_path);
         }
-        pthread_mutex_lock(&receiver->msg_queue_lock);
-        simple_linked_list_append(receiver->msg_queue, msg);
-        pthread_mutex_unlock(&receiver->msg_queue_lock);
+        inbox_push(receiver, msg);
 
         if (receiver->new_message) {
                 receiver->new_message(receiver);
@@ -282,15 +290,12 @@ void module_check_undelivered_messages(struct module *node)
 
 void module_store_message(struct module *node, struct message *m)
 {
-        pthread_mutex_guard guard(node->msg_queue_lock);
-        simple_linked_list_append(node->msg_queue, m);
+        inbox_push(node, m);
 }
 
 struct response *send_message_to_receiver(struct module *receiver, struct message *msg)
 {
-        pthread_mutex_lock(&receiver->msg_queue_lock);
-        simple_linked_list_append(receiver->msg_queue, msg);
-        pthread_mutex_unlock(&receiver->msg_queue_lock);
+        inbox_push(receiver, msg);
 
         pthread_mutex_guard guard(receiver->lock);
         if (receiver->new_message) {
@@ -391,14 +396,48 @@ const char *response_status_to_text(int status)
         return NULL;
 }
 
-struct message *check_message(struct module *mod)
+/**
+ * Sends the message to the receiver with cached address - unlike
+ * send_message(), the path is not resolved by walking the module tree on
+ * every call. Suitable for messages sent repeatedly to the same receiver.
+ */
+struct response *send_message_to_addr(struct module *root, struct module_addr *addr, struct message *msg)
 {
-        pthread_mutex_guard guard(mod->msg_queue_lock);
+        struct module *receiver = module_addr_lock(root, addr);
+        if (receiver == NULL) {
+                return send_message(root, addr->path, msg);
+        }
+        struct response *resp = send_message_to_receiver(receiver, msg);
+        module_addr_unlock();
+        return resp;
+}
 
-        if(simple_linked_list_size(mod->msg_queue) > 0) {
-                return (struct message *) simple_linked_list_pop(mod->msg_queue);
-        } else {
+/**
+ * Returns the oldest message for the module. If there is none, it costs just
+ * one atomic load so that it can be polled in the hot loops.
+ */
+struct message *check_message(struct module *mod)
+{
+        if (!module_has_messages(mod)) {
                 return NULL;
         }
+
+        pthread_mutex_guard guard(mod->msg_queue_lock);
+        if (mod->msg_ready == NULL) { // move the inbox to msg_ready, reversing its order
+                struct message *m = __atomic_exchange_n(&mod->msg_inbox, nullptr, __ATOMIC_ACQUIRE);
+                while (m != NULL) {
+                        struct message *next = m->next;
+                        m->next = mod->msg_ready;
+                        mod->msg_ready = m;
+                        m = next;
+                }
+        }
+        struct message *ret = mod->msg_ready;
+        if (ret != NULL) {
+                mod->msg_ready = ret->next;
+                ret->next = NULL;
+                __atomic_fetch_sub(&mod->msg_count, 1, __ATOMIC_RELAXED);
+        }
+        return ret;
 }
 
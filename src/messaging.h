@@ -78,6 +78,7 @@ struct message {
         // except from messaging.cpp
         void (*send_response)(void *priv_data, struct response *);
         void *priv_data;
+        struct message *next; ///< link in the receiver inbox
 };
 
 enum msg_root_type {
@@ -105,6 +106,8 @@ enum msg_sender_type {
         SENDER_MSG_CHANGE_FEC,
         SENDER_MSG_QUERY_VIDEO_MODE,
         SENDER_MSG_RESET_SSRC,
+        SENDER_MSG_ADD_CLIENT,    ///< additional unicast destination (RTSP session), uses client
+        SENDER_MSG_REMOVE_CLIENT, ///< uses client.id only
 };
 
 struct msg_sender {
@@ -117,6 +120,11 @@ struct msg_sender {
                 };
                 char receiver[128];
                 char fec_cfg[1024];
+                struct {
+                        unsigned id;
+                        int port;
+                        char addr[128];
+                } client;
         };
 };
 
@@ -189,6 +197,18 @@ struct message *new_message(size_t length) __attribute__ ((warn_unused_result));
 void free_message(struct message *m, struct response *r);
 const char *response_status_to_text(int status);
 
+/**
+ * Cached address of a message receiver, see send_message_to_addr(). Must not
+ * be shared between threads.
+ */
+struct module_addr {
+        const char *path;
+        struct module *mod;  ///< resolved receiver, valid while generation matches
+        unsigned generation;
+};
+#define MODULE_ADDR_INIT(path) { (path), NULL, 0 }
+struct response *send_message_to_addr(struct module *root, struct module_addr *addr, struct message *msg) __attribute__ ((warn_unused_result));
+
 struct message *check_message(struct module *);
 
 void free_message_for_child(void *m, struct response *r);
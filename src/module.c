@@ -43,9 +43,23 @@
 
 #include "debug.h"
 
+#include <stdatomic.h>
+
 #include "module.h"
 #include "utils/list.h"
 
+struct module_mem {
+        atomic_llong current;
+        atomic_llong peak;
+        atomic_int refcount; ///< module and each accounted allocation
+};
+
+static _Thread_local struct module_mem *thread_mem_owner; ///< holds a reference
+
+/// taken for writing when a module is being removed, for reading while a cached address is in use
+static pthread_rwlock_t module_tree_lock = PTHREAD_RWLOCK_INITIALIZER;
+static unsigned module_tree_generation = 1; ///< incremented when a module is removed, protected by module_tree_lock
+
 void module_init_default(struct module *module_data)
 {
         int ret = 0;
@@ -60,7 +74,6 @@ void module_init_default(struct module *module_data)
         assert(ret == 0 && "Unable to create mutex or set attributes");
 
         module_data->childs = simple_linked_list_init();
-        module_data->msg_queue = simple_linked_list_init();
         module_data->msg_queue_childs = simple_linked_list_init();
 
         module_data->magic = MODULE_MAGIC;
@@ -88,6 +101,8 @@ void module_done(struct module *module_data)
         assert(module_data->magic == MODULE_MAGIC);
 
         if(module_data->parent) {
+                pthread_rwlock_wrlock(&module_tree_lock);
+                module_tree_generation += 1;
                 pthread_mutex_lock(&module_data->parent->lock);
                 int found;
 
@@ -95,6 +110,7 @@ void module_done(struct module *module_data)
 
                 assert(found == TRUE);
                 pthread_mutex_unlock(&module_data->parent->lock);
+                pthread_rwlock_unlock(&module_tree_lock);
         }
 
         // we assume that deleter may dealloc space where are structure stored
@@ -122,14 +138,13 @@ void module_done(struct module *module_data)
         }
         simple_linked_list_destroy(tmp.childs);
 
-        if(simple_linked_list_size(tmp.msg_queue) > 0) {
+        if (module_has_messages(&tmp)) {
                 fprintf(stderr, "Warning: Message queue not empty!\n");
                 struct message *m;
                 while ((m = check_message(&tmp))) {
                         free_message(m, NULL);
                 }
         }
-        simple_linked_list_destroy(tmp.msg_queue);
 
         while (simple_linked_list_size(tmp.msg_queue_childs) > 0) {
                 struct message *m = simple_linked_list_pop(tmp.msg_queue_childs);
@@ -138,7 +153,9 @@ void module_done(struct module *module_data)
         simple_linked_list_destroy(tmp.msg_queue_childs);
 
         pthread_mutex_destroy(&tmp.lock);
+        pthread_mutex_destroy(&tmp.msg_queue_lock);
 
+        module_mem_release(tmp.mem);
         free(tmp.name);
 }
 
@@ -158,6 +175,7 @@ static const char *module_class_name_pairs[] = {
         [MODULE_CLASS_DECODER] = "decoder",
         [MODULE_CLASS_EXPORTER] = "exporter",
         [MODULE_CLASS_KEYCONTROL] = "keycontrol",
+        [MODULE_CLASS_SESSION] = "session",
 };
 
 const char *module_class_name(enum module_class cls)
@@ -281,6 +299,24 @@ struct module *get_module(struct module *root, const char *const_path)
         return receiver;
 }
 
+struct module *module_addr_lock(struct module *root, struct module_addr *addr)
+{
+        pthread_rwlock_rdlock(&module_tree_lock);
+        if (addr->mod == NULL || addr->generation != module_tree_generation) {
+                addr->mod = get_module(root, addr->path);
+                addr->generation = module_tree_generation;
+        }
+        if (addr->mod == NULL) {
+                pthread_rwlock_unlock(&module_tree_lock);
+        }
+        return addr->mod;
+}
+
+void module_addr_unlock(void)
+{
+        pthread_rwlock_unlock(&module_tree_lock);
+}
+
 struct module *get_matching_child(struct module *node, const char *const_path)
 {
         struct module *receiver = node;
@@ -320,6 +356,85 @@ void dump_tree(struct module *node, int indent) {
         }
 }
 
+/**
+ * Calls cb for root and all its descendants (parents before children). The
+ * module lock is held while its children are visited, so cb must not remove
+ * modules.
+ */
+void module_foreach(struct module *root, void (*cb)(struct module *mod, void *udata), void *udata)
+{
+        pthread_mutex_lock(&root->lock);
+        cb(root, udata);
+        for(void *it = simple_linked_list_it_init(root->childs); it != NULL; ) {
+                struct module *child = simple_linked_list_it_next(&it);
+                module_foreach(child, cb, udata);
+        }
+        pthread_mutex_unlock(&root->lock);
+}
+
+static struct module_mem *module_mem_ref(struct module_mem *mem)
+{
+        if (mem != NULL) {
+                atomic_fetch_add_explicit(&mem->refcount, 1, memory_order_relaxed);
+        }
+        return mem;
+}
+
+void module_mem_release(struct module_mem *mem)
+{
+        if (mem != NULL && atomic_fetch_sub_explicit(&mem->refcount, 1, memory_order_acq_rel) == 1) {
+                free(mem);
+        }
+}
+
+void module_set_mem_owner(struct module *mod)
+{
+        struct module_mem *mem = NULL;
+        if (mod != NULL) {
+                pthread_mutex_lock(&mod->lock);
+                if (mod->mem == NULL) {
+                        mod->mem = calloc(1, sizeof *mod->mem);
+                        atomic_init(&mod->mem->refcount, 1);
+                }
+                mem = mod->mem;
+                pthread_mutex_unlock(&mod->lock);
+        }
+        if (mem == thread_mem_owner) {
+                return;
+        }
+        module_mem_release(thread_mem_owner);
+        thread_mem_owner = module_mem_ref(mem);
+}
+
+struct module_mem *module_mem_acquire_owner(void)
+{
+        return module_mem_ref(thread_mem_owner);
+}
+
+void module_mem_add(struct module_mem *mem, long long bytes)
+{
+        if (mem == NULL) {
+                return;
+        }
+        long long current = atomic_fetch_add_explicit(&mem->current, bytes, memory_order_relaxed) + bytes;
+        long long peak = atomic_load_explicit(&mem->peak, memory_order_relaxed);
+        while (current > peak && !atomic_compare_exchange_weak_explicit(&mem->peak, &peak, current,
+                                memory_order_relaxed, memory_order_relaxed)) {
+        }
+}
+
+bool module_get_mem_usage(struct module *mod, long long *current, long long *peak)
+{
+        pthread_mutex_lock(&mod->lock);
+        struct module_mem *mem = mod->mem;
+        if (mem != NULL) {
+                *current = atomic_load_explicit(&mem->current, memory_order_relaxed);
+                *peak = atomic_load_explicit(&mem->peak, memory_order_relaxed);
+        }
+        pthread_mutex_unlock(&mod->lock);
+        return mem != NULL;
+}
+
 /**
  * Gets textual representation of path from root to module.
  *
@@ -75,6 +75,7 @@
 
 #ifndef __cplusplus
 #include <stdalign.h>
+#include <stdbool.h>
 #endif
 
 #ifdef __cplusplus
@@ -100,9 +101,11 @@ enum module_class {
         MODULE_CLASS_DECODER,
         MODULE_CLASS_EXPORTER,
         MODULE_CLASS_KEYCONTROL,
+        MODULE_CLASS_SESSION,
 };
 
 struct module;
+struct module_mem;
 struct simple_linked_list;
 
 typedef void (*module_deleter_t)(struct module *);
@@ -110,8 +113,8 @@ typedef void (*notify_t)(struct module *);
 
 /**
  * @struct module
- * Only members cls, deleter, priv_data and msg_queue may be directly touched
- * by user. The others should be considered private.
+ * Only members cls, deleter and priv_data may be directly touched by user.
+ * The others should be considered private.
  */
 struct module {
         alignas(8) uint32_t magic;
@@ -123,8 +126,11 @@ struct module {
         module_deleter_t deleter;
         notify_t new_message; ///< if set, notifies module that new message is in queue, receiver lock is hold during the call
 
-        pthread_mutex_t msg_queue_lock; // protects msg_queue
-        struct simple_linked_list *msg_queue;
+        /// lock-free LIFO of incoming messages (pushed by senders), accessed atomically only
+        struct message *msg_inbox;
+        pthread_mutex_t msg_queue_lock; ///< serializes the readers of msg_ready
+        struct message *msg_ready; ///< messages taken from msg_inbox in the FIFO order
+        int msg_count; ///< messages in msg_inbox and msg_ready, accessed atomically only
 
         struct simple_linked_list *msg_queue_childs; ///< messages for childern that were not delivered
 
@@ -134,6 +140,8 @@ struct module {
         char *name; ///< optional name of the module. May be used for indexing. Will be freed by
                     ///< module_done(). Must not start with a digit.
 
+        struct module_mem *mem; ///< memory accounting, created by the first module_set_mem_owner(), protected by lock
+
 #ifdef __cplusplus
         module() = default;
         // don't be tempted to copy/move module because parent holds pointer to struct module
@@ -178,6 +186,21 @@ private:
  */
 struct module *get_module(struct module *root, const char *path);
 
+/**
+ * Resolves the cached address, the path is looked up again only after some
+ * module has been removed since the last call.
+ *
+ * @retval NULL if not found
+ * @retval non-NULL the module, which cannot be removed until module_addr_unlock()
+ */
+struct module *module_addr_lock(struct module *root, struct module_addr *addr);
+void module_addr_unlock(void);
+
+/// @returns whether there are some messages for the module, costs just one atomic load
+static inline bool module_has_messages(struct module *mod) {
+        return __atomic_load_n(&mod->msg_count, __ATOMIC_ACQUIRE) > 0;
+}
+
 /**
  * IMPORTANT: module given as parameter should be locked within the calling thread.
  *
@@ -196,6 +219,26 @@ struct module *get_root_module(struct module *node);
 struct module *get_parent_module(struct module *node);
 
 void dump_tree(struct module *root, int indent);
+void module_foreach(struct module *root, void (*cb)(struct module *mod, void *udata), void *udata);
+
+/**
+ * @name Memory accounting
+ * Memory allocated by the frame helpers (vf_alloc_desc_data(), video_frame_pool,
+ * audio_frame2, pbuf) is accounted to the memory owner of the allocating
+ * thread. The charge is kept by the allocation even if it is freed in another
+ * thread or after the module is destroyed.
+ * @{
+ */
+/// sets module the subsequent allocations of the calling thread are accounted to, NULL to unset
+void module_set_mem_owner(struct module *mod);
+/// @returns reference to the memory owner of the calling thread (NULL if none), release with module_mem_release()
+struct module_mem *module_mem_acquire_owner(void);
+void module_mem_release(struct module_mem *mem);
+/// adds (or subtracts if negative) bytes, mem may be NULL (no-op)
+void module_mem_add(struct module_mem *mem, long long bytes);
+/// @returns false if no memory was ever accounted to the module
+bool module_get_mem_usage(struct module *mod, long long *current, long long *peak);
+/// @}
 
 #define CAST_MODULE(x) ((struct module *) x)
 
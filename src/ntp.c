@@ -35,3 +35,13 @@ void ntp64_time(uint32_t * ntp_sec, uint32_t * ntp_frac)
         tmp = now.tv_usec;
         *ntp_frac = (tmp << 12) + (tmp << 8) - ((tmp * 3650) >> 6);
 }
+
+/**
+ * Converts a 64-bit NTP timestamp to nanoseconds since the Unix epoch (the
+ * same base as get_time_in_ns()).
+ */
+int64_t ntp64_to_unix_ns(uint32_t ntp_sec, uint32_t ntp_frac)
+{
+        return ((int64_t) ntp_sec - SECS_BETWEEN_1900_1970) * 1000000000LL
+                + (int64_t) (((uint64_t) ntp_frac * 1000000000ULL) >> 32);
+}
@@ -69,174 +69,148 @@
 #include "tfrc.h"
 #include "pdb.h"
 
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
 #define PDB_MAGIC	0x10101010
-#define PDB_NODE_MAGIC	0x01010101
-
-typedef struct s_pdb_node {
-        uint32_t key;
-        void *data;
-        struct s_pdb_node *parent;
-        struct s_pdb_node *left;
-        struct s_pdb_node *right;
-        uint32_t magic;
-} pdb_node_t;
+#define PDB_MIN_INDEX   8       ///< minimal number of index slots, power of two
+
+/*
+ * The database is read (looked up and iterated) constantly by the receiving
+ * thread while participants are added or removed rarely, possibly from
+ * other threads (RTCP, control). Therefore it is kept as an immutable
+ * snapshot - a contiguous array of the participants and an open-addressing
+ * hash index over it. Writers (serialized by the lock) build a new snapshot,
+ * publish it and retire the old one, which is freed once no reader is in
+ * a read-side section (RCU-style), so readers never take a lock.
+ */
+struct pdb_snapshot {
+        struct pdb_snapshot *next_retired;
+        int count;
+        unsigned index_mask;    ///< number of index slots - 1
+        struct pdb_e **index;   ///< points behind items in the same allocation
+        struct pdb_e *items[];  ///< [count]
+};
 
 struct pdb {
-        pdb_node_t *root;
         uint32_t magic;
-        int count;
         volatile int *delay_ms;
-};
+        struct pdb_snapshot *_Atomic cur;
+        atomic_int readers;     ///< threads in a read-side section
+        atomic_bool has_retired;
 
-/*****************************************************************************/
-/* Debugging functions...                                                    */
-/*****************************************************************************/
+        pthread_mutex_t lock;   ///< serializes writers, protects retired
+        struct pdb_snapshot *retired;
+};
 
-#define BTREE_MAGIC      0x10101010
-#define BTREE_NODE_MAGIC 0x01010101
+static inline uint32_t pdb_hash(uint32_t ssrc)
+{
+        ssrc ^= ssrc >> 16;
+        ssrc *= 0x7feb352dU;
+        ssrc ^= ssrc >> 15;
+        ssrc *= 0x846ca68bU;
+        ssrc ^= ssrc >> 16;
+        return ssrc;
+}
 
-#ifdef DEBUG
-static
-#ifndef HAVE_MACOSX
-__thread
-#endif
-int pdb_count;
+static struct pdb_e *pdb_snapshot_find(const struct pdb_snapshot *snap, uint32_t ssrc)
+{
+        for (unsigned i = pdb_hash(ssrc) & snap->index_mask; ; i = (i + 1) & snap->index_mask) {
+                struct pdb_e *e = snap->index[i];
+                if (e == NULL || e->ssrc == ssrc) {
+                        return e;
+                }
+        }
+}
 
-static void pdb_validate_node(pdb_node_t * node, pdb_node_t * parent)
+/// @param count number of items that the caller fills in and then calls pdb_snapshot_index()
+static struct pdb_snapshot *pdb_snapshot_alloc(int count)
 {
-        assert(node->magic == BTREE_NODE_MAGIC);
-        assert(node->parent == parent);
-        pdb_count++;
-        if (node->left != NULL) {
-                pdb_validate_node(node->left, node);
+        unsigned index_size = PDB_MIN_INDEX;
+        while (index_size < 2U * count) {
+                index_size *= 2;
         }
-        if (node->right != NULL) {
-                pdb_validate_node(node->right, node);
+        struct pdb_snapshot *snap = calloc(1, sizeof *snap + count * sizeof(struct pdb_e *)
+                        + index_size * sizeof(struct pdb_e *));
+        if (snap == NULL) {
+                return NULL;
         }
+        snap->count = count;
+        snap->index_mask = index_size - 1;
+        snap->index = snap->items + count;
+        return snap;
 }
-#endif
 
-static void pdb_validate(struct pdb *t)
+static void pdb_snapshot_index(struct pdb_snapshot *snap)
 {
-        assert(t->magic == BTREE_MAGIC);
-#ifdef DEBUG
-        pdb_count = 0;
-        if (t->root != NULL) {
-                pdb_validate_node(t->root, NULL);
+        for (int n = 0; n < snap->count; ++n) {
+                unsigned i = pdb_hash(snap->items[n]->ssrc) & snap->index_mask;
+                while (snap->index[i] != NULL) {
+                        i = (i + 1) & snap->index_mask;
+                }
+                snap->index[i] = snap->items[n];
         }
-        assert(pdb_count == t->count);
-#endif
 }
 
 /*****************************************************************************/
-/* Utility functions                                                         */
+/* Debugging functions...                                                    */
 /*****************************************************************************/
 
-static pdb_node_t *pdb_min(pdb_node_t * x)
+static void pdb_validate(struct pdb *t)
 {
-        if (x == NULL) {
-                return NULL;
-        }
-        while (x->left) {
-                x = x->left;
+        assert(t->magic == PDB_MAGIC);
+#ifdef DEBUG
+        const struct pdb_snapshot *snap = atomic_load(&t->cur);
+        for (int i = 0; i < snap->count; ++i) {
+                assert(pdb_snapshot_find(snap, snap->items[i]->ssrc) == snap->items[i]);
         }
-        return x;
+#endif
 }
 
-static pdb_node_t *pdb_successor(pdb_node_t * x)
-{
-        pdb_node_t *y;
-
-        if (x->right != NULL) {
-                return pdb_min(x->right);
-        }
-
-        y = x->parent;
-        while (y != NULL && x == y->right) {
-                x = y;
-                y = y->parent;
-        }
-
-        return y;
-}
+/*****************************************************************************/
+/* Read-side sections and reclamation                                        */
+/*****************************************************************************/
 
-static pdb_node_t *pdb_search(pdb_node_t * x, uint32_t key)
+static const struct pdb_snapshot *pdb_read_lock(struct pdb *db)
 {
-        while (x != NULL && key != x->key) {
-                if (key < x->key) {
-                        x = x->left;
-                } else {
-                        x = x->right;
-                }
-        }
-        return x;
+        atomic_fetch_add(&db->readers, 1);
+        return atomic_load(&db->cur);
 }
 
-static void pdb_insert_node(struct pdb *tree, pdb_node_t * z)
+/// frees the retired snapshots if there is no reader, called with lock held
+static void pdb_reclaim(struct pdb *db)
 {
-        pdb_node_t *x, *y;
-
-        pdb_validate(tree);
-        y = NULL;
-        x = tree->root;
-        while (x != NULL) {
-                y = x;
-                assert(z->key != x->key);
-                if (z->key < x->key) {
-                        x = x->left;
-                } else {
-                        x = x->right;
-                }
+        if (db->retired == NULL || atomic_load(&db->readers) != 0) {
+                return;
         }
-
-        z->parent = y;
-        if (y == NULL) {
-                tree->root = z;
-        } else if (z->key < y->key) {
-                y->left = z;
-        } else {
-                y->right = z;
+        while (db->retired != NULL) {
+                struct pdb_snapshot *next = db->retired->next_retired;
+                free(db->retired);
+                db->retired = next;
         }
-        tree->count++;
-        pdb_validate(tree);
+        atomic_store(&db->has_retired, false);
 }
 
-static pdb_node_t *pdb_delete_node(struct pdb *tree, pdb_node_t * z)
+static void pdb_read_unlock(struct pdb *db)
 {
-        pdb_node_t *x, *y;
-
-        pdb_validate(tree);
-        if (z->left == NULL || z->right == NULL) {
-                y = z;
-        } else {
-                y = pdb_successor(z);
+        if (atomic_fetch_sub(&db->readers, 1) == 1 && atomic_load(&db->has_retired)
+                        && pthread_mutex_trylock(&db->lock) == 0) {
+                pdb_reclaim(db);
+                pthread_mutex_unlock(&db->lock);
         }
+}
 
-        if (y->left != NULL) {
-                x = y->left;
-        } else {
-                x = y->right;
-        }
-
-        if (x != NULL) {
-                x->parent = y->parent;
-        }
-
-        if (y->parent == NULL) {
-                tree->root = x;
-        } else if (y == y->parent->left) {
-                y->parent->left = x;
-        } else {
-                y->parent->right = x;
-        }
-
-        z->key = y->key;
-        z->data = y->data;
-
-        tree->count--;
-
-        pdb_validate(tree);
-        return y;
+/// publishes new snapshot, called with lock held
+static void pdb_publish(struct pdb *db, struct pdb_snapshot *snap)
+{
+        struct pdb_snapshot *old = atomic_exchange(&db->cur, snap);
+        old->next_retired = db->retired;
+        db->retired = old;
+        atomic_store(&db->has_retired, true);
+        pdb_validate(db);
+        pdb_reclaim(db);
 }
 
 /*****************************************************************************/
@@ -244,12 +218,21 @@ static pdb_node_t *pdb_delete_node(struct pdb *tree, pdb_node_t * z)
 struct pdb *pdb_init(volatile int *delay_ms)
 {
         struct pdb *db = malloc(sizeof(struct pdb));
-        if (db != NULL) {
-                db->magic = PDB_MAGIC;
-                db->count = 0;
-                db->root = NULL;
-                db->delay_ms = delay_ms;
+        if (db == NULL) {
+                return NULL;
+        }
+        struct pdb_snapshot *empty = pdb_snapshot_alloc(0);
+        if (empty == NULL) {
+                free(db);
+                return NULL;
         }
+        db->magic = PDB_MAGIC;
+        db->delay_ms = delay_ms;
+        atomic_init(&db->cur, empty);
+        atomic_init(&db->readers, 0);
+        atomic_init(&db->has_retired, false);
+        pthread_mutex_init(&db->lock, NULL);
+        db->retired = NULL;
         return db;
 }
 
@@ -258,18 +241,20 @@ void pdb_destroy(struct pdb **db_p)
         struct pdb *db = *db_p;
 
         pdb_validate(db);
-        if (db->root != NULL) {
-                pdb_iter_t it;
-                struct pdb_e *cp = pdb_iter_init(db, &it);
-                while (cp != NULL) {
-                        struct pdb_e *item = NULL;
-                        pdb_remove(db, cp->ssrc, &item);
-                        cp = pdb_iter_next(&it);
-                        pdb_destroy_item(item);
-                }
-                pdb_iter_done(&it);
+        pdb_iter_t it;
+        struct pdb_e *cp = pdb_iter_init(db, &it);
+        while (cp != NULL) {
+                struct pdb_e *item = NULL;
+                pdb_remove(db, cp->ssrc, &item);
+                cp = pdb_iter_next(&it);
+                pdb_destroy_item(item);
         }
+        pdb_iter_done(&it);
 
+        assert(atomic_load(&db->readers) == 0);
+        pdb_reclaim(db);
+        free(atomic_load(&db->cur));
+        pthread_mutex_destroy(&db->lock);
         free(db);
         *db_p = NULL;
 }
@@ -289,6 +274,8 @@ static struct pdb_e *pdb_create_item(uint32_t ssrc, volatile int *delay_ms)
                 p->sdes_note = NULL;
                 p->decoder_state = NULL;
                 p->decoder_state_deleter = NULL;
+                p->packet_handler = NULL;
+                p->packet_handler_udata = NULL;
                 p->pt = 255;
                 p->playout_buffer = pbuf_init(delay_ms);
                 p->tfrc_state = tfrc_init(p->creation_time);
@@ -301,30 +288,31 @@ int pdb_add(struct pdb *db, uint32_t ssrc)
         /* Add an item to the participant database, indexed by ssrc. */
         /* Returns 0 on success, 1 if the participant is already in  */
         /* the database, 2 for other failures.                       */
-        pdb_node_t *x;
         struct pdb_e *i;
 
         pdb_validate(db);
-        x = pdb_search(db->root, ssrc);
-        if (x != NULL) {
+        pthread_mutex_lock(&db->lock);
+        const struct pdb_snapshot *cur = atomic_load(&db->cur);
+        if (pdb_snapshot_find(cur, ssrc) != NULL) {
+                pthread_mutex_unlock(&db->lock);
                 debug_msg("Item already exists - ssrc %x\n", ssrc);
                 return 1;
         }
 
-        i = pdb_create_item(ssrc, db->delay_ms);
+        struct pdb_snapshot *snap = pdb_snapshot_alloc(cur->count + 1);
+        i = snap != NULL ? pdb_create_item(ssrc, db->delay_ms) : NULL;
         if (i == NULL) {
+                pthread_mutex_unlock(&db->lock);
+                free(snap);
                 debug_msg("Unable to create database entry - ssrc %x\n", ssrc);
                 return 2;
         }
 
-        x = (pdb_node_t *) malloc(sizeof(pdb_node_t));
-        x->key = ssrc;
-        x->data = i;
-        x->parent = NULL;
-        x->left = NULL;
-        x->right = NULL;
-        x->magic = BTREE_NODE_MAGIC;
-        pdb_insert_node(db, x);
+        memcpy(snap->items, cur->items, cur->count * sizeof(struct pdb_e *));
+        snap->items[cur->count] = i;
+        pdb_snapshot_index(snap);
+        pdb_publish(db, snap);
+        pthread_mutex_unlock(&db->lock);
         debug_msg("Added participant %x\n", ssrc);
         return 0;
 }
@@ -333,37 +321,37 @@ struct pdb_e *pdb_get(struct pdb *db, uint32_t ssrc)
 {
         /* Return a pointer to the item indexed by ssrc, or NULL if   */
         /* the item is not present in the database.                   */
-        pdb_node_t *x;
-
-        pdb_validate(db);
-        x = pdb_search(db->root, ssrc);
-        if (x != NULL) {
-                return x->data;
-        }
-        return NULL;
+        const struct pdb_snapshot *snap = pdb_read_lock(db);
+        struct pdb_e *e = pdb_snapshot_find(snap, ssrc);
+        pdb_read_unlock(db);
+        return e;
 }
 
 int pdb_remove(struct pdb *db, uint32_t ssrc, struct pdb_e **item)
 {
         /* Remove the item indexed by ssrc. Return zero on success.   */
-        pdb_node_t *x;
-
         pdb_validate(db);
-        x = pdb_search(db->root, ssrc);
-        if (x == NULL) {
-                debug_msg("Item not on tree - ssrc %ul\n", ssrc);
+        pthread_mutex_lock(&db->lock);
+        const struct pdb_snapshot *cur = atomic_load(&db->cur);
+        struct pdb_e *e = pdb_snapshot_find(cur, ssrc);
+        struct pdb_snapshot *snap = NULL;
+        if (e == NULL || (snap = pdb_snapshot_alloc(cur->count - 1)) == NULL) {
+                pthread_mutex_unlock(&db->lock);
+                debug_msg("Item not in database - ssrc %" PRIx32 "\n", ssrc);
                 *item = NULL;
                 return 1;
         }
 
-        /* Note value that gets freed is not necessarily the the same as node
-         * that gets removed from tree since there is an optimization to avoid
-         * pointer updates in tree which means sometimes we just copy key and
-         * data from one node to another.  
-         */
-        *item = x->data;
-        x = pdb_delete_node(db, x);
-        free(x);
+        int n = 0;
+        for (int i = 0; i < cur->count; ++i) {
+                if (cur->items[i] != e) {
+                        snap->items[n++] = cur->items[i];
+                }
+        }
+        pdb_snapshot_index(snap);
+        pdb_publish(db, snap);
+        pthread_mutex_unlock(&db->lock);
+        *item = e;
         return 0;
 }
 
@@ -387,30 +375,35 @@ void pdb_destroy_item(struct pdb_e *item)
 }
 
 /* 
- * Iterator functions 
+ * Iterator functions - the iterator holds a read-side section over the
+ * snapshot taken by pdb_iter_init(), which ends either when pdb_iter_next()
+ * returns NULL or by pdb_iter_done().
  */
 
 struct pdb_e *pdb_iter_init(struct pdb *db, pdb_iter_t *it)
 {
-        if (db->root == NULL) {
-                return NULL;    /* The database is empty */
-        }
-        *it = (pdb_node_t *) pdb_min(db->root);
-        return ((pdb_node_t *) *it)->data;
+        it->db = db;
+        it->snap = pdb_read_lock(db);
+        it->pos = -1;
+        return pdb_iter_next(it);
 }
 
 struct pdb_e *pdb_iter_next(pdb_iter_t *it)
 {
-        assert(*it != NULL);
-        *it = (pdb_node_t *)pdb_successor((pdb_node_t *)*it);
-        if (*it == NULL) {
+        if (it->db == NULL) {
                 return NULL;
         }
-        return ((pdb_node_t *) *it)->data;
+        if (++it->pos < it->snap->count) {
+                return it->snap->items[it->pos];
+        }
+        pdb_iter_done(it);
+        return NULL;
 }
 
 void pdb_iter_done(pdb_iter_t *it)
 {
-        *it = NULL;
+        if (it->db != NULL) {
+                pdb_read_unlock(it->db);
+                it->db = NULL;
+        }
 }
-
@@ -68,6 +68,11 @@ extern "C" {
  * Deletes decoder for participant when the participant is deleted
  */
 typedef void (*decoder_state_deleter_t)(void *);
+/**
+ * Takes the received RTP packet (rtp_packet *) of the participant instead of
+ * the playout buffer, eg. to pass it to another thread
+ */
+typedef void (*packet_handler_t)(void *udata, void *pkt);
 
 struct pdb_e {
 	uint32_t		 ssrc;
@@ -80,6 +85,8 @@ struct pdb_e {
 	char			*sdes_note;
 	void                    *decoder_state; ///< state of decoder for participant
         decoder_state_deleter_t  decoder_state_deleter; ///< decoder state deleter
+        packet_handler_t         packet_handler; ///< if set, received packets are passed to it instead of pbuf_insert()
+        void                    *packet_handler_udata;
 	uint8_t			 pt;	/* Last seen RTP payload type for this participant */
 	struct pbuf		*playout_buffer;
 	struct tfrc		*tfrc_state;
@@ -103,10 +110,18 @@ struct pdb_e        *pdb_get(struct pdb *db, uint32_t ssrc);
 int                  pdb_remove(struct pdb *db, uint32_t ssrc, struct pdb_e **item);
 void                 pdb_destroy_item(struct pdb_e *item);
 
-typedef void *pdb_iter_t;
+struct pdb_snapshot;
 /*
- * Iterator for the database.
- */ 
+ * Iterator for the database. The iteration goes over the participants
+ * present at pdb_iter_init(), participants can be added or removed
+ * meanwhile. pdb_iter_done() must be called unless pdb_iter_next()
+ * returned NULL (calling it anyway is fine).
+ */
+typedef struct {
+        struct pdb *db;
+        const struct pdb_snapshot *snap;
+        int pos;
+} pdb_iter_t;
 struct pdb_e        *pdb_iter_init(struct pdb *db, pdb_iter_t *it);
 struct pdb_e        *pdb_iter_next(pdb_iter_t *it);
 void                 pdb_iter_done(pdb_iter_t *it);
@@ -64,12 +64,22 @@
 #include "compat/qsort_s.h"
 #include "debug.h"
 #include "pixfmt_conv.h"
+#include "utils/cpu_features.h"
+#include "utils/frame_copy.h"
 #include "utils/macros.h" // to_fourcc, OPTIMEZED_FOR, CLAMP
 #include "video_codec.h"
 
 #ifdef __SSSE3__
 #include "tmmintrin.h"
 #endif
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#define HAVE_PIXFMT_CONV_AVX2 1
+#endif
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#define HAVE_PIXFMT_CONV_NEON 1
+#endif
 
 #ifdef WORDS_BIGENDIAN
 #define BYTE_SWAP(x) (3 - x)
@@ -77,6 +87,27 @@
 #define BYTE_SWAP(x) x
 #endif
 
+#ifdef __GNUC__
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+/**
+ * Defines line decoder NAME calling NAME_impl() (inlined) with the default
+ * shifts passed as constants if the caller requests them. This allows the
+ * compiler to specialize (and vectorize) the loop for the by far most common
+ * case, other shifts are handled by the generic instance.
+ */
+#define DEFINE_SHIFT_SPECIALIZED(linkage, name) \
+        linkage void name(unsigned char *dst, const unsigned char *src, int dst_len, int rshift, int gshift, int bshift) { \
+                if (rshift == DEFAULT_R_SHIFT && gshift == DEFAULT_G_SHIFT && bshift == DEFAULT_B_SHIFT) { \
+                        name##_impl(dst, src, dst_len, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT); \
+                } else { \
+                        name##_impl(dst, src, dst_len, rshift, gshift, bshift); \
+                } \
+        }
+
 /**
  * @brief Converts v210 to UYVY
  * @param[out] dst     4-byte aligned output buffer where UYVY will be stored
@@ -208,8 +239,7 @@ static void vc_copylineYUYV(unsigned char * __restrict dst, const unsigned char
  * @param[in]  gshift  destination green shift
  * @param[in]  bshift  destination blue shift
  */
-static void
-vc_copyliner10k(unsigned char * __restrict dst, const unsigned char * __restrict src, int len, int rshift,
+static ALWAYS_INLINE void vc_copyliner10k_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int len, int rshift,
                 int gshift, int bshift)
 {
         struct {
@@ -275,6 +305,7 @@ vc_copyliner10k(unsigned char * __restrict dst, const unsigned char * __restrict
                 len -= 4;
         }
 }
+DEFINE_SHIFT_SPECIALIZED(static, vc_copyliner10k)
 
 static void
 vc_copyliner10ktoRG48(unsigned char * __restrict dst, const unsigned char * __restrict src, int dstlen, int rshift,
@@ -409,8 +440,7 @@ vc_copylineR12LtoRGB(unsigned char * __restrict dst, const unsigned char * __res
  * @param[in]  gshift  destination green shift
  * @param[in]  bshift  destination blue shift
  */
-static void
-vc_copylineR12L(unsigned char *dst, const unsigned char *src, int dstlen, int rshift,
+static ALWAYS_INLINE void vc_copylineR12L_impl(unsigned char *dst, const unsigned char *src, int dstlen, int rshift,
                 int gshift, int bshift)
 {
         assert((uintptr_t) dst % sizeof(uint32_t) == 0);
@@ -487,6 +517,7 @@ vc_copylineR12L(unsigned char *dst, const unsigned char *src, int dstlen, int rs
                 *d++ = alpha_mask | (r << rshift) | (g << gshift) | (b << bshift);
         }
 }
+DEFINE_SHIFT_SPECIALIZED(static, vc_copylineR12L)
 
 /**
  * @brief Changes color channels' order in RGBA
@@ -726,7 +757,7 @@ static void vc_copylineRGB(unsigned char * __restrict dst, const unsigned char *
  * In opposite to the defined semantic of {r,g,b}shift, here instead of destination
  * shifts the shifts define the source codec properties.
  */
-static void vc_copylineRGBAtoRGBwithShift(unsigned char * __restrict dst2, const unsigned char * __restrict src2, int dst_len, int rshift, int gshift, int bshift)
+static ALWAYS_INLINE void vc_copylineRGBAtoRGBwithShift(unsigned char * __restrict dst2, const unsigned char * __restrict src2, int dst_len, int rshift, int gshift, int bshift)
 {
 	register const uint32_t * src = (const uint32_t *)(const void *) src2;
 	register uint32_t * dst = (uint32_t *)(void *) dst2;
@@ -787,6 +818,36 @@ static void vc_copylineRGBAtoRGB(unsigned char * __restrict dst, const unsigned
         vc_copylineRGBAtoRGBwithShift(dst, src, dst_len, 0, 8, 16);
 }
 
+#ifdef HAVE_PIXFMT_CONV_AVX2
+/**
+ * Byte-shuffling variant of vc_copylineToRGBA_inplace() for byte-aligned
+ * shifts, processes whole 32 B blocks.
+ * @returns number of bytes processed
+ */
+static __attribute__((target("avx2"))) int
+vc_copylineToRGBA_inplace_AVX2(unsigned char *dst, const unsigned char *src, int dst_len,
+                int src_rshift, int src_gshift, int src_bshift)
+{
+        if (src_rshift % 8 != 0 || src_gshift % 8 != 0 || src_bshift % 8 != 0 ||
+                        src_rshift > 24 || src_gshift > 24 || src_bshift > 24 ||
+                        src_rshift < 0 || src_gshift < 0 || src_bshift < 0) {
+                return 0;
+        }
+        char r = (char) (src_rshift / 8);
+        char g = (char) (src_gshift / 8);
+        char b = (char) (src_bshift / 8);
+        const __m256i shuf = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+                                r, g, b, -1, r + 4, g + 4, b + 4, -1,
+                                r + 8, g + 8, b + 8, -1, r + 12, g + 12, b + 12, -1));
+        int done = 0;
+        for ( ; dst_len - done >= 32; done += 32) {
+                __m256i v = _mm256_loadu_si256((const __m256i *)(const void *) (src + done));
+                _mm256_storeu_si256((__m256i *)(void *) (dst + done), _mm256_shuffle_epi8(v, shuf));
+        }
+        return done;
+}
+#endif
+
 /**
  * @brief Converts RGBA with different shifts to RGBA
  *
@@ -795,6 +856,14 @@ static void vc_copylineRGBAtoRGB(unsigned char * __restrict dst, const unsigned
 void vc_copylineToRGBA_inplace(unsigned char *dst, const unsigned char *src, int dst_len,
                 int src_rshift, int src_gshift, int src_bshift)
 {
+#ifdef HAVE_PIXFMT_CONV_AVX2
+        if (cpu_has(CPU_FEATURE_AVX2)) {
+                int done = vc_copylineToRGBA_inplace_AVX2(dst, src, dst_len, src_rshift, src_gshift, src_bshift);
+                dst += done;
+                src += done;
+                dst_len -= done;
+        }
+#endif
 	register const uint32_t * in = (const uint32_t *)(const void *) src;
 	register uint32_t * out = (uint32_t *)(void *) dst;
         while (dst_len >= 4) {
@@ -829,7 +898,7 @@ void vc_copylineUYVYtoGrayscale(unsigned char * __restrict dst, const unsigned c
  * @brief Converts RGB to RGBA
  * @copydetails vc_copyliner10k
  */
-void vc_copylineRGBtoRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
+static ALWAYS_INLINE void vc_copylineRGBtoRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
 {
         register unsigned int r, g, b;
         register uint32_t *d = (uint32_t *)(void *) dst;
@@ -843,6 +912,7 @@ void vc_copylineRGBtoRGBA(unsigned char * __restrict dst, const unsigned char *
                 *d++ = alpha_mask | (r << rshift) | (g << gshift) | (b << bshift);
         }
 }
+DEFINE_SHIFT_SPECIALIZED(, vc_copylineRGBtoRGBA)
 
 /**
  * @brief Converts RGB(A) into UYVY
@@ -965,7 +1035,7 @@ static void vc_copylineUYVYtoRG48(unsigned char * __restrict dst, const unsigned
  * @param[out] dst     output buffer for RGBA
  * @param[in]  src     input buffer with UYVY
  */
-static void vc_copylineUYVYtoRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+static ALWAYS_INLINE void vc_copylineUYVYtoRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
                 int gshift, int bshift) {
         assert((uintptr_t) dst % sizeof(uint32_t) == 0);
         uint32_t *dst32 = (uint32_t *)(void *) dst;
@@ -992,6 +1062,7 @@ static void vc_copylineUYVYtoRGBA(unsigned char * __restrict dst, const unsigned
                 *dst32++ = alpha_mask | r << rshift | g << gshift | b << bshift;
         }
 }
+DEFINE_SHIFT_SPECIALIZED(static, vc_copylineUYVYtoRGBA)
 
 /**
  * @brief Converts UYVY to RGB using SSE.
@@ -1672,7 +1743,7 @@ static void vc_copylineY416toRGB(unsigned char * __restrict dst, const unsigned
         }
 }
 
-static void vc_copylineY416toRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+static ALWAYS_INLINE void vc_copylineY416toRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
                 int gshift, int bshift)
 {
         assert((uintptr_t) src % 2 == 0);
@@ -1697,6 +1768,7 @@ static void vc_copylineY416toRGBA(unsigned char * __restrict dst, const unsigned
                 *out++ = alpha_mask | r << rshift | g << gshift | b << bshift;
         }
 }
+DEFINE_SHIFT_SPECIALIZED(static, vc_copylineY416toRGBA)
 
 static void vc_copylineRG48toR10k(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
                 int gshift, int bshift)
@@ -1735,7 +1807,7 @@ static void vc_copylineRG48toRGB(unsigned char * __restrict dst, const unsigned
         }
 }
 
-static void vc_copylineRG48toRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+static ALWAYS_INLINE void vc_copylineRG48toRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
                 int gshift, int bshift)
 {
         assert((uintptr_t) dst % sizeof(uint32_t) == 0);
@@ -1746,6 +1818,7 @@ static void vc_copylineRG48toRGBA(unsigned char * __restrict dst, const unsigned
                 src += 6;
         }
 }
+DEFINE_SHIFT_SPECIALIZED(static, vc_copylineRG48toRGBA)
 
 /**
  * @brief Converts RGB to UYVY.
@@ -2168,15 +2241,19 @@ void vc_memcpy(unsigned char * __restrict dst, const unsigned char * __restrict
         UNUSED(gshift);
         UNUSED(bshift);
 
-        memcpy(dst, src, dst_len);
+        // the lines of 4K and larger frames are copied bypassing the cache
+        if (dst_len >= 8192) {
+                memcpy_nt(dst, src, dst_len);
+        } else {
+                memcpy(dst, src, dst_len);
+        }
 }
 
 /**
  * @brief Converts DPX10 to RGBA
  * @copydetails vc_copyliner10k
  */
-static void
-vc_copylineDPX10toRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
+static ALWAYS_INLINE void vc_copylineDPX10toRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
 {
         
         register const unsigned int *in = (const unsigned int *)(const void *) src;
@@ -2195,6 +2272,7 @@ vc_copylineDPX10toRGBA(unsigned char * __restrict dst, const unsigned char * __r
                 dst_len -= 4;
         }
 }
+DEFINE_SHIFT_SPECIALIZED(static, vc_copylineDPX10toRGBA)
 
 /**
  * @brief Converts DPX10 to RGB.
@@ -2565,6 +2643,476 @@ static void vc_copylineY416toV210(unsigned char * __restrict dst, const unsigned
         }
 }
 
+#ifdef HAVE_PIXFMT_CONV_AVX2
+/*
+ * AVX2 versions of the 10- and 12-bit (un)packing line converters. Each of
+ * them converts whole vector blocks and passes the rest of the line to the
+ * scalar variant, so the result is bit-identical to it. The loads and stores
+ * never exceed the range touched by the scalar variant. The functions are
+ * selected at runtime by get_decoder_from_to() if the CPU supports AVX2.
+ */
+#define AVX2_FN __attribute__((target("avx2")))
+#define LANE_MASK(...) _mm256_broadcastsi128_si256(_mm_setr_epi8(__VA_ARGS__))
+
+static inline AVX2_FN __m256i load_2x128(const unsigned char *lane0, const unsigned char *lane1)
+{
+        return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(const void *) lane0)),
+                        _mm_loadu_si128((const __m128i *)(const void *) lane1), 1);
+}
+
+static inline AVX2_FN __m256i load_2x64(const unsigned char *lane0, const unsigned char *lane1)
+{
+        return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadl_epi64((const __m128i *)(const void *) lane0)),
+                        _mm_loadl_epi64((const __m128i *)(const void *) lane1), 1);
+}
+
+/// stores 2x24 B - 16 B from lo and 8 B from hi for each lane
+static inline AVX2_FN void store_2x24(unsigned char *dst, __m256i lo, __m256i hi)
+{
+        _mm_storeu_si128((__m128i *)(void *) dst, _mm256_castsi256_si128(lo));
+        _mm_storel_epi64((__m128i *)(void *) (dst + 16), _mm256_castsi256_si128(hi));
+        _mm_storeu_si128((__m128i *)(void *) (dst + 24), _mm256_extracti128_si256(lo, 1));
+        _mm_storel_epi64((__m128i *)(void *) (dst + 40), _mm256_extracti128_si256(hi, 1));
+}
+
+/// stores first 12 B of each lane as 24 contiguous B
+static inline AVX2_FN void store_24(unsigned char *dst, __m256i v)
+{
+        v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+        _mm_storeu_si128((__m128i *)(void *) dst, _mm256_castsi256_si128(v));
+        _mm_storel_epi64((__m128i *)(void *) (dst + 16), _mm256_extracti128_si256(v, 1));
+}
+
+/**
+ * spreads 3-byte groups into 32-bit words, no read past 24 B (lane 1 is
+ * loaded 4 B earlier)
+ */
+static inline AVX2_FN __m256i load_expand_3to4(const unsigned char *src)
+{
+        const __m256i expand = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                        4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1);
+        return _mm256_shuffle_epi8(load_2x128(src, src + 8), expand);
+}
+
+/**
+ * unpacks v210 words to 16-bit samples (shifted to MSB) - first and second
+ * component of each word to ab, the third one to the lower half of c
+ */
+static inline AVX2_FN void v210_unpack(__m256i w, __m256i *ab, __m256i *c)
+{
+        const __m256i lo = _mm256_set1_epi32(0xFFC0);
+        *ab = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(w, 6), lo),
+                        _mm256_and_si256(_mm256_slli_epi32(w, 12), _mm256_slli_epi32(lo, 16)));
+        *c = _mm256_and_si256(_mm256_srli_epi32(w, 14), lo);
+}
+
+/// @copydetails vc_copylinev210
+static AVX2_FN void vc_copylinev210_AVX2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m256i mask = _mm256_set1_epi32(0xFF);
+        const __m256i compact = LANE_MASK(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        for ( ; dst_len >= 24; dst_len -= 24) {
+                __m256i w = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                __m256i t = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(w, 2), mask),
+                                _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(w, 4), _mm256_slli_epi32(mask, 8)),
+                                        _mm256_and_si256(_mm256_srli_epi32(w, 6), _mm256_slli_epi32(mask, 16))));
+                store_24(dst, _mm256_shuffle_epi8(t, compact));
+                src += 32;
+                dst += 24;
+        }
+        vc_copylinev210(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static AVX2_FN void vc_copylineV210toY216_AVX2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m256i ab_lo = LANE_MASK(2, 3, 0, 1, 4, 5, -1, -1, -1, -1, 6, 7, 10, 11, 8, 9);
+        const __m256i c_lo = LANE_MASK(-1, -1, -1, -1, -1, -1, 0, 1, 4, 5, -1, -1, -1, -1, -1, -1);
+        const __m256i ab_hi = LANE_MASK(12, 13, -1, -1, -1, -1, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i c_hi = LANE_MASK(-1, -1, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        for ( ; dst_len >= 48; dst_len -= 48) {
+                __m256i ab, c;
+                v210_unpack(_mm256_loadu_si256((const __m256i *)(const void *) src), &ab, &c);
+                store_2x24(dst, _mm256_or_si256(_mm256_shuffle_epi8(ab, ab_lo), _mm256_shuffle_epi8(c, c_lo)),
+                                _mm256_or_si256(_mm256_shuffle_epi8(ab, ab_hi), _mm256_shuffle_epi8(c, c_hi)));
+                src += 32;
+                dst += 48;
+        }
+        vc_copylineV210toY216(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static AVX2_FN void vc_copylineV210toY416_AVX2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m256i ab_mask[3] = {
+                LANE_MASK(0, 1, 2, 3, -1, -1, -1, -1, 0, 1, 4, 5, -1, -1, -1, -1),
+                LANE_MASK(6, 7, -1, -1, 8, 9, -1, -1, 6, 7, 10, 11, 8, 9, -1, -1),
+                LANE_MASK(-1, -1, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, 14, 15, -1, -1),
+        };
+        const __m256i c_mask[3] = {
+                LANE_MASK(-1, -1, -1, -1, 0, 1, -1, -1, -1, -1, -1, -1, 0, 1, -1, -1),
+                LANE_MASK(-1, -1, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+                LANE_MASK(8, 9, -1, -1, -1, -1, -1, -1, 8, 9, 12, 13, -1, -1, -1, -1),
+        };
+        const __m256i alpha = _mm256_set1_epi64x((long long) 0xFFFF000000000000ULL);
+        for ( ; dst_len >= 96; dst_len -= 96) {
+                __m256i ab, c;
+                v210_unpack(_mm256_loadu_si256((const __m256i *)(const void *) src), &ab, &c);
+                for (int i = 0; i < 3; ++i) {
+                        __m256i out = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(ab, ab_mask[i]),
+                                                _mm256_shuffle_epi8(c, c_mask[i])), alpha);
+                        _mm_storeu_si128((__m128i *)(void *) (dst + 16 * i), _mm256_castsi256_si128(out));
+                        _mm_storeu_si128((__m128i *)(void *) (dst + 48 + 16 * i), _mm256_extracti128_si256(out, 1));
+                }
+                src += 32;
+                dst += 96;
+        }
+        vc_copylineV210toY416(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static AVX2_FN void vc_copylineUYVYtoV210_AVX2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m256i mask = _mm256_set1_epi32(0xFF);
+        for ( ; dst_len >= 32; dst_len -= 32) {
+                __m256i x = load_expand_3to4(src);
+                __m256i w = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(x, mask), 2),
+                                _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(x, _mm256_slli_epi32(mask, 8)), 4),
+                                        _mm256_slli_epi32(_mm256_and_si256(x, _mm256_slli_epi32(mask, 16)), 6)));
+                _mm256_storeu_si256((__m256i *)(void *) dst, w);
+                src += 24;
+                dst += 32;
+        }
+        vc_copylineUYVYtoV210(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static AVX2_FN void vc_copylineY216toV210_AVX2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m256i ab_x0 = LANE_MASK(2, 3, 0, 1, 4, 5, 10, 11, 14, 15, 12, 13, -1, -1, -1, -1);
+        const __m256i ab_x1 = LANE_MASK(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 6, 7);
+        const __m256i c_x0 = LANE_MASK(6, 7, -1, -1, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i c_x1 = LANE_MASK(-1, -1, -1, -1, -1, -1, -1, -1, 2, 3, -1, -1, 4, 5, -1, -1);
+        for ( ; dst_len >= 32; dst_len -= 32) {
+                __m256i x0 = _mm256_srli_epi16(load_2x128(src, src + 24), 6);
+                __m256i x1 = _mm256_srli_epi16(load_2x64(src + 16, src + 40), 6);
+                __m256i ab = _mm256_or_si256(_mm256_shuffle_epi8(x0, ab_x0), _mm256_shuffle_epi8(x1, ab_x1));
+                __m256i c = _mm256_or_si256(_mm256_shuffle_epi8(x0, c_x0), _mm256_shuffle_epi8(x1, c_x1));
+                __m256i w = _mm256_or_si256(_mm256_and_si256(ab, _mm256_set1_epi32(0xFFFF)),
+                                _mm256_or_si256(_mm256_slli_epi32(_mm256_srli_epi32(ab, 16), 10),
+                                        _mm256_slli_epi32(c, 20)));
+                _mm256_storeu_si256((__m256i *)(void *) dst, w);
+                src += 48;
+                dst += 32;
+        }
+        vc_copylineY216toV210(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static AVX2_FN void vc_copyliner10ktoRG48_AVX2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dstlen, int rshift,
+                int gshift, int bshift)
+{
+        const __m256i bswap = LANE_MASK(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        const __m256i lo = _mm256_set1_epi32(0xFFC0);
+        const __m256i ab_lo = LANE_MASK(0, 1, 2, 3, -1, -1, 4, 5, 6, 7, -1, -1, 8, 9, 10, 11);
+        const __m256i c_lo = LANE_MASK(-1, -1, -1, -1, 0, 1, -1, -1, -1, -1, 4, 5, -1, -1, -1, -1);
+        const __m256i ab_hi = LANE_MASK(-1, -1, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i c_hi = LANE_MASK(8, 9, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+        for ( ; dstlen >= 48; dstlen -= 48) {
+                __m256i w = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(const void *) src), bswap);
+                __m256i rg = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(w, 16), lo),
+                                _mm256_and_si256(_mm256_slli_epi32(w, 10), _mm256_slli_epi32(lo, 16)));
+                __m256i b = _mm256_and_si256(_mm256_slli_epi32(w, 4), lo);
+                store_2x24(dst, _mm256_or_si256(_mm256_shuffle_epi8(rg, ab_lo), _mm256_shuffle_epi8(b, c_lo)),
+                                _mm256_or_si256(_mm256_shuffle_epi8(rg, ab_hi), _mm256_shuffle_epi8(b, c_hi)));
+                src += 32;
+                dst += 48;
+        }
+        vc_copyliner10ktoRG48(dst, src, dstlen, rshift, gshift, bshift);
+}
+
+static AVX2_FN void vc_copylineRG48toR10k_AVX2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m256i rg_x0 = LANE_MASK(0, 1, 2, 3, 6, 7, 8, 9, 12, 13, 14, 15, -1, -1, -1, -1);
+        const __m256i rg_x1 = LANE_MASK(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 3, 4, 5);
+        const __m256i b_x0 = LANE_MASK(4, 5, -1, -1, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i b_x1 = LANE_MASK(-1, -1, -1, -1, -1, -1, -1, -1, 0, 1, -1, -1, 6, 7, -1, -1);
+        const __m256i bswap = LANE_MASK(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        const __m256i lo = _mm256_set1_epi32(0xFFC0);
+        for ( ; dst_len >= 32; dst_len -= 32) {
+                __m256i x0 = load_2x128(src, src + 24);
+                __m256i x1 = load_2x64(src + 16, src + 40);
+                __m256i rg = _mm256_or_si256(_mm256_shuffle_epi8(x0, rg_x0), _mm256_shuffle_epi8(x1, rg_x1));
+                __m256i b = _mm256_or_si256(_mm256_shuffle_epi8(x0, b_x0), _mm256_shuffle_epi8(x1, b_x1));
+                // R9-R0 G9-G0 B9-B0 11 (big endian)
+                __m256i w = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(rg, lo), 16),
+                                _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(rg, 10), _mm256_set1_epi32(0x3FF000)),
+                                        _mm256_or_si256(_mm256_srli_epi32(_mm256_and_si256(b, lo), 4), _mm256_set1_epi32(0x3))));
+                _mm256_storeu_si256((__m256i *)(void *) dst, _mm256_shuffle_epi8(w, bswap));
+                src += 48;
+                dst += 32;
+        }
+        vc_copylineRG48toR10k(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static AVX2_FN void vc_copylineR12LtoRG48_AVX2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        // 3 iterations (16 pixels) per loop to stay aligned with the 8-pixel R12L blocks
+        for ( ; dst_len >= 96; dst_len -= 96) {
+                for (int i = 0; i < 3; ++i) {
+                        __m256i t = load_expand_3to4(src);
+                        __m256i out = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(t, _mm256_set1_epi32(0xFFF)), 4),
+                                        _mm256_slli_epi32(_mm256_and_si256(t, _mm256_set1_epi32(0xFFF000)), 8));
+                        _mm256_storeu_si256((__m256i *)(void *) dst, out);
+                        src += 24;
+                        dst += 32;
+                }
+        }
+        vc_copylineR12LtoRG48(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static AVX2_FN void vc_copylineR12LtoRGB_AVX2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dstlen, int rshift,
+                int gshift, int bshift)
+{
+        const __m256i compact = LANE_MASK(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+        for ( ; dstlen >= 48; dstlen -= 48) {
+                for (int i = 0; i < 3; ++i) {
+                        __m256i t = load_expand_3to4(src);
+                        __m256i out = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(t, 4), _mm256_set1_epi32(0xFF)),
+                                        _mm256_and_si256(_mm256_srli_epi32(t, 8), _mm256_set1_epi32(0xFF00)));
+                        out = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(out, compact), 0x8);
+                        _mm_storeu_si128((__m128i *)(void *) dst, _mm256_castsi256_si128(out));
+                        src += 24;
+                        dst += 16;
+                }
+        }
+        vc_copylineR12LtoRGB(dst, src, dstlen, rshift, gshift, bshift);
+}
+
+static AVX2_FN void vc_copylineRG48toR12L_AVX2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m256i compact = LANE_MASK(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        for ( ; dst_len >= 72; dst_len -= 72) {
+                for (int i = 0; i < 3; ++i) {
+                        __m256i x = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                        __m256i t = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(x, 4), _mm256_set1_epi32(0xFFF)),
+                                        _mm256_and_si256(_mm256_srli_epi32(x, 8), _mm256_set1_epi32(0xFFF000)));
+                        store_24(dst, _mm256_shuffle_epi8(t, compact));
+                        src += 32;
+                        dst += 24;
+                }
+        }
+        vc_copylineRG48toR12L(dst, src, dst_len, rshift, gshift, bshift);
+}
+#endif // defined HAVE_PIXFMT_CONV_AVX2
+
+#ifdef HAVE_PIXFMT_CONV_NEON
+/*
+ * NEON versions of the most common 8-bit converters. Tails shorter than
+ * one vector block are passed to the scalar variant.
+ */
+
+/// @copydetails vc_copylinev210
+static void vc_copylinev210_NEON(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        for ( ; dst_len >= 24; dst_len -= 24) {
+                uint32x4_t w0 = vld1q_u32((const uint32_t *)(const void *) src);
+                uint32x4_t w1 = vld1q_u32((const uint32_t *)(const void *) (src + 16));
+                // narrowing keeps the lowest 8 bits of each component (shifted to 10 bits)
+                uint8x8x3_t out = {{
+                        vmovn_u16(vcombine_u16(vmovn_u32(vshrq_n_u32(w0, 2)), vmovn_u32(vshrq_n_u32(w1, 2)))),
+                        vmovn_u16(vcombine_u16(vmovn_u32(vshrq_n_u32(w0, 12)), vmovn_u32(vshrq_n_u32(w1, 12)))),
+                        vmovn_u16(vcombine_u16(vmovn_u32(vshrq_n_u32(w0, 22)), vmovn_u32(vshrq_n_u32(w1, 22)))),
+                }};
+                vst3_u8(dst, out);
+                src += 32;
+                dst += 24;
+        }
+        vc_copylinev210(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static void vc_copylineUYVYtoV210_NEON(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        for ( ; dst_len >= 32; dst_len -= 32) {
+                uint8x8x3_t in = vld3_u8(src);
+                uint16x8_t a = vmovl_u8(in.val[0]);
+                uint16x8_t b = vmovl_u8(in.val[1]);
+                uint16x8_t c = vmovl_u8(in.val[2]);
+                uint32x4_t lo = vorrq_u32(vshlq_n_u32(vmovl_u16(vget_low_u16(a)), 2),
+                                vorrq_u32(vshlq_n_u32(vmovl_u16(vget_low_u16(b)), 12), vshlq_n_u32(vmovl_u16(vget_low_u16(c)), 22)));
+                uint32x4_t hi = vorrq_u32(vshlq_n_u32(vmovl_u16(vget_high_u16(a)), 2),
+                                vorrq_u32(vshlq_n_u32(vmovl_u16(vget_high_u16(b)), 12), vshlq_n_u32(vmovl_u16(vget_high_u16(c)), 22)));
+                vst1q_u32((uint32_t *)(void *) dst, lo);
+                vst1q_u32((uint32_t *)(void *) (dst + 16), hi);
+                src += 24;
+                dst += 32;
+        }
+        vc_copylineUYVYtoV210(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/// @copydetails vc_copylineYUYV
+static void vc_copylineYUYV_NEON(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        for ( ; dst_len >= 16; dst_len -= 16) {
+                vst1q_u8(dst, vrev16q_u8(vld1q_u8(src)));
+                src += 16;
+                dst += 16;
+        }
+        vc_copylineYUYV(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/**
+ * computes (9535 * y + c1_coef * c1 + c2_coef * c2) >> 13 saturated to 0..255,
+ * coefficients are those of copylineYUVtoRGB in Q13
+ */
+static inline uint8x8_t uyvy_to_rgb_comp_neon(int16x8_t y, int16x8_t c1, int16_t c1_coef, int16x8_t c2, int16_t c2_coef)
+{
+        int32x4_t lo = vmull_n_s16(vget_low_s16(y), 9535);
+        lo = vmlal_n_s16(lo, vget_low_s16(c1), c1_coef);
+        lo = vmlal_n_s16(lo, vget_low_s16(c2), c2_coef);
+        int32x4_t hi = vmull_n_s16(vget_high_s16(y), 9535);
+        hi = vmlal_n_s16(hi, vget_high_s16(c1), c1_coef);
+        hi = vmlal_n_s16(hi, vget_high_s16(c2), c2_coef);
+        return vqmovn_u16(vcombine_u16(vqshrun_n_s32(lo, 13), vqshrun_n_s32(hi, 13)));
+}
+
+/// converts 16 UYVY pixels - the components are returned in pixel order
+static inline void uyvy_to_rgb_neon(const unsigned char *src, uint8x8x2_t *r, uint8x8x2_t *g, uint8x8x2_t *b)
+{
+        uint8x8x4_t in = vld4_u8(src);
+        int16x8_t u = vreinterpretq_s16_u16(vsubl_u8(in.val[0], vdup_n_u8(128)));
+        int16x8_t v = vreinterpretq_s16_u16(vsubl_u8(in.val[2], vdup_n_u8(128)));
+        uint8x8_t res_r[2];
+        uint8x8_t res_g[2];
+        uint8x8_t res_b[2];
+        for (int i = 0; i < 2; ++i) {
+                int16x8_t y = vreinterpretq_s16_u16(vsubl_u8(in.val[1 + 2 * i], vdup_n_u8(16)));
+                res_r[i] = uyvy_to_rgb_comp_neon(y, v, 14688, u, 0);
+                res_g[i] = uyvy_to_rgb_comp_neon(y, v, -4375, u, -1745);
+                res_b[i] = uyvy_to_rgb_comp_neon(y, u, 17326, v, 0);
+        }
+        *r = vzip_u8(res_r[0], res_r[1]);
+        *g = vzip_u8(res_g[0], res_g[1]);
+        *b = vzip_u8(res_b[0], res_b[1]);
+}
+
+/**
+ * @brief Converts UYVY to RGB using NEON.
+ * There can be some inaccuracies due to the use of integer arithmetic
+ * @copydetails vc_copylinev210
+ */
+static void vc_copylineUYVYtoRGB_NEON(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        for ( ; dst_len >= 48; dst_len -= 48) {
+                uint8x8x2_t r, g, b;
+                uyvy_to_rgb_neon(src, &r, &g, &b);
+                for (int i = 0; i < 2; ++i) {
+                        uint8x8x3_t out = {{ r.val[i], g.val[i], b.val[i] }};
+                        vst3_u8(dst + 24 * i, out);
+                }
+                src += 32;
+                dst += 48;
+        }
+        vc_copylineUYVYtoRGB(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/**
+ * @brief Converts UYVY to RGBA using NEON.
+ * There can be some inaccuracies due to the use of integer arithmetic
+ * @copydetails vc_copylinev210
+ */
+static void vc_copylineUYVYtoRGBA_NEON(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        if (rshift == 0 && gshift == 8 && bshift == 16) {
+                for ( ; dst_len >= 64; dst_len -= 64) {
+                        uint8x8x2_t r, g, b;
+                        uyvy_to_rgb_neon(src, &r, &g, &b);
+                        for (int i = 0; i < 2; ++i) {
+                                uint8x8x4_t out = {{ r.val[i], g.val[i], b.val[i], vdup_n_u8(0xFF) }};
+                                vst4_u8(dst + 32 * i, out);
+                        }
+                        src += 32;
+                        dst += 64;
+                }
+        }
+        vc_copylineUYVYtoRGBA(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/// (u/2 rounded towards zero + (1<<23)) clamped to 24 bits and shifted to 8 bits, as in vc_copylineToUYVY709
+static inline uint16x4_t rgb_to_uyvy_chroma_neon(int32x4_t c)
+{
+        c = vshrq_n_s32(vaddq_s32(c, vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(c), 31))), 1);
+        c = vaddq_s32(c, vdupq_n_s32(1 << 23));
+        c = vminq_s32(vmaxq_s32(c, vdupq_n_s32(0)), vdupq_n_s32((1 << 24) - 1));
+        return vreinterpret_u16_s16(vshrn_n_s32(c, 16));
+}
+
+/**
+ * @brief Converts RGBA to UYVY using NEON.
+ * Produces the same output as vc_copylineRGBAtoUYVY().
+ * @copydetails vc_copylinev210
+ */
+static void vc_copylineRGBAtoUYVY_NEON(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        for ( ; dst_len >= 32; dst_len -= 32) {
+                uint8x16x4_t in = vld4q_u8(src);
+                uint16x8_t rgb[2][3]; // [even/odd pixel][R/G/B]
+                for (int c = 0; c < 3; ++c) {
+                        uint8x16x2_t uzp = vuzpq_u8(in.val[c], in.val[c]);
+                        rgb[0][c] = vmovl_u8(vget_low_u8(uzp.val[0]));
+                        rgb[1][c] = vmovl_u8(vget_low_u8(uzp.val[1]));
+                }
+                uint8x8_t y[2];
+                for (int i = 0; i < 2; ++i) {
+                        uint32x4_t lo = vmull_n_u16(vget_low_u16(rgb[i][0]), 11993);
+                        lo = vmlal_n_u16(lo, vget_low_u16(rgb[i][1]), 40239);
+                        lo = vmlal_n_u16(lo, vget_low_u16(rgb[i][2]), 4063);
+                        uint32x4_t hi = vmull_n_u16(vget_high_u16(rgb[i][0]), 11993);
+                        hi = vmlal_n_u16(hi, vget_high_u16(rgb[i][1]), 40239);
+                        hi = vmlal_n_u16(hi, vget_high_u16(rgb[i][2]), 4063);
+                        lo = vaddq_u32(lo, vdupq_n_u32(1 << 20));
+                        hi = vaddq_u32(hi, vdupq_n_u32(1 << 20));
+                        y[i] = vmovn_u16(vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16)));
+                }
+                int16x8_t sum[3];
+                for (int c = 0; c < 3; ++c) {
+                        sum[c] = vreinterpretq_s16_u16(vaddq_u16(rgb[0][c], rgb[1][c]));
+                }
+                int32x4_t u_lo = vmull_n_s16(vget_low_s16(sum[0]), -6619);
+                u_lo = vmlal_n_s16(u_lo, vget_low_s16(sum[1]), -22151);
+                u_lo = vmlal_n_s16(u_lo, vget_low_s16(sum[2]), 28770);
+                int32x4_t u_hi = vmull_n_s16(vget_high_s16(sum[0]), -6619);
+                u_hi = vmlal_n_s16(u_hi, vget_high_s16(sum[1]), -22151);
+                u_hi = vmlal_n_s16(u_hi, vget_high_s16(sum[2]), 28770);
+                int32x4_t v_lo = vmull_n_s16(vget_low_s16(sum[0]), 28770);
+                v_lo = vmlal_n_s16(v_lo, vget_low_s16(sum[1]), -26149);
+                v_lo = vmlal_n_s16(v_lo, vget_low_s16(sum[2]), -2621);
+                int32x4_t v_hi = vmull_n_s16(vget_high_s16(sum[0]), 28770);
+                v_hi = vmlal_n_s16(v_hi, vget_high_s16(sum[1]), -26149);
+                v_hi = vmlal_n_s16(v_hi, vget_high_s16(sum[2]), -2621);
+                uint8x8x4_t out = {{
+                        vmovn_u16(vcombine_u16(rgb_to_uyvy_chroma_neon(u_lo), rgb_to_uyvy_chroma_neon(u_hi))),
+                        y[0],
+                        vmovn_u16(vcombine_u16(rgb_to_uyvy_chroma_neon(v_lo), rgb_to_uyvy_chroma_neon(v_hi))),
+                        y[1],
+                }};
+                vst4_u8(dst, out);
+                src += 64;
+                dst += 32;
+        }
+        vc_copylineRGBAtoUYVY(dst, src, dst_len, rshift, gshift, bshift);
+}
+#endif // defined HAVE_PIXFMT_CONV_NEON
+
 struct decoder_item {
         decoder_t decoder;
         codec_t in;
@@ -2629,10 +3177,47 @@ static const struct decoder_item decoders[] = {
         { vc_copylineV210toY416,  v210,  Y416 },
 };
 
+#ifdef HAVE_PIXFMT_CONV_AVX2
+static const struct decoder_item decoders_avx2[] = {
+        { vc_copylinev210_AVX2,       v210, UYVY },
+        { vc_copylineV210toY216_AVX2, v210, Y216 },
+        { vc_copylineV210toY416_AVX2, v210, Y416 },
+        { vc_copylineUYVYtoV210_AVX2, UYVY, v210 },
+        { vc_copylineY216toV210_AVX2, Y216, v210 },
+        { vc_copyliner10ktoRG48_AVX2, R10k, RG48 },
+        { vc_copylineRG48toR10k_AVX2, RG48, R10k },
+        { vc_copylineR12LtoRG48_AVX2, R12L, RG48 },
+        { vc_copylineR12LtoRGB_AVX2,  R12L, RGB },
+        { vc_copylineRG48toR12L_AVX2, RG48, R12L },
+};
+#endif
+
+#ifdef HAVE_PIXFMT_CONV_NEON
+static const struct decoder_item decoders_neon[] = {
+        { vc_copylinev210_NEON,       v210, UYVY },
+        { vc_copylineUYVYtoV210_NEON, UYVY, v210 },
+        { vc_copylineYUYV_NEON,       YUYV, UYVY },
+        { vc_copylineYUYV_NEON,       UYVY, YUYV },
+        { vc_copylineUYVYtoRGB_NEON,  UYVY, RGB },
+        { vc_copylineUYVYtoRGBA_NEON, UYVY, RGBA },
+        { vc_copylineRGBAtoUYVY_NEON, RGBA, UYVY },
+};
+#endif
+
+static decoder_t find_decoder(const struct decoder_item *items, size_t count, codec_t in, codec_t out) {
+        for (size_t i = 0; i < count; ++i) {
+                if (items[i].in == in && items[i].out == out) {
+                        return items[i].decoder;
+                }
+        }
+        return NULL;
+}
+
 /**
  * Returns line decoder for specifiedn input and output codec.
  *
- * If in == out, vc_memcpy is returned.
+ * If in == out, vc_memcpy is returned. AVX2 or NEON variant is returned instead
+ * of the scalar one if available and supported by the CPU.
  */
 decoder_t get_decoder_from_to(codec_t in, codec_t out) {
         if (in == out &&
@@ -2640,13 +3225,20 @@ decoder_t get_decoder_from_to(codec_t in, codec_t out) {
                 return vc_memcpy;
         }
 
-        for (unsigned int i = 0; i < sizeof(decoders)/sizeof(struct decoder_item); ++i) {
-                if (decoders[i].in == in && decoders[i].out == out) {
-                        return decoders[i].decoder;
-                }
+        decoder_t ret = NULL;
+#ifdef HAVE_PIXFMT_CONV_AVX2
+        if (cpu_has(CPU_FEATURE_AVX2)) {
+                ret = find_decoder(decoders_avx2, sizeof decoders_avx2 / sizeof decoders_avx2[0], in, out);
         }
-
-        return NULL;
+#elif defined HAVE_PIXFMT_CONV_NEON
+        if (cpu_has(CPU_FEATURE_NEON)) {
+                ret = find_decoder(decoders_neon, sizeof decoders_neon / sizeof decoders_neon[0], in, out);
+        }
+#endif
+        if (ret != NULL) {
+                return ret;
+        }
+        return find_decoder(decoders, sizeof decoders / sizeof decoders[0], in, out);
 }
 
 // less is better
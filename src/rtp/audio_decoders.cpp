@@ -73,6 +73,7 @@
 #include <atomic>
 #include <cctype>
 #include <chrono>
+#include <cmath>
 #include <cstring>
 #include <ctime>
 #include <iomanip>
@@ -217,6 +218,7 @@ struct state_audio_decoder {
         bool muted;
 
         audio_frame2_resampler resampler;
+        audio_frame2_resampler stretcher; ///< time-stretching for the adaptive playout delay
 
         audio_playback_ctl_t audio_playback_ctl_func;
         void *audio_playback_state;
@@ -231,6 +233,7 @@ struct state_audio_decoder {
         std::atomic_uint64_t req_resample_to{0}; // hi 32 - numerator; lo 32 - denominator
 };
 
+constexpr int ADEC_STRETCH_DEN = 256; ///< fixed-point denominator of the time-stretch rate
 constexpr double VOL_UP = 1.1;
 constexpr double VOL_DOWN = 1.0/1.1;
 
@@ -624,7 +627,7 @@ static bool audio_fec_decode(struct pbuf_audio_data *s, vector<pair<vector<char>
         return true;
 }
 
-int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_stats *)
+int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_stats *stats)
 {
         struct pbuf_audio_data *s = (struct pbuf_audio_data *) pbuf_data;
         struct state_audio_decoder *decoder = s->decoder;
@@ -778,8 +781,14 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                 return FALSE;
         }
 
+        // Time-stretch requested by the adaptive playout buffer is applied only if a resampler is available,
+        // otherwise the frame is played unstretched (the delay change then manifests as a tiny gap/overlap).
+        double stretch = stats->playout_stretch > 0.0 ? stats->playout_stretch : 1.0;
+#if !defined HAVE_SOXR && !defined HAVE_SPEEXDSP
+        stretch = 1.0;
+#endif
         // Perform a variable rate resample if any output device has requested it
-        if (decoder->req_resample_to != 0 || s->buffer.sample_rate != decompressed.get_sample_rate()) {
+        if (decoder->req_resample_to != 0 || stretch != 1.0 || s->buffer.sample_rate != decompressed.get_sample_rate()) {
                 int resampler_bps = decoder->resampler.align_bps(decompressed.get_bps());
                 if (resampler_bps <= 0) {
                         return FALSE;
@@ -788,17 +797,23 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                         decompressed.change_bps(resampler_bps);
                 }
                 if (decoder->req_resample_to != 0) {
-                        auto [ret, remainder] = decompressed.resample_fake(decoder->resampler, decoder->req_resample_to >> ADEC_CH_RATE_SHIFT, decoder->req_resample_to & ((1LLU << ADEC_CH_RATE_SHIFT) - 1));
+                        auto [ret, remainder] = decompressed.resample_fake(decoder->resampler, llround((decoder->req_resample_to >> ADEC_CH_RATE_SHIFT) * stretch), decoder->req_resample_to & ((1LLU << ADEC_CH_RATE_SHIFT) - 1));
                         if (!ret) {
                                 LOG(LOG_LEVEL_INFO) << MOD_NAME << "You may try to set different sampling on sender.\n";
                                 return FALSE;
                         }
                         decoder->resample_remainder = std::move(remainder);
                 } else {
-                        if (!decompressed.resample(decoder->resampler, s->buffer.sample_rate)) {
+                        if (s->buffer.sample_rate != decompressed.get_sample_rate() && !decompressed.resample(decoder->resampler, s->buffer.sample_rate)) {
                                 LOG(LOG_LEVEL_INFO) << MOD_NAME << "You may try to set different sampling on sender.\n";
                                 return FALSE;
                         }
+                        if (stretch != 1.0) {
+                                auto [ret, remainder] = decompressed.resample_fake(decoder->stretcher, llround(decompressed.get_sample_rate() * ADEC_STRETCH_DEN * stretch), ADEC_STRETCH_DEN);
+                                if (!ret) {
+                                        return FALSE;
+                                }
+                        }
                 }
         }
 
@@ -859,7 +874,9 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                         rms_dbfs1 = 20 * log(rms) / log(10);
                         peak_dbfs1 = 20 * log(peak) / log(10);
                 }
-                control_report_stats(decoder->control, static_cast<ostringstream&&>(ostringstream() << "ARECV volrms0 " << rms_dbfs0 << " volpeak0 " << peak_dbfs0 << " volrms1 " << rms_dbfs1 << " volpeak1 " << peak_dbfs1).str());
+                const struct control_stat_field fields[] = { { "volrms0", rms_dbfs0 }, { "volpeak0", peak_dbfs0 },
+                        { "volrms1", rms_dbfs1 }, { "volpeak1", peak_dbfs1 } };
+                control_report_stats_fields(decoder->control, "ARECV", fields, sizeof fields / sizeof fields[0]);
         }
 
         double seconds;
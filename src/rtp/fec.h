@@ -39,6 +39,7 @@
 #define FEC_H_
 
 #include "audio/types.h"
+#include "tv.h"
 #include "types.h"
 
 #ifdef __cplusplus
@@ -63,6 +64,15 @@ struct fec {
         virtual bool decode(char *in, int in_len, char **out, int *out_len,
                         const std::map<int, int> &) = 0;
         virtual ~fec() {}
+        /// @returns time (get_time_in_ns()) until which the video frames held back by
+        ///          encode() are to be sent with flush(), 0 if there are none
+        virtual time_ns_t flush_deadline() const { return 0; }
+        /// @returns encoded held back video frames, empty if there are none
+        virtual std::shared_ptr<video_frame> flush() { return {}; }
+
+        /// frames aggregated in the next encoded video block, written to the buffer
+        /// index of the protected video header (0 - a single frame), see fec_group.h
+        unsigned frame_group = 0;
 
         static fec *create_from_config(const char *str) noexcept;
         static fec *create_from_desc(struct fec_desc) noexcept;
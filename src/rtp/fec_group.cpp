@@ -0,0 +1,224 @@
+/**
+ * @file   rtp/fec_group.cpp
+ * @brief  FEC blocks spanning several consecutive video frames
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "debug.h"
+#include "host.h"
+#include "rtp/fec_group.h"
+#include "rtp/rtp_callback.h"
+#include "transmit.h"
+#include "utils/macros.h"
+#include "video.h"
+
+#define DEFAULT_MAX_BYTES 50000
+#define DEFAULT_FPS 25 ///< for the flush deadline if frame rate is unknown
+#define MOD_NAME "[FEC group] "
+
+using std::min;
+using std::pair;
+using std::shared_ptr;
+using std::vector;
+
+ADD_TO_PARAM("fec-frame-group", "* fec-frame-group=<frames>[/<bytes>]\n"
+                "  Protect up to <frames> consecutive video frames smaller than <bytes>\n"
+                "  (default " TOSTRING(DEFAULT_MAX_BYTES) ") with a single FEC block. Adds up to <frames>-1\n"
+                "  frame intervals of latency, the receiver paces the frames out. If the source stalls\n"
+                "  (or its rate is lower than the nominal), the held frames are sent <frames>-1/2\n"
+                "  nominal frame intervals after the first one.\n");
+
+fec *fec_frame_group::create(fec *inner) noexcept
+{
+        const char *cfg = get_commandline_param("fec-frame-group");
+        if (inner == nullptr || cfg == nullptr) {
+                return inner;
+        }
+        char *end = nullptr;
+        unsigned long frames = strtoul(cfg, &end, 10);
+        unsigned long long bytes = DEFAULT_MAX_BYTES;
+        if (*end == '/') {
+                bytes = strtoull(end + 1, &end, 10);
+        }
+        if (*end != '\0' || frames < 2 || frames > FEC_GROUP_MAX_FRAMES || bytes == 0) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME "Wrong configuration \"" << cfg << "\", frame count must be in range [2, "
+                        << FEC_GROUP_MAX_FRAMES << "]!\n";
+                delete inner;
+                return nullptr;
+        }
+        LOG(LOG_LEVEL_INFO) << MOD_NAME "Protecting up to " << frames << " frames smaller than " << bytes << " B by one block.\n";
+        return new fec_frame_group(inner, frames, bytes);
+}
+
+fec_frame_group::fec_frame_group(fec *inner, unsigned max_frames, size_t max_bytes)
+        : m_inner(inner), m_max_frames(max_frames), m_max_bytes(max_bytes)
+{
+        assert(max_frames >= 2 && max_frames <= FEC_GROUP_MAX_FRAMES);
+}
+
+fec_frame_group::~fec_frame_group()
+{
+        delete m_inner;
+}
+
+/**
+ * Holds the frame back until there is enough of them to form a block. The
+ * pending frames are flushed (one block per call) if the frame cannot extend
+ * the group, a frame that is not worth delaying is encoded on its own.
+ *
+ * @returns the frame to be sent for this call, NULL if the frame was held back
+ */
+shared_ptr<video_frame> fec_frame_group::encode(shared_ptr<video_frame> frame)
+{
+        shared_ptr<video_frame> ret;
+        if (m_pending_count > 0 && (frame->mem_location != CPU_MEM || m_pending_bytes >= m_max_bytes
+                                || !video_desc_eq(video_desc_from_frame(m_pending_meta.get()),
+                                        video_desc_from_frame(frame.get())))) {
+                ret = flush();
+        }
+        if (frame->mem_location != CPU_MEM) {
+                if (ret) {
+                        LOG(LOG_LEVEL_WARNING) << MOD_NAME "Dropping a device memory frame following the held ones.\n";
+                        return ret;
+                }
+                return m_inner->encode(frame);
+        }
+        if (!ret && m_pending_count == 0 && vf_get_data_len(frame.get()) >= m_max_bytes) {
+                return m_inner->encode(frame);
+        }
+        append(frame.get());
+        if (!ret && (m_pending_count >= m_max_frames || m_pending_bytes >= m_max_bytes)) {
+                ret = flush();
+        }
+        return ret;
+}
+
+void fec_frame_group::append(struct video_frame *frame)
+{
+        if (m_pending_count == 0) {
+                m_pending_meta = shared_ptr<video_frame>(vf_alloc_desc(video_desc_from_frame(frame)), vf_free);
+                vf_copy_metadata(m_pending_meta.get(), frame);
+                m_pending.assign(frame->tile_count, {});
+                // half an interval of slack not to race with the frame completing the group
+                const double fps = frame->fps > 0 ? frame->fps : DEFAULT_FPS;
+                m_flush_deadline = get_time_in_ns() + (time_ns_t) ((m_max_frames - 0.5) * NS_IN_SEC / fps);
+        }
+        for (unsigned i = 0; i < frame->tile_count; ++i) {
+                video_payload_hdr_t hdr{};
+                format_video_header(frame, i, 0, hdr);
+                m_pending[i].insert(m_pending[i].end(), (char *) hdr, (char *) hdr + sizeof hdr);
+                m_pending[i].insert(m_pending[i].end(), frame->tiles[i].data,
+                                frame->tiles[i].data + frame->tiles[i].data_len);
+        }
+        m_pending_count += 1;
+        m_pending_bytes += vf_get_data_len(frame);
+}
+
+time_ns_t fec_frame_group::flush_deadline() const
+{
+        return m_pending_count > 0 ? m_flush_deadline : 0;
+}
+
+/**
+ * Encodes the held frames as a block (called also by encode() if the frame
+ * cannot extend the group).
+ */
+shared_ptr<video_frame> fec_frame_group::flush()
+{
+        if (m_pending_count == 0) {
+                return {};
+        }
+        // a single frame is sent as an ordinary one (without its record header)
+        const size_t skip = m_pending_count == 1 ? sizeof(video_payload_hdr_t) : 0;
+        shared_ptr<video_frame> group(vf_alloc_desc(video_desc_from_frame(m_pending_meta.get())), vf_free);
+        vf_copy_metadata(group.get(), m_pending_meta.get());
+        group->callbacks.data_deleter = vf_data_deleter;
+        for (unsigned i = 0; i < group->tile_count; ++i) {
+                group->tiles[i].data_len = m_pending[i].size() - skip;
+                group->tiles[i].data = (char *) malloc(group->tiles[i].data_len);
+                memcpy(group->tiles[i].data, m_pending[i].data() + skip, group->tiles[i].data_len);
+        }
+
+        m_inner->frame_group = m_pending_count == 1 ? 0 : m_pending_count;
+        shared_ptr<video_frame> ret = m_inner->encode(group);
+        m_inner->frame_group = 0;
+
+        m_pending_count = 0;
+        m_pending_bytes = 0;
+        m_pending_meta.reset();
+        return ret;
+}
+
+audio_frame2 fec_frame_group::encode(audio_frame2 const &frame)
+{
+        return m_inner->encode(frame);
+}
+
+bool fec_frame_group::decode(char *in, int in_len, char **out, int *out_len,
+                const std::map<int, int> &packets)
+{
+        return m_inner->decode(in, in_len, out, out_len, packets);
+}
+
+unsigned fec_frame_group_count(const uint32_t *hdr)
+{
+        unsigned count = ntohl(hdr[0]) & 0x3fffffU;
+        return count >= 2 && count <= FEC_GROUP_MAX_FRAMES ? count : 0;
+}
+
+vector<pair<char *, int>> fec_frame_group_split(char *data, int len, unsigned count)
+{
+        vector<pair<char *, int>> ret(count, { nullptr, 0 });
+        for (unsigned i = 0; i < count && len >= (int) sizeof(video_payload_hdr_t); ++i) {
+                video_payload_hdr_t hdr;
+                memcpy(&hdr, data, sizeof hdr);
+                int rec_len = (int) min<long long>(sizeof hdr + (long long) ntohl(hdr[2]), len);
+                ret[i] = { data, rec_len };
+                data += rec_len;
+                len -= rec_len;
+        }
+        return ret;
+}
+
+/* vim: set expandtab sw=8: */
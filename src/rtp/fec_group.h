@@ -0,0 +1,108 @@
+/**
+ * @file   rtp/fec_group.h
+ * @brief  FEC blocks spanning several consecutive video frames
+ *
+ * Small frames (low-bitrate compressed streams) yield FEC blocks with only a
+ * few packets that do not survive a burst loss. fec_frame_group collects up to
+ * N consecutive frames and protects them with a single block of the wrapped
+ * scheme. The frame count is carried in the buffer index of the video header
+ * protected by the FEC (0 for a plain frame), the block data are then the
+ * frame records - each its own video header followed by the data.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_FEC_GROUP_H_
+#define RTP_FEC_GROUP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "rtp/fec.h"
+
+#define FEC_GROUP_MAX_FRAMES 64
+
+struct video_frame;
+
+struct fec_frame_group : public fec {
+        /**
+         * @param inner       FEC scheme used for the blocks, the ownership is passed
+         * @param max_frames  maximal number of frames in a block (the latency cost is max_frames-1 frames)
+         * @param max_bytes   frames at least that big are not held back
+         */
+        fec_frame_group(fec *inner, unsigned max_frames, size_t max_bytes);
+        ~fec_frame_group() override;
+        std::shared_ptr<video_frame> encode(std::shared_ptr<video_frame> frame) override;
+        audio_frame2 encode(audio_frame2 const &frame) override;
+        bool decode(char *in, int in_len, char **out, int *out_len,
+                        const std::map<int, int> &packets) override;
+        time_ns_t flush_deadline() const override;
+        std::shared_ptr<video_frame> flush() override;
+
+        /// wraps inner if requested with "fec-frame-group" param, returns inner otherwise
+        static fec *create(fec *inner) noexcept;
+
+private:
+        void append(struct video_frame *frame);
+
+        fec *m_inner;
+        unsigned m_max_frames;
+        size_t m_max_bytes;
+        /// the held frames are copied, the capture and compress frame pools may be small
+        std::vector<std::vector<char>> m_pending; ///< per-tile records
+        std::shared_ptr<video_frame> m_pending_meta; ///< first held frame without data
+        unsigned m_pending_count = 0;
+        size_t m_pending_bytes = 0;
+        time_ns_t m_flush_deadline = 0; ///< the held frames are sent even if no other frame comes
+};
+
+/// @returns number of frames in a FEC-protected block with header hdr, 0 if it holds a single frame
+unsigned fec_frame_group_count(const uint32_t *hdr);
+
+/**
+ * Splits the records of a FEC-decoded frame group (the tile data following the
+ * block video header).
+ *
+ * @returns count (pointer, length) pairs, each pointing to the record video
+ *          header; a record truncated by the block end is shortened, missing
+ *          ones have length 0
+ */
+std::vector<std::pair<char *, int>> fec_frame_group_split(char *data, int len, unsigned count);
+
+#endif // RTP_FEC_GROUP_H_
+
+/* vim: set expandtab sw=8: */
@@ -0,0 +1,282 @@
+/**
+ * @file   rtp/gf256.c
+ * @brief  GF(2^8) region arithmetic used by the Reed-Solomon FEC
+ *
+ * The SIMD kernels use the split-table technique: a product c * x is
+ * looked up as lo[x & 0xF] ^ hi[x >> 4] where lo and hi are 16-entry tables
+ * precomputed for the constant c. Those fit in a single vector register and
+ * the lookup is then a byte shuffle (PSHUFB/VPSHUFB or TBL).
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined __x86_64__ || defined __i386__
+#include <immintrin.h>
+#if defined __GNUC__
+#define HAVE_GF256_SSSE3 1
+#define HAVE_GF256_AVX2 1
+#endif
+#endif
+#if defined __aarch64__ && defined __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+#include "rtp/gf256.h"
+#include "utils/cpu_features.h"
+
+#define GF_POLY 0x11D ///< x^8+x^4+x^3+x^2+1
+#define CHUNK_LEN 4096 ///< matmul block - output and 1 input chunk fit in L1
+
+static uint8_t gf_exp[2 * 255];
+static uint8_t gf_log[256];
+static uint8_t gf_mul_tab[256][256];
+static uint8_t gf_mul_lo[256][16] __attribute__((aligned(16)));
+static uint8_t gf_mul_hi[256][16] __attribute__((aligned(16)));
+
+typedef void (*addmul_t)(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+static void addmul_scalar(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        const uint8_t *tab = gf_mul_tab[c];
+        for (size_t i = 0; i < len; ++i) {
+                dst[i] ^= tab[src[i]];
+        }
+}
+
+#ifdef HAVE_GF256_SSSE3
+__attribute__((target("ssse3")))
+static void addmul_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        const __m128i lo = _mm_load_si128((const __m128i *)(const void *) gf_mul_lo[c]);
+        const __m128i hi = _mm_load_si128((const __m128i *)(const void *) gf_mul_hi[c]);
+        const __m128i mask = _mm_set1_epi8(0x0F);
+        size_t i = 0;
+        for ( ; i + 16 <= len; i += 16) {
+                __m128i s = _mm_loadu_si128((const __m128i *)(const void *)(src + i));
+                __m128i p = _mm_xor_si128(
+                                _mm_shuffle_epi8(lo, _mm_and_si128(s, mask)),
+                                _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+                __m128i d = _mm_loadu_si128((const __m128i *)(void *)(dst + i));
+                _mm_storeu_si128((__m128i *)(void *)(dst + i), _mm_xor_si128(d, p));
+        }
+        addmul_scalar(dst + i, src + i, c, len - i);
+}
+#endif // defined HAVE_GF256_SSSE3
+
+#ifdef HAVE_GF256_AVX2
+__attribute__((target("avx2")))
+static void addmul_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        const __m256i lo = _mm256_broadcastsi128_si256(
+                        _mm_load_si128((const __m128i *)(const void *) gf_mul_lo[c]));
+        const __m256i hi = _mm256_broadcastsi128_si256(
+                        _mm_load_si128((const __m128i *)(const void *) gf_mul_hi[c]));
+        const __m256i mask = _mm256_set1_epi8(0x0F);
+        size_t i = 0;
+        for ( ; i + 32 <= len; i += 32) {
+                __m256i s = _mm256_loadu_si256((const __m256i *)(const void *)(src + i));
+                __m256i p = _mm256_xor_si256(
+                                _mm256_shuffle_epi8(lo, _mm256_and_si256(s, mask)),
+                                _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+                __m256i d = _mm256_loadu_si256((const __m256i *)(void *)(dst + i));
+                _mm256_storeu_si256((__m256i *)(void *)(dst + i), _mm256_xor_si256(d, p));
+        }
+        addmul_scalar(dst + i, src + i, c, len - i);
+}
+#endif // defined HAVE_GF256_AVX2
+
+#if defined __aarch64__ && defined __ARM_NEON
+static void addmul_neon(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        const uint8x16_t lo = vld1q_u8(gf_mul_lo[c]);
+        const uint8x16_t hi = vld1q_u8(gf_mul_hi[c]);
+        const uint8x16_t mask = vdupq_n_u8(0x0F);
+        size_t i = 0;
+        for ( ; i + 16 <= len; i += 16) {
+                uint8x16_t s = vld1q_u8(src + i);
+                uint8x16_t p = veorq_u8(vqtbl1q_u8(lo, vandq_u8(s, mask)),
+                                vqtbl1q_u8(hi, vshrq_n_u8(s, 4)));
+                vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), p));
+        }
+        addmul_scalar(dst + i, src + i, c, len - i);
+}
+#endif // defined __aarch64__ && defined __ARM_NEON
+
+static addmul_t addmul_impl = addmul_scalar;
+static const char *addmul_impl_name = "scalar";
+
+static void gf256_select(void)
+{
+        addmul_impl = addmul_scalar;
+        addmul_impl_name = "scalar";
+#ifdef HAVE_GF256_SSSE3
+        if (cpu_has(CPU_FEATURE_SSSE3)) {
+                addmul_impl = addmul_ssse3;
+                addmul_impl_name = "SSSE3";
+        }
+#endif
+#ifdef HAVE_GF256_AVX2
+        if (cpu_has(CPU_FEATURE_AVX2)) {
+                addmul_impl = addmul_avx2;
+                addmul_impl_name = "AVX2";
+        }
+#endif
+#if defined __aarch64__ && defined __ARM_NEON
+        if (cpu_has(CPU_FEATURE_NEON)) {
+                addmul_impl = addmul_neon;
+                addmul_impl_name = "NEON";
+        }
+#endif
+}
+
+static void gf256_init(void) __attribute__((constructor));
+static void gf256_init(void)
+{
+        unsigned x = 1;
+        for (int i = 0; i < 255; ++i) {
+                gf_exp[i] = gf_exp[i + 255] = x;
+                gf_log[x] = i;
+                x <<= 1;
+                if (x & 0x100) {
+                        x ^= GF_POLY;
+                }
+        }
+        for (int a = 0; a < 256; ++a) {
+                for (int b = 0; b < 256; ++b) {
+                        gf_mul_tab[a][b] = a == 0 || b == 0 ? 0
+                                : gf_exp[gf_log[a] + gf_log[b]];
+                }
+                for (int i = 0; i < 16; ++i) {
+                        gf_mul_lo[a][i] = gf_mul_tab[a][i];
+                        gf_mul_hi[a][i] = gf_mul_tab[a][i << 4];
+                }
+        }
+
+        cpu_features_register(gf256_select);
+}
+
+uint8_t gf256_mul(uint8_t a, uint8_t b)
+{
+        return gf_mul_tab[a][b];
+}
+
+void gf256_addmul(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        if (c == 0) {
+                return;
+        }
+        addmul_impl(dst, src, c, len);
+}
+
+void gf256_matmul(const uint8_t *matrix, unsigned rows, unsigned cols,
+                const uint8_t *const *src, uint8_t *const *dst, size_t len)
+{
+        for (size_t off = 0; off < len; off += CHUNK_LEN) {
+                size_t n = len - off < CHUNK_LEN ? len - off : CHUNK_LEN;
+                for (unsigned r = 0; r < rows; ++r) {
+                        uint8_t *d = dst[r] + off;
+                        memset(d, 0, n);
+                        for (unsigned j = 0; j < cols; ++j) {
+                                gf256_addmul(d, src[j] + off, matrix[r * cols + j], n);
+                        }
+                }
+        }
+}
+
+int gf256_invert(uint8_t *matrix, unsigned k)
+{
+        uint8_t *inv = calloc(k, k);
+        if (inv == NULL) {
+                return -1;
+        }
+        for (unsigned i = 0; i < k; ++i) {
+                inv[i * k + i] = 1;
+        }
+
+        int ret = 0;
+        for (unsigned col = 0; col < k; ++col) {
+                unsigned p = col;
+                while (p < k && matrix[p * k + col] == 0) {
+                        p++;
+                }
+                if (p == k) {
+                        ret = -1;
+                        break;
+                }
+                if (p != col) {
+                        for (unsigned j = 0; j < k; ++j) {
+                                uint8_t tmp = matrix[p * k + j];
+                                matrix[p * k + j] = matrix[col * k + j];
+                                matrix[col * k + j] = tmp;
+                                tmp = inv[p * k + j];
+                                inv[p * k + j] = inv[col * k + j];
+                                inv[col * k + j] = tmp;
+                        }
+                }
+                uint8_t *pivot_row = matrix + col * k;
+                uint8_t *pivot_inv = inv + col * k;
+                const uint8_t *scale = gf_mul_tab[gf_exp[255 - gf_log[pivot_row[col]]]];
+                for (unsigned j = 0; j < k; ++j) {
+                        pivot_row[j] = scale[pivot_row[j]];
+                        pivot_inv[j] = scale[pivot_inv[j]];
+                }
+                for (unsigned r = 0; r < k; ++r) {
+                        uint8_t f = matrix[r * k + col];
+                        if (r == col || f == 0) {
+                                continue;
+                        }
+                        gf256_addmul(matrix + r * k, pivot_row, f, k);
+                        gf256_addmul(inv + r * k, pivot_inv, f, k);
+                }
+        }
+
+        if (ret == 0) {
+                memcpy(matrix, inv, (size_t) k * k);
+        }
+        free(inv);
+        return ret;
+}
+
+const char *gf256_impl_name(void)
+{
+        return addmul_impl_name;
+}
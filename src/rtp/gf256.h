@@ -0,0 +1,86 @@
+/**
+ * @file   rtp/gf256.h
+ * @brief  GF(2^8) region arithmetic used by the Reed-Solomon FEC
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_GF256_H_
+#define RTP_GF256_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Multiplies 2 elements of GF(2^8) with the polynomial x^8+x^4+x^3+x^2+1
+ * (the same field as used by zfec).
+ */
+uint8_t gf256_mul(uint8_t a, uint8_t b);
+
+/**
+ * Computes dst[i] ^= c * src[i] for len bytes using the fastest kernel
+ * available on the running CPU (AVX2, SSSE3, NEON or a table lookup).
+ */
+void gf256_addmul(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+/**
+ * Multiplies matrix (rows x cols, row-major) by a vector of cols regions:
+ *
+ *     dst[r] = sum_j matrix[r * cols + j] * src[j]
+ *
+ * The regions are processed in L1-sized chunks so that an output chunk stays
+ * in cache while all source regions are accumulated into it. dst regions
+ * must not overlap any of src.
+ */
+void gf256_matmul(const uint8_t *matrix, unsigned rows, unsigned cols,
+                const uint8_t *const *src, uint8_t *const *dst, size_t len);
+
+/**
+ * Inverts a k x k matrix in place (Gauss-Jordan elimination).
+ * @retval 0  on success
+ * @retval -1 if the matrix is singular
+ */
+int gf256_invert(uint8_t *matrix, unsigned k);
+
+/// @returns name of the addmul kernel selected for this CPU
+const char *gf256_impl_name(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTP_GF256_H_
@@ -69,6 +69,7 @@
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
 #include "transmit.h"
+#include "utils/worker.h"
 #include "video.h"
 
 using namespace std;
@@ -223,7 +224,9 @@ void ldgm::init(unsigned int k, unsigned int m, unsigned int c, unsigned int see
 
                 }
         } else {
-                m_coding_session = unique_ptr<LDGM_session>(new LDGM_session_cpu());
+                auto *cpu_session = new LDGM_session_cpu();
+                cpu_session->set_parallel_for(task_run_parallel_for);
+                m_coding_session = unique_ptr<LDGM_session>(cpu_session);
         }
 
         set_params(k, m, c, seed);
@@ -403,11 +406,16 @@ shared_ptr<video_frame> ldgm::encode(shared_ptr<video_frame> tx_frame)
 
         for (unsigned int i = 0; i < tx_frame->tile_count; ++i) {
                 video_payload_hdr_t video_hdr;
-                format_video_header(tx_frame.get(), i, 0, video_hdr);
+                format_video_header(tx_frame.get(), i, frame_group, video_hdr);
 
                 int out_size;
                 char *output = m_coding_session->encode_hdr_frame((char *) video_hdr, sizeof(video_hdr),
-                                tx_frame->tiles[i].data, tx_frame->tiles[i].data_len, &out_size);
+                                tx_frame->tiles[i].data, tx_frame->tiles[i].data_len, &out_size,
+                                tx_frame->mem_location == CUDA_MEM);
+                if (output == nullptr) {
+                        LOG(LOG_LEVEL_ERROR) << "LDGM: Cannot encode frame" << (tx_frame->mem_location == CUDA_MEM ? " (CUDA_MEM frames need ldgm-device=GPU)" : "") << "!\n";
+                        return {};
+                }
 
                 out->tiles[i].data = output;
                 out->tiles[i].data_len = out_size;
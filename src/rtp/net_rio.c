@@ -0,0 +1,343 @@
+/**
+ * @file   rtp/net_rio.c
+ * @brief  Windows Registered I/O (RIO) datagram backend for socket_udp
+ *
+ * Receives are kept posted to a ring of slots of a registered buffer, the
+ * completions are dequeued in batches (one event wait only if the completion
+ * queue is empty). Sends are copied to free slots of another registered buffer
+ * and, inside udp_async_start()/udp_async_wait(), deferred and committed at
+ * once.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <mswsock.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#include "debug.h"
+#include "rtp/net_rio.h"
+#include "utils/macros.h"
+
+#define MOD_NAME "[RTP RIO] "
+#define RIO_DEQUEUE_MAX 64
+#define RIO_SLOT_ALIGN 64
+
+struct rio_socket {
+        RIO_EXTENSION_FUNCTION_TABLE f;
+        RIO_RQ rq;
+        RIO_CQ rx_cq;
+        RIO_CQ tx_cq;
+        HANDLE rx_event;
+        pthread_mutex_t lock; ///< RIO request queue isn't thread-safe (shared by RX and TX with a single socket)
+        int slot_size;
+
+        /// slot i data at i * slot_size, its address at depth * slot_size + i * sizeof(SOCKADDR_INET)
+        char *rx_area;
+        RIO_BUFFERID rx_buf;
+        int rx_depth;
+
+        char *tx_area;
+        RIO_BUFFERID tx_buf;
+        int tx_depth;
+        int *tx_free; ///< stack of free send slots
+        int tx_free_count;
+        int tx_deferred; ///< sends posted with RIO_MSG_DEFER not yet committed
+};
+
+static RIO_BUF rio_slot_data(RIO_BUFFERID id, int slot, int slot_size, int len)
+{
+        return (RIO_BUF){ id, (ULONG) slot * slot_size, (ULONG) len };
+}
+
+static RIO_BUF rio_slot_addr(RIO_BUFFERID id, int slot, int slot_size, int depth)
+{
+        return (RIO_BUF){ id, (ULONG) depth * slot_size + (ULONG) slot * sizeof(SOCKADDR_INET), sizeof(SOCKADDR_INET) };
+}
+
+static char *rio_alloc_area(int depth, int slot_size, RIO_EXTENSION_FUNCTION_TABLE *f, RIO_BUFFERID *id)
+{
+        DWORD size = (DWORD) depth * (slot_size + sizeof(SOCKADDR_INET));
+        char *area = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (area == NULL) {
+                return NULL;
+        }
+        if ((*id = f->RIORegisterBuffer(area, size)) == RIO_INVALID_BUFFERID) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "RIORegisterBuffer failed: %d\n", WSAGetLastError());
+                VirtualFree(area, 0, MEM_RELEASE);
+                return NULL;
+        }
+        return area;
+}
+
+/// @pre r->lock is held
+static bool rio_post_recv(struct rio_socket *r, int slot)
+{
+        RIO_BUF data = rio_slot_data(r->rx_buf, slot, r->slot_size, r->slot_size);
+        RIO_BUF addr = rio_slot_addr(r->rx_buf, slot, r->slot_size, r->rx_depth);
+        if (!r->f.RIOReceiveEx(r->rq, &data, 1, NULL, &addr, NULL, NULL, 0, (PVOID)(intptr_t) slot)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "RIOReceiveEx failed: %d\n", WSAGetLastError());
+                return false;
+        }
+        return true;
+}
+
+struct rio_socket *rio_socket_init(SOCKET fd, int rx_depth, int tx_depth, int slot_size)
+{
+        struct rio_socket *r = calloc(1, sizeof *r);
+        r->rq = RIO_INVALID_RQ;
+        r->rx_cq = r->tx_cq = RIO_INVALID_CQ;
+        r->rx_buf = r->tx_buf = RIO_INVALID_BUFFERID;
+        r->rx_depth = rx_depth;
+        r->tx_depth = tx_depth;
+        r->slot_size = (slot_size + RIO_SLOT_ALIGN - 1) / RIO_SLOT_ALIGN * RIO_SLOT_ALIGN;
+        pthread_mutex_init(&r->lock, NULL);
+
+        GUID fn_table_id = WSAID_MULTIPLE_RIO;
+        DWORD bytes = 0;
+        if (WSAIoctl(fd, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER, &fn_table_id, sizeof fn_table_id,
+                                &r->f, sizeof r->f, &bytes, NULL, NULL) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Registered I/O not available: %d\n", WSAGetLastError());
+                goto error;
+        }
+
+        r->rx_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+        RIO_NOTIFICATION_COMPLETION rx_notify = { .Type = RIO_EVENT_COMPLETION };
+        rx_notify.Event.EventHandle = r->rx_event;
+        rx_notify.Event.NotifyReset = FALSE;
+        r->rx_cq = r->f.RIOCreateCompletionQueue(MAX(rx_depth, 1), &rx_notify);
+        r->tx_cq = r->f.RIOCreateCompletionQueue(MAX(tx_depth, 1), NULL); // polled
+        if (r->rx_cq == RIO_INVALID_CQ || r->tx_cq == RIO_INVALID_CQ) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "RIOCreateCompletionQueue failed: %d\n", WSAGetLastError());
+                goto error;
+        }
+        r->rq = r->f.RIOCreateRequestQueue(fd, MAX(rx_depth, 1), 1, MAX(tx_depth, 1), 1, r->rx_cq, r->tx_cq, NULL);
+        if (r->rq == RIO_INVALID_RQ) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "RIOCreateRequestQueue failed: %d\n", WSAGetLastError());
+                goto error;
+        }
+
+        if (rx_depth > 0) {
+                if ((r->rx_area = rio_alloc_area(rx_depth, r->slot_size, &r->f, &r->rx_buf)) == NULL) {
+                        goto error;
+                }
+                for (int i = 0; i < rx_depth; ++i) {
+                        if (!rio_post_recv(r, i)) {
+                                goto error;
+                        }
+                }
+        }
+        if (tx_depth > 0) {
+                if ((r->tx_area = rio_alloc_area(tx_depth, r->slot_size, &r->f, &r->tx_buf)) == NULL) {
+                        goto error;
+                }
+                r->tx_free = malloc(tx_depth * sizeof r->tx_free[0]);
+                for (int i = 0; i < tx_depth; ++i) {
+                        r->tx_free[i] = i;
+                }
+                r->tx_free_count = tx_depth;
+        }
+
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using registered I/O (RX depth %d, TX depth %d).\n", rx_depth, tx_depth);
+        return r;
+
+error:
+        rio_socket_done(r);
+        return NULL;
+}
+
+void rio_socket_done(struct rio_socket *r)
+{
+        if (r == NULL) {
+                return;
+        }
+        // request queue is freed with the socket
+        if (r->rx_cq != RIO_INVALID_CQ) {
+                r->f.RIOCloseCompletionQueue(r->rx_cq);
+        }
+        if (r->tx_cq != RIO_INVALID_CQ) {
+                r->f.RIOCloseCompletionQueue(r->tx_cq);
+        }
+        if (r->rx_buf != RIO_INVALID_BUFFERID) {
+                r->f.RIODeregisterBuffer(r->rx_buf);
+        }
+        if (r->tx_buf != RIO_INVALID_BUFFERID) {
+                r->f.RIODeregisterBuffer(r->tx_buf);
+        }
+        if (r->rx_area != NULL) {
+                VirtualFree(r->rx_area, 0, MEM_RELEASE);
+        }
+        if (r->tx_area != NULL) {
+                VirtualFree(r->tx_area, 0, MEM_RELEASE);
+        }
+        if (r->rx_event != NULL) {
+                CloseHandle(r->rx_event);
+        }
+        pthread_mutex_destroy(&r->lock);
+        free(r->tx_free);
+        free(r);
+}
+
+int rio_recv(struct rio_socket *r, struct rio_msg *msgs, int count, int timeout_ms)
+{
+        RIORESULT results[RIO_DEQUEUE_MAX];
+        count = MIN(count, RIO_DEQUEUE_MAX);
+        ULONG n = r->f.RIODequeueCompletion(r->rx_cq, results, count);
+        if (n == 0) {
+                int ret = r->f.RIONotify(r->rx_cq);
+                if (ret != ERROR_SUCCESS && ret != WSAEALREADY) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "RIONotify failed: %d\n", ret);
+                        return -1;
+                }
+                if (WaitForSingleObject(r->rx_event, timeout_ms) != WAIT_OBJECT_0) {
+                        return 0;
+                }
+                n = r->f.RIODequeueCompletion(r->rx_cq, results, count);
+        }
+        if (n == RIO_CORRUPT_CQ) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "RX completion queue corrupted!\n");
+                return -1;
+        }
+
+        int filled = 0;
+        for (ULONG i = 0; i < n; ++i) {
+                int slot = (int)(intptr_t) results[i].RequestContext;
+                // errors like WSAECONNRESET (ICMP port unreachable) or empty datagrams are skipped
+                if (results[i].Status == 0 && results[i].BytesTransferred > 0) {
+                        struct rio_msg *m = &msgs[filled++];
+                        m->len = MIN((int) results[i].BytesTransferred, m->buflen);
+                        memcpy(m->buf, r->rx_area + (size_t) slot * r->slot_size, m->len);
+                        SOCKADDR_INET *src = (SOCKADDR_INET *)(void *)(r->rx_area + (size_t) r->rx_depth * r->slot_size
+                                        + slot * sizeof(SOCKADDR_INET));
+                        m->addrlen = src->si_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+                        memcpy(m->addr, src, m->addrlen);
+                }
+                pthread_mutex_lock(&r->lock);
+                bool posted = rio_post_recv(r, slot);
+                pthread_mutex_unlock(&r->lock);
+                if (!posted) {
+                        return -1;
+                }
+        }
+        return filled;
+}
+
+/// @pre r->lock is held
+static void rio_commit_locked(struct rio_socket *r)
+{
+        if (r->tx_deferred == 0) {
+                return;
+        }
+        if (!r->f.RIOSendEx(r->rq, NULL, 0, NULL, NULL, NULL, NULL, RIO_MSG_COMMIT_ONLY, NULL)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "RIOSendEx commit failed: %d\n", WSAGetLastError());
+        }
+        r->tx_deferred = 0;
+}
+
+/// returns slots of completed sends to the free stack, waits for at least one if wait is set
+/// @pre r->lock is held
+static bool rio_reclaim_locked(struct rio_socket *r, bool wait)
+{
+        RIORESULT results[RIO_DEQUEUE_MAX];
+        rio_commit_locked(r); // otherwise we might wait for deferred ones
+        while (1) {
+                ULONG n = r->f.RIODequeueCompletion(r->tx_cq, results, RIO_DEQUEUE_MAX);
+                if (n == RIO_CORRUPT_CQ) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "TX completion queue corrupted!\n");
+                        return false;
+                }
+                for (ULONG i = 0; i < n; ++i) {
+                        r->tx_free[r->tx_free_count++] = (int)(intptr_t) results[i].RequestContext;
+                }
+                if (n > 0 || !wait) {
+                        return true;
+                }
+                SwitchToThread();
+        }
+}
+
+int rio_send(struct rio_socket *r, const WSABUF *vec, int count, const struct sockaddr *dst, int dstlen, bool defer)
+{
+        pthread_mutex_lock(&r->lock);
+        if (r->tx_free_count == 0 && !rio_reclaim_locked(r, true)) {
+                pthread_mutex_unlock(&r->lock);
+                return -1;
+        }
+        int slot = r->tx_free[--r->tx_free_count];
+        char *data = r->tx_area + (size_t) slot * r->slot_size;
+        int len = 0;
+        for (int i = 0; i < count; ++i) {
+                if (len + (int) vec[i].len > r->slot_size) {
+                        r->tx_free[r->tx_free_count++] = slot;
+                        pthread_mutex_unlock(&r->lock);
+                        WSASetLastError(WSAEMSGSIZE);
+                        return -1;
+                }
+                memcpy(data + len, vec[i].buf, vec[i].len);
+                len += vec[i].len;
+        }
+        SOCKADDR_INET *addr = (SOCKADDR_INET *)(void *)(r->tx_area + (size_t) r->tx_depth * r->slot_size + slot * sizeof(SOCKADDR_INET));
+        memset(addr, 0, sizeof *addr);
+        memcpy(addr, dst, MIN((size_t) dstlen, sizeof *addr));
+
+        RIO_BUF data_buf = rio_slot_data(r->tx_buf, slot, r->slot_size, len);
+        RIO_BUF addr_buf = rio_slot_addr(r->tx_buf, slot, r->slot_size, r->tx_depth);
+        if (!r->f.RIOSendEx(r->rq, &data_buf, 1, NULL, &addr_buf, NULL, NULL, defer ? RIO_MSG_DEFER : 0, (PVOID)(intptr_t) slot)) {
+                r->tx_free[r->tx_free_count++] = slot;
+                pthread_mutex_unlock(&r->lock);
+                return -1;
+        }
+        if (defer) {
+                r->tx_deferred += 1;
+        }
+        pthread_mutex_unlock(&r->lock);
+        return 0;
+}
+
+void rio_commit(struct rio_socket *r)
+{
+        pthread_mutex_lock(&r->lock);
+        rio_commit_locked(r);
+        pthread_mutex_unlock(&r->lock);
+}
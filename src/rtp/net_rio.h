@@ -0,0 +1,99 @@
+/**
+ * @file   rtp/net_rio.h
+ * @brief  Windows Registered I/O (RIO) datagram backend for socket_udp
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_NET_RIO_H_
+#define RTP_NET_RIO_H_
+
+#include <stdbool.h>
+#include <winsock2.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rio_socket;
+struct sockaddr;
+
+/// datagram passed to rio_recv()
+struct rio_msg {
+        char *buf;
+        int buflen;
+        int len;               ///< [out] datagram length
+        struct sockaddr *addr; ///< [out] source address (sockaddr_storage sized)
+        int addrlen;           ///< [out]
+};
+
+/**
+ * Sets up RIO request queue of the socket. The socket must have been created
+ * with WSA_FLAG_REGISTERED_IO.
+ *
+ * Datagrams are received to/sent from buffers registered with RIO, so one
+ * copy from/to the caller's memory is made but there is no per-packet syscall
+ * or buffer probing/locking by the kernel.
+ *
+ * @param rx_depth   number of receives kept posted (0 - not used for receiving)
+ * @param tx_depth   number of sends that may be in flight (0 - not used for sending)
+ * @param slot_size  maximal datagram size
+ * @returns NULL if RIO is not available (pre-Windows 8) or on error
+ */
+struct rio_socket *rio_socket_init(SOCKET fd, int rx_depth, int tx_depth, int slot_size);
+/// @pre the socket is already closed (outstanding requests are cancelled)
+void rio_socket_done(struct rio_socket *r);
+/**
+ * Waits up to timeout_ms for datagrams and copies up to count of them to msgs.
+ *
+ * @returns number of filled messages, -1 on error
+ */
+int rio_recv(struct rio_socket *r, struct rio_msg *msgs, int count, int timeout_ms);
+/**
+ * Copies the datagram gathered from vec to a free send slot (waiting for
+ * completion of previous sends if there is none) and posts it.
+ *
+ * @param defer  do not pass the send to the kernel until rio_commit() (or
+ *               until the slots are exhausted) so that the whole batch takes
+ *               one syscall
+ * @returns 0 on success, -1 on error
+ */
+int rio_send(struct rio_socket *r, const WSABUF *vec, int count, const struct sockaddr *dst, int dstlen, bool defer);
+/// passes sends posted with defer to the kernel
+void rio_commit(struct rio_socket *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTP_NET_RIO_H_
@@ -50,6 +50,7 @@
 
 #include <pthread.h>
 #include <stdalign.h>
+#include <stdatomic.h>
 
 #include "debug.h"
 #include "host.h"
@@ -57,6 +58,12 @@
 #include "compat/platform_pipe.h"
 #include "compat/vsnprintf.h"
 #include "net_udp.h"
+#ifdef WIN32
+#include "net_rio.h"
+#endif
+#ifdef HAVE_XDP
+#include "net_xdp.h"
+#endif
 #include "rtp.h"
 #include "utils/list.h"
 #include "utils/macros.h"
@@ -69,10 +76,53 @@
 #include "addrinfo.h"
 #endif
 
+#ifdef HAVE_SENDMMSG
+#include <netinet/udp.h>
+#endif
+#ifdef HAVE_LINUX
+#include <linux/filter.h>     // struct sock_filter
+#include <linux/net_tstamp.h> // struct sock_txtime
+#endif
+
 #define DEFAULT_MAX_UDP_READER_QUEUE_LEN (1920/3*8*1080/1152) //< 10-bit FullHD frame divided by 1280 MTU packets (minus headers)
+#define DEFAULT_UDP_SEND_BATCH 32 ///< packets queued by udp_sendv() in async mode before flushing with sendmmsg()
+#define UDP_SEND_BATCH_MAX 1024   ///< sendmmsg() vlen limit (UIO_MAXIOV)
+#define UDP_SENDV_MAX_IOV 3       ///< RTP header + payload header + data (see rtp_send_data_hdr())
+#define UDP_GSO_MAX_SEGS 64       ///< UDP_MAX_SEGMENTS in older kernels
+#define UDP_GSO_MAX_LEN 65000     ///< GSO super-packet must fit in one IP datagram
+#define DEFAULT_UDP_RECV_BATCH 64 ///< max datagrams read by one recvmmsg() call in udp_reader
+#define UDP_RX_READERS_MAX 64     ///< max SO_REUSEPORT sockets (and reader threads) of one receiving socket
+#define UDP_BUF_SIZE_MIN (256 * 1024)
+#define UDP_BUF_SIZE_MAX (512 * 1024 * 1024)
+#ifdef SO_RXQ_OVFL
+#define UDP_RXQ_OVFL_CMSG_SPACE CMSG_SPACE(sizeof(uint32_t))
+#else
+#define UDP_RXQ_OVFL_CMSG_SPACE 0
+#endif
+#ifdef HAVE_LINUX
+#define UDP_RX_TS_CMSG_SPACE CMSG_SPACE(3 * sizeof(struct timespec)) ///< struct scm_timestamping (SCM_TIMESTAMPNS is smaller)
+#else
+#define UDP_RX_TS_CMSG_SPACE 0
+#endif
+#define UDP_RX_CMSG_SPACE (UDP_RXQ_OVFL_CMSG_SPACE + UDP_RX_TS_CMSG_SPACE)
+#define UDP_RX_TS_MAX_SKEW NS_IN_SEC ///< RX timestamps differing more from the system time are ignored (unsynchronized NIC clock)
+#define UDP_TXTIME_CMSG_SPACE CMSG_SPACE(sizeof(uint64_t))
+#define DEFAULT_UDP_RIO_DEPTH 1024 ///< receives kept posted (and sends in flight) with udp-rio
+#define UDP_RIO_RECV_BATCH 64      ///< max completions processed at once by udp_reader_rio()
+#define UDP_RIO_POLL_MS 100        ///< udp_reader_rio() exit check period
 
 static int resolve_address(socket_udp *s, const char *addr, uint16_t tx_port);
 static void *udp_reader(void *arg);
+#ifdef HAVE_RECVMMSG
+static void *udp_reader_mmsg(void *arg);
+#endif
+#ifdef WIN32
+static void *udp_reader_rio(void *arg);
+#endif
+struct item;
+struct socket_udp_local;
+static int udp_queue_size(struct socket_udp_local *l);
+static struct item udp_queue_pop(struct socket_udp_local *l);
 
 #define IPv4	4
 #define IPv6	6
@@ -135,6 +185,47 @@ struct item {
 #define ALIGNED_SOCKADDR_STORAGE_OFF ((RTP_MAX_PACKET_LEN + alignof(struct sockaddr_storage) - 1) / alignof(struct sockaddr_storage) * alignof(struct sockaddr_storage))
 #define ALIGNED_ITEM_OFF (((ALIGNED_SOCKADDR_STORAGE_OFF + sizeof(struct sockaddr_storage)) + alignof(struct item) - 1) / alignof(struct item) * alignof(struct item))
 
+/**
+ * Bounded single-producer (udp_reader) single-consumer (udp_recvfrom_data)
+ * queue of received packets. The mutex and condition variables of the socket
+ * are used only to sleep when the ring is empty (consumer) or full (producer).
+ */
+struct packet_ring {
+        struct item *slots;
+        unsigned int capacity; ///< max_packets + 1 (one slot is kept empty)
+        alignas(64) atomic_uint head; ///< next slot to read (written by consumer)
+        alignas(64) atomic_uint tail; ///< next slot to write (written by producer)
+        atomic_bool producer_waiting;
+};
+
+/**
+ * Receiving thread. With udp-rx-readers, each reader has its own socket of
+ * the SO_REUSEPORT group bound to the receiving port and its own ring, the
+ * consumer merges the rings.
+ */
+struct udp_rx_reader {
+        socket_udp *s;
+        fd_t fd;                 ///< rx_fd for the first reader
+        struct packet_ring *ring; ///< NULL with locked_queue
+        int cpu;                 ///< CPU the thread is pinned to, -1 if not pinned
+        pthread_t thread_id;
+        atomic_uint kernel_drops; ///< last SO_RXQ_OVFL value of fd (cumulative drops of the socket)
+        bool ts_skew_warned;
+};
+
+enum udp_rx_timestamps {
+        UDP_RX_TS_NONE,
+        UDP_RX_TS_SW, ///< SO_TIMESTAMPNS - kernel software timestamp
+        UDP_RX_TS_HW, ///< SO_TIMESTAMPING - NIC timestamp, software one as a fallback
+};
+
+enum udp_rx_steer {
+        UDP_RX_STEER_HASH, ///< kernel default (hash of the 4-tuple)
+        UDP_RX_STEER_CPU,  ///< reader pinned to the CPU that processes the packet (RSS queue)
+        UDP_RX_STEER_SSRC,
+        UDP_RX_STEER_TILE, ///< UltraGrid video substream (tile) index
+};
+
 /*
  * Local part of the socket
  *
@@ -147,12 +238,24 @@ struct socket_udp_local {
         bool multithreaded;
 #ifdef WIN32
         bool is_wsa_overlapped;
+        struct rio_socket *rio_rx; ///< rx_fd registered I/O (udp-rio), used by udp_reader_rio()
+        struct rio_socket *rio_tx; ///< tx_fd registered I/O, equal to rio_rx if there is a single socket
 #endif
 
         // for multithreaded receiving
-        pthread_t thread_id;
+        struct udp_rx_reader *readers;
+        int reader_count;
+        bool locked_queue; ///< use packets list instead of lock-free ring
         struct simple_linked_list *packets;
+        struct packet_ring *rings; ///< [reader_count + 1], the last one for udp_inject_data(), NULL with locked_queue
+        unsigned int next_ring;    ///< ring to be popped next (consumer only)
+        atomic_bool consumer_waiting;
         unsigned int max_packets;
+        int recv_batch; ///< datagrams received at once by udp_reader_mmsg()
+        enum udp_rx_timestamps rx_timestamps;
+#ifdef HAVE_XDP
+        struct xdp_rx *xdp; ///< used by udp_reader_mmsg() instead of rx_fd if set
+#endif
         pthread_mutex_t lock;
         pthread_cond_t boss_cv;
         pthread_cond_t reader_cv;
@@ -161,6 +264,31 @@ struct socket_udp_local {
         fd_t should_exit_fd[2];
 };
 
+#ifdef HAVE_SENDMMSG
+/**
+ * Packets queued by udp_sendv() between udp_async_start() and udp_async_wait().
+ * Packets are sent with sendmmsg(), consecutive packets of the same size are
+ * additionally coalesced with UDP_SEGMENT (GSO) if the kernel supports it.
+ */
+struct udp_send_batch {
+        bool active;
+        int capacity;
+        int count;
+        bool gso;
+
+        struct mmsghdr *msgs;   ///< [capacity]
+        struct iovec *iov;      ///< [capacity * UDP_SENDV_MAX_IOV]
+        void **dispose_udata;   ///< [capacity]
+        char *txtime_cmsg;      ///< [capacity * UDP_TXTIME_CMSG_SPACE], used with UDP_PACING_TXTIME
+
+        // GSO aggregated messages
+        struct mmsghdr *gso_msgs; ///< [capacity]
+        struct iovec *gso_iov;    ///< [capacity * UDP_SENDV_MAX_IOV]
+        int *gso_first;           ///< index of first packet in msgs for each gso_msgs
+        char *gso_cmsg;           ///< [capacity * CMSG_SPACE(sizeof(uint16_t))]
+};
+#endif
+
 /*
  * Complete socket including remote host
  */
@@ -180,6 +308,16 @@ struct _socket_udp {
         int overlapped_max;
         int overlapped_count;
 #endif
+#ifdef HAVE_SENDMMSG
+        struct udp_send_batch *batch;
+#endif
+        enum udp_pacing pacing;
+        long pacing_interval_ns;   ///< 0 - unpaced
+        unsigned int pacing_rate;  ///< current SO_MAX_PACING_RATE (B/s)
+        uint64_t next_txtime;      ///< SO_TXTIME departure of next packet (txtime_clock ns)
+#ifdef SO_TXTIME
+        clockid_t txtime_clock;    ///< SO_TXTIME clock - CLOCK_MONOTONIC for fq, CLOCK_TAI for etf
+#endif
 };
 
 static void udp_clean_async_state(socket_udp *s);
@@ -728,6 +866,12 @@ static bool set_sock_opts_and_bind(fd_t fd, bool ipv6, uint16_t rx_port, int ttl
                 socket_error("setsockopt SO_REUSEADDR");
                 handle_error(EXIT_FAIL_NETWORK);
         }
+#ifdef SO_RXQ_OVFL
+        // report socket drops (receive buffer overflows) with received datagrams
+        if (SETSOCKOPT(fd, SOL_SOCKET, SO_RXQ_OVFL, (char *)&reuse, sizeof(reuse)) != 0) {
+                socket_error("setsockopt SO_RXQ_OVFL");
+        }
+#endif
 
         if (!ipv6) {
                 struct sockaddr_in *s_in4 = (struct sockaddr_in *) &s_in;
@@ -763,12 +907,259 @@ static bool set_sock_opts_and_bind(fd_t fd, bool ipv6, uint16_t rx_port, int ttl
 ADD_TO_PARAM("udp-queue-len",
                 "* udp-queue-len=<l>\n"
                 "  Use different queue size than default DEFAULT_MAX_UDP_READER_QUEUE_LEN\n");
+ADD_TO_PARAM("udp-queue-locked",
+                "* udp-queue-locked\n"
+                "  Pass received packets from the receiving thread in a mutex-protected list instead of a lock-free ring\n");
+#ifdef HAVE_SENDMMSG
+ADD_TO_PARAM("udp-send-batch",
+                "* udp-send-batch=<n>\n"
+                "  Number of packets sent with one sendmmsg() call (default " TOSTRING(DEFAULT_UDP_SEND_BATCH) ", 1 disables batching)\n");
+ADD_TO_PARAM("udp-disable-gso",
+                "* udp-disable-gso\n"
+                "  Do not use UDP segmentation offload (UDP_SEGMENT) for batched sending\n");
+#endif
+#ifdef HAVE_RECVMMSG
+ADD_TO_PARAM("udp-recv-batch",
+                "* udp-recv-batch=<n>\n"
+                "  Max number of datagrams received with one recvmmsg() call by the receiving thread\n"
+                "  (default " TOSTRING(DEFAULT_UDP_RECV_BATCH) ", 1 disables batching)\n");
+#endif
+#ifdef HAVE_LINUX
+ADD_TO_PARAM("udp-rx-readers",
+                "* udp-rx-readers=<n>[:<cpu>+<cpu>...]\n"
+                "  Receive with <n> sockets bound to the same port (SO_REUSEPORT), each read by its own\n"
+                "  thread with its own queue. Reader i is pinned to i-th listed CPU - list the CPUs\n"
+                "  servicing the NIC RSS queues (see /proc/interrupts) to keep each packet on one core.\n");
+ADD_TO_PARAM("udp-rx-timestamps",
+                "* udp-rx-timestamps[=sw|hw]\n"
+                "  Use kernel (sw, default) or NIC (hw) receive timestamps as packet arrival times for\n"
+                "  the playout buffer and jitter stats instead of the time the packets are processed. The\n"
+                "  NIC timestamping must be enabled (eg. hwstamp_ctl -i <iface> -r 1) and its clock\n"
+                "  synchronized with the system one (phc2sys).\n");
+ADD_TO_PARAM("udp-rx-steer",
+                "* udp-rx-steer=cpu|ssrc|tile|hash\n"
+                "  How datagrams are distributed among udp-rx-readers: by the CPU processing the packet\n"
+                "  (to the reader pinned to it, default), by RTP SSRC, by UltraGrid video tile (substream)\n"
+                "  or by the kernel hash of addresses and ports.\n");
+ADD_TO_PARAM("udp-txtime-clock",
+                "* udp-txtime-clock=mono|tai\n"
+                "  Clock of the SO_TXTIME departure times - mono (default) for the fq qdisc, tai for\n"
+                "  the etf qdisc (which must be set up with the same clock, eg. clockid CLOCK_TAI)\n");
+#endif
+#ifdef HAVE_XDP
+ADD_TO_PARAM("udp-xdp",
+                "* udp-xdp=<iface>[:<queue>]\n"
+                "  Receive with AF_XDP from given NIC RX queue (multithreaded sockets only). The\n"
+                "  stream should be steered to a dedicated queue, eg. with ethtool -N <iface> flow-type udp4 ...\n");
+#endif
 #ifdef WIN32
+ADD_TO_PARAM("udp-rio",
+                "* udp-rio[=<depth>]\n"
+                "  Receive and send with Registered I/O (Windows 8 and newer) instead of overlapped\n"
+                "  WSARecvFrom/WSASendTo, <depth> receives are kept posted (default " TOSTRING(DEFAULT_UDP_RIO_DEPTH) ")\n");
 ADD_TO_PARAM("udp-disable-multi-socket",
                 "* udp-disable-multi-socket\n"
                 "  Disable separate sockets for RX and TX (Win only). Separated RX/TX is a workaround\n"
                 "  to some locking issues (thr. in recv() while no data are received and concurr. send()).\n");
 #endif
+#ifdef HAVE_LINUX
+/**
+ * Attaches classic BPF program to the SO_REUSEPORT group of fd returning index
+ * of the reader (socket in group in the order of binding) for each datagram.
+ * The program sees the datagram from the UDP payload (RTP header).
+ */
+static bool udp_attach_steering(fd_t fd, enum udp_rx_steer steer, const struct udp_rx_reader *readers, int count)
+{
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+        struct sock_filter code[2 * UDP_RX_READERS_MAX + 4];
+        int len = 0;
+        switch (steer) {
+        case UDP_RX_STEER_HASH:
+                return true;
+        case UDP_RX_STEER_CPU:
+                code[len++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+                for (int i = 0; i < count; ++i) {
+                        if (readers[i].cpu >= 0) {
+                                code[len++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, readers[i].cpu, 0, 1);
+                                code[len++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, i);
+                        }
+                }
+                break; // CPUs without a pinned reader - modulo below
+        case UDP_RX_STEER_SSRC:
+                code[len++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 8);
+                break;
+        case UDP_RX_STEER_TILE: // first word of video payload header (after 12 B RTP header), bits 22-31
+                code[len++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 12);
+                code[len++] = (struct sock_filter) BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 22);
+                break;
+        }
+        code[len++] = (struct sock_filter) BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, count);
+        code[len++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_A, 0);
+        struct sock_fprog prog = { .len = len, .filter = code };
+        if (SETSOCKOPT(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof prog) != 0) {
+                socket_error("setsockopt SO_ATTACH_REUSEPORT_CBPF");
+                return false;
+        }
+        return true;
+#else
+        UNUSED(fd), UNUSED(readers), UNUSED(count);
+        if (steer != UDP_RX_STEER_HASH) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Steering not supported by the system, using kernel hash.\n");
+        }
+        return true;
+#endif
+}
+
+static bool udp_parse_rx_readers(const char *cfg, struct socket_udp_local *l, enum udp_rx_steer *steer)
+{
+        char *end = NULL;
+        long count = strtol(cfg, &end, 10);
+        if (end == cfg || count < 1 || count > UDP_RX_READERS_MAX || (*end != '\0' && *end != ':')) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong udp-rx-readers value: %s (1-%d readers)\n", cfg, UDP_RX_READERS_MAX);
+                return false;
+        }
+        l->reader_count = count;
+        l->readers = (struct udp_rx_reader *) calloc(count, sizeof l->readers[0]);
+        for (int i = 0; i < count; ++i) {
+                l->readers[i].fd = INVALID_SOCKET;
+                l->readers[i].cpu = -1;
+        }
+        for (int i = 0; *end == (i == 0 ? ':' : '+'); ++i) {
+                const char *cpu = end + 1;
+                long val = strtol(cpu, &end, 10);
+                if (end == cpu || val < 0 || val >= CPU_SETSIZE || i >= count || (*end != '\0' && *end != '+')) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong udp-rx-readers CPU list: %s\n", cfg);
+                        return false;
+                }
+                l->readers[i].cpu = val;
+        }
+
+        const char *steer_cfg = get_commandline_param("udp-rx-steer");
+        if (steer_cfg == NULL || strcmp(steer_cfg, "cpu") == 0) {
+                *steer = UDP_RX_STEER_CPU;
+        } else if (strcmp(steer_cfg, "ssrc") == 0) {
+                *steer = UDP_RX_STEER_SSRC;
+        } else if (strcmp(steer_cfg, "tile") == 0) {
+                *steer = UDP_RX_STEER_TILE;
+        } else if (strcmp(steer_cfg, "hash") == 0) {
+                *steer = UDP_RX_STEER_HASH;
+        } else {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown udp-rx-steer value: %s\n", steer_cfg);
+                return false;
+        }
+        return true;
+}
+#endif // defined HAVE_LINUX
+
+#if defined HAVE_LINUX && defined HAVE_RECVMMSG
+static bool udp_enable_rx_timestamps(struct socket_udp_local *l, const char *cfg)
+{
+        int opt = 0;
+        int flags = 1;
+        if (strlen(cfg) == 0 || strcmp(cfg, "sw") == 0) {
+                l->rx_timestamps = UDP_RX_TS_SW;
+                opt = SO_TIMESTAMPNS;
+        } else if (strcmp(cfg, "hw") == 0) {
+                l->rx_timestamps = UDP_RX_TS_HW;
+                opt = SO_TIMESTAMPING;
+                flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE |
+                        SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        } else {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown udp-rx-timestamps value: %s\n", cfg);
+                return false;
+        }
+        for (int i = 0; i < l->reader_count; ++i) {
+                if (SETSOCKOPT(l->readers[i].fd, SOL_SOCKET, opt, &flags, sizeof flags) != 0) {
+                        socket_error(opt == SO_TIMESTAMPNS ? "setsockopt SO_TIMESTAMPNS" : "setsockopt SO_TIMESTAMPING");
+                        return false;
+                }
+        }
+        return true;
+}
+#endif
+
+/**
+ * Sets up readers of a multithreaded socket - one reading rx_fd and, with
+ * udp-rx-readers, additional ones each with own socket bound to the same port.
+ */
+static bool udp_init_readers(socket_udp *s, int ttl)
+{
+        struct socket_udp_local *l = s->local;
+        enum udp_rx_steer steer = UDP_RX_STEER_HASH;
+        const char *cfg = get_commandline_param("udp-rx-readers");
+#ifdef HAVE_XDP
+        if (cfg != NULL && get_commandline_param("udp-xdp") != NULL) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "udp-rx-readers cannot be combined with udp-xdp, ignoring.\n");
+                cfg = NULL;
+        }
+#endif
+        if (cfg != NULL) {
+#ifdef HAVE_LINUX
+                if (!udp_parse_rx_readers(cfg, l, &steer)) {
+                        return false;
+                }
+#else
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "udp-rx-readers is supported only in Linux, ignoring.\n");
+                cfg = NULL;
+#endif
+        }
+        if (cfg == NULL) {
+                l->reader_count = 1;
+                l->readers = (struct udp_rx_reader *) calloc(1, sizeof l->readers[0]);
+                l->readers[0].cpu = -1;
+        }
+        for (int i = 0; i < l->reader_count; ++i) {
+                l->readers[i].s = s;
+        }
+        l->readers[0].fd = l->rx_fd;
+
+        if (!l->locked_queue) {
+                l->rings = (struct packet_ring *) aligned_malloc((l->reader_count + 1) * sizeof l->rings[0], alignof(struct packet_ring));
+                memset(l->rings, 0, (l->reader_count + 1) * sizeof l->rings[0]);
+                for (int i = 0; i < l->reader_count + 1; ++i) {
+                        l->rings[i].capacity = l->max_packets + 1;
+                        l->rings[i].slots = (struct item *) calloc(l->rings[i].capacity, sizeof(struct item));
+                }
+                for (int i = 0; i < l->reader_count; ++i) {
+                        l->readers[i].ring = &l->rings[i];
+                }
+        }
+        if (l->reader_count == 1) {
+                return true;
+        }
+
+#ifdef HAVE_LINUX
+        int port = udp_get_udp_rx_port(s);
+        if (port < 0) {
+                return false;
+        }
+        for (int i = 1; i < l->reader_count; ++i) {
+                fd_t fd = socket(s->sock.ss_family, SOCK_DGRAM, 0);
+                if (fd == INVALID_SOCKET) {
+                        socket_error("Unable to initialize socket");
+                        return false;
+                }
+                l->readers[i].fd = fd;
+                if (!set_sock_opts_and_bind(fd, l->mode == IPv6, port, ttl)) {
+                        return false;
+                }
+                bool joined = l->mode == IPv4
+                        ? udp_join_mcast_grp4(((struct sockaddr_in *)&s->sock)->sin_addr.s_addr, fd, fd, ttl, s->ifindex)
+                        : udp_join_mcast_grp6(((struct sockaddr_in6 *)&s->sock)->sin6_addr, fd, fd, ttl, s->ifindex);
+                if (!joined) {
+                        return false;
+                }
+        }
+        if (!udp_attach_steering(l->rx_fd, steer, l->readers, l->reader_count)) {
+                return false;
+        }
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "Receiving port %d with %d SO_REUSEPORT readers.\n", port, l->reader_count);
+#else
+        UNUSED(ttl), UNUSED(steer);
+#endif
+        return true;
+}
+
 /**
  * udp_init_if:
  * Creates a session for sending and receiving UDP datagrams over IP
@@ -785,6 +1176,37 @@ ADD_TO_PARAM("udp-disable-multi-socket",
  *
  * @returns a pointer to a socket_udp structure on success, NULL otherwise.
  **/
+#ifdef WIN32
+/**
+ * Sets up registered I/O for the sockets of l. If it fails (eg. RIO missing
+ * before Windows 8), the sockets are used with the overlapped API as usual.
+ *
+ * @param rx  set up also receiving (done by udp_reader_rio())
+ */
+static void udp_init_rio(struct socket_udp_local *l, bool rx)
+{
+        int depth = DEFAULT_UDP_RIO_DEPTH;
+        const char *cfg = get_commandline_param("udp-rio");
+        if (strlen(cfg) > 0 && (depth = atoi(cfg)) <= 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Wrong udp-rio depth %s, using default.\n", cfg);
+                depth = DEFAULT_UDP_RIO_DEPTH;
+        }
+        const int slot_size = RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE;
+        if (l->rx_fd == l->tx_fd) {
+                l->rio_rx = l->rio_tx = rio_socket_init(l->rx_fd, rx ? depth : 0, depth, slot_size);
+        } else {
+                l->rio_rx = rx ? rio_socket_init(l->rx_fd, depth, 0, slot_size) : NULL;
+                l->rio_tx = rio_socket_init(l->tx_fd, 0, depth, slot_size);
+        }
+        if (l->rio_tx == NULL || (rx && l->rio_rx == NULL)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot use registered I/O, falling back to overlapped sockets.\n");
+        }
+        if (!rx) {
+                l->rio_rx = NULL;
+        }
+}
+#endif
+
 socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
                         uint16_t tx_port, int ttl, int force_ip_version, bool multithreaded)
 {
@@ -826,11 +1248,15 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
                 s->local->is_wsa_overlapped = true;
         }
 
-        s->local->rx_fd = WSASocket(s->sock.ss_family, SOCK_DGRAM, IPPROTO_UDP, NULL, 0, s->local->is_wsa_overlapped ? WSA_FLAG_OVERLAPPED : 0);
+        DWORD wsa_flags = s->local->is_wsa_overlapped ? WSA_FLAG_OVERLAPPED : 0;
+        if (get_commandline_param("udp-rio") != NULL) {
+                wsa_flags |= WSA_FLAG_REGISTERED_IO;
+        }
+        s->local->rx_fd = WSASocket(s->sock.ss_family, SOCK_DGRAM, IPPROTO_UDP, NULL, 0, wsa_flags);
         if (get_commandline_param("udp-disable-multi-socket")) {
                 s->local->tx_fd = s->local->rx_fd;
         } else {
-                s->local->tx_fd = WSASocket(s->sock.ss_family, SOCK_DGRAM, IPPROTO_UDP, NULL, 0, s->local->is_wsa_overlapped ? WSA_FLAG_OVERLAPPED : 0);
+                s->local->tx_fd = WSASocket(s->sock.ss_family, SOCK_DGRAM, IPPROTO_UDP, NULL, 0, wsa_flags);
         }
 #else
         s->local->rx_fd =
@@ -852,6 +1278,11 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
         if (is_wine()) {
                 SWAP(s->local->rx_fd, s->local->tx_fd);
         }
+#ifdef WIN32
+        if (get_commandline_param("udp-rio") != NULL) {
+                udp_init_rio(s->local, multithreaded);
+        }
+#endif
 
         // if we do not set tx port, fake that is the same as we are bound to
         if (tx_port == 0) {
@@ -890,15 +1321,54 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
                 abort();
         }
 
-        s->local->multithreaded = multithreaded;
         if (multithreaded) {
                 if (!get_commandline_param("udp-queue-len")) {
                         s->local->max_packets = DEFAULT_MAX_UDP_READER_QUEUE_LEN;
                 } else {
                         s->local->max_packets = atoi(get_commandline_param("udp-queue-len"));
                 }
+                s->local->locked_queue = get_commandline_param("udp-queue-locked") != NULL;
+                if (!udp_init_readers(s, ttl)) {
+                        goto error;
+                }
+                void *(*reader)(void *) = udp_reader;
+#ifdef HAVE_RECVMMSG
+                s->local->recv_batch = DEFAULT_UDP_RECV_BATCH;
+                if (get_commandline_param("udp-recv-batch")) {
+                        s->local->recv_batch = atoi(get_commandline_param("udp-recv-batch"));
+                }
+                if (s->local->recv_batch > 1) {
+                        reader = udp_reader_mmsg;
+                }
+#if defined HAVE_LINUX
+                if (get_commandline_param("udp-rx-timestamps") != NULL) {
+                        if (!udp_enable_rx_timestamps(s->local, get_commandline_param("udp-rx-timestamps"))) {
+                                goto error;
+                        }
+                        reader = udp_reader_mmsg; // timestamps are passed in control messages
+                }
+#endif
+#endif
+#ifdef WIN32
+                if (s->local->rio_rx != NULL) {
+                        reader = udp_reader_rio;
+                }
+#endif
+#ifdef HAVE_XDP
+                if (get_commandline_param("udp-xdp")) {
+                        int port = udp_get_udp_rx_port(s);
+                        if (port < 0 || (s->local->xdp = xdp_rx_init(get_commandline_param("udp-xdp"), port)) == NULL) {
+                                goto error;
+                        }
+                        s->local->recv_batch = MAX(s->local->recv_batch, DEFAULT_UDP_RECV_BATCH);
+                        reader = udp_reader_mmsg;
+                }
+#endif
                 platform_pipe_init(s->local->should_exit_fd);
-                pthread_create(&s->local->thread_id, NULL, udp_reader, s);
+                for (int i = 0; i < s->local->reader_count; ++i) {
+                        pthread_create(&s->local->readers[i].thread_id, NULL, reader, &s->local->readers[i]);
+                }
+                s->local->multithreaded = true;
         }
 
         return s;
@@ -983,19 +1453,44 @@ void udp_exit(socket_udp * s)
                         char c = 0;
                         int ret = PLATFORM_PIPE_WRITE(s->local->should_exit_fd[1], &c, 1);
                         assert (ret == 1);
+                        pthread_mutex_lock(&s->local->lock);
                         s->local->should_exit = true;
-                        pthread_cond_signal(&s->local->reader_cv);
-                        pthread_join(s->local->thread_id, NULL);
-                        while (simple_linked_list_size(s->local->packets) > 0) {
-                                struct item *item = (struct item *) simple_linked_list_pop(s->local->packets);
-                                free(item->buf);
+                        pthread_mutex_unlock(&s->local->lock);
+                        pthread_cond_broadcast(&s->local->reader_cv);
+                        for (int i = 0; i < s->local->reader_count; ++i) {
+                                pthread_join(s->local->readers[i].thread_id, NULL);
+                        }
+                        while (udp_queue_size(s->local) > 0) {
+                                free(udp_queue_pop(s->local).buf);
                         }
+                        platform_pipe_close(s->local->should_exit_fd[0]);
                         platform_pipe_close(s->local->should_exit_fd[1]);
                 }
+#ifdef HAVE_XDP
+                xdp_rx_done(s->local->xdp);
+#endif
+                if (s->local->rings != NULL) {
+                        for (int i = 0; i < s->local->reader_count + 1; ++i) {
+                                free(s->local->rings[i].slots);
+                        }
+                }
+                for (int i = 0; i < s->local->reader_count; ++i) {
+                        if (i > 0 && s->local->readers[i].fd != INVALID_SOCKET) {
+                                CLOSESOCKET(s->local->readers[i].fd);
+                        }
+                }
+                aligned_free(s->local->rings);
+                free(s->local->readers);
                 CLOSESOCKET(s->local->rx_fd);
                 if (s->local->tx_fd != s->local->rx_fd) {
                         CLOSESOCKET(s->local->tx_fd);
                 }
+#ifdef WIN32
+                if (s->local->rio_rx != s->local->rio_tx) {
+                        rio_socket_done(s->local->rio_rx);
+                }
+                rio_socket_done(s->local->rio_tx);
+#endif
                 simple_linked_list_destroy(s->local->packets);
                 pthread_mutex_destroy(&s->local->lock);
                 pthread_cond_destroy(&s->local->boss_cv);
@@ -1033,11 +1528,72 @@ int udp_sendto(socket_udp * s, char *buffer, int buflen, struct sockaddr *dst_ad
         return sendto(s->local->tx_fd, buffer, buflen, 0, dst_addr, addrlen);
 }
 
+#define UDP_SEND_MULTI_MAX 64 ///< datagrams passed to one sendmmsg() by udp_send_multi()
+
+/**
+ * Transmits count datagrams to the socket destination - with sendmmsg() (if
+ * available) so that there is one syscall for up to UDP_SEND_MULTI_MAX
+ * datagrams.
+ *
+ * @param nonblock  fail with EAGAIN/EWOULDBLOCK instead of blocking if the send buffer is full
+ * @returns count on success, otherwise number of datagrams sent before the
+ *          first failure (errno is set)
+ */
+int udp_send_multi(socket_udp *s, char **buffers, const int *buflens, int count, bool nonblock)
+{
+        assert(s != NULL);
+#ifdef MSG_DONTWAIT
+        const int flags = nonblock ? MSG_DONTWAIT : 0;
+#else
+        const int flags = 0;
+        UNUSED(nonblock);
+#endif
+#ifdef HAVE_SENDMMSG
+        struct mmsghdr msgs[UDP_SEND_MULTI_MAX];
+        struct iovec iov[UDP_SEND_MULTI_MAX];
+        int sent = 0;
+        while (sent < count) {
+                int n = MIN(count - sent, UDP_SEND_MULTI_MAX);
+                memset(msgs, 0, n * sizeof msgs[0]);
+                for (int i = 0; i < n; ++i) {
+                        iov[i].iov_base = buffers[sent + i];
+                        iov[i].iov_len = buflens[sent + i];
+                        msgs[i].msg_hdr.msg_name = (void *) &s->sock;
+                        msgs[i].msg_hdr.msg_namelen = s->sock_len;
+                        msgs[i].msg_hdr.msg_iov = &iov[i];
+                        msgs[i].msg_hdr.msg_iovlen = 1;
+                }
+                int ret = sendmmsg(s->local->tx_fd, msgs, n, flags);
+                if (ret < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return sent;
+                }
+                sent += ret;
+        }
+        return sent;
+#else
+        for (int i = 0; i < count; ++i) {
+                if (sendto(s->local->tx_fd, buffers[i], buflens[i], flags,
+                                        (struct sockaddr *) &s->sock, s->sock_len) < 0) {
+                        return i;
+                }
+        }
+        return count;
+#endif
+}
+
 #ifdef WIN32
 int udp_sendv(socket_udp * s, LPWSABUF vector, int count, void *d)
 {
         assert(s != NULL);
 
+        if (s->local->rio_tx != NULL) { // data are copied to the registered buffer
+                free(d);
+                return rio_send(s->local->rio_tx, vector, count, (struct sockaddr *) &s->sock, s->sock_len, s->overlapping_active);
+        }
+
         assert(!s->overlapping_active || s->overlapped_count < s->overlapped_max);
 
 	DWORD bytesSent;
@@ -1056,13 +1612,56 @@ int udp_sendv(socket_udp * s, LPWSABUF vector, int count, void *d)
                 return ret;
         }
 }
+
+/** @copydoc udp_sendv_multi */
+int udp_sendv_multi(socket_udp *s, LPWSABUF vector, const int *counts, int packets)
+{
+        int sent = 0;
+        for (int i = 0; i < packets; ++i) {
+                if (udp_sendv(s, vector, counts[i], NULL) == 0) {
+                        sent += 1;
+                }
+                vector += counts[i];
+        }
+        return sent;
+}
 #else
+#ifdef HAVE_SENDMMSG
+static void udp_batch_enqueue(socket_udp *s, struct iovec *vector, int count, void *d);
+static int udp_sendmmsg_all(fd_t fd, struct mmsghdr *msgs, int count, bool stop_on_error);
+#endif
+
+#ifdef SO_TXTIME
+/// attaches departure time to the message if sending with UDP_PACING_TXTIME
+static void udp_stamp_txtime(socket_udp *s, struct msghdr *m, char *cmsg_buf)
+{
+        if (s->pacing != UDP_PACING_TXTIME || s->pacing_interval_ns == 0) {
+                return;
+        }
+        m->msg_control = cmsg_buf;
+        m->msg_controllen = UDP_TXTIME_CMSG_SPACE;
+        struct cmsghdr *cm = CMSG_FIRSTHDR(m);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_TXTIME;
+        cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+        memcpy(CMSG_DATA(cm), &s->next_txtime, sizeof s->next_txtime);
+        s->next_txtime += s->pacing_interval_ns;
+}
+#endif
+
 int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
 {
         struct msghdr msg;
 
         assert(s != NULL);
 
+#ifdef HAVE_SENDMMSG
+        if (s->batch != NULL && s->batch->active) {
+                udp_batch_enqueue(s, vector, count, d);
+                return 0;
+        }
+#endif
+
         msg.msg_name = (void *) & s->sock;
         msg.msg_namelen = s->sock_len;
         msg.msg_iov = vector;
@@ -1071,79 +1670,611 @@ int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
         msg.msg_control = 0;
         msg.msg_controllen = 0;
         msg.msg_flags = 0;
+#ifdef SO_TXTIME
+        alignas(struct cmsghdr) char cmsg_buf[UDP_TXTIME_CMSG_SPACE];
+        udp_stamp_txtime(s, &msg, cmsg_buf);
+#endif
 
         int ret = sendmsg(s->local->tx_fd, &msg, 0);
         free(d);
         return ret;
 }
-#endif // WIN32
 
 /**
- * When receiving data in separate thread, this function fetches data
- * from socket and puts it in queue.
+ * Sends multiple packets, each given by counts[i] consecutive items of vector,
+ * with sendmmsg() (if available) or queues them if udp_async_start() batching
+ * is active. Nothing is allocated so the caller keeps the buffers as with
+ * udp_sendv() (until udp_async_wait() if sending asynchronously).
+ *
+ * @returns number of packets sent (or queued)
  */
-static void *udp_reader(void *arg)
+int udp_sendv_multi(socket_udp *s, struct iovec *vector, const int *counts, int packets)
 {
-        set_thread_name(__func__);
-        socket_udp *s = (socket_udp *) arg;
-
-        while (1) {
-                fd_set fds;
-                FD_ZERO(&fds);
-                FD_SET(s->local->rx_fd, &fds);
-                FD_SET(s->local->should_exit_fd[0], &fds);
-                int nfds = MAX(s->local->rx_fd, s->local->should_exit_fd[0]) + 1;
-
-                int rc = select(nfds, &fds, NULL, NULL, NULL);
-                if (rc <= 0) {
-                        socket_error("select");
-                        continue;
-                }
-                if (FD_ISSET(s->local->should_exit_fd[0], &fds)) {
-                        break;
-                }
-                uint8_t *packet = (uint8_t *) malloc(ALIGNED_ITEM_OFF + sizeof(struct item));
-                uint8_t *buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
-                struct sockaddr *src_addr = (struct sockaddr *)(void *)(packet + ALIGNED_SOCKADDR_STORAGE_OFF);
-                socklen_t addrlen = sizeof(struct sockaddr_storage);
-                int size = recvfrom(s->local->rx_fd, (char *) buffer,
-                                RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
-                                0, src_addr, &addrlen);
-
-                if (size <= 0) {
-                        /// @todo
-                        /// In MSW, this block is called as often as packet is sent if
-                        /// we got WSAECONNRESET error (noone is listening). This can have
-                        /// negative performance impact.
-                        socket_error("recvfrom");
-                        free(packet);
-                        continue;
+        assert(s != NULL);
+#ifdef HAVE_SENDMMSG
+        if (s->batch != NULL && s->batch->active) {
+                for (int i = 0; i < packets; ++i) {
+                        udp_batch_enqueue(s, vector, counts[i], NULL);
+                        vector += counts[i];
                 }
+                return packets;
+        }
 
-                pthread_mutex_lock(&s->local->lock);
-                while (simple_linked_list_size(s->local->packets) >= (int) s->local->max_packets && !s->local->should_exit) {
-                        pthread_cond_wait(&s->local->reader_cv, &s->local->lock);
+        struct mmsghdr msgs[UDP_SEND_MULTI_MAX];
+#ifdef SO_TXTIME
+        alignas(struct cmsghdr) char cmsg_buf[UDP_SEND_MULTI_MAX][UDP_TXTIME_CMSG_SPACE];
+#endif
+        int sent = 0;
+        while (sent < packets) {
+                int n = MIN(packets - sent, UDP_SEND_MULTI_MAX);
+                memset(msgs, 0, n * sizeof msgs[0]);
+                for (int i = 0; i < n; ++i) {
+                        struct msghdr *m = &msgs[i].msg_hdr;
+                        m->msg_name = (void *) &s->sock;
+                        m->msg_namelen = s->sock_len;
+                        m->msg_iov = vector;
+                        m->msg_iovlen = counts[sent + i];
+#ifdef SO_TXTIME
+                        udp_stamp_txtime(s, m, cmsg_buf[i]);
+#endif
+                        vector += counts[sent + i];
                 }
-                if (s->local->should_exit) {
-                        free(packet);
-                        pthread_mutex_unlock(&s->local->lock);
-                        break;
+                sent += udp_sendmmsg_all(s->local->tx_fd, msgs, n, false);
+        }
+        return sent;
+#else
+        int sent = 0;
+        for (int i = 0; i < packets; ++i) {
+                if (udp_sendv(s, vector, counts[i], NULL) >= 0) {
+                        sent += 1;
                 }
-
-                struct item *i = (struct item *)(void *)(packet + ALIGNED_ITEM_OFF);
-                *i = (struct item){packet, size, src_addr, addrlen};
-                simple_linked_list_append(s->local->packets, i);
-
-                pthread_mutex_unlock(&s->local->lock);
-                pthread_cond_signal(&s->local->boss_cv);
+                vector += counts[i];
         }
+        return sent;
+#endif
+}
+#endif // WIN32
 
-        platform_pipe_close(s->local->should_exit_fd[0]);
-
-        return NULL;
+static int udp_queue_size(struct socket_udp_local *l)
+{
+        if (l->locked_queue) {
+                return simple_linked_list_size(l->packets);
+        }
+        int size = 0;
+        for (int i = 0; i < l->reader_count + 1; ++i) {
+                unsigned int head = atomic_load(&l->rings[i].head);
+                unsigned int tail = atomic_load(&l->rings[i].tail);
+                size += (tail + l->rings[i].capacity - head) % l->rings[i].capacity;
+        }
+        return size;
 }
 
-static int udp_do_recv(socket_udp * s, char *buffer, int buflen, int flags, struct sockaddr *src_addr, socklen_t *addrlen)
+/// wakes producers blocked on full queue, all of them share reader_cv
+static void udp_queue_wake_readers(struct socket_udp_local *l)
+{
+        if (l->reader_count > 1) {
+                pthread_cond_broadcast(&l->reader_cv);
+        } else {
+                pthread_cond_signal(&l->reader_cv);
+        }
+}
+
+/**
+ * Enqueues received packets, blocks while the queue is full.
+ *
+ * @param r      ring of the calling reader (NULL with locked_queue)
+ * @param items  pointers to items stored inside the packet buffers
+ * @returns      false if the socket is being destroyed (items not enqueued are not freed)
+ */
+static bool udp_queue_push(struct socket_udp_local *l, struct packet_ring *r, struct item **items, int count)
+{
+        if (l->locked_queue) {
+                pthread_mutex_lock(&l->lock);
+                while (simple_linked_list_size(l->packets) >= (int) l->max_packets && !l->should_exit) {
+                        pthread_cond_wait(&l->reader_cv, &l->lock);
+                }
+                if (l->should_exit) {
+                        pthread_mutex_unlock(&l->lock);
+                        return false;
+                }
+                for (int i = 0; i < count; ++i) {
+                        simple_linked_list_append(l->packets, items[i]);
+                }
+                pthread_mutex_unlock(&l->lock);
+                pthread_cond_signal(&l->boss_cv);
+                return true;
+        }
+
+        unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        for (int i = 0; i < count; ++i) {
+                unsigned int next = (tail + 1) % r->capacity;
+                if (next == atomic_load_explicit(&r->head, memory_order_acquire)) { // full
+                        pthread_mutex_lock(&l->lock);
+                        atomic_store(&r->producer_waiting, true);
+                        while (next == atomic_load(&r->head) && !l->should_exit) {
+                                pthread_cond_wait(&l->reader_cv, &l->lock);
+                        }
+                        atomic_store(&r->producer_waiting, false);
+                        bool should_exit = l->should_exit;
+                        pthread_mutex_unlock(&l->lock);
+                        if (should_exit) {
+                                for (int j = i; j < count; ++j) {
+                                        free(items[j]->buf);
+                                        items[j] = NULL;
+                                }
+                                return false;
+                        }
+                }
+                r->slots[tail] = *items[i];
+                atomic_store(&r->tail, next); // seq_cst - pairs with consumer_waiting
+                tail = next;
+        }
+        if (atomic_load(&l->consumer_waiting)) {
+                pthread_mutex_lock(&l->lock);
+                pthread_mutex_unlock(&l->lock);
+                pthread_cond_signal(&l->boss_cv);
+        }
+        return true;
+}
+
+/**
+ * @param timeout  maximal time to wait, NULL for infinite
+ * @returns        true if there is a packet in the queue
+ */
+static bool udp_queue_wait(struct socket_udp_local *l, struct timeval *timeout)
+{
+        if (!l->locked_queue && udp_queue_size(l) > 0) {
+                return true;
+        }
+        struct timespec tmout_ts = { 0, 0 };
+        if (timeout) {
+                struct timeval tv;
+                gettimeofday(&tv, NULL);
+                tv.tv_sec += timeout->tv_sec;
+                tv.tv_usec += timeout->tv_usec;
+                if (tv.tv_usec >= 1000000) {
+                        tv.tv_sec += 1;
+                        tv.tv_usec -= 1000000;
+                }
+                tmout_ts.tv_sec = tv.tv_sec;
+                tmout_ts.tv_nsec = tv.tv_usec * 1000;
+        }
+
+        pthread_mutex_lock(&l->lock);
+        atomic_store(&l->consumer_waiting, true);
+        int rc = 0;
+        while (rc != ETIMEDOUT && udp_queue_size(l) == 0) {
+                rc = timeout ? pthread_cond_timedwait(&l->boss_cv, &l->lock, &tmout_ts)
+                        : pthread_cond_wait(&l->boss_cv, &l->lock);
+        }
+        atomic_store(&l->consumer_waiting, false);
+        bool ret = udp_queue_size(l) > 0;
+        pthread_mutex_unlock(&l->lock);
+        return ret;
+}
+
+/// @pre udp_queue_size() > 0
+static struct item udp_queue_pop(struct socket_udp_local *l)
+{
+        if (l->locked_queue) {
+                pthread_mutex_lock(&l->lock);
+                struct item it = *(struct item *)(simple_linked_list_pop(l->packets));
+                pthread_mutex_unlock(&l->lock);
+                udp_queue_wake_readers(l);
+                return it;
+        }
+
+        // rings of multiple readers (and of injected packets) are taken round-robin
+        struct packet_ring *r = NULL;
+        unsigned int head = 0;
+        for (int i = 0; i < l->reader_count + 1; ++i) {
+                r = &l->rings[l->next_ring];
+                l->next_ring = (l->next_ring + 1) % (l->reader_count + 1);
+                head = atomic_load_explicit(&r->head, memory_order_relaxed);
+                if (head != atomic_load_explicit(&r->tail, memory_order_acquire)) {
+                        break;
+                }
+                r = NULL;
+        }
+        assert(r != NULL);
+        struct item it = r->slots[head];
+        atomic_store(&r->head, (head + 1) % r->capacity); // seq_cst - pairs with producer_waiting
+        if (atomic_load(&r->producer_waiting)) {
+                pthread_mutex_lock(&l->lock);
+                pthread_mutex_unlock(&l->lock);
+                udp_queue_wake_readers(l);
+        }
+        return it;
+}
+
+/**
+ * Passes a packet to the receiving side of the multithreaded socket as if it
+ * was received from the network, eg. from another module of the same process.
+ * Unlike udp_reader(), it doesn't block if the queue is full - the packet is
+ * dropped instead.
+ *
+ * Packets may be injected by one thread only at a time.
+ *
+ * @returns false if the packet was not queued (queue full or packet too long)
+ */
+bool udp_inject_data(socket_udp *s, const char *data, int len)
+{
+        struct socket_udp_local *l = s->local;
+        assert(l->multithreaded);
+        if (len <= 0 || len > RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE) {
+                return false;
+        }
+
+        uint8_t *packet = (uint8_t *) malloc(ALIGNED_ITEM_OFF + sizeof(struct item));
+        memcpy(packet + RTP_PACKET_HEADER_SIZE, data, len);
+        ((rtp_packet *)(void *) packet)->arrival_ns = 0;
+        struct item *it = (struct item *)(void *)(packet + ALIGNED_ITEM_OFF);
+        *it = (struct item){packet, len, NULL, 0};
+
+        if (l->locked_queue) {
+                pthread_mutex_lock(&l->lock);
+                bool full = simple_linked_list_size(l->packets) >= (int) l->max_packets;
+                if (!full) {
+                        simple_linked_list_append(l->packets, it);
+                }
+                pthread_mutex_unlock(&l->lock);
+                if (full) {
+                        free(packet);
+                        return false;
+                }
+                pthread_cond_signal(&l->boss_cv);
+                return true;
+        }
+
+        struct packet_ring *r = &l->rings[l->reader_count];
+        unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        unsigned int next = (tail + 1) % r->capacity;
+        if (next == atomic_load_explicit(&r->head, memory_order_acquire)) {
+                free(packet);
+                return false;
+        }
+        r->slots[tail] = *it;
+        atomic_store(&r->tail, next); // seq_cst - pairs with consumer_waiting
+        if (atomic_load(&l->consumer_waiting)) {
+                pthread_mutex_lock(&l->lock);
+                pthread_mutex_unlock(&l->lock);
+                pthread_cond_signal(&l->boss_cv);
+        }
+        return true;
+}
+
+static void udp_reader_pin(struct udp_rx_reader *r)
+{
+        if (r->cpu < 0) {
+                return;
+        }
+#ifdef HAVE_LINUX
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(r->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof set, &set) != 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot pin UDP reader to CPU %d.\n", r->cpu);
+        }
+#endif
+}
+
+/**
+ * When receiving data in separate thread, this function fetches data
+ * from socket and puts it in queue.
+ */
+static void *udp_reader(void *arg)
+{
+        set_thread_name(__func__);
+        struct udp_rx_reader *r = (struct udp_rx_reader *) arg;
+        udp_reader_pin(r);
+        socket_udp *s = r->s;
+
+        while (1) {
+                fd_set fds;
+                FD_ZERO(&fds);
+                FD_SET(r->fd, &fds);
+                FD_SET(s->local->should_exit_fd[0], &fds);
+                int nfds = MAX(r->fd, s->local->should_exit_fd[0]) + 1;
+
+                int rc = select(nfds, &fds, NULL, NULL, NULL);
+                if (rc <= 0) {
+                        socket_error("select");
+                        continue;
+                }
+                if (FD_ISSET(s->local->should_exit_fd[0], &fds)) {
+                        break;
+                }
+                uint8_t *packet = (uint8_t *) malloc(ALIGNED_ITEM_OFF + sizeof(struct item));
+                uint8_t *buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
+                struct sockaddr *src_addr = (struct sockaddr *)(void *)(packet + ALIGNED_SOCKADDR_STORAGE_OFF);
+                socklen_t addrlen = sizeof(struct sockaddr_storage);
+                int size = recvfrom(r->fd, (char *) buffer,
+                                RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
+                                0, src_addr, &addrlen);
+
+                if (size <= 0) {
+                        /// @todo
+                        /// In MSW, this block is called as often as packet is sent if
+                        /// we got WSAECONNRESET error (noone is listening). This can have
+                        /// negative performance impact.
+                        socket_error("recvfrom");
+                        free(packet);
+                        continue;
+                }
+
+                ((rtp_packet *)(void *) packet)->arrival_ns = 0;
+                struct item *i = (struct item *)(void *)(packet + ALIGNED_ITEM_OFF);
+                *i = (struct item){packet, size, src_addr, addrlen};
+                if (!udp_queue_push(s->local, r->ring, &i, 1)) {
+                        if (i != NULL) {
+                                free(packet);
+                        }
+                        break;
+                }
+        }
+
+        return NULL;
+}
+
+#ifdef WIN32
+/**
+ * Variant of udp_reader() receiving completions of registered I/O (udp-rio)
+ * in batches - the datagrams are copied from the registered buffer to packet
+ * buffers allocated in advance as in udp_reader_mmsg().
+ */
+static void *udp_reader_rio(void *arg)
+{
+        set_thread_name("udp_reader");
+        struct udp_rx_reader *r = (struct udp_rx_reader *) arg;
+        socket_udp *s = r->s;
+        struct rio_msg msgs[UDP_RIO_RECV_BATCH];
+        uint8_t *packets[UDP_RIO_RECV_BATCH];
+        for (int i = 0; i < UDP_RIO_RECV_BATCH; ++i) {
+                packets[i] = (uint8_t *) malloc(ALIGNED_ITEM_OFF + sizeof(struct item));
+        }
+
+        while (1) {
+                for (int i = 0; i < UDP_RIO_RECV_BATCH; ++i) {
+                        msgs[i] = (struct rio_msg){ (char *) packets[i] + RTP_PACKET_HEADER_SIZE,
+                                RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE, 0,
+                                (struct sockaddr *)(void *)(packets[i] + ALIGNED_SOCKADDR_STORAGE_OFF), 0 };
+                }
+                int count = rio_recv(s->local->rio_rx, msgs, UDP_RIO_RECV_BATCH, UDP_RIO_POLL_MS);
+                if (count < 0) {
+                        break;
+                }
+                if (count == 0) {
+                        pthread_mutex_lock(&s->local->lock);
+                        bool should_exit = s->local->should_exit;
+                        pthread_mutex_unlock(&s->local->lock);
+                        if (should_exit) {
+                                break;
+                        }
+                        continue;
+                }
+
+                struct item *items[UDP_RIO_RECV_BATCH];
+                for (int i = 0; i < count; ++i) {
+                        uint8_t *packet = packets[i];
+                        ((rtp_packet *)(void *) packet)->arrival_ns = 0;
+                        items[i] = (struct item *)(void *)(packet + ALIGNED_ITEM_OFF);
+                        *items[i] = (struct item){packet, msgs[i].len, msgs[i].addr, msgs[i].addrlen};
+                        packets[i] = NULL;
+                }
+                if (!udp_queue_push(s->local, r->ring, items, count)) {
+                        for (int i = 0; i < count; ++i) { // not enqueued in locked mode
+                                if (items[i] != NULL && s->local->locked_queue) {
+                                        free(items[i]->buf);
+                                }
+                        }
+                        break;
+                }
+                for (int i = 0; i < count; ++i) {
+                        packets[i] = (uint8_t *) malloc(ALIGNED_ITEM_OFF + sizeof(struct item));
+                }
+        }
+
+        for (int i = 0; i < UDP_RIO_RECV_BATCH; ++i) {
+                free(packets[i]);
+        }
+        return NULL;
+}
+#endif // defined WIN32
+
+#ifdef HAVE_RECVMMSG
+/**
+ * Processes control messages received with a datagram - stores the socket
+ * drop counter (if the kernel passed it) and returns the RX timestamp.
+ *
+ * @returns RX timestamp in ns (wall clock), 0 if not present
+ */
+static long long udp_reader_parse_cmsg(struct udp_rx_reader *r, struct msghdr *msg)
+{
+        long long ts = 0;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+                if (cmsg->cmsg_level != SOL_SOCKET) {
+                        continue;
+                }
+                switch (cmsg->cmsg_type) {
+#ifdef SO_RXQ_OVFL
+                case SO_RXQ_OVFL:
+                        {
+                                uint32_t drops = 0;
+                                memcpy(&drops, CMSG_DATA(cmsg), sizeof drops);
+                                atomic_store_explicit(&r->kernel_drops, drops, memory_order_relaxed);
+                                break;
+                        }
+#endif
+#ifdef HAVE_LINUX
+                case SCM_TIMESTAMPNS:
+                case SCM_TIMESTAMPING: // ts[0] software, ts[2] raw hardware
+                        {
+                                struct timespec tss[3] = { { 0, 0 }, { 0, 0 }, { 0, 0 } };
+                                memcpy(tss, CMSG_DATA(cmsg), cmsg->cmsg_type == SCM_TIMESTAMPNS ? sizeof tss[0] : sizeof tss);
+                                const struct timespec *t = tss[2].tv_sec != 0 ? &tss[2] : &tss[0];
+                                ts = t->tv_sec * NS_IN_SEC + t->tv_nsec;
+                                break;
+                        }
+#endif
+                }
+        }
+        return ts;
+}
+
+/// @param control  buffer for ancillary data (UDP_RX_CMSG_SPACE), may be NULL
+static void udp_reader_reset_msg(struct mmsghdr *msg, char *control)
+{
+        msg->msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        if (control != NULL) {
+                msg->msg_hdr.msg_control = control;
+                msg->msg_hdr.msg_controllen = UDP_RX_CMSG_SPACE;
+        }
+}
+
+static uint8_t *udp_reader_alloc_packet(struct mmsghdr *msg, struct iovec *iov, char *control)
+{
+        uint8_t *packet = (uint8_t *) malloc(ALIGNED_ITEM_OFF + sizeof(struct item));
+        iov->iov_base = packet + RTP_PACKET_HEADER_SIZE;
+        iov->iov_len = RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE;
+        memset(&msg->msg_hdr, 0, sizeof msg->msg_hdr);
+        msg->msg_hdr.msg_iov = iov;
+        msg->msg_hdr.msg_iovlen = 1;
+        msg->msg_hdr.msg_name = packet + ALIGNED_SOCKADDR_STORAGE_OFF;
+        udp_reader_reset_msg(msg, control);
+        return packet;
+}
+
+/**
+ * Variant of udp_reader() receiving up to recv_batch datagrams with one
+ * recvmmsg() call. Received packets are appended to the queue under a single
+ * lock acquisition.
+ *
+ * Packet buffers are allocated in advance (and re-filled after handing the
+ * batch over) because the consumer takes ownership of each packet and frees
+ * it individually.
+ *
+ * The socket drop counter (SO_RXQ_OVFL) is taken from the last datagram of
+ * each batch, RX timestamps (udp-rx-timestamps) from each of them.
+ */
+static void *udp_reader_mmsg(void *arg)
+{
+        set_thread_name("udp_reader");
+        struct udp_rx_reader *r = (struct udp_rx_reader *) arg;
+        udp_reader_pin(r);
+        socket_udp *s = r->s;
+        const int batch = s->local->recv_batch;
+        struct mmsghdr *msgs = (struct mmsghdr *) calloc(batch, sizeof msgs[0]);
+        struct iovec *iov = (struct iovec *) calloc(batch, sizeof iov[0]);
+        uint8_t **packets = (uint8_t **) calloc(batch, sizeof packets[0]);
+        char *control = NULL; ///< ancillary data buffers, [batch * UDP_RX_CMSG_SPACE]
+        if (UDP_RX_CMSG_SPACE > 0) {
+                control = (char *) calloc(batch, UDP_RX_CMSG_SPACE);
+        }
+#ifdef HAVE_XDP
+        if (s->local->xdp) {
+                free(control);
+                control = NULL;
+        }
+#endif
+        for (int i = 0; i < batch; ++i) {
+                packets[i] = udp_reader_alloc_packet(&msgs[i], &iov[i], control ? control + i * UDP_RX_CMSG_SPACE : NULL);
+        }
+
+        fd_t rx_fd = r->fd;
+#ifdef HAVE_XDP
+        if (s->local->xdp) {
+                rx_fd = xdp_rx_fd(s->local->xdp);
+        }
+#endif
+
+        while (1) {
+                fd_set fds;
+                FD_ZERO(&fds);
+                FD_SET(rx_fd, &fds);
+                FD_SET(s->local->should_exit_fd[0], &fds);
+                int nfds = MAX(rx_fd, s->local->should_exit_fd[0]) + 1;
+
+                int rc = select(nfds, &fds, NULL, NULL, NULL);
+                if (rc <= 0) {
+                        socket_error("select");
+                        continue;
+                }
+                if (FD_ISSET(s->local->should_exit_fd[0], &fds)) {
+                        break;
+                }
+#ifdef HAVE_XDP
+                int count = s->local->xdp
+                        ? xdp_rx_recv(s->local->xdp, msgs, batch)
+                        : recvmmsg(r->fd, msgs, batch, MSG_DONTWAIT, NULL);
+#else
+                int count = recvmmsg(r->fd, msgs, batch, MSG_DONTWAIT, NULL);
+#endif
+                if (count <= 0) {
+                        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                                socket_error("recvmmsg");
+                        }
+                        continue;
+                }
+                const bool timestamps = control != NULL && s->local->rx_timestamps != UDP_RX_TS_NONE;
+                const long long now = timestamps ? get_time_in_ns() : 0;
+                if (control != NULL && !timestamps) {
+                        udp_reader_parse_cmsg(r, &msgs[count - 1].msg_hdr);
+                }
+
+                struct item *items[count];
+                int appended = 0;
+                for (int i = 0; i < count; ++i) {
+                        if (msgs[i].msg_len == 0) {
+                                continue;
+                        }
+                        uint8_t *packet = packets[i];
+                        long long ts = timestamps ? udp_reader_parse_cmsg(r, &msgs[i].msg_hdr) : 0;
+                        if (ts != 0 && llabs(now - ts) > UDP_RX_TS_MAX_SKEW) {
+                                if (!r->ts_skew_warned) {
+                                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "RX timestamp differs from system time by %lld ms, ignoring "
+                                                        "timestamps (is the NIC clock synchronized?)\n", (now - ts) / NS_IN_MS);
+                                        r->ts_skew_warned = true;
+                                }
+                                ts = 0;
+                        }
+                        ((rtp_packet *)(void *) packet)->arrival_ns = ts;
+                        struct item *it = (struct item *)(void *)(packet + ALIGNED_ITEM_OFF);
+                        *it = (struct item){packet, (int) msgs[i].msg_len,
+                                (struct sockaddr *) msgs[i].msg_hdr.msg_name, msgs[i].msg_hdr.msg_namelen};
+                        items[appended++] = it;
+                        packets[i] = NULL;
+                }
+                if (appended > 0 && !udp_queue_push(s->local, r->ring, items, appended)) {
+                        for (int i = 0; i < appended; ++i) { // not enqueued in locked mode
+                                if (items[i] != NULL && s->local->locked_queue) {
+                                        free(items[i]->buf);
+                                }
+                        }
+                        break;
+                }
+
+                for (int i = 0; i < count; ++i) {
+                        if (packets[i] == NULL) {
+                                packets[i] = udp_reader_alloc_packet(&msgs[i], &iov[i], control ? control + i * UDP_RX_CMSG_SPACE : NULL);
+                        } else { // empty datagram - only reset the header
+                                udp_reader_reset_msg(&msgs[i], control ? control + i * UDP_RX_CMSG_SPACE : NULL);
+                        }
+                }
+        }
+
+        for (int i = 0; i < batch; ++i) {
+                free(packets[i]);
+        }
+        free(control);
+        free(packets);
+        free(iov);
+        free(msgs);
+
+        return NULL;
+}
+#endif // defined HAVE_RECVMMSG
+
+static int udp_do_recv(socket_udp * s, char *buffer, int buflen, int flags, struct sockaddr *src_addr, socklen_t *addrlen)
 {
         /* Reads data into the buffer, returning the number of bytes read.   */
         /* If no data is available, this returns the value zero immediately. */
@@ -1191,29 +2322,7 @@ bool udp_not_empty(socket_udp * s, struct timeval *timeout)
 {
         assert(s->local->multithreaded);
 
-        pthread_mutex_lock(&s->local->lock);
-        if (timeout) {
-                struct timeval tv;
-                gettimeofday(&tv, NULL);
-                tv.tv_sec += timeout->tv_sec;
-                tv.tv_usec += timeout->tv_usec;
-                if (tv.tv_usec >= 1000000) {
-                        tv.tv_sec += 1;
-                        tv.tv_usec -= 1000000;
-                }
-                struct timespec tmout_ts = { tv.tv_sec, tv.tv_usec * 1000 };
-                int rc = 0;
-                while (rc != ETIMEDOUT && simple_linked_list_size(s->local->packets) == 0) {
-                        rc = pthread_cond_timedwait(&s->local->boss_cv, &s->local->lock, &tmout_ts);
-                }
-        } else {
-                while (simple_linked_list_size(s->local->packets) == 0) {
-                        pthread_cond_wait(&s->local->boss_cv, &s->local->lock);
-                }
-        }
-        bool ret = simple_linked_list_size(s->local->packets) > 0;
-        pthread_mutex_unlock(&s->local->lock);
-        return ret;
+        return udp_queue_wait(s->local, timeout);
 }
 
 /**
@@ -1251,25 +2360,18 @@ int udp_recvfrom_data(socket_udp * s, char **buffer,
                 struct sockaddr *src_addr, socklen_t *addrlen)
 {
         assert(s->local->multithreaded);
-        int ret;
 
-        pthread_mutex_lock(&s->local->lock);
-        struct item *it = (struct item *)(simple_linked_list_pop(s->local->packets));
-        *buffer = (char *) it->buf;
+        struct item it = udp_queue_pop(s->local);
+        *buffer = (char *) it.buf;
         if(src_addr){
-                if(it->src_addr){
-                        memcpy(src_addr, it->src_addr, it->addrlen);
-                        *addrlen = it->addrlen;
+                if(it.src_addr){
+                        memcpy(src_addr, it.src_addr, it.addrlen);
+                        *addrlen = it.addrlen;
                 } else {
                         *addrlen = 0;
                 }
         }
-        ret = it->size;
-
-        pthread_mutex_unlock(&s->local->lock);
-        pthread_cond_signal(&s->local->reader_cv);
-
-        return ret;
+        return it.size;
 }
 int udp_recv_data(socket_udp * s, char **buffer){
         return udp_recvfrom_data(s, buffer, NULL, NULL);
@@ -1434,6 +2536,13 @@ bool udp_set_recv_buf(socket_udp *s, int size)
                 socket_error("Unable to set socket buffer size");
                 return false;
         }
+        for (int i = 1; i < s->local->reader_count; ++i) { // other sockets of SO_REUSEPORT group
+                if (SETSOCKOPT(s->local->readers[i].fd, SOL_SOCKET, SO_RCVBUF, (sockopt_t) &size,
+                                sizeof(size)) != 0) {
+                        socket_error("Unable to set socket buffer size");
+                        return false;
+                }
+        }
 
         opt_size = sizeof(opt);
         if(GETSOCKOPT (s->local->rx_fd, SOL_SOCKET, SO_RCVBUF, (sockopt_t)&opt,
@@ -1451,6 +2560,36 @@ bool udp_set_recv_buf(socket_udp *s, int size)
         return true;
 }
 
+/**
+ * Returns the socket buffer size needed to hold data received (or sent) at
+ * the given bitrate during the given time, clamped to sane bounds.
+ *
+ * @param bitrate   bits per second
+ * @param duration  seconds
+ */
+int udp_buf_size_for_rate(long long bitrate, double duration)
+{
+        double size = bitrate / 8.0 * duration * 1.25; // headroom for headers and bursts
+        if (size < UDP_BUF_SIZE_MIN) {
+                return UDP_BUF_SIZE_MIN;
+        }
+        return size > UDP_BUF_SIZE_MAX ? UDP_BUF_SIZE_MAX : (int) size;
+}
+
+/**
+ * @returns number of received datagrams the kernel dropped, because the
+ * receive buffer was full, since the socket creation (SO_RXQ_OVFL). Available
+ * for multithreaded sockets receiving in batches, 0 otherwise.
+ */
+uint64_t udp_get_rx_drops(socket_udp *s)
+{
+        uint64_t drops = 0;
+        for (int i = 0; i < s->local->reader_count; ++i) {
+                drops += atomic_load_explicit(&s->local->readers[i].kernel_drops, memory_order_relaxed);
+        }
+        return drops;
+}
+
 bool udp_set_send_buf(socket_udp *s, int size)
 {
         int opt = 0;
@@ -1505,14 +2644,189 @@ void udp_flush_recv_buf(socket_udp *s)
         free(buf);
 }
 
+#ifdef HAVE_SENDMMSG
+static struct udp_send_batch *udp_batch_init(socket_udp *s)
+{
+        struct udp_send_batch *b = (struct udp_send_batch *) calloc(1, sizeof *b);
+        b->capacity = DEFAULT_UDP_SEND_BATCH;
+        if (get_commandline_param("udp-send-batch")) {
+                b->capacity = atoi(get_commandline_param("udp-send-batch"));
+        }
+        b->capacity = CLAMP(b->capacity, 1, UDP_SEND_BATCH_MAX);
+        b->msgs = (struct mmsghdr *) calloc(b->capacity, sizeof b->msgs[0]);
+        b->iov = (struct iovec *) calloc(b->capacity * UDP_SENDV_MAX_IOV, sizeof b->iov[0]);
+        b->dispose_udata = (void **) calloc(b->capacity, sizeof b->dispose_udata[0]);
+        b->txtime_cmsg = (char *) calloc(b->capacity, UDP_TXTIME_CMSG_SPACE);
+
+#ifdef UDP_SEGMENT
+        int gso_size = 0;
+        socklen_t len = sizeof gso_size;
+        // getsockopt succeeds only if the kernel knows UDP_SEGMENT (Linux 4.18+)
+        b->gso = get_commandline_param("udp-disable-gso") == NULL &&
+                GETSOCKOPT(s->local->tx_fd, SOL_UDP, UDP_SEGMENT, (sockopt_t) &gso_size, &len) == 0;
+        if (b->gso) {
+                b->gso_msgs = (struct mmsghdr *) calloc(b->capacity, sizeof b->gso_msgs[0]);
+                b->gso_iov = (struct iovec *) calloc(b->capacity * UDP_SENDV_MAX_IOV, sizeof b->gso_iov[0]);
+                b->gso_first = (int *) calloc(b->capacity + 1, sizeof b->gso_first[0]);
+                b->gso_cmsg = (char *) calloc(b->capacity, CMSG_SPACE(sizeof(uint16_t)));
+        }
+#else
+        UNUSED(s);
+#endif
+        verbose_msg(MOD_NAME "Sending in batches of %d packets%s.\n", b->capacity, b->gso ? " with GSO" : "");
+        return b;
+}
+
+static size_t iov_total_len(const struct iovec *iov, int count)
+{
+        size_t ret = 0;
+        for (int i = 0; i < count; ++i) {
+                ret += iov[i].iov_len;
+        }
+        return ret;
+}
+
+/**
+ * Sends msgs[0..count-1], retrying on partial sends.
+ * @returns index of the first message that failed or count if all were sent
+ */
+static int udp_sendmmsg_all(fd_t fd, struct mmsghdr *msgs, int count, bool stop_on_error)
+{
+        int sent = 0;
+        while (sent < count) {
+                int ret = sendmmsg(fd, msgs + sent, count - sent, 0);
+                if (ret >= 0) {
+                        sent += ret;
+                        continue;
+                }
+                if (errno == EINTR) {
+                        continue;
+                }
+                if (stop_on_error) {
+                        return sent;
+                }
+                socket_error("sendmmsg");
+                sent += 1; // drop the offending packet
+        }
+        return sent;
+}
+
+#ifdef UDP_SEGMENT
+/**
+ * Coalesces runs of equally-sized packets (the last of a run may be shorter)
+ * into single UDP_SEGMENT messages and sends them.
+ * @returns index of first packet not sent due to GSO error, b->count on success
+ */
+static int udp_batch_send_gso(socket_udp *s)
+{
+        struct udp_send_batch *b = s->batch;
+        int gso_count = 0;
+        struct iovec *iov = b->gso_iov;
+        for (int i = 0; i < b->count; ) {
+                struct msghdr *first = &b->msgs[i].msg_hdr;
+                size_t seg_len = iov_total_len(first->msg_iov, first->msg_iovlen);
+                size_t total = 0;
+                int start = i;
+                struct msghdr *m = &b->gso_msgs[gso_count].msg_hdr;
+                *m = *first;
+                m->msg_iov = iov;
+                m->msg_iovlen = 0;
+                while (i < b->count && i - start < UDP_GSO_MAX_SEGS) {
+                        struct msghdr *cur = &b->msgs[i].msg_hdr;
+                        size_t len = iov_total_len(cur->msg_iov, cur->msg_iovlen);
+                        if (len > seg_len || total + len > UDP_GSO_MAX_LEN) {
+                                break;
+                        }
+                        memcpy(iov, cur->msg_iov, cur->msg_iovlen * sizeof *iov);
+                        iov += cur->msg_iovlen;
+                        m->msg_iovlen += cur->msg_iovlen;
+                        total += len;
+                        i += 1;
+                        if (len < seg_len) { // only the last segment can be shorter
+                                break;
+                        }
+                }
+                if (i - start > 1) {
+                        m->msg_control = b->gso_cmsg + gso_count * CMSG_SPACE(sizeof(uint16_t));
+                        m->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+                        struct cmsghdr *cm = CMSG_FIRSTHDR(m);
+                        cm->cmsg_level = SOL_UDP;
+                        cm->cmsg_type = UDP_SEGMENT;
+                        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                        uint16_t gso_size = seg_len;
+                        memcpy(CMSG_DATA(cm), &gso_size, sizeof gso_size);
+                }
+                b->gso_first[gso_count++] = start;
+        }
+        b->gso_first[gso_count] = b->count;
+
+        int sent = udp_sendmmsg_all(s->local->tx_fd, b->gso_msgs, gso_count, true);
+        if (sent == gso_count) {
+                return b->count;
+        }
+        // EIO is returned if the device doesn't support checksum offload
+        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Sending with GSO failed (%s), disabling.\n", ug_strerror(errno));
+        b->gso = false;
+        return b->gso_first[sent];
+}
+#endif // defined UDP_SEGMENT
+
+static void udp_batch_flush(socket_udp *s)
+{
+        struct udp_send_batch *b = s->batch;
+        if (b->count == 0) {
+                return;
+        }
+        int first_unsent = 0;
+#ifdef UDP_SEGMENT
+        if (b->gso && s->pacing != UDP_PACING_TXTIME) { // GSO would merge packets with different departure times
+                first_unsent = udp_batch_send_gso(s);
+        }
+#endif
+        udp_sendmmsg_all(s->local->tx_fd, b->msgs + first_unsent, b->count - first_unsent, false);
+        for (int i = 0; i < b->count; ++i) {
+                free(b->dispose_udata[i]);
+        }
+        b->count = 0;
+}
+
+static void udp_batch_enqueue(socket_udp *s, struct iovec *vector, int count, void *d)
+{
+        struct udp_send_batch *b = s->batch;
+        assert(count <= UDP_SENDV_MAX_IOV);
+        struct iovec *iov = b->iov + b->count * UDP_SENDV_MAX_IOV;
+        memcpy(iov, vector, count * sizeof *iov);
+        struct msghdr *m = &b->msgs[b->count].msg_hdr;
+        memset(m, 0, sizeof *m);
+        m->msg_name = (void *) &s->sock;
+        m->msg_namelen = s->sock_len;
+        m->msg_iov = iov;
+        m->msg_iovlen = count;
+#ifdef SO_TXTIME
+        udp_stamp_txtime(s, m, b->txtime_cmsg + b->count * UDP_TXTIME_CMSG_SPACE);
+#endif
+        b->dispose_udata[b->count] = d;
+        if (++b->count == b->capacity) {
+                udp_batch_flush(s);
+        }
+}
+#endif // defined HAVE_SENDMMSG
+
 /**
  * By calling this function under MSW, caller indicates that following packets
  * can be send in asynchronous manner. Caller should then call udp_async_wait()
  * to ensure that all packets were actually sent.
+ *
+ * If sendmmsg() is available, packets are instead queued and sent in batches
+ * of udp_async_batch_size() packets, remainder is sent by udp_async_wait().
  */
 void udp_async_start(socket_udp *s, int nr_packets)
 {
 #ifdef WIN32
+        if (s->local->rio_tx != NULL) { // sends deferred until udp_async_wait()
+                s->overlapping_active = true;
+                return;
+        }
         if (!s->local->is_wsa_overlapped) {
                 return;
         }
@@ -1531,17 +2845,48 @@ void udp_async_start(socket_udp *s, int nr_packets)
 
         s->overlapped_count = 0;
         s->overlapping_active = true;
+#elif defined HAVE_SENDMMSG
+        if (nr_packets <= 1) {
+                return;
+        }
+        if (s->batch == NULL) {
+                s->batch = udp_batch_init(s);
+        }
+        if (s->batch->capacity > 1) {
+                s->batch->active = true;
+        }
 #else
         UNUSED(nr_packets);
         UNUSED(s);
 #endif
 }
 
+/**
+ * Returns number of packets that are passed to the kernel at once when sending
+ * in async mode. Intended for the traffic shaper to wait per batch instead of
+ * per packet.
+ */
+int udp_async_batch_size(socket_udp *s)
+{
+#ifdef HAVE_SENDMMSG
+        if (s->batch != NULL && s->batch->active) {
+                return s->batch->capacity;
+        }
+#endif
+        UNUSED(s);
+        return 1;
+}
+
 void udp_async_wait(socket_udp *s)
 {
 #ifdef WIN32
         if (!s->overlapping_active)
                 return;
+        if (s->local->rio_tx != NULL) {
+                rio_commit(s->local->rio_tx);
+                s->overlapping_active = false;
+                return;
+        }
         for(int i = 0; i < s->overlapped_count; i += WSA_MAXIMUM_WAIT_EVENTS)
         {
                 int count = WSA_MAXIMUM_WAIT_EVENTS;
@@ -1559,6 +2904,12 @@ void udp_async_wait(socket_udp *s)
                 free(s->dispose_udata[i]);
         }
         s->overlapping_active = false;
+#elif defined HAVE_SENDMMSG
+        if (s->batch == NULL || !s->batch->active) {
+                return;
+        }
+        udp_batch_flush(s);
+        s->batch->active = false;
 #else
         UNUSED(s);
 #endif
@@ -1573,8 +2924,136 @@ static void udp_clean_async_state(socket_udp *s)
         free(s->overlapped);
         free(s->overlapped_events);
         free(s->dispose_udata);
+#elif defined HAVE_SENDMMSG
+        if (s->batch == NULL) {
+                return;
+        }
+        udp_batch_flush(s);
+        free(s->batch->msgs);
+        free(s->batch->iov);
+        free(s->batch->dispose_udata);
+        free(s->batch->txtime_cmsg);
+        free(s->batch->gso_msgs);
+        free(s->batch->gso_iov);
+        free(s->batch->gso_first);
+        free(s->batch->gso_cmsg);
+        free(s->batch);
+#else
+        UNUSED(s);
+#endif
+}
+
+/**
+ * Lets the kernel pace sent packets instead of the caller. Packets are paced
+ * according to udp_set_pacing_interval().
+ *
+ * UDP_PACING_FQ sets SO_MAX_PACING_RATE, which is honored by the fq qdisc (or
+ * TCP-internal pacing), UDP_PACING_TXTIME stamps every packet with its
+ * departure time (SO_TXTIME), requires fq qdisc or etf qdisc with
+ * udp-txtime-clock=tai (etf drops packets with other clock).
+ *
+ * @retval false  requested pacing is not supported, caller should pace itself
+ */
+bool udp_set_pacing(socket_udp *s, enum udp_pacing pacing)
+{
+        if (s->pacing == pacing) {
+                return true;
+        }
+        switch (pacing) {
+        case UDP_PACING_NONE:
+                break;
+        case UDP_PACING_FQ:
+#ifdef SO_MAX_PACING_RATE
+                break;
+#else
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "SO_MAX_PACING_RATE is not supported!\n");
+                return false;
+#endif
+        case UDP_PACING_TXTIME:
+        {
+#ifdef SO_TXTIME
+                clockid_t clock = CLOCK_MONOTONIC;
+                const char *clock_cfg = get_commandline_param("udp-txtime-clock");
+                if (clock_cfg != NULL && strcmp(clock_cfg, "tai") == 0) {
+                        clock = CLOCK_TAI;
+                } else if (clock_cfg != NULL && strcmp(clock_cfg, "mono") != 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown SO_TXTIME clock: %s\n", clock_cfg);
+                        return false;
+                }
+                struct sock_txtime cfg = { .clockid = clock, .flags = 0 };
+                if (SETSOCKOPT(s->local->tx_fd, SOL_SOCKET, SO_TXTIME, (sockopt_t) &cfg, sizeof cfg) != 0) {
+                        socket_error("setsockopt SO_TXTIME");
+                        return false;
+                }
+                s->txtime_clock = clock;
+                break;
+#else
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "SO_TXTIME is not supported!\n");
+                return false;
+#endif
+        }
+        }
+        s->pacing = pacing;
+        s->pacing_interval_ns = 0;
+        s->pacing_rate = 0;
+        s->next_txtime = 0;
+        return true;
+}
+
+/**
+ * Sets inter-packet interval for subsequently sent packets if kernel pacing
+ * is used, see udp_set_pacing().
+ *
+ * @param interval_ns  inter-packet gap, 0 for unpaced sending
+ * @param packet_len   average packet length (used to compute rate for UDP_PACING_FQ)
+ */
+void udp_set_pacing_interval(socket_udp *s, long interval_ns, int packet_len)
+{
+        s->pacing_interval_ns = interval_ns;
+#ifdef SO_MAX_PACING_RATE
+        if (s->pacing == UDP_PACING_FQ) {
+                unsigned int rate = interval_ns == 0 ? UINT_MAX :
+                        MIN((uint64_t) packet_len * 1000000000ULL / interval_ns, UINT_MAX);
+                if (rate != s->pacing_rate && SETSOCKOPT(s->local->tx_fd, SOL_SOCKET,
+                                        SO_MAX_PACING_RATE, (sockopt_t) &rate, sizeof rate) != 0) {
+                        socket_error("setsockopt SO_MAX_PACING_RATE");
+                }
+                s->pacing_rate = rate;
+        }
+#else
+        UNUSED(packet_len);
+#endif
+#ifdef SO_TXTIME
+        if (s->pacing == UDP_PACING_TXTIME) {
+                struct timespec ts;
+                clock_gettime(s->txtime_clock, &ts);
+                uint64_t now = (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+                s->next_txtime = MAX(s->next_txtime, now);
+        }
+#endif
+}
+
+/**
+ * Sets the departure time of the next packet sent with UDP_PACING_TXTIME, the
+ * following ones depart in the interval set by udp_set_pacing_interval()
+ * (which must be called first). Times in the past are replaced by now.
+ *
+ * @param start  wall-clock time (get_time_in_ns())
+ */
+void udp_set_pacing_start(socket_udp *s, long long start)
+{
+#ifdef SO_TXTIME
+        if (s->pacing != UDP_PACING_TXTIME) {
+                return;
+        }
+        struct timespec ts;
+        clock_gettime(s->txtime_clock, &ts);
+        const uint64_t now = (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        const long long delay = start - get_time_in_ns();
+        s->next_txtime = delay > 0 ? now + delay : now;
 #else
         UNUSED(s);
+        UNUSED(start);
 #endif
 }
 
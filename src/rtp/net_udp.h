@@ -53,6 +53,12 @@
 typedef struct _socket_udp socket_udp; 
 struct socket_udp_local;
 
+enum udp_pacing {
+        UDP_PACING_NONE,   ///< no pacing (done by caller)
+        UDP_PACING_FQ,     ///< SO_MAX_PACING_RATE
+        UDP_PACING_TXTIME, ///< SO_TXTIME
+};
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -71,14 +77,18 @@ int         udp_recvfrom_timeout(socket_udp *s, char *buffer, int buflen,
 int         udp_recvfrom(socket_udp *s, char *buffer, int buflen, struct sockaddr *src_addr, socklen_t *addrlen);
 int         udp_send(socket_udp *s, char *buffer, int buflen);
 int         udp_sendto(socket_udp *s, char *buffer, int buflen, struct sockaddr *dst_addr, socklen_t addrlen);
+int         udp_send_multi(socket_udp *s, char **buffers, const int *buflens, int count, bool nonblock);
 
 int         udp_recvv(socket_udp *s, struct msghdr *m);
 void        udp_async_start(socket_udp *s, int nr_packets);
 void        udp_async_wait(socket_udp *s);
+int         udp_async_batch_size(socket_udp *s);
 #ifdef WIN32
 int         udp_sendv(socket_udp *s, LPWSABUF vector, int count, void *d);
+int         udp_sendv_multi(socket_udp *s, LPWSABUF vector, const int *counts, int packets);
 #else
 int         udp_sendv(socket_udp *s, struct iovec *vector, int count, void *d);
+int         udp_sendv_multi(socket_udp *s, struct iovec *vector, const int *counts, int packets);
 #endif
 
 char       *udp_host_addr(socket_udp *s);
@@ -89,8 +99,14 @@ void	    udp_fd_zero(void);
 void        udp_fd_set(socket_udp *s);
 int         udp_fd_isset(socket_udp *s);
 
+bool        udp_set_pacing(socket_udp *s, enum udp_pacing pacing);
+void        udp_set_pacing_interval(socket_udp *s, long interval_ns, int packet_len);
+void        udp_set_pacing_start(socket_udp *s, long long start);
+
 bool        udp_set_recv_buf(socket_udp *s, int size);
 bool        udp_set_send_buf(socket_udp *s, int size);
+int         udp_buf_size_for_rate(long long bitrate, double duration);
+uint64_t    udp_get_rx_drops(socket_udp *s);
 void        udp_flush_recv_buf(socket_udp *s);
 
 struct udp_fd_r {
@@ -107,6 +123,7 @@ int         udp_recv_data(socket_udp * s, char **buffer);
 int         udp_recvfrom_data(socket_udp * s, char **buffer,
                 struct sockaddr *src_addr, socklen_t *addrlen);
 bool        udp_not_empty(socket_udp *s, struct timeval *timeout);
+bool        udp_inject_data(socket_udp *s, const char *data, int len);
 int         udp_port_pair_is_free(int force_ip_version, int even_port);
 bool        udp_is_ipv6(socket_udp *s);
 
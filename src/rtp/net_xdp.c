@@ -0,0 +1,283 @@
+/**
+ * @file   rtp/net_xdp.c
+ * @brief  AF_XDP (kernel bypass) receive backend for socket_udp
+ *
+ * Frames are received into an UMEM area shared with the kernel, UDP payload of
+ * matching datagrams is then copied into the packet buffers provided by the
+ * caller (udp_reader_mmsg()) in the same layout as recvmmsg() would produce.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#endif // HAVE_CONFIG_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <xdp/xsk.h>
+
+#include "debug.h"
+#include "rtp/net_xdp.h"
+#include "utils/macros.h"
+
+#define MOD_NAME "[RTP XDP] "
+#define XDP_NUM_FRAMES 8192
+#define XDP_FRAME_SIZE XSK_UMEM__DEFAULT_FRAME_SIZE
+#define XDP_FILL_SIZE (XSK_RING_PROD__DEFAULT_NUM_DESCS * 2)
+#define XDP_RX_SIZE XSK_RING_CONS__DEFAULT_NUM_DESCS
+#define VLAN_HLEN 4
+
+struct xdp_rx {
+        void *umem_area;
+        struct xsk_umem *umem;
+        struct xsk_ring_prod fq;
+        struct xsk_ring_cons cq;
+        struct xsk_socket *xsk;
+        struct xsk_ring_cons rx;
+        uint16_t port; ///< network byte order
+};
+
+static void xdp_rx_refill(struct xdp_rx *x, const uint64_t *addrs, unsigned int count)
+{
+        uint32_t idx = 0;
+        unsigned int reserved = xsk_ring_prod__reserve(&x->fq, count, &idx);
+        for (unsigned int i = 0; i < reserved; ++i) {
+                *xsk_ring_prod__fill_addr(&x->fq, idx++) = addrs[i];
+        }
+        xsk_ring_prod__submit(&x->fq, reserved);
+}
+
+struct xdp_rx *xdp_rx_init(const char *cfg, uint16_t rx_port)
+{
+        char iface[IF_NAMESIZE] = "";
+        int queue = 0;
+        const char *colon = strchr(cfg, ':');
+        snprintf(iface, sizeof iface, "%.*s", colon ? (int) (colon - cfg) : (int) strlen(cfg), cfg);
+        if (colon) {
+                queue = atoi(colon + 1);
+        }
+
+        struct xdp_rx *x = calloc(1, sizeof *x);
+        x->port = htons(rx_port);
+        size_t umem_size = (size_t) XDP_NUM_FRAMES * XDP_FRAME_SIZE;
+        if (posix_memalign(&x->umem_area, getpagesize(), umem_size) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot allocate UMEM!\n");
+                free(x);
+                return NULL;
+        }
+
+        struct xsk_umem_config umem_cfg = {
+                .fill_size = XDP_FILL_SIZE,
+                .comp_size = XSK_RING_CONS__DEFAULT_NUM_DESCS,
+                .frame_size = XDP_FRAME_SIZE,
+                .frame_headroom = 0,
+                .flags = 0,
+        };
+        int ret = xsk_umem__create(&x->umem, x->umem_area, umem_size, &x->fq, &x->cq, &umem_cfg);
+        if (ret != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create UMEM: %s\n", strerror(-ret));
+                xdp_rx_done(x);
+                return NULL;
+        }
+
+        struct xsk_socket_config xsk_cfg = {
+                .rx_size = XDP_RX_SIZE,
+                .tx_size = XSK_RING_PROD__DEFAULT_NUM_DESCS,
+                .bind_flags = XDP_USE_NEED_WAKEUP,
+        };
+        ret = xsk_socket__create(&x->xsk, iface, queue, x->umem, &x->rx, NULL, &xsk_cfg);
+        if (ret != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create AF_XDP socket on %s queue %d: %s\n",
+                                iface, queue, strerror(-ret));
+                xdp_rx_done(x);
+                return NULL;
+        }
+
+        uint64_t addrs[XDP_FILL_SIZE];
+        for (int i = 0; i < XDP_FILL_SIZE; ++i) {
+                addrs[i] = (uint64_t) i * XDP_FRAME_SIZE;
+        }
+        xdp_rx_refill(x, addrs, XDP_FILL_SIZE);
+
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Receiving port %d on %s queue %d with AF_XDP.\n",
+                        rx_port, iface, queue);
+        return x;
+}
+
+void xdp_rx_done(struct xdp_rx *x)
+{
+        if (x == NULL) {
+                return;
+        }
+        if (x->xsk) {
+                xsk_socket__delete(x->xsk);
+        }
+        if (x->umem) {
+                xsk_umem__delete(x->umem);
+        }
+        free(x->umem_area);
+        free(x);
+}
+
+int xdp_rx_fd(struct xdp_rx *x)
+{
+        return xsk_socket__fd(x->xsk);
+}
+
+/**
+ * Checks that frame is UDP datagram for our port.
+ *
+ * @param[out] payload     UDP payload
+ * @param[out] src         source address
+ * @returns    length of the payload, -1 if the frame doesn't match
+ */
+static int parse_frame(struct xdp_rx *x, uint8_t *frame, uint32_t len,
+                uint8_t **payload, struct sockaddr_storage *src, socklen_t *src_len)
+{
+        if (len < sizeof(struct ether_header)) {
+                return -1;
+        }
+        uint16_t ethertype = ((struct ether_header *)(void *) frame)->ether_type;
+        uint32_t off = sizeof(struct ether_header);
+        if (ethertype == htons(ETHERTYPE_VLAN) && len >= off + VLAN_HLEN) {
+                memcpy(&ethertype, frame + off + 2, sizeof ethertype);
+                off += VLAN_HLEN;
+        }
+
+        struct udphdr udp;
+        if (ethertype == htons(ETHERTYPE_IP)) {
+                if (len < off + sizeof(struct iphdr)) {
+                        return -1;
+                }
+                struct iphdr *ip = (struct iphdr *)(void *) (frame + off);
+                if (ip->protocol != IPPROTO_UDP || (ip->frag_off & htons(IP_MF | IP_OFFMASK)) != 0) {
+                        return -1;
+                }
+                struct sockaddr_in *sin = (struct sockaddr_in *)(void *) src;
+                memset(sin, 0, sizeof *sin);
+                sin->sin_family = AF_INET;
+                sin->sin_addr.s_addr = ip->saddr;
+                *src_len = sizeof *sin;
+                off += ip->ihl * 4;
+        } else if (ethertype == htons(ETHERTYPE_IPV6)) {
+                if (len < off + sizeof(struct ip6_hdr)) {
+                        return -1;
+                }
+                struct ip6_hdr *ip6 = (struct ip6_hdr *)(void *) (frame + off);
+                if (ip6->ip6_nxt != IPPROTO_UDP) { // extension headers not handled
+                        return -1;
+                }
+                struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)(void *) src;
+                memset(sin6, 0, sizeof *sin6);
+                sin6->sin6_family = AF_INET6;
+                sin6->sin6_addr = ip6->ip6_src;
+                *src_len = sizeof *sin6;
+                off += sizeof(struct ip6_hdr);
+        } else {
+                return -1;
+        }
+
+        if (len < off + sizeof udp) {
+                return -1;
+        }
+        memcpy(&udp, frame + off, sizeof udp);
+        if (udp.uh_dport != x->port) {
+                return -1;
+        }
+        uint32_t udp_len = ntohs(udp.uh_ulen);
+        if (udp_len < sizeof udp || off + udp_len > len) {
+                return -1;
+        }
+        if (src->ss_family == AF_INET) {
+                ((struct sockaddr_in *)(void *) src)->sin_port = udp.uh_sport;
+        } else {
+                ((struct sockaddr_in6 *)(void *) src)->sin6_port = udp.uh_sport;
+        }
+        *payload = frame + off + sizeof udp;
+        return udp_len - sizeof udp;
+}
+
+int xdp_rx_recv(struct xdp_rx *x, struct mmsghdr *msgs, int count)
+{
+        uint32_t idx = 0;
+        unsigned int rcvd = xsk_ring_cons__peek(&x->rx, count, &idx);
+        if (rcvd == 0) {
+                if (xsk_ring_prod__needs_wakeup(&x->fq)) {
+                        recvfrom(xsk_socket__fd(x->xsk), NULL, 0, MSG_DONTWAIT, NULL, NULL);
+                }
+                errno = EAGAIN;
+                return 0;
+        }
+
+        uint64_t addrs[rcvd];
+        int filled = 0;
+        for (unsigned int i = 0; i < rcvd; ++i) {
+                const struct xdp_desc *desc = xsk_ring_cons__rx_desc(&x->rx, idx++);
+                addrs[i] = desc->addr; // kernel aligns the address to the chunk start
+                uint8_t *frame = xsk_umem__get_data(x->umem_area, desc->addr);
+
+                struct msghdr *m = &msgs[filled].msg_hdr;
+                struct sockaddr_storage src;
+                socklen_t src_len = 0;
+                uint8_t *payload = NULL;
+                int payload_len = parse_frame(x, frame, desc->len, &payload, &src, &src_len);
+                if (payload_len < 0 || (size_t) payload_len > m->msg_iov[0].iov_len) {
+                        continue;
+                }
+                memcpy(m->msg_iov[0].iov_base, payload, payload_len);
+                if (m->msg_name != NULL) {
+                        memcpy(m->msg_name, &src, MIN(src_len, m->msg_namelen));
+                        m->msg_namelen = src_len;
+                }
+                msgs[filled].msg_len = payload_len;
+                filled += 1;
+        }
+        xsk_ring_cons__release(&x->rx, rcvd);
+        xdp_rx_refill(x, addrs, rcvd);
+
+        if (filled == 0) {
+                errno = EAGAIN;
+        }
+        return filled;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file   rtp/net_xdp.h
+ * @brief  AF_XDP (kernel bypass) receive backend for socket_udp
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_NET_XDP_H_
+#define RTP_NET_XDP_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct mmsghdr;
+struct xdp_rx;
+
+/**
+ * Binds AF_XDP socket to a NIC RX queue.
+ *
+ * All traffic arriving at the queue is redirected to the socket and only UDP
+ * datagrams destined to rx_port are passed further. The NIC should therefore
+ * be configured to steer the stream to a dedicated queue, eg.:
+ *
+ *     ethtool -N eth0 flow-type udp4 dst-port 5004 action 4
+ *
+ * @param cfg      <iface>[:<queue>] (queue defaults to 0)
+ * @param rx_port  UDP destination port (host byte order)
+ */
+struct xdp_rx *xdp_rx_init(const char *cfg, uint16_t rx_port);
+void xdp_rx_done(struct xdp_rx *x);
+/// @returns file descriptor usable with select()/poll() to wait for data
+int xdp_rx_fd(struct xdp_rx *x);
+/**
+ * Receives up to count datagrams in recvmmsg() manner - UDP payload is copied
+ * to msgs[i].msg_hdr.msg_iov[0], source address to msg_name (if set). Does not
+ * block.
+ *
+ * @returns number of filled messages, errno is set to EAGAIN if 0
+ */
+int xdp_rx_recv(struct xdp_rx *x, struct mmsghdr *msgs, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTP_NET_XDP_H_
@@ -58,8 +58,12 @@
 #include "config_win32.h"
 
 #include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
 
 #include "debug.h"
+#include "host.h"
+#include "module.h"
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
 #include "rtp/ptime.h"
@@ -67,6 +71,7 @@
 #include "tv.h"
 #include "utils/color_out.h"
 #include "utils/macros.h"
+#include "utils/metrics.h"
 
 #define PBUF_MAGIC	0xcafebabe
 
@@ -75,24 +80,130 @@
 static_assert(DEFAULT_STATS_INTERVAL % STAT_INT_MIN_DIVISOR == 0,
                 "STATS_INTERVAL must be divisible by (sizeof(ull) * CHAR_BIT)");
 #define MOD_NAME "[Pbuf] "
+#define DEFAULT_RING_SLOTS 32
+
+#define ADAPTIVE_JITTER_MULT 4                       ///< target delay is min delay + this multiple of the jitter
+#define ADAPTIVE_WINDOW (2 * NS_IN_SEC)              ///< window for the minimal transit time (tracks the clock drift)
+#define ADAPTIVE_RESET NS_IN_SEC                     ///< transit time change considered a stream discontinuity
+#define ADAPTIVE_HYSTERESIS (NS_IN_SEC / 1000)       ///< playout offset is not adjusted if closer to target
+#define ADAPTIVE_STRETCH_UP 0.01                     ///< max ratio of the frame stretch when increasing delay
+#define ADAPTIVE_STRETCH_DOWN 0.005                  ///< max ratio of the frame shrink when decreasing delay
+#define ADAPTIVE_MISS_FRAMES 100                     ///< frames over which the miss ratio is evaluated
+#define ADAPTIVE_MULT_MIN 1.0                        ///< bounds of the jitter multiple adapted to the miss target
+#define ADAPTIVE_MULT_MAX 16.0
+#define ADAPTIVE_MULT_UP 1.5                         ///< jitter multiple change if the target is missed/met with margin
+#define ADAPTIVE_MULT_DOWN 0.9
+#define MAX_PENDING_NACKS 1024
+#define MAX_NACK_GAP 256                       ///< longer gap is considered a stream discontinuity
+#define NACK_REORDER_WAIT (NS_IN_SEC / 1000)   ///< wait for a possibly reordered packet before NACKing
+#define NACK_MAX_RETRIES 3
+#define PBUF_PKT_MEM RTP_MAX_PACKET_LEN ///< memory accounted per held packet (size of the UDP receive buffer)
 
 struct pbuf_node {
         struct pbuf_node *nxt;
         struct pbuf_node *prv;
         uint32_t rtp_timestamp; /* RTP timestamp for the frame           */
         time_ns_t arrival_time;    /* Arrival time of first packet in frame */
+        time_ns_t last_arrival;    /* Arrival time of last packet in frame  */
         time_ns_t playout_time;    /* Playout time for the frame            */
         time_ns_t deletion_time;   /* Deletion time for the frame            */
+        double stretch;            /* Playout/nominal duration of the frame */
         struct coded_data *cdata;       /*                                       */
         int decoded;            /* Non-zero if we've decoded this frame  */
         int mbit;               /* determines if mbit of frame had been seen */
         uint32_t magic;         /* For debugging                         */
         bool completed;
+        struct coded_data *partial_head; ///< cdata head at the last pbuf_decode_partial() call
+};
+
+/**
+ * Frame slot of the ring variant of the playout buffer. Packets are appended
+ * to the pkts vector in arrival order and linked to the descending-seqno
+ * list passed to the decoder only when the frame is decoded. The vector is
+ * kept when the slot is recycled so that steady state doesn't allocate.
+ */
+struct pbuf_slot {
+        uint32_t rtp_timestamp;
+        time_ns_t first_arrival;
+        time_ns_t last_arrival;
+        time_ns_t playout_time;
+        time_ns_t deletion_time;
+        double stretch;
+        struct coded_data *pkts;
+        int count;
+        int capacity;
+        int decoded;
+        int mbit;
+        bool completed;
+        int partial_count; ///< packets passed by pbuf_decode_partial()
+};
+
+/// lost packet to be requested by NACK until its frame is played out
+struct pbuf_nack {
+        uint16_t seq;
+        int retries;
+        time_ns_t next_send;
+        time_ns_t deadline;
+};
+
+/**
+ * State of the adaptive playout delay. The playout time is derived from the
+ * RTP timestamp, so that the frames are released regularly regardless of the
+ * network jitter:
+ *
+ *     playout_time = media_time(ts) + offset
+ *
+ * where the offset converges to the minimal observed transit time (arrival
+ * time minus media time) plus the target delay computed from the RFC 3550
+ * interarrival jitter estimate. The offset doesn't jump but changes at most
+ * by ADAPTIVE_STRETCH_* of the frame duration, the frame is then expected to
+ * be time-stretched by the decoder by the same ratio (pbuf_stats::playout_stretch)
+ * to be played out without gaps or overlaps.
+ *
+ * With a frame miss target (video), the jitter is estimated from the first
+ * packets of the frames only and the target delay also covers the arrival
+ * spread of the frame packets. The jitter multiple is then adapted so that
+ * the ratio of frames completed after their playout time stays below the
+ * target. The offset is moved by whole frames (a frame is repeated or
+ * dropped) if it is more than a frame duration off the target.
+ */
+struct pbuf_adaptive {
+        uint32_t ts_rate;          ///< RTP clock rate, 0 if adaptive delay is disabled
+        long long min_delay_ns;
+        long long max_delay_ns;
+
+        bool init;
+        uint32_t last_ts;          ///< highest seen RTP timestamp
+        long long last_ts_ns;      ///< media time of last_ts (unwrapped)
+        long long last_transit;
+        double jitter_ns;          ///< interarrival jitter estimate
+        long long base_transit;    ///< minimal transit time
+        long long window_min;      ///< minimal transit time in current window
+        time_ns_t window_start;
+        long long target_ns;       ///< current target delay
+
+        bool frame_init;
+        long long frame_ts_ns;     ///< media time of the last created frame
+        long long offset_ns;       ///< applied offset of the playout time to the media time
+        double stretch;            ///< stretch assigned to the last created frame
+
+        double miss_target;        ///< max. ratio of late frames, 0 if not used (see pbuf_set_adaptive_miss_target())
+        double jitter_mult;        ///< multiple of the jitter in the target delay
+        long long spread_ns;       ///< max. arrival spread of frame packets (previous and current window)
+        long long window_spread;   ///< max. arrival spread in the current window
+        int frames;                ///< frames played out in the current window
+        int missed;                ///< of them completed after the playout time
 };
 
 struct pbuf {
         struct pbuf_node *frst;
         struct pbuf_node *last;
+
+        struct pbuf_slot *ring; ///< if not NULL, ring of frame slots ordered by RTP TS is used instead of the list
+        int ring_size;
+        int ring_head;          ///< index of the oldest frame
+        int ring_count;
+
         long long int playout_delay_us;
         volatile int *offset_ms;
 
@@ -108,10 +219,46 @@ struct pbuf {
         int out_of_order_pkts;
         int max_out_of_order_dist;
         int dups; // duplicite packets
+        struct rtp *session; ///< session the packets are received from (for socket drops), may be NULL
+        uint64_t last_socket_drops;
+        int socket_drops; // packets dropped by kernel (currently computed value)
+        long long int socket_drops_cum;
+        struct pbuf_metrics {
+                uint32_t ssrc; ///< the metrics are labelled with
+                struct metric *received, *expected, *lost, *reordered, *duplicate, *socket_drops;
+        } metrics;
+
+        // NACK, enabled by the first pbuf_get_nacks() call; entries are in ascending seq order
+        struct pbuf_nack *nacks;
+        int nack_count;
+        int nack_highest_seq; ///< -1 if no packet seen yet
+
+        struct pbuf_adaptive adaptive;
+
+        struct {
+                time_ns_t time;   ///< sender wall-clock time corresponding to rtp_ts
+                uint32_t rtp_ts;
+                unsigned ts_rate; ///< 0 if the mapping is not known
+        } sender_clock;
+
+        struct module_mem *mem_owner; ///< held packets are accounted to, owner of the thread that created the buffer
 };
 
-static void free_cdata(struct coded_data *head);
+static void free_cdata(struct pbuf *playout_buf, struct coded_data *head);
 static int frame_complete(struct pbuf_node *frame);
+static struct pbuf_slot *ring_slot(struct pbuf *playout_buf, int i);
+static void frame_times(struct pbuf *playout_buf, time_ns_t arrival_time, long long pkt_ts_ns,
+                time_ns_t *playout_time, time_ns_t *deletion_time, double *stretch);
+static time_ns_t sender_time(struct pbuf *playout_buf, uint32_t rtp_ts);
+static void pbuf_ring_destroy(struct pbuf *playout_buf);
+static void pbuf_ring_insert(struct pbuf *playout_buf, rtp_packet *pkt, time_ns_t arrival_time, long long pkt_ts_ns);
+static void pbuf_ring_remove(struct pbuf *playout_buf, time_ns_t curr_time);
+static int pbuf_ring_decode(struct pbuf *playout_buf, time_ns_t curr_time,
+                decode_frame_t decode_func, void *data);
+static int pbuf_ring_decode_partial(struct pbuf *playout_buf, decode_frame_t decode_func, void *data);
+
+ADD_TO_PARAM("pbuf-ring", "* pbuf-ring[=<slots>]\n"
+                "  Use playout buffer with a fixed ring of frame slots (default " TOSTRING(DEFAULT_RING_SLOTS) ") instead of a linked list\n");
 
 /*********************************************************************************/
 
@@ -183,6 +330,17 @@ struct pbuf *pbuf_init(volatile int *delay_ms)
                 playout_buf->playout_delay_us = 0.032 * 1000 * 1000;
                 playout_buf->last_report_seq = -1;
                 playout_buf->stats_interval = DEFAULT_STATS_INTERVAL;
+                const char *ring = get_commandline_param("pbuf-ring");
+                if (ring != NULL) {
+                        playout_buf->ring_size = strlen(ring) > 0 ? atoi(ring) : DEFAULT_RING_SLOTS;
+                        if (playout_buf->ring_size <= 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong number of ring slots: %s\n", ring);
+                                free(playout_buf);
+                                return NULL;
+                        }
+                        playout_buf->ring = (struct pbuf_slot *) calloc(playout_buf->ring_size, sizeof(struct pbuf_slot));
+                }
+                playout_buf->mem_owner = module_mem_acquire_owner();
         } else {
                 debug_msg("Failed to allocate memory for playout buffer\n");
         }
@@ -194,14 +352,20 @@ void pbuf_destroy(struct pbuf *playout_buf) {
                 pbuf_validate(playout_buf);
 
                 if (playout_buf->received_pkts_cum) { // print only if relevant
+                        char drops_str[64] = "";
+                        if (playout_buf->socket_drops_cum > 0) {
+                                snprintf(drops_str, sizeof drops_str, ", %lld dropped by the kernel", playout_buf->socket_drops_cum);
+                        }
                         log_msg(LOG_LEVEL_INFO, "Pbuf: total %lld/%lld packets received "
-                                        "(%.5lf%%).\n",
+                                        "(%.5lf%%)%s.\n",
                                         playout_buf->received_pkts_cum,
                                         playout_buf->expected_pkts_cum,
                                         (double) playout_buf->received_pkts_cum /
-                                        playout_buf->expected_pkts_cum * 100.0);
+                                        playout_buf->expected_pkts_cum * 100.0,
+                                        drops_str);
                 }
 
+                pbuf_ring_destroy(playout_buf);
                 struct pbuf_node *curr = playout_buf->frst;
                 while (curr != NULL) {
                         struct pbuf_node *temp = curr->nxt;
@@ -217,20 +381,28 @@ void pbuf_destroy(struct pbuf *playout_buf) {
                         if (curr->prv != NULL) {
                                 curr->prv->nxt = curr->nxt;
                         }
-                        free_cdata(curr->cdata);
+                        free_cdata(playout_buf, curr->cdata);
                         free(curr);
                         curr = temp;
                 }
+                module_mem_release(playout_buf->mem_owner);
+                free(playout_buf->nacks);
                 free(playout_buf);
         }
 }
 
+/// accounts packets stored (count > 0) or freed (count < 0) by the buffer
+static void pbuf_mem_account(struct pbuf *playout_buf, int count)
+{
+        module_mem_add(playout_buf->mem_owner, (long long) count * PBUF_PKT_MEM);
+}
+
 /** Add "pkt" to the frame represented by "node". The "node" has
  * previously been created, and has some coded data already...
  *
  * New arrivals are filed to the list in descending sequence number order
  */
-static void add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
+static void add_coded_unit(struct pbuf *playout_buf, struct pbuf_node *node, rtp_packet * pkt)
 {
         assert(node->rtp_timestamp == pkt->ts);
         assert(node->cdata != NULL);
@@ -270,21 +442,22 @@ static void add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
                         /* this is bad, something went terribly wrong... */
                         free(pkt);
                         free(tmp);
+                        return;
                 }
         }
+        pbuf_mem_account(playout_buf, 1);
 }
 
-static struct pbuf_node *create_new_pnode(rtp_packet * pkt, long long playout_delay_us)
+static struct pbuf_node *create_new_pnode(struct pbuf *playout_buf, rtp_packet * pkt, time_ns_t arrival_time, long long pkt_ts_ns)
 {
         struct pbuf_node *tmp = calloc(1, sizeof(struct pbuf_node));
         if (tmp != NULL) {
                 tmp->magic = PBUF_MAGIC;
                 tmp->rtp_timestamp = pkt->ts;
                 tmp->mbit = pkt->m;
-                tmp->playout_time =
-                        tmp->arrival_time = get_time_in_ns();
-                tmp->playout_time += playout_delay_us * 1000;
-                tmp->deletion_time = tmp->playout_time + playout_delay_us * 1000;
+                tmp->arrival_time = tmp->last_arrival = arrival_time;
+                frame_times(playout_buf, arrival_time, pkt_ts_ns, &tmp->playout_time,
+                                &tmp->deletion_time, &tmp->stretch);
 
                 tmp->cdata = (struct coded_data *) malloc(sizeof(struct coded_data));
                 if (tmp->cdata != NULL) {
@@ -292,6 +465,7 @@ static struct pbuf_node *create_new_pnode(rtp_packet * pkt, long long playout_de
                         tmp->cdata->prv = NULL;
                         tmp->cdata->seqno = pkt->seq;
                         tmp->cdata->data = pkt;
+                        pbuf_mem_account(playout_buf, 1);
                 } else {
                         free(pkt);
                         free(tmp);
@@ -339,8 +513,24 @@ static void compute_longest_gap(int *longest_gap, int *accumulated_loss, unsigne
         }
 }
 
+static void pbuf_metrics_init(struct pbuf_metrics *m, uint32_t ssrc)
+{
+        char labels[32];
+        snprintf(labels, sizeof labels, "ssrc=\"0x%08" PRIx32 "\"", ssrc);
+        m->received = metric_counter("ug_rx_packets_received_total", "Received RTP packets", labels);
+        m->expected = metric_counter("ug_rx_packets_expected_total", "RTP packets expected according to sequence numbers", labels);
+        m->lost = metric_counter("ug_rx_packets_lost_total", "Lost RTP packets", labels);
+        m->reordered = metric_counter("ug_rx_packets_reordered_total", "RTP packets received out of order", labels);
+        m->duplicate = metric_counter("ug_rx_packets_duplicate_total", "Duplicate RTP packets", labels);
+        m->socket_drops = metric_counter("ug_rx_packets_socket_dropped_total", "RTP packets dropped by the kernel due to full socket buffer", labels);
+        m->ssrc = ssrc;
+}
+
 static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt)
 {
+        if (playout_buf->metrics.received == NULL || pkt->ssrc != playout_buf->metrics.ssrc) {
+                pbuf_metrics_init(&playout_buf->metrics, pkt->ssrc);
+        }
         // collect statistics
         if (playout_buf->last_report_seq == -1) { // init
                 playout_buf->last_seq = pkt->seq - 1;
@@ -353,6 +543,7 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
         unsigned long long current_bit = 1ull << (pkt->seq % NUMBER_WORD_BITS);
         if ((playout_buf->packets[pkt->seq / NUMBER_WORD_BITS] & ~current_bit) > current_bit) {
                 playout_buf->out_of_order_pkts += 1;
+                metric_inc(playout_buf->metrics.reordered, 1);
                 int dist = ((pkt->seq + (1<<16U)) - playout_buf->last_seq) % (1<<16U);
                 dist = dist < 1<<15U ? dist : abs(dist - (1<<16U));
                 playout_buf->max_out_of_order_dist = MAX(playout_buf->max_out_of_order_dist, dist);
@@ -360,22 +551,39 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
         playout_buf->last_seq = pkt->seq;
         if (playout_buf->packets[pkt->seq / NUMBER_WORD_BITS] & current_bit) {
                 playout_buf->dups += 1;
+                metric_inc(playout_buf->metrics.duplicate, 1);
         }
         playout_buf->packets[pkt->seq / NUMBER_WORD_BITS] |= current_bit;
         uint16_t dist = (uint16_t) (pkt->seq - playout_buf->last_report_seq);
         if (dist >= playout_buf->stats_interval * 2 && dist < 1U<<15U) {
                 uint16_t report_seq_until = (uint16_t) ((pkt->seq / playout_buf->stats_interval * playout_buf->stats_interval) - playout_buf->stats_interval); // sum up only up to current-playout_buf->stats_interval to be able to catch out-of-order packets
                 int accumulated_loss = 0;
+                int received = 0;
+                int expected = 0;
                 for (uint16_t i = playout_buf->last_report_seq;
                                 i != report_seq_until; i += NUMBER_WORD_BITS) {
-                        playout_buf->expected_pkts += NUMBER_WORD_BITS;
-                        playout_buf->received_pkts += __builtin_popcountll(playout_buf->packets[i / NUMBER_WORD_BITS]);
+                        expected += NUMBER_WORD_BITS;
+                        received += __builtin_popcountll(playout_buf->packets[i / NUMBER_WORD_BITS]);
                         compute_longest_gap(&playout_buf->longest_gap, &accumulated_loss,  playout_buf->packets[i / NUMBER_WORD_BITS]);
                         playout_buf->packets[i / NUMBER_WORD_BITS] = 0;
                 }
+                playout_buf->expected_pkts += expected;
+                playout_buf->received_pkts += received;
+                metric_inc(playout_buf->metrics.received, received);
+                metric_inc(playout_buf->metrics.expected, expected);
+                metric_inc(playout_buf->metrics.lost, expected - received);
+
+                playout_buf->received_pkts_cum += received;
+                playout_buf->expected_pkts_cum += expected;
 
-                playout_buf->received_pkts_cum += playout_buf->received_pkts;
-                playout_buf->expected_pkts_cum += playout_buf->expected_pkts;
+                if (playout_buf->session != NULL) {
+                        uint64_t drops = rtp_get_rx_drops(playout_buf->session);
+                        int new_drops = drops - playout_buf->last_socket_drops;
+                        playout_buf->last_socket_drops = drops;
+                        playout_buf->socket_drops += new_drops;
+                        playout_buf->socket_drops_cum += new_drops;
+                        metric_inc(playout_buf->metrics.socket_drops, new_drops);
+                }
 
                 playout_buf->last_report_seq = report_seq_until;
         }
@@ -394,9 +602,13 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
                 if (playout_buf->dups > 0) {
                         snprintf(oo_dups_str + strlen(oo_dups_str), sizeof oo_dups_str - strlen(oo_dups_str), ", %d dups", playout_buf->dups);
                 }
-                log_msg(LOG_LEVEL_INFO, "SSRC 0x%08" PRIx32 ": %d/%d packets received (%s%.4f%%" TERM_FG_RESET "), %d lost, max loss %d%s\n",
+                char drops_str[128] = "";
+                if (playout_buf->socket_drops > 0) { // socket shared by all streams, so the drops may belong to others
+                        snprintf(drops_str, sizeof drops_str, " (%d dropped by the kernel - socket buffer full)", playout_buf->socket_drops);
+                }
+                log_msg(LOG_LEVEL_INFO, "SSRC 0x%08" PRIx32 ": %d/%d packets received (%s%.4f%%" TERM_FG_RESET "), %d lost%s, max loss %d%s\n",
                                 pkt->ssrc, playout_buf->received_pkts, playout_buf->expected_pkts, (loss_pct < 100.0 ? TERM_FG_RED : ""), loss_pct,
-                                playout_buf->expected_pkts - playout_buf->received_pkts, playout_buf->longest_gap, oo_dups_str);
+                                playout_buf->expected_pkts - playout_buf->received_pkts, drops_str, playout_buf->longest_gap, oo_dups_str);
 
                 if (playout_buf->max_out_of_order_dist >= playout_buf->stats_interval) {
                         size_t new_val = (playout_buf->max_out_of_order_dist + STAT_INT_MIN_DIVISOR - 1) / STAT_INT_MIN_DIVISOR * STAT_INT_MIN_DIVISOR;
@@ -411,19 +623,209 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
                 playout_buf->out_of_order_pkts = 0;
                 playout_buf->max_out_of_order_dist = 0;
                 playout_buf->dups = 0;
+                playout_buf->socket_drops = 0;
+        }
+}
+
+static long long pbuf_total_delay_us(struct pbuf *playout_buf)
+{
+        return playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0);
+}
+
+static long long adaptive_target_delay(struct pbuf_adaptive *a)
+{
+        long long target = a->min_delay_ns + a->spread_ns + (long long) (a->jitter_mult * a->jitter_ns);
+        return MIN(target, a->max_delay_ns);
+}
+
+/**
+ * Records a frame passed to the decoder and, once per ADAPTIVE_MISS_FRAMES,
+ * adapts the jitter multiple to the observed ratio of late frames.
+ */
+static void adaptive_frame_decoded(struct pbuf_adaptive *a, time_ns_t first_arrival, time_ns_t last_arrival,
+                time_ns_t playout_time)
+{
+        if (a->ts_rate == 0 || a->miss_target <= 0.0) {
+                return;
+        }
+        a->window_spread = MAX(a->window_spread, last_arrival - first_arrival);
+        a->spread_ns = MAX(a->spread_ns, a->window_spread);
+        a->frames += 1;
+        a->missed += last_arrival > playout_time;
+        if (a->frames < ADAPTIVE_MISS_FRAMES) {
+                return;
+        }
+        double miss = (double) a->missed / a->frames;
+        if (miss > a->miss_target) {
+                a->jitter_mult = MIN(a->jitter_mult * ADAPTIVE_MULT_UP, ADAPTIVE_MULT_MAX);
+        } else if (miss <= a->miss_target / 2) {
+                a->jitter_mult = MAX(a->jitter_mult * ADAPTIVE_MULT_DOWN, ADAPTIVE_MULT_MIN);
+        }
+        a->spread_ns = a->window_spread;
+        a->target_ns = adaptive_target_delay(a);
+        log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Late frames %.2f%%, spread %.2f ms, jitter %.2f ms (x%.2f), target playout delay %.2f ms\n",
+                        miss * 100, a->spread_ns / NS_IN_MS_DBL, a->jitter_ns / NS_IN_MS_DBL, a->jitter_mult,
+                        a->target_ns / NS_IN_MS_DBL);
+        a->window_spread = 0;
+        a->frames = a->missed = 0;
+}
+
+/**
+ * Updates the jitter estimate with a packet arrived at arrival_time.
+ * @returns media time of the packet (RTP timestamp converted to ns, unwrapped)
+ */
+static long long adaptive_update(struct pbuf_adaptive *a, uint32_t ts, time_ns_t arrival_time,
+                long long playout_buf_delay_ns)
+{
+        if (a->init) {
+                int32_t ts_diff = (int32_t) (ts - a->last_ts);
+                long long ts_ns = a->last_ts_ns + (long long) ts_diff * NS_IN_SEC / a->ts_rate;
+                long long transit = arrival_time - ts_ns;
+                if (llabs(transit - a->base_transit) > ADAPTIVE_RESET) {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Stream discontinuity, resetting jitter estimate.\n");
+                        a->init = false;
+                } else {
+                        if (ts_diff > 0) {
+                                a->last_ts = ts;
+                                a->last_ts_ns = ts_ns;
+                        }
+                        // RFC 3550 6.4.1, with the miss target only for the first packets of frames (spread is separate)
+                        if (a->miss_target <= 0.0 || ts_diff > 0) {
+                                a->jitter_ns += (llabs(transit - a->last_transit) - a->jitter_ns) / 16.0;
+                                a->last_transit = transit;
+                        }
+                        a->base_transit = MIN(a->base_transit, transit);
+                        a->window_min = MIN(a->window_min, transit);
+                        a->target_ns = adaptive_target_delay(a);
+                        if (arrival_time - a->window_start > ADAPTIVE_WINDOW) {
+                                a->base_transit = a->window_min;
+                                a->window_min = transit;
+                                a->window_start = arrival_time;
+                                log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Jitter %.2f ms, target playout delay %.2f ms, current %.2f ms\n",
+                                                a->jitter_ns / NS_IN_MS_DBL, a->target_ns / NS_IN_MS_DBL,
+                                                (a->offset_ns - a->base_transit) / NS_IN_MS_DBL);
+                        }
+                        return ts_ns;
+                }
+        }
+
+        a->init = true;
+        a->frame_init = false;
+        a->last_ts = ts;
+        a->last_ts_ns = 0;
+        // start from the fixed playout delay, the estimate then converges to the actual jitter
+        a->jitter_ns = (double) MAX(MIN(playout_buf_delay_ns, a->max_delay_ns) - a->min_delay_ns, 0) / a->jitter_mult;
+        a->target_ns = adaptive_target_delay(a);
+        a->last_transit = a->base_transit = a->window_min = arrival_time;
+        a->window_start = arrival_time;
+        return 0;
+}
+
+/**
+ * Computes the playout and deletion time of a new frame. In the adaptive mode,
+ * also moves the playout offset by the stretch of the previous frame and
+ * decides the stretch of this one.
+ */
+static void frame_times(struct pbuf *playout_buf, time_ns_t arrival_time, long long pkt_ts_ns,
+                time_ns_t *playout_time, time_ns_t *deletion_time, double *stretch)
+{
+        struct pbuf_adaptive *a = &playout_buf->adaptive;
+        if (a->ts_rate == 0) {
+                long long playout_delay_us = pbuf_total_delay_us(playout_buf);
+                *playout_time = arrival_time + playout_delay_us * 1000;
+                *deletion_time = *playout_time + playout_delay_us * 1000;
+                *stretch = 1.0;
+                return;
+        }
+
+        long long spacing = pkt_ts_ns - a->frame_ts_ns;
+        long long target = a->base_transit + a->target_ns;
+        if (!a->frame_init || spacing <= 0 || spacing > ADAPTIVE_RESET) {
+                a->frame_init = true;
+                a->offset_ns = target;
+                a->stretch = 1.0;
+        } else {
+                a->offset_ns += (long long) ((a->stretch - 1.0) * spacing);
+        }
+        a->frame_ts_ns = pkt_ts_ns;
+
+        long long diff = target - a->offset_ns;
+        if (llabs(diff) <= ADAPTIVE_HYSTERESIS) {
+                a->stretch = 1.0;
+        } else if (a->miss_target > 0.0 && spacing > 0 && llabs(diff) >= spacing) {
+                a->stretch = diff > 0 ? 2.0 : 0.0; // repeat/drop the frame
+        } else {
+                a->stretch = diff > 0 ? 1.0 + ADAPTIVE_STRETCH_UP : 1.0 - ADAPTIVE_STRETCH_DOWN;
+        }
+
+        long long offset_ns = 1000000LL * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0);
+        *playout_time = pkt_ts_ns + a->offset_ns + offset_ns;
+        *deletion_time = *playout_time + a->offset_ns - a->base_transit + offset_ns;
+        *stretch = a->stretch;
+}
+
+/**
+ * Records packets skipped by pkt as lost and removes the pkt from the
+ * lost ones if it is a late (reordered or retransmitted) packet.
+ */
+static void pbuf_nack_track(struct pbuf *playout_buf, uint16_t seq)
+{
+        if (playout_buf->nack_highest_seq == -1) {
+                playout_buf->nack_highest_seq = seq;
+                return;
+        }
+        uint16_t ahead = seq - (uint16_t) playout_buf->nack_highest_seq;
+        if (ahead == 0) {
+                return;
+        }
+        if (ahead < 1U << 15U) {
+                if (ahead <= MAX_NACK_GAP) {
+                        time_ns_t now = get_time_in_ns();
+                        time_ns_t deadline = now + pbuf_total_delay_us(playout_buf) * 1000;
+                        for (uint16_t i = playout_buf->nack_highest_seq + 1; i != seq
+                                        && playout_buf->nack_count < MAX_PENDING_NACKS; ++i) {
+                                playout_buf->nacks[playout_buf->nack_count++] =
+                                        (struct pbuf_nack){ i, 0, now + NACK_REORDER_WAIT, deadline };
+                        }
+                }
+                playout_buf->nack_highest_seq = seq;
+                return;
+        }
+        for (int i = 0; i < playout_buf->nack_count; ++i) {
+                if (playout_buf->nacks[i].seq == seq) {
+                        memmove(&playout_buf->nacks[i], &playout_buf->nacks[i + 1],
+                                        (playout_buf->nack_count - i - 1) * sizeof playout_buf->nacks[0]);
+                        playout_buf->nack_count -= 1;
+                        return;
+                }
         }
 }
 
 void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
 {
         struct pbuf_node *tmp;
+        // prefer the socket RX timestamp if available (not delayed by the receiving threads)
+        time_ns_t arrival_time = pkt->arrival_ns != 0 ? pkt->arrival_ns : get_time_in_ns();
+        long long pkt_ts_ns = 0;
 
         pbuf_validate(playout_buf);
         pbuf_process_stats(playout_buf, pkt);
+        if (playout_buf->nacks != NULL) {
+                pbuf_nack_track(playout_buf, pkt->seq);
+        }
+        if (playout_buf->adaptive.ts_rate != 0) {
+                pkt_ts_ns = adaptive_update(&playout_buf->adaptive, pkt->ts, arrival_time,
+                                playout_buf->playout_delay_us * 1000);
+        }
+
+        if (playout_buf->ring) {
+                pbuf_ring_insert(playout_buf, pkt, arrival_time, pkt_ts_ns);
+                return;
+        }
 
         if (playout_buf->frst == NULL && playout_buf->last == NULL) {
                 /* playout buffer is empty - add new frame */
-                playout_buf->frst = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                playout_buf->frst = create_new_pnode(playout_buf, pkt, arrival_time, pkt_ts_ns);
                 playout_buf->last = playout_buf->frst;
                 return;
         }
@@ -434,11 +836,12 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                 }
                 /* Packet belongs to last frame in playout_buf this is the */
                 /* most likely scenario - although...                      */
-                add_coded_unit(playout_buf->last, pkt);
+                add_coded_unit(playout_buf, playout_buf->last, pkt);
+                playout_buf->last->last_arrival = arrival_time;
         } else {
                 if (playout_buf->last->rtp_timestamp < pkt->ts) {
                         /* Packet belongs to a new frame... */
-                        tmp = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                        tmp = create_new_pnode(playout_buf, pkt, arrival_time, pkt_ts_ns);
                         playout_buf->last->nxt = tmp;
                         playout_buf->last->completed = true;
                         tmp->prv = playout_buf->last;
@@ -458,7 +861,8 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                                 }
                                 if (curr->rtp_timestamp == pkt->ts) {
                                         /* Packet belongs to a previous existing frame... */
-                                        add_coded_unit(curr, pkt);
+                                        add_coded_unit(playout_buf, curr, pkt);
+                                        curr->last_arrival = arrival_time;
                                 } else {
                                         /* Packet belongs to a frame that is not present */
                                         discard_pkt = true;
@@ -476,12 +880,13 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
         pbuf_validate(playout_buf);
 }
 
-static void free_cdata(struct coded_data *head)
+static void free_cdata(struct pbuf *playout_buf, struct coded_data *head)
 {
         struct coded_data *tmp;
 
         while (head != NULL) {
                 free(head->data);
+                pbuf_mem_account(playout_buf, -1);
                 tmp = head;
                 head = head->nxt;
                 free(tmp);
@@ -496,6 +901,11 @@ void pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time)
 
         struct pbuf_node *curr, *temp;
 
+        if (playout_buf->ring) {
+                pbuf_ring_remove(playout_buf, curr_time);
+                return;
+        }
+
         pbuf_validate(playout_buf);
 
         curr = playout_buf->frst;
@@ -514,7 +924,7 @@ void pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time)
                         if (curr->prv != NULL) {
                                 curr->prv->nxt = curr->nxt;
                         }
-                        free_cdata(curr->cdata);
+                        free_cdata(playout_buf, curr->cdata);
                         free(curr);
                 } else {
                         /* The playout buffer is stored in order, so once  */
@@ -545,6 +955,9 @@ static int frame_complete(struct pbuf_node *frame)
 
 int pbuf_is_empty(struct pbuf *playout_buf)
 {
+        if (playout_buf->ring) {
+                return playout_buf->ring_count == 0 ? TRUE : FALSE;
+        }
         if (playout_buf->frst == NULL)
                 return TRUE;
         else
@@ -560,6 +973,10 @@ pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
         /* decoded, but otherwise leave it in the playout buffer.      */
         struct pbuf_node *curr;
 
+        if (playout_buf->ring) {
+                return pbuf_ring_decode(playout_buf, curr_time, decode_func, data);
+        }
+
         pbuf_validate(playout_buf);
 
         curr = playout_buf->frst;
@@ -569,9 +986,14 @@ pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
                    ) {
                         if (frame_complete(curr)) {
                                 struct pbuf_stats stats = { playout_buf->received_pkts_cum,
-                                        playout_buf->expected_pkts_cum };
+                                        playout_buf->expected_pkts_cum, curr->stretch,
+                                        curr->arrival_time, curr->last_arrival,
+                                        playout_buf->socket_drops_cum,
+                                        sender_time(playout_buf, curr->rtp_timestamp) };
                                 int ret = decode_func(curr->cdata, data, &stats);
                                 curr->decoded = 1;
+                                adaptive_frame_decoded(&playout_buf->adaptive, curr->arrival_time,
+                                                curr->last_arrival, curr->playout_time);
                                 return ret;
                         } else {
                                 if (curr_time > curr->playout_time + 1 * NS_IN_SEC) {
@@ -587,8 +1009,422 @@ pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
         return 0;
 }
 
+/**
+ * Passes the packets of the oldest not yet decoded frame received since the
+ * previous call to decode_func, even if the frame is not complete or its
+ * playout time hasn't come yet, so that its decoding may start while it is
+ * being received. The frame is later passed to pbuf_decode() as usual.
+ *
+ * The packets are passed in no particular order and packets arriving out of
+ * order may be omitted (they are only in the list passed by pbuf_decode()).
+ *
+ * @returns value returned by decode_func, 0 if there were no new packets
+ */
+int pbuf_decode_partial(struct pbuf *playout_buf, decode_frame_t decode_func, void *data)
+{
+        if (playout_buf->ring) {
+                return pbuf_ring_decode_partial(playout_buf, decode_func, data);
+        }
+        struct pbuf_node *curr = playout_buf->frst;
+        while (curr != NULL && curr->decoded) {
+                curr = curr->nxt;
+        }
+        if (curr == NULL || curr->cdata == curr->partial_head) {
+                return 0;
+        }
+        // cut the list after the packets added at the head since the last call
+        struct coded_data *last_new = curr->partial_head != NULL ? curr->partial_head->prv : NULL;
+        if (last_new != NULL) {
+                last_new->nxt = NULL;
+        }
+        struct pbuf_stats stats = { playout_buf->received_pkts_cum,
+                playout_buf->expected_pkts_cum, curr->stretch,
+                curr->arrival_time, curr->last_arrival,
+                playout_buf->socket_drops_cum,
+                sender_time(playout_buf, curr->rtp_timestamp) };
+        int ret = decode_func(curr->cdata, data, &stats);
+        if (last_new != NULL) {
+                last_new->nxt = curr->partial_head;
+        }
+        curr->partial_head = curr->cdata;
+        return ret;
+}
+
 void pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay)
 {
         playout_buf->playout_delay_us = playout_delay * 1000 * 1000;
 }
 
+/**
+ * Enables adaptive playout delay - the delay follows the network jitter
+ * within [min_delay, max_delay] (in seconds) instead of the fixed playout
+ * delay. The decoder should time-stretch the frames by
+ * pbuf_stats::playout_stretch.
+ *
+ * @param ts_rate RTP timestamp clock rate, 0 disables the adaptive delay
+ */
+void pbuf_set_adaptive_delay(struct pbuf *playout_buf, unsigned ts_rate, double min_delay, double max_delay)
+{
+        memset(&playout_buf->adaptive, 0, sizeof playout_buf->adaptive);
+        playout_buf->adaptive.ts_rate = ts_rate;
+        playout_buf->adaptive.min_delay_ns = min_delay * NS_IN_SEC;
+        playout_buf->adaptive.max_delay_ns = MAX(max_delay * NS_IN_SEC, playout_buf->adaptive.min_delay_ns);
+        playout_buf->adaptive.target_ns = playout_buf->adaptive.min_delay_ns;
+        playout_buf->adaptive.jitter_mult = ADAPTIVE_JITTER_MULT;
+}
+
+/**
+ * Makes the adaptive playout delay (pbuf_set_adaptive_delay()) the smallest
+ * one letting at most miss_ratio of the frames complete after their playout
+ * time. Intended for video - the offset is then changed also by whole
+ * frames (repeated or dropped) instead of time-stretching only.
+ *
+ * @param miss_ratio target ratio of late frames, 0 disables it
+ */
+void pbuf_set_adaptive_miss_target(struct pbuf *playout_buf, double miss_ratio)
+{
+        playout_buf->adaptive.miss_target = miss_ratio;
+}
+
+/**
+ * Sets the mapping of the sender RTP timestamps to the sender wall clock
+ * (usually from the last RTCP SR). The decoder then gets the sender time of
+ * each frame in pbuf_stats::sender_time.
+ *
+ * @param ts_rate RTP timestamp clock rate, 0 removes the mapping
+ */
+void pbuf_set_sender_clock(struct pbuf *playout_buf, time_ns_t sender_time, uint32_t rtp_ts, unsigned ts_rate)
+{
+        playout_buf->sender_clock.time = sender_time;
+        playout_buf->sender_clock.rtp_ts = rtp_ts;
+        playout_buf->sender_clock.ts_rate = ts_rate;
+}
+
+static time_ns_t sender_time(struct pbuf *playout_buf, uint32_t rtp_ts)
+{
+        if (playout_buf->sender_clock.ts_rate == 0) {
+                return 0;
+        }
+        int32_t diff = rtp_ts - playout_buf->sender_clock.rtp_ts;
+        return playout_buf->sender_clock.time + (long long) diff * NS_IN_SEC / playout_buf->sender_clock.ts_rate;
+}
+
+/// @returns current target playout delay in seconds (the fixed one if not adaptive)
+double pbuf_get_playout_delay(struct pbuf *playout_buf)
+{
+        if (playout_buf->adaptive.ts_rate == 0) {
+                return playout_buf->playout_delay_us / 1000.0 / 1000.0;
+        }
+        return (double) playout_buf->adaptive.target_ns / NS_IN_SEC;
+}
+
+/**
+ * Returns sequence numbers of lost packets that should be requested by
+ * a NACK now (ascending). Each one is requested up to NACK_MAX_RETRIES
+ * times until the playout time of the frame is reached.
+ *
+ * Loss tracking starts with the first call, so that receivers not using
+ * the NACKs (eg. audio) do not pay for it.
+ *
+ * @returns number of sequence numbers written to seqs
+ */
+int pbuf_get_nacks(struct pbuf *playout_buf, time_ns_t curr_time, uint16_t *seqs, int max)
+{
+        if (playout_buf->nacks == NULL) {
+                playout_buf->nacks = (struct pbuf_nack *) malloc(MAX_PENDING_NACKS * sizeof playout_buf->nacks[0]);
+                playout_buf->nack_highest_seq = -1;
+                return 0;
+        }
+        time_ns_t retry_interval = MAX(pbuf_total_delay_us(playout_buf) * 1000 / (NACK_MAX_RETRIES + 1), NACK_REORDER_WAIT);
+        int count = 0;
+        int kept = 0;
+        for (int i = 0; i < playout_buf->nack_count; ++i) {
+                struct pbuf_nack n = playout_buf->nacks[i];
+                if (curr_time > n.deadline || (n.retries == NACK_MAX_RETRIES && curr_time >= n.next_send)) {
+                        continue;
+                }
+                if (curr_time >= n.next_send && n.retries < NACK_MAX_RETRIES && count < max) {
+                        seqs[count++] = n.seq;
+                        n.retries += 1;
+                        n.next_send = curr_time + retry_interval;
+                }
+                playout_buf->nacks[kept++] = n;
+        }
+        playout_buf->nack_count = kept;
+        return count;
+}
+
+/// @returns time when pbuf_decode() or pbuf_remove() will need to be called for the frame
+static time_ns_t frame_deadline(time_ns_t curr_time, bool decoded, bool complete,
+                time_ns_t playout_time, time_ns_t deletion_time)
+{
+        if (decoded) { // if already past, the removal waits for an older frame
+                return curr_time <= deletion_time ? deletion_time + 1 : LLONG_MAX;
+        }
+        if (curr_time <= playout_time) {
+                return playout_time + 1;
+        }
+        return complete ? curr_time : playout_time + 1 * NS_IN_SEC + 1;
+}
+
+/**
+ * Sets the session the packets are received from - packets its socket
+ * dropped due to a full receive buffer are then reported separately from the
+ * network loss in the statistics.
+ */
+void pbuf_set_rtp_session(struct pbuf *playout_buf, struct rtp *session)
+{
+        playout_buf->session = session;
+        playout_buf->last_socket_drops = session != NULL ? rtp_get_rx_drops(session) : 0;
+}
+
+/**
+ * Returns the earliest time when the buffer needs to be serviced (a frame
+ * reaches its playout or deletion time, a NACK is due), so that the caller
+ * can sleep until then instead of polling. Packet arrival may of course
+ * complete a frame earlier.
+ *
+ * @returns the deadline, curr_time if something is due now or LLONG_MAX if none
+ */
+time_ns_t pbuf_next_deadline(struct pbuf *playout_buf, time_ns_t curr_time)
+{
+        time_ns_t deadline = LLONG_MAX;
+        if (playout_buf->ring) {
+                for (int i = 0; i < playout_buf->ring_count; ++i) {
+                        struct pbuf_slot *slot = ring_slot(playout_buf, i);
+                        deadline = MIN(deadline, frame_deadline(curr_time, slot->decoded, slot->mbit == 1 || slot->completed || slot->count == 0,
+                                                slot->playout_time, slot->deletion_time));
+                }
+        } else {
+                for (struct pbuf_node *curr = playout_buf->frst; curr != NULL; curr = curr->nxt) {
+                        deadline = MIN(deadline, frame_deadline(curr_time, curr->decoded, frame_complete(curr),
+                                                curr->playout_time, curr->deletion_time));
+                }
+        }
+        for (int i = 0; i < playout_buf->nack_count; ++i) {
+                if (playout_buf->nacks[i].retries < NACK_MAX_RETRIES) {
+                        deadline = MIN(deadline, playout_buf->nacks[i].next_send);
+                }
+        }
+        return MAX(deadline, curr_time);
+}
+
+/*********************************************************************************/
+/* Ring variant of the playout buffer (--param pbuf-ring). Frames are kept in a  */
+/* fixed ring ordered by RTP timestamp, newest at the end, so a packet of the    */
+/* current frame is filed in O(1) and reordered packets scan at most ring_size   */
+/* slots. Packets of a frame are stored in a per-slot vector reused across       */
+/* frames instead of allocating a coded_data node per packet.                    */
+/*********************************************************************************/
+
+static struct pbuf_slot *ring_slot(struct pbuf *playout_buf, int i)
+{
+        return &playout_buf->ring[(playout_buf->ring_head + i) % playout_buf->ring_size];
+}
+
+static void ring_slot_clear(struct pbuf *playout_buf, struct pbuf_slot *slot)
+{
+        for (int i = 0; i < slot->count; ++i) {
+                free(slot->pkts[i].data);
+        }
+        pbuf_mem_account(playout_buf, -slot->count);
+        slot->count = 0;
+}
+
+static void ring_slot_add(struct pbuf *playout_buf, struct pbuf_slot *slot, rtp_packet *pkt)
+{
+        if (slot->count == slot->capacity) {
+                int capacity = MAX(2 * slot->capacity, 64);
+                struct coded_data *pkts = (struct coded_data *) realloc(slot->pkts, capacity * sizeof *pkts);
+                if (pkts == NULL) {
+                        free(pkt);
+                        return;
+                }
+                slot->pkts = pkts;
+                slot->capacity = capacity;
+        }
+        slot->pkts[slot->count].seqno = pkt->seq;
+        slot->pkts[slot->count].data = pkt;
+        slot->count += 1;
+        slot->mbit |= pkt->m;
+        pbuf_mem_account(playout_buf, 1);
+}
+
+static void pbuf_ring_destroy(struct pbuf *playout_buf)
+{
+        if (playout_buf->ring == NULL) {
+                return;
+        }
+        for (int i = 0; i < playout_buf->ring_size; ++i) {
+                ring_slot_clear(playout_buf, &playout_buf->ring[i]);
+                free(playout_buf->ring[i].pkts);
+        }
+        free(playout_buf->ring);
+        playout_buf->ring = NULL;
+}
+
+static void pbuf_ring_insert(struct pbuf *playout_buf, rtp_packet *pkt, time_ns_t arrival_time, long long pkt_ts_ns)
+{
+        if (playout_buf->ring_count > 0) {
+                struct pbuf_slot *last = ring_slot(playout_buf, playout_buf->ring_count - 1);
+                if (last->rtp_timestamp == pkt->ts) {
+                        if (last->decoded) {
+                                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Late data for already decoded frame!\n");
+                        }
+                        ring_slot_add(playout_buf, last, pkt);
+                        last->last_arrival = arrival_time;
+                        return;
+                }
+                if (last->rtp_timestamp > pkt->ts) {
+                        /* Packet belongs to a previous frame... */
+                        for (int i = playout_buf->ring_count - 2; i >= 0; --i) {
+                                struct pbuf_slot *slot = ring_slot(playout_buf, i);
+                                if (slot->rtp_timestamp == pkt->ts) {
+                                        ring_slot_add(playout_buf, slot, pkt);
+                                        slot->last_arrival = arrival_time;
+                                        return;
+                                }
+                                if (slot->rtp_timestamp < pkt->ts) {
+                                        break;
+                                }
+                        }
+                        debug_msg("A packet for a frame that is not present - discarded\n");
+                        free(pkt);
+                        return;
+                }
+                last->completed = true;
+        }
+
+        if (playout_buf->ring_count == playout_buf->ring_size) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Ring full, dropping oldest frame (RTP TS=%u)\n",
+                                ring_slot(playout_buf, 0)->rtp_timestamp);
+                ring_slot_clear(playout_buf, ring_slot(playout_buf, 0));
+                playout_buf->ring_head = (playout_buf->ring_head + 1) % playout_buf->ring_size;
+                playout_buf->ring_count -= 1;
+        }
+
+        struct pbuf_slot *slot = ring_slot(playout_buf, playout_buf->ring_count);
+        playout_buf->ring_count += 1;
+        assert(slot->count == 0);
+        slot->rtp_timestamp = pkt->ts;
+        slot->first_arrival = slot->last_arrival = arrival_time;
+        frame_times(playout_buf, arrival_time, pkt_ts_ns, &slot->playout_time,
+                        &slot->deletion_time, &slot->stretch);
+        slot->decoded = 0;
+        slot->mbit = 0;
+        slot->completed = false;
+        slot->partial_count = 0;
+        ring_slot_add(playout_buf, slot, pkt);
+}
+
+static void pbuf_ring_remove(struct pbuf *playout_buf, time_ns_t curr_time)
+{
+        while (playout_buf->ring_count > 0) {
+                struct pbuf_slot *slot = ring_slot(playout_buf, 0);
+                if (curr_time <= slot->deletion_time || !(slot->mbit == 1 || slot->completed)) {
+                        break;
+                }
+                ring_slot_clear(playout_buf, slot);
+                playout_buf->ring_head = (playout_buf->ring_head + 1) % playout_buf->ring_size;
+                playout_buf->ring_count -= 1;
+        }
+}
+
+/// @copydoc pbuf_decode_partial
+static int pbuf_ring_decode_partial(struct pbuf *playout_buf, decode_frame_t decode_func, void *data)
+{
+        struct pbuf_slot *slot = NULL;
+        for (int i = 0; i < playout_buf->ring_count; ++i) {
+                slot = ring_slot(playout_buf, i);
+                if (!slot->decoded) {
+                        break;
+                }
+                slot = NULL;
+        }
+        if (slot == NULL || slot->partial_count >= slot->count) {
+                return 0;
+        }
+        // link the new packets in arrival order, ring_slot_link() relinks them for decoding
+        struct coded_data *pkts = slot->pkts;
+        for (int i = slot->partial_count; i < slot->count; ++i) {
+                pkts[i].nxt = i < slot->count - 1 ? &pkts[i + 1] : NULL;
+                pkts[i].prv = i > slot->partial_count ? &pkts[i - 1] : NULL;
+        }
+        struct pbuf_stats stats = { playout_buf->received_pkts_cum,
+                playout_buf->expected_pkts_cum, slot->stretch,
+                slot->first_arrival, slot->last_arrival,
+                playout_buf->socket_drops_cum,
+                sender_time(playout_buf, slot->rtp_timestamp) };
+        int ret = decode_func(&pkts[slot->partial_count], data, &stats);
+        slot->partial_count = slot->count;
+        return ret;
+}
+
+/**
+ * Sorts the slot packets, drops duplicates and links them to a coded_data list
+ * in descending sequence number order (the order of the pbuf list).
+ *
+ * Packets arrive mostly in order, so insertion sort to ascending order is
+ * nearly linear here; the list is then linked from the end of the vector.
+ */
+static struct coded_data *ring_slot_link(struct pbuf *playout_buf, struct pbuf_slot *slot)
+{
+        struct coded_data *pkts = slot->pkts;
+        for (int i = 1; i < slot->count; ++i) {
+                struct coded_data tmp = pkts[i];
+                int j = i - 1;
+                while (j >= 0 && (int16_t)(tmp.seqno - pkts[j].seqno) < 0) {
+                        pkts[j + 1] = pkts[j];
+                        j -= 1;
+                }
+                pkts[j + 1] = tmp;
+        }
+        int count = slot->count > 0 ? 1 : 0;
+        for (int i = 1; i < slot->count; ++i) {
+                if (pkts[i].seqno == pkts[count - 1].seqno) {
+                        free(pkts[i].data);
+                        pbuf_mem_account(playout_buf, -1);
+                        continue;
+                }
+                pkts[count++] = pkts[i];
+        }
+        slot->count = count;
+        for (int i = 0; i < count; ++i) {
+                pkts[i].nxt = i > 0 ? &pkts[i - 1] : NULL;
+                pkts[i].prv = i < count - 1 ? &pkts[i + 1] : NULL;
+        }
+        return count > 0 ? &pkts[count - 1] : NULL;
+}
+
+static int pbuf_ring_decode(struct pbuf *playout_buf, time_ns_t curr_time,
+                decode_frame_t decode_func, void *data)
+{
+        for (int i = 0; i < playout_buf->ring_count; ++i) {
+                struct pbuf_slot *slot = ring_slot(playout_buf, i);
+                if (slot->decoded || curr_time <= slot->playout_time) {
+                        continue;
+                }
+                if (slot->count == 0) { // all packets dropped (OOM)
+                        slot->decoded = 1;
+                        continue;
+                }
+                if (slot->mbit == 1 || slot->completed) {
+                        struct pbuf_stats stats = { playout_buf->received_pkts_cum,
+                                playout_buf->expected_pkts_cum, slot->stretch,
+                                slot->first_arrival, slot->last_arrival,
+                                playout_buf->socket_drops_cum,
+                                sender_time(playout_buf, slot->rtp_timestamp) };
+                        int ret = decode_func(ring_slot_link(playout_buf, slot), data, &stats);
+                        slot->decoded = 1;
+                        adaptive_frame_decoded(&playout_buf->adaptive, slot->first_arrival,
+                                        slot->last_arrival, slot->playout_time);
+                        return ret;
+                }
+                if (curr_time > slot->playout_time + 1 * NS_IN_SEC) {
+                        slot->completed = true;
+                }
+                debug_msg("Unable to decode frame due to missing data (RTP TS=%u)\n",
+                                slot->rtp_timestamp);
+        }
+        return 0;
+}
@@ -78,6 +78,11 @@ struct coded_data {
 struct pbuf_stats {
         long long int received_pkts_cum;
         long long int expected_pkts_cum;
+        double playout_stretch; ///< playout duration of the frame relative to the nominal one (adaptive delay, otherwise 1.0)
+        time_ns_t first_arrival; ///< arrival time of the first packet of the frame
+        time_ns_t last_arrival;  ///< arrival time of the last packet of the frame
+        long long int socket_drops_cum; ///< packets dropped by the kernel (full socket buffer), included in lost ones
+        time_ns_t sender_time;   ///< sender wall-clock time of the frame RTP timestamp (see pbuf_set_sender_clock()), 0 if unknown
 };
 
 /* The playout buffer */
@@ -119,8 +124,16 @@ int 	 	 pbuf_is_empty(struct pbuf *playout_buf);
 int 	 	 pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
                              decode_frame_t decode_func, void *data);
                              //struct video_frame *framebuffer, int i, struct state_decoder *decoder);
+int		 pbuf_decode_partial(struct pbuf *playout_buf, decode_frame_t decode_func, void *data);
 void		 pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time);
 void		 pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay);
+void		 pbuf_set_adaptive_delay(struct pbuf *playout_buf, unsigned ts_rate, double min_delay, double max_delay);
+void		 pbuf_set_adaptive_miss_target(struct pbuf *playout_buf, double miss_ratio);
+double		 pbuf_get_playout_delay(struct pbuf *playout_buf);
+int		 pbuf_get_nacks(struct pbuf *playout_buf, time_ns_t curr_time, uint16_t *seqs, int max);
+time_ns_t	 pbuf_next_deadline(struct pbuf *playout_buf, time_ns_t curr_time);
+void		 pbuf_set_rtp_session(struct pbuf *playout_buf, struct rtp *session);
+void		 pbuf_set_sender_clock(struct pbuf *playout_buf, time_ns_t sender_time, uint32_t rtp_ts, unsigned ts_rate);
 
 #ifdef __cplusplus
 }
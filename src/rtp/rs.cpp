@@ -43,8 +43,10 @@
 
 #include <bitset>
 #include <stdlib.h>
+#include <vector>
 
 #include "debug.h"
+#include "rtp/gf256.h"
 #include "rtp/rs.h"
 #include "rtp/rtp_callback.h"
 #include "transmit.h"
@@ -64,6 +66,42 @@ extern "C" {
 #endif
 #include <fec.h>
 }
+
+/**
+ * Reconstructs missing primary symbols. Same as fec_decode() except that the
+ * output is written directly to the missing slots in the received buffer and
+ * the multiplication uses the SIMD kernels from gf256.
+ *
+ * @param pkt   k received symbols, primary symbol i (if received) at index i
+ * @param index index of the symbols in pkt (>= k for the parity ones)
+ */
+static bool repair(const fec_t *code, unsigned k, unsigned ss,
+                void *const *pkt, const unsigned *index, char *in)
+{
+        std::vector<uint8_t> dec(k * k);
+        for (unsigned i = 0; i < k; ++i) {
+                if (index[i] < k) {
+                        dec[i * k + i] = 1;
+                } else {
+                        memcpy(&dec[i * k], code->enc_matrix + index[i] * k, k);
+                }
+        }
+        if (gf256_invert(dec.data(), k) != 0) {
+                return false;
+        }
+
+        std::vector<uint8_t> rows;
+        std::vector<uint8_t *> dst;
+        for (unsigned i = 0; i < k; ++i) {
+                if (index[i] >= k) {
+                        rows.insert(rows.end(), &dec[i * k], &dec[i * k] + k);
+                        dst.push_back((uint8_t *) in + i * ss);
+                }
+        }
+        gf256_matmul(rows.data(), dst.size(), k, (const uint8_t *const *) pkt,
+                        dst.data(), ss);
+        return true;
+}
 #endif
 
 static void usage();
@@ -115,6 +153,7 @@ rs::rs(const char *c_cfg)
 #ifdef HAVE_ZFEC
         state = fec_new(m_k, m_n);
         assert(state != NULL);
+        LOG(LOG_LEVEL_VERBOSE) << "[RS] Using " << gf256_impl_name() << " GF(2^8) kernel\n";
 #else
         throw ug_runtime_error("zfec support is not compiled in");
 #endif
@@ -135,7 +174,7 @@ shared_ptr<video_frame> rs::encode(shared_ptr<video_frame> in)
         assert(state != nullptr);
 
         video_payload_hdr_t hdr;
-        format_video_header(in.get(), 0, 0, hdr);
+        format_video_header(in.get(), 0, frame_group, hdr);
         const size_t hdr_len = sizeof(hdr);
 
         struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in.get()));
@@ -154,30 +193,16 @@ shared_ptr<video_frame> rs::encode(shared_ptr<video_frame> in)
                 memcpy(out_data + sizeof(len32) + hdr_len, data, len);
                 memset(out_data + sizeof(len32) + hdr_len + len, 0, ss * m_k - (sizeof(len32) + hdr_len + len));
 
-#if 0
-                void *src[m_k];
-                for (int k = 0; k < m_k; ++k) {
-                        src[k] = *out + ss * k;
-                }
-
-                for (int m = 0; m < m_n - m_k; ++m) {
-                        fec_encode(state, src, *out + ss * (m_k + m), m, ss);
-                }
-#else
-                void *src[m_k];
+                const uint8_t *src[m_k];
                 for (unsigned int k = 0; k < m_k; ++k) {
-                        src[k] = out_data + ss * k;
+                        src[k] = (uint8_t *) out_data + ss * k;
                 }
-                void *dst[m_n-m_k];
-                unsigned int dst_idx[m_n-m_k];
+                uint8_t *dst[m_n-m_k];
                 for (unsigned int m = 0; m < m_n-m_k; ++m) {
-                        dst[m] = out_data + ss * (m_k + m);
-                        dst_idx[m] = m_k + m;
+                        dst[m] = (uint8_t *) out_data + ss * (m_k + m);
                 }
-
-                fec_encode((const fec_t *)state, (gf **) src,
-                                (gf **) dst, dst_idx, m_n-m_k, ss);
-#endif
+                gf256_matmul(((const fec_t *) state)->enc_matrix + m_k * m_k,
+                                m_n - m_k, m_k, src, dst, ss);
 
                 out->tiles[i].data_len = buffer_len;
                 out->fec_params = fec_desc(FEC_RS, m_k, m_n - m_k, 0, 0, ss);
@@ -221,20 +246,16 @@ audio_frame2 rs::encode(const audio_frame2 &in)
 
                 out.set_fec_params(i, fec_desc(FEC_RS, m_k, m_n - m_k, 0, 0, ss));
 
-                void *src[m_k];
+                const uint8_t *src[m_k];
                 for (unsigned int k = 0; k < m_k; ++k) {
-                        src[k] = out.get_data(i) + ss * k;
+                        src[k] = (uint8_t *) out.get_data(i) + ss * k;
                 }
-
-                void *dst[m_n-m_k];
-                unsigned int dst_idx[m_n-m_k];
+                uint8_t *dst[m_n-m_k];
                 for (unsigned int m = 0; m < m_n-m_k; ++m) {
-                        dst[m] = out.get_data(i) + ss * (m_k + m);
-                        dst_idx[m] = m_k + m;
+                        dst[m] = (uint8_t *) out.get_data(i) + ss * (m_k + m);
                 }
-
-                fec_encode((const fec_t *)state, (gf **) src,
-                                (gf **) dst, dst_idx, m_n-m_k, ss);
+                gf256_matmul(((const fec_t *) state)->enc_matrix + m_k * m_k,
+                                m_n - m_k, m_k, src, dst, ss);
         }
 
         return out;
@@ -379,26 +400,12 @@ bool rs::decode(char *in, int in_len, char **out, int *len,
                 return false;
         }
 
-        char **output = (char **) malloc(m_k * sizeof(char *));
-        for (unsigned int i = 0; i < m_k; ++i) {
-                output[i] = (char *) malloc(ss);
-        }
-
-        fec_decode((const fec_t *) state, (const gf *const *) pkt,
-                        (gf *const *) output, index, ss);
-
-        i = 0;
-        for (unsigned int j = 0; j < m_k; ++j) {
-                if (repaired_slots.test(j)) {
-                        memcpy((void *) (in + j * ss), output[i], ss);
-                        i++;
-                }
-        }
-
-        for (unsigned int i = 0; i < m_k; ++i) {
-                free(output[i]);
+        if (repaired_slots.any() && 
+                        !repair((const fec_t *) state, m_k, ss, pkt, index, in)) {
+                *len = get_buf_len(in, c_m);
+                *out = (char *) in + sizeof(uint32_t);
+                return false;
         }
-        free(output);
 
         uint32_t out_sz;
         memcpy(&out_sz, in, sizeof(out_sz));
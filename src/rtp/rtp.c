@@ -77,6 +77,7 @@
 #endif // defined HAVE_CONFIG_H
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdatomic.h>
 
 #include "memory.h"
@@ -91,6 +92,7 @@
 #include "crypto/md5.h"
 #include "ntp.h"
 #include "rtp.h"
+#include "utils/macros.h"
 #include "utils/misc.h"
 #include "utils/net.h"
 
@@ -122,6 +124,7 @@ static int des_encrypt(struct rtp *session, unsigned char *data,
                        unsigned int size, unsigned char *initVec);
 static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
                uint8_t *buffer, rtp_packet *packet, int buflen);
+static void rtcp_udp_send(struct rtp *session, int len, char *buffer);
 
 #define MAX_DROPOUT    3000
 #define MAX_MISORDER   100
@@ -142,6 +145,13 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
 #define RTCP_BYE  203
 #define RTCP_APP  204
 #define RTCP_RX   205
+#define RTCP_RTPFB 205  /* RFC 4585 transport layer feedback - shares PT with the (unused) TFRC RX report */
+
+#define RTCP_PSFB 206  /* RFC 4585 payload-specific feedback */
+
+#define RTCP_FB_NACK 1  /* RTPFB FMT of Generic NACK */
+#define RTCP_FB_PLI  1  /* PSFB FMT of Picture Loss Indication */
+#define RTCP_FB_FIR  4  /* PSFB FMT of Full Intra Request (RFC 5104) */
 
 typedef struct {
 #ifdef WORDS_BIGENDIAN
@@ -190,9 +200,7 @@ typedef struct {
         } r;
 } rtcp_t;
 
-typedef struct _rtcp_rr_wrapper {
-        struct _rtcp_rr_wrapper *next;
-        struct _rtcp_rr_wrapper *prev;
+typedef struct {
         uint32_t reporter_ssrc;
         rtcp_rr *rr;
         rtcp_rx *rx;
@@ -236,16 +244,13 @@ typedef struct _source {
         uint32_t magic;         /* For debugging... */
 } source;
 
-/* The size of the hash table used to hold the source database. */
-/* Should be large enough that we're unlikely to get collisions */
-/* when sources are added, but not too large that we waste too  */
-/* much memory. Sedgewick ("Algorithms", 2nd Ed, Addison-Wesley */
-/* 1988) suggests that this should be around 1/10th the number  */
-/* of entries that we expect to have in the database and should */
-/* be a prime number. Everything continues to work if this is   */
-/* too low, it just goes slower... for now we assume around 100 */
-/* participants is a sensible limit so we set this to 11.       */
-#define RTP_DB_SIZE	11
+/* The source database and the receiver report store are indexed */
+/* by open-addressing (linear probing) hash tables that grow with */
+/* the number of participants so that the per-packet lookups stay */
+/* constant even in large sessions (reflector, mixer, multicast). */
+/* RTP_DB_SIZE is the initial (and minimal) number of slots, the  */
+/* tables are at most half full. Must be a power of two.          */
+#define RTP_DB_SIZE	16
 
 /*
  *  Options for an RTP session are stored in the "options" struct.
@@ -272,6 +277,20 @@ typedef bool (*rtp_decrypt_func) (struct rtp *, unsigned char *data,
  * The "struct rtp" defines an RTP session.
  */
 
+/*
+ * Copies of the recently sent RTP packets (indexed by seq modulo size) so
+ * that packets reported lost by a Generic NACK can be retransmitted. Sending
+ * and NACK processing may run in different threads, hence the lock.
+ */
+struct rtp_retx_ring {
+        pthread_mutex_t lock;
+        int size;
+        int *len;               /* 0 if the slot is empty */
+        uint16_t *seq;
+        uint8_t *data;          /* size * RTP_MAX_PACKET_LEN, allocated on first send */
+        unsigned long long retransmitted;
+};
+
 struct rtp {
         socket_udp *rtp_socket;
         socket_udp *rtcp_socket;
@@ -280,8 +299,15 @@ struct rtp {
         bool send_rtcp_to_origin; /* whether send RTCP reports to rtcp_dest */
         uint32_t my_ssrc;
         int last_advertised_csrc;
-        source *db[RTP_DB_SIZE];
-        rtcp_rr_wrapper rr[RTP_DB_SIZE][RTP_DB_SIZE];   /* Indexed by [hash(reporter)][hash(reportee)] */
+        source **db;            /* hash index of the sources, db_size (power of two) slots */
+        unsigned db_size;
+        unsigned db_used;
+        source *sources;        /* all sources linked by next/prev, for iteration */
+        rtcp_rr_wrapper *rr;    /* flat store of reception reports, rr_count of rr_capacity used */
+        int rr_count;
+        int rr_capacity;
+        int *rr_index;          /* hash index of rr by (reporter, reportee) - position + 1, 0 if empty */
+        unsigned rr_index_size;
         options *opt;
         uint8_t *userdata;
         int invalid_rtp_count;
@@ -308,6 +334,7 @@ struct rtp {
         uint32_t rtp_pcount;
         uint32_t rtp_bcount;
         uint64_t rtp_bytes_sent;
+        uint64_t rtp_bytes_received;
         int tfrc_on;            /* indicates TFRC congestion control */
         /* tfrc sender variables */
         uint32_t cmp_rtt;       /* rtt as computed by the sender */
@@ -333,6 +360,9 @@ struct rtp {
         rtp_callback callback;
         struct msghdr *mhdr;
         bool mt_recv; /* whether the receiver uses separate thread for receiving */
+        struct rtp_retx_ring *retx; /* NULL if retransmissions are disabled */
+        atomic_int keyframe_requests; /* PLI/FIR for our stream received since rtp_take_keyframe_requests() */
+        uint8_t fir_seq;        /* sequence number of the last FIR sent */
         uint32_t magic;         /* For debugging...  */
 };
 
@@ -345,26 +375,21 @@ static inline int filter_event(struct rtp *session, uint32_t ssrc)
 static uint32_t next_csrc(struct rtp *session)
 {
         /* This returns each source marked "should_advertise_sdes" in turn. */
-        int chain, cc;
+        int cc;
         source *s;
 
         cc = 0;
-        for (chain = 0; chain < RTP_DB_SIZE; chain++) {
-                /* Check that the linked lists making up the chains in */
-                /* the hash table are correctly linked together...     */
-                for (s = session->db[chain]; s != NULL; s = s->next) {
-                        if (s->should_advertise_sdes) {
-                                if (cc == session->last_advertised_csrc) {
-                                        session->last_advertised_csrc++;
-                                        if (session->last_advertised_csrc ==
-                                            session->csrc_count) {
-                                                session->last_advertised_csrc =
-                                                    0;
-                                        }
-                                        return s->ssrc;
-                                } else {
-                                        cc++;
+        for (s = session->sources; s != NULL; s = s->next) {
+                if (s->should_advertise_sdes) {
+                        if (cc == session->last_advertised_csrc) {
+                                session->last_advertised_csrc++;
+                                if (session->last_advertised_csrc ==
+                                    session->csrc_count) {
+                                        session->last_advertised_csrc = 0;
                                 }
+                                return s->ssrc;
+                        } else {
+                                cc++;
                         }
                 }
         }
@@ -372,62 +397,187 @@ static uint32_t next_csrc(struct rtp *session)
         abort();
 }
 
-static inline int ssrc_hash(uint32_t ssrc)
+static inline uint32_t ssrc_hash(uint32_t ssrc)
 {
         /* Hash from an ssrc to a position in the source database.   */
-        /* Assumes that ssrc values are uniformly distributed, which */
-        /* should be true but probably isn't (Rosenberg has reported */
-        /* that many implementations generate ssrc values which are  */
-        /* not uniformly distributed over the space, and the H.323   */
-        /* spec requires that they are non-uniformly distributed).   */
-        /* This routine is written as a function rather than inline  */
-        /* code to allow it to be made smart in future: probably we  */
-        /* should run MD5 on the ssrc and derive a hash value from   */
-        /* that, to ensure it's more uniformly distributed?          */
-        return ssrc % RTP_DB_SIZE;
+        /* SSRC values should be uniformly distributed, but probably */
+        /* aren't (Rosenberg has reported that many implementations  */
+        /* generate ssrc values which are not uniformly distributed  */
+        /* over the space, and the H.323 spec requires that they are */
+        /* non-uniformly distributed), so the bits are mixed first.  */
+        ssrc ^= ssrc >> 16;
+        ssrc *= 0x7feb352dU;
+        ssrc ^= ssrc >> 15;
+        ssrc *= 0x846ca68bU;
+        ssrc ^= ssrc >> 16;
+        return ssrc;
+}
+
+static inline uint32_t rr_hash(uint32_t reporter_ssrc, uint32_t reportee_ssrc)
+{
+        return ssrc_hash(reporter_ssrc ^ ssrc_hash(reportee_ssrc));
+}
+
+/* Backward-shift deletion for the linear probing tables: the entry in */
+/* slot i is removed, following entries of the cluster are moved back  */
+/* unless they would get before their home slot. @returns the slot to  */
+/* be cleared, move(to, from) moves the entries.                       */
+#define HASH_DELETE(size, i, is_empty, home_of, move) do { \
+                unsigned mask_ = (size) - 1; \
+                for (unsigned j_ = ((i) + 1) & mask_; !(is_empty(j_)); j_ = (j_ + 1) & mask_) { \
+                        unsigned k_ = home_of(j_) & mask_; \
+                        if ((j_ > (i) && (k_ <= (i) || k_ > j_)) || (j_ < (i) && k_ <= (i) && k_ > j_)) { \
+                                move((i), j_); \
+                                (i) = j_; \
+                        } \
+                } \
+        } while (0)
+
+/* @returns the slot of the source or the empty slot where it belongs */
+static source **source_slot(struct rtp *session, uint32_t ssrc)
+{
+        unsigned mask = session->db_size - 1;
+        for (unsigned i = ssrc_hash(ssrc) & mask; ; i = (i + 1) & mask) {
+                if (session->db[i] == NULL || session->db[i]->ssrc == ssrc) {
+                        return &session->db[i];
+                }
+        }
+}
+
+static void source_index_resize(struct rtp *session, unsigned size)
+{
+        source **old = session->db;
+        unsigned old_size = session->db_size;
+
+        session->db = (source **) calloc(size, sizeof(source *));
+        session->db_size = size;
+        for (unsigned i = 0; i < old_size; i++) {
+                if (old[i] != NULL) {
+                        *source_slot(session, old[i]->ssrc) = old[i];
+                }
+        }
+        free(old);
+}
+
+static void source_index_add(struct rtp *session, source * s)
+{
+        if ((session->db_used + 1) * 2 > session->db_size) {
+                source_index_resize(session, session->db_size * 2);
+        }
+        source **slot = source_slot(session, s->ssrc);
+        assert(*slot == NULL);
+        *slot = s;
+        session->db_used++;
+}
+
+static void source_index_remove(struct rtp *session, uint32_t ssrc)
+{
+        unsigned i = source_slot(session, ssrc) - session->db;
+        assert(session->db[i] != NULL);
+#define SRC_EMPTY(j) (session->db[j] == NULL)
+#define SRC_HOME(j) ssrc_hash(session->db[j]->ssrc)
+#define SRC_MOVE(to, from) session->db[to] = session->db[from]
+        HASH_DELETE(session->db_size, i, SRC_EMPTY, SRC_HOME, SRC_MOVE);
+#undef SRC_EMPTY
+#undef SRC_HOME
+#undef SRC_MOVE
+        session->db[i] = NULL;
+        session->db_used--;
+        if (session->db_used * 8 < session->db_size && session->db_size > RTP_DB_SIZE) {
+                source_index_resize(session, session->db_size / 2);
+        }
+}
+
+/* @returns the rr_index slot of the report or the empty slot where it belongs */
+static int *rr_slot(struct rtp *session, uint32_t reporter_ssrc, uint32_t reportee_ssrc)
+{
+        unsigned mask = session->rr_index_size - 1;
+        for (unsigned i = rr_hash(reporter_ssrc, reportee_ssrc) & mask; ; i = (i + 1) & mask) {
+                int pos = session->rr_index[i] - 1;
+                if (pos < 0 || (session->rr[pos].reporter_ssrc == reporter_ssrc
+                                && session->rr[pos].rr->ssrc == reportee_ssrc)) {
+                        return &session->rr_index[i];
+                }
+        }
+}
+
+static void rr_index_resize(struct rtp *session, unsigned size)
+{
+        free(session->rr_index);
+        session->rr_index = (int *) calloc(size, sizeof(int));
+        session->rr_index_size = size;
+        for (int pos = 0; pos < session->rr_count; pos++) {
+                *rr_slot(session, session->rr[pos].reporter_ssrc, session->rr[pos].rr->ssrc) = pos + 1;
+        }
+}
+
+/* Removes the report at position pos of the store, the last one is moved there. */
+static void rr_remove_at(struct rtp *session, int pos)
+{
+        rtcp_rr_wrapper *cur = &session->rr[pos];
+        unsigned i = rr_slot(session, cur->reporter_ssrc, cur->rr->ssrc) - session->rr_index;
+        assert(session->rr_index[i] == pos + 1);
+#define RR_EMPTY(j) (session->rr_index[j] == 0)
+#define RR_HOME(j) rr_hash(session->rr[session->rr_index[j] - 1].reporter_ssrc, \
+                session->rr[session->rr_index[j] - 1].rr->ssrc)
+#define RR_MOVE(to, from) session->rr_index[to] = session->rr_index[from]
+        HASH_DELETE(session->rr_index_size, i, RR_EMPTY, RR_HOME, RR_MOVE);
+#undef RR_EMPTY
+#undef RR_HOME
+#undef RR_MOVE
+        session->rr_index[i] = 0;
+
+        free(cur->rr);
+        free(cur->rx);
+        int last = --session->rr_count;
+        if (pos != last) {
+                *cur = session->rr[last];
+                *rr_slot(session, cur->reporter_ssrc, cur->rr->ssrc) = pos + 1;
+        }
+        if (session->rr_count * 8 < (int) session->rr_index_size && session->rr_index_size > RTP_DB_SIZE) {
+                rr_index_resize(session, session->rr_index_size / 2);
+        }
 }
 
 static void insert_rr(struct rtp *session, uint32_t reporter_ssrc, rtcp_rr * rr,
                       rtcp_rx * rx)
 {
         /* Insert the reception report into the receiver report      */
-        /* database. This database is a two dimensional table of     */
-        /* rr_wrappers indexed by hashes of reporter_ssrc and        */
-        /* reportee_src.  The rr_wrappers in the database are        */
-        /* sentinels to reduce conditions in list operations.        */
+        /* database. This database is a flat array of rr_wrappers    */
+        /* indexed by a hash table keyed by reporter_ssrc and        */
+        /* reportee_src.                                             */
         /* The ts is used to determine when to timeout this rr.      */
 
-        rtcp_rr_wrapper *cur, *start;
-
-        start = &session->rr[ssrc_hash(reporter_ssrc)][ssrc_hash(rr->ssrc)];
-        cur = start->next;
-
-        while (cur != start) {
-                if (cur->reporter_ssrc == reporter_ssrc
-                    && cur->rr->ssrc == rr->ssrc) {
-                        /* Replace existing entry in the database  */
-                        free(cur->rr);
-                        if (cur->rx)
-                                free(cur->rx);
-                        cur->rr = rr;
-                        cur->rx = rx;
-                        cur->ts = get_time_in_ns();
-                        return;
-                }
-                cur = cur->next;
+        int *slot = rr_slot(session, reporter_ssrc, rr->ssrc);
+        rtcp_rr_wrapper *cur;
+
+        if (*slot != 0) {
+                /* Replace existing entry in the database  */
+                cur = &session->rr[*slot - 1];
+                free(cur->rr);
+                free(cur->rx);
+                cur->rr = rr;
+                cur->rx = rx;
+                cur->ts = get_time_in_ns();
+                return;
         }
 
         /* No entry in the database so create one now. */
-        cur = (rtcp_rr_wrapper *) malloc(sizeof(rtcp_rr_wrapper));
+        if (session->rr_count == session->rr_capacity) {
+                session->rr_capacity *= 2;
+                session->rr = (rtcp_rr_wrapper *) realloc(session->rr,
+                                session->rr_capacity * sizeof(rtcp_rr_wrapper));
+        }
+        cur = &session->rr[session->rr_count++];
         cur->reporter_ssrc = reporter_ssrc;
         cur->rr = rr;
         cur->rx = rx;
         cur->ts = get_time_in_ns();
-        /* Fix links */
-        cur->next = start->next;
-        cur->next->prev = cur;
-        cur->prev = start;
-        cur->prev->next = cur;
+        if (session->rr_count * 2 > (int) session->rr_index_size) {
+                rr_index_resize(session, session->rr_index_size * 2);
+        } else {
+                *slot = session->rr_count;
+        }
 
         debug_msg("Created new rr entry for 0x%08" PRIx32 " from source 0x%08" PRIx32 "\n",
                   rr->ssrc, reporter_ssrc);
@@ -437,41 +587,12 @@ static void insert_rr(struct rtp *session, uint32_t reporter_ssrc, rtcp_rr * rr,
 static void remove_rr(struct rtp *session, uint32_t ssrc)
 {
         /* Remove any RRs from "s" which refer to "ssrc" as either   */
-        /* reporter or reportee.                                     */
-        rtcp_rr_wrapper *start, *cur, *tmp;
-        int i;
-
-        /* Remove rows, i.e. ssrc == reporter_ssrc                   */
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                start = &session->rr[ssrc_hash(ssrc)][i];
-                cur = start->next;
-                while (cur != start) {
-                        if (cur->reporter_ssrc == ssrc) {
-                                tmp = cur;
-                                cur = cur->prev;
-                                tmp->prev->next = tmp->next;
-                                tmp->next->prev = tmp->prev;
-                                free(tmp->rr);
-                                free(tmp);
-                        }
-                        cur = cur->next;
-                }
-        }
-
-        /* Remove columns, i.e.  ssrc == reporter_ssrc */
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                start = &session->rr[i][ssrc_hash(ssrc)];
-                cur = start->next;
-                while (cur != start) {
-                        if (cur->rr->ssrc == ssrc) {
-                                tmp = cur;
-                                cur = cur->prev;
-                                tmp->prev->next = tmp->next;
-                                tmp->next->prev = tmp->prev;
-                                free(tmp->rr);
-                                free(tmp);
-                        }
-                        cur = cur->next;
+        /* reporter or reportee. Iterating backwards, since the last */
+        /* entry is moved in place of the removed one.               */
+        for (int i = session->rr_count - 1; i >= 0; i--) {
+                if (session->rr[i].reporter_ssrc == ssrc
+                    || session->rr[i].rr->ssrc == ssrc) {
+                        rr_remove_at(session, i);
                 }
         }
 }
@@ -480,36 +601,21 @@ static void timeout_rr(struct rtp *session, time_ns_t curr_ts)
 {
         /* Timeout any reception reports which have been in the database for more than 3 */
         /* times the RTCP reporting interval without refresh.                            */
-        rtcp_rr_wrapper *start, *cur, *tmp;
         rtp_event event;
-        int i, j;
-
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                for (j = 0; j < RTP_DB_SIZE; j++) {
-                        start = &session->rr[i][j];
-                        cur = start->next;
-                        while (cur != start) {
-                                if (curr_ts - cur->ts >
-                                    session->rtcp_interval * 3 * NS_IN_SEC) {
-                                        /* Signal the application... */
-                                        if (!filter_event
-                                            (session, cur->reporter_ssrc)) {
-                                                event.ssrc = cur->reporter_ssrc;
-                                                event.type = RR_TIMEOUT;
-                                                event.data = cur->rr;
-                                                session->callback(session,
-                                                                  &event);
-                                        }
-                                        /* Delete this reception report... */
-                                        tmp = cur;
-                                        cur = cur->prev;
-                                        tmp->prev->next = tmp->next;
-                                        tmp->next->prev = tmp->prev;
-                                        free(tmp->rr);
-                                        free(tmp);
-                                }
-                                cur = cur->next;
+
+        for (int i = session->rr_count - 1; i >= 0; i--) {
+                rtcp_rr_wrapper *cur = &session->rr[i];
+                if (curr_ts - cur->ts >
+                    session->rtcp_interval * 3 * NS_IN_SEC) {
+                        /* Signal the application... */
+                        if (!filter_event(session, cur->reporter_ssrc)) {
+                                event.ssrc = cur->reporter_ssrc;
+                                event.type = RR_TIMEOUT;
+                                event.data = cur->rr;
+                                session->callback(session, &event);
                         }
+                        /* Delete this reception report... */
+                        rr_remove_at(session, i);
                 }
         }
 }
@@ -517,19 +623,23 @@ static void timeout_rr(struct rtp *session, time_ns_t curr_ts)
 static const rtcp_rr *get_rr(struct rtp *session, uint32_t reporter_ssrc,
                              uint32_t reportee_ssrc)
 {
-        rtcp_rr_wrapper *cur, *start;
+        int pos = *rr_slot(session, reporter_ssrc, reportee_ssrc);
+        return pos != 0 ? session->rr[pos - 1].rr : NULL;
+}
 
-        start =
-            &session->rr[ssrc_hash(reporter_ssrc)][ssrc_hash(reportee_ssrc)];
-        cur = start->next;
-        while (cur != start) {
-                if (cur->reporter_ssrc == reporter_ssrc &&
-                    cur->rr->ssrc == reportee_ssrc) {
-                        return cur->rr;
-                }
-                cur = cur->next;
-        }
-        return NULL;
+/* Initialises empty source database and receiver report store. */
+static void init_source_db(struct rtp *session)
+{
+        session->db = (source **) calloc(RTP_DB_SIZE, sizeof(source *));
+        session->db_size = RTP_DB_SIZE;
+        session->db_used = 0;
+        session->sources = NULL;
+        session->rr_capacity = RTP_DB_SIZE;
+        session->rr = (rtcp_rr_wrapper *) malloc(session->rr_capacity * sizeof(rtcp_rr_wrapper));
+        session->rr_count = 0;
+        session->rr_index = (int *) calloc(RTP_DB_SIZE, sizeof(int));
+        session->rr_index_size = RTP_DB_SIZE;
+        session->last_advertised_csrc = 0;
 }
 
 static inline void check_source(source * s)
@@ -550,7 +660,6 @@ static inline void check_database(struct rtp *session)
 #if defined DEBUG && ! defined SUPPRESS_BUGS
         source *s;
         int source_count;
-        int chain;
 
         assert(session != NULL);
         assert(session->magic == 0xfeedface);
@@ -559,40 +668,34 @@ static inline void check_database(struct rtp *session)
         /* performed during initialisation whilst creating the */
         /* source entry for my_ssrc.                           */
         if (session->ssrc_count > 0) {
-                for (s = session->db[ssrc_hash(session->my_ssrc)]; s != NULL;
-                     s = s->next) {
-                        if (s->ssrc == session->my_ssrc) {
-                                break;
-                        }
-                }
-                assert(s != NULL);
+                assert(*source_slot(session, session->my_ssrc) != NULL);
         }
 
         source_count = 0;
-        for (chain = 0; chain < RTP_DB_SIZE; chain++) {
-                /* Check that the linked lists making up the chains in */
-                /* the hash table are correctly linked together...     */
-                for (s = session->db[chain]; s != NULL; s = s->next) {
-                        check_source(s);
-                        source_count++;
-                        if (s->prev == NULL) {
-                                assert(s == session->db[chain]);
-                        } else {
-                                assert(s->prev->next == s);
-                        }
-                        if (s->next != NULL) {
-                                assert(s->next->prev == s);
-                        }
-                        /* Check that the SR is for this source... */
-                        if (s->sr != NULL) {
-                                /// @bug Fails here presumably on race condition (when struct rtp used by 2 threads)
-                                assert(s->sr->ssrc == s->ssrc);
-                        }
+        /* Check that the list of sources is correctly linked  */
+        /* together and that each source is in the index...    */
+        for (s = session->sources; s != NULL; s = s->next) {
+                check_source(s);
+                source_count++;
+                if (s->prev == NULL) {
+                        assert(s == session->sources);
+                } else {
+                        assert(s->prev->next == s);
+                }
+                if (s->next != NULL) {
+                        assert(s->next->prev == s);
+                }
+                assert(*source_slot(session, s->ssrc) == s);
+                /* Check that the SR is for this source... */
+                if (s->sr != NULL) {
+                        /// @bug Fails here presumably on race condition (when struct rtp used by 2 threads)
+                        assert(s->sr->ssrc == s->ssrc);
                 }
         }
         /* Check that the number of entries in the hash table  */
         /* matches session->ssrc_count                         */
         assert(source_count == session->ssrc_count);
+        assert(source_count == (int) session->db_used);
 #else
         UNUSED(session);
 #endif
@@ -603,31 +706,27 @@ static inline source *get_source(struct rtp *session, uint32_t ssrc)
         source *s;
 
         check_database(session);
-        for (s = session->db[ssrc_hash(ssrc)]; s != NULL; s = s->next) {
-                if (s->ssrc == ssrc) {
-                        check_source(s);
-                        return s;
-                }
+        s = *source_slot(session, ssrc);
+        if (s != NULL) {
+                check_source(s);
         }
-        return NULL;
+        return s;
 }
 
 static source *really_create_source(struct rtp *session, uint32_t ssrc,
                                     int probation, source * s)
 {
         /* Create a new source entry, and add it to the database.    */
-        /* The database is a hash table, using the separate chaining */
-        /* algorithm.                                                */
+        /* The database is a hash table, using the open addressing   */
+        /* (linear probing) algorithm, plus a list for iteration.    */
         rtp_event event;
-        int h;
 
         check_database(session);
         /* This is a new source, we have to create it... */
-        h = ssrc_hash(ssrc);
         s = (source *) malloc(sizeof(source));
         memset(s, 0, sizeof(source));
         s->magic = 0xc001feed;
-        s->next = session->db[h];
+        s->next = session->sources;
         s->ssrc = ssrc;
         if (probation) {
                 /* This is a probationary source, which only counts as */
@@ -639,10 +738,11 @@ static source *really_create_source(struct rtp *session, uint32_t ssrc,
 
         s->last_active = get_time_in_ns();
         /* Now, add it to the database... */
-        if (session->db[h] != NULL) {
-                session->db[h]->prev = s;
+        if (session->sources != NULL) {
+                session->sources->prev = s;
         }
-        session->db[ssrc_hash(ssrc)] = s;
+        session->sources = s;
+        source_index_add(session, s);
         session->ssrc_count++;
         check_database(session);
 
@@ -679,7 +779,6 @@ static void delete_source(struct rtp *session, uint32_t ssrc)
 {
         /* Remove a source from the RTP database... */
         source *s = get_source(session, ssrc);
-        int h = ssrc_hash(ssrc);
         rtp_event event;
         time_ns_t event_ts = get_time_in_ns();
 
@@ -687,14 +786,15 @@ static void delete_source(struct rtp *session, uint32_t ssrc)
 
         check_source(s);
         check_database(session);
-        if (session->db[h] == s) {
-                /* It's the first entry in this chain... */
-                session->db[h] = s->next;
+        source_index_remove(session, ssrc);
+        if (session->sources == s) {
+                /* It's the first entry in the list... */
+                session->sources = s->next;
                 if (s->next != NULL) {
                         s->next->prev = NULL;
                 }
         } else {
-                assert(s->prev != NULL);        /* Else it would be the first in the chain... */
+                assert(s->prev != NULL);        /* Else it would be the first in the list... */
                 s->prev->next = s->next;
                 if (s->next != NULL) {
                         s->next->prev = s->prev;
@@ -1075,7 +1175,6 @@ struct rtp *rtp_init_if(const char *addr, const char *iface,
                         int force_ip_version, bool multithreaded)
 {
         struct rtp *session;
-        int i, j;
         char *cname;
         char *hname;
 
@@ -1170,6 +1269,7 @@ struct rtp *rtp_init_if(const char *addr, const char *iface,
         session->tfrc_on = tfrc_on;
         session->rtp_bcount = 0;
         session->rtp_bytes_sent = 0;
+        session->rtp_bytes_received = 0;
         session->last_update =
                 session->last_rtcp_send_time =
                 session->next_rtcp_send_time = get_time_in_ns();
@@ -1180,18 +1280,7 @@ struct rtp *rtp_init_if(const char *addr, const char *iface,
         session->next_rtcp_send_time += rtcp_interval(session) * NS_IN_SEC;
 
         /* Initialise the source database... */
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                session->db[i] = NULL;
-        }
-        session->last_advertised_csrc = 0;
-
-        /* Initialize sentinels in rr table */
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                for (j = 0; j < RTP_DB_SIZE; j++) {
-                        session->rr[i][j].next = &session->rr[i][j];
-                        session->rr[i][j].prev = &session->rr[i][j];
-                }
-        }
+        init_source_db(session);
 
         /* Create a database entry for ourselves... */
         create_source(session, session->my_ssrc, FALSE);
@@ -1209,7 +1298,6 @@ struct rtp *rtp_init_if(const char *addr, const char *iface,
 rtp_t rtp_init_with_udp_socket(struct socket_udp_local *l, struct sockaddr *sa, socklen_t len, rtp_callback callback)
 {
         struct rtp *session;
-        int i, j;
         char *cname;
         char *hname;
         int ttl = 127;        /*  FIXME */
@@ -1226,7 +1314,7 @@ rtp_t rtp_init_with_udp_socket(struct socket_udp_local *l, struct sockaddr *sa,
         session->send_rtcp_to_origin = true;
 
         session->rtp_socket = udp_init_with_local(l, sa, len);
-        session->rtcp_socket = udp_init_if("localhost", NULL, 0, 0, ttl, true, false);
+        session->rtcp_socket = udp_init_if("localhost", NULL, 0, 0, ttl, 0, false);
 
         init_opt(session);
 
@@ -1263,6 +1351,7 @@ rtp_t rtp_init_with_udp_socket(struct socket_udp_local *l, struct sockaddr *sa,
         session->tfrc_on = tfrc_on;
         session->rtp_bcount = 0;
         session->rtp_bytes_sent = 0;
+        session->rtp_bytes_received = 0;
         session->last_update =
                 session->last_rtcp_send_time =
                 session->next_rtcp_send_time = get_time_in_ns();
@@ -1273,18 +1362,7 @@ rtp_t rtp_init_with_udp_socket(struct socket_udp_local *l, struct sockaddr *sa,
         session->next_rtcp_send_time += NS_IN_SEC * rtcp_interval(session);
 
         /* Initialise the source database... */
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                session->db[i] = NULL;
-        }
-        session->last_advertised_csrc = 0;
-
-        /* Initialize sentinels in rr table */
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                for (j = 0; j < RTP_DB_SIZE; j++) {
-                        session->rr[i][j].next = &session->rr[i][j];
-                        session->rr[i][j].prev = &session->rr[i][j];
-                }
-        }
+        init_source_db(session);
 
         /* Create a database entry for ourselves... */
         create_source(session, session->my_ssrc, FALSE);
@@ -1313,21 +1391,18 @@ rtp_t rtp_init_with_udp_socket(struct socket_udp_local *l, struct sockaddr *sa,
 bool rtp_set_my_ssrc(struct rtp *session, uint32_t ssrc)
 {
         source *s;
-        uint32_t h;
 
         if (session->ssrc_count != 1 && session->sender_count != 0) {
                 return false;
         }
         /* Remove existing source */
-        h = ssrc_hash(session->my_ssrc);
-        s = session->db[h];
-        session->db[h] = NULL;
+        s = get_source(session, session->my_ssrc);
+        source_index_remove(session, session->my_ssrc);
         /* Fill in new ssrc       */
         session->my_ssrc = ssrc;
         s->ssrc = ssrc;
-        h = ssrc_hash(ssrc);
         /* Put source back        */
-        session->db[h] = s;
+        source_index_add(session, s);
         return true;
 }
 
@@ -1439,6 +1514,14 @@ uint32_t rtp_my_ssrc(struct rtp * session)
         return session->my_ssrc;
 }
 
+/**
+ * @returns sequence number of the next sent RTP packet
+ */
+uint16_t rtp_get_next_seq(struct rtp *session)
+{
+        return session->rtp_seq;
+}
+
 static bool validate_rtp2(rtp_packet * packet, int len, int vlen)
 {
         /* Check for valid payload types..... 72-76 are RTCP payload type numbers, with */
@@ -1526,7 +1609,12 @@ process_rtp(struct rtp *session, uint32_t curr_rtp_ts, rtp_packet * packet,
         if (session->tfrc_on)
                 compute_loss_intervals(session, packet);
 
-        transit = curr_rtp_ts - packet->ts;
+        if (packet->arrival_ns != 0) { // RX timestamp, 90 kHz clock (UltraGrid native) assumed
+                uint32_t arrival_ts = packet->arrival_ns / 100000LL * 9 + packet->arrival_ns % 100000LL * 9 / 100000LL;
+                transit = arrival_ts - packet->ts;
+        } else {
+                transit = curr_rtp_ts - packet->ts;
+        }
         d = transit - s->transit;
         s->transit = transit;
         if (d < 0) {
@@ -1555,6 +1643,35 @@ int rtp_send_raw_rtp_data(struct rtp *session, char *data, int buflen)
         return udp_send(session->rtp_socket, data, buflen);
 }
 
+/**
+ * Passes a raw RTP packet to the receiving side of the session without
+ * sending it through the network (loopback). The packet is processed by the
+ * receiving thread (rtp_recv_r()) the same way as the packets received from
+ * the socket.
+ *
+ * Only sessions with multithreaded receiving are supported and packets may be
+ * injected by one thread only.
+ *
+ * @returns buflen on success, -1 with errno set otherwise (ENOBUFS if the
+ *          receive queue is full and the packet was dropped)
+ */
+int rtp_inject_packet(struct rtp *session, const char *data, int buflen)
+{
+        if (!session->mt_recv) {
+                errno = ENOTSUP;
+                return -1;
+        }
+        if (buflen > RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE) {
+                errno = EMSGSIZE;
+                return -1;
+        }
+        if (!udp_inject_data(session->rtp_socket, data, buflen)) {
+                errno = ENOBUFS;
+                return -1;
+        }
+        return buflen;
+}
+
 static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
 {
         int buflen;
@@ -1571,6 +1688,7 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
                         packet = (rtp_packet *) malloc(RTP_MAX_PACKET_LEN + (session->opt->record_source ? sizeof(struct sockaddr_storage) : 0));
                         buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
                 }
+                packet->arrival_ns = 0;
                 struct sockaddr_storage *sin = NULL;
                 socklen_t addrlen = 0;
                 if (session->opt->record_source) {
@@ -1602,6 +1720,7 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
         source *s;
 
         if (buflen > 0) {
+                session->rtp_bytes_received += buflen;
                 if (session->encryption_enabled) {
                         uint8_t initVec[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
                         (session->decrypt_func) (session, buffer, buflen,
@@ -2155,6 +2274,67 @@ static void process_rtcp_app(struct rtp *session, rtcp_t * packet)
         }
 }
 
+static void retx_resend(struct rtp *session, uint16_t seq)
+{
+        struct rtp_retx_ring *r = session->retx;
+        int idx = seq % r->size;
+        pthread_mutex_lock(&r->lock);
+        if (r->len[idx] > 0 && r->seq[idx] == seq) {
+                if (udp_send(session->rtp_socket, (char *) r->data + (size_t) idx * RTP_MAX_PACKET_LEN, r->len[idx]) == -1) {
+                        log_msg(LOG_LEVEL_WARNING, "retransmitting RTP packet: %s", ug_strerror(errno));
+                }
+                r->retransmitted += 1;
+        } else {
+                debug_msg("NACKed packet %" PRIu16 " no longer available\n", seq);
+        }
+        pthread_mutex_unlock(&r->lock);
+}
+
+static void process_rtcp_nack(struct rtp *session, rtcp_t * packet)
+{
+        /* RFC 4585 section 6.2.1: sender SSRC, media SSRC and FCI (PID, BLP) follow the header */
+        uint32_t *words = (uint32_t *)(void *) packet;
+        int len = ntohs(packet->common.length);
+
+        if (len < 2 || ntohl(words[2]) != session->my_ssrc || session->retx == NULL) {
+                return;
+        }
+        for (int i = 3; i <= len; ++i) {
+                uint32_t fci = ntohl(words[i]);
+                uint16_t pid = fci >> 16;
+                uint16_t blp = fci & 0xFFFFU;
+                retx_resend(session, pid);
+                for (int b = 0; b < 16; ++b) {
+                        if (blp & (1U << b)) {
+                                retx_resend(session, pid + b + 1);
+                        }
+                }
+        }
+}
+
+static void process_rtcp_psfb(struct rtp *session, rtcp_t * packet)
+{
+        /* RFC 4585 section 6.1: sender SSRC and media SSRC follow the header */
+        uint32_t *words = (uint32_t *)(void *) packet;
+        int len = ntohs(packet->common.length);
+
+        if (len < 2) {
+                return;
+        }
+        if (packet->common.count == RTCP_FB_PLI) {
+                if (ntohl(words[2]) == session->my_ssrc) {
+                        atomic_fetch_add(&session->keyframe_requests, 1);
+                }
+        } else if (packet->common.count == RTCP_FB_FIR) {
+                /* RFC 5104 section 4.3.1: FCI entries of SSRC and seq number, media SSRC is unused */
+                for (int i = 3; i + 1 <= len; i += 2) {
+                        if (ntohl(words[i]) == session->my_ssrc) {
+                                atomic_fetch_add(&session->keyframe_requests, 1);
+                        }
+                }
+        }
+}
+
 static
 uint32_t compute_rtt(struct rtp *session, rtcp_rx * rrx)
 {
@@ -2216,6 +2396,12 @@ static void rtp_process_ctrl(struct rtp *session, uint8_t * buffer, int buflen)
                                         process_rtcp_rr(session, packet);
                                         break;
                                 case RTCP_RX:
+                                        if (!session->tfrc_on) { /* RTCP_RTPFB */
+                                                if (packet->common.count == RTCP_FB_NACK) {
+                                                        process_rtcp_nack(session, packet);
+                                                }
+                                                break;
+                                        }
                                         /* am not sending up a RX_RTCP_START... */
                                         process_rtcp_rx(session, packet);
                                         if (session->tfrc_on) {
@@ -2281,6 +2467,9 @@ static void rtp_process_ctrl(struct rtp *session, uint8_t * buffer, int buflen)
                                         }
                                         process_rtcp_app(session, packet);
                                         break;
+                                case RTCP_PSFB:
+                                        process_rtcp_psfb(session, packet);
+                                        break;
                                 default:
                                         debug_msg
                                             ("RTCP packet with unknown type (%d) ignored.\n",
@@ -2750,6 +2939,211 @@ const rtcp_rr *rtp_get_rr(struct rtp *session, uint32_t reporter,
         return get_rr(session, reporter, reportee);
 }
 
+/**
+ * rtp_set_retransmission_ring:
+ * @session: the session pointer (returned by rtp_init())
+ * @packets: number of sent packets to keep, 0 disables retransmissions
+ *
+ * If enabled, copies of the last @packets sent RTP packets are kept and
+ * resent on receipt of a Generic NACK (RFC 4585) naming them.
+ *
+ * The packet buffer is allocated with the first sent packet so that a
+ * receive-only session does not pay for it.
+ *
+ * Return value: TRUE on success, FALSE if unable to allocate the ring.
+ **/
+bool rtp_set_retransmission_ring(struct rtp *session, int packets)
+{
+        struct rtp_retx_ring *r = session->retx;
+        if (r != NULL) {
+                log_msg(r->retransmitted > 0 ? LOG_LEVEL_INFO : LOG_LEVEL_VERBOSE,
+                                "[RTP] Retransmitted %llu NACKed packets.\n", r->retransmitted);
+                pthread_mutex_destroy(&r->lock);
+                free(r->len);
+                free(r->seq);
+                free(r->data);
+                free(r);
+                session->retx = NULL;
+        }
+        if (packets <= 0) {
+                return TRUE;
+        }
+        r = calloc(1, sizeof *r);
+        if (r == NULL) {
+                return FALSE;
+        }
+        r->size = packets;
+        r->len = calloc(packets, sizeof *r->len);
+        r->seq = calloc(packets, sizeof *r->seq);
+        if (r->len == NULL || r->seq == NULL) {
+                free(r->len);
+                free(r->seq);
+                free(r);
+                return FALSE;
+        }
+        pthread_mutex_init(&r->lock, NULL);
+        session->retx = r;
+        return TRUE;
+}
+
+/**
+ * rtp_send_nack:
+ * @session: the session pointer (returned by rtp_init())
+ * @media_ssrc: source of the lost packets
+ * @seqs: sequence numbers of the lost packets in ascending order
+ * @count: number of @seqs
+ *
+ * Immediately sends a Generic NACK (RFC 4585) for the given packets,
+ * preceded by an empty RR to form a valid compound RTCP packet. Not
+ * supported with RTP-level (DES/AES) encryption.
+ *
+ * Return value: TRUE if sent, FALSE otherwise.
+ **/
+bool rtp_send_nack(struct rtp *session, uint32_t media_ssrc, const uint16_t *seqs, int count)
+{
+        uint32_t buffer[RTP_MAX_PACKET_LEN / sizeof(uint32_t)];
+        const int max_fci = sizeof buffer / sizeof buffer[0] - 5;
+
+        if (session->encryption_enabled || count <= 0) {
+                return FALSE;
+        }
+
+        rtcp_t *rr = (rtcp_t *)(void *) buffer;
+        rr->common.version = 2;
+        rr->common.p = 0;
+        rr->common.count = 0;
+        rr->common.pt = RTCP_RR;
+        rr->common.length = htons(1);
+        rr->r.rr.ssrc = htonl(session->my_ssrc);
+
+        rtcp_t *fb = (rtcp_t *)(void *) (buffer + 2);
+        fb->common.version = 2;
+        fb->common.p = 0;
+        fb->common.count = RTCP_FB_NACK;
+        fb->common.pt = RTCP_RTPFB;
+        buffer[3] = htonl(session->my_ssrc);
+        buffer[4] = htonl(media_ssrc);
+
+        int fci_count = 0;
+        for (int i = 0; i < count && fci_count < max_fci; ) {
+                uint16_t pid = seqs[i++];
+                uint16_t blp = 0;
+                while (i < count && (uint16_t) (seqs[i] - pid - 1) < 16) {
+                        blp |= 1U << (uint16_t) (seqs[i] - pid - 1);
+                        i++;
+                }
+                buffer[5 + fci_count++] = htonl((uint32_t) pid << 16 | blp);
+        }
+        fb->common.length = htons(2 + fci_count);
+
+        rtcp_udp_send(session, (5 + fci_count) * sizeof(uint32_t), (char *) buffer);
+        return TRUE;
+}
+
+/**
+ * rtp_send_keyframe_request:
+ * @session: the session pointer (returned by rtp_init())
+ * @media_ssrc: source of the stream that cannot be decoded
+ * @fir: send Full Intra Request (RFC 5104) instead of Picture Loss
+ * Indication (RFC 4585)
+ *
+ * Immediately asks the sender of @media_ssrc to send a keyframe, the
+ * feedback packet is preceded by an empty RR (as in rtp_send_nack()). Not
+ * supported with RTP-level (DES/AES) encryption.
+ *
+ * Return value: TRUE if sent, FALSE otherwise.
+ **/
+bool rtp_send_keyframe_request(struct rtp *session, uint32_t media_ssrc, bool fir)
+{
+        uint32_t buffer[RTP_MAX_PACKET_LEN / sizeof(uint32_t)];
+
+        if (session->encryption_enabled) {
+                return FALSE;
+        }
+
+        rtcp_t *rr = (rtcp_t *)(void *) buffer;
+        rr->common.version = 2;
+        rr->common.p = 0;
+        rr->common.count = 0;
+        rr->common.pt = RTCP_RR;
+        rr->common.length = htons(1);
+        rr->r.rr.ssrc = htonl(session->my_ssrc);
+
+        rtcp_t *fb = (rtcp_t *)(void *) (buffer + 2);
+        fb->common.version = 2;
+        fb->common.p = 0;
+        fb->common.count = fir ? RTCP_FB_FIR : RTCP_FB_PLI;
+        fb->common.pt = RTCP_PSFB;
+        buffer[3] = htonl(session->my_ssrc);
+        buffer[4] = htonl(fir ? 0 : media_ssrc);
+        int len = 5;
+        if (fir) {
+                buffer[len++] = htonl(media_ssrc);
+                buffer[len++] = htonl((uint32_t) ++session->fir_seq << 24);
+        }
+        fb->common.length = htons(len - 3);
+
+        rtcp_udp_send(session, len * sizeof(uint32_t), (char *) buffer);
+        return TRUE;
+}
+
+/**
+ * rtp_take_keyframe_requests:
+ * @session: the session pointer (returned by rtp_init())
+ *
+ * Return value: number of keyframe requests (PLI or FIR) for our stream
+ * received since the last call (by the thread that receives RTCP).
+ **/
+int rtp_take_keyframe_requests(struct rtp *session)
+{
+        return atomic_exchange(&session->keyframe_requests, 0);
+}
+
+/**
+ * rtp_send_app:
+ * @session: the session pointer (returned by rtp_init())
+ * @name: four ASCII characters identifying the APP packet
+ * @data: application-dependent data
+ * @len: length of @data, must be a multiple of 4
+ *
+ * Immediately sends an RTCP APP packet preceded by an empty RR (as
+ * rtp_send_nack() does), unlike APP packets returned by the callback
+ * passed to rtp_send_ctrl() sent with the regular RTCP report. Not
+ * supported with RTP-level (DES/AES) encryption.
+ *
+ * Return value: TRUE if sent, FALSE otherwise.
+ **/
+bool rtp_send_app(struct rtp *session, const char *name, const char *data, int len)
+{
+        uint32_t buffer[RTP_MAX_PACKET_LEN / sizeof(uint32_t)];
+
+        if (session->encryption_enabled || len < 0 || len % 4 != 0
+                        || len > (int) sizeof buffer - 20) {
+                return FALSE;
+        }
+
+        rtcp_t *rr = (rtcp_t *)(void *) buffer;
+        rr->common.version = 2;
+        rr->common.p = 0;
+        rr->common.count = 0;
+        rr->common.pt = RTCP_RR;
+        rr->common.length = htons(1);
+        rr->r.rr.ssrc = htonl(session->my_ssrc);
+
+        rtcp_app *app = (rtcp_app *)(void *) (buffer + 2);
+        app->version = RTP_VERSION;
+        app->p = 0;
+        app->subtype = 0;
+        app->pt = RTCP_APP;
+        app->length = htons(2 + len / 4);
+        app->ssrc = htonl(session->my_ssrc);
+        memcpy(app->name, name, 4);
+        memcpy(app->data, data, len);
+
+        rtcp_udp_send(session, 20 + len, (char *) buffer);
+        return TRUE;
+}
+
 /**
  * rtp_send_data:
  * @session: the session pointer (returned by rtp_init())
@@ -2787,31 +3181,46 @@ int rtp_send_data(struct rtp *session, uint32_t rtp_ts, char pt, int m,
                                  data, data_len, extn, extn_len, extn_type);
 }
 
-int
-rtp_send_data_hdr(struct rtp *session,
-                  uint32_t rtp_ts, char pt, int m,
-                  int cc, uint32_t csrc[],
-                  char *phdr, int phdr_len,
-                  char *data, int data_len,
-                  char *extn, uint16_t extn_len, uint16_t extn_type)
+static void retx_store(struct rtp_retx_ring *r, uint16_t seq, const uint8_t *hdr, int hdr_len,
+                const char *phdr, int phdr_len, const char *data, int data_len)
 {
-        int vlen, buffer_len, i, rc, pad, pad_len __attribute__((unused));
-        uint8_t *buffer = NULL;
-        rtp_packet *packet = NULL;
-        uint8_t initVec[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
-#ifdef WIN32
-        WSABUF *send_vector = NULL;
-#else
-        struct iovec send_vector[3];
-#endif
-        int send_vector_len;
-
-        void *d; // to be freed after packet is sent
-
-        check_database(session);
+        int len = hdr_len + (phdr != NULL ? phdr_len : 0) + data_len;
+        if (len > RTP_MAX_PACKET_LEN) {
+                return;
+        }
+        int idx = seq % r->size;
+        pthread_mutex_lock(&r->lock);
+        if (r->data == NULL && (r->data = malloc((size_t) r->size * RTP_MAX_PACKET_LEN)) == NULL) {
+                pthread_mutex_unlock(&r->lock);
+                return;
+        }
+        uint8_t *dst = r->data + (size_t) idx * RTP_MAX_PACKET_LEN;
+        memcpy(dst, hdr, hdr_len);
+        if (phdr != NULL) {
+                memcpy(dst + hdr_len, phdr, phdr_len);
+                hdr_len += phdr_len;
+        }
+        if (data_len > 0) {
+                memcpy(dst + hdr_len, data, data_len);
+        }
+        r->seq[idx] = seq;
+        r->len[idx] = len;
+        pthread_mutex_unlock(&r->lock);
+}
 
-        assert((data == NULL && data_len == 0)
-               || (data != NULL && data_len > 0));
+/**
+ * Writes the RTP header (including CSRC list and extension) to buffer laid
+ * out as rtp_packet and encrypts it, if enabled.
+ *
+ * @returns length of the header on the wire (starting at buffer + RTP_PACKET_HEADER_SIZE)
+ */
+static int rtp_write_hdr(struct rtp *session, uint8_t *buffer,
+                uint32_t rtp_ts, char pt, int m, int cc, uint32_t csrc[],
+                char *extn, uint16_t extn_len, uint16_t extn_type)
+{
+        int vlen, buffer_len, i, pad, pad_len __attribute__((unused));
+        rtp_packet *packet = (rtp_packet *)(void *) buffer;
+        uint8_t initVec[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
 
         vlen = 12;
         if (session->tfrc_on) {
@@ -2848,26 +3257,7 @@ rtp_send_data_hdr(struct rtp *session,
         pad = FALSE;            /* FIXME */
         pad_len = 0;
 
-        /* Allocate memory for the packet... */
         assert(buffer_len < RTP_MAX_PACKET_LEN);
-        /* we dont always need 20 (12|16) but this seems to work. LG */
-#ifdef WIN32
-        d = (uint8_t *) malloc(3 * sizeof(WSABUF) + 20 + RTP_PACKET_HEADER_SIZE);
-        send_vector = d;
-        buffer = (uint8_t *) d + 3 * sizeof(WSABUF);
-#else
-        d = buffer = (uint8_t *) malloc(20 + RTP_PACKET_HEADER_SIZE);
-#endif
-        packet = (rtp_packet *)(void *) buffer;
-
-#ifdef WIN32
-        send_vector[0].buf = (char *) (buffer + RTP_PACKET_HEADER_SIZE);
-        send_vector[0].len = buffer_len;
-#else
-        send_vector[0].iov_base = buffer + RTP_PACKET_HEADER_SIZE;
-        send_vector[0].iov_len = buffer_len;
-#endif
-        send_vector_len = 1;
 
         /* These are internal pointers into the buffer... */
 #ifdef NDEF
@@ -2914,6 +3304,80 @@ rtp_send_data_hdr(struct rtp *session,
                 base[1] = htons(extn_len);
                 memcpy(packet->extn + 4, extn, extn_len * 4);
         }
+#ifdef NDEF                     /* FIXME */
+        /* ...and any padding... */
+        if (pad) {
+                for (i = 0; i < pad_len; i++) {
+                        buffer[buffer_len + RTP_PACKET_HEADER_SIZE - pad_len +
+                               i] = 0;
+                }
+                buffer[buffer_len + RTP_PACKET_HEADER_SIZE - 1] = (char)pad_len;
+        }
+#endif
+
+        /* Finally, encrypt if desired... */
+        if (session->encryption_enabled) {
+                assert((buffer_len % session->encryption_pad_length) == 0);
+                (session->encrypt_func) (session,
+                                         buffer + RTP_PACKET_HEADER_SIZE,
+                                         buffer_len, initVec);
+        }
+        return buffer_len;
+}
+
+/// updates the RTCP statistics after sending a packet
+static void rtp_account_sent(struct rtp *session, int hdr_len, int data_len)
+{
+        session->we_sent = TRUE;
+        session->rtp_pcount += 1;
+        session->rtp_bcount += hdr_len;
+        session->rtp_bytes_sent += hdr_len + data_len;
+}
+
+int
+rtp_send_data_hdr(struct rtp *session,
+                  uint32_t rtp_ts, char pt, int m,
+                  int cc, uint32_t csrc[],
+                  char *phdr, int phdr_len,
+                  char *data, int data_len,
+                  char *extn, uint16_t extn_len, uint16_t extn_type)
+{
+        int buffer_len, rc;
+        uint8_t *buffer = NULL;
+#ifdef WIN32
+        WSABUF *send_vector = NULL;
+#else
+        struct iovec send_vector[3];
+#endif
+        int send_vector_len;
+
+        void *d; // to be freed after packet is sent
+
+        check_database(session);
+
+        assert((data == NULL && data_len == 0)
+               || (data != NULL && data_len > 0));
+
+        /* Allocate memory for the packet... */
+        /* we dont always need 20 (12|16) but this seems to work. LG */
+#ifdef WIN32
+        d = (uint8_t *) malloc(3 * sizeof(WSABUF) + 20 + RTP_PACKET_HEADER_SIZE);
+        send_vector = d;
+        buffer = (uint8_t *) d + 3 * sizeof(WSABUF);
+#else
+        d = buffer = (uint8_t *) malloc(20 + RTP_PACKET_HEADER_SIZE);
+#endif
+        buffer_len = rtp_write_hdr(session, buffer, rtp_ts, pt, m, cc, csrc, extn, extn_len, extn_type);
+
+#ifdef WIN32
+        send_vector[0].buf = (char *) (buffer + RTP_PACKET_HEADER_SIZE);
+        send_vector[0].len = buffer_len;
+#else
+        send_vector[0].iov_base = buffer + RTP_PACKET_HEADER_SIZE;
+        send_vector[0].iov_len = buffer_len;
+#endif
+        send_vector_len = 1;
+
         /* ...the payload header... */
         if (phdr != NULL) {
 #ifdef WIN32
@@ -2936,23 +3400,10 @@ rtp_send_data_hdr(struct rtp *session,
 #endif
                 send_vector_len++;
         }
-#ifdef NDEF                     /* FIXME */
-        /* ...and any padding... */
-        if (pad) {
-                for (i = 0; i < pad_len; i++) {
-                        buffer[buffer_len + RTP_PACKET_HEADER_SIZE - pad_len +
-                               i] = 0;
-                }
-                buffer[buffer_len + RTP_PACKET_HEADER_SIZE - 1] = (char)pad_len;
-        }
-#endif
 
-        /* Finally, encrypt if desired... */
-        if (session->encryption_enabled) {
-                assert((buffer_len % session->encryption_pad_length) == 0);
-                (session->encrypt_func) (session,
-                                         buffer + RTP_PACKET_HEADER_SIZE,
-                                         buffer_len, initVec);
+        if (session->retx != NULL) {
+                retx_store(session->retx, session->rtp_seq - 1, buffer + RTP_PACKET_HEADER_SIZE, buffer_len,
+                                phdr, phdr_len, data, data_len);
         }
 
         rc = udp_sendv(session->rtp_socket, send_vector, send_vector_len, d);
@@ -2960,88 +3411,162 @@ rtp_send_data_hdr(struct rtp *session,
                 log_msg(LOG_LEVEL_WARNING, "sending RTP packet: %s", ug_strerror(errno));
         }
 
-        /* Update the RTCP statistics... */
-        session->we_sent = TRUE;
-        session->rtp_pcount += 1;
-        session->rtp_bcount += buffer_len;
-        session->rtp_bytes_sent += buffer_len + data_len;
+        rtp_account_sent(session, buffer_len, data_len);
         session->last_rtp_send_time = get_time_in_ns();
 
         check_database(session);
         return rc;
 }
 
+#define RTP_SEND_BATCH_CHUNK 64 ///< packets of rtp_send_data_hdr_batch() passed to udp_sendv_multi() at once
+
+/**
+ * Sends count packets with the same timestamp and payload type. As opposed
+ * to rtp_send_data_hdr(), the RTP headers are written to the caller-provided
+ * hdr_slots[count] and the packets are passed to the socket in batches, so
+ * nothing is allocated per packet. CSRCs and header extensions are not
+ * supported.
+ *
+ * The headers must be kept until rtp_async_wait() if sending
+ * asynchronously, the slots may be reused for the next batch otherwise.
+ *
+ * @returns number of packets sent (or queued)
+ */
+int rtp_send_data_hdr_batch(struct rtp *session, uint32_t rtp_ts, char pt,
+                const struct rtp_batch_pkt *pkts, int count,
+                rtp_hdr_slot *hdr_slots)
+{
+#ifdef WIN32
+        WSABUF send_vector[RTP_SEND_BATCH_CHUNK * 3];
+#else
+        struct iovec send_vector[RTP_SEND_BATCH_CHUNK * 3];
+#endif
+        int send_vector_counts[RTP_SEND_BATCH_CHUNK];
+
+        check_database(session);
+
+        int sent = 0;
+        for (int first = 0; first < count; first += RTP_SEND_BATCH_CHUNK) {
+                const int n = MIN(count - first, RTP_SEND_BATCH_CHUNK);
+                int vec_len = 0;
+                for (int i = first; i < first + n; ++i) {
+                        const struct rtp_batch_pkt *pkt = &pkts[i];
+                        assert((pkt->data == NULL && pkt->data_len == 0)
+                                        || (pkt->data != NULL && pkt->data_len > 0));
+                        uint8_t *buffer = hdr_slots[i].data;
+                        const int buffer_len = rtp_write_hdr(session, buffer, rtp_ts, pt, pkt->m, 0, NULL, NULL, 0, 0);
+                        const int vec_start = vec_len;
+#ifdef WIN32
+                        send_vector[vec_len].buf = (char *) (buffer + RTP_PACKET_HEADER_SIZE);
+                        send_vector[vec_len++].len = buffer_len;
+                        if (pkt->phdr != NULL) {
+                                send_vector[vec_len].buf = pkt->phdr;
+                                send_vector[vec_len++].len = pkt->phdr_len;
+                        }
+                        if (pkt->data_len > 0) {
+                                send_vector[vec_len].buf = pkt->data;
+                                send_vector[vec_len++].len = pkt->data_len;
+                        }
+#else
+                        send_vector[vec_len].iov_base = buffer + RTP_PACKET_HEADER_SIZE;
+                        send_vector[vec_len++].iov_len = buffer_len;
+                        if (pkt->phdr != NULL) {
+                                send_vector[vec_len].iov_base = pkt->phdr;
+                                send_vector[vec_len++].iov_len = pkt->phdr_len;
+                        }
+                        if (pkt->data_len > 0) {
+                                send_vector[vec_len].iov_base = pkt->data;
+                                send_vector[vec_len++].iov_len = pkt->data_len;
+                        }
+#endif
+                        send_vector_counts[i - first] = vec_len - vec_start;
+
+                        if (session->retx != NULL) {
+                                retx_store(session->retx, session->rtp_seq - 1, buffer + RTP_PACKET_HEADER_SIZE, buffer_len,
+                                                pkt->phdr, pkt->phdr_len, pkt->data, pkt->data_len);
+                        }
+                        rtp_account_sent(session, buffer_len, pkt->data_len);
+                }
+                int rc = udp_sendv_multi(session->rtp_socket, send_vector, send_vector_counts, n);
+                if (rc < n) {
+                        log_msg(LOG_LEVEL_WARNING, "sending RTP packets: %s", ug_strerror(errno));
+                }
+                sent += rc;
+        }
+        session->last_rtp_send_time = get_time_in_ns();
+
+        check_database(session);
+        return sent;
+}
+
 static int format_report_blocks(rtcp_rr * rrp, int remaining_length,
                                 struct rtp *session)
 {
         int nblocks = 0;
-        int h;
         source *s;
         uint32_t now_sec;
         uint32_t now_frac;
 
-        for (h = 0; h < RTP_DB_SIZE; h++) {
-                for (s = session->db[h]; s != NULL; s = s->next) {
-                        check_source(s);
-                        if ((nblocks == 31) || (remaining_length < 24)) {
-                                break;  /* Insufficient space for more report blocks... */
+        for (s = session->sources; s != NULL; s = s->next) {
+                check_source(s);
+                if ((nblocks == 31) || (remaining_length < 24)) {
+                        break;  /* Insufficient space for more report blocks... */
+                }
+                if (s->sender) {
+                        /* Much of this is taken from A.3 of draft-ietf-avt-rtp-new-01.txt */
+                        int extended_max = s->cycles + s->max_seq;
+                        int expected = extended_max - s->base_seq + 1;
+                        int lost = expected - s->received;
+                        int expected_interval =
+                            expected - s->expected_prior;
+                        int received_interval =
+                            s->received - s->received_prior;
+                        int lost_interval =
+                            expected_interval - received_interval;
+                        int fraction;
+                        uint32_t lsr;
+                        uint32_t dlsr;
+
+                        //printf("lost_interval %d\n", lost_interval);
+                        s->expected_prior = expected;
+                        s->received_prior = s->received;
+                        if (expected_interval == 0
+                            || lost_interval <= 0) {
+                                fraction = 0;
+                        } else {
+                                fraction =
+                                    (lost_interval << 8) /
+                                    expected_interval;
                         }
-                        if (s->sender) {
-                                /* Much of this is taken from A.3 of draft-ietf-avt-rtp-new-01.txt */
-                                int extended_max = s->cycles + s->max_seq;
-                                int expected = extended_max - s->base_seq + 1;
-                                int lost = expected - s->received;
-                                int expected_interval =
-                                    expected - s->expected_prior;
-                                int received_interval =
-                                    s->received - s->received_prior;
-                                int lost_interval =
-                                    expected_interval - received_interval;
-                                int fraction;
-                                uint32_t lsr;
-                                uint32_t dlsr;
-
-                                //printf("lost_interval %d\n", lost_interval);
-                                s->expected_prior = expected;
-                                s->received_prior = s->received;
-                                if (expected_interval == 0
-                                    || lost_interval <= 0) {
-                                        fraction = 0;
-                                } else {
-                                        fraction =
-                                            (lost_interval << 8) /
-                                            expected_interval;
-                                }
 
-                                if (s->sr == NULL) {
-                                        lsr = 0;
-                                        dlsr = 0;
-                                } else {
-                                        ntp64_time(&now_sec, &now_frac);
-                                        lsr =
-                                            ntp64_to_ntp32(s->sr->ntp_sec,
-                                                           s->sr->ntp_frac);
-                                        dlsr =
-                                            ntp64_to_ntp32(now_sec,
-                                                           now_frac) -
-                                            ntp64_to_ntp32(s->last_sr_sec,
-                                                           s->last_sr_frac);
-                                }
-                                rrp->ssrc = htonl(s->ssrc);
-                                rrp->fract_lost = fraction;
-                                rrp->total_lost = lost & 0x00ffffff;
-                                rrp->last_seq = htonl(extended_max);
-                                rrp->jitter = htonl(s->jitter / 16);
-                                rrp->lsr = htonl(lsr);
-                                rrp->dlsr = htonl(dlsr);
-                                rrp++;
-                                remaining_length -= 24;
-                                nblocks++;
-                                s->sender = FALSE;
-                                session->sender_count--;
-                                if (session->sender_count == 0) {
-                                        break;  /* No point continuing, since we've reported on all senders... */
-                                }
+                        if (s->sr == NULL) {
+                                lsr = 0;
+                                dlsr = 0;
+                        } else {
+                                ntp64_time(&now_sec, &now_frac);
+                                lsr =
+                                    ntp64_to_ntp32(s->sr->ntp_sec,
+                                                   s->sr->ntp_frac);
+                                dlsr =
+                                    ntp64_to_ntp32(now_sec,
+                                                   now_frac) -
+                                    ntp64_to_ntp32(s->last_sr_sec,
+                                                   s->last_sr_frac);
+                        }
+                        rrp->ssrc = htonl(s->ssrc);
+                        rrp->fract_lost = fraction;
+                        rrp->total_lost = lost & 0x00ffffff;
+                        rrp->last_seq = htonl(extended_max);
+                        rrp->jitter = htonl(s->jitter / 16);
+                        rrp->lsr = htonl(lsr);
+                        rrp->dlsr = htonl(dlsr);
+                        rrp++;
+                        remaining_length -= 24;
+                        nblocks++;
+                        s->sender = FALSE;
+                        session->sender_count--;
+                        if (session->sender_count == 0) {
+                                break;  /* No point continuing, since we've reported on all senders... */
                         }
                 }
         }
@@ -3451,7 +3976,6 @@ void rtp_send_ctrl(struct rtp *session, uint32_t rtp_ts,
         if (curr_time > session->next_rtcp_send_time) {
                 /* The RTCP transmission timer has expired. The following */
                 /* implements draft-ietf-avt-rtp-new-02.txt section 6.3.6 */
-                int h;
                 source *s;
                 double new_interval =
                     rtcp_interval(session) / (session->csrc_count + 1);
@@ -3465,11 +3989,9 @@ void rtp_send_ctrl(struct rtp *session, uint32_t rtp_ts,
                         /* We're starting a new RTCP reporting interval, zero out */
                         /* the per-interval statistics.                           */
                         session->sender_count = 0;
-                        for (h = 0; h < RTP_DB_SIZE; h++) {
-                                for (s = session->db[h]; s != NULL; s = s->next) {
-                                        check_source(s);
-                                        s->sender = FALSE;
-                                }
+                        for (s = session->sources; s != NULL; s = s->next) {
+                                check_source(s);
+                                s->sender = FALSE;
                         }
                 } else {
                         session->next_rtcp_send_time = new_send_time;
@@ -3479,6 +4001,15 @@ void rtp_send_ctrl(struct rtp *session, uint32_t rtp_ts,
         check_database(session);
 }
 
+/**
+ * Returns the time when rtp_send_ctrl() or rtp_update() has some work to do,
+ * so that the caller doesn't need to call them more often.
+ */
+time_ns_t rtp_next_ctrl_time(struct rtp *session)
+{
+        return MIN(session->next_rtcp_send_time + 1, session->last_update + 1 * NS_IN_SEC);
+}
+
 /**
  * rtp_update:
  * @session: the session pointer (returned by rtp_init())
@@ -3492,7 +4023,6 @@ void rtp_send_ctrl(struct rtp *session, uint32_t rtp_ts,
 void rtp_update(struct rtp *session, time_ns_t curr_time)
 {
         /* Perform housekeeping on the source database... */
-        int h;
         source *s, *n;
 
         if (curr_time - session->last_update < 1 * NS_IN_SEC) {
@@ -3509,47 +4039,45 @@ void rtp_update(struct rtp *session, time_ns_t curr_time)
 
         check_database(session);
 
-        for (h = 0; h < RTP_DB_SIZE; h++) {
-                for (s = session->db[h]; s != NULL; s = n) {
-                        check_source(s);
-                        n = s->next;
-                        /* Expire sources which haven't been heard from for a int time.   */
-                        /* Section 6.2.1 of the RTP specification details the timers used. */
-
-                        /* How int since we last heard from this source?  */
-                        delay = curr_time - s->last_active;
-
-                        /* Check if we've received a BYE packet from this source.    */
-                        /* If we have, and it was received more than 2 seconds ago   */
-                        /* then the source is deleted. The arbitrary 2 second delay  */
-                        /* is to ensure that all delayed packets are received before */
-                        /* the source is timed out.                                  */
-                        if (s->got_bye && (delay > 2 * NS_IN_SEC)) {
-                                debug_msg
-                                    ("Deleting source 0x%08" PRIx32 " due to reception of BYE %f seconds ago...\n",
-                                     s->ssrc, (double) delay / NS_IN_SEC);
-                                delete_source(session, s->ssrc);
-                        }
+        for (s = session->sources; s != NULL; s = n) {
+                check_source(s);
+                n = s->next;
+                /* Expire sources which haven't been heard from for a int time.   */
+                /* Section 6.2.1 of the RTP specification details the timers used. */
+
+                /* How int since we last heard from this source?  */
+                delay = curr_time - s->last_active;
+
+                /* Check if we've received a BYE packet from this source.    */
+                /* If we have, and it was received more than 2 seconds ago   */
+                /* then the source is deleted. The arbitrary 2 second delay  */
+                /* is to ensure that all delayed packets are received before */
+                /* the source is timed out.                                  */
+                if (s->got_bye && (delay > 2 * NS_IN_SEC)) {
+                        debug_msg
+                            ("Deleting source 0x%08" PRIx32 " due to reception of BYE %f seconds ago...\n",
+                             s->ssrc, (double) delay / NS_IN_SEC);
+                        delete_source(session, s->ssrc);
+                }
 
-                        /* Sources are marked as inactive if they haven't been heard */
-                        /* from for more than 2 intervals (RTP section 6.3.5)        */
-                        if ((s->ssrc != rtp_my_ssrc(session))
-                            && (delay > (session->rtcp_interval * 2 * NS_IN_SEC))) {
-                                if (s->sender) {
-                                        s->sender = FALSE;
-                                        session->sender_count--;
-                                }
+                /* Sources are marked as inactive if they haven't been heard */
+                /* from for more than 2 intervals (RTP section 6.3.5)        */
+                if ((s->ssrc != rtp_my_ssrc(session))
+                    && (delay > (session->rtcp_interval * 2 * NS_IN_SEC))) {
+                        if (s->sender) {
+                                s->sender = FALSE;
+                                session->sender_count--;
                         }
+                }
 
-                        /* If a source hasn't been heard from for more than 5 RTCP   */
-                        /* reporting intervals, we delete it from our database...    */
-                        if ((s->ssrc != rtp_my_ssrc(session))
-                            && (delay > (session->rtcp_interval * 5 * NS_IN_SEC))) {
-                                debug_msg
-                                    ("Deleting source 0x%08" PRIx32 " due to timeout...\n",
-                                     s->ssrc);
-                                delete_source(session, s->ssrc);
-                        }
+                /* If a source hasn't been heard from for more than 5 RTCP   */
+                /* reporting intervals, we delete it from our database...    */
+                if ((s->ssrc != rtp_my_ssrc(session))
+                    && (delay > (session->rtcp_interval * 5 * NS_IN_SEC))) {
+                        debug_msg
+                            ("Deleting source 0x%08" PRIx32 " due to timeout...\n",
+                             s->ssrc);
+                        delete_source(session, s->ssrc);
                 }
         }
 
@@ -3711,24 +4239,22 @@ void rtp_send_bye(struct rtp *session)
  */
 void rtp_done(struct rtp *session)
 {
-        int i;
         source *s, *n;
 
         check_database(session);
         /* In delete_source, check database gets called and this assumes */
         /* first added and last removed is us.                           */
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                s = session->db[i];
-                while (s != NULL) {
-                        n = s->next;
-                        if (s->ssrc != session->my_ssrc) {
-                                delete_source(session, session->db[i]->ssrc);
-                        }
-                        s = n;
+        for (s = session->sources; s != NULL; s = n) {
+                n = s->next;
+                if (s->ssrc != session->my_ssrc) {
+                        delete_source(session, s->ssrc);
                 }
         }
 
         delete_source(session, session->my_ssrc);
+        free(session->db);
+        free(session->rr);
+        free(session->rr_index);
 
         /*
          * Introduce a memory leak until we add algorithm-specific
@@ -3740,6 +4266,7 @@ void rtp_done(struct rtp *session)
 
         udp_exit(session->rtp_socket);
         udp_exit(session->rtcp_socket);
+        rtp_set_retransmission_ring(session, 0);
         free(session->opt);
         free(session);
 }
@@ -4006,44 +4533,55 @@ uint64_t rtp_get_bytes_sent(struct rtp *session)
         return session->rtp_bytes_sent;
 }
 
+/// @returns RTP bytes received, must be called from the receiving thread
+uint64_t rtp_get_bytes_received(struct rtp *session)
+{
+        return session->rtp_bytes_received;
+}
+
+/**
+ * @returns number of RTP packets dropped by the kernel because the socket
+ * receive buffer was full (not lost in the network), may be called from any
+ * thread
+ */
+uint64_t rtp_get_rx_drops(struct rtp *session)
+{
+        return udp_get_rx_drops(session->rtp_socket);
+}
+
 int rtp_compute_fract_lost(struct rtp *session, uint32_t ssrc)
 {
-        int h;
         source *s;
 
-        for (h = 0; h < RTP_DB_SIZE; h++) {
-                for (s = session->db[h]; s != NULL; s = s->next) {
-                        check_source(s);
-                        if (s->ssrc == ssrc) {
-                                /* Much of this is taken from A.3 of draft-ietf-avt-rtp-new-01.txt */
-                                int extended_max = s->cycles + s->max_seq;
-                                int expected = extended_max - s->base_seq + 1;
-                                //int lost = expected - s->received;
-                                int expected_interval =
-                                    expected - s->expected_prior;
-                                int received_interval =
-                                    s->received - s->received_prior;
-                                int lost_interval =
-                                    expected_interval - received_interval;
-                                int fraction;
-                                //uint32_t lsr;
-                                //uint32_t dlsr;
-
-                                //printf("lost_interval %d\n", lost_interval);
-                                s->expected_prior = expected;
-                                s->received_prior = s->received;
-                                if (expected_interval == 0
-                                    || lost_interval <= 0) {
-                                        fraction = 0;
-                                } else {
-                                        fraction =
-                                            (lost_interval << 8) /
-                                            expected_interval;
-                                }
-
-                                return fraction;
-                        }
+        s = get_source(session, ssrc);
+        if (s != NULL) {
+                /* Much of this is taken from A.3 of draft-ietf-avt-rtp-new-01.txt */
+                int extended_max = s->cycles + s->max_seq;
+                int expected = extended_max - s->base_seq + 1;
+                //int lost = expected - s->received;
+                int expected_interval =
+                    expected - s->expected_prior;
+                int received_interval =
+                    s->received - s->received_prior;
+                int lost_interval =
+                    expected_interval - received_interval;
+                int fraction;
+                //uint32_t lsr;
+                //uint32_t dlsr;
+
+                //printf("lost_interval %d\n", lost_interval);
+                s->expected_prior = expected;
+                s->received_prior = s->received;
+                if (expected_interval == 0
+                    || lost_interval <= 0) {
+                        fraction = 0;
+                } else {
+                        fraction =
+                            (lost_interval << 8) /
+                            expected_interval;
                 }
+
+                return fraction;
         }
         return 0;
 }
@@ -4068,6 +4606,26 @@ void rtp_async_wait(struct rtp *session)
        udp_async_wait(session->rtp_socket);
 }
 
+bool rtp_set_pacing(struct rtp *session, int pacing)
+{
+        return udp_set_pacing(session->rtp_socket, (enum udp_pacing) pacing);
+}
+
+void rtp_set_pacing_interval(struct rtp *session, long interval_ns, int packet_len)
+{
+        udp_set_pacing_interval(session->rtp_socket, interval_ns, packet_len);
+}
+
+void rtp_set_pacing_start(struct rtp *session, long long start)
+{
+        udp_set_pacing_start(session->rtp_socket, start);
+}
+
+int rtp_async_batch_size(struct rtp *session)
+{
+       return udp_async_batch_size(session->rtp_socket);
+}
+
 struct socket_udp_local *rtp_get_udp_local_socket(struct rtp *session)
 {
         return udp_get_local(session->rtp_socket);
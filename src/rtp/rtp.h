@@ -84,6 +84,7 @@ typedef struct __attribute__((packed)) {
 	uint32_t	*csrc;
 	char		*data;
 	int		 data_len;
+	long long	 arrival_ns;	/* Kernel/NIC RX timestamp (wall clock ns), 0 if unknown */
 	unsigned char	*extn;
 	uint16_t	 extn_len;	/* Size of the extension in 32 bit words minus one */
 	uint16_t	 extn_type;	/* Extension type field in the RTP packet header   */
@@ -258,6 +259,7 @@ bool             rtcp_recv_r(struct rtp *session,
 int 		 rtp_recv_poll_r(struct rtp **sessions, 
 			  struct timeval *timeout, uint32_t curr_rtp_ts);
 int 		 rtp_send_raw_rtp_data(struct rtp *session, char *buffer, int buffer_len);
+int              rtp_inject_packet(struct rtp *session, const char *data, int buflen);
 
 int 		 rtp_send_data(struct rtp *session, 
 			       uint32_t rtp_ts, char pt, int m, 
@@ -270,11 +272,38 @@ int 		 rtp_send_data_hdr(struct rtp *session,
                                char *phdr, int phdr_len, 
                                char *data, int data_len,
 			       char *extn, uint16_t extn_len, uint16_t extn_type);
+
+/**
+ * Packet sent with rtp_send_data_hdr_batch(). The payload header (phdr) and
+ * the data must stay untouched until rtp_async_wait() when sending
+ * asynchronously.
+ */
+struct rtp_batch_pkt {
+        char            *data;
+        int              data_len;
+        int              m;             ///< marker bit
+        char            *phdr;          ///< payload header, may be NULL
+        int              phdr_len;
+};
+
+/**
+ * Storage for the RTP header of one packet sent with rtp_send_data_hdr_batch(),
+ * laid out as (the beginning of) rtp_packet - 12 B header plus TFRC fields.
+ */
+typedef struct {
+        uint8_t          data[RTP_PACKET_HEADER_SIZE + 20];
+} rtp_hdr_slot;
+
+int              rtp_send_data_hdr_batch(struct rtp *session, uint32_t rtp_ts, char pt,
+                               const struct rtp_batch_pkt *pkts, int count,
+                               rtp_hdr_slot *hdr_slots);
 void 		 rtp_send_ctrl(struct rtp *session, uint32_t rtp_ts, 
 			       rtcp_app_callback appcallback, time_ns_t curr_time);
 void 		 rtp_update(struct rtp *session, time_ns_t curr_time);
+time_ns_t        rtp_next_ctrl_time(struct rtp *session);
 
 uint32_t	 rtp_my_ssrc(struct rtp *session);
+uint16_t         rtp_get_next_seq(struct rtp *session);
 bool             rtp_add_csrc(struct rtp *session, uint32_t csrc);
 bool             rtp_del_csrc(struct rtp *session, uint32_t csrc);
 
@@ -286,34 +315,51 @@ const char	*rtp_get_sdes(struct rtp *session, uint32_t ssrc, rtcp_sdes_type type
 const rtcp_sr	*rtp_get_sr(struct rtp *session, uint32_t ssrc);
 const rtcp_rr	*rtp_get_rr(struct rtp *session, uint32_t reporter, uint32_t reportee);
 
+bool             rtp_set_retransmission_ring(struct rtp *session, int packets);
+bool             rtp_send_nack(struct rtp *session, uint32_t media_ssrc, const uint16_t *seqs, int count);
+bool             rtp_send_app(struct rtp *session, const char *name, const char *data, int len);
+bool             rtp_send_keyframe_request(struct rtp *session, uint32_t media_ssrc, bool fir);
+int              rtp_take_keyframe_requests(struct rtp *session);
+
 bool             rtp_set_encryption_key(struct rtp *session, const char *passphrase);
 bool             rtp_set_my_ssrc(struct rtp *session, uint32_t ssrc);
 
 uint8_t		*rtp_get_userdata(struct rtp *session);
 void 		 rtp_set_recv_iov(struct rtp *session, struct msghdr *m);
 
+bool             rtp_set_pacing(struct rtp *session, int pacing /* enum udp_pacing */);
+void             rtp_set_pacing_interval(struct rtp *session, long interval_ns, int packet_len);
+void             rtp_set_pacing_start(struct rtp *session, long long start);
+
 bool             rtp_set_recv_buf(struct rtp *session, int bufsize);
 bool             rtp_set_send_buf(struct rtp *session, int bufsize);
 
 void             rtp_flush_recv_buf(struct rtp *session);
 int              rtp_get_udp_rx_port(struct rtp *session);
 uint64_t         rtp_get_bytes_sent(struct rtp *session);
+uint64_t         rtp_get_bytes_received(struct rtp *session);
+uint64_t         rtp_get_rx_drops(struct rtp *session);
 int              rtp_compute_fract_lost(struct rtp *session, uint32_t ssrc);
 bool             rtp_is_ipv6(struct rtp *session);
 bool             rtp_has_receiver(struct rtp *session);
 
 /*
- * Async API - MSW specific
+ * Async API - MSW overlapped I/O, sendmmsg() batching elsewhere (if available)
  *
  * Using async API hugely improves performance.
  * Usage is simple - prior to sending a bulk of packets (eg. video frame), rtp_async_start()
  * is started. Then, all packets are sent as usual, exept that neither data nor headers should
  * be altered up to rtp_async_wait() call, which waits upon completition of async operations
  * started after rtp_async_start(). Caller is responsible that rtp_send_data_hdr() is not called
- * more than nr_packet times.
+ * more than nr_packet times (packets passed to rtp_send_data_hdr_batch() count individually,
+ * its header slots must be kept until rtp_async_wait() as well).
+ *
+ * rtp_async_batch_size() returns number of packets passed to the kernel at once
+ * (1 if not batching) so that the caller can pace per batch.
  */
 void             rtp_async_start(struct rtp *session, int nr_packets);
 void             rtp_async_wait(struct rtp *session);
+int              rtp_async_batch_size(struct rtp *session);
 
 struct socket_udp_local *rtp_get_udp_local_socket(struct rtp *session);
 
@@ -73,6 +73,7 @@
 #include "rtp/pbuf.h"
 #include "rtp/rtp_callback.h"
 #include "tfrc.h"
+#include "utils/frame_trace.h"
 
 extern char *frame;
 
@@ -220,7 +221,11 @@ void rtp_recv_callback(struct rtp *session, rtp_event * e)
                 tfrc_recv_data(state->tfrc_state, get_time_in_ns(), pckt_rtp->seq,
                                pckt_rtp->data_len + 40);
                 if (pckt_rtp->data_len > 0) {   /* Only process packets that contain data... */
-                        pbuf_insert(state->playout_buffer, pckt_rtp);
+                        if (state->packet_handler) {
+                                state->packet_handler(state->packet_handler_udata, pckt_rtp);
+                        } else {
+                                pbuf_insert(state->playout_buffer, pckt_rtp);
+                        }
                 }
                 break;
         case RX_TFRC_RX:
@@ -246,7 +251,10 @@ void rtp_recv_callback(struct rtp *session, rtp_event * e)
                         assert(pckt_app->length == 3);
                         assert(pckt_app->subtype == 0);
 //                      tfrc_recv_rtt(state->tfrc_state, get_time_in_ns(), ntohl(*((int *) pckt_app->data)));
+                } else if (strncmp(pckt_app->name, FRAME_TRACE_APP_NAME, 4) == 0) {
+                        frame_trace_sender_report(e->ssrc, pckt_app->data, (pckt_app->length - 2) * 4);
                 }
+                free(pckt_app);
                 break;
         case RX_BYE:
                 break;
@@ -260,6 +268,9 @@ void rtp_recv_callback(struct rtp *session, rtp_event * e)
                 break;
         case SOURCE_CREATED:
                 pdb_add(participants, e->ssrc);
+                if ((state = pdb_get(participants, e->ssrc)) != NULL) {
+                        pbuf_set_rtp_session(state->playout_buffer, session);
+                }
                 break;
         case RR_TIMEOUT:
                 break;
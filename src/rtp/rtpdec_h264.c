@@ -98,12 +98,61 @@ static uint8_t process_nal(uint8_t nal, struct video_frame *frame, uint8_t *data
     return type;
 }
 
-static _Bool decode_nal_unit(struct video_frame *frame, int *total_length, int pass, unsigned char **dst, uint8_t *data, int data_len) {
-    int fu_length = 0;
+#define HEVC_NAL_TYPE(hdr0) (((hdr0) >> 1) & 0x3FU)
+#define HEVC_NAL_IRAP_MIN 16
+#define HEVC_NAL_IRAP_MAX 23
+#define HEVC_RTP_AP 48
+#define HEVC_RTP_FU 49
+
+/// frame type detection for HEVC NAL units (see process_nal())
+static void process_nal_hevc(uint8_t hdr0, struct video_frame *frame) {
+    uint8_t type = HEVC_NAL_TYPE(hdr0);
+    log_msg(LOG_LEVEL_DEBUG2, "HEVC NAL type %d\n", (int) type);
+    if ((type >= HEVC_NAL_IRAP_MIN && type <= HEVC_NAL_IRAP_MAX) || type == NAL_HEVC_VPS) {
+        frame->frame_type = INTRA;
+    } else if (type < HEVC_NAL_IRAP_MIN && frame->frame_type == BFRAME) {
+        frame->frame_type = OTHER;
+    }
+}
+
+/// prepends start code and NAL unit (optionally with separate NAL header) before *dst
+static void put_nal(unsigned char **dst, const uint8_t *nal_hdr, int nal_hdr_len, const uint8_t *data, int data_len) {
+    *dst -= sizeof(start_sequence) + nal_hdr_len + data_len;
+    memcpy(*dst, start_sequence, sizeof(start_sequence));
+    memcpy(*dst + sizeof(start_sequence), nal_hdr, nal_hdr_len);
+    memcpy(*dst + sizeof(start_sequence) + nal_hdr_len, data, data_len);
+}
+
+/**
+ * Processes one RTP payload (RFC 6184 or RFC 7798 non-interleaved mode).
+ *
+ * In pass 0 only the headers are parsed - the length of the reassembled
+ * stream is computed and the frame type deduced. In pass 1 the payload is
+ * written before *dst (the packets come in descending order).
+ */
+static _Bool decode_nal_unit(struct video_frame *frame, _Bool hevc, int *total_length, int pass, unsigned char **dst, uint8_t *data, int data_len) {
+    const int hdr_len = hevc ? 2 : 1;
+    if (data_len <= hdr_len) {
+        error_msg("Too short H.264/HEVC RTP packet (%d B)\n", data_len);
+        return FALSE;
+    }
     uint8_t nal = data[0];
-    uint8_t type = pass == 0 ? process_nal(nal, frame, data, data_len) : NALU_HDR_GET_TYPE(nal);
-    if (type >= NAL_MIN && type <= NAL_MAX) {
-        type = H264_NAL;
+    uint8_t type = 0;
+    if (hevc) {
+        type = HEVC_NAL_TYPE(nal);
+        if (type < HEVC_RTP_AP) {
+            type = H264_NAL;
+            if (pass == 0) {
+                process_nal_hevc(nal, frame);
+            }
+        } else {
+            type = type == HEVC_RTP_AP ? RTP_STAP_A : type == HEVC_RTP_FU ? RTP_FU_A : type;
+        }
+    } else {
+        type = pass == 0 ? process_nal(nal, frame, data, data_len) : NALU_HDR_GET_TYPE(nal);
+        if (type >= NAL_MIN && type <= NAL_MAX) {
+            type = H264_NAL;
+        }
     }
 
     switch (type) {
@@ -111,17 +160,15 @@ static _Bool decode_nal_unit(struct video_frame *frame, int *total_length, int p
             if (pass == 0) {
                 *total_length += sizeof(start_sequence) + data_len;
             } else {
-                *dst -= data_len + sizeof(start_sequence);
-                memcpy(*dst, start_sequence, sizeof(start_sequence));
-                memcpy(*dst + sizeof(start_sequence), data, data_len);
+                put_nal(dst, NULL, 0, data, data_len);
             }
             break;
         case RTP_STAP_A:
         {
             int nal_sizes[100];
             unsigned nal_count = 0;
-            data++;
-            data_len--;
+            data += hdr_len;
+            data_len -= hdr_len;
 
             while (data_len > 2) {
                 uint16_t nal_size;
@@ -131,96 +178,79 @@ static _Bool decode_nal_unit(struct video_frame *frame, int *total_length, int p
                 data += 2;
                 data_len -= 2;
 
-                log_msg(LOG_LEVEL_DEBUG2, "STAP-A subpacket NAL type %d (nri: %d)\n", (int) NALU_HDR_GET_TYPE(data[0]), (int) NALU_HDR_GET_NRI(nal));
-
-                if (nal_size <= data_len) {
-                    if (pass == 0) {
-                        *total_length += sizeof(start_sequence) + nal_size;
-                        process_nal(data[0], frame, data, data_len);
+                if (nal_size > data_len || nal_size < hdr_len) {
+                    error_msg("NAL size exceeds length: %u %d\n", nal_size, data_len);
+                    return FALSE;
+                }
+                if (pass == 0) {
+                    *total_length += sizeof(start_sequence) + nal_size;
+                    if (hevc) {
+                        process_nal_hevc(data[0], frame);
                     } else {
-                        assert(nal_count < sizeof nal_sizes / sizeof nal_sizes[0] - 1);
-                        nal_sizes[nal_count++] = nal_size;
+                        log_msg(LOG_LEVEL_DEBUG2, "STAP-A subpacket NAL type %d (nri: %d)\n", (int) NALU_HDR_GET_TYPE(data[0]), (int) NALU_HDR_GET_NRI(nal));
+                        process_nal(data[0], frame, data, nal_size);
                     }
                 } else {
-                    error_msg("NAL size exceeds length: %u %d\n", nal_size, data_len);
-                    return FALSE;
+                    if (nal_count == sizeof nal_sizes / sizeof nal_sizes[0]) {
+                        error_msg("Too many NAL units in an aggregation packet!\n");
+                        return FALSE;
+                    }
+                    nal_sizes[nal_count++] = nal_size;
                 }
                 data += nal_size;
                 data_len -= nal_size;
-
-                if (data_len < 0) {
-                    error_msg("Consumed more bytes than we got! (%d)\n", data_len);
-                    return FALSE;
-                }
-
             }
-            if (pass > 0) {
-                for (int i = nal_count - 1; i >= 0; i--) {
-                    int nal_size = nal_sizes[i];
-                    data -= nal_size;
-                    *dst -= nal_size + sizeof(start_sequence);
-                    memcpy(*dst, start_sequence, sizeof(start_sequence));
-                    memcpy(*dst + sizeof(start_sequence), data, nal_size);
-                    data -= 2;
-                }
+            for (int i = nal_count - 1; i >= 0; i--) { // pass 1 only
+                data -= nal_sizes[i];
+                put_nal(dst, NULL, 0, data, nal_sizes[i]);
+                data -= 2;
             }
             break;
         }
-        case RTP_STAP_B:
-        case RTP_MTAP16:
-        case RTP_MTAP24:
-        case RTP_FU_B:
-            error_msg("Unhandled NAL type %d\n", type);
-            return FALSE;
         case RTP_FU_A:
-            data++;
-            data_len--;
-
-            if (data_len > 1) {
-                uint8_t fu_header = *data;
-                uint8_t start_bit = fu_header >> 7;
-                uint8_t end_bit       = (fu_header & 0x40) >> 6;
-                uint8_t nal_type = NALU_HDR_GET_TYPE(fu_header);
-                uint8_t reconstructed_nal;
-
-                // Reconstruct this packet's true nal; only the data follows.
-                /* The original nal forbidden bit and NRI are stored in this
-                 * packet's nal. */
-                reconstructed_nal = nal & 0xe0;
-                reconstructed_nal |= nal_type;
-
-                // skip the fu_header
-                data++;
-                data_len--;
+        {
+            if (data_len <= hdr_len + 1) {
+                error_msg("Too short data for FU RTP packet\n");
+                return FALSE;
+            }
+            uint8_t fu_header = data[hdr_len];
+            uint8_t start_bit = fu_header >> 7;
+            // Reconstruct this packet's true NAL header from the payload
+            // header (F, NRI/layer, TID) and the type in the FU header.
+            uint8_t reconstructed_nal[2];
+            if (hevc) {
+                reconstructed_nal[0] = (nal & 0x81) | ((fu_header & 0x3F) << 1);
+                reconstructed_nal[1] = data[1];
+            } else {
+                reconstructed_nal[0] = (nal & 0xe0) | NALU_HDR_GET_TYPE(fu_header);
+            }
+            data += hdr_len + 1;
+            data_len -= hdr_len + 1;
 
-                if (pass == 0) {
-                    if (end_bit) {
-                        fu_length = data_len;
-                    } else {
-                        fu_length += data_len;
-                    }
-                    if (start_bit) {
-                        *total_length += sizeof(start_sequence) + sizeof(reconstructed_nal) + data_len;
-                        process_nal(reconstructed_nal, frame, data, fu_length);
-                    } else {
-                        *total_length += data_len;
-                    }
-                } else {
-                    if (start_bit) {
-                        *dst -= sizeof(start_sequence) + sizeof(reconstructed_nal) + data_len;
-                        memcpy(*dst, start_sequence, sizeof(start_sequence));
-                        memcpy(*dst + sizeof(start_sequence), &reconstructed_nal, sizeof(reconstructed_nal));
-                        memcpy(*dst + sizeof(start_sequence) + sizeof(reconstructed_nal), data, data_len);
+            if (pass == 0) {
+                *total_length += data_len;
+                if (start_bit) {
+                    *total_length += sizeof(start_sequence) + hdr_len;
+                    if (hevc) {
+                        process_nal_hevc(reconstructed_nal[0], frame);
                     } else {
-                        *dst -= data_len;
-                        memcpy(*dst, data, data_len);
+                        process_nal(reconstructed_nal[0], frame, data, data_len);
                     }
                 }
+            } else if (start_bit) {
+                put_nal(dst, reconstructed_nal, hdr_len, data, data_len);
             } else {
-                error_msg("Too short data for FU-A H264 RTP packet\n");
-                return FALSE;
+                *dst -= data_len;
+                memcpy(*dst, data, data_len);
             }
             break;
+        }
+        case RTP_STAP_B:
+        case RTP_MTAP16:
+        case RTP_MTAP24:
+        case RTP_FU_B:
+            error_msg("Unhandled NAL type %d\n", type);
+            return FALSE;
         default:
             error_msg("Unknown NAL type %d\n", type);
             return FALSE;
@@ -228,35 +258,51 @@ static _Bool decode_nal_unit(struct video_frame *frame, int *total_length, int p
     return TRUE;
 }
 
+/**
+ * Reassembles the Annex B bitstream of an access unit from its RTP packets
+ * directly to frame->tiles[0].data (after offset_len bytes reserved for the
+ * parameter sets if the frame is intra).
+ *
+ * The packet payloads are copied exactly once - the first walk over the
+ * packets reads just the headers to compute the stream length, the second
+ * one writes the payloads (backwards as the packets come in descending
+ * order). The stream is followed by RTPDEC_H264_PADDING zero bytes
+ * (required by libavcodec parsers).
+ *
+ * @retval FALSE if the packets are malformed or the stream doesn't fit in
+ *         max_len bytes, the required length is then stored to needed_len
+ */
 int decode_frame_h264(struct coded_data *cdata, void *decode_data) {
-    struct coded_data *orig = cdata;
-
-    int total_length = 0;
-
     struct decode_data_h264 *data = (struct decode_data_h264 *) decode_data;
     struct video_frame *frame = data->frame;
+    const _Bool hevc = frame->color_spec == H265;
+    int total_length = 0;
     frame->frame_type = BFRAME;
 
-    for (int pass = 0; pass < 2; pass++) {
-        unsigned char *dst = NULL;
-
-        if (pass > 0) {
-            cdata = orig;
-            if(frame->frame_type == INTRA){
-                total_length+=data->offset_len;
-            }
-            frame->tiles[0].data_len = total_length;
-            dst = (unsigned char *) frame->tiles[0].data + total_length;
+    for (struct coded_data *it = cdata; it != NULL; it = it->nxt) {
+        rtp_packet *pckt = it->data;
+        if (!decode_nal_unit(frame, hevc, &total_length, 0, NULL, (uint8_t *) pckt->data, pckt->data_len)) {
+            return FALSE;
         }
+    }
 
-        while (cdata != NULL) {
-            rtp_packet *pckt = cdata->data;
-
-            if (!decode_nal_unit(frame, &total_length, pass, &dst, (uint8_t *) pckt->data, pckt->data_len)) {
-                return FALSE;
-            }
+    if (frame->frame_type == INTRA) {
+        total_length += data->offset_len;
+    }
+    data->needed_len = total_length + RTPDEC_H264_PADDING;
+    if (data->max_len != 0 && data->needed_len > data->max_len) {
+        log_msg(LOG_LEVEL_WARNING, "H.264/HEVC frame of %d B doesn't fit in the buffer (%zu B), dropping\n",
+                total_length, data->max_len);
+        return FALSE;
+    }
+    frame->tiles[0].data_len = total_length;
+    unsigned char *dst = (unsigned char *) frame->tiles[0].data + total_length;
+    memset(dst, 0, RTPDEC_H264_PADDING);
 
-            cdata = cdata->nxt;
+    for (struct coded_data *it = cdata; it != NULL; it = it->nxt) {
+        rtp_packet *pckt = it->data;
+        if (!decode_nal_unit(frame, hevc, &total_length, 1, &dst, (uint8_t *) pckt->data, pckt->data_len)) {
+            return FALSE;
         }
     }
 
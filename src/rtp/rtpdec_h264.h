@@ -44,6 +44,8 @@
 #ifndef _RTP_DEC_H264_H
 #define _RTP_DEC_H264_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -58,10 +60,14 @@ extern "C" {
 
 struct video_frame;
 
+#define RTPDEC_H264_PADDING 64 ///< zeroed bytes after the reassembled stream (AV_INPUT_BUFFER_PADDING_SIZE)
+
 struct decode_data_h264 {
         struct video_frame *frame;
         int offset_len;
         int video_pt;
+        size_t max_len;    ///< capacity of frame data including padding, 0 - unchecked
+        size_t needed_len; ///< OUT - capacity needed for the last frame
 };
 
 struct coded_data;
@@ -6,7 +6,7 @@
  */
 /*
  * Copyright (c) 2005-2010 Fundació i2CAT, Internet I Innovació Digital a Catalunya
- * Copyright (c) 2014-2022 CESNET
+ * Copyright (c) 2014-2026 CESNET
  *
  * Redistribution and use in source and binary forms, with or without
  * modification, is permitted provided that the following conditions
@@ -52,6 +52,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "rtp/rtpenc_h264.h"
 
@@ -108,3 +109,246 @@ const unsigned char *rtpenc_h264_get_next_nal(const unsigned char *start, long l
         return nal;
 }
 
+#define H264_NAL_SLICE 1
+#define H264_NAL_IDR 5
+#define HEVC_NAL_TYPE(hdr0) (((hdr0) >> 1) & 0x3FU)
+#define HEVC_NAL_TID(hdr1) ((int) ((hdr1) & 0x7U) - 1) ///< TemporalId (nuh_temporal_id_plus1 - 1)
+#define HEVC_NAL_RSV_VCL_N14 14
+#define HEVC_NAL_IRAP_MIN 16
+#define HEVC_NAL_IRAP_MAX 23
+#define HEVC_NAL_VCL_MAX 31
+
+/**
+ * Classifies the access unit according to the headers of its slice NAL units.
+ *
+ * HEVC sub-layer non-reference pictures are not referenced only by pictures
+ * of the same sub-layer, higher sub-layers may still reference them. So such
+ * a picture is disposable only if its TemporalId is the highest one seen
+ * in the stream so far (including TemporalId 0 if no higher sub-layer was
+ * seen), which is tracked in hevc_max_tid.
+ *
+ * @param hevc_max_tid highest TemporalId seen in the HEVC stream, updated by
+ *                     the call, initialize to 0; if NULL, sub-layer
+ *                     non-reference pictures are reported as OTHER
+ * @retval INTRA  an IDR (H.264) or IRAP (HEVC) picture
+ * @retval BFRAME all slices are non-reference (nal_ref_idc 0, HEVC sub-layer
+ *                non-reference types in the highest sub-layer), so no other
+ *                frame depends on it and it can be dropped
+ * @retval OTHER  a reference picture (or no slice was found)
+ */
+frame_type_t rtpenc_h264_get_frame_type(const unsigned char *data, long len, bool hevc, int *hevc_max_tid) {
+        const unsigned char *nal = data;
+        const unsigned char *endptr = NULL;
+        bool slice_found = false;
+        int tid = 0;
+        while ((nal = rtpenc_h264_get_next_nal(nal, len - (nal - data), &endptr)) != NULL) {
+                if (endptr - nal < (hevc ? 2 : 1)) {
+                        nal = endptr;
+                        continue;
+                }
+                if (hevc) {
+                        unsigned type = HEVC_NAL_TYPE(nal[0]);
+                        if (type <= HEVC_NAL_VCL_MAX) { // all slices of a picture share TemporalId
+                                tid = HEVC_NAL_TID(nal[1]);
+                                if (hevc_max_tid != NULL && tid > *hevc_max_tid) {
+                                        *hevc_max_tid = tid;
+                                }
+                        }
+                        if (type >= HEVC_NAL_IRAP_MIN && type <= HEVC_NAL_IRAP_MAX) {
+                                return INTRA;
+                        }
+                        if (type <= HEVC_NAL_VCL_MAX) {
+                                if (type > HEVC_NAL_RSV_VCL_N14 || type % 2 == 1) {
+                                        return OTHER;
+                                }
+                                slice_found = true;
+                        }
+                } else {
+                        unsigned type = nal[0] & 0x1FU;
+                        if (type == H264_NAL_IDR) {
+                                return INTRA;
+                        }
+                        if (type >= H264_NAL_SLICE && type < H264_NAL_IDR) {
+                                if ((nal[0] & 0x60U) != 0) { // nal_ref_idc
+                                        return OTHER;
+                                }
+                                slice_found = true;
+                        }
+                }
+                nal = endptr;
+        }
+        if (hevc && slice_found && (hevc_max_tid == NULL || tid < *hevc_max_tid)) {
+                return OTHER; // a higher sub-layer may reference it
+        }
+        return slice_found ? BFRAME : OTHER;
+}
+
+#define H264_STAP_A 24
+#define H264_FU_A 28
+#define HEVC_AP 48
+#define HEVC_FU 49
+#define MAX_AGGREGATED_NALS 64 ///< receivers usually have a fixed limit
+
+struct packetizer {
+        bool hevc;
+        int max_payload;
+        struct rtpenc_h264_pkt *pkts;
+        int max_pkts;
+        int count;
+        unsigned char *scratch;
+        size_t scratch_len;
+        size_t scratch_used;
+};
+
+static void add_pkt(struct packetizer *p, const unsigned char *hdr, int hdr_len, const unsigned char *data, int data_len)
+{
+        if (p->count < p->max_pkts) {
+                p->pkts[p->count] = (struct rtpenc_h264_pkt){ hdr, hdr_len, data, data_len, false };
+        }
+        p->count += 1;
+}
+
+/// @returns scratch space for len bytes, NULL if it doesn't fit (only the required space is counted)
+static unsigned char *alloc_scratch(struct packetizer *p, size_t len)
+{
+        unsigned char *ret = p->scratch_used + len <= p->scratch_len ? p->scratch + p->scratch_used : NULL;
+        p->scratch_used += len;
+        return ret;
+}
+
+/**
+ * Sends the NAL unit as FU-A (H.264, RFC 6184) or FU (HEVC, RFC 7798)
+ * fragments. Only the FU headers are stored in the scratch, the payload
+ * points to the NAL unit.
+ */
+static void fragment(struct packetizer *p, const unsigned char *nal, int nalsize)
+{
+        const int nal_hdr_len = p->hevc ? 2 : 1;
+        const int fu_hdr_len = nal_hdr_len + 1;
+        const int chunk = p->max_payload - fu_hdr_len;
+        unsigned char fu[3];
+        int type = 0;
+        if (p->hevc) {
+                type = (nal[0] >> 1) & 0x3F;
+                fu[0] = (nal[0] & 0x81) | (HEVC_FU << 1);
+                fu[1] = nal[1];
+        } else {
+                type = nal[0] & 0x1F;
+                fu[0] = (nal[0] & 0xE0) | H264_FU_A;
+        }
+        for (int off = nal_hdr_len; off < nalsize; off += chunk) {
+                const int len = nalsize - off < chunk ? nalsize - off : chunk;
+                unsigned char *hdr = alloc_scratch(p, fu_hdr_len);
+                if (hdr != NULL) {
+                        memcpy(hdr, fu, nal_hdr_len);
+                        hdr[nal_hdr_len] = type | (off == nal_hdr_len ? 0x80 : 0) | (off + len == nalsize ? 0x40 : 0);
+                }
+                add_pkt(p, hdr, fu_hdr_len, nal + off, len);
+        }
+}
+
+/**
+ * Aggregates NAL units [nals[0], nals[count]) into STAP-A (H.264) or AP (HEVC)
+ * packet copied to the scratch buffer.
+ */
+static void aggregate(struct packetizer *p, const unsigned char *const *nals, const int *sizes, int count)
+{
+        if (count == 1) {
+                add_pkt(p, NULL, 0, nals[0], sizes[0]);
+                return;
+        }
+        const int hdr_len = p->hevc ? 2 : 1;
+        size_t len = hdr_len;
+        for (int i = 0; i < count; ++i) {
+                len += 2 + sizes[i];
+        }
+        unsigned char *buf = alloc_scratch(p, len);
+        if (buf != NULL) {
+                if (p->hevc) {
+                        // F bit ORed, lowest layer ID and temporal ID
+                        int f = 0, layer = 0x3F, tid = 7;
+                        for (int i = 0; i < count; ++i) {
+                                f |= nals[i][0] & 0x80;
+                                int l = ((nals[i][0] & 1) << 5) | (nals[i][1] >> 3);
+                                layer = l < layer ? l : layer;
+                                tid = (nals[i][1] & 7) < tid ? (nals[i][1] & 7) : tid;
+                        }
+                        buf[0] = f | (HEVC_AP << 1) | (layer >> 5);
+                        buf[1] = ((layer & 0x1F) << 3) | tid;
+                } else {
+                        // F bit ORed, highest NRI
+                        int f = 0, nri = 0;
+                        for (int i = 0; i < count; ++i) {
+                                f |= nals[i][0] & 0x80;
+                                nri = (nals[i][0] & 0x60) > nri ? (nals[i][0] & 0x60) : nri;
+                        }
+                        buf[0] = f | nri | H264_STAP_A;
+                }
+                unsigned char *dst = buf + hdr_len;
+                for (int i = 0; i < count; ++i) {
+                        *dst++ = sizes[i] >> 8;
+                        *dst++ = sizes[i] & 0xFF;
+                        memcpy(dst, nals[i], sizes[i]);
+                        dst += sizes[i];
+                }
+        }
+        add_pkt(p, NULL, 0, buf, (int) len);
+}
+
+/**
+ * Splits an Annex B access unit into RTP payloads in the non-interleaved
+ * mode of RFC 6184 (H.264) or RFC 7798 (HEVC). Consecutive NAL units that
+ * fit in one packet together (typically parameter sets and SEI) are
+ * aggregated, the ones exceeding max_payload are fragmented.
+ *
+ * The packets are filled only as long as they fit in pkts/scratch. The caller
+ * is expected to grow the buffers and call the function again if either the
+ * returned count exceeds max_pkts or *scratch_needed exceeds scratch_len.
+ *
+ * @param max_payload    maximal RTP payload length
+ * @param scratch        buffer for FU headers and aggregation packets, must
+ *                       stay unmodified as long as pkts are in use
+ * @param[out] scratch_needed  required length of scratch
+ * @returns              number of the packets
+ */
+int rtpenc_h264_packetize(const unsigned char *data, long len, bool hevc, int max_payload,
+                struct rtpenc_h264_pkt *pkts, int max_pkts,
+                unsigned char *scratch, size_t scratch_len, size_t *scratch_needed)
+{
+        struct packetizer p = { hevc, max_payload, pkts, max_pkts, 0, scratch, scratch_len, 0 };
+        const unsigned char *agg_nals[MAX_AGGREGATED_NALS];
+        int agg_sizes[MAX_AGGREGATED_NALS];
+        int agg_count = 0;
+        int agg_len = hevc ? 2 : 1; // payload length of the aggregation packet being built
+
+        const unsigned char *endptr = NULL;
+        const unsigned char *nal = data;
+        while ((nal = rtpenc_h264_get_next_nal(nal, len - (nal - data), &endptr)) != NULL) {
+                const int nalsize = (int) (endptr - nal);
+                if (nalsize <= (hevc ? 2 : 1)) { // no payload
+                        nal = endptr;
+                        continue;
+                }
+                if (agg_count > 0 && (agg_len + 2 + nalsize > max_payload || agg_count == MAX_AGGREGATED_NALS)) {
+                        aggregate(&p, agg_nals, agg_sizes, agg_count);
+                        agg_count = 0;
+                        agg_len = hevc ? 2 : 1;
+                }
+                if (nalsize > max_payload) {
+                        fragment(&p, nal, nalsize);
+                } else {
+                        agg_nals[agg_count] = nal;
+                        agg_sizes[agg_count++] = nalsize;
+                        agg_len += 2 + nalsize;
+                }
+                nal = endptr;
+        }
+        if (agg_count > 0) {
+                aggregate(&p, agg_nals, agg_sizes, agg_count);
+        }
+        if (p.count > 0 && p.count <= max_pkts) {
+                pkts[p.count - 1].m = true;
+        }
+        *scratch_needed = p.scratch_used;
+        return p.count;
+}
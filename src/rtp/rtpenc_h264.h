@@ -53,12 +53,38 @@
 /// custom orig format byte syntax - highest 1 bit zero, next 2 bits (depth-8)/2, next 3 bits subsampling (Y-1) from X:Y:Z, next 1 bit - vertical is subsampled, last bit RGB
 #define UG_ORIG_FORMAT_ISO_IEC_11578_GUID 0xDB, 0x69, 0xDA, 0x43, 0x42, 0x11, 0x40, 0xEC, 0xA2, 0xF1, 0x45, 0x96, 0x64, 0xFA, 0x14, 0x63
 
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#endif
+
+#include "types.h" // frame_type_t
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// function documented at definition
+/**
+ * RTP payload of one packet produced by rtpenc_h264_packetize() - the
+ * payload header (FU or aggregation data stored in the scratch buffer),
+ * followed by data (pointing to the bitstream for FU and single NAL units).
+ */
+struct rtpenc_h264_pkt {
+        const unsigned char *hdr; ///< may be NULL
+        int hdr_len;
+        const unsigned char *data;
+        int data_len;
+        bool m; ///< last packet of the access unit
+};
+
+// functions documented at definition
 const unsigned char *rtpenc_h264_get_next_nal(const unsigned char *start, long len, const unsigned char **endptr);
+frame_type_t rtpenc_h264_get_frame_type(const unsigned char *data, long len, bool hevc, int *hevc_max_tid);
+int rtpenc_h264_packetize(const unsigned char *data, long len, bool hevc, int max_payload,
+                struct rtpenc_h264_pkt *pkts, int max_pkts,
+                unsigned char *scratch, size_t scratch_len, size_t *scratch_needed);
 
 #ifdef __cplusplus
 }
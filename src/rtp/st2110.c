@@ -0,0 +1,327 @@
+/**
+ * @file   rtp/st2110.c
+ * @brief  SMPTE ST 2110-20 (RFC 4175) uncompressed video payload
+ *
+ * Frames are sent as pgroups (the smallest group of pixels taking an
+ * integral number of bytes) in the general packing mode - each packet
+ * carries up to ST2110_MAX_SRDS line segments, each announced by a sample
+ * row data header (length, line number, pixel offset). The segments are
+ * consecutive in the frame so the packet data are contiguous in the
+ * pgroup buffer as well.
+ *
+ * Supported formats are 4:2:2 8-bit (UYVY, which has the pgroup layout),
+ * 4:2:2 10-bit (v210, converted from/to 5 B pgroups) and RGB 8-bit.
+ * Only progressive video is handled.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rtp/st2110.h"
+#include "tv.h"
+#include "utils/macros.h"
+#include "video_codec.h"
+
+/**
+ * @param[out] bytes   pgroup size in bytes
+ * @param[out] pixels  pixels in pgroup
+ * @retval false codec cannot be sent as ST 2110-20
+ */
+bool st2110_get_pgroup(codec_t codec, int *bytes, int *pixels)
+{
+        switch (codec) {
+        case UYVY:
+                *bytes = 4;
+                *pixels = 2;
+                return true;
+        case v210:
+                *bytes = 5;
+                *pixels = 2;
+                return true;
+        case RGB:
+                *bytes = 3;
+                *pixels = 1;
+                return true;
+        default:
+                return false;
+        }
+}
+
+/// v210 stores the 4:2:2 components in the pgroup order (Cb Y0 Cr Y1), 3 per 32-bit word
+static inline unsigned v210_get(const uint32_t *line, int k)
+{
+        return line[k / 3] >> (10 * (k % 3)) & 0x3FFU;
+}
+
+static inline void v210_set(uint32_t *line, int k, unsigned val)
+{
+        const int shift = 10 * (k % 3);
+        line[k / 3] = (line[k / 3] & ~(0x3FFU << shift)) | val << shift;
+}
+
+/// packs 4 10-bit components into big-endian 5 B pgroup
+static inline void pgroup10_pack(unsigned char *dst, const unsigned *c)
+{
+        dst[0] = c[0] >> 2;
+        dst[1] = (c[0] & 0x3U) << 6 | c[1] >> 4;
+        dst[2] = (c[1] & 0xFU) << 4 | c[2] >> 6;
+        dst[3] = (c[2] & 0x3FU) << 2 | c[3] >> 8;
+        dst[4] = c[3] & 0xFFU;
+}
+
+static inline void pgroup10_unpack(unsigned *c, const unsigned char *src)
+{
+        c[0] = src[0] << 2 | src[1] >> 6;
+        c[1] = (src[1] & 0x3FU) << 4 | src[2] >> 4;
+        c[2] = (src[2] & 0xFU) << 6 | src[3] >> 2;
+        c[3] = (src[3] & 0x3U) << 8 | src[4];
+}
+
+/**
+ * Converts a line of the frame to pgroups - v210 is repacked, the other
+ * formats are only copied.
+ */
+void st2110_pack_line(codec_t codec, unsigned char *dst, const char *src, int width)
+{
+        if (codec != v210) {
+                memcpy(dst, src, vc_get_linesize(width, codec));
+                return;
+        }
+        const uint32_t *line = (const uint32_t *)(const void *) src;
+        const int comps = 2 * width;
+        int k = 0;
+        for ( ; k + 12 <= comps; k += 12, dst += 15) { // 6 pixels - 4 words to 3 pgroups
+                const uint32_t *in = line + k / 3;
+                unsigned c[12];
+                for (int i = 0; i < 4; ++i) {
+                        c[3 * i] = in[i] & 0x3FFU;
+                        c[3 * i + 1] = in[i] >> 10 & 0x3FFU;
+                        c[3 * i + 2] = in[i] >> 20 & 0x3FFU;
+                }
+                pgroup10_pack(dst, c);
+                pgroup10_pack(dst + 5, c + 4);
+                pgroup10_pack(dst + 10, c + 8);
+        }
+        for ( ; k < comps; k += 4, dst += 5) {
+                unsigned c[4] = { v210_get(line, k), v210_get(line, k + 1), v210_get(line, k + 2), v210_get(line, k + 3) };
+                pgroup10_pack(dst, c);
+        }
+}
+
+/**
+ * Writes received line segment to the frame line.
+ *
+ * @param offset  segment offset in pixels (multiple of pgroup pixels)
+ * @param len     segment length in bytes (multiple of pgroup size)
+ */
+void st2110_unpack(codec_t codec, char *dst_line, const unsigned char *src, unsigned offset, int len)
+{
+        int pg_bytes = 0;
+        int pg_pixels = 0;
+        st2110_get_pgroup(codec, &pg_bytes, &pg_pixels);
+        if (codec != v210) {
+                memcpy(dst_line + offset / pg_pixels * pg_bytes, src, len);
+                return;
+        }
+        uint32_t *line = (uint32_t *)(void *) dst_line;
+        int k = 2 * offset;
+        const int end = k + len / 5 * 4;
+        for ( ; k < end && k % 12 != 0; k += 4, src += 5) { // up to v210 block boundary
+                unsigned c[4];
+                pgroup10_unpack(c, src);
+                for (int i = 0; i < 4; ++i) {
+                        v210_set(line, k + i, c[i]);
+                }
+        }
+        for ( ; k + 12 <= end; k += 12, src += 15) {
+                unsigned c[12];
+                pgroup10_unpack(c, src);
+                pgroup10_unpack(c + 4, src + 5);
+                pgroup10_unpack(c + 8, src + 10);
+                uint32_t *out = line + k / 3;
+                for (int i = 0; i < 4; ++i) {
+                        out[i] = c[3 * i] | c[3 * i + 1] << 10 | c[3 * i + 2] << 20;
+                }
+        }
+        for ( ; k < end; k += 4, src += 5) {
+                unsigned c[4];
+                pgroup10_unpack(c, src);
+                for (int i = 0; i < 4; ++i) {
+                        v210_set(line, k + i, c[i]);
+                }
+        }
+}
+
+/**
+ * Splits a frame stored as pgroups (lines without padding) to packets. The
+ * packet data point to the buffer, the payload headers are stored in the
+ * packets.
+ *
+ * @param max_payload  maximal RTP payload length (including payload headers)
+ * @param ext_seq      extended sequence number of the first packet, the
+ *                     following packets are expected to be sent with
+ *                     consecutive sequence numbers
+ * @param max_pkts     capacity of pkts
+ * @returns number of packets of the frame (the packets above max_pkts are not
+ *          stored - caller should enlarge pkts and retry), -1 on error
+ */
+int st2110_packetize(const unsigned char *data, int width, int height, codec_t codec, int max_payload,
+                uint32_t ext_seq, struct st2110_pkt *pkts, int max_pkts)
+{
+        int pg_bytes = 0;
+        int pg_pixels = 0;
+        if (!st2110_get_pgroup(codec, &pg_bytes, &pg_pixels) || width % pg_pixels != 0
+                        || max_payload < ST2110_EXT_SEQ_LEN + ST2110_SRD_HDR_LEN + pg_bytes) {
+                return -1;
+        }
+        const int line_bytes = width / pg_pixels * pg_bytes;
+        int count = 0;
+        int line = 0;
+        int line_pos = 0; ///< bytes of the line already packetized
+        while (line < height) {
+                struct st2110_pkt tmp;
+                struct st2110_pkt *pkt = count < max_pkts ? &pkts[count] : &tmp;
+                pkt->data = data + (size_t) line * line_bytes + line_pos;
+                pkt->data_len = 0;
+                unsigned char *hdr = pkt->hdr + ST2110_EXT_SEQ_LEN;
+                int space = max_payload - ST2110_EXT_SEQ_LEN;
+                int srds = 0;
+                while (line < height && srds < ST2110_MAX_SRDS) {
+                        const int avail = (space - ST2110_SRD_HDR_LEN) / pg_bytes * pg_bytes;
+                        if (avail <= 0) {
+                                break;
+                        }
+                        const int len = MIN(avail, line_bytes - line_pos);
+                        const int offset = line_pos / pg_bytes * pg_pixels;
+                        if (srds > 0) {
+                                hdr[-ST2110_SRD_HDR_LEN + 4] |= 0x80; // continuation
+                        }
+                        hdr[0] = len >> 8;
+                        hdr[1] = len & 0xFF;
+                        hdr[2] = (line >> 8) & 0x7F; // F = 0 (progressive)
+                        hdr[3] = line & 0xFF;
+                        hdr[4] = (offset >> 8) & 0x7F;
+                        hdr[5] = offset & 0xFF;
+                        hdr += ST2110_SRD_HDR_LEN;
+                        srds += 1;
+                        space -= ST2110_SRD_HDR_LEN + len;
+                        pkt->data_len += len;
+                        line_pos += len;
+                        if (line_pos == line_bytes) {
+                                line += 1;
+                                line_pos = 0;
+                        }
+                }
+                const uint32_t seq = ext_seq + count;
+                pkt->hdr[0] = seq >> 24;
+                pkt->hdr[1] = (seq >> 16) & 0xFF;
+                pkt->hdr_len = ST2110_EXT_SEQ_LEN + srds * ST2110_SRD_HDR_LEN;
+                pkt->m = line == height;
+                count += 1;
+        }
+        return count;
+}
+
+/**
+ * Parses payload headers of a received packet.
+ *
+ * @param[out] ext_seq_hi  high 16 bits of the extended sequence number
+ * @returns number of line segments, -1 if the payload is malformed
+ */
+int st2110_parse(const unsigned char *payload, int len, uint16_t *ext_seq_hi, struct st2110_srd *srds, int max_srds)
+{
+        if (len < ST2110_EXT_SEQ_LEN + ST2110_SRD_HDR_LEN) {
+                return -1;
+        }
+        const unsigned char *const end = payload + len;
+        *ext_seq_hi = payload[0] << 8 | payload[1];
+        const unsigned char *hdr = payload + ST2110_EXT_SEQ_LEN;
+        int count = 0;
+        bool cont = true;
+        while (cont) {
+                if (count == max_srds || end - hdr < ST2110_SRD_HDR_LEN) {
+                        return -1;
+                }
+                srds[count].len = hdr[0] << 8 | hdr[1];
+                srds[count].second_field = (hdr[2] & 0x80) != 0;
+                srds[count].line = (hdr[2] & 0x7F) << 8 | hdr[3];
+                cont = (hdr[4] & 0x80) != 0;
+                srds[count].offset = (hdr[4] & 0x7F) << 8 | hdr[5];
+                hdr += ST2110_SRD_HDR_LEN;
+                count += 1;
+        }
+        for (int i = 0; i < count; ++i) {
+                if (end - hdr < srds[i].len) {
+                        return -1;
+                }
+                srds[i].data = hdr;
+                hdr += srds[i].len;
+        }
+        return count;
+}
+
+/**
+ * Computes the ST 2110-21 narrow gapped sender timing - the packets are
+ * spread over the active part of the frame period (as if the video was a
+ * raster with vertical blanking) and the first one departs TRO after the
+ * frame epoch.
+ *
+ * @param[out] trs_ns  inter-packet interval (TRS)
+ * @param[out] tro_ns  first packet offset from the frame epoch (TRO default,
+ *                     43 lines for 1080, 28 for 720 lines)
+ */
+void st2110_narrow_timing(int height, double fps, int pkt_count, long long *trs_ns, long long *tro_ns)
+{
+        int total_lines = 0;
+        switch (height) {
+        case 480: total_lines = 525; break;
+        case 576: total_lines = 625; break;
+        case 720: total_lines = 750; break;
+        case 1080: total_lines = 1125; break;
+        case 2160: total_lines = 2250; break;
+        case 4320: total_lines = 4500; break;
+        default: total_lines = height * 1125 / 1080; // ratio of the 1080-line formats
+        }
+        const double frame_ns = NS_IN_SEC_DBL / fps;
+        *trs_ns = (long long) (frame_ns * height / total_lines / MAX(pkt_count, 1));
+        *tro_ns = (long long) (frame_ns * MAX(total_lines - height - 2, 0) / total_lines);
+}
@@ -0,0 +1,92 @@
+/**
+ * @file   rtp/st2110.h
+ * @brief  SMPTE ST 2110-20 (RFC 4175) uncompressed video payload
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_ST2110_H_
+#define RTP_ST2110_H_
+
+#include "types.h"
+
+#ifdef __cplusplus
+#include <cstdint>
+#else
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+#define ST2110_EXT_SEQ_LEN 2  ///< extended sequence number (high 16 bits) preceding the SRD headers
+#define ST2110_SRD_HDR_LEN 6  ///< sample row data header - length, line number, offset
+#define ST2110_MAX_SRDS    3  ///< line segments per packet
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * RTP payload of one packet produced by st2110_packetize() - the payload
+ * header followed by data pointing to the pgroup buffer.
+ */
+struct st2110_pkt {
+        unsigned char hdr[ST2110_EXT_SEQ_LEN + ST2110_MAX_SRDS * ST2110_SRD_HDR_LEN];
+        int hdr_len;
+        const unsigned char *data;
+        int data_len;
+        bool m; ///< last packet of the frame
+};
+
+/// line segment of a received packet parsed by st2110_parse()
+struct st2110_srd {
+        unsigned line;
+        unsigned offset; ///< in pixels
+        bool second_field;
+        const unsigned char *data;
+        int len;         ///< in bytes
+};
+
+// functions documented at definition
+bool st2110_get_pgroup(codec_t codec, int *bytes, int *pixels);
+void st2110_pack_line(codec_t codec, unsigned char *dst, const char *src, int width);
+void st2110_unpack(codec_t codec, char *dst_line, const unsigned char *src, unsigned offset, int len);
+int st2110_packetize(const unsigned char *data, int width, int height, codec_t codec, int max_payload,
+                uint32_t ext_seq, struct st2110_pkt *pkts, int max_pkts);
+int st2110_parse(const unsigned char *payload, int len, uint16_t *ext_seq_hi, struct st2110_srd *srds, int max_srds);
+void st2110_narrow_timing(int height, double fps, int pkt_count, long long *trs_ns, long long *tro_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTP_ST2110_H_
@@ -51,6 +51,9 @@
  * 2. fec_thread() passes frame to decompress thread
  * 3. thread running decompress_thread(), displays the frame
  *
+ * The stages are connected with queues holding by default 1 frame, which can
+ * be increased with "decoder-pipeline-depth" to absorb a stage jitter.
+ *
  * ### Uncompressed video (without FEC) ###
  * In step one, the decoder is a linedecoder and framebuffer is the display framebuffer
  *
@@ -108,13 +111,17 @@
 #include "messaging.h"
 #include "module.h"
 #include "rtp/fec.h"
+#include "rtp/fec_group.h"
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
 #include "rtp/pbuf.h"
 #include "rtp/video_decoders.h"
 #include "utils/color_out.h"
+#include "utils/frame_trace.h"
 #include "utils/macros.h"
+#include "utils/metrics.h"
 #include "utils/misc.h"
+#include "utils/profile_timer.hpp"
 #include "utils/synchronized_queue.h"
 #include "utils/thread.h"
 #include "utils/timed_message.h"
@@ -159,6 +166,8 @@ struct state_video_decoder;
  * in place, that is when dst and src are the same.
  */
 typedef void (*change_il_t)(char *dst, char *src, int linesize, int height, void **state);
+/// maps source line to destination line for interlacing changes that are a plain line permutation
+typedef int (*il_line_map_t)(int line, int height);
 
 // prototypes
 static bool reconfigure_decoder(struct state_video_decoder *decoder,
@@ -208,8 +217,78 @@ struct line_decoder {
         unsigned int         dst_linesize; ///< destination linesize
         unsigned int         dst_pitch;    ///< framebuffer pitch - it can be larger if SDL resolution is larger than data
         unsigned int         src_linesize; ///< source linesize
+        bool                 contiguous;   ///< plain copy with src and dst lines adjacent - packet can be copied at once
+        int                  clip_src_len; ///< remaining source length from which a line segment is clipped to dst_linesize
+        il_line_map_t        il_line_map;  ///< if not NULL, interlacing is changed while decoding by writing lines to mapped positions
+        int                  height;       ///< source height in lines (for il_line_map)
 };
 
+static inline int line_decoder_dst_line(const struct line_decoder *d, int line)
+{
+        return d->il_line_map ? d->il_line_map(line, d->height) : line;
+}
+
+/**
+ * Decodes a line segment of l destination bytes to the line of the tile.
+ * @retval false the segment doesn't fit to the framebuffer
+ */
+template<bool plain_copy>
+static inline bool line_decoder_segment(const struct line_decoder *d, struct tile *tile, int line, int d_x,
+                const unsigned char *src, int l)
+{
+        unsigned int offset = line_decoder_dst_line(d, line) * d->dst_pitch + d_x;
+        if (l + d->base_offset + offset > tile->data_len) {
+                return false;
+        }
+        unsigned char *dst = (unsigned char *) tile->data + d->base_offset + offset;
+        if (plain_copy) {
+                memcpy(dst, src, l);
+        } else {
+                d->decode_line(dst, src, l, d->shifts[0], d->shifts[1], d->shifts[2]);
+        }
+        return true;
+}
+
+/**
+ * Decodes the packet of len source bytes at data_pos of the tile. The packet
+ * may start and end in the middle of a line, the line segments are clipped
+ * (v210) or centered (RGBA, R10k) to the destination line. Only the partial
+ * lines need the conversion ratio, the whole lines in between are decoded
+ * with the precomputed lengths.
+ *
+ * @retval false the framebuffer is too small, the rest of the packet was discarded
+ */
+template<bool plain_copy>
+static bool line_decoder_decode_packet(const struct line_decoder *d, struct tile *tile, int data_pos,
+                const unsigned char *source, int len)
+{
+        int line = data_pos / d->src_linesize;
+        int s_x = data_pos % d->src_linesize;
+
+        if (s_x != 0) { // packet starts in the middle of a line
+                int d_x = s_x * d->conv_num / d->conv_den;
+                int l = std::min<long>(len * d->conv_num / d->conv_den, d->dst_linesize - d_x);
+                if (!line_decoder_segment<plain_copy>(d, tile, line, d_x, source, l)) {
+                        return false;
+                }
+                len -= d->src_linesize - s_x;
+                source += d->src_linesize - s_x;
+                line += 1;
+        }
+        // whole lines, the segment is clipped to dst_linesize unless it is the last one
+        for ( ; len >= d->clip_src_len; len -= d->src_linesize, source += d->src_linesize, line += 1) {
+                if (!line_decoder_segment<plain_copy>(d, tile, line, 0, source, d->dst_linesize)) {
+                        return false;
+                }
+        }
+        for ( ; len > 0; len -= d->src_linesize, source += d->src_linesize, line += 1) {
+                if (!line_decoder_segment<plain_copy>(d, tile, line, 0, source, len * d->conv_num / d->conv_den)) {
+                        return false;
+                }
+        }
+        return true;
+}
+
 struct reported_statistics_cumul {
         ~reported_statistics_cumul() {
                 print();
@@ -218,6 +297,17 @@ struct reported_statistics_cumul {
         chrono::steady_clock::time_point t_last = chrono::steady_clock::now();
         unsigned long int displayed = 0, dropped = 0, corrupted = 0, missing = 0;
         atomic_ulong fec_ok = 0, fec_corrected = 0, fec_nok = 0;
+#define FRAMES_HELP "Received video frames by result"
+#define FEC_HELP "FEC-protected video frames by result"
+        struct metric *m_displayed = metric_counter("ug_video_frames_total", FRAMES_HELP, "result=\"displayed\"");
+        struct metric *m_dropped = metric_counter("ug_video_frames_total", FRAMES_HELP, "result=\"dropped\"");
+        struct metric *m_corrupted = metric_counter("ug_video_frames_total", FRAMES_HELP, "result=\"corrupted\"");
+        struct metric *m_missing = metric_counter("ug_video_frames_total", FRAMES_HELP, "result=\"missing\"");
+        struct metric *m_fec_ok = metric_counter("ug_video_fec_frames_total", FEC_HELP, "result=\"ok\"");
+        struct metric *m_fec_corrected = metric_counter("ug_video_fec_frames_total", FEC_HELP, "result=\"corrected\"");
+        struct metric *m_fec_nok = metric_counter("ug_video_fec_frames_total", FEC_HELP, "result=\"failed\"");
+#undef FRAMES_HELP
+#undef FEC_HELP
         void print() {
                 ostringstream fec;
                 if (fec_ok + fec_nok + fec_corrected > 0) {
@@ -236,16 +326,17 @@ struct reported_statistics_cumul {
                                         "to network jitter, try adding \"--param decoder-drop-policy=blocking\" if the problem persists.\n", dropped, total);
                 }
         }
-        void update(int buffer_number) {
+        /// @returns number of frames found missing
+        long long update(int buffer_number) {
+                long long newly_missing = 0;
                 if (last_buffer_number != -1) {
                         long long int diff = buffer_number -
                                 ((last_buffer_number + 1) & ((1U<<BUFNUM_BITS) - 1));
                         diff = (diff + (1U<<BUFNUM_BITS)) % (1U<<BUFNUM_BITS);
-                        if (diff < (1U<<BUFNUM_BITS) / 2) {
-                                missing += diff;
-                        } else { // frames may have been reordered, add arbitrary 1
-                                missing += 1;
-                        }
+                        newly_missing = diff < (1U<<BUFNUM_BITS) / 2 ? diff
+                                : 1; // frames may have been reordered, add arbitrary 1
+                        missing += newly_missing;
+                        metric_inc(m_missing, newly_missing);
                 }
                 last_buffer_number = buffer_number;
                 auto now = chrono::steady_clock::now();
@@ -253,9 +344,19 @@ struct reported_statistics_cumul {
                         print();
                         t_last = now;
                 }
+                return newly_missing;
         }
 };
 
+/// frame passed to the decompressor while being received (decoder-streaming)
+struct frame_stream {
+        mutex lock;
+        condition_variable cv;
+        unsigned int valid_len = 0; ///< length of the contiguous received prefix of the tile
+        bool complete = false; ///< whole frame received and frame_msg filled by the receiver
+        bool aborted = false;  ///< the frame won't be finished, the receiver doesn't touch frame_msg anymore
+};
+
 // message definitions
 struct frame_msg {
         inline frame_msg(struct control_state *c, struct reported_statistics_cumul &sr) : control(c), recv_frame(nullptr),
@@ -273,17 +374,22 @@ struct frame_msg {
                         if (recv_frame->fec_params.type != FEC_NONE) {
                                 if (is_corrupted) {
                                         stats.fec_nok += 1;
+                                        metric_inc(stats.m_fec_nok, 1);
                                 } else {
                                         if (received_bytes == expected_bytes) {
                                                 stats.fec_ok += 1;
+                                                metric_inc(stats.m_fec_ok, 1);
                                         } else {
                                                 stats.fec_corrected += 1;
+                                                metric_inc(stats.m_fec_corrected, 1);
                                         }
                                 }
                         }
                         stats.corrupted += is_corrupted;
                         stats.displayed += is_displayed;
                         stats.dropped += !is_displayed;
+                        metric_inc(is_displayed ? stats.m_displayed : stats.m_dropped, 1);
+                        metric_inc(stats.m_corrupted, is_corrupted);
                 }
                 vf_free(recv_frame);
                 vf_free(nofec_frame);
@@ -297,6 +403,10 @@ struct frame_msg {
         struct reported_statistics_cumul &stats;
         bool is_corrupted = false;
         bool is_displayed = false;
+        bool traced = false; ///< trace contains the frame stages (frame tracing enabled)
+        time_ns_t sender_time = 0; ///< capture time on the sender clock, 0 if unknown (pbuf_stats::sender_time)
+        struct frame_trace trace{};
+        shared_ptr<frame_stream> stream; ///< set if the frame is decompressed while being received
 };
 
 struct main_msg_reconfigure {
@@ -359,7 +469,24 @@ struct state_video_decoder
         struct line_decoder *line_decoder = NULL; ///< if the video is uncompressed and only pixelformat change
                                            ///< is neeeded, use this structure
         vector<struct state_decompress *> decompress_state; ///< state of the decompress (for every substream)
+        /// configuration decompress_state was initialized for, compression is VIDEO_CODEC_NONE if not reusable
+        struct {
+                codec_t compression = VIDEO_CODEC_NONE;
+                struct pixfmt_desc internal_prop{};
+                codec_t out_codec = VIDEO_CODEC_NONE;
+                vector<codec_t> native_codecs;
+        } decompress_cfg;
         bool accepts_corrupted_frame = false;     ///< whether we should pass corrupted frame to decompress
+        bool streaming = false; ///< frames are decompressed while being received (decoder-streaming)
+        /// frame being streamed, used by the receiver thread only
+        struct {
+                bool seen = false; ///< rtp_ts is valid
+                uint32_t rtp_ts = 0; ///< last frame considered for streaming
+                frame_msg *msg = nullptr; ///< owned by the pipeline, valid while stream is set
+                shared_ptr<frame_stream> stream;
+                map<int, int> pckt_list;
+                unsigned int prefix = 0; ///< contiguous received length
+        } rx_stream;
         bool buffer_swapped = true; /**< variable indicating that display buffer
                               * has been processed and we can write to a new one */
         condition_variable buffer_swapped_cv; ///< condition variable associated with @ref buffer_swapped
@@ -375,19 +502,36 @@ struct state_video_decoder
         bool          merged_fb = false; ///< flag if the display device driver requires tiled video or not
 
         timed_message<LOG_LEVEL_WARNING> slow_msg; ///< shows warning ony in certain interval
+        timed_message<LOG_LEVEL_WARNING> sync_playout_msg;
+        bool sync_playout_started = false; ///< sender clock of a frame was known
 
         synchronized_queue<main_msg_reconfigure *, -1> msg_queue;
 
         const struct openssl_decrypt_info *dec_funcs = NULL; ///< decrypt state
         struct openssl_decrypt      *decrypt = NULL; ///< decrypt state
+        int decrypt_threads = 1; ///< workers decrypting packets of a frame, 1 - inline
+        vector<struct openssl_decrypt_pkt> decrypt_pkts; ///< decrypt_frame() result per packet
+        vector<char> decrypt_buf; ///< plaintext of the whole frame
 
 #ifdef RECONFIGURE_IN_FUTURE_THREAD
         std::future<bool> reconfiguration_future;
         bool             reconfiguration_in_progress = false;
 #endif
         struct reported_statistics_cumul stats = {}; ///< stats to be reported through control socket
+        atomic<bool> keyframe_needed{false}; ///< see video_decoder_keyframe_needed()
 };
 
+/**
+ * Records a lost or corrupted frame - with an inter-frame compression, the
+ * following frames cannot be decoded correctly until the next keyframe.
+ */
+static void keyframe_loss(struct state_video_decoder *decoder)
+{
+        if (is_codec_interframe(decoder->received_vid_desc.color_spec)) {
+                decoder->keyframe_needed = true;
+        }
+}
+
 /**
  * This function blocks until video frame is displayed and decoder::frame
  * can be filled with new data. Until this point, the video frame is not considered
@@ -398,18 +542,423 @@ static void wait_for_framebuffer_swap(struct state_video_decoder *decoder) {
         decoder->buffer_swapped_cv.wait(lk, [decoder]{return decoder->buffer_swapped;});
 }
 
+/// gives up the frame being streamed (if any), the decompress thread drops it
+static void stream_abort(struct state_video_decoder *decoder)
+{
+        auto &rx = decoder->rx_stream;
+        if (!rx.stream) {
+                return;
+        }
+        {
+                lock_guard<mutex> lk(rx.stream->lock);
+                rx.stream->aborted = true;
+        }
+        rx.stream->cv.notify_one();
+        rx.stream.reset();
+        rx.msg = nullptr;
+        rx.pckt_list.clear();
+        rx.prefix = 0;
+}
+
 #define ENCRYPTED_ERR "Receiving encrypted video data but " \
         "no decryption key entered!\n"
 #define NOT_ENCRYPTED_ERR "Receiving unencrypted video data " \
         "while expecting encrypted.\n"
 
+namespace {
+struct fec_tile_result {
+        bool ret;
+        char *out;
+        int out_len;
+};
+
+/**
+ * Pool of FEC states for concurrent decoding of multiple frames. A state is
+ * exclusively held by a frame until the frame leaves the FEC stage, so the
+ * pool size bounds the number of frames in flight.
+ */
+class fec_state_pool {
+public:
+        explicit fec_state_pool(int size) : m_free(size) {}
+        ~fec_state_pool() {
+                for (auto &i : m_free) {
+                        delete i.first;
+                }
+        }
+        /// @returns FEC state for desc (blocks if none available), NULL on error
+        fec *acquire(struct fec_desc const &desc) {
+                unique_lock<mutex> lk(m_lock);
+                m_cv.wait(lk, [this]{ return !m_free.empty(); });
+                auto item = m_free.back();
+                m_free.pop_back();
+                lk.unlock();
+                if (item.first == nullptr || !fec_desc_eq(item.second, desc)) {
+                        delete item.first;
+                        item.first = fec::create_from_desc(desc);
+                }
+                return item.first;
+        }
+        /// @param desc  desc passed to acquire()
+        void release(fec *state, struct fec_desc const &desc) {
+                lock_guard<mutex> lk(m_lock);
+                m_free.emplace_back(state, desc);
+                m_cv.notify_one();
+        }
+        static bool fec_desc_eq(struct fec_desc const &a, struct fec_desc const &b) {
+                return a.type == b.type && a.k == b.k && a.m == b.m && a.c == b.c && a.seed == b.seed;
+        }
+private:
+        vector<pair<fec *, struct fec_desc>> m_free;
+        mutex m_lock;
+        condition_variable m_cv;
+};
+
+struct fec_job {
+        unique_ptr<frame_msg> data;
+        fec *fec_state = nullptr;
+        int tile_count = 0;
+        vector<fec_tile_result> results;
+        task_result_handle_t handle = nullptr;
+};
+} // end of anonymous namespace
+
+static void fec_decode_tiles(fec *fec_state, frame_msg *data, int tile_count, vector<fec_tile_result> &results)
+{
+        PROFILE_FUNC;
+        results.resize(tile_count);
+        for (int pos = 0; pos < tile_count; ++pos) {
+                if (data->recv_frame->tiles[pos].data_len != (unsigned int) sum_map(data->pckt_list[pos])) {
+                        debug_msg("Frame incomplete - substream %d, buffer %d: expected %u bytes, got %u.\n", pos,
+                                        (unsigned int) data->buffer_num[pos],
+                                        data->recv_frame->tiles[pos].data_len,
+                                        (unsigned int) sum_map(data->pckt_list[pos]));
+                }
+
+                results[pos].out = NULL;
+                results[pos].out_len = 0;
+                results[pos].ret = fec_state->decode(data->recv_frame->tiles[pos].data,
+                                data->recv_frame->tiles[pos].data_len,
+                                &results[pos].out, &results[pos].out_len, data->pckt_list[pos]);
+        }
+}
+
+static void *fec_job_run(void *arg)
+{
+        auto *job = static_cast<fec_job *>(arg);
+        fec_decode_tiles(job->fec_state, job->data.get(), job->tile_count, job->results);
+        return job;
+}
+
+/**
+ * Passes the FEC-decoded tiles (protected video header followed by the data)
+ * to the decompress stage (data->nofec_frame) or decodes them to the framebuffer.
+ *
+ * @retval false if the frame is to be dropped or was passed to reconfiguration
+ */
+static bool fec_finish_tiles(struct state_video_decoder *decoder, unique_ptr<frame_msg> &data,
+                vector<fec_tile_result> const &results)
+{
+        struct video_frame *frame = decoder->frame;
+        struct tile *tile = NULL;
+
+        bool buffer_swapped = false;
+        for (int pos = 0; pos < get_video_mode_tiles_x(decoder->video_mode)
+                        * get_video_mode_tiles_y(decoder->video_mode); ++pos) {
+                char *fec_out_buffer = results.at(pos).out;
+                int fec_out_len = results.at(pos).out_len;
+
+                if (results.at(pos).ret == false) {
+                        data->is_corrupted = true;
+                        keyframe_loss(decoder);
+                        verbose_msg("[decoder] FEC: unable to reconstruct data.\n");
+                        if (fec_out_len < (int) sizeof(video_payload_hdr_t)) {
+                                return false;
+                        }
+                        if (decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame) {
+                                return false;
+                        }
+                }
+
+                video_payload_hdr_t video_hdr;
+                memcpy(&video_hdr, fec_out_buffer,
+                                sizeof(video_payload_hdr_t));
+                fec_out_buffer += sizeof(video_payload_hdr_t);
+                fec_out_len -= sizeof(video_payload_hdr_t);
+
+                struct video_desc network_desc;
+                parse_video_hdr(video_hdr, &network_desc);
+                if (!video_desc_eq_excl_param(decoder->received_vid_desc,
+                                        network_desc, PARAM_TILE_COUNT)) {
+                        decoder->msg_queue.push(new main_msg_reconfigure(network_desc, std::move(data)));
+                        return false;
+                }
+
+                if (FRAMEBUFFER_NOT_READY(decoder)) {
+                        return false;
+                }
+
+                if(decoder->decoder_type == EXTERNAL_DECODER) {
+                        data->nofec_frame->tiles[pos].data_len = fec_out_len;
+                        data->nofec_frame->tiles[pos].data = fec_out_buffer;
+                } else { // linedecoder
+                        if (!buffer_swapped) {
+                                buffer_swapped = true;
+                                wait_for_framebuffer_swap(decoder);
+                                unique_lock<mutex> lk(decoder->lock);
+                                decoder->buffer_swapped = false;
+                        }
+
+                        int divisor;
+
+                        if (!decoder->merged_fb) {
+                                divisor = decoder->max_substreams;
+                        } else {
+                                divisor = 1;
+                        }
+
+                        tile = vf_get_tile(frame, pos % divisor);
+
+                        struct line_decoder *line_decoder =
+                                &decoder->line_decoder[pos];
+
+                        int data_pos = 0;
+                        int line = 0;
+                        char *src = fec_out_buffer;
+                        char *dst = tile->data + line_decoder->base_offset;
+                        int dst_linesize = vc_get_linesize(tile->width ,frame->color_spec);
+                        while(data_pos < (int) fec_out_len) {
+                                line_decoder->decode_line((unsigned char*)dst + line_decoder_dst_line(line_decoder, line) * dst_linesize,
+                                                (unsigned char *) src, line_decoder->dst_linesize,
+                                                line_decoder->shifts[0],
+                                                line_decoder->shifts[1],
+                                                line_decoder->shifts[2]);
+                                src += line_decoder->src_linesize;
+                                line += 1;
+                                data_pos += line_decoder->src_linesize;
+                        }
+                }
+        }
+        return true;
+}
+
+/// @returns frame count of a block protecting several frames (see fec_group.h), 0 for a single frame
+static unsigned fec_results_frame_group(vector<fec_tile_result> const &results)
+{
+        if (results.empty() || results[0].out_len < (int) sizeof(video_payload_hdr_t)) {
+                return 0;
+        }
+        video_payload_hdr_t hdr;
+        memcpy(&hdr, results[0].out, sizeof hdr);
+        return fec_frame_group_count(hdr);
+}
+
+/**
+ * Splits a FEC block protecting several consecutive frames and finishes them
+ * in order. The first frame is passed immediately, the following ones in frame
+ * intervals to undo the aggregation on the sender, so the added latency stays
+ * (count - 1) frames.
+ */
+static void fec_finish_frame_group(struct state_video_decoder *decoder, unique_ptr<frame_msg> data,
+                vector<fec_tile_result> const &results, unsigned count)
+{
+        PROFILE_FUNC;
+        const int tile_count = results.size();
+        vector<vector<fec_tile_result>> frame_results(count, vector<fec_tile_result>(tile_count, { false, nullptr, 0 }));
+        for (int pos = 0; pos < tile_count; ++pos) {
+                if (results[pos].out_len < (int) sizeof(video_payload_hdr_t)) {
+                        continue;
+                }
+                auto records = fec_frame_group_split(results[pos].out + sizeof(video_payload_hdr_t),
+                                results[pos].out_len - sizeof(video_payload_hdr_t), count);
+                for (unsigned i = 0; i < count; ++i) {
+                        bool complete = false;
+                        if (records[i].second >= (int) sizeof(video_payload_hdr_t)) {
+                                video_payload_hdr_t hdr;
+                                memcpy(&hdr, records[i].first, sizeof hdr);
+                                complete = ntohl(hdr[2]) == records[i].second - sizeof hdr;
+                        }
+                        frame_results[i][pos] = { results[pos].ret && complete, records[i].first, records[i].second };
+                }
+        }
+
+        if (!fec_finish_tiles(decoder, data, frame_results[0])) {
+                return; // whole block is dropped or processed again after the reconfiguration
+        }
+
+        // the following frames get their own copy, the block buffer is released with the first one
+        vector<unique_ptr<frame_msg>> msgs(count);
+        for (unsigned i = 1; i < count; ++i) {
+                unique_ptr<frame_msg> msg(new frame_msg(data->control, data->stats));
+                msg->buffer_num = data->buffer_num;
+                msg->recv_frame = vf_alloc(data->recv_frame->tile_count);
+                msg->recv_frame->callbacks.data_deleter = vf_data_deleter;
+                msg->recv_frame->fec_params = fec_desc(FEC_NONE);
+                msg->recv_frame->ssrc = data->recv_frame->ssrc;
+                msg->pckt_list.reset(new map<int, int>[data->recv_frame->tile_count]);
+                for (int pos = 0; pos < tile_count; ++pos) {
+                        fec_tile_result &res = frame_results[i][pos];
+                        struct tile *tile = &msg->recv_frame->tiles[pos];
+                        tile->data = (char *) malloc(res.out_len + PADDING);
+                        if (res.out_len > 0) {
+                                memcpy(tile->data, res.out, res.out_len);
+                        }
+                        tile->data_len = res.out_len;
+                        msg->pckt_list[pos][0] = res.out_len;
+                        res.out = tile->data;
+                }
+                msg->nofec_frame = vf_alloc(data->recv_frame->tile_count);
+                msg->nofec_frame->ssrc = data->recv_frame->ssrc;
+                msg->sender_time = data->sender_time;
+                msg->traced = data->traced;
+                msg->trace = data->trace;
+                msgs[i] = std::move(msg);
+        }
+        msgs[0] = std::move(data);
+
+        auto release = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < count; ++i) {
+                if (i > 0 && decoder->received_vid_desc.fps > 0.0) {
+                        release += duration_cast<std::chrono::steady_clock::duration>(
+                                        std::chrono::duration<double>(1.0 / decoder->received_vid_desc.fps));
+                        this_thread::sleep_until(release);
+                }
+                if (i > 0 && !fec_finish_tiles(decoder, msgs[i], frame_results[i])) {
+                        return; // the rest (if not reconfiguring) would be dropped as well
+                }
+                if (msgs[i]->traced) {
+                        msgs[i]->trace.t[FT_FEC] = get_time_in_ns();
+                }
+                decoder->decompress_queue.push(std::move(msgs[i]));
+        }
+}
+
+/**
+ * Processes FEC-decoded (or non-FEC) frame and passes it to the decompress
+ * stage. Must be called in frame order.
+ *
+ * @param results decoded tiles if the frame has FEC
+ */
+static void fec_finish_frame(struct state_video_decoder *decoder, unique_ptr<frame_msg> data,
+                vector<fec_tile_result> const &results)
+{
+        PROFILE_FUNC;
+        data->nofec_frame = vf_alloc(data->recv_frame->tile_count);
+        data->nofec_frame->ssrc = data->recv_frame->ssrc;
+
+        if (data->stream) { // no FEC, the data are being received - completed by stream_finish()
+                data->nofec_frame->tiles[0].data_len = data->recv_frame->tiles[0].data_len;
+                data->nofec_frame->tiles[0].data = data->recv_frame->tiles[0].data;
+                decoder->decompress_queue.push(std::move(data));
+                return;
+        }
+
+        if (data->recv_frame->fec_params.type != FEC_NONE) {
+                unsigned group = fec_results_frame_group(results);
+                if (group > 0) {
+                        fec_finish_frame_group(decoder, std::move(data), results, group);
+                        return;
+                }
+                if (!fec_finish_tiles(decoder, data, results)) {
+                        return;
+                }
+        } else { /* PT_VIDEO */
+                for(int i = 0; i < (int) decoder->max_substreams; ++i) {
+                        data->nofec_frame->tiles[i].data_len = data->recv_frame->tiles[i].data_len;
+                        data->nofec_frame->tiles[i].data = data->recv_frame->tiles[i].data;
+
+                        if (data->recv_frame->tiles[i].data_len != (unsigned int) sum_map(data->pckt_list[i])) {
+                                debug_msg("Frame incomplete - substream %d, buffer %d: expected %u bytes, got %u.%s\n", i,
+                                                (unsigned int) data->buffer_num[i],
+                                                data->recv_frame->tiles[i].data_len,
+                                                (unsigned int) sum_map(data->pckt_list[i]),
+                                                decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame ? " dropped.\n" : "");
+                                data->is_corrupted = true;
+                                keyframe_loss(decoder);
+                                if(decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame) {
+                                        return;
+                                }
+                        }
+                }
+        }
+
+        if (data->traced) {
+                data->trace.t[FT_FEC] = get_time_in_ns();
+        }
+        decoder->decompress_queue.push(std::move(data));
+}
+
+/**
+ * Collects frames dispatched by fec_thread() in parallel mode and finishes
+ * them in the order of arrival.
+ */
+static void fec_collect_thread(struct state_video_decoder *decoder, synchronized_queue<unique_ptr<fec_job>, -1> *jobs,
+                fec_state_pool *pool)
+{
+        set_thread_name(__func__);
+        while (1) {
+                unique_ptr<fec_job> job = jobs->pop();
+                if (job->handle != nullptr) {
+                        wait_task(job->handle);
+                }
+                if (!job->data->recv_frame) { // poisoned
+                        decoder->decompress_queue.push(std::move(job->data));
+                        break;
+                }
+                struct fec_desc fec_params = job->data->recv_frame->fec_params;
+                fec_finish_frame(decoder, std::move(job->data), job->results);
+                if (job->fec_state != nullptr) {
+                        pool->release(job->fec_state, fec_params);
+                }
+        }
+}
+
+ADD_TO_PARAM("decoder-fec-threads",
+                "* decoder-fec-threads=<n>\n"
+                "  Number of video frames FEC-decoded concurrently (default 1).\n");
 static void *fec_thread(void *args) {
         set_thread_name(__func__);
         struct state_video_decoder *decoder =
                 (struct state_video_decoder *) args;
+        module_set_mem_owner(&decoder->mod);
+
+        int fec_threads = 1;
+        if (get_commandline_param("decoder-fec-threads") != nullptr) {
+                fec_threads = MAX(atoi(get_commandline_param("decoder-fec-threads")), 1);
+        }
+
+        if (fec_threads > 1) { // dispatch FEC decoding to workers, fec_collect_thread() keeps the order
+                fec_state_pool pool(fec_threads);
+                synchronized_queue<unique_ptr<fec_job>, -1> jobs;
+                thread collector(fec_collect_thread, decoder, &jobs, &pool);
+                while (1) {
+                        unique_ptr<fec_job> job(new fec_job);
+                        job->data = decoder->fec_queue.pop();
+                        bool poisoned = !job->data->recv_frame;
+                        if (!poisoned && job->data->recv_frame->fec_params.type != FEC_NONE) {
+                                job->fec_state = pool.acquire(job->data->recv_frame->fec_params);
+                                if (job->fec_state == nullptr) {
+                                        log_msg(LOG_LEVEL_FATAL, "[decoder] Unable to initialize FEC.\n");
+                                        exit_uv(1);
+                                        pool.release(nullptr, FEC_NONE);
+                                        continue;
+                                }
+                                job->tile_count = get_video_mode_tiles_x(decoder->video_mode)
+                                        * get_video_mode_tiles_y(decoder->video_mode);
+                                job->handle = task_run_async(fec_job_run, job.get());
+                        }
+                        jobs.push(std::move(job));
+                        if (poisoned) {
+                                break;
+                        }
+                }
+                collector.join();
+                module_set_mem_owner(NULL);
+                return NULL;
+        }
 
         fec *fec_state = NULL;
         struct fec_desc desc(FEC_NONE);
+        vector<fec_tile_result> results;
 
         while(1) {
                 unique_ptr<frame_msg> data = decoder->fec_queue.pop();
@@ -419,9 +968,6 @@ static void *fec_thread(void *args) {
                         break; // exit from loop
                 }
 
-                struct video_frame *frame = decoder->frame;
-                struct tile *tile = NULL;
-
                 if (data->recv_frame->fec_params.type != FEC_NONE) {
                         if(!fec_state || desc.k != data->recv_frame->fec_params.k ||
                                         desc.m != data->recv_frame->fec_params.m ||
@@ -434,125 +980,19 @@ static void *fec_thread(void *args) {
                                 if(fec_state == NULL) {
                                         log_msg(LOG_LEVEL_FATAL, "[decoder] Unable to initialize FEC.\n");
                                         exit_uv(1);
-                                        goto cleanup;
-                                }
-                        }
-                }
-
-                data->nofec_frame = vf_alloc(data->recv_frame->tile_count);
-                data->nofec_frame->ssrc = data->recv_frame->ssrc;
-
-                if (data->recv_frame->fec_params.type != FEC_NONE) {
-                        bool buffer_swapped = false;
-                        for (int pos = 0; pos < get_video_mode_tiles_x(decoder->video_mode)
-                                        * get_video_mode_tiles_y(decoder->video_mode); ++pos) {
-                                char *fec_out_buffer = NULL;
-                                int fec_out_len = 0;
-
-                                if (data->recv_frame->tiles[pos].data_len != (unsigned int) sum_map(data->pckt_list[pos])) {
-                                        debug_msg("Frame incomplete - substream %d, buffer %d: expected %u bytes, got %u.\n", pos,
-                                                        (unsigned int) data->buffer_num[pos],
-                                                        data->recv_frame->tiles[pos].data_len,
-                                                        (unsigned int) sum_map(data->pckt_list[pos]));
-                                }
-
-                                bool ret = fec_state->decode(data->recv_frame->tiles[pos].data,
-                                                data->recv_frame->tiles[pos].data_len,
-                                                &fec_out_buffer, &fec_out_len, data->pckt_list[pos]);
-
-                                if (ret == false) {
-                                        data->is_corrupted = true;
-                                        verbose_msg("[decoder] FEC: unable to reconstruct data.\n");
-                                        if (fec_out_len < (int) sizeof(video_payload_hdr_t)) {
-                                                goto cleanup;
-                                        }
-                                        if (decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame) {
-                                                goto cleanup;
-                                        }
-                                }
-
-                                video_payload_hdr_t video_hdr;
-                                memcpy(&video_hdr, fec_out_buffer,
-                                                sizeof(video_payload_hdr_t));
-                                fec_out_buffer += sizeof(video_payload_hdr_t);
-                                fec_out_len -= sizeof(video_payload_hdr_t);
-
-                                struct video_desc network_desc;
-                                parse_video_hdr(video_hdr, &network_desc);
-                                if (!video_desc_eq_excl_param(decoder->received_vid_desc,
-                                                        network_desc, PARAM_TILE_COUNT)) {
-                                        decoder->msg_queue.push(new main_msg_reconfigure(network_desc, std::move(data)));
-                                        goto cleanup;
-                                }
-
-                                if (FRAMEBUFFER_NOT_READY(decoder)) {
-                                        goto cleanup;
-                                }
-
-                                if(decoder->decoder_type == EXTERNAL_DECODER) {
-                                        data->nofec_frame->tiles[pos].data_len = fec_out_len;
-                                        data->nofec_frame->tiles[pos].data = fec_out_buffer;
-                                } else { // linedecoder
-                                        if (!buffer_swapped) {
-                                                buffer_swapped = true;
-                                                wait_for_framebuffer_swap(decoder);
-                                                unique_lock<mutex> lk(decoder->lock);
-                                                decoder->buffer_swapped = false;
-                                        }
-
-                                        int divisor;
-
-                                        if (!decoder->merged_fb) {
-                                                divisor = decoder->max_substreams;
-                                        } else {
-                                                divisor = 1;
-                                        }
-
-                                        tile = vf_get_tile(frame, pos % divisor);
-
-                                        struct line_decoder *line_decoder =
-                                                &decoder->line_decoder[pos];
-
-                                        int data_pos = 0;
-                                        char *src = fec_out_buffer;
-                                        char *dst = tile->data + line_decoder->base_offset;
-                                        while(data_pos < (int) fec_out_len) {
-                                                line_decoder->decode_line((unsigned char*)dst, (unsigned char *) src, line_decoder->dst_linesize,
-                                                                line_decoder->shifts[0],
-                                                                line_decoder->shifts[1],
-                                                                line_decoder->shifts[2]);
-                                                src += line_decoder->src_linesize;
-                                                dst += vc_get_linesize(tile->width ,frame->color_spec);
-                                                data_pos += line_decoder->src_linesize;
-                                        }
-                                }
-                        }
-                } else { /* PT_VIDEO */
-                        for(int i = 0; i < (int) decoder->max_substreams; ++i) {
-                                data->nofec_frame->tiles[i].data_len = data->recv_frame->tiles[i].data_len;
-                                data->nofec_frame->tiles[i].data = data->recv_frame->tiles[i].data;
-
-                                if (data->recv_frame->tiles[i].data_len != (unsigned int) sum_map(data->pckt_list[i])) {
-                                        debug_msg("Frame incomplete - substream %d, buffer %d: expected %u bytes, got %u.%s\n", i,
-                                                        (unsigned int) data->buffer_num[i],
-                                                        data->recv_frame->tiles[i].data_len,
-                                                        (unsigned int) sum_map(data->pckt_list[i]),
-                                                        decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame ? " dropped.\n" : "");
-                                        data->is_corrupted = true;
-                                        if(decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame) {
-                                                goto cleanup;
-                                        }
+                                        continue;
                                 }
                         }
+                        fec_decode_tiles(fec_state, data.get(), get_video_mode_tiles_x(decoder->video_mode)
+                                        * get_video_mode_tiles_y(decoder->video_mode), results);
                 }
 
-                decoder->decompress_queue.push(std::move(data));
-cleanup:
-                ;
+                fec_finish_frame(decoder, std::move(data), results);
         }
 
         delete fec_state;
 
+        module_set_mem_owner(NULL);
         return NULL;
 }
 
@@ -584,6 +1024,7 @@ static void *decompress_worker(void *data)
         auto d = (struct decompress_data *) data;
         struct state_video_decoder *decoder = d->decoder;
 
+        PROFILE_FUNC;
         if (!d->compressed->tiles[d->pos].data)
                 return NULL;
         d->ret = decompress_frame(decoder->decompress_state.at(d->pos),
@@ -596,6 +1037,80 @@ static void *decompress_worker(void *data)
         return d;
 }
 
+/**
+ * Passes the growing received part of a streamed frame to the decompressor
+ * until the frame is complete.
+ * @returns DECODER_GOT_FRAME if any call produced the frame, DECODER_NO_FRAME
+ *          if it didn't or the frame was aborted
+ */
+static decompress_status decompress_stream(struct state_video_decoder *decoder, frame_msg *msg, unsigned char *out)
+{
+        PROFILE_FUNC;
+        frame_stream &stream = *msg->stream;
+        auto *buffer = (unsigned char *) msg->nofec_frame->tiles[0].data;
+        unsigned int passed = 0;
+        decompress_status ret = DECODER_NO_FRAME;
+        bool last = false;
+        while (!last) {
+                unique_lock<mutex> lk(stream.lock);
+                stream.cv.wait(lk, [&] { return stream.aborted || stream.complete || stream.valid_len > passed; });
+                if (stream.aborted) {
+                        lk.unlock();
+                        if (passed > 0) { // let the decompressor finish the frame
+                                decompress_push(decoder->decompress_state.at(0), out, buffer, passed, true,
+                                                msg->buffer_num[0], &decoder->frame->callbacks);
+                        }
+                        return DECODER_NO_FRAME;
+                }
+                last = stream.complete;
+                passed = stream.valid_len;
+                lk.unlock();
+                decompress_status r = decompress_push(decoder->decompress_state.at(0), out, buffer, passed, last,
+                                msg->buffer_num[0], &decoder->frame->callbacks);
+                if (r != DECODER_NO_FRAME) {
+                        ret = r;
+                }
+        }
+        return ret;
+}
+
+ADD_TO_PARAM("sync-playout",
+                "* sync-playout=<delay>\n"
+                "  Pass each frame to the display <delay> (eg. \"100ms\") after its capture on the sender\n"
+                "  clock (mapped from RTP timestamps with RTCP SR). If clocks of the sender and receivers\n"
+                "  are synchronized (PTP/NTP), all receivers (eg. of a videowall) show the frame at once.\n");
+#define SYNC_PLAYOUT_MAX_WAIT NS_IN_SEC ///< longer waits are considered to be caused by unsynchronized clocks
+
+/**
+ * Waits until the playout time of the frame.
+ * @returns timeout for display_put_frame() - blocking if the frame is on
+ * time, putf_timeout otherwise
+ */
+static long long sync_playout_wait(struct state_video_decoder *decoder, time_ns_t playout_time, long long putf_timeout)
+{
+        time_ns_t now = get_time_in_ns();
+        time_ns_t wait = playout_time - now;
+        if (!decoder->sync_playout_started) {
+                LOG(LOG_LEVEL_INFO) << MOD_NAME "Synchronized playout started, frame waits " << wait / (double) NS_IN_MS << " ms.\n";
+                decoder->sync_playout_started = true;
+        }
+        if (wait > SYNC_PLAYOUT_MAX_WAIT) {
+                decoder->sync_playout_msg.print(MOD_NAME "Frame playout time is too far in future, are the clocks synchronized?\n");
+                return putf_timeout;
+        }
+        if (wait < -NS_IN_SEC / decoder->display_desc.fps) {
+                char msg[128];
+                snprintf(msg, sizeof msg, MOD_NAME "Frame is %.1f ms late for synchronized playout, consider increasing the delay.\n",
+                                -wait / (double) NS_IN_MS);
+                decoder->sync_playout_msg.print(msg);
+                return putf_timeout;
+        }
+        if (wait > 0) {
+                this_thread::sleep_for(chrono::nanoseconds(wait));
+        }
+        return PUTF_BLOCKING;
+}
+
 ADD_TO_PARAM("decoder-drop-policy",
                 "* decoder-drop-policy=blocking|nonblock|<sec>\n"
                 "  Force specified blocking policy (default nonblock).\n"
@@ -604,6 +1119,7 @@ static void *decompress_thread(void *args) {
         set_thread_name(__func__);
         struct state_video_decoder *decoder =
                 (struct state_video_decoder *) args;
+        module_set_mem_owner(&decoder->mod);
         int tile_width = decoder->received_vid_desc.width; // get_video_mode_tiles_x(decoder->video_mode);
         int tile_height = decoder->received_vid_desc.height; // get_video_mode_tiles_y(decoder->video_mode);
 
@@ -620,6 +1136,14 @@ static void *decompress_thread(void *args) {
                 }
                 return static_cast<long long>(unit_evaluate_dbl(drop_policy->second.c_str(), true) * NS_IN_SEC);
         }();
+        const long long sync_playout_delay = []() {
+                const char *delay = get_commandline_param("sync-playout");
+                return delay != nullptr ? static_cast<long long>(unit_evaluate_dbl(delay, true) * NS_IN_SEC) : -1LL;
+        }();
+
+        // scratch output buffer (if out_codec == VIDEO_CODEC_END), reused for
+        // all frames - the thread is restarted on reconfiguration
+        unique_ptr<char, void (*)(void *)> tmp(nullptr, [](void *ptr) { aligned_free(ptr); });
 
         while(1) {
                 unique_ptr<frame_msg> msg = decoder->decompress_queue.pop();
@@ -627,12 +1151,17 @@ static void *decompress_thread(void *args) {
                 if(!msg->recv_frame) { // poisoned
                         break;
                 }
+                PROFILE_SCOPE("decompress_thread frame");
 
                 auto t0 = std::chrono::high_resolution_clock::now();
-                unique_ptr<char[]> tmp;
 
-                if (decoder->out_codec == VIDEO_CODEC_END) {
-                        tmp = unique_ptr<char[]>(new char[tile_height * (tile_width * MAX_BPS + MAX_PADDING)]);
+                if (decoder->out_codec == VIDEO_CODEC_END && !tmp) {
+                        size_t len = (size_t) tile_height * (tile_width * MAX_BPS + MAX_PADDING);
+                        tmp.reset((char *) aligned_malloc(len, 1U<<21U /* 2 MiB */));
+                        assert(tmp);
+#ifdef __linux__
+                        madvise(tmp.get(), len, MADV_HUGEPAGE);
+#endif
                 }
 
                 if(decoder->decoder_type == EXTERNAL_DECODER) {
@@ -645,7 +1174,7 @@ static void *decompress_thread(void *args) {
                                 data[pos].pos = pos;
                                 data[pos].compressed = msg->nofec_frame;
                                 data[pos].buffer_num = msg->buffer_num[pos];
-                                if (tmp.get()) {
+                                if (decoder->out_codec == VIDEO_CODEC_END) {
                                         data[pos].out = (unsigned char *) tmp.get();
                                 } else if (decoder->merged_fb) {
                                         // TODO: OK when rendering directly to display FB, otherwise, do not reflect pitch (we use PP)
@@ -656,7 +1185,9 @@ static void *decompress_thread(void *args) {
                                 } else {
                                         data[pos].out = (unsigned char *) vf_get_tile(decoder->frame, pos)->data;
                                 }
-                                if (tile_count > 1) {
+                                if (msg->stream) {
+                                        data[pos].ret = decompress_stream(decoder, msg.get(), data[pos].out);
+                                } else if (tile_count > 1) {
                                         handle[pos] = task_run_async(decompress_worker, &data[pos]);
                                 } else {
                                         decompress_worker(&data[pos]);
@@ -689,6 +1220,9 @@ static void *decompress_thread(void *args) {
                         }
                 }
 
+                if (msg->traced) {
+                        msg->trace.t[FT_DECOMPRESS] = get_time_in_ns();
+                }
                 LOG(LOG_LEVEL_DEBUG) << MOD_NAME << "Decompress duration: " <<
                         duration_cast<nanoseconds>(high_resolution_clock::now() - t0).count() / 1000000.0 << " ms\n";
 
@@ -703,10 +1237,20 @@ static void *decompress_thread(void *args) {
                 {
                         long long putf_timeout = force_putf_timeout != -1 ? force_putf_timeout : PUTF_NONBLOCK; // originally was BLOCKING when !is_codec_interframe(decoder->received_vid_desc.color_spec)
 
+                        if (sync_playout_delay >= 0 && msg->sender_time != 0) {
+                                putf_timeout = sync_playout_wait(decoder, msg->sender_time + sync_playout_delay, putf_timeout);
+                        }
                         decoder->frame->ssrc = msg->nofec_frame->ssrc;
                         int ret = display_put_frame(decoder->display,
                                         decoder->frame, putf_timeout);
                         msg->is_displayed = ret == 0;
+                        if (!msg->is_displayed && putf_timeout != PUTF_DISCARD) {
+                                PROFILER_TRIGGER("frame not displayed");
+                        }
+                        if (msg->traced && msg->is_displayed) {
+                                msg->trace.t[FT_PUTF] = get_time_in_ns();
+                                frame_trace_receiver_done(&msg->trace);
+                        }
                         decoder->frame = display_get_frame(decoder->display);
                 }
 
@@ -721,6 +1265,7 @@ skip_frame:
                 }
         }
 
+        module_set_mem_owner(NULL);
         return NULL;
 }
 
@@ -731,6 +1276,10 @@ static void decoder_set_video_mode(struct state_video_decoder *decoder, enum vid
                         * get_video_mode_tiles_y(decoder->video_mode);
 }
 
+ADD_TO_PARAM("decoder-pipeline-depth",
+                "* decoder-pipeline-depth=<n>\n"
+                "  Number of frames queued between receive, FEC and decompress stages (default 1).\n"
+                "  Higher values absorb a stage jitter, a display frame is still filled one at a time.\n");
 /**
  * @brief Initializes video decompress state.
  * @param video_mode  video_mode expected to be received from network
@@ -763,9 +1312,22 @@ struct state_video_decoder *video_decoder_init(struct module *parent,
                         delete s;
                         return NULL;
                 }
+                if (const char *threads = get_commandline_param("decoder-decrypt-threads")) {
+                        s->decrypt_threads = MAX(atoi(threads), 1);
+                }
+        }
+
+        if (const char *depth = get_commandline_param("decoder-pipeline-depth")) {
+                s->fec_queue.set_max_len(MAX(atoi(depth), 1));
+                s->decompress_queue.set_max_len(MAX(atoi(depth), 1));
         }
+        s->fec_queue.set_name("decoder_fec");
+        s->decompress_queue.set_name("decoder_decompress");
 
         decoder_set_video_mode(s, video_mode);
+        if (frame_trace_enabled()) {
+                frame_trace_init(parent);
+        }
 
         if(!video_decoder_register_display(s, display)) {
                 delete s;
@@ -802,6 +1364,7 @@ static void video_decoder_stop_threads(struct state_video_decoder *decoder)
 {
         assert(decoder->display);
 
+        stream_abort(decoder);
         unique_ptr<frame_msg> msg(new frame_msg(decoder->control, decoder->stats));
         decoder->fec_queue.push(std::move(msg));
 
@@ -898,6 +1461,17 @@ bool video_decoder_register_display(struct state_video_decoder *decoder, struct
         return true;
 }
 
+/**
+ * Checks (and clears) the need of a keyframe - whether a frame of an
+ * inter-frame compressed stream was lost or corrupted since the last call.
+ * The receiver may then ask the sender for a keyframe (PLI) instead of
+ * waiting for the next periodic one.
+ */
+bool video_decoder_keyframe_needed(struct state_video_decoder *decoder)
+{
+        return decoder->keyframe_needed.exchange(false);
+}
+
 /**
  * @brief This removes display from current decoder.
  *
@@ -922,6 +1496,7 @@ void video_decoder_remove_display(struct state_video_decoder *decoder)
 static void cleanup(struct state_video_decoder *decoder)
 {
         decoder->decoder_type = UNSET;
+        decoder->streaming = false;
         for (auto &d : decoder->decompress_state) {
                 decompress_done(d);
         }
@@ -1127,16 +1702,18 @@ after_decoder_lookup:
  * @return                 selected interlacing changing function, NULL if not needed or not found
  */
 static change_il_t select_il_func(enum interlacing_t in_il, enum interlacing_t *supported,
-                int il_out_cnt, /*out*/ enum interlacing_t *out_il)
+                int il_out_cnt, /*out*/ enum interlacing_t *out_il, /*out*/ il_line_map_t *line_map)
 {
-        struct transcode_t { enum interlacing_t in; enum interlacing_t out; change_il_t func; };
+        struct transcode_t { enum interlacing_t in; enum interlacing_t out; change_il_t func; il_line_map_t line_map; };
 
         struct transcode_t transcode[] = {
-                {LOWER_FIELD_FIRST, INTERLACED_MERGED, il_lower_to_merged},
-                {UPPER_FIELD_FIRST, INTERLACED_MERGED, il_upper_to_merged},
-                {INTERLACED_MERGED, UPPER_FIELD_FIRST, il_merged_to_upper}
+                {LOWER_FIELD_FIRST, INTERLACED_MERGED, il_lower_to_merged, NULL}, // needs field from previous frame
+                {UPPER_FIELD_FIRST, INTERLACED_MERGED, il_upper_to_merged, il_upper_to_merged_line},
+                {INTERLACED_MERGED, UPPER_FIELD_FIRST, il_merged_to_upper, il_merged_to_upper_line}
         };
 
+        *line_map = NULL;
+
         int i;
         /* first try to check if it can be nativelly displayed */
         for (i = 0; i < il_out_cnt; ++i) {
@@ -1151,6 +1728,7 @@ static change_il_t select_il_func(enum interlacing_t in_il, enum interlacing_t *
                 for (j = 0; j < sizeof(transcode) / sizeof(struct transcode_t); ++j) {
                         if(in_il == transcode[j].in && supported[i] == transcode[j].out) {
                                 *out_il = transcode[j].out;
+                                *line_map = transcode[j].line_map;
                                 return transcode[j].func;
                         }
                 }
@@ -1161,6 +1739,29 @@ static change_il_t select_il_func(enum interlacing_t in_il, enum interlacing_t *
         return NULL;
 }
 
+ADD_TO_PARAM("decoder-full-reconf",
+                "* decoder-full-reconf\n"
+                "  Re-create the decompressor on every video format change, not only if the codec changes.\n");
+/**
+ * Checks if the decompressors may be just reconfigured to the new format
+ * instead of being re-created, which is the case if the compression and the
+ * displayable codecs stay the same (eg. resolution or bitrate switch of
+ * the sender). Unknown internal property (no probe result) is considered
+ * to be unchanged.
+ */
+static bool can_reuse_decompress(struct state_video_decoder *decoder, struct video_desc desc,
+                struct pixfmt_desc comp_int_prop)
+{
+        const auto &cfg = decoder->decompress_cfg;
+        return decoder->decoder_type == EXTERNAL_DECODER
+                && cfg.compression == desc.color_spec
+                && cfg.out_codec != VIDEO_CODEC_END // probing only
+                && (comp_int_prop.depth == 0 || pixdesc_equals(cfg.internal_prop, comp_int_prop))
+                && cfg.native_codecs == decoder->native_codecs
+                && decoder->decompress_state.size() == (size_t) decoder->max_substreams
+                && get_commandline_param("decoder-full-reconf") == nullptr;
+}
+
 /**
  * Reconfigures decoder if network received video data format has changed.
  *
@@ -1177,6 +1778,7 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
         codec_t out_codec;
         decoder_t decode_line;
         enum interlacing_t display_il = PROGRESSIVE;
+        il_line_map_t il_line_map = NULL;
         //struct video_frame *frame;
         int display_requested_pitch = PITCH_DEFAULT;
         int display_requested_rgb_shift[] = DEFAULT_RGB_SHIFT_INIT;
@@ -1188,12 +1790,29 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
         decoder->frame = NULL;
         video_decoder_start_threads(decoder);
 
-        cleanup(decoder);
+        const bool reuse_decompress = can_reuse_decompress(decoder, desc, comp_int_prop);
+        auto decompress_cfg = std::move(decoder->decompress_cfg);
+        decoder->decompress_cfg = {}; // set back only if the reconfiguration succeeds
+        if (reuse_decompress) {
+                for (auto && item : decoder->change_il_state) {
+                        free(item);
+                }
+                decoder->change_il_state.resize(0);
+        } else {
+                cleanup(decoder);
+        }
 
         desc.tile_count = get_video_mode_tiles_x(decoder->video_mode)
                         * get_video_mode_tiles_y(decoder->video_mode);
 
-        out_codec = choose_codec_and_decoder(decoder, desc, &decode_line, comp_int_prop);
+        if (reuse_decompress) {
+                LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Reusing decompressor for the new format.\n";
+                out_codec = decompress_cfg.out_codec;
+                decode_line = nullptr;
+        } else {
+                out_codec = choose_codec_and_decoder(decoder, desc, &decode_line, comp_int_prop);
+                decompress_cfg = { desc.color_spec, comp_int_prop, out_codec, decoder->native_codecs };
+        }
         if (out_codec == VIDEO_CODEC_NONE) {
                 LOG(LOG_LEVEL_ERROR) << "Could not find neither line conversion nor decompress from " <<
                         get_codec_name(desc.color_spec) << " to display supported formats (" << codec_list_to_str(decoder->native_codecs) << ").\n";
@@ -1210,6 +1829,18 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
                 debug_msg("Failed to get video display mode.\n");
         }
 
+        enum mem_location_t mem_location = CPU_MEM;
+        len = sizeof mem_location;
+        if (!display_ctl_property(decoder->display, DISPLAY_PROPERTY_MEM_LOCATION,
+                        &mem_location, &len)) {
+                mem_location = CPU_MEM;
+        }
+        if (mem_location == CUDA_MEM && decoder->decoder_type != EXTERNAL_DECODER) {
+                LOG(LOG_LEVEL_ERROR) << "Display frames are in CUDA memory but " << get_codec_name(desc.color_spec)
+                        << " cannot be decompressed there!\n";
+                return false;
+        }
+
         if (display_mode == DISPLAY_PROPERTY_VIDEO_SEPARATE_3D) {
                 display_mode = display_desc.tile_count == 2 ? DISPLAY_PROPERTY_VIDEO_SEPARATE_TILES :
                         DISPLAY_PROPERTY_VIDEO_MERGED;
@@ -1222,7 +1853,7 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
         }
 
         decoder->change_il = select_il_func(desc.interlacing, decoder->disp_supported_il,
-                        decoder->disp_supported_il_cnt, &display_il);
+                        decoder->disp_supported_il_cnt, &display_il, &il_line_map);
         decoder->change_il_state.resize(decoder->max_substreams);
         if (out_codec != VIDEO_CODEC_END && !video_desc_eq(decoder->display_desc, display_desc)) {
                 display_desc.interlacing = display_il;
@@ -1331,6 +1962,26 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
                         }
                         decoder->merged_fb = false;
                 }
+                /* if the interlacing change only permutes lines, do it while
+                 * decoding instead of another pass over the whole frame (not
+                 * possible if the tiles are merged vertically - the change is
+                 * then applied to the merged frame) */
+                bool fuse_il = il_line_map != NULL && (display_mode == DISPLAY_PROPERTY_VIDEO_SEPARATE_TILES
+                                || src_y_tiles == 1);
+                for (int i = 0; i < src_x_tiles * src_y_tiles; ++i) {
+                        struct line_decoder *out = &decoder->line_decoder[i];
+                        out->il_line_map = fuse_il ? il_line_map : NULL;
+                        out->height = desc.height;
+                        out->contiguous = out->decode_line == vc_memcpy
+                                && out->src_linesize == out->dst_linesize
+                                && out->dst_pitch == out->dst_linesize
+                                && out->il_line_map == NULL;
+                        // smallest len with len * conv_num / conv_den >= dst_linesize
+                        out->clip_src_len = (out->dst_linesize * out->conv_den + out->conv_num - 1) / out->conv_num;
+                }
+                if (fuse_il) {
+                        decoder->change_il = NULL;
+                }
         } else if (decoder->decoder_type == EXTERNAL_DECODER) {
                 int buf_size;
 
@@ -1344,6 +1995,21 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
                         if(!buf_size) {
                                 return false;
                         }
+                        if (mem_location == CUDA_MEM) {
+                                int cuda_output = 1;
+                                size_t size = sizeof cuda_output;
+                                if (!decompress_get_property(decoder->decompress_state.at(i),
+                                                        DECOMPRESS_PROPERTY_CUDA_OUTPUT,
+                                                        &cuda_output, &size) || !cuda_output) {
+                                        LOG(LOG_LEVEL_ERROR) << "Decompressor cannot write " << get_codec_name(out_codec)
+                                                << " to CUDA memory requested by the display!\n";
+                                        return false;
+                                }
+                        }
+                }
+                if (mem_location == CUDA_MEM && decoder->change_il != NULL) {
+                        LOG(LOG_LEVEL_WARNING) << "Interlacing change not supported for frames in CUDA memory!\n";
+                        decoder->change_il = NULL;
                 }
                 decoder->merged_fb = display_mode != DISPLAY_PROPERTY_VIDEO_SEPARATE_TILES;
                 int res = 0, ret;
@@ -1352,6 +2018,22 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
                                 DECOMPRESS_PROPERTY_ACCEPTS_CORRUPTED_FRAME,
                                 &res, &size);
                 decoder->accepts_corrupted_frame = ret && res;
+                decoder->streaming = false;
+                if (get_commandline_param("decoder-streaming") != nullptr) {
+                        int streaming = 1;
+                        size = sizeof streaming;
+                        decoder->streaming = decoder->decompress_state.size() == 1 && decoder->decrypt == nullptr
+                                && out_codec != VIDEO_CODEC_END
+                                && decompress_get_property(decoder->decompress_state.at(0),
+                                                DECOMPRESS_PROPERTY_STREAMING, &streaming, &size) && streaming;
+                        if (decoder->streaming) {
+                                LOG(LOG_LEVEL_INFO) << MOD_NAME "Decompressing frames while being received.\n";
+                        } else {
+                                LOG(LOG_LEVEL_WARNING) << MOD_NAME "Streaming decompression not supported for "
+                                        << get_codec_name(desc.color_spec) << " with current setup, decoding whole frames.\n";
+                        }
+                }
+                decoder->decompress_cfg = std::move(decompress_cfg);
         }
 
         // Pass metadata to receiver thread (it can tweak parameters)
@@ -1467,8 +2149,243 @@ static int check_for_mode_change(struct state_video_decoder *decoder,
  *                     decoding may fail in some subsequent (asynchronous) steps.
  * @retval FALSE       if decoding failed
  */
+ADD_TO_PARAM("decoder-decrypt-threads",
+                "* decoder-decrypt-threads=<n>\n"
+                "  Decrypt all packets of a received video frame with <n> workers prior to decoding (default 1 - per packet).\n");
+/**
+ * Decrypts all encrypted packets of the frame at once. Results are stored in
+ * decoder->decrypt_pkts in the list order (packets that cannot be decrypted
+ * have ciphertext set to NULL and are handled by decode_video_frame()).
+ */
+static void decrypt_frame(struct state_video_decoder *decoder, struct coded_data *cdata)
+{
+        size_t buf_len = 0;
+        for (struct coded_data *it = cdata; it != NULL; it = it->nxt) {
+                buf_len += it->data->data_len;
+        }
+        if (decoder->decrypt_buf.size() < buf_len) {
+                decoder->decrypt_buf.resize(buf_len);
+        }
+
+        decoder->decrypt_pkts.clear();
+        size_t offset = 0;
+        for (struct coded_data *it = cdata; it != NULL; it = it->nxt) {
+                rtp_packet *pckt = it->data;
+                struct openssl_decrypt_pkt pkt{};
+                if (PT_VIDEO_IS_ENCRYPTED(pckt->pt)) {
+                        size_t media_hdr_len = pckt->pt == PT_ENCRYPT_VIDEO ? sizeof(video_payload_hdr_t) : sizeof(fec_payload_hdr_t);
+                        size_t hdrs_len = media_hdr_len + sizeof(crypto_payload_hdr_t);
+                        uint32_t crypto_hdr = 0;
+                        if ((size_t) pckt->data_len >= hdrs_len) {
+                                crypto_hdr = ntohl(*(uint32_t *)(void *)(pckt->data + media_hdr_len));
+                        }
+                        auto mode = (enum openssl_mode) (crypto_hdr >> 24);
+                        if (mode != MODE_AES128_NONE && mode <= MODE_AES128_MAX) {
+                                pkt = { pckt->data + hdrs_len, (int) (pckt->data_len - hdrs_len),
+                                        pckt->data, (int) media_hdr_len,
+                                        decoder->decrypt_buf.data() + offset, mode, 0 };
+                        }
+                }
+                offset += pckt->data_len;
+                decoder->decrypt_pkts.push_back(pkt);
+        }
+
+        decoder->dec_funcs->decrypt_batch(decoder->decrypt, decoder->decrypt_pkts.data(),
+                        decoder->decrypt_pkts.size(), decoder->decrypt_threads);
+}
+
+/**
+ * Starts streaming of the frame the packet belongs to if it can be passed to
+ * the decompressor right away, ie. the format didn't change and the pipeline
+ * is idle. Otherwise, the frame is decoded as usual once received.
+ */
+static bool stream_start(struct state_video_decoder *decoder, rtp_packet *pckt)
+{
+        if (pckt->pt != PT_VIDEO || pckt->data_len < (int) sizeof(video_payload_hdr_t)) {
+                return false;
+        }
+        uint32_t *hdr = (uint32_t *)(void *) pckt->data;
+        struct video_desc network_desc;
+        if (ntohl(hdr[0]) >> 22 != 0 || !parse_video_hdr(hdr, &network_desc)
+                        || !video_desc_eq_excl_param(decoder->received_vid_desc, network_desc, PARAM_TILE_COUNT)) {
+                return false;
+        }
+        if (FRAMEBUFFER_NOT_READY(decoder) || decoder->msg_queue.size() > 0
+                        || decoder->fec_queue.size() > 0 || decoder->decompress_queue.size() > 0) {
+                return false;
+        }
+
+        uint32_t buffer_length = ntohl(hdr[2]);
+        auto *msg = new frame_msg(decoder->control, decoder->stats);
+        msg->recv_frame = vf_alloc(1);
+        msg->recv_frame->callbacks.data_deleter = vf_data_deleter;
+        msg->recv_frame->tiles[0].data = (char *) malloc(buffer_length + PADDING);
+        msg->recv_frame->tiles[0].data_len = buffer_length;
+        msg->recv_frame->fec_params = fec_desc(FEC_NONE);
+        msg->recv_frame->ssrc = pckt->ssrc;
+        msg->buffer_num = { ntohl(hdr[0]) & 0x3fffff };
+        msg->pckt_list.reset(new map<int, int>[1]);
+        msg->stream = make_shared<frame_stream>();
+
+        auto &rx = decoder->rx_stream;
+        rx.msg = msg;
+        rx.stream = msg->stream;
+        decoder->fec_queue.push(unique_ptr<frame_msg>(msg));
+        return true;
+}
+
+/**
+ * Copies the packets to the streamed frame and publishes the new contiguous
+ * prefix to the decompress thread.
+ * @returns false if a packet doesn't belong to the streamed frame
+ */
+static bool stream_add_packets(struct state_video_decoder *decoder, struct coded_data *cdata)
+{
+        auto &rx = decoder->rx_stream;
+        struct tile *tile = &rx.msg->recv_frame->tiles[0];
+        for ( ; cdata != NULL; cdata = cdata->nxt) {
+                rtp_packet *pckt = cdata->data;
+                uint32_t *hdr = (uint32_t *)(void *) pckt->data;
+                if (pckt->pt != PT_VIDEO || pckt->ts != rx.rtp_ts || pckt->data_len < (int) sizeof(video_payload_hdr_t)
+                                || ntohl(hdr[0]) >> 22 != 0 || ntohl(hdr[2]) != tile->data_len) {
+                        return false;
+                }
+                uint32_t data_pos = ntohl(hdr[1]);
+                unsigned int len = pckt->data_len - sizeof(video_payload_hdr_t);
+                if (data_pos + len > tile->data_len || rx.pckt_list.count(data_pos) > 0) {
+                        continue;
+                }
+                memcpy(tile->data + data_pos, (char *) hdr + sizeof(video_payload_hdr_t), len);
+                rx.pckt_list[data_pos] = len;
+        }
+
+        unsigned int prefix = rx.prefix;
+        map<int, int>::const_iterator it;
+        while ((it = rx.pckt_list.find(prefix)) != rx.pckt_list.end() && it->second > 0) {
+                prefix += it->second;
+        }
+        if (prefix > rx.prefix) {
+                rx.prefix = prefix;
+                {
+                        lock_guard<mutex> lk(rx.stream->lock);
+                        rx.stream->valid_len = prefix;
+                }
+                rx.stream->cv.notify_one();
+        }
+        return true;
+}
+
+/**
+ * Completes the streamed frame if cdata belongs to it - adds the remaining
+ * packets and passes the packet list and stats to the decompress thread.
+ * @returns true if the frame was handled, false if it is to be decoded as usual
+ */
+static bool stream_finish(struct vcodec_state *pbuf_data, struct coded_data *cdata, struct pbuf_stats *stats)
+{
+        struct state_video_decoder *decoder = pbuf_data->decoder;
+        auto &rx = decoder->rx_stream;
+        if (cdata == NULL || cdata->data->ts != rx.rtp_ts || !stream_add_packets(decoder, cdata)) {
+                stream_abort(decoder);
+                return false;
+        }
+        frame_msg *msg = rx.msg;
+        struct tile *tile = &msg->recv_frame->tiles[0];
+        const uint32_t buffer_num = msg->buffer_num[0];
+        pbuf_data->max_frame_size = max(pbuf_data->max_frame_size, tile->data_len);
+        pbuf_data->decoded++;
+        if (decoder->stats.update(buffer_num) > 0) {
+                keyframe_loss(decoder);
+        }
+
+        msg->is_corrupted = rx.prefix != tile->data_len;
+        if (msg->is_corrupted) {
+                keyframe_loss(decoder);
+        }
+        if (msg->is_corrupted && !decoder->accepts_corrupted_frame) {
+                debug_msg("Streamed frame incomplete - buffer %u: expected %u bytes, got %u. dropped.\n",
+                                (unsigned int) buffer_num, tile->data_len, (unsigned int) sum_map(rx.pckt_list));
+                *msg->pckt_list.get() = std::move(rx.pckt_list);
+                stream_abort(decoder);
+                return true;
+        }
+        unsigned int last_end = 0;
+        for (auto const &packet : rx.pckt_list) {
+                if (last_end < (unsigned int) packet.first) {
+                        memset(tile->data + last_end, 0, packet.first - last_end);
+                }
+                last_end = packet.first + packet.second;
+        }
+        if (last_end < tile->data_len) {
+                memset(tile->data + last_end, 0, tile->data_len - last_end);
+        }
+
+        *msg->pckt_list.get() = std::move(rx.pckt_list);
+        msg->received_pkts_cum = stats->received_pkts_cum;
+        msg->expected_pkts_cum = stats->expected_pkts_cum;
+        msg->sender_time = stats->sender_time;
+        if (frame_trace_enabled()) {
+                msg->traced = true;
+                msg->trace.ssrc = msg->recv_frame->ssrc;
+                msg->trace.rtp_ts = rx.rtp_ts;
+                msg->trace.t[FT_RX_FIRST] = stats->first_arrival;
+                msg->trace.t[FT_RX_LAST] = stats->last_arrival;
+                msg->trace.t[FT_FEC] = get_time_in_ns();
+        }
+        {
+                lock_guard<mutex> lk(rx.stream->lock);
+                rx.stream->valid_len = tile->data_len;
+                rx.stream->complete = true;
+        }
+        rx.stream->cv.notify_one();
+        rx.stream.reset();
+        rx.msg = nullptr;
+        rx.pckt_list.clear();
+        rx.prefix = 0;
+        return true;
+}
+
+ADD_TO_PARAM("decoder-streaming",
+                "* decoder-streaming\n"
+                "  Pass received parts of a frame to the decompressor before the whole frame arrives\n"
+                "  (lower latency, H.264 with libavcodec only, no FEC, encryption or tiles).\n");
+/**
+ * Passes packets of a frame being received to the decompressor if streaming
+ * is enabled (decoder-streaming), called by pbuf_decode_partial(). The frame
+ * is completed by decode_video_frame() called by pbuf_decode() afterwards.
+ *
+ * @retval TRUE  if the packets were passed
+ * @retval FALSE if the frame isn't streamed
+ */
+int decode_video_frame_partial(struct coded_data *cdata, void *decoder_data, struct pbuf_stats *stats)
+{
+        UNUSED(stats);
+        struct vcodec_state *pbuf_data = (struct vcodec_state *) decoder_data;
+        struct state_video_decoder *decoder = pbuf_data->decoder;
+        auto &rx = decoder->rx_stream;
+        if (!decoder->streaming || !decoder->display || cdata == NULL) {
+                return FALSE;
+        }
+        if (!rx.seen || cdata->data->ts != rx.rtp_ts) { // new frame
+                stream_abort(decoder);
+                rx.seen = true;
+                rx.rtp_ts = cdata->data->ts;
+                if (!stream_start(decoder, cdata->data)) {
+                        return FALSE;
+                }
+        }
+        if (!rx.stream) {
+                return FALSE;
+        }
+        if (!stream_add_packets(decoder, cdata)) {
+                stream_abort(decoder);
+                return FALSE;
+        }
+        return TRUE;
+}
+
 int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf_stats *stats)
 {
+        PROFILE_FUNC;
         struct vcodec_state *pbuf_data = (struct vcodec_state *) decoder_data;
         struct state_video_decoder *decoder = pbuf_data->decoder;
 
@@ -1477,6 +2394,7 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
         int prints=0;
         int max_substreams = decoder->max_substreams;
         uint32_t ssrc = 0U;
+        const uint32_t rtp_ts = cdata != NULL ? cdata->data->ts : 0U;
         unsigned int frame_size = 0;
 
         vector<uint32_t> buffer_num(max_substreams);
@@ -1499,6 +2417,11 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                 return FALSE;
         }
 
+        if (decoder->rx_stream.stream && stream_finish(pbuf_data, cdata, stats)) {
+                vf_free(frame);
+                return TRUE;
+        }
+
 #ifdef RECONFIGURE_IN_FUTURE_THREAD
         // check if we are not in the middle of reconfiguration
         if (decoder->reconfiguration_in_progress) {
@@ -1535,17 +2458,24 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                 delete msg_reconf;
         }
 
+        const bool batch_decrypt = decoder->decrypt != nullptr && decoder->decrypt_threads > 1;
+        if (batch_decrypt) {
+                decrypt_frame(decoder, cdata);
+        }
+        size_t pckt_idx = 0;
+
         while (cdata != NULL) {
                 uint32_t tmp;
                 uint32_t *hdr;
                 int len;
                 uint32_t offset;
-                unsigned char *source;
                 char *data;
                 uint32_t data_pos;
                 uint32_t substream;
                 pckt = cdata->data;
                 enum openssl_mode crypto_mode = MODE_AES128_NONE;
+                const struct openssl_decrypt_pkt *decrypted =
+                        batch_decrypt ? &decoder->decrypt_pkts.at(pckt_idx++) : nullptr;
 
                 pt = pckt->pt;
                 hdr = (uint32_t *)(void *) pckt->data;
@@ -1634,8 +2564,14 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                         goto cleanup;
                 }
 
-                char plaintext[len]; // will be actually shorter
-                if (PT_VIDEO_IS_ENCRYPTED(pt)) {
+                char plaintext[decrypted ? 1 : len]; // will be actually shorter
+                if (decrypted != nullptr) {
+                        if (decrypted->plaintext_len == 0) {
+                                goto next_packet;
+                        }
+                        data = decrypted->plaintext;
+                        len = decrypted->plaintext_len;
+                } else if (PT_VIDEO_IS_ENCRYPTED(pt)) {
                         int data_len;
 
                         if((data_len = decoder->dec_funcs->decrypt(decoder->decrypt,
@@ -1693,75 +2629,38 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
 
                         /* End of critical section */
 
-                        /* MAGIC, don't touch it, you definitely break it
-                         *  *source* is data from network, *destination* is frame buffer
-                         */
-
-                        /* compute Y pos in source frame and convert it to
-                         * byte offset in the destination frame
-                         */
-                        int y = (data_pos / line_decoder->src_linesize) * line_decoder->dst_pitch;
-
-                        /* compute X pos in source frame */
-                        int s_x = data_pos % line_decoder->src_linesize;
-
-                        /* convert X pos from source frame into the destination frame.
-                         * it is byte offset from the beginning of a line.
-                         */
-                        int d_x = s_x * line_decoder->conv_num / line_decoder->conv_den;
-
-                        /* pointer to data payload in packet */
-                        source = (unsigned char*)(data);
-
-                        /* copy whole packet that can span several lines.
-                         * we need to clip data (v210 case) or center data (RGBA, R10k cases)
-                         */
-                        while (len > 0) {
-                                /* len id payload length in source BPP
-                                 * decoder needs len in destination BPP, so convert it
-                                 */
-                                int l = len * line_decoder->conv_num / line_decoder->conv_den;
-
-                                /* do not copy multiple lines, we need to
-                                 * copy (& clip, center) line by line
-                                 */
-                                if (l + d_x > (int) line_decoder->dst_linesize) {
-                                        l = line_decoder->dst_linesize - d_x;
-                                }
-
-                                /* compute byte offset in destination frame */
-                                offset = y + d_x;
-
-                                /* watch the SEGV */
-                                if (l + line_decoder->base_offset + offset <= tile->data_len) {
-                                        /*decode frame:
-                                         * we have offset for destination
-                                         * we update source contiguously
-                                         * we pass {r,g,b}shifts */
-                                        line_decoder->decode_line((unsigned char*)tile->data + line_decoder->base_offset + offset, source, l,
-                                                        line_decoder->shifts[0], line_decoder->shifts[1],
-                                                        line_decoder->shifts[2]);
-                                        /* we decoded one line (or a part of one line) to the end of the line
-                                         * so decrease *source* len by 1 line (or that part of the line */
-                                        len -= line_decoder->src_linesize - s_x;
-                                        /* jump in source by the same amount */
-                                        source += line_decoder->src_linesize - s_x;
+                        if (line_decoder->contiguous) {
+                                /* packet maps to a contiguous framebuffer
+                                 * chunk - copy it at once instead of per line */
+                                offset = line_decoder->base_offset + data_pos;
+                                if (offset + len <= tile->data_len) {
+                                        memcpy(tile->data + offset, data, len);
                                 } else {
-                                        /* this should not ever happen as we call reconfigure before each packet
-                                         * iff reconfigure is needed. But if it still happens, something is terribly wrong
-                                         * say it loudly
-                                         */
                                         if((prints % 100) == 0) {
                                                 log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n"
                                                                 "Well this should not happened. Expect troubles pretty soon.\n");
                                         }
                                         prints++;
-                                        len = 0;
                                 }
-                                /* each new line continues from the beginning */
-                                d_x = 0;        /* next line from beginning */
-                                s_x = 0;
-                                y += line_decoder->dst_pitch;  /* next line */
+                                goto next_packet;
+                        }
+
+                        /* *source* is data from network, *destination* is frame buffer */
+                        bool fits = line_decoder->decode_line == vc_memcpy
+                                ? line_decoder_decode_packet<true>(line_decoder, tile, data_pos,
+                                                (unsigned char *) data, len)
+                                : line_decoder_decode_packet<false>(line_decoder, tile, data_pos,
+                                                (unsigned char *) data, len);
+                        if (!fits) {
+                                /* this should not ever happen as we call reconfigure before each packet
+                                 * iff reconfigure is needed. But if it still happens, something is terribly wrong
+                                 * say it loudly
+                                 */
+                                if((prints % 100) == 0) {
+                                        log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n"
+                                                        "Well this should not happened. Expect troubles pretty soon.\n");
+                                }
+                                prints++;
                         }
                 } else { /* PT_VIDEO_LDGM or external decoder */
                         if(!frame->tiles[substream].data) {
@@ -1831,6 +2730,14 @@ next_packet:
                 fec_msg->pckt_list = std::move(pckt_list);
                 fec_msg->received_pkts_cum = stats->received_pkts_cum;
                 fec_msg->expected_pkts_cum = stats->expected_pkts_cum;
+                fec_msg->sender_time = stats->sender_time;
+                if (frame_trace_enabled()) {
+                        fec_msg->traced = true;
+                        fec_msg->trace.ssrc = ssrc;
+                        fec_msg->trace.rtp_ts = rtp_ts;
+                        fec_msg->trace.t[FT_RX_FIRST] = stats->first_arrival;
+                        fec_msg->trace.t[FT_RX_LAST] = stats->last_arrival;
+                }
 
                 auto t0 = std::chrono::high_resolution_clock::now();
                 decoder->fec_queue.push(std::move(fec_msg));
@@ -1850,7 +2757,9 @@ cleanup:
         pbuf_data->max_frame_size = max(pbuf_data->max_frame_size, frame_size);
         pbuf_data->decoded++;
 
-        decoder->stats.update(buffer_number);
+        if (decoder->stats.update(buffer_number) > 0) {
+                keyframe_loss(decoder);
+        }
 
         return ret;
 }
@@ -67,12 +67,14 @@ extern "C" {
 #endif // __cplusplus
 
 int decode_video_frame(struct coded_data *received_data, void *decoder_data, struct pbuf_stats *stats);
+int decode_video_frame_partial(struct coded_data *received_data, void *decoder_data, struct pbuf_stats *stats);
 
 struct state_video_decoder *video_decoder_init(struct module *parent, enum video_mode,
                 struct display *display, const char *encryption);
 void video_decoder_destroy(struct state_video_decoder *decoder);
 bool video_decoder_register_display(struct state_video_decoder *decoder, struct display *display);
 void video_decoder_remove_display(struct state_video_decoder *decoder);
+bool video_decoder_keyframe_needed(struct state_video_decoder *decoder);
 bool parse_video_hdr(uint32_t *hdr, struct video_desc *desc);
 
 /** @} */ // end of video_rtp_decoder
@@ -65,7 +65,6 @@ BasicRTSPOnlySubsession::BasicRTSPOnlySubsession(UsageEnvironment& env,
 		int audio_bps, int rtp_port, int rtp_port_audio) :
 		ServerMediaSubsession(env), fSDPLines(NULL), fReuseFirstSource(
 				reuseFirstSource), fLastStreamToken(NULL) {
-	Vdestination = NULL;
 	Adestination = NULL;
 	gethostname(fCNAME, sizeof fCNAME);
 	this->fmod = mod;
@@ -82,14 +81,13 @@ BasicRTSPOnlySubsession::BasicRTSPOnlySubsession(UsageEnvironment& env,
 BasicRTSPOnlySubsession::~BasicRTSPOnlySubsession() {
 	delete[] fSDPLines;
 	delete Adestination;
-	delete Vdestination;
 }
 
 char const* BasicRTSPOnlySubsession::sdpLines() {
 	if (fSDPLines == NULL) {
 		setSDPLines();
 	}
-	if (Adestination != NULL || Vdestination != NULL)
+	if (Adestination != NULL) // audio is sent to a single client only
 		return NULL;
 	return fSDPLines;
 }
@@ -186,8 +184,8 @@ void BasicRTSPOnlySubsession::getStreamParameters(unsigned /* clientSessionId */
 		unsigned char /* rtpChannelId */, unsigned char /* rtcpChannelId */,
 		netAddressBits& destinationAddress, uint8_t& /*destinationTTL*/,
 		Boolean& /* isMulticast */, Port& serverRTPPort, Port& serverRTCPPort,
-		void*& /* streamToken */) {
-	if (Vdestination == NULL && (avType == video || avType == av)) {
+		void*& streamToken) {
+	if (avType == video || avType == av) {
 		Port rtp(rtp_port);
 		serverRTPPort = rtp;
 		Port rtcp(rtp_port + 1);
@@ -201,7 +199,8 @@ void BasicRTSPOnlySubsession::getStreamParameters(unsigned /* clientSessionId */
 		}
 		struct in_addr destinationAddr;
 		destinationAddr.s_addr = destinationAddress;
-		Vdestination = new Destinations(destinationAddr, clientRTPPort,
+		// every video client has its own destination, see startStream()
+		streamToken = new Destinations(destinationAddr, clientRTPPort,
 				clientRTCPPort);
 	}
 	if (Adestination == NULL && (avType == audio || avType == av)) {
@@ -223,16 +222,17 @@ void BasicRTSPOnlySubsession::getStreamParameters(unsigned /* clientSessionId */
 	}
 }
 
-void BasicRTSPOnlySubsession::startStream(unsigned /* clientSessionId */,
-		void* /* streamToken */, TaskFunc* /* rtcpRRHandler */,
+void BasicRTSPOnlySubsession::startStream(unsigned clientSessionId,
+		void* streamToken, TaskFunc* /* rtcpRRHandler */,
 		void* /* rtcpRRHandlerClientData */, unsigned short& /* rtpSeqNum */,
 		unsigned& /* rtpTimestamp */,
 		ServerRequestAlternativeByteHandler* /* serverRequestAlternativeByteHandler */,
 		void* /* serverRequestAlternativeByteHandlerClientData */) {
 	struct response *resp = NULL;
 
-	if (Vdestination != NULL) {
+	if (streamToken != NULL) {
 		if (avType == video || avType == av) {
+			Destinations *dst = (Destinations *) streamToken;
 			char pathV[1024];
 
 			memset(pathV, 0, sizeof(pathV));
@@ -240,23 +240,17 @@ void BasicRTSPOnlySubsession::startStream(unsigned /* clientSessionId */,
 					MODULE_CLASS_NONE };
 			append_message_path(pathV, sizeof(pathV), path_sender);
 
-			//CHANGE DST PORT
-			struct msg_sender *msgV1 = (struct msg_sender *) new_message(
+			//ADD CLIENT - the frames are packetized once for all clients
+			struct msg_sender *msgV = (struct msg_sender *) new_message(
 					sizeof(struct msg_sender));
-			msgV1->tx_port = ntohs(Vdestination->rtpPort.num());
-			msgV1->type = SENDER_MSG_CHANGE_PORT;
-			resp = send_message(fmod, pathV, (struct message *) msgV1);
-			free_response(resp);
-
-			//CHANGE DST ADDRESS
-			struct msg_sender *msgV2 = (struct msg_sender *) new_message(
-					sizeof(struct msg_sender));
-			strncpy(msgV2->receiver, inet_ntoa(Vdestination->addr),
-					sizeof(msgV2->receiver) - 1);
-			msgV2->type = SENDER_MSG_CHANGE_RECEIVER;
-
-			resp = send_message(fmod, pathV, (struct message *) msgV2);
+			msgV->type = SENDER_MSG_ADD_CLIENT;
+			msgV->client.id = clientSessionId;
+			msgV->client.port = ntohs(dst->rtpPort.num());
+			strncpy(msgV->client.addr, inet_ntoa(dst->addr),
+					sizeof(msgV->client.addr) - 1);
+			resp = send_message(fmod, pathV, (struct message *) msgV);
 			free_response(resp);
+			resp = NULL;
 		}
 	}
 
@@ -292,34 +286,27 @@ void BasicRTSPOnlySubsession::startStream(unsigned /* clientSessionId */,
 	}
 }
 
-void BasicRTSPOnlySubsession::deleteStream(unsigned /* clientSessionId */,
-		void*& /* streamToken */) {
-	if (Vdestination != NULL) {
+void BasicRTSPOnlySubsession::deleteStream(unsigned clientSessionId,
+		void*& streamToken) {
+	if (streamToken != NULL) {
 		if (avType == video || avType == av) {
 			char pathV[1024];
-			Vdestination = NULL;
 			memset(pathV, 0, sizeof(pathV));
 			enum module_class path_sender[] = { MODULE_CLASS_SENDER,
 					MODULE_CLASS_NONE };
 			append_message_path(pathV, sizeof(pathV), path_sender);
 
-			//CHANGE DST PORT
-			struct msg_sender *msgV1 = (struct msg_sender *) new_message(
+			//REMOVE CLIENT
+			struct msg_sender *msgV = (struct msg_sender *) new_message(
 					sizeof(struct msg_sender));
-			msgV1->tx_port = rtp_port;
-			msgV1->type = SENDER_MSG_CHANGE_PORT;
+			msgV->type = SENDER_MSG_REMOVE_CLIENT;
+			msgV->client.id = clientSessionId;
 			struct response *resp;
-			resp = send_message(fmod, pathV, (struct message *) msgV1);
-			free_response(resp);
-
-			//CHANGE DST ADDRESS
-			struct msg_sender *msgV2 = (struct msg_sender *) new_message(
-					sizeof(struct msg_sender));
-			strncpy(msgV2->receiver, "127.0.0.1", sizeof(msgV2->receiver) - 1);
-			msgV2->type = SENDER_MSG_CHANGE_RECEIVER;
-			resp = send_message(fmod, pathV, (struct message *) msgV2);
+			resp = send_message(fmod, pathV, (struct message *) msgV);
 			free_response(resp);
 		}
+		delete (Destinations *) streamToken;
+		streamToken = NULL;
 	}
 
 	if (Adestination != NULL) {
@@ -130,8 +130,7 @@ protected:
 protected:
 
     char* fSDPLines;
-    Destinations* Vdestination;
-    Destinations* Adestination;
+    Destinations* Adestination; ///< video destinations are per client (stream token)
 
 private:
 
@@ -106,36 +106,27 @@ static struct {
         uint32_t ts;
 } loss[MAX_HISTORY];
 
-#ifdef NDEF
-static double transfer_rate(double p)
+/*
+ * TCP throughput equation (RFC 5348, section 3.1) - returns the allowed
+ * transmit rate in bytes/s for the packet size s [B], round-trip time rtt
+ * [s] and loss event rate p. t_RTO is approximated as 4*RTT.
+ */
+double tfrc_equation_rate(unsigned s, double rtt, double p)
 {
-        double t, t1, t2, t3, t4, rtt, tRTO;
-        if (p == 0) {
+        double t1, t2, t3, t4, tRTO;
+        if (p <= 0 || rtt <= 0) {
                 return 0;
         }
 
-        /* convert RTT from usec to sec */
-        rtt = ((double)RTT) / 1000000.0;
         tRTO = 4 * rtt;
 
         t1 = rtt * sqrt(2 * p / 3);
         t2 = (1 + 32 * p * p);
         t3 = 3 * sqrt(3 * p / 8);
         t4 = t1 + tRTO * t3 * p * t2;
-        t = ((double)s) / t4;
-
-        return (t);
-}
-
-static void compute_transfer_rate(void)
-{
-        double t1;
-        time_ns_t now;
 
-        t1 = transfer_rate(p);
-        now = get_time_in_ns()
+        return s / t4;
 }
-#endif
 
 static int set_zero(int first, int last, uint16_t u)
 {
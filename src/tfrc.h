@@ -58,6 +58,7 @@ void         tfrc_recv_data      (struct tfrc *state, time_ns_t curr_time, uint1
 void         tfrc_recv_rtt       (struct tfrc *state, time_ns_t curr_time, uint32_t rtt);
 double       tfrc_feedback_txrate(struct tfrc *state, time_ns_t curr_time);
 int          tfrc_feedback_is_due(struct tfrc *state, time_ns_t curr_time);
+double       tfrc_equation_rate  (unsigned packet_size, double rtt, double p);
 
 #ifdef __cplusplus
 }
@@ -73,20 +73,31 @@
 #include "crypto/openssl_encrypt.h"
 #include "module.h"
 #include "rtp/fec.h"
+#include "rtp/net_udp.h" // udp_pacing
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
 #include "rtp/rtpenc_h264.h"
+#include "rtp/st2110.h"
 #include "tv.h"
 #include "transmit.h"
+#include "utils/frame_trace.h"
 #include "utils/jpeg_reader.h"
+#include "utils/metrics.h"
 #include "utils/misc.h" // unit_evaluate
+#include "utils/profile_timer.hpp"
+#include "utils/thread.h"
 #include "video.h"
 #include "video_codec.h"
 #include "compat/platform_time.h"
 
 #include <algorithm>
 #include <array>
+#include <cinttypes>
+#include <condition_variable>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #define MOD_NAME "[transmit] "
@@ -113,6 +124,7 @@
 #define DEFAULT_CIPHER_MODE MODE_AES128_GCM
 
 using std::array;
+using std::unique_ptr;
 using std::vector;
 
 static void tx_update(struct tx *tx, struct video_frame *frame, int substream);
@@ -120,10 +132,11 @@ static void tx_done(struct module *tx);
 static uint32_t format_interl_fps_hdr_row(enum interlacing_t interlacing, double input_fps);
 
 static void
-tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
+tx_send_base(struct tx *tx, struct tx_buffers *bufs, struct video_frame *frame, struct rtp *rtp_session,
                 uint32_t ts, int send_m,
                 unsigned int substream,
-                int fragment_offset);
+                int fragment_offset, bool parallel);
+static void tx_send_interleaved(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session, uint32_t ts, int send_m);
 
 
 static bool set_fec(struct tx *tx, const char *fec);
@@ -135,6 +148,24 @@ struct rate_limit_dyn {
         static constexpr int EXCESS_GAP = 4; ///< minimal gap between excessive frames
 };
 
+/// per-packet buffers of the frame being sent, grown on demand and reused across frames
+struct tx_buffers {
+        /// per-packet RTP headers of the frame being sent (must persist
+        /// until rtp_async_wait())
+        uint32_t *hdr_arena;
+        size_t hdr_arena_len;
+        rtp_hdr_slot *rtp_hdrs; ///< RTP headers written by rtp_send_data_hdr_batch(), same lifetime as hdr_arena
+        size_t rtp_hdrs_len;
+        struct rtp_batch_pkt *pkts; ///< layout of the video/audio frame being sent
+        size_t pkts_len;
+        struct openssl_encrypt_pkt *enc_pkts;
+        size_t enc_pkts_len;
+        char *enc_frame; ///< sealed packets of the frame being sent
+        size_t enc_frame_len;
+};
+
+struct tx_tile_senders;
+
 struct tx {
         struct module mod;
 
@@ -159,15 +190,138 @@ struct tx {
         struct control_state *control = nullptr;
         size_t sent_since_report = 0;
         uint64_t last_stat_report = 0;
+        uint32_t metrics_ssrc = 0; ///< SSRC the metrics below are labelled with
+        struct metric *metric_bytes = nullptr;
+        struct metric *metric_packets = nullptr;
 
         const struct openssl_encrypt_info *enc_funcs;
         struct openssl_encrypt *encryption;
         long long int bitrate;
         struct rate_limit_dyn dyn_rate_limit_state;
+        enum udp_pacing pacing; ///< kernel pacing, busy-wait shaper is used if UDP_PACING_NONE
+        long long drop_late_ns; ///< non-reference H.264/HEVC frames waiting longer are dropped, 0 - never (tx-drop-late)
+        unsigned long dropped_late; ///< frames dropped because of drop_late_ns
+        int hevc_max_tid; ///< highest HEVC TemporalId seen, see rtpenc_h264_get_frame_type()
+
+        struct tx_buffers bufs;
+        struct tx_tile_senders *tile_senders; ///< created by the first tx_send_tiles() call
+        int enc_threads; ///< workers encrypting packets of a video frame
+        bool interleave_tiles; ///< tx_send() merges packets of the tiles (tx-interleave-tiles)
 		
+        struct rtpenc_h264_pkt *h264_pkts; ///< packets of the H.264/HEVC access unit being sent
+        size_t h264_pkts_len; ///< in bytes
+        unsigned char *h264_scratch; ///< FU headers and aggregation packets of h264_pkts
+        size_t h264_scratch_len;
+        uint32_t h264_part_ts; ///< RTP timestamp of the access unit being sent in parts
+
+        struct st2110_pkt *st2110_pkts; ///< packets of the ST 2110-20 frame being sent
+        size_t st2110_pkts_len; ///< in bytes
+        unsigned char *st2110_pgroups; ///< frame converted to pgroups (if the format differs)
+        size_t st2110_pgroups_len;
+        uint32_t st2110_ext_seq; ///< extended sequence number of the last sent packet + 1
+        long long st2110_epoch; ///< frame period (since the Unix epoch) of the last sent frame
+        bool st2110_unpaced; ///< SO_TXTIME not available
+
         char tmp_packet[RTP_MAX_MTU];
 };
 
+/**
+ * Ensures that *buf holds at least needed bytes. The buffer only grows (with
+ * some headroom) so that the steady state doesn't allocate.
+ */
+static void *tx_reserve(void *buf, size_t *len, size_t needed)
+{
+        if (needed <= *len) {
+                return buf;
+        }
+        *len = needed + needed / 4;
+        free(buf);
+        buf = malloc(*len);
+        assert(buf != nullptr);
+        return buf;
+}
+
+static void tx_buffers_free(struct tx_buffers *bufs)
+{
+        free(bufs->hdr_arena);
+        free(bufs->rtp_hdrs);
+        free(bufs->pkts);
+        free(bufs->enc_pkts);
+        free(bufs->enc_frame);
+}
+
+/**
+ * Threads sending one tile (substream) each for tx_send_tiles(). Every
+ * thread has its own packet buffers, the tx state shared by the threads
+ * (stats, rate control) is guarded by lock.
+ */
+struct tx_tile_senders {
+        struct sender {
+                std::thread thread;
+                struct tx_buffers bufs{};
+        };
+
+        ~tx_tile_senders() {
+                {
+                        std::lock_guard<std::mutex> lk(job_lock);
+                        should_exit = true;
+                }
+                job_cv.notify_all();
+                for (auto &s : senders) {
+                        s->thread.join();
+                        tx_buffers_free(&s->bufs);
+                }
+        }
+
+        std::mutex lock; ///< tx state shared by the senders
+        std::mutex job_lock;
+        std::condition_variable job_cv; ///< new job or exit
+        std::condition_variable done_cv; ///< all senders of the job finished
+        bool should_exit = false;
+        unsigned long long job_id = 0;
+        int pending = 0; ///< senders of the current job not yet finished
+        struct video_frame *frame = nullptr;
+        struct rtp **rtp_sessions = nullptr;
+        int session_count = 0;
+        uint32_t ts = 0;
+        vector<unique_ptr<sender>> senders;
+};
+
+/// locks the tx state shared with the tile senders (if there are any)
+static void tx_lock_shared(struct tx *tx)
+{
+        if (tx->tile_senders != nullptr) {
+                tx->tile_senders->lock.lock();
+        }
+}
+
+static void tx_unlock_shared(struct tx *tx)
+{
+        if (tx->tile_senders != nullptr) {
+                tx->tile_senders->lock.unlock();
+        }
+}
+
+/**
+ * Replaces the data of bufs->pkts with the sealed packets of bufs->enc_pkts and
+ * drops packets that failed to encrypt.
+ * @returns new packet count
+ */
+static int tx_collect_sealed(struct tx_buffers *bufs, int pkt_count)
+{
+        int kept = 0;
+        for (int i = 0; i < pkt_count; ++i) {
+                if (bufs->enc_pkts[i].ciphertext_len == 0) {
+                        continue;
+                }
+                bufs->pkts[kept] = bufs->pkts[i];
+                bufs->pkts[kept].data = bufs->enc_pkts[i].ciphertext;
+                bufs->pkts[kept].data_len = bufs->enc_pkts[i].ciphertext_len;
+                kept += 1;
+        }
+        return kept;
+}
+
 static void tx_update(struct tx *tx, struct video_frame *frame, int substream)
 {
         if(!frame) {
@@ -203,6 +357,50 @@ static void tx_update(struct tx *tx, struct video_frame *frame, int substream)
         }
 }
 
+ADD_TO_PARAM("encryption-threads", "* encryption-threads=<n>\n"
+                "  Number of workers encrypting packets of a video frame before it is sent (default 1)\n");
+ADD_TO_PARAM("tx-interleave-tiles", "* tx-interleave-tiles\n"
+                "  Send packets of all tiles of a frame interleaved (in proportion to the tile sizes) so that\n"
+                "  the tiles arrive at about the same time and receiver tile decoders can start in parallel\n");
+ADD_TO_PARAM("tx-pacing", "* tx-pacing=fq|txtime\n"
+                "  Let the kernel pace video packets instead of busy-waiting between them - either with\n"
+                "  SO_MAX_PACING_RATE (needs fq qdisc) or with SO_TXTIME departure times (needs fq qdisc,\n"
+                "  or etf qdisc with udp-txtime-clock=tai)\n");
+ADD_TO_PARAM("tx-drop-late", "* tx-drop-late=<ms>\n"
+                "  Drop H.264/HEVC frames without reference slices (eg. non-reference B-frames) that are about to be\n"
+                "  sent more than <ms> after the compression (congested link), reference frames are always sent\n");
+/**
+ * Accounts the sent frame to the metrics and, once per reporting interval,
+ * to the control socket statistics. Called once per frame, not per packet.
+ */
+static void tx_account_sent(struct tx *tx, struct rtp *rtp_session, size_t bytes, int packets)
+{
+        const char *media = tx->media_type == TX_MEDIA_VIDEO ? "video" : "audio";
+        uint32_t ssrc = rtp_my_ssrc(rtp_session);
+        if (tx->metric_bytes == nullptr || ssrc != tx->metrics_ssrc) {
+                char labels[64];
+                snprintf(labels, sizeof labels, "media=\"%s\",ssrc=\"0x%08" PRIx32 "\"", media, ssrc);
+                tx->metric_bytes = metric_counter("ug_tx_bytes_total", "Sent RTP bytes including RTP payload headers", labels);
+                tx->metric_packets = metric_counter("ug_tx_packets_total", "Sent RTP packets", labels);
+                tx->metrics_ssrc = ssrc;
+        }
+        metric_inc(tx->metric_bytes, bytes);
+        metric_inc(tx->metric_packets, packets);
+
+        if (!control_stats_enabled(tx->control)) {
+                return;
+        }
+        tx->sent_since_report += bytes;
+        auto current_time_ms = time_since_epoch_in_ms();
+        if (current_time_ms - tx->last_stat_report >= CONTROL_PORT_BANDWIDTH_REPORT_INTERVAL_MS) {
+                char report[128];
+                snprintf(report, sizeof report, "tx_send %" PRIx32 " %s %zu", ssrc, media, tx->sent_since_report);
+                control_report_stats(tx->control, report);
+                tx->last_stat_report = current_time_ms;
+                tx->sent_since_report = 0;
+        }
+}
+
 struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media_type,
                 const char *fec, const char *encryption, long long int bitrate)
 {
@@ -255,11 +453,42 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
                         module_done(&tx->mod);
                         return NULL;
                 }
+                tx->enc_threads = 1;
+                if (const char *threads = get_commandline_param("encryption-threads")) {
+                        tx->enc_threads = MAX(atoi(threads), 1);
+                }
         }
 
         tx->bitrate = bitrate;
+        tx->interleave_tiles = get_commandline_param("tx-interleave-tiles") != nullptr;
+
+        if (const char *pacing = get_commandline_param("tx-pacing")) {
+                if (strcmp(pacing, "fq") == 0) {
+                        tx->pacing = UDP_PACING_FQ;
+                } else if (strcmp(pacing, "txtime") == 0) {
+                        tx->pacing = UDP_PACING_TXTIME;
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown pacing: %s\n", pacing);
+                        module_done(&tx->mod);
+                        return NULL;
+                }
+        }
 
-        tx->control = (struct control_state *) get_module(get_root_module(parent), "control");
+        if (const char *drop_late = get_commandline_param("tx-drop-late")) {
+                tx->drop_late_ns = atoll(drop_late) * NS_IN_MS;
+                if (tx->drop_late_ns <= 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong tx-drop-late value: %s\n", drop_late);
+                        module_done(&tx->mod);
+                        return NULL;
+                }
+        }
+
+        if (parent != NULL) { // standalone TX sessions (audio mixer) report no stats
+                tx->control = (struct control_state *) get_module(get_root_module(parent), "control");
+        }
+        if (media_type == TX_MEDIA_VIDEO && frame_trace_enabled()) {
+                frame_trace_init(parent);
+        }
 
         return tx;
 }
@@ -373,9 +602,92 @@ static void tx_done(struct module *mod)
 {
         struct tx *tx = (struct tx *) mod->priv_data;
         assert(tx->magic == TRANSMIT_MAGIC);
+        if (tx->dropped_late > 0) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Dropped %lu late non-reference frames.\n", tx->dropped_late);
+        }
+        delete tx->tile_senders;
+        tx_buffers_free(&tx->bufs);
+        free(tx->h264_pkts);
+        free(tx->h264_scratch);
+        free(tx->st2110_pkts);
+        free(tx->st2110_pgroups);
         free(tx);
 }
 
+/**
+ * Passes the sender stages of the frame (sent since tx_first) to the frame
+ * tracing, which sends them to the receiver.
+ */
+static void tx_trace_frame(struct video_frame *frame, struct rtp *rtp_session, uint32_t ts, time_ns_t tx_first)
+{
+        struct frame_trace trace{};
+        trace.ssrc = rtp_my_ssrc(rtp_session);
+        trace.rtp_ts = ts;
+        trace.t[FT_CAPTURE] = frame->capture_time;
+        trace.t[FT_FILTER] = frame->filter_time;
+        trace.t[FT_COMPRESS_START] = frame->compress_start * NS_IN_MS;
+        trace.t[FT_COMPRESS_END] = frame->compress_end * NS_IN_MS;
+        trace.t[FT_TX_FIRST] = tx_first;
+        trace.t[FT_TX_LAST] = get_time_in_ns();
+        frame_trace_sender_done(&trace, rtp_session);
+}
+
+/**
+ * Decides if the frame should be skipped to let the following frames catch up
+ * when the link congests - only a non-reference H.264/HEVC frame that waited
+ * for sending longer than tx-drop-late since compression is dropped. FEC
+ * encoded frames cannot be inspected and are always sent.
+ */
+static bool tx_drop_late(struct tx *tx, const struct video_frame *frame)
+{
+        if (tx->drop_late_ns == 0 || frame->compress_end == 0 || frame->fragment
+                        || frame->fec_params.type != FEC_NONE || frame->tile_count != 1
+                        || (frame->color_spec != H264 && frame->color_spec != H265)) {
+                return false;
+        }
+        const long long waiting_ns = get_time_in_ns() - (time_ns_t) frame->compress_end * NS_IN_MS;
+        const bool hevc = frame->color_spec == H265;
+        if (waiting_ns < tx->drop_late_ns && !hevc) {
+                return false;
+        }
+        // HEVC frames are inspected always to track the highest temporal sub-layer
+        if (rtpenc_h264_get_frame_type((const unsigned char *) frame->tiles[0].data, frame->tiles[0].data_len,
+                                hevc, &tx->hevc_max_tid) != BFRAME || waiting_ns < tx->drop_late_ns) {
+                return false;
+        }
+        tx->dropped_late += 1;
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Dropping non-reference frame %lld ms late.\n", waiting_ns / NS_IN_MS);
+        return true;
+}
+
+/**
+ * @returns RTP timestamp of the frame capture instant if known, of the
+ * current time otherwise (the receivers may map it to the sender wall clock
+ * using RTCP SR, eg. for synchronized playout)
+ */
+static uint32_t tx_frame_mediatime(const struct video_frame *frame)
+{
+        uint32_t ts = get_local_mediatime();
+        if (frame->capture_time != 0) {
+                time_ns_t age = get_time_in_ns() - frame->capture_time;
+                if (age > 0 && age < NS_IN_SEC) {
+                        ts -= age / 100'000 * 9; // at 90000 Hz
+                }
+        }
+        return ts;
+}
+
+/// @returns RTP timestamp of the frame, the same for all fragments of a frame
+static uint32_t tx_frame_ts(struct tx *tx, const struct video_frame *frame)
+{
+        if (frame->fragment && tx->last_frame_fragment_id == frame->frame_fragment_id) {
+                return tx->last_ts;
+        }
+        tx->last_frame_fragment_id = frame->frame_fragment_id;
+        tx->last_ts = tx_frame_mediatime(frame);
+        return tx->last_ts;
+}
+
 /*
  * sends one or more frames (tiles) with same TS in one RTP stream. Only one m-bit is set.
  */
@@ -388,32 +700,37 @@ tx_send(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
         assert(!frame->fragment || tx->fec_scheme == FEC_NONE); // currently no support for FEC with fragments
         assert(!frame->fragment || frame->tile_count); // multiple tile are not currently supported for fragmented send
         fec_check_messages(tx);
+        if (tx_drop_late(tx, frame)) {
+                return;
+        }
+
+        ts = tx_frame_ts(tx, frame);
+
+        const bool trace = frame_trace_enabled() && (!frame->fragment || frame->last_fragment);
+        time_ns_t tx_first = trace ? get_time_in_ns() : 0;
 
-        ts = get_local_mediatime();
-        if(frame->fragment &&
-                        tx->last_frame_fragment_id == frame->frame_fragment_id) {
-                ts = tx->last_ts;
+        if (tx->interleave_tiles && frame->tile_count > 1) {
+                tx_send_interleaved(tx, frame, rtp_session, ts, !frame->fragment || frame->last_fragment);
         } else {
-                tx->last_frame_fragment_id = frame->frame_fragment_id;
-                tx->last_ts = ts;
-        }
+                for (i = 0; i < frame->tile_count; ++i) {
+                        int last = FALSE;
+                        int fragment_offset = 0;
 
-        for(i = 0; i < frame->tile_count; ++i)
-        {
-                int last = FALSE;
-                int fragment_offset = 0;
-                
-                if (i == frame->tile_count - 1) {
-                        if(!frame->fragment || frame->last_fragment)
-                                last = TRUE;
-                }
-                if(frame->fragment)
-                        fragment_offset = vf_get_tile(frame, i)->offset;
+                        if (i == frame->tile_count - 1) {
+                                if(!frame->fragment || frame->last_fragment)
+                                        last = TRUE;
+                        }
+                        if(frame->fragment)
+                                fragment_offset = vf_get_tile(frame, i)->offset;
 
-                tx_send_base(tx, frame, rtp_session, ts, last,
-                                i, fragment_offset);
+                        tx_send_base(tx, &tx->bufs, frame, rtp_session, ts, last,
+                                        i, fragment_offset, false);
+                }
         }
         tx->buffer++;
+        if (trace) {
+                tx_trace_frame(frame, rtp_session, ts, tx_first);
+        }
 }
 
 void format_video_header(struct video_frame *frame, int tile_idx, int buffer_idx, uint32_t *video_hdr)
@@ -460,21 +777,101 @@ tx_send_tile(struct tx *tx, struct video_frame *frame, int pos, struct rtp *rtp_
         assert(!frame->fragment || frame->tile_count); // multiple tile are not currently supported for fragmented send
         fec_check_messages(tx);
 
-        ts = get_local_mediatime();
-        if(frame->fragment &&
-                        tx->last_frame_fragment_id == frame->frame_fragment_id) {
-                ts = tx->last_ts;
-        } else {
-                tx->last_frame_fragment_id = frame->frame_fragment_id;
-                tx->last_ts = ts;
-        }
+        ts = tx_frame_ts(tx, frame);
         if(!frame->fragment || frame->last_fragment)
                 last = TRUE;
         if(frame->fragment)
                 fragment_offset = vf_get_tile(frame, pos)->offset;
-        tx_send_base(tx, frame, rtp_session, ts, last, pos,
-                        fragment_offset);
+        time_ns_t tx_first = last && frame_trace_enabled() ? get_time_in_ns() : 0;
+        tx_send_base(tx, &tx->bufs, frame, rtp_session, ts, last, pos,
+                        fragment_offset, false);
         tx->buffer ++;
+        if (tx_first != 0) {
+                tx_trace_frame(frame, rtp_session, ts, tx_first);
+        }
+}
+
+static void tx_tile_sender_run(struct tx *tx, struct tx_tile_senders::sender *me, int idx,
+                unsigned long long last_job)
+{
+        set_thread_name("tile_sender");
+        struct tx_tile_senders *s = tx->tile_senders;
+        std::unique_lock<std::mutex> lk(s->job_lock);
+        while (1) {
+                s->job_cv.wait(lk, [s, last_job] { return s->should_exit || s->job_id != last_job; });
+                if (s->should_exit) {
+                        return;
+                }
+                last_job = s->job_id;
+                if (idx >= s->session_count) {
+                        continue;
+                }
+                struct video_frame *frame = s->frame;
+                struct rtp *rtp_session = s->rtp_sessions[idx];
+                const uint32_t ts = s->ts;
+                lk.unlock();
+
+                int fragment_offset = frame->fragment ? vf_get_tile(frame, idx)->offset : 0;
+                tx_send_base(tx, &me->bufs, frame, rtp_session, ts, !frame->fragment || frame->last_fragment,
+                                idx, fragment_offset, true);
+
+                lk.lock();
+                if (--s->pending == 0) {
+                        s->done_cv.notify_one();
+                }
+        }
+}
+
+ADD_TO_PARAM("tx-tile-threads", "* tx-tile-threads\n"
+                "  Send the tiles of a frame split among multiple receivers concurrently, each from its own\n"
+                "  thread (\"tile_sender\", see thread-map) at 1/<tiles> of the bitrate\n");
+/**
+ * Sends tile i of the frame to rtp_sessions[i] for i < session_count, all
+ * tiles with the same RTP timestamp and buffer ID (each tile ends with an
+ * m-bit in its session). If the param tx-tile-threads is set, the tiles are
+ * sent concurrently by tile_sender threads (except with encryption, which is
+ * not reentrant), otherwise one after another.
+ */
+void
+tx_send_tiles(struct tx *tx, struct video_frame *frame, struct rtp **rtp_sessions, int session_count)
+{
+        assert((int) frame->tile_count >= session_count);
+        assert(!frame->fragment || tx->fec_scheme == FEC_NONE); // currently no support for FEC with fragments
+        fec_check_messages(tx);
+
+        const uint32_t ts = tx_frame_ts(tx, frame);
+        const int last = !frame->fragment || frame->last_fragment;
+        time_ns_t tx_first = last && frame_trace_enabled() ? get_time_in_ns() : 0;
+
+        if (get_commandline_param("tx-tile-threads") == nullptr || session_count == 1 || tx->encryption != nullptr) {
+                for (int i = 0; i < session_count; ++i) {
+                        int fragment_offset = frame->fragment ? vf_get_tile(frame, i)->offset : 0;
+                        tx_send_base(tx, &tx->bufs, frame, rtp_sessions[i], ts, last, i, fragment_offset, false);
+                }
+        } else {
+                if (tx->tile_senders == nullptr) {
+                        tx->tile_senders = new tx_tile_senders;
+                }
+                struct tx_tile_senders *s = tx->tile_senders;
+                std::unique_lock<std::mutex> lk(s->job_lock);
+                while ((int) s->senders.size() < session_count) {
+                        auto *sender = new tx_tile_senders::sender;
+                        sender->thread = std::thread(tx_tile_sender_run, tx, sender, (int) s->senders.size(), s->job_id);
+                        s->senders.emplace_back(sender);
+                }
+                s->frame = frame;
+                s->rtp_sessions = rtp_sessions;
+                s->session_count = session_count;
+                s->ts = ts;
+                s->pending = session_count;
+                s->job_id += 1;
+                s->job_cv.notify_all();
+                s->done_cv.wait(lk, [s] { return s->pending == 0; });
+        }
+        tx->buffer++;
+        if (tx_first != 0) {
+                tx_trace_frame(frame, rtp_sessions[0], ts, tx_first);
+        }
 }
 
 static uint32_t format_interl_fps_hdr_row(enum interlacing_t interlacing, double input_fps)
@@ -574,14 +971,17 @@ static vector<int> get_packet_sizes(struct video_frame *frame, int substream, in
 
 /**
  * Returns inter-packet interval in nanoseconds.
+ *
+ * @param parallel  the tiles are sent concurrently (tx_send_tiles()), so each
+ *                  gets the whole frame time and 1/tile_count of the bitrate
  */
 static long
-get_packet_rate(struct tx *tx, struct video_frame *frame, int substream, long packet_count)
+get_packet_rate(struct tx *tx, struct video_frame *frame, int substream, long packet_count, bool parallel)
 {
         if (tx->bitrate == RATE_UNLIMITED) {
                 return 0;
         }
-        double time_for_frame = 1.0 / frame->fps / frame->tile_count;
+        double time_for_frame = 1.0 / frame->fps / (parallel ? 1 : frame->tile_count);
         double interval_between_pkts = time_for_frame / tx->mult_count / packet_count;
         // use only 75% of the time - we less likely overshot the frame time and
         // can minimize risk of swapping packets between 2 frames (out-of-order ones)
@@ -604,7 +1004,7 @@ get_packet_rate(struct tx *tx, struct video_frame *frame, int substream, long pa
                 tx->dyn_rate_limit_state.avg_frame_size = (9 * tx->dyn_rate_limit_state.avg_frame_size + frame->tiles[substream].data_len) / 10;
                 return packet_rate_auto;
         }
-        long long int bitrate = tx->bitrate & ~RATE_FLAG_FIXED_RATE;
+        long long int bitrate = (tx->bitrate & ~RATE_FLAG_FIXED_RATE) / (parallel ? frame->tile_count : 1);
         int avg_packet_size = frame->tiles[substream].data_len / packet_count;
         long packet_rate = 1000'000'000L * avg_packet_size * 8 / bitrate; // fixed rate
         if ((tx->bitrate & RATE_FLAG_FIXED_RATE) == 0) { // adaptive capped rate
@@ -613,53 +1013,24 @@ get_packet_rate(struct tx *tx, struct video_frame *frame, int substream, long pa
         return packet_rate;
 }
 
-static void
-tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
-                uint32_t ts, int send_m,
-                unsigned int substream,
-                int fragment_offset)
+/**
+ * Fills the payload header common to all packets of the tile.
+ * @returns length of the header in bytes
+ */
+static int
+tx_fill_payload_hdr(struct tx *tx, struct video_frame *frame, unsigned int substream, uint32_t *rtp_hdr)
 {
-        if (!rtp_has_receiver(rtp_session)) {
-                return;
-        }
-
-        struct tile *tile = &frame->tiles[substream];
-
-        int data_len;
-        // see definition in rtp_callback.h
-
-        uint32_t rtp_hdr[100];
         int rtp_hdr_len;
-        int pt = fec_pt_from_fec_type(TX_MEDIA_VIDEO, frame->fec_params.type, tx->encryption);            /* A value specified in our packet format */
-#ifdef HAVE_LINUX
-        struct timespec start, stop;
-#elif defined HAVE_MACOSX
-        struct timeval start, stop;
-#else // Windows
-	LARGE_INTEGER start, stop, freq;
-#endif
-        long delta, overslept = 0;
-        array <int, FEC_MAX_MULT> mult_pos{};
-        int mult_index = 0;
-
-        int hdrs_len = (rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12; // IP hdr size + UDP hdr size + RTP hdr size
-
-        assert(tx->magic == TRANSMIT_MAGIC);
-
-        tx_update(tx, frame, substream);
-
         if (frame->fec_params.type == FEC_NONE) {
-                hdrs_len += (sizeof(video_payload_hdr_t));
                 rtp_hdr_len = sizeof(video_payload_hdr_t);
                 format_video_header(frame, substream, tx->buffer, rtp_hdr);
         } else {
-                hdrs_len += (sizeof(fec_payload_hdr_t));
                 rtp_hdr_len = sizeof(fec_payload_hdr_t);
                 uint32_t tmp = substream << 22;
                 tmp |= 0x3fffff & tx->buffer;
                 // see definition in rtp_callback.h
                 rtp_hdr[0] = htonl(tmp);
-                rtp_hdr[2] = htonl(tile->data_len);
+                rtp_hdr[2] = htonl(frame->tiles[substream].data_len);
                 rtp_hdr[3] = htonl(
                              frame->fec_params.k << 19 |
                              frame->fec_params.m << 6 |
@@ -668,34 +1039,41 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
         }
 
         if (tx->encryption) {
-                hdrs_len += sizeof(crypto_payload_hdr_t) + tx->enc_funcs->get_overhead(tx->encryption);
                 rtp_hdr[rtp_hdr_len / sizeof(uint32_t)] = htonl(DEFAULT_CIPHER_MODE << 24);
                 rtp_hdr_len += sizeof(crypto_payload_hdr_t);
         }
+        return rtp_hdr_len;
+}
 
-        vector<int> packet_sizes = get_packet_sizes(frame, substream, tx->mtu - hdrs_len);
-        long packet_count = packet_sizes.size() * (tx->fec_scheme == FEC_MULT ? tx->mult_count : 1);
-
-        long packet_rate = get_packet_rate(tx, frame, substream, packet_count);
-
-        // initialize header array with values (except offset which is different among
-        // different packts)
-        void *rtp_headers = malloc(packet_count * rtp_hdr_len);
-        uint32_t *rtp_hdr_packet = (uint32_t *) rtp_headers;
-        for (int i = 0; i < packet_count; ++i) {
-                memcpy(rtp_hdr_packet, rtp_hdr, rtp_hdr_len);
-                rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
-        }
-        rtp_hdr_packet = (uint32_t *) rtp_headers;
-
-        if (!tx->encryption) {
-                rtp_async_start(rtp_session, packet_count);
+/// @returns size of all headers of a video packet (IP, UDP, RTP, payload, encryption)
+static int
+tx_video_hdrs_len(struct tx *tx, struct rtp *rtp_session, int rtp_hdr_len)
+{
+        int hdrs_len = (rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12; // IP hdr size + UDP hdr size + RTP hdr size
+        hdrs_len += rtp_hdr_len;
+        if (tx->encryption) {
+                hdrs_len += tx->enc_funcs->get_overhead(tx->encryption);
         }
+        return hdrs_len;
+}
 
+/**
+ * Lays out the packets of the tile to pkts, each with its own copy of rtp_hdr
+ * (with the offset filled in) in hdrs. Both must hold packet_count entries.
+ *
+ * @returns number of packets laid out
+ */
+static int
+tx_layout_tile(struct tx *tx, struct tile *tile, vector<int> const &packet_sizes, int fragment_offset, int send_m,
+                const uint32_t *rtp_hdr, int rtp_hdr_len, uint32_t *hdrs, struct rtp_batch_pkt *pkts)
+{
+        array <int, FEC_MAX_MULT> mult_pos{};
+        int mult_index = 0;
+        int pkt_count = 0;
         int packet_idx = 0;
         unsigned pos = 0;
+        uint32_t *rtp_hdr_packet = hdrs;
         do {
-                GET_STARTTIME;
                 int m = 0;
                 if(tx->fec_scheme == FEC_MULT) {
                         pos = mult_pos[mult_index];
@@ -703,10 +1081,11 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
 
                 int offset = pos + fragment_offset;
 
+                memcpy(rtp_hdr_packet, rtp_hdr, rtp_hdr_len);
                 rtp_hdr_packet[1] = htonl(offset);
 
                 char *data = tile->data + pos;
-                data_len = packet_sizes.at(packet_idx);
+                int data_len = packet_sizes.at(packet_idx);
                 if (pos + data_len >= (unsigned int) tile->data_len) {
                         if (send_m) {
                                 m = 1;
@@ -715,33 +1094,7 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 }
                 pos += data_len;
                 if(data_len) { /* check needed for FEC_MULT */
-                        char encrypted_data[data_len + MAX_CRYPTO_EXCEED];
-
-                        if (tx->encryption) {
-                                data_len = tx->enc_funcs->encrypt(tx->encryption,
-                                                data, data_len,
-                                                (char *) rtp_hdr_packet,
-                                                frame->fec_params.type != FEC_NONE ? sizeof(fec_payload_hdr_t) :
-                                                sizeof(video_payload_hdr_t),
-                                                encrypted_data);
-                                data = encrypted_data;
-                        }
-
-                        if (control_stats_enabled(tx->control)) {
-                                auto current_time_ms = time_since_epoch_in_ms();
-                                if(current_time_ms - tx->last_stat_report >= CONTROL_PORT_BANDWIDTH_REPORT_INTERVAL_MS){
-                                        std::ostringstream oss;
-                                        oss << "tx_send " << std::hex << rtp_my_ssrc(rtp_session) << std::dec << " video " << tx->sent_since_report;
-                                        control_report_stats(tx->control, oss.str());
-                                        tx->last_stat_report = current_time_ms;
-                                        tx->sent_since_report = 0;
-                                }
-                                tx->sent_since_report += data_len + rtp_hdr_len;
-                        }
-
-                        rtp_send_data_hdr(rtp_session, ts, pt, m, 0, 0,
-                                  (char *) rtp_hdr_packet, rtp_hdr_len,
-                                  data, data_len, 0, 0, 0);
+                        pkts[pkt_count++] = { data, data_len, m, (char *) rtp_hdr_packet, rtp_hdr_len };
                 }
 
                 if (mult_index + 1 == tx->mult_count) {
@@ -754,22 +1107,208 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 }
 
                 rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
+        } while (pos < tile->data_len || mult_index != 0); // when multiplying, we need all streams go to the end
+        return pkt_count;
+}
+
+/**
+ * Seals (if encrypting) and sends the packets laid out in bufs->pkts, pacing
+ * them by packet_rate (inter-packet interval in ns).
+ */
+static void
+tx_send_pkts(struct tx *tx, struct tx_buffers *bufs, struct video_frame *frame, struct rtp *rtp_session,
+                uint32_t ts, int pkt_count, long packet_rate)
+{
+        int pt = fec_pt_from_fec_type(TX_MEDIA_VIDEO, frame->fec_params.type, tx->encryption);            /* A value specified in our packet format */
+#ifdef HAVE_LINUX
+        struct timespec start, stop;
+#elif defined HAVE_MACOSX
+        struct timeval start, stop;
+#else // Windows
+	LARGE_INTEGER start, stop, freq;
+#endif
+        long delta, overslept = 0;
+
+        // seal them (in parallel) so that the shaper only paces ready packets
+        if (tx->encryption) {
+                const size_t stride = tx->mtu + MAX_CRYPTO_EXCEED;
+                bufs->enc_pkts = (struct openssl_encrypt_pkt *) tx_reserve(bufs->enc_pkts, &bufs->enc_pkts_len, pkt_count * sizeof *bufs->enc_pkts);
+                bufs->enc_frame = (char *) tx_reserve(bufs->enc_frame, &bufs->enc_frame_len, pkt_count * stride);
+                for (int i = 0; i < pkt_count; ++i) {
+                        bufs->enc_pkts[i] = { bufs->pkts[i].data, bufs->pkts[i].data_len,
+                                bufs->pkts[i].phdr,
+                                frame->fec_params.type != FEC_NONE ? (int) sizeof(fec_payload_hdr_t) :
+                                        (int) sizeof(video_payload_hdr_t),
+                                bufs->enc_frame + i * stride, 0 };
+                }
+                if (tx->enc_funcs->encrypt_batch(tx->encryption, bufs->enc_pkts, pkt_count, tx->enc_threads) != pkt_count) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Some packets could not be encrypted!\n");
+                }
+                pkt_count = tx_collect_sealed(bufs, pkt_count);
+        }
+
+        bufs->rtp_hdrs = (rtp_hdr_slot *) tx_reserve(bufs->rtp_hdrs, &bufs->rtp_hdrs_len, pkt_count * sizeof *bufs->rtp_hdrs);
+        size_t sent_bytes = 0;
+        for (int i = 0; i < pkt_count; ++i) {
+                sent_bytes += bufs->pkts[i].data_len + bufs->pkts[i].phdr_len;
+        }
+
+        rtp_async_start(rtp_session, pkt_count);
+        int batch_size = rtp_async_batch_size(rtp_session); // packets handed to the kernel at once, pace per batch
+
+        for (int i = 0; i < pkt_count; i += batch_size) {
+                GET_STARTTIME;
+                const int n = std::min(batch_size, pkt_count - i);
+                rtp_send_data_hdr_batch(rtp_session, ts, pt, bufs->pkts + i, n, bufs->rtp_hdrs + i);
 
                 // TRAFFIC SHAPER
-                if (pos < (unsigned int) tile->data_len) { // wait for all but last packet
+                if (i + n < pkt_count) { // wait for all but last batch
+                        long batch_rate = packet_rate * batch_size;
                         do {
                                 GET_STOPTIME;
                                 GET_DELTA;
-                        } while (packet_rate - delta - overslept > 0);
-                        overslept = -(packet_rate - delta - overslept);
+                        } while (batch_rate - delta - overslept > 0);
+                        overslept = -(batch_rate - delta - overslept);
                         //fprintf(stdout, "%ld ", overslept);
                 }
-        } while (pos < tile->data_len || mult_index != 0); // when multiplying, we need all streams go to the end
+        }
 
-        if (!tx->encryption) {
-                rtp_async_wait(rtp_session);
+        rtp_async_wait(rtp_session);
+        tx_lock_shared(tx);
+        tx_account_sent(tx, rtp_session, sent_bytes, pkt_count);
+        tx_unlock_shared(tx);
+}
+
+/**
+ * @returns inter-packet interval in ns of the packets, sets up kernel pacing
+ * if requested (then returns 0)
+ */
+static long
+tx_pacing_setup(struct tx *tx, struct rtp *rtp_session, long packet_rate)
+{
+        if (tx->pacing != UDP_PACING_NONE) {
+                if (rtp_set_pacing(rtp_session, tx->pacing)) {
+                        rtp_set_pacing_interval(rtp_session, packet_rate, tx->mtu);
+                        return 0; // paced by the kernel, skip the traffic shaper
+                }
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Kernel pacing not available, using busy-wait traffic shaper.\n");
+                tx->pacing = UDP_PACING_NONE;
+        }
+        return packet_rate;
+}
+
+static void
+tx_send_base(struct tx *tx, struct tx_buffers *bufs, struct video_frame *frame, struct rtp *rtp_session,
+                uint32_t ts, int send_m,
+                unsigned int substream,
+                int fragment_offset, bool parallel)
+{
+        PROFILE_FUNC;
+        if (!rtp_has_receiver(rtp_session)) {
+                return;
         }
-        free(rtp_headers);
+
+        // see definition in rtp_callback.h
+        uint32_t rtp_hdr[100];
+
+        assert(tx->magic == TRANSMIT_MAGIC);
+
+        tx_lock_shared(tx);
+        tx_update(tx, frame, substream);
+        tx_unlock_shared(tx);
+
+        const int rtp_hdr_len = tx_fill_payload_hdr(tx, frame, substream, rtp_hdr);
+        const int hdrs_len = tx_video_hdrs_len(tx, rtp_session, rtp_hdr_len);
+
+        vector<int> packet_sizes = get_packet_sizes(frame, substream, tx->mtu - hdrs_len);
+        long packet_count = packet_sizes.size() * (tx->fec_scheme == FEC_MULT ? tx->mult_count : 1);
+
+        tx_lock_shared(tx);
+        long packet_rate = get_packet_rate(tx, frame, substream, packet_count, parallel);
+        packet_rate = tx_pacing_setup(tx, rtp_session, packet_rate);
+        tx_unlock_shared(tx);
+
+        bufs->hdr_arena = (uint32_t *) tx_reserve(bufs->hdr_arena, &bufs->hdr_arena_len, packet_count * rtp_hdr_len);
+        bufs->pkts = (struct rtp_batch_pkt *) tx_reserve(bufs->pkts, &bufs->pkts_len, packet_count * sizeof *bufs->pkts);
+        int pkt_count = tx_layout_tile(tx, &frame->tiles[substream], packet_sizes, fragment_offset, send_m,
+                        rtp_hdr, rtp_hdr_len, bufs->hdr_arena, bufs->pkts);
+
+        tx_send_pkts(tx, bufs, frame, rtp_session, ts, pkt_count, packet_rate);
+}
+
+/**
+ * Sends all tiles of the frame in one RTP stream with their packets merged
+ * in proportion to the tile sizes, so that all tiles are completed at about
+ * the same time. The m-bit is set on the very last packet if send_m.
+ */
+static void
+tx_send_interleaved(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session, uint32_t ts, int send_m)
+{
+        PROFILE_FUNC;
+        if (!rtp_has_receiver(rtp_session)) {
+                return;
+        }
+        assert(tx->magic == TRANSMIT_MAGIC);
+        struct tx_buffers *bufs = &tx->bufs;
+        const unsigned tile_count = frame->tile_count;
+
+        vector<array<uint32_t, 100>> rtp_hdrs(tile_count);
+        vector<vector<int>> packet_sizes(tile_count);
+        vector<long> packet_counts(tile_count);
+        int rtp_hdr_len = 0;
+        long total_count = 0;
+        double frame_time = 0; // sum of the per-tile pacing windows
+        for (unsigned i = 0; i < tile_count; ++i) {
+                tx_update(tx, frame, i);
+                rtp_hdr_len = tx_fill_payload_hdr(tx, frame, i, rtp_hdrs[i].data());
+                const int hdrs_len = tx_video_hdrs_len(tx, rtp_session, rtp_hdr_len);
+                packet_sizes[i] = get_packet_sizes(frame, i, tx->mtu - hdrs_len);
+                packet_counts[i] = packet_sizes[i].size() * (tx->fec_scheme == FEC_MULT ? tx->mult_count : 1);
+                frame_time += (double) get_packet_rate(tx, frame, i, packet_counts[i], false) * packet_counts[i];
+                total_count += packet_counts[i];
+        }
+        long packet_rate = tx_pacing_setup(tx, rtp_session, (long) (frame_time / total_count));
+
+        // lay out the tiles one after another to the upper half of pkts, merge to the lower one
+        bufs->hdr_arena = (uint32_t *) tx_reserve(bufs->hdr_arena, &bufs->hdr_arena_len, total_count * rtp_hdr_len);
+        bufs->pkts = (struct rtp_batch_pkt *) tx_reserve(bufs->pkts, &bufs->pkts_len, 2 * total_count * sizeof *bufs->pkts);
+        vector<struct rtp_batch_pkt *> tile_pkts(tile_count);
+        vector<int> tile_pkt_count(tile_count);
+        uint32_t *hdrs = bufs->hdr_arena;
+        struct rtp_batch_pkt *laid_out = bufs->pkts + total_count;
+        for (unsigned i = 0; i < tile_count; ++i) {
+                int fragment_offset = frame->fragment ? vf_get_tile(frame, i)->offset : 0;
+                tile_pkts[i] = laid_out;
+                tile_pkt_count[i] = tx_layout_tile(tx, &frame->tiles[i], packet_sizes[i], fragment_offset, 0,
+                                rtp_hdrs[i].data(), rtp_hdr_len, hdrs, laid_out);
+                hdrs += packet_counts[i] * rtp_hdr_len / sizeof(uint32_t);
+                laid_out += tile_pkt_count[i];
+        }
+
+        // next packet is taken from the tile with the lowest fraction of sent packets
+        vector<int> next(tile_count);
+        int pkt_count = 0;
+        while (true) {
+                int best = -1;
+                for (unsigned i = 0; i < tile_count; ++i) {
+                        if (next[i] == tile_pkt_count[i]) {
+                                continue;
+                        }
+                        if (best == -1 || (long long) (next[i] + 1) * tile_pkt_count[best]
+                                        < (long long) (next[best] + 1) * tile_pkt_count[i]) {
+                                best = i;
+                        }
+                }
+                if (best == -1) {
+                        break;
+                }
+                bufs->pkts[pkt_count++] = tile_pkts[best][next[best]++];
+        }
+        if (send_m && pkt_count > 0) {
+                bufs->pkts[pkt_count - 1].m = 1;
+        }
+
+        tx_send_pkts(tx, bufs, frame, rtp_session, ts, pkt_count, packet_rate);
 }
 
 /* 
@@ -784,43 +1323,55 @@ void audio_tx_send(struct tx* tx, struct rtp *rtp_session, const audio_frame2 *
 
         int pt = fec_pt_from_fec_type(TX_MEDIA_AUDIO, buffer->get_fec_params(0).type, tx->encryption); /* PT set for audio in our packet format */
         unsigned m = 0u;
-        const char *chan_data;
         // see definition in rtp_callback.h
         uint32_t rtp_hdr[100];
         uint32_t timestamp;
-#ifdef HAVE_LINUX
-        struct timespec start, stop;
-#elif defined HAVE_MACOSX
-        struct timeval start, stop;
-#else // Windows
-	LARGE_INTEGER start, stop, freq;
-#endif
-        long delta;
         int mult_first_sent = 0;
 
         fec_check_messages(tx);
 
         timestamp = get_local_mediatime();
 
+        int rtp_hdr_len = 0;
+        int hdrs_len = (rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12; // MTU - IP hdr - UDP hdr - RTP hdr - payload_hdr
+        if (buffer->get_fec_params(0).type == FEC_NONE) {
+                hdrs_len += (sizeof(audio_payload_hdr_t));
+                rtp_hdr_len = sizeof(audio_payload_hdr_t);
+        } else {
+                hdrs_len += (sizeof(fec_payload_hdr_t));
+                rtp_hdr_len = sizeof(fec_payload_hdr_t);
+        }
+        const int payload_hdr_len = rtp_hdr_len;
+        if (tx->encryption) {
+                hdrs_len += sizeof(crypto_payload_hdr_t) + tx->enc_funcs->get_overhead(tx->encryption);
+                rtp_hdr_len += sizeof(crypto_payload_hdr_t);
+        }
+        const int max_data_len = tx->mtu - hdrs_len;
+
+        // packets of all channels are laid out first and sent as one batch
+        long packet_count = 0;
+        for (int channel = 0; channel < buffer->get_channel_count(); ++channel) {
+                packet_count += ((long) buffer->get_data_len(channel) + max_data_len - 1) / max_data_len + 1;
+        }
+        packet_count *= tx->fec_scheme == FEC_MULT ? tx->mult_count : 1;
+        tx->bufs.hdr_arena = (uint32_t *) tx_reserve(tx->bufs.hdr_arena, &tx->bufs.hdr_arena_len, packet_count * rtp_hdr_len);
+        tx->bufs.pkts = (struct rtp_batch_pkt *) tx_reserve(tx->bufs.pkts, &tx->bufs.pkts_len, packet_count * sizeof *tx->bufs.pkts);
+        uint32_t *rtp_hdr_packet = tx->bufs.hdr_arena;
+        int pkt_count = 0;
+
         for (int channel = 0; channel < buffer->get_channel_count(); ++channel)
         {
-                int rtp_hdr_len = 0;
-                int hdrs_len = (rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12; // MTU - IP hdr - UDP hdr - RTP hdr - payload_hdr
                 unsigned int fec_symbol_size = buffer->get_fec_params(channel).symbol_size;
 
-                chan_data = buffer->get_data(channel);
+                const char *chan_data = buffer->get_data(channel);
                 unsigned pos = 0u;
 
                 array <int, FEC_MAX_MULT> mult_pos{};
                 int mult_index = 0;
 
                 if (buffer->get_fec_params(0).type == FEC_NONE) {
-                        hdrs_len += (sizeof(audio_payload_hdr_t));
-                        rtp_hdr_len = sizeof(audio_payload_hdr_t);
                         format_audio_header(buffer, channel, tx->buffer, rtp_hdr);
                 } else {
-                        hdrs_len += (sizeof(fec_payload_hdr_t));
-                        rtp_hdr_len = sizeof(fec_payload_hdr_t);
                         uint32_t tmp = channel << 22;
                         tmp |= 0x3fffff & tx->buffer;
                         // see definition in rtp_callback.h
@@ -834,44 +1385,12 @@ void audio_tx_send(struct tx* tx, struct rtp *rtp_session, const audio_frame2 *
                 }
 
                 if (tx->encryption) {
-                        hdrs_len += sizeof(crypto_payload_hdr_t) + tx->enc_funcs->get_overhead(tx->encryption);
-                        rtp_hdr[rtp_hdr_len / sizeof(uint32_t)] = htonl(DEFAULT_CIPHER_MODE << 24);
-                        rtp_hdr_len += sizeof(crypto_payload_hdr_t);
+                        rtp_hdr[payload_hdr_len / sizeof(uint32_t)] = htonl(DEFAULT_CIPHER_MODE << 24);
                 }
 
                 if (buffer->get_fec_params(0).type != FEC_NONE) {
-                        check_symbol_size(fec_symbol_size, tx->mtu - hdrs_len);
-                }
-
-                int packet_rate = 0;
-#if 0
-                if (tx->bitrate > 0) {
-                        //packet_rate = 1000ll * 1000 * 1000 * tx->mtu * 8 / tx->bitrate;
-			packet_rate = 0;
-                } else if (tx->bitrate == RATE_UNLIMITED) {
-                        packet_rate = 0;
-                } else if (tx->bitrate == RATE_AUTO || tx->bitrate == RATE_DYNAMIC) {
-                        /**
-                         * @todo
-                         * Following code would actually work but seems to be useless in most of cases (eg.
-                         * PCM 2 channels 2 Bps takes 5 std. Eth frames). On the other hand it could cause
-                         * unexpectable problems (I'd write them here but if I'd expect them they wouldn't
-                         * be unexpectable.)
-                         */
-                        double time_for_frame = buffer->get_duration() / buffer->get_channel_count();
-                        if (time_for_frame > 0.0) {
-                                long long req_bitrate = buffer->get_data_len(channel) * 8 / time_for_frame * tx->mult_count;
-                                // adjust computed value to 3
-                                req_bitrate = req_bitrate * 3;
-                                packet_rate = compute_packet_rate(req_bitrate, tx->mtu);
-                        } else {
-                                packet_rate = 0;
-                        }
-                        packet_rate = 0;
-                } else {
-                        abort();
+                        check_symbol_size(fec_symbol_size, max_data_len);
                 }
-#endif
 
                 do {
                         if(tx->fec_scheme == FEC_MULT) {
@@ -879,46 +1398,20 @@ void audio_tx_send(struct tx* tx, struct rtp *rtp_session, const audio_frame2 *
                         }
 
                         const char *data = chan_data + pos;
-                        int data_len = tx->mtu - hdrs_len;
+                        int data_len = max_data_len;
                         if(pos + data_len >= (unsigned int) buffer->get_data_len(channel)) {
                                 data_len = buffer->get_data_len(channel) - pos;
                                 if(channel == buffer->get_channel_count() - 1)
                                         m = 1;
                         }
-                        rtp_hdr[1] = htonl(pos);
-                        pos += data_len;
-                        
-                        GET_STARTTIME;
-                        
-                        if(data_len) { /* check needed for FEC_MULT */
-                                char encrypted_data[data_len + MAX_CRYPTO_EXCEED];
-                                if(tx->encryption) {
-                                        data_len = tx->enc_funcs->encrypt(tx->encryption,
-                                                        const_cast<char *>(data), data_len,
-                                                        (char *) rtp_hdr, rtp_hdr_len - sizeof(crypto_payload_hdr_t),
-                                                        encrypted_data);
-                                        data = encrypted_data;
-                                }
-
-                                if (control_stats_enabled(tx->control)) {
-                                        auto current_time_ms = time_since_epoch_in_ms();
-                                        if(current_time_ms - tx->last_stat_report >= CONTROL_PORT_BANDWIDTH_REPORT_INTERVAL_MS){
-                                                std::ostringstream oss;
-                                                oss << "tx_send " << std::hex << rtp_my_ssrc(rtp_session) << std::dec << " audio " << tx->sent_since_report;
-                                                control_report_stats(tx->control, oss.str());
-                                                tx->last_stat_report = current_time_ms;
-                                                tx->sent_since_report = 0;
-                                        }
-                                        tx->sent_since_report += data_len + rtp_hdr_len;
-                                }
-
-
-                                rtp_send_data_hdr(rtp_session, timestamp, pt, m, 0,        /* contributing sources */
-                                      0,        /* contributing sources length */
-                                      (char *) rtp_hdr, rtp_hdr_len,
-                                      const_cast<char *>(data), data_len,
-                                      0, 0, 0);
+                        if (data_len) { /* check needed for FEC_MULT */
+                                assert(pkt_count < packet_count);
+                                memcpy(rtp_hdr_packet, rtp_hdr, rtp_hdr_len);
+                                rtp_hdr_packet[1] = htonl(pos);
+                                tx->bufs.pkts[pkt_count++] = { const_cast<char *>(data), data_len, (int) m, (char *) rtp_hdr_packet, rtp_hdr_len };
+                                rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
                         }
+                        pos += data_len;
 
                         if(tx->fec_scheme == FEC_MULT) {
                                 mult_pos[mult_index] = pos;
@@ -927,24 +1420,38 @@ void audio_tx_send(struct tx* tx, struct rtp *rtp_session, const audio_frame2 *
                                                 mult_index = (mult_index + 1) % tx->mult_count;
                         }
 
-                        if (pos < buffer->get_data_len(channel)) {
-                                do {
-                                        GET_STOPTIME;
-                                        GET_DELTA;
-                                        if (delta < 0)
-                                                delta += 1000000000L;
-                                } while (packet_rate - delta > 0);
-                        }
-
                         /* when trippling, we need all streams goes to end */
                         if(tx->fec_scheme == FEC_MULT) {
                                 pos = mult_pos[tx->mult_count - 1];
                         }
-
-                      
                 } while (pos < buffer->get_data_len(channel));
         }
 
+        if (tx->encryption) {
+                const size_t stride = tx->mtu + MAX_CRYPTO_EXCEED;
+                tx->bufs.enc_pkts = (struct openssl_encrypt_pkt *) tx_reserve(tx->bufs.enc_pkts, &tx->bufs.enc_pkts_len, pkt_count * sizeof *tx->bufs.enc_pkts);
+                tx->bufs.enc_frame = (char *) tx_reserve(tx->bufs.enc_frame, &tx->bufs.enc_frame_len, pkt_count * stride);
+                for (int i = 0; i < pkt_count; ++i) {
+                        tx->bufs.enc_pkts[i] = { tx->bufs.pkts[i].data, tx->bufs.pkts[i].data_len,
+                                tx->bufs.pkts[i].phdr, payload_hdr_len,
+                                tx->bufs.enc_frame + i * stride, 0 };
+                }
+                if (tx->enc_funcs->encrypt_batch(tx->encryption, tx->bufs.enc_pkts, pkt_count, 1) != pkt_count) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Some packets could not be encrypted!\n");
+                }
+                pkt_count = tx_collect_sealed(&tx->bufs, pkt_count);
+        }
+
+        tx->bufs.rtp_hdrs = (rtp_hdr_slot *) tx_reserve(tx->bufs.rtp_hdrs, &tx->bufs.rtp_hdrs_len, pkt_count * sizeof *tx->bufs.rtp_hdrs);
+        size_t sent_bytes = 0;
+        for (int i = 0; i < pkt_count; ++i) {
+                sent_bytes += tx->bufs.pkts[i].data_len + rtp_hdr_len;
+        }
+        rtp_async_start(rtp_session, pkt_count);
+        rtp_send_data_hdr_batch(rtp_session, timestamp, pt, tx->bufs.pkts, pkt_count, tx->bufs.rtp_hdrs);
+        rtp_async_wait(rtp_session);
+        tx_account_sent(tx, rtp_session, sent_bytes, pkt_count);
+
         tx->buffer ++;
 }
 
@@ -1028,117 +1535,85 @@ void audio_tx_send_standard(struct tx* tx, struct rtp *rtp_session,
 }
 
 /**
- *  H.264 standard transmission
+ * H.264 (RFC 6184) and HEVC (RFC 7798) standard transmission
+ *
+ * The access unit is packetized by rtpenc_h264_packetize() and the packets
+ * are sent as one batch. Only the payload headers are copied, the payloads
+ * point to the frame data.
  */
 void tx_send_h264(struct tx *tx, struct video_frame *frame,
 		struct rtp *rtp_session) {
+        tx_send_h264_multi(tx, frame, &rtp_session, 1);
+}
+
+/**
+ * Sends the access unit to all sessions (eg. RTSP clients). The frame is
+ * packetized only once, each session then sends the same packets with its
+ * own SSRC and sequence numbers.
+ *
+ * The access unit may also be passed in parts of whole NAL units (a compressor
+ * with partial output, see @ref video_compress), the parts share the RTP
+ * timestamp and the marker bit is set only at the end of the last one.
+ */
+void tx_send_h264_multi(struct tx *tx, struct video_frame *frame,
+		struct rtp **rtp_sessions, int session_count) {
+        if (session_count == 0) {
+                return;
+        }
         assert(frame->tile_count == 1); // std transmit doesn't handle more than one tile
         assert(!frame->fragment || tx->fec_scheme == FEC_NONE); // currently no support for FEC with fragments
         assert(!frame->fragment || frame->tile_count); // multiple tiles are not currently supported for fragmented send
-        uint32_t ts = get_std_video_local_mediatime();
+        if (tx_drop_late(tx, frame)) {
+                return;
+        }
         struct tile *tile = &frame->tiles[0];
-
-	char pt =  PT_DynRTP_Type96;
-	unsigned char hdr[2];
-	int cc = 0;
-	uint32_t csrc = 0;
-	int m = 0;
-	char *extn = 0;
-	uint16_t extn_len = 0;
-	uint16_t extn_type = 0;
-	const uint8_t *start = (uint8_t *) tile->data;
-	int data_len = tile->data_len;
-	unsigned maxPacketSize = tx->mtu - 40;
-
-        const unsigned char *endptr = 0;
-        const unsigned char *nal = start;
-
-        while ((nal = rtpenc_h264_get_next_nal(nal, data_len - (nal - start), &endptr))) {
-                unsigned int nalsize = endptr - nal;
-                bool eof = endptr == start + data_len;
-                bool lastNALUnitFragment = false; // by default
-                unsigned curNALOffset = 0;
-                char *nalc = const_cast<char *>(reinterpret_cast<const char *>(nal));
-
-		while(!lastNALUnitFragment){
-			// We have NAL unit data in the buffer.  There are three cases to consider:
-			// 1. There is a new NAL unit in the buffer, and it's small enough to deliver
-			//    to the RTP sink (as is).
-			// 2. There is a new NAL unit in the buffer, but it's too large to deliver to
-			//    the RTP sink in its entirety.  Deliver the first fragment of this data,
-			//    as a FU packet, with one extra preceding header byte (for the "FU header").
-			// 3. There is a NAL unit in the buffer, and we've already delivered some
-			//    fragment(s) of this.  Deliver the next fragment of this data,
-			//    as a FU packet, with two (H.264) extra preceding header bytes
-			//    (for the "NAL header" and the "FU header").
-			if (curNALOffset == 0) { // case 1 or 2
-				if (nalsize	<= maxPacketSize) { // case 1
-
-					if (eof) m = 1;
-					if (rtp_send_data(rtp_session, ts, pt, m, cc, &csrc,
-							nalc, nalsize,
-							extn, extn_len, extn_type) < 0) {
-						error_msg("There was a problem sending the RTP packet\n");
-					}
-					lastNALUnitFragment = true;
-				} else { // case 2
-					// We need to send the NAL unit data as FU packets.  Deliver the first
-					// packet now.  Note that we add "NAL header" and "FU header" bytes to the front
-					// of the packet (overwriting the existing "NAL header").
-					hdr[0] = (nal[0] & 0xE0) | 28; //FU indicator
-					hdr[1] = 0x80 | (nal[0] & 0x1F); // FU header (with S bit)
-
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-									(char *) hdr, 2,
-									nalc + 1, maxPacketSize - 2,
-									extn, extn_len, extn_type) < 0) {
-										error_msg("There was a problem sending the RTP packet\n");
-					}
-					curNALOffset += maxPacketSize - 1;
-					lastNALUnitFragment = false;
-					nalsize -= maxPacketSize - 1;
-				}
-			} else { // case 3
-				// We are sending this NAL unit data as FU packets.  We've already sent the
-				// first packet (fragment).  Now, send the next fragment.  Note that we add
-				// "NAL header" and "FU header" bytes to the front.  (We reuse these bytes that
-				// we already sent for the first fragment, but clear the S bit, and add the E
-				// bit if this is the last fragment.)
-				hdr[1] = hdr[1] & ~0x80;// FU header (no S bit)
-
-				if (nalsize + 1 > maxPacketSize) {
-					// We can't send all of the remaining data this time:
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-							(char *) hdr, 2,
-							nalc + curNALOffset,
-							maxPacketSize - 2, extn, extn_len,
-							extn_type) < 0) {
-								error_msg("There was a problem sending the RTP packet\n");
-					}
-					curNALOffset += maxPacketSize - 2;
-					lastNALUnitFragment = false;
-					nalsize -= maxPacketSize - 2;
-
-				} else {
-					// This is the last fragment:
-					if (eof) m = 1;
-
-					hdr[1] |= 0x40;// set the E bit in the FU header
-
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-									(char *) hdr, 2,
-									nalc + curNALOffset,
-									nalsize, extn, extn_len, extn_type) < 0) {
-										error_msg("There was a problem sending the RTP packet\n");
-					}
-					lastNALUnitFragment = true;
-				}
-			}
-		}
-	}
-        if (endptr != start + data_len) {
+        if (!frame->fragment || tile->offset == 0) {
+                tx->h264_part_ts = get_std_video_local_mediatime();
+        }
+        const uint32_t ts = tx->h264_part_ts;
+        const bool hevc = frame->color_spec == H265;
+        const char pt = PT_DynRTP_Type96;
+        const int max_payload = tx->mtu - 40;
+
+        int pkt_count = 0;
+        size_t scratch_needed = 0;
+        while (true) {
+                pkt_count = rtpenc_h264_packetize((const unsigned char *) tile->data, tile->data_len, hevc, max_payload,
+                                tx->h264_pkts, tx->h264_pkts_len / sizeof(struct rtpenc_h264_pkt),
+                                tx->h264_scratch, tx->h264_scratch_len, &scratch_needed);
+                if ((size_t) pkt_count <= tx->h264_pkts_len / sizeof(struct rtpenc_h264_pkt)
+                                && scratch_needed <= tx->h264_scratch_len) {
+                        break;
+                }
+                tx->h264_pkts = (struct rtpenc_h264_pkt *) tx_reserve(tx->h264_pkts, &tx->h264_pkts_len,
+                                pkt_count * sizeof(struct rtpenc_h264_pkt));
+                tx->h264_scratch = (unsigned char *) tx_reserve(tx->h264_scratch, &tx->h264_scratch_len, scratch_needed);
+        }
+        if (pkt_count == 0) {
                 error_msg("No NAL found!\n");
+                return;
+        }
+        if (frame->fragment && !frame->last_fragment) {
+                tx->h264_pkts[pkt_count - 1].m = false; // access unit continues in the next part
+        }
+
+        size_t sent_bytes = 0;
+        for (int j = 0; j < session_count; ++j) {
+                struct rtp *rtp_session = rtp_sessions[j];
+                rtp_async_start(rtp_session, pkt_count);
+                for (int i = 0; i < pkt_count; ++i) {
+                        const struct rtpenc_h264_pkt *pkt = &tx->h264_pkts[i];
+                        if (rtp_send_data_hdr(rtp_session, ts, pt, pkt->m, 0, nullptr,
+                                                (char *) const_cast<unsigned char *>(pkt->hdr), pkt->hdr_len,
+                                                (char *) const_cast<unsigned char *>(pkt->data), pkt->data_len,
+                                                nullptr, 0, 0) < 0) {
+                                error_msg("There was a problem sending the RTP packet\n");
+                        }
+                        sent_bytes += pkt->hdr_len + pkt->data_len;
+                }
+                rtp_async_wait(rtp_session);
         }
+        tx_account_sent(tx, rtp_sessions[0], sent_bytes, pkt_count * session_count);
 }
 
 void tx_send_jpeg(struct tx *tx, struct video_frame *frame,
@@ -1213,6 +1688,99 @@ void tx_send_jpeg(struct tx *tx, struct video_frame *frame,
         } while (bytes_left > 0);
 }
 
+/**
+ * SMPTE ST 2110-20 transmission with ST 2110-21 narrow gapped sender
+ * pacing - the frame is sent in the first frame period (aligned to the
+ * wall clock, assumed to be PTP-synchronized) starting after the call,
+ * the packets being spread by the kernel (SO_TXTIME) over its active part.
+ * The RTP timestamp is the 90 kHz media clock at the frame epoch.
+ */
+void tx_send_st2110(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
+{
+        assert(frame->tile_count == 1); // std transmit doesn't handle more than one tile
+        if (!rtp_has_receiver(rtp_session)) {
+                return;
+        }
+        struct tile *tile = &frame->tiles[0];
+        int pg_bytes = 0;
+        int pg_pixels = 0;
+        if (!st2110_get_pgroup(frame->color_spec, &pg_bytes, &pg_pixels) || tile->width % pg_pixels != 0) {
+                log_msg_once(LOG_LEVEL_ERROR, to_fourcc('T', 'X', '2', '1'), MOD_NAME "ST 2110-20 cannot carry %s %ux%u!\n",
+                                get_codec_name(frame->color_spec), tile->width, tile->height);
+                return;
+        }
+
+        // RTP timestamp and departure of the frame, keep one frame at most queued in the kernel
+        const double period_ns = NS_IN_SEC_DBL / frame->fps;
+        const time_ns_t now = get_time_in_ns();
+        long long epoch = (long long) (now / period_ns) + 1;
+        if (epoch <= tx->st2110_epoch) {
+                if (tx->st2110_epoch - epoch >= 1) {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Frame arrived too early for ST 2110 sending, dropped.\n");
+                        return;
+                }
+                epoch = tx->st2110_epoch + 1;
+        }
+        tx->st2110_epoch = epoch;
+        const time_ns_t epoch_ns = (time_ns_t) (epoch * period_ns);
+        const uint32_t ts = epoch_ns / 100'000 * 9 + epoch_ns % 100'000 * 9 / 100'000;
+
+        const unsigned char *pgroups = (const unsigned char *) tile->data;
+        if (frame->color_spec == v210) {
+                const size_t line_bytes = tile->width / pg_pixels * pg_bytes;
+                tx->st2110_pgroups = (unsigned char *) tx_reserve(tx->st2110_pgroups, &tx->st2110_pgroups_len,
+                                line_bytes * tile->height);
+                const int src_linesize = vc_get_linesize(tile->width, v210);
+                for (unsigned y = 0; y < tile->height; ++y) {
+                        st2110_pack_line(v210, tx->st2110_pgroups + y * line_bytes, tile->data + y * src_linesize, tile->width);
+                }
+                pgroups = tx->st2110_pgroups;
+        }
+
+        const uint16_t next_seq = rtp_get_next_seq(rtp_session);
+        const uint32_t ext_seq = tx->st2110_ext_seq + (uint16_t) (next_seq - (uint16_t) tx->st2110_ext_seq);
+        const int max_payload = tx->mtu - ((rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12); // IP hdr size + UDP hdr size + RTP hdr size
+        int pkt_count = 0;
+        while ((size_t) (pkt_count = st2110_packetize(pgroups, tile->width, tile->height, frame->color_spec, max_payload,
+                                        ext_seq, tx->st2110_pkts, tx->st2110_pkts_len / sizeof(struct st2110_pkt)))
+                        > tx->st2110_pkts_len / sizeof(struct st2110_pkt)) {
+                tx->st2110_pkts = (struct st2110_pkt *) tx_reserve(tx->st2110_pkts, &tx->st2110_pkts_len,
+                                pkt_count * sizeof(struct st2110_pkt));
+        }
+        if (pkt_count <= 0) {
+                return;
+        }
+        tx->st2110_ext_seq = ext_seq + pkt_count;
+
+        tx->bufs.pkts = (struct rtp_batch_pkt *) tx_reserve(tx->bufs.pkts, &tx->bufs.pkts_len, pkt_count * sizeof *tx->bufs.pkts);
+        tx->bufs.rtp_hdrs = (rtp_hdr_slot *) tx_reserve(tx->bufs.rtp_hdrs, &tx->bufs.rtp_hdrs_len, pkt_count * sizeof *tx->bufs.rtp_hdrs);
+        size_t sent_bytes = 0;
+        for (int i = 0; i < pkt_count; ++i) {
+                struct st2110_pkt *pkt = &tx->st2110_pkts[i];
+                tx->bufs.pkts[i] = { (char *) const_cast<unsigned char *>(pkt->data), pkt->data_len, pkt->m,
+                        (char *) pkt->hdr, pkt->hdr_len };
+                sent_bytes += pkt->hdr_len + pkt->data_len;
+        }
+
+        if (!tx->st2110_unpaced) {
+                if (rtp_set_pacing(rtp_session, UDP_PACING_TXTIME)) {
+                        long long trs = 0;
+                        long long tro = 0;
+                        st2110_narrow_timing(tile->height, frame->fps, pkt_count, &trs, &tro);
+                        rtp_set_pacing_interval(rtp_session, trs, tx->mtu);
+                        rtp_set_pacing_start(rtp_session, epoch_ns + tro);
+                } else {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "SO_TXTIME not available, ST 2110 stream will not be paced!\n");
+                        tx->st2110_unpaced = true;
+                }
+        }
+
+        rtp_async_start(rtp_session, pkt_count);
+        rtp_send_data_hdr_batch(rtp_session, ts, PT_DynRTP_Type96, tx->bufs.pkts, pkt_count, tx->bufs.rtp_hdrs);
+        rtp_async_wait(rtp_session);
+        tx_account_sent(tx, rtp_session, sent_bytes, pkt_count);
+}
+
 int tx_get_buffer_id(struct tx *tx)
 {
         return tx->buffer;
@@ -74,11 +74,14 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
                 const char *fec, const char *encryption, long long bitrate);
 void		 tx_send_tile(struct tx *tx_session, struct video_frame *frame, int pos, struct rtp *rtp_session);
 void             tx_send(struct tx *tx_session, struct video_frame *frame, struct rtp *rtp_session);
+void             tx_send_tiles(struct tx *tx_session, struct video_frame *frame, struct rtp **rtp_sessions, int session_count);
 void             format_video_header(struct video_frame *frame, int tile_idx, int buffer_idx,
                 uint32_t *hdr);
 
 void tx_send_h264(struct tx *tx_session, struct video_frame *frame, struct rtp *rtp_session);
+void tx_send_h264_multi(struct tx *tx_session, struct video_frame *frame, struct rtp **rtp_sessions, int session_count);
 void tx_send_jpeg(struct tx *tx_session, struct video_frame *frame, struct rtp *rtp_session);
+void tx_send_st2110(struct tx *tx_session, struct video_frame *frame, struct rtp *rtp_session);
 
 /**
  * Returns buffer ID to be sent with next tx_send() call
@@ -104,6 +104,7 @@ typedef enum {
         PRORES_422,       ///< Apple ProRes 422
         PRORES_422_PROXY, ///< Apple ProRes 422 (Proxy)
         PRORES_422_LT,    ///< Apple ProRes 422 (LT)
+        HW_VIDEOTOOLBOX,  ///< VideoToolbox IOSurface-backed CVPixelBuffer (NV12)
         VIDEO_CODEC_COUNT, ///< count of known video codecs (including VIDEO_CODEC_NONE)
         VIDEO_CODEC_END = VIDEO_CODEC_COUNT
 } codec_t;
@@ -184,6 +185,7 @@ struct fec_desc {
 #endif
 };
 
+struct module_mem;
 struct video_frame;
 /**
  * @brief Struct containing callbacks of a @ref video_frame
@@ -251,6 +253,26 @@ struct tile {
         /// @brief Fragment offset from tile beginning (in bytes). Used only if frame is fragmented.
         /// @see video_frame::fragment
         unsigned int         offset;
+
+        /**
+         * @brief DMA-BUF file descriptor of the tile data, -1 if not available
+         *
+         * Set by capturers exporting their buffers so that a consumer can
+         * import the buffer to a GPU without a copy. Owned by the frame
+         * originator, valid until the frame is disposed.
+         */
+        int                  dmabuf_fd;
+
+        /**
+         * @brief Distance between the starts of the tile lines in bytes
+         *
+         * Non-zero only if the tile is a strided view into a bigger buffer
+         * (see vf_split_view()), data_len is then still the length of the
+         * tile lines stored contiguously. 0 if the lines are contiguous.
+         * Consumers not aware of strided tiles should pass the frame through
+         * vf_make_contiguous() first.
+         */
+        unsigned int         pitch;
 };
 
 #define FLEXIBLE_ARRAY_MEMBER 0
@@ -272,7 +294,8 @@ struct video_frame {
 
         /** @name Fragment Stuff 
          * @{ */
-        /// Indicates that the tile is fragmented. Normally not used (only for Bluefish444).
+        /// Indicates that the tile is fragmented. Normally not used (only for Bluefish444
+        /// and partial output of compressions, see @ref video_compress).
         unsigned int         fragment:1;
         /// Used only if (fragment == 1). Indicates this is the last fragment.
         unsigned int         last_fragment:1;
@@ -284,6 +307,9 @@ struct video_frame {
 
         struct video_frame_callbacks callbacks;
 
+        struct module_mem *mem_owner; ///< module the data are accounted to (see vf_mem_charge()), NULL if none
+        size_t mem_bytes;
+
         // metadata follow
 #define VF_METADATA_START fec_params
         struct fec_desc fec_params;
@@ -293,6 +319,8 @@ struct video_frame {
         uint32_t timecode; ///< BCD timecode (hours, minutes, seconds, frame number)
         uint64_t compress_start; ///< in ms from epoch
         uint64_t compress_end; ///< in ms from epoch
+        uint64_t capture_time; ///< in ns from epoch, set by vidcap_grab(), 0 if unknown
+        uint64_t filter_time; ///< in ns from epoch, set only if frame tracing is enabled
         unsigned int paused_play:1;
 #define VF_METADATA_END tile_count
 
@@ -47,6 +47,9 @@
 #include "utils/audio_buffer.h"
 #include "utils/ring_buffer.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #define WINDOW 50
 
 #undef max
@@ -59,6 +62,7 @@
 #define BUF_LAST_OVERRUN_THRESHOLD 10000
 #define AGGRESSIVITY_MAX 4
 #define AGGRESSIVITY_STEP 100
+#define DRIFT_COMP_RATE_DIV 256 ///< at aggressivity 1, up to 1/DRIFT_COMP_RATE_DIV samples are dropped/duplicated
 
 static const int occupacy_windows[] = { 50, 200 };
 
@@ -105,6 +109,50 @@ void audio_buffer_destroy(struct audio_buffer *buf)
         free(buf);
 }
 
+static void copy_from_regions(char *dst, const char *ptr1, int size1, const char *ptr2, int offset, int len)
+{
+        if (offset < size1) {
+                int n = min(len, size1 - offset);
+                memcpy(dst, ptr1 + offset, n);
+                dst += n;
+                offset += n;
+                len -= n;
+        }
+        if (len > 0) {
+                memcpy(dst, ptr2 + (offset - size1), len);
+        }
+}
+
+/**
+ * Reads out_frames sample frames compensating clock drift between the
+ * writer and the reader - comp frames (if positive) are dropped or (if
+ * negative) duplicated, evenly spread over the output so that the change
+ * is not audible as a discontinuity.
+ *
+ * Works on the ring buffer regions directly since it is called from
+ * playback callbacks. The ring must contain out_frames + comp frames.
+ */
+static void read_compensated(struct audio_buffer *buf, char *out, int out_frames, int comp)
+{
+        const int frame_size = buf->desc.bps * buf->desc.ch_count;
+        const int src_frames = out_frames + comp;
+        void *ptr1;
+        int size1;
+        void *ptr2;
+        int size2;
+        ring_get_read_regions(buf->ring, src_frames * frame_size, &ptr1, &size1, &ptr2, &size2);
+
+        const int segments = abs(comp) + 1;
+        for (int i = 0; i < segments; ++i) {
+                int out_begin = i * out_frames / segments;
+                int out_end = (i + 1) * out_frames / segments;
+                int src_begin = comp > 0 ? out_begin + i : out_begin - i;
+                copy_from_regions(out + out_begin * frame_size, ptr1, size1, ptr2,
+                                src_begin * frame_size, (out_end - out_begin) * frame_size);
+        }
+        ring_advance_read_idx(buf->ring, src_frames * frame_size);
+}
+
 int audio_buffer_read(struct audio_buffer *buf, char *out, int max_len)
 {
         if (buf->out_pkt_size > 0) {
@@ -135,8 +183,6 @@ int audio_buffer_read(struct audio_buffer *buf, char *out, int max_len)
         int suggested_latency_bytes = buf->suggested_latency_ms * buf->desc.bps * buf->desc.ch_count * buf->desc.sample_rate / 1000;
         int requested_latency_bytes = max(suggested_latency_bytes, 2*max(buf->in_pkt_size, buf->out_pkt_size));
 
-        int ret = ring_buffer_read(buf->ring, out, max_len);
-
         // fiddle aggressivity
         if (buf->last_aggressivity_change >= AGGRESSIVITY_STEP) {
                 buf->last_aggressivity_change = 0;
@@ -149,16 +195,35 @@ int audio_buffer_read(struct audio_buffer *buf, char *out, int max_len)
                 buf->last_aggressivity_change += 1;
         }
 
-        // handle overruns
-        int remaining_bytes = ring_size - ret;
-        if (requested_latency_bytes < remaining_bytes) {
-                int len_drop = (1<<buf->aggressivity) * buf->desc.bps * buf->desc.ch_count * 128;
-                len_drop = min(len_drop, remaining_bytes / 2);
+        const int frame_size = buf->desc.bps * buf->desc.ch_count;
+        const int out_frames = max_len / frame_size;
+        const int max_comp = max(1, out_frames * (1 << buf->aggressivity) / DRIFT_COMP_RATE_DIV);
+        int comp = 0;
+        int ret = 0;
+        if (ring_size >= max_len && out_frames > 2 * max_comp) {
+                // handle overruns (writer faster) and approaching underruns (reader faster)
+                int left = ring_size - max_len;
+                if (requested_latency_bytes < left) {
+                        comp = min((left - requested_latency_bytes) / frame_size, max_comp);
+                } else if (buf->avg_occupancy[1] - max_len < requested_latency_bytes / 2) {
+                        comp = -max_comp;
+                }
+                read_compensated(buf, out, out_frames, comp);
+                ret = out_frames * frame_size;
+        } else {
+                ret = ring_buffer_read(buf->ring, out, max_len);
+        }
 
-                char *tmp = alloca(len_drop);
-                ring_buffer_read(buf->ring, tmp, len_drop);
-                buf->last_overrun = 0;
+        int remaining_bytes = ring_size - ret - comp * frame_size;
+        if (comp > 0 && remaining_bytes > 2 * requested_latency_bytes) {
+                // too far to be compensated smoothly (eg. after a burst), drop at once
+                int len_drop = (1<<buf->aggressivity) * frame_size * 128;
+                len_drop = min(len_drop, remaining_bytes / 2) / frame_size * frame_size;
+                ring_advance_read_idx(buf->ring, len_drop);
                 log_msg(LOG_LEVEL_VERBOSE, "Dropped audio samples: req latency %d remaining %d dropped %d!\n", requested_latency_bytes, remaining_bytes, len_drop);
+        }
+        if (comp > 0) {
+                buf->last_overrun = 0;
         } else {
                 buf->last_overrun += 1;
         }
@@ -175,7 +240,9 @@ void audio_buffer_write(struct audio_buffer *buf, const char *in, int len)
         } else {
                 buf->in_pkt_size = len;
         }
-        ring_buffer_write(buf->ring, in, len);
+        if (!ring_buffer_try_write(buf->ring, in, len)) {
+                log_msg(LOG_LEVEL_WARNING, "Audio buffer full, dropping %d B!\n", len);
+        }
 }
 
 struct audio_buffer_api audio_buffer_fns = {
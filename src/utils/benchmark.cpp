@@ -0,0 +1,390 @@
+/**
+ * @file   utils/benchmark.cpp
+ *
+ * Latencies and frame counts are taken from the frame tracing histograms
+ * (enabled by the benchmark) accumulated since the end of the warm-up. CPU
+ * time is sampled per thread from /proc (Linux only, otherwise only the
+ * process total is reported) and grouped by thread names, which correspond
+ * to the pipeline stages.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#ifdef __linux__
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "host.h"
+#include "module.h"
+#include "tv.h"
+#include "utils/benchmark.hpp"
+#include "utils/color_out.h"
+#include "utils/frame_trace.h"
+#include "utils/thread.h"
+
+#define DEFAULT_DURATION 10.0
+#define DEFAULT_WARMUP 2.0
+#define MOD_NAME "[benchmark] "
+
+using std::map;
+using std::mutex;
+using std::ostringstream;
+using std::pair;
+using std::string;
+using std::unique_lock;
+using std::vector;
+
+namespace {
+struct format_preset {
+        const char *name;
+        unsigned width;
+        unsigned height;
+        double fps;
+};
+
+const struct format_preset presets[] = {
+        { "720p30", 1280, 720, 30 },
+        { "720p60", 1280, 720, 60 },
+        { "1080p30", 1920, 1080, 30 },
+        { "1080p60", 1920, 1080, 60 },
+        { "4k30", 3840, 2160, 30 },
+        { "4k60", 3840, 2160, 60 },
+        { "8k30", 7680, 4320, 30 },
+};
+
+/// CPU time in ns per thread ID with the thread name
+using cpu_sample = map<long, pair<string, long long>>;
+} // end of anonymous namespace
+
+struct benchmark {
+        struct benchmark_options opts;
+        std::thread thread;
+        mutex lock;
+        std::condition_variable cv;
+        bool should_exit = false;
+};
+
+static void usage() {
+        color_printf(TBOLD("--benchmark") " runs the video pipeline locally (testcard -> compression -> "
+                        "transport to localhost -> decoder -> display dummy) and reports the results.\n\n");
+        color_printf("Usage:\n\t" TBOLD(TRED("--benchmark") " <format>[,duration=<s>][,warmup=<s>][,codec=<pixfmt>][,unpaced][,loopback][:<compression>]") "\n\n");
+        color_printf("\t" TBOLD("<format>") "      - preset or " TBOLD("<width>x<height>@<fps>") ", presets:");
+        for (auto const &p : presets) {
+                color_printf(" %s", p.name);
+        }
+        color_printf("\n\t" TBOLD("duration") "     - length of the measurement (default %.0f s)\n", DEFAULT_DURATION);
+        color_printf("\t" TBOLD("warmup") "       - time excluded from the results (default %.0f s)\n", DEFAULT_WARMUP);
+        color_printf("\t" TBOLD("codec") "        - pixel format of the testcard\n");
+        color_printf("\t" TBOLD("unpaced") "      - capture as fast as possible instead of at <fps>\n");
+        color_printf("\t" TBOLD("loopback") "     - pass frames directly to the display without RTP (uncompressed only)\n");
+        color_printf("\t" TBOLD("<compression>") " - as for " TBOLD("-c") ", eg. " TBOLD("libavcodec:codec=HEVC") " (default none)\n\n");
+        color_printf("Example:\n\t" TBOLD("uv --benchmark 4k60,duration=20:libavcodec:codec=HEVC") "\n\n");
+        color_printf("Explicitly given capture (-t) and display (-d) are used instead of the default ones.\n\n");
+}
+
+static bool parse_format(const char *str, struct benchmark_options *opts, unsigned *width, unsigned *height) {
+        for (auto const &p : presets) {
+                if (strcasecmp(str, p.name) == 0) {
+                        *width = p.width;
+                        *height = p.height;
+                        opts->fps = p.fps;
+                        return true;
+                }
+        }
+        char *end = nullptr;
+        *width = strtol(str, &end, 10);
+        if (*end != 'x') {
+                return false;
+        }
+        *height = strtol(end + 1, &end, 10);
+        if (*end != '@') {
+                return false;
+        }
+        opts->fps = strtod(end + 1, &end);
+        return *end == '\0' && *width > 0 && *height > 0 && opts->fps > 0;
+}
+
+/**
+ * @retval 0 success
+ * @retval 1 help printed
+ * @retval -1 error
+ */
+int benchmark_parse(const char *cfg, struct benchmark_options *opts)
+{
+        if (strcmp(cfg, "help") == 0) {
+                usage();
+                return 1;
+        }
+        string fmt = cfg;
+        if (fmt.find(':') != string::npos) {
+                opts->compression = fmt.substr(fmt.find(':') + 1);
+                fmt.resize(fmt.find(':'));
+        }
+        opts->duration = DEFAULT_DURATION;
+        opts->warmup = DEFAULT_WARMUP;
+        unsigned width = 0;
+        unsigned height = 0;
+        string codec;
+        bool unpaced = false;
+        char *tmp = strdup(fmt.c_str());
+        char *save_ptr = nullptr;
+        bool ret = true;
+        for (char *item = strtok_r(tmp, ",", &save_ptr); item != nullptr && ret; item = strtok_r(nullptr, ",", &save_ptr)) {
+                if (width == 0) {
+                        ret = parse_format(item, opts, &width, &height);
+                } else if (strstr(item, "duration=") == item) {
+                        opts->duration = atof(strchr(item, '=') + 1);
+                        ret = opts->duration > 0;
+                } else if (strstr(item, "warmup=") == item) {
+                        opts->warmup = atof(strchr(item, '=') + 1);
+                        ret = opts->warmup >= 0;
+                } else if (strstr(item, "codec=") == item) {
+                        codec = strchr(item, '=') + 1;
+                } else if (strcmp(item, "unpaced") == 0) {
+                        unpaced = true;
+                } else if (strcmp(item, "loopback") == 0) {
+                        opts->loopback = true;
+                } else {
+                        ret = false;
+                }
+                if (!ret) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << (width == 0 ? "Wrong format: " : "Wrong option: ") << item << "\n";
+                }
+        }
+        free(tmp);
+        if (!ret || width == 0) {
+                if (ret) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME "Missing format, see \"--benchmark help\".\n";
+                }
+                return -1;
+        }
+        if (opts->loopback && !opts->compression.empty() && opts->compression != "none") {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME "Loopback transport doesn't decompress, use it without compression.\n";
+                return -1;
+        }
+        ostringstream capture;
+        capture << "testcard:size=" << width << "x" << height << ":fps=" << opts->fps;
+        if (!codec.empty()) {
+                capture << ":codec=" << codec;
+        }
+        if (unpaced) {
+                capture << ":unlimited";
+        }
+        opts->capture = capture.str();
+        ostringstream desc;
+        desc << width << "x" << height << " @" << opts->fps << (unpaced ? " (unpaced)" : "");
+        opts->format = desc.str();
+        return 0;
+}
+
+static cpu_sample get_cpu_sample() {
+        cpu_sample ret;
+#ifdef __linux__
+        DIR *dir = opendir("/proc/self/task");
+        if (dir == nullptr) {
+                return ret;
+        }
+        const long long ns_per_tick = NS_IN_SEC / sysconf(_SC_CLK_TCK);
+        while (struct dirent *ent = readdir(dir)) {
+                if (ent->d_name[0] == '.') {
+                        continue;
+                }
+                char path[300];
+                snprintf(path, sizeof path, "/proc/self/task/%s/stat", ent->d_name);
+                FILE *f = fopen(path, "r");
+                if (f == nullptr) {
+                        continue;
+                }
+                char buf[1024] = "";
+                size_t len = fread(buf, 1, sizeof buf - 1, f);
+                fclose(f);
+                buf[len] = '\0';
+                // pid (comm) state ... utime(14) stime(15); comm may contain spaces and parentheses
+                char *name_start = strchr(buf, '(');
+                char *name_end = strrchr(buf, ')');
+                if (name_start == nullptr || name_end == nullptr) {
+                        continue;
+                }
+                unsigned long long utime = 0;
+                unsigned long long stime = 0;
+                if (sscanf(name_end + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2) {
+                        continue;
+                }
+                ret[atol(ent->d_name)] = { string(name_start + 1, name_end), (long long) (utime + stime) * ns_per_tick };
+        }
+        closedir(dir);
+#endif
+        return ret;
+}
+
+static long long get_process_cpu_ns() {
+#ifdef _WIN32
+        return 0;
+#else
+        struct rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * NS_IN_SEC
+                + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * NS_IN_US;
+#endif
+}
+
+static void print_latency(const char *label, int stage) {
+        time_ns_t p50 = 0;
+        time_ns_t p99 = 0;
+        if (frame_trace_get_run_latency(true, stage, 50, &p50) == 0) {
+                return;
+        }
+        frame_trace_get_run_latency(true, stage, 99, &p99);
+        color_printf("  %-22s p50 %8.2f ms   p99 %8.2f ms\n", label, (double) p50 / NS_IN_MS, (double) p99 / NS_IN_MS);
+}
+
+static void report(struct benchmark_options const &opts, double elapsed, cpu_sample const &start,
+                cpu_sample const &end, long long process_cpu) {
+        const int sent = frame_trace_get_run_latency(false, FT_STAGE_COUNT, 50, nullptr);
+        const int displayed = frame_trace_get_run_latency(true, FT_STAGE_COUNT, 50, nullptr);
+        const int dropped = std::max(sent - displayed, 0);
+        time_ns_t g2g_p50 = 0;
+        time_ns_t g2g_p99 = 0;
+        frame_trace_get_run_latency(true, FT_STAGE_COUNT, 50, &g2g_p50);
+        frame_trace_get_run_latency(true, FT_STAGE_COUNT, 99, &g2g_p99);
+
+        color_printf("\n" TBOLD("Benchmark results") " - %s, compression %s, %s, %.1f s:\n", opts.format.c_str(),
+                        opts.compression.empty() ? "none" : opts.compression.c_str(),
+                        opts.loopback ? "loopback" : "UDP localhost", elapsed);
+        color_printf("  frames                 sent %d, displayed %d, dropped %d (%.2f %%)\n", sent, displayed, dropped,
+                        sent > 0 ? 100.0 * dropped / sent : 0.0);
+        color_printf("  frame rate             " TBOLD("%.2f") " fps (requested %.2f)\n", displayed / elapsed, opts.fps);
+        print_latency("glass-to-glass", FT_STAGE_COUNT);
+        for (int i = 0; i < FT_STAGE_COUNT; ++i) {
+                print_latency(frame_trace_stage_name(i), i);
+        }
+
+        map<string, long long> per_name;
+        for (auto const &thr : end) {
+                auto it = start.find(thr.first);
+                long long cpu = thr.second.second - (it != start.end() ? it->second.second : 0);
+                per_name[thr.second.first] += cpu;
+        }
+        vector<pair<string, long long>> sorted(per_name.begin(), per_name.end());
+        std::sort(sorted.begin(), sorted.end(), [](auto const &a, auto const &b) { return a.second > b.second; });
+        color_printf("  CPU time               %.3f s (%.0f %% of a core)\n", (double) process_cpu / NS_IN_SEC,
+                        100.0 * process_cpu / NS_IN_SEC / elapsed);
+        for (auto const &thr : sorted) {
+                if (thr.second > 0) {
+                        color_printf("    %-20s %.3f s (%.0f %%)\n", thr.first.c_str(), (double) thr.second / NS_IN_SEC,
+                                        100.0 * thr.second / NS_IN_SEC / elapsed);
+                }
+        }
+        // single line for scripts
+        printf("BENCHMARK fps=%.2f sent=%d displayed=%d dropped=%d g2g_p50_ms=%.3f g2g_p99_ms=%.3f cpu_s=%.3f\n\n",
+                        displayed / elapsed, sent, displayed, dropped, (double) g2g_p50 / NS_IN_MS,
+                        (double) g2g_p99 / NS_IN_MS, (double) process_cpu / NS_IN_SEC);
+        fflush(stdout);
+}
+
+static void benchmark_run(struct benchmark *b) {
+        set_thread_name(__func__);
+        using std::chrono::duration;
+        unique_lock<mutex> lk(b->lock);
+        if (b->cv.wait_for(lk, duration<double>(b->opts.warmup), [b] { return b->should_exit; })) {
+                LOG(LOG_LEVEL_WARNING) << MOD_NAME "Interrupted during the warm-up, no results.\n";
+                return;
+        }
+        frame_trace_reset_run();
+        const cpu_sample cpu_start = get_cpu_sample();
+        const long long process_cpu_start = get_process_cpu_ns();
+        const time_ns_t t0 = get_time_in_ns();
+        LOG(LOG_LEVEL_INFO) << MOD_NAME "Measuring for " << b->opts.duration << " s...\n";
+
+        const bool interrupted = b->cv.wait_for(lk, duration<double>(b->opts.duration), [b] { return b->should_exit; });
+        const double elapsed = (double) (get_time_in_ns() - t0) / NS_IN_SEC;
+        report(b->opts, elapsed, cpu_start, get_cpu_sample(), get_process_cpu_ns() - process_cpu_start);
+        if (!interrupted) {
+                exit_uv(0);
+        }
+}
+
+static void benchmark_should_exit(void *udata) {
+        auto *b = static_cast<struct benchmark *>(udata);
+        unique_lock<mutex> lk(b->lock);
+        b->should_exit = true;
+        b->cv.notify_one();
+}
+
+/**
+ * Starts the measurement thread, which calls exit_uv() when done.
+ * @note only one benchmark per process (the state is static so that the
+ * should-exit callback, which cannot be unregistered, stays valid)
+ */
+struct benchmark *benchmark_start(struct module *root, struct benchmark_options const &opts)
+{
+        static struct benchmark state;
+        struct benchmark *b = &state;
+        assert(!b->thread.joinable());
+        b->opts = opts;
+        register_should_exit_callback(root, benchmark_should_exit, b);
+        b->thread = std::thread(benchmark_run, b);
+        return b;
+}
+
+void benchmark_done(struct benchmark *b)
+{
+        if (b == nullptr) {
+                return;
+        }
+        benchmark_should_exit(b);
+        b->thread.join();
+}
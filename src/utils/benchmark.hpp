@@ -0,0 +1,65 @@
+/**
+ * @file   utils/benchmark.hpp
+ * @brief  local end-to-end benchmark of the video pipeline (--benchmark)
+ *
+ * Wires testcard, the requested compression, the transport to localhost,
+ * decoder and dummy display, runs for a given time and reports the achieved
+ * frame rate, drops, glass-to-glass latency (from frame tracing) and CPU
+ * time of the pipeline threads.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_BENCHMARK_HPP_6D0B51A3
+#define UTILS_BENCHMARK_HPP_6D0B51A3
+
+#include <string>
+
+struct benchmark;
+struct module;
+
+struct benchmark_options {
+        std::string capture;      ///< testcard configuration
+        std::string compression;  ///< empty if not given
+        std::string format;       ///< human readable format description
+        double fps = 0;
+        bool loopback = false;    ///< use loopback rxtx instead of UDP to localhost
+        double warmup = 0;        ///< seconds not counted to the results
+        double duration = 0;      ///< seconds of the measurement
+};
+
+int benchmark_parse(const char *cfg, struct benchmark_options *opts);
+struct benchmark *benchmark_start(struct module *root, struct benchmark_options const &opts);
+void benchmark_done(struct benchmark *b);
+
+#endif // defined UTILS_BENCHMARK_HPP_6D0B51A3
@@ -0,0 +1,221 @@
+/**
+ * @file   utils/cpu_features.c
+ *
+ * Detection uses __builtin_cpu_supports() on x86 and the auxiliary vector
+ * (or the compile-time baseline) on ARM. The usable set may be restricted
+ * with "--param cpu-features" to test the fallback paths. Selectors are
+ * registered from constructors, so the whole state is static and filled
+ * before any threads are started.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined __linux__ && (defined __aarch64__ || defined __arm__)
+#include <sys/auxv.h>
+#ifdef __aarch64__
+#include <asm/hwcap.h>
+#endif
+#endif
+
+#include "debug.h"
+#include "host.h"
+#include "utils/color_out.h"
+#include "utils/cpu_features.h"
+#include "utils/macros.h"
+
+#define MAX_SELECTORS 32
+#define MOD_NAME "[cpu features] "
+
+static const struct {
+        unsigned feature;
+        const char *name;
+} feature_names[] = {
+        { CPU_FEATURE_SSE2, "sse2" },
+        { CPU_FEATURE_SSSE3, "ssse3" },
+        { CPU_FEATURE_SSE41, "sse4.1" },
+        { CPU_FEATURE_SSE42, "sse4.2" },
+        { CPU_FEATURE_PCLMUL, "pclmul" },
+        { CPU_FEATURE_AES, "aes" },
+        { CPU_FEATURE_AVX2, "avx2" },
+        { CPU_FEATURE_AVX512, "avx512" },
+        { CPU_FEATURE_NEON, "neon" },
+        { CPU_FEATURE_ARMV8_CRC, "crc" },
+};
+
+static bool detected_init;
+static unsigned detected;
+static unsigned enabled = ~0U;
+static void (*selectors[MAX_SELECTORS])(void);
+static int selector_count;
+
+ADD_TO_PARAM("cpu-features", "* cpu-features=<f1>[:<f2>...]|-<f1>[:-<f2>...]|none|help\n"
+                "  Use only the listed SIMD features (or all detected except the ones prefixed with '-'), 'none' for the scalar code\n");
+
+static unsigned detect(void) {
+        unsigned ret = 0;
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+        __builtin_cpu_init();
+        ret |= __builtin_cpu_supports("sse2") ? CPU_FEATURE_SSE2 : 0;
+        ret |= __builtin_cpu_supports("ssse3") ? CPU_FEATURE_SSSE3 : 0;
+        ret |= __builtin_cpu_supports("sse4.1") ? CPU_FEATURE_SSE41 : 0;
+        ret |= __builtin_cpu_supports("sse4.2") ? CPU_FEATURE_SSE42 : 0;
+        ret |= __builtin_cpu_supports("pclmul") ? CPU_FEATURE_PCLMUL : 0;
+        ret |= __builtin_cpu_supports("aes") ? CPU_FEATURE_AES : 0;
+        ret |= __builtin_cpu_supports("avx2") ? CPU_FEATURE_AVX2 : 0;
+        ret |= __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") ? CPU_FEATURE_AVX512 : 0;
+#elif defined __aarch64__
+        ret |= CPU_FEATURE_NEON; // mandatory in ARMv8-A
+#if defined __linux__ && defined HWCAP_CRC32
+        ret |= (getauxval(AT_HWCAP) & HWCAP_CRC32) ? CPU_FEATURE_ARMV8_CRC : 0;
+#elif defined __ARM_FEATURE_CRC32
+        ret |= CPU_FEATURE_ARMV8_CRC;
+#endif
+#elif defined __arm__
+#if defined __linux__
+        ret |= (getauxval(AT_HWCAP) & (1U << 12) /* HWCAP_NEON */) ? CPU_FEATURE_NEON : 0;
+#elif defined __ARM_NEON
+        ret |= CPU_FEATURE_NEON;
+#endif
+#endif
+        return ret;
+}
+
+/// @returns all features detected on the current CPU (regardless of --param cpu-features)
+unsigned cpu_features_detected(void)
+{
+        if (!detected_init) {
+                detected = detect();
+                detected_init = true;
+        }
+        return detected;
+}
+
+/**
+ * @returns true if all of the features are supported by the CPU and not
+ * disabled by the user
+ */
+bool cpu_has(unsigned features)
+{
+        return (cpu_features_detected() & enabled & features) == features;
+}
+
+/**
+ * Registers a function that selects the kernels of a module with cpu_has().
+ * It is called immediately and again whenever the enabled set changes.
+ */
+void cpu_features_register(void (*select)(void))
+{
+        assert(selector_count < MAX_SELECTORS);
+        selectors[selector_count++] = select;
+        select();
+}
+
+void cpu_features_format(unsigned features, char *buf, size_t buflen)
+{
+        assert(buflen > 0);
+        buf[0] = '\0';
+        size_t len = 0;
+        for (unsigned i = 0; i < sizeof feature_names / sizeof feature_names[0]; ++i) {
+                if ((features & feature_names[i].feature) != 0 && len < buflen) {
+                        len += snprintf(buf + len, buflen - len, "%s%s", len > 0 ? " " : "", feature_names[i].name);
+                }
+        }
+        if (len == 0) {
+                snprintf(buf, buflen, "none");
+        }
+}
+
+static unsigned parse_feature(const char *name) {
+        for (unsigned i = 0; i < sizeof feature_names / sizeof feature_names[0]; ++i) {
+                if (strcasecmp(name, feature_names[i].name) == 0) {
+                        return feature_names[i].feature;
+                }
+        }
+        return 0;
+}
+
+/**
+ * Restricts the usable features according to cfg (syntax of --param
+ * cpu-features) and reselects the kernels of all modules.
+ *
+ * @param cfg  configuration or NULL to enable all detected features
+ * @retval  0 success
+ * @retval  1 help was printed
+ * @retval -1 wrong configuration
+ */
+int cpu_features_configure(const char *cfg)
+{
+        char buf[256];
+        if (cfg != NULL && strcmp(cfg, "help") == 0) {
+                cpu_features_format(cpu_features_detected(), buf, sizeof buf);
+                color_printf("Detected CPU features: " TBOLD("%s") "\n", buf);
+                return 1;
+        }
+        unsigned new_enabled = ~0U;
+        if (cfg != NULL && strcmp(cfg, "none") == 0) {
+                new_enabled = 0;
+        } else if (cfg != NULL && strlen(cfg) > 0) {
+                bool removing = cfg[0] == '-';
+                new_enabled = removing ? ~0U : 0;
+                char *tmp = strdup(cfg);
+                char *save_ptr = NULL;
+                for (char *item = strtok_r(tmp, ":", &save_ptr); item != NULL; item = strtok_r(NULL, ":", &save_ptr)) {
+                        if ((item[0] == '-') != removing || parse_feature(item + removing) == 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong feature: %s\n", item);
+                                free(tmp);
+                                return -1;
+                        }
+                        unsigned f = parse_feature(item + removing);
+                        new_enabled = removing ? new_enabled & ~f : new_enabled | f;
+                }
+                free(tmp);
+        }
+        enabled = new_enabled;
+        for (int i = 0; i < selector_count; ++i) {
+                selectors[i]();
+        }
+        cpu_features_format(cpu_features_detected() & enabled, buf, sizeof buf);
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using: %s\n", buf);
+        return 0;
+}
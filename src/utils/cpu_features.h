@@ -0,0 +1,81 @@
+/**
+ * @file   utils/cpu_features.h
+ * @brief  runtime detection of CPU SIMD features for kernel dispatch
+ *
+ * SIMD kernels are compiled with the target attribute regardless of the
+ * compiler flags and selected at run time, so that one binary uses the best
+ * variant of the CPU. Modules select their kernels in a selector function
+ * registered with cpu_features_register(), which is called again if the
+ * usable set changes (--param cpu-features).
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_CPU_FEATURES_H_
+#define UTILS_CPU_FEATURES_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stddef.h>
+#else
+#include <cstddef>
+#endif
+
+enum cpu_feature {
+        CPU_FEATURE_SSE2   = 1U << 0,
+        CPU_FEATURE_SSSE3  = 1U << 1,
+        CPU_FEATURE_SSE41  = 1U << 2,
+        CPU_FEATURE_SSE42  = 1U << 3,
+        CPU_FEATURE_PCLMUL = 1U << 4,
+        CPU_FEATURE_AES    = 1U << 5,
+        CPU_FEATURE_AVX2   = 1U << 6,
+        CPU_FEATURE_AVX512 = 1U << 7, ///< AVX-512 F and BW
+        CPU_FEATURE_NEON   = 1U << 8,
+        CPU_FEATURE_ARMV8_CRC = 1U << 9,
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool cpu_has(unsigned features);
+unsigned cpu_features_detected(void);
+void cpu_features_register(void (*select)(void));
+int cpu_features_configure(const char *cfg);
+void cpu_features_format(unsigned features, char *buf, size_t buflen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_CPU_FEATURES_H_
@@ -193,3 +193,167 @@ void cuda_UYVY_to_RGBA(unsigned char *dst,
 
         kern_UYVYtoRGBA<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height);
 }
+
+/// one thread converts one v210 block (6 pixels in 16 bytes) to 12 UYVY bytes
+__global__
+void kern_v210toUYVY(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height)
+{
+        const int block = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if(block * 6 >= width)
+                return;
+
+        if(y >= height)
+                return;
+
+        const uint4 w = *((uint4 *) (src + y * srcPitch) + block);
+        const uint32_t words[4] = { w.x, w.y, w.z, w.w };
+        unsigned char out[12];
+        for (int i = 0; i < 12; ++i) {
+                // 3 10-bit components per word, keep the 8 most significant bits
+                out[i] = (words[i / 3] >> (10 * (i % 3) + 2)) & 0xFFU;
+        }
+
+        unsigned char *dst_px = dst + y * dstPitch + block * 12;
+        const int count = min(12, (int) (width * 2 - block * 12));
+        for (int i = 0; i < count; ++i) {
+                dst_px[i] = out[i];
+        }
+}
+
+/// one thread converts 2 Y216 pixels (little-endian 16-bit Y0 Cb Y1 Cr) to UYVY
+__global__
+void kern_Y216toUYVY(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if(x * 2 + 1 >= width)
+                return;
+
+        if(y >= height)
+                return;
+
+        const ushort4 px = *((ushort4 *) (src + y * srcPitch) + x);
+        uchar4 *dst_px = (uchar4 *) (dst + y * dstPitch) + x;
+
+        *dst_px = make_uchar4(px.y >> 8, px.x >> 8, px.w >> 8, px.z >> 8);
+}
+
+/// R10k is big-endian RRRRRRRR RRGGGGGG GGGGBBBB BBBBBBxx
+__global__
+void kern_R10ktoRGB(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if(x >= width)
+                return;
+
+        if(y >= height)
+                return;
+
+        const uchar4 px = *((uchar4 *) (src + y * srcPitch) + x);
+        uchar3 *dst_px = (uchar3 *) (dst + y * dstPitch) + x;
+
+        *dst_px = make_uchar3(px.x, (px.y << 2) | (px.z >> 6), ((px.z & 0xF) << 4) | (px.w >> 4));
+}
+
+__global__
+void kern_RG48toRGB(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if(x >= width)
+                return;
+
+        if(y >= height)
+                return;
+
+        const ushort3 px = *((ushort3 *) (src + y * srcPitch) + x);
+        uchar3 *dst_px = (uchar3 *) (dst + y * dstPitch) + x;
+
+        *dst_px = make_uchar3(px.x >> 8, px.y >> 8, px.z >> 8);
+}
+
+void cuda_v210_to_UYVY(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                CUstream_st *stream){
+
+        dim3 blockSize(32,32);
+        dim3 numBlocks(((width + 5) / 6 + blockSize.x - 1) / blockSize.x,
+                        (height + blockSize.y - 1) / blockSize.y);
+
+        kern_v210toUYVY<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height);
+}
+
+void cuda_Y216_to_UYVY(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                CUstream_st *stream){
+
+        dim3 blockSize(32,32);
+        dim3 numBlocks((width / 2 + blockSize.x - 1) / blockSize.x,
+                        (height + blockSize.y - 1) / blockSize.y);
+
+        kern_Y216toUYVY<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height);
+}
+
+void cuda_R10k_to_RGB(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                CUstream_st *stream){
+
+        dim3 blockSize(32,32);
+        dim3 numBlocks((width + blockSize.x - 1) / blockSize.x,
+                        (height + blockSize.y - 1) / blockSize.y);
+
+        kern_R10ktoRGB<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height);
+}
+
+void cuda_RG48_to_RGB(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                CUstream_st *stream){
+
+        dim3 blockSize(32,32);
+        dim3 numBlocks((width + blockSize.x - 1) / blockSize.x,
+                        (height + blockSize.y - 1) / blockSize.y);
+
+        kern_RG48toRGB<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height);
+}
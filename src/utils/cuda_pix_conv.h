@@ -35,4 +35,36 @@ void cuda_UYVY_to_RGBA(unsigned char *dst,
                 size_t height,
                 struct CUstream_st *stream);
 
+void cuda_v210_to_UYVY(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                struct CUstream_st *stream);
+
+void cuda_Y216_to_UYVY(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                struct CUstream_st *stream);
+
+void cuda_R10k_to_RGB(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                struct CUstream_st *stream);
+
+void cuda_RG48_to_RGB(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                struct CUstream_st *stream);
+
 #endif
@@ -0,0 +1,153 @@
+/**
+ * @file   utils/frame_copy.c
+ *
+ * Non-temporal (streaming) stores write the destination directly to the
+ * memory without reading it into the cache first, so a frame copy doesn't
+ * evict the working set of the other stages (decoder, encoder) from the
+ * shared cache. It is worth only when the destination is consumed by
+ * another thread or device, not re-read by the same core immediately.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#define HAVE_MEMCPY_NT_X86 1
+#endif
+
+#include "utils/cpu_features.h"
+#include "utils/frame_copy.h"
+#include "utils/worker.h"
+
+#define STRIPE_SIZE (1024 * 1024)
+
+#ifdef HAVE_MEMCPY_NT_X86
+__attribute__((target("sse2")))
+static size_t memcpy_nt_sse2(char *dst, const char *src, size_t len)
+{
+        size_t i = 0;
+        for ( ; i + 64 <= len; i += 64) {
+                __m128i a = _mm_loadu_si128((const __m128i *)(const void *) (src + i));
+                __m128i b = _mm_loadu_si128((const __m128i *)(const void *) (src + i + 16));
+                __m128i c = _mm_loadu_si128((const __m128i *)(const void *) (src + i + 32));
+                __m128i d = _mm_loadu_si128((const __m128i *)(const void *) (src + i + 48));
+                _mm_stream_si128((__m128i *)(void *) (dst + i), a);
+                _mm_stream_si128((__m128i *)(void *) (dst + i + 16), b);
+                _mm_stream_si128((__m128i *)(void *) (dst + i + 32), c);
+                _mm_stream_si128((__m128i *)(void *) (dst + i + 48), d);
+        }
+        _mm_sfence();
+        return i;
+}
+
+__attribute__((target("avx2")))
+static size_t memcpy_nt_avx2(char *dst, const char *src, size_t len)
+{
+        size_t i = 0;
+        for ( ; i + 64 <= len; i += 64) {
+                __m256i a = _mm256_loadu_si256((const __m256i *)(const void *) (src + i));
+                __m256i b = _mm256_loadu_si256((const __m256i *)(const void *) (src + i + 32));
+                _mm256_stream_si256((__m256i *)(void *) (dst + i), a);
+                _mm256_stream_si256((__m256i *)(void *) (dst + i + 32), b);
+        }
+        _mm_sfence();
+        return i;
+}
+#endif // defined HAVE_MEMCPY_NT_X86
+
+/**
+ * Copies len bytes with non-temporal stores if supported by the CPU (plain
+ * memcpy otherwise). The stores are fenced before return so the data may be
+ * handed over to another thread by the usual synchronization.
+ */
+void memcpy_nt(void *__restrict dst, const void *__restrict src, size_t len)
+{
+#ifdef HAVE_MEMCPY_NT_X86
+        // the streaming stores need an aligned destination, the head is copied normally
+        size_t head = (64 - ((uintptr_t) dst & 63)) & 63;
+        if (len >= head + 64 && cpu_has(CPU_FEATURE_SSE2)) {
+                char *d = (char *) dst;
+                const char *s = (const char *) src;
+                memcpy(d, s, head);
+                d += head;
+                s += head;
+                len -= head;
+                size_t done = cpu_has(CPU_FEATURE_AVX2) ? memcpy_nt_avx2(d, s, len)
+                        : memcpy_nt_sse2(d, s, len);
+                memcpy(d + done, s + done, len - done);
+                return;
+        }
+#endif
+        memcpy(dst, src, len);
+}
+
+struct frame_copy_data {
+        char *dst;
+        const char *src;
+        size_t len;
+};
+
+static void frame_copy_body(void *udata, size_t begin, size_t end)
+{
+        struct frame_copy_data *d = udata;
+        size_t off = begin * STRIPE_SIZE;
+        size_t len = end * STRIPE_SIZE < d->len ? end * STRIPE_SIZE - off : d->len - off;
+        memcpy_nt(d->dst + off, d->src + off, len);
+}
+
+/**
+ * Copies a frame buffer. Short buffers are copied with memcpy, long with
+ * memcpy_nt() and the longest are also split into stripes copied in
+ * parallel by the worker pool (a single core usually cannot saturate the
+ * memory bandwidth).
+ */
+void frame_copy(void *__restrict dst, const void *__restrict src, size_t len)
+{
+        if (len < FRAME_COPY_NT_THRESHOLD) {
+                memcpy(dst, src, len);
+        } else if (len < FRAME_COPY_PARALLEL_THRESHOLD) {
+                memcpy_nt(dst, src, len);
+        } else {
+                struct frame_copy_data d = { dst, src, len };
+                task_run_parallel_for((len + STRIPE_SIZE - 1) / STRIPE_SIZE, 1, frame_copy_body, &d);
+        }
+}
@@ -0,0 +1,451 @@
+/**
+ * @file   utils/frame_trace.cpp
+ * @brief  end-to-end per-frame latency tracing
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // defined HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "control_socket.h"
+#include "debug.h"
+#include "host.h"
+#include "module.h"
+#include "rtp/rtp.h"
+#include "utils/frame_trace.h"
+#include "utils/metrics.h"
+
+#define MOD_NAME "[frame trace] "
+#define REPORT_INTERVAL (5 * NS_IN_SEC)
+#define MAX_PENDING_REPORTS 64 ///< sender reports waiting for the frame to be displayed
+#define HIST_SUB_BUCKETS 4     ///< histogram buckets per octave
+#define HIST_BUCKETS 112       ///< covers latencies up to 2^28 us
+#define FRAME_TRACE_PACKED_LEN (4 + 8 * FT_SENDER_STAGES)
+
+using std::deque;
+using std::lock_guard;
+using std::mutex;
+using std::ostringstream;
+using std::string;
+using std::vector;
+
+ADD_TO_PARAM("frame-trace", "* frame-trace\n"
+                "  Trace latencies of the video pipeline stages per frame, histograms are reported over control socket (\"FTRACE ...\").\n"
+                "  Must be enabled on both sender and receiver, network latency assumes synchronized clocks.\n");
+
+namespace {
+struct stage_info {
+        const char *name;
+        enum frame_trace_stage ref; ///< stage latency is measured from (or the nearest recorded one before)
+};
+
+const struct stage_info stage_info[FT_STAGE_COUNT] = {
+        { "capture", FT_CAPTURE },
+        { "filter", FT_CAPTURE },
+        { "compress_queue", FT_FILTER },
+        { "compress", FT_COMPRESS_START },
+        { "tx_queue", FT_COMPRESS_END },
+        { "tx", FT_TX_FIRST },
+        { "network", FT_TX_FIRST },
+        { "rx", FT_RX_FIRST },
+        { "playout_fec", FT_RX_LAST },
+        { "decompress", FT_FEC },
+        { "display", FT_DECOMPRESS },
+};
+
+/**
+ * Log-linear histogram of latencies in microseconds - values below
+ * HIST_SUB_BUCKETS have own bucket, greater are divided to HIST_SUB_BUCKETS
+ * buckets per power of two.
+ */
+struct latency_hist {
+        int count = 0;
+        time_ns_t max = 0;
+        unsigned buckets[HIST_BUCKETS] = {};
+
+        static int bucket(long long us) {
+                if (us < HIST_SUB_BUCKETS) {
+                        return (int) us;
+                }
+                int e = 2;
+                while ((us >> (e + 1)) > 0) {
+                        e += 1;
+                }
+                int idx = HIST_SUB_BUCKETS * (e - 1) + ((us >> (e - 2)) & (HIST_SUB_BUCKETS - 1));
+                return std::min(idx, HIST_BUCKETS - 1);
+        }
+        static long long lower_bound(int idx) {
+                if (idx < HIST_SUB_BUCKETS) {
+                        return idx;
+                }
+                int e = idx / HIST_SUB_BUCKETS + 1;
+                return (long long) (HIST_SUB_BUCKETS + idx % HIST_SUB_BUCKETS) << (e - 2);
+        }
+        void add(time_ns_t latency) {
+                latency = std::max<time_ns_t>(latency, 0); // clock skew between hosts
+                buckets[bucket(latency / NS_IN_US)] += 1;
+                max = std::max(max, latency);
+                count += 1;
+        }
+        /// @returns upper bound of the bucket containing the percentile
+        time_ns_t percentile(double p) const {
+                long long needed = (long long) (p / 100.0 * count + 0.5);
+                long long sum = 0;
+                for (int i = 0; i < HIST_BUCKETS; ++i) {
+                        sum += buckets[i];
+                        if (sum >= std::max(needed, 1LL)) {
+                                return std::min(lower_bound(i + 1) * NS_IN_US, max);
+                        }
+                }
+                return max;
+        }
+};
+
+struct trace_hists {
+        const char *name;
+        latency_hist stage[FT_STAGE_COUNT];
+        latency_hist total;
+        latency_hist run_stage[FT_STAGE_COUNT + 1]; ///< since frame_trace_reset_run(), not cleared by reports, the last one is total
+        time_ns_t last_report = 0;
+        struct metric *metric[FT_STAGE_COUNT + 1] = {}; ///< ug_frame_stage_latency_seconds, the last one is total
+
+        explicit trace_hists(const char *n) : name(n) {}
+        void clear() {
+                for (auto &h : stage) {
+                        h = latency_hist();
+                }
+                total = latency_hist();
+        }
+};
+
+struct frame_trace_state {
+        mutex lock;
+        struct control_state *control = nullptr;
+        trace_hists sender{"tx"};
+        trace_hists receiver{"rx"};
+        deque<struct frame_trace> pending; ///< received sender stages
+        deque<struct frame_trace> local;   ///< stages of own sent frames (RTCP from own SSRC is not received when sending to itself)
+};
+
+frame_trace_state &get_state() {
+        static frame_trace_state state;
+        return state;
+}
+} // end of anonymous namespace
+
+static struct metric *get_stage_metric(trace_hists *h, int stage)
+{
+        if (h->metric[stage] == nullptr) {
+                static const double bounds[] = { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+                        0.025, 0.05, 0.1, 0.25, 0.5, 1 };
+                char labels[64];
+                snprintf(labels, sizeof labels, "side=\"%s\",stage=\"%s\"", h->name,
+                                stage < FT_STAGE_COUNT ? stage_info[stage].name : "total");
+                h->metric[stage] = metric_histogram("ug_frame_stage_latency_seconds",
+                                "Latency of the video frame pipeline stages (frame tracing)",
+                                labels, bounds, sizeof bounds / sizeof bounds[0]);
+        }
+        return h->metric[stage];
+}
+
+static void record(trace_hists *h, const struct frame_trace *trace, int stage_count)
+{
+        int first = -1;
+        int last = -1;
+        for (int i = 0; i < stage_count; ++i) {
+                if (trace->t[i] == 0) {
+                        continue;
+                }
+                if (first == -1) {
+                        first = i;
+                }
+                last = i;
+                int ref = stage_info[i].ref;
+                while (ref >= 0 && trace->t[ref] == 0) {
+                        ref -= 1;
+                }
+                if (ref >= 0 && ref != i) {
+                        h->stage[i].add(trace->t[i] - trace->t[ref]);
+                        h->run_stage[i].add(trace->t[i] - trace->t[ref]);
+                        metric_observe(get_stage_metric(h, i), (double) (trace->t[i] - trace->t[ref]) / NS_IN_SEC);
+                }
+        }
+        if (first != last) {
+                h->total.add(trace->t[last] - trace->t[first]);
+                h->run_stage[FT_STAGE_COUNT].add(trace->t[last] - trace->t[first]);
+                metric_observe(get_stage_metric(h, FT_STAGE_COUNT), (double) (trace->t[last] - trace->t[first]) / NS_IN_SEC);
+        }
+}
+
+static void format_hist(vector<string> *lines, const trace_hists *h, const char *stage, const latency_hist *hist)
+{
+        if (hist->count == 0) {
+                return;
+        }
+        ostringstream oss;
+        oss << "FTRACE " << h->name << " stage=" << stage << " frames=" << hist->count
+                << " p50_us=" << hist->percentile(50) / NS_IN_US
+                << " p90_us=" << hist->percentile(90) / NS_IN_US
+                << " p99_us=" << hist->percentile(99) / NS_IN_US
+                << " max_us=" << hist->max / NS_IN_US << " hist=";
+        const char *sep = "";
+        for (int i = 0; i < HIST_BUCKETS; ++i) {
+                if (hist->buckets[i] > 0) {
+                        oss << sep << latency_hist::lower_bound(i) << ":" << hist->buckets[i];
+                        sep = ",";
+                }
+        }
+        lines->push_back(oss.str());
+}
+
+/// formats and clears the histograms if the report interval elapsed
+static void collect_report(vector<string> *lines, trace_hists *h, time_ns_t now)
+{
+        if (h->last_report == 0) {
+                h->last_report = now;
+        }
+        if (now - h->last_report < REPORT_INTERVAL) {
+                return;
+        }
+        for (int i = 0; i < FT_STAGE_COUNT; ++i) {
+                format_hist(lines, h, stage_info[i].name, &h->stage[i]);
+        }
+        format_hist(lines, h, "total", &h->total);
+        h->clear();
+        h->last_report = now;
+}
+
+static void report(frame_trace_state &s, vector<string> const &lines)
+{
+        for (auto const &line : lines) {
+                LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << line << "\n";
+                if (s.control != nullptr) {
+                        control_report_stats(s.control, line);
+                }
+        }
+}
+
+bool frame_trace_enabled(void)
+{
+        return get_commandline_param("frame-trace") != nullptr;
+}
+
+void frame_trace_init(struct module *parent)
+{
+        frame_trace_state &s = get_state();
+        lock_guard<mutex> lk(s.lock);
+        if (s.control == nullptr && parent != nullptr) {
+                s.control = (struct control_state *) get_module(get_root_module(parent), "control");
+        }
+}
+
+/**
+ * Records the sender stages and sends them to the receiver.
+ *
+ * @param session RTP session the frame was sent over (may be NULL)
+ */
+void frame_trace_sender_done(const struct frame_trace *trace, struct rtp *session)
+{
+        if (session != nullptr) {
+                char buf[FRAME_TRACE_PACKED_LEN];
+                int len = frame_trace_pack(trace, buf, sizeof buf);
+                if (len > 0 && !rtp_send_app(session, FRAME_TRACE_APP_NAME, buf, len)) {
+                        LOG(LOG_LEVEL_DEBUG) << MOD_NAME "Cannot send sender report (encryption?)\n";
+                }
+        }
+
+        frame_trace_state &s = get_state();
+        vector<string> lines;
+        {
+                lock_guard<mutex> lk(s.lock);
+                record(&s.sender, trace, FT_SENDER_STAGES);
+                s.local.push_back(*trace);
+                if (s.local.size() > MAX_PENDING_REPORTS) {
+                        s.local.pop_front();
+                }
+                collect_report(&lines, &s.sender, get_time_in_ns());
+        }
+        report(s, lines);
+}
+
+/**
+ * Stores sender stages (payload of FRAME_TRACE_APP_NAME RTCP APP packet) to
+ * be merged with the receiver ones.
+ */
+void frame_trace_sender_report(uint32_t ssrc, const char *data, int len)
+{
+        struct frame_trace trace;
+        if (!frame_trace_unpack(&trace, data, len)) {
+                LOG(LOG_LEVEL_WARNING) << MOD_NAME "Malformed sender report of length " << len << "\n";
+                return;
+        }
+        trace.ssrc = ssrc;
+
+        frame_trace_state &s = get_state();
+        lock_guard<mutex> lk(s.lock);
+        s.pending.push_back(trace);
+        if (s.pending.size() > MAX_PENDING_REPORTS) {
+                s.pending.pop_front();
+        }
+}
+
+/**
+ * Merges receiver stages of the frame with the sender ones (if received)
+ * and records the latencies.
+ */
+void frame_trace_receiver_done(const struct frame_trace *trace)
+{
+        struct frame_trace merged = *trace;
+        frame_trace_state &s = get_state();
+        vector<string> lines;
+        {
+                lock_guard<mutex> lk(s.lock);
+                auto matches = [trace](struct frame_trace const &t) {
+                        return t.ssrc == trace->ssrc && t.rtp_ts == trace->rtp_ts; };
+                for (auto *q : { &s.pending, &s.local }) {
+                        auto it = std::find_if(q->begin(), q->end(), matches);
+                        if (it != q->end()) {
+                                std::copy(it->t, it->t + FT_SENDER_STAGES, merged.t);
+                                q->erase(it);
+                                break;
+                        }
+                }
+                record(&s.receiver, &merged, FT_STAGE_COUNT);
+                collect_report(&lines, &s.receiver, get_time_in_ns());
+        }
+        report(s, lines);
+}
+
+/**
+ * Serializes RTP timestamp and sender stages (big endian).
+ *
+ * @returns length of the data, -1 if buf is too small
+ */
+int frame_trace_pack(const struct frame_trace *trace, char *buf, int len)
+{
+        if (len < FRAME_TRACE_PACKED_LEN) {
+                return -1;
+        }
+        auto *out = (unsigned char *) buf;
+        for (int i = 0; i < 4; ++i) {
+                *out++ = trace->rtp_ts >> (24 - 8 * i);
+        }
+        for (int s = 0; s < FT_SENDER_STAGES; ++s) {
+                uint64_t val = trace->t[s];
+                for (int i = 0; i < 8; ++i) {
+                        *out++ = val >> (56 - 8 * i);
+                }
+        }
+        return FRAME_TRACE_PACKED_LEN;
+}
+
+/// counterpart of frame_trace_pack(), receiver stages are zeroed
+bool frame_trace_unpack(struct frame_trace *trace, const char *buf, int len)
+{
+        if (len < FRAME_TRACE_PACKED_LEN) {
+                return false;
+        }
+        memset(trace, 0, sizeof *trace);
+        const auto *in = (const unsigned char *) buf;
+        for (int i = 0; i < 4; ++i) {
+                trace->rtp_ts = trace->rtp_ts << 8 | *in++;
+        }
+        for (int s = 0; s < FT_SENDER_STAGES; ++s) {
+                uint64_t val = 0;
+                for (int i = 0; i < 8; ++i) {
+                        val = val << 8 | *in++;
+                }
+                trace->t[s] = (time_ns_t) val;
+        }
+        return true;
+}
+
+int frame_trace_get_latency(bool receiver, enum frame_trace_stage stage, double percentile, time_ns_t *latency)
+{
+        frame_trace_state &s = get_state();
+        lock_guard<mutex> lk(s.lock);
+        const latency_hist &h = (receiver ? s.receiver : s.sender).stage[stage];
+        if (latency != nullptr) {
+                *latency = h.percentile(percentile);
+        }
+        return h.count;
+}
+
+/**
+ * Like frame_trace_get_latency() but counts all latencies recorded since the
+ * start (or frame_trace_reset_run()), regardless of the periodic reports.
+ *
+ * @param stage pipeline stage or FT_STAGE_COUNT for the total latency
+ */
+int frame_trace_get_run_latency(bool receiver, int stage, double percentile, time_ns_t *latency)
+{
+        assert(stage >= 0 && stage <= FT_STAGE_COUNT);
+        frame_trace_state &s = get_state();
+        lock_guard<mutex> lk(s.lock);
+        const latency_hist &h = (receiver ? s.receiver : s.sender).run_stage[stage];
+        if (latency != nullptr) {
+                *latency = h.percentile(percentile);
+        }
+        return h.count;
+}
+
+void frame_trace_reset_run(void)
+{
+        frame_trace_state &s = get_state();
+        lock_guard<mutex> lk(s.lock);
+        for (auto *h : { &s.sender, &s.receiver }) {
+                for (auto &hist : h->run_stage) {
+                        hist = latency_hist();
+                }
+        }
+}
+
+/// @param stage pipeline stage or FT_STAGE_COUNT for the total latency
+const char *frame_trace_stage_name(int stage)
+{
+        return stage < FT_STAGE_COUNT ? stage_info[stage].name : "total";
+}
@@ -0,0 +1,112 @@
+/**
+ * @file   utils/frame_trace.h
+ * @brief  end-to-end per-frame latency tracing
+ *
+ * If enabled by "--param frame-trace", each video frame is timestamped at
+ * the pipeline stages listed in @ref frame_trace_stage. The sender records
+ * the stages up to the transmission (frame_trace_sender_done()) and sends
+ * them to the receiver in an RTCP APP packet keyed by the RTP timestamp.
+ * The receiver adds its own stages and merges them with the sender ones
+ * (frame_trace_receiver_done()). Latencies of the stages are collected in
+ * histograms reported periodically over the control socket.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_FRAME_TRACE_H_
+#define UTILS_FRAME_TRACE_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stdint.h>
+#else
+#include <cstdint>
+#endif
+
+#include "tv.h"
+
+#define FRAME_TRACE_APP_NAME "UGFT" ///< name of the RTCP APP packet carrying sender stages
+
+struct module;
+struct rtp;
+
+/**
+ * Traced stages in the pipeline order. Stage latency is measured from the
+ * stage it depends on (see frame_trace.cpp), eg. network from FT_TX_FIRST
+ * to FT_RX_FIRST. Stages spanning both hosts assume synchronized clocks.
+ */
+enum frame_trace_stage {
+        FT_CAPTURE,        ///< frame grabbed from the capture device
+        FT_FILTER,         ///< capture filters applied
+        FT_COMPRESS_START,
+        FT_COMPRESS_END,
+        FT_TX_FIRST,       ///< sending of the first packet started
+        FT_TX_LAST,        ///< last packet sent
+        FT_RX_FIRST,       ///< first packet received
+        FT_RX_LAST,        ///< last packet received
+        FT_FEC,            ///< FEC decoded (after playout delay)
+        FT_DECOMPRESS,
+        FT_PUTF,           ///< frame passed to the display
+        FT_STAGE_COUNT
+};
+#define FT_SENDER_STAGES (FT_TX_LAST + 1)
+
+struct frame_trace {
+        uint32_t ssrc;
+        uint32_t rtp_ts;
+        time_ns_t t[FT_STAGE_COUNT]; ///< time from epoch (see get_time_in_ns()), 0 if not recorded
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool frame_trace_enabled(void);
+void frame_trace_init(struct module *parent);
+void frame_trace_sender_done(const struct frame_trace *trace, struct rtp *session);
+void frame_trace_sender_report(uint32_t ssrc, const char *data, int len);
+void frame_trace_receiver_done(const struct frame_trace *trace);
+
+int  frame_trace_pack(const struct frame_trace *trace, char *buf, int len);
+bool frame_trace_unpack(struct frame_trace *trace, const char *buf, int len);
+/// @returns number of recorded latencies of the stage since last report and its percentile in ns
+int  frame_trace_get_latency(bool receiver, enum frame_trace_stage stage, double percentile, time_ns_t *latency);
+int  frame_trace_get_run_latency(bool receiver, int stage, double percentile, time_ns_t *latency);
+void frame_trace_reset_run(void);
+const char *frame_trace_stage_name(int stage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_FRAME_TRACE_H_
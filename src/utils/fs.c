@@ -79,6 +79,49 @@ const char *get_temp_dir(void)
         return temp_dir;
 }
 
+/**
+ * Returns directory for cached data ending with path delimiter - the
+ * directory ultragrid in $XDG_CACHE_HOME (or ~/.cache), %LOCALAPPDATA% in
+ * Windows. The directory is created if it doesn't exist.
+ *
+ * @retval NULL if the directory cannot be determined or created
+ */
+const char *get_cache_dir(void)
+{
+        static __thread char cache_dir[MAX_PATH_SIZE];
+
+        if (cache_dir[0] != '\0') {
+                return cache_dir;
+        }
+
+#ifdef _WIN32
+        const char *base = getenv("LOCALAPPDATA");
+        const char *sub = "\\UltraGrid\\";
+        if (base == NULL) {
+                return NULL;
+        }
+        snprintf(cache_dir, sizeof cache_dir, "%s", base);
+#else
+        const char *base = getenv("XDG_CACHE_HOME");
+        const char *sub = "/ultragrid/";
+        if (base != NULL && base[0] != '\0') {
+                snprintf(cache_dir, sizeof cache_dir, "%s", base);
+        } else if (getenv("HOME") != NULL) {
+                snprintf(cache_dir, sizeof cache_dir, "%s/.cache", getenv("HOME"));
+        } else {
+                return NULL;
+        }
+#endif
+        platform_mkdir(cache_dir);
+        strncat(cache_dir, sub, sizeof cache_dir - strlen(cache_dir) - 1);
+        struct stat st;
+        if (platform_mkdir(cache_dir) != 0 && (stat(cache_dir, &st) != 0 || !S_ISDIR(st.st_mode))) {
+                cache_dir[0] = '\0';
+                return NULL;
+        }
+        return cache_dir;
+}
+
 #ifdef _WIN32
 int get_exec_path(char* path) {
         return GetModuleFileNameA(NULL, path, MAX_PATH_SIZE) != 0;
@@ -0,0 +1,99 @@
+/**
+ * @file   utils/gpu_scheduler.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "utils/gpu_scheduler.hpp"
+
+using std::lock_guard;
+using std::mutex;
+using std::unique_lock;
+
+gpu_scheduler &gpu_scheduler::get_instance()
+{
+        static gpu_scheduler instance;
+        return instance;
+}
+
+int gpu_scheduler::acquire(const void *owner, const unsigned int *devices, unsigned int count,
+                unsigned int max_depth)
+{
+        unique_lock<mutex> lk(lock);
+        int selected = -1;
+        cv.wait(lk, [&] {
+                selected = -1;
+                for (unsigned int i = 0; i < count; ++i) {
+                        unsigned int own = owner_load[{owner, devices[i]}];
+                        if (own >= max_depth) {
+                                continue;
+                        }
+                        if (selected == -1) {
+                                selected = i;
+                                continue;
+                        }
+                        unsigned int total = load[devices[i]];
+                        unsigned int best_total = load[devices[selected]];
+                        if (total < best_total || (total == best_total &&
+                                                own < owner_load[{owner, devices[selected]}])) {
+                                selected = i;
+                        }
+                }
+                return selected != -1;
+        });
+        load[devices[selected]] += 1;
+        owner_load[{owner, devices[selected]}] += 1;
+        return selected;
+}
+
+void gpu_scheduler::release(const void *owner, unsigned int device)
+{
+        {
+                lock_guard<mutex> lk(lock);
+                auto it = owner_load.find({owner, device});
+                if (it != owner_load.end() && it->second > 0) {
+                        it->second -= 1;
+                        load[device] -= 1;
+                        if (it->second == 0) {
+                                owner_load.erase(it);
+                        }
+                }
+        }
+        cv.notify_all();
+}
+
+unsigned int gpu_scheduler::get_load(unsigned int device)
+{
+        lock_guard<mutex> lk(lock);
+        return load[device];
+}
@@ -0,0 +1,78 @@
+/**
+ * @file   utils/gpu_scheduler.hpp
+ * @brief  assignment of encoding jobs to the least loaded GPU
+ *
+ * The scheduler is shared by all compressor instances in the process so
+ * that jobs of several streams or tiles are spread over the GPUs by the
+ * number of jobs each GPU currently has in flight.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_GPU_SCHEDULER_HPP_4A1C2E07
+#define UTILS_GPU_SCHEDULER_HPP_4A1C2E07
+
+#include <climits>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <utility>
+
+class gpu_scheduler {
+public:
+        static gpu_scheduler &get_instance();
+
+        /**
+         * Blocks until some of the devices has less than max_depth jobs of
+         * the owner in flight and assigns the job to the one with the
+         * lowest total load (of all owners). Ties are broken by the load of
+         * the owner and then by the order of the devices.
+         * @param owner     compressor instance submitting the job
+         * @param devices   CUDA device indices to choose from
+         * @returns         index to devices
+         */
+        int acquire(const void *owner, const unsigned int *devices, unsigned int count,
+                        unsigned int max_depth = UINT_MAX);
+        /// finishes the job assigned by acquire()
+        void release(const void *owner, unsigned int device);
+        /// @returns number of jobs of all owners in flight on the device
+        unsigned int get_load(unsigned int device);
+
+private:
+        std::mutex lock;
+        std::condition_variable cv;
+        std::map<unsigned int, unsigned int> load; ///< device -> jobs in flight
+        std::map<std::pair<const void *, unsigned int>, unsigned int> owner_load; ///< (owner, device) -> jobs in flight
+};
+
+#endif // defined UTILS_GPU_SCHEDULER_HPP_4A1C2E07
@@ -0,0 +1,120 @@
+/**
+ * @file   utils/init_graph.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <cassert>
+#include <exception>
+#include <utility>
+
+#include "debug.h"
+#include "tv.h"
+#include "utils/init_graph.hpp"
+
+#define MOD_NAME "[init] "
+
+using std::function;
+using std::initializer_list;
+using std::shared_future;
+
+init_graph::~init_graph()
+{
+        wait_all();
+}
+
+function<int()> init_graph::wrap(const char *name, function<int()> init, initializer_list<step_t> deps)
+{
+        std::vector<shared_future<int>> dep_results;
+        for (step_t dep : deps) {
+                assert(dep >= 0 && dep < (int) m_steps.size());
+                dep_results.push_back(m_steps.at(dep));
+        }
+        return [name, init = std::move(init), dep_results = std::move(dep_results)]() {
+                for (const auto &dep : dep_results) {
+                        if (int ret = dep.get(); ret != 0) {
+                                return ret;
+                        }
+                }
+                time_ns_t t0 = get_time_in_ns();
+                int ret = init();
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "%s initialized in %.3f s (result %d)\n", name,
+                                (double) (get_time_in_ns() - t0) / NS_IN_SEC_DBL, ret);
+                return ret;
+        };
+}
+
+init_graph::step_t init_graph::run_now(function<int()> step)
+{
+        std::promise<int> result;
+        try {
+                result.set_value(step());
+        } catch (...) {
+                result.set_exception(std::current_exception());
+        }
+        m_steps.push_back(result.get_future().share());
+        return (step_t) m_steps.size() - 1;
+}
+
+init_graph::step_t init_graph::add(const char *name, function<int()> init, initializer_list<step_t> deps)
+{
+        function<int()> step = wrap(name, std::move(init), deps);
+        if (!m_parallel) {
+                return run_now(std::move(step));
+        }
+        m_steps.push_back(std::async(std::launch::async, std::move(step)).share());
+        return (step_t) m_steps.size() - 1;
+}
+
+init_graph::step_t init_graph::run(const char *name, function<int()> init, initializer_list<step_t> deps)
+{
+        return run_now(wrap(name, std::move(init), deps));
+}
+
+int init_graph::wait(step_t step)
+{
+        return m_steps.at(step).get();
+}
+
+void init_graph::wait_all() noexcept
+{
+        for (const auto &step : m_steps) {
+                step.wait();
+        }
+}
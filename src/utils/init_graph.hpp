@@ -0,0 +1,81 @@
+/**
+ * @file   utils/init_graph.hpp
+ * @brief  concurrent initialization of independent modules
+ *
+ * Each step is started in its own thread as soon as the steps it depends on
+ * succeeded, so the total time is bounded by the slowest dependency chain
+ * rather than by the sum of all steps.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_INIT_GRAPH_HPP_7B1E4D92
+#define UTILS_INIT_GRAPH_HPP_7B1E4D92
+
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+/**
+ * Steps return 0 on success, the result of a failed step (non-zero or an
+ * exception) is propagated to the steps that depend on it instead of
+ * running them. In serial mode the steps are run in the order of addition.
+ */
+class init_graph {
+public:
+        using step_t = int;
+        explicit init_graph(bool parallel = true) : m_parallel(parallel) {}
+        ~init_graph();
+        init_graph(const init_graph &) = delete;
+        init_graph &operator=(const init_graph &) = delete;
+
+        /// starts the step in a new thread after the dependencies succeeded
+        step_t add(const char *name, std::function<int()> init, std::initializer_list<step_t> deps = {});
+        /// runs the step in the calling thread (eg. if the module requires the main thread)
+        step_t run(const char *name, std::function<int()> init, std::initializer_list<step_t> deps = {});
+        /// @returns result of the step, rethrows its exception
+        int wait(step_t step);
+        /// waits for all steps, ignores the results
+        void wait_all() noexcept;
+
+private:
+        std::function<int()> wrap(const char *name, std::function<int()> init, std::initializer_list<step_t> deps);
+        step_t run_now(std::function<int()> step);
+
+        bool m_parallel;
+        std::vector<std::shared_future<int>> m_steps;
+};
+
+#endif // defined UTILS_INIT_GRAPH_HPP_7B1E4D92
@@ -0,0 +1,299 @@
+/**
+ * @file   utils/lockfree_queue.h
+ * @brief  bounded MPMC lock-free queue with synchronized_queue interface
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_LOCKFREE_QUEUE_H_
+#define UTILS_LOCKFREE_QUEUE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "utils/queue_stats.h"
+
+#if defined __x86_64__ || defined __i386__
+#include <immintrin.h>
+#define LOCKFREE_QUEUE_RELAX() _mm_pause()
+#elif defined __aarch64__ || defined __arm__
+#define LOCKFREE_QUEUE_RELAX() __asm__ __volatile__("yield")
+#else
+#define LOCKFREE_QUEUE_RELAX() std::this_thread::yield()
+#endif
+
+/**
+ * @brief bounded multi-producer multi-consumer lock-free queue
+ *
+ * Drop-in alternative to synchronized_queue for hot inter-stage handoffs -
+ * push() and pop() don't take a lock unless they need to wait. Waiting
+ * thread spins first (see constructor) and then parks on a condition
+ * variable, which is notified only if there is a parked waiter.
+ *
+ * Based on the D. Vyukov's bounded MPMC queue, the cell sequence number is
+ * 2*pos if the cell is free for a push at pos and 2*pos+1 if it holds
+ * the element pushed at pos (so that also max_len 1 is unambiguous).
+ *
+ * Named queues (see set_name()) report their depth and blocking time as metrics.
+ *
+ * @tparam T       type to be stored, must be default constructible and movable
+ * @tparam max_len capacity of the queue (push blocks if full)
+ */
+template<typename T, int max_len = 1>
+class lockfree_queue {
+        static_assert(max_len > 0, "lockfree_queue must be bounded");
+public:
+        /// @param spin_count number of waiting iterations before parking (0 - park immediately)
+        explicit lockfree_queue(unsigned spin_count = 256) : m_spin_count(spin_count)
+        {
+                for (size_t i = 0; i < (size_t) max_len; ++i) {
+                        m_cells[i].seq.store(2 * i, std::memory_order_relaxed);
+                }
+        }
+        lockfree_queue(lockfree_queue const &) = delete;
+        lockfree_queue &operator=(lockfree_queue const &) = delete;
+
+        /**
+         * Enables the queue metrics (see utils/queue_stats.h), must be called
+         * before the queue is used by other threads.
+         */
+        void set_name(const char *name)
+        {
+                m_stats.reset(new queue_stats(name));
+                metric_set(m_stats->capacity, max_len);
+        }
+
+        /// records an item that the producer discarded instead of pushing it
+        void count_drop()
+        {
+                if (m_stats) {
+                        metric_inc(m_stats->drops, 1);
+                }
+        }
+
+        int size()
+        {
+                size_t tail = m_dequeue_pos.load(std::memory_order_acquire);
+                size_t head = m_enqueue_pos.load(std::memory_order_acquire);
+                return head > tail ? (int) (head - tail) : 0;
+        }
+
+        void push(T const &message)
+        {
+                T copy(message);
+                push(std::move(copy));
+        }
+
+        void push(T &&message)
+        {
+                wait(m_not_full, [&] { return try_push(message); }, m_stats ? m_stats->push_blocked : nullptr);
+                if (m_stats) {
+                        m_stats->pushed(size());
+                }
+                notify(m_not_empty);
+        }
+
+        /**
+         * "Latest wins" push - if the queue is full, the oldest element is
+         * discarded (and counted as a drop) instead of waiting for the consumer.
+         *
+         * The caller must make sure that no element that must not be lost
+         * (eg. a poison pill) can be discarded.
+         *
+         * @returns true if an element was discarded
+         */
+        bool push_latest(T &&message)
+        {
+                bool dropped = false;
+                while (!try_push(message)) {
+                        T stale{};
+                        if (try_pop(stale)) {
+                                count_drop();
+                                popped();
+                                dropped = true;
+                        }
+                }
+                if (m_stats) {
+                        m_stats->pushed(size());
+                }
+                notify(m_not_empty);
+                return dropped;
+        }
+
+        T pop(bool nonblocking = false)
+        {
+                T ret{};
+                if (nonblocking) {
+                        if (try_pop(ret)) {
+                                popped();
+                        }
+                        return ret;
+                }
+                wait(m_not_empty, [&] { return try_pop(ret); }, m_stats ? m_stats->pop_blocked : nullptr);
+                popped();
+                return ret;
+        }
+
+        template<typename Rep, typename Period>
+        bool timed_pop(T &result, std::chrono::duration<Rep, Period> const &timeout)
+        {
+                auto deadline = std::chrono::steady_clock::now() + timeout;
+                if (!wait(m_not_empty, [&] { return try_pop(result); }, m_stats ? m_stats->pop_blocked : nullptr,
+                                        &deadline)) {
+                        return false;
+                }
+                popped();
+                return true;
+        }
+
+        /// @returns false if the queue is full
+        bool try_push(T &message)
+        {
+                size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                while (true) {
+                        cell &c = m_cells[pos % max_len];
+                        size_t seq = c.seq.load(std::memory_order_acquire);
+                        if (seq == 2 * pos) {
+                                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                                        c.value = std::move(message);
+                                        c.seq.store(2 * pos + 1, std::memory_order_release);
+                                        return true;
+                                }
+                        } else if (seq < 2 * pos) { // cell still holds an element from the previous lap
+                                return false;
+                        } else {
+                                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                        }
+                }
+        }
+
+        /// @returns false if the queue is empty
+        bool try_pop(T &result)
+        {
+                size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                while (true) {
+                        cell &c = m_cells[pos % max_len];
+                        size_t seq = c.seq.load(std::memory_order_acquire);
+                        if (seq == 2 * pos + 1) {
+                                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                                        result = std::move(c.value);
+                                        c.value = T();
+                                        c.seq.store(2 * (pos + max_len), std::memory_order_release);
+                                        return true;
+                                }
+                        } else if (seq < 2 * pos + 1) { // not yet pushed
+                                return false;
+                        } else {
+                                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                        }
+                }
+        }
+
+private:
+        struct cell {
+                std::atomic<size_t> seq;
+                T                   value{};
+        };
+        struct waiters {
+                std::mutex              lock;
+                std::condition_variable cv;
+                std::atomic<int>        parked{0};
+        };
+
+        void popped()
+        {
+                if (m_stats) {
+                        metric_set(m_stats->depth, size());
+                }
+                notify(m_not_full);
+        }
+
+        /// @param blocked counter of the waiting time, NULL if not named
+        template<typename Pred>
+        bool wait(waiters &w, Pred &&pred, struct metric *blocked,
+                        std::chrono::steady_clock::time_point const *deadline = nullptr)
+        {
+                if (pred()) {
+                        return true;
+                }
+                queue_wait_timer t(blocked);
+                for (unsigned i = 0; i < m_spin_count; ++i) {
+                        if (pred()) {
+                                return true;
+                        }
+                        LOCKFREE_QUEUE_RELAX();
+                }
+                std::unique_lock<std::mutex> lk(w.lock);
+                w.parked.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with notify()
+                bool ret = true;
+                while (!pred()) {
+                        if (deadline == nullptr) {
+                                w.cv.wait(lk);
+                        } else if (w.cv.wait_until(lk, *deadline) == std::cv_status::timeout) {
+                                ret = pred();
+                                break;
+                        }
+                }
+                w.parked.fetch_sub(1);
+                return ret;
+        }
+
+        static void notify(waiters &w)
+        {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (w.parked.load(std::memory_order_relaxed) == 0) {
+                        return;
+                }
+                { // the waiter re-checks the condition with the lock held
+                        std::lock_guard<std::mutex> lk(w.lock);
+                }
+                w.cv.notify_all();
+        }
+
+        alignas(64) std::atomic<size_t> m_enqueue_pos{0};
+        alignas(64) std::atomic<size_t> m_dequeue_pos{0};
+        cell     m_cells[max_len];
+        waiters  m_not_empty;
+        waiters  m_not_full;
+        unsigned m_spin_count;
+        std::unique_ptr<queue_stats> m_stats; ///< NULL unless named
+};
+
+#endif // UTILS_LOCKFREE_QUEUE_H_
@@ -0,0 +1,240 @@
+/**
+ * @file   utils/lut3d.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // defined HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "debug.h"
+#include "utils/lut3d.hpp"
+
+#define MOD_NAME "[lut3d] "
+#define MAX_CUBE_SIZE 256
+
+using std::string;
+
+bool lut3d::load_cube(const char *filename)
+{
+        std::ifstream in(filename);
+        if (!in) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot open %s!\n", filename);
+                return false;
+        }
+        return parse_cube(in);
+}
+
+/**
+ * Parses the Adobe/Resolve .cube 3D LUT format. A non-default input domain
+ * (DOMAIN_MIN/DOMAIN_MAX) is resampled to [0, 1] so that sample() doesn't
+ * need to care.
+ */
+bool lut3d::parse_cube(std::istream &in)
+{
+        int new_size = 0;
+        float domain_min[3] = { 0.0F, 0.0F, 0.0F };
+        float domain_max[3] = { 1.0F, 1.0F, 1.0F };
+        std::vector<float> data;
+        string line;
+        int line_no = 0;
+        while (std::getline(in, line)) {
+                line_no += 1;
+                std::istringstream ls(line);
+                string keyword;
+                if (!(ls >> keyword) || keyword[0] == '#' || keyword == "TITLE") {
+                        continue;
+                }
+                if (keyword == "LUT_3D_SIZE") {
+                        if (!(ls >> new_size) || new_size < 2 || new_size > MAX_CUBE_SIZE) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong LUT_3D_SIZE on line %d!\n", line_no);
+                                return false;
+                        }
+                        data.reserve(3 * new_size * new_size * new_size);
+                } else if (keyword == "LUT_1D_SIZE") {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "1D LUTs are not supported!\n");
+                        return false;
+                } else if (keyword == "DOMAIN_MIN" || keyword == "DOMAIN_MAX") {
+                        float *domain = keyword == "DOMAIN_MIN" ? domain_min : domain_max;
+                        if (!(ls >> domain[0] >> domain[1] >> domain[2])) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong %s on line %d!\n", keyword.c_str(), line_no);
+                                return false;
+                        }
+                } else if (isdigit(keyword[0]) || keyword[0] == '-' || keyword[0] == '.') {
+                        ls.clear();
+                        ls.seekg(0);
+                        float rgb[3];
+                        if (new_size == 0 || !(ls >> rgb[0] >> rgb[1] >> rgb[2])) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong data on line %d!\n", line_no);
+                                return false;
+                        }
+                        data.insert(data.end(), rgb, rgb + 3);
+                } else {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Ignoring unknown keyword %s on line %d.\n", keyword.c_str(), line_no);
+                }
+        }
+        if (new_size == 0 || data.size() != 3U * new_size * new_size * new_size) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Expected %d entries, got %zu!\n",
+                                new_size * new_size * new_size, data.size() / 3);
+                return false;
+        }
+        for (int i = 0; i < 3; ++i) {
+                if (domain_max[i] <= domain_min[i]) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Empty input domain!\n");
+                        return false;
+                }
+        }
+
+        size = new_size;
+        table = std::move(data);
+        bool unit_domain = true;
+        for (int i = 0; i < 3; ++i) {
+                unit_domain = unit_domain && domain_min[i] == 0.0F && domain_max[i] == 1.0F;
+        }
+        if (unit_domain) {
+                return true;
+        }
+        lut3d orig = *this;
+        *this = generate(size, [&](const float *rgb, float *out) {
+                float norm[3];
+                for (int i = 0; i < 3; ++i) {
+                        norm[i] = (rgb[i] - domain_min[i]) / (domain_max[i] - domain_min[i]);
+                }
+                orig.sample(norm, out);
+        });
+        return true;
+}
+
+/// evaluates fn in the grid points
+lut3d lut3d::generate(int size, const std::function<void(const float *in, float *out)> &fn)
+{
+        lut3d ret;
+        ret.size = size;
+        ret.table.resize(3 * size * size * size);
+        for (int b = 0; b < size; ++b) {
+                for (int g = 0; g < size; ++g) {
+                        for (int r = 0; r < size; ++r) {
+                                const float in[3] = { (float) r / (size - 1), (float) g / (size - 1), (float) b / (size - 1) };
+                                fn(in, LUT3D_AT(ret.table.data(), size, r, g, b));
+                        }
+                }
+        }
+        return ret;
+}
+
+/// @returns absolute luminance in nits
+static float pq_eotf(float e)
+{
+        const float m1 = 2610.0F / 16384;
+        const float m2 = 2523.0F / 4096 * 128;
+        const float c1 = 3424.0F / 4096;
+        const float c2 = 2413.0F / 4096 * 32;
+        const float c3 = 2392.0F / 4096 * 32;
+        const float p = powf(std::max(e, 0.0F), 1.0F / m2);
+        return 10000.0F * powf(std::max(p - c1, 0.0F) / (c2 - c3 * p), 1.0F / m1);
+}
+
+/// @returns scene-linear light in [0, 1]
+static float hlg_inverse_oetf(float e)
+{
+        const float a = 0.17883277F;
+        const float b = 1.0F - 4.0F * a;
+        const float c = 0.5F - a * logf(4.0F * a);
+        e = std::max(e, 0.0F);
+        return e <= 0.5F ? e * e / 3.0F : (expf((e - c) / a) + b) / 12.0F;
+}
+
+static float bt2020_luminance(const float *rgb)
+{
+        return 0.2627F * rgb[0] + 0.6780F * rgb[1] + 0.0593F * rgb[2];
+}
+
+/**
+ * Converts BT.2100 (PQ or HLG) RGB to BT.709 SDR RGB (BT.1886 display
+ * gamma 2.4). The luminance is compressed with the extended Reinhard curve
+ * mapping peak_nits to the SDR white, the hue is kept by scaling all the
+ * components by the same ratio.
+ */
+void tonemap_hdr_to_sdr(const struct tonemap_params &p, const float in[3], float out[3])
+{
+        float rgb[3];
+        if (p.transfer == TONEMAP_PQ) {
+                for (int i = 0; i < 3; ++i) {
+                        rgb[i] = pq_eotf(in[i]);
+                }
+        } else { // HLG OOTF for the nominal display peak (BT.2100 note 5f)
+                for (int i = 0; i < 3; ++i) {
+                        rgb[i] = hlg_inverse_oetf(in[i]);
+                }
+                const float gamma = 1.2F + 0.42F * log10f(p.peak_nits / 1000.0F);
+                const float ys = bt2020_luminance(rgb);
+                const float gain = ys > 0.0F ? p.peak_nits * powf(ys, gamma - 1.0F) : 0.0F;
+                for (int i = 0; i < 3; ++i) {
+                        rgb[i] *= gain;
+                }
+        }
+
+        const float white = p.peak_nits / p.ref_nits;
+        for (int i = 0; i < 3; ++i) {
+                rgb[i] /= p.ref_nits;
+        }
+        const float l = bt2020_luminance(rgb);
+        if (l > 0.0F) {
+                const float ld = l * (1.0F + l / (white * white)) / (1.0F + l);
+                for (int i = 0; i < 3; ++i) {
+                        rgb[i] *= ld / l;
+                }
+        }
+
+        static const float bt2020_to_bt709[3][3] = {
+                {  1.6605F, -0.5876F, -0.0728F },
+                { -0.1246F,  1.1329F, -0.0083F },
+                { -0.0182F, -0.1006F,  1.1187F },
+        };
+        for (int i = 0; i < 3; ++i) {
+                float v = bt2020_to_bt709[i][0] * rgb[0] + bt2020_to_bt709[i][1] * rgb[1] + bt2020_to_bt709[i][2] * rgb[2];
+                out[i] = powf(std::min(std::max(v, 0.0F), 1.0F), 1.0F / 2.4F);
+        }
+}
+
+/* vim: set expandtab sw=8: */
@@ -0,0 +1,74 @@
+/**
+ * @file   utils/lut3d.hpp
+ * @brief  3D LUT loading (.cube) and generation, HDR to SDR tone mapping
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_LUT3D_HPP_E2B7A604
+#define UTILS_LUT3D_HPP_E2B7A604
+
+#include <functional>
+#include <istream>
+#include <vector>
+
+#include "utils/lut3d_sample.h"
+
+struct lut3d {
+        int size = 0;             ///< grid points per axis
+        std::vector<float> table; ///< size^3 RGB triplets, red changes fastest
+
+        bool load_cube(const char *filename);
+        bool parse_cube(std::istream &in);
+        void sample(const float in[3], float out[3]) const {
+                lut3d_sample(table.data(), size, in[0], in[1], in[2], out);
+        }
+        static lut3d generate(int size, const std::function<void(const float *in, float *out)> &fn);
+};
+
+enum tonemap_transfer {
+        TONEMAP_PQ,  ///< SMPTE ST 2084
+        TONEMAP_HLG, ///< ARIB STD-B67
+};
+
+struct tonemap_params {
+        enum tonemap_transfer transfer = TONEMAP_PQ;
+        float peak_nits = 1000.0F; ///< mastering (PQ) or display (HLG) peak luminance mapped to SDR white
+        float ref_nits = 203.0F;   ///< HDR reference white (BT.2408), scale of the tone curve
+};
+
+void tonemap_hdr_to_sdr(const struct tonemap_params &p, const float in[3], float out[3]);
+
+#endif // defined UTILS_LUT3D_HPP_E2B7A604
+
+/* vim: set expandtab sw=8: */
@@ -0,0 +1,116 @@
+/**
+ * @file   utils/lut3d_sample.h
+ * @brief  tetrahedral interpolation in a 3D LUT, shared by host and CUDA code
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_LUT3D_SAMPLE_H_5C0A9E31
+#define UTILS_LUT3D_SAMPLE_H_5C0A9E31
+
+#ifndef __cplusplus
+#include <math.h>
+#else
+#include <cmath>
+#endif
+
+#ifdef __CUDACC__
+#define LUT3D_FN __host__ __device__ static inline
+#else
+#define LUT3D_FN static inline
+#endif
+
+#define LUT3D_AT(table, size, r, g, b) ((table) + 3 * ((((b) * (size)) + (g)) * (size) + (r)))
+
+/**
+ * Interpolates a 3D LUT of size^3 RGB triplets (red changes fastest, as in
+ * the .cube format) at the point r, g, b (clamped to [0, 1]).
+ *
+ * Tetrahedral interpolation uses only 4 of the 8 surrounding grid points and
+ * reproduces neutral (gray) inputs exactly from the diagonal of the cube.
+ */
+LUT3D_FN void lut3d_sample(const float *table, int size, float r, float g, float b, float *out)
+{
+        const float scale = (float) (size - 1);
+        r = fminf(fmaxf(r, 0.0F), 1.0F) * scale;
+        g = fminf(fmaxf(g, 0.0F), 1.0F) * scale;
+        b = fminf(fmaxf(b, 0.0F), 1.0F) * scale;
+        const int r0 = (int) r < size - 2 ? (int) r : size - 2;
+        const int g0 = (int) g < size - 2 ? (int) g : size - 2;
+        const int b0 = (int) b < size - 2 ? (int) b : size - 2;
+        const float fr = r - (float) r0;
+        const float fg = g - (float) g0;
+        const float fb = b - (float) b0;
+
+        const float *c000 = LUT3D_AT(table, size, r0, g0, b0);
+        const float *c111 = LUT3D_AT(table, size, r0 + 1, g0 + 1, b0 + 1);
+        const float *c1 = c000;
+        const float *c2 = c000;
+        float w0 = 0.0F, w1 = 0.0F, w2 = 0.0F, w3 = 0.0F;
+        if (fr > fg) {
+                if (fg > fb) {
+                        c1 = LUT3D_AT(table, size, r0 + 1, g0, b0);
+                        c2 = LUT3D_AT(table, size, r0 + 1, g0 + 1, b0);
+                        w0 = 1.0F - fr; w1 = fr - fg; w2 = fg - fb; w3 = fb;
+                } else if (fr > fb) {
+                        c1 = LUT3D_AT(table, size, r0 + 1, g0, b0);
+                        c2 = LUT3D_AT(table, size, r0 + 1, g0, b0 + 1);
+                        w0 = 1.0F - fr; w1 = fr - fb; w2 = fb - fg; w3 = fg;
+                } else {
+                        c1 = LUT3D_AT(table, size, r0, g0, b0 + 1);
+                        c2 = LUT3D_AT(table, size, r0 + 1, g0, b0 + 1);
+                        w0 = 1.0F - fb; w1 = fb - fr; w2 = fr - fg; w3 = fg;
+                }
+        } else {
+                if (fb > fg) {
+                        c1 = LUT3D_AT(table, size, r0, g0, b0 + 1);
+                        c2 = LUT3D_AT(table, size, r0, g0 + 1, b0 + 1);
+                        w0 = 1.0F - fb; w1 = fb - fg; w2 = fg - fr; w3 = fr;
+                } else if (fb > fr) {
+                        c1 = LUT3D_AT(table, size, r0, g0 + 1, b0);
+                        c2 = LUT3D_AT(table, size, r0, g0 + 1, b0 + 1);
+                        w0 = 1.0F - fg; w1 = fg - fb; w2 = fb - fr; w3 = fr;
+                } else {
+                        c1 = LUT3D_AT(table, size, r0, g0 + 1, b0);
+                        c2 = LUT3D_AT(table, size, r0 + 1, g0 + 1, b0);
+                        w0 = 1.0F - fg; w1 = fg - fr; w2 = fr - fb; w3 = fb;
+                }
+        }
+        for (int i = 0; i < 3; ++i) {
+                out[i] = w0 * c000[i] + w1 * c1[i] + w2 * c2[i] + w3 * c111[i];
+        }
+}
+
+#endif // defined UTILS_LUT3D_SAMPLE_H_5C0A9E31
+
+/* vim: set expandtab sw=8: */
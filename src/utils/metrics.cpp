@@ -0,0 +1,449 @@
+/**
+ * @file   utils/metrics.cpp
+ * @brief  registry of counters, gauges and histograms exported in Prometheus text format
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // defined HAVE_CONFIG_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "debug.h"
+#include "host.h"
+#include "rtp/net_udp.h" // socket_error
+#include "utils/metrics.h"
+#include "utils/thread.h"
+
+#define MOD_NAME "[metrics] "
+#define MAX_REQUEST_LEN 4096
+#define HTTP_TIMEOUT_MS 1000
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#ifdef WIN32
+typedef const char *sso_val_type;
+#else
+typedef void *sso_val_type;
+#endif
+
+using std::atomic;
+using std::lock_guard;
+using std::map;
+using std::mutex;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+ADD_TO_PARAM("metrics-port", "* metrics-port=<port>\n"
+                "  Serve statistics in Prometheus text format over HTTP on the port (GET /metrics)\n");
+
+enum metric_type {
+        METRIC_COUNTER,
+        METRIC_GAUGE,
+        METRIC_HISTOGRAM,
+};
+
+struct metric {
+        enum metric_type type;
+        string labels;
+        atomic<uint64_t> count{0}; ///< counter value or number of observations
+        atomic<uint64_t> value_bits{0}; ///< gauge value or sum of observations (double)
+        const vector<double> *bounds = nullptr;
+        unique_ptr<atomic<uint64_t>[]> buckets; ///< non-cumulative, bounds->size() + 1 (+Inf)
+};
+
+namespace {
+struct family {
+        enum metric_type type;
+        string help;
+        vector<double> bounds;
+        map<string, unique_ptr<struct metric>> series;
+};
+
+struct registry {
+        mutex lock;
+        map<string, family> families;
+};
+
+registry &get_registry() {
+        static registry r;
+        return r;
+}
+
+double bits_to_double(uint64_t bits) {
+        double val = 0;
+        memcpy(&val, &bits, sizeof val);
+        return val;
+}
+
+uint64_t double_to_bits(double val) {
+        uint64_t bits = 0;
+        memcpy(&bits, &val, sizeof bits);
+        return bits;
+}
+
+const char *type_name(enum metric_type type) {
+        switch (type) {
+        case METRIC_COUNTER: return "counter";
+        case METRIC_GAUGE: return "gauge";
+        case METRIC_HISTOGRAM: return "histogram";
+        }
+        return "untyped";
+}
+
+struct metric *get_metric(enum metric_type type, const char *name, const char *help, const char *labels,
+                const double *bounds = nullptr, int bound_count = 0)
+{
+        registry &r = get_registry();
+        lock_guard<mutex> lk(r.lock);
+        auto it = r.families.find(name);
+        if (it == r.families.end()) {
+                family f{type, help != nullptr ? help : "", {}, {}};
+                if (type == METRIC_HISTOGRAM) {
+                        f.bounds.assign(bounds, bounds + bound_count);
+                }
+                it = r.families.emplace(name, std::move(f)).first;
+        } else if (it->second.type != type) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Metric %s already registered as %s!\n", name,
+                                type_name(it->second.type));
+                return nullptr;
+        }
+        family &f = it->second;
+        string l = labels != nullptr ? labels : "";
+        auto &m = f.series[l];
+        if (!m) {
+                m.reset(new struct metric);
+                m->type = type;
+                m->labels = l;
+                if (type == METRIC_HISTOGRAM) {
+                        m->bounds = &f.bounds;
+                        m->buckets.reset(new atomic<uint64_t>[f.bounds.size() + 1]);
+                        for (size_t i = 0; i <= f.bounds.size(); ++i) {
+                                m->buckets[i] = 0;
+                        }
+                }
+        }
+        return m.get();
+}
+
+void format_value(string *out, double val) {
+        char buf[64];
+        snprintf(buf, sizeof buf, "%.10g", val);
+        *out += buf;
+}
+
+/// appends "name{labels[,extra]} "
+void format_series(string *out, const string &name, const char *suffix, const string &labels, const string &extra = {}) {
+        *out += name;
+        *out += suffix;
+        if (!labels.empty() || !extra.empty()) {
+                *out += "{" + labels + (!labels.empty() && !extra.empty() ? "," : "") + extra + "}";
+        }
+        *out += " ";
+}
+} // end of anonymous namespace
+
+struct metric *metric_counter(const char *name, const char *help, const char *labels)
+{
+        return get_metric(METRIC_COUNTER, name, help, labels);
+}
+
+struct metric *metric_gauge(const char *name, const char *help, const char *labels)
+{
+        return get_metric(METRIC_GAUGE, name, help, labels);
+}
+
+struct metric *metric_histogram(const char *name, const char *help, const char *labels,
+                const double *bounds, int bound_count)
+{
+        return get_metric(METRIC_HISTOGRAM, name, help, labels, bounds, bound_count);
+}
+
+void metric_inc(struct metric *m, unsigned long long val)
+{
+        if (m != nullptr) {
+                m->count.fetch_add(val, std::memory_order_relaxed);
+        }
+}
+
+void metric_set(struct metric *m, double val)
+{
+        if (m != nullptr) {
+                m->value_bits.store(double_to_bits(val), std::memory_order_relaxed);
+        }
+}
+
+void metric_observe(struct metric *m, double val)
+{
+        if (m == nullptr || m->type != METRIC_HISTOGRAM) {
+                return;
+        }
+        size_t idx = std::lower_bound(m->bounds->begin(), m->bounds->end(), val) - m->bounds->begin();
+        m->buckets[idx].fetch_add(1, std::memory_order_relaxed);
+        uint64_t old_bits = m->value_bits.load(std::memory_order_relaxed);
+        while (!m->value_bits.compare_exchange_weak(old_bits, double_to_bits(bits_to_double(old_bits) + val),
+                                std::memory_order_relaxed)) {
+        }
+        m->count.fetch_add(1, std::memory_order_relaxed);
+}
+
+double metric_value(struct metric *m)
+{
+        if (m == nullptr) {
+                return 0;
+        }
+        if (m->type == METRIC_GAUGE) {
+                return bits_to_double(m->value_bits.load(std::memory_order_relaxed));
+        }
+        return (double) m->count.load(std::memory_order_relaxed);
+}
+
+/**
+ * @returns metrics in Prometheus text exposition format (version 0.0.4)
+ * @param prefix if not NULL, only the metrics with names starting with it
+ */
+string metrics_format(const char *prefix)
+{
+        string out;
+        registry &r = get_registry();
+        lock_guard<mutex> lk(r.lock);
+        for (auto const &it : r.families) {
+                const string &name = it.first;
+                if (prefix != nullptr && name.compare(0, strlen(prefix), prefix) != 0) {
+                        continue;
+                }
+                const family &f = it.second;
+                out += "# HELP " + name + " " + f.help + "\n";
+                out += "# TYPE " + name + " " + type_name(f.type) + "\n";
+                for (auto const &s : f.series) {
+                        const struct metric &m = *s.second;
+                        switch (f.type) {
+                        case METRIC_COUNTER:
+                                format_series(&out, name, "", m.labels);
+                                out += std::to_string(m.count.load(std::memory_order_relaxed));
+                                out += "\n";
+                                break;
+                        case METRIC_GAUGE:
+                                format_series(&out, name, "", m.labels);
+                                format_value(&out, bits_to_double(m.value_bits.load(std::memory_order_relaxed)));
+                                out += "\n";
+                                break;
+                        case METRIC_HISTOGRAM: {
+                                uint64_t cumulative = 0;
+                                for (size_t i = 0; i <= f.bounds.size(); ++i) {
+                                        cumulative += m.buckets[i].load(std::memory_order_relaxed);
+                                        string le = "le=\"";
+                                        if (i < f.bounds.size()) {
+                                                format_value(&le, f.bounds[i]);
+                                        } else {
+                                                le += "+Inf";
+                                        }
+                                        format_series(&out, name, "_bucket", m.labels, le + "\"");
+                                        out += std::to_string(cumulative) + "\n";
+                                }
+                                format_series(&out, name, "_sum", m.labels);
+                                format_value(&out, bits_to_double(m.value_bits.load(std::memory_order_relaxed)));
+                                out += "\n";
+                                format_series(&out, name, "_count", m.labels);
+                                // the count consistent with the buckets, observations may be in progress
+                                out += std::to_string(cumulative) + "\n";
+                                break;
+                        }
+                        }
+                }
+        }
+        return out;
+}
+
+namespace {
+struct metrics_server {
+        fd_t fd = INVALID_SOCKET;
+        atomic<bool> should_exit{false};
+        std::thread thread;
+};
+
+metrics_server *server;
+
+bool wait_readable(fd_t fd, int timeout_ms)
+{
+        fd_set set;
+        FD_ZERO(&set);
+        FD_SET(fd, &set);
+        struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+        return select(fd + 1, &set, nullptr, nullptr, &tv) > 0;
+}
+
+void send_all(fd_t fd, const string &data)
+{
+        size_t sent = 0;
+        while (sent < data.size()) {
+                // scraper may close the connection early (timeout) - do not get killed by SIGPIPE
+                int ret = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                if (ret <= 0) {
+                        return;
+                }
+                sent += ret;
+        }
+}
+
+void serve_client(fd_t fd)
+{
+        char req[MAX_REQUEST_LEN + 1];
+        int len = 0;
+        while (len < MAX_REQUEST_LEN && wait_readable(fd, HTTP_TIMEOUT_MS)) {
+                int ret = recv(fd, req + len, MAX_REQUEST_LEN - len, 0);
+                if (ret <= 0) {
+                        break;
+                }
+                len += ret;
+                req[len] = '\0';
+                if (strstr(req, "\r\n\r\n") != nullptr || strstr(req, "\n\n") != nullptr) {
+                        break;
+                }
+        }
+        req[len] = '\0';
+
+        string status = "200 OK";
+        string body;
+        if (strncmp(req, "GET /metrics ", strlen("GET /metrics ")) == 0 || strncmp(req, "GET / ", strlen("GET / ")) == 0) {
+                body = metrics_format();
+        } else {
+                status = "404 Not Found";
+                body = "Only GET /metrics is supported.\n";
+        }
+        send_all(fd, "HTTP/1.0 " + status + "\r\n"
+                        "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                        "Connection: close\r\n\r\n" + body);
+}
+
+void server_thread(metrics_server *s)
+{
+        set_thread_name("metrics_server");
+        while (!s->should_exit) {
+                if (!wait_readable(s->fd, 200)) {
+                        continue;
+                }
+                fd_t client = accept(s->fd, nullptr, nullptr);
+                if (client == INVALID_SOCKET) {
+                        continue;
+                }
+#ifdef SO_NOSIGPIPE // platforms without MSG_NOSIGNAL (macOS)
+                int one = 1;
+                setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, (sso_val_type) &one, sizeof one);
+#endif
+                serve_client(client);
+                CLOSESOCKET(client);
+        }
+}
+} // end of anonymous namespace
+
+bool metrics_server_start(int port)
+{
+        assert(server == nullptr);
+        auto *s = new metrics_server;
+        bool ipv6 = true;
+        s->fd = socket(AF_INET6, SOCK_STREAM, 0);
+        if (s->fd == INVALID_SOCKET) {
+                ipv6 = false;
+                s->fd = socket(AF_INET, SOCK_STREAM, 0);
+        }
+        if (s->fd == INVALID_SOCKET) {
+                socket_error(MOD_NAME "socket");
+                delete s;
+                return false;
+        }
+        int val = 1;
+        if (setsockopt(s->fd, SOL_SOCKET, SO_REUSEADDR, (sso_val_type) &val, sizeof val) != 0) {
+                socket_error(MOD_NAME "setsockopt SO_REUSEADDR");
+        }
+        struct sockaddr_storage ss{};
+        socklen_t ss_len = 0;
+        if (ipv6) {
+                int ipv6only = 0;
+                if (setsockopt(s->fd, IPPROTO_IPV6, IPV6_V6ONLY, (sso_val_type) &ipv6only, sizeof ipv6only) != 0) {
+                        socket_error(MOD_NAME "setsockopt IPV6_V6ONLY");
+                }
+                auto *s_in6 = reinterpret_cast<struct sockaddr_in6 *>(&ss);
+                s_in6->sin6_family = AF_INET6;
+                s_in6->sin6_addr = in6addr_any;
+                s_in6->sin6_port = htons(port);
+                ss_len = sizeof *s_in6;
+        } else {
+                auto *s_in = reinterpret_cast<struct sockaddr_in *>(&ss);
+                s_in->sin_family = AF_INET;
+                s_in->sin_addr.s_addr = htonl(INADDR_ANY);
+                s_in->sin_port = htons(port);
+                ss_len = sizeof *s_in;
+        }
+        if (::bind(s->fd, reinterpret_cast<const struct sockaddr *>(&ss), ss_len) != 0 || listen(s->fd, 4) != 0) {
+                socket_error(MOD_NAME "bind/listen on port %d", port);
+                CLOSESOCKET(s->fd);
+                delete s;
+                return false;
+        }
+        s->thread = std::thread(server_thread, s);
+        server = s;
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Serving Prometheus metrics on port %d\n", port);
+        return true;
+}
+
+void metrics_server_stop(void)
+{
+        if (server == nullptr) {
+                return;
+        }
+        server->should_exit = true;
+        server->thread.join();
+        CLOSESOCKET(server->fd);
+        delete server;
+        server = nullptr;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file   utils/metrics.h
+ * @brief  registry of counters, gauges and histograms exported in Prometheus text format
+ *
+ * Metrics are created (or looked up) once by name and labels and the
+ * returned pointer is then updated lock-free, series live until the program
+ * exits. All update functions accept NULL (eg. when the registration
+ * failed). The exposition is served over HTTP if "--param metrics-port" is
+ * given and also by the control socket command "metrics".
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_METRICS_H_
+#define UTILS_METRICS_H_
+
+#ifdef __cplusplus
+#include <string>
+#else
+#include <stdbool.h>
+#endif
+
+struct metric;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @param name   metric name, counters should have suffix "_total"
+ * @param labels comma-separated label pairs, eg. "ssrc=\"0x1234\"" or NULL
+ * @returns NULL if the name is already registered with other type
+ */
+struct metric *metric_counter(const char *name, const char *help, const char *labels);
+struct metric *metric_gauge(const char *name, const char *help, const char *labels);
+/// @param bounds ascending upper bucket bounds of the first registration of the name are used
+struct metric *metric_histogram(const char *name, const char *help, const char *labels,
+                const double *bounds, int bound_count);
+
+void metric_inc(struct metric *m, unsigned long long val);
+void metric_set(struct metric *m, double val);
+void metric_observe(struct metric *m, double val);
+/// @returns counter or gauge value, number of observations for histogram
+double metric_value(struct metric *m);
+
+bool metrics_server_start(int port);
+void metrics_server_stop(void);
+
+#ifdef __cplusplus
+}
+std::string metrics_format(const char *prefix = nullptr);
+#endif
+
+#endif // UTILS_METRICS_H_
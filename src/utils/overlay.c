@@ -0,0 +1,200 @@
+/**
+ * @file   utils/overlay.c
+ * @brief  alpha-blended overlays pre-rendered in the target pixel format
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include "color.h"
+#include "utils/macros.h"
+#include "utils/overlay.h"
+#include "video_codec.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+struct overlay {
+        codec_t codec;
+        int dirty_x, dirty_y; ///< offset of the dirty rectangle (non-transparent pixels) in the overlay
+        int dirty_height;
+        int row_bytes;        ///< length of a dirty rectangle line in the target pixel format
+        uint8_t *inv_alpha;   ///< 255 - alpha for every byte of the dirty rectangle
+        uint16_t *premul;     ///< value * alpha for every byte of the dirty rectangle
+};
+
+bool overlay_codec_supported(codec_t codec)
+{
+        return codec == UYVY || codec == RGB || codec == RGBA;
+}
+
+static void set_byte(struct overlay *o, size_t idx, int val, int alpha)
+{
+        o->inv_alpha[idx] = 255 - alpha;
+        o->premul[idx] = val * alpha;
+}
+
+/// converts the dirty rectangle of the RGBA image to the overlay representation
+static void convert_rgba(struct overlay *o, const unsigned char *rgba, int width, int dirty_width)
+{
+        for (int y = 0; y < o->dirty_height; ++y) {
+                const unsigned char *src = rgba + ((size_t) (o->dirty_y + y) * width + o->dirty_x) * 4;
+                size_t idx = (size_t) y * o->row_bytes;
+                if (o->codec == UYVY) {
+                        for (int x = 0; x < dirty_width; x += 2, src += 8, idx += 4) {
+                                const bool pair = x + 1 < dirty_width; // otherwise the 2nd pixel is transparent padding
+                                int a[2] = { src[3], pair ? src[7] : 0 };
+                                int cb[2];
+                                int cr[2];
+                                for (int i = 0; i < 2; ++i) {
+                                        const unsigned char *p = pair ? src + 4 * i : src;
+                                        comp_type_t luma = (RGB_TO_Y_709_SCALED(p[0], p[1], p[2]) >> COMP_BASE) + 16;
+                                        cb[i] = (RGB_TO_CB_709_SCALED(p[0], p[1], p[2]) >> COMP_BASE) + 128;
+                                        cr[i] = (RGB_TO_CR_709_SCALED(p[0], p[1], p[2]) >> COMP_BASE) + 128;
+                                        set_byte(o, idx + 1 + 2 * i, CLAMP_LIMITED_Y(luma, 8), a[i]);
+                                }
+                                // chroma of the alpha-weighted pixel pair
+                                int alpha_c = (a[0] + a[1] + 1) / 2;
+                                o->inv_alpha[idx] = o->inv_alpha[idx + 2] = 255 - alpha_c;
+                                o->premul[idx] = (CLAMP_LIMITED_CBCR(cb[0], 8) * a[0] + CLAMP_LIMITED_CBCR(cb[1], 8) * a[1]) / 2;
+                                o->premul[idx + 2] = (CLAMP_LIMITED_CBCR(cr[0], 8) * a[0] + CLAMP_LIMITED_CBCR(cr[1], 8) * a[1]) / 2;
+                        }
+                } else {
+                        const int bpp = o->codec == RGBA ? 4 : 3;
+                        for (int x = 0; x < dirty_width; ++x, src += 4, idx += bpp) {
+                                for (int i = 0; i < 3; ++i) {
+                                        set_byte(o, idx + i, src[i], src[3]);
+                                }
+                                if (o->codec == RGBA) {
+                                        set_byte(o, idx + 3, 0, 0); // keep the frame alpha
+                                }
+                        }
+                }
+        }
+}
+
+struct overlay *overlay_create(const unsigned char *rgba, int width, int height, codec_t codec)
+{
+        if (!overlay_codec_supported(codec)) {
+                return NULL;
+        }
+        int x_min = width;
+        int x_max = -1;
+        int y_min = height;
+        int y_max = -1;
+        for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                        if (rgba[((size_t) y * width + x) * 4 + 3] != 0) {
+                                x_min = MIN(x_min, x);
+                                x_max = MAX(x_max, x);
+                                y_min = MIN(y_min, y);
+                                y_max = MAX(y_max, y);
+                        }
+                }
+        }
+
+        struct overlay *o = calloc(1, sizeof *o);
+        o->codec = codec;
+        if (x_max < 0) { // fully transparent
+                return o;
+        }
+        const int block = get_pf_block_pixels(codec);
+        o->dirty_x = x_min / block * block;
+        o->dirty_y = y_min;
+        o->dirty_height = y_max - y_min + 1;
+        const int dirty_width = x_max + 1 - o->dirty_x;
+        o->row_bytes = vc_get_linesize((dirty_width + block - 1) / block * block, codec);
+        o->inv_alpha = malloc((size_t) o->row_bytes * o->dirty_height);
+        o->premul = malloc((size_t) o->row_bytes * o->dirty_height * sizeof o->premul[0]);
+        convert_rgba(o, rgba, width, dirty_width);
+        return o;
+}
+
+void overlay_destroy(struct overlay *o)
+{
+        if (o == NULL) {
+                return;
+        }
+        free(o->inv_alpha);
+        free(o->premul);
+        free(o);
+}
+
+/// dst = dst * inv_alpha / 255 + premul / 255, the division is exact floor for the whole range
+static void blend_line(unsigned char *dst, const uint8_t *inv_alpha, const uint16_t *premul, int len)
+{
+        int i = 0;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i transparent = _mm_set1_epi8((char) 255);
+        for ( ; i + 16 <= len; i += 16) {
+                __m128i ia = _mm_loadu_si128((const __m128i *)(const void *) (inv_alpha + i));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(ia, transparent)) == 0xFFFF) {
+                        continue; // premul is 0 as well
+                }
+                __m128i d = _mm_loadu_si128((const __m128i *)(void *) (dst + i));
+                __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(ia, zero)),
+                                _mm_loadu_si128((const __m128i *)(const void *) (premul + i)));
+                __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(ia, zero)),
+                                _mm_loadu_si128((const __m128i *)(const void *) (premul + i + 8)));
+                lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, one), _mm_srli_epi16(lo, 8)), 8);
+                hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, one), _mm_srli_epi16(hi, 8)), 8);
+                _mm_storeu_si128((__m128i *)(void *) (dst + i), _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for ( ; i < len; ++i) {
+                unsigned val = dst[i] * inv_alpha[i] + premul[i];
+                dst[i] = (val + 1 + (val >> 8)) >> 8;
+        }
+}
+
+void overlay_blend(const struct overlay *o, char *data, int pitch, int x, int y)
+{
+        assert(x % get_pf_block_pixels(o->codec) == 0);
+        unsigned char *dst = (unsigned char *) data + (size_t) (y + o->dirty_y) * pitch
+                + vc_get_linesize(x + o->dirty_x, o->codec);
+        for (int row = 0; row < o->dirty_height; ++row) {
+                size_t idx = (size_t) row * o->row_bytes;
+                blend_line(dst + (size_t) row * pitch, o->inv_alpha + idx, o->premul + idx, o->row_bytes);
+        }
+}
@@ -0,0 +1,77 @@
+/**
+ * @file   utils/overlay.h
+ * @brief  alpha-blended overlays pre-rendered in the target pixel format
+ *
+ * An RGBA image (logo, rendered text) is converted once to the pixel format
+ * of the video as per-byte premultiplied values and inverse alphas, only for
+ * the bounding box of its non-transparent pixels. Blending to a frame is then
+ * a single multiply-add per byte restricted to that rectangle (vectorized
+ * with SSE2 if available).
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_OVERLAY_H_
+#define UTILS_OVERLAY_H_
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct overlay;
+
+/// @returns true if overlay_create() accepts the pixel format
+bool overlay_codec_supported(codec_t codec);
+/**
+ * @param rgba   width x height RGBA 8-bit image, not premultiplied
+ * @returns NULL if the codec is not supported
+ */
+struct overlay *overlay_create(const unsigned char *rgba, int width, int height, codec_t codec);
+void overlay_destroy(struct overlay *o);
+/**
+ * Blends the overlay to the frame. The overlay (with width rounded up to
+ * get_pf_block_pixels() of the codec) must fit the frame and x must be a
+ * multiple of the block size.
+ *
+ * @param data   frame data in the codec the overlay was created for
+ * @param pitch  frame line length in bytes
+ */
+void overlay_blend(const struct overlay *o, char *data, int pitch, int x, int y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_OVERLAY_H_
@@ -44,42 +44,45 @@
 #include "utils/parallel_conv.h"
 #include "utils/worker.h"
 
+#define MIN_LINES_PER_CHUNK 16
+#define MAX_LINES_PER_CHUNK 64
+#define CHUNKS_PER_THREAD 4
+
 struct parallel_pix_conv_data {
         decoder_t decode;
-        int height;
         unsigned char *out_data;
         int out_linesize;
         const unsigned char *in_data;
         int in_linesize;
 };
 
-static void *parallel_pix_conv_task(void *arg) {
-        struct parallel_pix_conv_data *data = arg;
-        for (int y = 0; y < data->height; ++y) {
-                data->decode(data->out_data, data->in_data, data->out_linesize, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
-                data->out_data += data->out_linesize;
-                data->in_data += data->in_linesize;
+static void parallel_pix_conv_body(void *udata, size_t begin, size_t end) {
+        struct parallel_pix_conv_data *data = udata;
+        unsigned char *out = data->out_data + begin * data->out_linesize;
+        const unsigned char *in = data->in_data + begin * data->in_linesize;
+        for (size_t y = begin; y < end; ++y) {
+                data->decode(out, in, data->out_linesize, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+                out += data->out_linesize;
+                in += data->in_linesize;
         }
-        return NULL;
 }
 
-/// @todo utilize respawn_parallel
+/**
+ * Converts the picture by bands of 16-64 lines distributed among the worker
+ * pool (see task_run_parallel_for()).
+ *
+ * @param threads  parallelism hint, 1 converts serially in the calling thread
+ */
 void parallel_pix_conv(int height, char *out, int out_linesize, const char *in, int in_linesize, decoder_t decode, int threads)
 {
-        struct parallel_pix_conv_data data[threads];
-
-        for (int i = 0; i < threads; ++i) {
-                data[i].decode = decode;
-                data[i].height = height / threads;
-                data[i].out_data = (unsigned char *) out + i * data[i].height * out_linesize;
-                data[i].out_linesize = out_linesize;
-                data[i].in_data = (const unsigned char *) in + i * data[i].height * in_linesize;
-                data[i].in_linesize = in_linesize;
-                if (i == threads - 1) {
-                        data[i].height = height - (threads - 1) * (height / threads);
-                }
+        struct parallel_pix_conv_data data = { decode, (unsigned char *) out, out_linesize,
+                (const unsigned char *) in, in_linesize };
+        if (threads <= 1) {
+                parallel_pix_conv_body(&data, 0, height);
+                return;
         }
-
-        task_run_parallel(parallel_pix_conv_task, threads, data, sizeof data[0], NULL);
+        int lines = height / (threads * CHUNKS_PER_THREAD);
+        lines = lines < MIN_LINES_PER_CHUNK ? MIN_LINES_PER_CHUNK
+                : lines > MAX_LINES_PER_CHUNK ? MAX_LINES_PER_CHUNK : lines;
+        task_run_parallel_for(height, lines, parallel_pix_conv_body, &data);
 }
-
@@ -1,138 +1,357 @@
-#ifdef BUILD_PROFILED
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // defined HAVE_CONFIG_H
 
+#ifndef DISABLE_PROFILER
+
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
 #include "profile_timer.hpp"
 
-std::chrono::steady_clock::time_point Profiler::start_point;
+#define RING_SIZE (1 << 14) ///< events per thread, power of two
+#define FLUSH_INTERVAL std::chrono::milliseconds(100)
+#define DEFAULT_TRIGGER_WINDOW_SEC 5
 
-Profiler& Profiler::get_instance(){
-        static Profiler inst;
-        static std::mutex mut;
-        std::lock_guard<std::mutex> lock(mut);
-        if(inst.start_point.time_since_epoch() == std::chrono::steady_clock::duration::zero()){
-                inst.start_point = std::chrono::steady_clock::now();
+/**
+ * Single-producer ring of the events of one thread. In the continuous mode
+ * the flusher consumes the events and the owner drops the new ones if the
+ * ring is full. In the trigger mode the owner overwrites the oldest events
+ * and the flusher only takes copies - the entries that may have been
+ * overwritten during the copy are detected by re-reading head afterwards.
+ */
+struct Profiler_thread_buffer {
+        struct slot {
+                std::atomic<const char *> name{nullptr};
+                std::atomic<int64_t> start{0};
+                std::atomic<int64_t> end{0};
+        };
+
+        explicit Profiler_thread_buffer(int t) : tid(t), slots(new slot[RING_SIZE]) {}
+
+        void push_drop(const char *name, int64_t start, int64_t end) {
+                uint64_t h = head.load(std::memory_order_relaxed);
+                if (h - tail.load(std::memory_order_acquire) == RING_SIZE) {
+                        return;
+                }
+                push_overwrite(name, start, end);
         }
-        return inst;
+        void push_overwrite(const char *name, int64_t start, int64_t end) {
+                uint64_t h = head.load(std::memory_order_relaxed);
+                slot &s = slots[h % RING_SIZE];
+                s.name.store(name, std::memory_order_relaxed);
+                s.start.store(start, std::memory_order_relaxed);
+                s.end.store(end, std::memory_order_relaxed);
+                head.store(h + 1, std::memory_order_release);
+        }
+
+        const int tid;
+        std::unique_ptr<slot[]> slots;
+        std::atomic<uint64_t> head{0}; ///< written by the owner thread only
+        std::atomic<uint64_t> tail{0}; ///< written by the flusher only
+        std::atomic<bool> finished{false}; ///< owner thread exited
+};
+
+namespace {
+struct event_copy {
+        const char *name;
+        int64_t start;
+        int64_t end;
+};
+
+void write_escaped(std::ostream &out, const char *str)
+{
+        for ( ; *str != '\0'; ++str) {
+                if (*str == '"' || *str == '\\') {
+                        out << '\\';
+                }
+                out << *str;
+        }
+}
+
+void write_event(std::ostream &out, bool *first, long pid, int tid, event_copy const &e)
+{
+        out << (*first ? "\n" : ",\n");
+        *first = false;
+        out << "{ \"name\": \"";
+        write_escaped(out, e.name);
+        out << "\", \"cat\": \"function\", \"ph\": \"X\", \"pid\": " << pid
+                << ", \"tid\": " << tid << ", \"ts\": " << e.start
+                << ", \"dur\": " << e.end - e.start << " }";
+}
+} // end of anonymous namespace
+
+Profiler& Profiler::get_instance(){
+        // never destroyed - threads still running at exit may use it, the output is finished by atexit handler
+        static Profiler *inst = [] {
+                auto *p = new Profiler;
+                if (p->is_active()) {
+                        atexit([] { get_instance().stop(); });
+                }
+                return p;
+        }();
+        return *inst;
 }
 
-void Profiler::write_events(const std::vector<Profile_event>& events){
-        if(!active)
+Profiler::Profiler() : start_point(std::chrono::steady_clock::now()) {
+        const char *env_p = std::getenv("UG_PROFILE");
+        if (env_p == nullptr || env_p[0] == '\0') {
                 return;
+        }
 
-        std::lock_guard<std::mutex> lock(io_mut);
-        for(const auto& event : events){
+        std::string conf = env_p;
+        name = conf.substr(0, conf.find(':'));
+        for (size_t pos = conf.find(':'); pos != std::string::npos; ) {
+                size_t next = conf.find(':', pos + 1);
+                std::string opt = conf.substr(pos + 1, next == std::string::npos ? next : next - pos - 1);
+                if (opt.compare(0, 7, "sample=") == 0) {
+                        sample_rate = std::max(atoi(opt.c_str() + 7), 1);
+                } else if (opt.compare(0, 7, "trigger") == 0) {
+                        int sec = opt.size() > 8 ? atoi(opt.c_str() + 8) : DEFAULT_TRIGGER_WINDOW_SEC;
+                        trigger_window = std::max(sec, 1) * 1000000LL;
+                }
+                pos = next;
+        }
 
-                auto ts = event.start;
-                auto end = event.end;
-                out_file << "{ \"name\": \"" << event.name << "\""
-                        << ", \"cat\": \"function\""
-                        << ", \"ph\": \"X\""
-                        << ", \"pid\": \"" << pid << "\""
-                        << ", \"tid\": \"" << event.thread_id << "\""
-                        << ", \"ts\": \"" << ts << "\""
-                        << ", \"dur\": \"" << end - ts << "\""
-                        << ", \"dbg_end\": \"" << end << "\""
-                        << "},\n ";
+#ifdef _WIN32
+        pid = _getpid();
+#else
+        pid = getpid();
+#endif
+        if (trigger_window == 0) {
+                out_file.open("ug_" + name + ".json");
+                out_file << "[";
         }
+        active = true;
+        flusher_thread = std::thread(&Profiler::flusher, this);
 }
 
-Profiler::Profiler(){
-        const char *env_p = std::getenv("UG_PROFILE");
-        active = env_p && env_p[0] != '\0';
-        if(!active){
+std::shared_ptr<Profiler_thread_buffer> Profiler::register_thread(){
+        std::lock_guard<std::mutex> lk(lock);
+        auto buf = std::make_shared<Profiler_thread_buffer>(next_tid++);
+        buffers.push_back(buf);
+        return buf;
+}
+
+/**
+ * Requests writing of the events from the last trigger window. Subsequent
+ * triggers are ignored until a whole new window is recorded.
+ */
+void Profiler::trigger(const char *reason){
+        if (!is_active() || trigger_window == 0) {
                 return;
         }
+        int64_t expected = 0;
+        if (trigger_at.compare_exchange_strong(expected, now())) {
+                trigger_reason.store(reason);
+                cv.notify_one();
+        }
+}
 
-        std::string filename = "ug_";
-        filename += env_p;
-        filename += ".json";
+void Profiler::flusher(){
+        std::unique_lock<std::mutex> lk(lock);
+        while (!should_exit) {
+                cv.wait_for(lk, FLUSH_INTERVAL);
+                int64_t at = trigger_at.load();
+                if (at != 0) {
+                        if (at - last_dump >= trigger_window || last_dump == 0) {
+                                dump(trigger_reason.load(), at);
+                                last_dump = at;
+                        }
+                        trigger_at.store(0);
+                }
+                flush();
+        }
+        flush();
+}
 
-        pid = std::this_thread::get_id();
-        out_file.open(filename);
+/// writes the events of the continuous mode and removes buffers of finished threads, called with lock held
+void Profiler::flush(){
+        for (auto it = buffers.begin(); it != buffers.end(); ) {
+                Profiler_thread_buffer &b = **it;
+                bool finished = b.finished.load(std::memory_order_acquire);
+                if (trigger_window == 0) {
+                        uint64_t h = b.head.load(std::memory_order_acquire);
+                        for (uint64_t i = b.tail.load(std::memory_order_relaxed); i < h; ++i) {
+                                auto &s = b.slots[i % RING_SIZE];
+                                write_event(out_file, &first_event, pid, b.tid, { s.name.load(std::memory_order_relaxed),
+                                                s.start.load(std::memory_order_relaxed), s.end.load(std::memory_order_relaxed) });
+                        }
+                        b.tail.store(h, std::memory_order_release);
+                }
+                it = finished ? buffers.erase(it) : it + 1;
+        }
+        if (out_file.is_open()) {
+                out_file.flush();
+        }
+}
 
-        out_file << "[ ";
+/// writes events ending in the trigger window before at, called with lock held
+void Profiler::dump(const char *reason, int64_t at){
+        std::ofstream out("ug_" + name + "_" + std::to_string(++dump_count) + ".json");
+        bool first = true;
+        out << "[";
+        std::vector<event_copy> events;
+        for (auto const &buf : buffers) {
+                Profiler_thread_buffer &b = *buf;
+                uint64_t h = b.head.load(std::memory_order_acquire);
+                uint64_t begin = h > RING_SIZE ? h - RING_SIZE : 0;
+                events.clear();
+                for (uint64_t i = begin; i < h; ++i) {
+                        auto &s = b.slots[i % RING_SIZE];
+                        events.push_back({ s.name.load(std::memory_order_relaxed),
+                                        s.start.load(std::memory_order_relaxed), s.end.load(std::memory_order_relaxed) });
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                uint64_t h_after = b.head.load(std::memory_order_relaxed);
+                uint64_t valid_from = h_after > RING_SIZE ? h_after - RING_SIZE : 0;
+                for (uint64_t i = std::max(begin, valid_from); i < h; ++i) {
+                        event_copy const &e = events[i - begin];
+                        if (e.end >= at - trigger_window) {
+                                write_event(out, &first, pid, b.tid, e);
+                        }
+                }
+        }
+        out << (first ? "\n" : ",\n") << "{ \"name\": \"";
+        write_escaped(out, reason != nullptr ? reason : "trigger");
+        out << "\", \"ph\": \"i\", \"s\": \"g\", \"pid\": " << pid << ", \"tid\": 0, \"ts\": " << at << " }\n]\n";
 }
 
-Profiler_thread_inst::Profiler_thread_inst(Profiler& profiler) : profiler(profiler) {
-        thread_events.reserve(THREAD_EVENT_BUF_SIZE);
+void Profiler::stop(){
+        {
+                std::lock_guard<std::mutex> lk(lock);
+                should_exit = true;
+        }
+        cv.notify_one();
+        if (flusher_thread.joinable()) {
+                flusher_thread.join();
+        }
+        active = false;
+        if (out_file.is_open()) {
+                out_file << "\n]\n";
+                out_file.close();
+        }
+}
+
+Profiler_thread_inst::Profiler_thread_inst() : profiler(Profiler::get_instance()) {
+        if (profiler.is_active()) {
+                buffer = profiler.register_thread();
+        }
         c_timers.reserve(20);
 }
 
 Profiler_thread_inst& Profiler_thread_inst::get_instance(){
-        static thread_local Profiler_thread_inst inst(Profiler::get_instance());
+        static thread_local Profiler_thread_inst inst;
         return inst;
 }
 
 Profiler_thread_inst::~Profiler_thread_inst(){
-        profiler.write_events(thread_events);
+        if (buffer) {
+                buffer->finished.store(true, std::memory_order_release);
+        }
 }
 
-void Profiler_thread_inst::add_event(Profile_event&& event){
-        if(thread_events.size() == THREAD_EVENT_BUF_SIZE){
-                profiler.write_events(thread_events);
-                thread_events.clear();
+/// @returns true if the timer should be recorded (sampling)
+bool Profiler_thread_inst::begin(int64_t *start){
+        if (depth++ == 0) {
+                sampled = sample_counter++ % profiler.get_sample_rate() == 0;
+        }
+        if (!sampled || !buffer) {
+                return false;
+        }
+
+        /* Chromium has problems if two events within the same thread have
+         * the same start time. To work around this we just add a microsecond
+         * if the start time would be the same as the previous one
+         */
+        int64_t ts = profiler.now();
+        if(ts <= last_ts){
+                ts = last_ts + 1;
         }
+        *start = last_ts = ts;
+        return true;
+}
 
-        thread_events.emplace_back(std::move(event));
+void Profiler_thread_inst::end(const char *name, int64_t start){
+        if (name != nullptr) {
+                int64_t end = profiler.now();
+                if (!profiler.is_trigger_mode()) {
+                        buffer->push_drop(name, start, end);
+                } else {
+                        buffer->push_overwrite(name, start, end);
+                }
+        }
+        depth -= 1;
 }
 
 void Profiler_thread_inst::push_timer(const char *name){
-        c_timers.emplace_back(std::ref(*this), std::string(name));
+        c_timers.emplace_back(name);
 }
 
 void Profiler_thread_inst::pop_timer(){
-        c_timers.pop_back();
+        if (!c_timers.empty()) {
+                c_timers.pop_back();
+        }
 }
 
-Profile_timer::Profile_timer(Profiler_thread_inst& profiler, std::string name) :
-        profiler(profiler),
-        event(name, std::this_thread::get_id())
-{
-        auto ts = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - profiler.profiler.get_start_point()).count();
-
-        /* Chromium has problems if two events within the same thread have
-         * the same start time. To work around this we just add a microsecond
-         * if the start time would be the same as the previous one
-         */
-        if(ts <= profiler.last_ts){
-                ts = profiler.last_ts + 1;
+Profile_timer::Profile_timer(const char *n) {
+        if (n == nullptr || n[0] == '\0' || !Profiler::get_instance().is_active()) {
+                return;
+        }
+        counted = true;
+        if (Profiler_thread_inst::get_instance().begin(&start)) {
+                name = n;
         }
-
-        event.start = ts;
-        profiler.last_ts = ts;
 }
 
-Profile_timer::Profile_timer(Profile_timer&& o) :
-        profiler(o.profiler)
+Profile_timer::Profile_timer(Profile_timer&& o) noexcept :
+        name(o.name), start(o.start), counted(o.counted)
 {
-        std::swap(event, o.event);
+        o.name = nullptr;
+        o.counted = false;
 }
 
 Profile_timer::~Profile_timer(){
         commit();
 }
 
-Profile_timer& Profile_timer::operator=(Profile_timer&& rhs) {
-        std::swap(event, rhs.event);
-        std::swap(profiler, rhs.profiler);
+Profile_timer& Profile_timer::operator=(Profile_timer&& rhs) noexcept {
+        std::swap(name, rhs.name);
+        std::swap(start, rhs.start);
+        std::swap(counted, rhs.counted);
         return *this;
 }
 
 void Profile_timer::commit(){
-        if(event.name.empty())
+        if (!counted) {
                 return;
-
-        event.end = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - profiler.get().profiler.get_start_point()).count();
-        profiler.get().add_event(std::move(event));
+        }
+        Profiler_thread_inst::get_instance().end(name, start);
+        name = nullptr;
+        counted = false;
 }
 
 void push_prof_timer(const char *name){
-        Profiler_thread_inst::get_instance().push_timer(name);
+        if (Profiler::get_instance().is_active()) {
+                Profiler_thread_inst::get_instance().push_timer(name);
+        }
 }
 
 void pop_prof_timer(){
-        Profiler_thread_inst::get_instance().pop_timer();
+        if (Profiler::get_instance().is_active()) {
+                Profiler_thread_inst::get_instance().pop_timer();
+        }
+}
+
+void profiler_trigger(const char *reason){
+        Profiler::get_instance().trigger(reason);
 }
 
-#endif //BUILD_PROFILED
+#endif //DISABLE_PROFILER
@@ -1,7 +1,23 @@
 #ifndef PROFILE_TIMER_HPP
 #define PROFILE_TIMER_HPP
 
-#ifdef BUILD_PROFILED
+/*
+ * Scoped timers writing Chrome trace event format (viewable in Perfetto or
+ * chrome://tracing). Compiled in unless DISABLE_PROFILER is defined and
+ * enabled at runtime by the environment variable:
+ *
+ *   UG_PROFILE=<name>[:sample=<n>][:trigger[=<sec>]]
+ *
+ * Events are stored in per-thread lock-free ring buffers and written to
+ * ug_<name>.json by a background thread. sample=<n> records only every n-th
+ * outermost scope of each thread, trigger keeps just the last <sec> seconds
+ * (default 5) in the rings and writes them to ug_<name>_<k>.json when
+ * profiler_trigger() is called (eg. when a frame misses its deadline).
+ *
+ * Timer names must be string literals (or other static storage strings).
+ */
+
+#ifndef DISABLE_PROFILER
 
 #define C_PROFILER_PUSH(name) \
         push_prof_timer((name))
@@ -9,46 +25,39 @@
 #define C_PROFILER_POP \
         pop_prof_timer()
 
+#define PROFILER_TRIGGER(reason) \
+        profiler_trigger((reason))
+
 #ifdef __cplusplus
 
+#include <atomic>
 #include <chrono>
-#include <vector>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
-#include <fstream>
-#include <functional>
+#include <vector>
 
-#define THREAD_EVENT_BUF_SIZE 256
+#define PROFILER_CONCAT2(a, b) a ## b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT2(a, b)
 
 #define PROFILE_FUNC \
-        Profile_timer PROFILER_PROFILE_TIMER_FUNC(Profiler_thread_inst::get_instance(), __PRETTY_FUNCTION__); \
-        Profile_timer PROFILER_PROFILE_TIMER_DETAIL(Profiler_thread_inst::get_instance(), "");
+        Profile_timer PROFILER_PROFILE_TIMER_FUNC(__PRETTY_FUNCTION__); \
+        Profile_timer PROFILER_PROFILE_TIMER_DETAIL(nullptr);
 
 #define PROFILE_DETAIL(name) \
-        PROFILER_PROFILE_TIMER_DETAIL = Profile_timer(Profiler_thread_inst::get_instance(), (name));
-
+        PROFILER_PROFILE_TIMER_DETAIL = Profile_timer((name));
 
-struct Profile_event {
-        Profile_event(std::string name,
-                        std::thread::id thread_id) :
-                name(name),
-                start(),
-                end(),
-                thread_id(thread_id) {  }
+/// times the rest of the enclosing block
+#define PROFILE_SCOPE(name) \
+        Profile_timer PROFILER_CONCAT(PROFILER_PROFILE_TIMER_SCOPE_, __LINE__)((name));
 
-        Profile_event() = default;
-
-        std::string name;
-        std::chrono::steady_clock::time_point::rep start;
-        std::chrono::steady_clock::time_point::rep end;
-
-        std::thread::id thread_id;
-};
-
-class Profiler_thread_inst;
+struct Profiler_thread_buffer;
 
 class Profiler {
-        friend Profiler_thread_inst;
         public:
         static Profiler& get_instance();
 
@@ -57,70 +66,100 @@ class Profiler {
         Profiler& operator=(Profiler&&) = delete;
         Profiler& operator=(const Profiler&) = delete;
 
-        void write_events(const std::vector<Profile_event>& events);
-
-        static std::chrono::steady_clock::time_point get_start_point(){
-                return start_point;
+        bool is_active() const {
+                return active.load(std::memory_order_relaxed);
+        }
+        unsigned get_sample_rate() const {
+                return sample_rate;
         }
+        bool is_trigger_mode() const {
+                return trigger_window != 0;
+        }
+        /// @returns microseconds since the profiler start
+        int64_t now() const {
+                return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_point).count();
+        }
+
+        std::shared_ptr<Profiler_thread_buffer> register_thread();
+        void trigger(const char *reason);
 
         private:
         Profiler();
+        void stop();
+        void flusher();
+        void flush();
+        void dump(const char *reason, int64_t at);
+
+        std::atomic<bool> active{false};
+        std::chrono::steady_clock::time_point start_point;
+        std::string name;
+        unsigned sample_rate = 1;
+        int64_t trigger_window = 0; ///< us, 0 - continuous output
+
+        std::mutex lock;
+        std::condition_variable cv;
+        bool should_exit = false;
+        std::vector<std::shared_ptr<Profiler_thread_buffer>> buffers;
+        int next_tid = 1;
+        long pid = 0;
 
-        std::mutex io_mut;
         std::ofstream out_file;
-        std::thread::id pid;
+        bool first_event = true;
 
-        bool active = false;
+        std::atomic<int64_t> trigger_at{0};
+        std::atomic<const char *> trigger_reason{nullptr};
+        int64_t last_dump = 0;
+        int dump_count = 0;
 
-        static std::chrono::steady_clock::time_point start_point;
+        std::thread flusher_thread;
 };
 
-class Profile_timer;
+class Profile_timer {
+        public:
+        explicit Profile_timer(const char *name);
+        Profile_timer(Profile_timer&&) noexcept;
+        Profile_timer(const Profile_timer&) = delete;
+        ~Profile_timer();
+
+        Profile_timer& operator=(Profile_timer&& rhs) noexcept;
+        Profile_timer& operator=(const Profile_timer&) = delete;
+
+        private:
+        void commit();
+
+        const char *name = nullptr; ///< nullptr if not running
+        int64_t start = 0;
+        bool counted = false; ///< included in Profiler_thread_inst::depth
+};
 
 class Profiler_thread_inst {
-        friend Profile_timer;
+        friend class Profile_timer;
         public:
-
-        Profiler_thread_inst(Profiler& profiler);
-        ~Profiler_thread_inst();
+        static Profiler_thread_inst& get_instance();
 
         Profiler_thread_inst(const Profiler_thread_inst&) = delete;
         Profiler_thread_inst(Profiler_thread_inst&&) = delete;
         Profiler_thread_inst& operator=(Profiler_thread_inst&&) = delete;
         Profiler_thread_inst& operator=(const Profiler_thread_inst&) = delete;
-
-        static Profiler_thread_inst& get_instance();
-
-        void add_event(Profile_event&& event);
+        ~Profiler_thread_inst();
 
         void push_timer(const char *name);
         void pop_timer();
 
         private:
+        Profiler_thread_inst();
+        bool begin(int64_t *start);
+        void end(const char *name, int64_t start);
+
         Profiler& profiler;
-        std::vector<Profile_event> thread_events;
-        std::chrono::steady_clock::time_point::rep last_ts;
+        std::shared_ptr<Profiler_thread_buffer> buffer;
+        int64_t last_ts = -1;
+        int depth = 0; ///< nesting level of active timers
+        unsigned sample_counter = 0;
+        bool sampled = true; ///< current outermost scope is recorded
         std::vector<Profile_timer> c_timers;
 };
 
-class Profile_timer {
-        friend Profiler;
-        public:
-        Profile_timer(Profiler_thread_inst& profiler, std::string name);
-        Profile_timer(Profile_timer&&);
-        Profile_timer(const Profile_timer&) = delete;
-        ~Profile_timer();
-
-        Profile_timer& operator=(Profile_timer&& rhs);
-        Profile_timer& operator=(const Profile_timer&) = delete;
-
-        private:
-        void commit();
-
-        std::reference_wrapper<Profiler_thread_inst> profiler;
-        Profile_event event;
-};
-
 #endif //__cplusplus
 
 #ifdef __cplusplus
@@ -128,19 +167,22 @@ extern "C" {
 #endif //__cplusplus
 
         void push_prof_timer(const char *name);
-        void pop_prof_timer();
+        void pop_prof_timer(void);
+        void profiler_trigger(const char *reason);
 
 #ifdef __cplusplus
 }
 #endif //__cplusplus
 
-#else //BUILD_PROFILED
+#else //DISABLE_PROFILER
 
 #define PROFILE_FUNC
 #define PROFILE_DETAIL(name)
+#define PROFILE_SCOPE(name)
 #define C_PROFILER_PUSH(name)
 #define C_PROFILER_POP
+#define PROFILER_TRIGGER(reason)
 
-#endif //BUILD_PROFILED
+#endif //DISABLE_PROFILER
 
 #endif
@@ -0,0 +1,115 @@
+/**
+ * @file   utils/queue_stats.h
+ * @brief  optional metrics of the inter-stage queues
+ *
+ * Enabled by naming the queue (synchronized_queue::set_name(),
+ * lockfree_queue::set_name()), the series are labelled queue="<name>":
+ * - ug_queue_depth, ug_queue_capacity - items queued and the limit (-1 unlimited)
+ * - ug_queue_pushes_total
+ * - ug_queue_push_blocked_microseconds_total - producers waiting for space,
+ *   grows when the consumer stage is the bottleneck
+ * - ug_queue_pop_blocked_microseconds_total - consumers waiting for items,
+ *   grows when the producer stage is the bottleneck (or the stream is idle)
+ * - ug_queue_drops_total - items the producer discarded instead of pushing
+ *
+ * Only the blocking paths are timed, so the cost of an enabled queue is a few
+ * relaxed atomic updates per item.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_QUEUE_STATS_H_
+#define UTILS_QUEUE_STATS_H_
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+#include "utils/metrics.h"
+
+struct queue_stats {
+        explicit queue_stats(const char *name)
+        {
+                std::string labels = "queue=\"";
+                for (const char *c = name; *c != '\0'; ++c) {
+                        if (*c == '"' || *c == '\\') {
+                                labels += '\\';
+                        }
+                        labels += *c;
+                }
+                labels += "\"";
+                depth = metric_gauge("ug_queue_depth", "Items in the queue", labels.c_str());
+                capacity = metric_gauge("ug_queue_capacity", "Maximal items in the queue (-1 unlimited)", labels.c_str());
+                pushes = metric_counter("ug_queue_pushes_total", "Items pushed to the queue", labels.c_str());
+                push_blocked = metric_counter("ug_queue_push_blocked_microseconds_total",
+                                "Time the producers waited for the queue to have space", labels.c_str());
+                pop_blocked = metric_counter("ug_queue_pop_blocked_microseconds_total",
+                                "Time the consumers waited for an item", labels.c_str());
+                drops = metric_counter("ug_queue_drops_total", "Items dropped instead of pushed", labels.c_str());
+        }
+        void pushed(size_t len) {
+                metric_inc(pushes, 1);
+                metric_set(depth, len);
+        }
+
+        struct metric *depth;
+        struct metric *capacity;
+        struct metric *pushes;
+        struct metric *push_blocked;
+        struct metric *pop_blocked;
+        struct metric *drops;
+};
+
+/// adds the time until the end of the scope to the counter (if not NULL)
+class queue_wait_timer {
+public:
+        explicit queue_wait_timer(struct metric *m) : counter(m) {
+                if (counter != nullptr) {
+                        start = std::chrono::steady_clock::now();
+                }
+        }
+        ~queue_wait_timer() {
+                if (counter != nullptr) {
+                        metric_inc(counter, std::chrono::duration_cast<std::chrono::microseconds>(
+                                                std::chrono::steady_clock::now() - start).count());
+                }
+        }
+        queue_wait_timer(queue_wait_timer const &) = delete;
+        queue_wait_timer &operator=(queue_wait_timer const &) = delete;
+
+private:
+        struct metric *counter;
+        std::chrono::steady_clock::time_point start;
+};
+
+#endif // UTILS_QUEUE_STATS_H_
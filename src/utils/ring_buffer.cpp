@@ -44,6 +44,8 @@
 #include <memory>
 #include <atomic>
 
+#define RING_CACHE_LINE 64
+
 struct ring_buffer {
         std::unique_ptr<char[]> data;
         int len;
@@ -59,8 +61,12 @@ struct ring_buffer {
          *
          * When the range is doubled, full buffer has start == end in modulo
          * ring->len, but not in modulo 2*ring->len.
+         *
+         * The indices are on separate cache lines so that the reader and
+         * the writer don't invalidate each other's line on every update.
          */
-        std::atomic<int> start, end;
+        alignas(RING_CACHE_LINE) std::atomic<int> start;
+        alignas(RING_CACHE_LINE) std::atomic<int> end;
 };
 
 struct ring_buffer *ring_buffer_init(int size) {
@@ -224,6 +230,23 @@ void ring_buffer_write(struct ring_buffer * ring, const char *in, int len) {
         }
 }
 
+bool ring_buffer_try_write(struct ring_buffer *ring, const char *in, int len) {
+        if (len > ring_get_available_write_size(ring)) {
+                return false;
+        }
+        void *ptr1;
+        int size1;
+        void *ptr2;
+        int size2;
+        ring_get_write_regions(ring, len, &ptr1, &size1, &ptr2, &size2);
+        memcpy(ptr1, in, size1);
+        if (ptr2) {
+                memcpy(ptr2, in + size1, size2);
+        }
+        ring_advance_write_idx(ring, len);
+        return true;
+}
+
 int ring_get_size(struct ring_buffer * ring) {
         return ring->len;
 }
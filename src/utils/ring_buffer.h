@@ -67,6 +67,14 @@ void ring_buffer_destroy(struct ring_buffer * ring);
  */
 int ring_buffer_read(struct ring_buffer * ring, char *out, int max_len);
 void ring_buffer_write(struct ring_buffer * ring, const char *in, int len);
+/**
+ * Writes the data only if there is enough free space, so unlike
+ * ring_buffer_write() it never overwrites the data that the reader may be
+ * just reading. Wait-free, doesn't print anything - can be used from
+ * a real-time thread.
+ * @retval false  data were dropped (not enough space)
+ */
+bool ring_buffer_try_write(struct ring_buffer *ring, const char *in, int len);
 int ring_get_size(struct ring_buffer * ring);
 /**
  * Flushes all data from ring buffer. Not thread safe - needs external
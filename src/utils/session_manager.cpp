@@ -0,0 +1,284 @@
+/**
+ * @file   utils/session_manager.cpp
+ *
+ * The control commands ("session <cmd>" on the control socket) are processed
+ * synchronously in the new_message callback of the manager module:
+ * - create <name> <args> - starts a session with uv command-line arguments
+ * - destroy <name>       - stops the session and waits for it to finish
+ * - list                 - names and states of the sessions
+ * - <name> <path> <msg>  - forwards msg to the path in the session tree
+ *
+ * Session threads block the termination signals so that they (and the
+ * threads spawned by them) are always handled by the main thread.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <cctype>
+#include <csignal>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "debug.h"
+#include "host.h"
+#include "messaging.h"
+#include "module.h"
+#include "utils/session_manager.hpp"
+#include "utils/thread.h"
+
+#define MOD_NAME "[session] "
+
+using std::lock_guard;
+using std::map;
+using std::mutex;
+using std::string;
+using std::thread;
+using std::unique_ptr;
+using std::vector;
+
+struct session {
+        string name;
+        vector<string> args; ///< args[0] is the name
+        thread thr;
+
+        mutex lock;
+        struct module *root = nullptr; ///< valid between session_started() and session_stopped()
+        bool stop_requested = false;
+        bool finished = false;
+        int exit_status = 0;
+};
+
+struct session_manager {
+        struct module mod;
+        session_run_t run;
+        map<string, unique_ptr<session>> sessions;
+};
+
+/// splits cmdline to arguments, double quotes may be used to group words
+static vector<string> split_args(const char *cmdline)
+{
+        vector<string> ret;
+        const char *c = cmdline;
+        while (*c != '\0') {
+                while (*c == ' ' || *c == '\t') {
+                        c++;
+                }
+                if (*c == '\0') {
+                        break;
+                }
+                string arg;
+                bool quoted = false;
+                for ( ; *c != '\0' && (quoted || (*c != ' ' && *c != '\t')); ++c) {
+                        if (*c == '"') {
+                                quoted = !quoted;
+                        } else {
+                                arg += *c;
+                        }
+                }
+                ret.push_back(arg);
+        }
+        return ret;
+}
+
+static void session_thread(session_manager *sm, session *s)
+{
+        set_thread_name("session");
+#ifndef _WIN32
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGINT);
+        sigaddset(&mask, SIGTERM);
+        sigaddset(&mask, SIGHUP);
+        pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+#endif
+        vector<char *> argv;
+        for (auto &arg : s->args) {
+                argv.push_back(&arg[0]);
+        }
+        argv.push_back(nullptr);
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Session %s started.\n", s->name.c_str());
+        int rc = sm->run((int) argv.size() - 1, argv.data(), s);
+        lock_guard<mutex> lk(s->lock);
+        s->finished = true;
+        s->exit_status = rc;
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Session %s finished with status %d.\n", s->name.c_str(), rc);
+}
+
+/// called by the session when its root module exists (and can receive should_exit)
+void session_started(struct session *s, struct module *root)
+{
+        lock_guard<mutex> lk(s->lock);
+        s->root = root;
+        if (s->stop_requested) {
+                exit_uv_root(root, 0);
+        }
+}
+
+/// called by the session before its root module is destroyed
+void session_stopped(struct session *s)
+{
+        lock_guard<mutex> lk(s->lock);
+        s->root = nullptr;
+}
+
+static void stop_session(session *s)
+{
+        {
+                lock_guard<mutex> lk(s->lock);
+                s->stop_requested = true;
+                if (s->root != nullptr) {
+                        exit_uv_root(s->root, 0);
+                }
+        }
+        s->thr.join();
+}
+
+static struct response *create_session(session_manager *sm, const char *cfg)
+{
+        vector<string> args = split_args(cfg);
+        if (args.empty() || isdigit(args[0][0])) {
+                return new_response(RESPONSE_BAD_REQUEST, "usage: session create <name> <args>");
+        }
+        auto it = sm->sessions.find(args[0]);
+        if (it != sm->sessions.end()) {
+                if (!it->second->finished) {
+                        return new_response(RESPONSE_BAD_REQUEST, "session exists");
+                }
+                stop_session(it->second.get()); // reap the finished one
+                sm->sessions.erase(it);
+        }
+        auto s = unique_ptr<session>(new session());
+        s->name = args[0];
+        s->args = std::move(args);
+        s->thr = thread(session_thread, sm, s.get());
+        sm->sessions[s->name] = std::move(s);
+        return new_response(RESPONSE_OK, nullptr);
+}
+
+static struct response *process_command(session_manager *sm, char *text)
+{
+        char *save_ptr = nullptr;
+        char *cmd = strtok_r(text, " ", &save_ptr);
+        char *rest = strtok_r(nullptr, "", &save_ptr);
+        if (cmd == nullptr) {
+                return new_response(RESPONSE_BAD_REQUEST, nullptr);
+        }
+        if (strcmp(cmd, "create") == 0) {
+                return create_session(sm, rest != nullptr ? rest : "");
+        }
+        if (strcmp(cmd, "list") == 0) {
+                string list;
+                for (auto &it : sm->sessions) {
+                        lock_guard<mutex> lk(it.second->lock);
+                        list += (list.empty() ? "" : " ") + it.first + "=" +
+                                (it.second->finished ? "finished(" + std::to_string(it.second->exit_status) + ")" : string("running"));
+                }
+                return new_response(RESPONSE_OK, list.c_str());
+        }
+        const bool destroy = strcmp(cmd, "destroy") == 0;
+        char *name = cmd;
+        if (destroy) {
+                name = rest != nullptr ? strtok_r(rest, " ", &save_ptr) : nullptr;
+        }
+        auto it = name != nullptr ? sm->sessions.find(name) : sm->sessions.end();
+        if (it == sm->sessions.end()) {
+                return new_response(RESPONSE_NOT_FOUND, "no such session");
+        }
+        if (destroy) {
+                stop_session(it->second.get());
+                sm->sessions.erase(it);
+                return new_response(RESPONSE_OK, nullptr);
+        }
+        // forward to the session tree
+        char *path = rest != nullptr ? strtok_r(rest, " ", &save_ptr) : nullptr;
+        char *msg_text = path != nullptr ? strtok_r(nullptr, "", &save_ptr) : nullptr;
+        if (path == nullptr) {
+                return new_response(RESPONSE_BAD_REQUEST, "usage: session <name> <path> <message>");
+        }
+        lock_guard<mutex> lk(it->second->lock);
+        if (it->second->root == nullptr) {
+                return new_response(RESPONSE_NOT_FOUND, "session not running");
+        }
+        auto *msg = (struct msg_universal *) new_message(sizeof(struct msg_universal));
+        if (msg_text != nullptr) {
+                strncpy(msg->text, msg_text, sizeof msg->text - 1);
+        }
+        struct response *r = send_message(it->second->root, path, (struct message *) msg);
+        return r != nullptr ? r : new_response(RESPONSE_NOT_FOUND, nullptr);
+}
+
+static void session_manager_new_message(struct module *mod)
+{
+        auto *sm = static_cast<session_manager *>(mod->priv_data);
+        struct message *msg = nullptr;
+        while ((msg = check_message(mod)) != nullptr) {
+                auto *m = (struct msg_universal *) msg;
+                free_message(msg, process_command(sm, m->text));
+        }
+}
+
+struct session_manager *session_manager_init(struct module *parent, session_run_t run)
+{
+        auto *sm = new session_manager();
+        sm->run = run;
+        module_init_default(&sm->mod);
+        sm->mod.cls = MODULE_CLASS_SESSION;
+        sm->mod.priv_data = sm;
+        sm->mod.new_message = session_manager_new_message;
+        module_register(&sm->mod, parent);
+        return sm;
+}
+
+/// stops all the sessions and waits for them
+void session_manager_done(struct session_manager *sm)
+{
+        if (sm == nullptr) {
+                return;
+        }
+        module_done(&sm->mod);
+        for (auto &it : sm->sessions) {
+                stop_session(it.second.get());
+        }
+        delete sm;
+}
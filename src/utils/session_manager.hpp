@@ -0,0 +1,66 @@
+/**
+ * @file   utils/session_manager.hpp
+ * @brief  independent sender/receiver sessions hosted by one process (--daemon)
+ *
+ * Each session has its own module tree (root module), so it can be stopped
+ * separately, while the loaded modules, worker pool and GPU scheduling are
+ * shared by the process. Sessions are created and destroyed with the control
+ * socket command "session".
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_SESSION_MANAGER_HPP_3F6A0C21
+#define UTILS_SESSION_MANAGER_HPP_3F6A0C21
+
+struct module;
+struct session;
+struct session_manager;
+
+/**
+ * Runs the pipeline given by the command-line arguments in the calling
+ * thread until the session root receives should_exit.
+ *
+ * @param argv  argv[0] is the session name, the strings are owned by the
+ *              session for its whole lifetime and may be modified
+ * @returns exit status of the session
+ */
+typedef int (*session_run_t)(int argc, char *argv[], struct session *s);
+
+struct session_manager *session_manager_init(struct module *parent, session_run_t run);
+void session_manager_done(struct session_manager *sm);
+
+void session_started(struct session *s, struct module *root);
+void session_stopped(struct session *s);
+
+#endif // defined UTILS_SESSION_MANAGER_HPP_3F6A0C21
@@ -0,0 +1,428 @@
+/**
+ * @file   utils/shm_bus.c
+ *
+ * The segment (POSIX shared memory object "/<name>") consists of a header,
+ * slot descriptors and page-aligned slot data. Each slot has a reference
+ * count of readers; the writer claims only slots with no readers that are
+ * not the latest published one, so that a reader can always reference the
+ * latest frame. Publishing bumps the header sequence number, which also
+ * serves as a futex the readers sleep on.
+ *
+ * When the writer needs bigger slots, it closes the segment (readers get
+ * @ref SHM_BUS_CLOSED and reopen it by name) and creates a new one. Reader
+ * mappings are refcounted locally so that frames taken from an old segment
+ * remain valid until disposed.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "types.h"
+#include "utils/macros.h"
+#include "utils/shm_bus.h"
+#include "video_codec.h"
+#include "video_frame.h"
+
+#define MOD_NAME "[shm_bus] "
+
+#define SHM_BUS_MAGIC 0x55475342 // "UGSB"
+#define SHM_BUS_VERSION 1
+#define SHM_BUS_WRITING 0x80000000U ///< slot refcount flag - claimed by the writer
+#define SHM_BUS_ALIGN 4096
+
+struct shm_bus_header {
+        _Atomic uint32_t magic; ///< set last by the writer, 0 until initialized
+        uint32_t version;
+        uint32_t slot_desc_size;
+        uint32_t slot_count;
+        uint32_t tile_count;
+        uint32_t pad;
+        uint64_t tile_capacity; ///< aligned size of a tile
+        uint64_t data_offset;   ///< offset of the slot 0 data
+        uint64_t slot_stride;
+        _Atomic uint32_t seq;   ///< seq of the last published frame (futex word)
+        _Atomic int32_t latest; ///< index of the last published slot, -1 if none
+        _Atomic uint32_t closed;
+};
+
+struct shm_bus_slot {
+        _Atomic uint32_t refcount; ///< readers holding the slot | SHM_BUS_WRITING
+        uint32_t seq;
+        struct video_desc desc;
+        frame_type_t frame_type;
+        uint32_t data_len[SHM_BUS_MAX_TILES];
+        unsigned char metadata[VF_METADATA_SIZE];
+};
+
+struct shm_bus {
+        char name[NAME_MAX];
+        bool writer;
+        _Atomic int refs; ///< owner + frames taken (reader only)
+        ino_t ino;
+        size_t size;
+        unsigned next_slot;
+        struct shm_bus_header *hdr;
+        struct shm_bus_slot *slots;
+};
+
+static size_t align_up(size_t val, size_t align) {
+        return (val + align - 1) / align * align;
+}
+
+static void set_name(struct shm_bus *b, const char *name) {
+        snprintf(b->name, sizeof b->name, "/%s", name[0] == '/' ? name + 1 : name);
+}
+
+static int futex(_Atomic uint32_t *addr, int op, uint32_t val, const struct timespec *timeout) {
+        // not FUTEX_PRIVATE_FLAG - the word is shared between processes
+        return syscall(SYS_futex, (uint32_t *)(uintptr_t) addr, op, val, timeout, NULL, 0);
+}
+
+static size_t tile_len(struct video_desc desc) {
+        return vc_get_datalen(desc.width, desc.height, desc.color_spec);
+}
+
+struct shm_bus *shm_bus_create(const char *name, int slot_count, struct video_desc desc)
+{
+        if (slot_count < 2 || slot_count > SHM_BUS_MAX_SLOTS || desc.tile_count == 0
+                        || desc.tile_count > SHM_BUS_MAX_TILES) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported slot count %d or tile count %u!\n",
+                                slot_count, desc.tile_count);
+                return NULL;
+        }
+        struct shm_bus *b = calloc(1, sizeof *b);
+        set_name(b, name);
+        b->writer = true;
+        b->refs = 1;
+
+        size_t tile_capacity = align_up(tile_len(desc), 64);
+        size_t data_offset = align_up(sizeof(struct shm_bus_header) + slot_count * sizeof(struct shm_bus_slot), SHM_BUS_ALIGN);
+        size_t slot_stride = align_up(tile_capacity * desc.tile_count, SHM_BUS_ALIGN);
+        b->size = data_offset + slot_count * slot_stride;
+
+        shm_unlink(b->name); // stale segment of a previous writer
+        int fd = shm_open(b->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd == -1) {
+                log_perror(LOG_LEVEL_ERROR, MOD_NAME "shm_open");
+                free(b);
+                return NULL;
+        }
+        struct stat st;
+        if (ftruncate(fd, b->size) == -1 || fstat(fd, &st) == -1) {
+                log_perror(LOG_LEVEL_ERROR, MOD_NAME "ftruncate");
+                close(fd);
+                shm_unlink(b->name);
+                free(b);
+                return NULL;
+        }
+        b->ino = st.st_ino;
+        b->hdr = mmap(NULL, b->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (b->hdr == MAP_FAILED) {
+                log_perror(LOG_LEVEL_ERROR, MOD_NAME "mmap");
+                shm_unlink(b->name);
+                free(b);
+                return NULL;
+        }
+        b->slots = (struct shm_bus_slot *)(void *) (b->hdr + 1);
+        b->hdr->version = SHM_BUS_VERSION;
+        b->hdr->slot_desc_size = sizeof(struct shm_bus_slot);
+        b->hdr->slot_count = slot_count;
+        b->hdr->tile_count = desc.tile_count;
+        b->hdr->tile_capacity = tile_capacity;
+        b->hdr->data_offset = data_offset;
+        b->hdr->slot_stride = slot_stride;
+        atomic_init(&b->hdr->seq, 0);
+        atomic_init(&b->hdr->latest, -1);
+        atomic_init(&b->hdr->closed, 0);
+        for (int i = 0; i < slot_count; ++i) {
+                atomic_init(&b->slots[i].refcount, 0);
+        }
+        atomic_store_explicit(&b->hdr->magic, SHM_BUS_MAGIC, memory_order_release);
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Created %s: %d slots of %zu B\n", b->name, slot_count, slot_stride);
+        return b;
+}
+
+/// @returns true if a frame of desc fits the slots of the segment
+bool shm_bus_fits(const struct shm_bus *b, struct video_desc desc)
+{
+        return desc.tile_count == b->hdr->tile_count && tile_len(desc) <= b->hdr->tile_capacity;
+}
+
+/**
+ * Claims a slot for writing (no readers and not the latest frame).
+ * @returns slot index or -1 if all slots are held by readers
+ */
+int shm_bus_acquire_write(struct shm_bus *b)
+{
+        int latest = atomic_load(&b->hdr->latest);
+        for (unsigned i = 0; i < b->hdr->slot_count; ++i) {
+                int idx = (b->next_slot + i) % b->hdr->slot_count;
+                uint32_t expected = 0;
+                if (idx != latest && atomic_compare_exchange_strong(&b->slots[idx].refcount, &expected, SHM_BUS_WRITING)) {
+                        b->next_slot = idx + 1;
+                        return idx;
+                }
+        }
+        return -1;
+}
+
+char *shm_bus_tile_data(struct shm_bus *b, int slot, int tile)
+{
+        return (char *) b->hdr + b->hdr->data_offset + slot * b->hdr->slot_stride + tile * b->hdr->tile_capacity;
+}
+
+/**
+ * Publishes the slot claimed by shm_bus_acquire_write() with the format,
+ * data lengths and metadata of f. If the tile data of f doesn't point to the
+ * slot, it is copied there.
+ */
+void shm_bus_publish(struct shm_bus *b, int slot, const struct video_frame *f)
+{
+        struct shm_bus_slot *s = &b->slots[slot];
+        s->desc = (struct video_desc){ f->tiles[0].width, f->tiles[0].height, f->color_spec, f->fps,
+                f->interlacing, f->tile_count };
+        s->frame_type = f->frame_type;
+        for (unsigned i = 0; i < f->tile_count; ++i) {
+                char *data = shm_bus_tile_data(b, slot, i);
+                s->data_len[i] = MIN(f->tiles[i].data_len, b->hdr->tile_capacity);
+                if (f->tiles[i].data != data) {
+                        memcpy(data, f->tiles[i].data, s->data_len[i]);
+                }
+        }
+        memcpy(s->metadata, &f->VF_METADATA_START, VF_METADATA_SIZE);
+        uint32_t seq = atomic_load_explicit(&b->hdr->seq, memory_order_relaxed) + 1;
+        s->seq = seq;
+        atomic_fetch_and_explicit(&s->refcount, ~SHM_BUS_WRITING, memory_order_release);
+        atomic_store_explicit(&b->hdr->latest, slot, memory_order_release);
+        atomic_store_explicit(&b->hdr->seq, seq, memory_order_release);
+        futex(&b->hdr->seq, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+void shm_bus_abort_write(struct shm_bus *b, int slot)
+{
+        atomic_fetch_and_explicit(&b->slots[slot].refcount, ~SHM_BUS_WRITING, memory_order_release);
+}
+
+/**
+ * @returns reader handle or NULL if the segment doesn't exist (yet)
+ */
+struct shm_bus *shm_bus_open(const char *name)
+{
+        struct shm_bus *b = calloc(1, sizeof *b);
+        set_name(b, name);
+        b->refs = 1;
+        int fd = shm_open(b->name, O_RDWR, 0);
+        struct stat st;
+        if (fd == -1 || fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(struct shm_bus_header)) {
+                if (fd != -1) {
+                        close(fd);
+                }
+                free(b);
+                return NULL;
+        }
+        b->ino = st.st_ino;
+        b->size = st.st_size;
+        b->hdr = mmap(NULL, b->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (b->hdr == MAP_FAILED) {
+                log_perror(LOG_LEVEL_ERROR, MOD_NAME "mmap");
+                free(b);
+                return NULL;
+        }
+        b->slots = (struct shm_bus_slot *)(void *) (b->hdr + 1);
+        if (atomic_load_explicit(&b->hdr->magic, memory_order_acquire) != SHM_BUS_MAGIC) { // not yet initialized
+                munmap(b->hdr, b->size);
+                free(b);
+                return NULL;
+        }
+        if (b->hdr->version != SHM_BUS_VERSION || b->hdr->slot_desc_size != sizeof(struct shm_bus_slot)
+                        || b->hdr->data_offset + b->hdr->slot_count * b->hdr->slot_stride > b->size) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Segment %s has incompatible layout (version %" PRIu32 ")!\n",
+                                b->name, b->hdr->version);
+                munmap(b->hdr, b->size);
+                free(b);
+                return NULL;
+        }
+        return b;
+}
+
+static long long remaining_ns(const struct timespec *deadline) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (deadline->tv_sec - now.tv_sec) * 1000000000LL + (deadline->tv_nsec - now.tv_nsec);
+}
+
+/**
+ * Waits for a frame newer than *last_seq and takes a reference to it.
+ *
+ * @returns index of the slot (to be passed to shm_bus_take_frame()),
+ *          @ref SHM_BUS_TIMEOUT or @ref SHM_BUS_CLOSED
+ */
+int shm_bus_wait(struct shm_bus *b, uint32_t *last_seq, int timeout_ms)
+{
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000000000L;
+        }
+        while (true) {
+                if (atomic_load(&b->hdr->closed)) {
+                        return SHM_BUS_CLOSED;
+                }
+                uint32_t seq = atomic_load_explicit(&b->hdr->seq, memory_order_acquire);
+                int idx = atomic_load_explicit(&b->hdr->latest, memory_order_acquire);
+                if (seq != *last_seq && idx >= 0) {
+                        struct shm_bus_slot *s = &b->slots[idx];
+                        uint32_t old = atomic_fetch_add_explicit(&s->refcount, 1, memory_order_acquire);
+                        if ((old & SHM_BUS_WRITING) == 0 && s->seq != *last_seq) {
+                                *last_seq = s->seq;
+                                atomic_fetch_add(&b->refs, 1);
+                                return idx;
+                        }
+                        // the slot was reclaimed by the writer meanwhile - newer frame is published
+                        atomic_fetch_sub_explicit(&s->refcount, 1, memory_order_release);
+                        if (old & SHM_BUS_WRITING) {
+                                continue;
+                        }
+                }
+                long long left = remaining_ns(&deadline);
+                if (left <= 0) {
+                        return SHM_BUS_TIMEOUT;
+                }
+                struct timespec timeout = { left / 1000000000LL, left % 1000000000LL };
+                futex(&b->hdr->seq, FUTEX_WAIT, seq, &timeout);
+        }
+}
+
+static void shm_bus_unref(struct shm_bus *b) {
+        if (atomic_fetch_sub(&b->refs, 1) != 1) {
+                return;
+        }
+        munmap(b->hdr, b->size);
+        free(b);
+}
+
+struct shm_bus_frame_udata {
+        struct shm_bus *bus;
+        int slot;
+};
+
+static void shm_bus_frame_dispose(struct video_frame *f) {
+        struct shm_bus_frame_udata *udata = f->callbacks.dispose_udata;
+        atomic_fetch_sub_explicit(&udata->bus->slots[udata->slot].refcount, 1, memory_order_release);
+        shm_bus_unref(udata->bus);
+        free(udata);
+        vf_free(f);
+}
+
+/**
+ * Creates a frame pointing to a slot returned by shm_bus_wait(). The slot
+ * reference is released by the frame dispose callback.
+ */
+struct video_frame *shm_bus_take_frame(struct shm_bus *b, int slot)
+{
+        struct shm_bus_slot *s = &b->slots[slot];
+        struct video_frame *f = vf_alloc_desc(s->desc);
+        f->frame_type = s->frame_type;
+        memcpy(&f->VF_METADATA_START, s->metadata, VF_METADATA_SIZE);
+        for (unsigned i = 0; i < f->tile_count; ++i) {
+                f->tiles[i].data = shm_bus_tile_data(b, slot, i);
+                f->tiles[i].data_len = s->data_len[i];
+        }
+        struct shm_bus_frame_udata *udata = malloc(sizeof *udata);
+        udata->bus = b;
+        udata->slot = slot;
+        f->callbacks.dispose_udata = udata;
+        f->callbacks.dispose = shm_bus_frame_dispose;
+        return f;
+}
+
+/**
+ * @returns true if the writer closed the segment or the name now refers to
+ * another one (eg. the writer was restarted after a crash)
+ */
+bool shm_bus_is_stale(struct shm_bus *b)
+{
+        if (atomic_load(&b->hdr->closed)) {
+                return true;
+        }
+        int fd = shm_open(b->name, O_RDONLY, 0);
+        if (fd == -1) {
+                return true;
+        }
+        struct stat st;
+        bool stale = fstat(fd, &st) == -1 || st.st_ino != b->ino;
+        close(fd);
+        return stale;
+}
+
+/**
+ * Writer closes and unlinks the segment, reader drops its handle (mapping is
+ * kept until all frames taken from it are disposed).
+ */
+void shm_bus_destroy(struct shm_bus *b)
+{
+        if (b == NULL) {
+                return;
+        }
+        if (b->writer) {
+                atomic_store(&b->hdr->closed, 1);
+                atomic_fetch_add(&b->hdr->seq, 1);
+                futex(&b->hdr->seq, FUTEX_WAKE, INT_MAX, NULL);
+                shm_unlink(b->name);
+        }
+        shm_bus_unref(b);
+}
@@ -0,0 +1,92 @@
+/**
+ * @file   utils/shm_bus.h
+ *
+ * Shared-memory frame bus - a named ring of video frame slots shared between
+ * processes on one host. One writer (display shm) publishes frames, any
+ * number of readers (capture shm) reference the latest one without copying.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_SHM_BUS_H_
+#define UTILS_SHM_BUS_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHM_BUS_MAX_SLOTS 16
+#define SHM_BUS_MAX_TILES 4
+#define SHM_BUS_DEFAULT_NAME "ultragrid"
+
+#define SHM_BUS_TIMEOUT (-1) ///< shm_bus_wait() - no new frame within the timeout
+#define SHM_BUS_CLOSED  (-2) ///< shm_bus_wait() - writer closed the segment
+
+struct shm_bus;
+struct video_desc;
+struct video_frame;
+
+/// @name Writer
+/// @{
+struct shm_bus *shm_bus_create(const char *name, int slot_count, struct video_desc desc);
+bool shm_bus_fits(const struct shm_bus *b, struct video_desc desc);
+int shm_bus_acquire_write(struct shm_bus *b);
+char *shm_bus_tile_data(struct shm_bus *b, int slot, int tile);
+void shm_bus_publish(struct shm_bus *b, int slot, const struct video_frame *f);
+void shm_bus_abort_write(struct shm_bus *b, int slot);
+/// @}
+
+/// @name Reader
+/// @{
+struct shm_bus *shm_bus_open(const char *name);
+int shm_bus_wait(struct shm_bus *b, uint32_t *last_seq, int timeout_ms);
+struct video_frame *shm_bus_take_frame(struct shm_bus *b, int slot);
+bool shm_bus_is_stale(struct shm_bus *b);
+/// @}
+
+void shm_bus_destroy(struct shm_bus *b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_SHM_BUS_H_
@@ -39,10 +39,13 @@
 #define SYNCHRONIZED_QUEUE_H_
 
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <utility>
 
+#include "utils/queue_stats.h"
+
 struct msg {
         virtual ~msg() {}
 };
@@ -56,11 +59,44 @@ struct msg_quit : public msg {};
  * if there is no element in the queue.
  *
  * @tparam T type to be stored
- * @tparam max_len maximal length of the queue until it bloks (-1 means unlimited)
+ * @tparam max_len maximal length of the queue until it bloks (-1 means unlimited),
+ *                 can be changed in runtime with set_max_len()
+ *
+ * Named queues (see set_name()) report their depth and blocking time as metrics.
  */
 template<typename T = struct msg *, int max_len = 1>
 class synchronized_queue {
 public:
+        /// @param len new maximal length (-1 means unlimited)
+        void set_max_len(int len)
+        {
+                std::unique_lock<std::mutex> l(m_lock);
+                m_max_len = len;
+                if (m_stats) {
+                        metric_set(m_stats->capacity, len);
+                }
+                l.unlock();
+                m_queue_decremented.notify_all();
+        }
+
+        /**
+         * Enables the queue metrics (see utils/queue_stats.h), must be called
+         * before the queue is used by other threads.
+         */
+        void set_name(const char *name)
+        {
+                m_stats.reset(new queue_stats(name));
+                metric_set(m_stats->capacity, m_max_len);
+        }
+
+        /// records an item that the producer discarded instead of pushing it
+        void count_drop()
+        {
+                if (m_stats) {
+                        metric_inc(m_stats->drops, 1);
+                }
+        }
+
         int size()
         {
                 std::unique_lock<std::mutex> l(m_lock);
@@ -70,10 +106,11 @@ public:
         void push(T const & message)
         {
                 std::unique_lock<std::mutex> l(m_lock);
-                if (max_len != -1) {
-                        m_queue_decremented.wait(l, [this]{return m_queue.size() < (unsigned int) max_len;});
-                }
+                wait_for_space(l);
                 m_queue.push(message);
+                if (m_stats) {
+                        m_stats->pushed(m_queue.size());
+                }
                 l.unlock();
                 m_queue_incremented.notify_one();
         }
@@ -81,10 +118,11 @@ public:
         void push(T && message)
         {
                 std::unique_lock<std::mutex> l(m_lock);
-                if (max_len != -1) {
-                        m_queue_decremented.wait(l, [this]{return m_queue.size() < (unsigned int) max_len;});
-                }
+                wait_for_space(l);
                 m_queue.push(std::move(message));
+                if (m_stats) {
+                        m_stats->pushed(m_queue.size());
+                }
                 l.unlock();
                 m_queue_incremented.notify_one();
         }
@@ -96,9 +134,15 @@ public:
                         return T();
                 }
 
-                m_queue_incremented.wait(l, [this]{return m_queue.size() > 0;});
+                if (m_queue.size() == 0) {
+                        queue_wait_timer t(m_stats ? m_stats->pop_blocked : nullptr);
+                        m_queue_incremented.wait(l, [this]{return m_queue.size() > 0;});
+                }
                 T ret = std::move(m_queue.front());
                 m_queue.pop();
+                if (m_stats) {
+                        metric_set(m_stats->depth, m_queue.size());
+                }
 
                 l.unlock();
                 m_queue_decremented.notify_one();
@@ -109,21 +153,39 @@ public:
         bool timed_pop(T& result, std::chrono::duration<Rep, Period> const& timeout)
         {
                 std::unique_lock<std::mutex> l(m_lock);
-                if (!m_queue_incremented.wait_for(l, timeout, [this]{return m_queue.size() > 0;})) {
-                        return false;
+                if (m_queue.size() == 0) {
+                        queue_wait_timer t(m_stats ? m_stats->pop_blocked : nullptr);
+                        if (!m_queue_incremented.wait_for(l, timeout, [this]{return m_queue.size() > 0;})) {
+                                return false;
+                        }
                 }
                 result = std::move(m_queue.front());
                 m_queue.pop();
+                if (m_stats) {
+                        metric_set(m_stats->depth, m_queue.size());
+                }
                 l.unlock();
                 m_queue_decremented.notify_one();
                 return true;
         }
 
 private:
+        void wait_for_space(std::unique_lock<std::mutex> &l)
+        {
+                auto has_space = [this]{return m_max_len == -1 || m_queue.size() < (unsigned int) m_max_len;};
+                if (has_space()) {
+                        return;
+                }
+                queue_wait_timer t(m_stats ? m_stats->push_blocked : nullptr);
+                m_queue_decremented.wait(l, has_space);
+        }
+
+        int                     m_max_len = max_len;
         std::queue<T>           m_queue;
         std::mutex              m_lock;
         std::condition_variable m_queue_decremented;
         std::condition_variable m_queue_incremented;
+        std::unique_ptr<queue_stats> m_stats; ///< NULL unless named
 };
 
 #ifndef NO_EXTERN_MSGQ_MSG
@@ -42,6 +42,17 @@
 #endif
 
 #include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef WIN32
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef HAVE_LINUX
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 #ifdef HAVE_SETTHREADDESCRIPTION
 #include <processthreadsapi.h>
 // TODO: not yet present in MinGW headers - remove when available
@@ -52,6 +63,8 @@ HRESULT SetThreadDescription( HANDLE hThread, PCWSTR lpThreadDescription);
 #include "host.h"
 #include "utils/thread.h"
 
+#define MOD_NAME "[thread] "
+
 #if ! defined  WIN32 || defined HAVE_SETTHREADDESCRIPTION
 static inline char *get_argv_program_name(void) {
         if (uv_argv != NULL && uv_argv[0] != NULL) {
@@ -66,6 +79,14 @@ static inline char *get_argv_program_name(void) {
 }
 #endif
 
+#ifndef WIN32
+static void apply_thread_map(const char *name);
+#endif
+
+/**
+ * Names the calling thread and applies the thread-map parameter settings
+ * for it, so it should be called at the beginning of each thread.
+ */
 void set_thread_name(const char *name) {
 #ifdef HAVE_LINUX
 // thread name can have at most 16 chars (including terminating null char)
@@ -96,5 +117,242 @@ void set_thread_name(const char *name) {
 	UNUSED(name);
 #endif
 #endif
+#ifndef WIN32
+        apply_thread_map(name);
+#endif
+}
+
+/**
+ * Raises the priority of the calling thread for time-critical (eg. audio
+ * processing) work - SCHED_FIFO in the middle of the priority range on
+ * POSIX systems (usually needs CAP_SYS_NICE or rtprio limit), time critical
+ * priority on Windows.
+ *
+ * @retval false if the priority couldn't be set
+ */
+bool set_thread_realtime_priority(void) {
+#ifdef WIN32
+        return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+        struct sched_param sp = { 0 };
+        sp.sched_priority = (sched_get_priority_min(SCHED_FIFO) + sched_get_priority_max(SCHED_FIFO)) / 2;
+        return pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp) == 0;
+#endif
+}
+
+#ifndef WIN32
+ADD_TO_PARAM("thread-map", "* thread-map=<role>=[<cpus>][@fifo|@rr[=<prio>]][:<role>=...]\n"
+                "  Pin threads of given roles to CPUs and/or set their scheduling policy, eg.\n"
+                "  \"thread-map=net_rx=2@fifo:fec=3-5:decomp=6-11:display=12\". Roles are net_rx, rtp_rx,\n"
+                "  fec, decomp, display, capture, compress, net_tx, audio, worker or a thread name.\n"
+                "  <cpus> is a list of CPUs or ranges separated by '+' (Linux only) or node<n> to use\n"
+                "  the CPUs of the NUMA node and prefer its memory for the thread allocations.\n");
+
+#define MAX_THREAD_MAP_ENTRIES 32
+
+struct thread_map_entry {
+        char role[32];
+#ifdef HAVE_LINUX
+        bool has_cpus;
+        cpu_set_t cpus;
+        int numa_node; ///< -1 if not given by node<n>
+#endif
+        int policy; ///< -1 to keep
+        int priority;
+};
+
+static const struct {
+        const char *role;
+        const char *thread_names; ///< separated by space
+} thread_roles[] = {
+        { "net_rx", "udp_reader" },
+        { "rtp_rx", "receiver_loop" },
+        { "fec", "fec_thread fec_collect_thread" },
+        { "decomp", "decompress_thread" },
+        { "display", "display" },
+        { "capture", "capture_thread" },
+        { "compress", "compress_tile async_tile_consumer frame_parallel_consumer async_consumer" },
+        { "net_tx", "sender_loop tile_sender" },
+        { "audio", "audio_receiver_thread audio_sender_thread audio_mixer echo_cancel" },
+        { "worker", "worker fj_worker" },
+};
+
+static struct thread_map_entry thread_map[MAX_THREAD_MAP_ENTRIES];
+static int thread_map_count;
+static pthread_once_t thread_map_once = PTHREAD_ONCE_INIT;
+
+#ifdef HAVE_LINUX
+/// parses list of CPUs or ranges, eg. "0-3+8" (sep '+') or "0-3,8" (sep ',')
+static bool parse_cpu_list(const char *str, char sep, cpu_set_t *set)
+{
+        CPU_ZERO(set);
+        while (*str != '\0' && *str != '\n') {
+                char *end = NULL;
+                long first = strtol(str, &end, 10);
+                long last = first;
+                if (end == str || first < 0) {
+                        return false;
+                }
+                if (*end == '-') {
+                        str = end + 1;
+                        last = strtol(str, &end, 10);
+                        if (end == str || last < first) {
+                                return false;
+                        }
+                }
+                if (last >= CPU_SETSIZE) {
+                        return false;
+                }
+                for (long i = first; i <= last; ++i) {
+                        CPU_SET(i, set);
+                }
+                if (*end == sep) {
+                        end += 1;
+                } else if (*end != '\0' && *end != '\n') {
+                        return false;
+                }
+                str = end;
+        }
+        return CPU_COUNT(set) > 0;
+}
+
+static bool get_numa_node_cpus(int node, cpu_set_t *set)
+{
+        char path[128];
+        snprintf(path, sizeof path, "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *f = fopen(path, "r");
+        if (f == NULL) {
+                return false;
+        }
+        char buf[1024] = "";
+        bool ret = fgets(buf, sizeof buf, f) != NULL && parse_cpu_list(buf, ',', set);
+        fclose(f);
+        return ret;
+}
+#endif // defined HAVE_LINUX
+
+static bool parse_thread_map_entry(char *item, struct thread_map_entry *e)
+{
+        char *cpus = strchr(item, '=');
+        if (cpus == NULL || cpus == item || (size_t) (cpus - item) >= sizeof e->role) {
+                return false;
+        }
+        *cpus++ = '\0';
+        snprintf(e->role, sizeof e->role, "%s", item);
+        e->policy = -1;
+        char *policy = strchr(cpus, '@');
+        if (policy != NULL) {
+                *policy++ = '\0';
+                char *prio = strchr(policy, '=');
+                if (prio != NULL) {
+                        *prio++ = '\0';
+                }
+                if (strcmp(policy, "fifo") == 0) {
+                        e->policy = SCHED_FIFO;
+                } else if (strcmp(policy, "rr") == 0) {
+                        e->policy = SCHED_RR;
+                } else {
+                        return false;
+                }
+                e->priority = prio != NULL ? atoi(prio)
+                        : (sched_get_priority_min(e->policy) + sched_get_priority_max(e->policy)) / 2;
+                if (e->priority < sched_get_priority_min(e->policy) || e->priority > sched_get_priority_max(e->policy)) {
+                        return false;
+                }
+        }
+        if (*cpus == '\0') {
+                return e->policy != -1;
+        }
+#ifdef HAVE_LINUX
+        e->has_cpus = true;
+        e->numa_node = -1;
+        if (strncmp(cpus, "node", strlen("node")) == 0) {
+                e->numa_node = atoi(cpus + strlen("node"));
+                return get_numa_node_cpus(e->numa_node, &e->cpus);
+        }
+        return parse_cpu_list(cpus, '+', &e->cpus);
+#else
+        log_msg(LOG_LEVEL_WARNING, MOD_NAME "CPU pinning is not supported on this platform, ignoring CPUs of %s.\n", e->role);
+        return true;
+#endif
 }
 
+static void parse_thread_map(void)
+{
+        const char *cfg = get_commandline_param("thread-map");
+        if (cfg == NULL) {
+                return;
+        }
+        char *tmp = strdup(cfg);
+        char *save_ptr = NULL;
+        for (char *item = strtok_r(tmp, ":", &save_ptr); item != NULL; item = strtok_r(NULL, ":", &save_ptr)) {
+                if (thread_map_count == MAX_THREAD_MAP_ENTRIES) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Too many thread-map entries, ignoring the rest.\n");
+                        break;
+                }
+                char *item_copy = strdupa(item);
+                if (!parse_thread_map_entry(item, &thread_map[thread_map_count])) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong thread-map entry: %s\n", item_copy);
+                        continue;
+                }
+                thread_map_count += 1;
+        }
+        free(tmp);
+}
+
+static bool thread_has_role(const char *name, const char *role)
+{
+        if (strcmp(name, role) == 0) {
+                return true;
+        }
+        if (*name == '\0') {
+                return false;
+        }
+        for (unsigned i = 0; i < sizeof thread_roles / sizeof thread_roles[0]; ++i) {
+                if (strcmp(thread_roles[i].role, role) != 0) {
+                        continue;
+                }
+                size_t len = strlen(name);
+                for (const char *n = thread_roles[i].thread_names; (n = strstr(n, name)) != NULL; n += len) {
+                        bool word_start = n == thread_roles[i].thread_names || n[-1] == ' ';
+                        if (word_start && (n[len] == ' ' || n[len] == '\0')) {
+                                return true;
+                        }
+                }
+        }
+        return false;
+}
+
+static void apply_thread_map(const char *name)
+{
+        pthread_once(&thread_map_once, parse_thread_map);
+        for (int i = 0; i < thread_map_count; ++i) {
+                struct thread_map_entry *e = &thread_map[i];
+                if (!thread_has_role(name, e->role)) {
+                        continue;
+                }
+#ifdef HAVE_LINUX
+                if (e->has_cpus && pthread_setaffinity_np(pthread_self(), sizeof e->cpus, &e->cpus) != 0) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot set CPU affinity of %s.\n", name);
+                }
+                if (e->numa_node >= 0 && e->numa_node < (int) (sizeof(unsigned long) * 8)) {
+                        const int mpol_preferred = 1; // MPOL_PREFERRED from linux/mempolicy.h
+                        unsigned long nodemask = 1UL << e->numa_node;
+                        if (syscall(SYS_set_mempolicy, mpol_preferred, &nodemask, sizeof nodemask * 8) != 0) {
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot set NUMA memory policy of %s.\n", name);
+                        }
+                }
+#endif
+                if (e->policy != -1) {
+                        struct sched_param sp = { 0 };
+                        sp.sched_priority = e->priority;
+                        if (pthread_setschedparam(pthread_self(), e->policy, &sp) != 0) {
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot set scheduling policy of %s "
+                                                "(needs CAP_SYS_NICE or rtprio limit).\n", name);
+                        }
+                }
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Applied thread-map entry %s to %s.\n", e->role, name);
+                return;
+        }
+}
+#endif // ! defined WIN32
@@ -42,7 +42,12 @@
 extern "C" {
 #endif
 
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
 void set_thread_name(const char *name);
+bool set_thread_realtime_priority(void);
 
 #ifdef __cplusplus
 }
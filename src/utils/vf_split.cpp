@@ -42,71 +42,116 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
-#include <stdio.h>
-#include <string.h>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include "utils/vf_split.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_codec.h"
 
-void vf_split(struct video_frame *out, struct video_frame *src,
-              unsigned int x_count, unsigned int y_count, int preallocate)
+#define COPY_LINES_PER_TASK 64
+
+void vf_split_view(struct video_frame *out, struct video_frame *src,
+              unsigned int x_count, unsigned int y_count)
 {
-        unsigned int        tile_idx, line_idx;
-        struct tile        *cur_tiles;
-        unsigned int        tile_line = 0;
-        int                 out_linesize = 0;
-        int                 src_linesize;
+        assert(x_count * y_count > 0);
+        assert(vf_get_tile(src, 0)->width % x_count == 0u && vf_get_tile(src, 0)->height % y_count == 0u);
 
         out->color_spec = src->color_spec;
         out->fps = src->fps;
-        //out->aux = src->aux | AUX_TILED;
 
-        assert(vf_get_tile(src, 0)->width % x_count == 0u && vf_get_tile(src, 0)->height % y_count == 0u);
+        const unsigned int width = src->tiles[0].width / x_count;
+        const unsigned int height = src->tiles[0].height / y_count;
+        const int src_linesize = vc_get_linesize(src->tiles[0].width, src->color_spec);
+        const int out_linesize = vc_get_linesize(width, src->color_spec);
+        for (unsigned int y = 0; y < y_count; ++y) {
+                for (unsigned int x = 0; x < x_count; ++x) {
+                        struct tile *t = &out->tiles[y * x_count + x];
+                        t->width = width;
+                        t->height = height;
+                        t->data_len = out_linesize * height;
+                        t->data = src->tiles[0].data + (size_t) y * height * src_linesize + (size_t) x * out_linesize;
+                        t->pitch = x_count > 1 ? src_linesize : 0;
+                }
+        }
+}
 
-        src_linesize = vc_get_linesize(src->tiles[0].width,
-                        src->color_spec);
+bool vf_has_strided_tiles(const struct video_frame *frame)
+{
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                if (frame->tiles[i].pitch != 0) {
+                        return true;
+                }
+        }
+        return false;
+}
 
-        assert(x_count * y_count > 0);
-        for(tile_idx = 0u; tile_idx < x_count * y_count; ++tile_idx) {
-                out->tiles[tile_idx].width = vf_get_tile(src, 0)->width / x_count;
-                out->tiles[tile_idx].height = vf_get_tile(src, 0)->height / y_count;
+namespace {
+struct copy_lines_data {
+        const struct tile *src;
+        struct tile *dst;
+        size_t linesize;
+};
 
-                out_linesize = vc_get_linesize(out->tiles[tile_idx].width,
-                                src->color_spec);
-                out->tiles[tile_idx].data_len = out_linesize * out->tiles[tile_idx].height;
+void copy_lines(void *arg, size_t begin, size_t end)
+{
+        auto *d = static_cast<copy_lines_data *>(arg);
+        for (size_t y = begin; y < end; ++y) {
+                memcpy(d->dst->data + y * d->linesize, d->src->data + y * d->src->pitch, d->linesize);
         }
+}
+} // end of anonymous namespace
 
-        cur_tiles = &out->tiles[0];
-        for(line_idx = 0u; line_idx < vf_get_tile(src, 0)->height; ++line_idx, ++tile_line) {
-                unsigned int cur_tile_idx;
-                unsigned int byte = 0u;
-
-                if (line_idx % (vf_get_tile(src, 0)->height / y_count) == 0u) /* next tiles*/
-                {
-                        tile_line = 0u;
-                        if (line_idx != 0u)
-                                cur_tiles += x_count;
-                        if (preallocate) {
-                                for (cur_tile_idx = 0u; cur_tile_idx < x_count;
-                                               ++cur_tile_idx) {
-                                        cur_tiles[cur_tile_idx].data = (char *)
-                                                malloc(cur_tiles[cur_tile_idx].
-                                                                data_len);
-                                }
-                        }
+void vf_copy_tiles_contiguous(struct video_frame *out, const struct video_frame *src)
+{
+        assert(out->tile_count == src->tile_count);
+        for (unsigned int i = 0; i < src->tile_count; ++i) {
+                const struct tile *t = &src->tiles[i];
+                assert(out->tiles[i].width == t->width && out->tiles[i].height == t->height);
+                out->tiles[i].pitch = 0;
+                if (t->pitch == 0) {
+                        memcpy(out->tiles[i].data, t->data, t->data_len);
+                        continue;
                 }
+                copy_lines_data d{ t, &out->tiles[i], (size_t) vc_get_linesize(t->width, src->color_spec) };
+                task_run_parallel_for(t->height, COPY_LINES_PER_TASK, copy_lines, &d);
+        }
+}
 
-                for(cur_tile_idx = 0u; cur_tile_idx < x_count; ++cur_tile_idx) {
-                        memcpy((void *) &cur_tiles[cur_tile_idx].data[
-                                        tile_line *
-                                        out_linesize],
-                                        (void *) &src->tiles[0].data[line_idx *
-                                        src_linesize + byte],
-                                        cur_tiles[cur_tile_idx].width *
-                                        get_bpp(src->color_spec));
-                        byte += cur_tiles[cur_tile_idx].width * get_bpp(src->color_spec);
+void vf_split(struct video_frame *out, struct video_frame *src,
+              unsigned int x_count, unsigned int y_count, int preallocate)
+{
+        struct video_frame *view = vf_alloc(x_count * y_count);
+        vf_split_view(view, src, x_count, y_count);
+
+        out->color_spec = src->color_spec;
+        out->fps = src->fps;
+        //out->aux = src->aux | AUX_TILED;
+        for (unsigned int i = 0; i < x_count * y_count; ++i) {
+                out->tiles[i].width = view->tiles[i].width;
+                out->tiles[i].height = view->tiles[i].height;
+                out->tiles[i].data_len = view->tiles[i].data_len;
+                if (preallocate) {
+                        out->tiles[i].data = (char *) malloc(out->tiles[i].data_len);
                 }
         }
+        vf_copy_tiles_contiguous(out, view);
+        vf_free(view);
+}
+
+struct video_frame *vf_make_contiguous(struct video_frame *frame)
+{
+        if (frame == nullptr || !vf_has_strided_tiles(frame)) {
+                return frame;
+        }
+        struct video_frame *out = vf_alloc_desc_data(video_desc_from_frame(frame));
+        vf_copy_metadata(out, frame);
+        vf_copy_tiles_contiguous(out, frame);
+        out->callbacks.dispose = vf_free;
+        VIDEO_FRAME_DISPOSE(frame);
+        return out;
 }
 
 void vf_split_horizontal(struct video_frame *out, struct video_frame *src,
@@ -147,6 +192,7 @@ vector<shared_ptr<video_frame>> vf_separate_tiles(shared_ptr<video_frame> frame)
 
                 ret[i]->tiles[0].data_len = frame->tiles[i].data_len;
                 ret[i]->tiles[0].data = frame->tiles[i].data;
+                ret[i]->tiles[0].pitch = frame->tiles[i].pitch;
                 vf_copy_metadata(ret[i].get(), frame.get());
         }
 
@@ -179,3 +225,13 @@ shared_ptr<video_frame> vf_merge_tiles(std::vector<shared_ptr<video_frame>> cons
         return ret;
 }
 
+shared_ptr<video_frame> vf_make_contiguous(shared_ptr<video_frame> frame)
+{
+        if (!frame || !vf_has_strided_tiles(frame.get())) {
+                return frame;
+        }
+        shared_ptr<video_frame> out(vf_alloc_desc_data(video_desc_from_frame(frame.get())), vf_free);
+        vf_copy_metadata(out.get(), frame.get());
+        vf_copy_tiles_contiguous(out.get(), frame.get());
+        return out;
+}
@@ -38,6 +38,10 @@
 #ifndef VF_SPLIT_H_
 #define VF_SPLIT_H_
 
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
 struct video_frame;
 
 #ifdef __cplusplus
@@ -70,6 +74,34 @@ void vf_split(struct video_frame *out, struct video_frame *src,
 void vf_split_horizontal(struct video_frame *out, struct video_frame *src,
               unsigned int y_count);
 
+/**
+ * Splits the frame into x_count * y_count tiles without copying - the tiles of
+ * out point into the src data and have tile::pitch set to the source line
+ * length if they are strided (more than one column). src must outlive out.
+ *
+ * width must be divisible by x_count && heigth by y_count
+ *
+ * @param out          output frame with x_count * y_count tiles, the
+ *                     resulting matrix will be stored row-dominant
+ */
+void vf_split_view(struct video_frame *out, struct video_frame *src,
+              unsigned int x_count, unsigned int y_count);
+
+bool vf_has_strided_tiles(const struct video_frame *frame);
+
+/**
+ * Copies the tiles of src to the (allocated) tiles of out with the same
+ * dimensions removing the line padding of strided tiles, the lines are
+ * copied in parallel.
+ */
+void vf_copy_tiles_contiguous(struct video_frame *out, const struct video_frame *src);
+
+/**
+ * @returns frame if it has no strided tiles, otherwise its contiguous copy
+ *          (frame is then disposed), dispose callback of the copy is vf_free
+ */
+struct video_frame *vf_make_contiguous(struct video_frame *frame);
+
 #ifdef __cplusplus
 }
 #endif
@@ -80,6 +112,8 @@ void vf_split_horizontal(struct video_frame *out, struct video_frame *src,
 
 std::vector<std::shared_ptr<video_frame>> vf_separate_tiles(std::shared_ptr<video_frame> frame);
 std::shared_ptr<video_frame> vf_merge_tiles(std::vector<std::shared_ptr<video_frame>> const & tiles);
+/// @returns frame if it has no strided tiles, otherwise its contiguous copy
+std::shared_ptr<video_frame> vf_make_contiguous(std::shared_ptr<video_frame> frame);
 
 #endif // __cplusplus
 
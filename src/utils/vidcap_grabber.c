@@ -0,0 +1,234 @@
+/**
+ * @file   utils/vidcap_grabber.c
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "audio/types.h"
+#include "debug.h"
+#include "utils/thread.h"
+#include "utils/vidcap_grabber.h"
+#include "video_capture.h"
+#include "video_frame.h"
+
+#define MOD_NAME "[vidcap grabber] "
+
+struct vidcap_grabber {
+        struct vidcap *device;
+        char name[32];
+        pthread_t thread;
+
+        pthread_mutex_t lock;
+        pthread_cond_t cv;
+        struct vidcap_grabbed slot; ///< latest grabbed frame, frame NULL if empty
+        bool held;      ///< a taken frame not owned by the taker wasn't released yet
+        bool keep_warm;
+        bool should_exit;
+        unsigned long long dropped;
+};
+
+/// @returns true if the frame stays valid after next vidcap_grab() (is disposed by its owner)
+static bool is_independent(const struct vidcap_grabbed *g)
+{
+        return g->frame->callbacks.dispose != NULL &&
+                (g->audio == NULL || g->audio->dispose != NULL);
+}
+
+static void grabbed_dispose(struct vidcap_grabbed *g)
+{
+        VIDEO_FRAME_DISPOSE(g->frame);
+        AUDIO_FRAME_DISPOSE(g->audio);
+        memset(g, 0, sizeof *g);
+}
+
+/**
+ * Grabs the device in a loop. A new frame replaces the one in the slot if it
+ * wasn't taken yet so that the taker gets always the latest one. Frames that
+ * would be invalidated by the next grab are kept until taken (or, in the
+ * keep-warm mode, dropped just before grabbing the next one).
+ */
+static void *vidcap_grabber_thread(void *arg)
+{
+        struct vidcap_grabber *g = arg;
+        set_thread_name(g->name);
+
+        pthread_mutex_lock(&g->lock);
+        while (!g->should_exit) {
+                if (g->held || (g->slot.frame != NULL && !is_independent(&g->slot) && !g->keep_warm)) {
+                        pthread_cond_wait(&g->cv, &g->lock);
+                        continue;
+                }
+                if (g->slot.frame != NULL && !is_independent(&g->slot)) {
+                        g->dropped += 1;
+                        grabbed_dispose(&g->slot);
+                }
+                pthread_mutex_unlock(&g->lock);
+
+                struct vidcap_grabbed cur = { 0 };
+                cur.frame = vidcap_grab(g->device, &cur.audio);
+                cur.time = get_time_in_ns();
+
+                pthread_mutex_lock(&g->lock);
+                if (cur.frame == NULL) {
+                        AUDIO_FRAME_DISPOSE(cur.audio);
+                        continue;
+                }
+                if (g->slot.frame != NULL) {
+                        g->dropped += 1;
+                        grabbed_dispose(&g->slot);
+                }
+                g->slot = cur;
+                pthread_cond_broadcast(&g->cv);
+        }
+        pthread_mutex_unlock(&g->lock);
+
+        return NULL;
+}
+
+/**
+ * Starts grabbing the device in a separate thread.
+ *
+ * @param name  thread name
+ * @returns     the grabber or NULL on failure; the device is still owned by the caller
+ */
+struct vidcap_grabber *vidcap_grabber_start(struct vidcap *device, const char *name)
+{
+        struct vidcap_grabber *g = calloc(1, sizeof *g);
+        if (g == NULL) {
+                return NULL;
+        }
+        g->device = device;
+        snprintf(g->name, sizeof g->name, "%s", name);
+        pthread_mutex_init(&g->lock, NULL);
+        pthread_cond_init(&g->cv, NULL);
+        if (pthread_create(&g->thread, NULL, vidcap_grabber_thread, g) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to create thread for %s!\n", name);
+                pthread_cond_destroy(&g->cv);
+                pthread_mutex_destroy(&g->lock);
+                free(g);
+                return NULL;
+        }
+        return g;
+}
+
+/**
+ * Stops the thread and disposes the frame in the slot. The device may be
+ * deinitialized afterwards (as well as frames taken from the grabber).
+ */
+void vidcap_grabber_stop(struct vidcap_grabber *g)
+{
+        if (g == NULL) {
+                return;
+        }
+        pthread_mutex_lock(&g->lock);
+        g->should_exit = true;
+        pthread_cond_broadcast(&g->cv);
+        pthread_mutex_unlock(&g->lock);
+        pthread_join(g->thread, NULL);
+
+        if (g->slot.frame != NULL) {
+                grabbed_dispose(&g->slot);
+        }
+        if (g->dropped > 0) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "%s: %llu stale frames dropped.\n", g->name, g->dropped);
+        }
+        pthread_cond_destroy(&g->cv);
+        pthread_mutex_destroy(&g->lock);
+        free(g);
+}
+
+/**
+ * Takes the latest frame from the slot, waiting for it at most timeout_ns
+ * (0 - don't wait). See struct vidcap_grabbed for the frame lifetime.
+ *
+ * @retval false no frame was grabbed in time
+ */
+bool vidcap_grabber_take(struct vidcap_grabber *g, long long timeout_ns, struct vidcap_grabbed *out)
+{
+        struct timespec deadline;
+        timespec_get(&deadline, TIME_UTC);
+        ts_add_nsec(&deadline, timeout_ns);
+
+        pthread_mutex_lock(&g->lock);
+        while (g->slot.frame == NULL && timeout_ns > 0) {
+                if (pthread_cond_timedwait(&g->cv, &g->lock, &deadline) != 0) {
+                        break;
+                }
+        }
+        bool ret = g->slot.frame != NULL;
+        if (ret) {
+                *out = g->slot;
+                g->held = !is_independent(&g->slot);
+                memset(&g->slot, 0, sizeof g->slot);
+        }
+        pthread_mutex_unlock(&g->lock);
+        return ret;
+}
+
+/**
+ * Signalizes that the frames taken from the grabber won't be used any more
+ * so that it can grab the next one. Frames with dispose callbacks must be
+ * disposed by the taker regardless of this call.
+ */
+void vidcap_grabber_release(struct vidcap_grabber *g)
+{
+        pthread_mutex_lock(&g->lock);
+        if (g->held) {
+                g->held = false;
+                pthread_cond_broadcast(&g->cv);
+        }
+        pthread_mutex_unlock(&g->lock);
+}
+
+/**
+ * In the keep-warm mode the device is grabbed continuously even if nobody
+ * takes the frames so that the device doesn't stall (overflow its buffers)
+ * and its latest frame is available immediately when it is needed again.
+ */
+void vidcap_grabber_set_keep_warm(struct vidcap_grabber *g, bool keep_warm)
+{
+        pthread_mutex_lock(&g->lock);
+        g->keep_warm = keep_warm;
+        pthread_cond_broadcast(&g->cv);
+        pthread_mutex_unlock(&g->lock);
+}
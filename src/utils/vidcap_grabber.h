@@ -0,0 +1,83 @@
+/**
+ * @file   utils/vidcap_grabber.h
+ *
+ * Persistent grabbing thread of a video capture device with latest-frame
+ * slot, used by the capture drivers wrapping other devices (aggregate,
+ * switcher).
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_VIDCAP_GRABBER_H_
+#define UTILS_VIDCAP_GRABBER_H_
+
+#include "tv.h"
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct audio_frame;
+struct vidcap;
+struct vidcap_grabber;
+struct video_frame;
+
+/**
+ * Frame taken from the grabber slot together with its grab time.
+ *
+ * If the frames of the device have dispose callbacks, the frame is owned
+ * by the taker (and must be disposed by it) and the thread continues
+ * grabbing immediately. Otherwise it is valid until vidcap_grabber_release()
+ * and the thread doesn't grab until then.
+ */
+struct vidcap_grabbed {
+        struct video_frame *frame;
+        struct audio_frame *audio;
+        time_ns_t           time;   ///< when vidcap_grab() returned the frame
+};
+
+struct vidcap_grabber *vidcap_grabber_start(struct vidcap *device, const char *name);
+void vidcap_grabber_stop(struct vidcap_grabber *g);
+bool vidcap_grabber_take(struct vidcap_grabber *g, long long timeout_ns, struct vidcap_grabbed *out);
+void vidcap_grabber_release(struct vidcap_grabber *g);
+void vidcap_grabber_set_keep_warm(struct vidcap_grabber *g, bool keep_warm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_VIDCAP_GRABBER_H_
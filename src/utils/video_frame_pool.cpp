@@ -46,8 +46,77 @@
 #include <functional>
 #include <iostream>
 #include <stdexcept>
+#include <vector>
+#ifdef HAVE_CUDA
+#include "cuda_wrapper.h"
+#endif
 #include "video_frame_pool.h"
 
+#define HUGEPAGE_SIZE (2U<<20U)
+
+/**
+ * Cache of equally-sized blocks, used for shared_ptr control blocks returned
+ * by video_frame_pool::get_frame(). It is shared by the allocator copies stored
+ * in the control blocks so it outlives the pool if needed.
+ */
+struct video_frame_pool_cb_cache {
+        std::mutex          lock;
+        size_t              block_size = 0;
+        std::vector<void *> free_blocks;
+
+        ~video_frame_pool_cb_cache() {
+                for (void *block : free_blocks) {
+                        ::operator delete(block);
+                }
+        }
+        void *get(size_t size) {
+                std::unique_lock<std::mutex> lk(lock);
+                if (size == block_size && !free_blocks.empty()) {
+                        void *ret = free_blocks.back();
+                        free_blocks.pop_back();
+                        return ret;
+                }
+                if (block_size == 0) {
+                        block_size = size;
+                }
+                lk.unlock();
+                return ::operator new(size);
+        }
+        void put(void *ptr, size_t size) {
+                std::unique_lock<std::mutex> lk(lock);
+                if (size == block_size) {
+                        free_blocks.push_back(ptr);
+                        return;
+                }
+                lk.unlock();
+                ::operator delete(ptr);
+        }
+};
+
+namespace {
+template<typename T>
+struct cb_allocator {
+        using value_type = T;
+
+        explicit cb_allocator(std::shared_ptr<video_frame_pool_cb_cache> c) : cache(std::move(c)) {}
+        template<typename U>
+        cb_allocator(cb_allocator<U> const &other) : cache(other.cache) {}
+
+        T *allocate(size_t n) {
+                return static_cast<T *>(cache->get(n * sizeof(T)));
+        }
+        void deallocate(T *ptr, size_t n) {
+                cache->put(ptr, n * sizeof(T));
+        }
+
+        std::shared_ptr<video_frame_pool_cb_cache> cache;
+};
+template<typename T, typename U>
+bool operator==(cb_allocator<T> const &a, cb_allocator<U> const &b) { return a.cache == b.cache; }
+template<typename T, typename U>
+bool operator!=(cb_allocator<T> const &a, cb_allocator<U> const &b) { return !(a == b); }
+} // end of anonymous namespace
+
 void *default_data_allocator::allocate(size_t size) {
         return malloc(size);
 }
@@ -58,7 +127,49 @@ struct video_frame_pool_allocator *default_data_allocator::clone() const {
         return new default_data_allocator(*this);
 }
 
-video_frame_pool::video_frame_pool(unsigned int max_used_frames, video_frame_pool_allocator const &alloc) : m_allocator(alloc.clone()), m_generation(0), m_desc(), m_max_data_len(0), m_unreturned_frames(0), m_max_used_frames(max_used_frames) {
+void *hugepage_data_allocator::allocate(size_t size) {
+        if (size < HUGEPAGE_SIZE) {
+                return aligned_malloc(size, 64);
+        }
+        void *ptr = aligned_malloc(size, HUGEPAGE_SIZE);
+#ifdef __linux__
+        if (ptr != nullptr) {
+                madvise(ptr, size, MADV_HUGEPAGE);
+        }
+#endif
+        return ptr;
+}
+void hugepage_data_allocator::deallocate(void *ptr) {
+        aligned_free(ptr);
+}
+struct video_frame_pool_allocator *hugepage_data_allocator::clone() const {
+        return new hugepage_data_allocator(*this);
+}
+
+void *cuda_data_allocator::allocate(size_t size) {
+#ifdef HAVE_CUDA
+        void *ptr = nullptr;
+        if (cuda_wrapper_malloc(&ptr, size) != CUDA_WRAPPER_SUCCESS) {
+                return nullptr;
+        }
+        return ptr;
+#else
+        UNUSED(size);
+        return nullptr;
+#endif
+}
+void cuda_data_allocator::deallocate(void *ptr) {
+#ifdef HAVE_CUDA
+        cuda_wrapper_free(ptr);
+#else
+        UNUSED(ptr);
+#endif
+}
+struct video_frame_pool_allocator *cuda_data_allocator::clone() const {
+        return new cuda_data_allocator(*this);
+}
+
+video_frame_pool::video_frame_pool(unsigned int max_used_frames, video_frame_pool_allocator const &alloc) : m_allocator(alloc.clone()), m_cb_cache(std::make_shared<video_frame_pool_cb_cache>()), m_generation(0), m_desc(), m_max_data_len(0), m_unreturned_frames(0), m_max_used_frames(max_used_frames) {
 }
 
 video_frame_pool::~video_frame_pool() {
@@ -70,8 +181,12 @@ video_frame_pool::~video_frame_pool() {
 
 void video_frame_pool::reconfigure(struct video_desc new_desc, size_t new_size) {
         std::unique_lock<std::mutex> lk(m_lock);
+        size_t max_data_len = new_size != SIZE_MAX ? new_size : new_desc.height * vc_get_linesize(new_desc.width, new_desc.color_spec);
+        if (m_generation != 0 && video_desc_eq(m_desc, new_desc) && m_max_data_len == max_data_len) {
+                return; // keep the allocated buffers (they may be expensive to set up - eg. locked for DMA)
+        }
         m_desc = new_desc;
-        m_max_data_len = new_size != SIZE_MAX ? new_size : new_desc.height * vc_get_linesize(new_desc.width, new_desc.color_spec);
+        m_max_data_len = max_data_len;
         remove_free_frames();
         m_generation++;
 }
@@ -99,6 +214,7 @@ std::shared_ptr<video_frame> video_frame_pool::get_frame() {
                                 }
                                 ret->tiles[i].data_len = m_max_data_len;
                         }
+                        vf_mem_charge(ret, m_desc.tile_count * m_max_data_len);
                 } catch (std::exception &e) {
                         std::cerr << e.what() << std::endl;
                         deallocate_frame(ret);
@@ -116,9 +232,12 @@ std::shared_ptr<video_frame> video_frame_pool::get_frame() {
                                 if (this->m_generation != generation) {
                                 this->deallocate_frame(frame);
                                 } else {
+                                for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                                        frame->tiles[i].data_len = m_max_data_len; // may have been shrunk by the user
+                                }
                                 m_free_frames.push(frame);
                                 }
-                                }, std::placeholders::_1, m_generation));
+                                }, std::placeholders::_1, m_generation), cb_allocator<video_frame>(m_cb_cache));
 }
 
 struct video_frame *video_frame_pool::get_disposable_frame() {
@@ -164,14 +283,30 @@ void video_frame_pool::deallocate_frame(struct video_frame *frame) {
 }
 
 void *video_frame_pool_init(struct video_desc desc, int len) {
-        auto *out = new video_frame_pool(len, default_data_allocator());
+        auto *out = new video_frame_pool(len);
         out->reconfigure(desc);
         return (void *) out;
 }
 
+void *video_frame_pool_init_cuda(struct video_desc desc, int len) {
+        auto *out = new video_frame_pool(len, cuda_data_allocator());
+        out->reconfigure(desc);
+        return (void *) out;
+}
+
+/// @returns NULL if the frame cannot be allocated (exceptions must not propagate to C)
 struct video_frame *video_frame_pool_get_disposable_frame(void *state) {
         auto *s = static_cast<video_frame_pool* >(state);
-        return s->get_disposable_frame();
+        try {
+                return s->get_disposable_frame();
+        } catch (std::exception &e) {
+                return nullptr;
+        }
+}
+
+/// @param size  data length of the frames (SIZE_MAX to deduce from desc)
+void video_frame_pool_reconfigure(void *state, struct video_desc desc, size_t size) {
+        static_cast<video_frame_pool *>(state)->reconfigure(desc, size);
 }
 
 void video_frame_pool_destroy(void *state) {
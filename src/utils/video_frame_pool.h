@@ -3,7 +3,7 @@
  * @author Martin Pulec     <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2014-2021 CESNET, z. s. p. o.
+ * Copyright (c) 2014-2026 CESNET, z. s. p. o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -64,6 +64,29 @@ struct default_data_allocator : public video_frame_pool_allocator {
         struct video_frame_pool_allocator *clone() const override;
 };
 
+/**
+ * Allocates large buffers (at least 2 MiB) 2 MiB-aligned and advises
+ * transparent hugepages for them (Linux), which reduces page faults and TLB
+ * misses when touching the whole frame. Smaller buffers are cache-line aligned.
+ */
+struct hugepage_data_allocator : public video_frame_pool_allocator {
+        void *allocate(size_t size) override;
+        void deallocate(void *ptr) override;
+        struct video_frame_pool_allocator *clone() const override;
+};
+
+/**
+ * Allocates the buffers in CUDA device memory, frames must be marked
+ * as CUDA_MEM by the user. Allocation fails if compiled without CUDA.
+ */
+struct cuda_data_allocator : public video_frame_pool_allocator {
+        void *allocate(size_t size) override;
+        void deallocate(void *ptr) override;
+        struct video_frame_pool_allocator *clone() const override;
+};
+
+struct video_frame_pool_cb_cache;
+
 struct video_frame_pool {
         public:
                 /**
@@ -72,10 +95,13 @@ struct video_frame_pool {
                  *                        is called and that number of frames
                  *                        is unreturned, get_frames() will block.
                  */
-                video_frame_pool(unsigned int max_used_frames = 0, video_frame_pool_allocator const &alloc = default_data_allocator());
+                video_frame_pool(unsigned int max_used_frames = 0, video_frame_pool_allocator const &alloc = hugepage_data_allocator());
                 virtual ~video_frame_pool();
 
                 /**
+                 * Frames of the previous configuration are freed unless
+                 * both the desc and the size are unchanged.
+                 *
                  * @param new_size  if omitted, deduce from video desc (only for pixel formats)
                  */
                 void reconfigure(struct video_desc new_desc, size_t new_size = SIZE_MAX);
@@ -101,6 +127,8 @@ struct video_frame_pool {
                 void deallocate_frame(struct video_frame *frame);
 
                 std::unique_ptr<video_frame_pool_allocator> m_allocator;
+                /// recycled shared_ptr control blocks so that get_frame() doesn't allocate
+                std::shared_ptr<video_frame_pool_cb_cache> m_cb_cache;
                 std::queue<struct video_frame *> m_free_frames;
                 std::mutex        m_lock;
                 std::condition_variable m_frame_returned;
@@ -113,7 +141,9 @@ struct video_frame_pool {
 #endif //  __cplusplus
 
 EXTERN_C void *video_frame_pool_init(struct video_desc desc, int len);
+EXTERN_C void *video_frame_pool_init_cuda(struct video_desc desc, int len); ///< uses cuda_data_allocator
 EXTERN_C struct video_frame *video_frame_pool_get_disposable_frame(void *);
+EXTERN_C void video_frame_pool_reconfigure(void *, struct video_desc desc, size_t size);
 EXTERN_C void video_frame_pool_destroy(void *);
 
 #endif // VIDEO_FRAME_POOL_H_
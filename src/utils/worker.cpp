@@ -41,14 +41,28 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include "host.h"
 #include "utils/misc.h" // get_cpu_core_count
 #include "utils/thread.h"
 #include "utils/worker.h"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <set>
+#include <thread>
+#include <utility>
 #include <vector>
+#ifdef HAVE_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#define RESPAWN_CHUNKS_PER_THREAD 8 ///< granularity of respawn_parallel() load balancing
 
 using namespace std;
 
@@ -282,46 +296,273 @@ void *wait_task(task_result_handle_t handle)
         return instance.wait_task(handle);
 }
 
+ADD_TO_PARAM("worker-threads", "* worker-threads=<n>\n"
+                "  Number of threads (including the calling one) sharing parallel conversions (default: CPU count)\n");
+ADD_TO_PARAM("worker-affinity", "* worker-affinity\n"
+                "  Pin threads of the parallel conversion pool to CPU cores (Linux only)\n");
+
+namespace {
+struct alignas(64) fj_slot {
+        atomic<size_t> next; ///< next chunk to be taken
+        size_t end;
+};
+
+struct fj_job {
+        parallel_for_body_t body;
+        void *udata;
+        size_t count;
+        size_t grain;
+        fj_slot *slots;
+        int slot_count;
+};
+
+thread_local bool fj_in_job = false; ///< thread participates in a fork-join job
+
+/**
+ * Each participant processes (ascending) chunks of its own slot first, so
+ * that adjacent data stay on one core, then steals from the other slots.
+ */
+void fj_participate(fj_job *job, int slot)
+{
+        for (int i = 0; i < job->slot_count; ++i) {
+                fj_slot &s = job->slots[(slot + i) % job->slot_count];
+                size_t idx = 0;
+                while ((idx = s.next.fetch_add(1, memory_order_relaxed)) < s.end) {
+                        size_t begin = idx * job->grain;
+                        job->body(job->udata, begin, min(begin + job->grain, job->count));
+                }
+        }
+}
+
+void fj_distribute(fj_job *job)
+{
+        size_t chunks = (job->count + job->grain - 1) / job->grain;
+        for (int i = 0; i < job->slot_count; ++i) {
+                job->slots[i].next.store(chunks * i / job->slot_count, memory_order_relaxed);
+                job->slots[i].end = chunks * (i + 1) / job->slot_count;
+        }
+}
+
+void *fj_participate_task(void *arg)
+{
+        auto *args = static_cast<pair<fj_job *, int> *>(arg);
+        fj_participate(args->first, args->second);
+        return nullptr;
+}
+
+/**
+ * Persistent fork-join pool. The job is owned by the caller who also
+ * participates, so running a job allocates nothing.
+ */
+class fj_pool {
+public:
+        fj_pool(int participants, bool affinity) : m_slot_count(participants),
+                m_slots(new fj_slot[participants])
+        {
+#ifdef HAVE_LINUX
+                cpu_set_t allowed;
+                vector<int> cpus;
+                if (affinity && sched_getaffinity(0, sizeof allowed, &allowed) == 0) {
+                        for (int i = 0; i < CPU_SETSIZE; ++i) {
+                                if (CPU_ISSET(i, &allowed)) {
+                                        cpus.push_back(i);
+                                }
+                        }
+                }
+#endif
+                for (int i = 1; i < participants; ++i) {
+                        m_threads.emplace_back(&fj_pool::worker, this, i);
+#ifdef HAVE_LINUX
+                        if (!cpus.empty()) {
+                                cpu_set_t set;
+                                CPU_ZERO(&set);
+                                CPU_SET(cpus[i % cpus.size()], &set);
+                                pthread_setaffinity_np(m_threads.back().native_handle(), sizeof set, &set);
+                        }
+#endif
+                }
+        }
+        ~fj_pool() {
+                {
+                        lock_guard<mutex> lk(m_lock);
+                        m_stop = true;
+                }
+                m_job_cv.notify_all();
+                for (auto &t : m_threads) {
+                        t.join();
+                }
+        }
+        int participants() const {
+                return m_slot_count;
+        }
+        /// @retval false pool is busy with another caller's job
+        bool try_run(fj_job *job) {
+                unique_lock<mutex> run_lk(m_run_lock, try_to_lock);
+                if (!run_lk.owns_lock()) {
+                        return false;
+                }
+                job->slots = m_slots.get();
+                job->slot_count = m_slot_count;
+                fj_distribute(job);
+                {
+                        lock_guard<mutex> lk(m_lock);
+                        m_job = job;
+                        m_gen += 1;
+                }
+                m_job_cv.notify_all();
+
+                fj_in_job = true;
+                fj_participate(job, 0);
+                fj_in_job = false;
+
+                // no worker may touch the job after we return
+                unique_lock<mutex> lk(m_lock);
+                m_job = nullptr;
+                m_done_cv.wait(lk, [&]{ return m_active == 0; });
+                return true;
+        }
+
+private:
+        void worker(int slot) {
+                set_thread_name("fj_worker");
+                fj_in_job = true;
+                uint64_t seen_gen = 0;
+                unique_lock<mutex> lk(m_lock);
+                while (true) {
+                        m_job_cv.wait(lk, [&]{ return m_stop || (m_job != nullptr && m_gen != seen_gen); });
+                        if (m_stop) {
+                                return;
+                        }
+                        seen_gen = m_gen;
+                        fj_job *job = m_job;
+                        m_active += 1;
+                        lk.unlock();
+                        fj_participate(job, slot);
+                        lk.lock();
+                        if (--m_active == 0) {
+                                m_done_cv.notify_all();
+                        }
+                }
+        }
+
+        const int m_slot_count;
+        unique_ptr<fj_slot[]> m_slots;
+        vector<thread> m_threads;
+        mutex m_run_lock; ///< held by the caller for the whole job
+        mutex m_lock;
+        condition_variable m_job_cv;
+        condition_variable m_done_cv;
+        fj_job *m_job = nullptr; ///< job being run, nullptr once the caller finished its part
+        uint64_t m_gen = 0;
+        int m_active = 0; ///< workers processing m_job
+        bool m_stop = false;
+};
+
+fj_pool &get_fj_pool()
+{
+        static fj_pool pool([]{
+                        const char *threads = get_commandline_param("worker-threads");
+                        return threads != nullptr ? max(atoi(threads), 1) : get_cpu_core_count();
+                }(), get_commandline_param("worker-affinity") != nullptr);
+        return pool;
+}
+} // end of anonymous namespace
+
 /**
- * This combines task_run_async() + wait_task()
+ * Processes items [0, count) in chunks of grain items by a persistent
+ * work-stealing pool. Calling thread participates and the function returns
+ * after all the chunks have been processed.
  *
- * @param task         task to be run
- * @param worker_count number of workers to be run
- * @param data         pointer to data array to be passed to task
- * @param data_size    size of element of data
- * @param res          (optional) pointer to result array, may be NULL
+ * Nested calls (from within body) are processed serially. If the pool is
+ * busy with a job of another thread, per-call workers are used instead.
+ *
+ * @param count  number of items
+ * @param grain  number of items per chunk (the unit of load balancing)
+ * @param body   called for each chunk with [begin, end) item range
+ * @param udata  passed to body
  */
-void task_run_parallel(runnable_t task, int worker_count, void *data, size_t data_size, void **res)
+void task_run_parallel_for(size_t count, size_t grain, parallel_for_body_t body, void *udata)
 {
-        if (worker_count == 1) {
-                task(data);
+        grain = max<size_t>(grain, 1);
+        if (count <= grain || fj_in_job) {
+                if (count > 0) {
+                        body(udata, 0, count);
+                }
+                return;
+        }
+        fj_pool &pool = get_fj_pool();
+        if (pool.participants() == 1) {
+                body(udata, 0, count);
+                return;
+        }
+        fj_job job{body, udata, count, grain, nullptr, 0};
+        if (pool.try_run(&job)) {
                 return;
         }
 
-        vector<task_result_handle_t> tasks(worker_count);
-        for (int i = 0; i < worker_count; ++i) {
-                tasks[i] = task_run_async(task, (void *)((char *) data + i * data_size));
+        // pool busy - use dedicated workers
+        job.slot_count = min<size_t>(pool.participants(), (count + grain - 1) / grain);
+        unique_ptr<fj_slot[]> slots(new fj_slot[job.slot_count]);
+        job.slots = slots.get();
+        fj_distribute(&job);
+        vector<pair<fj_job *, int>> args(job.slot_count);
+        vector<task_result_handle_t> tasks(job.slot_count);
+        for (int i = 1; i < job.slot_count; ++i) {
+                args[i] = { &job, i };
+                tasks[i] = task_run_async(fj_participate_task, &args[i]);
+        }
+        fj_in_job = true;
+        fj_participate(&job, 0);
+        fj_in_job = false;
+        for (int i = 1; i < job.slot_count; ++i) {
+                wait_task(tasks[i]);
         }
-        for (int i = 0; i < worker_count; ++i) {
-                if (res != nullptr) {
-                        res[i] = wait_task(tasks[i]);
-                } else {
-                        wait_task(tasks[i]);
+}
+
+struct run_parallel_data {
+        runnable_t task;
+        char *data;
+        size_t data_size;
+        void **res;
+};
+static void run_parallel_body(void *udata, size_t begin, size_t end)
+{
+        auto *d = static_cast<run_parallel_data *>(udata);
+        for (size_t i = begin; i < end; ++i) {
+                void *res = d->task(d->data + i * d->data_size);
+                if (d->res != nullptr) {
+                        d->res[i] = res;
                 }
         }
 }
 
+/**
+ * Runs task for each of worker_count data elements in parallel (using the
+ * pool of task_run_parallel_for()) and waits for them
+ *
+ * @param task         task to be run
+ * @param worker_count number of workers to be run
+ * @param data         pointer to data array to be passed to task
+ * @param data_size    size of element of data
+ * @param res          (optional) pointer to result array, may be NULL
+ */
+void task_run_parallel(runnable_t task, int worker_count, void *data, size_t data_size, void **res)
+{
+        run_parallel_data d{task, (char *) data, data_size, res};
+        task_run_parallel_for(worker_count, 1, run_parallel_body, &d);
+}
+
 struct respawn_parallel_data {
         respawn_parallel_callback_t c;
-        void *in;
-        void *out;
-        size_t data_len;
+        char *in;
+        char *out;
+        size_t size;
         void *udata;
 };
-static void *respawn_parallel_task(void *arg) {
-        auto data = (struct respawn_parallel_data *) arg;
-        data->c(data->in, data->out, data->data_len, data->udata);
-        return NULL;
+static void respawn_parallel_body(void *udata, size_t begin, size_t end)
+{
+        auto *d = static_cast<respawn_parallel_data *>(udata);
+        d->c(d->in + begin * d->size, d->out + begin * d->size, (end - begin) * d->size, d->udata);
 }
 /**
  * Automatically respawns threads to convert in to out
@@ -331,20 +572,8 @@ static void *respawn_parallel_task(void *arg) {
  */
 void respawn_parallel(void *in, void *out, size_t nmemb, size_t size, respawn_parallel_callback_t c, void *udata)
 {
-        int threads = get_cpu_core_count();
-        struct respawn_parallel_data data[threads];
-
-        for (int i = 0; i < threads; ++i) {
-                data[i].c = c;
-                data[i].in = (char *) in + i * (nmemb / threads) * size;
-                data[i].out = (char *) out + i * (nmemb / threads) * size;
-                data[i].data_len = (nmemb / threads) * size;
-                data[i].udata = udata;
-                if (i == threads - 1) {
-                        data[i].data_len = size * (nmemb - (threads - 1) * (nmemb / threads));
-                }
-        }
-
-        task_run_parallel(respawn_parallel_task, threads, data, sizeof data[0], NULL);
+        respawn_parallel_data d{c, (char *) in, (char *) out, size, udata};
+        size_t grain = nmemb / (get_fj_pool().participants() * RESPAWN_CHUNKS_PER_THREAD);
+        task_run_parallel_for(nmemb, grain, respawn_parallel_body, &d);
 }
 
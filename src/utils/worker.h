@@ -44,18 +44,22 @@
 #ifndef WORKER_H_
 #define WORKER_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef void *task_result_handle_t;
 typedef void *(*runnable_t)(void *);
+typedef void (*parallel_for_body_t)(void *udata, size_t begin, size_t end);
 
 // fuctions documented at definition
 task_result_handle_t task_run_async(runnable_t task, void *data);
 void task_run_async_detached(runnable_t task, void *data);
 void *wait_task(task_result_handle_t handle);
 void task_run_parallel(runnable_t task, int worker_count, void *data, size_t data_size, void **res);
+void task_run_parallel_for(size_t count, size_t grain, parallel_for_body_t body, void *udata);
 
 /**
  * @param data_len   in/out processed block length in bytes (multpile of respawn_parallel's size param)
@@ -90,9 +90,16 @@ static struct {
 struct v4l2_buffer_data {
         void *start;
         size_t length;
+        int dmabuf_fd; ///< exported buffer (VIDIOC_EXPBUF), -1 if not exported
 };
 
-static _Bool set_v4l2_buffers(int fd, struct v4l2_requestbuffers *reqbuf, struct v4l2_buffer_data *buffers) {
+/**
+ * Requests and maps MMAP buffers.
+ *
+ * @param enqueue  enqueue the buffers immediately (capture), output
+ *                 buffers are kept by the application until filled
+ */
+static _Bool set_v4l2_buffers(int fd, struct v4l2_requestbuffers *reqbuf, struct v4l2_buffer_data *buffers, _Bool enqueue) {
         if (ioctl (fd, VIDIOC_REQBUFS, reqbuf) != 0) {
                 if (errno == EINVAL)
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Video capturing or mmap-streaming is not supported\n");
@@ -136,7 +143,7 @@ static _Bool set_v4l2_buffers(int fd, struct v4l2_requestbuffers *reqbuf, struct
 
                 buf.flags = 0;
 
-                if(ioctl(fd, VIDIOC_QBUF, &buf) != 0) {
+                if (enqueue && ioctl(fd, VIDIOC_QBUF, &buf) != 0) {
                         log_perror(LOG_LEVEL_ERROR, MOD_NAME "Unable to enqueue buffer");
                         return 0;
                 }
@@ -144,6 +151,27 @@ static _Bool set_v4l2_buffers(int fd, struct v4l2_requestbuffers *reqbuf, struct
         return 1;
 }
 
+/**
+ * Exports the (already allocated MMAP) buffers as DMA-BUF file descriptors.
+ */
+static _Bool export_v4l2_buffers(int fd, enum v4l2_buf_type type, int count, struct v4l2_buffer_data *buffers)
+{
+        for (int i = 0; i < count; ++i) {
+                struct v4l2_exportbuffer expbuf;
+                memset(&expbuf, 0, sizeof expbuf);
+                expbuf.type = type;
+                expbuf.index = i;
+                expbuf.flags = (type == V4L2_BUF_TYPE_VIDEO_CAPTURE ? O_RDONLY : O_RDWR) | O_CLOEXEC;
+                if (ioctl(fd, VIDIOC_EXPBUF, &expbuf) != 0) {
+                        log_perror(LOG_LEVEL_ERROR, MOD_NAME "VIDIOC_EXPBUF");
+                        return 0;
+                }
+                buffers[i].dmabuf_fd = expbuf.fd;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Exported %d buffers as DMA-BUF.\n", count);
+        return 1;
+}
+
 static int try_open_v4l2_device(int log_level, const char *dev_name, int cap) {
         log_msg(LOG_LEVEL_VERBOSE, "Trying device: %s\n", dev_name);
         int fd = open(dev_name, O_RDWR);
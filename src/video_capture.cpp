@@ -61,6 +61,7 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "module.h"
+#include "utils/frame_trace.h"
 #include "video_capture.h"
 
 #include <string>
@@ -199,8 +200,17 @@ struct video_frame *vidcap_grab(struct vidcap *state, struct audio_frame **audio
         assert(state->magic == VIDCAP_MAGIC);
         struct video_frame *frame;
         frame = state->funcs->grab(state->state, audio);
-        if (frame != NULL)
-                frame = capture_filter(state->capture_filter, frame);
+        if (frame == NULL) {
+                return NULL;
+        }
+        time_ns_t capture_time = get_time_in_ns();
+        frame = capture_filter(state->capture_filter, frame);
+        if (frame != NULL) {
+                frame->capture_time = capture_time;
+                if (frame_trace_enabled()) {
+                        frame->filter_time = get_time_in_ns();
+                }
+        }
         return frame;
 }
 
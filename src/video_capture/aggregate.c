@@ -49,9 +49,13 @@
 #include "tv.h"
 
 #include "audio/types.h"
+#include "utils/vidcap_grabber.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define GRAB_TIMEOUT_NS (NS_IN_SEC / 2)
 
 /* prototypes of functions defined in this module */
 static void show_help(void);
@@ -69,7 +73,8 @@ struct vidcap_aggregate_state {
         struct vidcap     **devices;
         int                 devices_cnt;
 
-        struct video_frame      **captured_frames;
+        struct vidcap_grabber   **grabbers;  ///< one grabbing thread per device
+        struct vidcap_grabbed    *captured_frames;
         struct video_frame       *frame; 
         int frames;
         struct       timeval t, t0;
@@ -133,7 +138,15 @@ vidcap_aggregate_init(struct vidcap_params *params, void **state)
                 }
         }
 
-        s->captured_frames = calloc(s->devices_cnt, sizeof(struct video_frame *));
+        s->captured_frames = calloc(s->devices_cnt, sizeof(struct vidcap_grabbed));
+        s->grabbers = calloc(s->devices_cnt, sizeof(struct vidcap_grabber *));
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                char name[32];
+                snprintf(name, sizeof name, "aggregate%d", i);
+                if ((s->grabbers[i] = vidcap_grabber_start(s->devices[i], name)) == NULL) {
+                        goto error;
+                }
+        }
 
         s->frame = vf_alloc(s->devices_cnt);
         
@@ -141,6 +154,11 @@ vidcap_aggregate_init(struct vidcap_params *params, void **state)
 	return VIDCAP_INIT_OK;
 
 error:
+        if (s->grabbers) {
+                for (int i = 0; i < s->devices_cnt; ++i) {
+                        vidcap_grabber_stop(s->grabbers[i]);
+                }
+        }
         if(s->devices) {
                 int i;
                 for (i = 0u; i < s->devices_cnt; ++i) {
@@ -149,6 +167,9 @@ error:
                         }
                 }
         }
+        free(s->grabbers);
+        free(s->captured_frames);
+        free(s->devices);
         free(s);
         return VIDCAP_INIT_FAIL;
 }
@@ -163,11 +184,17 @@ vidcap_aggregate_done(void *state)
 	if (s != NULL) {
                 int i;
 		for (i = 0; i < s->devices_cnt; ++i) {
+                        vidcap_grabber_stop(s->grabbers[i]);
+                        VIDEO_FRAME_DISPOSE(s->captured_frames[i].frame);
+                        AUDIO_FRAME_DISPOSE(s->captured_frames[i].audio);
                          vidcap_done(s->devices[i]);
 		}
 	}
         
         vf_free(s->frame);
+        free(s->grabbers);
+        free(s->captured_frames);
+        free(s->devices);
         free(s);
 }
 
@@ -175,20 +202,39 @@ static struct video_frame *
 vidcap_aggregate_grab(void *state, struct audio_frame **audio)
 {
 	struct vidcap_aggregate_state *s = (struct vidcap_aggregate_state *) state;
-        struct audio_frame *audio_frame = NULL;
-        struct video_frame *frame = NULL;
+        struct vidcap_grabbed *captured = s->captured_frames;
 
         for (int i = 0; i < s->devices_cnt; ++i) {
-                VIDEO_FRAME_DISPOSE(s->captured_frames[i]);
+                VIDEO_FRAME_DISPOSE(captured[i].frame);
+                AUDIO_FRAME_DISPOSE(captured[i].audio);
+                memset(&captured[i], 0, sizeof captured[i]);
+                vidcap_grabber_release(s->grabbers[i]);
         }
 
         *audio = NULL;
 
+        /* The devices are grabbed in parallel so that all frames are
+         * available as soon as the slowest device delivers. Devices that
+         * have grabbed a newer frame while waiting for the others contribute
+         * the newest one to keep the tiles aligned in time. */
         for (int i = 0; i < s->devices_cnt; ++i) {
-                frame = NULL;
-                while(!frame) {
-                        frame = vidcap_grab(s->devices[i], &audio_frame);
+                if (!vidcap_grabber_take(s->grabbers[i], GRAB_TIMEOUT_NS, &captured[i])) {
+                        return NULL;
+                }
+        }
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct vidcap_grabbed newer;
+                if (i != s->audio_source_index &&
+                                vidcap_grabber_take(s->grabbers[i], 0, &newer)) {
+                        VIDEO_FRAME_DISPOSE(captured[i].frame);
+                        AUDIO_FRAME_DISPOSE(captured[i].audio);
+                        captured[i] = newer;
                 }
+        }
+
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct video_frame *frame = captured[i].frame;
+                struct audio_frame *audio_frame = captured[i].audio;
                 if (i == 0) {
                         s->frame->color_spec = frame->color_spec;
                         s->frame->interlacing = frame->interlacing;
@@ -201,7 +247,10 @@ vidcap_aggregate_grab(void *state, struct audio_frame **audio)
                 }
                 if (s->audio_source_index == i) {
                         *audio = audio_frame;
+                } else {
+                        AUDIO_FRAME_DISPOSE(audio_frame);
                 }
+                captured[i].audio = NULL;
                 if (frame->color_spec != s->frame->color_spec ||
                                 frame->fps != s->frame->fps ||
                                 frame->interlacing != s->frame->interlacing) {
@@ -220,7 +269,6 @@ vidcap_aggregate_grab(void *state, struct audio_frame **audio)
                 vf_get_tile(s->frame, i)->height = vf_get_tile(frame, 0)->height;
                 vf_get_tile(s->frame, i)->data_len = vf_get_tile(frame, 0)->data_len;
                 vf_get_tile(s->frame, i)->data = vf_get_tile(frame, 0)->data;
-                s->captured_frames[i] = frame;
         }
         s->frames++;
         gettimeofday(&s->t, NULL);
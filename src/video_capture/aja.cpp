@@ -101,6 +101,7 @@
 #include <mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
 
 #include "aja_common.h"
 
@@ -133,16 +134,42 @@ unsigned int *aja_audio_capture_channels = &audio_capture_channels;
 
 using namespace std;
 
-struct aligned_data_allocator : public video_frame_pool_allocator {
+/**
+ * Page-aligned buffers locked for DMA with the device for their whole
+ * lifetime so that the driver doesn't need to lock and unlock the pages of
+ * every transferred frame. Falls back to ordinary buffers if locking fails.
+ */
+struct locked_data_allocator : public video_frame_pool_allocator {
+        explicit locked_data_allocator(CNTV2Card *device) : mDevice(device) {}
         void *allocate(size_t size) override {
-                return aligned_malloc(size, AJA_PAGE_SIZE);
+                void *ptr = aligned_malloc(size, AJA_PAGE_SIZE);
+#if !AJA_NTV2_SDK_VERSION_BEFORE(15,5)
+                if (ptr != nullptr) {
+                        if (mDevice->DMABufferLock(static_cast<ULWord *>(ptr), size, true)) {
+                                mLocked[ptr] = size;
+                        } else {
+                                LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Cannot lock host buffer for DMA.\n";
+                        }
+                }
+#endif
+                return ptr;
         }
         void deallocate(void *ptr) override {
+#if !AJA_NTV2_SDK_VERSION_BEFORE(15,5)
+                auto it = mLocked.find(ptr);
+                if (it != mLocked.end()) {
+                        mDevice->DMABufferUnlock(static_cast<ULWord *>(ptr), it->second);
+                        mLocked.erase(it);
+                }
+#endif
                 aligned_free(ptr);
         }
         video_frame_pool_allocator *clone() const override {
-                return new aligned_data_allocator(*this);
+                return new locked_data_allocator(mDevice);
         }
+private:
+        CNTV2Card *mDevice;
+        unordered_map<void *, size_t> mLocked; ///< locked buffers and their sizes
 };
 
 static const ULWord app = AJA_FOURCC ('U','L','G','R');
@@ -170,7 +197,7 @@ class vidcap_state_aja {
                 uint32_t               mVideoBufferSize{};            ///     My video buffer size, in bytes
                 uint32_t               mAudioBufferSize{};            ///     My audio buffer size, in bytes
                 thread                 mProducerThread;               ///     My producer thread object -- does the frame capturing
-                video_frame_pool       mPool{0, aligned_data_allocator()};
+                video_frame_pool       mPool{0, locked_data_allocator(&mDevice)}; ///< must be destroyed before mDevice
                 shared_ptr<video_frame> mOutputFrame;
                 shared_ptr<uint32_t>   mOutputAudioFrame;
                 size_t                 mOutputAudioFrameSize{};
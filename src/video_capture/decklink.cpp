@@ -53,6 +53,7 @@
 #include "config_win32.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <condition_variable>
 #include <chrono>
@@ -74,6 +75,7 @@
 #include "tv.h"
 #include "utils/color_out.h"
 #include "utils/windows.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_capture.h"
 
@@ -159,12 +161,13 @@ struct vidcap_decklink_state {
         BMDVideoInputFlags       enable_flags      = bmdVideoInputFlagDefault;
         BMDSupportedVideoModeFlags supported_flags = bmdSupportedVideoModeDefault;
 
-        mutex                   lock;
+        mutex                   lock; ///< guards audioPackets and reconfiguration, frames are passed in VideoDelegate::slot
 	condition_variable      boss_cv;
+        atomic<bool>            grab_waiting{false}; ///< grab thread may be waiting on boss_cv
 
         int                     frames = 0;
         bool                    stereo{false}; /* for eg. DeckLink HD Extreme, Quad doesn't set this !!! */
-        bool                    sync_timecode{false}; /* use timecode when grabbing from multiple inputs */
+        atomic<bool>            sync_timecode{false}; /* use timecode when grabbing from multiple inputs */
         map<BMDDeckLinkConfigurationID, bmd_option> device_options = {
                 { bmdDeckLinkConfigCapturePassThroughMode, bmd_option((int64_t) bmdDeckLinkCapturePassthroughModeDisabled, false) },
         };
@@ -195,6 +198,29 @@ static void cleanup_common(struct vidcap_decklink_state *s);
 static list<tuple<int, string, string, string>> get_input_modes (IDeckLink* deckLink);
 static void print_input_modes (IDeckLink* deckLink);
 
+/**
+ * Frame of one device handed over from the delegate to the grab thread.
+ * Holds a reference to the DeckLink frame so that the data stay valid
+ * until the grab thread replaces it by a newer one.
+ */
+struct captured_frame {
+        IDeckLinkVideoInputFrame *frame{};
+        IDeckLinkVideoFrame      *right_eye{};
+        void                     *data{};
+        void                     *data_right{};
+        uint32_t                  timecode{};
+        bool                      repeat{}; ///< no signal - send a previous frame again
+        captured_frame() = default;
+        captured_frame(captured_frame const &) = delete;
+        captured_frame &operator=(captured_frame const &) = delete;
+        ~captured_frame() {
+                RELEASE_IF_NOT_NULL(right_eye);
+                RELEASE_IF_NOT_NULL(frame);
+        }
+};
+
+static void notify_grab(struct vidcap_decklink_state *s);
+
 class VideoDelegate : public IDeckLinkInputCallback {
 private:
 	int32_t                       mRefCount{};
@@ -202,13 +228,14 @@ private:
         static constexpr BMDDetectedVideoInputFormatFlags bitDepthMask{bmdDetectedVideoInput8BitDepth | bmdDetectedVideoInput10BitDepth | bmdDetectedVideoInput12BitDepth};
         BMDDetectedVideoInputFormatFlags configuredCsBitDepth{};
 
+        bool                          have_frame{}; ///< a frame with data was already passed
+        uint32_t                      last_timecode{};
+
 public:
-        int	                      newFrameReady{};
-        IDeckLinkVideoFrame          *rightEyeFrame{};
-        void                         *pixelFrame{};
-        void                         *pixelFrameRight{};
-        IDeckLinkVideoInputFrame     *lastFrame{nullptr};
-        uint32_t                      timecode{};
+        /// the newest unprocessed frame, exchanged without locking by the delegate and the grab thread
+        atomic<captured_frame *>      slot{nullptr};
+        unique_ptr<captured_frame>    pending; ///< taken from slot but not yet returned (grab thread only)
+        unique_ptr<captured_frame>    grabbed; ///< currently returned frame (grab thread only)
         struct vidcap_decklink_state *s;
         struct device_state          &device;
 	
@@ -216,10 +243,21 @@ public:
         }
 	
         virtual ~VideoDelegate () {
-                RELEASE_IF_NOT_NULL(rightEyeFrame);
-                RELEASE_IF_NOT_NULL(lastFrame);
+                delete slot.exchange(nullptr);
 	}
 
+        /// takes the newest frame from the slot to pending (grab thread only)
+        bool take() {
+                if (captured_frame *f = slot.exchange(nullptr)) {
+                        if (f->repeat && pending) {
+                                delete f;
+                        } else {
+                                pending.reset(f);
+                        }
+                }
+                return (bool) pending;
+        }
+
 	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID *) override { return E_NOINTERFACE; }
 	virtual ULONG STDMETHODCALLTYPE  AddRef(void) override {
 		return mRefCount++;
@@ -343,27 +381,8 @@ public:
 HRESULT	
 VideoDelegate::VideoInputFrameArrived (IDeckLinkVideoInputFrame *videoFrame, IDeckLinkAudioInputPacket *audioPacket)
 {
-        bool nosig = false;
-
-	unique_lock<mutex> lk(s->lock);
-// LOCK - LOCK - LOCK - LOCK - LOCK - LOCK - LOCK - LOCK - LOCK - LOCK - LOCK //
-
-	// Video
-	if (videoFrame)
-	{
-                if (videoFrame->GetFlags() & bmdFrameHasNoInputSource) {
-                        nosig = true;
-			log_msg(LOG_LEVEL_INFO, "Frame received (#%d) - No input signal detected\n", s->frames);
-                        if (s->nosig_send) {
-                                newFrameReady = 1;
-                        }
-		} else {
-                        newFrameReady = 1; // The new frame is ready to grab
-			// printf("Frame received (#%lu) - Valid Frame (Size: %li bytes)\n", framecount, videoFrame->GetRowBytes() * videoFrame->GetHeight());
-		}
-	}
-
         if (audioPacket) {
+                unique_lock<mutex> lk(s->lock);
                 if (s->audioPackets.size() < MAX_AUDIO_PACKETS) {
                         audioPacket->AddRef();
                         s->audioPackets.push(audioPacket);
@@ -372,56 +391,74 @@ VideoDelegate::VideoInputFrameArrived (IDeckLinkVideoInputFrame *videoFrame, IDe
                 }
         }
 
-        if (videoFrame && newFrameReady && (!nosig || !lastFrame)) {
-                /// @todo videoFrame should be actually retained until the data are processed
-                videoFrame->GetBytes(&pixelFrame);
+        if (!videoFrame) {
+                return S_OK;
+        }
 
-                RELEASE_IF_NOT_NULL(lastFrame);
-                lastFrame = videoFrame;
-                lastFrame->AddRef();
+        bool nosig = false;
+        if (videoFrame->GetFlags() & bmdFrameHasNoInputSource) {
+                nosig = true;
+                log_msg(LOG_LEVEL_INFO, "Frame received (#%d) - No input signal detected\n", s->frames);
+                if (!s->nosig_send) {
+                        return S_OK;
+                }
+        }
 
-                IDeckLinkTimecode *tc = NULL;
-                if (videoFrame->GetTimecode(bmdTimecodeRP188Any, &tc) == S_OK) {
-                        timecode = tc->GetBCD();
-                        tc->Release();
-                } else {
-                        timecode = 0;
-                        if (s->sync_timecode) {
-                                log_msg(LOG_LEVEL_ERROR, "Failed to acquire timecode from stream. Disabling sync.\n");
-                                s->sync_timecode = FALSE;
-                        }
+        auto *f = new captured_frame;
+        if (nosig && have_frame) {
+                f->repeat = true;
+                f->timecode = last_timecode;
+                captured_frame *expected = nullptr;
+                // a frame not yet taken by the grab thread is as good as repeating
+                if (!slot.compare_exchange_strong(expected, f)) {
+                        delete f;
+                }
+                notify_grab(s);
+                return S_OK;
+        }
+
+        videoFrame->GetBytes(&f->data);
+        f->frame = videoFrame;
+        f->frame->AddRef();
+
+        IDeckLinkTimecode *tc = NULL;
+        if (videoFrame->GetTimecode(bmdTimecodeRP188Any, &tc) == S_OK) {
+                f->timecode = tc->GetBCD();
+                tc->Release();
+        } else {
+                f->timecode = 0;
+                if (s->sync_timecode) {
+                        log_msg(LOG_LEVEL_ERROR, "Failed to acquire timecode from stream. Disabling sync.\n");
+                        s->sync_timecode = false;
                 }
+        }
 
-                RELEASE_IF_NOT_NULL(rightEyeFrame);
-                pixelFrameRight = NULL;
+        if(s->stereo) {
+                IDeckLinkVideoFrame3DExtensions *rightEye;
+                HRESULT result;
+                result = videoFrame->QueryInterface(IID_IDeckLinkVideoFrame3DExtensions, (void **)&rightEye);
 
-                if(s->stereo) {
-                        IDeckLinkVideoFrame3DExtensions *rightEye;
-                        HRESULT result;
-                        result = videoFrame->QueryInterface(IID_IDeckLinkVideoFrame3DExtensions, (void **)&rightEye);
+                if (result == S_OK) {
+                        result = rightEye->GetFrameForRightEye(&f->right_eye);
 
-                        if (result == S_OK) {
-                                result = rightEye->GetFrameForRightEye(&rightEyeFrame);
-
-                                if(result == S_OK) {
-                                        if (rightEyeFrame->GetFlags() & bmdFrameHasNoInputSource)
-                                        {
-                                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Right Eye Frame received (#%d) - No input signal detected\n", s->frames);
-                                        }
-                                        rightEyeFrame->GetBytes(&pixelFrameRight);
+                        if(result == S_OK) {
+                                if (f->right_eye->GetFlags() & bmdFrameHasNoInputSource)
+                                {
+                                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Right Eye Frame received (#%d) - No input signal detected\n", s->frames);
                                 }
+                                f->right_eye->GetBytes(&f->data_right);
                         }
                         rightEye->Release();
-                        if(!pixelFrameRight) {
-                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Sending right eye error.\n");
-                        }
+                }
+                if(!f->data_right) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Sending right eye error.\n");
                 }
         }
 
-        lk.unlock();
-        s->boss_cv.notify_one();
-	
-// UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UN //
+        have_frame = true;
+        last_timecode = f->timecode;
+        delete slot.exchange(f); // drop the older frame if not taken yet
+        notify_grab(s);
 
 	debug_msg("VideoInputFrameArrived - END\n"); /* TOREMOVE */
 
@@ -971,12 +1008,15 @@ static bool detect_format(struct vidcap_decklink_state *s, BMDDisplayMode *outDi
                         if (result == S_OK) {
                                 device->deckLinkInput->StartStreams();
                                 unique_lock<mutex> lk(s->lock);
-                                s->boss_cv.wait_for(lk, chrono::milliseconds(1200), [device]{return device->delegate->newFrameReady;});
+                                s->grab_waiting = true;
+                                s->boss_cv.wait_for(lk, chrono::milliseconds(1200), [device]{return device->delegate->slot.load() != nullptr;});
+                                s->grab_waiting = false;
                                 lk.unlock();
                                 device->deckLinkInput->StopStreams();
                                 device->deckLinkInput->DisableVideoInput();
 
-                                if (device->delegate->newFrameReady) {
+                                if (captured_frame *f = device->delegate->slot.exchange(nullptr)) {
+                                        delete f;
                                         *outDisplayMode = displayMode->GetDisplayMode();
                                         // set also detected codec (!)
                                         s->set_codec(pf == bmdFormat8BitYUV ? UYVY : RGBA);
@@ -1435,10 +1475,27 @@ vidcap_decklink_done(void *state)
 }
 
 /**
- * This function basically counts frames from all devices, optionally
- * with respect to timecode (if synchronized).
+ * Wakes up the grab thread if it is waiting for frames. The lock is taken
+ * only in that case so the delegates of multiple devices do not serialize
+ * on it.
+ */
+static void notify_grab(struct vidcap_decklink_state *s)
+{
+        atomic_thread_fence(memory_order_seq_cst); // pairs with grab_waiting store and slot exchange in grab
+        if (!s->grab_waiting.load(memory_order_relaxed)) {
+                return;
+        }
+        { // the waiter re-checks the slots with the lock held
+                lock_guard<mutex> lk(s->lock);
+        }
+        s->boss_cv.notify_one();
+}
+
+/**
+ * This function basically collects frames from all devices and counts
+ * them, optionally with respect to timecode (if synchronized).
  *
- * Lock needs to be hold during the whole function call.
+ * Called only from the grab thread.
  *
  * @param s Blackmagic state
  * @return number of captured tiles
@@ -1448,12 +1505,16 @@ static int nr_frames(struct vidcap_decklink_state *s) {
         int tiles_total = 0;
         int i;
 
+        for (i = 0; i < s->devices_cnt; ++i) {
+                s->state[i].delegate->take();
+        }
+
         /* If we use timecode, take maximal timecode value... */
         if (s->sync_timecode) {
                 for (i = 0; i < s->devices_cnt; ++i) {
-                        if(s->state[i].delegate->newFrameReady) {
-                                if (s->state[i].delegate->timecode > max_timecode) {
-                                        max_timecode = s->state[i].delegate->timecode;
+                        if(s->state[i].delegate->pending) {
+                                if (s->state[i].delegate->pending->timecode > max_timecode) {
+                                        max_timecode = s->state[i].delegate->pending->timecode;
                                 }
                         }
                 }
@@ -1461,12 +1522,13 @@ static int nr_frames(struct vidcap_decklink_state *s) {
 
         /* count all tiles */
         for (i = 0; i < s->devices_cnt; ++i) {
-                if(s->state[i].delegate->newFrameReady) {
+                auto &pending = s->state[i].delegate->pending;
+                if(pending) {
                         /* if inputs are synchronized, use only up-to-date frames (with same TC)
                          * as the most recent */
                         if(s->sync_timecode) {
-                                if(s->state[i].delegate->timecode && s->state[i].delegate->timecode != max_timecode) {
-                                        s->state[i].delegate->newFrameReady = FALSE;
+                                if(pending->timecode && pending->timecode != max_timecode) {
+                                        pending.reset();
                                 } else {
                                         tiles_total++;
                                 }
@@ -1512,12 +1574,15 @@ static audio_frame *process_new_audio_packets(struct vidcap_decklink_state *s) {
         return &s->audio;
 }
 
+static void bgra_to_rgba(void *in, void *out, size_t data_len, void * /* udata */) {
+        vc_copylineToRGBA_inplace((unsigned char *) out, (unsigned char *) in, data_len, 16, 8, 0);
+}
+
 static void postprocess_frame(struct vidcap_decklink_state *s) {
         if (s->codec == RGBA) {
                 for (unsigned i = 0; i < s->frame->tile_count; ++i) {
-                        vc_copylineToRGBA_inplace((unsigned char*) s->frame->tiles[i].data,
-                                        (unsigned char*)s->frame->tiles[i].data,
-                                        s->frame->tiles[i].data_len, 16, 8, 0);
+                        respawn_parallel(s->frame->tiles[i].data, s->frame->tiles[i].data,
+                                        s->frame->tiles[i].data_len / 4, 4, bgra_to_rgba, nullptr);
                 }
         }
         if (s->codec == R10k && get_commandline_param(R10K_FULL_OPT) == nullptr) {
@@ -1545,6 +1610,7 @@ vidcap_decklink_grab(void *state, struct audio_frame **audio)
 
 	debug_msg("vidcap_decklink_grab - before while\n"); /* TOREMOVE */
 
+        s->grab_waiting = true;
         tiles_total = nr_frames(s);
 
         while(tiles_total != s->devices_cnt) {
@@ -1595,12 +1661,20 @@ vidcap_decklink_grab(void *state, struct audio_frame **audio)
                 }
 	}
 
-        /* cleanup newframe flag */
+        s->grab_waiting = false;
+
+        /* take the collected frames, incomplete set is dropped */
         for (i = 0; i < s->devices_cnt; ++i) {
-                if(s->state[i].delegate->newFrameReady == 0) {
+                if (!s->state[i].delegate->pending) {
                         frame_ready = false;
                 }
-                s->state[i].delegate->newFrameReady = 0;
+        }
+        for (i = 0; i < s->devices_cnt; ++i) {
+                VideoDelegate *delegate = s->state[i].delegate.get();
+                if (frame_ready && (!delegate->pending->repeat || !delegate->grabbed)) {
+                        delegate->grabbed = std::move(delegate->pending);
+                }
+                delegate->pending.reset();
 	}
 
         *audio = process_new_audio_packets(s); // return audio even if there is no video to avoid
@@ -1614,18 +1688,19 @@ vidcap_decklink_grab(void *state, struct audio_frame **audio)
         /* count returned tiles */
         int count = 0;
         if(s->stereo) {
-                if (s->state[0].delegate->pixelFrame != NULL &&
-                                s->state[0].delegate->pixelFrameRight != NULL) {
-                        s->frame->tiles[0].data = (char*)s->state[0].delegate->pixelFrame;
-                        s->frame->tiles[1].data = (char*)s->state[0].delegate->pixelFrameRight;
+                captured_frame *f = s->state[0].delegate->grabbed.get();
+                if (f->data != NULL && f->data_right != NULL) {
+                        s->frame->tiles[0].data = (char*) f->data;
+                        s->frame->tiles[1].data = (char*) f->data_right;
                         ++count;
                 } // else count == 0 -> return NULL
         } else {
                 for (i = 0; i < s->devices_cnt; ++i) {
-                        if (s->state[i].delegate->pixelFrame == NULL) {
+                        captured_frame *f = s->state[i].delegate->grabbed.get();
+                        if (f->data == NULL) {
                                 break;
                         }
-                        s->frame->tiles[i].data = (char*)s->state[i].delegate->pixelFrame;
+                        s->frame->tiles[i].data = (char*) f->data;
                         ++count;
                 }
         }
@@ -1635,7 +1710,7 @@ vidcap_decklink_grab(void *state, struct audio_frame **audio)
         postprocess_frame(s);
 
         s->frames++;
-        s->frame->timecode = s->state[0].delegate->timecode;
+        s->frame->timecode = s->state[0].delegate->grabbed->timecode;
         return s->frame;
 }
 
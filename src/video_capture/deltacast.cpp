@@ -41,6 +41,8 @@
 
 #include <algorithm>
 #include <fcntl.h>
+#include <mutex>
+#include <queue>
 #include <semaphore.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -66,11 +68,21 @@
 
 using namespace std;
 
+/**
+ * Number of driver slots. Captured frames reference the locked slot buffer
+ * directly (no copy), so the depth must cover the frames held by the
+ * pipeline plus those the board is filling meanwhile.
+ */
+#define DEFAULT_BUFFERQUEUE_DEPTH 8
+
 struct vidcap_deltacast_state {
         struct video_frame *frame;
         struct tile        *tile;
         HANDLE            BoardHandle, StreamHandle;
-        HANDLE            SlotHandle;
+        unsigned int      queue_depth;
+
+        mutex             lock;
+        queue<HANDLE>     frames_to_free; ///< slots of disposed frames, unlocked by grab
 
         struct audio_frame audio_frame;
         
@@ -92,7 +104,7 @@ static void usage(void);
 
 static void usage(void)
 {
-        printf("\t-t deltacast[:device=<index>][:mode=<mode>][:codec=<codec>]\n");
+        printf("\t-t deltacast[:device=<index>][:mode=<mode>][:codec=<codec>][:queue=<n>]\n");
 
         print_available_delta_boards();
 
@@ -113,6 +125,8 @@ static void usage(void)
 
         printf("\nDefault board is 0. If mode is omitted, it will be autodetected "
                         "(except of UHD modes). Default codec is UYVY.\n");
+        printf("queue sets the number of driver slots (default %d), each of them "
+                        "can be held by a frame in flight.\n", DEFAULT_BUFFERQUEUE_DEPTH);
 }
 
 static void vidcap_deltacast_probe(device_info **available_cards, int *count, void (**deleter)(void *))
@@ -237,6 +251,9 @@ static bool wait_for_channel(struct vidcap_deltacast_state *s)
         DELTA_TRY_CMD(VHD_SetStreamProperty(s->StreamHandle, VHD_CORE_SP_TRANSFER_SCHEME,
                                 VHD_TRANSFER_SLAVED),
                         "Unable to set transfer scheme.");
+        DELTA_TRY_CMD(VHD_SetStreamProperty(s->StreamHandle, VHD_CORE_SP_BUFFERQUEUE_DEPTH,
+                                s->queue_depth),
+                        "Unable to set buffer queue depth.");
 
         if(s->autodetect_format) {
                 Result = VHD_GetStreamProperty(s->StreamHandle, VHD_CORE_SP_BUFFER_PACKING, &Packing);
@@ -323,14 +340,7 @@ vidcap_deltacast_init(struct vidcap_params *params, void **state)
                 return VIDCAP_INIT_NOERR;
         }
 
-        s = (struct vidcap_deltacast_state *) calloc(1, sizeof(struct vidcap_deltacast_state));
-
-	if(s == NULL) {
-		printf("Unable to allocate DELTACAST state\n");
-                free(init_fmt);
-                free(s);
-		return VIDCAP_INIT_FAIL;
-	}
+        s = new vidcap_deltacast_state();
 
         gettimeofday(&s->t0, NULL);
 
@@ -341,8 +351,9 @@ vidcap_deltacast_init(struct vidcap_params *params, void **state)
         s->autodetect_format = TRUE;
         s->frame->color_spec = UYVY;
         s->audio_frame.data = NULL;
+        s->queue_depth = DEFAULT_BUFFERQUEUE_DEPTH;
 
-        s->BoardHandle = s->StreamHandle = s->SlotHandle = NULL;
+        s->BoardHandle = s->StreamHandle = NULL;
 
         if (init_fmt) {
                 char *save_ptr = NULL;
@@ -372,6 +383,13 @@ vidcap_deltacast_init(struct vidcap_params *params, void **state)
                                         usage();
                                         goto error;
                                 }
+                        } else if (strncasecmp(tok, "queue=", strlen("queue=")) == 0) {
+                                int depth = atoi(tok + strlen("queue="));
+                                if (depth < 2) {
+                                        log_msg(LOG_LEVEL_ERROR, "[DELTACAST] Queue depth must be at least 2!\n");
+                                        goto error;
+                                }
+                                s->queue_depth = depth;
                         } else {
                                 log_msg(LOG_LEVEL_ERROR, "[DELTACAST] Wrong config option '%s'!\n", tok);
                                 goto error;
@@ -459,7 +477,7 @@ error:
                 vf_free(s->frame);
         }
 
-        free(s);
+        delete s;
         return VIDCAP_INIT_FAIL;
 }
 
@@ -469,9 +487,12 @@ vidcap_deltacast_done(void *state)
 	struct vidcap_deltacast_state *s = (struct vidcap_deltacast_state *) state;
 
 	assert(s != NULL);
-        
-        if(s->SlotHandle)
-                VHD_UnlockSlotHandle(s->SlotHandle);
+
+        // frames held by the pipeline have been disposed by now
+        while (!s->frames_to_free.empty()) {
+                VHD_UnlockSlotHandle(s->frames_to_free.front());
+                s->frames_to_free.pop();
+        }
         VHD_StopStream(s->StreamHandle);
         VHD_CloseStreamHandle(s->StreamHandle);
         /* Re-establish RX0-TX0 by-pass relay loopthrough */
@@ -480,7 +501,26 @@ vidcap_deltacast_done(void *state)
         
         vf_free(s->frame);
         free(s->audio_frame.data);
-        free(s);
+        delete s;
+}
+
+struct vidcap_deltacast_dispose_udata {
+        struct vidcap_deltacast_state *s;
+        HANDLE SlotHandle;
+};
+
+/**
+ * The slot is only queued here - it is unlocked from the grab thread, the
+ * frame may be disposed from any thread.
+ */
+static void vidcap_deltacast_dispose(struct video_frame *f)
+{
+        auto data = (struct vidcap_deltacast_dispose_udata *) f->callbacks.dispose_udata;
+        data->s->lock.lock();
+        data->s->frames_to_free.push(data->SlotHandle);
+        data->s->lock.unlock();
+        delete data;
+        vf_free(f);
 }
 
 static struct video_frame *
@@ -491,6 +531,16 @@ vidcap_deltacast_grab(void *state, struct audio_frame **audio)
         ULONG             /*SlotsCount, SlotsDropped,*/BufferSize;
         ULONG             Result;
         BYTE             *pBuffer=NULL;
+        HANDLE            SlotHandle;
+        queue<HANDLE>     queue;
+
+        s->lock.lock();
+        swap(queue, s->frames_to_free); // empty the synchronized queue and unlock the slots without a lock
+        s->lock.unlock();
+        while (!queue.empty()) {
+                VHD_UnlockSlotHandle(queue.front());
+                queue.pop();
+        }
 
         if (!s->initialized) {
                 try {
@@ -504,10 +554,7 @@ vidcap_deltacast_grab(void *state, struct audio_frame **audio)
         }
 
         *audio = NULL;
-        /* Unlock slot */
-        if(s->SlotHandle)
-                VHD_UnlockSlotHandle(s->SlotHandle);
-        Result = VHD_LockSlotHandle(s->StreamHandle,&s->SlotHandle);
+        Result = VHD_LockSlotHandle(s->StreamHandle, &SlotHandle);
         if (Result != VHDERR_NOERROR) {
                 if (Result != VHDERR_TIMEOUT) {
                         log_msg(LOG_LEVEL_ERROR, "ERROR : Cannot lock slot on RX0 stream. Result = 0x%08" PRIX_ULONG "\n", Result);
@@ -525,7 +572,7 @@ vidcap_deltacast_grab(void *state, struct audio_frame **audio)
                 s->pAudioChn->DataSize = s->AudioBufferSize;
 
                 /* Extract audio */
-                Result = VHD_SlotExtractAudio(s->SlotHandle, &s->AudioInfo);
+                Result = VHD_SlotExtractAudio(SlotHandle, &s->AudioInfo);
                 if(Result==VHDERR_NOERROR) {
                         s->audio_frame.data_len = s->pAudioChn->DataSize;
                         /* Do audio processing here */
@@ -536,15 +583,21 @@ vidcap_deltacast_grab(void *state, struct audio_frame **audio)
         }
 
         
-         Result = VHD_GetSlotBuffer(s->SlotHandle, VHD_SDI_BT_VIDEO, &pBuffer, &BufferSize);
+         Result = VHD_GetSlotBuffer(SlotHandle, VHD_SDI_BT_VIDEO, &pBuffer, &BufferSize);
          
          if (Result != VHDERR_NOERROR) {
                 log_msg(LOG_LEVEL_ERROR, "\nERROR : Cannot get slot buffer. Result = 0x%08" PRIX_ULONG "\n",Result);
+                VHD_UnlockSlotHandle(SlotHandle);
                 return NULL;
          }
-         
-         s->tile->data = (char*) pBuffer;
-         s->tile->data_len = BufferSize;
+
+         // the slot stays locked until the frame is disposed so that the
+         // board fills the other slots while this one is being processed
+         struct video_frame *out = vf_alloc_desc(video_desc_from_frame(s->frame));
+         out->tiles[0].data = (char*) pBuffer;
+         out->tiles[0].data_len = BufferSize;
+         out->callbacks.dispose_udata = new vidcap_deltacast_dispose_udata{s, SlotHandle};
+         out->callbacks.dispose = vidcap_deltacast_dispose;
 
          /* Print some statistics */
          /*VHD_GetStreamProperty(s->StreamHandle,VHD_CORE_SP_SLOTS_COUNT,&SlotsCount);
@@ -560,7 +613,7 @@ vidcap_deltacast_grab(void *state, struct audio_frame **audio)
         }
         s->frames++;
         
-	return s->frame;
+	return out;
 }
 
 static const struct video_capture_info vidcap_deltacast_info = {
@@ -65,6 +65,7 @@
 
 #include "utils/cuda_pix_conv.h"
 #include "utils/profile_timer.hpp"
+#include "utils/video_frame_pool.h"
 
 #define PI 3.14159265
 
@@ -83,16 +84,39 @@ static void show_help()
         printf("Usage\n");
         printf("\t-t gpustitch -t <dev1_config> -t <dev2_config> ....]\n");
         printf("\t\twhere devn_config is a complete configuration string of device involved in stitching\n");
+        printf("\toptions (after -t gpustitch:): width=, blend_algo=multiband|feather, feather_width=, multiband_levels=,\n"
+               "\t\trig_spec=, fps=, fmt=RGBA|RGB|UYVY, tiled, cudabuf (keep the panorama in CUDA memory, eg. for GPUJPEG)\n");
 
 }
 
 struct grab_worker_state;
 
+/// result frames - page-locked host memory for asynchronous download or device memory (cudabuf)
+struct cuda_result_allocator : public video_frame_pool_allocator {
+        explicit cuda_result_allocator(bool device) : device(device) {}
+        void *allocate(size_t size) override {
+                void *ptr = nullptr;
+                cudaError_t ret = device ? cudaMalloc(&ptr, size) : cudaMallocHost(&ptr, size);
+                return ret == cudaSuccess ? ptr : nullptr;
+        }
+        void deallocate(void *ptr) override {
+                if (device) {
+                        cudaFree(ptr);
+                } else {
+                        cudaFreeHost(ptr);
+                }
+        }
+        struct video_frame_pool_allocator *clone() const override {
+                return new cuda_result_allocator(*this);
+        }
+        bool device;
+};
+
 struct vidcap_gpustitch_state {
         unsigned            devices_cnt;
 
         struct video_frame      **captured_frames;
-        struct video_frame       *frame; 
+        std::unique_ptr<video_frame_pool> frame_pool; ///< result frames, the consumer may hold some while stitching the next
         int frames;
         struct       timeval t, t0;
 
@@ -140,7 +164,10 @@ struct grab_worker_state {
         unsigned width = 0;
         unsigned height = 0;
         unsigned char *tmp_in_frame;
-        unsigned char *tmp_rgba_frame;
+        /// double-buffered so that frame N+1 is uploaded while the stitcher reads frame N
+        unsigned char *tmp_rgba_frame[2];
+        /// recorded to the stitcher input stream(s) after the submission (4 for tiled capture)
+        cudaEvent_t tmp_rgba_frame_consumed[2][4];
         unsigned tmp_rgba_frame_pitch;
         void (*conv_func)(unsigned char *dst,
                 size_t dstPitch,
@@ -239,11 +266,11 @@ static bool upload_to_cuda_buf(grab_worker_state *gs, video_frame *in_frame,
                                 gs->tmp_in_frame + offset_bytes, in_line_size,
                                 w, h, stream);
         } else {
-                if (cudaMemcpy2D(dst + y_offset * dst_pitch + vc_get_linesize(x_offset, RGBA), dst_pitch,
+                if (cudaMemcpy2DAsync(dst + y_offset * dst_pitch + vc_get_linesize(x_offset, RGBA), dst_pitch,
                                         (unsigned char*)(in_frame->tiles[0].data) + offset_bytes,
                                         in_line_size,
                                         w, h,
-                                        cudaMemcpyHostToDevice) != cudaSuccess)
+                                        cudaMemcpyHostToDevice, stream) != cudaSuccess)
                 {
                         std::cerr << "Error copying RGBA image bitmap to CUDA buffer" << std::endl;
                         return false;
@@ -254,63 +281,64 @@ static bool upload_to_cuda_buf(grab_worker_state *gs, video_frame *in_frame,
         return true;
 }
 
-static bool upload_frame(grab_worker_state *gs, video_frame *in_frame, int i){
-        cudaStream_t stream;
-        gs->s->stitcher.get_input_stream(i, &stream);
+/**
+ * Uploads (and converts to RGBA) the whole captured frame to the buffer on
+ * the worker's own stream so that it may overlap the stitching of the
+ * previous frame.
+ */
+static bool upload_frame(grab_worker_state *gs, video_frame *in_frame, int buf){
+        // the stitcher must have already copied the frame submitted from this buffer 2 frames ago
+        for (int input = 0; input < (gs->tiled ? 4 : 1); ++input) {
+                if (cudaEventSynchronize(gs->tmp_rgba_frame_consumed[buf][input]) != cudaSuccess) {
+                        std::cerr << log_str << "Error waiting for the stitcher input" << std::endl;
+                        return false;
+                }
+        }
 
-        if(!stream){
-                std::cerr << std::endl << "Failed to get input stream." << std::endl;
+        if (!upload_to_cuda_buf(gs,
+                                in_frame,
+                                0, 0, gs->width, gs->height,
+                                gs->tmp_rgba_frame[buf],
+                                gs->tmp_rgba_frame_pitch,
+                                gs->tmp_in_frame_stream)) {
                 return false;
         }
 
-        upload_to_cuda_buf(gs,
-                        in_frame,
-                        0, 0, gs->width, gs->height,
-                        gs->tmp_rgba_frame,
-                        gs->tmp_rgba_frame_pitch,
-                        stream);
-
-        gs->s->stitcher.submit_input_image_async(i, gs->tmp_rgba_frame,
-                        gs->width, gs->height,
-                        gs->tmp_rgba_frame_pitch,
-                        gpustitch::Src_mem_kind::Device);
-
-        return true;
+        return cudaStreamSynchronize(gs->tmp_in_frame_stream) == cudaSuccess;
 }
 
-static void upload_tiles(grab_worker_state *gs, video_frame *frame){
+/// passes the uploaded frame to the stitcher input i (4 inputs for tiled capture)
+static bool submit_frame(grab_worker_state *gs, int buf, int i){
         const int order[] = {3, 1, 2, 0};
+        const int inputs = gs->tiled ? 4 : 1;
 
-        for(int i = 0; i < 4; i++){
+        for(int input = 0; input < inputs; input++){
+                const int stitcher_input = gs->tiled ? input : i;
                 cudaStream_t stream;
+                gs->s->stitcher.get_input_stream(stitcher_input, &stream);
+                if(!stream){
+                        std::cerr << std::endl << "Failed to get input stream." << std::endl;
+                        return false;
+                }
 
-                gs->s->stitcher.get_input_stream(i, &stream);
-
-                unsigned tile_height = gs->height / 2;
-                unsigned tile_width = gs->width / 2;
-                unsigned src_pitch = gs->tmp_rgba_frame_pitch;
-                unsigned tile_line_len = gs->tmp_rgba_frame_pitch / 2;
-                unsigned x_offset = (order[i] % 2) * tile_width;
-                unsigned y_offset = (order[i] / 2) * tile_height;
-
-                upload_to_cuda_buf(gs,
-                                frame,
-                                x_offset, y_offset, tile_width, tile_height,
-                                gs->tmp_rgba_frame,
-                                gs->tmp_rgba_frame_pitch,
-                                stream
-                                );
-
-                unsigned char *src = static_cast<unsigned char *>(gs->tmp_rgba_frame);
-                src += (order[i] % 2) * tile_line_len;
-                src += (order[i] / 2) * src_pitch * tile_height;
+                unsigned char *src = gs->tmp_rgba_frame[buf];
+                unsigned width = gs->width;
+                unsigned height = gs->height;
+                if (gs->tiled) {
+                        width /= 2;
+                        height /= 2;
+                        src += (order[input] % 2) * (gs->tmp_rgba_frame_pitch / 2);
+                        src += (order[input] / 2) * gs->tmp_rgba_frame_pitch * height;
+                }
 
-                gs->s->stitcher.submit_input_image_async(i, src,
-                                gs->width / 2, gs->height / 2,
+                gs->s->stitcher.submit_input_image_async(stitcher_input, src,
+                                width, height,
                                 gs->tmp_rgba_frame_pitch,
                                 gpustitch::Src_mem_kind::Device);
-
+                cudaEventRecord(gs->tmp_rgba_frame_consumed[buf][input], stream);
         }
+
+        return true;
 }
 
 static void grab_worker(grab_worker_state *gs, vidcap_params *param, int id){
@@ -329,7 +357,12 @@ static void grab_worker(grab_worker_state *gs, vidcap_params *param, int id){
 
         int in_line_size = vc_get_linesize(gs->width, RGBA);
         gs->tmp_rgba_frame_pitch = in_line_size;
-        cudaMalloc(&gs->tmp_rgba_frame, in_line_size * gs->height);
+        for (int buf = 0; buf < 2; ++buf) {
+                cudaMalloc(&gs->tmp_rgba_frame[buf], in_line_size * gs->height);
+                for (auto &event : gs->tmp_rgba_frame_consumed[buf]) {
+                        cudaEventCreateWithFlags(&event, cudaEventDisableTiming);
+                }
+        }
 
         vidcap *device = nullptr;
 
@@ -341,9 +374,24 @@ static void grab_worker(grab_worker_state *gs, vidcap_params *param, int id){
                 return;
         }
 
-        cudaStreamCreate(&gs->tmp_in_frame_stream);
+        cudaStreamCreateWithFlags(&gs->tmp_in_frame_stream, cudaStreamNonBlocking);
 
+        // Frame N+1 is grabbed and uploaded while the stitcher processes
+        // frame N, only the submission waits for the stitcher.
+        int buf = 0;
         while(true){
+                frame = nullptr;
+                PROFILE_DETAIL("Grab frame");
+                while(!frame){
+                        frame = vidcap_grab(device, &audio_frame);
+                }
+
+                bool uploaded = false;
+                if (check_in_format(gs, frame, id)){
+                        PROFILE_DETAIL("Upload");
+                        uploaded = upload_frame(gs, frame, buf);
+                }
+
                 stitch_lk.lock();
                 PROFILE_DETAIL("Wait for cv");
                 gs->s->stitched_cv.wait(stitch_lk,
@@ -352,32 +400,25 @@ static void grab_worker(grab_worker_state *gs, vidcap_params *param, int id){
                         VIDEO_FRAME_DISPOSE(frame);
                         vidcap_done(device);
                         cudaStreamDestroy(gs->tmp_in_frame_stream);
+                        for (int i = 0; i < 2; ++i) {
+                                for (auto &event : gs->tmp_rgba_frame_consumed[i]) {
+                                        cudaEventDestroy(event);
+                                }
+                                cudaFree(gs->tmp_rgba_frame[i]);
+                        }
                         return;
                 }
                 stitch_lk.unlock();
 
-                VIDEO_FRAME_DISPOSE(frame);
-
-                frame = nullptr;
-                PROFILE_DETAIL("Grab frame");
-                while(!frame){
-                        frame = vidcap_grab(device, &audio_frame);
-                }
-
-                if (check_in_format(gs, frame, id)){
-                        PROFILE_DETAIL("Upload");
-                        if(gs->tiled){
-                                upload_tiles(gs, frame);
-
-                        } else {
-                                upload_frame(gs, frame, id);
-                        }
+                if (uploaded) {
+                        submit_frame(gs, buf, id);
+                        buf = 1 - buf;
                 }
+                VIDEO_FRAME_DISPOSE(frame);
 
                 grab_lk.lock();
                 gs->grabbed_count += 1;
-                if(frame)
-                        gs->grabbed_fps = frame->fps;
+                gs->grabbed_fps = frame->fps;
                 grab_lk.unlock();
                 gs->grabbed_cv.notify_one();
         }
@@ -560,8 +601,6 @@ vidcap_gpustitch_init(struct vidcap_params *params, void **state)
 
         s->captured_frames = (struct video_frame **) calloc(s->devices_cnt, sizeof(struct video_frame *));
 
-        s->frame = nullptr;
-
         if(!init_stitcher(s)){
                 goto error;
         }
@@ -598,20 +637,12 @@ vidcap_gpustitch_done(void *state)
         stop_grab_workers(s);
 
         free(s->captured_frames);
-        vf_free(s->frame);
         cudaFree(s->conv_tmp_frame);
 
         delete s;
 }
 
-static void result_data_delete(struct video_frame *buf){
-        if(!buf)
-                return;
-
-        cudaFreeHost(buf->tiles[0].data);
-}
-
-static bool allocate_result_frame(vidcap_gpustitch_state *s, unsigned width, unsigned height){
+static bool allocate_result_frames(vidcap_gpustitch_state *s, unsigned width, unsigned height){
         video_desc desc{};
         desc.width = width;
         desc.height = height;
@@ -619,22 +650,12 @@ static bool allocate_result_frame(vidcap_gpustitch_state *s, unsigned width, uns
         desc.tile_count = 1;
         desc.fps = s->fps;
 
-        s->frame = vf_alloc_desc(desc);
-        s->frame->tiles[0].data_len = vc_get_linesize(desc.width,
-                        desc.color_spec) * desc.height;
-
-        s->frame->callbacks.data_deleter = NULL;
-        s->frame->callbacks.recycle = NULL;
+        // 3 frames - one being filled, one held by the consumer and one spare
+        s->frame_pool = std::make_unique<video_frame_pool>(3,
+                        cuda_result_allocator(s->output_cuda_buf));
+        s->frame_pool->reconfigure(desc);
 
-        if(!s->output_cuda_buf){
-                if(cudaMallocHost(&s->frame->tiles[0].data, s->frame->tiles[0].data_len) != cudaSuccess){
-                        std::cerr << log_str << "Failed to allocate result frame" << std::endl;
-                        return false;
-                }
-                s->frame->callbacks.data_deleter = result_data_delete;
-        }
-
-        if(s->conv_func){
+        if(s->conv_func && !s->output_cuda_buf){
                 size_t size = vc_get_linesize(desc.width, s->out_fmt) * desc.height;
 
                 if(cudaMalloc(&s->conv_tmp_frame, size) != cudaSuccess){
@@ -646,52 +667,66 @@ static bool allocate_result_frame(vidcap_gpustitch_state *s, unsigned width, uns
         return true;
 }
 
-static bool download_stitched(vidcap_gpustitch_state *s, cudaStream_t out_stream){
+static struct video_frame *download_stitched(vidcap_gpustitch_state *s, cudaStream_t out_stream){
         PROFILE_FUNC;
         gpustitch::Image_cuda *output_image;
 
         output_image = s->stitcher.get_output_image();
         if(!output_image){
                 std::cerr << log_str << "Failed to get output buffer" << std::endl;
-                return false;
+                return nullptr;
         }
 
         size_t w = output_image->get_width();
         size_t h = output_image->get_height();
 
-        if(!s->frame){
-                if(!allocate_result_frame(s, w, h)){
-                        return false;
+        if(!s->frame_pool){
+                if(!allocate_result_frames(s, w, h)){
+                        return nullptr;
                 }
         }
 
+        struct video_frame *frame = nullptr;
+        try {
+                frame = s->frame_pool->get_disposable_frame();
+        } catch (std::exception &e) {
+                std::cerr << log_str << "Failed to allocate result frame: " << e.what() << std::endl;
+                return nullptr;
+        }
+
         void *src = output_image->data();
         size_t src_pitch = output_image->get_pitch();
         size_t row_bytes = output_image->get_row_bytes();
         if(s->conv_func){
-                s->conv_func(s->conv_tmp_frame, vc_get_linesize(w, s->out_fmt),
+                // with cudabuf the conversion writes directly to the result frame
+                unsigned char *dst = s->output_cuda_buf ?
+                        (unsigned char *) frame->tiles[0].data : s->conv_tmp_frame;
+                s->conv_func(dst, vc_get_linesize(w, s->out_fmt),
                                 (unsigned char *) src, src_pitch,
                                 w, h,
                                 out_stream);
-                src = s->conv_tmp_frame;
+                src = dst;
                 src_pitch = vc_get_linesize(w, s->out_fmt);
                 row_bytes = src_pitch;
         }
 
-        if(s->output_cuda_buf){
-                s->frame->tiles[0].data = (char *) src;
-        } else {
-                if (cudaMemcpy2DAsync(s->frame->tiles[0].data, row_bytes,
+        if(!s->output_cuda_buf || !s->conv_func){
+                if (cudaMemcpy2DAsync(frame->tiles[0].data, row_bytes,
                                         src, src_pitch,
                                         row_bytes, h,
-                                        cudaMemcpyDeviceToHost, out_stream) != cudaSuccess)
+                                        s->output_cuda_buf ? cudaMemcpyDeviceToDevice : cudaMemcpyDeviceToHost,
+                                        out_stream) != cudaSuccess)
                 {
                         std::cerr << log_str << "Error copying output panorama from CUDA buffer" << std::endl;
-                        return false;
+                        VIDEO_FRAME_DISPOSE(frame);
+                        return nullptr;
                 }
         }
+        if(s->output_cuda_buf){
+                frame->mem_location = CUDA_MEM;
+        }
 
-        return true;
+        return frame;
 }
 
 static void report_stats(vidcap_gpustitch_state *s){
@@ -739,7 +774,8 @@ static struct video_frame *stitch(struct vidcap_gpustitch_state *s){
         stitch_lk.unlock();
         s->stitched_cv.notify_all();
 
-        if(!download_stitched(s, out_stream)){
+        struct video_frame *frame = download_stitched(s, out_stream);
+        if(!frame){
                 return NULL;
         }
 
@@ -747,10 +783,11 @@ static struct video_frame *stitch(struct vidcap_gpustitch_state *s){
         if (cudaStreamSynchronize(out_stream) != cudaSuccess)
         {
                 std::cerr << "Error synchronizing with the output CUDA stream" << std::endl;
+                VIDEO_FRAME_DISPOSE(frame);
                 return NULL;
         }
 
-        return s->frame;
+        return frame;
 }
 
 static struct video_frame *
@@ -55,6 +55,7 @@
 #include "lib_common.h"
 #include "video.h"
 #include "video_capture.h"
+#include "video_decompress.h"
 
 #include "tv.h"
 
@@ -68,6 +69,7 @@
 #include "utils/color_out.h"
 #include "utils/macros.h"
 #include "utils/ring_buffer.h"
+#include "utils/video_frame_pool.h"
 #include "utils/worker.h"
 #include "video_export.h"
 
@@ -79,15 +81,24 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
 #include <chrono>
+#include <memory>
 #include <mutex>
+#include <vector>
 
-#define BUFFER_LEN_MAX 40
+#define BUFFER_LEN_DEFAULT 40
+#define ALLOC_ALIGN 512
 #define MAX_CLIENTS 16
+#define MAX_TILE_COUNT 10 ///< tile index in file name is a single digit
 
 #define VIDCAP_IMPORT_ID 0x76FA7F6D
 
@@ -105,16 +116,36 @@ using std::string;
 using std::to_string;
 using std::unique_lock;
 
-struct processed_entry;
-struct tile_data {
-        char *data;
-        int data_len;
-};
-
 struct processed_entry {
         struct processed_entry *next;
-        int count;
-        struct tile_data tiles[];
+        struct video_frame *frame; ///< disposable frame passed to the caller
+        long frame_idx;            ///< 0-based position in the sequence
+};
+
+/// location of a tile recorded to a segment file (see video_export.c)
+struct import_index_entry {
+        int segment = -1; ///< -1 - not recorded (dropped)
+        off_t offset = 0;
+        size_t len = 0;
+};
+
+/// per-frame properties recorded to the segment index
+struct import_frame_info {
+        long long ts_us = -1; ///< presentation time relative to the first frame, -1 - unknown
+        bool keyframe = true;
+};
+
+/// buffers aligned for O_DIRECT reads
+struct import_data_allocator : public video_frame_pool_allocator {
+        void *allocate(size_t size) override {
+                return aligned_malloc(size, max<size_t>(ALLOC_ALIGN, 4096));
+        }
+        void deallocate(void *ptr) override {
+                aligned_free(ptr);
+        }
+        struct video_frame_pool_allocator *clone() const override {
+                return new import_data_allocator(*this);
+        }
 };
 
 typedef enum {
@@ -193,7 +224,19 @@ struct vidcap_import_state {
         bool finished;
         bool loop;
         bool o_direct;
+        bool use_mmap;
+        int queue_len_max = BUFFER_LEN_DEFAULT;
+        int prefetch;            ///< number of frames past the queue to pre-load to page cache
+        std::unique_ptr<video_frame_pool> pool; ///< uncompressed frames only
+        size_t pool_data_len;
+        std::vector<import_index_entry> index; ///< [(frame - 1) * tile_count + tile] for segmented recording
+        std::vector<import_frame_info> frame_info; ///< [frame - 1], empty if not recorded in the index
+        std::atomic<long> current_frame{0}; ///< index of the frame last passed to the caller
         int video_reading_threads_count;
+        codec_t decode_codec = VIDEO_CODEC_NONE; ///< decode compressed frames to this codec (in the reading workers)
+        std::vector<struct state_decompress *> decoders; ///< [worker], empty if not decoding
+        std::unique_ptr<video_frame_pool> decode_pool; ///< decoded frames
+        struct video_desc decoded_desc;
         bool should_exit_at_end;
         double force_fps;
 };
@@ -341,7 +384,7 @@ static int get_tile_count(const char *directory, codec_t color_spec, char *tile_
         int tile_count = 0;
         char possible_tile_delim[] = { '_', '-' };
         for (unsigned int d = 0; d < sizeof possible_tile_delim; d++) {
-                for (int i = 0; i < 10; i++) {
+                for (int i = 0; i < MAX_TILE_COUNT; i++) {
                         snprintf(name, sizeof(name), "%s/%08d%c%d.%s",
                                         directory, 1,
                                         possible_tile_delim[d], i,
@@ -364,6 +407,139 @@ static int get_tile_count(const char *directory, codec_t color_spec, char *tile_
         return tile_count;
 }
 
+/**
+ * Loads index of a recording done to segment files (instead of a file per frame)
+ * @retval false  index not found (file per frame recording)
+ */
+static bool load_index(struct vidcap_import_state *s) {
+        std::string index_filename = std::string(s->directory) + "/" VIDEO_EXPORT_INDEX_FILE;
+        FILE *f = fopen(index_filename.c_str(), "r");
+        if (f == nullptr) {
+                return false;
+        }
+        struct rec { long frame; int tile; import_index_entry e; };
+        std::vector<rec> recs;
+        int tile_count = 1;
+        bool has_frame_info = false;
+        s->frame_info.resize(s->video_frame_count);
+        char line[512];
+        while (fgets(line, sizeof line, f) != nullptr) {
+                rec r;
+                long long offset = 0;
+                import_frame_info info;
+                int keyframe = 1;
+                int ret = line[0] == '#' ? 0 : sscanf(line, "%ld %d %d %lld %zu %lld %d", &r.frame, &r.tile,
+                                &r.e.segment, &offset, &r.e.len, &info.ts_us, &keyframe);
+                if (ret != 5 && ret != 7) { // older recordings have no timestamp and keyframe flag
+                        continue;
+                }
+                if (r.frame < 1 || r.frame > s->video_frame_count || r.tile < 0 || r.tile >= MAX_TILE_COUNT || r.e.segment < 0) {
+                        continue;
+                }
+                if (ret == 7 && r.tile == 0) {
+                        info.keyframe = keyframe != 0;
+                        s->frame_info[r.frame - 1] = info;
+                        has_frame_info = true;
+                }
+                r.e.offset = offset;
+                tile_count = max(tile_count, r.tile + 1);
+                recs.push_back(r);
+        }
+        fclose(f);
+        if (!has_frame_info) {
+                s->frame_info.clear();
+        }
+
+        s->video_desc.tile_count = tile_count;
+        s->index.resize(s->video_frame_count * tile_count);
+        for (auto const &r : recs) {
+                s->index[(r.frame - 1) * tile_count + r.tile] = r.e;
+        }
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "Reading segmented recording (%zu tiles indexed).\n", recs.size());
+        return true;
+}
+
+/**
+ * Converts a seek time to a frame index using the timestamps from the index,
+ * so that the seek is accurate even if frames were dropped while recording.
+ * @param ts_us time relative to the first frame
+ */
+static long find_frame_by_time(struct vidcap_import_state *s, long long ts_us) {
+        auto it = std::upper_bound(s->frame_info.begin(), s->frame_info.end(), ts_us,
+                        [](long long ts, import_frame_info const &i) { return i.ts_us >= 0 && ts < i.ts_us; });
+        return max<long>(0, it - s->frame_info.begin() - 1);
+}
+
+/**
+ * Resolves a seek request (see process_msg()) to an absolute frame index.
+ * If the recording indicates keyframes, the position is moved back to the
+ * nearest preceding keyframe, where the decoder can start from.
+ */
+static long resolve_seek_frame(struct vidcap_import_state *s, const char *time_spec) {
+        const bool relative = time_spec[0] == '+' || time_spec[0] == '-';
+        const long current = s->current_frame;
+        long frame = 0;
+        if (strchr(time_spec, 's') != NULL) {
+                double val = atof(time_spec);
+                if (!s->frame_info.empty() && s->frame_info[current].ts_us >= 0) {
+                        long long base = relative ? s->frame_info[current].ts_us : 0;
+                        frame = find_frame_by_time(s, base + (long long) (val * 1000000));
+                } else {
+                        frame = (relative ? current : 0) + (long) (val * s->video_desc.fps);
+                }
+        } else {
+                frame = (relative ? current : 0) + atol(time_spec);
+        }
+        frame = min(max(0L, frame), s->video_frame_count - 1);
+
+        if (!s->frame_info.empty()) {
+                long key = frame;
+                while (key > 0 && !s->frame_info[key].keyframe) {
+                        key -= 1;
+                }
+                if (key != frame) {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Seeking to keyframe %ld instead of %ld.\n", key, frame);
+                }
+                frame = key;
+        }
+        return frame;
+}
+
+/// creates a decoder for each reading worker, throws on error
+static void init_decoders(struct vidcap_import_state *s) {
+        using namespace std::string_literals;
+        if (!is_codec_opaque(s->video_desc.color_spec)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "The recording is not compressed, ignoring decode.\n");
+                return;
+        }
+        if (is_codec_interframe(s->video_desc.color_spec) && s->video_reading_threads_count > 1) {
+                throw ug_runtime_error("Parallel decoding requires an intra-frame codec, use mt_reading=1 for "s
+                                + get_codec_name(s->video_desc.color_spec) + ".");
+        }
+        s->decoders.resize(s->video_reading_threads_count);
+        if (!decompress_init_multi(s->video_desc.color_spec, pixfmt_desc{}, s->decode_codec,
+                                s->decoders.data(), s->decoders.size())) {
+                s->decoders.clear();
+                throw ug_runtime_error("Cannot find decoder from "s + get_codec_name(s->video_desc.color_spec)
+                                + " to " + get_codec_name(s->decode_codec) + ".");
+        }
+        struct video_desc tile_desc = s->video_desc;
+        tile_desc.tile_count = 1;
+        for (auto *decoder : s->decoders) {
+                if (decompress_reconfigure(decoder, tile_desc, 0, 8, 16,
+                                        vc_get_linesize(tile_desc.width, s->decode_codec), s->decode_codec) == 0) {
+                        throw ug_runtime_error("Cannot configure the decoder.");
+                }
+        }
+        s->decoded_desc = s->video_desc;
+        s->decoded_desc.color_spec = s->decode_codec;
+        s->decode_pool = std::make_unique<video_frame_pool>();
+        s->decode_pool->reconfigure(s->decoded_desc,
+                        vc_get_datalen(s->decoded_desc.width, s->decoded_desc.height, s->decode_codec));
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "Decoding %s to %s with %zu decoders.\n", get_codec_name(s->video_desc.color_spec),
+                        get_codec_name(s->decode_codec), s->decoders.size());
+}
+
 static int
 vidcap_import_init(struct vidcap_params *params, void **state)
 {
@@ -378,10 +554,15 @@ try {
 
         if (strlen(tmp) == 0 || strcmp(tmp, "help") == 0) {
                 color_printf("Import usage:\n"
-                                TERM_BOLD TERM_FG_RED "\t<directory>" TERM_FG_RESET "{:loop|:mt_reading=<nr_threads>|:o_direct|:exit_at_end|:fps=<fps>|frames=<n>|:disable_audio}\n" TERM_RESET
+                                TERM_BOLD TERM_FG_RED "\t<directory>" TERM_FG_RESET "{:loop|:mt_reading=<nr_threads>|:o_direct|:mmap|:queue_len=<len>|:prefetch=<frames>|:decode=<codec>|:exit_at_end|:fps=<fps>|frames=<n>|:disable_audio}\n" TERM_RESET
                                 "where\n"
                                 TERM_BOLD "\t<fps>" TERM_RESET " - overrides FPS from sequence metadata\n"
-                                TERM_BOLD "\t<n>  " TERM_RESET " - use only N first frames fron sequence (if less than available frames)\n");
+                                TERM_BOLD "\t<n>  " TERM_RESET " - use only N first frames fron sequence (if less than available frames)\n"
+                                TERM_BOLD "\tmmap " TERM_RESET " - map the frame files instead of reading them (no copy, pages are populated by the reading thread)\n"
+                                TERM_BOLD "\t<len>" TERM_RESET " - number of frames read ahead (default " TOSTRING(BUFFER_LEN_DEFAULT) ")\n"
+                                TERM_BOLD "\t<frames>" TERM_RESET " - hint the kernel to pre-load that many frame files following the read-ahead queue (default 0, not with o_direct)\n"
+                                TERM_BOLD "\tdecode=<codec>" TERM_RESET " - decode compressed frames to <codec> (eg. UYVY) in the reading threads - with mt_reading=<n>\n"
+                                "\t\tconsecutive frames are decoded in parallel (intra-frame codecs only, eg. JPEG or J2K)\n");
                 delete s;
                 free(tmp);
                 return VIDCAP_INIT_NOERR;
@@ -426,6 +607,23 @@ try {
                                         MAX_NUMBER_WORKERS);
                 } else if (strcmp(suffix, "o_direct") == 0) {
                         s->o_direct = true;
+                } else if (strcmp(suffix, "mmap") == 0) {
+#ifdef WIN32
+                        throw ug_runtime_error("mmap is not supported on this platform!");
+#endif
+                        s->use_mmap = true;
+                } else if (strstr(suffix, "queue_len=") == suffix) {
+                        s->queue_len_max = atoi(strchr(suffix, '=') + 1);
+                        if (s->queue_len_max < 2) {
+                                throw ug_runtime_error("Queue length must be at least 2!");
+                        }
+                } else if (strstr(suffix, "prefetch=") == suffix) {
+                        s->prefetch = atoi(strchr(suffix, '=') + 1);
+                } else if (strstr(suffix, "decode=") == suffix) {
+                        s->decode_codec = get_codec_from_name(strchr(suffix, '=') + 1);
+                        if (s->decode_codec == VIDEO_CODEC_NONE || is_codec_opaque(s->decode_codec)) {
+                                throw ug_runtime_error("Wrong decoded codec: "s + (strchr(suffix, '=') + 1));
+                        }
                 } else if (strcmp(suffix, "noaudio") == 0) {
                         disable_audio = true;
                 } else if (strcmp(suffix, "opportunistic_audio") == 0) { // skip
@@ -481,7 +679,21 @@ try {
                 fclose(info);
                 info = NULL;
 
-                s->video_desc.tile_count = get_tile_count(s->directory, s->video_desc.color_spec, &s->tile_delim);
+                if (!load_index(s)) {
+                        s->video_desc.tile_count = get_tile_count(s->directory, s->video_desc.color_spec, &s->tile_delim);
+                }
+        }
+
+        if (s->has_video && !s->use_mmap && !is_codec_opaque(s->video_desc.color_spec)) {
+                // size is known in advance - reuse the buffers; reads are rounded to ALLOC_ALIGN
+                s->pool_data_len = (vc_get_datalen(s->video_desc.width, s->video_desc.height, s->video_desc.color_spec)
+                                + ALLOC_ALIGN - 1) / ALLOC_ALIGN * ALLOC_ALIGN;
+                s->pool = std::make_unique<video_frame_pool>(0, import_data_allocator());
+                s->pool->reconfigure(s->video_desc, s->pool_data_len);
+        }
+
+        if (s->has_video && s->decode_codec != VIDEO_CODEC_NONE) {
+                init_decoders(s);
         }
 
         // override metadata fps setting
@@ -560,10 +772,7 @@ static void free_entry(struct processed_entry *entry)
         if (entry == NULL) {
                 return;
         }
-        for (int i = 0; i < entry->count; ++i) {
-                aligned_free(entry->tiles[i].data);
-        }
-
+        VIDEO_FRAME_DISPOSE(entry->frame);
         free(entry);
 }
 
@@ -592,6 +801,12 @@ static int flush_processed(struct processed_entry *list)
 static void cleanup_common(struct vidcap_import_state *s) {
         flush_processed(s->head);
 
+        for (auto *decoder : s->decoders) {
+                if (decoder != nullptr) {
+                        decompress_done(decoder);
+                }
+        }
+
         free(s->directory);
 
         // audio
@@ -676,7 +891,10 @@ static void process_msg(struct vidcap_import_state *s, const char *message)
                 msg->data_len = sizeof(struct seek_data);
                 msg->next = NULL;
 
-                if(time_spec[0] == '+' || time_spec[0] == '-') {
+                if (s->has_video) { // seek relative to the displayed frame, not the reading position
+                        data->whence = IMPORT_SEEK_SET;
+                        data->offset = resolve_seek_frame(s, time_spec);
+                } else if(time_spec[0] == '+' || time_spec[0] == '-') {
                         data->whence = IMPORT_SEEK_CUR;
                         if(strchr(time_spec, 's') != NULL) {
                                 double val = atof(time_spec);
@@ -771,7 +989,8 @@ static void * audio_reading_thread(void *args)
                                                 perror("wav_seek");
                                         }
                                         ring_buffer_flush(s->audio_state.data);
-                                        s->audio_state.video_frames_played = max<long long>(0, s->audio_state.video_frames_played + data->offset);
+                                        s->audio_state.video_frames_played = data->whence == IMPORT_SEEK_SET ? data->offset
+                                                : max<long long>(0, s->audio_state.video_frames_played + data->offset);
                                         s->audio_state.samples_read = bytes / (s->audio_frame.bps * s->audio_frame.ch_count);
                                         s->audio_state.samples_read = min(s->audio_state.samples_read, s->audio_state.total_samples);
                                         s->audio_state.played_samples = s->audio_state.samples_read;
@@ -806,35 +1025,161 @@ struct video_reader_data {
         char file_name_prefix[512];
         char file_name_suffix[512];
         char tile_delim;
-        unsigned int tile_count;
+        struct video_desc desc;
         struct processed_entry *entry;
         bool o_direct;
+        bool use_mmap;
+        video_frame_pool *pool;
+        size_t pool_data_len;
+        const char *directory;
+        const import_index_entry *index; ///< tiles of the frame if reading segments, otherwise nullptr
+        long frame_idx;
+        struct state_decompress *decoder; ///< decodes the frame after reading if not nullptr
+        video_frame_pool *decode_pool;
 };
 
-#define ALLOC_ALIGN 512
+static void import_aligned_data_deleter(struct video_frame *frame) {
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                aligned_free(frame->tiles[i].data);
+        }
+}
 
+#ifndef WIN32
+static void import_mmap_data_deleter(struct video_frame *frame) {
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                if (frame->tiles[i].data != nullptr) {
+                        munmap(frame->tiles[i].data, frame->tiles[i].data_len);
+                }
+        }
+}
+
+static bool map_tile(struct tile *tile, int fd, size_t len, off_t offset) {
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE; // fault the pages in here, not in the consumer
+#endif
+        void *addr = mmap(nullptr, len, PROT_READ | PROT_WRITE, flags, fd, offset);
+        if (addr == MAP_FAILED) {
+                perror(MOD_NAME "mmap");
+                return false;
+        }
+        tile->data = (char *) addr;
+        tile->data_len = len;
+        return true;
+}
+#endif
+
+static bool read_tile(struct tile *tile, int fd, size_t len, off_t offset) {
+        if (offset != 0 && lseek(fd, offset, SEEK_SET) != offset) {
+                perror("lseek");
+                return false;
+        }
+        size_t bytes = 0;
+        do {
+                ssize_t res = read(fd, tile->data + bytes,
+                                (len - bytes + ALLOC_ALIGN - 1) / ALLOC_ALIGN * ALLOC_ALIGN);
+                if (res <= 0) {
+                        perror("read");
+                        return false;
+                }
+                bytes += res;
+        } while (bytes < len);
+        tile->data_len = len;
+        return true;
+}
+
+static void get_tile_file_name(const struct video_reader_data *data, unsigned int i, char *name, size_t name_len) {
+        char tile_idx[3] = "";
+        if (data->desc.tile_count > 1) {
+                snprintf(tile_idx, sizeof tile_idx, "%c%d", data->tile_delim, i);
+        }
+        snprintf(name, name_len, "%s%s.%s",
+                        data->file_name_prefix, tile_idx,
+                        data->file_name_suffix);
+}
+
+/**
+ * Opens the file holding tile i of the frame
+ * @param[out] len     tile data length
+ * @param[out] offset  tile data offset within the file
+ * @returns fd or -1 on error
+ */
+static int open_tile(const struct video_reader_data *data, unsigned int i, int flags, size_t *len, off_t *offset) {
+        char name[1048];
+        if (data->index != nullptr) {
+                const import_index_entry &e = data->index[i];
+                if (e.segment == -1) {
+                        return -1; // frame was dropped while recording
+                }
+                snprintf(name, sizeof name, VIDEO_EXPORT_SEGMENT_FMT, data->directory, e.segment);
+                *len = e.len;
+                *offset = e.offset;
+                return open(name, flags);
+        }
+        get_tile_file_name(data, i, name, sizeof name);
+        int fd = open(name, flags);
+        if (fd == -1) {
+                return -1;
+        }
+        struct stat sb;
+        if (fstat(fd, &sb)) {
+                perror("fstat");
+                close(fd);
+                return -1;
+        }
+        *len = sb.st_size;
+        *offset = 0;
+        return fd;
+}
+
+/**
+ * Decodes the compressed frame read by the worker, the workers decode
+ * consecutive frames in parallel, each with its own decoder.
+ * @returns decoded frame or nullptr on error, the compressed frame is disposed
+ */
+static struct video_frame *decode_frame(struct video_reader_data *data, struct video_frame *compressed) {
+        struct video_frame *out = data->decode_pool->get_disposable_frame();
+        bool ok = true;
+        for (unsigned int i = 0; i < compressed->tile_count && ok; ++i) {
+                struct pixfmt_desc internal_prop{};
+                decompress_status ret = decompress_frame(data->decoder, (unsigned char *) out->tiles[i].data,
+                                (unsigned char *) compressed->tiles[i].data, compressed->tiles[i].data_len,
+                                data->frame_idx, &out->callbacks, &internal_prop);
+                if (ret != DECODER_GOT_FRAME) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot decode frame %ld (tile %u).\n", data->frame_idx + 1, i);
+                        ok = false;
+                }
+        }
+        VIDEO_FRAME_DISPOSE(compressed);
+        if (!ok) {
+                VIDEO_FRAME_DISPOSE(out);
+                return nullptr;
+        }
+        return out;
+}
+
+/**
+ * Reads (or maps) the frame files to a frame. If the size is known in advance
+ * (uncompressed stream), the frame is taken from the pool.
+ */
 static void *video_reader_callback(void *arg)
 {
         struct video_reader_data *data =
                 (struct video_reader_data *) arg;
-       
-        data->entry = (struct processed_entry *) calloc(1, sizeof(struct processed_entry) + data->tile_count * sizeof(struct tile_data));
-        assert(data->entry != NULL);
-        data->entry->next = NULL;
-        data->entry->count = data->tile_count;
-
-        for (unsigned int i = 0; i < data->tile_count; i++) {
-                char name[1048];
-                char tile_idx[3] = "";
-                if (data->tile_count > 1) {
-                        snprintf(tile_idx, sizeof tile_idx, "%c%d", data->tile_delim, i);
-	        }
-                snprintf(name, sizeof(name), "%s%s.%s",
-                                data->file_name_prefix, tile_idx,
-                                data->file_name_suffix);
-
-                struct stat sb;
+        data->entry = NULL;
+
+        int fds[MAX_TILE_COUNT];
+        size_t lens[MAX_TILE_COUNT];
+        off_t offsets[MAX_TILE_COUNT];
+        unsigned int opened = 0;
+        auto close_files = [&]() {
+                for (unsigned int i = 0; i < opened; ++i) {
+                        close(fds[i]);
+                }
+        };
+        bool pooled = data->pool != nullptr;
 
+        for ( ; opened < data->desc.tile_count; opened++) {
                 int flags = O_RDONLY;
 #ifdef WIN32
                 flags |= O_BINARY;
@@ -844,61 +1189,111 @@ static void *video_reader_callback(void *arg)
                         flags |= O_DIRECT;
 #endif
                 }
-                int fd = open(name, flags);
-                if(fd == -1) {
-                        perror("open");
+                fds[opened] = open_tile(data, opened, flags, &lens[opened], &offsets[opened]);
+                if (fds[opened] == -1) {
+                        if (data->index == nullptr) {
+                                perror("open");
+                        }
+                        close_files();
                         return NULL;
                 }
-                if (fstat(fd, &sb)) {
-                        perror("fstat");
-                        close(fd);
-                        free_entry(data->entry);
-                        return NULL;
+                pooled = pooled && lens[opened] <= data->pool_data_len;
+        }
+
+        struct video_frame *frame = nullptr;
+        if (pooled) {
+                frame = data->pool->get_disposable_frame();
+        } else {
+                frame = vf_alloc_desc(data->desc);
+                frame->callbacks.data_deleter = import_aligned_data_deleter;
+#ifndef WIN32
+                if (data->use_mmap) {
+                        frame->callbacks.data_deleter = import_mmap_data_deleter;
                 }
+#endif
+                frame->callbacks.dispose = vf_free;
+        }
 
-                data->entry->tiles[i].data_len = sb.st_size;
-                const int aligned_data_len = (data->entry->tiles[i].data_len + ALLOC_ALIGN - 1)
-                        / ALLOC_ALIGN * ALLOC_ALIGN;
-                // alignment needed when using O_DIRECT flag
-                data->entry->tiles[i].data = (char *)
-                        aligned_malloc(aligned_data_len, ALLOC_ALIGN);
-                assert(data->entry->tiles[i].data != NULL);
-
-                ssize_t bytes = 0;
-                do {
-                        ssize_t res = read(fd, data->entry->tiles[i].data + bytes,
-                                        (data->entry->tiles[i].data_len - bytes + ALLOC_ALIGN - 1)
-                                        / ALLOC_ALIGN * ALLOC_ALIGN);
-                        if (res <= 0) {
-                                perror("read");
-                                for (unsigned int i = 0; i < data->tile_count; i++) {
-                                        aligned_free(data->entry->tiles[i].data);
-                                }
-                                free(data->entry);
-                                close(fd);
-                                return NULL;
-                        }
-                        bytes += res;
-                } while (bytes < data->entry->tiles[i].data_len);
+        bool ok = true;
+        for (unsigned int i = 0; i < data->desc.tile_count && ok; i++) {
+#ifndef WIN32
+                if (data->use_mmap) {
+                        ok = map_tile(&frame->tiles[i], fds[i], lens[i], offsets[i]);
+                        continue;
+                }
+#endif
+                if (!pooled) {
+                        // alignment needed when using O_DIRECT flag
+                        frame->tiles[i].data = (char *) aligned_malloc(
+                                        (lens[i] + ALLOC_ALIGN - 1) / ALLOC_ALIGN * ALLOC_ALIGN, ALLOC_ALIGN);
+                        assert(frame->tiles[i].data != NULL);
+                }
+                ok = read_tile(&frame->tiles[i], fds[i], lens[i], offsets[i]);
+        }
+        close_files();
 
-                close(fd);
+        if (!ok) {
+                VIDEO_FRAME_DISPOSE(frame);
+                return NULL;
         }
 
+        if (data->decoder != nullptr && (frame = decode_frame(data, frame)) == nullptr) {
+                return NULL;
+        }
+
+        data->entry = (struct processed_entry *) calloc(1, sizeof(struct processed_entry));
+        assert(data->entry != NULL);
+        data->entry->frame = frame;
+        data->entry->frame_idx = data->frame_idx;
+
         return data;
 }
 
+/**
+ * Asks the kernel to start loading the frame files [first, last) to the page
+ * cache so that the reads of the workers find them already there.
+ */
+static void prefetch_frames(struct vidcap_import_state *s, long first, long last) {
+#ifdef HAVE_LINUX
+        struct video_reader_data data{};
+        data.desc = s->video_desc;
+        data.tile_delim = s->tile_delim;
+        data.directory = s->directory;
+        strncpy(data.file_name_suffix, get_codec_file_extension(s->video_desc.color_spec),
+                        sizeof(data.file_name_suffix) - 1);
+        for (long idx = first; idx < last && idx < s->video_frame_count; ++idx) {
+                snprintf(data.file_name_prefix, sizeof(data.file_name_prefix),
+                                "%s/%08ld", s->directory, idx + 1);
+                data.index = s->index.empty() ? nullptr : &s->index[idx * s->video_desc.tile_count];
+                for (unsigned int i = 0; i < s->video_desc.tile_count; ++i) {
+                        size_t len = 0;
+                        off_t offset = 0;
+                        int fd = open_tile(&data, i, O_RDONLY, &len, &offset);
+                        if (fd == -1) {
+                                continue;
+                        }
+                        posix_fadvise(fd, offset, len, POSIX_FADV_WILLNEED);
+                        close(fd);
+                }
+        }
+#else
+        UNUSED(s), UNUSED(first), UNUSED(last);
+#endif
+}
+
 static void * video_reading_thread(void *args)
 {
 	struct vidcap_import_state 	*s = (struct vidcap_import_state *) args;
         long index = 0;
 
         bool paused = false;
+        long prefetched = 0; // frames up to this index were already hinted
 
         ///while(index < s->video_frame_count && !s->finish_threads) {
         while(1) {
                 {
                         unique_lock<mutex> lk(s->lock);
-                        while((s->queue_len >= BUFFER_LEN_MAX - 1 || index >= s->video_frame_count || paused)
+                        while((s->queue_len >= s->queue_len_max - 1 || index >= s->video_frame_count || paused)
                                        && s->message_queue.len == 0) {
                                 if (index >= s->video_frame_count) {
                                         s->finished = true;
@@ -957,17 +1352,34 @@ static void * video_reading_thread(void *args)
                         struct video_reader_data *data =
                                 &data_reader[i];
                         data->o_direct = s->o_direct;
-                        data->tile_count = s->video_desc.tile_count;
+                        data->use_mmap = s->use_mmap;
+                        data->pool = s->pool.get();
+                        data->pool_data_len = s->pool_data_len;
+                        data->desc = s->video_desc;
+                        data->directory = s->directory;
+                        data->index = s->index.empty() ? nullptr : &s->index[(index + i) * s->video_desc.tile_count];
                         data->tile_delim = s->tile_delim;
                         snprintf(data->file_name_prefix, sizeof(data->file_name_prefix),
                                         "%s/%08ld", s->directory, index + i + 1);
                         strncpy(data->file_name_suffix,
                                         get_codec_file_extension(s->video_desc.color_spec),
                                         sizeof(data->file_name_suffix));
+                        data->frame_idx = index + i;
                         data->entry = NULL;
+                        data->decoder = s->decoders.empty() ? nullptr : s->decoders.at(i);
+                        data->decode_pool = s->decode_pool.get();
                         task_handle[i] = task_run_async(video_reader_callback, data);
                 }
 
+                if (s->prefetch > 0 && !s->o_direct) {
+                        long ahead = index + number_workers + s->queue_len_max;
+                        if (prefetched < ahead || prefetched > ahead + s->prefetch) { // start or seek
+                                prefetched = ahead;
+                        }
+                        prefetch_frames(s, prefetched, ahead + s->prefetch);
+                        prefetched = ahead + s->prefetch;
+                }
+
                 // wait for workers to finish
                 for (int i = 0; i < number_workers; ++i) {
                         struct video_reader_data *data =
@@ -1029,11 +1441,6 @@ static void reset_import(struct vidcap_import_state *s)
         }
 }
 
-static void vidcap_import_dispose_video_frame(struct video_frame *frame) {
-        free_entry((struct processed_entry *) frame->callbacks.dispose_udata);
-        vf_free(frame);
-}
-
 static struct video_frame *
 vidcap_import_grab(void *state, struct audio_frame **audio)
 {
@@ -1072,14 +1479,9 @@ vidcap_import_grab(void *state, struct audio_frame **audio)
                 lk.unlock();
                 s->worker_cv.notify_one();
 
-                ret = vf_alloc_desc(s->video_desc);
-                ret->callbacks.dispose = vidcap_import_dispose_video_frame;
-                ret->callbacks.dispose_udata = current;
-                for (unsigned int i = 0; i < s->video_desc.tile_count; ++i) {
-                        ret->tiles[i].data_len =
-                                current->tiles[i].data_len;
-                        ret->tiles[i].data = current->tiles[i].data;
-                }
+                ret = current->frame;
+                s->current_frame = current->frame_idx;
+                free(current);
         }
 
         // audio
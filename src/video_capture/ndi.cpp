@@ -64,6 +64,7 @@
 #include "ndi_common.h"
 #include "utils/color_out.h"
 #include "utils/macros.h" // OPTIMIZED_FOR
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_capture.h"
 
@@ -96,6 +97,8 @@ struct vidcap_state_ndi {
         struct video_desc last_desc{};
 
         NDIlib_video_frame_v2_t field_0{}; ///< stored to asssemble interleaved interlaced video together with field 1
+        video_frame_pool pool; ///< for frames that needs to be converted (or fields merged)
+        struct video_desc pool_desc{};
 
         string requested_name; // if not empty recv from requested NDI name
         string requested_url; // if not empty recv from requested URL (either addr or addr:port)
@@ -519,15 +522,18 @@ static struct video_frame *vidcap_ndi_grab(void *state, struct audio_frame **aud
                         s->field_0 = video_frame;
                         return nullptr;
                 }
-                if (video_frame.frame_format_type == NDIlib_frame_format_type_field_1) {
-                        if (convert == nullptr) {
-                                convert = convert_memcpy;
-                        }
+                int stride = video_frame.line_stride_in_bytes != 0 ? video_frame.line_stride_in_bytes : vc_get_linesize(video_frame.xres, out_desc.color_spec);
+                if (convert == nullptr && (video_frame.frame_format_type == NDIlib_frame_format_type_field_1 ||
+                                        (!is_codec_opaque(out_desc.color_spec) && stride != vc_get_linesize(video_frame.xres, out_desc.color_spec)))) {
+                        convert = convert_memcpy; // fields to be merged or padded lines - cannot be passed directly
                 }
 
                 if (convert != nullptr) {
-                        out = vf_alloc_desc_data(out_desc);
-                        int stride = video_frame.line_stride_in_bytes != 0 ? video_frame.line_stride_in_bytes : vc_get_linesize(video_frame.xres, out_desc.color_spec);
+                        if (s->pool_desc != out_desc) {
+                                s->pool.reconfigure(out_desc);
+                                s->pool_desc = out_desc;
+                        }
+                        out = s->pool.get_disposable_frame();
                         int field_count = video_frame.frame_format_type == NDIlib_frame_format_type_field_1 ? 2 : 1;
                         if (field_count > 1) {
                                 if (s->field_0.p_data == nullptr) {
@@ -542,7 +548,6 @@ static struct video_frame *vidcap_ndi_grab(void *state, struct audio_frame **aud
                                 convert(out, video_frame.p_data, stride, 0, 1);
                         }
                         s->NDIlib->recv_free_video_v2(s->pNDI_recv, &video_frame);
-                        out->callbacks.dispose = vf_free;
                 } else {
                         out = vf_alloc_desc(out_desc);
                         out->tiles[0].data = reinterpret_cast<char*>(video_frame.p_data);
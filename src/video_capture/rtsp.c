@@ -69,7 +69,9 @@
 #include "rtp/rtpdec_h264.h"
 #include "rtsp/rtsp_utils.h"
 #include "utils/macros.h"
+#include "utils/list.h"
 #include "utils/text.h" // base64_decode
+#include "utils/video_frame_pool.h"
 #include "video_decompress.h"
 
 #include "pdb.h"
@@ -88,6 +90,10 @@
 //TODO set lower initial video recv buffer size (to find the minimal?)
 #define DEFAULT_VIDEO_FRAME_WIDTH 1920
 #define DEFAULT_VIDEO_FRAME_HEIGHT 1080
+#define MAX_QUEUED_FRAMES 4 ///< frames received while the consumer is busy
+#define MAX_SHARED_STREAMS 256 ///< streams handled by the shared receiving loop
+#define RX_LOOP_TIMEOUT_US 10000
+#define INITIAL_FRAME_CAPACITY (1000 * 1000) ///< initial bitstream buffer size, grown on demand
 #define INITIAL_VIDEO_RECV_BUFFER_SIZE  ((0.1*DEFAULT_VIDEO_FRAME_WIDTH*DEFAULT_VIDEO_FRAME_HEIGHT)*110/100) //command line net.core setup: sysctl -w net.core.rmem_max=9123840
 
 /* error handling macros */
@@ -150,9 +156,6 @@ init_rtsp(struct rtsp_state *s);
 static int
 init_decompressor(struct video_rtsp_state *sr, struct video_desc desc);
 
-static void *
-vidcap_rtsp_thread(void *args);
-
 static void
 show_help(void);
 
@@ -174,7 +177,13 @@ struct video_rtsp_state {
     const char *codec;
 
     struct video_desc desc;
-    struct video_frame *out_frame;
+    struct simple_linked_list *frames; ///< received frames waiting for grab
+    struct video_frame *rx_frame; ///< frame being received (owned by the receiving loop)
+    bool drop_until_intra; ///< consumer was late, frames are dropped until the next intra frame
+    bool in_rx_loop;
+    time_ns_t start_time;
+    void *frame_pool; ///< buffers for the reassembled bitstream
+    size_t frame_capacity; ///< data length of frame_pool frames
 
     //struct std_frame_received *rx_data;
     bool decompress;
@@ -192,13 +201,8 @@ struct video_rtsp_state {
     char *mcast_if;
     int required_connections;
 
-    pthread_t vrtsp_thread_id; //the worker_id
-
     pthread_mutex_t lock;
-    pthread_cond_t worker_cv;
-    volatile bool worker_waiting;
     pthread_cond_t boss_cv;
-    volatile bool boss_waiting;
 
     unsigned int h264_offset_len;
     unsigned char *h264_offset_buffer;
@@ -302,64 +306,158 @@ int decode_frame_by_pt(struct coded_data *cdata, void *decode_data, struct pbuf_
     }
 }
 
-static void *
-vidcap_rtsp_thread(void *arg) {
-    struct rtsp_state *s;
-    s = (struct rtsp_state *) arg;
+/**
+ * Enlarges the frame pool so that a frame of needed bytes fits - the frames
+ * allocated before are freed once returned.
+ */
+static void grow_frame_pool(struct video_rtsp_state *s, size_t needed) {
+    s->frame_capacity = MAX(needed + needed / 2, s->frame_capacity);
+    video_frame_pool_reconfigure(s->frame_pool, s->desc, s->frame_capacity);
+    log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Bitstream buffer size set to %zu B\n", s->frame_capacity);
+}
+
+/**
+ * Runs the depacketizer of the stream and queues the complete frames for
+ * vidcap_rtsp_grab(). Never blocks (the loop is shared by all the streams) -
+ * if the consumer is late, frames are dropped until the next intra frame.
+ */
+static void process_stream(struct rtsp_state *s, time_ns_t curr_time) {
+    struct video_rtsp_state *vs = &s->vrtsp_state;
+    rtp_update(vs->device, curr_time);
+
+    pdb_iter_t it;
+    struct pdb_e *cp = pdb_iter_init(vs->participants, &it);
+    while (cp != NULL) {
+        struct decode_data_h264 d;
+        d.frame = vs->rx_frame;
+        d.offset_len = vs->h264_offset_len;
+        d.video_pt = vs->pt;
+        d.max_len = vs->frame_capacity;
+        d.needed_len = 0;
+        int ret = pbuf_decode(cp->playout_buffer, curr_time,
+                    decode_frame_by_pt, &d);
+        if (!ret && d.needed_len > vs->frame_capacity) {
+            VIDEO_FRAME_DISPOSE(vs->rx_frame);
+            grow_frame_pool(vs, d.needed_len);
+            vs->rx_frame = video_frame_pool_get_disposable_frame(vs->frame_pool);
+        }
+        if (ret && vs->drop_until_intra && vs->rx_frame->frame_type != INTRA) {
+            ret = 0;
+        }
+        if (ret) {
+            pthread_mutex_lock(&vs->lock);
+            if (simple_linked_list_append_if_less(vs->frames, vs->rx_frame, MAX_QUEUED_FRAMES)) {
+                vs->drop_until_intra = false;
+                vs->rx_frame = video_frame_pool_get_disposable_frame(vs->frame_pool);
+                pthread_cond_signal(&vs->boss_cv);
+            } else {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "%s: frame dropped, waiting for intra frame\n", s->uri);
+                vs->drop_until_intra = true;
+            }
+            pthread_mutex_unlock(&vs->lock);
+        }
+        pbuf_remove(cp->playout_buffer, curr_time);
+        cp = pdb_iter_next(&it);
+    }
+    pdb_iter_done(&it);
+}
 
-    time_ns_t start_time = get_time_in_ns();
+/**
+ * @brief Receiving loop shared by all the RTSP capture instances
+ *
+ * A single thread polls the RTP/RTCP sockets of all the streams at once and
+ * runs their depacketizers, so that ingesting many cameras in one process (eg.
+ * with -t aggregate or switcher) doesn't need a receiving thread per camera.
+ * The lock is held for a whole iteration so that a stream can be removed
+ * only in between.
+ */
+static struct rtsp_rx_loop {
+    pthread_mutex_t lock;
+    pthread_t thread;
+    struct rtsp_state *streams[MAX_SHARED_STREAMS];
+    int count;
+    pthread_mutex_t reg_lock; ///< serializes rx_loop_add() and rx_loop_remove() including thread start/join
+} rx_loop = { .lock = PTHREAD_MUTEX_INITIALIZER, .reg_lock = PTHREAD_MUTEX_INITIALIZER };
 
-    struct video_frame *frame = vf_alloc_desc_data(s->vrtsp_state.desc);
+static void *
+rx_loop_thread(void *arg) {
+    UNUSED(arg);
+    struct rtp *sessions[MAX_SHARED_STREAMS + 1];
+
+    pthread_mutex_lock(&rx_loop.lock);
+    while (rx_loop.count > 0) {
+        for (int i = 0; i < rx_loop.count; ++i) {
+            sessions[i] = rx_loop.streams[i]->vrtsp_state.device;
+        }
+        sessions[rx_loop.count] = NULL;
 
-    while (!s->should_exit) {
         time_ns_t curr_time = get_time_in_ns();
-        uint32_t timestamp = (curr_time - start_time) / (100*1000) * 9; // at 90000 Hz
-
-        rtp_update(s->vrtsp_state.device, curr_time);
-
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 10000;
-
-        if (!rtp_recv_r(s->vrtsp_state.device, &timeout, timestamp)) {
-            pdb_iter_t it;
-            struct pdb_e *cp = pdb_iter_init(s->vrtsp_state.participants, &it);
-
-            while (cp != NULL) {
-                struct decode_data_h264 d;
-                d.frame = frame;
-                d.offset_len = s->vrtsp_state.h264_offset_len;
-                d.video_pt = s->vrtsp_state.pt;
-                if (pbuf_decode(cp->playout_buffer, curr_time,
-                            decode_frame_by_pt, &d))
-                {
-                    pthread_mutex_lock(&s->vrtsp_state.lock);
-                    while (s->vrtsp_state.out_frame != NULL && !s->should_exit) {
-                        s->vrtsp_state.worker_waiting = true;
-                        pthread_cond_wait(&s->vrtsp_state.worker_cv, &s->vrtsp_state.lock);
-                        s->vrtsp_state.worker_waiting = false;
-                    }
-                    if (s->vrtsp_state.out_frame == NULL) {
-                        s->vrtsp_state.out_frame = frame;
-                        frame = vf_alloc_desc_data(s->vrtsp_state.desc); // alloc new
-                        if (s->vrtsp_state.boss_waiting)
-                            pthread_cond_signal(&s->vrtsp_state.boss_cv);
-                        pthread_mutex_unlock(&s->vrtsp_state.lock);
-                    } else {
-                        pthread_mutex_unlock(&s->vrtsp_state.lock);
-                    }
-                }
-                pbuf_remove(cp->playout_buffer, curr_time);
-                cp = pdb_iter_next(&it);
-            }
+        struct timeval timeout = { 0, RX_LOOP_TIMEOUT_US };
+        // RTP timestamp of the RTCP RR, common for all the streams
+        rtp_recv_poll_r(sessions, &timeout, (curr_time - rx_loop.streams[0]->vrtsp_state.start_time) / (100*1000) * 9);
 
-            pdb_iter_done(&it);
+        curr_time = get_time_in_ns();
+        for (int i = 0; i < rx_loop.count; ++i) {
+            process_stream(rx_loop.streams[i], curr_time);
         }
+
+        pthread_mutex_unlock(&rx_loop.lock);
+        pthread_mutex_lock(&rx_loop.lock); // give (un)registration a chance
     }
-    vf_free(frame);
+    pthread_mutex_unlock(&rx_loop.lock);
     return NULL;
 }
 
+static bool rx_loop_add(struct rtsp_state *s) {
+    struct video_rtsp_state *vs = &s->vrtsp_state;
+    vs->start_time = get_time_in_ns();
+    grow_frame_pool(vs, MAX(vs->desc.width * vs->desc.height, INITIAL_FRAME_CAPACITY));
+    vs->rx_frame = video_frame_pool_get_disposable_frame(vs->frame_pool);
+
+    pthread_mutex_lock(&rx_loop.reg_lock);
+    pthread_mutex_lock(&rx_loop.lock);
+    if (rx_loop.count == MAX_SHARED_STREAMS) {
+        pthread_mutex_unlock(&rx_loop.lock);
+        pthread_mutex_unlock(&rx_loop.reg_lock);
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "At most %d RTSP streams are supported!\n", MAX_SHARED_STREAMS);
+        VIDEO_FRAME_DISPOSE(vs->rx_frame);
+        vs->rx_frame = NULL;
+        return false;
+    }
+    rx_loop.streams[rx_loop.count++] = s;
+    if (rx_loop.count == 1) {
+        pthread_create(&rx_loop.thread, NULL, rx_loop_thread, NULL);
+    }
+    vs->in_rx_loop = true;
+    int count = rx_loop.count;
+    pthread_mutex_unlock(&rx_loop.lock);
+    pthread_mutex_unlock(&rx_loop.reg_lock);
+    log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "%s added to the receiving loop (%d streams)\n", s->uri, count);
+    return true;
+}
+
+static void rx_loop_remove(struct rtsp_state *s) {
+    if (!s->vrtsp_state.in_rx_loop) {
+        return;
+    }
+    pthread_mutex_lock(&rx_loop.reg_lock);
+    pthread_mutex_lock(&rx_loop.lock);
+    for (int i = 0; i < rx_loop.count; ++i) {
+        if (rx_loop.streams[i] == s) {
+            rx_loop.streams[i] = rx_loop.streams[--rx_loop.count];
+            break;
+        }
+    }
+    bool last = rx_loop.count == 0;
+    pthread_mutex_unlock(&rx_loop.lock);
+    if (last) {
+        pthread_join(rx_loop.thread, NULL);
+    }
+    pthread_mutex_unlock(&rx_loop.reg_lock);
+    s->vrtsp_state.in_rx_loop = false;
+    VIDEO_FRAME_DISPOSE(s->vrtsp_state.rx_frame);
+}
+
 /**
  * This is not mandatory and is merely an optimization - we can emit PPS/SPS
  * early (otherwise it is prepended only to IDR frames). The aim is to allow
@@ -392,7 +490,7 @@ vidcap_rtsp_grab(void *state, struct audio_frame **audio) {
 
     if(pthread_mutex_trylock(&s->vrtsp_state.lock)==0){
         {
-            while (s->vrtsp_state.out_frame == NULL && !s->should_exit) {
+            while (simple_linked_list_size(s->vrtsp_state.frames) == 0 && !s->should_exit) {
                 struct timeval  tp;
                 gettimeofday(&tp, NULL);
                 struct timespec timeout = { .tv_sec = tp.tv_sec, .tv_nsec = (tp.tv_usec + 100*1000) * 1000 };
@@ -400,12 +498,10 @@ vidcap_rtsp_grab(void *state, struct audio_frame **audio) {
                     timeout.tv_nsec -= 1000L*1000*1000;
                     timeout.tv_sec += 1;
                 }
-                s->vrtsp_state.boss_waiting = true;
                 if (pthread_cond_timedwait(&s->vrtsp_state.boss_cv, &s->vrtsp_state.lock, &timeout) == ETIMEDOUT) {
                     pthread_mutex_unlock(&s->vrtsp_state.lock);
                     return NULL;
                 }
-                s->vrtsp_state.boss_waiting = false;
             }
 
             if (s->should_exit) {
@@ -413,10 +509,8 @@ vidcap_rtsp_grab(void *state, struct audio_frame **audio) {
                 return NULL;
             }
 
-            struct video_frame *frame = s->vrtsp_state.out_frame;
-            s->vrtsp_state.out_frame = NULL;
+            struct video_frame *frame = simple_linked_list_pop(s->vrtsp_state.frames);
             pthread_mutex_unlock(&s->vrtsp_state.lock);
-            pthread_cond_signal(&s->vrtsp_state.worker_cv);
 
             if(s->vrtsp_state.h264_offset_len>0 && frame->frame_type == INTRA){
                     memcpy(frame->tiles[0].data, s->vrtsp_state.h264_offset_buffer, s->vrtsp_state.h264_offset_len);
@@ -440,10 +534,10 @@ vidcap_rtsp_grab(void *state, struct audio_frame **audio) {
                 decompress_frame(s->vrtsp_state.sd, (unsigned char *) decompressed->tiles[0].data,
                     (unsigned char *) frame->tiles[0].data,
                     frame->tiles[0].data_len, 0, NULL, NULL);
-                vf_free(frame);
+                VIDEO_FRAME_DISPOSE(frame);
                 frame = decompressed;
+                frame->callbacks.dispose = vf_free;
             }
-            frame->callbacks.dispose = vf_free;
             return frame;
         }
     } else {
@@ -507,7 +601,7 @@ vidcap_rtsp_init(struct vidcap_params *params, void **state) {
     pthread_cond_init(&s->keepalive_cv, NULL);
     pthread_mutex_init(&s->vrtsp_state.lock, NULL);
     pthread_cond_init(&s->vrtsp_state.boss_cv, NULL);
-    pthread_cond_init(&s->vrtsp_state.worker_cv, NULL);
+    s->vrtsp_state.frames = simple_linked_list_init();
 
     char *tmp, *item;
     fmt = strdup(vidcap_params_get_fmt(params));
@@ -616,9 +710,6 @@ vidcap_rtsp_init(struct vidcap_params *params, void **state) {
 
     s->should_exit = FALSE;
 
-    s->vrtsp_state.boss_waiting = false;
-    s->vrtsp_state.worker_waiting = false;
-
     if (s->vrtsp_state.decompress) {
         struct video_desc decompress_desc = s->vrtsp_state.desc;
         decompress_desc.color_spec = H264;
@@ -628,7 +719,11 @@ vidcap_rtsp_init(struct vidcap_params *params, void **state) {
         }
     }
 
-    pthread_create(&s->vrtsp_state.vrtsp_thread_id, NULL, vidcap_rtsp_thread, s);
+    s->vrtsp_state.frame_pool = video_frame_pool_init(s->vrtsp_state.desc, 0);
+    if (!rx_loop_add(s)) {
+        vidcap_rtsp_done(s);
+        return VIDCAP_INIT_FAIL;
+    }
     pthread_create(&s->keep_alive_rtsp_thread_id, NULL, keep_alive_thread, s);
 
     verbose_msg("[rtsp] rtsp capture init done\n");
@@ -1047,11 +1142,8 @@ vidcap_rtsp_done(void *state) {
     pthread_mutex_unlock(&s->lock);
 
     pthread_cond_signal(&s->keepalive_cv);
-    pthread_cond_signal(&s->vrtsp_state.worker_cv);
 
-    if (s->vrtsp_state.vrtsp_thread_id) {
-        pthread_join(s->vrtsp_state.vrtsp_thread_id, NULL);
-    }
+    rx_loop_remove(s);
     if (s->keep_alive_rtsp_thread_id) {
         pthread_join(s->keep_alive_rtsp_thread_id, NULL);
     }
@@ -1064,7 +1156,14 @@ vidcap_rtsp_done(void *state) {
     }
 
     if(s->vrtsp_state.h264_offset_buffer!=NULL) free(s->vrtsp_state.h264_offset_buffer);
-    vf_free(s->vrtsp_state.out_frame);
+    struct video_frame *f = NULL;
+    while (s->vrtsp_state.frames != NULL && (f = simple_linked_list_pop(s->vrtsp_state.frames)) != NULL) {
+        VIDEO_FRAME_DISPOSE(f);
+    }
+    simple_linked_list_destroy(s->vrtsp_state.frames);
+    if (s->vrtsp_state.frame_pool != NULL) {
+        video_frame_pool_destroy(s->vrtsp_state.frame_pool);
+    }
     free(s->vrtsp_state.control);
     free(s->artsp_state.control);
 
@@ -1078,7 +1177,6 @@ vidcap_rtsp_done(void *state) {
     pthread_cond_destroy(&s->keepalive_cv);
     pthread_mutex_destroy(&s->vrtsp_state.lock);
     pthread_cond_destroy(&s->vrtsp_state.boss_cv);
-    pthread_cond_destroy(&s->vrtsp_state.worker_cv);
 
     free(s);
 }
@@ -21,7 +21,9 @@
 #include "utils/synchronized_queue.h"
 #include "debug.h"
 #include "lib_common.h"
+#include "pixfmt_conv.h"
 #include "utils/color_out.h"
+#include "utils/parallel_conv.h"
 #include "video.h"
 #include "video_capture.h"
 
@@ -58,6 +60,8 @@ static constexpr int MIN_BUFFERS_PW = 2;
 static constexpr int MAX_BUFFERS_PW = 10;
 static constexpr int QUEUE_SIZE = 3;
 static constexpr int DEFAULT_EXPECTING_FPS = 30;
+static constexpr int MAX_DAMAGE_REGIONS = 16;
+static constexpr uint64_t DEFAULT_DAMAGE_KEEPALIVE_MS = 1000;
 
 struct request_path_t {
         std::string token;
@@ -308,8 +312,11 @@ struct screen_cast_session {
                 std::string restore_file = "";
                 uint32_t fps = 0;
                 bool crop = true;
+                uint64_t damage_keepalive_ms = 0; ///< skip unchanged frames if nonzero, send at least one per this interval
         } user_options;
 
+        uint64_t last_sent_ms = 0; ///< time of the last passed frame (damage tracking)
+
         std::unique_ptr<ScreenCastPortal> portal;
 
         // empty string if no error occured, or an error message
@@ -445,6 +452,17 @@ static void on_stream_param_changed(void *session_ptr, uint32_t id, const struct
                         SPA_POD_Int(sizeof(struct spa_meta_region)))
                 );
         }
+
+        if (session.user_options.damage_keepalive_ms > 0) {
+                params[n_params++] = static_cast<spa_pod *>(spa_pod_builder_add_object(&builder,
+                        SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
+                        SPA_PARAM_META_type, SPA_POD_Id(SPA_META_VideoDamage),
+                        SPA_PARAM_META_size, SPA_POD_CHOICE_RANGE_Int(
+                                sizeof(struct spa_meta_region) * MAX_DAMAGE_REGIONS,
+                                sizeof(struct spa_meta_region) * 1,
+                                sizeof(struct spa_meta_region) * MAX_DAMAGE_REGIONS))
+                );
+        }
         
         pw_stream_update_params(session.pw.stream, params, n_params);
 
@@ -455,64 +473,29 @@ static void on_stream_param_changed(void *session_ptr, uint32_t id, const struct
 }
 
 
-static void copy_frame_impl_cropped(bool swap_red_blue, char *dest, char *src, 
-        int actual_width, int actual_height, int x_begin, int y_begin, int crop_width, int crop_height) 
-{
-        UNUSED(actual_height);
-        SCOPE_STOPWATCH(copy_frame_impl_cropped);
-        
-        for(int y = y_begin; y < crop_height; ++y){
-                int line_offset_src = 4 * y * actual_width;
-                int line_offset_dest = 4 * y * crop_width;     
-                if (swap_red_blue) {
-                        for(int x = x_begin; x < crop_width; ++x) {
-                                int x_offset = 4 * x;
-                                // rgba <- bgra    
-                                dest[line_offset_dest + x_offset    ] = src[line_offset_src + x_offset + 2];
-                                dest[line_offset_dest + x_offset + 1] = src[line_offset_src + x_offset + 1];
-                                dest[line_offset_dest + x_offset + 2] = src[line_offset_src + x_offset    ];
-                                dest[line_offset_dest + x_offset + 3] = src[line_offset_src + x_offset + 3];
-                        }
-                } else {
-                        memcpy(dest+line_offset_dest, src + line_offset_src + 4 * x_begin, crop_width * 4);
-                }
-        }
-}
-
-static void copy_frame_impl(bool swap_red_blue, char *dest, char *src, int width, int height)
+/// BGRA/BGRx to RGBA line conversion (decoder_t interface, shifts are ignored)
+static void copyline_bgra_to_rgba(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len,
+                int /* rshift */, int /* gshift */, int /* bshift */)
 {
-        SCOPE_STOPWATCH(copy_frame_impl);
-        int linesize = vc_get_linesize(width, RGBA);
-        if (swap_red_blue) {
-                for (int line_offset = 0; line_offset < height * linesize; line_offset += linesize) {
-                        for(int x = 0; x < linesize; x += 4) {
-                                // rgba <- bgra
-                                dest[line_offset + x    ] = src[line_offset + x + 2];
-                                dest[line_offset + x + 1] = src[line_offset + x + 1];
-                                dest[line_offset + x + 2] = src[line_offset + x    ];
-                                dest[line_offset + x + 3] = src[line_offset + x + 3];
-                        }
-                }
-        } else {
-                memcpy(dest, src, height * linesize);
-        }
+        vc_copylineRGBA(dst, src, dst_len, 16, 8, 0);
 }
 
+/**
+ * Copies (and converts if needed) the PipeWire buffer to the output frame in
+ * parallel bands. The buffer stride is honored, crop region (if given) is
+ * cut out of the buffer.
+ */
 static void copy_frame(spa_video_format video_format, spa_buffer *buffer, video_frame_wrapper& output_frame, int session_width, int session_height, spa_region *crop_region = nullptr){
+        SCOPE_STOPWATCH(copy_frame);
         bool swap_red_blue = video_format == SPA_VIDEO_FORMAT_BGRA || video_format == SPA_VIDEO_FORMAT_BGRx;
 
-        if (crop_region != nullptr) {
-            copy_frame_impl_cropped(swap_red_blue, output_frame->tiles[0].data,static_cast<char *>(buffer->datas[0].data),
-                                    session_width, session_height,
-                                    crop_region->position.x, crop_region->position.y,
-                                    static_cast<int>(crop_region->size.width), static_cast<int>(crop_region->size.height));
-        } else {
-                copy_frame_impl(swap_red_blue, output_frame->tiles[0].data, static_cast<char*>(buffer->datas[0].data), session_width, session_height);
-        }
-        
         struct tile *tile = vf_get_tile(output_frame.get(), 0);
         assert(tile != nullptr);
+        int x_begin = 0;
+        int y_begin = 0;
         if (crop_region != nullptr){
+                x_begin = crop_region->position.x;
+                y_begin = crop_region->position.y;
                 tile->width = crop_region->size.width;
                 tile->height = crop_region->size.height;
         }else{
@@ -520,7 +503,34 @@ static void copy_frame(spa_video_format video_format, spa_buffer *buffer, video_
                 tile->height = session_height;
         }
 
-        tile->data_len = vc_get_linesize(tile->width, RGBA) * tile->height;
+        const int src_linesize = buffer->datas[0].chunk->stride > 0 ? buffer->datas[0].chunk->stride
+                : vc_get_linesize(session_width, RGBA);
+        const char *src = static_cast<char *>(buffer->datas[0].data) + y_begin * src_linesize + 4 * x_begin;
+        const int dst_linesize = vc_get_linesize(tile->width, RGBA);
+        static const int threads = std::max<int>(std::thread::hardware_concurrency(), 1);
+        parallel_pix_conv(tile->height, tile->data, dst_linesize, src, src_linesize,
+                        swap_red_blue ? copyline_bgra_to_rgba : vc_memcpy, threads);
+
+        tile->data_len = dst_linesize * tile->height;
+}
+
+/**
+ * @returns false if the buffer carries damage metadata with no damaged
+ * region (the content is the same as in the previous buffer), true otherwise
+ */
+static bool buffer_damaged(spa_buffer *buffer)
+{
+        spa_meta *damage = spa_buffer_find_meta(buffer, SPA_META_VideoDamage);
+        if (damage == nullptr) {
+                return true;
+        }
+        spa_meta_region *region = nullptr;
+        spa_meta_for_each(region, damage) {
+                if (spa_meta_region_is_valid(region)) {
+                        return true;
+                }
+        }
+        return false;
 }
 
 static void on_process(void *session_ptr) {
@@ -546,6 +556,13 @@ static void on_process(void *session_ptr) {
                         continue;
                 }
 
+                if (session.user_options.damage_keepalive_ms > 0 && !buffer_damaged(buffer->buffer)
+                                && time_since_epoch_in_ms() - session.last_sent_ms < session.user_options.damage_keepalive_ms) {
+                        LOG(LOG_LEVEL_DEBUG) << "[screen_pw]: dropping - unchanged frame\n";
+                        pw_stream_queue_buffer(session.pw.stream, buffer);
+                        continue;
+                }
+
                 if(!session.blank_frames.timed_pop(next_frame, 1000ms / session.pw.expecting_fps)) {
                         LOG(LOG_LEVEL_DEBUG) << "[screen_pw]: dropping frame (blank frame dequeue timed out)\n";
                         pw_stream_queue_buffer(session.pw.stream, buffer);
@@ -565,6 +582,7 @@ static void on_process(void *session_ptr) {
                 
                 ++session.pw.frame_count;
                 uint64_t time_now = time_since_epoch_in_ms();
+                session.last_sent_ms = time_now;
 
                 uint64_t delta = time_now - session.pw.frame_counter_begin_time;
                 if(delta >= 5000) {
@@ -875,11 +893,12 @@ static void show_help() {
         };
 
         std::cout << "Screen capture using PipeWire and ScreenCast freedesktop portal API\n";
-        std::cout << "Usage: -t screen_pw[:cursor|:nocrop|:fps=<fps>|:restore=<token_file>]]\n";
+        std::cout << "Usage: -t screen_pw[:cursor|:nocrop|:fps=<fps>|:restore=<token_file>|:damage[=<keepalive_ms>]]\n";
         param("cursor") << "make the cursor visible (default hidden)\n";
         param("nocrop") << "when capturing a window do not crop out the empty background\n";
         param("<fps>") << "prefered FPS passed to PipeWire (PipeWire may ignore it)\n";
         param("<token_file>") << "restore the selected window/display from a file.\n\t\tIf not possible, display the selection dialog and save the token to the file specified.\n";
+        param("damage") << "skip frames that PipeWire reports as unchanged (damage metadata), send\n\t\tat least one frame per <keepalive_ms> (default " << DEFAULT_DAMAGE_KEEPALIVE_MS << ")\n";
 }
 
 
@@ -896,6 +915,8 @@ static int parse_params(struct vidcap_params *params, screen_cast_session &sessi
                                 session.user_options.show_cursor = true;
                         } else if (param == "nocrop") {
                                 session.user_options.crop = false;
+                        } else if (param == "damage") {
+                                session.user_options.damage_keepalive_ms = DEFAULT_DAMAGE_KEEPALIVE_MS;
                         } else {
                                 auto split_index = param.find('=');
                                 if(split_index != std::string::npos && split_index != 0){
@@ -909,6 +930,10 @@ static int parse_params(struct vidcap_params *params, screen_cast_session &sessi
                                         }else if(name == "restore"){
                                                 session.user_options.restore_file = value;
                                                 continue;
+                                        } else if (name == "damage") {
+                                                std::istringstream is(value);
+                                                is >> session.user_options.damage_keepalive_ms;
+                                                continue;
                                         }
                                 }
 
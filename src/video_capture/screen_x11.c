@@ -37,6 +37,12 @@
 /**
  * @todo
  * The XGetImage() is a bit slow, consider using XShm as OBS does.
+ *
+ * With the damage option, unchanged frames are not passed further (and so
+ * neither compressed nor sent), the receiver keeps displaying the last one.
+ * The changes are detected with XDamage if available (the unchanged screen
+ * isn't even read), otherwise by comparing the grabbed image with the
+ * previous one.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -60,16 +66,22 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
+#include <unistd.h>
 
 #include <X11/Xlib.h>
 #ifdef HAVE_XFIXES
 #include <X11/extensions/Xfixes.h>
 #endif // HAVE_XFIXES
+#ifdef HAVE_XDAMAGE
+#include <X11/extensions/Xdamage.h>
+#endif // HAVE_XDAMAGE
 #include <X11/Xutil.h>
 
 #define MOD_NAME "[screen capture] "
 #define QUEUE_SIZE_MAX 3
+#define DEFAULT_DAMAGE_KEEPALIVE_MS 1000
 
 /* prototypes of functions defined in this module */
 static void show_help(void);
@@ -79,10 +91,18 @@ static void show_help()
 {
         printf("Screen capture\n");
         printf("Usage\n");
-        printf("\t-t screen[:fps=<fps>][:display=<d>][:geometry=WxH[+x[+y]]|:size=WxH]\n");
+        printf("\t-t screen[:fps=<fps>][:display=<d>][:geometry=WxH[+x[+y]]|:size=WxH][:damage[=<keepalive_ms>]]\n");
         printf("\t\t<fps> - preferred grabbing fps (otherwise unlimited)\n");
         printf("\t\tdisplay - display to capture (including the colon!)\n");
         printf("\t\tgeomoetry | size - viewport to use (both option mean the same - size is just a convenient name)\n");
+        printf("\t\tdamage - skip unchanged frames, send at least one per <keepalive_ms> (default %d)%s\n",
+                        DEFAULT_DAMAGE_KEEPALIVE_MS,
+#ifdef HAVE_XDAMAGE
+                        ""
+#else
+                        ", compiled without XDamage - frames are compared"
+#endif
+                        );
 }
 
 struct grabbed_data;
@@ -121,6 +141,18 @@ struct vidcap_screen_x11_state {
         bool initialized;
         int cpu_count;
         char *req_display;
+
+        unsigned damage_keepalive_ms; ///< skip unchanged frames if nonzero, pass at least one per this interval
+        struct timeval last_changed;  ///< (worker) time of the last passed frame
+#ifdef HAVE_XDAMAGE
+        Damage damage;
+        int damage_event_base;
+        int cursor_x, cursor_y;
+        unsigned long cursor_serial;
+#else
+        char *prev_image;             ///< (worker) copy of the last passed image to compare with
+        size_t prev_image_len;
+#endif // HAVE_XDAMAGE
 };
 
 static bool initialize(struct vidcap_screen_x11_state *s) {
@@ -170,25 +202,111 @@ static bool initialize(struct vidcap_screen_x11_state *s) {
 
         s->tile->data = (char *) malloc(s->tile->data_len);
 
+#ifdef HAVE_XDAMAGE
+        int damage_error_base = 0;
+        if (s->damage_keepalive_ms > 0) {
+                if (XDamageQueryExtension(s->dpy, &s->damage_event_base, &damage_error_base)) {
+                        s->damage = XDamageCreate(s->dpy, s->root, XDamageReportNonEmpty);
+                } else {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "XDamage extension not available, not skipping unchanged frames.\n");
+                        s->damage_keepalive_ms = 0;
+                }
+        }
+#endif // HAVE_XDAMAGE
+
         pthread_create(&s->worker_id, NULL, grab_thread, s);
 
         return true;
 }
 
 
+#ifdef HAVE_XDAMAGE
+/// @returns true if the captured viewport was damaged since the last call
+static bool viewport_damaged(struct vidcap_screen_x11_state *s)
+{
+        bool notified = false;
+        while (XPending(s->dpy) > 0) {
+                XEvent ev;
+                XNextEvent(s->dpy, &ev);
+                notified = notified || ev.type == s->damage_event_base + XDamageNotify;
+        }
+        if (!notified) {
+                return false;
+        }
+        XserverRegion parts = XFixesCreateRegion(s->dpy, NULL, 0);
+        XDamageSubtract(s->dpy, s->damage, None, parts);
+        int count = 0;
+        XRectangle *rects = XFixesFetchRegion(s->dpy, parts, &count);
+        bool damaged = false;
+        for (int i = 0; i < count && !damaged; ++i) {
+                damaged = rects[i].x < s->x + (int) s->tile->width && rects[i].x + rects[i].width > s->x &&
+                        rects[i].y < s->y + (int) s->tile->height && rects[i].y + rects[i].height > s->y;
+        }
+        if (rects != NULL) {
+                XFree(rects);
+        }
+        XFixesDestroyRegion(s->dpy, parts);
+        return damaged;
+}
+#else
+/// @returns true if the image differs from the previous one (which is then replaced)
+static bool image_changed(struct vidcap_screen_x11_state *s, const XImage *img)
+{
+        size_t len = (size_t) img->bytes_per_line * img->height;
+        if (s->prev_image_len == len && memcmp(s->prev_image, img->data, len) == 0) {
+                return false;
+        }
+        if (s->prev_image_len != len) {
+                free(s->prev_image);
+                s->prev_image = malloc(len);
+                s->prev_image_len = len;
+        }
+        memcpy(s->prev_image, img->data, len);
+        return true;
+}
+#endif // HAVE_XDAMAGE
+
 static void *grab_thread(void *args)
 {
         struct vidcap_screen_x11_state *s = args;
 
         while(!s->should_exit_worker) {
                 struct grabbed_data *new_item = malloc(sizeof(struct grabbed_data));
+                new_item->data = NULL;
 
 #ifdef HAVE_XFIXES
                 XFixesCursorImage *cursor =
                         XFixesGetCursorImage (s->dpy);
 #endif // HAVE_XFIXES
-                new_item->data = XGetImage(s->dpy,s->root, s->x, s->y, s->tile->width, s->tile->height, AllPlanes, ZPixmap);
-                assert(new_item->data != NULL);
+                bool changed = true;
+                bool skip_grab = false;
+                struct timeval now = { 0, 0 };
+                if (s->damage_keepalive_ms > 0) {
+                        gettimeofday(&now, NULL);
+                        changed = tv_diff_usec(now, s->last_changed) >= s->damage_keepalive_ms * 1000.0;
+#ifdef HAVE_XDAMAGE
+                        changed = viewport_damaged(s) || changed;
+                        if (cursor) { // cursor is not a part of the damage
+                                changed = changed || cursor->x != s->cursor_x || cursor->y != s->cursor_y
+                                        || cursor->cursor_serial != s->cursor_serial;
+                                s->cursor_x = cursor->x;
+                                s->cursor_y = cursor->y;
+                                s->cursor_serial = cursor->cursor_serial;
+                        }
+                        if (!changed) {
+                                if (cursor) {
+                                        XFree(cursor);
+                                        cursor = NULL;
+                                }
+                                skip_grab = true;
+                                usleep(1000000 / s->frame->fps);
+                        }
+#endif // HAVE_XDAMAGE
+                }
+                if (!skip_grab) {
+                        new_item->data = XGetImage(s->dpy,s->root, s->x, s->y, s->tile->width, s->tile->height, AllPlanes, ZPixmap);
+                        assert(new_item->data != NULL);
+                }
 
 #ifdef HAVE_XFIXES
                 if (cursor) {
@@ -222,6 +340,15 @@ static void *grab_thread(void *args)
                         XFree(cursor);
                 }
 #endif // HAVE_XFIXES
+#ifndef HAVE_XDAMAGE
+                if (s->damage_keepalive_ms > 0 && !image_changed(s, new_item->data) && !changed) {
+                        XDestroyImage(new_item->data);
+                        new_item->data = NULL;
+                }
+#endif // ! HAVE_XDAMAGE
+                if (s->damage_keepalive_ms > 0 && new_item->data != NULL) {
+                        s->last_changed = now;
+                }
 
                 new_item->next = NULL;
 
@@ -297,6 +424,12 @@ static _Bool parse_fmt(struct vidcap_screen_x11_state *s, char *fmt) {
                         s->req_display = realloc(s->req_display, strlen(s->req_display) + 1 + strlen(tok) + 1);
                         strcat(s->req_display, ":");
                         strcat(s->req_display, tok);
+                } else if (strcmp(tok, "damage") == 0 || strstr(tok, "damage=") == tok) {
+                        s->damage_keepalive_ms = strchr(tok, '=') != NULL ? atoi(strchr(tok, '=') + 1) : DEFAULT_DAMAGE_KEEPALIVE_MS;
+                        if (s->damage_keepalive_ms == 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong keepalive interval: %s\n", tok);
+                                return 0;
+                        }
                 } else if (strstr(tok, "geometry=") == tok || strstr(tok, "size=") == tok) {
                         char *val = strchr(tok, '=') + 1;
                         s->width = atoi(val);
@@ -395,7 +528,9 @@ static void vidcap_screen_x11_done(void *state)
                 while(s->queue_len > 0) {
                         struct grabbed_data *item = s->head;
                         s->head = s->head->next;
-                        XDestroyImage(item->data);
+                        if (item->data != NULL) {
+                                XDestroyImage(item->data);
+                        }
                         free(item);
                         s->queue_len -= 1;
                 }
@@ -405,6 +540,14 @@ static void vidcap_screen_x11_done(void *state)
         if(s->tile)
                 free(s->tile->data);
 
+#ifdef HAVE_XDAMAGE
+        if (s->damage) {
+                XDamageDestroy(s->dpy, s->damage);
+        }
+#else
+        free(s->prev_image);
+#endif // HAVE_XDAMAGE
+
         vf_free(s->frame);
         free(s->req_display);
         free(s);
@@ -445,6 +588,11 @@ static struct video_frame * vidcap_screen_x11_grab(void *state, struct audio_fra
         }
         pthread_mutex_unlock(&s->lock);
 
+        if (item->data == NULL) { // unchanged
+                free(item);
+                return NULL;
+        }
+
         /*
          * The more correct way is to use X pixel accessor (XGetPixel) as in previous version
          * Unfortunatelly, this approach is damn slow. Current approach might be incorrect in
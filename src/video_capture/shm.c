@@ -0,0 +1,166 @@
+/**
+ * @file   video_capture/shm.c
+ *
+ * Captures frames published by "-d shm" of another UltraGrid process on the
+ * same host. The frames point directly to the shared memory and the slot is
+ * held until the frame is disposed.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "lib_common.h"
+#include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
+#include "utils/shm_bus.h"
+#include "video.h"
+#include "video_capture.h"
+#include "video_capture_params.h"
+
+#define MOD_NAME "[shm cap.] "
+#define WAIT_MS 100
+
+struct state_vidcap_shm {
+        char name[NAME_MAX];
+        struct shm_bus *bus;
+        uint32_t last_seq;
+        bool waiting_reported;
+};
+
+static void usage() {
+        color_printf("Capture " TBOLD("shm") " grabs frames published by " TBOLD("-d shm") " of another "
+                        "UltraGrid process on this host without copying them.\n\n");
+        struct key_val options[] = {
+                { "name=<name>", "name of the segment (default \"" SHM_BUS_DEFAULT_NAME "\")" },
+                { NULL, NULL }
+        };
+        print_module_usage("-t shm", options, NULL, 0);
+}
+
+static int vidcap_shm_init(struct vidcap_params *params, void **state)
+{
+        if (vidcap_params_get_flags(params) & VIDCAP_FLAG_AUDIO_ANY) {
+                return VIDCAP_INIT_AUDIO_NOT_SUPPOTED;
+        }
+        const char *fmt = vidcap_params_get_fmt(params);
+        if (strcmp(fmt, "help") == 0) {
+                usage();
+                return VIDCAP_INIT_NOERR;
+        }
+        struct state_vidcap_shm *s = calloc(1, sizeof *s);
+        snprintf(s->name, sizeof s->name, "%s", SHM_BUS_DEFAULT_NAME);
+
+        char *ccpy = strdup(fmt);
+        char *tmp = ccpy;
+        char *item = NULL;
+        char *save_ptr = NULL;
+        while ((item = strtok_r(tmp, ":", &save_ptr)) != NULL) {
+                tmp = NULL;
+                if (strstr(item, "name=") == item) {
+                        snprintf(s->name, sizeof s->name, "%s", strchr(item, '=') + 1);
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unrecognized option: %s\n", item);
+                        free(ccpy);
+                        free(s);
+                        return VIDCAP_INIT_FAIL;
+                }
+        }
+        free(ccpy);
+        *state = s;
+        return VIDCAP_INIT_OK;
+}
+
+static void vidcap_shm_done(void *state)
+{
+        struct state_vidcap_shm *s = state;
+        shm_bus_destroy(s->bus);
+        free(s);
+}
+
+static struct video_frame *vidcap_shm_grab(void *state, struct audio_frame **audio)
+{
+        struct state_vidcap_shm *s = state;
+        *audio = NULL;
+        if (s->bus == NULL) {
+                s->bus = shm_bus_open(s->name);
+                if (s->bus == NULL) {
+                        if (!s->waiting_reported) {
+                                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Waiting for segment \"%s\" to be created...\n", s->name);
+                                s->waiting_reported = true;
+                        }
+                        usleep(WAIT_MS * 1000);
+                        return NULL;
+                }
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Opened segment \"%s\".\n", s->name);
+                s->waiting_reported = false;
+                s->last_seq = 0;
+        }
+        int slot = shm_bus_wait(s->bus, &s->last_seq, WAIT_MS);
+        if (slot == SHM_BUS_CLOSED || (slot == SHM_BUS_TIMEOUT && shm_bus_is_stale(s->bus))) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Segment closed by the writer, reopening.\n");
+                shm_bus_destroy(s->bus);
+                s->bus = NULL;
+                return NULL;
+        }
+        if (slot < 0) {
+                return NULL;
+        }
+        return shm_bus_take_frame(s->bus, slot);
+}
+
+static void vidcap_shm_probe(struct device_info **available_cards, int *count, void (**deleter)(void *))
+{
+        *deleter = free;
+        *available_cards = NULL;
+        *count = 0;
+}
+
+static const struct video_capture_info vidcap_shm_info = {
+        vidcap_shm_probe,
+        vidcap_shm_init,
+        vidcap_shm_done,
+        vidcap_shm_grab,
+        MOD_NAME,
+};
+
+REGISTER_MODULE(shm, &vidcap_shm_info, LIBRARY_CLASS_VIDEO_CAPTURE, VIDEO_CAPTURE_ABI_VERSION);
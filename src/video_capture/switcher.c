@@ -49,6 +49,7 @@
 
 #include "audio/types.h"
 #include "module.h"
+#include "utils/vidcap_grabber.h"
 
 #include <inttypes.h>
 #include <limits.h>
@@ -56,6 +57,7 @@
 #include <stdlib.h>
 
 #define MOD_NAME "[switcher] "
+#define GRAB_TIMEOUT_NS (NS_IN_SEC / 2)
 
 /* prototypes of functions defined in this module */
 static void show_help(void);
@@ -74,7 +76,9 @@ static void show_help()
 struct vidcap_switcher_state {
         struct module       mod;
         struct vidcap     **devices;
+        struct vidcap_grabber **grabbers; ///< grabbing threads of all devices if not excl_init
         unsigned int        devices_cnt;
+        int                 held_device; ///< device the last returned frame was taken from (or -1)
 
         unsigned int        selected_device;
 
@@ -190,6 +194,19 @@ vidcap_switcher_init(struct vidcap_params *params, void **state)
                 }
         }
 
+        if (!s->excl_init) {
+                // inactive devices are kept grabbing to allow instant switching
+                s->grabbers = calloc(s->devices_cnt, sizeof(struct vidcap_grabber *));
+                for (unsigned int i = 0; i < s->devices_cnt; ++i) {
+                        char name[32];
+                        snprintf(name, sizeof name, "switcher%u", i);
+                        if ((s->grabbers[i] = vidcap_grabber_start(s->devices[i], name)) == NULL) {
+                                goto error;
+                        }
+                        vidcap_grabber_set_keep_warm(s->grabbers[i], i != s->selected_device);
+                }
+        }
+        s->held_device = -1;
         s->params = params;
 
         module_init_default(&s->mod);
@@ -202,6 +219,12 @@ vidcap_switcher_init(struct vidcap_params *params, void **state)
 	return VIDCAP_INIT_OK;
 
 error:
+        if (s->grabbers) {
+                for (unsigned int i = 0U; i < s->devices_cnt; ++i) {
+                        vidcap_grabber_stop(s->grabbers[i]);
+                }
+                free(s->grabbers);
+        }
         if(s->devices) {
                 for (unsigned int i = 0U; i < s->devices_cnt; ++i) {
                         if(s->devices[i]) {
@@ -222,12 +245,17 @@ vidcap_switcher_done(void *state)
 
 	if (s != NULL) {
 		for (unsigned int i = 0U; i < s->devices_cnt; ++i) {
+                        if (s->grabbers) {
+                                vidcap_grabber_stop(s->grabbers[i]);
+                        }
                         if (!s->excl_init || i == s->selected_device) {
                                 vidcap_done(s->devices[i]);
                         }
 		}
 	}
         module_done(&s->mod);
+        free(s->grabbers);
+        free(s->devices);
         free(s);
 }
 
@@ -238,6 +266,12 @@ vidcap_switcher_grab(void *state, struct audio_frame **audio)
         struct audio_frame *audio_frame = NULL;
         struct video_frame *frame = NULL;
 
+        // the frame returned last time (if not disposable by the caller) is no longer used
+        if (s->held_device != -1) {
+                vidcap_grabber_release(s->grabbers[s->held_device]);
+                s->held_device = -1;
+        }
+
         struct message *msg;
         while ((msg = check_message(&s->mod))) {
                 struct msg_universal *msg_univ = (struct msg_universal *) msg;
@@ -260,6 +294,9 @@ vidcap_switcher_grab(void *state, struct audio_frame **audio)
                                                 vidcap_params_get_nth((struct vidcap_params *) s->params, new_selected_device + 1),
                                                 &s->devices[new_selected_device]);
                                 assert(ret == 0);
+                        } else {
+                                vidcap_grabber_set_keep_warm(s->grabbers[s->selected_device], true);
+                                vidcap_grabber_set_keep_warm(s->grabbers[new_selected_device], false);
                         }
 
                         s->selected_device = new_selected_device;
@@ -271,23 +308,32 @@ vidcap_switcher_grab(void *state, struct audio_frame **audio)
                 free_message(msg, r);
         }
 
-        frame = vidcap_grab(s->devices[s->selected_device], &audio_frame);
-        *audio = audio_frame;
-
-        if (frame || !s->fallback) {
+        if (s->excl_init) {
+                frame = vidcap_grab(s->devices[s->selected_device], &audio_frame);
+                *audio = audio_frame;
                 return frame;
         }
+
+        struct vidcap_grabbed grabbed;
+        unsigned int i = s->selected_device;
+        bool ok = vidcap_grabber_take(s->grabbers[i], GRAB_TIMEOUT_NS, &grabbed);
         // if frame was not returned but we have a fallback behavior, try also other devices
-        for (unsigned int i = (s->selected_device + 1U) % s->devices_cnt;
-                        i != s->selected_device;
-                        i = (s->selected_device + 1U) % s->devices_cnt) {
-                frame = vidcap_grab(s->devices[i], &audio_frame);
-                *audio = audio_frame;
-                if (frame != NULL) {
-                        break;
+        if (!ok && s->fallback) {
+                for (i = (s->selected_device + 1U) % s->devices_cnt;
+                                i != s->selected_device;
+                                i = (i + 1U) % s->devices_cnt) {
+                        if ((ok = vidcap_grabber_take(s->grabbers[i], 0, &grabbed))) {
+                                break;
+                        }
                 }
         }
-        return frame;
+        if (!ok) {
+                *audio = NULL;
+                return NULL;
+        }
+        s->held_device = (int) i;
+        *audio = grabbed.audio;
+        return grabbed.frame;
 }
 
 static const struct video_capture_info vidcap_switcher_info = {
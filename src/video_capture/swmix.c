@@ -63,11 +63,19 @@
 
 #include "audio/types.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #define MAX_AUDIO_LEN (1024*1024)
 
+#ifndef HAVE_MACOSX
+/// PBO uploads and fenced asynchronous readback (compositing frame N overlaps readback of frame N-1)
+#define SWMIX_ASYNC_PBO 1
+#endif
+
+#define OUTPUT_BUFFERS 4 ///< network, completed, being composited and being read back
+
 typedef enum {
         BICUBIC,
         BILINEAR
@@ -234,6 +242,8 @@ struct vidcap_swmix_state {
         GLuint              tex_output_uyvy;
         GLuint              fbo;
         GLuint              fbo_uyvy;
+        bool                use_pbo;
+        GLuint              readback_pbo[2];
 
         struct video_frame *frame;
         char               *network_buffer;
@@ -281,6 +291,7 @@ struct slave_data {
         float               posY[4];
         GLuint              texture[2]; // RGB(A), (UYVY)
         GLuint              fbo; // RGB(A)
+        GLuint              pbo; ///< upload buffer, 0 if not used
         double              x, y, width, height; // in 1x1 unit space
         double              fb_aspect;
 
@@ -316,6 +327,9 @@ static struct slave_data *init_slave_data(struct vidcap_swmix_state *s, FILE *co
                 }
 
                 glGenFramebuffers(1, &slaves_data[i].fbo);
+                if (s->use_pbo) {
+                        glGenBuffers(1, &slaves_data[i].pbo);
+                }
 
                 slaves_data[i].fb_aspect = (double) s->frame->tiles[0].width /
                         s->frame->tiles[0].height;
@@ -356,6 +370,9 @@ static void destroy_slave_data(struct slave_data *data, int count) {
         for(int i = 0; i < count; ++i) {
                 glDeleteTextures(2, data[i].texture);
                 glDeleteFramebuffers(1, &data[i].fbo);
+                if (data[i].pbo != 0) {
+                        glDeleteBuffers(1, &data[i].pbo);
+                }
         }
         free(data);
 }
@@ -538,8 +555,25 @@ static void load_texture(struct slave_data *s, GLuint from_uyvy)
         int src_width = s->current_frame->tiles[0].width;
         unsigned char *data = (unsigned char *) s->current_frame->tiles[0].data;
         unsigned char *tmp = NULL, *in_gl_buffer = data;
+        unsigned char *pbo_data = NULL;
+#ifdef SWMIX_ASYNC_PBO
+        if (s->pbo != 0) {
+                // the data are copied (or decoded) directly to the orphaned PBO so that
+                // glTexSubImage2D() doesn't need to wait for the previous upload
+                const size_t len = (size_t) src_height * vc_get_linesize(src_width, out_codec);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s->pbo);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, len, NULL, GL_STREAM_DRAW);
+                pbo_data = (unsigned char *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, len,
+                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+                if (pbo_data == NULL) {
+                        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                } else if (!decoder) {
+                        memcpy(pbo_data, data, len);
+                }
+        }
+#endif
         if (decoder) {
-                tmp = in_gl_buffer = (unsigned char *) malloc(src_height *
+                tmp = in_gl_buffer = pbo_data ? pbo_data : (unsigned char *) malloc(src_height *
                                 vc_get_linesize(src_width, out_codec));
                 for (int i = 0; i < src_height; ++i) {
                         decoder(tmp + i * vc_get_linesize(src_width, out_codec),
@@ -547,6 +581,13 @@ static void load_texture(struct slave_data *s, GLuint from_uyvy)
                                         vc_get_linesize(src_width, out_codec), 0, 8, 16);
                 }
         }
+#ifdef SWMIX_ASYNC_PBO
+        if (pbo_data) {
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                in_gl_buffer = NULL; // offset in the bound PBO
+                tmp = NULL;
+        }
+#endif
 
         if(out_codec == UYVY) {
                 glBindTexture(GL_TEXTURE_2D, s->texture[1]);
@@ -556,6 +597,11 @@ static void load_texture(struct slave_data *s, GLuint from_uyvy)
         glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
                         width, src_height, format, GL_UNSIGNED_BYTE, in_gl_buffer);
         free(tmp);
+#ifdef SWMIX_ASYNC_PBO
+        if (pbo_data) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+#endif
 
         if(out_codec == UYVY) {
                 glUseProgram(from_uyvy);
@@ -601,6 +647,87 @@ static void render_slave(struct slave_data *s, interpolation_t interpolation, GL
         glEnd();
 }
 
+/**
+ * Stores the read-back picture (or field) to the output buffer and, when
+ * complete, passes it to grab after the frame time is due.
+ */
+static void complete_frame(struct vidcap_swmix_state *s, char *buffer, const char *read_buf, int field,
+                char *audio_data, int audio_len, struct timeval *t0)
+{
+        if(s->frame->interlacing == INTERLACED_MERGED) {
+                int linesize =
+                        vc_get_linesize(s->frame->tiles[0].width, s->frame->color_spec);
+                for(unsigned int i = field; i < s->frame->tiles[0].height; i += 2) {
+                        memcpy(buffer + i * linesize, read_buf + i * linesize,
+                                        linesize);
+                }
+                if (field == 0) { // wait for the second field
+                        return;
+                }
+        } else if (read_buf != buffer) {
+                memcpy(buffer, read_buf, s->frame->tiles[0].data_len);
+        }
+
+        // wait until next frame time is due
+        double sec;
+        struct timeval t;
+        do {
+                gettimeofday(&t, NULL);
+                sec = tv_diff(t, *t0);
+        } while(sec < 1.0 / s->frame->fps);
+        *t0 = t;
+
+        pthread_mutex_lock(&s->lock);
+        while(s->completed_buffer != NULL) {
+                pthread_cond_wait(&s->frame_sent_cv, &s->lock);
+        }
+        s->completed_buffer = buffer;
+        s->completed_audio_buffer = audio_data;
+        s->completed_audio_buffer_len = audio_len;
+        pthread_cond_signal(&s->frame_ready_cv);
+        pthread_mutex_unlock(&s->lock);
+}
+
+#ifdef SWMIX_ASYNC_PBO
+/// readback issued to a PBO, completed in the next iteration
+struct swmix_readback {
+        GLsync              fence;
+        char               *buffer;
+        int                 field;
+        char               *audio_data;
+        int                 audio_len;
+};
+
+static void finish_readback(struct vidcap_swmix_state *s, GLuint pbo, struct swmix_readback *rb,
+                struct timeval *t0)
+{
+        if (rb->fence == NULL) {
+                return;
+        }
+        while (glClientWaitSync(rb->fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_C(1000000000)) == GL_TIMEOUT_EXPIRED) {
+        }
+        glDeleteSync(rb->fence);
+        rb->fence = NULL;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        const char *data = (const char *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                        s->frame->tiles[0].data_len, GL_MAP_READ_BIT);
+        if (data != NULL) {
+                complete_frame(s, rb->buffer, data, rb->field, rb->audio_data, rb->audio_len, t0);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+                log_msg(LOG_LEVEL_ERROR, "[swmix] Cannot map readback buffer!\n");
+                if (s->frame->interlacing != INTERLACED_MERGED || rb->field == 1) {
+                        pthread_mutex_lock(&s->lock);
+                        simple_linked_list_append(s->free_buffer_queue, rb->buffer);
+                        pthread_mutex_unlock(&s->lock);
+                        free(rb->audio_data);
+                }
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+#endif
+
 static void *master_worker(void *arg)
 {
         struct vidcap_swmix_state *s = (struct vidcap_swmix_state *) arg;
@@ -626,6 +753,10 @@ static void *master_worker(void *arg)
         char *tmp_buffer = (char *) malloc(s->frame->tiles[0].data_len);
 
         char *current_buffer = NULL;
+#ifdef SWMIX_ASYNC_PBO
+        struct swmix_readback readback[2] = { { 0 } };
+        int readback_idx = 0;
+#endif
 
         while(1) {
                 pthread_mutex_lock(&s->lock);
@@ -745,53 +876,61 @@ static void *master_worker(void *arg)
                         format = GL_RGB;
                 }
 
-                char *read_buf;
-                if(s->frame->interlacing == PROGRESSIVE) {
-                        read_buf = current_buffer;
-                } else {
-                        read_buf = tmp_buffer;
+#ifdef SWMIX_ASYNC_PBO
+                if (s->use_pbo) {
+                        glBindBuffer(GL_PIXEL_PACK_BUFFER, s->readback_pbo[readback_idx]);
+                        glReadPixels(0, 0, width,
+                                        s->frame->tiles[0].height,
+                                        format, GL_UNSIGNED_BYTE,
+                                        NULL);
+                        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                        glBindTexture(GL_TEXTURE_2D, 0);
+                        readback[readback_idx] = (struct swmix_readback) {
+                                glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0),
+                                current_buffer, field, audio_data, audio_len };
+                        readback_idx = 1 - readback_idx;
+                        // previous frame - its readback ran while this one was composited
+                        finish_readback(s, s->readback_pbo[readback_idx], &readback[readback_idx], &t0);
+                } else
+#endif
+                {
+                        char *read_buf = s->frame->interlacing == PROGRESSIVE ? current_buffer : tmp_buffer;
+                        glReadPixels(0, 0, width,
+                                        s->frame->tiles[0].height,
+                                        format, GL_UNSIGNED_BYTE,
+                                        read_buf);
+                        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                        glBindTexture(GL_TEXTURE_2D, 0);
+                        complete_frame(s, current_buffer, read_buf, field, audio_data, audio_len, &t0);
                 }
-                glReadPixels(0, 0, width,
-                                s->frame->tiles[0].height,
-                                format, GL_UNSIGNED_BYTE,
-                                read_buf);
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
-                glBindTexture(GL_TEXTURE_2D, 0);
 
                 if(s->frame->interlacing == INTERLACED_MERGED) {
-                        int linesize =
-                                vc_get_linesize(s->frame->tiles[0].width, s->frame->color_spec);
-                        for(unsigned int i = field; i < s->frame->tiles[0].height; i += 2) {
-                                memcpy(current_buffer + i * linesize, tmp_buffer + i * linesize,
-                                                linesize);
-                        }
                         field = (field + 1) % 2;
                 }
-
                 if(field == 0) {
-                        // wait until next frame time is due
-                        double sec;
-                        struct timeval t;
-                        do {
-                                gettimeofday(&t, NULL);
-                                sec = tv_diff(t, t0);
-                        } while(sec < 1.0 / s->frame->fps);
-                        t0 = t;
-
-                        pthread_mutex_lock(&s->lock);
-                        while(s->completed_buffer != NULL) {
-                                pthread_cond_wait(&s->frame_sent_cv, &s->lock);
-                        }
-                        s->completed_buffer = current_buffer;
-                        s->completed_audio_buffer = audio_data;
-                        s->completed_audio_buffer_len = audio_len;
-                        current_buffer = NULL;
-                        pthread_cond_signal(&s->frame_ready_cv);
-                        pthread_mutex_unlock(&s->lock);
-                        field = 0;
+                        current_buffer = NULL; // passed to grab (possibly after the readback completes)
                 }
+        }
 
+        // return the buffers not passed to grab
+        pthread_mutex_lock(&s->lock);
+#ifdef SWMIX_ASYNC_PBO
+        for (int i = 0; i < 2; ++i) {
+                if (readback[i].fence == NULL) {
+                        continue;
+                }
+                glDeleteSync(readback[i].fence);
+                if (readback[i].buffer != current_buffer) {
+                        simple_linked_list_append(s->free_buffer_queue, readback[i].buffer);
+                }
+                free(readback[i].audio_data);
+        }
+#endif
+        if (current_buffer != NULL) {
+                simple_linked_list_append(s->free_buffer_queue, current_buffer);
         }
+        pthread_mutex_unlock(&s->lock);
 
         free(tmp_buffer);
 
@@ -1147,6 +1286,10 @@ vidcap_swmix_init(struct vidcap_params *params, void **state)
         }
 
         gl_context_make_current(&s->gl_context);
+#ifdef SWMIX_ASYNC_PBO
+        s->use_pbo = GLEW_ARB_pixel_buffer_object && GLEW_ARB_sync && GLEW_ARB_map_buffer_range;
+        log_msg(LOG_LEVEL_VERBOSE, "[swmix] PBO transfers %s.\n", s->use_pbo ? "enabled" : "not supported");
+#endif
 
         {
                 char *bicubic = strdup(bicubic_template);
@@ -1194,11 +1337,19 @@ vidcap_swmix_init(struct vidcap_params *params, void **state)
         glGenFramebuffers(1, &s->fbo);
         glGenFramebuffers(1, &s->fbo_uyvy);
 
-        gl_context_make_current(NULL);
-
         s->frame->tiles[0].data_len = vc_get_linesize(s->frame->tiles[0].width,
                                 s->frame->color_spec) * s->frame->tiles[0].height;
-        for(int i = 0; i < 3; ++i) {
+        if (s->use_pbo) {
+                glGenBuffers(2, s->readback_pbo);
+                for (int i = 0; i < 2; ++i) {
+                        glBindBuffer(GL_PIXEL_PACK_BUFFER, s->readback_pbo[i]);
+                        glBufferData(GL_PIXEL_PACK_BUFFER, s->frame->tiles[0].data_len, NULL, GL_STREAM_READ);
+                }
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
+        gl_context_make_current(NULL);
+        for(int i = 0; i < OUTPUT_BUFFERS; ++i) {
                 char *buffer = (char *) malloc(s->frame->tiles[0].data_len);
                 simple_linked_list_append(s->free_buffer_queue, buffer);
         }
@@ -1291,6 +1442,9 @@ vidcap_swmix_done(void *state)
         if (s->fbo_uyvy) {
                 glDeleteFramebuffers(1, &s->fbo_uyvy);
         }
+        if (s->readback_pbo[0]) {
+                glDeleteBuffers(2, s->readback_pbo);
+        }
 
         gl_context_make_current(NULL);
         destroy_gl_context(&s->gl_context);
@@ -70,6 +70,7 @@
 #include "utils/ring_buffer.h"
 #include "utils/string.h"
 #include "utils/vf_split.h"
+#include "utils/video_frame_pool.h"
 #include "utils/pam.h"
 #include "utils/y4m.h"
 #include <stdio.h>
@@ -107,6 +108,11 @@ struct testcard_state {
         bool grab_audio = false;
         bool still_image = false;
         string pattern{"bars"};
+
+        int ring_len = 0; ///< number of precomputed frames, 0 - generate on the fly
+        char *ring_data = nullptr;
+        int ring_idx = 0;
+        bool unlimited = false; ///< emit frames as fast as possible
 };
 
 static void configure_fallback_audio(struct testcard_state *s) {
@@ -134,6 +140,25 @@ static auto configure_audio(struct testcard_state *s)
         return true;
 }
 
+/**
+ * Precomputes s->ring_len successive frames of the generator (moving if not
+ * still) so that grab only hands out pointers into the ring.
+ */
+static bool configure_ring(struct testcard_state *s)
+{
+        size_t data_len = s->frame->tiles[0].data_len;
+        s->ring_data = static_cast<char *>(hugepage_data_allocator().allocate(s->ring_len * data_len));
+        if (s->ring_data == nullptr) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot allocate %d frames for the ring!\n", s->ring_len);
+                return false;
+        }
+        for (int i = 0; i < s->ring_len; ++i) {
+                memcpy(s->ring_data + i * data_len, video_pattern_generator_next_frame(s->generator), data_len);
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Precomputed %d frames (%zu MiB).\n", s->ring_len, s->ring_len * data_len / (1024 * 1024));
+        return true;
+}
+
 #if 0
 static int configure_tiling(struct testcard_state *s, const char *fmt)
 {
@@ -379,7 +404,7 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
 
         if (vidcap_params_get_fmt(params) == NULL || strcmp(vidcap_params_get_fmt(params), "help") == 0) {
                 printf("testcard options:\n");
-                col() << TBOLD(TRED("\t-t testcard") << "[:size=<width>x<height>][:fps=<fps>][:codec=<codec>]") << "[:file=<filename>][:p][:s=<X>x<Y>][:i|:sf][:still][:pattern=<pattern>] " << TBOLD("| -t testcard:help\n");
+                col() << TBOLD(TRED("\t-t testcard") << "[:size=<width>x<height>][:fps=<fps>][:codec=<codec>]") << "[:file=<filename>][:p][:s=<X>x<Y>][:i|:sf][:still][:pattern=<pattern>][:ring=<K>][:unlimited] " << TBOLD("| -t testcard:help\n");
                 col() << "or\n";
                 col() << TBOLD(TRED("\t-t testcard") << ":<width>:<height>:<fps>:<codec>") << "[:other_opts]\n";
                 col() << "where\n";
@@ -389,6 +414,8 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
                 col() << TBOLD("\ti|sf") << "       - send as interlaced or segmented frame (if none of those is set, progressive is assumed)\n";
                 col() << TBOLD("\tstill") << "      - send still image\n";
                 col() << TBOLD("\tpattern") << "    - pattern to use, use \"" << TBOLD("pattern=help") << "\" for options\n";
+                col() << TBOLD("\tring") << "       - precompute K successive frames and send them without any per-frame work\n";
+                col() << TBOLD("\tunlimited") << "  - send the frames as fast as possible (fps is used only as the signalled frame rate)\n";
                 col() << "\n";
                 testcard_show_codec_help("testcard", false);
                 col() << TBOLD("Note:") << " only certain codec and generator combinations produce full-depth samples (not up-sampled 8-bit), use " << TBOLD("pattern=help") << " for details.\n";
@@ -427,6 +454,14 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
                 } else if (strncmp(tmp, "pattern=", strlen("pattern=")) == 0) {
                         const char *pattern = tmp + strlen("pattern=");
                         s->pattern = pattern;
+                } else if (strstr(tmp, "ring=") == tmp) {
+                        s->ring_len = atoi(strchr(tmp, '=') + 1);
+                        if (s->ring_len <= 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong ring length: %s\n", strchr(tmp, '=') + 1);
+                                goto error;
+                        }
+                } else if (strcmp(tmp, "unlimited") == 0) {
+                        s->unlimited = true;
                 } else if (strstr(tmp, "codec=") == tmp) {
                         desc.color_spec = get_codec_from_name(strchr(tmp, '=') + 1);
                         pixfmt_default = false;
@@ -472,6 +507,10 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
                 video_pattern_generator_fill_data(s->generator, in_file_contents.data());
         }
 
+        if (s->ring_len > 0 && !configure_ring(s)) {
+                goto error;
+        }
+
         s->last_frame_time = std::chrono::steady_clock::now();
 
         LOG(LOG_LEVEL_INFO) << MOD_NAME << "capture set to " << desc << ", bpc "
@@ -503,6 +542,7 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
 error:
         free(fmt);
         vf_free(s->frame);
+        hugepage_data_allocator().deallocate(s->ring_data);
         delete s;
         return ret;
 }
@@ -520,6 +560,7 @@ static void vidcap_testcard_done(void *state)
         vf_free(s->frame);
         ring_buffer_destroy(s->midi_buf);
         video_pattern_generator_destroy(s->generator);
+        hugepage_data_allocator().deallocate(s->ring_data);
         delete s;
 }
 
@@ -531,7 +572,7 @@ static struct video_frame *vidcap_testcard_grab(void *arg, struct audio_frame **
         std::chrono::steady_clock::time_point curr_time =
                 std::chrono::steady_clock::now();
 
-        if (std::chrono::duration_cast<std::chrono::duration<double>>(curr_time - state->last_frame_time).count() <
+        if (!state->unlimited && std::chrono::duration_cast<std::chrono::duration<double>>(curr_time - state->last_frame_time).count() <
                         1.0 / state->frame->fps) {
                 return NULL;
         }
@@ -549,7 +590,12 @@ static struct video_frame *vidcap_testcard_grab(void *arg, struct audio_frame **
                 *audio = NULL;
         }
 
-        vf_get_tile(state->frame, 0)->data = video_pattern_generator_next_frame(state->generator);
+        if (state->ring_len > 0) {
+                vf_get_tile(state->frame, 0)->data = state->ring_data + (size_t) state->ring_idx * state->frame->tiles[0].data_len;
+                state->ring_idx = (state->ring_idx + 1) % state->ring_len;
+        } else {
+                vf_get_tile(state->frame, 0)->data = video_pattern_generator_next_frame(state->generator);
+        }
 
         if (state->tiled) {
                 /* update tile data instead */
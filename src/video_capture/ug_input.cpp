@@ -3,7 +3,7 @@
  * @author Martin Pulec     <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2014-2023 CESNET, z. s. p. o.
+ * Copyright (c) 2014-2026 CESNET, z. s. p. o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -53,20 +53,28 @@
 #include "video_rxtx/ultragrid_rtp.h"
 
 #include <chrono>
-#include <iostream>
+#include <condition_variable>
 #include <mutex>
 #include <memory>
 #include <queue>
 #include <thread>
 
+#define MOD_NAME "[ug_input] "
+
 static constexpr int MAX_QUEUE_SIZE = 2;
+static constexpr int GRAB_TIMEOUT_MS = 100;
 
 using namespace std;
 using namespace std::chrono;
 
 struct ug_input_state  : public frame_recv_delegate {
         mutex lock;
+        condition_variable frame_added;
+        condition_variable frame_consumed;
         queue<pair<struct video_frame *, struct audio_frame *>> frame_queue;
+        size_t max_queue_size = MAX_QUEUE_SIZE;
+        bool block = false; ///< full queue policy - block the receiver instead of dropping the oldest frame
+        bool should_exit = false;
         struct display *display;
 
         void frame_arrived(struct video_frame *f, struct audio_frame *a);
@@ -82,31 +90,72 @@ struct ug_input_state  : public frame_recv_delegate {
 
 void ug_input_state::frame_arrived(struct video_frame *f, struct audio_frame *a)
 {
-        lock_guard<mutex> lk(lock);
-        if (frame_queue.size() < MAX_QUEUE_SIZE) {
-                frame_queue.push({f, a});
-        } else {
-                cerr << "[ug_input] Dropping frame!" << endl;
-                AUDIO_FRAME_DISPOSE(a);
-                VIDEO_FRAME_DISPOSE(f);
+        unique_lock<mutex> lk(lock);
+        if (block) {
+                frame_consumed.wait(lk, [this] { return frame_queue.size() < max_queue_size || should_exit; });
+                if (should_exit) {
+                        AUDIO_FRAME_DISPOSE(a);
+                        VIDEO_FRAME_DISPOSE(f);
+                        return;
+                }
+        } else if (frame_queue.size() >= max_queue_size) {
+                // drop the oldest frame to keep the latency low
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Dropping frame!\n");
+                auto item = frame_queue.front();
+                frame_queue.pop();
+                AUDIO_FRAME_DISPOSE(item.second);
+                VIDEO_FRAME_DISPOSE(item.first);
         }
+        frame_queue.push({f, a});
+        lk.unlock();
+        frame_added.notify_one();
+}
+
+static void vidcap_ug_input_usage()
+{
+        printf("Usage:\n");
+        printf("\t-t ug_input[:<port>][:queue=<len>][:policy=drop|block] [-s embedded]\n");
+        printf("\t\tqueue  - maximal number of frames waiting to be grabbed (default %d)\n", MAX_QUEUE_SIZE);
+        printf("\t\tpolicy - if the queue is full, drop the oldest frame (default) or block the receiver\n");
 }
 
 static int vidcap_ug_input_init(struct vidcap_params *cap_params, void **state)
 {
         uint16_t port = 5004;
+        int max_queue_size = MAX_QUEUE_SIZE;
+        bool block = false;
 
         if (strcmp("help", vidcap_params_get_fmt(cap_params)) == 0) {
-                printf("Usage:\n");
-                printf("\t-t ug_input[:<port>] [-s embedded]\n");
+                vidcap_ug_input_usage();
                 return VIDCAP_INIT_NOERR;
         }
-        ug_input_state *s = new ug_input_state();
 
-        if (isdigit(vidcap_params_get_fmt(cap_params)[0])) {
-                port = atoi(vidcap_params_get_fmt(cap_params));
+        char *fmt = strdupa(vidcap_params_get_fmt(cap_params));
+        char *save_ptr = nullptr;
+        char *item = nullptr;
+        while ((item = strtok_r(fmt, ":", &save_ptr)) != nullptr) {
+                fmt = nullptr;
+                if (isdigit(item[0])) {
+                        port = atoi(item);
+                } else if (strstr(item, "queue=") == item) {
+                        max_queue_size = atoi(item + strlen("queue="));
+                        if (max_queue_size <= 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Queue length must be positive!\n");
+                                return VIDCAP_INIT_FAIL;
+                        }
+                } else if (strcmp(item, "policy=drop") == 0 || strcmp(item, "policy=block") == 0) {
+                        block = strcmp(item, "policy=block") == 0;
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", item);
+                        vidcap_ug_input_usage();
+                        return VIDCAP_INIT_FAIL;
+                }
         }
 
+        ug_input_state *s = new ug_input_state();
+        s->max_queue_size = max_queue_size;
+        s->block = block;
+
         char cfg[128] = "";
         snprintf(cfg, sizeof cfg, "%p", s);
         int ret = initialize_video_display(vidcap_params_get_parent(cap_params), "pipe", cfg, 0, NULL, &s->display);
@@ -185,6 +234,13 @@ static void vidcap_ug_input_done(void *state)
 {
         auto s = (ug_input_state *) state;
 
+        {
+                // release the receiver if blocked in frame_arrived()
+                lock_guard<mutex> lk(s->lock);
+                s->should_exit = true;
+        }
+        s->frame_consumed.notify_one();
+
         audio_join(s->audio);
         s->receiver_thread.join();
 
@@ -209,15 +265,18 @@ static struct video_frame *vidcap_ug_input_grab(void *state, struct audio_frame
 {
         auto s = (ug_input_state *) state;
         *audio = NULL;
-        lock_guard<mutex> lk(s->lock);
+        unique_lock<mutex> lk(s->lock);
+        s->frame_added.wait_for(lk, milliseconds(GRAB_TIMEOUT_MS), [s] { return !s->frame_queue.empty(); });
         if (s->frame_queue.empty()) {
                 return NULL;
         } else {
                 auto item = s->frame_queue.front();
+                // passed further as is - dispose callback returns the frame to the pipe display pool
                 struct video_frame *frame = item.first;
                 *audio = item.second;
                 s->frame_queue.pop();
-                frame->callbacks.dispose = vf_free;
+                lk.unlock();
+                s->frame_consumed.notify_one();
 
                 s->frames++;
                 auto curr_time = steady_clock::now();
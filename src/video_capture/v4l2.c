@@ -68,6 +68,7 @@
 #include "utils/color_out.h"
 #include "utils/list.h"
 #include "utils/misc.h" // ug_strerror
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "v4l2_common.h"
 
@@ -81,8 +82,10 @@ struct vidcap_v4l2_state {
         struct v4l2_buffer_data buffers[MAX_BUF_COUNT];
 
         _Bool permissive; ///< do not fail if parameters (size, FPS...) not set exactly
+        _Bool dmabuf; ///< export the buffers as DMA-BUF
 #ifdef HAVE_LIBV4LCONVERT
         struct v4lconvert_data *convert;
+        void *convert_pool; ///< frames for the converted data
 #endif
         struct v4l2_format src_fmt; ///< captured format
         struct v4l2_format dst_fmt; ///< converted format if v4lconvert is used
@@ -133,6 +136,9 @@ static void vidcap_v4l2_common_cleanup(struct vidcap_v4l2_state *s) {
         pthread_mutex_unlock(&s->lock);
 
         for (int i = 0; i < s->buffer_count; ++i) {
+                if (s->buffers[i].dmabuf_fd != -1) {
+                        close(s->buffers[i].dmabuf_fd);
+                }
                 if (s->buffers[i].start) {
                         if (-1 == munmap(s->buffers[i].start, s->buffers[i].length)) {
                                 log_perror(LOG_LEVEL_ERROR, MOD_NAME "munmap");
@@ -151,6 +157,9 @@ static void vidcap_v4l2_common_cleanup(struct vidcap_v4l2_state *s) {
         if (s->convert) {
                 v4lconvert_destroy(s->convert);
         }
+        if (s->convert_pool) {
+                video_frame_pool_destroy(s->convert_pool);
+        }
 #endif
 
         free(s);
@@ -201,7 +210,7 @@ static void show_help(_Bool full)
         printf("V4L2 capture\n");
         printf("Usage\n");
         color_printf(TERM_BOLD TERM_FG_RED "\t-t v4l2[:device=<dev>]" TERM_FG_RESET
-                        "[:codec=<pixel_fmt>][:size=<width>x<height>][:tpf=<tpf>|:fps=<fps>][:buffers=<bufcnt>][:convert=<conv>][:permissive] | -t v4l2:[short]help\n" TERM_RESET);
+                        "[:codec=<pixel_fmt>][:size=<width>x<height>][:tpf=<tpf>|:fps=<fps>][:buffers=<bufcnt>][:convert=<conv>][:permissive][:dmabuf] | -t v4l2:[short]help\n" TERM_RESET);
         printf("where\n");
         color_printf(TERM_BOLD "<dev> -" TERM_RESET "\tuse device to grab from (default: first usable)\n");
         color_printf(TERM_BOLD "\t<tpf>" TERM_RESET " - time per frame in format <numerator>/<denominator>\n");
@@ -220,6 +229,7 @@ static void show_help(_Bool full)
 #endif
         printf("\n");
         printf("\t\tpermissive - do not fail if configuration values (size, FPS) are adjusted by driver and not set exactly\n");
+        printf("\t\tdmabuf - export capture buffers as DMA-BUF so that they can be imported by a GPU consumer without a copy\n");
         printf("\n");
 
         printf("Available devices:\n");
@@ -515,6 +525,9 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
         }
         s->buffer_count = DEFAULT_BUF_COUNT;
         s->fd = -1;
+        for (int i = 0; i < MAX_BUF_COUNT; ++i) {
+                s->buffers[i].dmabuf_fd = -1;
+        }
         s->buffers_to_enqueue = simple_linked_list_init();
         pthread_mutex_init(&s->lock, NULL);
         pthread_cond_init(&s->cv, NULL);
@@ -581,6 +594,8 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
 #endif
                         } else if (strstr(item, "permissive") == item) {
                                 s->permissive = 1;
+                        } else if (strcmp(item, "dmabuf") == 0) {
+                                s->dmabuf = 1;
                         } else {
                                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Invalid configuration argument: %s\n",
                                                 item);
@@ -708,6 +723,7 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
         s->convert = NULL;
         if (v4l2_convert_to != VIDEO_CODEC_NONE) {
                 s->convert = v4lconvert_create(s->fd);
+                s->convert_pool = video_frame_pool_init(s->desc, 0);
         }
 #endif
 
@@ -718,11 +734,22 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
         reqbuf.memory = V4L2_MEMORY_MMAP;
         reqbuf.count = s->buffer_count;
 
-        if (!set_v4l2_buffers(s->fd, &reqbuf, s->buffers)) {
+        if (!set_v4l2_buffers(s->fd, &reqbuf, s->buffers, 1)) {
                 goto error;
         }
         s->buffer_count = reqbuf.count;
 
+        if (s->dmabuf) {
+#ifdef HAVE_LIBV4LCONVERT
+                if (s->convert) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "DMA-BUF export is not used with conversion.\n");
+                } else
+#endif
+                if (!export_v4l2_buffers(s->fd, reqbuf.type, s->buffer_count, s->buffers)) {
+                        goto error;
+                }
+        }
+
         if(ioctl(s->fd, VIDIOC_STREAMON, &reqbuf.type) != 0) {
                 log_perror(LOG_LEVEL_ERROR, MOD_NAME "Unable to start stream");
                 goto error;
@@ -757,14 +784,10 @@ static void vidcap_v4l2_dispose_video_frame(struct video_frame *frame) {
         struct v4l2_dispose_deq_buffer_data *data =
                 (struct v4l2_dispose_deq_buffer_data *) frame->callbacks.dispose_udata;
 
-        if (data) {
-                pthread_mutex_lock(&data->s->lock);
-                simple_linked_list_append(data->s->buffers_to_enqueue, data);
-                pthread_mutex_unlock(&data->s->lock);
-                pthread_cond_signal(&data->s->cv);
-        } else {
-                free(frame->tiles[0].data);
-        }
+        pthread_mutex_lock(&data->s->lock);
+        simple_linked_list_append(data->s->buffers_to_enqueue, data);
+        pthread_mutex_unlock(&data->s->lock);
+        pthread_cond_signal(&data->s->cv);
 
         vf_free(frame);
 }
@@ -796,13 +819,10 @@ static struct video_frame * vidcap_v4l2_grab(void *state, struct audio_frame **a
 
         s->dequeued_buffers += 1;
 
-        out = vf_alloc_desc(s->desc);
-        out->callbacks.dispose = vidcap_v4l2_dispose_video_frame;
-
 #ifdef HAVE_LIBV4LCONVERT
         if (s->convert) {
-                out->callbacks.dispose_udata = NULL;
-                out->tiles[0].data = (char *) malloc(out->tiles[0].data_len);
+                // pooled (hugepage-backed) buffers avoid allocating and faulting the whole frame for each grab
+                out = video_frame_pool_get_disposable_frame(s->convert_pool);
                 int ret = v4lconvert_convert(s->convert,
                                 &s->src_fmt,  /*  in */
                                 &s->dst_fmt, /*  in */
@@ -829,12 +849,15 @@ static struct video_frame * vidcap_v4l2_grab(void *state, struct audio_frame **a
         if (0) {
 #endif // HAVE_LIBV4LCONVERT
         } else {
+                out = vf_alloc_desc(s->desc);
+                out->callbacks.dispose = vidcap_v4l2_dispose_video_frame;
                 struct v4l2_dispose_deq_buffer_data *frame_data =
                         malloc(sizeof(struct v4l2_dispose_deq_buffer_data));
                 frame_data->s = s;
                 memcpy(&frame_data->buf, &buf, sizeof(buf));
                 out->tiles[0].data = s->buffers[frame_data->buf.index].start;
                 out->tiles[0].data_len = frame_data->buf.bytesused;
+                out->tiles[0].dmabuf_fd = s->buffers[frame_data->buf.index].dmabuf_fd;
                 out->callbacks.dispose_udata = frame_data;
         }
 
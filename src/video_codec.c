@@ -69,13 +69,25 @@
 #include "debug.h"
 #include "host.h"
 #include "hwaccel_vdpau.h"
+#include "hwaccel_videotoolbox.h"
 #include "hwaccel_rpi4.h"
+#include "utils/cpu_features.h"
 #include "utils/macros.h" // to_fourcc, OPTIMEZED_FOR
+#include "utils/worker.h"
 #include "video_codec.h"
 
 #ifdef __SSSE3__
 #include "tmmintrin.h"
 #endif
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#define HAVE_VC_AVG_AVX2 1
+#endif
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+#define DEINTERLACE_BAND_LINES 32
 
 char pixfmt_conv_pref[] = "dsc"; ///< bitdepth, subsampling, color space
 
@@ -195,6 +207,10 @@ static const struct codec_info_t codec_info[] = {
                 to_fourcc('a','p','c','o'), 1, 1, 0, 8, FALSE, TRUE, FALSE, FALSE, 0, "apco"},
         [PRORES_422_LT] =  {"PRORES_422_LT", "Apple ProRes 422 (LT)",
                 to_fourcc('a','p','c','s'), 1, 1, 0, 8, FALSE, TRUE, FALSE, FALSE, 0, "apcs"},
+#ifdef HWACC_VIDEOTOOLBOX
+        [HW_VIDEOTOOLBOX] = {"HW_VIDEOTOOLBOX", "VideoToolbox hardware surface",
+                to_fourcc('V', 'T', 'B', 'S'), sizeof(hw_videotoolbox_frame), 1, 0, 8, FALSE, TRUE, FALSE, TRUE, 4200, "vtb"},
+#endif
 };
 
 /// for planar pixel formats
@@ -478,7 +494,7 @@ bool codec_is_const_size(codec_t codec)
 }
 
 bool codec_is_hw_accelerated(codec_t codec) {
-        return codec == HW_VDPAU;
+        return codec == HW_VDPAU || codec == HW_VIDEOTOOLBOX;
 }
 
 /**
@@ -694,142 +710,212 @@ static void vc_deinterlace_unaligned(unsigned char *src, long src_linesize, int
 #endif
 
 /**
- * Extended version of vc_deinterlace(). The former version was in-place only.
- * This allows to output to a different buffer while it can still be used in-place.
+ * Averages packed unsigned fields of 32-bit words (rounding up, as
+ * _mm_avg_epu8 does) without unpacking - (a | b) - ((a ^ b) >> 1), the
+ * shifted xor is masked not to cross the field boundaries.
+ */
+static inline uint32_t avg_packed(uint32_t a, uint32_t b, uint32_t shift_mask)
+{
+        return (a | b) - (((a ^ b) >> 1) & shift_mask);
+}
+
+#ifdef HAVE_VC_AVG_AVX2
+static __attribute__((target("avx2"))) size_t avg_lines_avx2(int bpp, size_t len, const unsigned char *s1,
+                const unsigned char *s2, unsigned char *d)
+{
+        size_t x = 0;
+        for ( ; x + 32 <= len; x += 32) {
+                __m256i i1 = _mm256_loadu_si256((__m256i const *)(const void *) (s1 + x));
+                __m256i i2 = _mm256_loadu_si256((__m256i const *)(const void *) (s2 + x));
+                __m256i res = bpp == 8 ? _mm256_avg_epu8(i1, i2) : _mm256_avg_epu16(i1, i2);
+                _mm256_storeu_si256((__m256i *)(void *) (d + x), res);
+        }
+        return x;
+}
+#endif
+
+/// @returns number of bytes processed
+static size_t avg_lines_simd(int bpp, size_t len, const unsigned char *s1, const unsigned char *s2, unsigned char *d)
+{
+        size_t x = 0;
+#ifdef HAVE_VC_AVG_AVX2
+        if (cpu_has(CPU_FEATURE_AVX2)) {
+                x = avg_lines_avx2(bpp, len, s1, s2, d);
+        }
+#endif
+#if defined __SSE2__
+        const size_t simd_len = cpu_has(CPU_FEATURE_SSE2) ? len : 0;
+        for ( ; x + 16 <= simd_len; x += 16) {
+                __m128i i1 = _mm_loadu_si128((__m128i const *)(const void *) (s1 + x));
+                __m128i i2 = _mm_loadu_si128((__m128i const *)(const void *) (s2 + x));
+                __m128i res = bpp == 8 ? _mm_avg_epu8(i1, i2) : _mm_avg_epu16(i1, i2);
+                _mm_storeu_si128((__m128i *)(void *) (d + x), res);
+        }
+#elif defined __ARM_NEON
+        const size_t simd_len = cpu_has(CPU_FEATURE_NEON) ? len : 0;
+        for ( ; x + 16 <= simd_len; x += 16) {
+                if (bpp == 8) {
+                        vst1q_u8(d + x, vrhaddq_u8(vld1q_u8(s1 + x), vld1q_u8(s2 + x)));
+                } else {
+                        vst1q_u16((uint16_t *)(void *) (d + x), vrhaddq_u16(vld1q_u16((const uint16_t *)(const void *) (s1 + x)),
+                                                vld1q_u16((const uint16_t *)(const void *) (s2 + x))));
+                }
+        }
+#endif
+        return x;
+}
+
+/**
+ * Computes the average of 2 lines (rounded up) to dst, which may be the same
+ * as any of the sources.
+ *
+ * The 8-bit and 16-bit formats use AVX2 (if the CPU supports it), SSE2 or
+ * NEON, v210 and R10k are averaged directly in the packed words.
  *
  * @returns false on unsupported codecs
  */
-// Sibling of this function is in double-framerate.cpp:avg_lines so consider
-// porting changes made here there.
-bool vc_deinterlace_ex(codec_t codec, unsigned char *src, size_t src_linesize, unsigned char *dst, size_t dst_pitch, size_t lines)
+static bool avg_lines_supported(codec_t codec)
 {
         if (is_codec_opaque(codec) && codec_is_planar(codec)) {
                 return false;
         }
-        if (lines == 1) {
-                memcpy(dst, src, src_linesize);
-                return true;
+        int bpp = get_bits_per_component(codec);
+        return bpp == 8 || bpp == 16 || codec == v210 || codec == R10k || codec == R12L;
+}
+
+bool vc_avg_lines(codec_t codec, size_t linesize, const unsigned char *src1, const unsigned char *src2, unsigned char *dst)
+{
+        if (!avg_lines_supported(codec)) {
+                return false;
         }
-        DEBUG_TIMER_START(vc_deinterlace_ex);
         int bpp = get_bits_per_component(codec);
-        for (size_t y = 0; y < lines - 1; y += 1) {
-                unsigned char *s = src + y * src_linesize;
-                unsigned char *d = dst + y * dst_pitch;
-                if (bpp == 8 || bpp == 16) {
-                        size_t x = 0;
-#ifdef __SSSE3__
-                        if (bpp == 8) {
-                                for ( ; x < src_linesize / 16; ++x) {
-                                        __m128i i1 = _mm_lddqu_si128((__m128i const*)(const void *) s);
-                                        __m128i i2 = _mm_lddqu_si128((__m128i const*)(const void *) (s + src_linesize));
-                                        __m128i res = _mm_avg_epu8(i1, i2);
-                                        _mm_storeu_si128((__m128i *)(void *) d, res);
-                                        s += 16;
-                                        d += 16;
-                                }
-                        } else {
-                                for ( ; x < src_linesize / 16; ++x) {
-                                        __m128i i1 = _mm_lddqu_si128((__m128i const*)(const void *) s);
-                                        __m128i i2 = _mm_lddqu_si128((__m128i const*)(const void *) (s + src_linesize));
-                                        __m128i res = _mm_avg_epu16(i1, i2);
-                                        _mm_storeu_si128((__m128i *)(void *) d, res);
-                                        s += 16;
-                                        d += 16;
-                                }
+        if (bpp == 8 || bpp == 16) {
+                size_t x = avg_lines_simd(bpp, linesize, src1, src2, dst);
+                if (bpp == 8) {
+                        for ( ; x < linesize; ++x) {
+                                dst[x] = (src1[x] + src2[x] + 1) >> 1;
                         }
-#endif
-                        x *= 16;
-                        if (bpp  == 8) {
-                                for ( ; x < src_linesize; ++x) {
-                                        int val = (*s + s[src_linesize] + 1) >> 1;
-                                        *d++ = val;
-                                        s++;
-                                }
-                        } else {
-                                uint16_t *d16 = (void *) d;
-                                uint16_t *s16 = (void *) s;
-                                for ( ; x < src_linesize / 2; ++x) {
-                                        int val = (*s16 + s16[src_linesize / 2] + 1) >> 1;
-                                        *d16++ = val;
-                                        s16++;
-                                }
+                } else {
+                        for ( ; x + 1 < linesize; x += 2) {
+                                uint16_t v1, v2;
+                                memcpy(&v1, src1 + x, 2);
+                                memcpy(&v2, src2 + x, 2);
+                                uint16_t res = (v1 + v2 + 1) >> 1;
+                                memcpy(dst + x, &res, 2);
                         }
-                } else if (codec == v210) {
-                        uint32_t *s32 = (void *) s;
-                        uint32_t *d32 = (void *) d;
-                        for (size_t x = 0; x < src_linesize / 16; ++x) {
-                                #pragma GCC unroll 4
-                                for (size_t y = 0; y < 4; ++y) {
-                                        uint32_t v1 = *s32;
-                                        uint32_t v2 = s32[src_linesize / 4];
-                                        uint32_t out =
-                                                (((v1 >> 20        ) + (v2 >> 20        ) + 1) / 2) << 20 |
-                                                (((v1 >> 10 & 0x3ff) + (v2 >> 10 & 0x3ff) + 1) / 2) << 10 |
-                                                (((v1       & 0x3ff) + (v2       & 0x3ff) + 1) / 2);
-                                        *d32++ = out;
-                                        s32++;
-                                }
+                }
+        } else if (codec == v210 || codec == R10k) {
+                const uint32_t *s32_1 = (const uint32_t *)(const void *) src1;
+                const uint32_t *s32_2 = (const uint32_t *)(const void *) src2;
+                uint32_t *d32 = (uint32_t *)(void *) dst;
+                if (codec == v210) { // fields at bits 0, 10, 20
+                        OPTIMIZED_FOR (size_t x = 0; x < linesize / 4; ++x) {
+                                d32[x] = avg_packed(s32_1[x], s32_2[x], ~(1U << 9 | 1U << 19 | 3U << 29));
                         }
-                } else if (codec == R10k) {
-                        uint32_t *s32 = (void *) s;
-                        uint32_t *d32 = (void *) d;
-                        for (size_t x = 0; x < src_linesize / 16; ++x) {
-                                #pragma GCC unroll 4
-                                for (size_t y = 0; y < 4; ++y) {
-                                        uint32_t v1 = ntohl(*s32);
-                                        uint32_t v2 = ntohl(s32[src_linesize / 4]);
-                                        uint32_t out =
-                                                (((v1 >> 22        ) + (v2 >> 22        ) + 1) / 2) << 22 |
-                                                (((v1 >> 12 & 0x3ff) + (v2 >> 12 & 0x3ff) + 1) / 2) << 12 |
-                                                (((v1 >>  2 & 0x3ff) + (v2 >>  2 & 0x3ff) + 1) / 2) << 2;
-                                        *d32++ = htonl(out);
-                                        s32++;
-                                }
+                } else { // big-endian, fields at bits 22, 12, 2, 2 LSBs are padding
+                        OPTIMIZED_FOR (size_t x = 0; x < linesize / 4; ++x) {
+                                uint32_t res = avg_packed(ntohl(s32_1[x]), ntohl(s32_2[x]), ~(1U << 21 | 1U << 11 | 3U));
+                                d32[x] = htonl(res & ~3U);
                         }
-                } else if (codec == R12L) {
-                        uint32_t *s32 = (void *) s;
-                        uint32_t *d32 = (void *) d;
-                        int shift = 0;
-                        uint32_t remain1 = 0;
-                        uint32_t remain2 = 0;
-                        uint32_t out = 0;
-                        for (size_t x = 0; x < src_linesize / 36; ++x) {
-                                #pragma GCC unroll 8
-                                for (size_t y = 0; y < 8; ++y) {
-                                        uint32_t in1 = *s32;
-                                        uint32_t in2 = s32[src_linesize / 4];
-                                        if (shift > 0) {
-                                                remain1 = remain1 | (in1 & ((1<<((shift + 12) % 32)) - 1)) << (32-shift);
-                                                remain2 = remain2 | (in2 & ((1<<((shift + 12) % 32)) - 1)) << (32-shift);
-                                                uint32_t ret = (remain1 + remain2 + 1) / 2;
-                                                out |= ret << shift;
-                                                *d32++ = out;
-                                                out = ret >> (32-shift);
-                                                shift = (shift + 12) % 32;
-                                                in1 >>= shift;
-                                                in2 >>= shift;
-                                        }
-                                        while (shift <= 32 - 12) {
-                                                out |= ((((in1 & 0xfff) + (in2 & 0xfff)) + 1) / 2) << shift;
-                                                in1 >>= 12;
-                                                in2 >>= 12;
-                                                shift += 12;
-                                        }
-                                        if (shift == 32) {
-                                                *d32++ = out;
-                                                out = 0;
-                                                shift = 0;
-                                        } else {
-                                                remain1 = in1;
-                                                remain2 = in2;
-                                        }
-                                        s32++;
-                                }
+                }
+        } else if (codec == R12L) { // 12-bit fields continue over the word boundaries
+                const uint32_t *s32_1 = (const uint32_t *)(const void *) src1;
+                const uint32_t *s32_2 = (const uint32_t *)(const void *) src2;
+                uint32_t *d32 = (uint32_t *)(void *) dst;
+                int shift = 0;
+                uint32_t remain1 = 0;
+                uint32_t remain2 = 0;
+                uint32_t out = 0;
+                for (size_t x = 0; x < linesize / 4; ++x) {
+                        uint32_t in1 = *s32_1++;
+                        uint32_t in2 = *s32_2++;
+                        if (shift > 0) {
+                                remain1 = remain1 | (in1 & ((1<<((shift + 12) % 32)) - 1)) << (32-shift);
+                                remain2 = remain2 | (in2 & ((1<<((shift + 12) % 32)) - 1)) << (32-shift);
+                                uint32_t ret = (remain1 + remain2 + 1) / 2;
+                                out |= ret << shift;
+                                *d32++ = out;
+                                out = ret >> (32-shift);
+                                shift = (shift + 12) % 32;
+                                in1 >>= shift;
+                                in2 >>= shift;
                         }
-                } else {
-                        return false;
+                        while (shift <= 32 - 12) {
+                                out |= ((((in1 & 0xfff) + (in2 & 0xfff)) + 1) / 2) << shift;
+                                in1 >>= 12;
+                                in2 >>= 12;
+                                shift += 12;
+                        }
+                        if (shift == 32) {
+                                *d32++ = out;
+                                out = 0;
+                                shift = 0;
+                        } else {
+                                remain1 = in1;
+                                remain2 = in2;
+                        }
+                }
+        }
+        return true;
+}
+
+struct deinterlace_data {
+        codec_t codec;
+        unsigned char *src;
+        size_t src_linesize;
+        unsigned char *dst;
+        size_t dst_pitch;
+        size_t lines;
+        unsigned char *band_first_lines; ///< copies of the first lines of bands if in-place, otherwise NULL
+};
+
+static void deinterlace_bands(void *arg, size_t begin, size_t end)
+{
+        struct deinterlace_data *d = arg;
+        for (size_t band = begin; band < end; ++band) {
+                size_t y_end = MIN((band + 1) * DEINTERLACE_BAND_LINES, d->lines - 1);
+                for (size_t y = band * DEINTERLACE_BAND_LINES; y < y_end; y += 1) {
+                        const unsigned char *next = d->src + (y + 1) * d->src_linesize;
+                        if (d->band_first_lines != NULL && y + 1 == y_end && y_end != d->lines - 1) {
+                                // next band's first line may have already been overwritten
+                                next = d->band_first_lines + band * d->src_linesize;
+                        }
+                        vc_avg_lines(d->codec, d->src_linesize, d->src + y * d->src_linesize, next,
+                                        d->dst + y * d->dst_pitch);
+                }
+        }
+}
+
+/**
+ * Extended version of vc_deinterlace(). The former version was in-place only.
+ * This allows to output to a different buffer while it can still be used in-place.
+ *
+ * The frame is processed in bands of lines in parallel by the worker pool.
+ *
+ * @returns false on unsupported codecs
+ */
+bool vc_deinterlace_ex(codec_t codec, unsigned char *src, size_t src_linesize, unsigned char *dst, size_t dst_pitch, size_t lines)
+{
+        if (!avg_lines_supported(codec)) {
+                return false;
+        }
+        if (lines == 1) {
+                memcpy(dst, src, src_linesize);
+                return true;
+        }
+        DEBUG_TIMER_START(vc_deinterlace_ex);
+        size_t bands = (lines - 1 + DEINTERLACE_BAND_LINES - 1) / DEINTERLACE_BAND_LINES;
+        struct deinterlace_data d = { codec, src, src_linesize, dst, dst_pitch, lines, NULL };
+        const bool overlaps = dst < src + lines * src_linesize && src < dst + lines * dst_pitch;
+        if (overlaps && bands > 1) {
+                d.band_first_lines = malloc((bands - 1) * src_linesize);
+                for (size_t band = 1; band < bands; ++band) {
+                        memcpy(d.band_first_lines + (band - 1) * src_linesize,
+                                        src + band * DEINTERLACE_BAND_LINES * src_linesize, src_linesize);
                 }
         }
+        task_run_parallel_for(bands, 1, deinterlace_bands, &d);
+        free(d.band_first_lines);
         memcpy(dst + (lines - 1) * dst_pitch, dst + (lines - 2) * dst_pitch, src_linesize); // last line
         DEBUG_TIMER_STOP(vc_deinterlace_ex);
         return true;
@@ -43,6 +43,8 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
 #include <memory>
 #include <stdio.h>
@@ -54,22 +56,86 @@
 #include "compat/platform_time.h"
 #include "messaging.h"
 #include "module.h"
+#include "utils/lockfree_queue.h"
 #include "utils/synchronized_queue.h"
 #include "utils/thread.h"
 #include "utils/vf_split.h"
-#include "utils/worker.h"
 #include "video.h"
 #include "video_compress.h"
 #include "lib_common.h"
 #include "debug.h"
+#include "host.h"
+
+#ifdef HAVE_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 static constexpr const char *MOD_NAME = "[vcompress] ";
 
 using namespace std;
 
 struct compress_state;
+static void *compress_tile_callback(void *arg);
+
+/**
+ * @brief Auxiliary structure passed to worker thread.
+ */
+struct compress_worker_data {
+        struct module *state;      ///< compress driver status
+        shared_ptr<video_frame> frame; ///< uncompressed tile to be compressed
+
+        compress_tile_t callback;  ///< tile compress callback
+        shared_ptr<video_frame> ret; ///< OUT - returned compressed tile, NULL if failed
+        uint64_t compress_start = 0; ///< frame-parallel mode only
+};
 
 namespace {
+/**
+ * @brief Persistent thread compressing one tile of each frame
+ *
+ * The tiles are handed over and returned through lock-free queues so that
+ * compress_frame_tiles() neither allocates nor waits for a pool worker.
+ */
+struct tile_worker {
+        /// @param cpu core to pin the thread to, -1 for none
+        explicit tile_worker(int cpu) : worker(&tile_worker::run, this)
+        {
+#ifdef HAVE_LINUX
+                if (cpu >= 0) {
+                        cpu_set_t set;
+                        CPU_ZERO(&set);
+                        CPU_SET(cpu, &set);
+                        pthread_setaffinity_np(worker.native_handle(), sizeof set, &set);
+                }
+#else
+                (void) cpu;
+#endif
+        }
+        ~tile_worker() {
+                in.push(nullptr); // poison
+                worker.join();
+        }
+        void run() {
+                set_thread_name("compress_tile");
+                compress_worker_data *data = nullptr;
+                while ((data = in.pop()) != nullptr) {
+                        if (data->callback != nullptr) { // otherwise frame-parallel mode poison
+                                module_set_mem_owner(data->state);
+                                compress_tile_callback(data);
+                        }
+                        data->frame = nullptr; // release the uncompressed frame early
+                        done.push(data);
+                }
+                module_set_mem_owner(nullptr);
+        }
+
+        lockfree_queue<compress_worker_data *, 1> in;
+        lockfree_queue<compress_worker_data *, 1> done;
+        lockfree_queue<compress_worker_data *, 1> idle; ///< frame-parallel mode - slot data when not in flight
+        thread worker;
+};
+
 /**
  * @brief This structure represents real internal compress state
  */
@@ -79,6 +145,7 @@ private:
         void          start(struct compress_state *proxy);
         void          async_consumer(struct compress_state *s);
         void          async_tile_consumer(struct compress_state *s);
+        void          frame_parallel_consumer(struct compress_state *s);
         thread        asynch_consumer_thread;
 public:
         static compress_state_real *create(struct module *parent, const char *config_string,
@@ -92,6 +159,14 @@ public:
         vector<struct module *> state;                  ///< driver internal states
         string              compress_options; ///< compress options (for reconfiguration)
         volatile bool       discard_frames;   ///< this class is no longer active
+        vector<unique_ptr<tile_worker>> tile_workers; ///< for compress_frame_tiles() and frame-parallel mode
+
+        unsigned            frame_threads = 1; ///< frames compressed in parallel (frame-parallel mode if > 1)
+        bool                frame_parallel_started = false;
+        unsigned            frame_seq = 0;   ///< number of frames submitted in frame-parallel mode
+        vector<compress_worker_data> frame_data; ///< frame-parallel mode per-worker data
+        void          frame_parallel_submit(shared_ptr<video_frame> frame, uint64_t t0);
+        bool          frame_parallel_start(struct compress_state *proxy);
 };
 }
 
@@ -104,10 +179,35 @@ public:
 struct compress_state {
         struct module mod;               ///< compress module data
         struct compress_state_real *ptr; ///< pointer to real compress state
-        synchronized_queue<shared_ptr<video_frame>, 1> queue;
+        lockfree_queue<shared_ptr<video_frame>, 1> queue;
         bool poisoned = false;
+        atomic<int> output_policy{COMPRESS_OUTPUT_BLOCK};
+        atomic<unsigned long long> output_drops{0};
+        atomic<bool> partial_output{false}; ///< consumer accepts frame parts (see compress_set_partial_output())
+        bool frame_partial = false;         ///< parts allowed for the frame being compressed
+        uint64_t frame_t0 = 0;              ///< compress start of the frame being compressed
 };
 
+/**
+ * Passes the compressed frame (nullptr for poison) to compress_pop(). With a
+ * "latest wins" policy, a frame still waiting in the queue is replaced
+ * instead of waiting for the consumer. Frames of an inter-frame codec are not
+ * discarded with COMPRESS_OUTPUT_LATEST_INTRA since the following frames
+ * would reference them. Frame parts are never replaced either.
+ */
+static void compress_output_push(struct compress_state *proxy, shared_ptr<video_frame> frame)
+{
+        int policy = proxy->output_policy.load(std::memory_order_relaxed);
+        if (frame && !frame->fragment && (policy == COMPRESS_OUTPUT_LATEST
+                                || (policy == COMPRESS_OUTPUT_LATEST_INTRA && !is_codec_interframe(frame->color_spec)))) {
+                if (proxy->queue.push_latest(std::move(frame))) {
+                        proxy->output_drops += 1;
+                }
+                return;
+        }
+        proxy->queue.push(std::move(frame));
+}
+
 static shared_ptr<video_frame> compress_frame_tiles(struct compress_state *proxy,
                 shared_ptr<video_frame> frame);
 static void compress_done(struct module *mod);
@@ -120,7 +220,9 @@ void show_compress_help(bool full)
 }
 
 static void async_poison(struct compress_state_real *s){
-        if (s->funcs->compress_frame_async_push_func) {
+        if (s->frame_parallel_started) {
+                s->frame_parallel_submit({}, 0);
+        } else if (s->funcs->compress_frame_async_push_func) {
                 s->funcs->compress_frame_async_push_func(s->state[0], {}); // poison
         } else if (s->funcs->compress_tile_async_push_func){
                 for(size_t i = 0; i < s->state.size(); i++){
@@ -198,6 +300,7 @@ static void compress_process_message(struct compress_state *proxy, struct msg_ch
 int compress_init(struct module *parent, const char *config_string, struct compress_state **state) {
         struct compress_state *proxy;
         proxy = new struct compress_state();
+        proxy->queue.set_name((std::string("compress_out:") + config_string).c_str());
 
         module_init_default(&proxy->mod);
         proxy->mod.cls = MODULE_CLASS_COMPRESS;
@@ -254,6 +357,14 @@ compress_state_real::compress_state_real(struct module *parent, const char *conf
 
         funcs = vci;
 
+        if (const char *threads = get_commandline_param("compress-frame-threads")) {
+                if (funcs->compress_frame_async_push_func || funcs->compress_tile_async_push_func) {
+                        LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Frame-parallel compression is not supported by " << compress_name << "\n";
+                } else {
+                        frame_threads = max(atoi(threads), 1);
+                }
+        }
+
         if (funcs->init_func) {
                 state.resize(1);
                 state[0] = funcs->init_func(parent, compress_options.c_str());
@@ -292,6 +403,71 @@ const char *get_compress_name(struct compress_state *proxy)
                 return NULL;
 }
 
+/**
+ * GPUJPEG and CUDA DXT encoders are currently the only ones taking input
+ * from device memory (CUDA_MEM), frames for other ones are downloaded by
+ * compress_frame().
+ *
+ * @param compress compress name or configuration string ("name[:opts]")
+ */
+bool compress_accepts_cuda_frames(const char *compress)
+{
+        for (const char *name : { "gpujpeg", "cuda_dxt" }) {
+                if (strncasecmp(compress, name, strlen(name)) == 0
+                                && (compress[strlen(name)] == '\0' || compress[strlen(name)] == ':')) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+/**
+ * Sets the policy of the queue between the compression and compress_pop(),
+ * may be changed while running.
+ */
+void compress_set_output_policy(struct compress_state *proxy, enum compress_output_policy policy)
+{
+        proxy->output_policy = policy;
+}
+
+/**
+ * Lets the compression modules supporting it pass the frames in parts to
+ * compress_pop(), so that the consumer can start sending the frame while it
+ * is still being compressed (see @ref video_compress). The consumer must then
+ * handle frames with video_frame::fragment set.
+ */
+void compress_set_partial_output(struct compress_state *proxy, bool enable)
+{
+        proxy->partial_output = enable;
+}
+
+/**
+ * @param compress_mod parent module passed to the compress init function
+ * @returns whether the frame being compressed may be passed in parts
+ */
+bool compress_partial_output_enabled(struct module *compress_mod)
+{
+        assert(compress_mod->cls == MODULE_CLASS_COMPRESS);
+        return static_cast<struct compress_state *>(compress_mod->priv_data)->frame_partial;
+}
+
+/**
+ * Passes a part of the frame being compressed to compress_pop() right away,
+ * may be called only if compress_partial_output_enabled(). The last part is
+ * returned by the compress function.
+ *
+ * @param compress_mod parent module passed to the compress init function
+ */
+void compress_output_partial(struct module *compress_mod, shared_ptr<video_frame> part)
+{
+        assert(compress_mod->cls == MODULE_CLASS_COMPRESS);
+        auto *proxy = static_cast<struct compress_state *>(compress_mod->priv_data);
+        assert(proxy->frame_partial && part->fragment && !part->last_fragment);
+        part->compress_start = proxy->frame_t0;
+        part->compress_end = time_since_epoch_in_ms();
+        proxy->queue.push(std::move(part));
+}
+
 /**
  * Checks if there are at least as many states as there are tiles.
  * If there are not enough states it initializes new ones. 
@@ -318,6 +494,87 @@ static bool check_state_count(unsigned tile_count, struct compress_state *proxy)
         return true;
 }
 
+ADD_TO_PARAM("compress-tile-affinity", "* compress-tile-affinity\n"
+                "  Pin per-tile compress threads to separate CPU cores (Linux only)\n");
+/**
+ * Ensures that there is a persistent worker for each of tile_count tiles.
+ */
+static void start_tile_workers(struct compress_state_real *s, size_t tile_count)
+{
+        if (s->tile_workers.size() >= tile_count) {
+                return;
+        }
+        vector<int> cpus;
+#ifdef HAVE_LINUX
+        cpu_set_t allowed;
+        if (get_commandline_param("compress-tile-affinity") != nullptr
+                        && sched_getaffinity(0, sizeof allowed, &allowed) == 0) {
+                for (int i = 0; i < CPU_SETSIZE; ++i) {
+                        if (CPU_ISSET(i, &allowed)) {
+                                cpus.push_back(i);
+                        }
+                }
+        }
+#endif
+        while (s->tile_workers.size() < tile_count) {
+                int cpu = cpus.empty() ? -1 : cpus[s->tile_workers.size() % cpus.size()];
+                s->tile_workers.emplace_back(new tile_worker(cpu));
+        }
+}
+
+/**
+ * @name Frame-parallel mode
+ * Successive single-tile frames are distributed round-robin to frame_threads
+ * compress instances (each with a persistent tile_worker). Since the workers
+ * are collected in the same order, the output keeps the input order.
+ * Suitable only for intra-frame compressions.
+ * @{
+ */
+ADD_TO_PARAM("compress-frame-threads", "* compress-frame-threads=<n>\n"
+                "  Compress <n> successive frames in parallel by separate compress instances\n"
+                "  (intra-frame compressions only, eg. uyvy or libavcodec MJPEG), adds up to <n>-1 frames of latency\n");
+/**
+ * Hands the frame (nullptr for poison) to the next worker in the round-robin
+ * order. Blocks while the worker's previous frame is in flight.
+ */
+void compress_state_real::frame_parallel_submit(shared_ptr<video_frame> frame, uint64_t t0)
+{
+        tile_worker &w = *tile_workers[frame_seq++ % frame_threads];
+        compress_worker_data *data = w.idle.pop();
+        data->frame = std::move(frame);
+        data->callback = !data->frame ? nullptr
+                : funcs->compress_frame_func ? funcs->compress_frame_func : funcs->compress_tile_func;
+        data->compress_start = t0;
+        w.in.push(data);
+}
+
+/// initializes compress instances, workers and consumer thread
+bool compress_state_real::frame_parallel_start(struct compress_state *proxy)
+{
+        while (state.size() < frame_threads) {
+                struct module *s = funcs->init_func(&proxy->mod, compress_options.c_str());
+                if (s == nullptr || s == INIT_NOERR) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Compression initialization failed, disabling frame-parallel mode\n";
+                        frame_threads = 1;
+                        return false;
+                }
+                state.push_back(s);
+        }
+        start_tile_workers(this, frame_threads);
+        frame_data.resize(frame_threads);
+        for (unsigned i = 0; i < frame_threads; ++i) {
+                frame_data[i].state = state[i];
+                tile_workers[i]->idle.push(&frame_data[i]);
+        }
+        asynch_consumer_thread = thread(&compress_state_real::frame_parallel_consumer, this, proxy);
+        frame_parallel_started = true;
+        return true;
+}
+
+/**
+ * @}
+ */
+
 /**
  * Puts frame for compression to queue and returns, result must be queried by
  * compress_pop().
@@ -336,6 +593,7 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
                 abort();
 
         uint64_t t0 = time_since_epoch_in_ms();
+        module_set_mem_owner(&proxy->mod);
 
         struct msg_change_compress_data *msg = NULL;
         while ((msg = (struct msg_change_compress_data *) check_message(&proxy->mod))) {
@@ -343,9 +601,20 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
         }
 
         struct compress_state_real *s = proxy->ptr;
+        // only the synchronous APIs compress the frame within this call
+        proxy->frame_partial = frame && proxy->partial_output && frame->tile_count == 1 && s->frame_threads == 1
+                && !s->funcs->compress_frame_async_push_func && !s->funcs->compress_tile_async_push_func;
+        proxy->frame_t0 = t0;
 
         if (!frame) {
                 proxy->poisoned = true;
+        } else if (frame->mem_location == CUDA_MEM && !compress_accepts_cuda_frames(s->funcs->name)) {
+                struct video_frame *host_frame = vf_download_cuda(frame.get());
+                if (host_frame == nullptr) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << s->funcs->name << " doesn't accept frames in CUDA memory, dropping!\n";
+                        return;
+                }
+                frame = shared_ptr<video_frame>(host_frame, vf_free);
         }
 
         if (s->funcs->compress_frame_async_push_func) {
@@ -353,7 +622,7 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
                 if (frame) {
                         frame->compress_start = t0;
                 }
-                s->funcs->compress_frame_async_push_func(s->state[0], frame);
+                s->funcs->compress_frame_async_push_func(s->state[0], vf_make_contiguous(frame));
         } else if (s->funcs->compress_tile_async_push_func) {
                 assert(s->funcs->compress_tile_async_pop_func);
                 if (!frame) {
@@ -372,12 +641,25 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
                 frame = NULL;
 
                 for(unsigned i = 0; i < separate_tiles.size(); i++){
-                        s->funcs->compress_tile_async_push_func(s->state[i], separate_tiles[i]);
+                        s->funcs->compress_tile_async_push_func(s->state[i], vf_make_contiguous(separate_tiles[i]));
                 }
 
         } else {
+                if (!s->funcs->compress_tile_func) {
+                        frame = vf_make_contiguous(frame);
+                }
+                if (s->frame_threads > 1 && (!frame || s->frame_parallel_started || s->frame_parallel_start(proxy))) {
+                        if (frame && frame->tile_count != 1) {
+                                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Frame-parallel mode supports only single-tile video!\n";
+                                return;
+                        }
+                        if (s->frame_parallel_started) {
+                                s->frame_parallel_submit(std::move(frame), t0);
+                                return;
+                        }
+                }
                 if (!frame) { // pass poisoned pill
-                        proxy->queue.push(shared_ptr<video_frame>());
+                        compress_output_push(proxy, shared_ptr<video_frame>());
                         return;
                 }
 
@@ -399,7 +681,7 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
                 sync_api_frame->compress_start = t0;
                 sync_api_frame->compress_end = time_since_epoch_in_ms();
 
-                proxy->queue.push(sync_api_frame);
+                compress_output_push(proxy, std::move(sync_api_frame));
         }
 }
 
@@ -408,17 +690,6 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
  * The worker callbacks here are optimization - all tiles are processed concurrently.
  * @{
  */
-/**
- * @brief Auxiliary structure passed to worker thread.
- */
-struct compress_worker_data {
-        struct module *state;      ///< compress driver status
-        shared_ptr<video_frame> frame; ///< uncompressed tile to be compressed
-
-        compress_tile_t callback;  ///< tile compress callback
-        shared_ptr<video_frame> ret; ///< OUT - returned compressed tile, NULL if failed
-};
-
 /**
  * @brief This function is callback passed to a "thread pool"
  * @param arg @ref compress_worker_data
@@ -427,7 +698,8 @@ struct compress_worker_data {
 static void *compress_tile_callback(void *arg) {
         compress_worker_data *s = (compress_worker_data *) arg;
 
-        s->ret = s->callback(s->state, s->frame);
+        // strided tiles (zero-copy split) are copied by the tile workers concurrently
+        s->ret = s->callback(s->state, vf_make_contiguous(s->frame));
 
         return s;
 }
@@ -452,7 +724,7 @@ static shared_ptr<video_frame> compress_frame_tiles(struct compress_state *proxy
         // frame pointer may no longer be valid
         frame = NULL;
 
-        vector<task_result_handle_t> task_handle(separate_tiles.size());
+        start_tile_workers(s, separate_tiles.size());
 
         vector <compress_worker_data> data_tile(separate_tiles.size());
         for(unsigned int i = 0; i < separate_tiles.size(); ++i) {
@@ -461,15 +733,14 @@ static shared_ptr<video_frame> compress_frame_tiles(struct compress_state *proxy
                 data->frame = separate_tiles[i];
                 data->callback = s->funcs->compress_tile_func;
 
-                task_handle[i] = task_run_async(compress_tile_callback, data);
+                s->tile_workers[i]->in.push(data);
         }
 
         vector<shared_ptr<video_frame>> compressed_tiles(separate_tiles.size());
 
         bool failed = false;
         for(unsigned int i = 0; i < separate_tiles.size(); ++i) {
-                struct compress_worker_data *data = (struct compress_worker_data *)
-                        wait_task(task_handle[i]);
+                struct compress_worker_data *data = s->tile_workers[i]->done.pop();
 
                 if(!data->ret) {
                         failed = true;
@@ -502,6 +773,9 @@ static void compress_done(struct module *mod)
         if (!proxy->poisoned) { // pass poisoned pill if it wasn't
                 compress_frame(proxy, {});
         }
+        if (proxy->output_drops > 0) {
+                LOG(LOG_LEVEL_INFO) << MOD_NAME << proxy->output_drops << " compressed frames replaced by newer ones before sending.\n";
+        }
 
         delete s;
         delete proxy;
@@ -512,6 +786,7 @@ compress_state_real::~compress_state_real()
         if (asynch_consumer_thread.joinable()) {
                 asynch_consumer_thread.join();
         }
+        tile_workers.clear();
 
         for(unsigned int i = 0; i < state.size(); ++i) {
                 module_done(state[i]);
@@ -535,7 +810,7 @@ void compress_state_real::async_tile_consumer(struct compress_state *s)
 
                         if (!ret) {
                                 if(!discard_frames)
-                                        s->queue.push(nullptr); //poison
+                                        compress_output_push(s, nullptr); //poison
                                 return;
                         }
 
@@ -563,20 +838,49 @@ void compress_state_real::async_tile_consumer(struct compress_state *s)
                         continue;
 
                 if (!discard_frames) {
-                        s->queue.push(vf_merge_tiles(compressed_tiles));
+                        compress_output_push(s, vf_merge_tiles(compressed_tiles));
                 }
                 //If frames are not numbered they always have seq = 0
                 if(expected_seq > 0) expected_seq++;
         }
 }
 
+/**
+ * Collects the frame-parallel mode output in the submission order.
+ */
+void compress_state_real::frame_parallel_consumer(struct compress_state *s)
+{
+        set_thread_name(__func__);
+        for (unsigned seq = 0; ; ++seq) {
+                tile_worker &w = *tile_workers[seq % frame_threads];
+                compress_worker_data *data = w.done.pop();
+                bool poisoned = data->callback == nullptr;
+                shared_ptr<video_frame> frame = std::move(data->ret);
+                uint64_t t0 = data->compress_start;
+                w.idle.push(data);
+
+                if (poisoned) {
+                        if (!discard_frames) {
+                                compress_output_push(s, nullptr);
+                        }
+                        return;
+                }
+                // failed compression is not passed - nullptr would be a poison
+                if (frame && !discard_frames) {
+                        frame->compress_start = t0;
+                        frame->compress_end = time_since_epoch_in_ms();
+                        compress_output_push(s, std::move(frame));
+                }
+        }
+}
+
 void compress_state_real::async_consumer(struct compress_state *s)
 {
         set_thread_name(__func__);
         while (true) {
                 auto frame = funcs->compress_frame_async_pop_func(state[0]);
                 if (!discard_frames) {
-                        s->queue.push(frame);
+                        compress_output_push(s, frame);
 
                 }
                 if (!frame) {
@@ -606,3 +910,21 @@ shared_ptr<video_frame> compress_pop(struct compress_state *proxy)
         return f;
 }
 
+/**
+ * As compress_pop() but waits for the frame only until the deadline.
+ *
+ * @param deadline_ns  get_time_in_ns() based
+ * @retval false       no frame was compressed until the deadline, frame is unchanged
+ */
+bool compress_pop_until(struct compress_state *proxy, long long deadline_ns, shared_ptr<video_frame> *frame)
+{
+        const long long timeout_ns = max(deadline_ns - get_time_in_ns(), 0LL);
+        if (!proxy->queue.timed_pop(*frame, std::chrono::nanoseconds(timeout_ns))) {
+                return false;
+        }
+        if (*frame) {
+                log_msg(LOG_LEVEL_DEBUG, "Compressed frame size: %8u; duration: %3" PRIu64 " ms\n", vf_get_data_len(frame->get()), (*frame)->compress_end - (*frame)->compress_start);
+        }
+        return true;
+}
+
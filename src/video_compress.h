@@ -62,6 +62,22 @@
  * s->mod.deleter = vcompress_xy_free;
  * module_register(&s->mod, s->parent);
  * ```
+ *
+ * #### Partial output
+ * A module may hand a compressed frame over in parts (eg. slices or NAL units)
+ * so that the transmission can start before the whole frame is compressed.
+ * This is allowed only for single-tile frames if compress_partial_output_enabled()
+ * returns true for the parent module passed to the init function - the consumer
+ * must have requested it with compress_set_partial_output(). Currently only the
+ * standard H.264/HEVC RTP transmission does so (tx_send_h264()), the UltraGrid
+ * RTP needs whole frames (every video packet carries the total length of the
+ * tile and FEC is computed over the whole buffer).
+ *
+ * The parts have video_frame::fragment set, the same video_frame::frame_fragment_id
+ * and tiles[0].offset set to the offset of the part in the frame. All parts
+ * except of the last one are passed with compress_output_partial() while
+ * compressing, the last one (with video_frame::last_fragment set) is returned
+ * as a normal compressed frame.
  */
 #ifndef __video_compress_h
 #define __video_compress_h
@@ -95,6 +111,19 @@ void show_compress_help(bool full);
 int compress_init(struct module *parent, const char *config_string, struct compress_state **);
 // documented at definition
 const char *get_compress_name(struct compress_state *);
+// documented at definition
+bool compress_accepts_cuda_frames(const char *compress);
+
+/// handling of a compressed frame when the previous one was not yet popped
+enum compress_output_policy {
+        COMPRESS_OUTPUT_BLOCK,        ///< compression waits for compress_pop() (default)
+        COMPRESS_OUTPUT_LATEST,       ///< the previous frame is discarded
+        COMPRESS_OUTPUT_LATEST_INTRA, ///< as COMPRESS_OUTPUT_LATEST but only for intra-frame codecs
+};
+// documented at definition
+void compress_set_output_policy(struct compress_state *, enum compress_output_policy);
+// documented at definition
+void compress_set_partial_output(struct compress_state *, bool enable);
 #ifdef __cplusplus
 }
 #endif
@@ -104,6 +133,8 @@ const char *get_compress_name(struct compress_state *);
 void compress_frame(struct compress_state *, std::shared_ptr<video_frame>);
 // documented at definition
 std::shared_ptr<video_frame> compress_pop(struct compress_state *);
+// documented at definition
+bool compress_pop_until(struct compress_state *, long long deadline_ns, std::shared_ptr<video_frame> *frame);
 
 //
 // Begins API for individual video compression modules
@@ -168,6 +199,11 @@ typedef void (*compress_tile_async_push_t)(struct module *state, std::shared_ptr
  */
 typedef  std::shared_ptr<video_frame> (*compress_tile_async_pop_t)(struct module *state);
 
+// documented at definition
+bool compress_partial_output_enabled(struct module *compress_mod);
+// documented at definition
+void compress_output_partial(struct module *compress_mod, std::shared_ptr<video_frame> part);
+
 struct module_option{
         std::string display_name; //Name displayed to user
         std::string display_desc; //Description displayed to user
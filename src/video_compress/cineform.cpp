@@ -70,9 +70,12 @@
 #include <time.h>
 #endif
 #include "utils/misc.h" // to_fourcc
+#include "utils/video_frame_pool.h"
+#include "utils/worker.h"
 
 #define DEFAULT_POOL_SIZE 16
 #define DEFAULT_THREAD_COUNT 8
+#define CONVERT_ROWS_PER_TASK 32
 #define MOD_NAME "[cineform] "
 
 struct state_video_compress_cineform{
@@ -89,6 +92,7 @@ struct state_video_compress_cineform{
         CFHD_EncodingQuality requested_quality;
         int requested_threads;
         int requested_pool_size;
+        int requested_in_flight; ///< max frames submitted to the encoder pool and not yet popped, 0 - pool size
 
         CFHD_EncoderPoolRef encoderPoolRef;
         CFHD_MetadataRef metadataRef;
@@ -96,7 +100,8 @@ struct state_video_compress_cineform{
         uint32_t frame_seq_in;
         uint32_t frame_seq_out;
 
-        std::queue<std::unique_ptr<video_frame, decltype(&vf_free)>> frame_queue;
+        std::unique_ptr<video_frame_pool> buffers; ///< precompress frames, bounded by requested_in_flight
+        std::queue<std::shared_ptr<video_frame>> frame_queue;
 
         bool started;
         bool stop;
@@ -129,11 +134,12 @@ struct {
         {"Quality", "quality", "specifies encode quality, range 1-6 (default: 4)", ":quality="},
         {"Threads", "num_threads", "specifies number of threads for encoding (default: " TOSTRING(DEFAULT_THREAD_COUNT) ")", ":num_threads="},
         {"Pool size", "pool_size", "specifies the size of encoding pool (default: " TOSTRING(DEFAULT_POOL_SIZE) ")", ":pool_size="},
+        {"In-flight frames", "in_flight", "max frames being encoded at once, push blocks when reached (default: pool size)", ":in_flight="},
 };
 
 static void usage() {
         printf("Cineform encoder usage:\n");
-        printf("\t-c cineform[:quality=<quality>][:threads=<num_threads>][:pool_size=<pool_size>]\n");
+        printf("\t-c cineform[:quality=<quality>][:threads=<num_threads>][:pool_size=<pool_size>][:in_flight=<in_flight>]\n");
 
         for(const auto& opt : usage_opts){
                 printf("\t\t<%s> %s\n", opt.key, opt.description);
@@ -162,6 +168,12 @@ static int parse_fmt(struct state_video_compress_cineform *s, char *fmt) {
                         } else if(strncasecmp("pool_size=", item, strlen("pool_size=")) == 0) {
                                 char *pool_size = item + strlen("pool_size=");
                                 s->requested_pool_size = atoi(pool_size);
+                        } else if(strncasecmp("in_flight=", item, strlen("in_flight=")) == 0) {
+                                s->requested_in_flight = atoi(item + strlen("in_flight="));
+                                if (s->requested_in_flight <= 0) {
+                                        log_msg(LOG_LEVEL_ERROR, "[cineform] Error: in_flight must be positive.\n");
+                                        return -1;
+                                }
                         } else {
                                 log_msg(LOG_LEVEL_ERROR, "[cineform] Error: unknown option %s.\n",
                                                 item);
@@ -193,7 +205,12 @@ static struct module * cineform_compress_init(struct module *parent, const char
                 return ret > 0 ? static_cast<module*>(INIT_NOERR) : nullptr;
         }
 
-        log_msg(LOG_LEVEL_NOTICE, "[cineform] : Threads: %d.\n", s->requested_threads);
+        if (s->requested_in_flight == 0) {
+                s->requested_in_flight = s->requested_pool_size;
+        }
+        s->buffers = std::make_unique<video_frame_pool>(s->requested_in_flight);
+
+        log_msg(LOG_LEVEL_NOTICE, "[cineform] : Threads: %d, in-flight frames: %d.\n", s->requested_threads, s->requested_in_flight);
         CFHD_Error status = CFHD_ERROR_OKAY;
         status = CFHD_CreateEncoderPool(&s->encoderPoolRef,
                         s->requested_threads,
@@ -260,6 +277,7 @@ static bool configure_with(struct state_video_compress_cineform *s, struct video
         }
         s->precompress_desc = desc;
         s->dec = get_best_decoder_from(desc.color_spec, to_convs, &s->precompress_desc.color_spec);
+        s->buffers->reconfigure(s->precompress_desc);
         LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Using " << get_codec_name(s->precompress_desc.color_spec) << " as intermediate.\n";
 
         CFHD_PixelFormat pix_fmt = CFHD_PIXEL_FORMAT_UNKNOWN;
@@ -331,20 +349,34 @@ static bool configure_with(struct state_video_compress_cineform *s, struct video
         return true;
 }
 
-static video_frame *get_copy(struct state_video_compress_cineform *s, video_frame *frame){
-        video_frame *ret = vf_alloc_desc_data(s->precompress_desc);
-        vf_copy_metadata(ret, frame); // seq and compress_start
-        int src_linesize = vc_get_linesize(frame->tiles[0].width, frame->color_spec);
-        int dst_linesize = vc_get_linesize(frame->tiles[0].width, ret->color_spec);
-        auto *dst = (unsigned char *) ret->tiles[0].data;
-        int dst_sign = 1;
+/// converts the frame to a pooled precompress buffer, rows are processed in parallel
+static std::shared_ptr<video_frame> get_copy(struct state_video_compress_cineform *s, video_frame *frame){
+        std::shared_ptr<video_frame> ret = s->buffers->get_frame();
+        vf_copy_metadata(ret.get(), frame); // seq and compress_start
+        struct convert_data {
+                decoder_t dec;
+                unsigned char *dst;
+                long dst_step;
+                const unsigned char *src;
+                int src_linesize;
+                int dst_linesize;
+        } d{};
+        d.dec = s->dec;
+        d.src = (const unsigned char *) frame->tiles[0].data;
+        d.src_linesize = vc_get_linesize(frame->tiles[0].width, frame->color_spec);
+        d.dst_linesize = vc_get_linesize(frame->tiles[0].width, ret->color_spec);
+        d.dst = (unsigned char *) ret->tiles[0].data;
+        d.dst_step = d.dst_linesize;
         if (s->precompress_desc.color_spec == RGB) { // upside down
-                dst += static_cast<size_t>(dst_linesize) * frame->tiles[0].height - 1;
-                dst_sign = -1;
-        }
-        for (unsigned i = 0; i < frame->tiles[0].height; ++i) {
-                s->dec(dst + dst_sign * i * dst_linesize, (unsigned char *) frame->tiles[0].data + i * src_linesize, dst_linesize, 16, 8, 0);
+                d.dst += static_cast<size_t>(d.dst_linesize) * (frame->tiles[0].height - 1);
+                d.dst_step = -d.dst_step;
         }
+        task_run_parallel_for(frame->tiles[0].height, CONVERT_ROWS_PER_TASK, [](void *udata, size_t begin, size_t end) {
+                auto *d = static_cast<convert_data *>(udata);
+                for (size_t i = begin; i < end; ++i) {
+                        d->dec(d->dst + (long) i * d->dst_step, d->src + i * d->src_linesize, d->dst_linesize, 16, 8, 0);
+                }
+        }, &d);
 
         return ret;
 }
@@ -364,7 +396,7 @@ static void cineform_compress_push(struct module *state, std::shared_ptr<video_f
                         video_desc desc{1920, 1080, UYVY, 25.0, PROGRESSIVE, 1};
                         configure_with(s, desc);
                 }
-                std::unique_ptr<video_frame, decltype(&vf_free)> dummy(vf_alloc_desc_data(s->precompress_desc), vf_free);
+                std::shared_ptr<video_frame> dummy(vf_alloc_desc_data(s->precompress_desc), vf_free);
                 video_frame *dummy_ptr = dummy.get();
 
                 lock.lock();
@@ -394,7 +426,7 @@ static void cineform_compress_push(struct module *state, std::shared_ptr<video_f
                 }
         }
 
-        std::unique_ptr<video_frame, decltype(&vf_free)> frame_copy(get_copy(s, tx.get()), vf_free);
+        std::shared_ptr<video_frame> frame_copy = get_copy(s, tx.get());
 
         video_frame *frame_ptr = frame_copy.get();
 
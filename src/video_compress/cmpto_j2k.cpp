@@ -42,6 +42,11 @@
  * the GPU is powerful enough due to the fact that CUDA registers the new
  * buffers which is very slow and because of that the frames cumulate before
  * the GPU encoder.
+ *
+ * Every CUDA device has its own encoder context. The frames are assigned to
+ * the device with the least frames in flight (see gpu_scheduler), counted
+ * over all instances, so that also the tiles (each tile has its own
+ * instance) or multiple streams are spread over the GPUs.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -55,6 +60,8 @@
 #include "lib_common.h"
 #include "module.h"
 #include "utils/color_out.h"
+#include "utils/frame_copy.h"
+#include "utils/gpu_scheduler.hpp"
 #include "utils/misc.h"
 #include "utils/video_frame_pool.h"
 #include "video_compress.h"
@@ -66,6 +73,7 @@
 #include <mutex>
 #include <queue>
 #include <utility>
+#include <vector>
 
 constexpr const char *MOD_NAME = "[Cmpto J2K enc.] ";
 
@@ -94,8 +102,14 @@ struct state_video_compress_j2k {
                 : rate{bitrate}, mct(mct), pool{pool_size}, max_in_frames{pool_size} {}
         struct module module_data{};
 
-        struct cmpto_j2k_enc_ctx *context{};
-        struct cmpto_j2k_enc_cfg *enc_settings{};
+        struct device_ctx {
+                struct cmpto_j2k_enc_ctx *context{};
+                struct cmpto_j2k_enc_cfg *enc_settings{};
+        };
+        vector<device_ctx> devices; ///< indexed as cuda_devices
+        queue<int> pending;         ///< devices of the frames being encoded in push order
+        bool stopped{};
+        condition_variable frame_pushed;
         long long int rate; ///< bitrate in bits per second
         int mct; // force use of mct - -1 means default
         video_frame_pool pool; ///< pool for frames allocated by us but not yet consumed by encoder
@@ -107,11 +121,25 @@ struct state_video_compress_j2k {
         video_desc precompress_desc{};
         video_desc compressed_desc{};
         void (*convertFunc)(video_frame *dst, video_frame *src){nullptr};
+        bool copy_input{}; ///< copy also frames that could be passed to the encoder directly
 };
 
 static void j2k_compressed_frame_dispose(struct video_frame *frame);
 static void j2k_compress_done(struct module *mod);
 
+static void j2k_destroy_contexts(struct state_video_compress_j2k *s)
+{
+        for (auto &dev : s->devices) {
+                if (dev.enc_settings) {
+                        cmpto_j2k_enc_cfg_destroy(dev.enc_settings);
+                }
+                if (dev.context) {
+                        cmpto_j2k_enc_ctx_destroy(dev.context);
+                }
+        }
+        s->devices.clear();
+}
+
 static void R12L_to_RG48(video_frame *dst, video_frame *src){
         int src_pitch = vc_get_linesize(src->tiles[0].width, src->color_spec);
         int dst_pitch = vc_get_linesize(dst->tiles[0].width, dst->color_spec);
@@ -163,25 +191,26 @@ static bool configure_with(struct state_video_compress_j2k *s, struct video_desc
                 return false;
         }
 
-        CHECK_OK(cmpto_j2k_enc_cfg_set_samples_format_type(s->enc_settings, sample_format),
-                        "Setting sample format", return false);
-        CHECK_OK(cmpto_j2k_enc_cfg_set_size(s->enc_settings, desc.width, desc.height),
-                        "Setting image size", return false);
-        if (s->rate) {
-                CHECK_OK(cmpto_j2k_enc_cfg_set_rate_limit(s->enc_settings,
-                                        CMPTO_J2K_ENC_COMP_MASK_ALL,
-                                        CMPTO_J2K_ENC_RES_MASK_ALL, s->rate / 8 / desc.fps),
-                                "Setting rate limit",
-                                NOOP);
-        }
-
         int mct = s->mct;
         if (mct == -1) {
                 mct = codec_is_a_rgb(desc.color_spec) ? 1 : 0;
         }
-        CHECK_OK(cmpto_j2k_enc_cfg_set_mct(s->enc_settings, mct),
-                        "Setting MCT",
-                        NOOP);
+        for (auto &dev : s->devices) {
+                CHECK_OK(cmpto_j2k_enc_cfg_set_samples_format_type(dev.enc_settings, sample_format),
+                                "Setting sample format", return false);
+                CHECK_OK(cmpto_j2k_enc_cfg_set_size(dev.enc_settings, desc.width, desc.height),
+                                "Setting image size", return false);
+                if (s->rate) {
+                        CHECK_OK(cmpto_j2k_enc_cfg_set_rate_limit(dev.enc_settings,
+                                                CMPTO_J2K_ENC_COMP_MASK_ALL,
+                                                CMPTO_J2K_ENC_RES_MASK_ALL, s->rate / 8 / desc.fps),
+                                        "Setting rate limit",
+                                        NOOP);
+                }
+                CHECK_OK(cmpto_j2k_enc_cfg_set_mct(dev.enc_settings, mct),
+                                "Setting MCT",
+                                NOOP);
+        }
 
         s->compressed_desc = desc;
         s->compressed_desc.color_spec = codec_is_a_rgb(desc.color_spec) ? J2KR : J2K;
@@ -192,13 +221,24 @@ static bool configure_with(struct state_video_compress_j2k *s, struct video_desc
         return true;
 }
 
-static shared_ptr<video_frame> get_copy(struct state_video_compress_j2k *s, video_frame *frame){
+/**
+ * @returns frame with the samples for the encoder - the input frame itself
+ * if it may be held until the encoder releases it, otherwise its copy
+ */
+static shared_ptr<video_frame> get_copy(struct state_video_compress_j2k *s, shared_ptr<video_frame> frame){
+        /* A frame without dispose callback is the capture's own buffer that
+         * is waited for to be released before grabbing the next frame, so
+         * keeping it during the (asynchronous) encoding would stall the capture. */
+        if (!s->convertFunc && !s->copy_input && frame->callbacks.dispose != nullptr) {
+                return frame;
+        }
+
         std::shared_ptr<video_frame> ret = s->pool.get_frame();
 
         if (s->convertFunc) {
-                s->convertFunc(ret.get(), frame);
+                s->convertFunc(ret.get(), frame.get());
         } else {
-                memcpy(ret->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
+                frame_copy(ret->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
         }
 
         return ret;
@@ -220,16 +260,31 @@ start:
 
         struct cmpto_j2k_enc_img *img;
         int status;
+        int dev;
+        bool failed = false;
+        {
+                unique_lock<mutex> lk(s->lock);
+                s->frame_pushed.wait(lk, [s]{return !s->pending.empty() || s->stopped;});
+                if (s->pending.empty()) { // stopped, nothing more to encode
+                        return {};
+                }
+                dev = s->pending.front();
+                s->pending.pop();
+        }
         CHECK_OK(cmpto_j2k_enc_ctx_get_encoded_img(
-                                s->context,
+                                s->devices[dev].context,
                                 1,
                                 &img /* Set to NULL if encoder stopped */,
-                                &status), "Encode image", HANDLE_ERROR_COMPRESS_POP);
+                                &status), "Encode image", failed = true);
+        gpu_scheduler::get_instance().release(s, cuda_devices[dev]);
         {
                 unique_lock<mutex> lk(s->lock);
                 s->in_frames--;
                 s->frame_popped.notify_one();
         }
+        if (failed) {
+                goto start;
+        }
         if (!img) {
                 // this happens cmpto_j2k_enc_ctx_stop() is called
                 // pass poison pill further
@@ -251,12 +306,12 @@ start:
         CHECK_OK(cmpto_j2k_enc_img_get_cstream(img, &ptr, &size),
                         "get cstream", HANDLE_ERROR_COMPRESS_POP);
 
+        // the output references the codestream of the image, which is destroyed with the frame
         struct video_frame *out = vf_alloc_desc(*desc);
         out->tiles[0].data_len = size;
-        out->tiles[0].data = (char *) malloc(size);
-        memcpy(out->tiles[0].data, ptr, size);
-        CHECK_OK(cmpto_j2k_enc_img_destroy(img), "Destroy image", NOOP);
+        out->tiles[0].data = (char *) ptr;
         out->callbacks.dispose = j2k_compressed_frame_dispose;
+        out->callbacks.dispose_udata = img;
         return shared_ptr<video_frame>(out, out->callbacks.dispose);
 }
 
@@ -273,6 +328,7 @@ struct {
         {"Tile limit", "tile_limit", "Number of tiles encoded at moment (less to reduce latency, more to increase performance, 0 means infinity), default: " TOSTRING(DEFAULT_TILE_LIMIT), ":tile_limit=", false},
         {"Pool size", "pool_size", "Total number of tiles encoder can hold at moment (same meaning as above), default: " TOSTRING(DEFAULT_POOL_SIZE) ", should be greater than <t>", ":pool_size=", false},
         {"Use MCT", "mct", "use MCT", ":mct", true},
+        {"Copy input", "copy_input", "copy the frames before encoding instead of holding the captured ones (for devices with few buffers)", ":copy_input", true},
 };
 
 static void usage() {
@@ -316,6 +372,7 @@ static struct module * j2k_compress_init(struct module *parent, const char *c_cf
         long long int mem_limit = DEFAULT_MEM_LIMIT;
         unsigned int tile_limit = DEFAULT_TILE_LIMIT;
         unsigned int pool_size = DEFAULT_POOL_SIZE;
+        bool copy_input = false;
 
         const auto *version = cmpto_j2k_enc_get_version();
         LOG(LOG_LEVEL_INFO) << MOD_NAME << "Using codec version: " << (version == nullptr ? "(unknown)" : version->name) << "\n";
@@ -337,6 +394,8 @@ static struct module * j2k_compress_init(struct module *parent, const char *c_cf
                         ASSIGN_CHECK_VAL(tile_limit, strchr(item, '=') + 1, 0);
                 } else if (strncasecmp("pool_size=", item, strlen("pool_size=")) == 0) {
                         ASSIGN_CHECK_VAL(pool_size, strchr(item, '=') + 1, 1);
+                } else if (strcasecmp("copy_input", item) == 0) {
+                        copy_input = true;
                 } else if (strcasecmp("help", item) == 0) {
                         usage();
                         return static_cast<module*>(INIT_NOERR);
@@ -352,35 +411,38 @@ static struct module * j2k_compress_init(struct module *parent, const char *c_cf
         }
 
         auto *s = new state_video_compress_j2k(bitrate, pool_size, mct);
+        s->copy_input = copy_input;
 
-        struct cmpto_j2k_enc_ctx_cfg *ctx_cfg;
-        CHECK_OK(cmpto_j2k_enc_ctx_cfg_create(&ctx_cfg), "Context configuration create",
-                        goto error);
+        s->devices.resize(cuda_devices_count);
         for (unsigned int i = 0; i < cuda_devices_count; ++i) {
+                auto &dev = s->devices[i];
+                struct cmpto_j2k_enc_ctx_cfg *ctx_cfg;
+                CHECK_OK(cmpto_j2k_enc_ctx_cfg_create(&ctx_cfg), "Context configuration create",
+                                goto error);
                 CHECK_OK(cmpto_j2k_enc_ctx_cfg_add_cuda_device(ctx_cfg, cuda_devices[i], mem_limit, tile_limit),
-                                "Setting CUDA device", goto error);
-        }
+                                "Setting CUDA device", cmpto_j2k_enc_ctx_cfg_destroy(ctx_cfg); goto error);
 
-        CHECK_OK(cmpto_j2k_enc_ctx_create(ctx_cfg, &s->context), "Context create",
-                        goto error);
-        CHECK_OK(cmpto_j2k_enc_ctx_cfg_destroy(ctx_cfg), "Context configuration destroy",
-                        NOOP);
-
-        CHECK_OK(cmpto_j2k_enc_cfg_create(
-                                s->context,
-                                &s->enc_settings),
-                        "Creating context configuration:",
-                        goto error);
-        CHECK_OK(cmpto_j2k_enc_cfg_set_quantization(
-                                s->enc_settings,
-                                quality /* 0.0 = poor quality, 1.0 = full quality */
-                                ),
-                        "Setting quantization",
-                        NOOP);
-
-        CHECK_OK(cmpto_j2k_enc_cfg_set_resolutions( s->enc_settings, 6),
-                        "Setting DWT levels",
-                        NOOP);
+                CHECK_OK(cmpto_j2k_enc_ctx_create(ctx_cfg, &dev.context), "Context create",
+                                cmpto_j2k_enc_ctx_cfg_destroy(ctx_cfg); goto error);
+                CHECK_OK(cmpto_j2k_enc_ctx_cfg_destroy(ctx_cfg), "Context configuration destroy",
+                                NOOP);
+
+                CHECK_OK(cmpto_j2k_enc_cfg_create(
+                                        dev.context,
+                                        &dev.enc_settings),
+                                "Creating context configuration:",
+                                goto error);
+                CHECK_OK(cmpto_j2k_enc_cfg_set_quantization(
+                                        dev.enc_settings,
+                                        quality /* 0.0 = poor quality, 1.0 = full quality */
+                                        ),
+                                "Setting quantization",
+                                NOOP);
+
+                CHECK_OK(cmpto_j2k_enc_cfg_set_resolutions(dev.enc_settings, 6),
+                                "Setting DWT levels",
+                                NOOP);
+        }
 
         module_init_default(&s->module_data);
         s->module_data.cls = MODULE_CLASS_DATA;
@@ -391,13 +453,15 @@ static struct module * j2k_compress_init(struct module *parent, const char *c_cf
         return &s->module_data;
 
 error:
+        j2k_destroy_contexts(s);
         delete s;
         return NULL;
 }
 
 static void j2k_compressed_frame_dispose(struct video_frame *frame)
 {
-        free(frame->tiles[0].data);
+        CHECK_OK(cmpto_j2k_enc_img_destroy((struct cmpto_j2k_enc_img *) frame->callbacks.dispose_udata),
+                        "Destroy image", NOOP);
         vf_free(frame);
 }
 
@@ -407,7 +471,8 @@ static void release_cstream(void * custom_data, size_t custom_data_size, const v
         ((shared_ptr<video_frame> *)(void *) ((char *) custom_data + sizeof(struct video_desc)))->~shared_ptr<video_frame>();
 }
 
-#define HANDLE_ERROR_COMPRESS_PUSH if (img) cmpto_j2k_enc_img_destroy(img); return
+#define HANDLE_ERROR_COMPRESS_PUSH if (img) cmpto_j2k_enc_img_destroy(img); \
+        gpu_scheduler::get_instance().release(s, cuda_devices[dev]); return
 static void j2k_compress_push(struct module *state, std::shared_ptr<video_frame> tx)
 {
         struct state_video_compress_j2k *s =
@@ -418,7 +483,12 @@ static void j2k_compress_push(struct module *state, std::shared_ptr<video_frame>
         shared_ptr<video_frame> *ref;
 
         if (tx == NULL) { // pass poison pill through encoder
-                CHECK_OK(cmpto_j2k_enc_ctx_stop(s->context), "stop", NOOP);
+                for (auto &d : s->devices) {
+                        CHECK_OK(cmpto_j2k_enc_ctx_stop(d.context), "stop", NOOP);
+                }
+                unique_lock<mutex> lk(s->lock);
+                s->stopped = true;
+                s->frame_pushed.notify_one();
                 return;
         }
 
@@ -434,8 +504,9 @@ static void j2k_compress_push(struct module *state, std::shared_ptr<video_frame>
 
         assert(tx->tile_count == 1); // TODO
 
-        CHECK_OK(cmpto_j2k_enc_img_create(s->context, &img),
-                        "Image create", return);
+        const int dev = gpu_scheduler::get_instance().acquire(s, cuda_devices, cuda_devices_count);
+        CHECK_OK(cmpto_j2k_enc_img_create(s->devices[dev].context, &img),
+                        "Image create", HANDLE_ERROR_COMPRESS_PUSH);
 
         /*
          * Copy video desc to udata (to be able to reconstruct in j2k_compress_pop().
@@ -452,7 +523,7 @@ static void j2k_compress_push(struct module *state, std::shared_ptr<video_frame>
         memcpy(udata, &s->compressed_desc, sizeof(s->compressed_desc));
 
         ref = (shared_ptr<video_frame> *)(void *)((char *) udata + sizeof(struct video_desc));
-        new (ref) shared_ptr<video_frame>(get_copy(s, tx.get()));
+        new (ref) shared_ptr<video_frame>(get_copy(s, tx));
 
         CHECK_OK(cmpto_j2k_enc_img_set_samples(img, ref->get()->tiles[0].data, ref->get()->tiles[0].data_len, release_cstream),
                         "Setting image samples", HANDLE_ERROR_COMPRESS_PUSH);
@@ -460,10 +531,12 @@ static void j2k_compress_push(struct module *state, std::shared_ptr<video_frame>
         unique_lock<mutex> lk(s->lock);
         s->frame_popped.wait(lk, [s]{return s->in_frames < s->max_in_frames;});
         lk.unlock();
-        CHECK_OK(cmpto_j2k_enc_img_encode(img, s->enc_settings),
-                        "Encode image", return);
+        CHECK_OK(cmpto_j2k_enc_img_encode(img, s->devices[dev].enc_settings),
+                        "Encode image", gpu_scheduler::get_instance().release(s, cuda_devices[dev]); return);
         lk.lock();
         s->in_frames++;
+        s->pending.push(dev);
+        s->frame_pushed.notify_one();
         lk.unlock();
 
 }
@@ -473,8 +546,7 @@ static void j2k_compress_done(struct module *mod)
         struct state_video_compress_j2k *s =
                 (struct state_video_compress_j2k *) mod->priv_data;
 
-        cmpto_j2k_enc_cfg_destroy(s->enc_settings);
-        cmpto_j2k_enc_ctx_destroy(s->context);
+        j2k_destroy_contexts(s);
 
         delete s;
 }
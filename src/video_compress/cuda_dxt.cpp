@@ -3,7 +3,7 @@
  * @author Martin Pulec  <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2012-2023 CESNET z. s. p. o.
+ * Copyright (c) 2012-2026 CESNET z. s. p. o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -41,6 +41,11 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <queue>
+
 #include "cuda_dxt/cuda_dxt.h"
 #include "cuda_wrapper.h"
 #include "debug.h"
@@ -52,6 +57,9 @@
 #include "video.h"
 #include "video_compress.h"
 
+#define MOD_NAME "[CUDA DXT] "
+#define PIPELINE_DEPTH 3 ///< frames in flight - upload, compression and download of subsequent frames overlap
+
 using namespace std;
 
 namespace {
@@ -66,24 +74,40 @@ struct cuda_buffer_data_allocator : public video_frame_pool_allocator {
                 return ptr;
         }
         void deallocate(void *ptr) override {
-                cuda_wrapper_free(ptr);
+                cuda_wrapper_free_host(ptr);
         }
         video_frame_pool_allocator *clone() const override {
                 return new cuda_buffer_data_allocator(*this);
         }
 };
 
+/**
+ * Resources of one frame in flight. All operations of the frame are enqueued
+ * to the slot's stream so that the slots run concurrently.
+ */
+struct cuda_dxt_slot {
+        cuda_wrapper_stream_t stream = nullptr;
+        char *host_in_buffer = nullptr;     ///< page-locked staging buffer for the (decoded) input
+        char *cuda_uyvy_buffer = nullptr;   ///< uploaded UYVY input (device memory)
+        char *cuda_in_buffer = nullptr;     ///< RGB or YUV 4:4:4 input of the encoder (device memory)
+        char *cuda_out_buffer = nullptr;    ///< compressed output (device memory)
+        shared_ptr<video_frame> in;         ///< CUDA_MEM input kept until the slot is finished
+        shared_ptr<video_frame> out;        ///< being downloaded to
+};
+
 struct state_video_compress_cuda_dxt {
         struct module       module_data;
         struct video_desc   saved_desc;
-        char               *in_buffer;      ///< for decoded data
-        char               *cuda_uyvy_buffer; ///< same as in_buffer but in device memory
-        char               *cuda_in_buffer;  ///< same as in_buffer but in device memory
-        char               *cuda_out_buffer;  ///< same as in_buffer but in device memory
         codec_t             in_codec;
         codec_t             out_codec;
         decoder_t           decoder;
 
+        cuda_dxt_slot       slots[PIPELINE_DEPTH];
+        int                 next_slot = 0;
+        queue<cuda_dxt_slot *> in_flight; ///< in submission order, nullptr is a poison
+        mutex               lock;
+        condition_variable  cv;
+
         video_frame_pool pool{0, cuda_buffer_data_allocator()};
 };
 
@@ -120,53 +144,40 @@ struct module *cuda_dxt_compress_init(struct module *parent,
 
 static void cleanup(struct state_video_compress_cuda_dxt *s)
 {
-        if (s->in_buffer) {
-                free(s->in_buffer);
-                s->in_buffer = NULL;
-        }
-        if (s->cuda_uyvy_buffer) {
-                cuda_wrapper_free(s->cuda_uyvy_buffer);
-                s->cuda_uyvy_buffer = NULL;
-        }
-        if (s->cuda_in_buffer) {
-                cuda_wrapper_free(s->cuda_in_buffer);
-                s->cuda_in_buffer = NULL;
-        }
-        if (s->cuda_out_buffer) {
-                cuda_wrapper_free(s->cuda_out_buffer);
-                s->cuda_out_buffer = NULL;
+        for (auto &slot : s->slots) {
+                if (slot.host_in_buffer) {
+                        cuda_wrapper_free_host(slot.host_in_buffer);
+                        slot.host_in_buffer = NULL;
+                }
+                if (slot.cuda_uyvy_buffer) {
+                        cuda_wrapper_free(slot.cuda_uyvy_buffer);
+                        slot.cuda_uyvy_buffer = NULL;
+                }
+                if (slot.cuda_in_buffer) {
+                        cuda_wrapper_free(slot.cuda_in_buffer);
+                        slot.cuda_in_buffer = NULL;
+                }
+                if (slot.cuda_out_buffer) {
+                        cuda_wrapper_free(slot.cuda_out_buffer);
+                        slot.cuda_out_buffer = NULL;
+                }
         }
 }
 
+/// must be called only if no frame is in flight
 static bool configure_with(struct state_video_compress_cuda_dxt *s, struct video_desc desc)
 {
         cleanup(s);
 
         if (get_bits_per_component(desc.color_spec) > 8) {
-                LOG(LOG_LEVEL_NOTICE) << "[CUDA DXT] Converting from " << get_bits_per_component(desc.color_spec) <<
+                LOG(LOG_LEVEL_NOTICE) << MOD_NAME "Converting from " << get_bits_per_component(desc.color_spec) <<
                         " to 8 bits. You may directly capture 8-bit signal to improve performance.\n";
         }
 
         codec_t supported_codecs[] = { RGB, UYVY, VIDEO_CODEC_NONE };
         s->decoder = get_best_decoder_from(desc.color_spec, supported_codecs, &s->in_codec);
         if (!s->decoder) {
-                fprintf(stderr, "Unsupported codec: %s\n", get_codec_name(desc.color_spec));
-                return false;
-        }
-
-        if (s->in_codec == UYVY) {
-                if (CUDA_WRAPPER_SUCCESS != cuda_wrapper_malloc((void **) &s->cuda_uyvy_buffer,
-                                        desc.width * desc.height * 2)) {
-                        fprintf(stderr, "Could not allocate CUDA UYVY buffer.\n");
-                        return false;
-                }
-        }
-
-        s->in_buffer = (char *) malloc(desc.width * desc.height * 3);
-
-        if (CUDA_WRAPPER_SUCCESS != cuda_wrapper_malloc((void **) &s->cuda_in_buffer,
-                                desc.width * desc.height * 3)) {
-                fprintf(stderr, "Could not allocate CUDA output buffer.\n");
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported codec: %s\n", get_codec_name(desc.color_spec));
                 return false;
         }
 
@@ -174,71 +185,93 @@ static bool configure_with(struct state_video_compress_cuda_dxt *s, struct video
         compressed_desc.color_spec = s->out_codec;
         compressed_desc.tile_count = 1;
         size_t data_len = desc.width * desc.height / (s->out_codec == DXT1 ? 2 : 1);
+        size_t in_len = vc_get_datalen(desc.width, desc.height, s->in_codec);
 
         s->pool.reconfigure(compressed_desc, data_len);
 
-        if (CUDA_WRAPPER_SUCCESS != cuda_wrapper_malloc((void **)
-                                &s->cuda_out_buffer,
-                                data_len)) {
-                fprintf(stderr, "Could not allocate CUDA output buffer.\n");
-                return false;
+        for (auto &slot : s->slots) {
+                if (!slot.stream && cuda_wrapper_stream_create(&slot.stream) != CUDA_WRAPPER_SUCCESS) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Could not create CUDA stream: %s\n", cuda_wrapper_last_error_string());
+                        return false;
+                }
+                if (CUDA_WRAPPER_SUCCESS != cuda_wrapper_malloc_host((void **) &slot.host_in_buffer, in_len)) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Could not allocate host input buffer.\n");
+                        return false;
+                }
+                if (s->in_codec == UYVY) {
+                        if (CUDA_WRAPPER_SUCCESS != cuda_wrapper_malloc((void **) &slot.cuda_uyvy_buffer,
+                                                in_len)) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Could not allocate CUDA UYVY buffer.\n");
+                                return false;
+                        }
+                }
+                if (CUDA_WRAPPER_SUCCESS != cuda_wrapper_malloc((void **) &slot.cuda_in_buffer,
+                                        desc.width * desc.height * 3)) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Could not allocate CUDA input buffer.\n");
+                        return false;
+                }
+                if (CUDA_WRAPPER_SUCCESS != cuda_wrapper_malloc((void **)
+                                        &slot.cuda_out_buffer,
+                                        data_len)) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Could not allocate CUDA output buffer.\n");
+                        return false;
+                }
         }
 
         return true;
 }
 
-shared_ptr<video_frame> cuda_dxt_compress_tile(struct module *mod, shared_ptr<video_frame> tx)
+/**
+ * Enqueues upload, compression and download of the tile to the slot's stream.
+ * Input residing in CUDA memory (CUDA_MEM) is passed to the kernels directly.
+ */
+static bool submit(struct state_video_compress_cuda_dxt *s, cuda_dxt_slot *slot,
+                const shared_ptr<video_frame> &tx)
 {
-        struct state_video_compress_cuda_dxt *s =
-                (struct state_video_compress_cuda_dxt *) mod->priv_data;
-
-        cuda_wrapper_set_device(cuda_devices[0]);
-
-        if (!video_desc_eq_excl_param(video_desc_from_frame(tx.get()),
-                                s->saved_desc, PARAM_TILE_COUNT)) {
-                if(configure_with(s, video_desc_from_frame(tx.get()))) {
-                        s->saved_desc = video_desc_from_frame(tx.get());
-                } else {
-                        fprintf(stderr, "[CUDA DXT] Reconfiguration failed!\n");
-                        return NULL;
+        const bool on_device = tx->mem_location == CUDA_MEM;
+        const struct tile *tile = &tx->tiles[0];
+        const size_t in_len = vc_get_datalen(tile->width, tile->height, s->in_codec);
+        const char *in_buffer = tile->data;
+
+        if (tx->color_spec != s->in_codec) {
+                if (on_device) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot convert %s in CUDA memory, only RGB and UYVY are accepted!\n",
+                                        get_codec_name(tx->color_spec));
+                        return false;
                 }
-        }
+                auto *line1 = (const unsigned char *) tile->data;
+                auto *line2 = (unsigned char *) slot->host_in_buffer;
 
-        char *in_buffer;
-        if (tx->color_spec == s->in_codec) {
-                in_buffer = tx->tiles[0].data;
-        } else {
-                unsigned char *line1 = (unsigned char *) tx->tiles[0].data;
-                unsigned char *line2 = (unsigned char *) s->in_buffer;
-
-                for (int i = 0; i < (int) tx->tiles[0].height; ++i) {
-                        s->decoder(line2, line1, vc_get_linesize(tx->tiles[0].width,
+                for (int i = 0; i < (int) tile->height; ++i) {
+                        s->decoder(line2, line1, vc_get_linesize(tile->width,
                                                 s->in_codec), 0, 8, 16);
-                        line1 += vc_get_linesize(tx->tiles[0].width, tx->color_spec);
-                        line2 += vc_get_linesize(tx->tiles[0].width, s->in_codec);
+                        line1 += vc_get_linesize(tile->width, tx->color_spec);
+                        line2 += vc_get_linesize(tile->width, s->in_codec);
                 }
-                in_buffer = s->in_buffer;
+                in_buffer = slot->host_in_buffer;
+        } else if (!on_device) {
+                // copy to page-locked memory to make the upload asynchronous
+                memcpy(slot->host_in_buffer, tile->data, in_len);
+                in_buffer = slot->host_in_buffer;
         }
 
-        if (s->in_codec == UYVY) {
-                if (cuda_wrapper_memcpy(s->cuda_uyvy_buffer, in_buffer, tx->tiles[0].width *
-                                        tx->tiles[0].height * 2,
-                                        CUDA_WRAPPER_MEMCPY_HOST_TO_DEVICE) != CUDA_WRAPPER_SUCCESS) {
-                        fprintf(stderr, "Memcpy failed: %s\n", cuda_wrapper_last_error_string());
-                        return NULL;
-                }
-                if (cuda_yuv422_to_yuv444(s->cuda_uyvy_buffer, s->cuda_in_buffer,
-                                        tx->tiles[0].width *
-                                        tx->tiles[0].height, 0) != CUDA_WRAPPER_SUCCESS) {
-                        fprintf(stderr, "Kernel failed: %s\n", cuda_wrapper_last_error_string());
+        const char *enc_in = in_buffer;
+        if (!on_device) {
+                char *upload_dst = s->in_codec == UYVY ? slot->cuda_uyvy_buffer : slot->cuda_in_buffer;
+                if (cuda_wrapper_memcpy_async(upload_dst, in_buffer, in_len,
+                                        CUDA_WRAPPER_MEMCPY_HOST_TO_DEVICE, slot->stream) != CUDA_WRAPPER_SUCCESS) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Memcpy failed: %s\n", cuda_wrapper_last_error_string());
+                        return false;
                 }
-        } else {
-                if (cuda_wrapper_memcpy(s->cuda_in_buffer, in_buffer, tx->tiles[0].width *
-                                        tx->tiles[0].height * 3,
-                                        CUDA_WRAPPER_MEMCPY_HOST_TO_DEVICE) != CUDA_WRAPPER_SUCCESS) {
-                        fprintf(stderr, "Memcpy failed: %s\n", cuda_wrapper_last_error_string());
-                        return NULL;
+                enc_in = upload_dst;
+        }
+        if (s->in_codec == UYVY) {
+                if (cuda_yuv422_to_yuv444(enc_in, slot->cuda_in_buffer,
+                                        tile->width * tile->height, slot->stream) != CUDA_WRAPPER_SUCCESS) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Kernel failed: %s\n", cuda_wrapper_last_error_string());
+                        return false;
                 }
+                enc_in = slot->cuda_in_buffer;
         }
 
         int (*cuda_dxt_enc_func)(const void * src, void * out, int size_x, int size_y,
@@ -257,23 +290,108 @@ shared_ptr<video_frame> cuda_dxt_compress_tile(struct module *mod, shared_ptr<vi
                         cuda_dxt_enc_func = cuda_yuv_to_dxt6;
                 }
         }
-        int ret = cuda_dxt_enc_func(s->cuda_in_buffer, s->cuda_out_buffer,
-                        s->saved_desc.width, s->saved_desc.height, 0);
+        int ret = cuda_dxt_enc_func(enc_in, slot->cuda_out_buffer,
+                        s->saved_desc.width, s->saved_desc.height, slot->stream);
         if (ret != 0) {
-                fprintf(stderr, "Encoding failed: %s\n", cuda_wrapper_last_error_string());
-                return NULL;
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Encoding failed: %s\n", cuda_wrapper_last_error_string());
+                return false;
         }
 
         shared_ptr<video_frame> out = s->pool.get_frame();
-        if (cuda_wrapper_memcpy(out->tiles[0].data,
-                                s->cuda_out_buffer,
+        if (cuda_wrapper_memcpy_async(out->tiles[0].data,
+                                slot->cuda_out_buffer,
                                 out->tiles[0].data_len,
-                                CUDA_WRAPPER_MEMCPY_DEVICE_TO_HOST) != CUDA_WRAPPER_SUCCESS) {
-                fprintf(stderr, "Memcpy failed: %s\n", cuda_wrapper_last_error_string());
-                return NULL;
+                                CUDA_WRAPPER_MEMCPY_DEVICE_TO_HOST, slot->stream) != CUDA_WRAPPER_SUCCESS) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Memcpy failed: %s\n", cuda_wrapper_last_error_string());
+                return false;
+        }
+        vf_copy_metadata(out.get(), tx.get());
+        slot->out = std::move(out);
+        if (on_device) {
+                slot->in = tx;
+        }
+
+        return true;
+}
+
+/**
+ * Enqueues the tile to a free slot, blocks only if PIPELINE_DEPTH tiles are
+ * in flight. Tiles that fail to be submitted are dropped.
+ */
+void cuda_dxt_compress_push(struct module *mod, shared_ptr<video_frame> tx)
+{
+        struct state_video_compress_cuda_dxt *s =
+                (struct state_video_compress_cuda_dxt *) mod->priv_data;
+
+        unique_lock<mutex> lk(s->lock);
+        if (!tx) {
+                s->in_flight.push(nullptr);
+                s->cv.notify_all();
+                return;
+        }
+
+        cuda_wrapper_set_device(cuda_devices[0]);
+
+        if (!video_desc_eq_excl_param(video_desc_from_frame(tx.get()),
+                                s->saved_desc, PARAM_TILE_COUNT)) {
+                s->cv.wait(lk, [s] { return s->in_flight.empty(); });
+                if(configure_with(s, video_desc_from_frame(tx.get()))) {
+                        s->saved_desc = video_desc_from_frame(tx.get());
+                } else {
+                        s->saved_desc = {};
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Reconfiguration failed!\n");
+                        return;
+                }
         }
 
-        return out;
+        s->cv.wait(lk, [s] { return s->in_flight.size() < PIPELINE_DEPTH; });
+        cuda_dxt_slot *slot = &s->slots[s->next_slot];
+        lk.unlock();
+        bool ok = submit(s, slot, tx);
+        lk.lock();
+        if (!ok) {
+                slot->out = {};
+                slot->in = {};
+                return;
+        }
+        s->next_slot = (s->next_slot + 1) % PIPELINE_DEPTH;
+        s->in_flight.push(slot);
+        s->cv.notify_all();
+}
+
+/// @returns the oldest tile in flight once its stream finishes, empty pointer on poison
+shared_ptr<video_frame> cuda_dxt_compress_pop(struct module *mod)
+{
+        struct state_video_compress_cuda_dxt *s =
+                (struct state_video_compress_cuda_dxt *) mod->priv_data;
+
+        cuda_wrapper_set_device(cuda_devices[0]);
+
+        while (true) {
+                unique_lock<mutex> lk(s->lock);
+                s->cv.wait(lk, [s] { return !s->in_flight.empty(); });
+                cuda_dxt_slot *slot = s->in_flight.front();
+                if (slot == nullptr) {
+                        s->in_flight.pop();
+                        return {};
+                }
+                lk.unlock();
+
+                int ret = cuda_wrapper_stream_synchronize(slot->stream);
+                shared_ptr<video_frame> out = std::move(slot->out);
+                slot->in = {};
+
+                lk.lock();
+                s->in_flight.pop();
+                s->cv.notify_all();
+                lk.unlock();
+
+                if (ret != CUDA_WRAPPER_SUCCESS) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Compression failed: %s\n", cuda_wrapper_get_error_string(ret));
+                        continue;
+                }
+                return out;
+        }
 }
 
 static void cuda_dxt_compress_done(struct module *mod)
@@ -281,6 +399,14 @@ static void cuda_dxt_compress_done(struct module *mod)
         struct state_video_compress_cuda_dxt *s =
                 (struct state_video_compress_cuda_dxt *) mod->priv_data;
 
+        for (auto &slot : s->slots) {
+                if (slot.stream) {
+                        cuda_wrapper_stream_synchronize(slot.stream);
+                        cuda_wrapper_stream_destroy(slot.stream);
+                }
+                slot.in = {};
+                slot.out = {};
+        }
         cleanup(s);
 
         delete s;
@@ -290,11 +416,11 @@ const struct video_compress_info cuda_dxt_info = {
         "cuda_dxt",
         cuda_dxt_compress_init,
         NULL,
-        cuda_dxt_compress_tile,
-        NULL,
         NULL,
         NULL,
         NULL,
+        cuda_dxt_compress_push,
+        cuda_dxt_compress_pop,
         NULL
 };
 
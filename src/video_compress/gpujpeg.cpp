@@ -42,12 +42,17 @@
 #endif // HAVE_CONFIG_H
 
 #include "compat/platform_time.h"
+#ifdef HAVE_CUDA
+#include "cuda_wrapper.h"
+#include "utils/cuda_pix_conv.h"
+#endif
 #include "debug.h"
 #include "host.h"
 #include "video_compress.h"
 #include "module.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
+#include "utils/gpu_scheduler.hpp"
 #include "utils/synchronized_queue.h"
 #include "utils/video_frame_pool.h"
 #include "video.h"
@@ -58,7 +63,6 @@
 #include <libgpujpeg/gpujpeg_version.h>
 #include <memory>
 #include <map>
-#include <mutex>
 #include <thread>
 #include <set>
 #include <vector>
@@ -74,6 +78,10 @@ using namespace std;
 namespace {
 struct state_video_compress_gpujpeg;
 
+/// converts pixel format on the GPU, both buffers are in device memory
+typedef void (*gpu_conv_t)(unsigned char *dst, size_t dstPitch, unsigned char *src,
+                size_t srcPitch, size_t width, size_t height, struct CUstream_st *stream);
+
 /**
  * @brief state for single instance of encoder running on one GPU
  */
@@ -82,6 +90,7 @@ private:
         void cleanup_state();
         shared_ptr<video_frame> compress_step(shared_ptr<video_frame> frame);
         bool configure_with(struct video_desc desc);
+        uint8_t *gpu_convert(struct tile *in_tile, bool on_device);
 
         struct state_video_compress_gpujpeg        *m_parent_state;
         int                                      m_device_id;
@@ -91,13 +100,16 @@ private:
         decoder_t                                m_decoder;
         codec_t                                  m_enc_input_codec{};
         unique_ptr<char []>                      m_decoded;
+        gpu_conv_t                               m_gpu_conv{}; ///< used instead of m_decoder if set
+        unsigned char                           *m_cuda_raw{}; ///< uploaded input of m_gpu_conv
+        unsigned char                           *m_cuda_converted{}; ///< output of m_gpu_conv
 
         struct gpujpeg_parameters                m_encoder_param{};
         struct gpujpeg_image_parameters          m_param_image{};
 public:
         encoder_state(struct state_video_compress_gpujpeg *s, int device_id) :
                 m_parent_state(s), m_device_id(device_id), m_encoder{}, m_saved_desc{},
-                m_decoder{}, m_occupied{}
+                m_decoder{}
         {
         }
         ~encoder_state() {
@@ -108,7 +120,6 @@ public:
 
         synchronized_queue<shared_ptr<struct video_frame>, 1> m_in_queue; ///< queue for uncompressed frames
         thread                                   m_thread_id;
-        bool                                     m_occupied; ///< protected by state_video_compress_gpujpeg::m_occupancy_lock
 };
 
 struct state_video_compress_gpujpeg {
@@ -150,8 +161,6 @@ public:
         enum gpujpeg_color_space m_use_internal_codec = GPUJPEG_NONE; // requested internal codec
 
         synchronized_queue<shared_ptr<struct video_frame>, 1> m_out_queue; ///< queue for compressed frames
-        mutex                                                 m_occupancy_lock;
-        condition_variable                                    m_worker_finished;
 };
 
 /**
@@ -198,10 +207,7 @@ void encoder_state::worker() {
 
                 compress(std::move(frame));
 
-                unique_lock<mutex> lk(m_parent_state->m_occupancy_lock);
-                m_occupied = false;
-                lk.unlock();
-                m_parent_state->m_worker_finished.notify_one();
+                gpu_scheduler::get_instance().release(m_parent_state, m_device_id);
         }
 }
 
@@ -216,6 +222,35 @@ static decoder_t get_decoder(codec_t in_codec, codec_t *out_codec)
         return get_best_decoder_from(in_codec, candidate_codecs, out_codec);
 }
 
+/**
+ * @returns GPU conversion for formats that GPUJPEG doesn't accept and whose
+ * CPU conversion is expensive (10+ bit), nullptr if there is none
+ */
+static gpu_conv_t get_gpu_conv(codec_t in_codec, codec_t *out_codec)
+{
+#ifdef HAVE_CUDA
+        const struct {
+                codec_t in;
+                codec_t out;
+                gpu_conv_t conv;
+        } convs[] = {
+                { v210, UYVY, cuda_v210_to_UYVY },
+                { Y216, UYVY, cuda_Y216_to_UYVY },
+                { R10k, RGB, cuda_R10k_to_RGB },
+                { RG48, RGB, cuda_RG48_to_RGB },
+        };
+        for (const auto &c : convs) {
+                if (c.in == in_codec) {
+                        *out_codec = c.out;
+                        return c.conv;
+                }
+        }
+#else
+        UNUSED(in_codec), UNUSED(out_codec);
+#endif
+        return nullptr;
+}
+
 /**
  * Configures GPUJPEG encoder with provided parameters.
  */
@@ -236,6 +271,17 @@ bool encoder_state::configure_with(struct video_desc desc)
 #endif
                 m_decoder = nullptr;
                 m_enc_input_codec = desc.color_spec;
+        } else if ((m_gpu_conv = get_gpu_conv(desc.color_spec, &m_enc_input_codec)) != nullptr) {
+#ifdef HAVE_CUDA
+                m_decoder = nullptr;
+                if (cuda_wrapper_malloc((void **) &m_cuda_raw, vc_get_datalen(desc.width, desc.height, desc.color_spec)) != CUDA_WRAPPER_SUCCESS ||
+                                cuda_wrapper_malloc((void **) &m_cuda_converted, vc_get_datalen(desc.width, desc.height, m_enc_input_codec)) != CUDA_WRAPPER_SUCCESS) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot allocate CUDA conversion buffers: %s\n", cuda_wrapper_last_error_string());
+                        return false;
+                }
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Converting %s to %s on GPU.\n", get_codec_name(desc.color_spec),
+                                get_codec_name(m_enc_input_codec));
+#endif
         } else {
                 m_decoder = get_decoder(desc.color_spec, &m_enc_input_codec);
                 if (!m_decoder) {
@@ -543,7 +589,12 @@ shared_ptr<video_frame> encoder_state::compress_step(shared_ptr<video_frame> tx)
                 struct tile *out_tile = vf_get_tile(out.get(), x);
                 uint8_t *jpeg_enc_input_data;
 
-                if (m_decoder && m_decoder != vc_memcpy) {
+                if (m_gpu_conv) {
+                        jpeg_enc_input_data = gpu_convert(in_tile, tx->mem_location == CUDA_MEM);
+                        if (jpeg_enc_input_data == nullptr) {
+                                return {};
+                        }
+                } else if (m_decoder && m_decoder != vc_memcpy) {
                         assert(tx.get()->mem_location == CPU_MEM);
                         unsigned char *line1 = (unsigned char *) in_tile->data;
                         unsigned char *line2 = (unsigned char *) m_decoded.get();
@@ -566,7 +617,7 @@ shared_ptr<video_frame> encoder_state::compress_step(shared_ptr<video_frame> tx)
                 int ret;
 
                 struct gpujpeg_encoder_input encoder_input;
-                if(tx.get()->mem_location == CUDA_MEM){
+                if(tx.get()->mem_location == CUDA_MEM || m_gpu_conv){
                         gpujpeg_encoder_input_set_gpu_image(&encoder_input, jpeg_enc_input_data);
                 } else {
                         gpujpeg_encoder_input_set_image(&encoder_input, jpeg_enc_input_data);
@@ -585,11 +636,55 @@ shared_ptr<video_frame> encoder_state::compress_step(shared_ptr<video_frame> tx)
         return out;
 }
 
+/**
+ * Uploads the tile (unless already on the device) and converts it with
+ * m_gpu_conv.
+ * @returns converted image in device memory, nullptr on error
+ */
+uint8_t *encoder_state::gpu_convert(struct tile *in_tile, bool on_device)
+{
+#ifdef HAVE_CUDA
+        auto *src = (unsigned char *) in_tile->data;
+        const size_t src_len = vc_get_datalen(in_tile->width, in_tile->height, m_saved_desc.color_spec);
+        if (!on_device) {
+                if (cuda_wrapper_memcpy(m_cuda_raw, in_tile->data, src_len,
+                                        CUDA_WRAPPER_MEMCPY_HOST_TO_DEVICE) != CUDA_WRAPPER_SUCCESS) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Upload failed: %s\n", cuda_wrapper_last_error_string());
+                        return nullptr;
+                }
+                src = m_cuda_raw;
+        }
+        m_gpu_conv(m_cuda_converted, vc_get_linesize(in_tile->width, m_enc_input_codec), src,
+                        vc_get_linesize(in_tile->width, m_saved_desc.color_spec), in_tile->width, in_tile->height, nullptr);
+        // the encoder may use a non-blocking stream
+        int ret = cuda_wrapper_stream_synchronize(nullptr);
+        if (ret != CUDA_WRAPPER_SUCCESS) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Conversion failed: %s\n", cuda_wrapper_get_error_string(ret));
+                return nullptr;
+        }
+        return m_cuda_converted;
+#else
+        UNUSED(in_tile), UNUSED(on_device);
+        return nullptr;
+#endif
+}
+
 void encoder_state::cleanup_state()
 {
         if (m_encoder)
                 gpujpeg_encoder_destroy(m_encoder);
         m_encoder = NULL;
+#ifdef HAVE_CUDA
+        if (m_cuda_raw) {
+                cuda_wrapper_free(m_cuda_raw);
+                m_cuda_raw = nullptr;
+        }
+        if (m_cuda_converted) {
+                cuda_wrapper_free(m_cuda_converted);
+                m_cuda_converted = nullptr;
+        }
+#endif
+        m_gpu_conv = nullptr;
 }
 
 void state_video_compress_gpujpeg::push(std::shared_ptr<video_frame> in_frame)
@@ -607,19 +702,8 @@ void state_video_compress_gpujpeg::push(std::shared_ptr<video_frame> in_frame)
                                 worker->m_in_queue.push({});
                         }
                 } else {
-                        int index;
-                        unique_lock<mutex> lk(m_occupancy_lock);
-                        // wait for/select not occupied worker
-                        m_worker_finished.wait(lk, [this, &index]{
-                                        index = 0;
-                                        for (auto worker : m_workers) {
-                                        if (!worker->m_occupied) return true;
-                                        index++;
-                                        }
-                                        return false;
-                                        });
-                        m_workers[index]->m_occupied = true;
-                        lk.unlock();
+                        // wait for a not occupied worker, prefer the GPU least loaded by all encoders
+                        int index = gpu_scheduler::get_instance().acquire(this, cuda_devices, cuda_devices_count, 1);
                         m_workers[index]->m_in_queue.push(in_frame);
                 }
         }
@@ -46,6 +46,7 @@
 #include <array>
 #include <cassert>
 #include <cmath>
+#include <deque>
 #include <list>
 #include <map>
 #include <regex>
@@ -55,6 +56,7 @@
 #include <string_view>
 #include <thread>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "debug.h"
@@ -152,6 +154,26 @@ static void usage(void);
 static int parse_fmt(struct state_video_compress_libav *s, char *fmt);
 static void cleanup(struct state_video_compress_libav *s);
 
+/**
+ * Opened encoder with everything that depends on the input format. Sessions
+ * for the previous formats are kept open (see "lavc-session-cache") so that
+ * switching back doesn't need to reopen the encoder (and hw device), which
+ * takes hundreds of ms with hw encoders.
+ */
+struct lavc_session {
+        struct video_desc   saved_desc{};
+        struct video_desc   compressed_desc{};
+        AVCodecContext     *codec_ctx = nullptr;
+        struct to_lavc_vid_conv *pixfmt_conversion = nullptr;
+        bool                hwenc = false;
+        AVFrame            *hwframe = nullptr;
+        bool                hwmap = false;
+#ifdef HAVE_SWSCALE
+        struct SwsContext  *sws_ctx = nullptr;
+        AVFrame            *sws_frame = nullptr;
+#endif
+};
+
 static map<codec_t, codec_params_t> codec_params = {
         { H264, codec_params_t{
                 [](bool is_rgb) { return is_rgb ? "libx264rgb" : "libx264"; },
@@ -266,7 +288,9 @@ struct state_video_compress_libav {
 
         bool hwenc = false;
         bool store_orig_format = false;
+        unsigned int part_frame_id = 0; ///< video_frame::frame_fragment_id of frames passed in parts
         AVFrame *hwframe = nullptr;
+        bool hwmap = false; ///< convert directly to a mapped HW surface
 
 #ifdef HAVE_SWSCALE
         struct SwsContext *sws_ctx = nullptr;
@@ -276,6 +300,9 @@ struct state_video_compress_libav {
         int conv_thread_count = clamp<unsigned int>(thread::hardware_concurrency(), 1, INT_MAX); ///< number of threads used for UG conversions
         double mov_avg_comp_duration = 0;
         long mov_avg_frames = 0;
+
+        deque<lavc_session> session_cache; ///< idle sessions, most recently used first
+        bool force_keyframe = false; ///< next frame is the first one of a resumed session
 };
 
 struct codec_encoders_decoders{
@@ -369,7 +396,8 @@ static void usage() {
         col() << "\t" << SBOLD("<threads>") << " can be \"no\", or \"<number>[F][S][n]\" where 'F'/'S' indicate if frame/slice thr. should be used, both can be used (default slice), 'n' means none;\n";
         col() << "\t" <<       "         "  << " use a comma to add also number of conversion threads (eg. \"0S,8\"), default: number of logical cores\n";
         col() << "\t" << SBOLD("<slices>") << " number of slices to use (default: " << DEFAULT_SLICE_COUNT << ")\n";
-        col() << "\t" << SBOLD("<gop>") << " specifies GOP size\n";
+        col() << "\t" << SBOLD("<gop>") << " specifies GOP size, with " << SBOLD("--param keyframe-requests") << " (default) it can be long\n"
+                "\t\tbecause the receivers request a keyframe upon loss (possibly combined with intra_refresh)\n";
         col() << "\t" << SBOLD("<lavc_opt>") << " arbitrary option to be passed directly to libavcodec (eg. preset=veryfast), eventual colons must be backslash-escaped (eg. for x264opts)\n";
         col() << "\nSupported codecs:\n";
         for (auto && param : codec_params) {
@@ -886,6 +914,7 @@ static bool try_open_codec(struct state_video_compress_libav *s,
                         return false;
                 }
                 s->hwenc = true;
+                s->hwmap = get_commandline_param("lavc-hw-map") != nullptr;
                 s->hwframe = av_frame_alloc();
                 av_hwframe_get_buffer(s->codec_ctx->hw_frames_ctx, s->hwframe, 0);
                 pix_fmt = AV_PIX_FMT_NV12;
@@ -1154,6 +1183,99 @@ static void write_orig_format(struct video_frame *compressed_frame, codec_t orig
         *data_len += sizeof eob;
 }
 
+#ifdef HWACC_VAAPI
+ADD_TO_PARAM("lavc-hw-map", "* lavc-hw-map\n"
+                "  Convert directly to a mapped VA-API surface instead of uploading\n"
+                "  a converted frame (saves the intermediate frame and the copy).\n");
+/**
+ * Converts in_data to a fresh surface from the encoder HW frame pool - the
+ * previous one may still be referenced by the encoder.
+ */
+static AVFrame *convert_to_hwframe(struct state_video_compress_libav *s, char *in_data)
+{
+        const int64_t pts = s->hwframe->pts;
+        av_frame_unref(s->hwframe);
+        int ret = av_hwframe_get_buffer(s->codec_ctx->hw_frames_ctx, s->hwframe, 0);
+        if (ret < 0) {
+                print_libav_error(LOG_LEVEL_ERROR, MOD_NAME "Cannot get HW frame", ret);
+                return nullptr;
+        }
+        s->hwframe->pts = pts;
+
+        if (s->hwmap) {
+                AVFrame *mapped = av_frame_alloc();
+                ret = av_hwframe_map(mapped, s->hwframe, AV_HWFRAME_MAP_WRITE | AV_HWFRAME_MAP_OVERWRITE);
+                bool converted = ret == 0 && to_lavc_vid_conv_to_frame(s->pixfmt_conversion, in_data, mapped);
+                av_frame_free(&mapped); // unmaps the surface
+                if (converted) {
+                        return s->hwframe;
+                }
+                if (ret < 0) {
+                        print_libav_error(LOG_LEVEL_WARNING, MOD_NAME "Cannot map HW frame, using upload", ret);
+                }
+                s->hwmap = false;
+        }
+
+        AVFrame *frame = to_lavc_vid_conv(s->pixfmt_conversion, in_data);
+        if (!frame) {
+                return nullptr;
+        }
+        debug_file_dump("lavc-avframe", serialize_video_avframe, frame);
+        if ((ret = av_hwframe_transfer_data(s->hwframe, frame, 0)) < 0) {
+                print_libav_error(LOG_LEVEL_ERROR, MOD_NAME "Cannot upload HW frame", ret);
+                return nullptr;
+        }
+        return s->hwframe;
+}
+#endif
+
+/**
+ * Passes the packets of the encoded picture to the transmission as they are
+ * received, without copying (see compress_output_partial()). Encoders emitting
+ * the picture in more packets (slices) let the transmission start before the
+ * whole picture is encoded.
+ *
+ * @returns the last part, empty if no packet was received
+ */
+static shared_ptr<video_frame> libavcodec_receive_parts(struct state_video_compress_libav *s,
+                const struct video_frame *tx)
+{
+        shared_ptr<video_frame> last{};
+        const unsigned int frame_id = s->part_frame_id++;
+        unsigned int offset = 0;
+        int ret = 0;
+        while ((ret = avcodec_receive_packet(s->codec_ctx, s->pkt)) == 0) {
+                if (s->pkt->size == 0) {
+                        av_packet_unref(s->pkt);
+                        continue;
+                }
+                if (last) {
+                        compress_output_partial(s->module_data.parent, std::move(last));
+                }
+                AVPacket *pkt = av_packet_alloc();
+                av_packet_move_ref(pkt, s->pkt);
+                last = shared_ptr<video_frame>(vf_alloc_desc(s->compressed_desc), [pkt](struct video_frame *frame) mutable {
+                        av_packet_free(&pkt);
+                        vf_free(frame);
+                });
+                vf_copy_metadata(last.get(), tx);
+                last->frame_type = (pkt->flags & AV_PKT_FLAG_KEY) != 0 ? INTRA : OTHER;
+                last->fragment = 1;
+                last->frame_fragment_id = frame_id;
+                last->tiles[0].data = (char *) pkt->data;
+                last->tiles[0].data_len = pkt->size;
+                last->tiles[0].offset = offset;
+                offset += pkt->size;
+        }
+        if (ret != AVERROR(EAGAIN)) {
+                print_libav_error(LOG_LEVEL_WARNING, "[lavc] Receive packet error", ret);
+        }
+        if (last) {
+                last->last_fragment = 1;
+        }
+        return last;
+}
+
 static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shared_ptr<video_frame> tx)
 {
         struct state_video_compress_libav *s = (struct state_video_compress_libav *) mod->priv_data;
@@ -1164,41 +1286,32 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
 
         if(!video_desc_eq_excl_param(video_desc_from_frame(tx.get()),
                                 s->saved_desc, PARAM_TILE_COUNT)) {
-                cleanup(s);
-                int ret = configure_with(s, video_desc_from_frame(tx.get()));
-                if(!ret) {
-                        return {};
+                if (!switch_session(s, video_desc_from_frame(tx.get()))) {
+                        int ret = configure_with(s, video_desc_from_frame(tx.get()));
+                        if(!ret) {
+                                return {};
+                        }
                 }
         }
 
-        static auto dispose = [](struct video_frame *frame) {
-                free(frame->tiles[0].data);
-                vf_free(frame);
-        };
-        out = shared_ptr<video_frame>(vf_alloc_desc(s->compressed_desc), dispose);
-        if (s->compressed_desc.color_spec == PRORES) {
-                assert(s->codec_ctx->codec_tag != 0);
-                out->color_spec = get_codec_from_fcc(s->codec_ctx->codec_tag);
-        }
-        vf_copy_metadata(out.get(), tx.get());
-        const size_t max_len = MAX((size_t) s->compressed_desc.width * s->compressed_desc.height * 4, 4096);
-        out->tiles[0].data = (char *) malloc(max_len);
-
         time_ns_t t0 = get_time_in_ns();
-        struct AVFrame *frame = to_lavc_vid_conv(s->pixfmt_conversion, tx->tiles[0].data);
+        struct AVFrame *frame = nullptr;
+#ifdef HWACC_VAAPI
+        if (s->hwenc) {
+                frame = convert_to_hwframe(s, tx->tiles[0].data);
+        } else
+#endif
+        {
+                frame = to_lavc_vid_conv(s->pixfmt_conversion, tx->tiles[0].data);
+                if (frame) {
+                        debug_file_dump("lavc-avframe", serialize_video_avframe, frame);
+                }
+        }
         if (!frame) {
                 return {};
         }
         time_ns_t t1 = get_time_in_ns();
 
-        debug_file_dump("lavc-avframe", serialize_video_avframe, frame);
-#ifdef HWACC_VAAPI
-        if(s->hwenc){
-                av_hwframe_transfer_data(s->hwframe, frame, 0);
-                frame = s->hwframe;
-        }
-#endif
-
 #ifdef HAVE_SWSCALE
         if(s->sws_ctx){
                 sws_scale(s->sws_ctx,
@@ -1215,6 +1328,34 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
 
         /* encode the image */
         frame->pts += 1;
+        frame->pict_type = s->force_keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+        s->force_keyframe = false;
+
+        if (int ret = avcodec_send_frame(s->codec_ctx, frame)) {
+                print_libav_error(LOG_LEVEL_WARNING, "[lavc] Error encoding frame", ret);
+                return {};
+        }
+
+        if ((s->compressed_desc.color_spec == H264 || s->compressed_desc.color_spec == H265) && !s->store_orig_format
+                        && compress_partial_output_enabled(s->module_data.parent)) {
+                out = libavcodec_receive_parts(s, tx.get());
+                time_ns_t t3 = get_time_in_ns();
+                check_duration(s, t1 - t0, t3 - t0);
+                return out;
+        }
+
+        static auto dispose = [](struct video_frame *frame) {
+                free(frame->tiles[0].data);
+                vf_free(frame);
+        };
+        out = shared_ptr<video_frame>(vf_alloc_desc(s->compressed_desc), dispose);
+        if (s->compressed_desc.color_spec == PRORES) {
+                assert(s->codec_ctx->codec_tag != 0);
+                out->color_spec = get_codec_from_fcc(s->codec_ctx->codec_tag);
+        }
+        vf_copy_metadata(out.get(), tx.get());
+        const size_t max_len = MAX((size_t) s->compressed_desc.width * s->compressed_desc.height * 4, 4096);
+        out->tiles[0].data = (char *) malloc(max_len);
         out->tiles[0].data_len = 0;
         if (libav_codec_has_extradata(s->compressed_desc.color_spec)) { // we need to store extradata for HuffYUV/FFV1 in the beginning
                 out->tiles[0].data_len += sizeof(uint32_t) + s->codec_ctx->extradata_size;
@@ -1222,12 +1363,12 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
                 memcpy(out->tiles[0].data + sizeof(uint32_t), s->codec_ctx->extradata, s->codec_ctx->extradata_size);
         }
 
-        if (int ret = avcodec_send_frame(s->codec_ctx, frame)) {
-                print_libav_error(LOG_LEVEL_WARNING, "[lavc] Error encoding frame", ret);
-                return {};
-        }
         int ret = avcodec_receive_packet(s->codec_ctx, s->pkt);
+        out->frame_type = INTRA;
         while (ret == 0) {
+                if ((s->pkt->flags & AV_PKT_FLAG_KEY) == 0) { // marked for recording index (seeking)
+                        out->frame_type = OTHER;
+                }
                 assert(s->pkt->size + out->tiles[0].data_len <= max_len - out->tiles[0].data_len);
                 memcpy((uint8_t *) out->tiles[0].data + out->tiles[0].data_len,
                                 s->pkt->data, s->pkt->size);
@@ -1287,11 +1428,99 @@ static void cleanup(struct state_video_compress_libav *s)
 #endif //HAVE_SWSCALE
 }
 
+/// moves the current session out of the state
+static lavc_session take_session(struct state_video_compress_libav *s)
+{
+        lavc_session ret;
+        ret.saved_desc = s->saved_desc;
+        ret.compressed_desc = s->compressed_desc;
+        ret.codec_ctx = exchange(s->codec_ctx, nullptr);
+        ret.pixfmt_conversion = exchange(s->pixfmt_conversion, nullptr);
+        ret.hwenc = exchange(s->hwenc, false);
+        ret.hwframe = exchange(s->hwframe, nullptr);
+        ret.hwmap = exchange(s->hwmap, false);
+#ifdef HAVE_SWSCALE
+        ret.sws_ctx = exchange(s->sws_ctx, nullptr);
+        ret.sws_frame = exchange(s->sws_frame, nullptr);
+#endif
+        s->saved_desc = {};
+        return ret;
+}
+
+static void put_session(struct state_video_compress_libav *s, lavc_session *session)
+{
+        s->saved_desc = session->saved_desc;
+        s->compressed_desc = session->compressed_desc;
+        s->codec_ctx = session->codec_ctx;
+        s->pixfmt_conversion = session->pixfmt_conversion;
+        s->hwenc = session->hwenc;
+        s->hwframe = session->hwframe;
+        s->hwmap = session->hwmap;
+#ifdef HAVE_SWSCALE
+        s->sws_ctx = session->sws_ctx;
+        s->sws_frame = session->sws_frame;
+#endif
+}
+
+static void free_session(struct state_video_compress_libav *s, lavc_session *session)
+{
+        lavc_session current = take_session(s);
+        put_session(s, session);
+        cleanup(s);
+        to_lavc_vid_conv_destroy(&s->pixfmt_conversion);
+        put_session(s, &current);
+}
+
+static void free_session_cache(struct state_video_compress_libav *s)
+{
+        for (auto &session : s->session_cache) {
+                free_session(s, &session);
+        }
+        s->session_cache.clear();
+}
+
+ADD_TO_PARAM("lavc-session-cache", "* lavc-session-cache=<n>\n"
+                "  Number of encoder sessions of the previous video formats kept open\n"
+                "  to switch back to them without reopening the encoder (default 1, 0 - disable)\n");
+/**
+ * Keeps the current session for a later reuse (or closes it if the cache is
+ * disabled) and resumes a cached one matching desc.
+ * @retval true a session for desc is resumed, no configuration is needed
+ */
+static bool switch_session(struct state_video_compress_libav *s, struct video_desc desc)
+{
+        const char *cache_size_str = get_commandline_param("lavc-session-cache");
+        const size_t cache_size = cache_size_str != nullptr ? max(atoi(cache_size_str), 0) : 1;
+
+        if (s->codec_ctx != nullptr && cache_size > 0) {
+                s->session_cache.push_front(take_session(s));
+                while (s->session_cache.size() > cache_size) {
+                        free_session(s, &s->session_cache.back());
+                        s->session_cache.pop_back();
+                }
+        } else {
+                cleanup(s);
+        }
+
+        for (auto it = s->session_cache.begin(); it != s->session_cache.end(); ++it) {
+                if (video_desc_eq_excl_param(it->saved_desc, desc, PARAM_TILE_COUNT)) {
+                        put_session(s, &*it);
+                        s->session_cache.erase(it);
+                        s->mov_avg_frames = s->mov_avg_comp_duration = 0;
+                        s->force_keyframe = true;
+                        LOG(LOG_LEVEL_NOTICE) << MOD_NAME "Resuming encoder session for " << desc << ".\n";
+                        return true;
+                }
+        }
+        return false;
+}
+
 static void libavcodec_compress_done(struct module *mod)
 {
         struct state_video_compress_libav *s = (struct state_video_compress_libav *) mod->priv_data;
 
         cleanup(s);
+        free_session_cache(s);
 
         delete s;
 }
@@ -1687,6 +1916,80 @@ static void setparam_vp8_vp9(AVCodecContext *codec_ctx, struct setparam_param *p
         check_av_opt_set<int>(codec_ctx->priv_data, "rc_lookahead", 0);
 }
 
+/**
+ * Applies bitrate and GOP changes to the running encoder if it supports
+ * changing them without reopening (FFmpeg reconfigures the encoder when it
+ * detects the change in AVCodecContext on the next frame).
+ * @retval false the change needs the encoder to be reopened
+ */
+static bool try_runtime_reconfigure(struct state_video_compress_libav *s, const char *config)
+{
+        if (strcasecmp(config, "keyframe") == 0) { // receiver keyframe request (RTCP PLI/FIR)
+                s->force_keyframe = true;
+                return true;
+        }
+        if (s->codec_ctx == nullptr) {
+                return false;
+        }
+        const char *name = s->codec_ctx->codec->name;
+        const bool is_qsv = regex_match(name, regex("(h264|hevc)_qsv"));
+        const bool dyn_bitrate = strcmp(name, "libx264") == 0 || strstr(name, "_nvenc") != nullptr
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(60, 3, 100)
+                || is_qsv
+#endif
+                ;
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(60, 3, 100)
+        const bool dyn_gop = is_qsv;
+#else
+        const bool dyn_gop = false;
+        (void) is_qsv;
+#endif
+
+        long long bitrate = 0;
+        int gop = 0;
+        string cfg = config;
+        char *tmp = cfg.data();
+        char *item, *save_ptr = nullptr;
+        while ((item = strtok_r(tmp, ":", &save_ptr)) != nullptr) {
+                tmp = nullptr;
+                if (strncasecmp("bitrate=", item, strlen("bitrate=")) == 0 && dyn_bitrate
+                                && s->codec_ctx->bit_rate > 0) { // not for CQP/CRF
+                        bitrate = unit_evaluate(item + strlen("bitrate="));
+                        if (bitrate <= 0) {
+                                return false;
+                        }
+                } else if (strncasecmp("gop=", item, strlen("gop=")) == 0 && dyn_gop) {
+                        gop = atoi(item + strlen("gop="));
+                        if (gop <= 0) {
+                                return false;
+                        }
+                } else {
+                        return false;
+                }
+        }
+        if (bitrate == 0 && gop == 0) {
+                return false;
+        }
+
+        if (bitrate != 0) {
+                // keep the ratios of max rate and VBV buffer set by the configure_* functions
+                const double ratio = (double) bitrate / s->codec_ctx->bit_rate;
+                s->codec_ctx->rc_max_rate = llround(s->codec_ctx->rc_max_rate * ratio);
+                s->codec_ctx->rc_buffer_size = (int) lround(s->codec_ctx->rc_buffer_size * ratio);
+                s->codec_ctx->bit_rate = bitrate;
+                s->codec_ctx->bit_rate_tolerance = bitrate / s->saved_desc.fps * 6;
+                s->requested_bitrate = bitrate;
+                LOG(LOG_LEVEL_INFO) << MOD_NAME << "Changing bitrate of running encoder to " << format_in_si_units(bitrate) << "bps.\n";
+        }
+        if (gop != 0) {
+                s->codec_ctx->gop_size = s->requested_gop = gop;
+                LOG(LOG_LEVEL_INFO) << MOD_NAME << "Changing GOP of running encoder to " << gop << ".\n";
+        }
+        // cached sessions were configured with the previous values
+        free_session_cache(s);
+        return true;
+}
+
 static void libavcodec_check_messages(struct state_video_compress_libav *s)
 {
         struct message *msg;
@@ -1694,6 +1997,10 @@ static void libavcodec_check_messages(struct state_video_compress_libav *s)
                 struct msg_change_compress_data *data =
                         (struct msg_change_compress_data *) msg;
                 struct response *r;
+                if (try_runtime_reconfigure(s, data->config_string)) {
+                        free_message(msg, new_response(RESPONSE_OK, NULL));
+                        continue;
+                }
                 if (parse_fmt(s, data->config_string) == 0) {
                         log_msg(LOG_LEVEL_NOTICE, "[Libavcodec] Compression successfully changed.\n");
                         r = new_response(RESPONSE_OK, NULL);
@@ -1701,7 +2008,10 @@ static void libavcodec_check_messages(struct state_video_compress_libav *s)
                         log_msg(LOG_LEVEL_ERROR, "[Libavcodec] Unable to change compression!\n");
                         r = new_response(RESPONSE_INT_SERV_ERR, NULL);
                 }
+                // reopen with the new parameters, also the cached sessions are outdated
+                cleanup(s);
                 memset(&s->saved_desc, 0, sizeof(s->saved_desc));
+                free_session_cache(s);
                 free_message(msg, r);
         }
 
@@ -239,9 +239,22 @@ decompress_status decompress_frame(
                         internal_prop);
 }
 
+/** @copydoc decompress_push_t */
+decompress_status decompress_push(struct state_decompress *s, unsigned char *dst, unsigned char *buffer,
+                unsigned int src_len, bool last, int frame_seq, struct video_frame_callbacks *callbacks)
+{
+        assert(s->magic == DECOMPRESS_MAGIC);
+        assert(s->functions->push != nullptr);
+
+        return s->functions->push(s->state, dst, buffer, src_len, last, frame_seq, callbacks);
+}
+
 /** @copydoc decompress_get_property_t */
 int decompress_get_property(struct state_decompress *s, int property, void *val, size_t *len)
 {
+        if (property == DECOMPRESS_PROPERTY_STREAMING && s->functions->push == nullptr) {
+                return FALSE;
+        }
         return s->functions->get_property(s->state, property, val, len);
 }
 
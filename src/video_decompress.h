@@ -39,7 +39,7 @@
  *
  */
 
-#define VIDEO_DECOMPRESS_ABI_VERSION 6
+#define VIDEO_DECOMPRESS_ABI_VERSION 7
 
 /**
  * @defgroup video_decompress Video Decompress
@@ -61,6 +61,20 @@ struct state_decompress;
  * can be passed to decompressor. Otherwise, broken frame is discarded.
  */
 #define DECOMPRESS_PROPERTY_ACCEPTS_CORRUPTED_FRAME  1          /* int */
+/**
+ * Requests decompressing to CUDA device memory - dst passed to decompress is
+ * then a device pointer. Input value (int) is non-zero to enable, the module
+ * returns TRUE if it can write to the device buffer with the configuration
+ * passed to last decompress_reconfigure.
+ */
+#define DECOMPRESS_PROPERTY_CUDA_OUTPUT              2          /* int, in/out */
+/**
+ * Requests streaming decompression (see @ref decompress_push_t). Input value
+ * (int) is non-zero to enable, the module returns TRUE if the frames may be
+ * passed incrementally with the configuration passed to last
+ * decompress_reconfigure (decompress_push() must be used then).
+ */
+#define DECOMPRESS_PROPERTY_STREAMING                3          /* int, in/out */
 
 /**
  * initializes decompression and returns internal state
@@ -116,6 +130,37 @@ typedef decompress_status (*decompress_decompress_t)(
                 struct video_frame_callbacks *callbacks,
                 struct pixfmt_desc *internal_prop);
 
+/**
+ * @brief Decompresses video frame incrementally while it is being received
+ *
+ * Called repeatedly for one frame with a growing valid part of the buffer,
+ * so that decoding of the first slices can start before the rest of the
+ * frame arrives. The module decodes what it can of the newly passed data.
+ *
+ * @param[in]  state         decompress state
+ * @param[out] dst           buffer where uncompressed frame will be written
+ * @param[in]  buffer        whole compressed frame buffer (the same for all calls for the frame)
+ * @param[in]  src_len       length of the valid (received) prefix of the buffer,
+ *                           doesn't decrease within the frame
+ * @param[in]  last          the frame is complete (src_len is its length), the module
+ *                           must finish the frame and be prepared for the next one
+ * @param[in]  frame_seq     @see decompress_decompress_t
+ * @param      callbacks     @see decompress_decompress_t
+ * @retval DECODER_NO_FRAME  more data needed (or the frame cannot be decoded if last)
+ * @retval DECODER_GOT_FRAME frame decoded and written to dst (at latest when last)
+ * @note
+ * Used only if enabled by @ref DECOMPRESS_PROPERTY_STREAMING, so never for
+ * probing the internal codec.
+ */
+typedef decompress_status (*decompress_push_t)(
+                void *state,
+                unsigned char *dst,
+                unsigned char *buffer,
+                unsigned int src_len,
+                bool last,
+                int frame_seq,
+                struct video_frame_callbacks *callbacks);
+
 /**
  * @param state decoder state
  * @param property  ID of queried property
@@ -144,6 +189,7 @@ struct video_decompress_info {
         decompress_get_property_t get_property;
         decompress_done_t done;
         decompress_get_priority_t get_decompress_priority;
+        decompress_push_t push; ///< optional, may be NULL
 };
 
 bool decompress_init_multi(codec_t compression,
@@ -174,6 +220,14 @@ decompress_status decompress_frame(struct state_decompress *,
                 struct video_frame_callbacks *callbacks,
                 struct pixfmt_desc *internal_prop);
 
+decompress_status decompress_push(struct state_decompress *,
+                unsigned char *dst,
+                unsigned char *buffer,
+                unsigned int src_len,
+                bool last,
+                int frame_seq,
+                struct video_frame_callbacks *callbacks);
+
 int decompress_get_property(struct state_decompress *state,
                 int property,
                 void *val,
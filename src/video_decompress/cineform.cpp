@@ -49,12 +49,15 @@
 #include "video.h"
 #include "video_decompress.h"
 #include "utils/macros.h" // to_fourcc
+#include "utils/worker.h"
 
 #include "CFHDTypes.h"
 #include "CFHDDecoder.h"
 
 #include <vector>
 
+#define CONVERT_ROWS_PER_TASK 32
+
 struct state_cineform_decompress {
         int              width, height;
         int              pitch;
@@ -67,6 +70,7 @@ struct state_cineform_decompress {
         void (*convert)(unsigned char *dst_buffer,
                         unsigned char *src_buffer,
                         int width, int height, int pitch);
+        bool             convert_flips; ///< convert turns the picture upside down
         std::vector<unsigned char> conv_buf;
 
         unsigned         last_frame_seq:22; // This gives last sucessfully decoded frame seq number. It is the buffer number from the packet format header, uses 22 bits.
@@ -162,16 +166,34 @@ static const struct {
         void (*convert)(unsigned char *dst_buffer,
                         unsigned char *src_buffer,
                         int width, int height, int pitch);
-} decode_codecs[] = {
-        {R12L, CFHD_PIXEL_FORMAT_RG48, rg48_to_r12l},
-        {RG48, CFHD_PIXEL_FORMAT_RG48, nullptr},
-        {UYVY, CFHD_PIXEL_FORMAT_2VUY, nullptr},
-        {R10k, CFHD_PIXEL_FORMAT_DPX0, nullptr},
-        {v210, CFHD_PIXEL_FORMAT_V210, nullptr},
-        {RGB, CFHD_PIXEL_FORMAT_RG24, bgr_to_rgb_invert},
-        {RGBA, CFHD_PIXEL_FORMAT_BGRa, abgr_to_rgba},
+        bool convert_flips;
+} decode_codecs[] = { // formats without convert are decoded directly to the output buffer
+        {R12L, CFHD_PIXEL_FORMAT_RG48, rg48_to_r12l, false},
+        {RG48, CFHD_PIXEL_FORMAT_RG48, nullptr, false},
+        {UYVY, CFHD_PIXEL_FORMAT_2VUY, nullptr, false},
+        {R10k, CFHD_PIXEL_FORMAT_DPX0, nullptr, false},
+        {v210, CFHD_PIXEL_FORMAT_V210, nullptr, false},
+        {RGB, CFHD_PIXEL_FORMAT_RG24, bgr_to_rgb_invert, true},
+        {RGBA, CFHD_PIXEL_FORMAT_BGRa, abgr_to_rgba, false},
 };
 
+/// runs s->convert on horizontal stripes of the picture in parallel
+static void parallel_convert(struct state_cineform_decompress *s, unsigned char *dst, unsigned char *src)
+{
+        struct convert_data {
+                struct state_cineform_decompress *s;
+                unsigned char *dst;
+                unsigned char *src;
+        } d{s, dst, src};
+        task_run_parallel_for(s->height, CONVERT_ROWS_PER_TASK, [](void *udata, size_t begin, size_t end) {
+                auto *d = static_cast<convert_data *>(udata);
+                const struct state_cineform_decompress *s = d->s;
+                size_t src_row = s->convert_flips ? s->height - end : begin;
+                s->convert(d->dst + begin * s->pitch, d->src + src_row * s->decode_linesize,
+                                s->width, end - begin, s->pitch);
+        }, &d);
+}
+
 static bool configure_with(struct state_cineform_decompress *s,
                 struct video_desc desc)
 {
@@ -188,6 +210,7 @@ static bool configure_with(struct state_cineform_decompress *s,
                 if(i.ug_codec == s->out_codec){
                         s->decode_codec = i.cfhd_pixfmt;
                         s->convert = i.convert;
+                        s->convert_flips = i.convert_flips;
                         CFHD_GetImagePitch(desc.width, i.cfhd_pixfmt, &s->decode_linesize);
                         if(i.ug_codec == R12L){
                                 log_msg(LOG_LEVEL_NOTICE, "[cineform] Decoding to 12-bit RGB.\n");
@@ -383,7 +406,7 @@ static decompress_status cineform_decompress(void *state, unsigned char *dst, un
 
         if(status == CFHD_ERROR_OKAY){
                 if(s->convert){
-                        s->convert(dst, decode_dst, s->width, s->height, s->pitch);
+                        parallel_convert(s, dst, decode_dst);
                 }
                 res = DECODER_GOT_FRAME;
         } else {
@@ -447,6 +470,7 @@ static const struct video_decompress_info cineform_info = {
         cineform_decompress_get_property,
         cineform_decompress_done,
         cineform_decompress_get_priority,
+        nullptr,
 };
 
 REGISTER_MODULE(cineform, &cineform_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
@@ -48,6 +48,8 @@
  *   (which is asynchronous, thus non-blocking)
  * - then queue (filled by thread in first point) is checked - if it is
  *   non-empty, frame is copied to framebufffer. If not false is returned.
+ *   The queue holds the decoded images themselves, so the samples are copied
+ *   (or converted) only once, directly to the framebuffer.
  *
  * @todo
  * Reconfiguration isn't entirely correct - on reconfigure, all frames
@@ -74,6 +76,7 @@
 #include <mutex>
 #include <queue>
 #include <utility>
+#include <vector>
 
 constexpr const int DEFAULT_TILE_LIMIT = 2;
 /// maximal size of queue for decompressed frames
@@ -95,7 +98,8 @@ struct state_decompress_j2k {
         codec_t out_codec{};
 
         mutex lock;
-        queue<pair<char *, size_t>> decompressed_frames; ///< buffer, length
+        queue<cmpto_j2k_dec_img *> decompressed_frames; ///< decoded images not yet copied to the framebuffer
+        vector<unsigned char> convert_buf; ///< converted frame if it cannot be written to the framebuffer directly
         int pitch;
         pthread_t thread_id{};
         unsigned int max_queue_size; ///< maximal length of @ref decompressed_frames
@@ -175,29 +179,14 @@ next_image:
                         continue;
                 }
 
-                void *dec_data;
-                size_t len;
-                CHECK_OK(cmpto_j2k_dec_img_get_samples(img, &dec_data, &len),
-                                "Error getting samples", cmpto_j2k_dec_img_destroy(img); goto next_image);
-
-                char *buffer = (char *) malloc(len);
-                if (s->convert) {
-                        s->convert((unsigned char*) buffer, (unsigned char*) dec_data, s->desc.width, s->desc.height);
-                        len = vc_get_linesize(s->desc.width, s->out_codec) * s->desc.height;
-                } else {
-                        memcpy(buffer, dec_data, len);
-                }
-
-                CHECK_OK(cmpto_j2k_dec_img_destroy(img),
-                                "Unable to to return processed image", NOOP);
                 lock_guard<mutex> lk(s->lock);
                 while (s->decompressed_frames.size() >= s->max_queue_size) {
                         print_dropped(s->dropped++);
-                        auto decoded = s->decompressed_frames.front();
+                        CHECK_OK(cmpto_j2k_dec_img_destroy(s->decompressed_frames.front()),
+                                        "Unable to to return processed image", NOOP);
                         s->decompressed_frames.pop();
-                        free(decoded.first);
                 }
-                s->decompressed_frames.push({buffer,len});
+                s->decompressed_frames.push(img);
         }
 
         return NULL;
@@ -403,6 +392,9 @@ static decompress_status j2k_probe_internal_codec(codec_t in_codec, unsigned cha
  * Main decompress function - passes frame to the codec and checks if there are
  * some decoded frames. If so, copies that to framebuffer. In the opposite case
  * it just returns false.
+ *
+ * The input must still be copied because the codec reads it asynchronously
+ * after the buffer has been returned to the UltraGrid decoder.
  */
 static decompress_status j2k_decompress(void *state, unsigned char *dst, unsigned char *buffer,
                 unsigned int src_len, int /* frame_seq */, struct video_frame_callbacks * /* callbacks */, struct pixfmt_desc *internal_prop)
@@ -410,7 +402,6 @@ static decompress_status j2k_decompress(void *state, unsigned char *dst, unsigne
         struct state_decompress_j2k *s =
                 (struct state_decompress_j2k *) state;
         struct cmpto_j2k_dec_img *img;
-        pair<char *, size_t> decoded;
         void *tmp;
 
         if (s->out_codec == VIDEO_CODEC_NONE) {
@@ -442,23 +433,46 @@ return_previous:
         if (s->decompressed_frames.size() == 0) {
                 return DECODER_NO_FRAME;
         }
-        decoded = s->decompressed_frames.front();
+        img = s->decompressed_frames.front();
         s->decompressed_frames.pop();
         lk.unlock();
 
+        decompress_status ret = DECODER_GOT_FRAME;
+        void *dec_data;
+        size_t len;
+        CHECK_OK(cmpto_j2k_dec_img_get_samples(img, &dec_data, &len),
+                        "Error getting samples", ret = DECODER_NO_FRAME);
+
         size_t linesize = vc_get_linesize(s->desc.width, s->out_codec);
         size_t frame_size = linesize * s->desc.height;
-        if ((decoded.second + 3) / 4 * 4 != frame_size) { // for "RGBA with non-standard shift" (search) it would be (frame_size - 1)
-                LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Incorrect decoded size (" << frame_size << " vs. " << decoded.second << ")\n";
+        const unsigned char *src = (unsigned char *) dec_data;
+        if (ret == DECODER_GOT_FRAME && s->convert) {
+                unsigned char *out = dst;
+                if ((size_t) s->pitch != linesize) {
+                        s->convert_buf.resize(frame_size);
+                        out = s->convert_buf.data();
+                }
+                s->convert(out, (unsigned char *) dec_data, s->desc.width, s->desc.height);
+                src = out;
+                len = frame_size;
         }
-
-        for (size_t i = 0; i < s->desc.height; ++i) {
-                memcpy(dst + i * s->pitch, decoded.first + i * linesize, min(linesize, decoded.second - min(decoded.second, i * linesize)));
+        if (ret == DECODER_GOT_FRAME && src != dst) {
+                if ((len + 3) / 4 * 4 != frame_size) { // for "RGBA with non-standard shift" (search) it would be (frame_size - 1)
+                        LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Incorrect decoded size (" << frame_size << " vs. " << len << ")\n";
+                }
+                if ((size_t) s->pitch == linesize) {
+                        memcpy(dst, src, min(len, frame_size));
+                } else {
+                        for (size_t i = 0; i < s->desc.height; ++i) {
+                                memcpy(dst + i * s->pitch, src + i * linesize, min(linesize, len - min(len, i * linesize)));
+                        }
+                }
         }
 
-        free(decoded.first);
+        CHECK_OK(cmpto_j2k_dec_img_destroy(img),
+                        "Unable to to return processed image", NOOP);
 
-        return DECODER_GOT_FRAME;
+        return ret;
 }
 
 static int j2k_decompress_get_property(void *state, int property, void *val, size_t *len)
@@ -489,15 +503,16 @@ static void j2k_decompress_done(void *state)
         pthread_join(s->thread_id, NULL);
         log_msg(LOG_LEVEL_VERBOSE, "[J2K dec.] Decoder stopped.\n");
 
-        cmpto_j2k_dec_cfg_destroy(s->settings);
-        cmpto_j2k_dec_ctx_destroy(s->decoder);
-
         while (s->decompressed_frames.size() > 0) {
-                auto decoded = s->decompressed_frames.front();
+                CHECK_OK(cmpto_j2k_dec_img_destroy(s->decompressed_frames.front()),
+                                "Unable to to return processed image", NOOP);
                 s->decompressed_frames.pop();
-                free(decoded.first);
         }
 
+        cmpto_j2k_dec_cfg_destroy(s->settings);
+        cmpto_j2k_dec_ctx_destroy(s->decoder);
+
+
         delete s;
 }
 
@@ -535,6 +550,7 @@ static const struct video_decompress_info j2k_decompress_info = {
         j2k_decompress_get_property,
         j2k_decompress_done,
         j2k_decompress_get_priority,
+        nullptr,
 };
 
 REGISTER_MODULE(j2k, &j2k_decompress_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
@@ -248,6 +248,7 @@ static const struct video_decompress_info dxt_glsl_info = {
         dxt_glsl_decompress_get_property,
         dxt_glsl_decompress_done,
         dxt_glsl_decompress_get_priority,
+        NULL,
 };
 
 REGISTER_MODULE(dxt_glsl, &dxt_glsl_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
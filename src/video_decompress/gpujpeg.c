@@ -49,12 +49,15 @@
 #include <libgpujpeg/gpujpeg_version.h>
 //#include "compat/platform_semaphore.h"
 #include <pthread.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include "lib_common.h"
 #include "utils/macros.h"
+#include "utils/worker.h"
 
 #define MOD_NAME "[GPUJPEG dec.] "
+#define COPY_LINES_PER_TASK 32
 
 struct state_decompress_gpujpeg {
         struct gpujpeg_decoder *decoder;
@@ -63,6 +66,7 @@ struct state_decompress_gpujpeg {
         int rshift, gshift, bshift;
         int pitch;
         codec_t out_codec;
+        bool cuda_output; ///< dst is in CUDA device memory
 };
 
 static int configure_with(struct state_decompress_gpujpeg *s, struct video_desc desc);
@@ -166,6 +170,7 @@ static int gpujpeg_decompress_reconfigure(void *state, struct video_desc desc,
                 s->rshift = rshift;
                 s->gshift = gshift;
                 s->bshift = bshift;
+                s->cuda_output = false; // must be requested again for the new configuration
                 if(s->decoder) {
                         gpujpeg_decoder_destroy(s->decoder);
                 }
@@ -229,6 +234,40 @@ static decompress_status gpujpeg_probe_internal_codec(unsigned char *buffer, siz
 	return DECODER_GOT_CODEC;
 }
 
+/// decoder output can be written to the destination buffer without conversion
+static bool can_output_directly(const struct state_decompress_gpujpeg *s)
+{
+        return s->pitch == vc_get_linesize(s->desc.width, s->out_codec) && (s->out_codec == UYVY || s->out_codec == RGB
+                        || (s->out_codec == RGBA && s->rshift == 0 && s->gshift == 8 && s->bshift == 16));
+}
+
+struct copy_lines_data {
+        const struct state_decompress_gpujpeg *s;
+        unsigned char *dst;
+        const unsigned char *src;
+        int linesize;     ///< of the output codec
+        int src_linesize; ///< of the decoder output
+};
+
+static void copy_lines(void *udata, size_t begin, size_t end)
+{
+        const struct copy_lines_data *d = udata;
+        const struct state_decompress_gpujpeg *s = d->s;
+        unsigned char *line_dst = d->dst + begin * s->pitch;
+        const unsigned char *line_src = d->src + begin * d->src_linesize;
+        for (size_t i = begin; i < end; i++) {
+                if (s->out_codec == RGBA) {
+                        vc_copylineRGBtoRGBA(line_dst, line_src, d->linesize,
+                                        s->rshift, s->gshift, s->bshift);
+                } else {
+                        assert(s->out_codec == UYVY || s->out_codec == I420);
+                        memcpy(line_dst, line_src, d->linesize);
+                }
+                line_dst += s->pitch;
+                line_src += d->src_linesize;
+        }
+}
+
 static decompress_status gpujpeg_decompress(void *state, unsigned char *dst, unsigned char *buffer,
                 unsigned int src_len, int frame_seq, struct video_frame_callbacks *callbacks, struct pixfmt_desc *internal_prop)
 {
@@ -247,17 +286,17 @@ static decompress_status gpujpeg_decompress(void *state, unsigned char *dst, uns
         
         gpujpeg_set_device(cuda_devices[0]);
 
-        if (s->pitch == linesize && (s->out_codec == UYVY || s->out_codec == RGB
-                                || (s->out_codec == RGBA && s->rshift == 0 && s->gshift == 8 && s->bshift == 16)
-                        )) {
+        if (s->cuda_output) {
+                gpujpeg_decoder_output_set_custom_cuda(&decoder_output, dst);
+                ret = gpujpeg_decoder_decode(s->decoder, (uint8_t*) buffer, src_len, &decoder_output);
+                if (ret != 0) return DECODER_NO_FRAME;
+        } else if (can_output_directly(s)) {
                 gpujpeg_decoder_output_set_custom(&decoder_output, dst);
                 //int data_decompressed_size = decoder_output.data_size;
                     
                 ret = gpujpeg_decoder_decode(s->decoder, (uint8_t*) buffer, src_len, &decoder_output);
                 if (ret != 0) return DECODER_NO_FRAME;
         } else {
-                unsigned char *line_src, *line_dst;
-                
                 gpujpeg_decoder_output_set_default(&decoder_output);
                 decoder_output.type = GPUJPEG_DECODER_OUTPUT_INTERNAL_BUFFER;
                 //int data_decompressed_size = decoder_output.data_size;
@@ -265,21 +304,12 @@ static decompress_status gpujpeg_decompress(void *state, unsigned char *dst, uns
                 ret = gpujpeg_decoder_decode(s->decoder, (uint8_t*) buffer, src_len, &decoder_output);
 
                 if (ret != 0) return DECODER_NO_FRAME;
-                
-                line_dst = dst;
-                line_src = decoder_output.data;
-                for (unsigned i = 0u; i < s->desc.height; i++) {
-                        if (s->out_codec == RGBA) {
-                                vc_copylineRGBtoRGBA(line_dst, line_src, linesize,
-                                                s->rshift, s->gshift, s->bshift);
-                        } else {
-                                assert(s->out_codec == UYVY || s->out_codec == I420);
-                                memcpy(line_dst, line_src, linesize);
-                        }
-                                
-                        line_dst += s->pitch;
-                        line_src += vc_get_linesize(s->desc.width, s->out_codec);
-                }
+
+                // copied by the worker pool - a serial copy of 4K frames limits the decode rate,
+                // RGBA is converted from packed RGB output of the decoder
+                struct copy_lines_data d = { s, dst, decoder_output.data, linesize,
+                        s->out_codec == RGBA ? vc_get_linesize(s->desc.width, RGB) : linesize };
+                task_run_parallel_for(s->desc.height, COPY_LINES_PER_TASK, copy_lines, &d);
         }
 
         return DECODER_GOT_FRAME;
@@ -287,8 +317,7 @@ static decompress_status gpujpeg_decompress(void *state, unsigned char *dst, uns
 
 static int gpujpeg_decompress_get_property(void *state, int property, void *val, size_t *len)
 {
-        struct state_decompress *s = (struct state_decompress *) state;
-        UNUSED(s);
+        struct state_decompress_gpujpeg *s = (struct state_decompress_gpujpeg *) state;
         int ret = FALSE;
 
         switch(property) {
@@ -299,6 +328,14 @@ static int gpujpeg_decompress_get_property(void *state, int property, void *val,
                                 ret = TRUE;
                         }
                         break;
+                case DECOMPRESS_PROPERTY_CUDA_OUTPUT:
+                        if(*len >= sizeof(int)) {
+                                s->cuda_output = *(int *) val && can_output_directly(s);
+                                *(int *) val = s->cuda_output;
+                                *len = sizeof(int);
+                                ret = TRUE;
+                        }
+                        break;
                 default:
                         ret = FALSE;
         }
@@ -354,6 +391,7 @@ static const struct video_decompress_info gpujpeg_info = {
         gpujpeg_decompress_get_property,
         gpujpeg_decompress_done,
         gpujpeg_decompress_get_priority,
+        NULL,
 };
 
 REGISTER_MODULE(gpujpeg, &gpujpeg_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
@@ -377,6 +377,7 @@ static const struct video_decompress_info gpujpeg_to_dxt_info = {
         gpujpeg_to_dxt_decompress_get_property,
         gpujpeg_to_dxt_decompress_done,
         gpujpeg_to_dxt_decompress_get_priority,
+        nullptr,
 };
 
 REGISTER_MODULE(gpujpeg_to_dxt, &gpujpeg_to_dxt_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
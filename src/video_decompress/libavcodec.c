@@ -50,6 +50,8 @@
 #include "tv.h"
 #include "rtp/rtpdec_h264.h"
 #include "rtp/rtpenc_h264.h"
+#include "utils/macros.h"
+#include "utils/metrics.h"
 #include "utils/misc.h" // get_cpu_core_count()
 #include "utils/worker.h"
 #include "video.h"
@@ -97,8 +99,20 @@ struct state_libavcodec_decompress {
         struct hw_accel_state hwaccel;
 
         _Bool sps_vps_found; ///< to avoid initial error flood, start decoding after SPS (H.264) or VPS (HEVC) was received
+        bool streaming;      ///< frames are passed incrementally (DECOMPRESS_PROPERTY_STREAMING)
+        unsigned stream_sent; ///< bytes of the current frame already passed to the decoder if streaming
         double mov_avg_comp_duration;
         long mov_avg_frames;
+
+        struct {
+                bool enabled;       ///< thread type not set by the user in lavd-thread-count
+                int budget_ms;      ///< lavd-latency-budget - max decode delay added by frame threads
+                int probed_frames;  ///< frames checked for the slice count
+                int max_slices;     ///< max slice NAL units per frame seen (H.264/HEVC only)
+                int frame_threads;  ///< selected frame thread count, 0 - slice threading
+                bool reopen;        ///< decoder needs to be reopened with frame threads
+        } auto_threads;
+        struct metric *metric_delay;
 };
 
 static enum AVPixelFormat get_format_callback(struct AVCodecContext *s, const enum AVPixelFormat *fmt);
@@ -136,7 +150,10 @@ static int check_av_opt_set(void *state, const char *key, const char *val) {
 
 ADD_TO_PARAM("lavd-thread-count", "* lavd-thread-count=<thread_count>[F][S][n][d]\n"
                 "  Use <thread_count> decoding threads (0 is usually auto).\n"
-                "  Flag 'F' enables frame parallelism (disabled by default), 'S' slice based, can be both (default slice), 'n' for none; 'd' - disable low delay\n");
+                "  Flag 'F' enables frame parallelism (disabled by default), 'S' slice based, can be both (default slice), 'n' for none; 'd' - disable low delay\n"
+                "  Without 'F'/'S' the threading is selected automatically, see lavd-latency-budget.\n");
+ADD_TO_PARAM("lavd-latency-budget", "* lavd-latency-budget=<ms>\n"
+                "  Switch to frame threading if slice threads cannot keep up with the stream, adding at most <ms> of decode delay (default 0 - never)\n");
 static void set_codec_context_params(struct state_libavcodec_decompress *s)
 {
         int thread_count = 0; ///< decoder may use <cpu_count> frame threads with AV_CODEC_CAP_OTHER_THREADS (latency)
@@ -163,6 +180,12 @@ static void set_codec_context_params(struct state_libavcodec_decompress *s)
                 }
         }
 
+        s->auto_threads.enabled = req_thread_type == 0;
+        if (req_thread_type == 0 && s->auto_threads.frame_threads > 0) {
+                req_thread_type = FF_THREAD_FRAME;
+                thread_count = s->auto_threads.frame_threads;
+        }
+
         s->codec_ctx->thread_count = thread_count; // zero should mean count equal to the number of virtual cores
         s->codec_ctx->thread_type = 0;
         if (req_thread_type == 0) {
@@ -185,6 +208,12 @@ static void set_codec_context_params(struct state_libavcodec_decompress *s)
                 }
         }
 
+        if (s->streaming) {
+                // frame threads would delay the output by a frame per thread
+                s->codec_ctx->thread_type &= ~FF_THREAD_FRAME;
+                s->codec_ctx->flags2 |= AV_CODEC_FLAG2_CHUNKS;
+        }
+
         s->codec_ctx->flags |= req_low_delay ? AV_CODEC_FLAG_LOW_DELAY : 0;
         s->codec_ctx->flags2 |= AV_CODEC_FLAG2_FAST;
         // set by decoder
@@ -200,6 +229,24 @@ static void set_codec_context_params(struct state_libavcodec_decompress *s)
         }
 }
 
+/// exports and logs the output delay caused by frame threading of the opened decoder
+static void report_decode_delay(struct state_libavcodec_decompress *s)
+{
+        int delay_frames = 0;
+        if ((s->codec_ctx->active_thread_type & FF_THREAD_FRAME) != 0) {
+                delay_frames = (s->codec_ctx->thread_count > 0 ? s->codec_ctx->thread_count : get_cpu_core_count()) - 1;
+        }
+        if (s->metric_delay == NULL) {
+                s->metric_delay = metric_gauge("ug_lavd_decode_delay_frames",
+                                "frames of output delay added by frame threaded decoding", NULL);
+        }
+        metric_set(s->metric_delay, delay_frames);
+        if (delay_frames > 0) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Frame threading adds decode delay of %d frames (%.1f ms).\n",
+                                delay_frames, s->desc.fps > 0 ? delay_frames * 1000 / s->desc.fps : 0.0);
+        }
+}
+
 static void jpeg_callback(void)
 {
         log_msg(LOG_LEVEL_WARNING, "[lavd] Warning: JPEG decoder "
@@ -249,6 +296,9 @@ ADD_TO_PARAM("force-lavd-decoder", "* force-lavd-decoder=<decoder>[:<decoder2>..
 #ifdef HWACC_COMMON_IMPL
 ADD_TO_PARAM("use-hw-accel", "* use-hw-accel\n"
                 "  Tries to use hardware acceleration. \n");
+ADD_TO_PARAM("lavd-hw-map", "* lavd-hw-map\n"
+                "  Map hw. decoded surfaces to CPU memory instead of copying them (with use-hw-accel).\n"
+                "  Saves the download but reading a mapped surface may be slower on some GPUs.\n");
 #endif
 static bool configure_with(struct state_libavcodec_decompress *s,
                 struct video_desc desc, void *extradata, int extradata_size)
@@ -355,6 +405,7 @@ static bool configure_with(struct state_libavcodec_decompress *s,
                 log_msg(LOG_LEVEL_NOTICE, "[lavd] Using decoder: %s\n", (*codec_it)->name);
                 log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Codec %s capabilities: 0x%08X; using thread type %d, count %d\n",
                                 (*codec_it)->name, (*codec_it)->capabilities, s->codec_ctx->thread_type, s->codec_ctx->thread_count);
+                report_decode_delay(s);
                 break;
         }
 
@@ -410,6 +461,14 @@ static int libavcodec_decompress_reconfigure(void *state, struct video_desc desc
         }
         s->out_codec = out_codec;
         s->desc = desc;
+        s->streaming = false;
+        s->stream_sent = 0;
+        s->auto_threads.budget_ms = get_commandline_param("lavd-latency-budget") != NULL
+                ? atoi(get_commandline_param("lavd-latency-budget")) : 0;
+        s->auto_threads.probed_frames = 0;
+        s->auto_threads.max_slices = 0;
+        s->auto_threads.frame_threads = 0;
+        s->auto_threads.reopen = false;
 
         deconfigure(s);
         if (libav_codec_has_extradata(desc.color_spec)) {
@@ -421,7 +480,7 @@ static int libavcodec_decompress_reconfigure(void *state, struct video_desc desc
         }
 }
 
-#ifdef HWACC_RPI4
+#ifdef HWACC_RPI4_MMAL
 static int rpi4_hwacc_init(struct AVCodecContext *s,
                 struct hw_accel_state *state,
                 codec_t out_codec)
@@ -433,6 +492,28 @@ static int rpi4_hwacc_init(struct AVCodecContext *s,
 }
 #endif
 
+#ifdef HWACC_RPI4_DRM
+/**
+ * Decoded frames stay in DMA-BUFs (AV_PIX_FMT_DRM_PRIME) that are scanned out
+ * directly by the rpi4 display (DRM/KMS backend).
+ */
+static int rpi4_drm_hwacc_init(struct AVCodecContext *s,
+                struct hw_accel_state *state,
+                codec_t out_codec)
+{
+        UNUSED(out_codec);
+        AVBufferRef *device_ref = NULL;
+        int ret = create_hw_device_ctx(AV_HWDEVICE_TYPE_DRM, &device_ref);
+        if (ret < 0) {
+                return ret;
+        }
+        s->hw_device_ctx = device_ref;
+        state->type = HWACCEL_RPI4;
+        state->copy = false;
+        return 0;
+}
+#endif
+
 #ifdef HWACC_COMMON_IMPL
 static int hwacc_cuda_init(struct AVCodecContext *s, struct hw_accel_state *state, codec_t out_codec)
 {
@@ -492,11 +573,14 @@ static enum AVPixelFormat get_format_callback(struct AVCodecContext *s, const en
 #ifdef HWACC_VAAPI
                 {AV_PIX_FMT_VAAPI, HWACCEL_VAAPI, vaapi_init},
 #endif
-#ifdef HAVE_MACOSX
+#ifdef HWACC_VIDEOTOOLBOX
                 {AV_PIX_FMT_VIDEOTOOLBOX, HWACCEL_VIDEOTOOLBOX, videotoolbox_init},
 #endif
-#ifdef HWACC_RPI4
+#ifdef HWACC_RPI4_MMAL
                 {AV_PIX_FMT_RPI4_8, HWACCEL_RPI4, rpi4_hwacc_init},
+#endif
+#ifdef HWACC_RPI4_DRM
+                {AV_PIX_FMT_DRM_PRIME, HWACCEL_RPI4, rpi4_drm_hwacc_init},
 #endif
                 {AV_PIX_FMT_NONE, HWACCEL_NONE, NULL}
         };
@@ -522,7 +606,7 @@ static enum AVPixelFormat get_format_callback(struct AVCodecContext *s, const en
                         }
                 }
                 log_msg(LOG_LEVEL_WARNING, "[lavd] Falling back to software decoding!\n");
-                if (state->out_codec == HW_VDPAU) {
+                if (state->out_codec == HW_VDPAU || state->out_codec == HW_VIDEOTOOLBOX) {
                         return AV_PIX_FMT_NONE;
                 }
         }
@@ -650,14 +734,18 @@ static void *convert_task(void *arg) {
         return NULL;
 }
 
+/// minimal count of pixels converted by one task - splitting smaller frames costs more than it saves
+#define CONVERT_MIN_TASK_PIXELS (256 * 1024)
+
 static void parallel_convert(codec_t out_codec, const av_to_uv_convert_t *convert, char *dst, AVFrame *in, int width, int height, int pitch, int rgb_shift[static restrict 3]) {
-        if (codec_is_const_size(out_codec)) { // VAAPI etc
+        // each part needs to have at least 2 lines (even height)
+        int cpu_count = MIN(MIN(get_cpu_core_count(), height / 2),
+                        (int) ((long long) width * height / CONVERT_MIN_TASK_PIXELS));
+        if (codec_is_const_size(out_codec) || cpu_count <= 1) { // VAAPI etc
                 av_to_uv_convert(convert, dst, in, width, height, pitch, rgb_shift);
                 return;
         }
 
-        int cpu_count = get_cpu_core_count();
-
         struct convert_task_data d[cpu_count];
         AVFrame parts[cpu_count];
         for (int i = 0; i < cpu_count; ++i) {
@@ -795,6 +883,72 @@ static _Bool check_first_sps_vps(struct state_libavcodec_decompress *s, unsigned
         return 0;
 }
 
+/// records the number of H.264/HEVC slice NAL units in the frame for the thread mode selection
+static void probe_slice_count(struct state_libavcodec_decompress *s, const unsigned char *src, unsigned int src_len)
+{
+        enum { PROBED_FRAMES = 100 };
+        if (!s->auto_threads.enabled || s->auto_threads.probed_frames >= PROBED_FRAMES
+                        || (s->desc.color_spec != H264 && s->desc.color_spec != H265)) {
+                return;
+        }
+        s->auto_threads.probed_frames += 1;
+        int slices = 0;
+        const unsigned char *nal = src;
+        const unsigned char *nal_end = NULL;
+        while ((nal = rtpenc_h264_get_next_nal(nal, src + src_len - nal, &nal_end)) != NULL) {
+                if (s->desc.color_spec == H264) {
+                        int type = NALU_HDR_GET_TYPE(nal[0]);
+                        slices += type >= NAL_MIN && type <= NAL_IDR;
+                } else {
+                        slices += (nal[0] >> 1) < 32; // VCL NAL unit
+                }
+                nal = nal_end;
+        }
+        s->auto_threads.max_slices = MAX(s->auto_threads.max_slices, slices);
+}
+
+/**
+ * Automatic thread mode selection, called when the decoder is not making it.
+ * Slice threading (the default) is kept if the stream has at least as many
+ * slices as there are cores. Otherwise frame threading is selected with as
+ * many threads as the latency budget allows - each thread delays the output
+ * by one frame.
+ *
+ * @returns true if the decoder is going to be reopened with frame threads
+ */
+static bool auto_threads_select(struct state_libavcodec_decompress *s)
+{
+        if (!s->auto_threads.enabled || s->auto_threads.frame_threads > 0 || s->streaming
+                        || (s->codec_ctx->codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) == 0) {
+                return false;
+        }
+        const int cores = get_cpu_core_count();
+        if ((s->codec_ctx->active_thread_type & FF_THREAD_SLICE) != 0 && s->auto_threads.max_slices >= cores) {
+                return false;
+        }
+        const int delay_frames = MIN((int) (s->auto_threads.budget_ms * s->desc.fps / 1000), cores - 1);
+        if (delay_frames < 1) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Latency budget of %d ms doesn't allow frame threading (frame time %.2f ms).\n",
+                                s->auto_threads.budget_ms, 1000 / s->desc.fps);
+                return false;
+        }
+        s->auto_threads.frame_threads = delay_frames + 1;
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Slice threading cannot keep up (max %d slices per frame), "
+                        "switching to %d frame threads within latency budget of %d ms.\n",
+                        s->auto_threads.max_slices, s->auto_threads.frame_threads, s->auto_threads.budget_ms);
+        return true;
+}
+
+/// reopens the decoder with the automatically selected frame threading
+static void auto_threads_reopen(struct state_libavcodec_decompress *s)
+{
+        s->auto_threads.reopen = false;
+        deconfigure(s); // the new decoder produces output from the next keyframe
+        if (!libav_codec_has_extradata(s->desc.color_spec)) {
+                configure_with(s, s->desc, NULL, 0);
+        }
+}
+
 /// print hint to improve performance if not making it
 static void check_duration(struct state_libavcodec_decompress *s, double duration_total_sec, double duration_pixfmt_change_sec)
 {
@@ -809,6 +963,12 @@ static void check_duration(struct state_libavcodec_decompress *s, double duratio
         }
         log_msg(LOG_LEVEL_WARNING, MOD_NAME "Average decompression time of last %d frames is %f ms but time per frame is only %f ms!\n",
                         mov_window, s->mov_avg_comp_duration * 1000, 1000 / s->desc.fps);
+        if (auto_threads_select(s)) {
+                s->auto_threads.reopen = true;
+                s->mov_avg_comp_duration = 0;
+                s->mov_avg_frames = 0;
+                return;
+        }
         const char *hint = NULL;
         if ((s->codec_ctx->thread_type & FF_THREAD_SLICE) == 0 && (s->codec_ctx->codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) != 0) {
                 hint = "\"--param lavd-thread-count=<n>FS\" option with small <n> or 0 (nr of logical cores)";
@@ -873,6 +1033,49 @@ static bool read_forced_pixfmt(codec_t compress, unsigned char *src, unsigned in
         return true;
 }
 
+/**
+ * Converts the decoded s->frame to dst (unless probing).
+ * @param t0 time when the decoding of the frame started
+ */
+static decompress_status write_frame(struct state_libavcodec_decompress *s, unsigned char *dst, int frame_seq,
+                struct video_frame_callbacks *callbacks, time_ns_t t0)
+{
+        time_ns_t t1 = get_time_in_ns();
+
+        s->frame->opaque = callbacks;
+        /* Skip the frame if this is not an I-frame
+                 * and we have missed some of previous frames for VP8 because the
+                 * decoder makes ugly artifacts. We rather wait for next I-frame. */
+        if (s->desc.color_spec == VP8 &&
+                (s->frame->pict_type != AV_PICTURE_TYPE_I &&
+                (!s->last_frame_seq_initialized || (s->last_frame_seq + 1) % ((1<<22) - 1) != frame_seq))) {
+                        log_msg(LOG_LEVEL_WARNING, "[lavd] Missing appropriate I-frame "
+                                "(last valid %d, this %u).\n",
+                                s->last_frame_seq_initialized ?
+                                s->last_frame_seq : -1, (unsigned) frame_seq);
+                        return DECODER_NO_FRAME;
+        }
+#ifdef HWACC_COMMON_IMPL
+        if(s->hwaccel.copy){
+                transfer_frame(&s->hwaccel, s->frame);
+        }
+#endif
+        if (s->out_codec != VIDEO_CODEC_NONE) {
+                if (!reconfigure_convert_if_needed(s, s->frame->format, s->out_codec, s->desc.width, s->desc.height)) {
+                        return DECODER_UNSUPP_PIXFMT;
+                }
+                change_pixfmt(s->frame, dst, &s->convert, s->out_codec, s->desc.width,
+                              s->desc.height, s->pitch, s->rgb_shift, &s->sws);
+                s->last_frame_seq_initialized = true;
+                s->last_frame_seq = frame_seq;
+        }
+        time_ns_t t2 = get_time_in_ns();
+        log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Decompressing %c frame took %f ms, pixfmt change %f ms.\n", av_get_picture_type_char(s->frame->pict_type),
+                (t1 - t0) / NS_IN_MS_DBL, (t2 - t1) / NS_IN_MS_DBL);
+        check_duration(s, (t2 - t0) / NS_IN_SEC_DBL, (t2 - t1) / NS_IN_MS_DBL);
+        return DECODER_GOT_FRAME;
+}
+
 static decompress_status libavcodec_decompress(void *state, unsigned char *dst, unsigned char *src,
                 unsigned int src_len, int frame_seq, struct video_frame_callbacks *callbacks, struct pixfmt_desc *internal_props)
 {
@@ -891,6 +1094,8 @@ static decompress_status libavcodec_decompress(void *state, unsigned char *dst,
                 src_len -= extradata_size + sizeof(uint32_t);
         }
 
+        probe_slice_count(s, src, src_len);
+
         s->pkt->size = src_len;
         s->pkt->data = src;
 
@@ -907,39 +1112,10 @@ static decompress_status libavcodec_decompress(void *state, unsigned char *dst,
                 handle_lavd_error(s, ret);
                 return DECODER_NO_FRAME;
         }
-        time_ns_t t1 = get_time_in_ns();
-
-        s->frame->opaque = callbacks;
-        /* Skip the frame if this is not an I-frame
-                 * and we have missed some of previous frames for VP8 because the
-                 * decoder makes ugly artifacts. We rather wait for next I-frame. */
-        if (s->desc.color_spec == VP8 &&
-                (s->frame->pict_type != AV_PICTURE_TYPE_I &&
-                (!s->last_frame_seq_initialized || (s->last_frame_seq + 1) % ((1<<22) - 1) != frame_seq))) {
-                        log_msg(LOG_LEVEL_WARNING, "[lavd] Missing appropriate I-frame "
-                                "(last valid %d, this %u).\n",
-                                s->last_frame_seq_initialized ?
-                                s->last_frame_seq : -1, (unsigned) frame_seq);
-                        return DECODER_NO_FRAME;
-        }
-#ifdef HWACC_COMMON_IMPL
-        if(s->hwaccel.copy){
-                transfer_frame(&s->hwaccel, s->frame);
-        }
-#endif
-        if (s->out_codec != VIDEO_CODEC_NONE) {
-                if (!reconfigure_convert_if_needed(s, s->frame->format, s->out_codec, s->desc.width, s->desc.height)) {
-                        return DECODER_UNSUPP_PIXFMT;
-                }
-                change_pixfmt(s->frame, dst, &s->convert, s->out_codec, s->desc.width,
-                              s->desc.height, s->pitch, s->rgb_shift, &s->sws);
-                s->last_frame_seq_initialized = true;
-                s->last_frame_seq = frame_seq;
+        decompress_status status = write_frame(s, dst, frame_seq, callbacks, t0);
+        if (status != DECODER_GOT_FRAME) {
+                return status;
         }
-        time_ns_t t2 = get_time_in_ns();
-        log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Decompressing %c frame took %f ms, pixfmt change %f ms.\n", av_get_picture_type_char(s->frame->pict_type),
-                (t1 - t0) / NS_IN_MS_DBL, (t2 - t1) / NS_IN_MS_DBL);
-        check_duration(s, (t2 - t0) / NS_IN_SEC_DBL, (t2 - t1) / NS_IN_MS_DBL);
 
         if (s->out_codec == VIDEO_CODEC_NONE) {
                 log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Selected output pixel format: %s\n", av_get_pix_fmt_name(s->codec_ctx->pix_fmt));
@@ -953,9 +1129,63 @@ static decompress_status libavcodec_decompress(void *state, unsigned char *dst,
                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "Multiple frames decoded at once!\n");
         }
 
+        if (s->auto_threads.reopen) {
+                auto_threads_reopen(s);
+        }
+
         return DECODER_GOT_FRAME;
 }
 
+/**
+ * Passes the complete H.264 NAL units of the newly received part of the frame
+ * to the decoder (opened with AV_CODEC_FLAG2_CHUNKS) so that the slices are
+ * decoded as they arrive. The last NAL unit is complete only if followed by
+ * another one or if the whole frame was received.
+ */
+static decompress_status libavcodec_decompress_push(void *state, unsigned char *dst, unsigned char *buffer,
+                unsigned int src_len, bool last, int frame_seq, struct video_frame_callbacks *callbacks)
+{
+        struct state_libavcodec_decompress *s = (struct state_libavcodec_decompress *) state;
+        decompress_status status = DECODER_NO_FRAME;
+
+        if (!check_first_sps_vps(s, buffer, src_len)) {
+                return DECODER_NO_FRAME;
+        }
+
+        const unsigned char *end = buffer + src_len;
+        if (!last) {
+                const unsigned char *nal = buffer + s->stream_sent;
+                const unsigned char *nal_end = NULL;
+                end = buffer + s->stream_sent;
+                while ((nal = rtpenc_h264_get_next_nal(nal, buffer + src_len - nal, &nal_end)) != NULL
+                                && nal_end < buffer + src_len) {
+                        end = nal = nal_end;
+                }
+        }
+
+        time_ns_t t0 = get_time_in_ns();
+        if (end > buffer + s->stream_sent) {
+                s->pkt->data = buffer + s->stream_sent;
+                s->pkt->size = end - (buffer + s->stream_sent);
+                s->stream_sent = end - buffer;
+                int ret = avcodec_send_packet(s->codec_ctx, s->pkt);
+                if (ret != 0 && ret != AVERROR(EAGAIN)) {
+                        handle_lavd_error(s, ret);
+                }
+        }
+        int ret = avcodec_receive_frame(s->codec_ctx, s->frame);
+        if (ret == 0) {
+                s->consecutive_failed_decodes = 0;
+                status = write_frame(s, dst, frame_seq, callbacks, t0);
+        } else if (last && ret != AVERROR(EAGAIN)) {
+                handle_lavd_error(s, ret);
+        }
+        if (last) {
+                s->stream_sent = 0;
+        }
+        return status;
+}
+
 ADD_TO_PARAM("lavd-accept-corrupted",
                 "* lavd-accept-corrupted[=no]\n"
                 "  Pass corrupted frames to decoder. If decoder isn't error-resilient,\n"
@@ -981,6 +1211,25 @@ static int libavcodec_decompress_get_property(void *state, int property, void *v
                                         strcmp(get_commandline_param("lavd-accept-corrupted"), "no") != 0;
                         }
 
+                        *len = sizeof(int);
+                        ret = TRUE;
+                        break;
+                case DECOMPRESS_PROPERTY_STREAMING:
+                        if (*len < sizeof(int)) {
+                                return FALSE;
+                        }
+                        if (*(int *) val != 0 && !s->streaming && s->codec_ctx != NULL
+                                        && s->desc.color_spec == H264 && s->out_codec != VIDEO_CODEC_NONE) {
+                                // reopen the decoder with the streaming flags
+                                s->streaming = true;
+                                deconfigure(s);
+                                if (!configure_with(s, s->desc, NULL, 0)) {
+                                        s->streaming = false;
+                                        deconfigure(s);
+                                        configure_with(s, s->desc, NULL, 0);
+                                }
+                        }
+                        *(int *) val = s->streaming && *(int *) val != 0;
                         *len = sizeof(int);
                         ret = TRUE;
                         break;
@@ -1007,7 +1256,7 @@ static void libavcodec_decompress_done(void *state)
  */
 static int libavcodec_decompress_get_priority(codec_t compression, struct pixfmt_desc internal, codec_t ugc) {
         if (get_commandline_param("use-hw-accel") &&
-                        (((compression == H264 || compression == H265) && ugc == HW_VDPAU) ||
+                        (((compression == H264 || compression == H265) && (ugc == HW_VDPAU || ugc == HW_VIDEOTOOLBOX)) ||
                          (compression == H265 && ugc == RPI4_8))) {
                 return 200;
         }
@@ -1050,6 +1299,7 @@ static const struct video_decompress_info libavcodec_info = {
         libavcodec_decompress_get_property,
         libavcodec_decompress_done,
         libavcodec_decompress_get_priority,
+        libavcodec_decompress_push,
 };
 
 REGISTER_MODULE(libavcodec, &libavcodec_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
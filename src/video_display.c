@@ -66,6 +66,7 @@
 #include "lib_common.h"
 #include "module.h"
 #include "tv.h"
+#include "utils/profile_timer.hpp"
 #include "utils/thread.h"
 #include "utils/color_out.h"
 #include "video.h"
@@ -334,7 +335,9 @@ struct video_frame *display_get_frame(struct display *d)
 
 static int display_frame_helper(struct display *d, struct video_frame *frame, long long timeout_ns)
 {
+        C_PROFILER_PUSH("display_put_frame");
         int ret = d->funcs->putf(d->state, frame, timeout_ns);
+        C_PROFILER_POP;
         if (ret != 0 || !d->funcs->generic_fps_indicator_prefix) {
                 return ret;
         }
@@ -542,6 +545,8 @@ int display_ctl_property(struct display *d, int property, void *val, size_t *len
                                 }
                         }
 			break;
+                case DISPLAY_PROPERTY_EXTERNAL_FRAMES: // the frames are passed to the postprocessor
+                        return FALSE;
                 default:
                         return d->funcs->ctl_property(d->state, property, val, len);
                 }
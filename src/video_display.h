@@ -132,6 +132,9 @@ enum display_property {
         DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES = 5, ///< whether display supports receiving data from - returns (struct multi_sources_supp_info *)
                                                      ///< multiple network sources concurrently
         DISPLAY_PROPERTY_AUDIO_FORMAT = 6, ///< @see audio_display_info::query_format - in/out parameter is struct audio_desc
+        DISPLAY_PROPERTY_MEM_LOCATION = 7, ///< where frames returned by getf are allocated - enum mem_location_t (CPU_MEM if not implemented)
+        DISPLAY_PROPERTY_EXTERNAL_FRAMES = 8, ///< putf accepts also frames not obtained from getf, the display calls VIDEO_FRAME_DISPOSE
+                                              ///< on them when done (also if discarded) and must not write to them - bool (false if not implemented)
 };
 
 #define PITCH_DEFAULT -1 ///< default pitch, i. e. respective linesize
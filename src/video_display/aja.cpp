@@ -36,7 +36,8 @@
  */
 /*
  * Internal structure heavily inspired by and much code taken from NTV2Player Demo.
- * The use of ping-pong buffer technique is based on NTV2LLBurn.
+ * The use of ping-pong buffer technique is based on NTV2LLBurn, the AutoCirculate
+ * mode follows NTV2Player.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -62,6 +63,7 @@
 
 #include <chrono>
 #include <condition_variable>
+#include <exception>
 #include <functional>
 #include <iostream>
 #include <memory>
@@ -78,13 +80,17 @@
 #include "debug.h"
 #include "host.h"
 #include "lib_common.h"
+#include "module.h"
 #include "video_display.h"
+#include "video_display/audio_drift_fix.hpp"
 #include "rang.hpp"
 #include "video.h"
 
 #include "aja_common.h" // should be included last (overrides log_msg etc.)
 
 #define DEFAULT_MAX_FRAME_QUEUE_LEN 1
+#define DEFAULT_AC_RING_DEPTH 4
+#define HOST_BUFFER_ALIGN 4096
 #define MODULE_NAME "[AJA display] "
 /**
  * The maximum number of bytes of 48KHz audio that can be transferred for two frames.
@@ -110,6 +116,7 @@ using std::cout;
 using std::endl;
 using std::hash;
 using std::lock_guard;
+using std::max;
 using std::min;
 using std::mutex;
 using std::ostringstream;
@@ -147,6 +154,7 @@ struct display {
                 bool setupAll = true;
                 bool setupRoute = true;
                 bool smpteRange = true;
+                int acRingDepth = 0; ///< AutoCirculate ring depth, 0 - ping-pong buffers with DMA after VBlank
         } mConf;
 
         queue<struct video_frame *> frames;
@@ -155,7 +163,9 @@ struct display {
         condition_variable frame_ready;
         thread worker;
         void join();
+        struct video_frame *pop_frame();
         void process_frames();
+        void process_frames_autocirculate();
 
         bool mOutIsRGB = false;
         static const ULWord app = AJA_FOURCC ('U','L','G','R');
@@ -178,6 +188,14 @@ struct display {
         bool mAudioIsReset = false;
         uint32_t mAudioOutWrapAddress = 0u;
         uint32_t mAudioOutLastAddress = 0u;
+        uint32_t mAudioHwBuffered = 0u; ///< samples per channel queued on the card at the last DMA, guarded by mAudioLock
+        AudioDriftFixer mAudioDriftFixer{"AJA"};
+
+        /// page-locked host buffers for AutoCirculate transfers, recycled by getf
+        mutex mHostBuffersLock;
+        vector<char *> mFreeHostBuffers;
+        unordered_map<char *, size_t> mHostBufferSizes; ///< all allocated buffers
+        unique_ptr<char[]> mAcAudioBuffer; ///< audio copied out of mAudioBuffer for the transfer
 
         uint32_t mCurrentOutFrame;
         uint32_t mFramesProcessed = 0u;
@@ -191,10 +209,16 @@ public:
         display(struct configuration &configuration);
         ~display();
         void Init();
+        void InitAutoCirculate();
         AJAStatus SetUpVideo();
         AJAStatus SetUpAudio();
         void RouteOutputSignal();
         int Putf(struct video_frame *frame, long long nonblock);
+        struct video_frame *Getf();
+        char *GetHostBuffer(size_t size);
+        void ReturnHostBuffer(char *buf);
+        void FreeHostBuffers();
+        static void host_buffer_deleter(struct video_frame *frame);
 
         static NTV2FrameRate getFrameRate(double fps);
         void print_stats();
@@ -263,9 +287,13 @@ display::display(struct configuration &conf)
         }
 
         mCurrentOutFrame = mOutputChannel * 2u;
+        if (mConf.acRingDepth > 0 && mConf.withAudio) {
+                mAcAudioBuffer.reset(new char[NTV2_AUDIOSIZE_MAX]);
+        }
 }
 
 display::~display() {
+        FreeHostBuffers();
         CHECK(mDevice.UnsubscribeOutputVerticalEvent (mOutputChannel));
 
         if (!mDoMultiChannel) {
@@ -288,6 +316,11 @@ void display::Init()
         }
         RouteOutputSignal();
 
+        if (mConf.acRingDepth > 0) {
+                InitAutoCirculate();
+                return;
+        }
+
         //      Before the main loop starts, ping-pong the buffers so the hardware will use
         //      different buffers than the ones it was using while idling...
         for (unsigned int i = 0; i < desc.tile_count; ++i) {
@@ -300,6 +333,28 @@ void display::Init()
         }
 }
 
+/**
+ * Sets up the AutoCirculate output ring of mConf.acRingDepth device frames for
+ * every channel. The frames are transferred as soon as the ring has room so
+ * the DMA of next frames overlaps the scan-out of the current one. Audio (if
+ * any) is transferred together with the first tile.
+ */
+void display::InitAutoCirculate()
+{
+        for (unsigned int i = 0; i < desc.tile_count; ++i) {
+                NTV2Channel chan = (NTV2Channel)((unsigned int) mOutputChannel + i);
+                CHECK(mDevice.AutoCirculateStop(chan));
+                NTV2AudioSystem audioSystem = i == 0 && mConf.withAudio ? NTV2ChannelToAudioSystem(mOutputChannel) : NTV2_AUDIOSYSTEM_INVALID;
+                if (!mDevice.AutoCirculateInitForOutput(chan, mConf.acRingDepth, audioSystem)) {
+                        ostringstream oss;
+                        oss << "Cannot initialize AutoCirculate for channel " << chan + 1;
+                        throw runtime_error(oss.str());
+                }
+        }
+        mFramesDropped = 0;
+        FreeHostBuffers(); // drop buffers of the previous format
+}
+
 AJAStatus display::SetUpVideo ()
 {
         if (!mConf.setupAll) {
@@ -474,6 +529,7 @@ AJAStatus display::SetUpAudio ()
 
         CHECK(mDevice.GetAudioWrapAddress(mAudioOutWrapAddress, mAudioSystem));
         mAudioOutLastAddress = 0;
+        mAudioHwBuffered = 0;
 
         return AJA_STATUS_SUCCESS;
 
@@ -600,6 +656,16 @@ void display::join()
         worker.join();
 }
 
+/// @returns next frame to be displayed, nullptr to exit
+struct video_frame *display::pop_frame()
+{
+        unique_lock<mutex> lk(frames_lock);
+        frame_ready.wait(lk, [this]{ return frames.size() > 0; });
+        struct video_frame *frame = frames.front();
+        frames.pop();
+        return frame;
+}
+
 void display::process_frames()
 {
         for (unsigned int i = 0; i < desc.tile_count; ++i) {
@@ -607,16 +673,12 @@ void display::process_frames()
                 CHECK(mDevice.SubscribeOutputVerticalEvent(chan));
         }
 
-        while (true) {
-                unique_lock<mutex> lk(frames_lock);
-                frame_ready.wait(lk, [this]{ return frames.size() > 0; });
-                struct video_frame *frame = frames.front();
-                frames.pop();
-                lk.unlock();
-                if (!frame) { // poison pill
-                        break;
-                }
+        if (mConf.acRingDepth > 0) {
+                process_frames_autocirculate();
+                return;
+        }
 
+        while (struct video_frame *frame = pop_frame()) {
                 CHECK(mDevice.WaitForOutputVerticalInterrupt(mOutputChannel));
                 //      Flip sense of the buffers again to refer to the buffers that the hardware isn't using (i.e. the off-screen buffers)...
                 mCurrentOutFrame ^= 1;
@@ -652,7 +714,8 @@ void display::process_frames()
                                 uint32_t val;
                                 CHECK(mDevice.ReadAudioLastOut(val, NTV2AudioSystem(mOutputChannel)));
                                 int channels = ::NTV2DeviceGetMaxAudioChannels (mDeviceID);
-                                int latency_ms = ((mAudioOutLastAddress + mAudioOutWrapAddress - val) % mAudioOutWrapAddress) / (SAMPLE_RATE / 1000) / BPS / channels;
+                                mAudioHwBuffered = ((mAudioOutLastAddress + mAudioOutWrapAddress - val) % mAudioOutWrapAddress) / BPS / channels;
+                                int latency_ms = mAudioHwBuffered / (SAMPLE_RATE / 1000);
                                 if (latency_ms > 135) {
                                         LOG(LOG_LEVEL_WARNING) << MODULE_NAME "Buffer length: " << latency_ms << " ms, possible wrap-around.\n";
                                         mAudioOutLastAddress = ((val + (SAMPLE_RATE / 1000) * 70 /* ms */ * BPS * channels) % mAudioOutWrapAddress) / 128 * 128;
@@ -679,6 +742,133 @@ void display::process_frames()
         }
 }
 
+void display::process_frames_autocirculate()
+{
+        const ULWord preroll = max(mConf.acRingDepth / 2, 1);
+        AUTOCIRCULATE_TRANSFER xfer;
+        bool running = false;
+
+        while (struct video_frame *frame = pop_frame()) {
+                for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                        NTV2Channel chan = (NTV2Channel)((unsigned int) mOutputChannel + i);
+                        AUTOCIRCULATE_STATUS status;
+                        //      Block only if the whole ring is queued - the device then frees a slot each VBlank...
+                        while (running && mDevice.AutoCirculateGetStatus(chan, status) && !status.CanAcceptMoreOutputFrames()) {
+                                CHECK(mDevice.WaitForOutputVerticalInterrupt(chan));
+                        }
+                        xfer.SetVideoBuffer(reinterpret_cast<ULWord *>(frame->tiles[i].data), frame->tiles[i].data_len);
+                        size_t audioLen = 0;
+                        if (i == 0 && mAcAudioBuffer) {
+                                lock_guard<mutex> lk(mAudioLock);
+                                memcpy(mAcAudioBuffer.get(), mAudioBuffer.get(), mAudioLen);
+                                audioLen = mAudioLen;
+                                mAudioLen = 0;
+                        }
+                        xfer.SetAudioBuffer(audioLen > 0 ? reinterpret_cast<ULWord *>(mAcAudioBuffer.get()) : nullptr, audioLen);
+                        CHECK(mDevice.AutoCirculateTransfer(chan, xfer));
+                }
+
+                AUTOCIRCULATE_STATUS status;
+                CHECK(mDevice.AutoCirculateGetStatus(mOutputChannel, status));
+                if (!running && status.GetBufferLevel() >= preroll) {
+                        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                                CHECK(mDevice.AutoCirculateStart((NTV2Channel)((unsigned int) mOutputChannel + i)));
+                        }
+                        running = true;
+                }
+                if (status.GetDroppedFrameCount() > mFramesDropped) {
+                        LOG(LOG_LEVEL_WARNING) << MODULE_NAME << status.GetDroppedFrameCount() - mFramesDropped << " frame(s) repeated by AutoCirculate (ring underrun)\n";
+                        mFramesDropped = status.GetDroppedFrameCount();
+                }
+                mFramesProcessed++;
+                mFrames += 1;
+                print_stats();
+
+                vf_free(frame);
+        }
+
+        for (unsigned int i = 0; i < desc.tile_count; ++i) {
+                CHECK(mDevice.AutoCirculateStop((NTV2Channel)((unsigned int) mOutputChannel + i)));
+        }
+}
+
+/**
+ * @returns page-aligned host buffer of given size, registered for DMA with
+ * the device if the SDK supports that (otherwise the driver locks the pages
+ * for every transfer)
+ */
+char *display::GetHostBuffer(size_t size)
+{
+        lock_guard<mutex> lk(mHostBuffersLock);
+        for (auto it = mFreeHostBuffers.begin(); it != mFreeHostBuffers.end(); ++it) {
+                if (mHostBufferSizes.at(*it) == size) {
+                        char *buf = *it;
+                        mFreeHostBuffers.erase(it);
+                        return buf;
+                }
+        }
+        auto *buf = static_cast<char *>(aligned_malloc(size, HOST_BUFFER_ALIGN));
+        if (buf == nullptr) {
+                return nullptr;
+        }
+#if (AJA_NTV2_SDK_VERSION_MAJOR > 15 || (AJA_NTV2_SDK_VERSION_MAJOR == 15 && AJA_NTV2_SDK_VERSION_MINOR >= 5))
+        if (!mDevice.DMABufferLock(reinterpret_cast<ULWord *>(buf), size, true)) {
+                LOG(LOG_LEVEL_VERBOSE) << MODULE_NAME "Cannot page-lock host buffer, using regular DMA.\n";
+        }
+#endif
+        mHostBufferSizes[buf] = size;
+        return buf;
+}
+
+void display::ReturnHostBuffer(char *buf)
+{
+        lock_guard<mutex> lk(mHostBuffersLock);
+        mFreeHostBuffers.push_back(buf);
+}
+
+/// frees unused host buffers, the ones currently in use are returned to the free list and freed by the next call
+void display::FreeHostBuffers()
+{
+        lock_guard<mutex> lk(mHostBuffersLock);
+        for (char *buf : mFreeHostBuffers) {
+#if (AJA_NTV2_SDK_VERSION_MAJOR > 15 || (AJA_NTV2_SDK_VERSION_MAJOR == 15 && AJA_NTV2_SDK_VERSION_MINOR >= 5))
+                mDevice.DMABufferUnlock(reinterpret_cast<ULWord *>(buf), mHostBufferSizes.at(buf));
+#endif
+                mHostBufferSizes.erase(buf);
+                aligned_free(buf);
+        }
+        mFreeHostBuffers.clear();
+}
+
+void display::host_buffer_deleter(struct video_frame *frame)
+{
+        auto s = static_cast<struct aja::display *>(frame->callbacks.dispose_udata);
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                s->ReturnHostBuffer(frame->tiles[i].data);
+        }
+}
+
+struct video_frame *display::Getf()
+{
+        if (mConf.acRingDepth == 0) {
+                return vf_alloc_desc_data(desc);
+        }
+        struct video_frame *frame = vf_alloc_desc(desc);
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                frame->tiles[i].data = GetHostBuffer(frame->tiles[i].data_len + MAX_PADDING);
+                if (frame->tiles[i].data == nullptr) {
+                        for (unsigned int j = 0; j < i; ++j) {
+                                ReturnHostBuffer(frame->tiles[j].data);
+                        }
+                        vf_free(frame);
+                        return nullptr;
+                }
+        }
+        frame->callbacks.dispose_udata = this;
+        frame->callbacks.data_deleter = host_buffer_deleter;
+        return frame;
+}
+
 int display::Putf(struct video_frame *frame, long long flags) {
         if (frame == nullptr) {
                 return 1;
@@ -720,9 +910,13 @@ void aja::display::print_stats() {
 void aja::display::show_help() {
         cout << "Usage:\n"
                 "\t" << rang::style::bold << rang::fg::red << "-d aja" << rang::fg::reset <<
-                "[[:buffers=<b>][:channel=<ch>][:clear-routing][:connection=<c>][:device=<d>][:[no-]multi-channel][:novsync][:no-setup[-route]][:RGB|:YUV][:{smpte|full}-range]|:help] [-r embedded]\n" << rang::style::reset <<
+                "[[:autocirculate[=<depth>]][:buffers=<b>][:channel=<ch>][:clear-routing][:connection=<c>][:device=<d>][:[no-]multi-channel][:novsync][:no-setup[-route]][:RGB|:YUV][:{smpte|full}-range]" AUDIO_DRIFT_FIX_OPTS "|:help] [-r embedded]\n" << rang::style::reset <<
                 "where\n";
 
+        cout << rang::style::bold << "\tautocirculate[=<depth>]\n" << rang::style::reset <<
+                "\t\tuse AutoCirculate with a ring of <depth> device frames (default " << DEFAULT_AC_RING_DEPTH << ") - frames are transferred\n"
+                "\t\twhile the previous ones are played, playback starts when half of the ring is filled\n";
+
         cout << rang::style::bold << "\tbuffers\n" << rang::style::reset <<
                 "\t\tuse <b> output buffers (default is " << DEFAULT_MAX_FRAME_QUEUE_LEN << ") - higher values increase stability\n"
                 "\t\tbut may also increase latency (when VBlank is enabled)\n";
@@ -768,6 +962,8 @@ void aja::display::show_help() {
         cout << rang::style::bold << "\t-r embedded\n" << rang::style::reset <<
                 "\t\treceive also audio and embed it to SDI\n";
 
+        cout << "\nEmbedded audio clock drift compensation (not with autocirculate):\n" AUDIO_DRIFT_FIX_HELP;
+
         cout << "\n";
         cout << "Available devices:\n";
 
@@ -912,9 +1108,10 @@ LINK_SPEC int display_aja_reconfigure(void *state, struct video_desc desc)
         return TRUE;
 }
 
-LINK_SPEC void *display_aja_init(struct module * /* parent */, const char *fmt, unsigned int flags)
+LINK_SPEC void *display_aja_init(struct module *parent, const char *fmt, unsigned int flags)
 {
         struct aja::display::configuration conf;
+        vector<string> drift_fix_opts; // applied to the display, the configuration is const there
         auto tmp = static_cast<char *>(alloca(strlen(fmt) + 1));
         strcpy(tmp, fmt);
 
@@ -923,6 +1120,15 @@ LINK_SPEC void *display_aja_init(struct module * /* parent */, const char *fmt,
                 if (strcmp("help", item) == 0) {
                         aja::display::show_help();
                         return INIT_NOERR;
+                } else if (strstr(item, "autocirculate") == item) {
+                        conf.acRingDepth = DEFAULT_AC_RING_DEPTH;
+                        if (strchr(item, '=') != nullptr) {
+                                conf.acRingDepth = atoi(strchr(item, '=') + 1);
+                        }
+                        if (conf.acRingDepth < 2) {
+                                LOG(LOG_LEVEL_ERROR) << MODULE_NAME "AutoCirculate ring depth must be at least 2!\n";
+                                return nullptr;
+                        }
                 } else if (strstr(item, "buffers=") == item) {
                         conf.bufLen = atoi(item + strlen("buffers="));
                         if (conf.bufLen <= 0) {
@@ -964,6 +1170,10 @@ LINK_SPEC void *display_aja_init(struct module * /* parent */, const char *fmt,
                         conf.forceOutputColorSpace = strcasecmp(item, "RGB") == 0 ? RGB : UYVY;
                 } else if (strcasecmp(item, "smpte-range") == 0 || strcasecmp(item, "full-range") == 0) {
                         conf.smpteRange = strcasecmp(item, "smpte-range") == 0;
+                } else if (strstr(item, "drift_fix") == item || strncasecmp(item, "maxresample=", strlen("maxresample=")) == 0
+                                || strncasecmp(item, "minresample=", strlen("minresample=")) == 0
+                                || strncasecmp(item, "targetbuffer=", strlen("targetbuffer=")) == 0) {
+                        drift_fix_opts.push_back(item);
                 } else {
                         LOG(LOG_LEVEL_ERROR) << MODULE_NAME "Unknown option: " << item << "\n";
                         return nullptr;
@@ -971,15 +1181,25 @@ LINK_SPEC void *display_aja_init(struct module * /* parent */, const char *fmt,
                 tmp = nullptr;
         }
 
+        aja::display *s = nullptr;
         try {
                 conf.withAudio = (flags & DISPLAY_FLAG_AUDIO_ANY) != 0u;
-                auto s = new aja::display(conf);
-                return s;
-        } catch (runtime_error &e) {
+                s = new aja::display(conf);
+                for (auto const &opt : drift_fix_opts) {
+                        s->mAudioDriftFixer.parse_option(opt.c_str());
+                }
+        } catch (std::exception &e) {
                 LOG(LOG_LEVEL_ERROR) << MODULE_NAME << e.what() << "\n";
+                delete s;
+                return nullptr;
+        }
+        if (s->mAudioDriftFixer.is_enabled() && conf.acRingDepth > 0) {
+                // AutoCirculate owns the audio ring, the host-side fill is not meaningful
+                LOG(LOG_LEVEL_WARNING) << MODULE_NAME "Audio drift fix is not supported with AutoCirculate, ignoring.\n";
         }
+        s->mAudioDriftFixer.set_root(get_root_module(parent));
 
-        return nullptr;
+        return s;
 }
 
 LINK_SPEC void display_aja_done(void *state)
@@ -998,14 +1218,19 @@ LINK_SPEC struct video_frame *display_aja_getf(void *state)
 {
         auto s = static_cast<struct aja::display *>(state);
 
-        return vf_alloc_desc_data(s->desc);
+        return s->Getf();
 }
 
 LINK_SPEC int display_aja_putf(void *state, struct video_frame *frame, long long nonblock)
 {
         auto s = static_cast<struct aja::display *>(state);
 
-        if (frame && frame->color_spec == R12L) {
+        if (frame && frame->color_spec == R12L && frame->callbacks.data_deleter == aja::display::host_buffer_deleter) {
+                // keep the page-locked buffer, convert through a temporary one
+                vector<unsigned char> tmp(frame->tiles[0].data_len);
+                vc_copylineR12LtoR12A(tmp.data(), (unsigned char *) frame->tiles[0].data, frame->tiles[0].data_len, 0, 0, 0);
+                memcpy(frame->tiles[0].data, tmp.data(), tmp.size());
+        } else if (frame && frame->color_spec == R12L) {
                 char *tmp = (char *) malloc(frame->tiles[0].data_len);
                 vc_copylineR12LtoR12A((unsigned char *) tmp, (unsigned char *) frame->tiles[0].data, frame->tiles[0].data_len, 0, 0, 0);
                 free(frame->tiles[0].data);
@@ -1065,16 +1290,27 @@ LINK_SPEC int display_aja_get_property(void *state, int property, void *val, siz
 LINK_SPEC void display_aja_put_audio_frame(void *state, const struct audio_frame *frame)
 {
         auto s = static_cast<struct aja::display *>(state);
+        const int sample_size = frame->bps * frame->ch_count;
+        uint32_t buffered = 0;
+        int len = 0;
 
-        lock_guard<mutex> lk(s->mAudioLock);
-        int len = NTV2_AUDIOSIZE_MAX - s->mAudioLen;
-        if (frame->data_len > len) {
-                LOG(LOG_LEVEL_WARNING) << MODULE_NAME << "Audio buffer overrun!\n";
-        } else {
-                len = frame->data_len;
+        {
+                lock_guard<mutex> lk(s->mAudioLock);
+                // the card plays from its ring, mAudioBuffer is DMA-ed there once per frame
+                buffered = s->mAudioHwBuffered + s->mAudioLen / sample_size;
+                len = NTV2_AUDIOSIZE_MAX - s->mAudioLen;
+                if (frame->data_len > len) {
+                        LOG(LOG_LEVEL_WARNING) << MODULE_NAME << "Audio buffer overrun!\n";
+                } else {
+                        len = frame->data_len;
+                }
+                memcpy(s->mAudioBuffer.get() + s->mAudioLen, frame->data, len);
+                s->mAudioLen += len;
+        }
+
+        if (s->mConf.acRingDepth == 0) {
+                s->mAudioDriftFixer.update(buffered, frame->data_len / sample_size, len / sample_size);
         }
-        memcpy(s->mAudioBuffer.get() + s->mAudioLen, frame->data, len);
-        s->mAudioLen += len;
 }
 
 LINK_SPEC int display_aja_reconfigure_audio(void *state, int quant_samples, int channels,
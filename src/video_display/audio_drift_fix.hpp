@@ -1,7 +1,14 @@
 /**
- * @file   video_display/decklink_drift_fix.hpp
+ * @file   video_display/audio_drift_fix.hpp
  * @author Martin Pulec     <pulec@cesnet.cz>
  * @author Andrew Walker    <andrew.walker@sohonet.com>
+ * @brief  audio-driven clock recovery for displays with a hardware clock
+ *
+ * The display reports its audio buffer fill on every written audio frame
+ * (AudioDriftFixer::update()) and the fixer asks the audio decoder to
+ * resample slightly faster or slower so that the fill stays around the
+ * target - the audio then follows the output card clock instead of the
+ * sender one. Used by DeckLink, AJA, Bluefish444 and Deltacast displays.
  */
 /*
  * Copyright (c) 2021-2022 CESNET, z. s. p. o.
@@ -36,17 +43,39 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#ifndef SRC_VIDEO_DISPLAY_DECKLINK_DRIFT_FIX_HPP_69DBC8A9_974D_46C5_833D_5A77CF35E034
-#define SRC_VIDEO_DISPLAY_DECKLINK_DRIFT_FIX_HPP_69DBC8A9_974D_46C5_833D_5A77CF35E034
+#ifndef SRC_VIDEO_DISPLAY_AUDIO_DRIFT_FIX_HPP_69DBC8A9_974D_46C5_833D_5A77CF35E034
+#define SRC_VIDEO_DISPLAY_AUDIO_DRIFT_FIX_HPP_69DBC8A9_974D_46C5_833D_5A77CF35E034
 
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 #include <string>
+#include <strings.h>
 
+#include "debug.h"
 #include "host.h"
+#include "messaging.h"
+#include "module.h"
+#include "rtp/audio_decoders.h"
 #include "utils/color_out.h"
+#include "utils/macros.h" // TOSTRING
+#include "utils/misc.h" // parse_uint32
 
 #define MAX_RESAMPLE_DELTA_DEFAULT 30
 #define MIN_RESAMPLE_DELTA_DEFAULT 1
 #define TARGET_BUFFER_DEFAULT 2700
+#define AUDIO_DRIFT_FIX_SAMPLE_RATE_DEFAULT 48000
+
+/// options accepted by AudioDriftFixer::parse_option(), to be listed in the display help
+#define AUDIO_DRIFT_FIX_OPTS "[:drift_fix][:maxresample=<N>][:minresample=<N>][:targetbuffer=<N>]"
+#define AUDIO_DRIFT_FIX_HELP \
+        "\tdrift_fix\n\t\tfollow the card clock by resampling the audio (experimental)\n" \
+        "\tmaxresample=<N>/minresample=<N>\n\t\tmaximal/minimal resample delta when the scaling is applied (Hz)\n" \
+        "\ttargetbuffer=<N>\n\t\ttarget amount of samples in the buffer (per channel, default " TOSTRING(TARGET_BUFFER_DEFAULT) ")\n"
 
 class MovingAverage {
 public:
@@ -129,16 +158,17 @@ private:
 	}
 };
 
-class DecklinkAudioSummary {
+class AudioDriftSummary {
 public:
+        explicit AudioDriftSummary(std::string name) : name(std::move(name)) {}
         /**
-         * @brief This will detail out the longer running stats of the Decklink. It should be called on every audio frame
+         * @brief This will detail out the longer running stats of the display. It should be called on every audio frame
          *        but will only print out the report once every 30 seconds.
          */
         void report() {
                 std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
                 if(std::chrono::duration_cast<std::chrono::seconds>(now - this->last_summary).count() > 10) {                
-                        LOG(LOG_LEVEL_INFO) << SUNDERLINE("Decklink stats (cumulative)")
+                        LOG(LOG_LEVEL_INFO) << SUNDERLINE(name + " stats (cumulative)")
                                         << " - Total Audio Frames Played: "
                                         << SBOLD(this->frames_played)
                                         << " / Missing Audio Frames: "
@@ -267,7 +297,8 @@ public:
                 this->prev_audio_end = std::chrono::high_resolution_clock::now();
         }
 private:
-        // Keep a track of the amount in the decklink buffer
+        std::string name;
+        // Keep a track of the amount in the display buffer
         int32_t prev_buffer_samples = -1;
         // How many frames have been successfully written
         uint32_t frames_played = 0;
@@ -300,13 +331,51 @@ private:
  */
 class AudioDriftFixer {
 public:
+        /// @param name display name used in the log and the stats
+        explicit AudioDriftFixer(const char *name = "DeckLink")
+                : log_prefix(std::string("[") + name + " drift fix] "), audio_summary(name) {}
+
         void enable() {
                 m_enabled = true;
                 if (commandline_params.find("resampler") == commandline_params.end()) {
-                        LOG(LOG_LEVEL_INFO) << MOD_NAME << "Using SoxR resampler by default when DecKlink audio drift fixer is enabled.\n";
+                        LOG(LOG_LEVEL_INFO) << log_prefix << "Using SoxR resampler by default when audio drift fixer is enabled.\n";
                         commandline_params["resampler"] = "soxr";
                 }
         }
+
+        bool is_enabled() const {
+                return m_enabled;
+        }
+
+        /**
+         * Parses one of the AUDIO_DRIFT_FIX_OPTS display options.
+         * @retval true  option was recognized and applied
+         * @retval false not a drift-fix option
+         * @throws std::logic_error if the value is not a valid number
+         */
+        bool parse_option(const char *opt) {
+                if (strstr(opt, "drift_fix") == opt) {
+                        enable();
+                } else if (strncasecmp(opt, "maxresample=", strlen("maxresample=")) == 0) {
+                        set_max_hz(parse_uint32(strchr(opt, '=') + 1));
+                } else if (strncasecmp(opt, "minresample=", strlen("minresample=")) == 0) {
+                        set_min_hz(parse_uint32(strchr(opt, '=') + 1));
+                } else if (strncasecmp(opt, "targetbuffer=", strlen("targetbuffer=")) == 0) {
+                        set_target_buffer(parse_uint32(strchr(opt, '=') + 1));
+                } else {
+                        return false;
+                }
+                return true;
+        }
+
+        /**
+         * @brief Set the nominal sample rate of the output
+         *
+         * @param sample_rate rate the card plays (and the resampling is relative to)
+         */
+        void set_sample_rate(uint32_t sample_rate) {
+                this->sample_rate = sample_rate;
+        }
         /**
          * @brief Set the max hz object
          * 
@@ -400,7 +469,7 @@ public:
                 // Calculate the average
                 uint32_t average_buffer_depth = (uint32_t)(this->average_buffer_samples.avg());
 
-                int resample_hz = dst_frame_rate = (bmdAudioSampleRate48kHz) * BASE;
+                int resample_hz = dst_frame_rate = (long long) sample_rate * BASE;
 
                 // Check to see if our buffered samples has enough to calculate a good average
                 if (this->average_buffer_samples.filled()) {
@@ -419,28 +488,28 @@ public:
                         {
                                 // The buffer is too large, so we need to resample down to remove some frames
                                 resample_hz = (int)this->scale_buffer_delta(average_buffer_depth - target_buffer_fill - this->pos_jitter);
-                                dst_frame_rate = (bmdAudioSampleRate48kHz - resample_hz) * BASE;
+                                dst_frame_rate = ((long long) sample_rate - resample_hz) * BASE;
                                 this->audio_summary.increment_resample_low();
                         } else if(average_buffer_depth < target_buffer_fill - this->neg_jitter) {
                                  // The buffer is too small, so we need to resample up to generate some additional frames
                                 resample_hz = (int)this->scale_buffer_delta(target_buffer_fill - average_buffer_depth - this->neg_jitter);
-                                dst_frame_rate = (bmdAudioSampleRate48kHz + resample_hz) * BASE;
+                                dst_frame_rate = ((long long) sample_rate + resample_hz) * BASE;
                                 this->audio_summary.increment_resample_high();
                         } else {
-                                dst_frame_rate = (bmdAudioSampleRate48kHz) * BASE;
+                                dst_frame_rate = (long long) sample_rate * BASE;
                         }       
                 }
 
-                LOG(LOG_LEVEL_DEBUG) << MOD_NAME << " UPDATE playing speed " <<  average_buffer_depth << " vs " << buffered_count << " " << average_delta.avg() << " average_velocity " << resample_hz << " resample_hz\n";
+                LOG(LOG_LEVEL_DEBUG) << log_prefix << "UPDATE playing speed " <<  average_buffer_depth << " vs " << buffered_count << " " << average_delta.avg() << " average_velocity " << resample_hz << " resample_hz\n";
 
    
                 if (dst_frame_rate != 0) {
                         auto *m = new msg_universal((std::string(MSG_UNIVERSAL_TAG_AUDIO_DECODER) + std::to_string(dst_frame_rate << ADEC_CH_RATE_SHIFT | BASE)).c_str());
-                        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Sending resample request " << dst_frame_rate << "/" << BASE << "\n";
+                        LOG(LOG_LEVEL_VERBOSE) << log_prefix << "Sending resample request " << dst_frame_rate << "/" << BASE << "\n";
                         assert(m_root != nullptr);
                         auto *response = send_message_sync(m_root, "audio.receiver.decoder", reinterpret_cast<message *>(m), 100, SEND_MESSAGE_FLAG_NO_STORE);
                         if (!RESPONSE_SUCCESSFUL(response_get_status(response))) {
-                                LOG(LOG_LEVEL_WARNING) << MOD_NAME "Unable to send resample message: " << response_get_text(response) << " (" << response_get_status(response) << ")\n";
+                                LOG(LOG_LEVEL_WARNING) << log_prefix << "Unable to send resample message: " << response_get_text(response) << " (" << response_get_status(response) << ")\n";
                         }
                         free_response(response);
                 }
@@ -456,7 +525,9 @@ public:
         }
 
 private:
+        std::string log_prefix;
         bool m_enabled = false;
+        uint32_t sample_rate = AUDIO_DRIFT_FIX_SAMPLE_RATE_DEFAULT;
 
         static constexpr unsigned long BASE = (1U<<8U);
         struct module *m_root = nullptr;
@@ -482,10 +553,10 @@ private:
         [[maybe_unused]] uint32_t min_avg = 1800;
 
         // Store a audio_summary of resampling
-        DecklinkAudioSummary audio_summary{};
+        AudioDriftSummary audio_summary;
 
         static const uint32_t POS_JITTER_DEFAULT = 600;
         static const uint32_t NEG_JITTER_DEFAULT = 600;
 };
 
-#endif // defined SRC_VIDEO_DISPLAY_DECKLINK_DRIFT_FIX_HPP_69DBC8A9_974D_46C5_833D_5A77CF35E034
+#endif // defined SRC_VIDEO_DISPLAY_AUDIO_DRIFT_FIX_HPP_69DBC8A9_974D_46C5_833D_5A77CF35E034
@@ -45,6 +45,9 @@
 #include "config_win32.h"
 #include "debug.h"
 #include "lib_common.h"
+#include "utils/cpu_features.h"
+#include "utils/frame_copy.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_display.h"
 
@@ -60,6 +63,11 @@
 #include <thread>
 #include <unordered_map>
 
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#define HAVE_BLEND_X86_SIMD 1
+#endif
+
 using namespace std;
 
 static constexpr int TRANSITION_COUNT = 10;
@@ -67,9 +75,114 @@ static constexpr int BUFFER_LEN = 5;
 static constexpr chrono::milliseconds SOURCE_TIMEOUT(500);
 static constexpr unsigned int IN_QUEUE_MAX_BUFFER_LEN = 5;
 static constexpr int SKIP_FIRST_N_FRAMES_IN_STREAM = 5;
+static constexpr size_t CROSSFADE_CHUNK = 64 * 1024; ///< bytes processed by one parallel task
+
+/*
+ * The weighted sum of 2 pixels (at most 255 * TRANSITION_COUNT) is divided by
+ * TRANSITION_COUNT by a multiplication: x / d = (x * DIV_MAGIC) >> (16 + DIV_SHIFT),
+ * exact for all 16-bit x as long as DIV_MAGIC * d - 2^(16 + DIV_SHIFT) <= 2^DIV_SHIFT.
+ */
+static constexpr int floor_log2(unsigned x, int ret = 0) {
+        return (2U << ret) > x ? ret : floor_log2(x, ret + 1);
+}
+static constexpr int DIV_SHIFT = floor_log2(TRANSITION_COUNT);
+static constexpr unsigned DIV_MAGIC = (1U << (16 + DIV_SHIFT)) / TRANSITION_COUNT + 1;
+static_assert(255 * TRANSITION_COUNT < 65536 && DIV_MAGIC < 65536 &&
+                DIV_MAGIC * TRANSITION_COUNT - (1U << (16 + DIV_SHIFT)) <= (1U << DIV_SHIFT),
+                "the magic division is not exact for TRANSITION_COUNT");
 
 static void display_blend_run(void *state);
 
+#ifdef HAVE_BLEND_X86_SIMD
+__attribute__((target("sse2")))
+static size_t crossfade_sse2(unsigned char *dst, const unsigned char *old_data, const unsigned char *new_data,
+                size_t len, int transition)
+{
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i new_weight = _mm_set1_epi16((short) transition);
+        const __m128i old_weight = _mm_set1_epi16((short) (TRANSITION_COUNT - transition));
+        const __m128i magic = _mm_set1_epi16((short) DIV_MAGIC);
+        size_t i = 0;
+        for ( ; i + 16 <= len; i += 16) {
+                __m128i o = _mm_loadu_si128((const __m128i *)(const void *) (old_data + i));
+                __m128i n = _mm_loadu_si128((const __m128i *)(const void *) (new_data + i));
+                __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(n, zero), new_weight),
+                                _mm_mullo_epi16(_mm_unpacklo_epi8(o, zero), old_weight));
+                __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(n, zero), new_weight),
+                                _mm_mullo_epi16(_mm_unpackhi_epi8(o, zero), old_weight));
+                lo = _mm_srli_epi16(_mm_mulhi_epu16(lo, magic), DIV_SHIFT);
+                hi = _mm_srli_epi16(_mm_mulhi_epu16(hi, magic), DIV_SHIFT);
+                _mm_storeu_si128((__m128i *)(void *) (dst + i), _mm_packus_epi16(lo, hi));
+        }
+        return i;
+}
+
+__attribute__((target("avx2")))
+static size_t crossfade_avx2(unsigned char *dst, const unsigned char *old_data, const unsigned char *new_data,
+                size_t len, int transition)
+{
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i new_weight = _mm256_set1_epi16((short) transition);
+        const __m256i old_weight = _mm256_set1_epi16((short) (TRANSITION_COUNT - transition));
+        const __m256i magic = _mm256_set1_epi16((short) DIV_MAGIC);
+        size_t i = 0;
+        for ( ; i + 32 <= len; i += 32) {
+                __m256i o = _mm256_loadu_si256((const __m256i *)(const void *) (old_data + i));
+                __m256i n = _mm256_loadu_si256((const __m256i *)(const void *) (new_data + i));
+                // unpack and pack are both per 128-bit lane, so the byte order is preserved
+                __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(n, zero), new_weight),
+                                _mm256_mullo_epi16(_mm256_unpacklo_epi8(o, zero), old_weight));
+                __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(n, zero), new_weight),
+                                _mm256_mullo_epi16(_mm256_unpackhi_epi8(o, zero), old_weight));
+                lo = _mm256_srli_epi16(_mm256_mulhi_epu16(lo, magic), DIV_SHIFT);
+                hi = _mm256_srli_epi16(_mm256_mulhi_epu16(hi, magic), DIV_SHIFT);
+                _mm256_storeu_si256((__m256i *)(void *) (dst + i), _mm256_packus_epi16(lo, hi));
+        }
+        return i;
+}
+#endif // defined HAVE_BLEND_X86_SIMD
+
+/// dst = (new * transition + old * (TRANSITION_COUNT - transition)) / TRANSITION_COUNT
+static void crossfade_line(unsigned char *dst, const unsigned char *old_data, const unsigned char *new_data,
+                size_t len, int transition)
+{
+        size_t i = 0;
+#ifdef HAVE_BLEND_X86_SIMD
+        if (cpu_has(CPU_FEATURE_AVX2)) {
+                i = crossfade_avx2(dst, old_data, new_data, len, transition);
+        } else if (cpu_has(CPU_FEATURE_SSE2)) {
+                i = crossfade_sse2(dst, old_data, new_data, len, transition);
+        }
+#endif
+        for ( ; i < len; ++i) {
+                dst[i] = ((new_data[i] * transition) + (old_data[i] * (TRANSITION_COUNT - transition))) / TRANSITION_COUNT;
+        }
+}
+
+struct crossfade_data {
+        unsigned char *dst;
+        const unsigned char *old_data;
+        const unsigned char *new_data;
+        size_t len;
+        int transition;
+};
+
+static void crossfade_body(void *udata, size_t begin, size_t end)
+{
+        auto *d = static_cast<crossfade_data *>(udata);
+        size_t off = begin * CROSSFADE_CHUNK;
+        size_t len = min(end * CROSSFADE_CHUNK, d->len) - off;
+        crossfade_line(d->dst + off, d->old_data + off, d->new_data + off, len, d->transition);
+}
+
+/// crossfades the frames in slices processed by the worker pool
+static void crossfade(unsigned char *dst, const unsigned char *old_data, const unsigned char *new_data,
+                size_t len, int transition)
+{
+        crossfade_data d{dst, old_data, new_data, len, transition};
+        task_run_parallel_for((len + CROSSFADE_CHUNK - 1) / CROSSFADE_CHUNK, 1, crossfade_body, &d);
+}
+
 struct state_blend_common {
         ~state_blend_common() {
                 display_done(real_display);
@@ -245,7 +358,7 @@ static void display_blend_run(void *state)
                                         check_reconf(s.get(), video_desc_from_frame(frame));
 
                                         struct video_frame *real_display_frame = display_get_frame(s->real_display);
-                                        memcpy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
+                                        frame_copy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
                                         vf_free(frame);
                                         real_display_frame->ssrc = s->current_ssrc;
                                         display_put_frame(s->real_display, real_display_frame, PUTF_BLOCKING);
@@ -276,16 +389,14 @@ static void display_blend_run(void *state)
                                         struct video_frame *real_display_frame = display_get_frame(s->real_display);
 
                                         if (video_desc_eq(old_desc, new_desc)) {
-                                                for (unsigned int i = 0; i < new_frame->tiles[0].data_len; ++i) {
-                                                        int old_val = ((unsigned char *) old_frame->tiles[0].data)[i];
-                                                        int new_val = ((unsigned char *) new_frame->tiles[0].data)[i];
-                                                        ((unsigned char *) real_display_frame->tiles[0].data)[i] =
-                                                                ((new_val * s->transition) + (old_val * (TRANSITION_COUNT - s->transition))) / TRANSITION_COUNT;
-                                                }
+                                                crossfade((unsigned char *) real_display_frame->tiles[0].data,
+                                                                (const unsigned char *) old_frame->tiles[0].data,
+                                                                (const unsigned char *) new_frame->tiles[0].data,
+                                                                new_frame->tiles[0].data_len, s->transition);
                                         } else {
                                                 // new desc is different than old desc!
                                                 fprintf(stderr, "SMOLIK4!\n");
-                                                memcpy(real_display_frame->tiles[0].data, new_frame->tiles[0].data, new_frame->tiles[0].data_len);
+                                                frame_copy(real_display_frame->tiles[0].data, new_frame->tiles[0].data, new_frame->tiles[0].data_len);
                                         }
                                         vf_free(old_frame);
                                         vf_free(new_frame);
@@ -305,7 +416,7 @@ static void display_blend_run(void *state)
                                         check_reconf(s.get(), video_desc_from_frame(frame));
 
                                         struct video_frame *real_display_frame = display_get_frame(s->real_display);
-                                        memcpy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
+                                        frame_copy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
                                         vf_free(frame);
                                         real_display_frame->ssrc = s->current_ssrc;
                                         display_put_frame(s->real_display, real_display_frame, PUTF_BLOCKING);
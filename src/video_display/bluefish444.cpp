@@ -43,6 +43,8 @@
 
 #include "video_display.h"
 
+#include <algorithm>
+#include <exception>
 #include <iomanip>
 #include <iostream>
 #include <queue>
@@ -57,10 +59,12 @@
 #include "debug.h"
 #include "host.h"
 #include "lib_common.h"
+#include "module.h"
 #include "tv.h"
 #include "utils/ring_buffer.h"
 #include "video.h"
 #include "video_display.h"
+#include "video_display/audio_drift_fix.hpp"
 
 #define BLUEFISH444_MAGIC 0x15b75db8
 
@@ -111,6 +115,7 @@ struct display_bluefish444_state {
                 void                reconfigure_audio(int quant_samples, int channels,
                                 int sample_rate)                   noexcept(false);
                 void                put_audio_frame(const struct audio_frame *) noexcept;
+                AudioDriftFixer    &audio_drift_fixer()            noexcept { return m_AudioDriftFixer; }
 #endif
         private:
                 uint32_t            m_magic;
@@ -146,6 +151,7 @@ struct display_bluefish444_state {
                 hanc_stream_info_struct m_HancInfo;
                 pthread_spinlock_t  m_AudioSpinLock;
                 struct ring_buffer *m_AudioRingBuffer;
+                AudioDriftFixer     m_AudioDriftFixer{"Bluefish444"};
 #endif
                 bool                m_PlayAudio;
  };
@@ -797,13 +803,20 @@ void display_bluefish444_state::reconfigure_audio(int quant_samples, int channel
         m_AudioDesc.sample_rate = sample_rate;
         ring_buffer_flush(m_AudioRingBuffer);
         pthread_spin_unlock(&m_AudioSpinLock);
+        m_AudioDriftFixer.set_sample_rate(sample_rate);
 }
 
 void display_bluefish444_state::put_audio_frame(const struct audio_frame *frame) noexcept
 {
         if(!m_PlayAudio)
                 return;
+        // the ring is drained by the HANC encoder in the playback loop at the card clock
+        const int sample_size = frame->bps * frame->ch_count;
+        const uint32_t buffered = ring_get_current_size(m_AudioRingBuffer) / sample_size;
+        const uint32_t available = ring_get_available_write_size(m_AudioRingBuffer) / sample_size;
         ring_buffer_write(m_AudioRingBuffer, frame->data, frame->data_len);
+        const uint32_t samples = frame->data_len / sample_size;
+        m_AudioDriftFixer.update(buffered, samples, min(samples, available));
 }
 #endif // defined HAVE_BLUE_AUDIO
 
@@ -820,7 +833,11 @@ static void show_help(void)
         bfcDestroy(pSDK);
 
         cout << "bluefish444 (output) options:" << endl
+#ifdef HAVE_BLUE_AUDIO
+                << "\tbluefish444[:device=<device_id>]" AUDIO_DRIFT_FIX_OPTS << endl
+#else
                 << "\tbluefish444[:device=<device_id>]" << endl
+#endif
                 << "\t\tID of the Bluefish device (if more present)" << endl
                 << "\t\t" << iDevices << " Bluefish devices found in this system" << endl;
         if(iDevices == 1) {
@@ -829,6 +846,10 @@ static void show_help(void)
                 cout << ", valid indices [1," << iDevices  << "]" << endl;
                 cout << "default is 1" << endl;
         }
+#ifdef HAVE_BLUE_AUDIO
+        cout << endl << "Embedded audio clock drift compensation:" << endl
+                << AUDIO_DRIFT_FIX_HELP;
+#endif
 }
 
 static void display_bluefish444_probe(struct device_info **available_cards, int *count, void (**deleter)(void *))
@@ -849,27 +870,58 @@ static void display_bluefish444_probe(struct device_info **available_cards, int
 
 static void *display_bluefish444_init(struct module *parent, const char *fmt, unsigned int flags)
 {
-        UNUSED(parent);
         int deviceId = 1;
+        vector<string> drift_fix_opts;
+        if(fmt && strcmp(fmt, "help") == 0) {
+                show_help();
+                return NULL;
+        }
         if(fmt){
-                if(strcmp(fmt, "help") == 0) {
-                        show_help();
-                        return NULL;
-                } else if(strncasecmp(fmt, "device=", strlen("device=")) == 0) {
-                        deviceId = atoi(fmt + strlen("device="));
-                } else {
-                        cerr << "[Blue444 disp] Unknown parameter: " << fmt << endl;
-                        return NULL;
+                char *tmp = strdup(fmt);
+                char *save_ptr = NULL;
+                for (char *item = strtok_r(tmp, ":", &save_ptr); item != NULL; item = strtok_r(NULL, ":", &save_ptr)) {
+                        if(strncasecmp(item, "device=", strlen("device=")) == 0) {
+                                deviceId = atoi(item + strlen("device="));
+                        } else {
+                                // drift fix options are applied once the state exists
+                                drift_fix_opts.push_back(item);
+                        }
                 }
+                free(tmp);
         }
 
-        void *state = NULL;
+        display_bluefish444_state *state = NULL;
 
         try {
                 state = new display_bluefish444_state(flags, deviceId);
         } catch(runtime_error &e) {
                 cerr << "[Blue444 disp] " << e.what() << endl;
+                return NULL;
+        }
+
+        for (auto const &opt : drift_fix_opts) {
+                bool recognized = false;
+#ifdef HAVE_BLUE_AUDIO
+                try {
+                        recognized = state->audio_drift_fixer().parse_option(opt.c_str());
+                } catch (exception &e) {
+                        cerr << "[Blue444 disp] Wrong value " << opt << ": " << e.what() << endl;
+                        delete state;
+                        return NULL;
+                }
+#endif
+                if (!recognized) {
+                        cerr << "[Blue444 disp] Unknown parameter: " << opt << endl;
+                        delete state;
+                        return NULL;
+                }
         }
+#ifdef HAVE_BLUE_AUDIO
+        state->audio_drift_fixer().set_root(get_root_module(parent));
+#else
+        UNUSED(parent);
+#endif
+
         return state;
 }
 
@@ -48,17 +48,21 @@
 #include "module.h"
 #include "utils/misc.h"
 #include "utils/string_view_utils.hpp"
+#include "utils/worker.h"
 
+#include <algorithm>
 #include <cinttypes>
 #include <condition_variable>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <list>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <vector>
 #include <string_view>
 
 #pragma GCC diagnostic push
@@ -82,8 +86,49 @@ using clock = std::chrono::steady_clock;
 struct frame_deleter{ void operator()(video_frame *f){ vf_free(f); } };
 using unique_frame = std::unique_ptr<video_frame, frame_deleter>;
 
+/**
+ * Packs planar luma and interleaved chroma (U0V0U1V1...) back to UYVY
+ */
+void pack_uyvy_line(unsigned char *dst, const unsigned char *luma_src,
+                const unsigned char *chroma_src, unsigned pairs)
+{
+#ifdef __SSSE3__
+        __m128i y_shuff = _mm_set_epi8(7, -1, 6, -1, 5, -1, 4, -1, 3, -1, 2, -1, 1, -1, 0, -1);
+        __m128i uv_shuff = _mm_set_epi8(-1, 7, -1, 6, -1, 5, -1, 4, -1, 3, -1, 2, -1, 1, -1, 0);
+        while(pairs >= 8){
+               __m128i luma = _mm_loadu_si128((__m128i const*)(const void *) luma_src);
+               luma_src += 16;
+               __m128i chroma = _mm_loadu_si128((__m128i const*)(const void *) chroma_src);
+               chroma_src += 16;
+
+               __m128i res = _mm_or_si128(_mm_shuffle_epi8(luma, y_shuff), _mm_shuffle_epi8(chroma, uv_shuff));
+               _mm_storeu_si128((__m128i *)(void *) dst, res);
+               dst += 16;
+
+               luma = _mm_bsrli_si128(luma, 8);
+               chroma = _mm_bsrli_si128(chroma, 8);
+
+               res = _mm_or_si128(_mm_shuffle_epi8(luma, y_shuff), _mm_shuffle_epi8(chroma, uv_shuff));
+               _mm_storeu_si128((__m128i *)(void *) dst, res);
+               dst += 16;
+
+               pairs -= 8;
+        }
+#endif
+
+        while(pairs > 0){
+                *dst++ = *chroma_src++;
+                *dst++ = *luma_src++;
+                *dst++ = *chroma_src++;
+                *dst++ = *luma_src++;
+
+                pairs--;
+        }
+}
+
 struct Participant{
         void to_cv_frame();
+        void render(unsigned char *dst, size_t dst_linesize);
         void frame_recieved(unique_frame &&f);
         void set_pos_keep_aspect(int x, int y, int w, int h);
 
@@ -97,8 +142,13 @@ struct Participant{
         unsigned width = 0;
         unsigned height = 0;
 
+        /// participant needs to be re-scaled and written to the mixed frame
+        bool dirty = true;
+
         cv::Mat luma;
         cv::Mat chroma;
+        cv::Mat scaled_luma;
+        cv::Mat scaled_chroma;
 };
 
 void Participant::frame_recieved(unique_frame &&f){
@@ -107,6 +157,7 @@ void Participant::frame_recieved(unique_frame &&f){
 
         src_w = frame->tiles[0].width;
         src_h = frame->tiles[0].height;
+        dirty = true;
 }
 
 void Participant::set_pos_keep_aspect(int x, int y, int w, int h){
@@ -123,8 +174,9 @@ void Participant::set_pos_keep_aspect(int x, int y, int w, int h){
                 y += (h - height) / 2;
         }
 
-        this->x = x;
+        this->x = x & ~1; // keep the UYVY macropixels aligned
         this->y = y;
+        dirty = true;
 }
 
 void Participant::to_cv_frame(){
@@ -182,6 +234,31 @@ void Participant::to_cv_frame(){
         }
 }
 
+/**
+ * Scales the current participant frame to its place in the layout and
+ * writes it directly to the UYVY mixed frame.
+ */
+void Participant::render(unsigned char *dst, size_t dst_linesize){
+        dirty = false;
+        if(!frame || width < 2 || height == 0)
+                return;
+
+        PROFILE_FUNC;
+
+        to_cv_frame();
+
+        PROFILE_DETAIL("resize participant");
+        cv::resize(luma, scaled_luma, cv::Size(width, height), 0, 0);
+        cv::resize(chroma, scaled_chroma, cv::Size(width / 2, height), 0, 0);
+
+        PROFILE_DETAIL("pack participant");
+        dst += y * dst_linesize + x * 2;
+        for(unsigned i = 0; i < height; i++){
+                pack_uyvy_line(dst, scaled_luma.ptr(i), scaled_chroma.ptr(i), width / 2);
+                dst += dst_linesize;
+        }
+}
+
 class Video_mixer{
 public:
         enum class Layout{ Invalid, Tiled, One_big };
@@ -210,8 +287,10 @@ private:
 
         uint32_t primary_ssrc = 0;
 
-        cv::Mat mixed_luma;
-        cv::Mat mixed_chroma;
+        /// composited UYVY frame, only changed participants are redrawn
+        std::vector<unsigned char> mixed;
+        size_t mixed_linesize;
+        std::vector<Participant *> to_render;
 
         std::map<uint32_t, Participant> participants;
 };
@@ -221,8 +300,8 @@ Video_mixer::Video_mixer(int width, int height, Layout layout):
         height(height),
         layout(layout)
 {
-        mixed_luma.create(cv::Size(width, height), CV_8UC1);
-        mixed_chroma.create(cv::Size(width / 2, height), CV_8UC2);
+        mixed_linesize = vc_get_linesize(width, UYVY);
+        mixed.resize(mixed_linesize * height);
 }
 
 void Video_mixer::tiled_layout(){
@@ -262,8 +341,13 @@ void Video_mixer::one_big_layout(){
 }
 
 void Video_mixer::recompute_layout(){
-        mixed_luma.setTo(16);
-        mixed_chroma.setTo(128);
+        for(size_t i = 0; i + 4 <= mixed.size(); i += 4){
+                memcpy(&mixed[i], "\x80\x10\x80\x10", 4);
+        }
+        for(auto& [ssrc, p]: participants){
+                (void) ssrc;
+                p.dirty = true;
+        }
 
         if(!primary_ssrc && !participants.empty()){
                 primary_ssrc = participants.begin()->first;
@@ -318,57 +402,25 @@ void Video_mixer::get_mixed(video_frame *result){
         if(recompute)
                 recompute_layout();
 
+        to_render.clear();
         for(auto&& [ssrc, p] : participants){
                 (void) ssrc;
-                p.to_cv_frame();
-
-                PROFILE_DETAIL("resize participant");
-                cv::Size l_size(p.width, p.height);
-                cv::Size c_size(p.width / 2, p.height);
-                cv::resize(p.luma, mixed_luma(cv::Rect(p.x, p.y, p.width, p.height)), l_size, 0, 0);
-                cv::resize(p.chroma, mixed_chroma(cv::Rect(p.x / 2, p.y, p.width / 2, p.height)), c_size, 0, 0);
-                PROFILE_DETAIL("");
-        }
-
-        unsigned char *dst = reinterpret_cast<unsigned char *>(result->tiles[0].data);
-        unsigned char *chroma_src = mixed_chroma.ptr(0);
-        unsigned char *luma_src = mixed_luma.ptr(0);
-        assert(mixed_luma.isContinuous() && mixed_chroma.isContinuous());
-        PROFILE_DETAIL("Convert to ug frame");
-        unsigned dst_len = result->tiles[0].data_len;
-
-#ifdef __SSSE3__
-        __m128i y_shuff = _mm_set_epi8(7, -1, 6, -1, 5, -1, 4, -1, 3, -1, 2, -1, 1, -1, 0, -1);
-        __m128i uv_shuff = _mm_set_epi8(-1, 7, -1, 6, -1, 5, -1, 4, -1, 3, -1, 2, -1, 1, -1, 0);
-        while(dst_len >= 32){
-               __m128i luma = _mm_load_si128((__m128i const*)(const void *) luma_src); 
-               luma_src += 16;
-               __m128i chroma = _mm_load_si128((__m128i const*)(const void *) chroma_src); 
-               chroma_src += 16;
-
-               __m128i res = _mm_or_si128(_mm_shuffle_epi8(luma, y_shuff), _mm_shuffle_epi8(chroma, uv_shuff));
-               _mm_storeu_si128((__m128i *)(void *) dst, res);
-               dst += 16;
-
-               luma = _mm_bsrli_si128(luma, 8);
-               chroma = _mm_bsrli_si128(chroma, 8);
-
-               res = _mm_or_si128(_mm_shuffle_epi8(luma, y_shuff), _mm_shuffle_epi8(chroma, uv_shuff));
-               _mm_storeu_si128((__m128i *)(void *) dst, res);
-               dst += 16;
-
-               dst_len -= 32;
+                if(p.dirty)
+                        to_render.push_back(&p);
         }
-#endif
 
-        while(dst_len >= 4){
-                *dst++ = *chroma_src++;
-                *dst++ = *luma_src++;
-                *dst++ = *chroma_src++;
-                *dst++ = *luma_src++;
+        PROFILE_DETAIL("render participants");
+        // participants occupy disjoint rectangles of the mixed frame
+        task_run_parallel_for(to_render.size(), 1, [](void *udata, size_t begin, size_t end){
+                        auto *m = static_cast<Video_mixer *>(udata);
+                        for(size_t i = begin; i < end; i++){
+                                m->to_render[i]->render(m->mixed.data(), m->mixed_linesize);
+                        }
+                }, this);
 
-                dst_len -= 4;
-        }
+        PROFILE_DETAIL("Copy to ug frame");
+        memcpy(result->tiles[0].data, mixed.data(),
+                        std::min<size_t>(result->tiles[0].data_len, mixed.size()));
 }
 
 std::vector<uint32_t> Video_mixer::get_participant_ssrc_list() const{
@@ -60,20 +60,21 @@
 #include "rtp/audio_decoders.h"
 #include "tv.h"
 #include "ug_runtime_error.hpp"
+#include "utils/lockfree_queue.h"
 #include "utils/misc.h"
 #include "utils/string.h" // is_prefix_of
 #include "video.h"
 #include "video_display.h"
-#include "video_display/decklink_drift_fix.hpp"
+#include "video_display/audio_drift_fix.hpp"
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <cinttypes>
 #include <cstdint>
 #include <iomanip>
 #include <mutex>
-#include <queue>
 #include <string>
 #include <vector>
 
@@ -164,9 +165,18 @@ public:
 
 class DeckLinkFrame;
 
+/// frames kept for reuse - enough to cover the scheduled frames (see putf max_frames) plus the ones being filled
+#define BUFFER_POOL_SIZE 16
+/// frame buffers are page-aligned so that the driver can DMA them directly
+#define FRAME_BUFFER_ALIGNMENT 4096
+
+/**
+ * Returned frames are pushed to the pool from the DeckLink completion
+ * callback and popped by getf, so that neither takes a lock. Frames that
+ * don't fit into the pool are deleted.
+ */
 struct buffer_pool_t {
-        queue<DeckLinkFrame *> frame_queue;
-        mutex lock;
+        lockfree_queue<DeckLinkFrame *, BUFFER_POOL_SIZE> frame_queue{0};
 };
 
 class DeckLinkTimecode : public IDeckLinkTimecode{
@@ -240,11 +250,14 @@ class DeckLinkFrame : public IDeckLinkMutableVideoFrame, public IDeckLinkVideoFr
                 long height;
                 long rawBytes;
                 BMDPixelFormat pixelFormat;
-                unique_ptr<char []> data;
+                struct aligned_deleter {
+                        void operator()(char *ptr) const { aligned_free(ptr); }
+                };
+                unique_ptr<char [], aligned_deleter> data;
 
                 IDeckLinkTimecode *timecode;
 
-                long ref;
+                atomic<long> ref;
 
                 buffer_pool_t &buffer_pool;
                 struct HDRMetadata m_metadata;
@@ -499,16 +512,14 @@ display_decklink_getf(void *state)
         for (unsigned int i = 0; i < s->vid_desc.tile_count; ++i) {
                 const int linesize = vc_get_linesize(s->vid_desc.width, s->vid_desc.color_spec);
                 IDeckLinkMutableVideoFrame *deckLinkFrame = nullptr;
-                lock_guard<mutex> lg(s->buffer_pool.lock);
 
-                while (!s->buffer_pool.frame_queue.empty()) {
-                        auto tmp = s->buffer_pool.frame_queue.front();
+                DeckLinkFrame *tmp = nullptr;
+                while (s->buffer_pool.frame_queue.try_pop(tmp)) {
                         IDeckLinkMutableVideoFrame *frame;
                         if (s->stereo)
                                 frame = dynamic_cast<DeckLink3DFrame *>(tmp);
                         else
                                 frame = dynamic_cast<DeckLinkFrame *>(tmp);
-                        s->buffer_pool.frame_queue.pop();
                         if (!frame || // wrong type
                                         frame->GetWidth() != (long) s->vid_desc.width ||
                                         frame->GetHeight() != (long) s->vid_desc.height ||
@@ -1062,14 +1073,8 @@ static bool settings_init(struct state_decklink *s, const char *fmt,
                         }
                 } else if (strstr(ptr, "keep-settings") == ptr) {
                         s->keep_device_defaults = true;
-                } else if (strstr(ptr, "drift_fix") == ptr) {
-                        s->audio_drift_fixer.enable();
-                } else if (strncasecmp(ptr, "maxresample=", strlen("maxresample=")) == 0) {
-                        s->audio_drift_fixer.set_max_hz(parse_uint32(strchr(ptr, '=') + 1));
-                } else if (strncasecmp(ptr, "minresample=", strlen("minresample=")) == 0) {
-                        s->audio_drift_fixer.set_min_hz(parse_uint32(strchr(ptr, '=') + 1));
-                } else if (strncasecmp(ptr, "targetbuffer=", strlen("targetbuffer=")) == 0) {
-                        s->audio_drift_fixer.set_target_buffer(parse_uint32(strchr(ptr, '=') + 1));
+                } else if (s->audio_drift_fixer.parse_option(ptr)) {
+                        // drift_fix, maxresample, minresample, targetbuffer
                 } else {
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "unknown option in config string: %s\n", ptr);
                         return false;
@@ -1330,9 +1335,8 @@ static void display_decklink_done(void *state)
                 delete s->state.at(i).delegate;
         }
 
-        while (!s->buffer_pool.frame_queue.empty()) {
-                auto tmp = s->buffer_pool.frame_queue.front();
-                s->buffer_pool.frame_queue.pop();
+        DeckLinkFrame *tmp = nullptr;
+        while (s->buffer_pool.frame_queue.try_pop(tmp)) {
                 delete tmp;
         }
 
@@ -1609,15 +1613,19 @@ ULONG DeckLinkFrame::AddRef()
 
 ULONG DeckLinkFrame::Release()
 {
-        if (--ref == 0) {
-                lock_guard<mutex> lg(buffer_pool.lock);
-                buffer_pool.frame_queue.push(this);
+        long ret = --ref;
+        if (ret == 0) {
+                DeckLinkFrame *frame = this;
+                if (!buffer_pool.frame_queue.try_push(frame)) {
+                        delete this;
+                }
         }
-	return ref;
+	return ret;
 }
 
 DeckLinkFrame::DeckLinkFrame(long w, long h, long rb, BMDPixelFormat pf, buffer_pool_t & bp, HDRMetadata const & hdr_metadata)
-	: width(w), height(h), rawBytes(rb), pixelFormat(pf), data(new char[rb * h]), timecode(NULL), ref(1l),
+	: width(w), height(h), rawBytes(rb), pixelFormat(pf),
+        data(static_cast<char *>(aligned_malloc(rb * h, FRAME_BUFFER_ALIGNMENT))), timecode(NULL), ref(1L),
         buffer_pool(bp)
 {
         clear_video_buffer(reinterpret_cast<unsigned char *>(data.get()), rawBytes, rawBytes, height,
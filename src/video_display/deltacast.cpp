@@ -51,10 +51,13 @@
 #include "audio/types.h"
 #include "audio/utils.h"
 #include "utils/ring_buffer.h"
+#include "video_display/audio_drift_fix.hpp"
 
 #include <algorithm>
+#include <exception>
 
 #define DELTACAST_MAGIC 0x01005e02
+#define DEFAULT_BUFFERQUEUE_DEPTH 2
 
 struct state_deltacast {
         uint32_t            magic;
@@ -68,6 +71,8 @@ struct state_deltacast {
         bool                initialized;
         HANDLE              BoardHandle, StreamHandle;
         HANDLE              SlotHandle;
+        ULONG               queue_depth;
+        ULONG               preload;
 
         pthread_mutex_t     lock;
 
@@ -78,6 +83,7 @@ struct state_deltacast {
         struct audio_desc  audio_desc;
         struct ring_buffer  *audio_channels[16];
         char            *audio_tmp;
+        AudioDriftFixer audio_drift_fixer{"DELTACAST"};
  };
 
 static void show_help(void);
@@ -85,11 +91,16 @@ static void show_help(void);
 static void show_help(void)
 {
         printf("deltacast (output) options:\n");
-        printf("\t-d deltacast[:device=<index>]\n");
+        printf("\t-d deltacast[:device=<index>][:queue=<n>][:preload=<n>]" AUDIO_DRIFT_FIX_OPTS "\n");
 
         print_available_delta_boards();
 
         printf("\nDefault board is 0.\n");
+        printf("queue - number of driver slots that are being DMA-ed to the board "
+                        "while next frames are rendered (default %d)\n", DEFAULT_BUFFERQUEUE_DEPTH);
+        printf("preload - number of slots filled before the playback starts "
+                        "(default 0, adds latency)\n");
+        printf("\nEmbedded audio clock drift compensation:\n" AUDIO_DRIFT_FIX_HELP);
 
 }
 
@@ -236,8 +247,8 @@ display_deltacast_reconfigure(void *state, struct video_desc desc)
         }
         
         VHD_SetStreamProperty(s->StreamHandle,VHD_SDI_SP_VIDEO_STANDARD,VideoStandard);
-        VHD_SetStreamProperty(s->StreamHandle,VHD_CORE_SP_BUFFERQUEUE_DEPTH,2);
-        VHD_SetStreamProperty(s->StreamHandle,VHD_CORE_SP_BUFFERQUEUE_PRELOAD,0);
+        VHD_SetStreamProperty(s->StreamHandle,VHD_CORE_SP_BUFFERQUEUE_DEPTH,s->queue_depth);
+        VHD_SetStreamProperty(s->StreamHandle,VHD_CORE_SP_BUFFERQUEUE_PRELOAD,s->preload);
 
         Result = VHD_StartStream(s->StreamHandle);
         if (Result != VHDERR_NOERROR) {
@@ -299,19 +310,30 @@ static void display_deltacast_probe(struct device_info **available_cards, int *c
 
 }
 
+static bool parse_drift_fix_option(struct state_deltacast *s, const char *tok)
+{
+        try {
+                return s->audio_drift_fixer.parse_option(tok);
+        } catch (std::exception &e) {
+                log_msg(LOG_LEVEL_ERROR, "[DELTACAST] Wrong value %s: %s\n", tok, e.what());
+                return false;
+        }
+}
+
 static void *display_deltacast_init(struct module *parent, const char *fmt, unsigned int flags)
 {
-        UNUSED(parent);
         struct state_deltacast *s;
         ULONG             Result,DllVersion,NbBoards,ChnType;
         ULONG             BrdId = 0;
 
-        s = (struct state_deltacast *)calloc(1, sizeof(struct state_deltacast));
+        s = new state_deltacast();
         s->magic = DELTACAST_MAGIC;
         
         s->frame = vf_alloc(1);
         s->tile = vf_get_tile(s->frame, 0);
         s->frames = 0;
+        s->queue_depth = DEFAULT_BUFFERQUEUE_DEPTH;
+        s->preload = 0;
         
         gettimeofday(&s->tv, NULL);
         
@@ -324,11 +346,12 @@ static void *display_deltacast_init(struct module *parent, const char *fmt, unsi
         
         s->BoardHandle = s->StreamHandle = s->SlotHandle = NULL;
         s->audio_configured = FALSE;
+        s->audio_drift_fixer.set_root(get_root_module(parent));
 
         if(fmt && strcmp(fmt, "help") == 0) {
                 show_help();
                 vf_free(s->frame);
-                free(s);
+                delete s;
                 return INIT_NOERR;
         }
         
@@ -338,22 +361,31 @@ static void *display_deltacast_init(struct module *parent, const char *fmt, unsi
                 char *save_ptr = NULL;
                 char *tok;
                 
-                tok = strtok_r(tmp, ":", &save_ptr);
-                if(!tok)
-                {
-                        free(tmp);
-                        show_help();
-                        goto error;
+                char *item = tmp;
+
+                while ((tok = strtok_r(item, ":", &save_ptr)) != NULL) {
+                        if (strncasecmp(tok, "device=", strlen("device=")) == 0) {
+                                BrdId = atoi(tok + strlen("device="));
+                        } else if (strncasecmp(tok, "queue=", strlen("queue=")) == 0) {
+                                s->queue_depth = atoi(tok + strlen("queue="));
+                        } else if (strncasecmp(tok, "preload=", strlen("preload=")) == 0) {
+                                s->preload = atoi(tok + strlen("preload="));
+                        } else if (parse_drift_fix_option(s, tok)) {
+                                // drift_fix, maxresample, minresample, targetbuffer
+                        } else {
+                                log_msg(LOG_LEVEL_ERROR, "Unknown option: %s\n\n", tok);
+                                free(tmp);
+                                show_help();
+                                goto error;
+                        }
+                        item = NULL;
                 }
-                if (strncasecmp(tok, "device=", strlen("device=")) == 0) {
-                        BrdId = atoi(tok + strlen("device="));
-                } else {
-                        log_msg(LOG_LEVEL_ERROR, "Unknown option: %s\n\n", tok);
-                        free(tmp);
-                        show_help();
+                free(tmp);
+                if (s->queue_depth < 2 || s->preload >= s->queue_depth) {
+                        log_msg(LOG_LEVEL_ERROR, "[DELTACAST] Queue depth must be at least 2 "
+                                        "and greater than preload!\n");
                         goto error;
                 }
-                free(tmp);
         }
 
         /* Query VideoMasterHD information */
@@ -406,7 +438,7 @@ bad_channel:
         VHD_CloseBoardHandle(s->BoardHandle);
 error:
         vf_free(s->frame);
-        free(s);
+        delete s;
         return NULL;
 }
 
@@ -424,7 +456,7 @@ static void display_deltacast_done(void *state)
         }
 
         vf_free(s->frame);
-        free(s);
+        delete s;
 }
 
 static int display_deltacast_get_property(void *state, int property, void *val, size_t *len)
@@ -498,6 +530,7 @@ static int display_deltacast_reconfigure_audio(void *state, int quant_samples, i
         s->audio_desc.bps = quant_samples / 8;
         s->audio_desc.ch_count = channels;
         s->audio_desc.sample_rate = sample_rate;
+        s->audio_drift_fixer.set_sample_rate(sample_rate);
 
         for(i = 0; i < channels; ++i) {
                 s->audio_channels[i] = ring_buffer_init(s->audio_desc.bps * s->audio_desc.sample_rate);
@@ -541,11 +574,17 @@ static void display_deltacast_put_audio_frame(void *state, const struct audio_fr
         int channel_len = frame->data_len / frame->ch_count;
 
         pthread_mutex_lock(&s->lock);
+        // the buffer is drained by the slots embedding audio at the card clock
+        const uint32_t buffered = ring_get_current_size(s->audio_channels[0]) / frame->bps;
+        const uint32_t available = ring_get_available_write_size(s->audio_channels[0]) / frame->bps;
         for(i = 0; i < frame->ch_count; ++i) {
                  demux_channel(s->audio_tmp, frame->data, frame->bps, frame->data_len, frame->ch_count, i);
                  ring_buffer_write(s->audio_channels[i], s->audio_tmp, channel_len);
         }
         pthread_mutex_unlock(&s->lock);
+
+        const uint32_t samples = channel_len / frame->bps;
+        s->audio_drift_fixer.update(buffered, samples, std::min(samples, available));
 }
 
 static const struct video_display_info display_deltacast_info = {
@@ -212,10 +212,16 @@ static void dump_buf(unsigned char *buf, size_t len, int block_size) {
 
 static int display_dummy_putf(void *state, struct video_frame *frame, long long flags)
 {
-        if (flags == PUTF_DISCARD || frame == NULL) {
+        struct dummy_display_state *s = state;
+        if (frame == NULL) {
+                return 0;
+        }
+        if (flags == PUTF_DISCARD) {
+                if (frame != s->f) { // external frame
+                        VIDEO_FRAME_DISPOSE(frame);
+                }
                 return 0;
         }
-        struct dummy_display_state *s = state;
         if (s->dump_bytes > 0) {
                 dump_buf((unsigned char *)(frame->tiles[0].data), MIN(frame->tiles[0].data_len, s->dump_bytes), get_pf_block_bytes(frame->color_spec));
         }
@@ -234,6 +240,9 @@ static int display_dummy_putf(void *state, struct video_frame *frame, long long
                 }
         }
 
+        if (frame != s->f) {
+                VIDEO_FRAME_DISPOSE(frame);
+        }
         return 0;
 }
 
@@ -259,6 +268,13 @@ static int display_dummy_get_property(void *state, int property, void *val, size
                         *len = sizeof s->rgb_shift;
                         memcpy(val, s->rgb_shift, *len);
                         break;
+                case DISPLAY_PROPERTY_EXTERNAL_FRAMES:
+                        if (sizeof(bool) > *len) {
+                                return FALSE;
+                        }
+                        *len = sizeof(bool);
+                        *(bool *) val = true;
+                        break;
                 default:
                         return FALSE;
         }
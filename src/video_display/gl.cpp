@@ -94,9 +94,23 @@
 #define ADAPTIVE_VSYNC -1
 #define SYSTEM_VSYNC 0xFE
 #define SINGLE_BUF 0xFF // use single buffering instead of double
+#define PBO_RING_SIZE (MAX_BUFFER_SIZE + 3) ///< queued + displayed + decoded + one whose upload may be in flight
+#ifndef HAVE_MACOSX
+#define HAVE_PERSISTENT_PBO 1 // macOS GL doesn't have ARB_buffer_storage
+#endif
 
 #include "gl_vdpau.hpp"
 
+#ifdef HWACC_VIDEOTOOLBOX
+#include <CoreVideo/CoreVideo.h>
+#include <IOSurface/IOSurface.h>
+#include <OpenGL/CGLIOSurface.h>
+#include "hwaccel_videotoolbox.h"
+#ifndef GL_RG
+#define GL_RG 0x8227
+#endif
+#endif
+
 using namespace std;
 using namespace std::chrono_literals;
 
@@ -136,6 +150,31 @@ void main()
 }
 )raw";
 
+/// NV12 bound directly from IOSurface planes (HW_VIDEOTOOLBOX) - rectangle
+/// textures are addressed in pixels, chroma plane has half the resolution
+static const char * nv12_rect_to_rgb_fp = R"raw(
+#version 110
+#extension GL_ARB_texture_rectangle : enable
+uniform sampler2DRect image;
+uniform sampler2DRect chroma;
+uniform float imageWidth;
+uniform float imageHeight;
+void main()
+{
+        vec2 pos = vec2(gl_TexCoord[0].x * imageWidth, gl_TexCoord[0].y * imageHeight);
+        vec4 yuv;
+        yuv.r = texture2DRect(image, pos).r;
+        yuv.gb = texture2DRect(chroma, pos / 2.0).rg;
+        yuv.r = Y_SCALED_PLACEHOLDER * (yuv.r - 0.0625);
+        yuv.g = yuv.g - 0.5;
+        yuv.b = yuv.b - 0.5;
+        gl_FragColor.r = yuv.r + R_CR_PLACEHOLDER * yuv.b;
+        gl_FragColor.g = yuv.r + G_CB_PLACEHOLDER * yuv.g + G_CR_PLACEHOLDER * yuv.b;
+        gl_FragColor.b = yuv.r + B_CB_PLACEHOLDER * yuv.g;
+        gl_FragColor.a = 1.0;
+}
+)raw";
+
 static const char * yuva_to_rgb_fp = R"raw(
 #version 110
 uniform sampler2D image;
@@ -308,6 +347,9 @@ unordered_map<codec_t, const char *> glsl_programs = {
         { v210, v210_to_rgb_fp },
         { DXT1_YUV, fp_display_dxt1_yuv },
         { DXT5, fp_display_dxt5ycocg },
+#ifdef HWACC_VIDEOTOOLBOX
+        { HW_VIDEOTOOLBOX, nv12_rect_to_rgb_fp },
+#endif
 };
 
 static constexpr array keybindings{
@@ -343,6 +385,14 @@ static void upload_compressed_texture(struct state_gl *s, char *data);
 static void upload_texture(struct state_gl *s, char *data);
 static bool check_rpi_pbo_quirks();
 static void set_gamma(struct state_gl *s);
+static void gl_pbo_ring_create(struct state_gl *s, struct video_desc desc);
+static void gl_pbo_frame_wait(struct video_frame *f);
+static void gl_pbo_collect_garbage(struct state_gl *s);
+static struct gl_pbo_frame *gl_pbo_bind_current(struct state_gl *s, const char *data);
+static void gl_pbo_upload_finished(struct gl_pbo_frame *pbo);
+#ifdef HAVE_PERSISTENT_PBO
+static struct gl_pbo_frame *gl_pbo_of(struct video_frame *f);
+#endif
 
 struct state_gl {
         unordered_map<codec_t, GLuint> PHandles;
@@ -354,6 +404,9 @@ struct state_gl {
         GLuint texture_display = 0;
         GLuint texture_raw = 0;
         GLuint pbo_id = 0;
+#ifdef HWACC_VIDEOTOOLBOX
+        GLuint texture_iosurface[2] = { 0, 0 }; ///< HW_VIDEOTOOLBOX luma and chroma planes
+#endif
 
         /* For debugging... */
         uint32_t        magic = MAGIC_GL;
@@ -400,6 +453,11 @@ struct state_gl {
         enum modeset_t { MODESET = -2, MODESET_SIZE_ONLY = GLFW_DONT_CARE, NOMODESET = 0 } modeset = NOMODESET; ///< positive vals force framerate
         bool nodecorate = false;
         int use_pbo = -1;
+        bool persistent_pbo = false; ///< ARB_buffer_storage and ARB_sync are available
+#ifdef HAVE_PERSISTENT_PBO
+        mutex pbo_garbage_lock;
+        vector<pair<GLuint, GLsync>> pbo_garbage; ///< resources of freed PBO frames, deleted by GL thread
+#endif
 #ifdef HWACC_VDPAU
         struct state_vdpau vdp;
 #endif
@@ -433,9 +491,26 @@ struct state_gl {
         }
 };
 
+#ifdef HAVE_PERSISTENT_PBO
+/**
+ * Frame data of a frame returned by getf() may live in a persistently mapped
+ * PBO (set as video_frame::callbacks::dispose_udata). The decoder then writes
+ * directly to the GPU-visible memory and the upload is just a DMA from the
+ * PBO. The fence guards reuse of the buffer until the upload is finished.
+ */
+struct gl_pbo_frame {
+        struct state_gl *s;
+        GLuint pbo;
+        GLsync fence;
+};
+#endif
+
 static constexpr array gl_supp_codecs = {
 #ifdef HWACC_VDPAU
         HW_VDPAU,
+#endif
+#ifdef HWACC_VIDEOTOOLBOX
+        HW_VIDEOTOOLBOX,
 #endif
         UYVY,
         v210,
@@ -941,6 +1016,21 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
         else if (desc.color_spec == HW_VDPAU) {
                 s->vdp.init();
         }
+#endif
+#ifdef HWACC_VIDEOTOOLBOX
+        else if (desc.color_spec == HW_VIDEOTOOLBOX) {
+                glActiveTexture(GL_TEXTURE0 + 0);
+                glBindTexture(GL_TEXTURE_2D,s->texture_display);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                                desc.width, desc.height, 0,
+                                GL_RGBA, GL_UNSIGNED_BYTE,
+                                NULL);
+                s->current_program = s->PHandles.at(HW_VIDEOTOOLBOX);
+                glUseProgram(s->current_program);
+                glUniform1i(glGetUniformLocation(s->current_program, "chroma"), 3);
+                glUniform1f(glGetUniformLocation(s->current_program, "imageHeight"), (GLfloat) desc.height);
+                glUseProgram(0);
+        }
 #endif
         if (s->current_program) {
                 glUseProgram(s->current_program);
@@ -966,6 +1056,9 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
 
         gl_check_error();
 
+        gl_pbo_ring_create(s, desc);
+        gl_check_error();
+
         if (!s->fixed_size) {
                 glfw_resize_window(s->window, s->fs, desc.height, s->aspect, desc.fps, s->window_size_factor);
                 gl_resize(s->window, desc.width, desc.height);
@@ -1080,11 +1173,13 @@ static void gl_process_frames(struct state_gl *s)
                         return;
                 }
                 if (s->current_frame) {
+                        gl_pbo_frame_wait(s->current_frame);
                         vf_recycle(s->current_frame);
                         s->free_frame_queue.push(s->current_frame);
                 }
                 s->current_frame = frame;
         }
+        gl_pbo_collect_garbage(s);
 
         if (!video_desc_eq(video_desc_from_frame(frame), s->current_display_desc)) {
                 gl_reconfigure_screen(s, video_desc_from_frame(frame));
@@ -1466,6 +1561,9 @@ static bool display_gl_init_opengl(struct state_gl *s)
                 return false;
         }
         display_gl_print_depth();
+#ifdef HAVE_PERSISTENT_PBO
+        s->persistent_pbo = GLEW_ARB_buffer_storage && GLEW_ARB_sync;
+#endif
 
         glClearColor( 0.0f, 0.0f, 0.0f, 1.0f );
         glEnable( GL_TEXTURE_2D );
@@ -1484,6 +1582,18 @@ static bool display_gl_init_opengl(struct state_gl *s)
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
+#ifdef HWACC_VIDEOTOOLBOX
+        glGenTextures(2, s->texture_iosurface);
+        for (GLuint tex : s->texture_iosurface) {
+                glBindTexture(GL_TEXTURE_RECTANGLE_ARB, tex);
+                glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_RECTANGLE_ARB, 0);
+#endif
+
         for (auto &it : glsl_programs) {
                 GLuint prog = gl_substitute_compile_link(vert, it.second);
                 if (prog == 0U) {
@@ -1521,6 +1631,9 @@ static void display_gl_cleanup_opengl(struct state_gl *s){
         }
         glDeleteTextures(1, &s->texture_display);
         glDeleteTextures(1, &s->texture_raw);
+#ifdef HWACC_VIDEOTOOLBOX
+        glDeleteTextures(2, s->texture_iosurface);
+#endif
         glDeleteFramebuffersEXT(1, &s->fbo_id);
         glDeleteBuffersARB(1, &s->pbo_id);
         glfwDestroyWindow(s->window);
@@ -1582,34 +1695,85 @@ static void gl_resize(GLFWwindow *win, int width, int height)
         }
 }
 
+/**
+ * @returns size of the compressed texture image uploaded for a DXT frame, it
+ * can be larger than the frame data if the dimensions are not divisible by 4
+ */
+static size_t gl_compressed_texture_size(struct video_desc desc)
+{
+        const size_t width = (desc.width + 3) / 4 * 4;
+        const size_t height = (desc.height + 3) / 4 * 4;
+        switch (desc.color_spec) {
+                case DXT1:
+                        return width * height / 2;
+                case DXT1_YUV:
+                        return (desc.width * desc.height / 16) * 8;
+                case DXT5:
+                        return width * height;
+                default:
+                        return 0;
+        }
+}
+
 static void upload_compressed_texture(struct state_gl *s, char *data) {
+        GLsizei width = (s->current_display_desc.width + 3) / 4 * 4;
+        GLsizei height = s->dxt_height;
+        GLenum format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
         switch (s->current_display_desc.color_spec) {
                 case DXT1:
-                        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
-                                        (s->current_display_desc.width + 3) / 4 * 4, s->dxt_height,
-                                        GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
-                                        ((s->current_display_desc.width + 3) / 4 * 4 * s->dxt_height)/2,
-                                        data);
                         break;
                 case DXT1_YUV:
-                        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
-                                        s->current_display_desc.width, s->current_display_desc.height,
-                                        GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
-                                        (s->current_display_desc.width * s->current_display_desc.height/16)*8,
-                                        data);
+                        width = s->current_display_desc.width;
+                        height = s->current_display_desc.height;
                         break;
                 case DXT5:
-                        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
-                                        (s->current_display_desc.width + 3) / 4 * 4, s->dxt_height,
-                                        GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
-                                        (s->current_display_desc.width + 3) / 4 * 4 * s->dxt_height,
-                                        data);
+                        format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
                         break;
                 default:
                         abort();
         }
+        const GLsizei size = gl_compressed_texture_size(s->current_display_desc);
+        // the decoder wrote the packets directly to the PBO - upload from it
+        if (auto *pbo = gl_pbo_bind_current(s, data)) {
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, size, nullptr);
+                gl_pbo_upload_finished(pbo);
+                return;
+        }
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, size, data);
 }
 
+#ifdef HWACC_VIDEOTOOLBOX
+/**
+ * Binds both NV12 planes of the IOSurface backing the decoded CVPixelBuffer
+ * as rectangle textures (units 2 and 3) - no copy is made, the GPU samples
+ * the decoder output directly.
+ */
+static void bind_iosurface(struct state_gl *s, hw_videotoolbox_frame *frame)
+{
+        auto pixbuf = reinterpret_cast<CVPixelBufferRef>(frame->av_frame->data[3]);
+        IOSurfaceRef surf = CVPixelBufferGetIOSurface(pixbuf);
+        if (surf == nullptr) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "VideoToolbox frame is not backed by IOSurface!\n");
+                return;
+        }
+        const GLsizei w = s->current_display_desc.width;
+        const GLsizei h = s->current_display_desc.height;
+        CGLContextObj ctx = CGLGetCurrentContext();
+        glActiveTexture(GL_TEXTURE0 + 2);
+        glBindTexture(GL_TEXTURE_RECTANGLE_ARB, s->texture_iosurface[0]);
+        CGLError ret = CGLTexImageIOSurface2D(ctx, GL_TEXTURE_RECTANGLE_ARB, GL_RED, w, h, GL_RED, GL_UNSIGNED_BYTE, surf, 0);
+        glActiveTexture(GL_TEXTURE0 + 3);
+        glBindTexture(GL_TEXTURE_RECTANGLE_ARB, s->texture_iosurface[1]);
+        if (ret == kCGLNoError) {
+                ret = CGLTexImageIOSurface2D(ctx, GL_TEXTURE_RECTANGLE_ARB, GL_RG, (w + 1) / 2, (h + 1) / 2, GL_RG, GL_UNSIGNED_BYTE, surf, 1);
+        }
+        if (ret != kCGLNoError) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to bind IOSurface: %s\n", CGLErrorString(ret));
+        }
+        glActiveTexture(GL_TEXTURE0 + 2);
+}
+#endif
+
 static void upload_texture(struct state_gl *s, char *data)
 {
 #ifdef HWACC_VDPAU
@@ -1617,6 +1781,12 @@ static void upload_texture(struct state_gl *s, char *data)
                 s->vdp.loadFrame(reinterpret_cast<hw_vdpau_frame *>(data));
                 return;
         }
+#endif
+#ifdef HWACC_VIDEOTOOLBOX
+        if (s->current_display_desc.color_spec == HW_VIDEOTOOLBOX) {
+                bind_iosurface(s, reinterpret_cast<hw_videotoolbox_frame *>(data));
+                return;
+        }
 #endif
         if (s->current_display_desc.color_spec == DXT1 || s->current_display_desc.color_spec == DXT1_YUV || s->current_display_desc.color_spec == DXT5) {
                 upload_compressed_texture(s, data);
@@ -1633,6 +1803,11 @@ static void upload_texture(struct state_gl *s, char *data)
         if (s->current_display_desc.color_spec == UYVY || s->current_display_desc.color_spec == v210) {
                 width = vc_get_linesize(width, s->current_display_desc.color_spec) / 4;
         }
+        if (auto *pbo = gl_pbo_bind_current(s, data)) {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, s->current_display_desc.height, format, type, nullptr);
+                gl_pbo_upload_finished(pbo);
+                return;
+        }
         /// swaps bytes and removes 256B padding
         auto process_r10k = [](uint32_t * __restrict out, const uint32_t *__restrict in, long width, long height) {
                 DEBUG_TIMER_START(process_r10k);
@@ -1674,6 +1849,139 @@ static void upload_texture(struct state_gl *s, char *data)
         }
 }
 
+#ifdef HAVE_PERSISTENT_PBO
+/// can be called from any thread, GL resources are deleted later by the GL thread
+static void gl_pbo_frame_data_deleter(struct video_frame *f)
+{
+        auto *pbo = static_cast<gl_pbo_frame *>(f->callbacks.dispose_udata);
+        {
+                lock_guard<mutex> lk(pbo->s->pbo_garbage_lock);
+                pbo->s->pbo_garbage.emplace_back(pbo->pbo, pbo->fence);
+        }
+        delete pbo;
+}
+
+static struct gl_pbo_frame *gl_pbo_of(struct video_frame *f)
+{
+        if (f == nullptr || f->callbacks.data_deleter != gl_pbo_frame_data_deleter) {
+                return nullptr;
+        }
+        return static_cast<gl_pbo_frame *>(f->callbacks.dispose_udata);
+}
+
+/**
+ * Binds the PBO of the current frame for the upload if data are those of the
+ * frame (and not eg. a scratchpad).
+ *
+ * @returns the PBO (to be passed to gl_pbo_upload_finished()) or nullptr if
+ * data are not in a PBO
+ */
+static struct gl_pbo_frame *gl_pbo_bind_current(struct state_gl *s, const char *data)
+{
+        auto *pbo = gl_pbo_of(s->current_frame);
+        if (pbo == nullptr || data != s->current_frame->tiles[0].data) {
+                return nullptr;
+        }
+        gl_pbo_frame_wait(s->current_frame); // in case of a re-upload of the same frame
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->pbo);
+        return pbo;
+}
+
+static void gl_pbo_upload_finished(struct gl_pbo_frame *pbo)
+{
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        pbo->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/**
+ * codecs uploaded as they are in the frame (R10k needs a byte swap, HW_VDPAU
+ * has own path), DXT frames are uploaded as compressed textures
+ */
+static bool gl_pbo_codec_eligible(codec_t codec)
+{
+        return codec == UYVY || codec == v210 || codec == RGBA || codec == RGB || codec == RG48 || codec == Y416
+                || codec == DXT1 || codec == DXT1_YUV || codec == DXT5;
+}
+
+/**
+ * Allocates a ring of frames backed by persistently mapped PBOs for the new
+ * format. The frames are then passed to the decoder through getf() (frames of
+ * the previous format are freed there).
+ */
+static void gl_pbo_ring_create(struct state_gl *s, struct video_desc desc)
+{
+        gl_pbo_collect_garbage(s);
+        if (!s->use_pbo || !s->persistent_pbo || !gl_pbo_codec_eligible(desc.color_spec)) {
+                return;
+        }
+        // frame may be also read (interlacing change in decoder, screenshot)
+        const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        vector<struct video_frame *> frames;
+        for (int i = 0; i < PBO_RING_SIZE; ++i) {
+                struct video_frame *f = vf_alloc_desc(desc);
+                auto *pbo = new gl_pbo_frame{s, 0, nullptr};
+                f->callbacks.dispose_udata = pbo;
+                f->callbacks.data_deleter = gl_pbo_frame_data_deleter;
+                // DXT texture image is padded to whole blocks
+                const size_t size = max<size_t>(f->tiles[0].data_len, gl_compressed_texture_size(desc));
+                glGenBuffers(1, &pbo->pbo);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->pbo);
+                glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+                f->tiles[0].data = static_cast<char *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+                if (f->tiles[0].data == nullptr) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot map persistent PBO, using regular frames.\n");
+                        vf_free(f);
+                        break;
+                }
+                frames.push_back(f);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        gl_pbo_collect_garbage(s);
+
+        lock_guard<mutex> lk(s->lock);
+        for (auto *f : frames) {
+                s->free_frame_queue.push(f);
+        }
+}
+
+/**
+ * Waits until the texture upload from the frame PBO is done so that it can be
+ * passed to the decoder again. Usually returns immediately - the frame is
+ * returned when its successor is being displayed.
+ */
+static void gl_pbo_frame_wait(struct video_frame *f)
+{
+        auto *pbo = gl_pbo_of(f);
+        if (pbo == nullptr || pbo->fence == nullptr) {
+                return;
+        }
+        if (glClientWaitSync(pbo->fence, GL_SYNC_FLUSH_COMMANDS_BIT, NS_IN_SEC) == GL_TIMEOUT_EXPIRED) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "PBO upload not finished in time!\n");
+        }
+        glDeleteSync(pbo->fence);
+        pbo->fence = nullptr;
+}
+
+/// must be called from GL thread
+static void gl_pbo_collect_garbage(struct state_gl *s)
+{
+        lock_guard<mutex> lk(s->pbo_garbage_lock);
+        for (auto &it : s->pbo_garbage) {
+                if (it.second != nullptr) {
+                        glDeleteSync(it.second);
+                }
+                glDeleteBuffers(1, &it.first);
+        }
+        s->pbo_garbage.clear();
+}
+#else
+static struct gl_pbo_frame *gl_pbo_bind_current(struct state_gl *, const char *) { return nullptr; }
+static void gl_pbo_upload_finished(struct gl_pbo_frame *) {}
+static void gl_pbo_ring_create(struct state_gl *, struct video_desc) {}
+static void gl_pbo_frame_wait(struct video_frame *) {}
+static void gl_pbo_collect_garbage(struct state_gl *) {}
+#endif // defined HAVE_PERSISTENT_PBO
+
 static bool check_rpi_pbo_quirks()
 {
 #if ! defined __linux__
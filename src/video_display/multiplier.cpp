@@ -44,18 +44,22 @@
 #include "lib_common.h"
 #include "video.h"
 #include "video_display.h"
+#include "utils/frame_copy.h"
 #include "utils/string_view_utils.hpp"
+#include "utils/thread.h"
 
 #include <condition_variable>
 #include <vector>
 #include <memory>
 #include <mutex>
 #include <queue>
+#include <set>
 #include <thread>
 
 using namespace std;
 
 static constexpr unsigned int IN_QUEUE_MAX_BUFFER_LEN = 5;
+static constexpr unsigned int OUT_QUEUE_MAX_BUFFER_LEN = 2;
 static constexpr const char *MOD_NAME = "[multiplier] ";
 static constexpr int SKIP_FIRST_N_FRAMES_IN_STREAM = 5;
 
@@ -64,8 +68,27 @@ struct disp_deleter{ void operator()(display *d){ display_done(d); } };
 using unique_disp = std::unique_ptr<struct display, disp_deleter>;
 }
 
+/**
+ * Output to one of the displays. Every output has its own queue and thread
+ * so that the frames are copied for all displays in parallel and a slow
+ * display doesn't delay the others (unless it is blocking).
+ */
+struct multiplier_output {
+        struct display *disp;
+        bool external_frames = false; ///< display accepts the shared frame without a copy
+        bool drop = false; ///< drop the oldest frame when full instead of blocking the other displays
+        queue<shared_ptr<struct video_frame>> frames; ///< nullptr is a poison pill
+        bool busy = false; ///< a frame is being put to the display
+        unsigned long long dropped = 0;
+        mutex lock;
+        condition_variable cv;
+        condition_variable consumed_cv;
+        thread worker;
+};
+
 struct state_multiplier_common {
         std::vector<unique_disp> displays;
+        std::vector<unique_ptr<multiplier_output>> outputs;
 
         struct video_desc display_desc;
 
@@ -88,8 +111,14 @@ static void show_help(){
         printf("Multiplier display\n");
         printf("Usage:\n");
         printf("\t-d multiplier:<display1>[:<display_config1>][#<display2>[:<display_config2>]]...\n");
+        printf("\nDisplays that accept external frames get the received frame without a copy, the frame is\n"
+                        "copied in parallel for the others. Use \"--param multiplier-drop=<idx>[,<idx>]...\" (indices\n"
+                        "from 0) to let the given displays drop frames instead of slowing down the remaining ones.\n");
 }
 
+ADD_TO_PARAM("multiplier-drop", "* multiplier-drop=<idx>[,<idx>]...\n"
+                "  Displays of the multiplier (indexed from 0) that drop frames if they cannot keep up instead of blocking\n");
+
 static void *display_multiplier_init(struct module *parent, const char *fmt, unsigned int flags)
 {
         auto s = std::make_unique<state_multiplier>();
@@ -134,25 +163,145 @@ static void *display_multiplier_init(struct module *parent, const char *fmt, uns
                 s->common->displays.push_back(std::move(disp));
         }
 
+        std::set<unsigned> drop;
+        if (const char *drop_cfg = get_commandline_param("multiplier-drop")) {
+                std::string_view drop_sv = drop_cfg;
+                for (auto tok = tokenize(drop_sv, ','); !tok.empty(); tok = tokenize(drop_sv, ',')) {
+                        drop.insert(strtoul(std::string(tok).c_str(), nullptr, 10));
+                }
+        }
+        for (auto &disp : s->common->displays) {
+                auto out = make_unique<multiplier_output>();
+                out->disp = disp.get();
+                out->drop = drop.count(s->common->outputs.size()) > 0;
+                s->common->outputs.push_back(std::move(out));
+        }
+
         return s.release();
 }
 
+static bool display_accepts_external_frames(struct display *d)
+{
+        bool external = false;
+        size_t len = sizeof external;
+        if (!display_ctl_property(d, DISPLAY_PROPERTY_EXTERNAL_FRAMES, &external, &len) || !external) {
+                return false;
+        }
+        int pitch = PITCH_DEFAULT;
+        len = sizeof pitch;
+        if (display_ctl_property(d, DISPLAY_PROPERTY_BUF_PITCH, &pitch, &len) && pitch != PITCH_DEFAULT) {
+                return false;
+        }
+        return true;
+}
+
+/// waits until all outputs have put their queued frames so that the displays can be reconfigured
+static void wait_outputs_idle(struct state_multiplier_common *s)
+{
+        for (auto &out : s->outputs) {
+                unique_lock<mutex> lk(out->lock);
+                out->consumed_cv.wait(lk, [&out]{ return out->frames.empty() && !out->busy; });
+        }
+}
+
 static void check_reconf(struct state_multiplier_common *s, struct video_desc desc)
 {
         if (!video_desc_eq(desc, s->display_desc)) {
+                wait_outputs_idle(s);
                 s->display_desc = desc;
                 fprintf(stderr, "RECONFIGURED\n");
-                for(auto& disp : s->displays){
-                        display_reconfigure(disp.get(), s->display_desc, VIDEO_NORMAL);
+                for (auto &out : s->outputs) {
+                        display_reconfigure(out->disp, s->display_desc, VIDEO_NORMAL);
+                        out->external_frames = display_accepts_external_frames(out->disp);
+                }
+        }
+}
+
+static void release_shared_frame(struct video_frame *f)
+{
+        delete static_cast<shared_ptr<struct video_frame> *>(f->callbacks.dispose_udata);
+        vf_free(f);
+}
+
+/// @returns frame referencing the data of the shared frame, released by the display with VIDEO_FRAME_DISPOSE
+static struct video_frame *get_shared_view(shared_ptr<struct video_frame> const &frame)
+{
+        struct video_frame *view = vf_alloc_desc(video_desc_from_frame(frame.get()));
+        for (unsigned i = 0; i < frame->tile_count; ++i) {
+                view->tiles[i].data = frame->tiles[i].data;
+                view->tiles[i].data_len = frame->tiles[i].data_len;
+        }
+        view->callbacks.dispose = release_shared_frame;
+        view->callbacks.dispose_udata = new shared_ptr<struct video_frame>(frame);
+        return view;
+}
+
+static void multiplier_output_worker(multiplier_output *out)
+{
+        set_thread_name("multiplier_out");
+        while (true) {
+                shared_ptr<struct video_frame> frame;
+                {
+                        unique_lock<mutex> lk(out->lock);
+                        out->cv.wait(lk, [out]{ return !out->frames.empty(); });
+                        frame = std::move(out->frames.front());
+                        out->frames.pop();
+                        out->busy = true;
+                }
+                out->consumed_cv.notify_all();
+
+                if (!frame) {
+                        display_put_frame(out->disp, NULL, PUTF_BLOCKING);
+                        break;
                 }
+
+                struct video_frame *display_frame = nullptr;
+                if (out->external_frames) {
+                        display_frame = get_shared_view(frame);
+                } else {
+                        display_frame = display_get_frame(out->disp);
+                        for (unsigned i = 0; i < display_frame->tile_count && i < frame->tile_count; ++i) {
+                                frame_copy(display_frame->tiles[i].data, frame->tiles[i].data,
+                                                min(display_frame->tiles[i].data_len, frame->tiles[i].data_len));
+                        }
+                }
+                display_put_frame(out->disp, display_frame, out->drop ? PUTF_NONBLOCK : PUTF_BLOCKING);
+
+                {
+                        lock_guard<mutex> lk(out->lock);
+                        out->busy = false;
+                }
+                out->consumed_cv.notify_all();
         }
 }
 
+static void push_to_output(multiplier_output *out, shared_ptr<struct video_frame> const &frame)
+{
+        unique_lock<mutex> lk(out->lock);
+        if (frame && out->drop) {
+                while (out->frames.size() >= OUT_QUEUE_MAX_BUFFER_LEN) {
+                        out->frames.pop();
+                        if (out->dropped++ % 100 == 0) {
+                                LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Display too slow, " << out->dropped << " frames dropped.\n";
+                        }
+                }
+        } else {
+                out->consumed_cv.wait(lk, [out]{ return out->frames.size() < OUT_QUEUE_MAX_BUFFER_LEN; });
+        }
+        out->frames.push(frame);
+        lk.unlock();
+        out->cv.notify_one();
+}
+
 static void display_multiplier_worker(void *state)
 {
         shared_ptr<struct state_multiplier_common> s = ((struct state_multiplier *)state)->common;
         int skipped = 0;
 
+        for (auto &out : s->outputs) {
+                out->worker = thread(multiplier_output_worker, out.get());
+        }
+
         while (1) {
                 struct video_frame *frame;
                 {
@@ -164,8 +313,8 @@ static void display_multiplier_worker(void *state)
                 }
 
                 if (!frame) {
-                        for (auto& disp : s->displays) {
-                                display_put_frame(disp.get(), NULL, PUTF_BLOCKING);
+                        for (auto &out : s->outputs) {
+                                push_to_output(out.get(), nullptr);
                         }
                         break;
                 }
@@ -178,13 +327,15 @@ static void display_multiplier_worker(void *state)
 
                 check_reconf(s.get(), video_desc_from_frame(frame));
 
-                for (auto& disp : s->displays) {
-                        struct video_frame *real_display_frame = display_get_frame(disp.get());
-                        memcpy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
-                        display_put_frame(disp.get(), real_display_frame, PUTF_BLOCKING);
+                // shared by all outputs, freed when the last display releases it
+                shared_ptr<struct video_frame> shared_frame(frame, vf_free);
+                for (auto &out : s->outputs) {
+                        push_to_output(out.get(), shared_frame);
                 }
+        }
 
-                vf_free(frame);
+        for (auto &out : s->outputs) {
+                out->worker.join();
         }
 }
 
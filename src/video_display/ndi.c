@@ -59,15 +59,20 @@
 #include "utils/color_out.h"
 #include "utils/macros.h" // OPTIMIZED_FOR
 #include "utils/misc.h"
+#include "utils/video_frame_pool.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_display.h"
 
+#include <stdint.h> // SIZE_MAX
+
+#define CONVERT_LINES_PER_TASK 32
 #define DEFAULT_AUDIO_LEVEL 0
 #define MOD_NAME "[NDI disp.] "
 
-typedef void ndi_disp_convert_t(const struct video_frame *f, char *out);
-static void ndi_disp_convert_Y216_to_P216(const struct video_frame *f, char *out);
-static void ndi_disp_convert_Y416_to_PA16(const struct video_frame *f, char *out);
+typedef void ndi_disp_convert_t(void *udata, size_t begin, size_t end);
+static void ndi_disp_convert_Y216_to_P216(void *udata, size_t begin, size_t end);
+static void ndi_disp_convert_Y416_to_PA16(void *udata, size_t begin, size_t end);
 
 struct display_ndi {
         LIB_HANDLE lib;
@@ -79,9 +84,18 @@ struct display_ndi {
         struct video_desc desc;
         struct audio_desc audio_desc;
         struct video_frame *send_frame; ///< frame that is just being asynchronously sent
+        void *frame_pool; ///< frames returned by getf
 
         ndi_disp_convert_t *convert;
-        char *convert_buffer; ///< for codecs that need conversion (eg. Y216->P216)
+        /// for codecs that need conversion (eg. Y216->P216) - one is being sent
+        /// while the next frame is converted to the other
+        char *convert_buffer[2];
+        int convert_idx;
+};
+
+struct ndi_disp_convert_data {
+        const struct video_frame *f;
+        char *out;
 };
 
 static void display_ndi_probe(struct device_info **available_cards, int *count, void (**deleter)(void *))
@@ -111,9 +125,21 @@ static int display_ndi_reconfigure(void *state, struct video_desc desc)
 {
         struct display_ndi *s = (struct display_ndi *) state;
 
+        // the buffers of the last asynchronously sent frame are released by this
+        s->NDIlib->send_send_video_v2(s->pNDI_send, NULL);
+        VIDEO_FRAME_DISPOSE(s->send_frame);
+        s->send_frame = NULL;
+
         s->desc = desc;
-        free(s->convert_buffer);
-        s->convert_buffer = malloc(MAX_BPS * desc.width * desc.height + MAX_PADDING);
+        for (int i = 0; i < 2; ++i) {
+                free(s->convert_buffer[i]);
+                s->convert_buffer[i] = malloc(MAX_BPS * desc.width * desc.height + MAX_PADDING);
+        }
+        if (s->frame_pool == NULL) {
+                s->frame_pool = video_frame_pool_init(desc, 0);
+        } else {
+                video_frame_pool_reconfigure(s->frame_pool, desc, SIZE_MAX);
+        }
 
         s->NDI_video_frame.xres = s->desc.width;
         s->NDI_video_frame.yres = s->desc.height;
@@ -259,10 +285,15 @@ static void display_ndi_done(void *state)
         struct display_ndi *s = (struct display_ndi *) state;
 
         s->NDIlib->send_destroy(s->pNDI_send);
-        free(s->convert_buffer);
+        for (int i = 0; i < 2; ++i) {
+                free(s->convert_buffer[i]);
+        }
         s->NDIlib->destroy();
         close_ndi_library(s->lib);
-        vf_free(s->send_frame);
+        VIDEO_FRAME_DISPOSE(s->send_frame);
+        if (s->frame_pool != NULL) {
+                video_frame_pool_destroy(s->frame_pool);
+        }
         free(s->video_metadata);
         free(s);
 }
@@ -271,19 +302,22 @@ static struct video_frame *display_ndi_getf(void *state)
 {
         struct display_ndi *s = (struct display_ndi *) state;
 
-        return vf_alloc_desc_data(s->desc);
+        return video_frame_pool_get_disposable_frame(s->frame_pool);
 }
 
-static void ndi_disp_convert_Y216_to_P216(const struct video_frame *f, char *out)
+/// converts lines [begin, end) - the planes are written by rows so that the frame may be converted in bands
+static void ndi_disp_convert_Y216_to_P216(void *udata, size_t begin, size_t end)
 {
-        assert((uintptr_t) out % 2 == 0);
+        const struct ndi_disp_convert_data *d = udata;
+        const struct video_frame *f = d->f;
+        assert((uintptr_t) d->out % 2 == 0);
 
-        uint16_t *in = (uint16_t *)(void *) f->tiles[0].data;
-        uint16_t *out_y = (uint16_t *)(void *) out;
-        uint16_t *out_cb_cr = (uint16_t *)(void *) out + f->tiles[0].width * f->tiles[0].height;
+        unsigned int width = f->tiles[0].width;
+        const uint16_t *in = (uint16_t *)(void *) (f->tiles[0].data + begin * vc_get_linesize(width, Y216));
+        uint16_t *out_y = (uint16_t *)(void *) d->out + begin * width;
+        uint16_t *out_cb_cr = (uint16_t *)(void *) d->out + (size_t) width * f->tiles[0].height + begin * width;
 
-        for (unsigned int i = 0; i < f->tiles[0].height; ++i) {
-                unsigned int width = f->tiles[0].width;
+        for (size_t i = begin; i < end; ++i) {
                 OPTIMIZED_FOR (unsigned int j = 0; j < (width + 1) / 2; j += 1) {
                         *out_y++ = *in++;
                         *out_cb_cr++ = *in++;
@@ -293,17 +327,21 @@ static void ndi_disp_convert_Y216_to_P216(const struct video_frame *f, char *out
         }
 }
 
-static void ndi_disp_convert_Y416_to_PA16(const struct video_frame *f, char *out)
+/// PA16 is P216 followed by the alpha plane
+static void ndi_disp_convert_Y416_to_PA16(void *udata, size_t begin, size_t end)
 {
-        assert((uintptr_t) out % 2 == 0);
-
-        uint16_t *in = (uint16_t *)(void *) f->tiles[0].data;
-        uint16_t *out_y = (uint16_t *)(void *) out;
-        uint16_t *out_cb_cr = out_y + (size_t) f->tiles[0].width * f->tiles[0].height;
-        uint16_t *out_a = out_cb_cr + (size_t) (f->tiles[0].width + 1) / 2 * f->tiles[0].height;
-
-        for (unsigned int i = 0; i < f->tiles[0].height; ++i) {
-                unsigned int width = f->tiles[0].width;
+        const struct ndi_disp_convert_data *d = udata;
+        const struct video_frame *f = d->f;
+        assert((uintptr_t) d->out % 2 == 0);
+
+        unsigned int width = f->tiles[0].width;
+        size_t plane_len = (size_t) width * f->tiles[0].height;
+        const uint16_t *in = (uint16_t *)(void *) (f->tiles[0].data + begin * vc_get_linesize(width, Y416));
+        uint16_t *out_y = (uint16_t *)(void *) d->out + begin * width;
+        uint16_t *out_cb_cr = (uint16_t *)(void *) d->out + plane_len + begin * width;
+        uint16_t *out_a = (uint16_t *)(void *) d->out + 2 * plane_len + begin * width;
+
+        for (size_t i = begin; i < end; ++i) {
                 OPTIMIZED_FOR (unsigned int j = 0; j < (width + 1) / 2; j += 1) {
                         *out_a++ = in[0];
                         *out_y++ = in[1];
@@ -328,24 +366,25 @@ static int display_ndi_putf(void *state, struct video_frame *frame, long long fl
         }
 
         if (flag == PUTF_DISCARD) {
-                vf_free(frame);
+                VIDEO_FRAME_DISPOSE(frame);
                 return 0;
         }
 
-        s->NDIlib->send_send_video_v2(s->pNDI_send, NULL); // wait for the async frame to be processed
-        vf_free(s->send_frame);
-        s->send_frame = NULL;
-
+        // the previous frame is still being sent (its buffer is released by the next send call)
         if (s->convert != NULL) {
-                s->convert(frame, s->convert_buffer);
-                s->NDI_video_frame.p_data = (uint8_t *) s->convert_buffer;
-                vf_free(frame);
+                struct ndi_disp_convert_data d = { frame, s->convert_buffer[s->convert_idx] };
+                task_run_parallel_for(frame->tiles[0].height, CONVERT_LINES_PER_TASK, s->convert, &d);
+                s->NDI_video_frame.p_data = (uint8_t *) d.out;
+                s->convert_idx ^= 1;
+                VIDEO_FRAME_DISPOSE(frame);
+                frame = NULL;
         } else {
                 s->NDI_video_frame.p_data = (uint8_t *) frame->tiles[0].data;
-                s->send_frame = frame;
         }
 
         s->NDIlib->send_send_video_async_v2(s->pNDI_send, &s->NDI_video_frame);
+        VIDEO_FRAME_DISPOSE(s->send_frame);
+        s->send_frame = frame;
 
         return 0;
 }
@@ -42,7 +42,9 @@
 #include <glm/gtc/quaternion.hpp>
 #include "opengl_utils.hpp"
 
+#include "debug.h"
 #include "utils/profile_timer.hpp"
+#include "video_frame.h"
 
 static const float PI_F=3.14159265358979f;
 
@@ -385,6 +387,56 @@ void Texture::upload_frame(video_frame *f, bool pbo_frame){
         }
 }
 
+static void map_new_buffer(video_frame *f){
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, f->tiles[0].data_len, 0, GL_STREAM_DRAW);
+        f->tiles[0].data = (char *) glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        GLenum ret = glGetError();
+        if(ret != GL_NO_ERROR){
+                log_msg(LOG_LEVEL_ERROR, "Error mapping PBO: %u\n", ret);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+video_frame *allocate_pbo_frame(const video_desc& desc){
+        video_frame *buffer = vf_alloc_desc(desc);
+        GlBuffer *pbo = new GlBuffer();
+        buffer->callbacks.dispose_udata = pbo;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->get());
+
+        map_new_buffer(buffer);
+
+        return buffer;
+}
+
+void recycle_pbo_frame(video_frame *f){
+        GlBuffer *pbo = static_cast<GlBuffer *>(f->callbacks.dispose_udata);
+        if(!pbo){
+                return;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->get());
+        if(f->tiles[0].data){
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        map_new_buffer(f);
+}
+
+void delete_pbo_frame(video_frame *f){
+        GlBuffer *pbo = static_cast<GlBuffer *>(f->callbacks.dispose_udata);
+        bool mapped = f->tiles[0].data != nullptr;
+        vf_free(f);
+
+        if(!pbo){
+                return;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->get());
+        if(mapped){
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        delete pbo;
+}
+
 void Framebuffer::attach_texture(GLuint tex){
         glBindTexture(GL_TEXTURE_2D, tex);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -318,6 +318,28 @@ private:
 /**
  * Class used to convert YUV textures to RGB textures
  */
+/**
+ * Allocates a video frame whose data point to a mapped PBO (the GlBuffer is
+ * stored in callbacks.dispose_udata), so that the decoder writes directly to
+ * the buffer and Texture::upload_frame() uploads from it without a copy.
+ * The PBO frame functions must be called from the thread of the uploading
+ * context.
+ *
+ * @param desc video description of the frame
+ */
+video_frame *allocate_pbo_frame(const video_desc& desc);
+
+/**
+ * Maps a fresh (orphaned) storage of the PBO of an uploaded frame so that
+ * the frame can be filled again
+ */
+void recycle_pbo_frame(video_frame *f);
+
+/**
+ * Frees the frame together with its PBO
+ */
+void delete_pbo_frame(video_frame *f);
+
 class Yuv_convertor{
 public:
         Yuv_convertor();
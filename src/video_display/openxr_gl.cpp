@@ -497,55 +497,6 @@ static int64_t select_swapchain_fmt(const std::vector<int64_t>& swapchain_format
         return 0;
 }
 
-static void map_new_buffer(struct video_frame *f){
-        glBufferData(GL_PIXEL_UNPACK_BUFFER, f->tiles[0].data_len, 0, GL_STREAM_DRAW);
-        f->tiles[0].data = (char *) glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
-        GLenum ret = glGetError();
-        if(ret != GL_NO_ERROR){
-                std::cerr << "Error mapping: " << ret << std::endl;
-        }
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-}
-
-static void recycle_frame(video_frame *f){
-        GlBuffer *pbo = static_cast<GlBuffer *>(f->callbacks.dispose_udata);
-        if(!pbo){
-                return;
-        }
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->get());
-        if(f->tiles[0].data){
-                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-        }
-        map_new_buffer(f);
-}
-
-static void delete_frame(video_frame *f){
-        GlBuffer *pbo = static_cast<GlBuffer *>(f->callbacks.dispose_udata);
-        vf_free(f);
-
-        if(!pbo){
-                return;
-        }
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->get());
-        if(f->tiles[0].data){
-                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-        }
-         
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-        delete pbo;
-}
-
-static video_frame *allocate_frame(state_xrgl *s){
-        video_frame *buffer = vf_alloc_desc(s->current_desc);
-        GlBuffer *pbo = new GlBuffer();
-        buffer->callbacks.dispose_udata = pbo;
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->get());
-
-        map_new_buffer(buffer);
-
-        return buffer;
-}
-
 static void worker(state_xrgl *s){
         PROFILE_FUNC;
         s->window.make_worker_context_current();
@@ -571,12 +522,12 @@ static void worker(state_xrgl *s){
                         PROFILE_DETAIL("Process disposed frames");
                         for(video_frame *f : s->dispose_frame_pool){
                                 if (video_desc_eq(video_desc_from_frame(f), s->current_desc)) {
-                                        recycle_frame(f);
+                                        recycle_pbo_frame(f);
                                         s->free_frame_pool.push_back(f);
                                 } else {
-                                        delete_frame(f);
+                                        delete_pbo_frame(f);
 
-                                        struct video_frame *buffer = allocate_frame(s);
+                                        struct video_frame *buffer = allocate_pbo_frame(s->current_desc);
                                         s->free_frame_pool.push_back(buffer);
                                 }
                         }
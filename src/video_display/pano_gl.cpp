@@ -45,6 +45,8 @@
 #include <condition_variable>
 #include <mutex>
 #include <queue>
+#include <thread>
+#include <vector>
 
 #include "debug.h"
 #include "host.h"
@@ -61,6 +63,7 @@
 #include "utils/profile_timer.hpp"
 
 #define MAX_BUFFER_SIZE   1
+#define PBO_RING_SIZE     3 ///< frames being decoded, queued and uploaded
 #define MOD_NAME "[pano gl] "
 
 struct state_vr{
@@ -73,7 +76,6 @@ struct state_vr{
         unsigned sdl_redraw_event;
 
         video_desc current_desc;
-        int buffered_frames_count;
 
         Scene scene;
 
@@ -84,9 +86,20 @@ struct state_vr{
 
         std::chrono::steady_clock::time_point last_frame;
 
+        /* Frames are uploaded to the back texture of the scene by the
+         * upload thread with a shared context, the render thread only
+         * samples the latest completely uploaded texture
+         */
+        std::thread upload_thread;
         std::mutex lock;
         std::condition_variable frame_consumed_cv;
-        std::queue<video_frame *> free_frame_queue;
+        std::condition_variable new_frame_ready_cv;
+        std::queue<video_frame *> frame_queue;
+
+        std::vector<video_frame *> free_frame_pool; ///< PBO frames for getf
+        std::condition_variable free_frame_ready_cv;
+
+        std::vector<video_frame *> dispose_frame_pool; ///< frames to be recycled by the upload thread
 };
 
 static void * display_panogl_init(struct module *parent, const char *fmt, unsigned int flags) {
@@ -179,27 +192,86 @@ static void handle_keyboard_event(state_vr *s, SDL_Event *event){
         }
 }
 
-static void handle_user_event(state_vr *s, SDL_Event *event){
-        if(event->type == s->sdl_frame_event){
-                std::unique_lock<std::mutex> lk(s->lock);
-                s->buffered_frames_count -= 1;
+/**
+ * Uploads the incoming frames to the scene and notifies the render thread
+ * with sdl_frame_event (data1 is nullptr for poison, code is nonzero if the
+ * frame rate is over threshold_fps).
+ */
+static void upload_worker(state_vr *s){
+        PROFILE_FUNC;
+        s->window.make_worker_context_current();
+        std::unique_lock<std::mutex> lk(s->lock);
+        for(size_t i = 0; i < PBO_RING_SIZE; i++){
+                video_frame *buf = vf_alloc(1);
+                buf->callbacks.dispose_udata = new GlBuffer();
+                s->free_frame_pool.push_back(buf);
+        }
+        lk.unlock();
+        s->free_frame_ready_cv.notify_all();
+
+        bool running = true;
+        lk.lock();
+        while(running){
+                PROFILE_DETAIL("Wait for frame");
+                s->new_frame_ready_cv.wait(lk,
+                                [s]{
+                                return !s->frame_queue.empty() || !s->dispose_frame_pool.empty();
+                                });
+                if(!s->dispose_frame_pool.empty()){
+                        PROFILE_DETAIL("Process disposed frames");
+                        for(video_frame *f : s->dispose_frame_pool){
+                                if (video_desc_eq(video_desc_from_frame(f), s->current_desc)) {
+                                        recycle_pbo_frame(f);
+                                } else {
+                                        delete_pbo_frame(f);
+                                        f = allocate_pbo_frame(s->current_desc);
+                                }
+                                s->free_frame_pool.push_back(f);
+                        }
+                        s->dispose_frame_pool.clear();
+                        s->free_frame_ready_cv.notify_all();
+                }
+
+                if(s->frame_queue.empty()){
+                        continue;
+                }
+                video_frame *frame = s->frame_queue.front();
+                s->frame_queue.pop();
                 lk.unlock();
                 s->frame_consumed_cv.notify_one();
 
-                video_frame *frame = static_cast<video_frame *>(event->user.data1);
+                SDL_Event event;
+                event.type = s->sdl_frame_event;
+                event.user.data1 = frame;
+                if(frame){
+                        PROFILE_DETAIL("put_frame");
+                        s->scene.put_frame(frame, frame->callbacks.dispose_udata != nullptr);
+                        event.user.code = frame->fps >= s->threshold_fps;
+                } else {
+                        running = false;
+                }
+                SDL_PushEvent(&event);
 
+                lk.lock();
                 if(frame){
-                        s->scene.put_frame(frame);
+                        s->dispose_frame_pool.push_back(frame);
+                }
+        }
 
-                        lk.lock();
-                        s->free_frame_queue.push(frame);
-                        lk.unlock();
-                } else {
+        for(video_frame *f : s->free_frame_pool){
+                delete_pbo_frame(f);
+        }
+        s->free_frame_pool.clear();
+}
+
+static void handle_user_event(state_vr *s, SDL_Event *event){
+        if(event->type == s->sdl_frame_event){
+                if(!event->user.data1){
                         //poison
                         s->running = false;
                         return;
                 }
-                redraw(s, frame->fps >= s->threshold_fps, true);
+                redraw(s, event->user.code != 0, true);
         } else if(event->type == s->sdl_redraw_event){
                 if(s->redraw_needed){
                         draw(s);
@@ -214,6 +286,11 @@ static void handle_user_event(state_vr *s, SDL_Event *event){
 static void display_panogl_run(void *state) {
         state_vr *s = static_cast<state_vr *>(state);
 
+        //Make sure the worker context is initialized before starting the upload thread
+        s->window.make_worker_context_current();
+        s->window.make_render_context_current();
+        s->upload_thread = std::thread(upload_worker, s);
+
         draw(s);
 
         s->running = true;
@@ -251,6 +328,8 @@ static void display_panogl_run(void *state) {
                                 break;
                 }
         }
+
+        s->upload_thread.join();
 }
 
 static void display_panogl_done(void *state) {
@@ -262,45 +341,45 @@ static void display_panogl_done(void *state) {
 static struct video_frame * display_panogl_getf(void *state) {
         struct state_vr *s = static_cast<state_vr *>(state);
 
-        std::lock_guard<std::mutex> lock(s->lock);
+        std::unique_lock<std::mutex> lock(s->lock);
 
-        while (s->free_frame_queue.size() > 0) {
-                struct video_frame *buffer = s->free_frame_queue.front();
-                s->free_frame_queue.pop();
+        while (true) {
+                s->free_frame_ready_cv.wait(lock, [s]{return s->free_frame_pool.size() > 0;});
+                struct video_frame *buffer = s->free_frame_pool.back();
+                s->free_frame_pool.pop_back();
                 if (video_desc_eq(video_desc_from_frame(buffer), s->current_desc)) {
                         return buffer;
                 } else {
-                        vf_free(buffer);
+                        s->dispose_frame_pool.push_back(buffer);
+                        s->new_frame_ready_cv.notify_one();
                 }
         }
-
-        return vf_alloc_desc_data(s->current_desc);
 }
 
 static int display_panogl_putf(void *state, struct video_frame *frame, long long nonblock) {
         PROFILE_FUNC;
         struct state_vr *s = static_cast<state_vr *>(state);
 
-        if (nonblock == PUTF_DISCARD) {
-                vf_free(frame);
+        std::unique_lock<std::mutex> lk(s->lock);
+        if (frame != NULL && nonblock == PUTF_DISCARD) {
+                s->dispose_frame_pool.push_back(frame);
+                lk.unlock();
+                s->new_frame_ready_cv.notify_one();
                 return 0;
         }
-
-        std::unique_lock<std::mutex> lk(s->lock);
-        if (s->buffered_frames_count >= MAX_BUFFER_SIZE && nonblock != PUTF_BLOCKING
+        if (s->frame_queue.size() >= MAX_BUFFER_SIZE && nonblock != PUTF_BLOCKING
                         && frame != NULL) {
-                vf_free(frame);
+                s->dispose_frame_pool.push_back(frame);
+                lk.unlock();
+                s->new_frame_ready_cv.notify_one();
                 printf("1 frame(s) dropped!\n");
                 return 1;
         }
-        s->frame_consumed_cv.wait(lk, [s]{return s->buffered_frames_count < MAX_BUFFER_SIZE;});
-        s->buffered_frames_count += 1;
+        s->frame_consumed_cv.wait(lk, [s]{return s->frame_queue.size() < MAX_BUFFER_SIZE;});
+        s->frame_queue.push(frame);
         lk.unlock();
-        SDL_Event event;
-        event.type = s->sdl_frame_event;
-        event.user.data1 = frame;
-        PROFILE_DETAIL("push frame event");
-        SDL_PushEvent(&event);
+        PROFILE_DETAIL("notify upload thread");
+        s->new_frame_ready_cv.notify_one();
 
         return 0;
 }
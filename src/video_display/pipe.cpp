@@ -3,7 +3,7 @@
  * @author Martin Pulec     <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2014-2023 CESNET, z. s. p. o.
+ * Copyright (c) 2014-2026 CESNET, z. s. p. o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -41,12 +41,16 @@
 
 #include <iostream>
 #include <list>
+#include <memory>
 #include <mutex>
+#include <stdexcept>
+#include <string>
 
 #include "audio/types.h"
 #include "audio/utils.h"
 #include "debug.h"
 #include "lib_common.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_display.h"
 #include "video_display/pipe.hpp"
@@ -55,23 +59,37 @@ using std::cout;
 using std::list;
 using std::mutex;
 using std::lock_guard;
+using std::shared_ptr;
 
 struct state_pipe {
         struct module *parent;
         frame_recv_delegate *delegate;
         codec_t decode_to;
+        enum mem_location_t mem_location;
         struct video_desc desc{};
         list<struct audio_frame *> audio_frames{};
         mutex audio_lock{};
+        /// frames are recycled, the pool is held also by every frame given out
+        /// so that it outlives the display if the frame is still in use
+        shared_ptr<video_frame_pool> pool;
+};
+
+/**
+ * Reference passed along with the frame. Frame returns to the pool
+ * (declared later so destroyed first) before the pool reference is dropped.
+ */
+struct pipe_frame_ref {
+        shared_ptr<video_frame_pool> pool;
+        shared_ptr<video_frame> frame;
 };
 
 static struct display *display_pipe_fork(void *state)
 {
         struct state_pipe *s = (struct state_pipe *) state;
-        char fmt[2 + sizeof(void *) * 2 + 1] = "";
+        char fmt[2 + sizeof(void *) * 2 + sizeof ":gpu"] = "";
         struct display *out;
 
-        snprintf(fmt, sizeof fmt, "%p", s->delegate);
+        snprintf(fmt, sizeof fmt, "%p%s", s->delegate, s->mem_location == CUDA_MEM ? ":gpu" : "");
         int rc = initialize_video_display(s->parent,
                 "pipe", fmt, 0, NULL, &out);
         if (rc == 0) return out; else return NULL;
@@ -79,7 +97,8 @@ static struct display *display_pipe_fork(void *state)
 
 static void display_pipe_usage() {
         cout << "Usage:\n"
-                "\t-d pipe:<ptr>[:codec=<c>]\n";
+                "\t-d pipe:<ptr>[:codec=<c>][:gpu]\n"
+                "\t\tgpu - allocate frames in CUDA device memory (decompressor must support it)\n";
 }
 
 /**
@@ -90,6 +109,7 @@ static void *display_pipe_init(struct module *parent, const char *fmt, unsigned
 {
         UNUSED(flags);
         codec_t decode_to = UYVY;
+        enum mem_location_t mem_location = CPU_MEM;
         frame_recv_delegate *delegate;
 
         if (!fmt || strlen(fmt) == 0 || strcmp(fmt, "help") == 0) {
@@ -101,22 +121,31 @@ static void *display_pipe_init(struct module *parent, const char *fmt, unsigned
         }
 
         sscanf(fmt, "%p", &delegate);
-        if (strchr(fmt, ':') != nullptr) {
+        while (strchr(fmt, ':') != nullptr) {
                 fmt = strchr(fmt, ':') + 1;
                 if (strstr(fmt, "codec=") == fmt) {
-                        const char *codec_name = fmt + strlen("codec=");
-                        decode_to = get_codec_from_name(codec_name);
+                        std::string codec_name(fmt + strlen("codec="), strcspn(fmt + strlen("codec="), ":"));
+                        decode_to = get_codec_from_name(codec_name.c_str());
                         if (decode_to == VIDEO_CODEC_NONE) {
                                 LOG(LOG_LEVEL_ERROR) << "Wrong codec name: " << codec_name << "\n";
                                 return nullptr;
                         }
+                } else if (strncmp(fmt, "gpu", strcspn(fmt, ":")) == 0 && strcspn(fmt, ":") == strlen("gpu")) {
+#ifdef HAVE_CUDA
+                        mem_location = CUDA_MEM;
+#else
+                        LOG(LOG_LEVEL_ERROR) << "[pipe] CUDA support is not enabled!\n";
+                        return nullptr;
+#endif
                 } else {
                         display_pipe_usage();
                         return nullptr;
                 }
         }
 
-        auto *s = new state_pipe{parent, delegate, decode_to};
+        auto pool = mem_location == CUDA_MEM ? std::make_shared<video_frame_pool>(0, cuda_data_allocator())
+                : std::make_shared<video_frame_pool>();
+        auto *s = new state_pipe{parent, delegate, decode_to, mem_location, {}, {}, {}, std::move(pool)};
 
         return s;
 }
@@ -132,14 +161,29 @@ static void display_pipe_done(void *state)
         delete s;
 }
 
+static void display_pipe_dispose_frame(struct video_frame *f)
+{
+        delete static_cast<struct pipe_frame_ref *>(f->callbacks.dispose_udata);
+}
+
 static struct video_frame *display_pipe_getf(void *state)
 {
         struct state_pipe *s = (struct state_pipe *)state;
 
-        struct video_frame *out = vf_alloc_desc_data(s->desc);
+        struct pipe_frame_ref *ref = nullptr;
+        try {
+                ref = new pipe_frame_ref{s->pool, s->pool->get_frame()};
+        } catch (std::exception &e) {
+                LOG(LOG_LEVEL_ERROR) << "[pipe] Cannot allocate frame: " << e.what() << "\n";
+                return nullptr;
+        }
+        struct video_frame *out = ref->frame.get();
+        out->mem_location = s->mem_location;
         // explicit dispose is needed because we do not process the frame
-        // by ourselves but it is passed to further processing
-        out->callbacks.dispose = vf_free;
+        // by ourselves but it is passed to further processing - the frame
+        // is returned to the pool when disposed by the final consumer
+        out->callbacks.dispose = display_pipe_dispose_frame;
+        out->callbacks.dispose_udata = ref;
         return out;
 }
 
@@ -196,7 +240,7 @@ static int display_pipe_putf(void *state, struct video_frame *frame, long long f
         struct audio_frame *af = display_pipe_get_audio(s);
         s->delegate->frame_arrived(frame, af);
 
-        return TRUE;
+        return 0;
 }
 
 static int display_pipe_get_property(void *state, int property, void *val, size_t *len)
@@ -242,6 +286,13 @@ static int display_pipe_get_property(void *state, int property, void *val, size_
                         ((struct multi_sources_supp_info *) val)->state = state;
                         *len = sizeof(struct multi_sources_supp_info);
                         break;
+                case DISPLAY_PROPERTY_MEM_LOCATION:
+                        if (sizeof s->mem_location > *len) {
+                                return FALSE;
+                        }
+                        memcpy(val, &s->mem_location, sizeof s->mem_location);
+                        *len = sizeof s->mem_location;
+                        break;
                 case DISPLAY_PROPERTY_AUDIO_FORMAT:
                         {
                                 assert (*len >= sizeof(struct audio_desc));
@@ -260,6 +311,7 @@ static int display_pipe_reconfigure(void *state, struct video_desc desc)
         struct state_pipe *s = (struct state_pipe *) state;
 
         s->desc = desc;
+        s->pool->reconfigure(desc);
 
         return 1;
 }
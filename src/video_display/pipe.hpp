@@ -3,7 +3,7 @@
  * @author Martin Pulec     <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2020 CESNET, z. s. p. o.
+ * Copyright (c) 2020-2026 CESNET, z. s. p. o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -46,6 +46,10 @@ class frame_recv_delegate {
                 /**
                  * Implementing method must release both audio and video frame received
                  * as parameters with AUDIO_FRAME_DISPOSE() and VIDEO_FRAME_DISPOSE().
+                 *
+                 * The video frame is pooled and its ownership may be passed further
+                 * (eg. returned from vidcap grab) but its dispose callback must be
+                 * kept unchanged - it returns the frame to the pool.
                  */
                 virtual void frame_arrived(struct video_frame *, struct audio_frame *) = 0;
 };
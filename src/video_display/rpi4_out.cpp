@@ -45,6 +45,7 @@
 #include "video_codec.h"
 #include "video_display.h"
 #include "hwaccel_rpi4.h"
+#include "utils/macros.h"
 #include "utils/string_view_utils.hpp"
 #include "utils/color_out.h"
 
@@ -57,21 +58,40 @@
 #include <type_traits>
 #include <thread>
 #include <chrono>
+#include <cerrno>
 #include <charconv>
+#include <cstring>
+#include <string>
 
+#ifdef HWACC_RPI4_MMAL
 #include <bcm_host.h>
 #include <interface/mmal/mmal.h>
 #include <interface/mmal/mmal_component.h>
 #include <interface/mmal/util/mmal_default_components.h>
 #include <interface/mmal/util/mmal_util_params.h>
+#endif
+
+#ifdef HWACC_RPI4_DRM
+#include <drm_fourcc.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#endif
 
 extern "C" { //needed for rpi_zc.h and rpi_sand_fns.h
 #include <libavcodec/avcodec.h> //needed for rpi_zc.h
+#ifdef HWACC_RPI4_MMAL
 #include <libavcodec/rpi_zc.h>
 #include <libavutil/rpi_sand_fns.h>
+#endif
+#ifdef HWACC_RPI4_DRM
+#include <libavutil/hwcontext_drm.h>
+#endif
 }
 
 #define MAX_BUFFER_SIZE 4
+#define MOD_NAME "[RPi display] "
 
 namespace{
 
@@ -81,6 +101,18 @@ struct frame_deleter{
 
 using unique_frame = std::unique_ptr<struct video_frame, frame_deleter>;
 
+/**
+ * Output backend, display() is called from the display thread only.
+ */
+class Video_out{
+public:
+        virtual ~Video_out() = default;
+
+        virtual void display(AVFrame *f) = 0;
+        virtual void resize(int width, int height) = 0;
+};
+
+#ifdef HWACC_RPI4_MMAL
 struct mmal_component_deleter{
         void operator()(MMAL_COMPONENT_T *c){ mmal_component_destroy(c); }
 };
@@ -111,14 +143,13 @@ struct mmal_buf_header_deleter{
 
 using mmal_buf_header_unique = std::unique_ptr<MMAL_BUFFER_HEADER_T, mmal_buf_header_deleter>;
 
-class Rpi4_video_out{
+class Rpi4_video_out final : public Video_out{
 public:
-        Rpi4_video_out() = default;
         Rpi4_video_out(int x, int y, int width, int height, bool fs, int layer);
 
-        void display(AVFrame *f);
+        void display(AVFrame *f) override;
 
-        void resize(int width, int height);
+        void resize(int width, int height) override;
         void move(){
                 const int max_x = 1920 - out_width;
                 const int max_y = 1080 - out_height;
@@ -343,11 +374,269 @@ void Rpi4_video_out::display(AVFrame *f){
         zc_frame.release();
         buf.release();
 }
+#endif // defined HWACC_RPI4_MMAL
+
+#ifdef HWACC_RPI4_DRM
+/**
+ * Scans DRM-PRIME frames out on a KMS plane of an already active CRTC (the
+ * mode is kept as set by the console or compositor). The decoder DMA-BUFs
+ * are imported as framebuffers without a copy, the frame is referenced until
+ * it is replaced on the screen.
+ */
+class Drm_video_out final : public Video_out{
+public:
+        Drm_video_out(int x, int y, int width, int height, bool fs);
+        ~Drm_video_out() override;
+
+        void display(AVFrame *f) override;
+        void resize(int width, int height) override{
+                out_width = width;
+                out_height = height;
+        }
+private:
+        struct scanout_buf{
+                uint32_t fb_id = 0;
+                uint32_t handles[AV_DRM_MAX_PLANES] = {};
+                AVFrame *frame = nullptr;
+        };
+
+        bool find_crtc();
+        bool find_plane(uint32_t fourcc);
+        void release(scanout_buf &buf);
+
+        int fd = -1;
+        uint32_t crtc_id = 0;
+        int crtc_idx = -1;
+        int screen_w = 0;
+        int screen_h = 0;
+        uint32_t plane_id = 0;
+        uint32_t plane_fourcc = 0;
+
+        int out_pos_x;
+        int out_pos_y;
+        int out_width;
+        int out_height;
+        bool fullscreen;
+
+        scanout_buf shown;
+};
+
+Drm_video_out::Drm_video_out(int x, int y, int width, int height, bool fs):
+        out_pos_x(x),
+        out_pos_y(y),
+        out_width(width),
+        out_height(height),
+        fullscreen(fs)
+{
+        for(int i = 0; i < 4; i++){
+                std::string path = "/dev/dri/card" + std::to_string(i);
+                fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+                if(fd < 0)
+                        continue;
+                if(find_crtc()){
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using %s, CRTC %u (%dx%d)\n",
+                                        path.c_str(), crtc_id, screen_w, screen_h);
+                        break;
+                }
+                close(fd);
+                fd = -1;
+        }
+        if(fd < 0){
+                throw std::runtime_error("No DRM device with an active CRTC found");
+        }
+
+        drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+}
+
+Drm_video_out::~Drm_video_out(){
+        if(plane_id){
+                drmModeSetPlane(fd, plane_id, crtc_id, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        }
+        release(shown);
+        close(fd);
+}
+
+bool Drm_video_out::find_crtc(){
+        drmModeRes *res = drmModeGetResources(fd);
+        if(!res)
+                return false;
+
+        for(int i = 0; i < res->count_crtcs && crtc_id == 0; i++){
+                drmModeCrtc *crtc = drmModeGetCrtc(fd, res->crtcs[i]);
+                if(!crtc)
+                        continue;
+                if(crtc->mode_valid && crtc->buffer_id != 0){
+                        crtc_id = crtc->crtc_id;
+                        crtc_idx = i;
+                        screen_w = crtc->mode.hdisplay;
+                        screen_h = crtc->mode.vdisplay;
+                }
+                drmModeFreeCrtc(crtc);
+        }
+        drmModeFreeResources(res);
+
+        return crtc_id != 0;
+}
+
+/**
+ * Finds a plane of our CRTC not used by anyone else (the primary plane holds
+ * the console) that supports given format.
+ */
+bool Drm_video_out::find_plane(uint32_t fourcc){
+        if(plane_id != 0 && plane_fourcc == fourcc)
+                return true;
+
+        if(plane_id != 0){
+                drmModeSetPlane(fd, plane_id, crtc_id, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+                release(shown);
+                plane_id = 0;
+        }
+
+        drmModePlaneRes *res = drmModeGetPlaneResources(fd);
+        if(!res)
+                return false;
+
+        for(uint32_t i = 0; i < res->count_planes && plane_id == 0; i++){
+                drmModePlane *plane = drmModeGetPlane(fd, res->planes[i]);
+                if(!plane)
+                        continue;
+                if((plane->possible_crtcs & (1U << crtc_idx)) && plane->fb_id == 0){
+                        for(uint32_t j = 0; j < plane->count_formats; j++){
+                                if(plane->formats[j] == fourcc){
+                                        plane_id = plane->plane_id;
+                                        break;
+                                }
+                        }
+                }
+                drmModeFreePlane(plane);
+        }
+        drmModeFreePlaneResources(res);
+
+        plane_fourcc = fourcc;
+        return plane_id != 0;
+}
+
+void Drm_video_out::release(scanout_buf &buf){
+        if(buf.fb_id)
+                drmModeRmFB(fd, buf.fb_id);
+        buf.fb_id = 0;
+
+        for(int i = 0; i < AV_DRM_MAX_PLANES; i++){
+                bool dup = false; // objects may share GEM handle
+                for(int j = 0; j < i; j++)
+                        dup = dup || buf.handles[j] == buf.handles[i];
+                if(buf.handles[i] != 0 && !dup){
+                        struct drm_gem_close req = {};
+                        req.handle = buf.handles[i];
+                        drmIoctl(fd, DRM_IOCTL_GEM_CLOSE, &req);
+                }
+        }
+        for(auto &h : buf.handles)
+                h = 0;
+
+        av_frame_free(&buf.frame);
+}
+
+void Drm_video_out::display(AVFrame *f){
+        if(f->format != AV_PIX_FMT_DRM_PRIME){
+                log_msg_once(LOG_LEVEL_ERROR, to_fourcc('R', 'P', 'D', 'F'), MOD_NAME
+                                "DRM output needs DRM-PRIME frames, got %s!\n",
+                                av_get_pix_fmt_name(static_cast<AVPixelFormat>(f->format)));
+                return;
+        }
+
+        const auto *desc = reinterpret_cast<const AVDRMFrameDescriptor *>(f->data[0]);
+        if(desc->nb_layers < 1)
+                return;
+        const AVDRMLayerDescriptor *layer = &desc->layers[0];
+
+        if(!find_plane(layer->format)){
+                log_msg_once(LOG_LEVEL_ERROR, to_fourcc('R', 'P', 'D', 'P'), MOD_NAME
+                                "No free plane supports format %.4s!\n",
+                                reinterpret_cast<const char *>(&layer->format));
+                return;
+        }
+
+        scanout_buf next;
+        for(int i = 0; i < desc->nb_objects; i++){
+                if(drmPrimeFDToHandle(fd, desc->objects[i].fd, &next.handles[i]) != 0){
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot import DMA-BUF: %s\n", strerror(errno));
+                        release(next);
+                        return;
+                }
+        }
+
+        uint32_t handles[4] = {};
+        uint32_t pitches[4] = {};
+        uint32_t offsets[4] = {};
+        uint64_t modifiers[4] = {};
+        bool use_modifiers = false;
+        for(int i = 0; i < layer->nb_planes && i < 4; i++){
+                const AVDRMPlaneDescriptor *plane = &layer->planes[i];
+                handles[i] = next.handles[plane->object_index];
+                pitches[i] = plane->pitch;
+                offsets[i] = plane->offset;
+                modifiers[i] = desc->objects[plane->object_index].format_modifier;
+                use_modifiers = use_modifiers || modifiers[i] != DRM_FORMAT_MOD_INVALID;
+        }
+
+        if(drmModeAddFB2WithModifiers(fd, f->width, f->height, layer->format,
+                                handles, pitches, offsets,
+                                use_modifiers ? modifiers : nullptr, &next.fb_id,
+                                use_modifiers ? DRM_MODE_FB_MODIFIERS : 0) != 0)
+        {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot add framebuffer: %s\n", strerror(errno));
+                release(next);
+                return;
+        }
+
+        const int crop_w = f->width - f->crop_left - f->crop_right;
+        const int crop_h = f->height - f->crop_top - f->crop_bottom;
+        int dst_x = out_pos_x;
+        int dst_y = out_pos_y;
+        int dst_w = out_width;
+        int dst_h = out_height;
+        if(fullscreen){ // letterbox to the current mode
+                dst_w = screen_w;
+                dst_h = crop_h * screen_w / crop_w;
+                if(dst_h > screen_h){
+                        dst_h = screen_h;
+                        dst_w = crop_w * screen_h / crop_h;
+                }
+                dst_x = (screen_w - dst_w) / 2;
+                dst_y = (screen_h - dst_h) / 2;
+        }
+
+        // legacy SetPlane commit is blocking - when it returns, the
+        // previous framebuffer is no longer being scanned out
+        if(drmModeSetPlane(fd, plane_id, crtc_id, next.fb_id, 0,
+                                dst_x, dst_y, dst_w, dst_h,
+                                static_cast<uint32_t>(f->crop_left) << 16,
+                                static_cast<uint32_t>(f->crop_top) << 16,
+                                static_cast<uint32_t>(crop_w) << 16,
+                                static_cast<uint32_t>(crop_h) << 16) != 0)
+        {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot set plane: %s\n", strerror(errno));
+                release(next);
+                return;
+        }
+
+        next.frame = av_frame_clone(f);
+        release(shown);
+        shown = next;
+}
+#endif // defined HWACC_RPI4_DRM
 
 } //anonymous namespace
 
 static void display_rpi4_run(void *state);
 
+enum class rpi4_backend{
+        automatic, ///< DRM for DRM-PRIME frames, MMAL otherwise
+        mmal,
+        drm,
+};
+
 struct rpi4_display_state{
         struct video_desc current_desc;
 
@@ -366,15 +655,45 @@ struct rpi4_display_state{
         int force_w = 0;
         int force_h = 0;
         bool fullscreen = false;
+        rpi4_backend backend = rpi4_backend::automatic;
+
+        int out_w = 640; ///< protected by frame_queue_mut
+        int out_h = 480;
 
-        Rpi4_video_out video_out;
+        std::unique_ptr<Video_out> video_out; ///< used by the display thread only
+        int video_out_format = AV_PIX_FMT_NONE; ///< frame format video_out was created for
 };
 
+static std::unique_ptr<Video_out> create_video_out(rpi4_display_state *s, int av_format){
+        rpi4_backend backend = s->backend;
+        if(backend == rpi4_backend::automatic){
+                backend = av_format == AV_PIX_FMT_DRM_PRIME ? rpi4_backend::drm : rpi4_backend::mmal;
+        }
+
+        switch(backend){
+#ifdef HWACC_RPI4_MMAL
+        case rpi4_backend::mmal:
+                return std::make_unique<Rpi4_video_out>(s->requested_pos_x, s->requested_pos_y,
+                                s->out_w, s->out_h, s->fullscreen, 2);
+#endif
+#ifdef HWACC_RPI4_DRM
+        case rpi4_backend::drm:
+                return std::make_unique<Drm_video_out>(s->requested_pos_x, s->requested_pos_y,
+                                s->out_w, s->out_h, s->fullscreen);
+#endif
+        default:
+                throw std::runtime_error(backend == rpi4_backend::drm ?
+                                "DRM output not compiled in" : "MMAL output not compiled in");
+        }
+}
+
 static void print_rpi4_out_help(){
         col() << "usage:\n";
-        col() << TBOLD(TRED("\t-d rpi4") << "[:force-size=<w>x<h>|:position=<x>x<y>|:fs]* | help\n\n");
+        col() << TBOLD(TRED("\t-d rpi4") << "[:force-size=<w>x<h>|:position=<x>x<y>|:fs|:drm|:mmal]* | help\n\n");
         col() << "options:\n";
         col() << TBOLD("\tfs")          << "\t\tfullscreen\n";
+        col() << TBOLD("\tdrm")         << "\t\tscan out DRM-PRIME frames on a KMS plane (default for DRM-PRIME frames)\n";
+        col() << TBOLD("\tmmal")        << "\t\tuse the (deprecated) MMAL renderer\n";
         col() << TBOLD("\tforce-size")  << "\t\tspecifies desired size of output\n";
         col() << TBOLD("\tposition")    << "\t\tspecifies the desired position of output (coordinates of top left corner)\n";
 }
@@ -408,6 +727,10 @@ static void *display_rpi4_init(struct module *parent, const char *cfg, unsigned
                         }
                 } else if(key == "fs"){
                         s->fullscreen = true;
+                } else if(key == "drm"){
+                        s->backend = rpi4_backend::drm;
+                } else if(key == "mmal"){
+                        s->backend = rpi4_backend::mmal;
                 } else if(key == "position"){
                         auto val = tokenize(token, '=');
 
@@ -425,12 +748,19 @@ static void *display_rpi4_init(struct module *parent, const char *cfg, unsigned
                 }
         }
 
-        int width = s->force_w ? s->force_w : 640;
-        int height = s->force_h ? s->force_h : 480;
+        if(s->force_w && s->force_h){
+                s->out_w = s->force_w;
+                s->out_h = s->force_h;
+        }
 
-        s->video_out = Rpi4_video_out(s->requested_pos_x, s->requested_pos_y,
-                        width, height,
-                        s->fullscreen, 2);
+        if(s->backend != rpi4_backend::automatic){
+                try{
+                        s->video_out = create_video_out(s.get(), AV_PIX_FMT_NONE);
+                } catch(std::exception &e){
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "%s\n", e.what());
+                        return nullptr;
+                }
+        }
 
         s->thread_id = std::thread(display_rpi4_run, s.get());
         return s.release();
@@ -556,6 +886,8 @@ static void display_rpi4_run(void *state)
 
                 unique_frame frame = std::move(s->frame_queue.front());
                 s->frame_queue.pop();
+                const int out_w = s->out_w;
+                const int out_h = s->out_h;
                 lk.unlock();
                 s->frame_consumed_cv.notify_one();
 
@@ -567,7 +899,20 @@ static void display_rpi4_run(void *state)
                 auto av_wrap = reinterpret_cast<struct av_frame_wrapper *>(
                                 reinterpret_cast<void *>(frame->tiles[0].data));
 
-                s->video_out.display(av_wrap->av_frame);
+                const int av_format = av_wrap->av_frame->format;
+                try{
+                        if(!s->video_out || (s->backend == rpi4_backend::automatic
+                                                && av_format != s->video_out_format))
+                        {
+                                s->video_out.reset();
+                                s->video_out = create_video_out(s, av_format);
+                                s->video_out_format = av_format;
+                        }
+                        s->video_out->resize(out_w, out_h);
+                        s->video_out->display(av_wrap->av_frame);
+                } catch(std::exception &e){
+                        log_msg_once(LOG_LEVEL_ERROR, to_fourcc('R', 'P', 'D', 'E'), MOD_NAME "%s\n", e.what());
+                }
 
                 vf_recycle(frame.get());
                 std::lock_guard(s->free_frames_mut);
@@ -582,8 +927,11 @@ static int display_rpi4_reconfigure(void *state, struct video_desc desc)
         assert(desc.color_spec == RPI4_8);
         s->current_desc = desc;
 
-        if(s->force_w == 0 && s->force_h == 0)
-                s->video_out.resize(desc.width, desc.height);
+        if(s->force_w == 0 && s->force_h == 0){
+                std::lock_guard lk(s->frame_queue_mut);
+                s->out_w = desc.width;
+                s->out_h = desc.height;
+        }
 
         return TRUE;
 }
@@ -658,7 +1006,7 @@ static const struct video_display_info display_rpi4_info = {
         display_rpi4_get_property,
         display_rpi4_put_audio_frame,
         display_rpi4_reconfigure_audio,
-        "[RPi display] ",
+        MOD_NAME,
 };
 
 REGISTER_MODULE(rpi4, &display_rpi4_info, LIBRARY_CLASS_VIDEO_DISPLAY, VIDEO_DISPLAY_ABI_VERSION);
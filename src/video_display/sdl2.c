@@ -58,6 +58,7 @@
 #include "module.h"
 #include "utils/color_out.h"
 #include "utils/list.h"
+#include "utils/macros.h"
 #include "video_display.h"
 #include "video.h"
 
@@ -74,7 +75,7 @@
 
 #define SDL2_DEINTERLACE_IMPOSSIBLE_MSG_ID 0x327058e5
 #define MAGIC_SDL2   0x3cc234a1
-#define BUFFER_COUNT   2
+#define DEFAULT_BUFFER_COUNT 3 ///< render-ahead depth (including the displayed frame)
 #define MOD_NAME "[SDL] "
 
 struct state_sdl2;
@@ -93,6 +94,7 @@ struct state_sdl2 {
         struct module           mod;
 
         int                     texture_pitch;
+        int                     buffer_count;
 
         Uint32                  sdl_user_new_frame_event;
         Uint32                  sdl_user_new_message_event;
@@ -146,6 +148,14 @@ static const struct {
 
 #define SDL_CHECK(cmd) do { int ret = cmd; if (ret < 0) { log_msg(LOG_LEVEL_ERROR, MOD_NAME "Error (%s): %s\n", #cmd, SDL_GetError());} } while(0)
 
+static void release_frame(struct state_sdl2 *s, struct video_frame *frame)
+{
+        pthread_mutex_lock(&s->lock);
+        simple_linked_list_append(s->free_frame_queue, frame);
+        pthread_mutex_unlock(&s->lock);
+        pthread_cond_signal(&s->frame_consumed_cv);
+}
+
 static void display_frame(struct state_sdl2 *s, struct video_frame *frame)
 {
         if (!frame) {
@@ -153,12 +163,6 @@ static void display_frame(struct state_sdl2 *s, struct video_frame *frame)
         }
 
         SDL_Texture *texture = (SDL_Texture *) frame->callbacks.dispose_udata;
-        if (s->deinterlace == DEINT_FORCE || (s->deinterlace == DEINT_ON && frame->interlacing == INTERLACED_MERGED)) {
-                size_t pitch = vc_get_linesize(frame->tiles[0].width, frame->color_spec);
-                if (!vc_deinterlace_ex(frame->color_spec, (unsigned char *) frame->tiles[0].data, pitch, (unsigned char *) frame->tiles[0].data, pitch, frame->tiles[0].height)) {
-                         log_msg_once(LOG_LEVEL_ERROR, SDL2_DEINTERLACE_IMPOSSIBLE_MSG_ID, MOD_NAME "Cannot deinterlace, unsupported pixel format '%s'!\n", get_codec_name(frame->color_spec));
-                }
-        }
 
         SDL_RenderClear(s->renderer);
         SDL_UnlockTexture(texture);
@@ -173,13 +177,22 @@ static void display_frame(struct state_sdl2 *s, struct video_frame *frame)
                 return; // we are only redrawing on window resize
         }
 
-        pthread_mutex_lock(&s->lock);
-        simple_linked_list_append(s->free_frame_queue, frame);
-        pthread_mutex_unlock(&s->lock);
-        pthread_cond_signal(&s->frame_consumed_cv);
+        release_frame(s, frame);
         s->last_frame = frame;
 }
 
+/**
+ * If a newer frame is already waiting in the event queue, the ahead-rendered
+ * frame is not presented at all (it would only add latency when presenting
+ * is slower than decoding, eg. due to vsync).
+ */
+static bool newer_frame_pending(struct state_sdl2 *s)
+{
+        SDL_Event next;
+        return SDL_PeepEvents(&next, 1, SDL_PEEKEVENT, s->sdl_user_new_frame_event,
+                        s->sdl_user_new_frame_event) > 0 && next.user.data1 != NULL;
+}
+
 static int64_t translate_sdl_key_to_ug(SDL_Keysym sym) {
         sym.mod &= ~(KMOD_NUM | KMOD_CAPS); // remove num+caps lock modifiers
 
@@ -263,6 +276,11 @@ static void display_sdl2_run(void *arg)
                         if (sdl_event.user.data1 == NULL) { // poison pill received
                                 break;
                         }
+                        if (newer_frame_pending(s)) {
+                                release_frame(s, sdl_event.user.data1);
+                                log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Skipping frame, newer one already queued.\n");
+                                continue;
+                        }
                         display_frame(s, (struct video_frame *) sdl_event.user.data1);
                 } else if (sdl_event.type == s->sdl_user_new_message_event) {
                         struct msg_universal *msg;
@@ -336,7 +354,7 @@ static void show_help(void)
 {
         SDL_CHECK(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS));
         printf("SDL options:\n");
-        color_printf(TBOLD(TRED("\t-d sdl") "[[:fs|:d|:display=<didx>|:driver=<drv>|:novsync|:renderer=<ridx>|:nodecorate|:fixed_size[=WxH]|:window_flags=<f>|:pos=<x>,<y>|:keep-aspect]*|:help]") "\n");
+        color_printf(TBOLD(TRED("\t-d sdl") "[[:fs|:d|:display=<didx>|:driver=<drv>|:novsync|:renderer=<ridx>|:nodecorate|:fixed_size[=WxH]|:window_flags=<f>|:pos=<x>,<y>|:keep-aspect|:buffers=<n>]*|:help]") "\n");
         printf("\twhere:\n");
         color_printf(TBOLD("\t\td[force]") " - deinterlace (force even for progresive video)\n");
         color_printf(TBOLD("\t\t      fs") " - fullscreen\n");
@@ -352,6 +370,7 @@ static void show_help(void)
         color_printf(TBOLD("\t      nodecorate") " - disable window border\n");
         color_printf(TBOLD("\tfixed_size[=WxH]") " - use fixed sized window\n");
         color_printf(TBOLD("\t    window_flags") " - flags to be passed to SDL_CreateWindow (use prefix 0x for hex)\n");
+        color_printf(TBOLD("\t     buffers=<n>") " - number of streaming textures the decoder can render ahead into (default " TOSTRING(DEFAULT_BUFFER_COUNT) ")\n");
         color_printf(TBOLD("\t\t  <ridx>") " - renderer index: ");
         for (int i = 0; i < SDL_GetNumRenderDrivers(); ++i) {
                 SDL_RendererInfo renderer_info;
@@ -453,7 +472,7 @@ static void vf_sdl_texture_data_deleter(struct video_frame *buf) {
 static bool recreate_textures(struct state_sdl2 *s, struct video_desc desc) {
         cleanup_frames(s);
 
-        for (int i = 0; i < BUFFER_COUNT; ++i) {
+        for (int i = 0; i < s->buffer_count; ++i) {
                 SDL_Texture *texture = SDL_CreateTexture(s->renderer, get_ug_to_sdl_format(desc.color_spec), SDL_TEXTUREACCESS_STREAMING, desc.width, desc.height);
                 if (!texture) {
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to create texture: %s\n", SDL_GetError());
@@ -548,6 +567,7 @@ static void *display_sdl2_init(struct module *parent, const char *fmt, unsigned
         s->x = s->y = SDL_WINDOWPOS_UNDEFINED;
         s->renderer_idx = -1;
         s->vsync = true;
+        s->buffer_count = DEFAULT_BUFFER_COUNT;
 
         if (fmt == NULL) {
                 fmt = "";
@@ -603,6 +623,13 @@ static void *display_sdl2_init(struct module *parent, const char *fmt, unsigned
                         s->y = atoi(strchr(tok, ',') + 1);
                 } else if (strncmp(tok, "renderer=", strlen("renderer=")) == 0) {
                         s->renderer_idx = atoi(tok + strlen("renderer="));
+                } else if (strncmp(tok, "buffers=", strlen("buffers=")) == 0) {
+                        s->buffer_count = atoi(tok + strlen("buffers="));
+                        if (s->buffer_count < 2) {
+                                log_msg(LOG_LEVEL_ERROR, "[SDL] At least 2 buffers needed!\n");
+                                free(s);
+                                return NULL;
+                        }
                 } else {
                         log_msg(LOG_LEVEL_ERROR, "[SDL] Wrong option: %s\n", tok);
                         free(s);
@@ -741,6 +768,15 @@ static int display_sdl2_putf(void *state, struct video_frame *frame, long long t
                 return 1;
         }
         pthread_mutex_unlock(&s->lock);
+
+        // done here so that the display thread only presents
+        if (frame != NULL && (s->deinterlace == DEINT_FORCE || (s->deinterlace == DEINT_ON && frame->interlacing == INTERLACED_MERGED))) {
+                size_t pitch = vc_get_linesize(frame->tiles[0].width, frame->color_spec);
+                if (!vc_deinterlace_ex(frame->color_spec, (unsigned char *) frame->tiles[0].data, pitch, (unsigned char *) frame->tiles[0].data, pitch, frame->tiles[0].height)) {
+                         log_msg_once(LOG_LEVEL_ERROR, SDL2_DEINTERLACE_IMPOSSIBLE_MSG_ID, MOD_NAME "Cannot deinterlace, unsupported pixel format '%s'!\n", get_codec_name(frame->color_spec));
+                }
+        }
+
         SDL_Event event;
         event.type = s->sdl_user_new_frame_event;
         event.user.data1 = frame;
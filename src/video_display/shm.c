@@ -0,0 +1,238 @@
+/**
+ * @file   video_display/shm.c
+ *
+ * Publishes the received frames to the shared-memory frame bus so that other
+ * UltraGrid processes on the same host can capture them with "-t shm"
+ * without copying.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "lib_common.h"
+#include "types.h"
+#include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
+#include "utils/shm_bus.h"
+#include "video.h"
+#include "video_codec.h"
+#include "video_display.h"
+#include "video_frame.h"
+
+#define DEFAULT_SLOTS 4
+#define MOD_NAME "[shm disp.] "
+
+static const codec_t codecs[] = {UYVY, YUYV, v210, R10k, R12L, RGBA, RGB, BGR, RG48, Y416, I420};
+
+struct state_shm_display {
+        char name[NAME_MAX];
+        int slot_count;
+        struct shm_bus *bus;
+        struct video_frame *slot_frames[SHM_BUS_MAX_SLOTS]; ///< frames pointing to the slot data
+        struct video_frame *fallback; ///< returned by getf if all slots are held by readers
+        unsigned long long dropped;
+};
+
+static void usage() {
+        color_printf("Display " TBOLD("shm") " publishes frames to a shared-memory segment to be captured "
+                        "by other UltraGrid processes on this host with " TBOLD("-t shm") " (zero-copy, "
+                        "any number of readers).\n\n");
+        struct key_val options[] = {
+                { "name=<name>", "name of the segment (default \"" SHM_BUS_DEFAULT_NAME "\")" },
+                { "slots=<n>", "number of frame slots (default " TOSTRING(DEFAULT_SLOTS) ", 2-" TOSTRING(SHM_BUS_MAX_SLOTS) "), "
+                        "should be at least number of readers + 2" },
+                { NULL, NULL }
+        };
+        print_module_usage("-d shm", options, NULL, 0);
+}
+
+static void *display_shm_init(struct module *parent, const char *cfg, unsigned int flags)
+{
+        UNUSED(parent), UNUSED(flags);
+        if (strcmp(cfg, "help") == 0) {
+                usage();
+                return INIT_NOERR;
+        }
+        struct state_shm_display *s = calloc(1, sizeof *s);
+        snprintf(s->name, sizeof s->name, "%s", SHM_BUS_DEFAULT_NAME);
+        s->slot_count = DEFAULT_SLOTS;
+
+        char *ccpy = strdup(cfg);
+        char *tmp = ccpy;
+        char *item = NULL;
+        char *save_ptr = NULL;
+        while ((item = strtok_r(tmp, ":", &save_ptr)) != NULL) {
+                tmp = NULL;
+                if (strstr(item, "name=") == item) {
+                        snprintf(s->name, sizeof s->name, "%s", strchr(item, '=') + 1);
+                } else if (strstr(item, "slots=") == item) {
+                        s->slot_count = atoi(strchr(item, '=') + 1);
+                        if (s->slot_count < 2 || s->slot_count > SHM_BUS_MAX_SLOTS) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong slot count: %s\n", item);
+                                free(ccpy);
+                                free(s);
+                                return NULL;
+                        }
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unrecognized option: %s\n", item);
+                        free(ccpy);
+                        free(s);
+                        return NULL;
+                }
+        }
+        free(ccpy);
+        return s;
+}
+
+static void free_frames(struct state_shm_display *s) {
+        for (int i = 0; i < SHM_BUS_MAX_SLOTS; ++i) {
+                vf_free(s->slot_frames[i]);
+                s->slot_frames[i] = NULL;
+        }
+        vf_free(s->fallback);
+        s->fallback = NULL;
+}
+
+static void display_shm_done(void *state)
+{
+        struct state_shm_display *s = state;
+        if (s->dropped > 0) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "%llu frames dropped (all slots held by readers).\n", s->dropped);
+        }
+        free_frames(s);
+        shm_bus_destroy(s->bus);
+        free(s);
+}
+
+static struct video_frame *display_shm_getf(void *state)
+{
+        struct state_shm_display *s = state;
+        int slot = shm_bus_acquire_write(s->bus);
+        return slot >= 0 ? s->slot_frames[slot] : s->fallback;
+}
+
+static int display_shm_putf(void *state, struct video_frame *frame, long long flags)
+{
+        struct state_shm_display *s = state;
+        if (frame == NULL) {
+                return 0;
+        }
+        int slot = -1;
+        for (int i = 0; i < s->slot_count; ++i) {
+                if (frame == s->slot_frames[i]) {
+                        slot = i;
+                }
+        }
+        if (flags == PUTF_DISCARD) {
+                if (slot >= 0) {
+                        shm_bus_abort_write(s->bus, slot);
+                }
+                return 0;
+        }
+        if (slot < 0 && (slot = shm_bus_acquire_write(s->bus)) < 0) { // fallback frame, copied to a slot
+                s->dropped += 1;
+                return 1;
+        }
+        shm_bus_publish(s->bus, slot, frame);
+        return 0;
+}
+
+static int display_shm_get_property(void *state, int property, void *val, size_t *len)
+{
+        UNUSED(state);
+        switch (property) {
+                case DISPLAY_PROPERTY_CODECS:
+                        if (sizeof codecs > *len) {
+                                return FALSE;
+                        }
+                        *len = sizeof codecs;
+                        memcpy(val, codecs, *len);
+                        break;
+                default:
+                        return FALSE;
+        }
+        return TRUE;
+}
+
+static int display_shm_reconfigure(void *state, struct video_desc desc)
+{
+        struct state_shm_display *s = state;
+        free_frames(s);
+        if (s->bus == NULL || !shm_bus_fits(s->bus, desc)) {
+                // readers reopen the segment by name after being notified
+                shm_bus_destroy(s->bus);
+                s->bus = shm_bus_create(s->name, s->slot_count, desc);
+                if (s->bus == NULL) {
+                        return FALSE;
+                }
+        }
+        for (int i = 0; i < s->slot_count; ++i) {
+                s->slot_frames[i] = vf_alloc_desc(desc);
+                for (unsigned t = 0; t < desc.tile_count; ++t) {
+                        s->slot_frames[i]->tiles[t].data = shm_bus_tile_data(s->bus, i, t);
+                }
+        }
+        s->fallback = vf_alloc_desc_data(desc);
+        return TRUE;
+}
+
+static void display_shm_probe(struct device_info **available_cards, int *count, void (**deleter)(void *)) {
+        UNUSED(deleter);
+        *available_cards = NULL;
+        *count = 0;
+}
+
+static const struct video_display_info display_shm_info = {
+        display_shm_probe,
+        display_shm_init,
+        NULL, // _run
+        display_shm_done,
+        display_shm_getf,
+        display_shm_putf,
+        display_shm_reconfigure,
+        display_shm_get_property,
+        NULL, // _put_audio_frame
+        NULL, // _reconfigure_audio
+        MOD_NAME,
+};
+
+REGISTER_MODULE(shm, &display_shm_info, LIBRARY_CLASS_VIDEO_DISPLAY, VIDEO_DISPLAY_ABI_VERSION);
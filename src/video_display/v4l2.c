@@ -50,7 +50,8 @@
 #include "config_unix.h"
 #include "config_win32.h"
 
-#define BUFFERS 2
+#define DEFAULT_BUF_COUNT 4
+#define MAX_BUF_COUNT 30
 #define MOD_NAME "[v4l2 disp.] "
 
 #include "debug.h"
@@ -62,12 +63,25 @@
 #include "video_display.h"
 #include "v4l2_common.h"
 
+/**
+ * Frames handed out by getf() point directly to the driver (MMAP) buffers,
+ * putf() then only enqueues the buffer. Buffers not yet queued (after
+ * reconfigure or discarded ones) are kept in free_buf, the others are
+ * recycled with VIDIOC_DQBUF. If the driver line pitch differs from the
+ * UltraGrid line size, a staging frame is used and copied line by line.
+ */
 struct display_v4l2_state {
         int fd;
         _Bool stream_started;
-        struct v4l2_buffer_data buffers[BUFFERS];
+        _Bool dmabuf; ///< export the buffers as DMA-BUF
+        int buffer_count;
+        struct v4l2_buffer_data buffers[MAX_BUF_COUNT];
+        int free_buf[MAX_BUF_COUNT]; ///< indices of buffers owned by us, not yet queued
+        int free_buf_count;
 
+        struct v4l2_format fmt;
         struct video_frame *f;
+        char *staging; ///< used if fmt.fmt.pix.bytesperline differs from ours
         struct v4l2_buffer buf;
 };
 
@@ -110,7 +124,10 @@ next_device:
 
 static void usage() {
         printf("Usage:\n");
-        color_printf(TERM_BOLD TERM_FG_RED "\t-d v4l2" TERM_FG_RESET "[:device=<path>] | -d v4l2:help\n" TERM_RESET);
+        color_printf(TERM_BOLD TERM_FG_RED "\t-d v4l2" TERM_FG_RESET "[:device=<path>][:buffers=<bufcnt>][:dmabuf] | -d v4l2:help\n" TERM_RESET);
+        printf("\n");
+        color_printf(TERM_BOLD "\t<bufcnt>" TERM_RESET " - number of output buffers to be used (default: %d)\n", DEFAULT_BUF_COUNT);
+        color_printf(TERM_BOLD "\tdmabuf" TERM_RESET " - export the output buffers as DMA-BUF so that a GPU producer can fill them without a copy\n");
         printf("\n");
         printf("Available devices:\n");
         int count = 0;
@@ -135,13 +152,23 @@ static void *display_v4l2_init(struct module *parent, const char *fmt, unsigned
         UNUSED(flags);
         UNUSED(parent);
         const char *dev_name = NULL;
+        int buffer_count = DEFAULT_BUF_COUNT;
+        _Bool dmabuf = 0;
         char *tok = NULL;
         char *save_ptr = NULL;
         char *fmt_c = strdupa(fmt);
         while ((tok = strtok_r(fmt_c, ":", &save_ptr)) != NULL) {
                 fmt_c = NULL;
                 if (strstr(tok, "device=") == tok) {
-                        dev_name = strchr(fmt, '=') + 1;
+                        dev_name = strchr(tok, '=') + 1;
+                } else if (strstr(tok, "buffers=") == tok) {
+                        buffer_count = atoi(strchr(tok, '=') + 1);
+                        if (buffer_count < 2 || buffer_count > MAX_BUF_COUNT) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Buffer count must be in range 2-%d!\n", MAX_BUF_COUNT);
+                                return NULL;
+                        }
+                } else if (strcmp(tok, "dmabuf") == 0) {
+                        dmabuf = 1;
                 } else {
                         usage();
                         return strstr(fmt, "help") != 0 ? INIT_NOERR : NULL;
@@ -149,6 +176,11 @@ static void *display_v4l2_init(struct module *parent, const char *fmt, unsigned
         }
 
         struct display_v4l2_state *s = calloc(1, sizeof(struct display_v4l2_state));
+        s->buffer_count = buffer_count;
+        s->dmabuf = dmabuf;
+        for (int i = 0; i < MAX_BUF_COUNT; ++i) {
+                s->buffers[i].dmabuf_fd = -1;
+        }
 
         static_assert(V4L2_PROBE_MAX < 100, "Pattern below has place only for 2 digits");
         char dev_name_try[] = "/dev/videoXX";
@@ -187,13 +219,27 @@ static void deinit_device(struct display_v4l2_state *s) {
                 log_perror(LOG_LEVEL_ERROR, MOD_NAME "Stream stopping error");
         }
 
-        for (int i = 0; i < BUFFERS; ++i) {
+        for (int i = 0; i < s->buffer_count; ++i) {
+                if (s->buffers[i].dmabuf_fd != -1) {
+                        close(s->buffers[i].dmabuf_fd);
+                        s->buffers[i].dmabuf_fd = -1;
+                }
                 if (s->buffers[i].start) {
                         if (-1 == munmap(s->buffers[i].start, s->buffers[i].length)) {
                                 log_perror(LOG_LEVEL_ERROR, MOD_NAME "munmap");
                         }
+                        s->buffers[i].start = NULL;
                 }
         }
+        struct v4l2_requestbuffers reqbuf = { .type = V4L2_BUF_TYPE_VIDEO_OUTPUT, .memory = V4L2_MEMORY_MMAP, .count = 0 };
+        if (ioctl(s->fd, VIDIOC_REQBUFS, &reqbuf) != 0) {
+                log_perror(LOG_LEVEL_WARNING, MOD_NAME "Unable to free buffers");
+        }
+        vf_free(s->f);
+        s->f = NULL;
+        free(s->staging);
+        s->staging = NULL;
+        s->free_buf_count = 0;
         s->stream_started = 0;
 }
 
@@ -210,25 +256,49 @@ static void display_v4l2_done(void *state)
 static struct video_frame *display_v4l2_getf(void *state)
 {
         struct display_v4l2_state *s = state;
-        int ret = ioctl(s->fd, VIDIOC_DQBUF, &s->buf);
-        if (ret != 0) {
-                log_perror(LOG_LEVEL_WARNING, MOD_NAME "QBUF");
+        if (!s->stream_started) {
                 return NULL;
         }
+        if (s->free_buf_count > 0) {
+                s->buf.index = s->free_buf[--s->free_buf_count];
+        } else {
+                int ret = ioctl(s->fd, VIDIOC_DQBUF, &s->buf);
+                if (ret != 0) {
+                        log_perror(LOG_LEVEL_WARNING, MOD_NAME "DQBUF");
+                        return NULL;
+                }
+        }
 
-        s->f->tiles[0].data = s->buffers[s->buf.index].start;
+        if (s->staging) {
+                s->f->tiles[0].data = s->staging;
+        } else {
+                s->f->tiles[0].data = s->buffers[s->buf.index].start;
+                s->f->tiles[0].dmabuf_fd = s->buffers[s->buf.index].dmabuf_fd;
+        }
 
         return s->f;
 }
 
 static int display_v4l2_putf(void *state, struct video_frame *frame, long long nonblock)
 {
-        UNUSED(nonblock);
         struct display_v4l2_state *s = state;
 
         if (frame == NULL) {
                 return 0;
         }
+        if (nonblock == PUTF_DISCARD) {
+                s->free_buf[s->free_buf_count++] = s->buf.index;
+                return 0;
+        }
+        if (s->staging) {
+                const size_t linesize = vc_get_linesize(frame->tiles[0].width, frame->color_spec);
+                char *dst = s->buffers[s->buf.index].start;
+                for (unsigned y = 0; y < frame->tiles[0].height; ++y) {
+                        memcpy(dst + y * s->fmt.fmt.pix.bytesperline, s->staging + y * linesize, linesize);
+                }
+        }
+        s->buf.bytesused = s->fmt.fmt.pix.sizeimage;
+        s->buf.field = s->fmt.fmt.pix.field;
         int ret = ioctl(s->fd, VIDIOC_QBUF, &s->buf);
         if (ret != 0) {
                 log_perror(LOG_LEVEL_WARNING, MOD_NAME "QBUF");
@@ -294,6 +364,12 @@ static int display_v4l2_reconfigure(void *state, struct video_desc desc)
                 }
         }
         CHECK(ioctl(s->fd, VIDIOC_S_FMT, &fmt));
+        if (fmt.fmt.pix.width != desc.width || fmt.fmt.pix.height != desc.height) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Device doesn't support %ux%u (%ux%u offered)!\n",
+                                desc.width, desc.height, fmt.fmt.pix.width, fmt.fmt.pix.height);
+                return FALSE;
+        }
+        s->fmt = fmt;
 
         struct v4l2_streamparm parm = { .type = V4L2_BUF_TYPE_VIDEO_OUTPUT };
         CHECK(ioctl(s->fd, VIDIOC_G_PARM, &parm));
@@ -305,8 +381,17 @@ static int display_v4l2_reconfigure(void *state, struct video_desc desc)
         struct v4l2_requestbuffers reqbuf = { 0 };
         reqbuf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
         reqbuf.memory = V4L2_MEMORY_MMAP;
-        reqbuf.count = BUFFERS;
-        if (!set_v4l2_buffers(s->fd, &reqbuf, s->buffers)) {
+        reqbuf.count = s->buffer_count;
+        if (!set_v4l2_buffers(s->fd, &reqbuf, s->buffers, 0)) {
+                return FALSE;
+        }
+        assert(reqbuf.count <= MAX_BUF_COUNT);
+        s->buffer_count = reqbuf.count;
+        for (int i = 0; i < s->buffer_count; ++i) {
+                s->free_buf[i] = s->buffer_count - 1 - i;
+        }
+        s->free_buf_count = s->buffer_count;
+        if (s->dmabuf && !export_v4l2_buffers(s->fd, reqbuf.type, s->buffer_count, s->buffers)) {
                 return FALSE;
         }
 
@@ -316,6 +401,12 @@ static int display_v4l2_reconfigure(void *state, struct video_desc desc)
         };
 
         s->f = vf_alloc_desc(desc);
+        const unsigned int linesize = vc_get_linesize(desc.width, desc.color_spec);
+        if (fmt.fmt.pix.bytesperline != linesize) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Driver line pitch %u differs from %u, frames will be copied.\n",
+                                fmt.fmt.pix.bytesperline, linesize);
+                s->staging = malloc(s->f->tiles[0].data_len);
+        }
 
         s->stream_started = 1;
 
@@ -312,6 +312,11 @@ bool VulkanDisplay::is_image_description_supported(ImageDescription description)
                 return true;
         }
 
+        // shaders are compiled separately (see shaders/compile_shaders.sh)
+        if (!std::ifstream(path_to_shaders + "/" + format_info.conversion_shader + ".comp.spv")){
+                return false;
+        }
+
         return is_format_supported(context.get_gpu(), context.is_yCbCr_supported(), description.size,
                 format_info.conversion_image_format, vk::ImageTiling::eOptimal,
                 vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage);
@@ -506,7 +506,7 @@ struct CodecToVulkanFormat{
 // Ultragrid to VulkanDisplay Format mapping
 const std::vector<CodecToVulkanFormat>& get_ug_to_vkd_format_mapping(state_vulkan_sdl2& s){
         //the backup vkd::Format must follow the corrresponding native vkd::Format 
-        constexpr std::array<CodecToVulkanFormat, 10> format_mapping {{
+        constexpr std::array<CodecToVulkanFormat, 11> format_mapping {{
                 {RGBA, vkd::Format::RGBA8},
                 {RGB,  vkd::Format::RGB8},
                 {UYVY, vkd::Format::UYVY8_422},
@@ -515,6 +515,7 @@ const std::vector<CodecToVulkanFormat>& get_ug_to_vkd_format_mapping(state_vulka
                 {Y216, vkd::Format::YUYV16_422},
                 {Y416, vkd::Format::UYVA16_422_conv},
                 {R10k, vkd::Format::RGB10A2_conv},
+                {v210, vkd::Format::v210_conv},
                 {RG48, vkd::Format::RGB16},
         }};
 
@@ -91,6 +91,10 @@ vk::Extent2D get_buffer_size(const vulkan_display::ImageDescription& description
         if (description.format == vulkan_display::Format::UYVY8_422_conv){
                 return { description.size.width / 2, description.size.height };
         }
+        if (description.format == vulkan_display::Format::v210_conv){
+                // one 32-bit word per texel, 48-pixel blocks of 32 words (128 B)
+                return { (description.size.width + 47) / 48 * 32, description.size.height };
+        }
         return description.size;
 }
 
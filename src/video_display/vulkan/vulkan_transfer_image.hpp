@@ -51,7 +51,8 @@ enum class Format{
         YUYV16_422,
         UYVA16_422_conv,
         RGB10A2_conv,
-        RGB16
+        RGB16,
+        v210_conv
 };
 
 struct ImageDescription;
@@ -72,7 +73,7 @@ inline const FormatInfo& format_info(vulkan_display::Format format){
         using F = vulkan_display::Format;
         using VkF = vk::Format;
 
-        static std::array<FormatInfo, 11> format_infos = {{
+        static std::array<FormatInfo, 12> format_infos = {{
 {F::uninitialized,   VkF::eUndefined,            },
 {F::RGBA8,           VkF::eR8G8B8A8Unorm,        },
 {F::RGB8,            VkF::eR8G8B8Srgb,           },
@@ -83,6 +84,7 @@ inline const FormatInfo& format_info(vulkan_display::Format format){
 {F::UYVA16_422_conv, VkF::eR16G16B16A16Uint,     {"UYVA16_conv"}, VkF::eR16G16B16A16Sfloat},
 {F::RGB10A2_conv,    VkF::eR8G8B8A8Uint,         {"RGB10A2_conv"}, VkF::eA2B10G10R10UnormPack32},
 {F::RGB16,          VkF::eR16G16B16Unorm        },
+{F::v210_conv,       VkF::eR32Uint,              {"v210_conv"}, VkF::eA2B10G10R10UnormPack32},
         }};
 
         auto& result = format_infos[static_cast<size_t>(format)];
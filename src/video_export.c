@@ -3,7 +3,7 @@
  * @author Martin Pulec     <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2012-2016 CESNET, z. s. p. o.
+ * Copyright (c) 2012-2026 CESNET, z. s. p. o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -35,6 +35,7 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #include "config_unix.h"
@@ -43,33 +44,85 @@
 
 #include <compat/platform_semaphore.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
 
 #include "debug.h"
+#include "host.h"
+#include "tv.h"
+#include "utils/frame_copy.h"
+#include "utils/macros.h"
 #include "video.h"
 #include "video_codec.h"
 #include "video_export.h"
+#include "video_export_compress.h"
 
 #define MAX_QUEUE_SIZE 300
+#define MAX_WRITER_THREADS 16
+#define SEGMENT_ALIGN 4096 ///< minimal alignment of frames in segment (O_DIRECT)
+#define DEFAULT_MAX_REFS 3 ///< frames referenced (not copied) by the queue at most
+#define MOD_NAME "[Video export] "
+
+#if !defined _WIN32
+#define HAVE_SEGMENTS 1
+#endif
+
+ADD_TO_PARAM("video-export-segment", "* video-export-segment=<MiB>\n"
+                "  Record video to preallocated segment files of given size with an index (" VIDEO_EXPORT_INDEX_FILE ") instead of a file per frame\n");
+ADD_TO_PARAM("video-export-threads", "* video-export-threads=<n>\n"
+                "  Number of threads writing the recorded video (default 1, max " TOSTRING(MAX_WRITER_THREADS) ")\n");
+ADD_TO_PARAM("video-export-o-direct", "* video-export-o-direct\n"
+                "  Write video segment files with O_DIRECT (bypassing page cache, frames are always copied)\n");
+ADD_TO_PARAM("video-export-compress", "* video-export-compress=<compression>\n"
+                "  Compress the recorded video in the export threads, eg. \"libavcodec:encoder=prores_ks\", \"libavcodec:encoder=ffv1\"\n"
+                "  or \"libavcodec:codec=HEVC\" (frames are dropped from the recording if it is too slow)\n");
+ADD_TO_PARAM("video-export-max-refs", "* video-export-max-refs=<n>\n"
+                "  Maximum number of frames held by reference (without copy) until written (default " TOSTRING(DEFAULT_MAX_REFS) ", 0 - always copy)\n");
 
 /*
- * we do not need to have possible stalls, so IO is performend in a separate thread
+ * we do not need to have possible stalls, so IO is performend in separate threads
  */
 static void *video_export_thread(void *arg);
+static void export_encoded(void *arg, struct video_frame *frame, video_export_release_t release, void *udata);
+static void export_frame(struct video_export *s, struct video_frame *frame,
+                video_export_release_t release, void *udata);
 void output_summary(struct video_export *s);
 
+/// reference to a frame shared by its tiles' entries
+struct frame_ref {
+        int count;
+        video_export_release_t release;
+        void *udata;
+};
+
 struct output_entry;
 
 struct output_entry {
-        char *filename;
-        char *data;
-        int data_len;
+        char filename[512]; ///< file per frame mode only
+        const char *data;   ///< either buf or referenced frame data
+        size_t data_len;
+        char *buf;          ///< aligned, recycled with the entry
+        size_t alloc_len;
+        struct frame_ref *ref; ///< if data is referenced
+        int segment;        ///< -1 if writing to filename
+        off_t offset;
 
         struct output_entry *next;
 };
 
+struct export_segment {
+        int fd;
+        int pending;        ///< assigned frames not yet written
+        bool full;          ///< no more frames will be assigned
+        off_t used;
+};
+
 struct video_export {
         char *path;
 
@@ -80,12 +133,208 @@ struct video_export {
                             * volatile tail;
         volatile int queue_len;
         sem_t semaphore;
+        struct output_entry *free_entries;
+        int refs_in_flight;
+        int max_refs;
 
         struct video_desc saved_desc;
 
-        pthread_t thread_id;
+        pthread_t thread_id[MAX_WRITER_THREADS];
+        int thread_count;
+
+        // segment mode
+        off_t segment_size; ///< 0 - file per frame
+        bool o_direct;
+        size_t align;
+        FILE *index;
+        time_ns_t start_time; ///< arrival of the first frame, origin of index timestamps
+        struct export_segment *segments;
+        int segment_count;
+        off_t segment_offset; ///< write position in the last segment
+
+        struct video_export_encoder *encoder; ///< NULL if the frames are recorded as received
 };
 
+/**
+ * @param ref  frame reference or NULL, in which case the entry gets a buffer
+ *             for at least len bytes, aligned to s->align
+ * s->lock must be held
+ */
+static struct output_entry *get_entry(struct video_export *s, size_t len, struct frame_ref *ref)
+{
+        struct output_entry *entry = s->free_entries;
+        if (entry) {
+                s->free_entries = entry->next;
+        } else {
+                entry = calloc(1, sizeof *entry);
+        }
+        size_t alloc_len = (len + s->align - 1) / s->align * s->align;
+        if (ref == NULL && entry->alloc_len < alloc_len) {
+                aligned_free(entry->buf);
+                entry->buf = aligned_malloc(alloc_len, s->align);
+                assert(entry->buf != NULL);
+                entry->alloc_len = alloc_len;
+        }
+        entry->data = entry->buf;
+        entry->data_len = len;
+        entry->ref = ref;
+        entry->segment = -1;
+        entry->next = NULL;
+        return entry;
+}
+
+/// @param ref  reference to be dropped, s->lock must be held
+/// @returns reference to be released (outside the lock) if it was the last one
+static struct frame_ref *unref(struct video_export *s, struct frame_ref *ref)
+{
+        if (ref == NULL || --ref->count > 0) {
+                return NULL;
+        }
+        s->refs_in_flight -= 1;
+        return ref;
+}
+
+static void release_ref(struct frame_ref *ref)
+{
+        if (ref != NULL) {
+                ref->release(ref->udata);
+                free(ref);
+        }
+}
+
+static void put_entry(struct video_export *s, struct output_entry *entry)
+{
+        pthread_mutex_lock(&s->lock);
+        struct frame_ref *ref = unref(s, entry->ref);
+        entry->ref = NULL;
+        entry->next = s->free_entries;
+        s->free_entries = entry;
+        pthread_mutex_unlock(&s->lock);
+        release_ref(ref);
+}
+
+#ifdef HAVE_SEGMENTS
+static void close_segment(struct export_segment *seg)
+{
+        if (seg->fd == -1) {
+                return;
+        }
+        if (ftruncate(seg->fd, seg->used) != 0) { // drop the unused preallocated space
+                perror(MOD_NAME "ftruncate");
+        }
+        close(seg->fd);
+        seg->fd = -1;
+}
+
+static bool open_segment(struct video_export *s)
+{
+        if (s->segment_count > 0) {
+                struct export_segment *last = &s->segments[s->segment_count - 1];
+                last->full = true;
+                if (last->pending == 0) {
+                        close_segment(last);
+                }
+        }
+        char name[512];
+        snprintf(name, sizeof name, VIDEO_EXPORT_SEGMENT_FMT, s->path, s->segment_count);
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+        if (s->o_direct) {
+                flags |= O_DIRECT;
+        }
+#endif
+        int fd = open(name, flags, 0644);
+        if (fd == -1 && s->o_direct && errno == EINVAL) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "O_DIRECT not supported by the filesystem, disabling.\n");
+                s->o_direct = false;
+                fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
+        if (fd == -1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot open segment %s: %s\n", name, strerror(errno));
+                return false;
+        }
+#ifdef HAVE_LINUX
+        int rc = posix_fallocate(fd, 0, s->segment_size);
+        if (rc != 0) {
+                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('V', 'E', 'f', 'a'), MOD_NAME "Cannot preallocate segment: %s\n", strerror(rc));
+        }
+#endif
+        struct export_segment *segments = realloc(s->segments, (s->segment_count + 1) * sizeof *segments);
+        assert(segments != NULL);
+        s->segments = segments;
+        s->segments[s->segment_count++] = (struct export_segment){ .fd = fd, .pending = 0, .full = false, .used = 0 };
+        s->segment_offset = 0;
+        return true;
+}
+
+/**
+ * assigns the entry a place in a segment and records it to the index; s->lock must be held
+ * @param ts_us    frame presentation time relative to the first frame
+ * @param keyframe frame can be decoded without the preceding ones
+ */
+static bool assign_segment(struct video_export *s, struct output_entry *entry, int tile_idx,
+                long long ts_us, bool keyframe)
+{
+        off_t len = (entry->data_len + s->align - 1) / s->align * s->align;
+        if (s->segment_count == 0 || s->segment_offset + len > s->segment_size) {
+                if (!open_segment(s)) {
+                        return false;
+                }
+        }
+        struct export_segment *seg = &s->segments[s->segment_count - 1];
+        entry->segment = s->segment_count - 1;
+        entry->offset = s->segment_offset;
+        s->segment_offset += len;
+        seg->used = s->segment_offset;
+        seg->pending += 1;
+        fprintf(s->index, "%" PRIu32 " %d %d %lld %zu %lld %d\n", s->total + 1, tile_idx,
+                        entry->segment, (long long) entry->offset, entry->data_len,
+                        ts_us, keyframe ? 1 : 0);
+        return true;
+}
+
+static void write_to_segment(struct video_export *s, struct output_entry *entry)
+{
+        pthread_mutex_lock(&s->lock);
+        int fd = s->segments[entry->segment].fd;
+        pthread_mutex_unlock(&s->lock);
+
+        // whole aligned buffer is written (O_DIRECT), index holds the real length
+        size_t len = entry->ref != NULL ? entry->data_len
+                : (entry->data_len + s->align - 1) / s->align * s->align;
+        size_t written = 0;
+        while (written < len) {
+                ssize_t ret = pwrite(fd, entry->data + written, len - written, entry->offset + written);
+                if (ret <= 0) {
+                        perror(MOD_NAME "pwrite");
+                        break;
+                }
+                written += ret;
+        }
+
+        pthread_mutex_lock(&s->lock);
+        struct export_segment *seg = &s->segments[entry->segment];
+        seg->pending -= 1;
+        if (seg->full && seg->pending == 0) {
+                close_segment(seg);
+        }
+        pthread_mutex_unlock(&s->lock);
+}
+#endif // defined HAVE_SEGMENTS
+
+static void write_to_file(struct output_entry *entry)
+{
+        FILE *out = fopen(entry->filename, "wb");
+        if (out == NULL) {
+                perror("fopen");
+        } else {
+                if (fwrite(entry->data, entry->data_len, 1, out) != 1) {
+                        perror("fwrite");
+                }
+                fclose(out);
+        }
+}
+
 static void *video_export_thread(void *arg)
 {
         struct video_export *s = (struct video_export *) arg;
@@ -102,31 +351,56 @@ static void *video_export_thread(void *arg)
                 }
                 pthread_mutex_unlock(&s->lock);
 
-                assert((current->data == NULL && current->data_len == 0) ||
-                                (current->data != NULL && current->data_len != 0));
-
                 // poison
-                if(current->data == NULL) {
+                if(current->data_len == 0) {
+                        put_entry(s, current);
                         return NULL;
                 }
 
-                FILE *out = fopen(current->filename, "wb");
-                if (out == NULL) {
-                        perror("fopen");
-                } else {
-                        if (fwrite(current->data, current->data_len, 1, out) != 1) {
-                                perror("fwrite");
-                        }
-                        fclose(out);
+#ifdef HAVE_SEGMENTS
+                if (current->segment != -1) {
+                        write_to_segment(s, current);
+                } else
+#endif
+                {
+                        write_to_file(current);
                 }
-                free(current->data);
-                free(current->filename);
-                free(current);
+                put_entry(s, current);
         }
 
         // never get here
 }
 
+static void parse_export_params(struct video_export *s)
+{
+        s->thread_count = 1;
+        s->align = 64;
+        const char *val = get_commandline_param("video-export-threads");
+        if (val != NULL) {
+                s->thread_count = MAX(1, MIN(atoi(val), MAX_WRITER_THREADS));
+        }
+        if ((val = get_commandline_param("video-export-segment")) != NULL) {
+#ifdef HAVE_SEGMENTS
+                s->segment_size = (off_t) atoll(val) << 20;
+                if (s->segment_size <= 0) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Wrong segment size %s, writing a file per frame.\n", val);
+                        s->segment_size = 0;
+                }
+#else
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Segment files not supported on this platform.\n");
+#endif
+        }
+        s->o_direct = get_commandline_param("video-export-o-direct") != NULL;
+        s->max_refs = DEFAULT_MAX_REFS;
+        if ((val = get_commandline_param("video-export-max-refs")) != NULL) {
+                s->max_refs = MAX(0, atoi(val));
+        }
+        if (s->segment_size > 0) {
+                long page = sysconf(_SC_PAGESIZE); // frames may be mmapped by import
+                s->align = MAX(SEGMENT_ALIGN, page > 0 ? page : 0);
+        }
+}
+
 struct video_export * video_export_init(const char *path)
 {
         struct video_export *s;
@@ -143,10 +417,34 @@ struct video_export * video_export_init(const char *path)
 
         memset(&s->saved_desc, 0, sizeof(s->saved_desc));
 
-        if(pthread_create(&s->thread_id, NULL, video_export_thread, s) != 0) {
-                fprintf(stderr, "[Video exporter] Failed to create thread.\n");
-                free(s);
-                return NULL;
+        parse_export_params(s);
+        if (s->segment_size > 0) {
+                char name[512];
+                snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_INDEX_FILE, s->path);
+                s->index = fopen(name, "w");
+                if (s->index == NULL) {
+                        perror(MOD_NAME "Cannot create index");
+                        free(s->path);
+                        free(s);
+                        return NULL;
+                }
+                fprintf(s->index, "# frame tile segment offset length timestamp_us keyframe\n");
+        }
+
+        for (int i = 0; i < s->thread_count; ++i) {
+                if(pthread_create(&s->thread_id[i], NULL, video_export_thread, s) != 0) {
+                        fprintf(stderr, "[Video exporter] Failed to create thread.\n");
+                        abort(); // already running threads cannot be stopped cleanly
+                }
+        }
+
+        const char *compress = get_commandline_param("video-export-compress");
+        if (compress != NULL) {
+                s->encoder = video_export_encoder_init(compress, s->max_refs, export_encoded, s);
+                if (s->encoder == NULL) {
+                        video_export_destroy(s);
+                        return NULL;
+                }
         }
 
         return s;
@@ -176,27 +474,53 @@ void output_summary(struct video_export *s)
         fclose(summary);
 }
 
+static void enqueue(struct video_export *s, struct output_entry *entry)
+{
+        if(s->head) {
+                s->tail->next = entry;
+                s->tail = entry;
+        } else {
+                s->head = s->tail = entry;
+        }
+        s->queue_len += 1;
+}
+
 void video_export_destroy(struct video_export *s)
 {
         if(s) {
-                // poison
-                struct output_entry *entry = calloc(sizeof(struct output_entry), 1);
+                video_export_encoder_destroy(s->encoder); // passes the remaining frames to the writers
 
+                // poison, one for each thread
                 pthread_mutex_lock(&s->lock);
-                {
-                        if(s->head) {
-                                s->tail->next = entry;
-                                s->tail = entry;
-                        } else {
-                                s->head = s->tail = entry;
-                        }
+                for (int i = 0; i < s->thread_count; ++i) {
+                        enqueue(s, get_entry(s, 0, NULL));
                 }
                 pthread_mutex_unlock(&s->lock);
-                platform_sem_post(&s->semaphore);
+                for (int i = 0; i < s->thread_count; ++i) {
+                        platform_sem_post(&s->semaphore);
+                }
 
-                pthread_join(s->thread_id, NULL);
+                for (int i = 0; i < s->thread_count; ++i) {
+                        pthread_join(s->thread_id[i], NULL);
+                }
                 pthread_mutex_destroy(&s->lock);
 
+#ifdef HAVE_SEGMENTS
+                for (int i = 0; i < s->segment_count; ++i) {
+                        close_segment(&s->segments[i]);
+                }
+#endif
+                free(s->segments);
+                if (s->index) {
+                        fclose(s->index);
+                }
+                while (s->free_entries) {
+                        struct output_entry *next = s->free_entries->next;
+                        aligned_free(s->free_entries->buf);
+                        free(s->free_entries);
+                        s->free_entries = next;
+                }
+
                 // write summary
                 if(s->total > 0) {
                         output_summary(s);
@@ -208,66 +532,131 @@ void video_export_destroy(struct video_export *s)
 }
 
 void video_export(struct video_export *s, struct video_frame *frame)
+{
+        video_export_ref(s, frame, NULL, NULL);
+}
+
+void video_export_ref(struct video_export *s, struct video_frame *frame,
+                video_export_release_t release, void *udata)
 {
         if(!s) {
+                if (release) {
+                        release(udata);
+                }
                 return;
         }
 
         assert(frame != NULL);
+        if (s->encoder != NULL) {
+                video_export_encoder_push(s->encoder, frame, release, udata);
+        } else {
+                export_frame(s, frame, release, udata);
+        }
+}
 
+/// writes the frame (either received or compressed by the encoder)
+static void export_frame(struct video_export *s, struct video_frame *frame,
+                video_export_release_t release, void *udata)
+{
         if(s->saved_desc.width == 0) {
                 s->saved_desc = video_desc_from_frame(frame);
         } else {
                 if(!video_desc_eq(s->saved_desc, video_desc_from_frame(frame))) {
                         fprintf(stderr, "[Video export] Format change detected, not exporting.\n");
+                        if (release) {
+                                release(udata);
+                        }
                         return;
                 }
         }
 
+        struct frame_ref *ref = NULL;
+        pthread_mutex_lock(&s->lock);
+        // O_DIRECT needs aligned buffers; copy also if writing lags so that
+        // the frames are not held away from the producer's pool
+        if (release != NULL && !s->o_direct && s->refs_in_flight < s->max_refs) {
+                ref = malloc(sizeof *ref);
+                *ref = (struct frame_ref){ .count = 1, .release = release, .udata = udata };
+                s->refs_in_flight += 1;
+        }
+        pthread_mutex_unlock(&s->lock);
+
+#ifdef HAVE_SEGMENTS
+        long long ts_us = 0;
+        if (s->segment_size > 0) {
+                time_ns_t now = get_time_in_ns();
+                if (s->total == 0) {
+                        s->start_time = now;
+                }
+                ts_us = (now - s->start_time) / 1000;
+        }
+        // uncompressed and intra-only codecs have all frames independently decodable
+        const bool keyframe = frame->frame_type == INTRA;
+#endif
+
         for (unsigned int i = 0; i < frame->tile_count; ++i) {
                 assert(frame->tiles[i].data != NULL && frame->tiles[i].data_len != 0);
 
-                struct output_entry *entry = malloc(sizeof(struct output_entry));
-
-                entry->data_len = frame->tiles[i].data_len;
-                entry->data = (char *) malloc(entry->data_len);
-                entry->filename = malloc(512);
-                entry->next = NULL;
+                pthread_mutex_lock(&s->lock);
+                // check if we do not occupy too much memory
+                if(s->queue_len >= MAX_QUEUE_SIZE) {
+                        fprintf(stderr, "[Video export] Maximal queue size (%d) exceeded, not saving frame %d.\n",
+                                        MAX_QUEUE_SIZE,
+                                        s->total); // we increment total size to keep the index
+                        pthread_mutex_unlock(&s->lock);
+                        break;
+                }
+                if (ref != NULL) {
+                        ref->count += 1;
+                }
+                struct output_entry *entry = get_entry(s, frame->tiles[i].data_len, ref);
+                pthread_mutex_unlock(&s->lock);
 
-                if(frame->tile_count == 1) {
-                        snprintf(entry->filename, 512, "%s/%08d.%s", s->path, s->total + 1, get_codec_file_extension(frame->color_spec));
+                if (ref != NULL) {
+                        entry->data = frame->tiles[i].data;
                 } else {
-                        // add also tile index
-                        snprintf(entry->filename, 512, "%s/%08d_%d.%s", s->path, s->total + 1, i, get_codec_file_extension(frame->color_spec));
+                        frame_copy(entry->buf, frame->tiles[i].data, entry->data_len);
+                        // keep the alignment padding deterministic
+                        memset(entry->buf + entry->data_len, 0, entry->alloc_len - entry->data_len);
                 }
-                memcpy(entry->data, frame->tiles[i].data, entry->data_len);
-
-                pthread_mutex_lock(&s->lock);
-                {
-                        // check if we do not occupy too much memory
-                        if(s->queue_len >= MAX_QUEUE_SIZE) {
-                                fprintf(stderr, "[Video export] Maximal queue size (%d) exceeded, not saving frame %d.\n",
-                                                MAX_QUEUE_SIZE,
-                                                s->total++); // we increment total size to keep the index
-                                pthread_mutex_unlock(&s->lock);
-                                free(entry->data);
-                                free(entry);
-                                return;
-                        }
 
-                        if(s->head) {
-                                s->tail->next = entry;
-                                s->tail = entry;
+                if (s->segment_size == 0) {
+                        if(frame->tile_count == 1) {
+                                snprintf(entry->filename, sizeof entry->filename, "%s/%08d.%s", s->path, s->total + 1, get_codec_file_extension(frame->color_spec));
                         } else {
-                                s->head = s->tail = entry;
+                                // add also tile index
+                                snprintf(entry->filename, sizeof entry->filename, "%s/%08d_%d.%s", s->path, s->total + 1, i, get_codec_file_extension(frame->color_spec));
                         }
-                        s->queue_len += 1;
                 }
+
+                pthread_mutex_lock(&s->lock);
+#ifdef HAVE_SEGMENTS
+                if (s->segment_size > 0 && !assign_segment(s, entry, i, ts_us, keyframe)) {
+                        pthread_mutex_unlock(&s->lock);
+                        put_entry(s, entry);
+                        continue;
+                }
+#endif
+                enqueue(s, entry);
                 pthread_mutex_unlock(&s->lock);
 
                 platform_sem_post(&s->semaphore);
         }
 
         s->total += 1;
+
+        if (release != NULL && ref == NULL) { // data were copied
+                release(udata);
+        }
+
+        pthread_mutex_lock(&s->lock);
+        ref = unref(s, ref); // the initial reference
+        pthread_mutex_unlock(&s->lock);
+        release_ref(ref);
 }
 
+/// receives frames compressed by s->encoder
+static void export_encoded(void *arg, struct video_frame *frame, video_export_release_t release, void *udata)
+{
+        export_frame((struct video_export *) arg, frame, release, udata);
+}
@@ -39,6 +39,8 @@
 #define _VIDEO_EXPORT_H_
 
 #define VIDEO_EXPORT_SUMMARY_VERSION 1
+#define VIDEO_EXPORT_INDEX_FILE "video.index" ///< frame -> segment mapping (segment mode)
+#define VIDEO_EXPORT_SEGMENT_FMT "%s/segment_%05d.dat" ///< directory, segment number
 
 #ifdef __cplusplus
 extern "C" {
@@ -51,6 +53,16 @@ struct video_export * video_export_init(const char *path);
 void video_export_destroy(struct video_export *state);
 void video_export(struct video_export *state, struct video_frame *frame);
 
+/// releases the reference passed to video_export_ref()
+typedef void (*video_export_release_t)(void *udata);
+/**
+ * Exports the frame without copying if possible - the exporter calls release
+ * once the data is written (or immediately if it decided to copy the data).
+ * The frame data must not be modified until released.
+ */
+void video_export_ref(struct video_export *state, struct video_frame *frame,
+                video_export_release_t release, void *udata);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -0,0 +1,160 @@
+/**
+ * @file   video_export_compress.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "debug.h"
+#include "module.h"
+#include "utils/synchronized_queue.h"
+#include "utils/thread.h"
+#include "video_compress.h"
+#include "video_export_compress.h"
+#include "video_frame.h"
+
+#define ENCODER_QUEUE_LEN 8 ///< frames waiting for compression at most, newer are dropped
+#define MOD_NAME "[Video export] "
+
+using std::atomic;
+using std::shared_ptr;
+using std::thread;
+
+struct video_export_encoder {
+        struct module root; ///< parent of the compress module
+        struct compress_state *compress = nullptr;
+        int max_refs;
+        atomic<int> refs_in_flight{0};
+        atomic<unsigned long long> dropped{0};
+        video_export_encoded_t on_frame;
+        void *udata;
+
+        synchronized_queue<shared_ptr<video_frame>, -1> in;
+        thread compress_thread;
+        thread pop_thread;
+};
+
+static void compress_worker(struct video_export_encoder *enc)
+{
+        set_thread_name("video_export_compress");
+        while (auto frame = enc->in.pop()) {
+                compress_frame(enc->compress, std::move(frame));
+        }
+        compress_frame(enc->compress, nullptr); // poison
+}
+
+static void pop_worker(struct video_export_encoder *enc)
+{
+        set_thread_name("video_export_pop");
+        while (auto frame = compress_pop(enc->compress)) {
+                auto *holder = new shared_ptr<video_frame>(frame);
+                enc->on_frame(enc->udata, frame.get(),
+                                [](void *h) { delete static_cast<shared_ptr<video_frame> *>(h); }, holder);
+        }
+}
+
+struct video_export_encoder *video_export_encoder_init(const char *cfg, int max_refs,
+                video_export_encoded_t on_frame, void *udata)
+{
+        auto *enc = new video_export_encoder();
+        module_init_default(&enc->root);
+        enc->root.cls = MODULE_CLASS_ROOT;
+        enc->max_refs = max_refs;
+        enc->on_frame = on_frame;
+        enc->udata = udata;
+        if (compress_init(&enc->root, cfg, &enc->compress) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot initialize compression %s!\n", cfg);
+                module_done(&enc->root);
+                delete enc;
+                return nullptr;
+        }
+        enc->compress_thread = thread(compress_worker, enc);
+        enc->pop_thread = thread(pop_worker, enc);
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "Recording compressed with %s.\n", get_compress_name(enc->compress));
+        return enc;
+}
+
+void video_export_encoder_push(struct video_export_encoder *enc, struct video_frame *frame,
+                void (*release)(void *udata), void *udata)
+{
+        if (enc->in.size() >= ENCODER_QUEUE_LEN) {
+                if (enc->dropped++ == 0) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Compression of the recording is too slow, dropping frames.\n");
+                }
+                if (release != nullptr) {
+                        release(udata);
+                }
+                return;
+        }
+        if (release != nullptr && enc->refs_in_flight.fetch_add(1) < enc->max_refs) {
+                enc->in.push(shared_ptr<video_frame>(frame, [enc, release, udata](video_frame *) {
+                        release(udata);
+                        enc->refs_in_flight--;
+                }));
+                return;
+        }
+        if (release != nullptr) {
+                enc->refs_in_flight--;
+        }
+        struct video_frame *copy = vf_get_copy(frame);
+        if (release != nullptr) {
+                release(udata);
+        }
+        enc->in.push(shared_ptr<video_frame>(copy, vf_free));
+}
+
+void video_export_encoder_destroy(struct video_export_encoder *enc)
+{
+        if (enc == nullptr) {
+                return;
+        }
+        enc->in.push({});
+        enc->compress_thread.join();
+        enc->pop_thread.join();
+        if (enc->dropped > 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "%llu frames not recorded - compression too slow.\n",
+                                enc->dropped.load());
+        }
+        module_done(CAST_MODULE(enc->compress));
+        module_done(&enc->root);
+        delete enc;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file   video_export_compress.h
+ * @brief  compression stage of the video export
+ *
+ * Frames are compressed with a compress module (eg. libavcodec with ProRes,
+ * FFV1 or HEVC) in threads of the encoder and passed to the export writer
+ * afterwards, so the live path only enqueues the frame.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef VIDEO_EXPORT_COMPRESS_H_5C0D2A7E
+#define VIDEO_EXPORT_COMPRESS_H_5C0D2A7E
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+struct video_export_encoder;
+struct video_frame;
+
+/// receives a compressed frame, the frame is valid only until release(release_udata) is called
+typedef void (*video_export_encoded_t)(void *udata, struct video_frame *frame,
+                void (*release)(void *release_udata), void *release_udata);
+
+/**
+ * @param cfg      compress module configuration (as for "-c")
+ * @param max_refs frames held by reference (instead of copied) at most
+ * @returns encoder or NULL on error
+ */
+struct video_export_encoder *video_export_encoder_init(const char *cfg, int max_refs,
+                video_export_encoded_t on_frame, void *udata);
+/**
+ * Enqueues the frame for compression without blocking. The frame is either
+ * copied (and release called immediately) or release is called after the
+ * compression. The frame is dropped if the encoder lags.
+ * @param release  may be NULL, the frame is then always copied
+ */
+void video_export_encoder_push(struct video_export_encoder *enc, struct video_frame *frame,
+                void (*release)(void *udata), void *udata);
+/// compresses the enqueued frames and stops the encoder
+void video_export_encoder_destroy(struct video_export_encoder *enc);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // defined VIDEO_EXPORT_COMPRESS_H_5C0D2A7E
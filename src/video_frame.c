@@ -59,6 +59,10 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#ifdef HAVE_CUDA
+#include "cuda_wrapper.h"
+#endif
+#include "module.h"
 #include "utils/pam.h"
 #include "utils/y4m.h"
 #include "video_codec.h"
@@ -73,6 +77,9 @@ struct video_frame * vf_alloc(int count)
         assert(buf != NULL);
         
         buf->tile_count = count;
+        for (int i = 0; i < count; ++i) {
+                buf->tiles[i].dmabuf_fd = -1;
+        }
 
         return buf;
 }
@@ -136,16 +143,27 @@ struct video_frame * vf_alloc_desc_data(struct video_desc desc)
                 buf->tiles[i].data = (char *) aligned_malloc(buf->tiles[i].data_len + MAX_PADDING, 1U<<21U /* 2 MiB */);
                 assert(buf->tiles[i].data != NULL);
 #ifdef __linux__
-                madvise(buf->tiles[0].data, buf->tiles[0].data_len, MADV_HUGEPAGE);
+                madvise(buf->tiles[i].data, buf->tiles[i].data_len, MADV_HUGEPAGE);
 #endif
         }
 
         buf->callbacks.data_deleter = vf_aligned_data_deleter;
         buf->callbacks.recycle = NULL;
+        vf_mem_charge(buf, desc.tile_count * (buf->tiles[0].data_len + MAX_PADDING));
 
         return buf;
 }
 
+void vf_mem_charge(struct video_frame *buf, size_t bytes)
+{
+        assert(buf->mem_owner == NULL);
+        if ((buf->mem_owner = module_mem_acquire_owner()) == NULL) {
+                return;
+        }
+        buf->mem_bytes = bytes;
+        module_mem_add(buf->mem_owner, (long long) bytes);
+}
+
 void vf_free(struct video_frame *buf)
 {
         if(!buf)
@@ -153,6 +171,10 @@ void vf_free(struct video_frame *buf)
 
         vf_recycle(buf);
 
+        if (buf->mem_owner != NULL) {
+                module_mem_add(buf->mem_owner, -(long long) buf->mem_bytes);
+                module_mem_release(buf->mem_owner);
+        }
         if (buf->callbacks.data_deleter) {
                 buf->callbacks.data_deleter(buf);
         }
@@ -369,6 +391,17 @@ void il_merged_to_upper(char *dst, char *src, int linesize, int height, void **s
         free(tmp);
 }
 
+int il_upper_to_merged_line(int line, int height)
+{
+        int upper_lines = (height + 1) / 2;
+        return line < upper_lines ? line * 2 : (line - upper_lines) * 2 + 1;
+}
+
+int il_merged_to_upper_line(int line, int height)
+{
+        return line % 2 == 0 ? line / 2 : (height + 1) / 2 + line / 2;
+}
+
 /**
  * Computes FPS from packet format values:
  * https://www.cesnet.cz/wp-content/uploads/2013/01/ultragrid-4k.pdf
@@ -567,6 +600,28 @@ void vf_copy_metadata(struct video_frame *desc, const struct video_frame *src)
         memcpy((char *) desc + offsetof(struct video_frame, VF_METADATA_START), (const char *) src + offsetof(struct video_frame, VF_METADATA_START), VF_METADATA_SIZE);
 }
 
+struct video_frame *vf_download_cuda(struct video_frame *f)
+{
+#ifdef HAVE_CUDA
+        struct video_frame *out = vf_alloc_desc_data(video_desc_from_frame(f));
+        vf_copy_metadata(out, f);
+        out->callbacks.dispose = vf_free;
+        for (unsigned int i = 0; i < f->tile_count; ++i) {
+                if (cuda_wrapper_memcpy(out->tiles[i].data, f->tiles[i].data, f->tiles[i].data_len,
+                                        CUDA_WRAPPER_MEMCPY_DEVICE_TO_HOST) != CUDA_WRAPPER_SUCCESS) {
+                        log_msg(LOG_LEVEL_ERROR, "Cannot copy frame from CUDA memory: %s\n",
+                                        cuda_wrapper_last_error_string());
+                        vf_free(out);
+                        return NULL;
+                }
+        }
+        return out;
+#else
+        UNUSED(f);
+        return NULL;
+#endif
+}
+
 void vf_store_metadata(struct video_frame *f, void *s)
 {
         memcpy(s, (char *) f + offsetof(struct video_frame, VF_METADATA_START), VF_METADATA_SIZE);
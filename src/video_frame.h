@@ -104,6 +104,14 @@ struct video_frame * vf_alloc_desc(struct video_desc desc);
  */
 struct video_frame * vf_alloc_desc_data(struct video_desc desc);
 
+/**
+ * @brief Accounts frame data to the memory owner of the calling thread
+ *
+ * The charge is released by vf_free(). Used by frame allocators, see
+ * module_set_mem_owner().
+ */
+void vf_mem_charge(struct video_frame *buf, size_t bytes);
+
 /**
  * @brief Frees video_frame structure
  *
@@ -179,6 +187,18 @@ void il_upper_to_merged(char *dst, char *src, int linesize, int height, void **s
  * @brief Converts interlaced merged to upper-field-first.
  */
 void il_merged_to_upper(char *dst, char *src, int linesize, int height, void **stored_state);
+/**
+ * @brief Returns the index of the line where il_upper_to_merged() puts source line
+ *
+ * Allows doing the conversion while the lines are written to the framebuffer,
+ * without another pass over the whole frame.
+ */
+int il_upper_to_merged_line(int line, int height);
+/**
+ * @brief Returns the index of the line where il_merged_to_upper() puts source line
+ * @sa il_upper_to_merged_line
+ */
+int il_merged_to_upper_line(int line, int height);
 
 /**
  * @brief Computes FPS as a double from packet fields.
@@ -192,6 +212,12 @@ bool save_video_frame_as_pnm(struct video_frame *frame, const char *name);
 const char *save_video_frame(struct video_frame *frame, const char *name, bool raw);
 
 void vf_copy_metadata(struct video_frame *desc, const struct video_frame *src);
+/**
+ * @returns host memory copy of a frame residing in CUDA device memory
+ *          (disposable with VIDEO_FRAME_DISPOSE) or NULL on error or if
+ *          compiled without CUDA
+ */
+struct video_frame *vf_download_cuda(struct video_frame *f);
 void vf_store_metadata(struct video_frame *f, void *);
 void vf_restore_metadata(struct video_frame *f, void *);
 
@@ -68,8 +68,50 @@
 #include "video_display.h"
 #include "video_rxtx.h"
 
+#define MOD_NAME "[video_rxtx] "
+
 using namespace std;
 
+ADD_TO_PARAM("sender-frame-policy", "* sender-frame-policy=<compress>[:<transmit>]\n"
+                "  Handling of a new frame while the next sender stage still hasn't taken the previous one,\n"
+                "  ahead of compression (default latest) and ahead of transmission (default auto):\n"
+                "    latest - the waiting frame is replaced by the new one (latency doesn't grow under overload)\n"
+                "    block  - wait for the stage (all frames are kept)\n"
+                "    auto   - latest except for inter-frame compressions (eg. H.264) ahead of transmission\n");
+
+/**
+ * @param[out] latest  drop the waiting frame
+ * @param[out] intra   drop it only if the compression is intra-frame (auto)
+ */
+static bool parse_frame_policy(string const &val, bool *latest, bool *intra)
+{
+        *intra = val == "auto";
+        *latest = val == "latest" || val == "auto";
+        return *latest || val == "block";
+}
+
+static void set_frame_policies(struct compress_state *compression, bool *compress_latest)
+{
+        const char *param = get_commandline_param("sender-frame-policy");
+        string compress_val = "latest";
+        string transmit_val = "auto";
+        if (param != nullptr) {
+                string cfg = param;
+                compress_val = cfg.substr(0, cfg.find(':'));
+                if (cfg.find(':') != string::npos) {
+                        transmit_val = cfg.substr(cfg.find(':') + 1);
+                }
+        }
+        bool intra = false;
+        bool transmit_latest = false;
+        if (!parse_frame_policy(compress_val, compress_latest, &intra)
+                        || !parse_frame_policy(transmit_val, &transmit_latest, &intra)) {
+                throw string("Wrong sender-frame-policy: ") + param;
+        }
+        compress_set_output_policy(compression, !transmit_latest ? COMPRESS_OUTPUT_BLOCK
+                        : intra ? COMPRESS_OUTPUT_LATEST_INTRA : COMPRESS_OUTPUT_LATEST);
+}
+
 video_rxtx::video_rxtx(map<string, param_u> const &params): m_port_id("default"), m_paused(params.at("paused").b),
                 m_report_paused_play(false), m_rxtx_mode(params.at("rxtx_mode").i),
                 m_parent(static_cast<struct module *>(params.at("parent").ptr)),
@@ -97,6 +139,9 @@ video_rxtx::video_rxtx(map<string, param_u> const &params): m_port_id("default")
                         }
                 }
 
+                set_frame_policies(m_compression, &m_compress_latest);
+                m_compress_in.set_name("compress_in");
+
                 pthread_mutex_init(&m_lock, NULL);
 
         } catch (...) {
@@ -134,6 +179,12 @@ void video_rxtx::start() {
                          (void *) this) != 0) {
                 throw string("Unable to create sender thread!\n");
         }
+        if (m_compress_latest) {
+                if (pthread_create(&m_compress_thread_id, NULL, video_rxtx::compress_thread, (void *) this) != 0) {
+                        throw string("Unable to create compress thread!\n");
+                }
+                m_compress_thread_started = true;
+        }
         m_joined = false;
 }
 
@@ -142,6 +193,13 @@ void video_rxtx::join() {
                 return;
         }
         send(NULL); // pass poisoned pill
+        if (m_compress_thread_started) {
+                pthread_join(m_compress_thread_id, NULL);
+                m_compress_thread_started = false;
+                if (m_compress_drops > 0) {
+                        log_msg(LOG_LEVEL_INFO, MOD_NAME "%llu frames replaced by newer ones before compression.\n", m_compress_drops);
+                }
+        }
         pthread_join(m_thread_id, NULL);
         m_joined = true;
 }
@@ -156,15 +214,49 @@ const char *video_rxtx::get_long_name(string const & short_name) {
 }
 
 void video_rxtx::send(shared_ptr<video_frame> frame) {
-        if (!frame && m_poisoned) {
+        const bool poison = !frame;
+        if (poison && m_poisoned) {
                 return;
         }
-        compress_frame(m_compression, frame);
-        if (!frame) {
+        if (m_compress_thread_started) {
+                if (poison) { // must not be replaced
+                        m_compress_in.push(nullptr);
+                } else if (m_compress_in.push_latest(std::move(frame))) {
+                        m_compress_drops += 1;
+                }
+        } else {
+                compress_frame(m_compression, std::move(frame));
+        }
+        if (poison) {
                 m_poisoned = true;
         }
 }
 
+void *video_rxtx::compress_thread(void *args) {
+        return static_cast<video_rxtx *>(args)->compress_loop();
+}
+
+/// compresses frames handed over by send() with the "latest wins" policy
+void *video_rxtx::compress_loop() {
+        set_thread_name(__func__);
+        while (true) {
+                shared_ptr<video_frame> frame = m_compress_in.pop();
+                bool poisoned = !frame;
+                compress_frame(m_compression, std::move(frame));
+                if (poisoned) {
+                        return NULL;
+                }
+        }
+}
+
+/**
+ * Lets the compression pass frames in parts to send_frame() (see
+ * compress_set_partial_output()), the exported stream needs whole frames.
+ */
+void video_rxtx::enable_partial_output() {
+        compress_set_partial_output(m_compression, m_exporter == nullptr);
+}
+
 void *video_rxtx::sender_thread(void *args) {
         return static_cast<video_rxtx *>(args)->sender_loop();
 }
@@ -196,16 +288,30 @@ void *video_rxtx::sender_loop() {
 
                 shared_ptr<video_frame> tx_frame;
 
-                tx_frame = compress_pop(m_compression);
+                if (time_ns_t deadline = held_frames_deadline()) {
+                        if (!compress_pop_until(m_compression, deadline, &tx_frame)) {
+                                send_held_frames();
+                                continue;
+                        }
+                } else {
+                        tx_frame = compress_pop(m_compression);
+                }
                 if (!tx_frame)
                         goto exit;
 
-                export_video(m_exporter, tx_frame.get());
+                if (m_exporter) {
+                        // the exporter holds the frame until written instead of copying it
+                        export_video_ref(m_exporter, tx_frame.get(),
+                                        [](void *f) { delete static_cast<shared_ptr<video_frame> *>(f); },
+                                        new shared_ptr<video_frame>(tx_frame));
+                }
 
                 tx_frame->paused_play = ret == STREAM_PAUSED_PLAY;
 
                 send_frame(tx_frame);
-                m_frames_sent += 1;
+                if (!tx_frame->fragment || tx_frame->last_fragment) {
+                        m_frames_sent += 1;
+                }
         }
 
 exit:
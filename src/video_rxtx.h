@@ -44,6 +44,8 @@
 #include <string>
 
 #include "module.h"
+#include "tv.h"
+#include "utils/lockfree_queue.h"
 
 #define VIDEO_RXTX_ABI_VERSION 2
 
@@ -96,6 +98,7 @@ public:
 protected:
         video_rxtx(std::map<std::string, param_u> const &);
         int check_sender_messages();
+        void enable_partial_output();
         bool m_paused;
         bool m_report_paused_play;
         struct module m_sender_mod;
@@ -106,9 +109,15 @@ protected:
 private:
         void start();
         virtual void send_frame(std::shared_ptr<video_frame>) = 0;
+        /// @returns time (get_time_in_ns()) until which frames held back by send_frame()
+        ///          are to be sent with send_held_frames() if no other frame comes, 0 if none
+        virtual time_ns_t held_frames_deadline() { return 0; }
+        virtual void send_held_frames() {}
         virtual void *(*get_receiver_thread())(void *arg) = 0;
         static void *sender_thread(void *args);
         void *sender_loop();
+        static void *compress_thread(void *args);
+        void *compress_loop();
         virtual struct response *process_sender_message(struct msg_sender *, int *status) {
                 *status = 0;
                 return NULL;
@@ -120,6 +129,12 @@ private:
 
         pthread_t m_thread_id;
         bool m_poisoned, m_joined;
+
+        bool m_compress_latest = true; ///< "latest wins" slot ahead of compression
+        lockfree_queue<std::shared_ptr<video_frame>, 1> m_compress_in; ///< used if m_compress_thread_started
+        pthread_t m_compress_thread_id{};
+        bool m_compress_thread_started = false;
+        unsigned long long m_compress_drops = 0;
 };
 
 class video_rxtx_loader {
@@ -0,0 +1,102 @@
+/**
+ * @file   video_rxtx/abr.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // defined HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+#include "tfrc.h"
+#include "video_rxtx/abr.h"
+
+#define LOSS_HIGH            0.02  ///< loss that triggers decrease
+#define LOSS_LOW             0.005 ///< max loss at which the bitrate may grow
+#define JITTER_FLOOR_MS      5.0   ///< jitter below this is never considered as congestion
+#define DECREASE_INTERVAL    NS_IN_SEC      ///< RR still reflects previous rate shortly after decrease
+#define INCREASE_HOLD        (3 * NS_IN_SEC) ///< no increase for this time after decrease
+#define INCREASE_INTERVAL    (2 * NS_IN_SEC)
+#define INCREASE_STEP        0.05  ///< additive step (fraction of max bitrate)
+#define MIN_CHANGE           0.05  ///< relative changes smaller than this are not signalized
+
+abr_controller::abr_controller(long long min_bitrate, long long max_bitrate, unsigned packet_size) :
+        m_min_bitrate(min_bitrate), m_max_bitrate(max_bitrate), m_bitrate(max_bitrate),
+        m_packet_size(packet_size)
+{
+        assert(min_bitrate > 0 && min_bitrate <= max_bitrate);
+}
+
+long long abr_controller::update(time_ns_t now, double loss, double jitter_ms, double rtt)
+{
+        if (m_jitter_baseline < 0.0 || jitter_ms < m_jitter_baseline) {
+                m_jitter_baseline = jitter_ms;
+        } else { // let the baseline follow a lasting change slowly
+                m_jitter_baseline += 0.05 * (jitter_ms - m_jitter_baseline);
+        }
+        const bool delay_congestion = jitter_ms > std::max(2.0 * m_jitter_baseline, JITTER_FLOOR_MS);
+
+        long long target = m_bitrate;
+        if (loss > LOSS_HIGH || delay_congestion) {
+                if (now - m_last_decrease < DECREASE_INTERVAL) {
+                        return 0;
+                }
+                double factor = loss > LOSS_HIGH ? std::clamp(1.0 - 2.0 * loss, 0.5, 0.9) : 0.9;
+                target = m_bitrate * factor;
+                // RR carries the packet loss fraction, not the loss event rate, so this errs on the safe side
+                double tfrc_bitrate = tfrc_equation_rate(m_packet_size, rtt, loss) * 8;
+                if (tfrc_bitrate > 0) {
+                        target = std::min<long long>(target, tfrc_bitrate);
+                }
+                target = std::max(target, m_min_bitrate);
+                m_last_decrease = now;
+        } else if (loss < LOSS_LOW && now - m_last_decrease >= INCREASE_HOLD
+                        && now - m_last_increase >= INCREASE_INTERVAL) {
+                target = std::min<long long>(m_bitrate + m_max_bitrate * INCREASE_STEP, m_max_bitrate);
+                m_last_increase = now;
+        }
+
+        // clamped values are always signalized so that the range ends are reached
+        if (target == m_bitrate || (target != m_min_bitrate && target != m_max_bitrate
+                                && std::abs(target - m_bitrate) < m_bitrate * MIN_CHANGE)) {
+                return 0;
+        }
+        m_bitrate = target;
+        return m_bitrate;
+}
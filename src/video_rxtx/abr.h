@@ -0,0 +1,78 @@
+/**
+ * @file   video_rxtx/abr.h
+ * @brief  sender bitrate controller driven by RTCP receiver reports
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef VIDEO_RXTX_ABR_H_
+#define VIDEO_RXTX_ABR_H_
+
+#include "tv.h"
+
+/**
+ * @brief AIMD bitrate controller
+ *
+ * Fed with the loss fraction and interarrival jitter reported by the
+ * receivers (RTCP RR). Bitrate is decreased multiplicatively on loss or
+ * if the jitter rises well above its observed baseline (queue build-up on
+ * the path), otherwise it is slowly increased back toward the maximum.
+ * If the round-trip time is known, the decreased bitrate is also capped by
+ * the TFRC throughput equation so that a lossy path is left quickly.
+ *
+ * Since changing the encoder bitrate usually reinitializes the encoder,
+ * the changes are rate-limited and the small ones are suppressed.
+ */
+class abr_controller {
+public:
+        abr_controller(long long min_bitrate, long long max_bitrate, unsigned packet_size = 1500);
+        /**
+         * @param loss      fraction of lost packets (0.0-1.0)
+         * @param jitter_ms interarrival jitter in milliseconds
+         * @param rtt       round-trip time in seconds (0 if unknown)
+         * @returns         new bitrate to be set or 0 if it should be kept
+         */
+        long long update(time_ns_t now, double loss, double jitter_ms, double rtt = 0.0);
+        long long get_bitrate() const { return m_bitrate; }
+
+private:
+        long long m_min_bitrate;
+        long long m_max_bitrate;
+        long long m_bitrate;
+        unsigned  m_packet_size;
+        double    m_jitter_baseline = -1.0;
+        time_ns_t m_last_decrease = 0;
+        time_ns_t m_last_increase = 0;
+};
+
+#endif // VIDEO_RXTX_ABR_H_
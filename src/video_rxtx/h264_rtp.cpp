@@ -52,12 +52,17 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <algorithm>
+
 #include "compat/misc.h"
+#include "debug.h"
 #include "host.h"
 #include "lib_common.h"
 #include "transmit.h"
 #include "tv.h"
+#include "messaging.h"
 #include "rtp/rtp.h"
+#include "rtp/rtp_callback.h"
 #include "rtp/rtpenc_h264.h"
 #include "utils/color_out.h"
 #include "video_rxtx.h"
@@ -83,31 +88,80 @@ h264_rtp_video_rxtx::h264_rtp_video_rxtx(std::map<std::string, param_u> const &p
 
 void h264_rtp_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame)
 {
-        if (m_connections_count == 1) { /* normal/default case - only one connection */
-            tx_send_h264(m_tx, tx_frame.get(), m_network_devices[0]);
-        } else {
-            //TODO to be tested, the idea is to reply per destiny
-                for (int i = 0; i < m_connections_count; ++i) {
-                    tx_send_h264(m_tx, tx_frame.get(),
-                                        m_network_devices[i]);
-                }
-        }
+        // with RTSP clients connected the frame is sent only to them, the
+        // configured receiver(s) otherwise
+        const bool to_clients = !m_client_sessions.empty();
+        struct rtp **sessions = to_clients ? m_client_sessions.data() : m_network_devices;
+        const int session_count = to_clients ? (int) m_client_sessions.size() : m_connections_count;
+        tx_send_h264_multi(m_tx, tx_frame.get(), sessions, session_count);
+
         if ((m_rxtx_mode & MODE_RECEIVER) == 0) { // send RTCP (receiver thread would otherwise do this
                 time_ns_t curr_time = get_time_in_ns();
                 uint32_t ts = (curr_time - m_start_time) / 100'000 * 9; // at 90000 Hz
-                rtp_update(m_network_devices[0], curr_time);
-                rtp_send_ctrl(m_network_devices[0], ts, 0, curr_time);
-
-                // receive RTCP
-                struct timeval timeout;
-                timeout.tv_sec = 0;
-                timeout.tv_usec = 0;
-                rtp_recv_r(m_network_devices[0], &timeout, ts);
+                for (int i = 0; i < (to_clients ? session_count : 1); ++i) {
+                        rtp_update(sessions[i], curr_time);
+                        rtp_send_ctrl(sessions[i], ts, 0, curr_time);
+
+                        // receive RTCP
+                        struct timeval timeout;
+                        timeout.tv_sec = 0;
+                        timeout.tv_usec = 0;
+                        rtp_recv_r(sessions[i], &timeout, ts);
+                }
+        }
+}
+
+/**
+ * Handles adding and removing of the RTSP clients, other messages are
+ * processed by rtp_video_rxtx. Each client gets its own RTP session (and
+ * thus SSRC and sequence numbers) but the packets are shared.
+ */
+struct response *h264_rtp_video_rxtx::process_sender_message(struct msg_sender *msg, int *status)
+{
+        switch (msg->type) {
+        case SENDER_MSG_ADD_CLIENT: {
+                *status = 0;
+                lock_guard<mutex> lock(m_network_devices_lock);
+                if (m_clients.find(msg->client.id) != m_clients.end()) {
+                        return new_response(RESPONSE_BAD_REQUEST, "Client already exists!");
+                }
+                struct rtp *session = rtp_init_if(msg->client.addr, m_requested_mcast_if, 0, msg->client.port,
+                                m_requested_ttl, 5 * 1024 * 1024, FALSE, rtp_recv_callback,
+                                (uint8_t *) m_participants, m_force_ip_version, false);
+                if (session == nullptr) {
+                        log_msg(LOG_LEVEL_ERROR, "[RTSP SERVER] Unable to add client %s:%d!\n",
+                                        msg->client.addr, msg->client.port);
+                        return new_response(RESPONSE_INT_SERV_ERR, "Adding client failed!");
+                }
+                m_clients[msg->client.id] = session;
+                m_client_sessions.push_back(session);
+                log_msg(LOG_LEVEL_NOTICE, "[RTSP SERVER] Added client %s:%d (%zu clients).\n",
+                                msg->client.addr, msg->client.port, m_clients.size());
+                return new_response(RESPONSE_OK, NULL);
+        }
+        case SENDER_MSG_REMOVE_CLIENT: {
+                *status = 0;
+                lock_guard<mutex> lock(m_network_devices_lock);
+                auto it = m_clients.find(msg->client.id);
+                if (it == m_clients.end()) {
+                        return new_response(RESPONSE_NOT_FOUND, NULL);
+                }
+                m_client_sessions.erase(std::find(m_client_sessions.begin(), m_client_sessions.end(), it->second));
+                rtp_done(it->second);
+                m_clients.erase(it);
+                log_msg(LOG_LEVEL_NOTICE, "[RTSP SERVER] Removed client (%zu clients).\n", m_clients.size());
+                return new_response(RESPONSE_OK, NULL);
+        }
+        default:
+                return rtp_video_rxtx::process_sender_message(msg, status);
         }
 }
 
 h264_rtp_video_rxtx::~h264_rtp_video_rxtx()
 {
+        for (auto *session : m_client_sessions) {
+                rtp_done(session);
+        }
 #ifdef HAVE_RTSP_SERVER
         c_stop_server(m_rtsp_server);
         free(m_rtsp_server);
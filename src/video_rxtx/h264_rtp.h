@@ -46,6 +46,9 @@
 #include "video_rxtx.h"
 #include "video_rxtx/rtp.h"
 
+#include <map>
+#include <vector>
+
 class h264_rtp_video_rxtx : public rtp_video_rxtx {
 public:
         h264_rtp_video_rxtx(std::map<std::string, param_u> const &, int);
@@ -55,7 +58,10 @@ private:
         virtual void *(*get_receiver_thread())(void *arg) {
                 return NULL;
         }
+        struct response *process_sender_message(struct msg_sender *msg, int *status) override;
         rtsp_serv_t *m_rtsp_server;
+        std::map<unsigned, struct rtp *> m_clients; ///< RTSP clients by session ID
+        std::vector<struct rtp *> m_client_sessions; ///< sessions of m_clients, passed to tx_send_h264_multi()
 };
 
 #endif // VIDEO_RXTX_H264_RTP_H_
@@ -79,6 +79,7 @@ h264_sdp_video_rxtx::h264_sdp_video_rxtx(std::map<std::string, param_u> const &p
         if (int ret = sdp_set_options(opts)) {
                 throw ret == 1 ? 0 : 1;
         }
+        enable_partial_output(); // tx_send_h264() sends the slices as they are compressed
 }
 
 void send_change_address_message(struct module *root, enum module_class *path, const char *address) {
@@ -53,6 +53,8 @@
 #include "debug.h"
 #include "host.h"
 #include "lib_common.h"
+#include "tv.h"
+#include "utils/frame_trace.h"
 #include "utils/thread.h"
 #include "video_display.h"
 #include "video_frame.h"
@@ -83,6 +85,12 @@ void *loopback_video_rxtx::receiver_thread(void *arg)
 
 void loopback_video_rxtx::send_frame(std::shared_ptr<video_frame> f)
 {
+        if (frame_trace_enabled()) {
+                struct frame_trace trace{};
+                trace.t[FT_CAPTURE] = f->capture_time;
+                trace.t[FT_TX_FIRST] = get_time_in_ns();
+                frame_trace_sender_done(&trace, nullptr);
+        }
         unique_lock<mutex> lk(m_lock);
         if (m_frames.size() >= BUFF_MAX_LEN) {
                 LOG(LOG_LEVEL_WARNING) << MODULE_NAME << "Max buffer len " <<
@@ -118,6 +126,12 @@ void *loopback_video_rxtx::receiver_loop()
                 auto display_f = display_get_frame(m_display_device);
                 memcpy(display_f->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
                 display_put_frame(m_display_device, display_f, PUTF_BLOCKING);
+                if (frame_trace_enabled()) {
+                        struct frame_trace trace{};
+                        trace.t[FT_CAPTURE] = frame->capture_time;
+                        trace.t[FT_PUTF] = get_time_in_ns();
+                        frame_trace_receiver_done(&trace);
+                }
         }
         display_put_frame(m_display_device, nullptr, PUTF_BLOCKING);
         return nullptr;
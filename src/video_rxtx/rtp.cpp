@@ -46,6 +46,7 @@
 
 #include "debug.h"
 
+#include <algorithm>
 #include <cinttypes>
 #include <sstream>
 #include <string>
@@ -55,8 +56,11 @@
 #include "ihdtv.h"
 #include "messaging.h"
 #include "module.h"
+#include "ntp.h"
 #include "pdb.h"
 #include "rtp/fec.h"
+#include "rtp/fec_group.h"
+#include "rtp/net_udp.h"
 #include "rtp/rtp.h"
 #include "rtp/video_decoders.h"
 #include "rtp/pbuf.h"
@@ -65,6 +69,7 @@
 #include "transmit.h"
 #include "tv.h"
 #include "ug_runtime_error.hpp"
+#include "utils/misc.h"
 #include "utils/net.h" // IN6_BLACKHOLE_STR
 #include "utils/vf_split.h"
 #include "video.h"
@@ -72,6 +77,10 @@
 #include "video_decompress.h"
 #include "video_display.h"
 #include "video_rxtx.h"
+#include "video_rxtx/abr.h"
+
+#define DEFAULT_RETX_RING_PACKETS 2048
+#define DEFAULT_KEYFRAME_MIN_INTERVAL_MS 500
 
 using namespace std;
 
@@ -154,7 +163,7 @@ struct response *rtp_video_rxtx::process_sender_message(struct msg_sender *msg,
                                 if (strcmp(msg->fec_cfg, "flush") == 0) {
                                         delete old_fec_state;
                                 } else {
-                                        m_fec_state = fec::create_from_config(msg->fec_cfg);
+                                        m_fec_state = fec_frame_group::create(fec::create_from_config(msg->fec_cfg));
                                         if (!m_fec_state) {
                                                 m_fec_state = old_fec_state;
                                                 if (strstr(msg->fec_cfg, "help") != nullptr || m_frames_sent == 0ULL) { // -f LDGM:help or so + init
@@ -201,6 +210,8 @@ struct response *rtp_video_rxtx::process_sender_message(struct msg_sender *msg,
                         break;
                 case SENDER_MSG_GET_STATUS:
                 case SENDER_MSG_MUTE:
+                case SENDER_MSG_ADD_CLIENT:
+                case SENDER_MSG_REMOVE_CLIENT:
                         log_msg(LOG_LEVEL_ERROR, "Unexpected message!\n");
                         break;
         }
@@ -208,6 +219,16 @@ struct response *rtp_video_rxtx::process_sender_message(struct msg_sender *msg,
         return new_response(RESPONSE_OK, NULL);
 }
 
+ADD_TO_PARAM("rtp-nack", "* rtp-nack[=<packets>]\n"
+                "  Request retransmission of lost video packets with RTCP NACK (receiver) and keep last <packets>\n"
+                "  sent packets to serve them (sender, default " TOSTRING(DEFAULT_RETX_RING_PACKETS) "), set on both sides\n");
+ADD_TO_PARAM("video-abr", "* video-abr=<max_bitrate>[:<min_bitrate>]\n"
+                "  Adapt the video compression bitrate (libavcodec) in the given range according to loss and jitter\n"
+                "  reported by receivers in RTCP RRs (default min is max/10), with default -l also the sender pacing\n");
+ADD_TO_PARAM("keyframe-requests", "* keyframe-requests=<min_interval_ms>|disable\n"
+                "  Request a keyframe with RTCP PLI after an unrecoverable loss of an inter-frame compressed stream (receiver)\n"
+                "  and force it in the compression upon the request (sender), at most once per interval (default "
+                TOSTRING(DEFAULT_KEYFRAME_MIN_INTERVAL_MS) " ms)\n");
 rtp_video_rxtx::rtp_video_rxtx(map<string, param_u> const &params) :
         video_rxtx(params), m_fec_state(NULL), m_start_time(params.at("start_time").ll), m_video_desc{}
 {
@@ -238,6 +259,35 @@ rtp_video_rxtx::rtp_video_rxtx(map<string, param_u> const &params) :
                                         params.at("bitrate").ll)) == NULL) {
                 throw ug_runtime_error("Unable to initialize transmitter", EXIT_FAIL_TRANSMIT);
         }
+        if (long long bitrate = params.at("bitrate").ll; bitrate > 0) {
+                // the send buffer holds the data of SEND_BUF_DURATION at the requested rate
+                int size = std::max(udp_buf_size_for_rate(bitrate & ~RATE_FLAG_FIXED_RATE, SEND_BUF_DURATION),
+                                INITIAL_VIDEO_SEND_BUFFER_SIZE);
+                for (struct rtp **d = m_network_devices; *d != nullptr; ++d) {
+                        if (!rtp_set_send_buf(*d, size)) {
+                                log_msg(LOG_LEVEL_VERBOSE, "Unable to set send buffer size to %d B.\n", size);
+                        }
+                }
+        }
+
+        if (const char *abr = get_commandline_param("video-abr")) {
+                long long max_bitrate = unit_evaluate(abr);
+                long long min_bitrate = strchr(abr, ':') != nullptr ? unit_evaluate(strchr(abr, ':') + 1) : max_bitrate / 10;
+                if (max_bitrate <= 0 || min_bitrate <= 0 || min_bitrate > max_bitrate) {
+                        throw ug_runtime_error("Wrong video-abr specification: "s + abr, EXIT_FAIL_USAGE);
+                }
+                m_abr = make_unique<abr_controller>(min_bitrate, max_bitrate, params.at("mtu").i);
+                // pace also the sender unless the user has set the rate explicitly
+                m_abr_shape_tx = params.at("bitrate").ll == RATE_AUTO || params.at("bitrate").ll == RATE_DYNAMIC;
+        }
+
+        if (const char *kf = get_commandline_param("keyframe-requests"); kf == nullptr || strcmp(kf, "disable") != 0) {
+                long long interval_ms = kf != nullptr ? strtoll(kf, nullptr, 10) : DEFAULT_KEYFRAME_MIN_INTERVAL_MS;
+                if (interval_ms <= 0) {
+                        throw ug_runtime_error("Wrong keyframe-requests interval: "s + kf, EXIT_FAIL_USAGE);
+                }
+                m_keyframe_min_interval = interval_ms * NS_IN_MS;
+        }
 
         // The idea of doing that is to display help on '-f ldgm:help' even if UG would exit
         // immediatelly. The encoder is actually created by a message.
@@ -261,6 +311,109 @@ rtp_video_rxtx::~rtp_video_rxtx()
         delete m_fec_state;
 }
 
+/**
+ * Looks up receiver reports about our stream received since the last call and
+ * passes the worst of them to the ABR controller. Must be called from the
+ * thread that receives RTCP.
+ */
+void rtp_video_rxtx::abr_process_reports()
+{
+        if (!m_abr) {
+                return;
+        }
+        struct rtp *session = m_network_devices[0];
+        const uint32_t my_ssrc = rtp_my_ssrc(session);
+        double loss = -1.0;
+        double jitter_ms = 0.0;
+        double rtt = 0.0;
+        uint32_t ntp_sec, ntp_frac;
+        ntp64_time(&ntp_sec, &ntp_frac);
+        const uint32_t now_ntp32 = ntp64_to_ntp32(ntp_sec, ntp_frac);
+
+        pdb_iter_t it;
+        for (struct pdb_e *cp = pdb_iter_init(m_participants, &it); cp != nullptr; cp = pdb_iter_next(&it)) {
+                const rtcp_rr *rr = rtp_get_rr(session, cp->ssrc, my_ssrc);
+                if (rr == nullptr) {
+                        continue;
+                }
+                auto last = m_abr_last_seq.find(cp->ssrc);
+                if (last != m_abr_last_seq.end() && last->second == rr->last_seq) {
+                        continue;
+                }
+                m_abr_last_seq[cp->ssrc] = rr->last_seq;
+                loss = max(loss, rr->fract_lost / 256.0);
+                jitter_ms = max(jitter_ms, rr->jitter / 90.0); // video RTP clock is 90 kHz
+                if (rr->lsr != 0 && now_ntp32 - rr->lsr >= rr->dlsr) {
+                        rtt = max(rtt, (now_ntp32 - rr->lsr - rr->dlsr) / 65536.0);
+                }
+        }
+        pdb_iter_done(&it);
+
+        if (loss < 0.0) {
+                return;
+        }
+        long long bitrate = m_abr->update(get_time_in_ns(), loss, jitter_ms, rtt);
+        if (bitrate == 0) {
+                return;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, "[ABR] Receivers report loss %.2f%%, jitter %.2f ms, RTT %.2f ms, setting bitrate to %s.\n",
+                        loss * 100.0, jitter_ms, rtt * 1000.0, format_in_si_units(bitrate));
+        if (m_abr_shape_tx) {
+                // capped (not fixed) rate with headroom for FEC and I-frames
+                auto *tx_msg = (struct msg_universal *) new_message(sizeof(struct msg_universal));
+                snprintf(tx_msg->text, sizeof tx_msg->text, MSG_UNIVERSAL_TAG_TX "rate %lld", bitrate * 3 / 2);
+                free_response(send_message_to_receiver(CAST_MODULE(m_tx), (struct message *) tx_msg));
+        }
+        auto *msg = (struct msg_change_compress_data *) new_message(sizeof(struct msg_change_compress_data));
+        msg->what = CHANGE_PARAMS;
+        snprintf(msg->config_string, sizeof msg->config_string, "bitrate=%lld", bitrate);
+        free_response(send_message_to_addr(get_root_module(m_parent), &m_abr_compress_addr, (struct message *) msg));
+}
+
+/**
+ * Forces a keyframe in the compression if a receiver has requested it with
+ * RTCP PLI/FIR since the last call. Requests of multiple receivers (or the
+ * repeated ones) within the interval are served by a single keyframe.
+ */
+void rtp_video_rxtx::keyframe_process_requests()
+{
+        if (m_keyframe_min_interval == 0 || rtp_take_keyframe_requests(m_network_devices[0]) == 0) {
+                return;
+        }
+        const time_ns_t now = get_time_in_ns();
+        if (now - m_keyframe_last_forced < m_keyframe_min_interval) {
+                log_msg(LOG_LEVEL_DEBUG, "[keyframe] Request ignored, keyframe forced %.1f ms ago.\n",
+                                (now - m_keyframe_last_forced) / (double) NS_IN_MS);
+                return;
+        }
+        m_keyframe_last_forced = now;
+        log_msg(LOG_LEVEL_VERBOSE, "[keyframe] Receiver requested a keyframe, forcing it.\n");
+        auto *msg = (struct msg_change_compress_data *) new_message(sizeof(struct msg_change_compress_data));
+        msg->what = CHANGE_PARAMS;
+        snprintf(msg->config_string, sizeof msg->config_string, "keyframe");
+        free_response(send_message_to_addr(get_root_module(m_parent), &m_abr_compress_addr, (struct message *) msg));
+}
+
+/**
+ * Sends RTCP PLI to the participant if its decoder has lost a frame of an
+ * inter-frame compressed stream, at most once per the interval (the
+ * keyframe takes at least a RTT to arrive).
+ */
+void rtp_video_rxtx::keyframe_request_if_needed(struct pdb_e *cp, time_ns_t now)
+{
+        if (m_keyframe_min_interval == 0 || cp->decoder_state == nullptr
+                        || !video_decoder_keyframe_needed(((struct vcodec_state *) cp->decoder_state)->decoder)) {
+                return;
+        }
+        time_ns_t &last = m_keyframe_last_request[cp->ssrc];
+        if (now - last < m_keyframe_min_interval) {
+                return;
+        }
+        last = now;
+        log_msg(LOG_LEVEL_VERBOSE, "[keyframe] Loss in the stream of 0x%08" PRIx32 ", requesting a keyframe.\n", cp->ssrc);
+        rtp_send_keyframe_request(m_network_devices[0], cp->ssrc, false);
+}
+
 void rtp_video_rxtx::display_buf_increase_warning(int size)
 {
         log_msg(LOG_LEVEL_VERBOSE, "\n***\n"
@@ -352,6 +505,12 @@ struct rtp **rtp_video_rxtx::initialize_network(const char *addrs, int recv_port
                 rtp_set_sdes(devices[index], rtp_my_ssrc(devices[index]),
                         RTCP_SDES_TOOL,
                         PACKAGE_STRING, strlen(PACKAGE_STRING));
+                if (const char *nack = get_commandline_param("rtp-nack")) {
+                        int packets = strlen(nack) > 0 ? atoi(nack) : DEFAULT_RETX_RING_PACKETS;
+                        if (packets <= 0 || !rtp_set_retransmission_ring(devices[index], packets)) {
+                                log_msg(LOG_LEVEL_ERROR, "Unable to set retransmission ring of %s packets!\n", nack);
+                        }
+                }
                 if (strcmp(addr, IN6_BLACKHOLE_STR) == 0) {
                         rtp_set_option(devices[index], RTP_OPT_SEND_BACK,
                                         TRUE);
@@ -41,6 +41,9 @@
 #include "tv.h"
 #include "video_rxtx.h"
 
+#include <cstdint>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 
@@ -51,9 +54,11 @@
 #endif
 
 #define INITIAL_VIDEO_SEND_BUFFER_SIZE  (1024*1024)
+#define SEND_BUF_DURATION 0.05 ///< s, send buffer is sized to hold this long data at fixed bitrate
 
 struct rtp;
 struct fec;
+class abr_controller;
 
 class rtp_video_rxtx : public video_rxtx {
         friend class video_rxtx;
@@ -82,8 +87,19 @@ protected:
         fec             *m_fec_state;
         time_ns_t        m_start_time;
         video_desc       m_video_desc;
+
+        void abr_process_reports();
+        void keyframe_process_requests();
+        void keyframe_request_if_needed(struct pdb_e *cp, time_ns_t now);
+        struct response *process_sender_message(struct msg_sender *i, int *status) override;
 private:
-        struct response *process_sender_message(struct msg_sender *i, int *status);
+        std::unique_ptr<abr_controller> m_abr;
+        bool m_abr_shape_tx = false;
+        struct module_addr m_abr_compress_addr = MODULE_ADDR_INIT("sender.compress");
+        std::map<uint32_t, uint32_t> m_abr_last_seq; ///< last processed RR per reporter (ext. highest seq)
+        time_ns_t m_keyframe_min_interval = 0; ///< min. interval of keyframe requests (receiver) and forced keyframes (sender), 0 - disabled
+        time_ns_t m_keyframe_last_forced = 0;
+        std::map<uint32_t, time_ns_t> m_keyframe_last_request; ///< per sender SSRC
 };
 
 #endif // VIDEO_RXTX_RTP_H_
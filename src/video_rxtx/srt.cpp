@@ -0,0 +1,357 @@
+/**
+ * @file   video_rxtx/srt.cpp
+ * @brief  UltraGrid RTP over SRT (Secure Reliable Transport)
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include "video_rxtx/srt.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "compat/misc.h"
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "rtp/net_udp.h"
+#include "rtp/rtp.h"
+#include "ug_runtime_error.hpp"
+#include "utils/color_out.h"
+#include "utils/thread.h"
+
+#define MOD_NAME "[SRT] "
+#define DEFAULT_LATENCY_MS 120
+#define RELAY_TIMEOUT_MS 100
+#define CONNECT_TIMEOUT_MS 1000
+
+using std::string;
+
+srt_video_rxtx::srt_video_rxtx(std::map<std::string, param_u> const &params, srt_video_rxtx_conf conf, fd_t relay_fd) :
+        ultragrid_rtp_video_rxtx(params), m_conf(std::move(conf)), m_relay_fd(relay_fd)
+{
+        struct sockaddr_in *local = reinterpret_cast<struct sockaddr_in *>(&m_local_rtp);
+        memset(&m_local_rtp, 0, sizeof m_local_rtp);
+        local->sin_family = AF_INET;
+        local->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        local->sin_port = htons(rtp_get_udp_rx_port(m_network_devices[0]));
+        m_local_rtp_len = sizeof(struct sockaddr_in);
+
+        srt_startup();
+        m_eid = srt_epoll_create();
+        int events = SRT_EPOLL_IN | SRT_EPOLL_ERR;
+        if (m_eid < 0 || srt_epoll_add_ssock(m_eid, m_relay_fd, &events) != 0) {
+                srt_cleanup();
+                throw ug_runtime_error(string("Unable to create SRT epoll: ") + srt_getlasterror_str(), EXIT_FAIL_NETWORK);
+        }
+
+        if (!m_conf.caller) {
+                m_listen_sock = srt_create_socket();
+                struct sockaddr_in6 sa{};
+                sa.sin6_family = AF_INET6;
+                sa.sin6_addr = in6addr_any;
+                sa.sin6_port = htons(m_conf.port);
+                int v6only = 0;
+                if (m_listen_sock == SRT_INVALID_SOCK || !configure_socket(m_listen_sock)
+                                || srt_setsockflag(m_listen_sock, SRTO_IPV6ONLY, &v6only, sizeof v6only) != 0
+                                || srt_bind(m_listen_sock, reinterpret_cast<struct sockaddr *>(&sa), sizeof sa) != 0
+                                || srt_listen(m_listen_sock, 1) != 0
+                                || srt_epoll_add_usock(m_eid, m_listen_sock, &events) != 0) {
+                        string err = srt_getlasterror_str();
+                        if (m_listen_sock != SRT_INVALID_SOCK) {
+                                srt_close(m_listen_sock);
+                        }
+                        srt_epoll_release(m_eid);
+                        srt_cleanup();
+                        throw ug_runtime_error("Unable to listen on SRT port " + std::to_string(m_conf.port) + ": " + err, EXIT_FAIL_NETWORK);
+                }
+                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Listening on port %d.\n", m_conf.port);
+        }
+
+        m_relay_thread = std::thread(&srt_video_rxtx::relay_loop, this);
+}
+
+srt_video_rxtx::~srt_video_rxtx()
+{
+        m_relay_should_exit = true;
+        m_relay_thread.join();
+        close_peer();
+        if (m_listen_sock != SRT_INVALID_SOCK) {
+                srt_close(m_listen_sock);
+        }
+        srt_epoll_release(m_eid);
+        srt_cleanup();
+        CLOSESOCKET(m_relay_fd);
+}
+
+/// sets the options that are inherited by the accepted sockets (must be set before connect/listen)
+bool srt_video_rxtx::configure_socket(SRTSOCKET sock)
+{
+        SRT_TRANSTYPE tt = SRTT_LIVE;
+        int payload_size = SRT_LIVE_MAX_PLSIZE;
+        int conn_timeout = CONNECT_TIMEOUT_MS;
+        bool no = false;
+        if (srt_setsockflag(sock, SRTO_TRANSTYPE, &tt, sizeof tt) != 0
+                        || srt_setsockflag(sock, SRTO_PAYLOADSIZE, &payload_size, sizeof payload_size) != 0
+                        || srt_setsockflag(sock, SRTO_LATENCY, &m_conf.latency_ms, sizeof m_conf.latency_ms) != 0
+                        || srt_setsockflag(sock, SRTO_CONNTIMEO, &conn_timeout, sizeof conn_timeout) != 0
+                        || srt_setsockflag(sock, SRTO_RCVSYN, &no, sizeof no) != 0) {
+                return false;
+        }
+        if (!m_conf.passphrase.empty() && srt_setsockflag(sock, SRTO_PASSPHRASE, m_conf.passphrase.c_str(),
+                                m_conf.passphrase.length()) != 0) {
+                return false;
+        }
+        if (!m_conf.filter.empty() && srt_setsockflag(sock, SRTO_PACKETFILTER, m_conf.filter.c_str(),
+                                m_conf.filter.length()) != 0) {
+                return false;
+        }
+        return true;
+}
+
+/**
+ * Connects to the peer (caller). The listener accepts the connection in
+ * relay_loop() when the listening socket becomes readable.
+ */
+bool srt_video_rxtx::open_peer()
+{
+        struct addrinfo hints{};
+        struct addrinfo *res = nullptr;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+        if (getaddrinfo(m_conf.host.c_str(), std::to_string(m_conf.port).c_str(), &hints, &res) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to resolve %s!\n", m_conf.host.c_str());
+                return false;
+        }
+        SRTSOCKET sock = srt_create_socket();
+        bool ret = sock != SRT_INVALID_SOCK && configure_socket(sock)
+                && srt_connect(sock, res->ai_addr, res->ai_addrlen) != SRT_ERROR;
+        freeaddrinfo(res);
+        int events = SRT_EPOLL_IN | SRT_EPOLL_ERR;
+        if (!ret || srt_epoll_add_usock(m_eid, sock, &events) != 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Unable to connect to %s:%d: %s\n", m_conf.host.c_str(),
+                                m_conf.port, srt_getlasterror_str());
+                if (sock != SRT_INVALID_SOCK) {
+                        srt_close(sock);
+                }
+                return false;
+        }
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Connected to %s:%d.\n", m_conf.host.c_str(), m_conf.port);
+        m_sock = sock;
+        return true;
+}
+
+void srt_video_rxtx::close_peer()
+{
+        if (m_sock == SRT_INVALID_SOCK) {
+                return;
+        }
+        SRT_TRACEBSTATS stats{};
+        if (srt_bstats(m_sock, &stats, 0) == 0) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Connection stats: %" PRId64 " packets sent, %d retransmitted, "
+                                "%" PRId64 " received, %d lost, %d dropped.\n", stats.pktSentTotal,
+                                stats.pktRetransTotal, stats.pktRecvTotal, stats.pktRcvLossTotal,
+                                stats.pktRcvDropTotal);
+        }
+        srt_epoll_remove_usock(m_eid, m_sock);
+        srt_close(m_sock);
+        m_sock = SRT_INVALID_SOCK;
+}
+
+/**
+ * Forwards the RTP datagrams of the base class to the peer and the messages
+ * received from the peer to the base class receiving socket. Datagrams are
+ * dropped while no peer is connected.
+ */
+void srt_video_rxtx::relay_loop()
+{
+        set_thread_name("srt_relay");
+        auto buf = std::make_unique<char[]>(UINT16_MAX);
+        auto last_connect = std::chrono::steady_clock::time_point();
+        bool warned_too_big = false;
+
+        while (!m_relay_should_exit) {
+                if (m_conf.caller && m_sock == SRT_INVALID_SOCK
+                                && std::chrono::steady_clock::now() - last_connect >= std::chrono::seconds(1)) {
+                        last_connect = std::chrono::steady_clock::now();
+                        open_peer();
+                }
+
+                SRTSOCKET ready[2];
+                int ready_count = 2;
+                SYSSOCKET sys_ready[1];
+                int sys_ready_count = 1;
+                if (srt_epoll_wait(m_eid, ready, &ready_count, nullptr, nullptr, RELAY_TIMEOUT_MS,
+                                        sys_ready, &sys_ready_count, nullptr, nullptr) < 0) {
+                        continue; // timeout
+                }
+
+                if (sys_ready_count > 0) {
+                        ssize_t len = recv(m_relay_fd, buf.get(), UINT16_MAX, 0);
+                        if (len > SRT_LIVE_MAX_PLSIZE) {
+                                if (!warned_too_big) {
+                                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Dropping %zd B packet, SRT "
+                                                        "payload is limited to %d B, check MTU!\n",
+                                                        len, SRT_LIVE_MAX_PLSIZE);
+                                        warned_too_big = true;
+                                }
+                        } else if (len > 0 && m_sock != SRT_INVALID_SOCK
+                                        && srt_sendmsg2(m_sock, buf.get(), (int) len, nullptr) == SRT_ERROR) {
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Connection lost: %s\n", srt_getlasterror_str());
+                                close_peer();
+                        }
+                }
+
+                for (int i = 0; i < ready_count; ++i) {
+                        if (ready[i] == m_listen_sock) {
+                                struct sockaddr_storage peer;
+                                int peer_len = sizeof peer;
+                                SRTSOCKET sock = srt_accept(m_listen_sock, reinterpret_cast<struct sockaddr *>(&peer), &peer_len);
+                                if (sock == SRT_INVALID_SOCK) {
+                                        continue;
+                                }
+                                close_peer(); // only one peer at time, the newest wins
+                                int events = SRT_EPOLL_IN | SRT_EPOLL_ERR;
+                                srt_epoll_add_usock(m_eid, sock, &events);
+                                m_sock = sock;
+                                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Accepted connection.\n");
+                                continue;
+                        }
+                        if (ready[i] != m_sock) {
+                                continue;
+                        }
+                        int len = 0;
+                        while ((len = srt_recvmsg(m_sock, buf.get(), UINT16_MAX)) > 0) {
+                                sendto(m_relay_fd, buf.get(), len, 0, reinterpret_cast<struct sockaddr *>(&m_local_rtp),
+                                                m_local_rtp_len);
+                        }
+                        if (len == SRT_ERROR && srt_getlasterror(nullptr) != SRT_EASYNCRCV) {
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Connection lost: %s\n", srt_getlasterror_str());
+                                close_peer();
+                        }
+                }
+        }
+}
+
+static void usage()
+{
+        color_printf("Usage:\n");
+        color_printf("\t" TBOLD("--video-protocol srt[:caller|:listener][:port=<p>][:latency=<ms>][:passphrase=<pass>][:filter=<fec>]") "\n\n");
+        color_printf("\t" TBOLD("caller|listener") " - connect to the receiver or wait for the peer (default: sender is caller)\n");
+        color_printf("\t" TBOLD("port") "        - SRT port (default: TX port for caller, RX port for listener)\n");
+        color_printf("\t" TBOLD("latency") "     - receiver buffer used for retransmissions (default %d ms)\n", DEFAULT_LATENCY_MS);
+        color_printf("\t" TBOLD("passphrase") "  - AES encryption passphrase (10-79 characters)\n");
+        color_printf("\t" TBOLD("filter") "      - SRT packet filter, eg. " TBOLD("fec,cols:10,rows:5") " (use " TBOLD("-f") " for UltraGrid FEC)\n\n");
+        color_printf("UltraGrid RTP packets are carried as SRT messages, the MTU is limited to %d B.\n\n", SRT_LIVE_MAX_PLSIZE);
+}
+
+static video_rxtx *create_video_rxtx_srt(std::map<std::string, param_u> const &params)
+{
+        const bool sender = (params.at("rxtx_mode").i & MODE_SENDER) != 0;
+        srt_video_rxtx_conf conf{ sender, params.at("receiver").str, -1, DEFAULT_LATENCY_MS, {}, {} };
+
+        char *cfg = strdupa(params.at("opts").str);
+        char *save_ptr = nullptr;
+        char *item = nullptr;
+        while ((item = strtok_r(cfg, ":", &save_ptr)) != nullptr) {
+                cfg = nullptr;
+                if (strcmp(item, "help") == 0) {
+                        usage();
+                        return nullptr;
+                }
+                if (strcmp(item, "caller") == 0 || strcmp(item, "listener") == 0) {
+                        conf.caller = item[0] == 'c';
+                } else if (strncmp(item, "port=", strlen("port=")) == 0) {
+                        conf.port = atoi(item + strlen("port="));
+                } else if (strncmp(item, "latency=", strlen("latency=")) == 0) {
+                        conf.latency_ms = atoi(item + strlen("latency="));
+                } else if (strncmp(item, "passphrase=", strlen("passphrase=")) == 0) {
+                        conf.passphrase = item + strlen("passphrase=");
+                } else if (strncmp(item, "filter=", strlen("filter=")) == 0) {
+                        conf.filter = item + strlen("filter=");
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", item);
+                        usage();
+                        return nullptr;
+                }
+        }
+        if (conf.port == -1) {
+                conf.port = params.at(conf.caller ? "tx_port" : "rx_port").i;
+        }
+        if (conf.port <= 0 || conf.port > UINT16_MAX) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Invalid port %d!\n", conf.port);
+                return nullptr;
+        }
+
+        fd_t relay_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in sa{};
+        socklen_t sa_len = sizeof sa;
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (relay_fd == INVALID_SOCKET || bind(relay_fd, reinterpret_cast<struct sockaddr *>(&sa), sizeof sa) != 0
+                        || getsockname(relay_fd, reinterpret_cast<struct sockaddr *>(&sa), &sa_len) != 0) {
+                socket_error(MOD_NAME "Unable to create relay socket");
+                if (relay_fd != INVALID_SOCKET) {
+                        CLOSESOCKET(relay_fd);
+                }
+                return nullptr;
+        }
+
+        // the base class talks UltraGrid RTP to the relay socket over the loopback
+        auto local_params = params;
+        local_params["receiver"].str = "127.0.0.1";
+        local_params["rx_port"].i = 0;
+        local_params["tx_port"].i = ntohs(sa.sin_port);
+        local_params["force_ip_version"].i = 4;
+        local_params["mtu"].i = std::min(params.at("mtu").i, SRT_LIVE_MAX_PLSIZE);
+        try {
+                return new srt_video_rxtx(local_params, std::move(conf), relay_fd);
+        } catch (...) {
+                CLOSESOCKET(relay_fd);
+                throw;
+        }
+}
+
+static const struct video_rxtx_info srt_video_rxtx_info = {
+        "UltraGrid RTP over SRT",
+        create_video_rxtx_srt
+};
+
+REGISTER_MODULE(srt, &srt_video_rxtx_info, LIBRARY_CLASS_VIDEO_RXTX, VIDEO_RXTX_ABI_VERSION);
@@ -0,0 +1,86 @@
+/**
+ * @file   video_rxtx/srt.h
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef VIDEO_RXTX_SRT_H_
+#define VIDEO_RXTX_SRT_H_
+
+#include <srt/srt.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "video_rxtx/ultragrid_rtp.h"
+
+struct srt_video_rxtx_conf {
+        bool caller;              ///< connect to the peer, listen otherwise
+        std::string host;         ///< peer address (caller only)
+        int port;
+        int latency_ms;
+        std::string passphrase;
+        std::string filter;       ///< SRT packet filter (FEC) configuration
+};
+
+/**
+ * UltraGrid RTP carried over SRT. The RTP sessions of the base class are
+ * bound to the loopback and the relay thread forwards the datagrams
+ * between them and the SRT connection, so the compression, FEC and
+ * decoding paths stay those of ultragrid_rtp.
+ */
+class srt_video_rxtx : public ultragrid_rtp_video_rxtx {
+public:
+        srt_video_rxtx(std::map<std::string, param_u> const &params, srt_video_rxtx_conf conf, fd_t relay_fd);
+        virtual ~srt_video_rxtx();
+
+private:
+        void relay_loop();
+        bool open_peer();
+        void close_peer();
+        bool configure_socket(SRTSOCKET sock);
+
+        srt_video_rxtx_conf m_conf;
+        fd_t             m_relay_fd;         ///< loopback socket the base class sends to
+        struct sockaddr_storage m_local_rtp; ///< receiving socket of the base class
+        socklen_t        m_local_rtp_len;
+        SRTSOCKET        m_listen_sock = SRT_INVALID_SOCK;
+        SRTSOCKET        m_sock = SRT_INVALID_SOCK;
+        int              m_eid;
+        std::atomic<bool> m_relay_should_exit{false};
+        std::thread      m_relay_thread;
+};
+
+#endif // VIDEO_RXTX_SRT_H_
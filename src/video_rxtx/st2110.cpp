@@ -0,0 +1,320 @@
+/**
+ * @file   video_rxtx/st2110.cpp
+ * @brief  SMPTE ST 2110-20 uncompressed video send/receive mode
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include "video_rxtx/st2110.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "compat/misc.h"
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "messaging.h"
+#include "pdb.h"
+#include "rtp/st2110.h"
+#include "transmit.h"
+#include "tv.h"
+#include "ug_runtime_error.hpp"
+#include "utils/color_out.h"
+#include "utils/thread.h"
+#include "video.h"
+#include "video_codec.h"
+#include "video_display.h"
+
+#define MOD_NAME "[ST 2110] "
+#define DEFAULT_CODEC v210 ///< 4:2:2 10-bit, the common 2110 production format
+#define RECV_TIMEOUT_US 20000
+
+using std::shared_ptr;
+
+st2110_video_rxtx::st2110_video_rxtx(std::map<std::string, param_u> const &params, struct video_desc rx_desc) :
+        rtp_video_rxtx(params), m_rx_desc(rx_desc)
+{
+        m_display_device = (m_rxtx_mode & MODE_RECEIVER) != 0 ? (struct display *) params.at("display_device").ptr : nullptr;
+        if (m_display_device != nullptr && m_rx_desc.width == 0) {
+                throw ug_runtime_error(MOD_NAME "The receiver needs the video format (see \"--video-protocol st2110:help\")!",
+                                EXIT_FAIL_USAGE);
+        }
+}
+
+st2110_video_rxtx::~st2110_video_rxtx()
+{
+        if (m_display_device != nullptr) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Received %llu complete and %llu incomplete frames (%llu malformed packets).\n",
+                                m_frames_complete, m_frames_incomplete, m_packets_malformed);
+        }
+}
+
+void st2110_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame)
+{
+        m_video_desc = video_desc_from_frame(tx_frame.get());
+        std::lock_guard<std::mutex> lock(m_network_devices_lock);
+        if (m_paused) {
+                return;
+        }
+        tx_send_st2110(m_tx, tx_frame.get(), m_network_devices[0]);
+
+        if ((m_rxtx_mode & MODE_RECEIVER) == 0) { // send RTCP (receiver thread would otherwise do this
+                time_ns_t curr_time = get_time_in_ns();
+                uint32_t ts = (curr_time - m_start_time) / 100'000 * 9; // at 90000 Hz
+                rtp_update(m_network_devices[0], curr_time);
+                rtp_send_ctrl(m_network_devices[0], ts, 0, curr_time);
+
+                // receive RTCP
+                struct timeval timeout { 0, 0 };
+                rtp_recv_r(m_network_devices[0], &timeout, ts);
+        }
+}
+
+void *st2110_video_rxtx::receiver_thread(void *arg)
+{
+        return static_cast<st2110_video_rxtx *>(arg)->receiver_loop();
+}
+
+/// checks that the display accepts the configured format, configures it and gets the first framebuffer
+bool st2110_video_rxtx::configure_display()
+{
+        codec_t codecs[VIDEO_CODEC_COUNT];
+        size_t len = sizeof codecs;
+        if (!display_ctl_property(m_display_device, DISPLAY_PROPERTY_CODECS, codecs, &len)
+                        || std::find(codecs, codecs + len / sizeof(codec_t), m_rx_desc.color_spec) == codecs + len / sizeof(codec_t)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Display doesn't support %s!\n", get_codec_name(m_rx_desc.color_spec));
+                return false;
+        }
+        if (!display_reconfigure(m_display_device, m_rx_desc, VIDEO_NORMAL)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to configure display to %s!\n", video_desc_to_string(m_rx_desc));
+                return false;
+        }
+        int pitch = PITCH_DEFAULT;
+        len = sizeof pitch;
+        if (!display_ctl_property(m_display_device, DISPLAY_PROPERTY_BUF_PITCH, &pitch, &len)) {
+                pitch = PITCH_DEFAULT;
+        }
+        m_rx_linesize = pitch != PITCH_DEFAULT ? pitch : vc_get_linesize(m_rx_desc.width, m_rx_desc.color_spec);
+        int pg_bytes = 0;
+        int pg_pixels = 0;
+        st2110_get_pgroup(m_rx_desc.color_spec, &pg_bytes, &pg_pixels);
+        m_rx_frame_bytes = (size_t) m_rx_desc.width / pg_pixels * pg_bytes * m_rx_desc.height;
+        m_frame = display_get_frame(m_display_device);
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Receiving %s.\n", video_desc_to_string(m_rx_desc));
+        return true;
+}
+
+void st2110_video_rxtx::push_packet(void *udata, void *pkt)
+{
+        static_cast<st2110_video_rxtx *>(udata)->process_packet(static_cast<rtp_packet *>(pkt));
+}
+
+void st2110_video_rxtx::put_frame()
+{
+        if (m_frame_bytes_received >= m_rx_frame_bytes) {
+                m_frames_complete += 1;
+        } else {
+                m_frames_incomplete += 1;
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Incomplete frame - %zu of %zu B received.\n",
+                                m_frame_bytes_received, m_rx_frame_bytes);
+        }
+        display_put_frame(m_display_device, m_frame, PUTF_NONBLOCK);
+        m_frame = display_get_frame(m_display_device);
+        m_frame_started = false;
+}
+
+/**
+ * Writes the line segments of the packet to the framebuffer. The frame is
+ * passed to the display after its last packet (marker bit) or when a packet
+ * of the next frame arrives.
+ */
+void st2110_video_rxtx::process_packet(rtp_packet *pkt)
+{
+        if (m_frame == nullptr) {
+                free(pkt);
+                return;
+        }
+        if (m_frame_started && pkt->ts != m_frame_ts) {
+                put_frame(); // last packet lost
+        }
+        if (!m_frame_started) {
+                m_frame_started = true;
+                m_frame_ts = pkt->ts;
+                m_frame_bytes_received = 0;
+        }
+
+        int pg_bytes = 0;
+        int pg_pixels = 0;
+        st2110_get_pgroup(m_rx_desc.color_spec, &pg_bytes, &pg_pixels);
+        uint16_t ext_seq_hi = 0;
+        struct st2110_srd srds[ST2110_MAX_SRDS];
+        const int count = st2110_parse((const unsigned char *) pkt->data, pkt->data_len, &ext_seq_hi, srds, ST2110_MAX_SRDS);
+        if (count < 0) {
+                m_packets_malformed += 1;
+        }
+        for (int i = 0; i < count; ++i) {
+                const struct st2110_srd *srd = &srds[i];
+                if (srd->line >= m_rx_desc.height || srd->offset % pg_pixels != 0 || srd->len % pg_bytes != 0
+                                || srd->offset + (unsigned) srd->len / pg_bytes * pg_pixels > m_rx_desc.width) {
+                        if (!m_warned_sender_format) {
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Segment of line %u (offset %u, %d B) doesn't fit "
+                                                "the configured format %s!\n", srd->line, srd->offset, srd->len,
+                                                video_desc_to_string(m_rx_desc));
+                                m_warned_sender_format = true;
+                        }
+                        m_packets_malformed += 1;
+                        continue;
+                }
+                st2110_unpack(m_rx_desc.color_spec, m_frame->tiles[0].data + (size_t) srd->line * m_rx_linesize,
+                                srd->data, srd->offset, srd->len);
+                m_frame_bytes_received += srd->len;
+        }
+        if (pkt->m) {
+                put_frame();
+        }
+        free(pkt);
+}
+
+void *st2110_video_rxtx::receiver_loop()
+{
+        set_thread_name(__func__);
+        if (!configure_display()) {
+                exit_uv(1);
+        }
+
+        while (!m_should_exit) {
+                time_ns_t curr_time = get_time_in_ns();
+                uint32_t ts = (curr_time - m_start_time) / 100'000 * 9; // at 90000 Hz
+                rtp_update(m_network_devices[0], curr_time);
+                rtp_send_ctrl(m_network_devices[0], ts, 0, curr_time);
+
+                struct timeval timeout { 0, RECV_TIMEOUT_US };
+                rtp_recv_r(m_network_devices[0], &timeout, ts);
+
+                // packets of the new senders bypass the playout buffer (the first ones are already in it)
+                pdb_iter_t it;
+                for (struct pdb_e *cp = pdb_iter_init(m_participants, &it); cp != nullptr; cp = pdb_iter_next(&it)) {
+                        if (cp->packet_handler == nullptr) {
+                                cp->packet_handler = push_packet;
+                                cp->packet_handler_udata = this;
+                        }
+                }
+                pdb_iter_done(&it);
+
+                struct message *msg;
+                while ((msg = check_message(&m_receiver_mod)) != nullptr) {
+                        free_message(msg, new_response(RESPONSE_NOT_IMPL, nullptr));
+                }
+        }
+
+        if (m_frame != nullptr) {
+                display_put_frame(m_display_device, m_frame, PUTF_DISCARD);
+                m_frame = nullptr;
+        }
+        // pass posioned pill to display
+        display_put_frame(m_display_device, NULL, PUTF_BLOCKING);
+        return nullptr;
+}
+
+static void usage()
+{
+        color_printf("Usage:\n");
+        color_printf("\t" TBOLD("--video-protocol st2110[:size=<W>x<H>:fps=<fps>[:codec=UYVY|v210|RGB]]") "\n\n");
+        color_printf("Sends (" TBOLD("-c none") " is required) or receives SMPTE ST 2110-20 uncompressed video with ST 2110-21\n"
+                        "narrow gapped sender pacing (SO_TXTIME, needs fq qdisc or etf qdisc with " TBOLD("--param udp-txtime-clock=tai") ").\n"
+                        "Sender timing is aligned to the system clock, which should be synchronized with PTP (phc2sys).\n"
+                        "Only progressive video is supported.\n\n");
+        color_printf("\t" TBOLD("size, fps, codec") " - format of the received video (receiver only, default codec %s)\n\n",
+                        get_codec_name(DEFAULT_CODEC));
+}
+
+static video_rxtx *create_video_rxtx_st2110(std::map<std::string, param_u> const &params)
+{
+        struct video_desc desc{};
+        desc.color_spec = DEFAULT_CODEC;
+        desc.interlacing = PROGRESSIVE;
+        desc.tile_count = 1;
+
+        char *cfg = strdupa(params.at("opts").str);
+        char *save_ptr = nullptr;
+        char *item = nullptr;
+        while ((item = strtok_r(cfg, ":", &save_ptr)) != nullptr) {
+                cfg = nullptr;
+                if (strcmp(item, "help") == 0) {
+                        usage();
+                        return nullptr;
+                }
+                if (strncmp(item, "size=", strlen("size=")) == 0) {
+                        if (sscanf(item + strlen("size="), "%ux%u", &desc.width, &desc.height) != 2) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong size: %s\n", item + strlen("size="));
+                                return nullptr;
+                        }
+                } else if (strncmp(item, "fps=", strlen("fps=")) == 0) {
+                        desc.fps = atof(item + strlen("fps="));
+                } else if (strncmp(item, "codec=", strlen("codec=")) == 0) {
+                        desc.color_spec = get_codec_from_name(item + strlen("codec="));
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", item);
+                        usage();
+                        return nullptr;
+                }
+        }
+        int pg_bytes = 0;
+        int pg_pixels = 0;
+        if (!st2110_get_pgroup(desc.color_spec, &pg_bytes, &pg_pixels)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Codec %s cannot be received, use UYVY, v210 or RGB.\n", get_codec_name(desc.color_spec));
+                return nullptr;
+        }
+        if (desc.width != 0 && (desc.width % pg_pixels != 0 || desc.height == 0 || desc.fps <= 0.0)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong video format %s!\n", video_desc_to_string(desc));
+                return nullptr;
+        }
+        return new st2110_video_rxtx(params, desc);
+}
+
+static const struct video_rxtx_info st2110_video_rxtx_info = {
+        "SMPTE ST 2110-20",
+        create_video_rxtx_st2110
+};
+
+REGISTER_MODULE(st2110, &st2110_video_rxtx_info, LIBRARY_CLASS_VIDEO_RXTX, VIDEO_RXTX_ABI_VERSION);
@@ -0,0 +1,88 @@
+/**
+ * @file   video_rxtx/st2110.h
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef VIDEO_RXTX_ST2110_H_
+#define VIDEO_RXTX_ST2110_H_
+
+#include "rtp/rtp.h"
+#include "types.h"
+#include "video_rxtx.h"
+#include "video_rxtx/rtp.h"
+
+#include <map>
+#include <memory>
+#include <string>
+
+struct display;
+
+/**
+ * SMPTE ST 2110-20 uncompressed video. The sender packetizes the frames
+ * with tx_send_st2110(), the receiver writes the line segments of the
+ * received packets straight to the display framebuffer (no playout buffer
+ * nor decoder). The video format is not signalled in-band so the receiver
+ * needs it in its configuration (as would be in the SDP).
+ */
+class st2110_video_rxtx : public rtp_video_rxtx {
+public:
+        st2110_video_rxtx(std::map<std::string, param_u> const &params, struct video_desc rx_desc);
+        virtual ~st2110_video_rxtx();
+private:
+        void send_frame(std::shared_ptr<video_frame>) override;
+        void *(*get_receiver_thread())(void *arg) override {
+                return receiver_thread;
+        }
+        static void *receiver_thread(void *arg);
+        void *receiver_loop();
+        static void push_packet(void *udata, void *pkt);
+        void process_packet(rtp_packet *pkt);
+        bool configure_display();
+        void put_frame();
+
+        struct display  *m_display_device;
+        struct video_desc m_rx_desc;
+        int              m_rx_linesize = 0;
+        size_t           m_rx_frame_bytes = 0; ///< pgroup bytes of a whole frame
+        struct video_frame *m_frame = nullptr; ///< framebuffer being received into
+        bool             m_frame_started = false;
+        uint32_t         m_frame_ts = 0;
+        size_t           m_frame_bytes_received = 0;
+        unsigned long long m_frames_complete = 0;
+        unsigned long long m_frames_incomplete = 0;
+        unsigned long long m_packets_malformed = 0;
+        bool             m_warned_sender_format = false;
+};
+
+#endif // VIDEO_RXTX_ST2110_H_
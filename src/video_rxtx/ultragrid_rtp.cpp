@@ -52,11 +52,13 @@
 #include "control_socket.h"
 #include "export.h"
 #include "host.h"
+#include "ntp.h"
 #include "lib_common.h"
 #include "messaging.h"
 #include "module.h"
 #include "pdb.h"
 #include "rtp/ldgm.h"
+#include "rtp/net_udp.h"
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
 #include "rtp/video_decoders.h"
@@ -75,12 +77,155 @@
 #include "ug_runtime_error.hpp"
 #include "utils/worker.h"
 
+#include <algorithm>
 #include <chrono>
 #include <sstream>
+#include <thread>
 #include <utility>
+#include <vector>
+
+#define MAX_NACKS_PER_PASS 256
+#define RECV_MAX_TIMEOUT (NS_IN_SEC / 50)  ///< max receiver loop sleep while receiving (message processing)
+#define RECV_IDLE_TIMEOUT (NS_IN_SEC / 10) ///< max receiver loop sleep when no data are received
+#define NACK_POLL_MAX (NS_IN_SEC / 10) ///< max time the sender waits for NACKs after a frame
+#define RECV_BUF_PLAYOUT_DELAYS 2 ///< socket buffer holds data received during this many playout delays
+#define VIDEO_ADAPTIVE_MIN_DELAY_MS 1
+#define VIDEO_ADAPTIVE_MAX_DELAY_MS 500
+#define VIDEO_ADAPTIVE_MISS_PCT 1
 
 using namespace std;
 
+ADD_TO_PARAM("rtp-participant-threads", "* rtp-participant-threads\n"
+                "  Process the playout buffer and decode each received video source in its own thread\n"
+                "  (only with displays supporting multiple sources, eg. conference)\n");
+ADD_TO_PARAM("video-jitter-buffer", "* video-jitter-buffer[=<min_ms>:<max_ms>[:<miss_pct>]]\n"
+                "  Video playout delay follows the network jitter and the frame arrival spread within the bounds (default "
+                TOSTRING(VIDEO_ADAPTIVE_MIN_DELAY_MS) ":" TOSTRING(VIDEO_ADAPTIVE_MAX_DELAY_MS) " ms)\n"
+                "  keeping at most miss_pct % of frames late (default " TOSTRING(VIDEO_ADAPTIVE_MISS_PCT) "), instead of the fixed frame time\n");
+
+namespace {
+/**
+ * Decoder of a participant with its own thread processing the playout
+ * buffer - the receiver thread only passes it the packets (demultiplexed
+ * by SSRC by the participant database). Used as the participant
+ * decoder_state (it is a vcodec_state).
+ */
+struct participant_decoder : vcodec_state {
+        participant_decoder(struct pbuf *buf, bool n, struct vcodec_state *dec) :
+                vcodec_state(*dec), playout_buffer(buf), nack(n)
+        {
+                free(dec);
+                thr = thread(&participant_decoder::run, this);
+        }
+        ~participant_decoder() {
+                stop();
+        }
+
+        static void push_packet(void *udata, void *pkt);
+        void stop();
+        void run();
+
+        struct pbuf *playout_buffer;
+        const bool nack;
+        atomic<double> playout_delay{-1}; ///< new playout delay to be set by the thread, -1 if none
+        atomic<int> recv_buf_size{0};     ///< socket buffer size required for the received frames
+        struct {
+                time_ns_t time;
+                uint32_t rtp_ts;
+        } sender_clock{};                 ///< new sender clock to be set by the thread, protected by lock
+        bool sender_clock_set = false;    ///< protected by lock
+
+        mutex lock;
+        condition_variable cv;
+        vector<rtp_packet *> incoming;    ///< protected by lock
+        vector<uint16_t> nacks;           ///< to be requested by the receiver thread, protected by lock
+        bool waiting = false;             ///< the thread waits for the packets, protected by lock
+        bool should_exit = false;         ///< protected by lock
+        thread thr;
+};
+
+void participant_decoder::push_packet(void *udata, void *pkt)
+{
+        auto *d = static_cast<participant_decoder *>(udata);
+        unique_lock<mutex> lk(d->lock);
+        d->incoming.push_back(static_cast<rtp_packet *>(pkt));
+        bool notify = d->waiting;
+        lk.unlock();
+        if (notify) {
+                d->cv.notify_one();
+        }
+}
+
+void participant_decoder::stop()
+{
+        if (!thr.joinable()) {
+                return;
+        }
+        unique_lock<mutex> lk(lock);
+        should_exit = true;
+        lk.unlock();
+        cv.notify_one();
+        thr.join();
+        for (auto *pkt : incoming) {
+                free(pkt);
+        }
+        incoming.clear();
+}
+
+void participant_decoder::run()
+{
+        set_thread_name("participant_decoder");
+        vector<rtp_packet *> pkts;
+        time_ns_t deadline = 0;
+        unique_lock<mutex> lk(lock);
+        while (!should_exit) {
+                if (incoming.empty()) {
+                        waiting = true;
+                        cv.wait_for(lk, chrono::nanoseconds(deadline - get_time_in_ns()),
+                                        [this] { return !incoming.empty() || should_exit; });
+                        waiting = false;
+                }
+                swap(pkts, incoming);
+                if (sender_clock_set) {
+                        pbuf_set_sender_clock(playout_buffer, sender_clock.time, sender_clock.rtp_ts, 90000);
+                        sender_clock_set = false;
+                }
+                lk.unlock();
+
+                for (auto *pkt : pkts) {
+                        pbuf_insert(playout_buffer, pkt);
+                }
+                pkts.clear();
+                double delay = playout_delay.exchange(-1);
+                if (delay >= 0) {
+                        pbuf_set_playout_delay(playout_buffer, delay);
+                }
+                time_ns_t now = get_time_in_ns();
+                uint16_t lost[MAX_NACKS_PER_PASS];
+                int lost_count = nack ? pbuf_get_nacks(playout_buffer, now, lost, MAX_NACKS_PER_PASS) : 0;
+                pbuf_decode_partial(playout_buffer, decode_video_frame_partial, static_cast<vcodec_state *>(this));
+                while (pbuf_decode(playout_buffer, now, decode_video_frame, static_cast<vcodec_state *>(this))) {
+                        if (decoded % 100 == 99) {
+                                recv_buf_size = max_frame_size * 110ULL / 100;
+                        }
+                }
+                pbuf_remove(playout_buffer, now);
+                deadline = min(pbuf_next_deadline(playout_buffer, now), now + RECV_IDLE_TIMEOUT);
+
+                lk.lock();
+                nacks.insert(nacks.end(), lost, lost + lost_count);
+        }
+}
+
+participant_decoder *get_participant_decoder(struct pdb_e *cp)
+{
+        if (cp->packet_handler != participant_decoder::push_packet) {
+                return nullptr;
+        }
+        return static_cast<participant_decoder *>(cp->packet_handler_udata);
+}
+} // end of anonymous namespace
+
 ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &params) :
         rtp_video_rxtx(params), m_send_bytes_total(0)
 {
@@ -88,6 +233,20 @@ ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &p
         m_display_device = (struct display *) params.at("display_device").ptr;
         m_requested_encryption = (const char *) params.at("encryption").ptr;
         m_async_sending = false;
+        m_nack = get_commandline_param("rtp-nack") != nullptr;
+        m_participant_threads = get_commandline_param("rtp-participant-threads") != nullptr;
+        if (const char *cfg = get_commandline_param("video-jitter-buffer")) {
+                double min_ms = VIDEO_ADAPTIVE_MIN_DELAY_MS;
+                double max_ms = VIDEO_ADAPTIVE_MAX_DELAY_MS;
+                double miss_pct = VIDEO_ADAPTIVE_MISS_PCT;
+                if (strlen(cfg) > 0) {
+                        sscanf(cfg, "%lf:%lf:%lf", &min_ms, &max_ms, &miss_pct);
+                }
+                if (min_ms < 0 || max_ms < min_ms || miss_pct <= 0) {
+                        throw ug_runtime_error("Wrong video-jitter-buffer specification: "s + cfg, EXIT_FAIL_USAGE);
+                }
+                m_adaptive_delay = { min_ms / 1000, max_ms / 1000, miss_pct / 100 };
+        }
 
         if (get_commandline_param("decoder-use-codec") != nullptr && "help"s == get_commandline_param("decoder-use-codec")) {
                 destroy_video_decoder(new_video_decoder(m_display_device));
@@ -125,12 +284,34 @@ void ultragrid_rtp_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame)
         m_video_desc = video_desc_from_frame(tx_frame.get());
         if (m_fec_state) {
                 tx_frame = m_fec_state->encode(tx_frame);
+                if (!tx_frame) {
+                        return;
+                }
         }
+        send_encoded_frame(std::move(tx_frame));
+}
 
+time_ns_t ultragrid_rtp_video_rxtx::held_frames_deadline()
+{
+        return m_fec_state != nullptr ? m_fec_state->flush_deadline() : 0;
+}
+
+/// sends frames held back by FEC (see fec_frame_group) if the next frame is late
+void ultragrid_rtp_video_rxtx::send_held_frames()
+{
+        if (auto tx_frame = m_fec_state->flush()) {
+                send_encoded_frame(std::move(tx_frame));
+        }
+}
+
+void ultragrid_rtp_video_rxtx::send_encoded_frame(shared_ptr<video_frame> tx_frame)
+{
         auto data = new pair<ultragrid_rtp_video_rxtx *, shared_ptr<video_frame>>(this, tx_frame);
 
+        m_next_frame_waiting = true;
         unique_lock<mutex> lk(m_async_sending_lock);
         m_async_sending_cv.wait(lk, [this]{return !m_async_sending;});
+        m_next_frame_waiting = false;
         m_async_sending = true;
         task_run_async_detached(ultragrid_rtp_video_rxtx::send_frame_async_callback,
                         (void *) data);
@@ -139,7 +320,7 @@ void ultragrid_rtp_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame)
 void *ultragrid_rtp_video_rxtx::send_frame_async_callback(void *arg) {
         auto data = (pair<ultragrid_rtp_video_rxtx *, shared_ptr<video_frame>> *) arg;
 
-        data->first->send_frame_async(data->second);
+        data->first->send_frame_async(std::move(data->second));
         delete data;
 
         return NULL;
@@ -148,7 +329,7 @@ void *ultragrid_rtp_video_rxtx::send_frame_async_callback(void *arg) {
 
 void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame)
 {
-        lock_guard<mutex> lock(m_network_devices_lock);
+        unique_lock<mutex> lock(m_network_devices_lock);
 
         if (m_paused) {
                 goto after_send;
@@ -163,17 +344,15 @@ void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame
                 //assert(frame_count == 1);
                 vf_split_horizontal(split_frames, tx_frame.get(),
                                 m_connections_count);
-                for (int i = 0; i < m_connections_count; ++i) {
-                        tx_send_tile(m_tx, split_frames, i,
-                                        m_network_devices[i]);
-                }
+                tx_send_tiles(m_tx, split_frames, m_network_devices,
+                                m_connections_count);
 
                 vf_free(split_frames);
         }
 
         if ((m_rxtx_mode & MODE_RECEIVER) == 0) { // otherwise receiver thread does the stuff...
                 time_ns_t curr_time = get_time_in_ns();
-                uint32_t ts = (curr_time - m_start_time) / 100'000 * 9; // at 90000 Hz
+                uint32_t ts = get_local_mediatime(); // SR must use the clock of the sent frames
                 rtp_update(m_network_devices[0], curr_time);
                 rtp_send_ctrl(m_network_devices[0], ts, 0, curr_time);
 
@@ -183,6 +362,21 @@ void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame
                         struct timeval timeout { 0, 0 };
                         rc = rtcp_recv_r(m_network_devices[0], &timeout, ts);
                 } while (!m_should_exit && rc == TRUE);
+                abr_process_reports();
+                keyframe_process_requests();
+
+                if (m_nack) {
+                        // Keep serving NACKs until the next frame is ready, otherwise the retransmission
+                        // would be delayed by up to a frame time while the receiver waits only its playout delay.
+                        tx_frame.reset(); // capture may wait for the frame to be released
+                        time_ns_t deadline = curr_time + NACK_POLL_MAX;
+                        while (!m_next_frame_waiting && !m_should_exit && get_time_in_ns() < deadline) {
+                                lock.unlock();
+                                lock.lock();
+                                struct timeval timeout { 0, 1000 };
+                                rtcp_recv_r(m_network_devices[0], &timeout, ts);
+                        }
+                }
         }
 
 after_send:
@@ -226,9 +420,14 @@ void ultragrid_rtp_video_rxtx::receiver_process_messages()
                                 pdb_iter_t it;
                                 /// @todo should be set only to relevant participant, not all
                                 struct pdb_e *cp = pdb_iter_init(m_participants, &it);
+                                m_playout_delay = 1.0 / msg->new_desc.fps;
                                 while (cp) {
-                                        pbuf_set_playout_delay(cp->playout_buffer,
-                                                        1.0 / msg->new_desc.fps);
+                                        if (participant_decoder *pd = get_participant_decoder(cp)) {
+                                                pd->playout_delay = 1.0 / msg->new_desc.fps;
+                                        } else {
+                                                pbuf_set_playout_delay(cp->playout_buffer,
+                                                                1.0 / msg->new_desc.fps);
+                                        }
 
                                         cp = pdb_iter_next(&it);
                                 }
@@ -260,6 +459,13 @@ void ultragrid_rtp_video_rxtx::remove_display_from_decoders() {
         }
 }
 
+void ultragrid_rtp_video_rxtx::destroy_participant_decoder(void *state) {
+        auto *pd = static_cast<participant_decoder *>(static_cast<struct vcodec_state *>(state));
+        pd->stop();
+        video_decoder_destroy(pd->decoder);
+        delete pd;
+}
+
 void ultragrid_rtp_video_rxtx::destroy_video_decoder(void *state) {
         struct vcodec_state *video_decoder_state = (struct vcodec_state *) state;
 
@@ -295,12 +501,15 @@ struct vcodec_state *ultragrid_rtp_video_rxtx::new_video_decoder(struct display
 void *ultragrid_rtp_video_rxtx::receiver_loop()
 {
         set_thread_name(__func__);
+        module_set_mem_owner(&m_receiver_mod);
         struct pdb_e *cp;
         int fr;
         int ret;
         int tiles_post = 0;
         time_ns_t last_tile_received = 0;
         int last_buf_size = INITIAL_VIDEO_RECV_BUFFER_SIZE;
+        time_ns_t last_rate_check = 0;
+        uint64_t last_bytes_received = 0;
 
 #ifdef SHARED_DECODER
         struct vcodec_state *shared_decoder = new_video_decoder(m_display_device);
@@ -314,33 +523,49 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
         fr = 1;
 
         time_ns_t last_not_timeout = 0;
+        time_ns_t next_deadline = 0; ///< earliest playout buffer deadline
+
+        auto adjust_recv_buf = [&](int new_size) {
+                if(new_size > last_buf_size) {
+                        struct rtp **device = m_network_devices;
+                        while(*device) {
+                                int ret = rtp_set_recv_buf(*device, new_size);
+                                if(!ret) {
+                                        display_buf_increase_warning(new_size);
+                                }
+                                debug_msg("Recv buffer adjusted to %d\n", new_size);
+                                device++;
+                        }
+                        last_buf_size = new_size;
+                }
+        };
 
         while (!m_should_exit) {
                 struct timeval timeout;
                 /* Housekeeping and RTCP... */
                 time_ns_t curr_time = get_time_in_ns();
-                uint32_t ts = (m_start_time - curr_time) / 100'000 * 9; // at 90000 Hz
+                uint32_t ts = get_local_mediatime(); // SR must use the clock of the sent frames
 
                 rtp_update(m_network_devices[0], curr_time);
                 rtp_send_ctrl(m_network_devices[0], ts, 0, curr_time);
 
                 /* Receive packets from the network... The timeout is adjusted */
                 /* to match the video capture rate, so the transmitter works.  */
-                if (fr) {
+                if (fr || m_participant_threads) { // the participant threads don't set fr
                         curr_time = get_time_in_ns();
                         receiver_process_messages();
                         fr = 0;
                 }
 
-                timeout.tv_sec = 0;
-                //timeout.tv_usec = 999999 / 59.94;
+                // sleep until a packet arrives, a playout buffer deadline or RTCP is due;
                 // use longer timeout when we are not receivng any data
-                if ((last_not_timeout - curr_time) > NS_IN_SEC) {
-                        timeout.tv_usec = 100000;
-                } else {
-                        timeout.tv_usec = 1000;
-                }
+                time_ns_t max_sleep = curr_time - last_not_timeout > NS_IN_SEC ? RECV_IDLE_TIMEOUT : RECV_MAX_TIMEOUT;
+                time_ns_t wakeup = std::min({ next_deadline, rtp_next_ctrl_time(m_network_devices[0]), curr_time + max_sleep });
+                time_ns_t sleep_ns = std::max<time_ns_t>(wakeup - curr_time, 0);
+                timeout.tv_sec = sleep_ns / NS_IN_SEC;
+                timeout.tv_usec = (sleep_ns % NS_IN_SEC + NS_IN_US - 1) / NS_IN_US;
                 ret = rtp_recv_r(m_network_devices[0], &timeout, ts);
+                curr_time = get_time_in_ns();
 
                 // timeout
                 if (ret == FALSE) {
@@ -350,8 +575,27 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                 } else {
                         last_not_timeout = curr_time;
                 }
+                if ((m_rxtx_mode & MODE_SENDER) != 0) {
+                        abr_process_reports();
+                        keyframe_process_requests();
+                }
+
+                // size the socket buffers according to the received bitrate
+                if (curr_time - last_rate_check >= NS_IN_SEC) {
+                        uint64_t bytes = 0;
+                        for (struct rtp **d = m_network_devices; *d != nullptr; ++d) {
+                                bytes += rtp_get_bytes_received(*d);
+                        }
+                        if (last_rate_check != 0 && bytes > last_bytes_received) { // counters reset on RX port change
+                                long long bitrate = (bytes - last_bytes_received) * 8 * NS_IN_SEC / (curr_time - last_rate_check);
+                                adjust_recv_buf(udp_buf_size_for_rate(bitrate, RECV_BUF_PLAYOUT_DELAYS * m_playout_delay));
+                        }
+                        last_bytes_received = bytes;
+                        last_rate_check = curr_time;
+                }
 
                 /* Decode and render for each participant in the conference... */
+                next_deadline = LLONG_MAX;
                 pdb_iter_t it;
                 cp = pdb_iter_init(m_participants, &it);
                 while (cp != NULL) {
@@ -388,6 +632,18 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
 
                                 cp->decoder_state = new_video_decoder(d);
                                 cp->decoder_state_deleter = destroy_video_decoder;
+                                if (m_adaptive_delay.miss > 0) {
+                                        pbuf_set_adaptive_delay(cp->playout_buffer, 90000, m_adaptive_delay.min, m_adaptive_delay.max);
+                                        pbuf_set_adaptive_miss_target(cp->playout_buffer, m_adaptive_delay.miss);
+                                }
+                                if (cp->decoder_state != NULL && m_participant_threads && supp_for_mult_sources.val) {
+                                        auto *pd = new participant_decoder(cp->playout_buffer, m_nack,
+                                                        (struct vcodec_state *) cp->decoder_state);
+                                        cp->decoder_state = static_cast<struct vcodec_state *>(pd);
+                                        cp->decoder_state_deleter = destroy_participant_decoder;
+                                        cp->packet_handler = participant_decoder::push_packet;
+                                        cp->packet_handler_udata = pd;
+                                }
 
                                 if (cp->decoder_state == NULL) {
                                         log_msg(LOG_LEVEL_FATAL, "Fatal: unable to create decoder state for "
@@ -398,9 +654,41 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
 #endif // SHARED_DECODER
                         }
 
+                        const rtcp_sr *sr = rtp_get_sr(m_network_devices[0], cp->ssrc);
+                        if (participant_decoder *pd = get_participant_decoder(cp)) {
+                                // the playout buffer is processed by the participant thread
+                                unique_lock<mutex> lk(pd->lock);
+                                vector<uint16_t> lost;
+                                swap(lost, pd->nacks);
+                                if (sr != nullptr) {
+                                        pd->sender_clock = { ntp64_to_unix_ns(sr->ntp_sec, sr->ntp_frac), sr->rtp_ts };
+                                        pd->sender_clock_set = true;
+                                }
+                                lk.unlock();
+                                if (!lost.empty()) {
+                                        rtp_send_nack(m_network_devices[0], cp->ssrc, lost.data(), lost.size());
+                                }
+                                adjust_recv_buf(pd->recv_buf_size);
+                                keyframe_request_if_needed(cp, curr_time);
+                                cp = pdb_iter_next(&it);
+                                continue;
+                        }
+
+                        if (m_nack) {
+                                uint16_t lost[MAX_NACKS_PER_PASS];
+                                int count = pbuf_get_nacks(cp->playout_buffer, curr_time, lost, MAX_NACKS_PER_PASS);
+                                if (count > 0) {
+                                        rtp_send_nack(m_network_devices[0], cp->ssrc, lost, count);
+                                }
+                        }
+
+                        if (sr != nullptr) {
+                                pbuf_set_sender_clock(cp->playout_buffer, ntp64_to_unix_ns(sr->ntp_sec, sr->ntp_frac), sr->rtp_ts, 90000);
+                        }
                         struct vcodec_state *vdecoder_state = (struct vcodec_state *) cp->decoder_state;
 
                         /* Decode and render video... */
+                        pbuf_decode_partial(cp->playout_buffer, decode_video_frame_partial, vdecoder_state);
                         if (pbuf_decode
                             (cp->playout_buffer, curr_time, decode_video_frame, vdecoder_state)) {
                                 tiles_post++;
@@ -435,23 +723,14 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                                 last_tile_received = curr_time;
                         }
 
+                        keyframe_request_if_needed(cp, curr_time);
+
                         if(vdecoder_state && vdecoder_state->decoded % 100 == 99) {
-                                int new_size = vdecoder_state->max_frame_size * 110ull / 100;
-                                if(new_size > last_buf_size) {
-                                        struct rtp **device = m_network_devices;
-                                        while(*device) {
-                                                int ret = rtp_set_recv_buf(*device, new_size);
-                                                if(!ret) {
-                                                        display_buf_increase_warning(new_size);
-                                                }
-                                                debug_msg("Recv buffer adjusted to %d\n", new_size);
-                                                device++;
-                                        }
-                                        last_buf_size = new_size;
-                                }
+                                adjust_recv_buf(vdecoder_state->max_frame_size * 110ull / 100);
                         }
 
                         pbuf_remove(cp->playout_buffer, curr_time);
+                        next_deadline = std::min(next_deadline, pbuf_next_deadline(cp->playout_buffer, curr_time));
                         cp = pdb_iter_next(&it);
                 }
                 pdb_iter_done(&it);
@@ -460,6 +739,14 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
 #ifdef SHARED_DECODER
         destroy_video_decoder(shared_decoder);
 #else
+        pdb_iter_t it;
+        for (cp = pdb_iter_init(m_participants, &it); cp != NULL; cp = pdb_iter_next(&it)) {
+                if (participant_decoder *pd = get_participant_decoder(cp)) {
+                        pd->stop();
+                }
+        }
+        pdb_iter_done(&it);
+
         /* Because decoders work asynchronously we need to make sure
          * that display won't be called */
         remove_display_from_decoders();
@@ -468,6 +755,7 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
         // pass posioned pill to display
         display_put_frame(m_display_device, NULL, PUTF_BLOCKING);
 
+        module_set_mem_owner(NULL);
         return 0;
 }
 
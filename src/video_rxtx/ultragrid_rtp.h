@@ -41,6 +41,7 @@
 #include "video_rxtx.h"
 #include "video_rxtx/rtp.h"
 
+#include <atomic>
 #include <condition_variable>
 #include <list>
 #include <map>
@@ -61,6 +62,9 @@ public:
 private:
         static void *receiver_thread(void *arg);
         virtual void send_frame(std::shared_ptr<video_frame>);
+        time_ns_t held_frames_deadline() override;
+        void send_held_frames() override;
+        void send_encoded_frame(std::shared_ptr<video_frame>);
         void *receiver_loop();
         static void *send_frame_async_callback(void *arg);
         virtual void send_frame_async(std::shared_ptr<video_frame>);
@@ -70,6 +74,7 @@ private:
         void remove_display_from_decoders();
         struct vcodec_state *new_video_decoder(struct display *d);
         static void destroy_video_decoder(void *state);
+        static void destroy_participant_decoder(void *state);
 
         enum video_mode  m_decoder_mode;
         struct display  *m_display_device;
@@ -78,6 +83,14 @@ private:
                                                       ///< multiple decoders, here are
                                                       ///< saved forked states
         const char      *m_requested_encryption;
+        bool             m_nack; ///< request (receiver) and serve (sender) retransmissions of lost packets
+        bool             m_participant_threads; ///< process each participant playout buffer in its own thread
+        struct {
+                double min, max; ///< s
+                double miss;     ///< ratio of late frames, 0 - adaptive playout delay disabled
+        } m_adaptive_delay{};
+        double           m_playout_delay = 0.032; ///< video playout delay the socket buffer is sized for (receiver thread only)
+        std::atomic<bool> m_next_frame_waiting{false};
 
         /**
          * This variables serve as a notification when asynchronous sending exits
@@ -59,8 +59,44 @@ struct state_scale {
         GLuint tex_input;
         GLuint tex_output;
         GLuint fbo;
+
+        bool pipelined; ///< requested by the user
+        bool use_pbo; ///< pipelined mode is active for current format (single tile only)
+        GLuint pbo_upload[2];
+        GLuint pbo_readback[2];
+        int cur; ///< index of PBOs used by the current frame
+        bool readback_pending; ///< pbo_readback[!cur] holds previous frame
+
+        char *tmp_data; ///< persistent buffer for pitch conversion
+        size_t tmp_data_len;
 };
 
+static void get_tex_size(struct state_scale *s, int width, int height, int *tex_width, int *tex_height)
+{
+        if(s->in->color_spec == UYVY) {
+                width /= 2;
+        }
+        if(s->in->interlacing == INTERLACED_MERGED) {
+                width *= 2;
+                height /= 2;
+        }
+        *tex_width = width;
+        *tex_height = height;
+}
+
+static void copy_lines(char *dst, const char *src, int linesize, int dst_pitch, int height)
+{
+        if (linesize == dst_pitch) {
+                memcpy(dst, src, (size_t) linesize * height);
+                return;
+        }
+        for (int y = 0; y < height; y += 1) {
+                memcpy(dst, src, linesize);
+                dst += dst_pitch;
+                src += linesize;
+        }
+}
+
 static bool scale_get_property(void *state, int property, void *val, size_t *len)
 {
         bool ret = false;
@@ -87,7 +123,9 @@ static bool scale_get_property(void *state, int property, void *val, size_t *len
 static void usage()
 {
         printf("Scale postprocessor settings:\n");
-        printf("\t-p scale:width:height\n");
+        printf("\t-p scale:width:height[:pipelined]\n");
+        printf("\tpipelined - overlap upload, scaling and readback of consecutive frames\n"
+               "\t            (asynchronous PBO transfers, adds 1 frame of latency)\n");
 }
 
 static void * scale_init(const char *config) {
@@ -114,6 +152,16 @@ static void * scale_init(const char *config) {
         if (ptr != NULL) {
                 s->scaled_height = atoi(ptr);
         }
+        ptr = strtok_r(NULL, ":", &save_ptr);
+        if (ptr != NULL && strcmp(ptr, "pipelined") == 0) {
+                s->pipelined = true;
+        } else if (ptr != NULL) {
+                fprintf(stderr, "Scale postprocessor unknown option: %s.\n", ptr);
+                usage();
+                free(s);
+                free(tmp);
+                return NULL;
+        }
         if (s->scaled_width <= 0 || s->scaled_height <= 0) {
                 fprintf(stderr, "Scale postprocessor incorrect usage.\n");
                 usage();
@@ -146,10 +194,42 @@ static void * scale_init(const char *config) {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
         glGenFramebuffers(1, &s->fbo);
+        if (s->pipelined) {
+                glGenBuffers(2, s->pbo_upload);
+                glGenBuffers(2, s->pbo_readback);
+        }
 
         return s;
 }
 
+/// maps upload PBO of the current frame so that the decoder writes directly to it
+static void map_upload_pbo(struct state_scale *s)
+{
+        struct tile *in_tile = vf_get_tile(s->in, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s->pbo_upload[s->cur]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, in_tile->data_len, NULL, GL_STREAM_DRAW); // orphan - no wait for GPU
+        in_tile->data = (char *) glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+static void free_input(struct state_scale *s)
+{
+        if (!s->in) {
+                return;
+        }
+        if (s->use_pbo) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s->pbo_upload[s->cur]);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        } else {
+                for (int i = 0; i < (int) s->in->tile_count; ++i) {
+                        free(s->in->tiles[i].data);
+                }
+        }
+        vf_free(s->in);
+        s->in = NULL;
+}
+
 static int scale_reconfigure(void *state, struct video_desc desc)
 {
         struct state_scale *s = (struct state_scale *) state;
@@ -157,13 +237,9 @@ static int scale_reconfigure(void *state, struct video_desc desc)
         int i;
         int width, height;
 
-        if(s->in) {
-                int i;
-                for(i = 0; i < (int) s->in->tile_count; ++i) {
-                        free(s->in->tiles[i].data);
-                }
-                vf_free(s->in);
-        }
+        gl_context_make_current(&s->context);
+
+        free_input(s);
 
         s->in = vf_alloc(desc.tile_count);
 
@@ -171,6 +247,7 @@ static int scale_reconfigure(void *state, struct video_desc desc)
         s->in->color_spec = desc.color_spec;
         s->in->fps = desc.fps;
         s->in->interlacing = desc.interlacing;
+        s->use_pbo = s->pipelined && desc.tile_count == 1;
 
         for(i = 0; i < (int) desc.tile_count; ++i) {
                 in_tile = vf_get_tile(s->in, i);
@@ -179,42 +256,36 @@ static int scale_reconfigure(void *state, struct video_desc desc)
 
                 in_tile->data_len =
                         vc_get_linesize(desc.width, desc.color_spec) * desc.height;
-                in_tile->data = malloc(in_tile->data_len);
+                if (!s->use_pbo) {
+                        in_tile->data = malloc(in_tile->data_len);
+                }
         }
 
         assert(desc.tile_count >= 1);
         in_tile = vf_get_tile(s->in, 0);
 
-        gl_context_make_current(&s->context);
-
         glBindTexture(GL_TEXTURE_2D, s->tex_input);
-        width = in_tile->width;
-        height = in_tile->height;
-        if(s->in->color_spec == UYVY) {
-                width /= 2;
-        }
-        if(s->in->interlacing == INTERLACED_MERGED) {
-                width *= 2;
-                height /= 2;
-        }
+        get_tex_size(s, in_tile->width, in_tile->height, &width, &height);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height,
                         0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 
 
 
         glBindTexture(GL_TEXTURE_2D, s->tex_output);
-        width = s->scaled_width;
-        height = s->scaled_height;
-        if(s->in->color_spec == UYVY) {
-                width /= 2;
-        }
-        if(s->in->interlacing == INTERLACED_MERGED) {
-                width *= 2;
-                height /= 2;
-        }
+        get_tex_size(s, s->scaled_width, s->scaled_height, &width, &height);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height,
                         0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 
+        if (s->use_pbo) {
+                for (i = 0; i < 2; ++i) {
+                        glBindBuffer(GL_PIXEL_PACK_BUFFER, s->pbo_readback[i]);
+                        glBufferData(GL_PIXEL_PACK_BUFFER, (size_t) width * height * 4, NULL, GL_STREAM_READ);
+                }
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                s->cur = 0;
+                s->readback_pending = false;
+                map_upload_pbo(s);
+        }
 
         return TRUE;
 }
@@ -226,6 +297,75 @@ static struct video_frame * scale_getf(void *state)
         return s->in;
 }
 
+/// renders tex_input scaled to tex_output, leaves the FBO bound for readback
+static void render_scaled(struct state_scale *s)
+{
+        int width, height;
+        glBindFramebuffer(GL_FRAMEBUFFER, s->fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, s->tex_output, 0);
+
+        get_tex_size(s, s->scaled_width, s->scaled_height, &width, &height);
+        glViewport(0, 0, width, height);
+        glBindTexture(GL_TEXTURE_2D, s->tex_input);
+
+        glClearColor(1,0,0,1);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glBegin(GL_QUADS);
+        glTexCoord2f(0.0, 0.0); glVertex2f(-1.0, -1.0);
+        glTexCoord2f(1.0, 0.0); glVertex2f(1.0, -1.0);
+        glTexCoord2f(1.0, 1.0); glVertex2f(1.0, 1.0);
+        glTexCoord2f(0.0, 1.0); glVertex2f(-1.0, 1.0);
+        glEnd();
+
+        glBindTexture(GL_TEXTURE_2D, s->tex_output);
+}
+
+/**
+ * Pipelined variant - the frame was decoded directly to the mapped upload
+ * PBO, its upload and scaling are only queued and the readback goes to
+ * a PBO as well. What is copied to the output is the previous frame, whose
+ * readback has finished in the meantime, so the CPU doesn't wait for GPU.
+ */
+static bool scale_postprocess_pipelined(struct state_scale *s, struct video_frame *out, int req_pitch)
+{
+        struct tile *in_tile = vf_get_tile(s->in, 0);
+        int width, height;
+        bool ret = false;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s->pbo_upload[s->cur]);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindTexture(GL_TEXTURE_2D, s->tex_input);
+        get_tex_size(s, in_tile->width, in_tile->height, &width, &height);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+                        GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        render_scaled(s);
+
+        get_tex_size(s, s->scaled_width, s->scaled_height, &width, &height);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, s->pbo_readback[s->cur]);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+        if (s->readback_pending) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, s->pbo_readback[!s->cur]);
+                const char *prev = (const char *) glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+                if (prev) {
+                        copy_lines(out->tiles[0].data, prev, vc_get_linesize(out->tiles[0].width, out->color_spec),
+                                        req_pitch, out->tiles[0].height);
+                        ret = true;
+                }
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        s->readback_pending = true;
+        s->cur = !s->cur;
+        map_upload_pbo(s);
+
+        return ret;
+}
+
 static bool scale_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
 {
         struct state_scale *s = (struct state_scale *) state;
@@ -234,74 +374,40 @@ static bool scale_postprocess(void *state, struct video_frame *in, struct video_
 
         int src_linesize = vc_get_linesize(out->tiles[0].width, out->color_spec);
 
-        char *tmp_data = NULL;
+        gl_context_make_current(&s->context);
 
-        if(req_pitch != src_linesize) {
-                tmp_data = malloc(src_linesize *
-                                out->tiles[0].height);
+        if (s->use_pbo) {
+                return scale_postprocess_pipelined(s, out, req_pitch);
         }
 
-        gl_context_make_current(&s->context);
+        if(req_pitch != src_linesize) {
+                size_t len = (size_t) src_linesize * out->tiles[0].height;
+                if (s->tmp_data_len < len) {
+                        free(s->tmp_data);
+                        s->tmp_data = malloc(len);
+                        s->tmp_data_len = len;
+                }
+        }
 
         for(i = 0; i < (int) in->tile_count; ++i) {
                 struct tile *in_tile = vf_get_tile(s->in, i);
 
                 glBindTexture(GL_TEXTURE_2D, s->tex_input);
-                width = in_tile->width;
-                height = in_tile->height;
-                if(s->in->color_spec == UYVY) {
-                        width /= 2;
-                }
-                if(s->in->interlacing == INTERLACED_MERGED) {
-                        width *= 2;
-                        height /= 2;
-                }
+                get_tex_size(s, in_tile->width, in_tile->height, &width, &height);
                 glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
                                 GL_RGBA, GL_UNSIGNED_BYTE, in_tile->data); 
 
-                glBindFramebuffer(GL_FRAMEBUFFER, s->fbo);
-                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, s->tex_output, 0);
+                render_scaled(s);
 
-                width = s->scaled_width;
-                height = s->scaled_height;
-                if(s->in->color_spec == UYVY) {
-                        width /= 2;
-                }
-                if(s->in->interlacing == INTERLACED_MERGED) {
-                        width *= 2;
-                        height /= 2;
-                }
-                glViewport(0, 0, width, height);
-                glBindTexture(GL_TEXTURE_2D, s->tex_input);
-
-                glClearColor(1,0,0,1);
-                glClear(GL_COLOR_BUFFER_BIT);
-
-                glBegin(GL_QUADS);
-                glTexCoord2f(0.0, 0.0); glVertex2f(-1.0, -1.0);
-                glTexCoord2f(1.0, 0.0); glVertex2f(1.0, -1.0);
-                glTexCoord2f(1.0, 1.0); glVertex2f(1.0, 1.0);
-                glTexCoord2f(0.0, 1.0); glVertex2f(-1.0, 1.0);
-                glEnd();
-
-                glBindTexture(GL_TEXTURE_2D, s->tex_output);
-                if(tmp_data) { /* we need to change pitch */
-                        int y;
-                        glReadPixels(0, 0, width , height, GL_RGBA, GL_UNSIGNED_BYTE, tmp_data);
-                        char *src = tmp_data;
-                        char *dst = out->tiles[i].data;
-                        for (y = 0; y < (int) out->tiles[i].height; y += 1) {
-                                memcpy(dst, src, src_linesize);
-                                dst += req_pitch;
-                                src += src_linesize;
-                        }
+                get_tex_size(s, s->scaled_width, s->scaled_height, &width, &height);
+                if(req_pitch != src_linesize) { /* we need to change pitch */
+                        glReadPixels(0, 0, width , height, GL_RGBA, GL_UNSIGNED_BYTE, s->tmp_data);
+                        copy_lines(out->tiles[i].data, s->tmp_data, src_linesize, req_pitch, out->tiles[i].height);
                 } else {
                         glReadPixels(0, 0, width , height, GL_RGBA, GL_UNSIGNED_BYTE, out->tiles[i].data);
                 }
         }
 
-        free(tmp_data);
-
         return true;
 }
 
@@ -309,13 +415,17 @@ static void scale_done(void *state)
 {
         struct state_scale *s = (struct state_scale *) state;
 
+        gl_context_make_current(&s->context);
+        free_input(s);
+
         glDeleteTextures(1, &s->tex_input);
         glDeleteTextures(1, &s->tex_output);
         glDeleteFramebuffers(1, &s->fbo);
-
-        free(s->in->tiles[0].data);
-
-        vf_free(s->in);
+        if (s->pipelined) {
+                glDeleteBuffers(2, s->pbo_upload);
+                glDeleteBuffers(2, s->pbo_readback);
+        }
+        free(s->tmp_data);
 
         destroy_gl_context(&s->context);
 
@@ -52,16 +52,24 @@
 #include "lib_common.h"
 #include "tv.h"
 #include "utils/color_out.h"
+#include "utils/macros.h"
 #include "utils/text.h" // indent_paragraph
+#include "utils/worker.h"
 #include "video.h"
 #include "video_display.h"
 #include "vo_postprocess.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define MOD_NAME "[temporal deint] "
 #define TIMEOUT "20ms"
 #define DFR_DEINTERLACE_IMPOSSIBLE_MSG_ID 0x27ff0a78
+#define YADIF_UNSUPPORTED_MSG_ID 0x1c5e7a02
+#define LINES_PER_TASK 32
 
-enum algo { DF, BOB, LINEAR };
+enum algo { DF, BOB, LINEAR, YADIF };
 
 struct state_df {
         enum algo algo;
@@ -71,6 +79,7 @@ struct state_df {
         bool deinterlace;
         bool nodelay;
         bool force;
+        bool have_prev; ///< the other buffer holds previous frame (YADIF)
 
         time_ns_t frame_received;
 };
@@ -160,6 +169,20 @@ static void * linear_init(const char *config) {
         return init_common(LINEAR, config);
 }
 
+static void * yadif_init(const char *config) {
+        if (strcmp(config, "help") == 0) {
+                color_printf(TBOLD("YADIF") " is a motion adaptive deinterlacer - static areas are "
+                                "weaved from both fields, moving ones interpolated spatially (edge directed). "
+                                "Outputs every field as a frame with one field delay.\n\n");
+                color_printf("Usage:\n");
+                color_printf("\t" TBOLD(TRED("-p deinterlace_yadif") "[:nodelay|:force]") "\n");
+                color_printf("\nwhere:\n");
+                print_common_opts();
+                return NULL;
+        }
+        return init_common(YADIF, config);
+}
+
 static bool common_get_property(void *state, int property, void *val, size_t *len)
 {
         UNUSED(state);
@@ -195,6 +218,7 @@ static int common_postprocess_reconfigure(void *state, struct video_desc desc)
 
         s->buffers[0] = (char *) malloc(in_tile->data_len);
         s->buffers[1] = (char *) malloc(in_tile->data_len);
+        s->have_prev = false;
         in_tile->data = s->buffers[s->buffer_current];
         
         return TRUE;
@@ -248,179 +272,260 @@ static void perform_df(struct state_df *s, struct video_frame *in, struct video_
         }
 }
 
-static void perform_bob(struct state_df *s, struct video_frame *in, struct video_frame *out, int pitch)
+struct line_job {
+        struct state_df *s;
+        const char *prev; ///< previous frame (YADIF only)
+        const char *next; ///< current (last received) frame (YADIF only)
+        const char *cur; ///< frame whose field is being output
+        char *dst;
+        int pitch;
+        int linesize;
+        unsigned height;
+        int parity; ///< 0 - the field of even lines is kept, 1 - odd one
+};
+
+/**
+ * Bob and linear for a band of output line pairs - every kept field line is
+ * copied and the following missing one is either duplicated or interpolated
+ * from the neighbouring field lines.
+ */
+static void bob_linear_pairs(void *arg, size_t begin, size_t end)
 {
-        int linesize = vc_get_linesize(s->in->tiles[0].width, s->in->color_spec);
-        char *dst = out->tiles[0].data;
-        char *src = s->buffers[s->buffer_current] + (in ? 0 : linesize);
-        if (in == NULL) {
-                memcpy(dst, src, linesize); // copy first line up
-                dst += pitch; // then copy every even line to subsequent odd line
+        struct line_job *j = arg;
+        for (size_t pair = begin; pair < end; ++pair) {
+                unsigned y = 2 * pair + j->parity; // kept line
+                const char *src = j->cur + (size_t) y * j->linesize;
+                char *dst = j->dst + (size_t) y * j->pitch;
+                memcpy(dst, src, j->linesize);
+                if (y + 1 >= j->height) {
+                        continue;
+                }
+                if (j->s->algo == BOB || y + 2 >= j->height
+                                || !vc_avg_lines(j->s->in->color_spec, j->linesize, (const unsigned char *) src,
+                                        (const unsigned char *) src + 2 * j->linesize, (unsigned char *) dst + j->pitch)) {
+                        memcpy(dst + j->pitch, src, j->linesize); // bob (or fallback)
+                }
         }
-        unsigned y = in ? 0 : 1;
-        for ( ; y < out->tiles[0].height - 1; y += 2) {
-                memcpy(dst, src, linesize);
-                memcpy(dst + pitch, src, linesize);
-                dst += 2 * pitch;
-                src += 2 * linesize;
+}
+
+static void perform_bob_linear(struct state_df *s, struct video_frame *in, struct video_frame *out, int pitch)
+{
+        struct line_job j = { s, NULL, NULL, s->buffers[s->buffer_current], out->tiles[0].data, pitch,
+                vc_get_linesize(s->in->tiles[0].width, s->in->color_spec), out->tiles[0].height, in ? 0 : 1 };
+        if (in == NULL) {
+                memcpy(j.dst, j.cur + j.linesize, j.linesize); // copy first line up
         }
-        if (y < out->tiles[0].height) {
-                memcpy(dst, dst - pitch, linesize);
+        size_t pairs = (j.height - j.parity + 1) / 2;
+        task_run_parallel_for(pairs, LINES_PER_TASK / 2, bob_linear_pairs, &j);
+}
+
+#define ABS(x) ((x) < 0 ? -(x) : (x))
+#define MIN3(a, b, c) MIN(MIN(a, b), c)
+#define MAX3(a, b, c) MAX(MAX(a, b), c)
+
+/// lines used to interpolate one missing line by YADIF
+struct yadif_rows {
+        const void *c, *e; ///< lines above and below in the output field
+        const void *p, *n; ///< the missing line in the previous and current frame
+        const void *pc, *nc; ///< line above in the previous and current frame
+        const void *pe, *ne; ///< line below in the previous and current frame
+        const void *pa2, *na2; ///< line 2 above in the previous and current frame
+        const void *pb2, *nb2; ///< line 2 below in the previous and current frame
+};
+
+/**
+ * Motion adaptive interpolation of one missing line (YADIF algorithm) for
+ * codecs with 8-bit or 16-bit components. The temporal prediction is the
+ * average of the previous and the current frame (the fields with the
+ * parity of the missing line surround the output field in time), it is
+ * used where the picture doesn't move, otherwise the edge-directed
+ * spatial prediction is used clamped by the temporal differences.
+ *
+ * Processes samples [begin, end), step is the distance of the samples of
+ * the same component and len the line length (in samples).
+ */
+#define DEFINE_YADIF_LINE(name, T) \
+static void name(void *dst_line, const struct yadif_rows *r, int begin, int end, int len, int step) \
+{ \
+        T *dst = dst_line; \
+        const T *c = r->c, *e = r->e, *p = r->p, *n = r->n; \
+        const T *pc = r->pc, *nc = r->nc, *pe = r->pe, *ne = r->ne; \
+        const T *pa2 = r->pa2, *na2 = r->na2, *pb2 = r->pb2, *nb2 = r->nb2; \
+        for (int x = begin; x < end; ++x) { \
+                int d = (p[x] + n[x]) >> 1; \
+                int td0 = ABS(p[x] - n[x]); \
+                int td1 = (ABS(pc[x] - nc[x]) + ABS(pe[x] - ne[x])) >> 1; \
+                int diff = MAX(td0 >> 1, td1); \
+                int spatial = (c[x] + e[x] + 1) >> 1; \
+                if (x >= 2 * step && x < len - 2 * step) { \
+                        int score = ABS(c[x - step] - e[x - step]) + ABS(c[x] - e[x]) + ABS(c[x + step] - e[x + step]); \
+                        int score_l = ABS(c[x - 2 * step] - e[x]) + ABS(c[x - step] - e[x + step]) + ABS(c[x] - e[x + 2 * step]); \
+                        int score_r = ABS(c[x] - e[x - 2 * step]) + ABS(c[x + step] - e[x - step]) + ABS(c[x + 2 * step] - e[x]); \
+                        if (score_l < score && score_l <= score_r) { \
+                                spatial = (c[x - step] + e[x + step] + 1) >> 1; \
+                        } else if (score_r < score) { \
+                                spatial = (c[x + step] + e[x - step] + 1) >> 1; \
+                        } \
+                } \
+                int b = (pa2[x] + na2[x]) >> 1; \
+                int f = (pb2[x] + nb2[x]) >> 1; \
+                int max = MAX3(d - e[x], d - c[x], MIN(b - c[x], f - e[x])); \
+                int min = MIN3(d - e[x], d - c[x], MAX(b - c[x], f - e[x])); \
+                diff = MAX3(diff, min, -max); \
+                dst[x] = MIN(MAX(spatial, d - diff), d + diff); \
+        } \
+}
+DEFINE_YADIF_LINE(yadif_line_8, uint8_t)
+DEFINE_YADIF_LINE(yadif_line_16, uint16_t)
+
+#ifdef __SSE2__
+static inline __m128i load8_epi16(const void *src, int x)
+{
+        return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(const void *) ((const uint8_t *) src + x)), _mm_setzero_si128());
+}
+
+static inline __m128i absdiff_epi16(__m128i a, __m128i b)
+{
+        return _mm_max_epi16(_mm_sub_epi16(a, b), _mm_sub_epi16(b, a));
+}
+
+static inline __m128i select_epi16(__m128i mask, __m128i a, __m128i b)
+{
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/**
+ * SSE2 version of yadif_line_8() for the samples having all the spatial
+ * neighbours, processes 8 samples at once in 16-bit lanes
+ * @returns the first unprocessed sample
+ */
+static int yadif_line_8_sse2(void *dst, const struct yadif_rows *r, int len, int step)
+{
+        int x = 2 * step;
+        for ( ; x + 8 + 2 * step <= len; x += 8) {
+                __m128i cx = load8_epi16(r->c, x);
+                __m128i ex = load8_epi16(r->e, x);
+                __m128i px = load8_epi16(r->p, x);
+                __m128i nx = load8_epi16(r->n, x);
+                __m128i d = _mm_srli_epi16(_mm_add_epi16(px, nx), 1);
+                __m128i td0 = absdiff_epi16(px, nx);
+                __m128i td1 = _mm_srli_epi16(_mm_add_epi16(absdiff_epi16(load8_epi16(r->pc, x), load8_epi16(r->nc, x)),
+                                        absdiff_epi16(load8_epi16(r->pe, x), load8_epi16(r->ne, x))), 1);
+                __m128i diff = _mm_max_epi16(_mm_srli_epi16(td0, 1), td1);
+
+                __m128i c_l1 = load8_epi16(r->c, x - step);
+                __m128i c_l2 = load8_epi16(r->c, x - 2 * step);
+                __m128i c_r1 = load8_epi16(r->c, x + step);
+                __m128i c_r2 = load8_epi16(r->c, x + 2 * step);
+                __m128i e_l1 = load8_epi16(r->e, x - step);
+                __m128i e_l2 = load8_epi16(r->e, x - 2 * step);
+                __m128i e_r1 = load8_epi16(r->e, x + step);
+                __m128i e_r2 = load8_epi16(r->e, x + 2 * step);
+                __m128i score = _mm_add_epi16(_mm_add_epi16(absdiff_epi16(c_l1, e_l1), absdiff_epi16(cx, ex)),
+                                absdiff_epi16(c_r1, e_r1));
+                __m128i score_l = _mm_add_epi16(_mm_add_epi16(absdiff_epi16(c_l2, ex), absdiff_epi16(c_l1, e_r1)),
+                                absdiff_epi16(cx, e_r2));
+                __m128i score_r = _mm_add_epi16(_mm_add_epi16(absdiff_epi16(cx, e_l2), absdiff_epi16(c_r1, e_l1)),
+                                absdiff_epi16(c_r2, ex));
+                __m128i use_l = _mm_andnot_si128(_mm_cmpgt_epi16(score_l, score_r), _mm_cmplt_epi16(score_l, score));
+                __m128i use_r = _mm_andnot_si128(use_l, _mm_cmplt_epi16(score_r, score));
+                __m128i spatial = select_epi16(use_l, _mm_avg_epu16(c_l1, e_r1),
+                                select_epi16(use_r, _mm_avg_epu16(c_r1, e_l1), _mm_avg_epu16(cx, ex)));
+
+                __m128i b = _mm_srli_epi16(_mm_add_epi16(load8_epi16(r->pa2, x), load8_epi16(r->na2, x)), 1);
+                __m128i f = _mm_srli_epi16(_mm_add_epi16(load8_epi16(r->pb2, x), load8_epi16(r->nb2, x)), 1);
+                __m128i de = _mm_sub_epi16(d, ex);
+                __m128i dc = _mm_sub_epi16(d, cx);
+                __m128i bc = _mm_sub_epi16(b, cx);
+                __m128i fe = _mm_sub_epi16(f, ex);
+                __m128i max = _mm_max_epi16(_mm_max_epi16(de, dc), _mm_min_epi16(bc, fe));
+                __m128i min = _mm_min_epi16(_mm_min_epi16(de, dc), _mm_max_epi16(bc, fe));
+                diff = _mm_max_epi16(_mm_max_epi16(diff, min), _mm_sub_epi16(_mm_setzero_si128(), max));
+
+                __m128i res = _mm_min_epi16(_mm_max_epi16(spatial, _mm_sub_epi16(d, diff)), _mm_add_epi16(d, diff));
+                _mm_storel_epi64((__m128i *)(void *) ((uint8_t *) dst + x), _mm_packus_epi16(res, res));
         }
+        return x;
 }
+#endif
 
-/// copied from vc_deinterlace_ex
-///
-/// consider merging with vc_deinterlace_ex but perhaps not needed (that func
-/// has slightly different structure - always averages 2 adjacent lines and
-/// writes the result twice to those. This version also uses GCC generic
-/// vectorization support instead of SSE (performs fast if vector_size==16)
-static bool avg_lines(codec_t codec, size_t linesize, char *src1, char *src2, char *dst)
+static int get_component_step(codec_t codec)
 {
-        char *s1 = (char *) src1;
-        char *s2 = (char *) src2;
-        char *d = (char *) dst;
-        if (is_codec_opaque(codec) && codec_is_planar(codec)) {
-                return false;
+        switch (codec) {
+        case RGB:
+        case BGR:
+        case RG48:
+                return 3;
+        default:
+                return 4; // UYVY, YUYV, RGBA, Y416...
         }
-        int bpp = get_bits_per_component(codec);
-        if (bpp == 8 || bpp == 16) {
-                size_t x = 0;
-                if (bpp == 8) {
-                        typedef unsigned char v16uc __attribute__ ((vector_size (16)));
-                        for ( ; x < linesize / 16; ++x) {
-                                v16uc i1, i2;
-                                memcpy(&i1, s1, sizeof i1);
-                                memcpy(&i2, s2, sizeof i2);
-                                v16uc res = ((i1 / 2) + (i2 / 2) + (i1 % 2 + i1 % 2) / 2);
-                                memcpy(d, &res, sizeof res);
-                                s1 += 16;
-                                s2 += 16;
-                                d += 16;
-                        }
-                } else {
-                        typedef unsigned short v16us __attribute__ ((vector_size (16)));
-                        for ( ; x < linesize / 16; ++x) {
-                                v16us i1, i2;
-                                memcpy(&i1, s1, sizeof i1);
-                                memcpy(&i2, s2, sizeof i2);
-                                v16us res = ((i1 / 2) + (i2 / 2) + (i1 % 2 + i1 % 2) / 2);
-                                memcpy(d, &res, sizeof res);
-                                s1 += 16;
-                                s2 += 16;
-                                d += 16;
-                        }
-                }
-                x *= 16;
-                if (bpp  == 8) {
-                        for ( ; x < linesize; ++x) {
-                                *d++ = (*s1++ + *s2++ + 1) >> 1;
-                        }
-                } else {
-                        uint16_t *d16 = (uint16_t *)(void *) d;
-                        uint16_t *s16_1 = (uint16_t *)(void *) s1;
-                        uint16_t *s16_2 = (uint16_t *)(void *) s2;
-                        for ( ; x < linesize / 2; ++x) {
-                                *d16++ = (*s16_1++ + *s16_2++ + 1) >> 1;
-                        }
-                }
-        } else if (codec == v210) {
-                uint32_t *s32_1 = (uint32_t *)(void *) s1;
-                uint32_t *s32_2 = (uint32_t *)(void *) s2;
-                uint32_t *d32 = (uint32_t *)(void *) d;
-                for (size_t x = 0; x < linesize / 16; ++x) {
-                        #pragma GCC unroll 4
-                        for (int y = 0; y < 4; ++y) {
-                                uint32_t v1 = *s32_1++;
-                                uint32_t v2 = *s32_2++;
-                                *d32++ =
-                                        (((v1 >> 20        ) + (v2 >> 20        ) + 1) / 2) << 20 |
-                                        (((v1 >> 10 & 0x3ff) + (v2 >> 10 & 0x3ff) + 1) / 2) << 10 |
-                                        (((v1       & 0x3ff) + (v2       & 0x3ff) + 1) / 2);
-                        }
+}
+
+static void yadif_lines(void *arg, size_t begin, size_t end)
+{
+        struct line_job *j = arg;
+        const int bpp = get_bits_per_component(j->s->in->color_spec);
+        const int step = get_component_step(j->s->in->color_spec);
+        const int h = (int) j->height;
+        const size_t ls = j->linesize;
+        const int len = bpp == 8 ? (int) ls : (int) ls / 2;
+#define LINE(frame, y) ((frame) + (size_t) (y) * ls)
+        for (int m = (int) begin; m < (int) end; ++m) {
+                char *dst = j->dst + (size_t) m * j->pitch;
+                if ((m - j->parity) % 2 == 0) { // kept line
+                        memcpy(dst, LINE(j->cur, m), ls);
+                        continue;
                 }
-        } else if (codec == R10k) {
-                uint32_t *s32_1 = (uint32_t *)(void *) s1;
-                uint32_t *s32_2 = (uint32_t *)(void *) s2;
-                uint32_t *d32 = (uint32_t *)(void *) d;
-                for (size_t x = 0; x < linesize / 4; ++x) {
-                        #pragma GCC unroll 4
-                        for (int y = 0; y < 4; ++y) {
-                                uint32_t v1 = ntohl(*s32_1++);
-                                uint32_t v2 = ntohl(*s32_2++);
-                                *d32++ =
-                                        (((v1 >> 22        ) + (v2 >> 22        ) + 1) / 2) << 22 |
-                                        (((v1 >> 12 & 0x3ff) + (v2 >> 12 & 0x3ff) + 1) / 2) << 12 |
-                                        (((v1 >>  2 & 0x3ff) + (v2 >>  2 & 0x3ff) + 1) / 2) << 2;
-                        }
+                // neighbouring lines, mirrored at the edges
+                const int c = m - 1 >= 0 ? m - 1 : m + 1;
+                const int e = m + 1 < h ? m + 1 : m - 1;
+                const int a2 = m - 2 >= 0 ? m - 2 : m;
+                const int b2 = m + 2 < h ? m + 2 : m;
+                if (e < 0) { // single line picture
+                        memcpy(dst, LINE(j->cur, m), ls);
+                        continue;
                 }
-        } else if (codec == R12L) {
-                uint32_t *s32_1 = (uint32_t *)(void *) s1;
-                uint32_t *s32_2 = (uint32_t *)(void *) s2;
-                uint32_t *d32 = (uint32_t *)(void *) d;
-                int shift = 0;
-                uint32_t remain1 = 0;
-                uint32_t remain2 = 0;
-                uint32_t out = 0;
-                for (size_t x = 0; x < linesize / 16; ++x) {
-                        #pragma GCC unroll 8
-                        for (int y = 0; y < 4; ++y) {
-                                uint32_t in1 = *s32_1++;
-                                uint32_t in2 = *s32_2++;
-                                if (shift > 0) {
-                                        remain1 = remain1 | (in1 & ((1<<((shift + 12) % 32)) - 1)) << (32-shift);
-                                        remain2 = remain2 | (in2 & ((1<<((shift + 12) % 32)) - 1)) << (32-shift);
-                                        uint32_t ret = (remain1 + remain2 + 1) / 2;
-                                        out |= ret << shift;
-                                        *d32++ = out;
-                                        out = ret >> (32-shift);
-                                        shift = (shift + 12) % 32;
-                                        in1 >>= shift;
-                                        in2 >>= shift;
-                                }
-                                while (shift <= 32 - 12) {
-                                        out |= ((((in1 & 0xfff) + (in2 & 0xfff)) + 1) / 2) << shift;
-                                        in1 >>= 12;
-                                        in2 >>= 12;
-                                        shift += 12;
-                                }
-                                if (shift == 32) {
-                                        *d32++ = out;
-                                        out = 0;
-                                        shift = 0;
-                                } else {
-                                        remain1 = in1;
-                                        remain2 = in2;
-                                }
-                        }
+                const struct yadif_rows r = {
+                        LINE(j->cur, c), LINE(j->cur, e), LINE(j->prev, m), LINE(j->next, m),
+                        LINE(j->prev, c), LINE(j->next, c), LINE(j->prev, e), LINE(j->next, e),
+                        LINE(j->prev, a2), LINE(j->next, a2), LINE(j->prev, b2), LINE(j->next, b2),
+                };
+                if (bpp == 16) {
+                        yadif_line_16(dst, &r, 0, len, len, step);
+                        continue;
                 }
-        } else {
-                return false;
+                int x = 0;
+#ifdef __SSE2__
+                x = yadif_line_8_sse2(dst, &r, len, step);
+                yadif_line_8(dst, &r, 0, 2 * step, len, step); // left border
+#endif
+                yadif_line_8(dst, &r, x, len, len, step);
         }
-        return true;
+#undef LINE
 }
 
-static void perform_linear(struct state_df *s, struct video_frame *in, struct video_frame *out, int pitch)
+/**
+ * Outputs the fields with one field delay (top field first assumed) - when
+ * frame N arrives, the bottom field of N-1 and then the top field of N are
+ * output. The missing lines of both are then temporally surrounded by the
+ * fields of frames N-1 and N.
+ */
+static void perform_yadif(struct state_df *s, struct video_frame *in, struct video_frame *out, int pitch)
 {
-        int linesize = vc_get_linesize(s->in->tiles[0].width, s->in->color_spec);
-        char *src = s->buffers[s->buffer_current] + (in ? 0 : linesize);
-        char *dst = out->tiles[0].data;
-        if (in == NULL) {
-                memcpy(dst, src, linesize); // copy first line up
-                dst += pitch; // then copy every even line to subsequent odd line
-        }
-        unsigned y = in ? 0 : 1;
-        for ( ; y < out->tiles[0].height - 2; y += 2) {
-                memcpy(dst, src, linesize);
-                if (!avg_lines(out->color_spec, linesize, src, src + 2 * linesize, dst + pitch)) {
-                        memcpy(dst + pitch, src, linesize); // fallback bob
-                }
-                dst += 2 * pitch;
-                src += 2 * linesize;
+        const int bpp = get_bits_per_component(s->in->color_spec);
+        if (is_codec_opaque(s->in->color_spec) || codec_is_planar(s->in->color_spec) || (bpp != 8 && bpp != 16)) {
+                log_msg_once(LOG_LEVEL_WARNING, YADIF_UNSUPPORTED_MSG_ID, MOD_NAME "YADIF supports only 8-bit and 16-bit packed "
+                                "formats, not %s, using linear interpolation.\n", get_codec_name(s->in->color_spec));
+                perform_bob_linear(s, in, out, pitch);
+                return;
         }
-        for ( ; y < out->tiles[0].height; y++) { // last line(s) if needed
-                memcpy(dst, src, linesize);
-                dst += pitch;
+        const char *cur_frame = s->buffers[s->buffer_current];
+        const char *prev_frame = s->have_prev ? s->buffers[(s->buffer_current + 1) % 2] : cur_frame;
+        struct line_job j = { s, prev_frame, cur_frame, in ? prev_frame : cur_frame, out->tiles[0].data, pitch,
+                vc_get_linesize(s->in->tiles[0].width, s->in->color_spec), out->tiles[0].height, in ? 1 : 0 };
+        task_run_parallel_for(j.height, LINES_PER_TASK, yadif_lines, &j);
+        if (in == NULL) {
+                s->have_prev = true;
         }
 }
 
@@ -435,10 +540,11 @@ static bool common_postprocess(void *state, struct video_frame *in, struct video
                                 perform_df(s, in, out, req_pitch);
                                 break;
                         case BOB:
-                                perform_bob(s, in, out, req_pitch);
-                                break;
                         case LINEAR:
-                                perform_linear(s, in, out, req_pitch);
+                                perform_bob_linear(s, in, out, req_pitch);
+                                break;
+                        case YADIF:
+                                perform_yadif(s, in, out, req_pitch);
                                 break;
                 }
         } else {
@@ -519,7 +625,18 @@ static const struct vo_postprocess_info vo_pp_linear_info = {
         common_done,
 };
 
+static const struct vo_postprocess_info vo_pp_yadif_info = {
+        yadif_init,
+        common_postprocess_reconfigure,
+        common_getf,
+        common_get_out_desc,
+        common_get_property,
+        common_postprocess,
+        common_done,
+};
+
 REGISTER_MODULE(double_framerate, &vo_pp_df_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
 REGISTER_MODULE(deinterlace_bob, &vo_pp_bob_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
 REGISTER_MODULE(deinterlace_linear, &vo_pp_linear_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
+REGISTER_MODULE(deinterlace_yadif, &vo_pp_yadif_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
 
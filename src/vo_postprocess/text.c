@@ -65,6 +65,7 @@
 #include "vo_postprocess.h"
 #include "utils/color_out.h"
 #include "utils/macros.h"
+#include "utils/overlay.h"
 #include "utils/string.h" // replace_all
 #include "utils/text.h"
 
@@ -77,8 +78,7 @@ struct state_text {
         int margin_x, margin_y, text_h;
         struct video_desc saved_desc;
 
-        DrawingWand *dw;
-        MagickWand *wand;
+        struct overlay *overlay; ///< text pre-rendered for saved_desc
 };
 
 static bool text_get_property(void *state, int property, void *val, size_t *len)
@@ -164,18 +164,71 @@ static int cf_text_init(struct module *parent, const char *cfg, void **state)
         }
 }
 
+/// renders the text once to a transparent RGBA image that is converted to an overlay
+static struct overlay *render_text(struct state_text *s, codec_t codec)
+{
+        struct overlay *ret = NULL;
+        unsigned char *rgba = NULL;
+        DrawingWand *dw = NewDrawingWand();
+        MagickWand *wand = NewMagickWand();
+        PixelWand *pw = NewPixelWand();
+
+        DrawSetFontSize(dw, s->text_h);
+        MagickBooleanType status = DrawSetFont(dw, "helvetica");
+        if(status != MagickTrue) {
+                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] DraweSetFont failed!\n");
+                goto end;
+        }
+        PixelSetColor(pw, "#333333FF");
+        DrawSetFillColor(dw, pw);
+        PixelSetColor(pw, "#FFFFFFFF");
+        DrawSetStrokeColor(dw, pw);
+
+        PixelSetColor(pw, "none");
+        status = MagickNewImage(wand, s->width, s->height, pw);
+        if(status != MagickTrue) {
+                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickNewImage failed!\n");
+                goto end;
+        }
+        status = MagickAnnotateImage(wand, dw, s->margin_x, s->margin_y + s->text_h, 0, s->text);
+        if (status != MagickTrue) {
+                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickAnnotateImage failed!\n");
+                goto end;
+        }
+        status = MagickDrawImage(wand, dw);
+        if (status != MagickTrue) {
+                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickDrawImage failed!\n");
+                goto end;
+        }
+        rgba = malloc((size_t) s->width * s->height * 4);
+        status = MagickExportImagePixels(wand, 0, 0, s->width, s->height, "RGBA", CharPixel, rgba);
+        if (status != MagickTrue) {
+                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickExportImagePixels failed!\n");
+                goto end;
+        }
+        ret = overlay_create(rgba, s->width, s->height, codec);
+end:
+        free(rgba);
+        DestroyPixelWand(pw);
+        DestroyMagickWand(wand);
+        DestroyDrawingWand(dw);
+        return ret;
+}
+
 static int text_postprocess_reconfigure(void *state, struct video_desc desc)
 {
         struct state_text *s = (struct state_text *) state;
 
         vf_free(s->in);
-        if (s->wand)
-                DestroyMagickWand(s->wand);
-        if (s->dw)
-                DestroyDrawingWand(s->dw);
+        overlay_destroy(s->overlay);
         s->in = 0;
-        s->wand = 0;
-        s->dw = 0;
+        s->overlay = 0;
+
+        if (!overlay_codec_supported(desc.color_spec)) {
+                log_msg(LOG_LEVEL_ERROR, "[text vo_pp.] Codec not supported! Please report to "
+                                PACKAGE_BUGREPORT ".\n");
+                return FALSE;
+        }
 
         s->in = vf_alloc_desc_data(desc);
 
@@ -183,65 +236,11 @@ static int text_postprocess_reconfigure(void *state, struct video_desc desc)
         s->margin_y = s->req_y == -1 ? (int) desc.height / MARGIN_Y_DIV : s->req_y;
         s->text_h = s->req_h == -1 ? (int) desc.height / TEXT_H_DIV : s->req_h;
         s->width = MIN(s->margin_x + strlen(s->text) * s->text_h, desc.width);
+        s->width = s->width / get_pf_block_pixels(desc.color_spec) * get_pf_block_pixels(desc.color_spec);
         s->height = MIN(s->margin_y + s->text_h, (int) desc.height);
 
-        const char *color;
-        const char *color_outline;
-        const char *colorspace;
-        if (desc.color_spec == RGBA) {
-                color = "#333333FF";
-                color_outline = "#FFFFFFFF";
-                colorspace = "rgba";
-        } else if (desc.color_spec == RGB) {
-                color = "#333333FF";
-                color_outline = "#FFFFFFFF";
-                colorspace = "rgb";
-        } else if (desc.color_spec == UYVY) {
-                color = "#228080FF";
-                color_outline = "#EB8080FF";
-                colorspace = "UYVY";
-        } else {
-                log_msg(LOG_LEVEL_ERROR, "[text vo_pp.] Codec not supported! Please report to "
-                                PACKAGE_BUGREPORT ".\n");
-                return FALSE;
-        }
-
-        s->dw = NewDrawingWand();
-        DrawSetFontSize(s->dw, s->text_h);
-        MagickBooleanType status = DrawSetFont(s->dw, "helvetica");
-        if(status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] DraweSetFont failed!\n");
-                return FALSE;
-        }
-        {
-               PixelWand *pw = NewPixelWand();
-               PixelSetColor(pw, color);
-               DrawSetFillColor(s->dw, pw);
-               PixelSetColor(pw, color_outline);
-               DrawSetStrokeColor(s->dw, pw);
-               DestroyPixelWand(pw);
-        }
-
-        s->wand = NewMagickWand();
-        status = MagickSetFormat(s->wand, colorspace);
-        if(status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickSetFormat failed!\n");
-                return FALSE;
-        }
-
-        status = MagickSetSize(s->wand, s->width, s->height);
-        if(status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickSetSize failed!\n");
-                return FALSE;
-        }
-
-        status = MagickSetDepth(s->wand, 8);
-        if(status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickSetDepth failed!\n");
-                return FALSE;
-        }
-
-        return TRUE;
+        s->overlay = render_text(s, desc.color_spec);
+        return s->overlay != NULL;
 }
 
 static struct video_frame * text_getf(void *state)
@@ -251,58 +250,15 @@ static struct video_frame * text_getf(void *state)
         return s->in;
 }
 
-/**
- * @todo
- * Rendering of the text is a bit slow. Since the text doesn't change at all, it should be
- * prerendered and then only alpha blended.
- */
 static bool text_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
 {
         struct state_text *s = (struct state_text *) state;
 
-        int dstlinesize = vc_get_linesize(s->width, in->color_spec);
-        int srclinesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
-        char *tmp = malloc((size_t) s->height * dstlinesize);
-        for (ptrdiff_t y = 0; y < s->height; y++) {
-                memcpy(tmp + y * dstlinesize, in->tiles[0].data + y * srclinesize, dstlinesize);
-        }
-
-        MagickRemoveImage(s->wand);
-        MagickBooleanType status = MagickReadImageBlob(s->wand, tmp, s->height * dstlinesize);
-        if (status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickReadImageBlob failed!\n");
-                return false;
+        int linesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
+        for (unsigned y = 0; y < in->tiles[0].height; ++y) {
+                memcpy(out->tiles[0].data + (size_t) y * req_pitch, in->tiles[0].data + (size_t) y * linesize, linesize);
         }
-        //double *ret = MagickQueryFontMetrics(wand, dw, s->text.c_str());
-        //fprintf(stderr, "%f %f %f %f %f\n", ret[0], ret[1], ret[2], ret[3], ret[4]);
-        unsigned char *data;
-        size_t data_len;
-        status = MagickAnnotateImage(s->wand, s->dw, s->margin_x, s->margin_y + s->text_h, 0, s->text);
-        if (status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickAnnotateImage failed!\n");
-                return false;
-        }
-        status = MagickDrawImage(s->wand, s->dw);
-        if (status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickDrawImage failed!\n");
-                return false;
-        }
-        data = MagickGetImageBlob(s->wand, &data_len);
-        if (!data) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickGetImageBlob failed!\n");
-                return false;
-        }
-
-        memcpy(out->tiles[0].data, in->tiles[0].data, in->tiles[0].data_len);
-
-        if ((int) data_len == s->height * dstlinesize) {
-                for (int y = 0; y < s->height; y++) {
-                        memcpy(out->tiles[0].data + y * req_pitch, data + y * dstlinesize, dstlinesize);
-                }
-        }
-
-        free(data);
-        free(tmp);
+        overlay_blend(s->overlay, out->tiles[0].data, req_pitch, 0, 0);
 
         return true;
 }
@@ -320,16 +276,9 @@ static struct video_frame *cf_text_filter(void *state, struct video_frame *f)
                 }
         }
 
-        struct video_frame *out = vf_alloc_desc_data(s->saved_desc);
-        out->callbacks.dispose = vf_free;
-        if (text_postprocess(state, f, out, vc_get_linesize(f->tiles[0].width, f->color_spec))) {
-                VIDEO_FRAME_DISPOSE(f);
-                return out;
-        } else {
-                VIDEO_FRAME_DISPOSE(f);
-                vf_free(out);
-                return NULL;
-        }
+        // capture filters may modify the frame in place
+        overlay_blend(s->overlay, f->tiles[0].data, vc_get_linesize(f->tiles[0].width, f->color_spec), 0, 0);
+        return f;
 }
 
 static void text_done(void *state)
@@ -337,9 +286,7 @@ static void text_done(void *state)
         struct state_text *s = (struct state_text *) state;
 
         vf_free(s->in);
-
-        DestroyMagickWand(s->wand);
-        DestroyDrawingWand(s->dw);
+        overlay_destroy(s->overlay);
 
         free(s->data);
         free(s->text);
@@ -369,7 +316,9 @@ static const struct vo_postprocess_info vo_pp_text_info = {
 static const struct capture_filter_info capture_filter_text_info = {
         cf_text_init,
         text_done,
-        cf_text_filter
+        cf_text_filter,
+        NULL,
+        NULL,
 };
 
 
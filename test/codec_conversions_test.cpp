@@ -4,25 +4,210 @@
 #include "config_win32.h"
 #endif
 
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <list>
 #include <sstream>
 #include <string>
 #include <utility>
+#include <vector>
 
+#include "pixfmt_conv.h"
 #include "unit_common.h"
 #include "video_codec.h"
 #include "video_capture/testcard_common.h"
 
 using std::cerr;
+using std::function;
 using std::list;
 using std::pair;
 using std::string;
 using std::to_string;
 using std::ostringstream;
+using std::vector;
 
+extern "C" int codec_conversion_test_packed_line_converters(void);
+extern "C" int codec_conversion_test_rgba_shifts(void);
 extern "C" int codec_conversion_test_testcard_uyvy_to_i420(void);
 
+static uint32_t rd32(const unsigned char *p) {
+        uint32_t ret = 0;
+        memcpy(&ret, p, sizeof ret);
+        return ret;
+}
+
+static unsigned rd16(const unsigned char *p, size_t idx) {
+        return p[2 * idx] | p[2 * idx + 1] << 8U;
+}
+
+static void wr16(unsigned char *p, size_t idx, unsigned val) {
+        p[2 * idx] = val & 0xFFU;
+        p[2 * idx + 1] = val >> 8U;
+}
+
+static void wr32be(unsigned char *p, uint32_t val) {
+        for (int i = 0; i < 4; ++i) {
+                p[i] = val >> (24 - 8 * i);
+        }
+}
+
+/// k-th 10-bit component of v210 stream
+static unsigned v210_comp(const unsigned char *src, size_t k) {
+        return (rd32(src + 4 * (k / 3)) >> (10 * (k % 3))) & 0x3FFU;
+}
+
+/// k-th 12-bit component of R12L stream (LSB-first bitstream)
+static unsigned r12l_comp(const unsigned char *src, size_t k) {
+        size_t bit = 12 * k;
+        return ((src[bit / 8] | src[bit / 8 + 1] << 8U) >> (bit % 8)) & 0xFFFU;
+}
+
+using reference_t = function<void(unsigned char *, const unsigned char *, size_t)>;
+
+/**
+ * Checks line converters between packed 10/12-bit formats (which may be
+ * vectorized) against straightforward per-component reference.
+ */
+int codec_conversion_test_packed_line_converters(void)
+{
+        const vector<int> widths_v210 = { 6, 12, 18, 30, 42, 90, 1926 };
+        const vector<int> widths_r12l = { 8, 16, 24, 40, 1928 };
+        const vector<int> widths_any = { 6, 8, 17, 31, 90, 1921 };
+        struct {
+                codec_t in;
+                codec_t out;
+                const vector<int> &widths;
+                reference_t ref;
+        } convs[] = {
+                { v210, UYVY, widths_v210, [](unsigned char *dst, const unsigned char *src, size_t len) {
+                        for (size_t i = 0; i < len; ++i) {
+                                dst[i] = v210_comp(src, i) >> 2U;
+                        }
+                } },
+                { v210, Y216, widths_v210, [](unsigned char *dst, const unsigned char *src, size_t len) {
+                        for (size_t i = 0; i < len / 2; ++i) {
+                                wr16(dst, i, v210_comp(src, i ^ 1U) << 6U);
+                        }
+                } },
+                { v210, Y416, widths_v210, [](unsigned char *dst, const unsigned char *src, size_t len) {
+                        for (size_t p = 0; p < len / 8; ++p) {
+                                size_t q = 4 * (p / 2);
+                                wr16(dst, 4 * p, v210_comp(src, q) << 6U);
+                                wr16(dst, 4 * p + 1, v210_comp(src, q + 1 + 2 * (p % 2)) << 6U);
+                                wr16(dst, 4 * p + 2, v210_comp(src, q + 2) << 6U);
+                                wr16(dst, 4 * p + 3, 0xFFFFU);
+                        }
+                } },
+                { UYVY, v210, widths_any, [](unsigned char *dst, const unsigned char *src, size_t len) {
+                        for (size_t i = 0; i < len / 4; ++i) {
+                                uint32_t w = src[3 * i] << 2U | src[3 * i + 1] << 12U | src[3 * i + 2] << 22U;
+                                memcpy(dst + 4 * i, &w, sizeof w);
+                        }
+                } },
+                { Y216, v210, widths_any, [](unsigned char *dst, const unsigned char *src, size_t len) {
+                        for (size_t i = 0; i < len / 4; ++i) {
+                                uint32_t w = 0;
+                                for (size_t j = 0; j < 3; ++j) {
+                                        w |= (rd16(src, (3 * i + j) ^ 1U) >> 6U) << (10 * j);
+                                }
+                                memcpy(dst + 4 * i, &w, sizeof w);
+                        }
+                } },
+                { R10k, RG48, widths_any, [](unsigned char *dst, const unsigned char *src, size_t len) {
+                        for (size_t p = 0; p < len / 6; ++p) {
+                                const unsigned char *s = src + 4 * p;
+                                uint32_t w = s[0] << 24U | s[1] << 16U | s[2] << 8U | s[3];
+                                for (size_t j = 0; j < 3; ++j) {
+                                        wr16(dst, 3 * p + j, ((w >> (22 - 10 * j)) & 0x3FFU) << 6U);
+                                }
+                        }
+                } },
+                { RG48, R10k, widths_any, [](unsigned char *dst, const unsigned char *src, size_t len) {
+                        for (size_t p = 0; p < len / 4; ++p) {
+                                uint32_t w = 0x3;
+                                for (size_t j = 0; j < 3; ++j) {
+                                        w |= (rd16(src, 3 * p + j) >> 6U) << (22 - 10 * j);
+                                }
+                                wr32be(dst + 4 * p, w);
+                        }
+                } },
+                { R12L, RG48, widths_r12l, [](unsigned char *dst, const unsigned char *src, size_t len) {
+                        for (size_t i = 0; i < len / 2; ++i) {
+                                wr16(dst, i, r12l_comp(src, i) << 4U);
+                        }
+                } },
+                { R12L, RGB, widths_r12l, [](unsigned char *dst, const unsigned char *src, size_t len) {
+                        for (size_t i = 0; i < len; ++i) {
+                                dst[i] = r12l_comp(src, i) >> 4U;
+                        }
+                } },
+                { RG48, R12L, widths_r12l, [](unsigned char *dst, const unsigned char *src, size_t len) {
+                        memset(dst, 0, len);
+                        for (size_t k = 0; k < len * 8 / 12; ++k) {
+                                size_t bit = 12 * k;
+                                unsigned val = (rd16(src, k) >> 4U) << (bit % 8);
+                                dst[bit / 8] |= val & 0xFFU;
+                                dst[bit / 8 + 1] |= val >> 8U;
+                        }
+                } },
+        };
+
+        for (auto &c : convs) {
+                decoder_t decoder = get_decoder_from_to(c.in, c.out);
+                ASSERT(decoder != nullptr);
+                for (int width : c.widths) {
+                        size_t src_len = 16 * width + 1024;
+                        vector<unsigned char> src(src_len);
+                        for (auto &b : src) {
+                                b = rand() % 256;
+                        }
+                        size_t dst_len = vc_get_linesize(width, c.out);
+                        vector<unsigned char> actual(dst_len + 64);
+                        vector<unsigned char> expected(dst_len);
+                        decoder(actual.data(), src.data(), dst_len, 0, 8, 16);
+                        c.ref(expected.data(), src.data(), dst_len);
+                        for (size_t i = 0; i < dst_len; ++i) {
+                                ostringstream oss;
+                                oss << get_codec_name(c.in) << "->" << get_codec_name(c.out) << " width " << width << " byte " << i;
+                                ASSERT_EQUAL_MESSAGE(oss.str(), (int) expected[i], (int) actual[i]);
+                        }
+                }
+        }
+        return 0;
+}
+
+/**
+ * Checks that conversions to RGBA with default shifts (specialized code path)
+ * and with swapped R and B give the same pixels.
+ */
+int codec_conversion_test_rgba_shifts(void)
+{
+        const int width = 1920 + 6;
+        for (codec_t in : { R10k, R12L, RGB, UYVY, Y416, RG48, DPX10 }) {
+                decoder_t decoder = get_decoder_from_to(in, RGBA);
+                ASSERT(decoder != nullptr);
+                vector<unsigned char> src(16 * width + 1024);
+                for (auto &b : src) {
+                        b = rand() % 256;
+                }
+                size_t dst_len = vc_get_linesize(width, RGBA);
+                vector<uint32_t> rgba(dst_len / 4);
+                vector<uint32_t> bgra(dst_len / 4);
+                decoder((unsigned char *) rgba.data(), src.data(), dst_len, 0, 8, 16);
+                decoder((unsigned char *) bgra.data(), src.data(), dst_len, 16, 8, 0);
+                for (size_t i = 0; i < rgba.size(); ++i) {
+                        uint32_t swapped = (bgra[i] & 0xFF00FF00U) | (bgra[i] & 0xFFU) << 16U | (bgra[i] >> 16U & 0xFFU);
+                        ostringstream oss;
+                        oss << get_codec_name(in) << " pixel " << i;
+                        ASSERT_EQUAL_MESSAGE(oss.str(), rgba[i], swapped);
+                }
+        }
+        return 0;
+}
+
 int codec_conversion_test_testcard_uyvy_to_i420(void)
 {
         list<pair<size_t,size_t>> sizes = { {1, 2}, {2, 1}, { 16, 1}, {16, 16}, {127, 255} };
@@ -8,6 +8,7 @@
 
 #include <algorithm>
 #include <array>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <random>
@@ -18,6 +19,7 @@
 #include "libavcodec/to_lavc_vid_conv.h"
 #include "tv.h"
 #include "unit_common.h"
+#include "utils/cpu_features.h"
 #include "video_capture/testcard_common.h"
 #include "video_codec.h"
 
@@ -32,6 +34,7 @@ using std::uniform_int_distribution;
 using std::ifstream;
 using std::min;
 using std::max;
+using std::string;
 using std::to_string;
 using std::vector;
 
@@ -44,6 +47,7 @@ extern "C" {
         int ff_codec_conversions_test_yuv444p16le_from_to_rg48();
         int ff_codec_conversions_test_yuv444p16le_from_to_rg48_out_of_range();
         int ff_codec_conversions_test_pX10_from_to_v210();
+        int ff_codec_conversions_test_simd_equivalence();
 }
 
 #define CHECK(res) if ((res) != 0) { return res; }
@@ -388,4 +392,79 @@ int ff_codec_conversions_test_pX10_from_to_v210()
         return 0;
 }
 
+/// @returns AVFrame with all lines (including padding) filled with 0xAA
+static AVFrame *alloc_filled_frame(AVPixelFormat fmt, int width, int height) {
+        AVFrame *frame = av_frame_alloc();
+        frame->format = fmt;
+        frame->width = width;
+        frame->height = height;
+        if (av_frame_get_buffer(frame, 0) < 0) {
+                av_frame_free(&frame);
+                return nullptr;
+        }
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+        for (int i = 0; i < av_pix_fmt_count_planes(fmt); ++i) {
+                int lines = i == 0 ? height : AV_CEIL_RSHIFT(height, desc->log2_chroma_h);
+                memset(frame->data[i], 0xAA, (size_t) frame->linesize[i] * lines);
+        }
+        return frame;
+}
+
+/**
+ * Checks that the vectorized (AVX2/NEON) UG->lavc conversions give the same
+ * output as the scalar ones for random input also in the vector tails (odd
+ * widths and heights) and don't write outside of what the scalar code writes.
+ * The scalar path is forced by disabling the CPU features.
+ */
+int ff_codec_conversions_test_simd_equivalence()
+{
+        struct {
+                codec_t in;
+                AVPixelFormat out;
+        } convs[] = {
+                { UYVY, AV_PIX_FMT_YUV420P },
+                { UYVY, AV_PIX_FMT_YUVJ420P },
+                { UYVY, AV_PIX_FMT_NV12 },
+                { v210, AV_PIX_FMT_P010LE },
+                { v210, AV_PIX_FMT_YUV422P10LE },
+                { R10k, AV_PIX_FMT_GBRP10LE },
+                { R10k, AV_PIX_FMT_GBRP16LE },
+                { R10k, AV_PIX_FMT_YUV444P10LE },
+        };
+        struct {
+                int width;
+                int height;
+                int threads;
+        } sizes[] = { { 6, 2, 1 }, { 17, 3, 1 }, { 31, 7, 1 }, { 90, 4, 1 }, { 1921, 9, 1 }, { 1926, 8, 3 } };
+        default_random_engine rand_gen;
+        for (auto const &c : convs) {
+                for (auto const &s : sizes) {
+                        vector<unsigned char> in(vc_get_datalen(s.width, s.height, c.in));
+                        for_each(in.begin(), in.end(), [&](unsigned char &b) { b = rand_gen() % 0x100; });
+                        AVFrame *out[2]{};
+                        const char *cfgs[] = { "none", nullptr };
+                        for (int i = 0; i < 2; ++i) {
+                                ASSERT_EQUAL(0, cpu_features_configure(cfgs[i]));
+                                struct to_lavc_vid_conv *conv = to_lavc_vid_conv_init(c.in, s.width, s.height, c.out, s.threads);
+                                out[i] = alloc_filled_frame(c.out, s.width, s.height);
+                                assert(conv != nullptr && out[i] != nullptr);
+                                ASSERT(to_lavc_vid_conv_to_frame(conv, (char *) in.data(), out[i]));
+                                to_lavc_vid_conv_destroy(&conv);
+                        }
+                        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(c.out);
+                        const string msg = get_codec_name(c.in) + " to "s + av_get_pix_fmt_name(c.out) + " "s
+                                + to_string(s.width) + "x"s + to_string(s.height);
+                        for (int i = 0; i < av_pix_fmt_count_planes(c.out); ++i) {
+                                int lines = i == 0 ? s.height : AV_CEIL_RSHIFT(s.height, desc->log2_chroma_h);
+                                ASSERT_EQUAL_MESSAGE(msg, out[0]->linesize[i], out[1]->linesize[i]);
+                                ASSERT_MESSAGE(msg + " plane "s + to_string(i) + " differs"s,
+                                                memcmp(out[0]->data[i], out[1]->data[i], (size_t) out[0]->linesize[i] * lines) == 0);
+                        }
+                        av_frame_free(&out[0]);
+                        av_frame_free(&out[1]);
+                }
+        }
+        return 0;
+}
+
 #endif // HAVE_LAVC
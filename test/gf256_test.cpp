@@ -0,0 +1,127 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "rtp/gf256.h"
+#include "unit_common.h"
+
+extern "C" {
+        int gf256_test_addmul();
+        int gf256_test_erasure_roundtrip();
+}
+
+using std::vector;
+
+/**
+ * Checks the selected addmul kernel against gf256_mul for all constants and
+ * lengths not aligned to the vector width (tail handling).
+ */
+int gf256_test_addmul()
+{
+        const size_t len = 259;
+        vector<uint8_t> src(len);
+        for (size_t i = 0; i < len; ++i) {
+                src[i] = i * 7 + 3;
+        }
+        for (int c = 0; c < 256; ++c) {
+                vector<uint8_t> dst(len + 1);
+                for (size_t i = 0; i < dst.size(); ++i) {
+                        dst[i] = i;
+                }
+                gf256_addmul(dst.data() + 1, src.data(), c, len - c % 33);
+                for (size_t i = 0; i < len; ++i) {
+                        uint8_t expected = i + 1;
+                        if (i < len - c % 33) {
+                                expected ^= gf256_mul(c, src[i]);
+                        }
+                        ASSERT_EQUAL_MESSAGE(gf256_impl_name(), (int) expected, (int) dst[i + 1]);
+                }
+                ASSERT_EQUAL(0, (int) dst[0]);
+        }
+        return 0;
+}
+
+/**
+ * Encodes k symbols with a systematic Cauchy code, drops some of them and
+ * recovers them with gf256_invert + gf256_matmul (as rs::decode does).
+ */
+int gf256_test_erasure_roundtrip()
+{
+        const unsigned k = 10, m = 4;
+        const size_t ss = 5000; // more than one matmul chunk
+        vector<uint8_t> parity_rows(m * k);
+        for (unsigned r = 0; r < m; ++r) {
+                for (unsigned j = 0; j < k; ++j) {
+                        uint8_t x = k + r;
+                        uint8_t y = j;
+                        // 1 / (x + y)
+                        uint8_t sum = x ^ y;
+                        uint8_t inv = 1;
+                        for (int e = 0; e < 254; ++e) {
+                                inv = gf256_mul(inv, sum);
+                        }
+                        parity_rows[r * k + j] = inv;
+                }
+        }
+
+        vector<vector<uint8_t>> symbols(k + m, vector<uint8_t>(ss));
+        srand(1);
+        for (unsigned j = 0; j < k; ++j) {
+                for (auto &b : symbols[j]) {
+                        b = rand();
+                }
+        }
+        vector<const uint8_t *> src;
+        vector<uint8_t *> dst;
+        for (unsigned j = 0; j < k; ++j) {
+                src.push_back(symbols[j].data());
+        }
+        for (unsigned r = 0; r < m; ++r) {
+                dst.push_back(symbols[k + r].data());
+        }
+        gf256_matmul(parity_rows.data(), m, k, src.data(), dst.data(), ss);
+
+        // lose primary symbols 1, 4, 5 and 9, use parity 10, 11, 12, 13
+        const unsigned lost[] = { 1, 4, 5, 9 };
+        vector<unsigned> index(k);
+        for (unsigned i = 0; i < k; ++i) {
+                index[i] = i;
+        }
+        for (unsigned r = 0; r < m; ++r) {
+                index[lost[r]] = k + r;
+        }
+        vector<uint8_t> dec(k * k);
+        for (unsigned i = 0; i < k; ++i) {
+                if (index[i] < k) {
+                        dec[i * k + i] = 1;
+                } else {
+                        for (unsigned j = 0; j < k; ++j) {
+                                dec[i * k + j] = parity_rows[(index[i] - k) * k + j];
+                        }
+                }
+                src[i] = symbols[index[i]].data();
+        }
+        ASSERT_EQUAL(0, gf256_invert(dec.data(), k));
+
+        vector<uint8_t> rows;
+        vector<vector<uint8_t>> repaired(m, vector<uint8_t>(ss));
+        dst.clear();
+        for (unsigned r = 0; r < m; ++r) {
+                rows.insert(rows.end(), &dec[lost[r] * k], &dec[lost[r] * k] + k);
+                dst.push_back(repaired[r].data());
+        }
+        gf256_matmul(rows.data(), m, k, src.data(), dst.data(), ss);
+        for (unsigned r = 0; r < m; ++r) {
+                ASSERT(repaired[r] == symbols[lost[r]]);
+        }
+
+        vector<uint8_t> singular(k * k, 1);
+        ASSERT_EQUAL(-1, gf256_invert(singular.data(), k));
+        return 0;
+}
@@ -0,0 +1,68 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "rtp/ldgm.h"
+#include "rtp/rtp_types.h" // video_payload_hdr_t
+#include "unit_common.h"
+#include "video.h"
+
+extern "C" {
+        int ldgm_test_decode_losses();
+}
+
+using std::map;
+using std::shared_ptr;
+using std::vector;
+
+/**
+ * Encodes a frame on CPU, drops scattered data and parity symbols and checks
+ * that the decoder recovers the frame (the decoding runs in stripes in
+ * parallel) and that it reports failure when too much is lost.
+ */
+int ldgm_test_decode_losses()
+{
+        const int k = 256, m = 64, c = 5;
+        ldgm fec(k, m, c, DEFAULT_LDGM_SEED);
+
+        struct video_desc desc{ 640, 480, UYVY, 30, PROGRESSIVE, 1 };
+        shared_ptr<video_frame> frame(vf_alloc_desc_data(desc), vf_free);
+        for (unsigned i = 0; i < frame->tiles[0].data_len; ++i) {
+                frame->tiles[0].data[i] = i * 13 + i / 4099;
+        }
+        shared_ptr<video_frame> encoded = fec.encode(frame);
+        ASSERT(encoded);
+        const int len = encoded->tiles[0].data_len;
+        const int ss = encoded->fec_params.symbol_size;
+        ASSERT_EQUAL(0, len % ss);
+
+        for (int drop_every : { 37, 3 }) {
+                vector<char> received(encoded->tiles[0].data, encoded->tiles[0].data + len);
+                map<int, int> packets;
+                for (int i = 0; i < len / ss; ++i) {
+                        if (i % drop_every == drop_every - 1) {
+                                memset(received.data() + i * ss, 0xAB, ss);
+                        } else {
+                                packets[i * ss] = ss;
+                        }
+                }
+                char *out = nullptr;
+                int out_len = 0;
+                bool ret = fec.decode(received.data(), len, &out, &out_len, packets);
+                if (drop_every == 3) { // a third of symbols - cannot be recovered
+                        ASSERT(!ret);
+                        continue;
+                }
+                ASSERT(ret);
+                ASSERT_EQUAL((int) (sizeof(video_payload_hdr_t) + frame->tiles[0].data_len), out_len);
+                ASSERT(memcmp(out + sizeof(video_payload_hdr_t), frame->tiles[0].data, frame->tiles[0].data_len) == 0);
+        }
+        return 0;
+}
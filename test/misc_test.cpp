@@ -4,22 +4,1195 @@
 #include "config_win32.h"
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
 #include <list>
 #include <sstream>
+#include <thread>
+#include <vector>
 
+#include "audio/utils.h"
+#include "capture_filter.h"
+#include "capture_filter/resize_yuv.h"
+#include "crypto/crc.h"
+#include "crypto/crypt_aes.h"
+#include "messaging.h"
+#include "module.h"
+#include "pdb.h"
+#include "rtp/fec_group.h"
+#include "rtp/net_udp.h"
+#include "rtp/gf256.h"
+#include "rtp/pbuf.h"
+#include "rtp/rtp.h"
+#include "rtp/rtpdec_h264.h"
+#include "rtp/rtpenc_h264.h"
+#include "rtp/rtp_types.h"
 #include "types.h"
+#include "utils/audio_buffer.h"
+#include "utils/cpu_features.h"
+#include "utils/frame_copy.h"
+#include "utils/frame_trace.h"
+#include "utils/gpu_scheduler.hpp"
+#include "utils/init_graph.hpp"
+#include "utils/lockfree_queue.h"
+#include "utils/lut3d.hpp"
+#include "utils/metrics.h"
+#include "utils/overlay.h"
+#include "utils/shm_bus.h"
 #include "utils/string.h"
+#include "utils/synchronized_queue.h"
+#include "utils/vf_split.h"
+#include "utils/video_frame_pool.h"
 #include "unit_common.h"
 #include "video.h"
+#include "video_codec.h"
 #include "video_frame.h"
+#include "video_rxtx/abr.h"
+#include "vo_postprocess.h"
 
 extern "C" {
+        int misc_test_abr_controller();
+        int misc_test_aes_rijndael();
+        int misc_test_audio_buffer_drift();
+        int misc_test_audio_change_bps();
+        int misc_test_audio_float_conversion();
+        int misc_test_audio_interleave();
+        int misc_test_capture_filter_fusion();
+        int misc_test_cpu_features();
+        int misc_test_crc32();
+        int misc_test_deinterlace();
+        int misc_test_fec_frame_group();
+        int misc_test_frame_copy();
+        int misc_test_frame_trace();
+        int misc_test_gpu_scheduler();
+        int misc_test_h264_depacketize();
+        int misc_test_h264_frame_type();
+        int misc_test_h264_packetize();
+        int misc_test_il_line_maps();
+        int misc_test_init_graph();
+        int misc_test_lockfree_queue_latest();
+        int misc_test_lockfree_queue_mpmc();
+        int misc_test_lut3d();
+        int misc_test_metrics();
+        int misc_test_module_mem();
+        int misc_test_module_messages();
+        int misc_test_overlay_blend();
+        int misc_test_pdb_concurrent();
+        int misc_test_queue_stats();
         int misc_test_replace_all();
+        int misc_test_resize_yuv();
+        int misc_test_rtp_keyframe_request();
+        int misc_test_shm_bus();
+        int misc_test_udp_inject();
+        int misc_test_vf_split_view();
         int misc_test_video_desc_io_op_symmetry();
+        int misc_test_video_frame_pool_reuse();
 }
 
 using namespace std;
 
+/**
+ * Feeds the audio buffer with a sample counter at a slightly faster and
+ * slower rate than it is read and checks that the drift is compensated by
+ * dropping/duplicating single samples - the buffer neither grows nor
+ * underruns and the output has no larger discontinuities.
+ */
+int misc_test_audio_buffer_drift()
+{
+        for (int write_len : { 481, 479 }) {
+                const int read_len = 480; // 10 ms
+                struct audio_buffer *buf = audio_buffer_init(48000, 2, 1, 20);
+                ASSERT(buf != nullptr);
+                vector<uint16_t> in(write_len);
+                vector<uint16_t> out(read_len);
+                uint16_t counter = 0;
+                auto write = [&]() {
+                        for (auto &sample : in) {
+                                sample = counter++;
+                        }
+                        audio_buffer_write(buf, (char *) in.data(), write_len * 2);
+                };
+                write();
+                write();
+                int last = -1;
+                for (int i = 0; i < 3000; ++i) {
+                        write();
+                        ASSERT_EQUAL(read_len * 2, audio_buffer_read(buf, (char *) out.data(), read_len * 2));
+                        for (auto sample : out) {
+                                if (last >= 0) {
+                                        uint16_t diff = sample - last;
+                                        ASSERT(write_len > read_len ? diff == 1 || diff == 2 : diff == 0 || diff == 1);
+                                }
+                                last = sample;
+                        }
+                }
+                // the buffer holds at most ~2x latency
+                uint16_t backlog = counter - last;
+                ASSERT(backlog < 4 * read_len);
+                audio_buffer_destroy(buf);
+        }
+        return 0;
+}
+
+/**
+ * Checks the (vectorized) int2float() and float2int() against the scalar
+ * conversion, including the clamping and lengths that are not a multiple of
+ * the vector width.
+ */
+int misc_test_audio_float_conversion()
+{
+        const float int_max_flt = nexttowardf((float) INT_MAX, INT_MAX);
+        vector<int32_t> ints = { INT_MAX, INT_MIN, 0, 1, -1, INT_MAX / 2, INT_MIN / 3 };
+        while (ints.size() < 1027) {
+                ints.push_back((int32_t) ((unsigned) rand() << 16U ^ (unsigned) rand()));
+        }
+        vector<float> floats(ints.size());
+        int2float((char *) floats.data(), (const char *) ints.data(), ints.size() * sizeof(int32_t));
+        for (size_t i = 0; i < ints.size(); ++i) {
+                ASSERT_EQUAL((float) ints[i] / (float) INT_MAX, floats[i]);
+        }
+
+        floats.insert(floats.begin(), { 1.5F, -1.5F, 1.0F, -1.0F, 0.25F });
+        vector<int32_t> out(floats.size());
+        float2int((char *) out.data(), (const char *) floats.data(), floats.size() * sizeof(float));
+        for (size_t i = 0; i < floats.size(); ++i) {
+                float sample = max(-1.0F, min(1.0F, floats[i]));
+                ASSERT_EQUAL((int32_t) (sample * int_max_flt), out[i]);
+        }
+        return 0;
+}
+
+/**
+ * Checks change_bps2() for all BPS pairs against per-sample conversion incl.
+ * the SIMD block sizes - exact without dithering, dithered output must stay
+ * within 1 LSB from the rounded value.
+ */
+int misc_test_audio_change_bps()
+{
+        const int samples = 1029;
+        for (int in_bps = 1; in_bps <= 4; ++in_bps) {
+                vector<char> in(samples * in_bps);
+                for (auto &c : in) {
+                        c = rand();
+                }
+                for (int out_bps = 1; out_bps <= 4; ++out_bps) {
+                        for (bool dither : { false, true }) {
+                                vector<char> out(samples * out_bps);
+                                change_bps2(out.data(), out_bps, in.data(), in_bps, in.size(), dither);
+                                for (int i = 0; i < samples; ++i) {
+                                        int32_t in_val = format_from_in_bps(in.data() + i * in_bps, in_bps);
+                                        int32_t out_val = format_from_in_bps(out.data() + i * out_bps, out_bps);
+                                        if (in_bps <= out_bps) {
+                                                ASSERT_EQUAL((int64_t) in_val * (1LL << ((out_bps - in_bps) * 8)), (int64_t) out_val);
+                                        } else if (!dither) {
+                                                ASSERT_EQUAL(in_val >> ((in_bps - out_bps) * 8), out_val);
+                                        } else {
+                                                double expected = in_val / (double) (1LL << ((in_bps - out_bps) * 8));
+                                                ASSERT(fabs(expected - out_val) <= 1.5);
+                                        }
+                                }
+                        }
+                }
+        }
+        return 0;
+}
+
+/**
+ * Checks interleaved2planar() against demux_channel() and that
+ * planar2interleaved() restores the original, incl. the SIMD block sizes.
+ */
+int misc_test_audio_interleave()
+{
+        for (int bps = 1; bps <= 4; ++bps) {
+                for (int ch_count : { 1, 2, 3, 8, 16, 64 }) {
+                        const int samples = 1925;
+                        const int len = samples * ch_count * bps;
+                        vector<char> in(len);
+                        for (auto &c : in) {
+                                c = rand();
+                        }
+                        vector<vector<char>> planes(ch_count, vector<char>(samples * bps));
+                        vector<char *> plane_ptrs;
+                        for (auto &p : planes) {
+                                plane_ptrs.push_back(p.data());
+                        }
+                        interleaved2planar(plane_ptrs.data(), in.data(), bps, samples, ch_count);
+                        vector<char> ref(samples * bps);
+                        for (int c = 0; c < ch_count; ++c) {
+                                demux_channel(ref.data(), in.data(), bps, len, ch_count, c);
+                                ASSERT(ref == planes[c]);
+                        }
+                        vector<char> out(len);
+                        planar2interleaved(out.data(), plane_ptrs.data(), bps, samples, ch_count);
+                        ASSERT(out == in);
+                }
+        }
+        return 0;
+}
+
+/**
+ * Checks overlay_blend() against the straight alpha blending formula for
+ * RGB(A) in and around the overlay (vector and scalar parts) and the
+ * converted color (up to rounding) of an opaque overlay for UYVY.
+ */
+int misc_test_overlay_blend()
+{
+        const int width = 61;
+        const int height = 7;
+        const int ov_w = 37;
+        const int ov_h = 4;
+        const int pos_x = 9;
+        const int pos_y = 2;
+        vector<unsigned char> rgba(ov_w * ov_h * 4);
+        for (size_t i = 0; i < rgba.size(); ++i) {
+                rgba[i] = rand();
+                if (i % 4 == 3 && i % 3 == 0) {
+                        rgba[i] = i % 2 == 0 ? 0 : 255;
+                }
+        }
+        for (int i = 0; i < ov_h; ++i) { // transparent first column - outside of the dirty rectangle
+                rgba[i * ov_w * 4 + 3] = 0;
+        }
+
+        for (codec_t codec : { RGB, RGBA }) {
+                const int bpp = codec == RGB ? 3 : 4;
+                const int pitch = width * bpp;
+                vector<unsigned char> frame(pitch * height);
+                for (auto &c : frame) {
+                        c = rand();
+                }
+                vector<unsigned char> orig = frame;
+                struct overlay *o = overlay_create(rgba.data(), ov_w, ov_h, codec);
+                ASSERT(o != nullptr);
+                overlay_blend(o, (char *) frame.data(), pitch, pos_x, pos_y);
+                overlay_destroy(o);
+                for (int y = 0; y < height; ++y) {
+                        for (int x = 0; x < width; ++x) {
+                                for (int c = 0; c < bpp; ++c) {
+                                        int d = orig[y * pitch + x * bpp + c];
+                                        int expected = d;
+                                        int ox = x - pos_x;
+                                        int oy = y - pos_y;
+                                        if (c < 3 && ox >= 0 && ox < ov_w && oy >= 0 && oy < ov_h) {
+                                                int a = rgba[(oy * ov_w + ox) * 4 + 3];
+                                                expected = (d * (255 - a) + rgba[(oy * ov_w + ox) * 4 + c] * a) / 255;
+                                        }
+                                        ASSERT_EQUAL(expected, (int) frame[y * pitch + x * bpp + c]);
+                                }
+                        }
+                }
+        }
+
+        vector<unsigned char> white(4 * 4, 255);
+        vector<unsigned char> uyvy(vc_get_linesize(width, UYVY) * height, 0x10);
+        struct overlay *o = overlay_create(white.data(), 4, 1, UYVY);
+        overlay_blend(o, (char *) uyvy.data(), vc_get_linesize(width, UYVY), 2, 1);
+        overlay_destroy(o);
+        const unsigned char *px = uyvy.data() + vc_get_linesize(width, UYVY) + 4;
+        for (int i = 0; i < 4; ++i) {
+                ASSERT(abs((i % 2 == 0 ? 128 : 235) - px[i]) <= 1); // conversion rounding
+                ASSERT_EQUAL(0x10, (int) px[i + 8]);
+                ASSERT_EQUAL(0x10, (int) px[i - 4]);
+        }
+        return 0;
+}
+
+/**
+ * Checks that packets injected to a multithreaded socket are received in
+ * order with the socket's buffer layout.
+ */
+int misc_test_udp_inject()
+{
+        socket_udp *s = udp_init("127.0.0.1", 50404, 50404, 255, 0, true);
+        ASSERT(s != nullptr);
+        for (int i = 0; i < 3; ++i) {
+                char data[100];
+                memset(data, i, sizeof data);
+                ASSERT(udp_inject_data(s, data, sizeof data - i));
+        }
+        ASSERT(!udp_inject_data(s, "", RTP_MAX_PACKET_LEN));
+        for (int i = 0; i < 3; ++i) {
+                struct timeval timeout = { 1, 0 };
+                ASSERT(udp_not_empty(s, &timeout));
+                char *packet = nullptr;
+                ASSERT_EQUAL(100 - i, udp_recv_data(s, &packet));
+                for (int j = 0; j < 100 - i; ++j) {
+                        ASSERT_EQUAL(i, (int) packet[RTP_PACKET_HEADER_SIZE + j]);
+                }
+                free(packet);
+        }
+        struct timeval timeout = { 0, 0 };
+        ASSERT(!udp_not_empty(s, &timeout));
+        udp_exit(s);
+        return 0;
+}
+
+/**
+ * Checks that the ABR controller backs off on loss and jitter growth,
+ * respects the bounds (and TFRC rate) and recovers when the path is clean.
+ */
+int misc_test_abr_controller()
+{
+        const long long max_bitrate = 10'000'000;
+        const long long min_bitrate = 1'000'000;
+        abr_controller abr(min_bitrate, max_bitrate);
+        time_ns_t now = 10 * NS_IN_SEC;
+
+        ASSERT_EQUAL(0, abr.update(now, 0.0, 1.0)); // already at max
+        long long bitrate = abr.update(now += NS_IN_SEC, 0.1, 1.0);
+        ASSERT(bitrate > 0 && bitrate < max_bitrate);
+        ASSERT_EQUAL(0, abr.update(now + NS_IN_SEC / 2, 0.1, 1.0)); // too early after decrease
+        for (int i = 0; i < 20; ++i) {
+                abr.update(now += NS_IN_SEC, 0.3, 1.0);
+        }
+        ASSERT_EQUAL(min_bitrate, abr.get_bitrate());
+
+        for (int i = 0; i < 60; ++i) {
+                abr.update(now += NS_IN_SEC, 0.0, 1.0);
+        }
+        ASSERT_EQUAL(max_bitrate, abr.get_bitrate());
+
+        bitrate = abr.update(now += NS_IN_SEC, 0.0, 50.0); // queue build-up without loss yet
+        ASSERT(bitrate > 0 && bitrate < max_bitrate);
+
+        // with known RTT the TFRC equation limits the decrease - for s=1500 B, RTT 100 ms and
+        // p=0.1 it gives ~212 kbps, so the bitrate drops to min_bitrate at once
+        abr_controller abr_rtt(min_bitrate, max_bitrate);
+        ASSERT_EQUAL(min_bitrate, abr_rtt.update(now, 0.1, 1.0, 0.1));
+        return 0;
+}
+
+/**
+ * Checks that a chain of per-line filters fused into a single pass gives the
+ * same result as applying the filters one after another.
+ */
+static vector<unsigned char> from_hex(const char *hex)
+{
+        vector<unsigned char> ret;
+        for ( ; hex[0] != '\0' && hex[1] != '\0'; hex += 2) {
+                ret.push_back((unsigned char) stoi(string(hex, 2), nullptr, 16));
+        }
+        return ret;
+}
+
+/**
+ * Checks the Rijndael ECB and CBC modes (AES-NI if available) against the
+ * NIST SP 800-38A AES-128 vectors, with more blocks than processed at once.
+ */
+int misc_test_aes_rijndael()
+{
+        char key[] = "2b7e151628aed2a6abf7158809cf4f3c";
+        char iv[] = "000102030405060708090a0b0c0d0e0f";
+        const auto pt = from_hex("6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+                        "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710");
+        const auto ecb = from_hex("3ad77bb40d7a3660a89ecaf32466ef97f5d3d58503b9699de785895a96fdbaaf"
+                        "43b1cd7f598ece23881b00e3ed0306887b0c785e27e8ad3f8223207104725dd4");
+        const auto cbc = from_hex("7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b2"
+                        "73bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7");
+        keyInstance enc, dec;
+        cipherInstance cipher;
+        ASSERT_EQUAL(TRUE, makeKey(&enc, DIR_ENCRYPT, 128, key));
+        ASSERT_EQUAL(TRUE, makeKey(&dec, DIR_DECRYPT, 128, key));
+
+        // ECB: 9 blocks - the vector twice and its first block
+        vector<unsigned char> in(pt);
+        in.insert(in.end(), pt.begin(), pt.end());
+        in.insert(in.end(), pt.begin(), pt.begin() + 16);
+        vector<unsigned char> buf(in);
+        ASSERT_EQUAL(TRUE, cipherInit(&cipher, MODE_ECB, nullptr));
+        ASSERT_EQUAL((int) buf.size() * 8, blockEncrypt(&cipher, &enc, buf.data(), buf.size() * 8, buf.data()));
+        for (size_t i = 0; i < buf.size(); ++i) {
+                ASSERT_EQUAL(ecb[i % ecb.size()], buf[i]);
+        }
+        blockDecrypt(&cipher, &dec, buf.data(), buf.size() * 8, buf.data());
+        ASSERT(buf == in);
+
+        // CBC, the decryption in 2 calls (IV is carried over)
+        buf = pt;
+        ASSERT_EQUAL(TRUE, cipherInit(&cipher, MODE_CBC, iv));
+        blockEncrypt(&cipher, &enc, buf.data(), buf.size() * 8, buf.data());
+        ASSERT(buf == cbc);
+        blockDecrypt(&cipher, &dec, buf.data(), 16 * 8, buf.data());
+        blockDecrypt(&cipher, &dec, buf.data() + 16, 48 * 8, buf.data() + 16);
+        ASSERT(buf == pt);
+        return 0;
+}
+
+int misc_test_capture_filter_fusion()
+{
+        struct capture_filter *cf = nullptr;
+        ASSERT_EQUAL(0, capture_filter_init(nullptr, "flip,mirror,grayscale", &cf));
+
+        const int w = 6;
+        const int h = 5;
+        struct video_desc desc{ (unsigned) w, (unsigned) h, UYVY, 25, PROGRESSIVE, 1 };
+        struct video_frame *in = vf_alloc_desc_data(desc);
+        in->callbacks.dispose = vf_free;
+        for (unsigned i = 0; i < in->tiles[0].data_len; ++i) {
+                in->tiles[0].data[i] = (char) i;
+        }
+        vector<unsigned char> orig(in->tiles[0].data, in->tiles[0].data + in->tiles[0].data_len);
+
+        struct video_frame *out = capture_filter(cf, in);
+        ASSERT(out != nullptr);
+        ASSERT(video_desc_eq(video_desc_from_frame(out), desc));
+        const auto *res = (const unsigned char *) out->tiles[0].data;
+        const int linesize = vc_get_linesize(w, UYVY);
+        for (int y = 0; y < h; ++y) {
+                const unsigned char *src = orig.data() + (h - 1 - y) * linesize;
+                const unsigned char *dst = res + y * linesize;
+                for (int x = 0; x < w / 2; ++x) {
+                        const unsigned char *mirrored = src + (w / 2 - 1 - x) * 4;
+                        ASSERT_EQUAL(127, dst[4 * x]);
+                        ASSERT_EQUAL(mirrored[3], dst[4 * x + 1]);
+                        ASSERT_EQUAL(127, dst[4 * x + 2]);
+                        ASSERT_EQUAL(mirrored[1], dst[4 * x + 3]);
+                }
+        }
+        VIDEO_FRAME_DISPOSE(out);
+        capture_filter_destroy(cf);
+        return 0;
+}
+
+static uint32_t crc32_ref(const unsigned char *buf, size_t len, uint32_t crc)
+{
+        crc = ~crc;
+        for (size_t i = 0; i < len; ++i) {
+                crc ^= buf[i];
+                for (int b = 0; b < 8; ++b) {
+                        crc = crc >> 1 ^ (0xedb88320U & -(crc & 1));
+                }
+        }
+        return ~crc;
+}
+
+/**
+ * Checks that restricting the CPU features reselects the kernels and that
+ * all of the variants give the same results.
+ */
+int misc_test_cpu_features()
+{
+        ASSERT_EQUAL(-1, cpu_features_configure("avx2:-sse2"));
+        ASSERT_EQUAL(-1, cpu_features_configure("-nonexistent"));
+
+        ASSERT_EQUAL(0, cpu_features_configure("none"));
+        ASSERT(!cpu_has(CPU_FEATURE_SSE2));
+        ASSERT(cpu_has(0));
+        ASSERT(strcmp(gf256_impl_name(), "scalar") == 0);
+        ASSERT(strcmp(crc32_impl_name(), "table") == 0);
+
+        vector<uint8_t> src(1000);
+        vector<uint8_t> ref(src.size());
+        for (size_t i = 0; i < src.size(); ++i) {
+                src[i] = (uint8_t) (i * 2654435761U >> 11);
+                ref[i] = (uint8_t) i ^ gf256_mul(src[i], 0x53);
+        }
+        const char *cfgs[] = { "none", "sse2:ssse3", "-avx2:-avx512", nullptr };
+        for (const char *cfg : cfgs) {
+                ASSERT_EQUAL(0, cpu_features_configure(cfg));
+                ASSERT_EQUAL_MESSAGE(crc32_impl_name(), 0xcbf43926U, crc32buf("123456789", 9));
+                vector<uint8_t> dst(src.size());
+                for (size_t i = 0; i < dst.size(); ++i) {
+                        dst[i] = (uint8_t) i;
+                }
+                gf256_addmul(dst.data(), src.data(), 0x53, dst.size());
+                ASSERT_MESSAGE(gf256_impl_name(), dst == ref);
+        }
+        return 0;
+}
+
+/**
+ * Checks the CRC-32 of the implementation selected for this CPU against a
+ * bitwise computation for various lengths and alignments, also when chained.
+ */
+int misc_test_crc32()
+{
+        ASSERT_EQUAL_MESSAGE(crc32_impl_name(), 0xcbf43926U, crc32buf("123456789", 9));
+
+        vector<unsigned char> buf(600);
+        for (size_t i = 0; i < buf.size(); ++i) {
+                buf[i] = (unsigned char) (i * 2654435761U >> 13);
+        }
+        for (size_t off = 0; off < 4; ++off) {
+                for (size_t len = 0; len + off <= buf.size(); len += len < 150 ? 1 : 37) {
+                        ASSERT_EQUAL_MESSAGE(crc32_impl_name(), crc32_ref(buf.data() + off, len, 0),
+                                        crc32buf((const char *) buf.data() + off, len));
+                }
+        }
+        uint32_t chained = crc32buf((const char *) buf.data(), 100);
+        chained = crc32buf_with_oldcrc((const char *) buf.data() + 100, buf.size() - 100, chained);
+        ASSERT_EQUAL(crc32_ref(buf.data(), buf.size(), 0), chained);
+        return 0;
+}
+
+static uint32_t avg10_ref(uint32_t a, uint32_t b, int shift)
+{
+        return (((a >> shift & 0x3ff) + (b >> shift & 0x3ff) + 1) / 2) << shift;
+}
+
+/**
+ * Checks the packed v210/R10k line averaging against per-component
+ * computation, that the parallel in-place deinterlace gives the same result
+ * as the out-of-place one and that YADIF reconstructs a static smooth
+ * interlaced picture exactly.
+ */
+int misc_test_deinterlace()
+{
+        vector<uint32_t> l1(64), l2(64), avg(64);
+        for (size_t i = 0; i < l1.size(); ++i) {
+                l1[i] = ((uint32_t) rand() << 16 ^ rand()) & 0x3fffffff;
+                l2[i] = ((uint32_t) rand() << 16 ^ rand()) & 0x3fffffff;
+        }
+        ASSERT(vc_avg_lines(v210, l1.size() * 4, (unsigned char *) l1.data(), (unsigned char *) l2.data(), (unsigned char *) avg.data()));
+        for (size_t i = 0; i < l1.size(); ++i) {
+                ASSERT_EQUAL(avg10_ref(l1[i], l2[i], 0) | avg10_ref(l1[i], l2[i], 10) | avg10_ref(l1[i], l2[i], 20), avg[i]);
+        }
+        ASSERT(vc_avg_lines(R10k, l1.size() * 4, (unsigned char *) l1.data(), (unsigned char *) l2.data(), (unsigned char *) avg.data()));
+        for (size_t i = 0; i < l1.size(); ++i) {
+                uint32_t a = ntohl(l1[i]);
+                uint32_t b = ntohl(l2[i]);
+                ASSERT_EQUAL(avg10_ref(a, b, 2) | avg10_ref(a, b, 12) | avg10_ref(a, b, 22), ntohl(avg[i]));
+        }
+
+        const int w = 64;
+        const int h = 200;
+        const int linesize = vc_get_linesize(w, UYVY);
+        vector<unsigned char> frame(linesize * h);
+        for (auto &c : frame) {
+                c = rand();
+        }
+        vector<unsigned char> out(frame.size());
+        ASSERT(vc_deinterlace_ex(UYVY, frame.data(), linesize, out.data(), linesize, h));
+        ASSERT(vc_deinterlace_ex(UYVY, frame.data(), linesize, frame.data(), linesize, h));
+        ASSERT(frame == out);
+
+        // vertically smooth picture (no local extrema across the lines)
+        for (int y = 0; y < h; ++y) {
+                for (int x = 0; x < linesize; ++x) {
+                        frame[y * linesize + x] = x % 200 + y / 4;
+                }
+        }
+        struct vo_postprocess_state *pp = vo_postprocess_init("deinterlace_yadif:nodelay");
+        ASSERT(pp != nullptr);
+        ASSERT(vo_postprocess_reconfigure(pp, video_desc{ (unsigned) w, (unsigned) h, UYVY, 25, INTERLACED_MERGED, 1 }));
+        struct video_frame *dst = vf_alloc_desc_data(video_desc{ (unsigned) w, (unsigned) h, UYVY, 50, PROGRESSIVE, 1 });
+        for (int i = 0; i < 2; ++i) {
+                struct video_frame *f = vo_postprocess_getf(pp);
+                memcpy(f->tiles[0].data, frame.data(), frame.size());
+                ASSERT(vo_postprocess(pp, f, dst, linesize));
+                if (i == 1) {
+                        ASSERT(memcmp(dst->tiles[0].data, frame.data(), frame.size()) == 0);
+                }
+                ASSERT(vo_postprocess(pp, nullptr, dst, linesize));
+                ASSERT(memcmp(dst->tiles[0].data, frame.data(), frame.size()) == 0);
+        }
+        vf_free(dst);
+        vo_postprocess_done(pp);
+        return 0;
+}
+
+namespace {
+/// passes the frames through, records the frame count of the last block
+struct fec_passthrough : public fec {
+        unsigned last_group = 0;
+        shared_ptr<video_frame> encode(shared_ptr<video_frame> frame) override {
+                last_group = frame_group;
+                return frame;
+        }
+        bool decode(char *, int, char **, int *, const map<int, int> &) override {
+                return false;
+        }
+};
+} // end of anonymous namespace
+
+/**
+ * Checks that the small frames are aggregated to blocks of the requested size
+ * with one record (video header + data) per frame, that the big ones are not
+ * held back and that a truncated block is split only up to its end.
+ */
+int misc_test_fec_frame_group()
+{
+        auto *inner = new fec_passthrough;
+        fec_frame_group group(inner, 3, 1000);
+        auto make_frame = [](unsigned len, char val) {
+                shared_ptr<video_frame> f(vf_alloc_desc_data(video_desc{ 640, 480, H264, 25, PROGRESSIVE, 1 }), vf_free);
+                f->tiles[0].data_len = len;
+                memset(f->tiles[0].data, val, len);
+                return f;
+        };
+
+        ASSERT(!group.encode(make_frame(100, 1)));
+        ASSERT(!group.encode(make_frame(200, 2)));
+        shared_ptr<video_frame> out = group.encode(make_frame(300, 3));
+        ASSERT(out);
+        ASSERT_EQUAL(3U, inner->last_group);
+        ASSERT_EQUAL(600 + 3 * sizeof(video_payload_hdr_t), (size_t) out->tiles[0].data_len);
+        auto records = fec_frame_group_split(out->tiles[0].data, out->tiles[0].data_len, 3);
+        for (int i = 0; i < 3; ++i) {
+                ASSERT_EQUAL((int) ((i + 1) * 100 + sizeof(video_payload_hdr_t)), records[i].second);
+                ASSERT_EQUAL((uint32_t) (i + 1) * 100, ntohl(((uint32_t *) records[i].first)[2]));
+                ASSERT_EQUAL(i + 1, (int) records[i].first[records[i].second - 1]);
+        }
+
+        // a truncated block
+        records = fec_frame_group_split(out->tiles[0].data, 150 + 2 * sizeof(video_payload_hdr_t), 3);
+        ASSERT_EQUAL((int) (100 + sizeof(video_payload_hdr_t)), records[0].second);
+        ASSERT_EQUAL((int) (50 + sizeof(video_payload_hdr_t)), records[1].second);
+        ASSERT_EQUAL(0, records[2].second);
+
+        // a big frame is sent on its own, or closes the pending group
+        shared_ptr<video_frame> big = make_frame(2000, 4);
+        ASSERT(group.encode(big) == big);
+        ASSERT_EQUAL(0U, inner->last_group);
+        ASSERT(!group.encode(make_frame(100, 5)));
+        out = group.encode(big);
+        ASSERT(out && out != big);
+        ASSERT_EQUAL(2U, inner->last_group);
+
+        // held frames are flushed if no other frame comes until the deadline ((3 - 1/2) frames at 25 fps)
+        ASSERT_EQUAL(0LL, group.flush_deadline());
+        ASSERT(!group.flush());
+        ASSERT(!group.encode(make_frame(100, 6)));
+        const time_ns_t deadline = group.flush_deadline();
+        ASSERT(deadline > get_time_in_ns() && deadline <= get_time_in_ns() + 100 * NS_IN_MS);
+        out = group.flush();
+        ASSERT(out);
+        ASSERT_EQUAL(0U, inner->last_group);
+        ASSERT_EQUAL(100, (int) out->tiles[0].data_len);
+        ASSERT_EQUAL(0LL, group.flush_deadline());
+
+        uint32_t hdr[6] = { htonl(3), 0, 0, 0, 0, 0 };
+        ASSERT_EQUAL(3U, fec_frame_group_count(hdr));
+        hdr[0] = htonl(2U << 22U); // tile index only
+        ASSERT_EQUAL(0U, fec_frame_group_count(hdr));
+        return 0;
+}
+
+/**
+ * Checks frame_copy() and memcpy_nt() for all the size classes (including
+ * stripes not a multiple of the stripe size) and misaligned buffers, also
+ * with the non-temporal stores disabled.
+ */
+int misc_test_frame_copy()
+{
+        const size_t max_len = FRAME_COPY_PARALLEL_THRESHOLD + 12345;
+        vector<unsigned char> src(max_len + 64);
+        for (size_t i = 0; i < src.size(); ++i) {
+                src[i] = (unsigned char) (i * 2654435761U >> 15);
+        }
+        vector<unsigned char> dst(src.size());
+        for (const char *cfg : { "none", (const char *) nullptr }) {
+                ASSERT_EQUAL(0, cpu_features_configure(cfg));
+                for (size_t len : { (size_t) 0, (size_t) 63, (size_t) 130, (size_t) 8191, (size_t) FRAME_COPY_NT_THRESHOLD + 7, max_len }) {
+                        for (size_t off : { 0, 1, 17 }) {
+                                fill(dst.begin(), dst.end(), 0);
+                                frame_copy(dst.data() + off, src.data() + 3, len);
+                                ASSERT(equal(src.begin() + 3, src.begin() + 3 + len, dst.begin() + off));
+                                ASSERT_EQUAL(0, dst[off + len]);
+                                fill(dst.begin(), dst.end(), 0);
+                                memcpy_nt(dst.data() + off, src.data() + off, len);
+                                ASSERT(equal(src.begin() + off, src.begin() + off + len, dst.begin() + off));
+                                ASSERT_EQUAL(0, dst[off + len]);
+                        }
+                }
+        }
+        return 0;
+}
+
+/**
+ * Passes sender stages of a frame through the (un)packing as they are sent
+ * in the RTCP APP packet and checks that they are merged with the receiver
+ * ones of the same frame only and that the stage latencies are recorded.
+ */
+int misc_test_frame_trace()
+{
+        const time_ns_t t0 = get_time_in_ns();
+        struct frame_trace sender{};
+        sender.rtp_ts = 0xdeadbeefU;
+        for (int i = 0; i < FT_SENDER_STAGES; ++i) {
+                sender.t[i] = t0 + i * NS_IN_MS;
+        }
+        char buf[256];
+        int len = frame_trace_pack(&sender, buf, sizeof buf);
+        ASSERT(len > 0 && len % 4 == 0);
+        ASSERT(frame_trace_pack(&sender, buf, len - 1) == -1);
+        struct frame_trace unpacked{};
+        ASSERT(frame_trace_unpack(&unpacked, buf, len));
+        ASSERT_EQUAL(sender.rtp_ts, unpacked.rtp_ts);
+        for (int i = 0; i < FT_SENDER_STAGES; ++i) {
+                ASSERT_EQUAL(sender.t[i], unpacked.t[i]);
+        }
+        ASSERT(!frame_trace_unpack(&unpacked, buf, len - 4));
+
+        const int network_before = frame_trace_get_latency(true, FT_RX_FIRST, 50, nullptr);
+        const int compress_before = frame_trace_get_latency(true, FT_COMPRESS_END, 50, nullptr);
+        const int decompress_before = frame_trace_get_latency(true, FT_DECOMPRESS, 50, nullptr);
+        frame_trace_sender_report(42, buf, len);
+
+        struct frame_trace receiver{};
+        receiver.ssrc = 42;
+        receiver.rtp_ts = sender.rtp_ts + 1; // another frame - not merged
+        receiver.t[FT_RX_FIRST] = sender.t[FT_TX_FIRST] + 20 * NS_IN_MS;
+        receiver.t[FT_RX_LAST] = receiver.t[FT_RX_FIRST] + 4 * NS_IN_MS;
+        receiver.t[FT_DECOMPRESS] = receiver.t[FT_RX_LAST] + 10 * NS_IN_MS;
+        frame_trace_receiver_done(&receiver);
+        ASSERT_EQUAL(network_before, frame_trace_get_latency(true, FT_RX_FIRST, 50, nullptr));
+        ASSERT_EQUAL(decompress_before + 1, frame_trace_get_latency(true, FT_DECOMPRESS, 50, nullptr));
+
+        receiver.rtp_ts = sender.rtp_ts;
+        frame_trace_receiver_done(&receiver);
+        ASSERT_EQUAL(compress_before + 1, frame_trace_get_latency(true, FT_COMPRESS_END, 50, nullptr));
+        time_ns_t network = 0;
+        ASSERT_EQUAL(network_before + 1, frame_trace_get_latency(true, FT_RX_FIRST, 100, &network));
+        if (network_before == 0) { // histogram precision is 1/4 of the octave
+                ASSERT(network >= 20 * NS_IN_MS && network <= 25 * NS_IN_MS);
+        }
+
+        frame_trace_receiver_done(&receiver); // the sender report was consumed
+        ASSERT_EQUAL(compress_before + 1, frame_trace_get_latency(true, FT_COMPRESS_END, 50, nullptr));
+        return 0;
+}
+
+/**
+ * Checks that line maps used to change interlacing while decoding match
+ * the full-frame interlacing conversions.
+ */
+int misc_test_il_line_maps()
+{
+        struct { void (*func)(char *, char *, int, int, void **); int (*line_map)(int, int); } const maps[] = {
+                { il_upper_to_merged, il_upper_to_merged_line },
+                { il_merged_to_upper, il_merged_to_upper_line },
+        };
+        for (const auto &m : maps) {
+                for (int height : { 1, 2, 7, 1080, 1081 }) {
+                        vector<char> src(height);
+                        vector<char> dst(height);
+                        for (int i = 0; i < height; ++i) {
+                                src[i] = (char) i;
+                        }
+                        m.func(dst.data(), src.data(), 1, height, nullptr);
+                        for (int i = 0; i < height; ++i) {
+                                ASSERT_EQUAL(src[i], dst[m.line_map(i, height)]);
+                        }
+                }
+        }
+        return 0;
+}
+
+template<int len>
+static int check_lockfree_queue_mpmc(unsigned spin_count)
+{
+        constexpr int producers = 3;
+        constexpr int per_producer = 10000;
+        lockfree_queue<int, len> q(spin_count);
+        vector<thread> threads;
+        for (int p = 0; p < producers; ++p) {
+                threads.emplace_back([&q, p] {
+                        for (int i = 1; i <= per_producer; ++i) {
+                                q.push(p * per_producer + i);
+                        }
+                });
+        }
+        vector<long long> sums(2);
+        vector<thread> consumers;
+        for (int c = 0; c < 2; ++c) {
+                consumers.emplace_back([&q, &sums, c] {
+                        int val = 0;
+                        while ((val = q.pop()) != 0) {
+                                sums[c] += val;
+                        }
+                });
+        }
+        for (auto &t : threads) {
+                t.join();
+        }
+        q.push(0); // poison each consumer
+        q.push(0);
+        for (auto &t : consumers) {
+                t.join();
+        }
+        const long long n = producers * per_producer;
+        ASSERT_EQUAL(n * (n + 1) / 2, sums[0] + sums[1]);
+        int val = -1;
+        ASSERT(!q.timed_pop(val, std::chrono::milliseconds(1)));
+        return 0;
+}
+
+/**
+ * Checks that independent init_graph steps overlap, that a step starts only
+ * after its dependencies and that a failure is propagated instead of running
+ * the dependent steps.
+ */
+int misc_test_init_graph()
+{
+        for (bool parallel : { true, false }) {
+                init_graph graph(parallel);
+                atomic<int> first_done{0};
+                bool dependent_run = false;
+                auto t0 = chrono::steady_clock::now();
+                auto first = graph.add("first", [&] { this_thread::sleep_for(100ms); first_done = 1; return 0; });
+                auto second = graph.add("second", [&] { this_thread::sleep_for(100ms); return 0; });
+                auto failing = graph.add("failing", [] { return -2; });
+                auto throwing = graph.add("throwing", []() -> int { throw 5; });
+                auto dependent = graph.run("dependent", [&] { return first_done == 1 ? 0 : 1; }, { first, second });
+                auto skipped = graph.add("skipped", [&] { dependent_run = true; return 0; }, { first, failing });
+                ASSERT_EQUAL(0, graph.wait(dependent));
+                ASSERT_EQUAL(-2, graph.wait(skipped));
+                ASSERT(!dependent_run);
+                int thrown = 0;
+                try {
+                        graph.wait(throwing);
+                } catch (int i) {
+                        thrown = i;
+                }
+                ASSERT_EQUAL(5, thrown);
+                auto elapsed = chrono::steady_clock::now() - t0;
+                ASSERT(parallel ? elapsed < 190ms : elapsed >= 200ms);
+        }
+        return 0;
+}
+
+/**
+ * Checks that push_latest() replaces the oldest element of a full queue and
+ * that a slow consumer always gets increasing and recent values.
+ */
+int misc_test_lockfree_queue_latest()
+{
+        lockfree_queue<int, 2> q;
+        ASSERT(!q.push_latest(1));
+        ASSERT(!q.push_latest(2));
+        ASSERT(q.push_latest(3));
+        ASSERT_EQUAL(2, q.pop());
+        ASSERT_EQUAL(3, q.pop());
+
+        lockfree_queue<int, 1> slot;
+        const int count = 2000;
+        int dropped = 0;
+        thread producer([&] {
+                for (int i = 1; i <= count; ++i) {
+                        dropped += slot.push_latest(std::move(i)) ? 1 : 0;
+                }
+                slot.push(0);
+        });
+        int last = 0;
+        int received = 0;
+        for (int val = 0; (val = slot.pop()) != 0; ) {
+                ASSERT(val > last);
+                last = val;
+                received += 1;
+                this_thread::sleep_for(chrono::microseconds(10));
+        }
+        producer.join();
+        ASSERT_EQUAL(count, last);
+        ASSERT_EQUAL(count, received + dropped);
+        return 0;
+}
+
+/**
+ * Checks that lockfree_queue delivers every pushed element exactly once with
+ * multiple producers and consumers, both using spin and parking only.
+ */
+int misc_test_lockfree_queue_mpmc()
+{
+        for (unsigned spin : { 0U, 256U }) {
+                if (check_lockfree_queue_mpmc<1>(spin) != 0 || check_lockfree_queue_mpmc<4>(spin) != 0) {
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+/**
+ * Checks that the frames allocated by a thread are accounted to its owner
+ * module until freed, also from another thread, and that the peak is kept.
+ */
+int misc_test_module_mem()
+{
+        struct module mod;
+        module_init_default(&mod);
+        mod.cls = MODULE_CLASS_DATA;
+        long long current = 0;
+        long long peak = 0;
+        ASSERT(!module_get_mem_usage(&mod, &current, &peak));
+
+        module_set_mem_owner(&mod);
+        struct video_desc desc{1920, 1080, UYVY, 30, PROGRESSIVE, 1};
+        struct video_frame *frames[2] = { vf_alloc_desc_data(desc), vf_alloc_desc_data(desc) };
+        module_set_mem_owner(nullptr);
+        struct video_frame *unaccounted = vf_alloc_desc_data(desc);
+        ASSERT(module_get_mem_usage(&mod, &current, &peak));
+        const long long frame_size = frames[0]->tiles[0].data_len + MAX_PADDING;
+        ASSERT_EQUAL(2 * frame_size, current);
+        ASSERT_EQUAL(2 * frame_size, peak);
+
+        thread([&] { vf_free(frames[0]); }).join();
+        vf_free(unaccounted);
+        ASSERT(module_get_mem_usage(&mod, &current, &peak));
+        ASSERT_EQUAL(frame_size, current);
+        ASSERT_EQUAL(2 * frame_size, peak);
+
+        // the accounting outlives the module
+        module_done(&mod);
+        vf_free(frames[1]);
+        return 0;
+}
+
+/**
+ * Sends messages to a module from several threads and checks that each
+ * sender's messages are received once and in order. Then checks that a
+ * cached address is resolved again after the receiver is replaced.
+ */
+int misc_test_module_messages()
+{
+        struct module root;
+        module_init_default(&root);
+        root.cls = MODULE_CLASS_ROOT;
+        struct module recv;
+        module_init_default(&recv);
+        recv.cls = MODULE_CLASS_SENDER;
+        module_register(&recv, &root);
+
+        const int senders = 4;
+        const int count = 20;
+        vector<thread> threads;
+        for (int i = 0; i < senders; ++i) {
+                threads.emplace_back([&recv, i] {
+                        for (int j = 0; j < count; ++j) {
+                                auto *msg = (struct msg_universal *) new_message(sizeof(struct msg_universal));
+                                snprintf(msg->text, sizeof msg->text, "%d %d", i, j);
+                                free_response(send_message_to_receiver(&recv, (struct message *) msg));
+                        }
+                });
+        }
+        for (auto &t : threads) {
+                t.join();
+        }
+        vector<int> next(senders);
+        struct message *msg;
+        while ((msg = check_message(&recv)) != nullptr) {
+                int sender = 0;
+                int seq = 0;
+                ASSERT_EQUAL(2, sscanf(((struct msg_universal *) msg)->text, "%d %d", &sender, &seq));
+                ASSERT_EQUAL(next.at(sender)++, seq);
+                free_message(msg, nullptr);
+        }
+        ASSERT(!module_has_messages(&recv));
+        for (int n : next) {
+                ASSERT_EQUAL(count, n);
+        }
+
+        struct module_addr addr = MODULE_ADDR_INIT("sender");
+        free_response(send_message_to_addr(&root, &addr, new_message(sizeof(struct msg_universal))));
+        ASSERT(addr.mod == &recv);
+        free_message(check_message(&recv), nullptr);
+        module_done(&recv);
+        struct module recv2;
+        module_init_default(&recv2);
+        recv2.cls = MODULE_CLASS_SENDER;
+        module_register(&recv2, &root);
+        free_response(send_message_to_addr(&root, &addr, new_message(sizeof(struct msg_universal))));
+        ASSERT(addr.mod == &recv2);
+        ASSERT(module_has_messages(&recv2));
+        free_message(check_message(&recv2), nullptr);
+
+        module_done(&recv2);
+        module_done(&root);
+        return 0;
+}
+
+/**
+ * Adds and removes participants while another thread looks them up and
+ * iterates the database - the permanent participants must always be found
+ * and each participant must be iterated at most once.
+ */
+int misc_test_pdb_concurrent()
+{
+        struct pdb *db = pdb_init(nullptr);
+        ASSERT(db != nullptr);
+        const uint32_t permanent = 50;
+        for (uint32_t ssrc = 1; ssrc <= permanent; ++ssrc) {
+                ASSERT_EQUAL(0, pdb_add(db, ssrc));
+        }
+        ASSERT_EQUAL(1, pdb_add(db, 1));
+
+        atomic<bool> stop{false};
+        atomic<bool> failed{false};
+        thread reader([&] {
+                while (!stop) {
+                        for (uint32_t ssrc = 1; ssrc <= permanent; ++ssrc) {
+                                struct pdb_e *e = pdb_get(db, ssrc);
+                                if (e == nullptr || e->ssrc != ssrc) {
+                                        failed = true;
+                                }
+                        }
+                        uint32_t found = 0;
+                        vector<uint32_t> seen;
+                        pdb_iter_t it;
+                        for (struct pdb_e *cp = pdb_iter_init(db, &it); cp != nullptr; cp = pdb_iter_next(&it)) {
+                                seen.push_back(cp->ssrc);
+                                found += cp->ssrc <= permanent ? 1 : 0;
+                        }
+                        pdb_iter_done(&it);
+                        sort(seen.begin(), seen.end());
+                        if (found != permanent || adjacent_find(seen.begin(), seen.end()) != seen.end()) {
+                                failed = true;
+                        }
+                }
+        });
+
+        vector<struct pdb_e *> removed; // destroyed after the reader ends, may be still iterated
+        for (uint32_t i = 0; i < 2000; ++i) {
+                uint32_t ssrc = 1000 + i % 100;
+                struct pdb_e *item = nullptr;
+                if (pdb_get(db, ssrc) == nullptr) {
+                        ASSERT_EQUAL(0, pdb_add(db, ssrc));
+                } else {
+                        ASSERT_EQUAL(0, pdb_remove(db, ssrc, &item));
+                        ASSERT(item != nullptr && item->ssrc == ssrc);
+                        removed.push_back(item);
+                }
+        }
+        stop = true;
+        reader.join();
+        ASSERT(!failed);
+        for (auto *item : removed) {
+                pdb_destroy_item(item);
+        }
+
+        struct pdb_e *item = nullptr;
+        ASSERT_EQUAL(1, pdb_remove(db, 999, &item));
+        ASSERT(item == nullptr);
+        pdb_destroy(&db);
+        ASSERT(db == nullptr);
+        return 0;
+}
+
+/**
+ * Checks .cube parsing (including a non-default domain), that interpolation
+ * in an identity LUT is exact and basic properties of the tone mapping.
+ */
+int misc_test_lut3d()
+{
+        std::istringstream cube("# comment\nTITLE \"identity\"\nLUT_3D_SIZE 2\n"
+                        "0 0 0\n1 0 0\n0 1 0\n1 1 0\n0 0 1\n1 0 1\n0 1 1\n1 1 1\n");
+        lut3d lut;
+        ASSERT(lut.parse_cube(cube));
+        ASSERT_EQUAL(2, lut.size);
+        const float points[][3] = { { 0.0F, 0.0F, 0.0F }, { 0.3F, 0.7F, 0.1F }, { 0.9F, 0.2F, 0.5F }, { 0.4F, 0.4F, 0.4F } };
+        for (const auto &p : points) {
+                float out[3];
+                lut.sample(p, out);
+                for (int i = 0; i < 3; ++i) {
+                        ASSERT(fabsf(out[i] - p[i]) < 1e-5F);
+                }
+        }
+
+        std::istringstream scaled("LUT_3D_SIZE 2\nDOMAIN_MAX 2 2 2\n"
+                        "0 0 0\n1 0 0\n0 1 0\n1 1 0\n0 0 1\n1 0 1\n0 1 1\n1 1 1\n");
+        ASSERT(lut.parse_cube(scaled));
+        float out[3];
+        lut.sample(points[1], out);
+        ASSERT(fabsf(out[1] - points[1][1] / 2) < 1e-5F);
+
+        std::istringstream truncated("LUT_3D_SIZE 2\n0 0 0\n1 0 0\n");
+        ASSERT(!lut.parse_cube(truncated));
+
+        for (auto transfer : { TONEMAP_PQ, TONEMAP_HLG }) {
+                tonemap_params tm;
+                tm.transfer = transfer;
+                const float peak_code = transfer == TONEMAP_PQ ? 0.7518F : 1.0F; // 1000 nits
+                const float black[3] = { 0.0F, 0.0F, 0.0F };
+                const float peak[3] = { peak_code, peak_code, peak_code };
+                tonemap_hdr_to_sdr(tm, black, out);
+                ASSERT(out[0] < 1e-3F && out[1] < 1e-3F && out[2] < 1e-3F);
+                tonemap_hdr_to_sdr(tm, peak, out);
+                ASSERT(fabsf(out[0] - 1.0F) < 0.01F && fabsf(out[1] - 1.0F) < 0.01F && fabsf(out[2] - 1.0F) < 0.01F);
+                float last = 0.0F;
+                for (float v = 0.05F; v <= peak_code; v += 0.05F) {
+                        const float gray[3] = { v, v, v };
+                        tonemap_hdr_to_sdr(tm, gray, out);
+                        ASSERT(out[1] > last);
+                        last = out[1];
+                }
+        }
+        return 0;
+}
+
+/**
+ * Checks counter and histogram updates (including from multiple threads)
+ * and their rendering in the Prometheus text format.
+ */
+int misc_test_metrics()
+{
+        struct metric *c = metric_counter("ug_test_events_total", "Test events", "kind=\"a\"");
+        ASSERT(c != nullptr);
+        ASSERT(metric_counter("ug_test_events_total", "Test events", "kind=\"a\"") == c);
+        ASSERT(metric_gauge("ug_test_events_total", "Test events", nullptr) == nullptr); // type mismatch
+        metric_inc(nullptr, 1); // ignored
+        vector<thread> threads;
+        for (int i = 0; i < 4; ++i) {
+                threads.emplace_back([c] { for (int j = 0; j < 1000; ++j) { metric_inc(c, 1); } });
+        }
+        for (auto &t : threads) {
+                t.join();
+        }
+        ASSERT_EQUAL(4000, (int) metric_value(c));
+
+        struct metric *g = metric_gauge("ug_test_level", "Test level", nullptr);
+        metric_set(g, 2.5);
+        ASSERT(metric_value(g) == 2.5);
+
+        const double bounds[] = { 1, 10 };
+        struct metric *h = metric_histogram("ug_test_latency_seconds", "Test latency", "side=\"rx\"", bounds, 2);
+        for (double val : { 0.5, 1.0, 5.0, 50.0 }) {
+                metric_observe(h, val);
+        }
+        ASSERT_EQUAL(4, (int) metric_value(h));
+
+        string text = metrics_format();
+        for (const char *line : { "# TYPE ug_test_events_total counter\n",
+                                "ug_test_events_total{kind=\"a\"} 4000\n",
+                                "ug_test_level 2.5\n",
+                                "# TYPE ug_test_latency_seconds histogram\n",
+                                "ug_test_latency_seconds_bucket{side=\"rx\",le=\"1\"} 2\n",
+                                "ug_test_latency_seconds_bucket{side=\"rx\",le=\"10\"} 3\n",
+                                "ug_test_latency_seconds_bucket{side=\"rx\",le=\"+Inf\"} 4\n",
+                                "ug_test_latency_seconds_sum{side=\"rx\"} 56.5\n",
+                                "ug_test_latency_seconds_count{side=\"rx\"} 4\n" }) {
+                ASSERT_MESSAGE(line, text.find(line) != string::npos);
+        }
+        return 0;
+}
+
+/**
+ * Checks that a named queue counts the pushes and the time the producer
+ * was blocked by a full queue.
+ */
+int misc_test_queue_stats()
+{
+        synchronized_queue<int, 1> q;
+        q.set_name("test \"stage\"");
+        const char *labels = "queue=\"test \\\"stage\\\"\"";
+        q.push(1);
+        thread producer([&q] { q.push(2); }); // blocks until the pop below
+        this_thread::sleep_for(chrono::milliseconds(20));
+        ASSERT_EQUAL(1, q.pop());
+        producer.join();
+        q.count_drop();
+
+        ASSERT_EQUAL(2, (int) metric_value(metric_counter("ug_queue_pushes_total", "", labels)));
+        ASSERT_EQUAL(1, (int) metric_value(metric_gauge("ug_queue_depth", "", labels)));
+        ASSERT_EQUAL(1, (int) metric_value(metric_gauge("ug_queue_capacity", "", labels)));
+        ASSERT_EQUAL(1, (int) metric_value(metric_counter("ug_queue_drops_total", "", labels)));
+        ASSERT(metric_value(metric_counter("ug_queue_push_blocked_microseconds_total", "", labels)) >= 10000);
+        ASSERT(metrics_format("ug_queue").find("ug_queue_pushes_total{queue=\"test \\\"stage\\\"\"} 2\n") != string::npos);
+        ASSERT(metrics_format("ug_queue").find("ug_test_") == string::npos);
+        return 0;
+}
+
 #ifdef __clang__
 #pragma clang diagnostic ignored "-Wstring-concatenation"
 #endif
@@ -36,6 +1209,88 @@ int misc_test_replace_all()
         return 0;
 }
 
+/**
+ * Checks that the YUV resizer keeps flat areas flat, keeps 10-bit values of
+ * v210 and fills the letterbox margins with black.
+ */
+int misc_test_resize_yuv()
+{
+        struct resize_yuv *s = resize_yuv_init();
+        ASSERT(resize_yuv_supported(v210) && !resize_yuv_supported(RGB));
+
+        // flat UYVY 64x32 downscaled to 32x16
+        vector<unsigned char> in(vc_get_datalen(64, 32, UYVY));
+        for (size_t i = 0; i < in.size(); i += 4) {
+                in[i] = 100; in[i + 1] = 150; in[i + 2] = 200; in[i + 3] = 150;
+        }
+        vector<unsigned char> out(vc_get_datalen(32, 16, UYVY));
+        ASSERT_EQUAL(0, resize_yuv_frame(s, (char *) in.data(), UYVY, (char *) out.data(), 64, 32, 32, 16));
+        for (size_t i = 0; i < out.size(); i += 4) {
+                ASSERT(out[i] == 100 && out[i + 1] == 150 && out[i + 2] == 200 && out[i + 3] == 150);
+        }
+
+        // the same picture to 32x32 - the 2:1 picture is in the middle 16 lines
+        out.resize(vc_get_datalen(32, 32, UYVY));
+        ASSERT_EQUAL(0, resize_yuv_frame(s, (char *) in.data(), UYVY, (char *) out.data(), 64, 32, 32, 32));
+        for (int y = 0; y < 32; ++y) {
+                const unsigned char *line = out.data() + y * vc_get_linesize(32, UYVY);
+                const bool black = y < 8 || y >= 24;
+                ASSERT_EQUAL(black ? 128 : 100, line[0]);
+                ASSERT_EQUAL(black ? 16 : 150, line[1]);
+        }
+
+        // v210 10-bit luma ramp with the same dimensions must not lose the 2 LSBs
+        const int w = 48;
+        const int h = 2;
+        vector<uint32_t> v210_in(vc_get_datalen(w, h, v210) / 4);
+        for (int y = 0; y < h; ++y) {
+                uint32_t *line = v210_in.data() + y * vc_get_linesize(w, v210) / 4;
+                for (int i = 0; i < w / 6 * 4; ++i) { // component order Cb Y Cr Y
+                        uint32_t word = 0;
+                        for (int c = 0; c < 3; ++c) {
+                                const int comp = i * 3 + c;
+                                const uint32_t val = comp % 2 == 1 ? 64 + comp / 2 * 7 : 513;
+                                word |= val << (10 * c);
+                        }
+                        line[i] = word;
+                }
+        }
+        vector<uint32_t> v210_out(v210_in.size());
+        ASSERT_EQUAL(0, resize_yuv_frame(s, (char *) v210_in.data(), v210, (char *) v210_out.data(), w, h, w, h));
+        ASSERT(v210_in == v210_out);
+
+        resize_yuv_done(s);
+        return 0;
+}
+
+static void rtp_test_callback(struct rtp *, rtp_event *)
+{
+}
+
+/**
+ * Sends PLI and FIR between two local sessions and checks that only the
+ * requests for the receiving session's SSRC are counted.
+ */
+int misc_test_rtp_keyframe_request()
+{
+        struct rtp *a = rtp_init("127.0.0.1", 50406, 50408, 255, 0, 0, rtp_test_callback, nullptr, 0, false);
+        struct rtp *b = rtp_init("127.0.0.1", 50408, 50406, 255, 0, 0, rtp_test_callback, nullptr, 0, false);
+        ASSERT(a != nullptr && b != nullptr);
+        ASSERT(rtp_send_keyframe_request(a, rtp_my_ssrc(b), false));
+        ASSERT(rtp_send_keyframe_request(a, rtp_my_ssrc(b), true));
+        ASSERT(rtp_send_keyframe_request(a, rtp_my_ssrc(b) + 1, false));
+        for (int i = 0; i < 3; ++i) {
+                struct timeval timeout = { 1, 0 };
+                ASSERT(rtcp_recv_r(b, &timeout, 0));
+        }
+        ASSERT_EQUAL(2, rtp_take_keyframe_requests(b));
+        ASSERT_EQUAL(0, rtp_take_keyframe_requests(b));
+        ASSERT_EQUAL(0, rtp_take_keyframe_requests(a));
+        rtp_done(a);
+        rtp_done(b);
+        return 0;
+}
+
 int misc_test_video_desc_io_op_symmetry()
 {
         const std::list<video_desc> test_desc = {
@@ -58,3 +1313,388 @@ int misc_test_video_desc_io_op_symmetry()
         }
         return 0;
 }
+
+/**
+ * Checks that returned frames are handed out again (with the full data_len
+ * restored), that a frame from the previous generation is not reused after
+ * reconfiguration and that reconfiguration to the same format keeps the frames.
+ */
+int misc_test_video_frame_pool_reuse()
+{
+        video_frame_pool pool(2);
+        pool.reconfigure(video_desc{ 3840, 2160, UYVY, 30, PROGRESSIVE, 1 });
+        char *data = nullptr;
+        for (int i = 0; i < 3; ++i) {
+                auto frame = pool.get_frame();
+                ASSERT(frame->tiles[0].data_len == 3840 * 2160 * 2);
+                if (data != nullptr) {
+                        ASSERT(frame->tiles[0].data == data);
+                }
+                data = frame->tiles[0].data;
+                frame->tiles[0].data_len = 1000; // eg. shorter converted data
+        }
+        auto old = pool.get_frame();
+        pool.reconfigure(video_desc{ 1920, 1080, UYVY, 30, PROGRESSIVE, 1 });
+        old.reset();
+        auto frame = pool.get_frame();
+        ASSERT(frame->tiles[0].data_len == 1920 * 1080 * 2);
+        data = frame->tiles[0].data;
+        pool.reconfigure(video_desc{ 1920, 1080, UYVY, 30, PROGRESSIVE, 1 });
+        frame.reset();
+        ASSERT(pool.get_frame()->tiles[0].data == data);
+        return 0;
+}
+
+/**
+ * Checks that the zero-copy split points into the source frame and that its
+ * contiguous copy equals the copying vf_split().
+ */
+int misc_test_vf_split_view()
+{
+        const unsigned w = 64, h = 48;
+        struct video_frame *src = vf_alloc_desc_data(video_desc{ w, h, UYVY, 25, PROGRESSIVE, 1 });
+        for (unsigned i = 0; i < src->tiles[0].data_len; ++i) {
+                src->tiles[0].data[i] = (char) (i * 7 + i / 128);
+        }
+        const int src_linesize = vc_get_linesize(w, UYVY);
+
+        struct video_frame *view = vf_alloc(4);
+        vf_split_view(view, src, 2, 2);
+        ASSERT(vf_has_strided_tiles(view));
+        ASSERT_EQUAL(src_linesize, (int) view->tiles[3].pitch);
+        ASSERT(view->tiles[3].data == src->tiles[0].data + (h / 2) * src_linesize + src_linesize / 2);
+
+        struct video_frame *copied = vf_alloc_desc_data(video_desc{ w / 2, h / 2, UYVY, 25, PROGRESSIVE, 4 });
+        vf_split(copied, src, 2, 2, 0);
+        view->callbacks.dispose = vf_free;
+        struct video_frame *contiguous = vf_make_contiguous(view); // disposes view
+        ASSERT(!vf_has_strided_tiles(contiguous));
+        for (unsigned i = 0; i < 4; ++i) {
+                ASSERT_EQUAL(copied->tiles[i].data_len, contiguous->tiles[i].data_len);
+                ASSERT(memcmp(copied->tiles[i].data, contiguous->tiles[i].data, copied->tiles[i].data_len) == 0);
+        }
+
+        struct video_frame *rows = vf_alloc(2);
+        vf_split_view(rows, src, 1, 2);
+        ASSERT(!vf_has_strided_tiles(rows));
+        ASSERT(vf_make_contiguous(rows) == rows);
+
+        vf_free(rows);
+        vf_free(contiguous);
+        vf_free(copied);
+        vf_free(src);
+        return 0;
+}
+
+static vector<unsigned char> make_nal(vector<unsigned char> hdr, size_t len)
+{
+        vector<unsigned char> nal{ 0, 0, 0, 1 };
+        nal.insert(nal.end(), hdr.begin(), hdr.end());
+        for (size_t i = hdr.size(); i < len; ++i) {
+                nal.push_back(i % 251 + 2); // no start code emulation
+        }
+        return nal;
+}
+
+/**
+ * Checks that the parameter sets are aggregated to one packet and the big
+ * NAL unit is fragmented with correct FU headers for H.264 and HEVC.
+ */
+int misc_test_h264_packetize()
+{
+        for (bool hevc : { false, true }) {
+                const vector<unsigned char> params_hdr[] = { { 0x67 }, { 0x68 } }; // SPS, PPS
+                const vector<unsigned char> hevc_params_hdr[] = { { 0x40, 0x01 }, { 0x42, 0x01 }, { 0x44, 0x01 } }; // VPS, SPS, PPS
+                vector<unsigned char> au;
+                size_t params_len = 0;
+                int param_count = 0;
+                for (auto const &h : hevc ? vector<vector<unsigned char>>(begin(hevc_params_hdr), end(hevc_params_hdr))
+                                : vector<vector<unsigned char>>(begin(params_hdr), end(params_hdr))) {
+                        auto nal = make_nal(h, 10 + param_count);
+                        params_len += 2 + nal.size() - 4;
+                        param_count += 1;
+                        au.insert(au.end(), nal.begin(), nal.end());
+                }
+                auto idr = make_nal(hevc ? vector<unsigned char>{ 0x26, 0x01 } : vector<unsigned char>{ 0x65 }, 5000);
+                au.insert(au.end(), idr.begin(), idr.end());
+
+                const int max_payload = 1400;
+                vector<rtpenc_h264_pkt> pkts;
+                vector<unsigned char> scratch;
+                size_t scratch_needed = 0;
+                int count = 0;
+                while ((count = rtpenc_h264_packetize(au.data(), au.size(), hevc, max_payload, pkts.data(), pkts.size(),
+                                                scratch.data(), scratch.size(), &scratch_needed)) > (int) pkts.size()
+                                || scratch_needed > scratch.size()) {
+                        pkts.resize(count);
+                        scratch.resize(scratch_needed);
+                }
+                const int hdr_len = hevc ? 2 : 1;
+                const int fu_count = (5000 - hdr_len + max_payload - hdr_len - 2) / (max_payload - hdr_len - 1);
+                ASSERT_EQUAL(1 + fu_count, count);
+
+                // aggregation packet
+                ASSERT(pkts[0].hdr == nullptr && pkts[0].data_len == (int) (hdr_len + params_len));
+                ASSERT_EQUAL(hevc ? 48 : 24, hevc ? pkts[0].data[0] >> 1 : pkts[0].data[0] & 0x1F);
+                ASSERT_EQUAL(hevc ? 0x01 : 0x60, hevc ? pkts[0].data[1] : pkts[0].data[0] & 0x60); // TID or NRI
+                ASSERT_EQUAL(10, (pkts[0].data[hdr_len] << 8) | pkts[0].data[hdr_len + 1]);
+
+                // fragments - reassemble the NAL unit
+                vector<unsigned char> reassembled(idr.begin() + 4, idr.begin() + 4 + hdr_len);
+                for (int i = 1; i < count; ++i) {
+                        auto const &p = pkts[i];
+                        ASSERT_EQUAL(hdr_len + 1, p.hdr_len);
+                        ASSERT(p.hdr_len + p.data_len <= max_payload);
+                        ASSERT_EQUAL(hevc ? 49 : 28, hevc ? p.hdr[0] >> 1 : p.hdr[0] & 0x1F);
+                        const unsigned char fu = p.hdr[hdr_len];
+                        ASSERT_EQUAL(i == 1, (fu & 0x80) != 0);
+                        ASSERT_EQUAL(i == count - 1, (fu & 0x40) != 0);
+                        ASSERT_EQUAL(hevc ? 19 : 5, fu & 0x3F);
+                        ASSERT_EQUAL(i == count - 1, p.m);
+                        ASSERT(p.data >= au.data() && p.data + p.data_len <= au.data() + au.size()); // zero-copy
+                        reassembled.insert(reassembled.end(), p.data, p.data + p.data_len);
+                }
+                ASSERT(reassembled == vector<unsigned char>(idr.begin() + 4, idr.end()));
+        }
+        return 0;
+}
+
+#ifdef HAVE_RTSP
+/**
+ * Sends H.264 and HEVC access units through the packetizer and checks that
+ * the depacketizer reassembles the original stream (with zeroed padding) and
+ * refuses to overflow the buffer.
+ */
+int misc_test_h264_depacketize()
+{
+        for (bool hevc : { false, true }) {
+                vector<unsigned char> au;
+                const vector<vector<unsigned char>> hdrs = hevc
+                        ? vector<vector<unsigned char>>{ { 0x40, 0x01 }, { 0x4E, 0x01 }, { 0x26, 0x01 }, { 0x02, 0x01 } } // VPS, SEI, IDR, TRAIL
+                        : vector<vector<unsigned char>>{ { 0x68 }, { 0x06 }, { 0x65 }, { 0x41 } }; // PPS, SEI, IDR, non-IDR
+                const size_t sizes[] = { 8, 20, 9000, 700 };
+                for (size_t i = 0; i < hdrs.size(); ++i) {
+                        auto nal = make_nal(hdrs[i], sizes[i]);
+                        au.insert(au.end(), nal.begin(), nal.end());
+                }
+
+                vector<rtpenc_h264_pkt> pkts(64);
+                vector<unsigned char> scratch(4096);
+                size_t scratch_needed = 0;
+                int count = rtpenc_h264_packetize(au.data(), au.size(), hevc, 1400, pkts.data(), pkts.size(),
+                                scratch.data(), scratch.size(), &scratch_needed);
+                ASSERT(count <= (int) pkts.size() && scratch_needed <= scratch.size());
+
+                // payloads in the order given by pbuf (descending seqno)
+                vector<vector<char>> payloads(count);
+                vector<rtp_packet> rtp_pkts(count);
+                vector<coded_data> cdata(count);
+                for (int i = 0; i < count; ++i) {
+                        payloads[i].insert(payloads[i].end(), pkts[i].hdr, pkts[i].hdr + pkts[i].hdr_len);
+                        payloads[i].insert(payloads[i].end(), pkts[i].data, pkts[i].data + pkts[i].data_len);
+                        rtp_pkts[i].data = payloads[i].data();
+                        rtp_pkts[i].data_len = payloads[i].size();
+                        int idx = count - 1 - i;
+                        cdata[idx].data = &rtp_pkts[i];
+                        cdata[idx].seqno = i;
+                        cdata[idx].nxt = idx + 1 < count ? &cdata[idx + 1] : nullptr;
+                }
+
+                struct video_frame *frame = vf_alloc_desc_data(video_desc{ 1920, 1080, hevc ? H265 : H264, 25, PROGRESSIVE, 1 });
+                memset(frame->tiles[0].data, 0xFF, frame->tiles[0].data_len);
+                struct decode_data_h264 d{};
+                d.frame = frame;
+                d.max_len = au.size() + RTPDEC_H264_PADDING - 1;
+                ASSERT(!decode_frame_h264(&cdata[0], &d));
+                ASSERT_EQUAL(au.size() + RTPDEC_H264_PADDING, d.needed_len);
+
+                d.max_len = d.needed_len;
+                ASSERT(decode_frame_h264(&cdata[0], &d));
+                ASSERT_EQUAL(au.size(), frame->tiles[0].data_len);
+                ASSERT(memcmp(frame->tiles[0].data, au.data(), au.size()) == 0);
+                ASSERT(frame->frame_type == INTRA);
+                for (int i = 0; i < RTPDEC_H264_PADDING; ++i) {
+                        ASSERT_EQUAL(0, frame->tiles[0].data[au.size() + i]);
+                }
+                vf_free(frame);
+        }
+        return 0;
+}
+#else
+int misc_test_h264_depacketize()
+{
+        return 1;
+}
+#endif // defined HAVE_RTSP
+
+/**
+ * Checks the classification of H.264 and HEVC access units by the slice NAL
+ * unit headers - only the frames with all slices non-reference are disposable,
+ * in HEVC only if no higher temporal sub-layer was seen.
+ */
+int misc_test_h264_frame_type()
+{
+        struct {
+                bool hevc;
+                vector<vector<unsigned char>> hdrs;
+                frame_type_t type;
+        } cases[] = {
+                { false, { { 0x67 }, { 0x68 }, { 0x65 } }, INTRA },   // SPS, PPS, IDR
+                { false, { { 0x41 } }, OTHER },                       // reference slice
+                { false, { { 0x06 }, { 0x01 } }, BFRAME },            // SEI, non-reference slice
+                { false, { { 0x01 }, { 0x41 } }, OTHER },
+                { false, { { 0x67 } }, OTHER },                       // no slice
+                { true, { { 0x40, 0x01 }, { 0x26, 0x01 } }, INTRA },  // VPS, IDR_W_RADL
+                { true, { { 0x02, 0x01 } }, OTHER },                  // TRAIL_R
+                { true, { { 0x4E, 0x01 }, { 0x00, 0x01 } }, BFRAME }, // SEI, TRAIL_N
+                { true, { { 0x10, 0x01 }, { 0x10, 0x01 } }, BFRAME }, // RASL_N
+                { true, { { 0x00, 0x01 }, { 0x12, 0x01 } }, OTHER },  // TRAIL_N, RASL_R
+        };
+        for (auto const &c : cases) {
+                vector<unsigned char> au;
+                for (auto const &hdr : c.hdrs) {
+                        auto nal = make_nal(hdr, 100);
+                        au.insert(au.end(), nal.begin(), nal.end());
+                }
+                int max_tid = 0;
+                ASSERT_EQUAL(c.type, rtpenc_h264_get_frame_type(au.data(), au.size(), c.hevc, &max_tid));
+        }
+
+        // HEVC stream with 2 temporal sub-layers (nuh_temporal_id_plus1 in the 2nd header byte)
+        struct {
+                vector<unsigned char> hdr;
+                frame_type_t type;
+                int max_tid;
+        } seq[] = {
+                { { 0x00, 0x01 }, BFRAME, 0 }, // TRAIL_N TID 0, no higher sub-layer seen yet
+                { { 0x02, 0x02 }, OTHER, 1 },  // TRAIL_R TID 1
+                { { 0x00, 0x01 }, OTHER, 1 },  // TRAIL_N TID 0 - may be referenced by TID 1
+                { { 0x00, 0x02 }, BFRAME, 1 }, // TRAIL_N TID 1
+                { { 0x26, 0x01 }, INTRA, 1 },  // IDR_W_RADL TID 0
+        };
+        int max_tid = 0;
+        for (auto const &s : seq) {
+                auto au = make_nal(s.hdr, 100);
+                ASSERT_EQUAL(s.type, rtpenc_h264_get_frame_type(au.data(), au.size(), true, &max_tid));
+                ASSERT_EQUAL(s.max_tid, max_tid);
+        }
+        auto au = make_nal({ 0x00, 0x01 }, 100);
+        ASSERT_EQUAL(OTHER, rtpenc_h264_get_frame_type(au.data(), au.size(), true, nullptr));
+        return 0;
+}
+
+#ifdef HAVE_SHM_BUS
+/**
+ * Publishes frames to the shared-memory bus and reads them with two readers
+ * checking that a referenced slot is not reused by the writer and that a
+ * closed segment is reported.
+ */
+int misc_test_shm_bus()
+{
+        const char *name = "ug_misc_test_shm_bus";
+        struct video_desc desc{ 64, 4, UYVY, 30, PROGRESSIVE, 1 };
+        struct shm_bus *w = shm_bus_create(name, 3, desc);
+        ASSERT(w != nullptr);
+        struct shm_bus *r1 = shm_bus_open(name);
+        struct shm_bus *r2 = shm_bus_open(name);
+        ASSERT(r1 != nullptr && r2 != nullptr);
+        uint32_t seq1 = 0;
+        uint32_t seq2 = 0;
+        ASSERT_EQUAL(SHM_BUS_TIMEOUT, shm_bus_wait(r1, &seq1, 1));
+
+        struct video_frame *src = vf_alloc_desc_data(desc);
+        auto publish = [&](char val) {
+                int slot = shm_bus_acquire_write(w);
+                if (slot >= 0) {
+                        memset(src->tiles[0].data, val, src->tiles[0].data_len);
+                        src->seq = val;
+                        shm_bus_publish(w, slot, src); // copied
+                }
+                return slot;
+        };
+        ASSERT(publish(1) >= 0);
+        int slot1 = shm_bus_wait(r1, &seq1, 10);
+        int slot2 = shm_bus_wait(r2, &seq2, 10);
+        ASSERT(slot1 >= 0 && slot1 == slot2);
+        struct video_frame *f1 = shm_bus_take_frame(r1, slot1);
+        struct video_frame *f2 = shm_bus_take_frame(r2, slot2);
+        ASSERT(video_desc_eq(video_desc_from_frame(f1), desc));
+        ASSERT_EQUAL(1U, f1->seq);
+        ASSERT_EQUAL(src->tiles[0].data_len, f1->tiles[0].data_len);
+        ASSERT_EQUAL(1, f2->tiles[0].data[f2->tiles[0].data_len - 1]);
+        ASSERT_EQUAL(SHM_BUS_TIMEOUT, shm_bus_wait(r1, &seq1, 1)); // nothing new
+
+        // the slot held by the readers and the latest one are never claimed
+        for (char i = 2; i < 10; ++i) {
+                int slot = publish(i);
+                ASSERT(slot >= 0 && slot != slot1);
+        }
+        ASSERT_EQUAL(1, f1->tiles[0].data[0]);
+        ASSERT_EQUAL(1, f2->tiles[0].data[0]);
+        int latest = shm_bus_wait(r1, &seq1, 10);
+        ASSERT(latest >= 0 && latest != slot1);
+        struct video_frame *f3 = shm_bus_take_frame(r1, latest);
+        ASSERT_EQUAL(9U, f3->seq);
+        // 3 slots: one held by f1+f2, one by f3 (latest), the last one claimed
+        int spare = shm_bus_acquire_write(w);
+        ASSERT(spare >= 0 && spare != slot1 && spare != latest);
+        ASSERT_EQUAL(-1, shm_bus_acquire_write(w));
+        VIDEO_FRAME_DISPOSE(f1);
+        ASSERT_EQUAL(-1, shm_bus_acquire_write(w));
+        VIDEO_FRAME_DISPOSE(f2);
+        int slot = shm_bus_acquire_write(w);
+        ASSERT_EQUAL(slot1, slot);
+        shm_bus_abort_write(w, slot);
+        shm_bus_abort_write(w, spare);
+
+        shm_bus_destroy(w);
+        ASSERT_EQUAL(SHM_BUS_CLOSED, shm_bus_wait(r2, &seq2, 10));
+        ASSERT(shm_bus_is_stale(r1));
+        shm_bus_destroy(r1);
+        ASSERT_EQUAL(9, f3->tiles[0].data[0]); // mapping kept until disposed
+        VIDEO_FRAME_DISPOSE(f3);
+        shm_bus_destroy(r2);
+        ASSERT(shm_bus_open(name) == nullptr);
+        vf_free(src);
+        return 0;
+}
+#else
+int misc_test_shm_bus()
+{
+        return 1;
+}
+#endif // defined HAVE_SHM_BUS
+
+/**
+ * Checks that jobs go to the GPU least loaded by all owners, that the
+ * per-owner depth is respected and that acquire blocks until a release.
+ */
+int misc_test_gpu_scheduler()
+{
+        auto &sched = gpu_scheduler::get_instance();
+        const unsigned int devices[] = { 100, 101 };
+        int a = 0;
+        int b = 0;
+
+        ASSERT_EQUAL(0, sched.acquire(&a, devices, 2));
+        ASSERT_EQUAL(1, sched.acquire(&b, devices, 2)); // device 100 loaded by a
+        ASSERT_EQUAL(0, sched.acquire(&b, devices, 2)); // tie, b has less on 100
+        ASSERT_EQUAL(2, (int) sched.get_load(100));
+        ASSERT_EQUAL(1, sched.acquire(&a, devices, 2, 1)); // a is at depth on 100
+
+        std::thread t([&] { sched.acquire(&a, devices, 2, 1); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ASSERT_EQUAL(2, (int) sched.get_load(101)); // still blocked
+        sched.release(&a, 100);
+        t.join();
+        ASSERT_EQUAL(2, (int) sched.get_load(100));
+
+        sched.release(&a, 100);
+        sched.release(&a, 101);
+        sched.release(&b, 100);
+        sched.release(&b, 101);
+        sched.release(&b, 101); // not acquired - ignored
+        ASSERT_EQUAL(0, (int) sched.get_load(100));
+        ASSERT_EQUAL(0, (int) sched.get_load(101));
+        return 0;
+}
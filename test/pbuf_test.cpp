@@ -0,0 +1,369 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "host.h"
+#include "rtp/pbuf.h"
+#include "rtp/rtp.h"
+#include "tv.h"
+#include "unit_common.h"
+
+extern "C" {
+        int pbuf_test_insert_reordered();
+        int pbuf_test_nack();
+        int pbuf_test_adaptive_delay();
+        int pbuf_test_adaptive_miss_target();
+        int pbuf_test_next_deadline();
+        int pbuf_test_sender_time();
+        int pbuf_test_decode_partial();
+}
+
+using std::vector;
+
+static rtp_packet *alloc_pkt(uint32_t ts, uint16_t seq, bool m)
+{
+        auto *pkt = static_cast<rtp_packet *>(calloc(1, sizeof(rtp_packet)));
+        pkt->ts = ts;
+        pkt->seq = seq;
+        pkt->m = m;
+        return pkt;
+}
+
+static int collect_seqnos(struct coded_data *cdata, void *data, struct pbuf_stats *)
+{
+        auto *seqnos = static_cast<vector<uint16_t> *>(data);
+        for ( ; cdata != nullptr; cdata = cdata->nxt) {
+                seqnos->push_back(cdata->seqno);
+        }
+        return 1;
+}
+
+/**
+ * Inserts a frame with reordered and duplicated packets (seqno wrapping
+ * around) and checks that the decoder gets each packet once in descending
+ * order - for both the list and the ring variant.
+ */
+static int check_insert_reordered()
+{
+        struct pbuf *buf = pbuf_init(nullptr);
+        ASSERT(buf != nullptr);
+        pbuf_set_playout_delay(buf, 0);
+
+        const vector<uint16_t> order = { 65534, 65535, 1, 0, 0, 2, 3 };
+        for (auto seq : order) {
+                pbuf_insert(buf, alloc_pkt(1000, seq, seq == 3));
+        }
+        pbuf_insert(buf, alloc_pkt(900, 65533, false)); // older than any frame - discarded
+        pbuf_insert(buf, alloc_pkt(2000, 4, false)); // next frame
+
+        vector<uint16_t> seqnos;
+        time_ns_t now = get_time_in_ns() + 10 * NS_IN_SEC;
+        ASSERT_EQUAL(1, pbuf_decode(buf, now, collect_seqnos, &seqnos));
+        const vector<uint16_t> expected = { 3, 2, 1, 0, 65535, 65534 };
+        ASSERT(seqnos == expected);
+
+        // the second frame is complete only after it times out
+        seqnos.clear();
+        ASSERT_EQUAL(0, pbuf_decode(buf, now, collect_seqnos, &seqnos));
+        ASSERT_EQUAL(1, pbuf_decode(buf, now + 2 * NS_IN_SEC, collect_seqnos, &seqnos));
+        ASSERT(seqnos == vector<uint16_t>{ 4 });
+
+        pbuf_remove(buf, now + 10 * NS_IN_SEC);
+        ASSERT(pbuf_is_empty(buf));
+        pbuf_destroy(buf);
+        return 0;
+}
+
+int pbuf_test_insert_reordered()
+{
+        int ret = check_insert_reordered();
+        if (ret != 0) {
+                return ret;
+        }
+        set_commandline_param("pbuf-ring", "2");
+        ret = check_insert_reordered();
+        commandline_params.erase("pbuf-ring");
+        return ret;
+}
+
+/**
+ * Checks that lost packets are reported for NACK in ascending order, are
+ * not reported once they arrive late and are given up after the playout
+ * delay.
+ */
+int pbuf_test_nack()
+{
+        struct pbuf *buf = pbuf_init(nullptr);
+        ASSERT(buf != nullptr);
+        pbuf_set_playout_delay(buf, 0.1);
+        uint16_t lost[16];
+        time_ns_t start = get_time_in_ns();
+        ASSERT_EQUAL(0, pbuf_get_nacks(buf, start, lost, 16)); // enables tracking
+
+        for (auto seq : { 65534, 65535, 2, 5 }) {
+                pbuf_insert(buf, alloc_pkt(1000, seq, seq == 5));
+        }
+        time_ns_t now = get_time_in_ns() + 2 * NS_IN_SEC / 1000;
+        ASSERT_EQUAL(4, pbuf_get_nacks(buf, now, lost, 16));
+        ASSERT(vector<uint16_t>(lost, lost + 4) == (vector<uint16_t>{ 0, 1, 3, 4 }));
+        ASSERT_EQUAL(0, pbuf_get_nacks(buf, now, lost, 16)); // retry not yet due
+
+        pbuf_insert(buf, alloc_pkt(1000, 1, false)); // retransmitted
+        now += 30 * NS_IN_SEC / 1000;
+        ASSERT_EQUAL(3, pbuf_get_nacks(buf, now, lost, 16));
+        ASSERT(vector<uint16_t>(lost, lost + 3) == (vector<uint16_t>{ 0, 3, 4 }));
+
+        ASSERT_EQUAL(0, pbuf_get_nacks(buf, start + NS_IN_SEC, lost, 16));
+        pbuf_remove(buf, start + 10 * NS_IN_SEC);
+        pbuf_destroy(buf);
+        return 0;
+}
+
+static int collect_stretch(struct coded_data *, void *data, struct pbuf_stats *stats)
+{
+        static_cast<vector<double> *>(data)->push_back(stats->playout_stretch);
+        return 1;
+}
+
+/**
+ * Feeds 2 ms audio frames first regularly and then in bursts and checks that
+ * the adaptive delay grows with the jitter, stays in bounds and that the
+ * frames are stretched only by the allowed ratios.
+ */
+int pbuf_test_adaptive_delay()
+{
+        struct pbuf *buf = pbuf_init(nullptr);
+        ASSERT(buf != nullptr);
+        pbuf_set_playout_delay(buf, 0);
+        pbuf_set_adaptive_delay(buf, 90000, 0.002, 0.1);
+
+        uint32_t ts = 0;
+        uint16_t seq = 0;
+        for (int i = 0; i < 50; ++i) {
+                pbuf_insert(buf, alloc_pkt(ts += 180, seq++, true));
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        double regular_delay = pbuf_get_playout_delay(buf);
+        ASSERT(regular_delay >= 0.002);
+
+        for (int i = 0; i < 50; ++i) { // bursts of 5 frames every 10 ms
+                pbuf_insert(buf, alloc_pkt(ts += 180, seq++, true));
+                if (i % 5 == 4) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+        }
+        double bursty_delay = pbuf_get_playout_delay(buf);
+        ASSERT(bursty_delay > regular_delay + 0.005);
+        ASSERT(bursty_delay <= 0.1);
+
+        vector<double> stretch;
+        time_ns_t now = get_time_in_ns() + 10 * NS_IN_SEC;
+        while (pbuf_decode(buf, now, collect_stretch, &stretch)) {
+        }
+        ASSERT_EQUAL(100, (int) stretch.size());
+        for (double s : stretch) {
+                ASSERT(s == 1.0 || (s > 0.99 && s < 1.02));
+        }
+
+        pbuf_remove(buf, now + 10 * NS_IN_SEC);
+        ASSERT(pbuf_is_empty(buf));
+        pbuf_destroy(buf);
+        return 0;
+}
+
+static int count_frames(struct coded_data *, void *data, struct pbuf_stats *)
+{
+        *static_cast<int *>(data) += 1;
+        return 1;
+}
+
+/**
+ * Feeds 30 fps video frames of 2 packets arriving 10 ms apart, every 4th
+ * frame delayed by delay_ns, decoding them in the (simulated) real time.
+ */
+static void feed_video_frames(struct pbuf *buf, int count, long long delay_ns, time_ns_t *t, uint32_t *ts,
+                uint16_t *seq, vector<double> *stretch)
+{
+        const long long frame_ns = NS_IN_SEC / 30;
+        for (int i = 0; i < count; ++i) {
+                *t += frame_ns;
+                *ts += 3000;
+                time_ns_t arrival = *t + (i % 4 == 3 ? delay_ns : 0);
+                rtp_packet *first = alloc_pkt(*ts, (*seq)++, false);
+                rtp_packet *last = alloc_pkt(*ts, (*seq)++, true);
+                first->arrival_ns = arrival;
+                last->arrival_ns = arrival + 10 * NS_IN_MS;
+                pbuf_insert(buf, first);
+                pbuf_insert(buf, last);
+                while (pbuf_decode(buf, arrival + 10 * NS_IN_MS, collect_stretch, stretch)) {
+                }
+                pbuf_remove(buf, arrival);
+        }
+}
+
+/**
+ * Checks that the adaptive video playout delay covers the frame arrival
+ * spread on a regular stream, grows when the frames would be late and
+ * decreases again when the jitter disappears.
+ */
+int pbuf_test_adaptive_miss_target()
+{
+        struct pbuf *buf = pbuf_init(nullptr);
+        ASSERT(buf != nullptr);
+        pbuf_set_playout_delay(buf, 1.0 / 30);
+        pbuf_set_adaptive_delay(buf, 90000, 0.001, 0.5);
+        pbuf_set_adaptive_miss_target(buf, 0.01);
+
+        time_ns_t t = get_time_in_ns();
+        uint32_t ts = 0;
+        uint16_t seq = 0;
+        vector<double> stretch;
+        feed_video_frames(buf, 300, 0, &t, &ts, &seq, &stretch);
+        double regular_delay = pbuf_get_playout_delay(buf);
+        ASSERT(regular_delay >= 0.011 && regular_delay < 0.015);
+
+        feed_video_frames(buf, 600, 30 * NS_IN_MS, &t, &ts, &seq, &stretch);
+        double jittery_delay = pbuf_get_playout_delay(buf);
+        ASSERT(jittery_delay >= 0.041 && jittery_delay < 0.1);
+
+        feed_video_frames(buf, 600, 0, &t, &ts, &seq, &stretch);
+        ASSERT(pbuf_get_playout_delay(buf) < jittery_delay - 0.01);
+
+        while (pbuf_decode(buf, t + 10 * NS_IN_SEC, collect_stretch, &stretch)) {
+        }
+        ASSERT_EQUAL(1500, (int) stretch.size());
+        for (double s : stretch) {
+                ASSERT(s == 0.0 || s == 2.0 || (s > 0.99 && s < 1.02));
+        }
+        pbuf_remove(buf, t + 20 * NS_IN_SEC);
+        ASSERT(pbuf_is_empty(buf));
+        pbuf_destroy(buf);
+        return 0;
+}
+
+/**
+ * Checks that the deadline of a complete frame is its playout time, then
+ * its deletion time once decoded, and that the deadline of an incomplete
+ * frame past its playout time is the time when it is given up waiting for.
+ */
+int pbuf_test_next_deadline()
+{
+        struct pbuf *buf = pbuf_init(nullptr);
+        ASSERT(buf != nullptr);
+        pbuf_set_playout_delay(buf, 0.1);
+        ASSERT_EQUAL(LLONG_MAX, pbuf_next_deadline(buf, get_time_in_ns()));
+
+        time_ns_t before = get_time_in_ns();
+        pbuf_insert(buf, alloc_pkt(1000, 0, true));
+        time_ns_t deadline = pbuf_next_deadline(buf, get_time_in_ns());
+        ASSERT(deadline > before + NS_IN_SEC / 10 && deadline <= get_time_in_ns() + NS_IN_SEC / 10 + 1);
+        int frames = 0;
+        ASSERT_EQUAL(0, pbuf_decode(buf, deadline - 1, count_frames, &frames));
+        ASSERT_EQUAL(1, pbuf_decode(buf, deadline, count_frames, &frames));
+        time_ns_t deletion = pbuf_next_deadline(buf, deadline);
+        ASSERT_EQUAL(deadline + NS_IN_SEC / 10, deletion);
+        pbuf_remove(buf, deletion);
+        ASSERT(pbuf_is_empty(buf));
+
+        pbuf_insert(buf, alloc_pkt(2000, 1, false)); // incomplete
+        deadline = pbuf_next_deadline(buf, get_time_in_ns());
+        ASSERT_EQUAL(0, pbuf_decode(buf, deadline, count_frames, &frames));
+        ASSERT_EQUAL(deadline + NS_IN_SEC, pbuf_next_deadline(buf, deadline));
+        ASSERT_EQUAL(1, frames);
+
+        pbuf_remove(buf, deadline + 10 * NS_IN_SEC);
+        pbuf_destroy(buf);
+        return 0;
+}
+
+static int collect_sender_time(struct coded_data *, void *data, struct pbuf_stats *stats)
+{
+        static_cast<vector<time_ns_t> *>(data)->push_back(stats->sender_time);
+        return 1;
+}
+
+/**
+ * Checks that frames get the sender time mapped from their RTP timestamps
+ * (also across the timestamp wrap-around) once the sender clock is set.
+ */
+int pbuf_test_sender_time()
+{
+        struct pbuf *buf = pbuf_init(nullptr);
+        ASSERT(buf != nullptr);
+        pbuf_set_playout_delay(buf, 0);
+
+        vector<time_ns_t> times;
+        time_ns_t now = get_time_in_ns() + 10 * NS_IN_SEC;
+        pbuf_insert(buf, alloc_pkt(1000, 0, true));
+        ASSERT_EQUAL(1, pbuf_decode(buf, now, collect_sender_time, &times));
+        ASSERT_EQUAL(0, times.at(0)); // unknown yet
+
+        const time_ns_t sr_time = 1'000 * NS_IN_SEC;
+        pbuf_set_sender_clock(buf, sr_time, UINT32_MAX - 89999, 90000);
+        pbuf_insert(buf, alloc_pkt(8100, 1, true)); // the SR was sent before the wrap-around
+        pbuf_insert(buf, alloc_pkt(18000, 2, true));
+        while (pbuf_decode(buf, now, collect_sender_time, &times)) {
+        }
+        ASSERT_EQUAL(3, (int) times.size());
+        ASSERT_EQUAL(sr_time + 1090 * NS_IN_MS, times.at(1));
+        ASSERT_EQUAL(sr_time + 1200 * NS_IN_MS, times.at(2));
+
+        pbuf_remove(buf, now + 10 * NS_IN_SEC);
+        pbuf_destroy(buf);
+        return 0;
+}
+
+static int check_decode_partial()
+{
+        struct pbuf *buf = pbuf_init(nullptr);
+        ASSERT(buf != nullptr);
+        pbuf_set_playout_delay(buf, 0.1);
+
+        vector<uint16_t> seqnos;
+        ASSERT_EQUAL(0, pbuf_decode_partial(buf, collect_seqnos, &seqnos));
+        pbuf_insert(buf, alloc_pkt(1000, 0, false));
+        pbuf_insert(buf, alloc_pkt(1000, 1, false));
+        ASSERT_EQUAL(1, pbuf_decode_partial(buf, collect_seqnos, &seqnos));
+        ASSERT_EQUAL(2, (int) seqnos.size());
+        ASSERT_EQUAL(0, pbuf_decode_partial(buf, collect_seqnos, &seqnos)); // nothing new
+
+        seqnos.clear();
+        pbuf_insert(buf, alloc_pkt(1000, 2, true));
+        ASSERT_EQUAL(1, pbuf_decode_partial(buf, collect_seqnos, &seqnos));
+        ASSERT(seqnos == vector<uint16_t>{ 2 });
+
+        seqnos.clear();
+        time_ns_t now = get_time_in_ns() + 10 * NS_IN_SEC;
+        ASSERT_EQUAL(1, pbuf_decode(buf, now, collect_seqnos, &seqnos));
+        ASSERT(seqnos == (vector<uint16_t>{ 2, 1, 0 }));
+        ASSERT_EQUAL(0, pbuf_decode_partial(buf, collect_seqnos, &seqnos)); // decoded already
+
+        pbuf_remove(buf, now + 10 * NS_IN_SEC);
+        pbuf_destroy(buf);
+        return 0;
+}
+
+/**
+ * Checks that pbuf_decode_partial() passes only the packets received since
+ * its previous call and that pbuf_decode() gets the whole frame afterwards.
+ */
+int pbuf_test_decode_partial()
+{
+        int ret = check_decode_partial();
+        if (ret != 0) {
+                return ret;
+        }
+        set_commandline_param("pbuf-ring", "2");
+        ret = check_decode_partial();
+        commandline_params.erase("pbuf-ring");
+        return ret;
+}
@@ -75,19 +75,69 @@ long packet_rate = 13600;
 #define DEFINE_QUIET_TEST(func) { #func, func, true } // original tests that print status by itselves
 #define DEFINE_TEST(func) { #func, func, false }
 
+DECLARE_TEST(codec_conversion_test_packed_line_converters);
+DECLARE_TEST(codec_conversion_test_rgba_shifts);
 DECLARE_TEST(codec_conversion_test_testcard_uyvy_to_i420);
 DECLARE_TEST(ff_codec_conversions_test_yuv444pXXle_from_to_r10k);
 DECLARE_TEST(ff_codec_conversions_test_yuv444pXXle_from_to_r12l);
 DECLARE_TEST(ff_codec_conversions_test_yuv444p16le_from_to_rg48);
 DECLARE_TEST(ff_codec_conversions_test_yuv444p16le_from_to_rg48_out_of_range);
 DECLARE_TEST(ff_codec_conversions_test_pX10_from_to_v210);
+DECLARE_TEST(ff_codec_conversions_test_simd_equivalence);
 DECLARE_TEST(get_framerate_test_2997);
 DECLARE_TEST(get_framerate_test_3000);
 DECLARE_TEST(get_framerate_test_free);
+DECLARE_TEST(gf256_test_addmul);
+DECLARE_TEST(gf256_test_erasure_roundtrip);
 DECLARE_TEST(gpujpeg_test_simple);
+DECLARE_TEST(ldgm_test_decode_losses);
 DECLARE_TEST(libavcodec_test_get_decoder_from_uv_to_uv);
+DECLARE_TEST(misc_test_abr_controller);
+DECLARE_TEST(misc_test_aes_rijndael);
+DECLARE_TEST(misc_test_audio_buffer_drift);
+DECLARE_TEST(misc_test_audio_change_bps);
+DECLARE_TEST(misc_test_audio_float_conversion);
+DECLARE_TEST(misc_test_audio_interleave);
+DECLARE_TEST(misc_test_capture_filter_fusion);
+DECLARE_TEST(misc_test_cpu_features);
+DECLARE_TEST(misc_test_crc32);
+DECLARE_TEST(misc_test_deinterlace);
+DECLARE_TEST(misc_test_fec_frame_group);
+DECLARE_TEST(misc_test_frame_copy);
+DECLARE_TEST(misc_test_frame_trace);
+DECLARE_TEST(misc_test_gpu_scheduler);
+DECLARE_TEST(misc_test_h264_depacketize);
+DECLARE_TEST(misc_test_h264_frame_type);
+DECLARE_TEST(misc_test_h264_packetize);
+DECLARE_TEST(misc_test_il_line_maps);
+DECLARE_TEST(misc_test_init_graph);
+DECLARE_TEST(misc_test_lockfree_queue_latest);
+DECLARE_TEST(misc_test_lockfree_queue_mpmc);
+DECLARE_TEST(misc_test_lut3d);
+DECLARE_TEST(misc_test_metrics);
+DECLARE_TEST(misc_test_module_mem);
+DECLARE_TEST(misc_test_module_messages);
+DECLARE_TEST(misc_test_overlay_blend);
+DECLARE_TEST(misc_test_pdb_concurrent);
+DECLARE_TEST(misc_test_queue_stats);
 DECLARE_TEST(misc_test_replace_all);
+DECLARE_TEST(misc_test_resize_yuv);
+DECLARE_TEST(misc_test_rtp_keyframe_request);
+DECLARE_TEST(misc_test_shm_bus);
+DECLARE_TEST(misc_test_udp_inject);
+DECLARE_TEST(misc_test_vf_split_view);
 DECLARE_TEST(misc_test_video_desc_io_op_symmetry);
+DECLARE_TEST(misc_test_video_frame_pool_reuse);
+DECLARE_TEST(pbuf_test_insert_reordered);
+DECLARE_TEST(pbuf_test_nack);
+DECLARE_TEST(pbuf_test_adaptive_delay);
+DECLARE_TEST(pbuf_test_adaptive_miss_target);
+DECLARE_TEST(pbuf_test_next_deadline);
+DECLARE_TEST(pbuf_test_sender_time);
+DECLARE_TEST(pbuf_test_decode_partial);
+DECLARE_TEST(st2110_test_v210_roundtrip);
+DECLARE_TEST(st2110_test_narrow_timing);
+DECLARE_TEST(worker_test_parallel_for);
 
 struct {
         const char *name;
@@ -106,19 +156,69 @@ struct {
         DEFINE_QUIET_TEST(test_video_capture),
         DEFINE_QUIET_TEST(test_video_display),
 #endif
+        DEFINE_TEST(codec_conversion_test_packed_line_converters),
+        DEFINE_TEST(codec_conversion_test_rgba_shifts),
         DEFINE_TEST(codec_conversion_test_testcard_uyvy_to_i420),
         DEFINE_TEST(ff_codec_conversions_test_yuv444pXXle_from_to_r10k),
         DEFINE_TEST(ff_codec_conversions_test_yuv444pXXle_from_to_r12l),
         DEFINE_TEST(ff_codec_conversions_test_yuv444p16le_from_to_rg48),
         DEFINE_TEST(ff_codec_conversions_test_yuv444p16le_from_to_rg48_out_of_range),
         DEFINE_TEST(ff_codec_conversions_test_pX10_from_to_v210),
+        DEFINE_TEST(ff_codec_conversions_test_simd_equivalence),
         DEFINE_TEST(get_framerate_test_2997),
         DEFINE_TEST(get_framerate_test_3000),
         DEFINE_TEST(get_framerate_test_free),
+        DEFINE_TEST(gf256_test_addmul),
+        DEFINE_TEST(gf256_test_erasure_roundtrip),
         DEFINE_TEST(gpujpeg_test_simple),
+        DEFINE_TEST(ldgm_test_decode_losses),
         DEFINE_TEST(libavcodec_test_get_decoder_from_uv_to_uv),
+        DEFINE_TEST(misc_test_abr_controller),
+        DEFINE_TEST(misc_test_aes_rijndael),
+        DEFINE_TEST(misc_test_audio_buffer_drift),
+        DEFINE_TEST(misc_test_audio_change_bps),
+        DEFINE_TEST(misc_test_audio_float_conversion),
+        DEFINE_TEST(misc_test_audio_interleave),
+        DEFINE_TEST(misc_test_capture_filter_fusion),
+        DEFINE_TEST(misc_test_cpu_features),
+        DEFINE_TEST(misc_test_crc32),
+        DEFINE_TEST(misc_test_deinterlace),
+        DEFINE_TEST(misc_test_fec_frame_group),
+        DEFINE_TEST(misc_test_frame_copy),
+        DEFINE_TEST(misc_test_frame_trace),
+        DEFINE_TEST(misc_test_gpu_scheduler),
+        DEFINE_TEST(misc_test_h264_depacketize),
+        DEFINE_TEST(misc_test_h264_frame_type),
+        DEFINE_TEST(misc_test_h264_packetize),
+        DEFINE_TEST(misc_test_il_line_maps),
+        DEFINE_TEST(misc_test_init_graph),
+        DEFINE_TEST(misc_test_lockfree_queue_latest),
+        DEFINE_TEST(misc_test_lockfree_queue_mpmc),
+        DEFINE_TEST(misc_test_lut3d),
+        DEFINE_TEST(misc_test_metrics),
+        DEFINE_TEST(misc_test_module_mem),
+        DEFINE_TEST(misc_test_module_messages),
+        DEFINE_TEST(misc_test_overlay_blend),
+        DEFINE_TEST(misc_test_pdb_concurrent),
+        DEFINE_TEST(misc_test_queue_stats),
         DEFINE_TEST(misc_test_replace_all),
+        DEFINE_TEST(misc_test_resize_yuv),
+        DEFINE_TEST(misc_test_rtp_keyframe_request),
+        DEFINE_TEST(misc_test_shm_bus),
+        DEFINE_TEST(misc_test_udp_inject),
+        DEFINE_TEST(misc_test_vf_split_view),
         DEFINE_TEST(misc_test_video_desc_io_op_symmetry),
+        DEFINE_TEST(misc_test_video_frame_pool_reuse),
+        DEFINE_TEST(pbuf_test_insert_reordered),
+        DEFINE_TEST(pbuf_test_nack),
+        DEFINE_TEST(pbuf_test_adaptive_delay),
+        DEFINE_TEST(pbuf_test_adaptive_miss_target),
+        DEFINE_TEST(pbuf_test_next_deadline),
+        DEFINE_TEST(pbuf_test_sender_time),
+        DEFINE_TEST(pbuf_test_decode_partial),
+        DEFINE_TEST(st2110_test_v210_roundtrip),
+        DEFINE_TEST(st2110_test_narrow_timing),
+        DEFINE_TEST(worker_test_parallel_for),
 };
 
 static bool test_helper(const char *name, int (*func)(), bool quiet) {
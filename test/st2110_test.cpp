@@ -0,0 +1,90 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "rtp/st2110.h"
+#include "tv.h"
+#include "unit_common.h"
+#include "video_codec.h"
+
+extern "C" {
+        int st2110_test_v210_roundtrip();
+        int st2110_test_narrow_timing();
+}
+
+using std::vector;
+
+/**
+ * Packetizes a v210 frame (width not aligned to v210 blocks so that the
+ * segments start in the middle of them), parses the packets and writes them
+ * to another frame, which must then have the same pgroups.
+ */
+int st2110_test_v210_roundtrip()
+{
+        const int width = 1000;
+        const int height = 8;
+        const int max_payload = 1400;
+        const int linesize = vc_get_linesize(width, v210);
+        const int pg_line = width / 2 * 5;
+        vector<uint32_t> src(linesize / 4 * height);
+        for (size_t i = 0; i < src.size(); ++i) {
+                src[i] = (uint32_t) rand() & 0x3FFFFFFFU;
+        }
+        vector<unsigned char> pgroups(pg_line * height);
+        for (int y = 0; y < height; ++y) {
+                st2110_pack_line(v210, pgroups.data() + y * pg_line, (const char *) src.data() + y * linesize, width);
+        }
+
+        const uint32_t ext_seq = 0x1FFFFU; // high part changes after the first packet
+        vector<st2110_pkt> pkts(1);
+        int count = st2110_packetize(pgroups.data(), width, height, v210, max_payload, ext_seq, pkts.data(), pkts.size());
+        ASSERT((size_t) count > pkts.size());
+        pkts.resize(count);
+        ASSERT_EQUAL(count, st2110_packetize(pgroups.data(), width, height, v210, max_payload, ext_seq, pkts.data(), pkts.size()));
+        ASSERT_EQUAL(pg_line * height / (max_payload - ST2110_EXT_SEQ_LEN - ST2110_MAX_SRDS * ST2110_SRD_HDR_LEN) + 1, count);
+
+        vector<uint32_t> dst(src.size());
+        size_t total = 0;
+        for (int i = 0; i < count; ++i) {
+                ASSERT(pkts[i].hdr_len + pkts[i].data_len <= max_payload);
+                ASSERT_EQUAL(i == count - 1, pkts[i].m);
+                vector<unsigned char> payload(pkts[i].hdr, pkts[i].hdr + pkts[i].hdr_len);
+                payload.insert(payload.end(), pkts[i].data, pkts[i].data + pkts[i].data_len);
+                uint16_t seq_hi = 0;
+                st2110_srd srds[ST2110_MAX_SRDS];
+                int srd_count = st2110_parse(payload.data(), payload.size(), &seq_hi, srds, ST2110_MAX_SRDS);
+                ASSERT(srd_count > 0);
+                ASSERT_EQUAL((ext_seq + i) >> 16, seq_hi);
+                ASSERT_EQUAL(-1, st2110_parse(payload.data(), payload.size() - 1, &seq_hi, srds, ST2110_MAX_SRDS));
+                for (int j = 0; j < srd_count; ++j) {
+                        ASSERT(srds[j].line < (unsigned) height && !srds[j].second_field);
+                        st2110_unpack(v210, (char *) dst.data() + srds[j].line * linesize, srds[j].data, srds[j].offset, srds[j].len);
+                        total += srds[j].len;
+                }
+        }
+        ASSERT_EQUAL((size_t) pg_line * height, total);
+
+        vector<unsigned char> pgroups_rx(pgroups.size());
+        for (int y = 0; y < height; ++y) {
+                st2110_pack_line(v210, pgroups_rx.data() + y * pg_line, (const char *) dst.data() + y * linesize, width);
+        }
+        ASSERT(pgroups == pgroups_rx);
+        return 0;
+}
+
+/// checks ST 2110-21 TRS and TRO default for 1080p50
+int st2110_test_narrow_timing()
+{
+        long long trs = 0;
+        long long tro = 0;
+        st2110_narrow_timing(1080, 50, 4320, &trs, &tro);
+        ASSERT_EQUAL(NS_IN_SEC / 50 * 1080 / 1125 / 4320, trs);
+        ASSERT_EQUAL(NS_IN_SEC / 50 * 43 / 1125, tro);
+        return 0;
+}
@@ -0,0 +1,76 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "unit_common.h"
+#include "utils/worker.h"
+
+extern "C" {
+        int worker_test_parallel_for();
+}
+
+using std::atomic;
+using std::unique_ptr;
+
+namespace {
+struct marks {
+        unique_ptr<atomic<int>[]> counts;
+        size_t count;
+        bool nested;
+};
+
+void mark(void *udata, size_t begin, size_t end)
+{
+        auto *m = static_cast<marks *>(udata);
+        if (m->nested) { // nested call must be run serially without deadlocking
+                marks inner{ unique_ptr<atomic<int>[]>(new atomic<int>[10]()), 10, false };
+                task_run_parallel_for(10, 1, mark, &inner);
+        }
+        for (size_t i = begin; i < end; ++i) {
+                m->counts[i] += 1;
+        }
+}
+
+bool run_marks(size_t count, size_t grain, bool nested)
+{
+        marks m{ unique_ptr<atomic<int>[]>(new atomic<int>[count]()), count, nested };
+        task_run_parallel_for(count, grain, mark, &m);
+        for (size_t i = 0; i < count; ++i) {
+                if (m.counts[i] != 1) {
+                        return false;
+                }
+        }
+        return true;
+}
+} // end of anonymous namespace
+
+/**
+ * Checks that every item is processed exactly once - with various grains,
+ * nested calls and concurrent callers (pool busy).
+ */
+int worker_test_parallel_for()
+{
+        ASSERT(run_marks(0, 16, false));
+        ASSERT(run_marks(5, 16, false));
+        ASSERT(run_marks(1080, 16, false));
+        ASSERT(run_marks(100003, 7, false));
+        ASSERT(run_marks(64, 1, true));
+
+        atomic<bool> ok{true};
+        auto concurrent = [&ok]() {
+                for (int i = 0; i < 20; ++i) {
+                        ok = ok && run_marks(4321, 3, false);
+                }
+        };
+        std::thread t1(concurrent), t2(concurrent);
+        t1.join();
+        t2.join();
+        ASSERT(ok);
+        return 0;
+}
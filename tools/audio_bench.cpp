@@ -0,0 +1,354 @@
+/**
+ * @file   tools/audio_bench.cpp
+ * @brief  throughput benchmark of the audio sample format conversions
+ *
+ * Built and run by "make audio-bench" (see usage() for options), links
+ * against the same objects as the unit tests. Covers the conversions from
+ * audio/utils.h used on the audio path - bit depth changes, float/int and
+ * (de)multiplexing of the interleaved channels.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "audio/utils.h"
+
+using std::cerr;
+using std::cout;
+using std::map;
+using std::ostream;
+using std::string;
+using std::vector;
+
+#define WARMUP_RUNS 2
+#define MIN_RUNS 5
+#define MAX_RUNS 10000
+#define DEFAULT_MIN_TIME 0.1 ///< s measured per conversion and channel count
+#define DEFAULT_SAMPLES 48000 ///< per channel, 1 s of 48 kHz audio
+#define DEFAULT_TOLERANCE 10 ///< % of the median time
+
+namespace {
+struct bench_opts {
+        vector<int> channels{2, 16, 64};
+        int samples = DEFAULT_SAMPLES;
+        string filter; ///< substring of the case name
+        double min_time = DEFAULT_MIN_TIME;
+        string format = "text";
+        string output;
+        string baseline;
+        double tolerance = DEFAULT_TOLERANCE;
+};
+
+struct bench_result {
+        string name;
+        int channels;
+        int iterations;
+        double median_ms;
+        double p99_ms;
+        double msamples_s; ///< all channels
+        double gb_s;
+
+        string key() const {
+                return name + ":" + std::to_string(channels);
+        }
+};
+
+/// interleaved buffers of all channels, in and out sizes in bytes per sample
+struct bench_buffers {
+        vector<char> in;
+        vector<char> out;
+        vector<char *> planes; ///< into out
+        int samples;
+        int channels;
+};
+
+struct bench_case {
+        const char *name;
+        int in_bps;
+        int out_bps;
+        std::function<void(bench_buffers &)> run;
+};
+
+void fill_random(vector<char> &data)
+{
+        std::minstd_rand gen;
+        std::generate(data.begin(), data.end(), [&] { return (char) gen(); });
+}
+
+/// floats in the <-1, 1> range for float2int
+void fill_random_float(vector<char> &data)
+{
+        std::minstd_rand gen;
+        std::uniform_real_distribution<float> dist(-1.0F, 1.0F);
+        auto *f = reinterpret_cast<float *>(data.data());
+        std::generate(f, f + data.size() / sizeof(float), [&] { return dist(gen); });
+}
+
+const bench_case cases[] = {
+        { "change_bps:2->4", 2, 4, [](bench_buffers &b) { change_bps2(b.out.data(), 4, b.in.data(), 2, b.in.size(), false); } },
+        { "change_bps:4->2", 4, 2, [](bench_buffers &b) { change_bps2(b.out.data(), 2, b.in.data(), 4, b.in.size(), false); } },
+        { "change_bps:4->2:dither", 4, 2, [](bench_buffers &b) { change_bps2(b.out.data(), 2, b.in.data(), 4, b.in.size(), true); } },
+        { "change_bps:3->4", 3, 4, [](bench_buffers &b) { change_bps2(b.out.data(), 4, b.in.data(), 3, b.in.size(), false); } },
+        { "change_bps:4->3", 4, 3, [](bench_buffers &b) { change_bps2(b.out.data(), 3, b.in.data(), 4, b.in.size(), false); } },
+        { "float2int", 4, 4, [](bench_buffers &b) { float2int(b.out.data(), b.in.data(), b.in.size()); } },
+        { "int2float", 4, 4, [](bench_buffers &b) { int2float(b.out.data(), b.in.data(), b.in.size()); } },
+        { "demux_channel:2", 2, 2, [](bench_buffers &b) {
+                for (int c = 0; c < b.channels; ++c) {
+                        demux_channel(b.planes[c], b.in.data(), 2, b.in.size(), b.channels, c);
+                } } },
+        { "demux_channel:3", 3, 3, [](bench_buffers &b) {
+                for (int c = 0; c < b.channels; ++c) {
+                        demux_channel(b.planes[c], b.in.data(), 3, b.in.size(), b.channels, c);
+                } } },
+        { "mux_channel:2", 2, 2, [](bench_buffers &b) {
+                for (int c = 0; c < b.channels; ++c) {
+                        mux_channel(b.out.data(), b.in.data() + (size_t) c * b.samples * 2, 2, b.samples * 2, b.channels, c, 1.0);
+                } } },
+        { "mux_channel:2:scale", 2, 2, [](bench_buffers &b) {
+                for (int c = 0; c < b.channels; ++c) {
+                        mux_channel(b.out.data(), b.in.data() + (size_t) c * b.samples * 2, 2, b.samples * 2, b.channels, c, 0.5);
+                } } },
+        { "interleaved2noninterleaved:2", 2, 2, [](bench_buffers &b) {
+                interleaved2noninterleaved(b.out.data(), b.in.data(), 2, b.in.size(), b.channels); } },
+        { "interleaved2noninterleaved:3", 3, 3, [](bench_buffers &b) {
+                interleaved2noninterleaved(b.out.data(), b.in.data(), 3, b.in.size(), b.channels); } },
+        { "interleaved2noninterleaved:4", 4, 4, [](bench_buffers &b) {
+                interleaved2noninterleaved(b.out.data(), b.in.data(), 4, b.in.size(), b.channels); } },
+};
+
+bench_buffers prepare(const bench_case &c, int samples, int channels)
+{
+        bench_buffers b;
+        b.samples = samples;
+        b.channels = channels;
+        b.in.resize((size_t) samples * channels * c.in_bps);
+        b.out.resize((size_t) samples * channels * c.out_bps);
+        if (strcmp(c.name, "float2int") == 0) {
+                fill_random_float(b.in);
+        } else {
+                fill_random(b.in);
+        }
+        memset(b.out.data(), 0, b.out.size()); // fault the pages in
+        for (int i = 0; i < channels; ++i) {
+                b.planes.push_back(b.out.data() + (size_t) i * samples * c.out_bps);
+        }
+        return b;
+}
+
+bench_result measure(const bench_case &c, bench_buffers &b, double min_time)
+{
+        using clock = std::chrono::steady_clock;
+        for (int i = 0; i < WARMUP_RUNS; ++i) {
+                c.run(b);
+        }
+        vector<double> samples; // s
+        double total = 0;
+        while ((total < min_time || samples.size() < MIN_RUNS) && samples.size() < MAX_RUNS) {
+                auto t0 = clock::now();
+                c.run(b);
+                double duration = std::chrono::duration<double>(clock::now() - t0).count();
+                samples.push_back(duration);
+                total += duration;
+        }
+        std::sort(samples.begin(), samples.end());
+        double median = samples.size() % 2 == 1 ? samples[samples.size() / 2]
+                : (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]) / 2;
+        double p99 = samples[std::min(samples.size() - 1, (size_t) ((samples.size() * 99 + 99) / 100) - 1)];
+        return { c.name, b.channels, (int) samples.size(), median * 1000, p99 * 1000,
+                (double) b.samples * b.channels / median / 1e6,
+                (double) (b.in.size() + b.out.size()) / median / 1e9 };
+}
+
+void print_result(ostream &out, const bench_result &r, const string &format, bool first)
+{
+        char buf[1024];
+        if (format == "json") {
+                snprintf(buf, sizeof buf, "%s{\"name\": \"%s\", \"channels\": %d, \"iterations\": %d, \"median_ms\": %.4f, "
+                                "\"p99_ms\": %.4f, \"msamples_s\": %.1f, \"gb_s\": %.3f}", first ? "" : ",\n", r.name.c_str(),
+                                r.channels, r.iterations, r.median_ms, r.p99_ms, r.msamples_s, r.gb_s);
+        } else if (format == "csv") {
+                snprintf(buf, sizeof buf, "%s%s,%d,%d,%.4f,%.4f,%.1f,%.3f\n",
+                                first ? "name,channels,iterations,median_ms,p99_ms,msamples_s,gb_s\n" : "",
+                                r.name.c_str(), r.channels, r.iterations, r.median_ms, r.p99_ms, r.msamples_s, r.gb_s);
+        } else {
+                snprintf(buf, sizeof buf, "%-30s %3d ch: median %8.3f ms, p99 %8.3f ms, %8.1f Msamples/s, %7.3f GB/s\n",
+                                r.name.c_str(), r.channels, r.median_ms, r.p99_ms, r.msamples_s, r.gb_s);
+        }
+        out << buf << std::flush;
+}
+
+/// reads the records written with --format=json (one per line)
+bool load_baseline(const string &file, map<string, bench_result> *baseline)
+{
+        std::ifstream in(file);
+        if (!in) {
+                cerr << "Cannot open baseline " << file << "\n";
+                return false;
+        }
+        const std::regex re(R"re("name": "([^"]*)", "channels": (\d+), "iterations": (\d+), "median_ms": ([0-9.]+))re");
+        string line;
+        while (getline(in, line)) {
+                std::smatch m;
+                if (!std::regex_search(line, m, re)) {
+                        continue;
+                }
+                bench_result r{ m[1], stoi(m[2]), stoi(m[3]), stod(m[4]), 0, 0, 0 };
+                (*baseline)[r.key()] = r;
+        }
+        return true;
+}
+
+void usage(const char *progname)
+{
+        printf("Benchmark of the audio sample format conversions.\n\n"
+                        "Usage:\n"
+                        "\t%s [--channels=2,16,64] [--samples=<n>] [--filter=<str>] [--min-time=<s>]\n"
+                        "\t\t[--format=text|json|csv] [--output=<file>] [--baseline=<json> [--tolerance=<%%>]]\n\n"
+                        "where\n"
+                        "\t--samples   - samples per channel in one run (default %d)\n"
+                        "\t--filter    - run only conversions whose name contains <str>\n"
+                        "\t--min-time  - measured time per conversion and channel count (default %g s)\n"
+                        "\t--baseline  - compare medians with earlier --format=json output, fail if slower by more than\n"
+                        "\t              --tolerance %% (default %d)\n\n"
+                        "Median and 99th percentile are computed from the runs after %d warm-up ones. (De)multiplexing\n"
+                        "runs process all channels. GB/s counts both bytes read and written.\n",
+                        progname, DEFAULT_SAMPLES, DEFAULT_MIN_TIME, DEFAULT_TOLERANCE, WARMUP_RUNS);
+}
+
+bool parse_opts(int argc, char *argv[], bench_opts *opts)
+{
+        for (int i = 1; i < argc; ++i) {
+                string arg = argv[i];
+                string val = arg.find('=') != string::npos ? arg.substr(arg.find('=') + 1) : "";
+                if (arg.compare(0, 11, "--channels=") == 0) {
+                        opts->channels.clear();
+                        std::istringstream iss(val);
+                        string item;
+                        while (getline(iss, item, ',')) {
+                                int ch = atoi(item.c_str());
+                                if (ch <= 0) {
+                                        cerr << "Wrong channel count: " << item << "\n";
+                                        return false;
+                                }
+                                opts->channels.push_back(ch);
+                        }
+                } else if (arg.compare(0, 10, "--samples=") == 0 && atoi(val.c_str()) > 0) {
+                        opts->samples = atoi(val.c_str());
+                } else if (arg.compare(0, 9, "--filter=") == 0) {
+                        opts->filter = val;
+                } else if (arg.compare(0, 11, "--min-time=") == 0) {
+                        opts->min_time = atof(val.c_str());
+                } else if (arg.compare(0, 9, "--format=") == 0 && (val == "text" || val == "json" || val == "csv")) {
+                        opts->format = val;
+                } else if (arg.compare(0, 9, "--output=") == 0) {
+                        opts->output = val;
+                } else if (arg.compare(0, 11, "--baseline=") == 0) {
+                        opts->baseline = val;
+                } else if (arg.compare(0, 12, "--tolerance=") == 0) {
+                        opts->tolerance = atof(val.c_str());
+                } else {
+                        return false;
+                }
+        }
+        return true;
+}
+} // end of anonymous namespace
+
+int main(int argc, char *argv[])
+{
+        bench_opts opts;
+        if (!parse_opts(argc, argv, &opts)) {
+                usage(argv[0]);
+                return argc == 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) ? 0 : 1;
+        }
+        map<string, bench_result> baseline;
+        if (!opts.baseline.empty() && !load_baseline(opts.baseline, &baseline)) {
+                return 1;
+        }
+        std::ofstream out_file;
+        if (!opts.output.empty()) {
+                out_file.open(opts.output);
+        }
+        ostream &out = opts.output.empty() ? cout : out_file;
+
+        if (opts.format == "json") {
+                out << "[\n";
+        }
+        bool first = true;
+        int regressions = 0;
+        for (const auto &c : cases) {
+                if (string(c.name).find(opts.filter) == string::npos) {
+                        continue;
+                }
+                for (int channels : opts.channels) {
+                        bench_buffers b = prepare(c, opts.samples, channels);
+                        bench_result r = measure(c, b, opts.min_time);
+                        print_result(out, r, opts.format, first);
+                        first = false;
+                        auto it = baseline.find(r.key());
+                        if (it != baseline.end() && r.median_ms > it->second.median_ms * (1 + opts.tolerance / 100)) {
+                                fprintf(stderr, "REGRESSION %s: median %.4f ms, baseline %.4f ms (+%.1f%%)\n",
+                                                r.key().c_str(), r.median_ms, it->second.median_ms,
+                                                (r.median_ms / it->second.median_ms - 1) * 100);
+                                regressions += 1;
+                        }
+                }
+        }
+        if (opts.format == "json") {
+                out << "\n]\n";
+        }
+        if (!baseline.empty()) {
+                fprintf(stderr, "%d regression(s) against %s (tolerance %g%%)\n", regressions, opts.baseline.c_str(), opts.tolerance);
+        }
+        return regressions == 0 ? 0 : 2;
+}
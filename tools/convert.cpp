@@ -1,5 +1,4 @@
 #include <cassert>
-#include <chrono>
 #include <cstring>
 #include <fstream>
 #include <iostream>
@@ -9,9 +8,6 @@
 #include "../src/config_unix.h"
 #include "../src/video_codec.h"
 
-using std::chrono::duration_cast;
-using std::chrono::high_resolution_clock;
-using std::chrono::microseconds;
 using std::cout;
 using std::cerr;
 using std::exception;
@@ -21,28 +17,6 @@ using std::stoi;
 using std::string;
 using std::vector;
 
-static void benchmark() {
-        int width = 3840;
-        int height = 2160;
-        vector<unsigned char> in(width * height * MAX_BPS + MAX_PADDING);
-        vector<unsigned char> out(width * height * MAX_BPS + MAX_PADDING);
-        for (int i = 0; i < VIDEO_CODEC_END; ++i) {
-                bool src_print = false;
-                for (int j = 0; j < VIDEO_CODEC_END; ++j) {
-                        codec_t inc = static_cast<codec_t>(i);
-                        codec_t outc = static_cast<codec_t>(j);
-                        decoder_t conv = nullptr;
-                        if ((conv = get_decoder_from_to(inc, outc)) == nullptr || i == j) {
-                                continue;
-                        }
-                        auto t0 = high_resolution_clock::now();
-                        conv(out.data(), in.data(), vc_get_linesize(width, outc) * height, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
-                        auto t1 = high_resolution_clock::now();
-                        cout << get_codec_name(inc) << "->" << get_codec_name(outc) << ": " << duration_cast<microseconds>(t1 - t0).count() / 1000.0 << " ms\n";
-                }
-        }
-}
-
 static void print_conversions() {
         for (int i = 0; i < VIDEO_CODEC_END; ++i) {
                 bool src_print = false;
@@ -65,16 +39,15 @@ int main(int argc, char *argv[]) {
                 return 0;
         }
         if (argc == 2 && string("benchmark") == argv[1]) {
-                benchmark();
-                return 0;
+                cerr << "The benchmark was replaced by \"make bench\" (bin/convert_bench) in the main build.\n";
+                return 1;
         }
         if (argc < 7) {
                 cout << "Tool to convert between UltraGrid raw pixel format with supported conversions.\n\n"
                         "Usage:\n"
-                        "\t" << argv[0] << " <width> <height> <in_codec> <out_codec> <in_file> <out_file> | benchmark | help | list-conversions\n"
+                        "\t" << argv[0] << " <width> <height> <in_codec> <out_codec> <in_file> <out_file> | help | list-conversions\n"
                         "\n"
                         "where\n"
-                        "\t" << "benchmark        - benchmark conversions\n"
                         "\t" << "help             - show this help\n"
                         "\t" << "list-conversions - prints valid conversion pairs\n";
                 return (argc == 1 || argc == 2 && string("help") == argv[1]) ? 0 : 1;
@@ -0,0 +1,584 @@
+/**
+ * @file   tools/convert_bench.cpp
+ * @brief  throughput benchmark of the pixel format conversions
+ *
+ * Built and run by "make bench" (see usage() for options), links against the
+ * same objects as the unit tests. Covers every get_decoder_from_to() pair
+ * and, if compiled with libavcodec, the conversions from/to AVFrames.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <strings.h>
+#include <vector>
+
+#include "pixfmt_conv.h"
+#include "utils/misc.h" // get_cpu_core_count
+#include "utils/parallel_conv.h"
+#include "utils/worker.h"
+#include "video_codec.h"
+#ifdef HAVE_LAVC
+#include "libavcodec/from_lavc_vid_conv.h"
+#include "libavcodec/lavc_common.h"
+#include "libavcodec/to_lavc_vid_conv.h"
+#include "libavcodec/utils.h"
+#endif
+
+using std::cerr;
+using std::cout;
+using std::map;
+using std::ostream;
+using std::string;
+using std::vector;
+
+#define WARMUP_RUNS 2
+#define MIN_RUNS 5
+#define MAX_RUNS 1000
+#define DEFAULT_MIN_TIME 0.2 ///< s measured per conversion, size and thread count
+#define DEFAULT_TOLERANCE 10 ///< % of the median time
+
+namespace {
+struct bench_size {
+        const char *name;
+        int width;
+        int height;
+};
+
+const bench_size all_sizes[] = {
+        { "1080p", 1920, 1080 },
+        { "4k", 3840, 2160 },
+        { "8k", 7680, 4320 },
+};
+
+struct bench_opts {
+        vector<bench_size> sizes{std::begin(all_sizes), std::end(all_sizes)};
+        string filter; ///< substring of "<kind>:<from>-><to>"
+        int threads = 0; ///< parallel runs, 0 - number of CPU cores, 1 - single-threaded only
+        double min_time = DEFAULT_MIN_TIME;
+        string format = "text";
+        string output;
+        string baseline;
+        double tolerance = DEFAULT_TOLERANCE;
+        bool lavc = true;
+};
+
+struct bench_result {
+        string kind; ///< pixfmt, from_lavc or to_lavc
+        string from;
+        string to;
+        int width;
+        int height;
+        int threads;
+        int iterations;
+        double median_ms;
+        double p99_ms;
+        double mpix_s;
+        double gb_s;
+
+        string key() const {
+                return kind + ":" + from + "->" + to + ":" + std::to_string(width) + "x" + std::to_string(height)
+                        + ":" + std::to_string(threads);
+        }
+};
+
+/**
+ * A conversion to be benchmarked - reset() prepares the buffers for the
+ * size, run() converts one frame.
+ */
+struct bench_case {
+        string kind;
+        string from;
+        string to;
+        virtual ~bench_case() = default;
+        virtual bool reset(int width, int height, int threads) = 0;
+        virtual void run() = 0;
+        virtual size_t bytes() const = 0; ///< read + written per frame
+        virtual void release() = 0; ///< frees the buffers
+};
+
+/// fills the buffer with a repeated block of random data (faster than generating all)
+void fill_random(unsigned char *data, size_t len)
+{
+        static const vector<unsigned char> pattern = [] {
+                vector<unsigned char> p(64 * 1024 + 1); // odd length to avoid alignment with lines
+                std::minstd_rand gen;
+                std::generate(p.begin(), p.end(), [&] { return gen() & 0xFFU; });
+                return p;
+        }();
+        for (size_t pos = 0; pos < len; pos += pattern.size()) {
+                memcpy(data + pos, pattern.data(), std::min(pattern.size(), len - pos));
+        }
+}
+
+struct pixfmt_case : public bench_case {
+        pixfmt_case(codec_t i, codec_t o, decoder_t d) : in_codec(i), out_codec(o), dec(d) {
+                kind = "pixfmt";
+                from = get_codec_name(i);
+                to = get_codec_name(o);
+        }
+        bool reset(int w, int h, int t) override {
+                height = h;
+                threads = t;
+                in_linesize = vc_get_linesize(w, in_codec);
+                out_linesize = vc_get_linesize(w, out_codec);
+                in.resize((size_t) in_linesize * h + MAX_PADDING);
+                out.resize((size_t) out_linesize * h + MAX_PADDING);
+                fill_random(in.data(), in.size());
+                memset(out.data(), 0, out.size()); // fault the pages in
+                return true;
+        }
+        void run() override {
+                parallel_pix_conv(height, (char *) out.data(), out_linesize, (const char *) in.data(), in_linesize, dec, threads);
+        }
+        size_t bytes() const override {
+                return (size_t) (in_linesize + out_linesize) * height;
+        }
+        void release() override {
+                in = {};
+                out = {};
+        }
+
+        codec_t in_codec, out_codec;
+        decoder_t dec;
+        int height = 0, threads = 1;
+        int in_linesize = 0, out_linesize = 0;
+        vector<unsigned char> in, out;
+};
+
+#ifdef HAVE_LAVC
+size_t av_plane_len(const AVFrame *frame, int plane)
+{
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((enum AVPixelFormat) frame->format);
+        int h = plane == 0 || plane == 3 ? frame->height : AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h);
+        return (size_t) frame->linesize[plane] * h;
+}
+
+size_t av_frame_data_len(const AVFrame *frame)
+{
+        size_t len = 0;
+        for (int plane = 0; plane < AV_NUM_DATA_POINTERS && frame->data[plane] != nullptr; ++plane) {
+                len += av_plane_len(frame, plane);
+        }
+        return len;
+}
+
+struct from_lavc_part {
+        const av_to_uv_convert_t *convert;
+        char *dst;
+        AVFrame frame;
+        int width;
+        int height;
+        int pitch;
+};
+
+void *from_lavc_part_convert(void *arg)
+{
+        auto *p = static_cast<from_lavc_part *>(arg);
+        int rgb_shift[] = { DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT };
+        av_to_uv_convert(p->convert, p->dst, &p->frame, p->width, p->height, p->pitch, rgb_shift);
+        return nullptr;
+}
+
+/// parallel runs split the frame into horizontal bands as the libavcodec decompress does
+struct from_lavc_case : public bench_case {
+        from_lavc_case(enum AVPixelFormat i, codec_t o, av_to_uv_convert_t c) : in_fmt(i), out_codec(o), conv(c) {
+                kind = "from_lavc";
+                from = av_get_pix_fmt_name(i);
+                to = get_codec_name(o);
+        }
+        ~from_lavc_case() override {
+                av_frame_free(&frame);
+        }
+        bool reset(int w, int h, int t) override {
+                av_frame_free(&frame);
+                frame = av_frame_alloc();
+                if (frame == nullptr) {
+                        return false;
+                }
+                frame->format = in_fmt;
+                frame->width = w;
+                frame->height = h;
+                if (av_frame_get_buffer(frame, 0) != 0) {
+                        return false;
+                }
+                for (int plane = 0; plane < AV_NUM_DATA_POINTERS && frame->data[plane] != nullptr; ++plane) {
+                        fill_random(frame->data[plane], av_plane_len(frame, plane));
+                }
+                pitch = vc_get_linesize(w, out_codec);
+                out.resize(vc_get_datalen(w, h, out_codec) + MAX_PADDING);
+                memset(out.data(), 0, out.size());
+                in_len = av_frame_data_len(frame);
+
+                int parts_count = t <= 1 ? 1 : std::min(t, h / 2);
+                const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(in_fmt);
+                parts.resize(parts_count);
+                int row_height = (h / parts_count) & ~1; // needs to be even
+                for (int i = 0; i < parts_count; ++i) {
+                        from_lavc_part &p = parts[i];
+                        p = { &conv, (char *) out.data() + (size_t) i * row_height * pitch, {}, w,
+                                i == parts_count - 1 ? h - row_height * (parts_count - 1) : row_height, pitch };
+                        memcpy(p.frame.linesize, frame->linesize, sizeof frame->linesize);
+                        for (int plane = 0; plane < AV_NUM_DATA_POINTERS && frame->data[plane] != nullptr; ++plane) {
+                                int shift = plane == 0 || plane == 3 ? 0 : desc->log2_chroma_h;
+                                p.frame.data[plane] = frame->data[plane] + (((size_t) i * row_height * frame->linesize[plane]) >> shift);
+                        }
+                        p.frame.format = in_fmt;
+                        p.frame.width = w;
+                        p.frame.height = p.height;
+                }
+                return true;
+        }
+        void run() override {
+                if (parts.size() == 1) {
+                        from_lavc_part_convert(&parts[0]);
+                } else {
+                        task_run_parallel(from_lavc_part_convert, parts.size(), parts.data(), sizeof parts[0], nullptr);
+                }
+        }
+        size_t bytes() const override {
+                return in_len + (size_t) pitch * frame->height;
+        }
+        void release() override {
+                av_frame_free(&frame);
+                out = {};
+                parts = {};
+        }
+
+        enum AVPixelFormat in_fmt;
+        codec_t out_codec;
+        av_to_uv_convert_t conv;
+        AVFrame *frame = nullptr;
+        size_t in_len = 0;
+        int pitch = 0;
+        vector<unsigned char> out;
+        vector<from_lavc_part> parts;
+};
+
+struct to_lavc_case : public bench_case {
+        to_lavc_case(codec_t i, enum AVPixelFormat o) : in_codec(i), out_fmt(o) {
+                kind = "to_lavc";
+                from = get_codec_name(i);
+                to = av_get_pix_fmt_name(o);
+        }
+        ~to_lavc_case() override {
+                to_lavc_vid_conv_destroy(&conv);
+        }
+        bool reset(int w, int h, int t) override {
+                release();
+                conv = to_lavc_vid_conv_init(in_codec, w, h, out_fmt, t);
+                if (conv == nullptr) {
+                        return false;
+                }
+                in.resize(vc_get_datalen(w, h, in_codec) + MAX_PADDING);
+                fill_random(in.data(), in.size());
+                run(); // allocates the output frame
+                return out_len > 0;
+        }
+        void run() override {
+                AVFrame *out = to_lavc_vid_conv(conv, (char *) in.data());
+                if (out != nullptr && out_len == 0) {
+                        out_len = av_frame_data_len(out);
+                }
+        }
+        size_t bytes() const override {
+                return in.size() - MAX_PADDING + out_len;
+        }
+        void release() override {
+                to_lavc_vid_conv_destroy(&conv);
+                in = {};
+                out_len = 0;
+        }
+
+        codec_t in_codec;
+        enum AVPixelFormat out_fmt;
+        struct to_lavc_vid_conv *conv = nullptr;
+        vector<unsigned char> in;
+        size_t out_len = 0;
+};
+#endif // defined HAVE_LAVC
+
+vector<std::unique_ptr<bench_case>> collect_cases(const bench_opts &opts)
+{
+        vector<std::unique_ptr<bench_case>> cases;
+        for (int i = VIDEO_CODEC_NONE + 1; i < VIDEO_CODEC_END; ++i) {
+                for (int j = VIDEO_CODEC_NONE + 1; j < VIDEO_CODEC_END; ++j) {
+                        codec_t in = static_cast<codec_t>(i);
+                        codec_t out = static_cast<codec_t>(j);
+                        decoder_t dec = get_decoder_from_to(in, out);
+                        if (i != j && dec != nullptr && dec != vc_memcpy) {
+                                cases.emplace_back(new pixfmt_case(in, out, dec));
+                        }
+                }
+        }
+#ifdef HAVE_LAVC
+        if (opts.lavc) {
+                for (int i = 0; i < AV_PIX_FMT_NB; ++i) {
+                        auto av = static_cast<enum AVPixelFormat>(i);
+                        if (av_pix_fmt_desc_get(av) == nullptr || get_av_to_ug_pixfmt(av) != VIDEO_CODEC_NONE) {
+                                continue; // the mapped ones are just the pixfmt conversions
+                        }
+                        for (int j = VIDEO_CODEC_NONE + 1; j < VIDEO_CODEC_END; ++j) {
+                                auto uv = static_cast<codec_t>(j);
+                                if (is_codec_opaque(uv) || codec_is_const_size(uv)) {
+                                        continue;
+                                }
+                                av_to_uv_convert_t conv = get_av_to_uv_conversion(av, uv);
+                                if (conv.valid) {
+                                        cases.emplace_back(new from_lavc_case(av, uv, conv));
+                                }
+                        }
+                }
+                for (int i = VIDEO_CODEC_NONE + 1; i < VIDEO_CODEC_END; ++i) {
+                        auto uv = static_cast<codec_t>(i);
+                        if (is_codec_opaque(uv) || codec_is_const_size(uv) || codec_is_planar(uv)) {
+                                continue;
+                        }
+                        enum AVPixelFormat fmts[AV_PIX_FMT_NB];
+                        int count = get_available_pix_fmts(uv, { 0, 0, -1, VIDEO_CODEC_NONE }, fmts);
+                        for (int k = 0; k < count; ++k) {
+                                if (get_av_to_ug_pixfmt(fmts[k]) == VIDEO_CODEC_NONE) {
+                                        cases.emplace_back(new to_lavc_case(uv, fmts[k]));
+                                }
+                        }
+                }
+        }
+#else
+        (void) opts;
+#endif
+        return cases;
+}
+
+bench_result measure(bench_case &c, const bench_size &size, int threads, double min_time)
+{
+        using clock = std::chrono::steady_clock;
+        for (int i = 0; i < WARMUP_RUNS; ++i) {
+                c.run();
+        }
+        vector<double> samples; // s
+        double total = 0;
+        while ((total < min_time || samples.size() < MIN_RUNS) && samples.size() < MAX_RUNS) {
+                auto t0 = clock::now();
+                c.run();
+                double duration = std::chrono::duration<double>(clock::now() - t0).count();
+                samples.push_back(duration);
+                total += duration;
+        }
+        std::sort(samples.begin(), samples.end());
+        double median = samples.size() % 2 == 1 ? samples[samples.size() / 2]
+                : (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]) / 2;
+        double p99 = samples[std::min(samples.size() - 1, (size_t) ((samples.size() * 99 + 99) / 100) - 1)];
+        return { c.kind, c.from, c.to, size.width, size.height, threads, (int) samples.size(),
+                median * 1000, p99 * 1000, (double) size.width * size.height / median / 1e6,
+                (double) c.bytes() / median / 1e9 };
+}
+
+void print_result(ostream &out, const bench_result &r, const string &format, bool first)
+{
+        char buf[1024];
+        if (format == "json") {
+                snprintf(buf, sizeof buf, "%s{\"kind\": \"%s\", \"from\": \"%s\", \"to\": \"%s\", \"width\": %d, \"height\": %d, "
+                                "\"threads\": %d, \"iterations\": %d, \"median_ms\": %.4f, \"p99_ms\": %.4f, "
+                                "\"mpix_s\": %.1f, \"gb_s\": %.3f}", first ? "" : ",\n", r.kind.c_str(), r.from.c_str(), r.to.c_str(),
+                                r.width, r.height, r.threads, r.iterations, r.median_ms, r.p99_ms, r.mpix_s, r.gb_s);
+        } else if (format == "csv") {
+                snprintf(buf, sizeof buf, "%s%s,%s,%s,%d,%d,%d,%d,%.4f,%.4f,%.1f,%.3f\n",
+                                first ? "kind,from,to,width,height,threads,iterations,median_ms,p99_ms,mpix_s,gb_s\n" : "",
+                                r.kind.c_str(), r.from.c_str(), r.to.c_str(), r.width, r.height, r.threads, r.iterations,
+                                r.median_ms, r.p99_ms, r.mpix_s, r.gb_s);
+        } else {
+                snprintf(buf, sizeof buf, "%-9s %-12s -> %-12s %5dx%-4d %3d thr: median %9.3f ms, p99 %9.3f ms, %9.1f Mpix/s, %7.3f GB/s\n",
+                                r.kind.c_str(), r.from.c_str(), r.to.c_str(), r.width, r.height, r.threads,
+                                r.median_ms, r.p99_ms, r.mpix_s, r.gb_s);
+        }
+        out << buf << std::flush;
+}
+
+/// reads the records written with --format=json (one per line)
+bool load_baseline(const string &file, map<string, bench_result> *baseline)
+{
+        std::ifstream in(file);
+        if (!in) {
+                cerr << "Cannot open baseline " << file << "\n";
+                return false;
+        }
+        const std::regex re(R"re("kind": "([^"]*)", "from": "([^"]*)", "to": "([^"]*)", "width": (\d+), "height": (\d+), "threads": (\d+), "iterations": (\d+), "median_ms": ([0-9.]+))re");
+        string line;
+        while (getline(in, line)) {
+                std::smatch m;
+                if (!std::regex_search(line, m, re)) {
+                        continue;
+                }
+                bench_result r{ m[1], m[2], m[3], stoi(m[4]), stoi(m[5]), stoi(m[6]), stoi(m[7]), stod(m[8]), 0, 0, 0 };
+                (*baseline)[r.key()] = r;
+        }
+        return true;
+}
+
+void usage(const char *progname)
+{
+        printf("Benchmark of the pixel format conversions.\n\n"
+                        "Usage:\n"
+                        "\t%s [--sizes=1080p,4k,8k] [--filter=<str>] [--threads=<n>] [--min-time=<s>]\n"
+                        "\t\t[--format=text|json|csv] [--output=<file>] [--baseline=<json> [--tolerance=<%%>]] [--no-lavc]\n\n"
+                        "where\n"
+                        "\t--filter    - run only conversions whose \"<kind>:<from>-><to>\" contains <str>\n"
+                        "\t--threads   - thread count of the parallel runs (default: CPU cores), 1 - single-threaded only\n"
+                        "\t--min-time  - measured time per conversion and size (default %g s)\n"
+                        "\t--baseline  - compare medians with earlier --format=json output, fail if slower by more than\n"
+                        "\t              --tolerance %% (default %d)\n"
+                        "\t--no-lavc   - skip conversions from/to AVFrame\n\n"
+                        "Median and 99th percentile are computed from the runs after %d warm-up ones. GB/s counts both\n"
+                        "bytes read and written.\n", progname, DEFAULT_MIN_TIME, DEFAULT_TOLERANCE, WARMUP_RUNS);
+}
+
+bool parse_opts(int argc, char *argv[], bench_opts *opts)
+{
+        for (int i = 1; i < argc; ++i) {
+                string arg = argv[i];
+                string val = arg.find('=') != string::npos ? arg.substr(arg.find('=') + 1) : "";
+                if (arg.compare(0, 8, "--sizes=") == 0) {
+                        opts->sizes.clear();
+                        std::istringstream iss(val);
+                        string item;
+                        while (getline(iss, item, ',')) {
+                                auto it = std::find_if(std::begin(all_sizes), std::end(all_sizes),
+                                                [&](const bench_size &s) { return strcasecmp(s.name, item.c_str()) == 0; });
+                                if (it == std::end(all_sizes)) {
+                                        cerr << "Unknown size: " << item << "\n";
+                                        return false;
+                                }
+                                opts->sizes.push_back(*it);
+                        }
+                } else if (arg.compare(0, 9, "--filter=") == 0) {
+                        opts->filter = val;
+                } else if (arg.compare(0, 10, "--threads=") == 0) {
+                        opts->threads = std::max(atoi(val.c_str()), 1);
+                } else if (arg.compare(0, 11, "--min-time=") == 0) {
+                        opts->min_time = atof(val.c_str());
+                } else if (arg.compare(0, 9, "--format=") == 0 && (val == "text" || val == "json" || val == "csv")) {
+                        opts->format = val;
+                } else if (arg.compare(0, 9, "--output=") == 0) {
+                        opts->output = val;
+                } else if (arg.compare(0, 11, "--baseline=") == 0) {
+                        opts->baseline = val;
+                } else if (arg.compare(0, 12, "--tolerance=") == 0) {
+                        opts->tolerance = atof(val.c_str());
+                } else if (arg == "--no-lavc") {
+                        opts->lavc = false;
+                } else {
+                        return false;
+                }
+        }
+        return true;
+}
+} // end of anonymous namespace
+
+int main(int argc, char *argv[])
+{
+        bench_opts opts;
+        if (!parse_opts(argc, argv, &opts)) {
+                usage(argv[0]);
+                return argc == 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) ? 0 : 1;
+        }
+        map<string, bench_result> baseline;
+        if (!opts.baseline.empty() && !load_baseline(opts.baseline, &baseline)) {
+                return 1;
+        }
+        std::ofstream out_file;
+        if (!opts.output.empty()) {
+                out_file.open(opts.output);
+        }
+        ostream &out = opts.output.empty() ? cout : out_file;
+
+        vector<int> thread_counts{1};
+        int parallel = opts.threads == 0 ? get_cpu_core_count() : opts.threads;
+        if (parallel > 1) {
+                thread_counts.push_back(parallel);
+        }
+
+        if (opts.format == "json") {
+                out << "[\n";
+        }
+        bool first = true;
+        int regressions = 0;
+        for (auto &c : collect_cases(opts)) {
+                if ((c->kind + ":" + c->from + "->" + c->to).find(opts.filter) == string::npos) {
+                        continue;
+                }
+                for (const auto &size : opts.sizes) {
+                        for (int threads : thread_counts) {
+                                if (!c->reset(size.width, size.height, threads)) {
+                                        cerr << "Cannot initialize " << c->kind << " " << c->from << "->" << c->to << "\n";
+                                        continue;
+                                }
+                                bench_result r = measure(*c, size, threads, opts.min_time);
+                                print_result(out, r, opts.format, first);
+                                first = false;
+                                auto it = baseline.find(r.key());
+                                if (it != baseline.end() && r.median_ms > it->second.median_ms * (1 + opts.tolerance / 100)) {
+                                        fprintf(stderr, "REGRESSION %s: median %.4f ms, baseline %.4f ms (+%.1f%%)\n",
+                                                        r.key().c_str(), r.median_ms, it->second.median_ms,
+                                                        (r.median_ms / it->second.median_ms - 1) * 100);
+                                        regressions += 1;
+                                }
+                        }
+                }
+                c->release();
+        }
+        if (opts.format == "json") {
+                out << "\n]\n";
+        }
+        if (!baseline.empty()) {
+                fprintf(stderr, "%d regression(s) against %s (tolerance %g%%)\n", regressions, opts.baseline.c_str(), opts.tolerance);
+        }
+        return regressions == 0 ? 0 : 2;
+}
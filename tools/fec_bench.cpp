@@ -0,0 +1,657 @@
+/**
+ * @file   tools/fec_bench.cpp
+ * @brief  benchmark of the video FEC schemes and selection of their parameters
+ *
+ * Built and run by "make fec-bench" (see usage() for options). Frames of the
+ * size given by the bitrate and frame rate are encoded by the actual LDGM
+ * (CPU, GPU if compiled in), RS and mult implementations, split to packets
+ * the same way as tx_send() does, dropped by a simulated loss model and
+ * decoded again. The cheapest setting recovering the frames with the target
+ * probability within the CPU budget is printed as the -f argument.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "host.h"
+#include "rtp/fec.h"
+#include "rtp/ldgm.h"
+#include "rtp/rs.h"
+#include "rtp/rtp_types.h" // fec_payload_hdr_t, video_payload_hdr_t
+#include "types.h"
+#include "utils/misc.h" // unit_evaluate
+#include "video_frame.h"
+
+using std::cerr;
+using std::map;
+using std::ostream;
+using std::shared_ptr;
+using std::string;
+using std::to_string;
+using std::unique_ptr;
+using std::vector;
+
+#define DEFAULT_BITRATE 1000000000LL
+#define DEFAULT_FPS 30
+#define DEFAULT_MTU 1500
+#define DEFAULT_LOSS 1.0 ///< %
+#define DEFAULT_TARGET 99.0 ///< % of recovered frames
+#define DEFAULT_TRIALS 500
+#define DEFAULT_CPU_BUDGET 0.5 ///< cores available to each of encoding and decoding
+#define ENCODE_RUNS 3
+#define MAX_MULT 4 ///< transmit allows more copies but they are never cheaper than FEC
+#define RS_MAX_N 255
+#define LDGM_MIN_KM 64 ///< MINIMAL_VALUE in rtp/ldgm.cpp
+#define LDGM_MAX_KM 8191 ///< 13 bits in the FEC payload header
+#define LDGM_MAX_ROW_WEIGHT 128 ///< MAX_W in ldgm/src/ldgm-session.cpp, rows have about k * c / m ones
+#define TIE_OVERHEAD 0.01 ///< wire sizes within this ratio are compared by CPU time
+#define HDRS_LEN (20 + 8 + 12) ///< IPv4 + UDP + RTP, as in tx_send_base()
+
+namespace {
+const double redundancies[] = { 0.02, 0.05, 0.1, 0.15, 0.2, 0.3, 0.5, 0.75, 1.0 }; ///< m/k
+const unsigned rs_ks[] = { 32, 64, 128, 192 };
+const unsigned ldgm_ks[] = { 256, 500, 1000, 1500, 2000 };
+const unsigned ldgm_cs[] = { 5, 6, 8 };
+
+struct bench_opts {
+        long long bitrate = DEFAULT_BITRATE;
+        double fps = DEFAULT_FPS;
+        int mtu = DEFAULT_MTU;
+        double loss = DEFAULT_LOSS;
+        double burst = 0; ///< mean length of loss bursts in packets, 0 - independent losses
+        double target = DEFAULT_TARGET;
+        int trials = DEFAULT_TRIALS;
+        double cpu_budget = DEFAULT_CPU_BUDGET;
+        vector<string> schemes{"none", "mult", "rs", "ldgm", "ldgm-gpu"};
+        unsigned seed = 1;
+        string format = "text";
+        string output;
+
+        size_t frame_size() const {
+                return bitrate / 8 / fps;
+        }
+};
+
+struct candidate {
+        string scheme; ///< none, mult, rs, ldgm or ldgm-gpu
+        unsigned k; ///< copy count for mult
+        unsigned m;
+        unsigned c;
+
+        /// @returns the corresponding -f argument
+        string fec_arg() const {
+                if (scheme == "none") {
+                        return scheme;
+                }
+                if (scheme == "mult") {
+                        return "mult:" + to_string(k);
+                }
+                if (scheme == "rs") {
+                        return "rs:" + to_string(k) + ":" + to_string(k + m);
+                }
+                return "ldgm:" + to_string(k) + ":" + to_string(m) + ":" + to_string(c);
+        }
+};
+
+struct bench_result {
+        candidate cand;
+        double wire_bytes; ///< per frame including the packet headers
+        double overhead_pct; ///< wire_bytes over those of the unprotected frame
+        int trials;
+        int recovered;
+        double encode_ms;
+        double decode_ms;
+        bool meets_target;
+        bool fits_cpu;
+        bool recommended;
+};
+
+/**
+ * Gilbert-Elliott channel losing every packet in the bad state and none in
+ * the good one, parametrized by the mean loss and the mean burst length. With
+ * burst 0 the losses are independent.
+ */
+class loss_model {
+public:
+        loss_model(double loss_pct, double burst, unsigned seed) : rng(seed), p(loss_pct / 100.0) {
+                if (burst > 0 && p < 1.0) {
+                        p_bg = 1.0 / std::max(burst, 1.0);
+                        p_gb = std::min(p * p_bg / (1.0 - p), 1.0);
+                }
+        }
+        bool lost() {
+                if (p_bg == 0) {
+                        return dist(rng) < p;
+                }
+                bad = bad ? dist(rng) >= p_bg : dist(rng) < p_gb;
+                return bad;
+        }
+
+private:
+        std::mt19937_64 rng;
+        std::uniform_real_distribution<double> dist{0.0, 1.0};
+        double p;
+        double p_gb = 0; ///< good -> bad transition probability
+        double p_bg = 0; ///< bad -> good, 0 if independent
+        bool bad = false;
+};
+
+double ms_since(std::chrono::steady_clock::time_point t0)
+{
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+/**
+ * Packet payload sizes of a frame laid out as by get_packet_sizes() in
+ * transmit.cpp - symbols start at the beginning of a packet and the ones
+ * longer than the payload are split.
+ *
+ * @param symbol_size FEC symbol size, 0 for the unprotected frames
+ */
+vector<int> packetize(int len, int symbol_size, int payload)
+{
+        vector<int> ret;
+        int symbol_offset = 0;
+        for (int pos = 0; pos < len; ) {
+                int pkt_len = payload;
+                if (symbol_size > payload) {
+                        if (symbol_size - symbol_offset <= payload) {
+                                pkt_len = symbol_size - symbol_offset;
+                                symbol_offset = 0;
+                        } else {
+                                symbol_offset += payload;
+                        }
+                } else if (symbol_size > 0) {
+                        pkt_len = payload / symbol_size * symbol_size;
+                }
+                pkt_len = std::min(pkt_len, len - pos);
+                ret.push_back(pkt_len);
+                pos += pkt_len;
+        }
+        return ret;
+}
+
+double wire_bytes(const vector<int> &pkts, int hdr_len, unsigned copies)
+{
+        double sum = 0;
+        for (int len : pkts) {
+                sum += len + hdr_len;
+        }
+        return sum * copies;
+}
+
+/**
+ * Creates the FEC state, for ldgm-gpu with the ldgm-device param set.
+ * @returns nullptr if the scheme is not available (not compiled in)
+ */
+fec *create_fec(const candidate &cand, const struct fec_desc *desc)
+{
+        bool gpu = cand.scheme == "ldgm-gpu";
+        if (gpu) {
+                set_commandline_param("ldgm-device", "GPU");
+        }
+        fec *ret = nullptr;
+        try {
+                if (desc != nullptr) { // decoder - the same way as the receiver creates it
+                        ret = fec::create_from_desc(*desc);
+                } else if (cand.scheme == "rs") {
+                        ret = new rs((to_string(cand.k) + ":" + to_string(cand.k + cand.m)).c_str());
+                } else {
+                        ret = new ldgm(cand.k, cand.m, cand.c, DEFAULT_LDGM_SEED);
+                }
+        } catch (string const &s) {
+                LOG(LOG_LEVEL_VERBOSE) << s << "\n";
+        } catch (std::exception const &e) {
+                LOG(LOG_LEVEL_VERBOSE) << e.what() << "\n";
+        } catch (...) {
+        }
+        if (gpu) {
+                commandline_params.erase("ldgm-device");
+        }
+        return ret;
+}
+
+/// @returns whether the scheme can be used at all (eg. RS needs zfec, LDGM GPU CUDA)
+bool scheme_available(const string &scheme)
+{
+        if (scheme != "rs" && scheme != "ldgm-gpu") {
+                return true;
+        }
+        candidate probe = scheme == "rs" ? candidate{ "rs", 200, 40, 0 } : candidate{ "ldgm-gpu", 256, 192, 5 };
+        unique_ptr<fec> state(create_fec(probe, nullptr));
+        return state != nullptr;
+}
+
+/**
+ * Encodes the frame and decodes it opts.trials times with packets dropped by
+ * the loss model. The trials end early once the target cannot be met.
+ *
+ * @retval false the setting is not supported by the implementation
+ */
+bool run_fec(const bench_opts &opts, const vector<char> &data, loss_model *lm, bench_result *res)
+{
+        unique_ptr<fec> encoder(create_fec(res->cand, nullptr));
+        if (!encoder) {
+                return false;
+        }
+        struct video_desc desc{1920, 1080, MJPG, opts.fps, PROGRESSIVE, 1};
+        shared_ptr<video_frame> in(vf_alloc_desc(desc), vf_free);
+        in->tiles[0].data = const_cast<char *>(data.data());
+        in->tiles[0].data_len = data.size();
+
+        vector<double> encode_ms;
+        shared_ptr<video_frame> out;
+        for (int i = 0; i < ENCODE_RUNS; ++i) {
+                out = nullptr; // free the previous output first
+                auto t0 = std::chrono::steady_clock::now();
+                out = encoder->encode(in);
+                encode_ms.push_back(ms_since(t0));
+        }
+        if (!out) {
+                return false;
+        }
+        std::sort(encode_ms.begin(), encode_ms.end());
+        res->encode_ms = encode_ms[ENCODE_RUNS / 2];
+        unique_ptr<fec> decoder(create_fec(res->cand, &out->fec_params));
+        if (!decoder) {
+                return false;
+        }
+
+        const char *encoded = out->tiles[0].data;
+        const int encoded_len = out->tiles[0].data_len;
+        const int hdr_len = HDRS_LEN + sizeof(fec_payload_hdr_t);
+        vector<int> pkts = packetize(encoded_len, out->fec_params.symbol_size, opts.mtu - hdr_len);
+        res->wire_bytes = wire_bytes(pkts, hdr_len, 1);
+
+        vector<char> received(encoded_len);
+        const int allowed_failures = opts.trials * (1.0 - opts.target / 100.0);
+        double decode_ms = 0;
+        while (res->trials < opts.trials && res->trials - res->recovered <= allowed_failures) {
+                memcpy(received.data(), encoded, encoded_len);
+                map<int, int> received_pkts; // offset -> length, as collected by the decoder
+                int pos = 0;
+                for (int len : pkts) {
+                        if (lm->lost()) {
+                                memset(received.data() + pos, 0, len);
+                        } else {
+                                received_pkts[pos] = len;
+                        }
+                        pos += len;
+                }
+                res->trials += 1;
+                if (received_pkts.empty()) { // the frame wouldn't reach the decoder at all
+                        continue;
+                }
+                char *decoded = nullptr;
+                int decoded_len = 0;
+                auto t0 = std::chrono::steady_clock::now();
+                bool ok = decoder->decode(received.data(), encoded_len, &decoded, &decoded_len, received_pkts);
+                decode_ms += ms_since(t0);
+                ok = ok && decoded_len == (int) (sizeof(video_payload_hdr_t) + data.size())
+                        && memcmp(decoded + sizeof(video_payload_hdr_t), data.data(), data.size()) == 0;
+                res->recovered += ok ? 1 : 0;
+        }
+        res->decode_ms = decode_ms / res->trials;
+        return true;
+}
+
+/// none and mult - the frame is recovered if at least one copy of every packet arrives
+void run_plain(const bench_opts &opts, size_t frame_size, loss_model *lm, bench_result *res)
+{
+        const unsigned copies = res->cand.scheme == "mult" ? res->cand.k : 1;
+        const int hdr_len = HDRS_LEN + sizeof(video_payload_hdr_t);
+        vector<int> pkts = packetize(frame_size, 0, opts.mtu - hdr_len);
+        res->wire_bytes = wire_bytes(pkts, hdr_len, copies);
+        const int allowed_failures = opts.trials * (1.0 - opts.target / 100.0);
+        while (res->trials < opts.trials && res->trials - res->recovered <= allowed_failures) {
+                bool ok = true;
+                for (size_t i = 0; i < pkts.size(); ++i) {
+                        bool received = false;
+                        for (unsigned j = 0; j < copies; ++j) { // copies are sent back-to-back
+                                received = !lm->lost() || received;
+                        }
+                        ok = ok && received;
+                }
+                res->trials += 1;
+                res->recovered += ok ? 1 : 0;
+        }
+}
+
+/// @returns candidates grouped to families with the redundancy ascending
+vector<vector<candidate>> get_families(const bench_opts &opts)
+{
+        vector<vector<candidate>> ret;
+        for (auto const &scheme : opts.schemes) {
+                if (scheme == "none") {
+                        ret.push_back({{ "none", 0, 0, 0 }});
+                } else if (scheme == "mult") {
+                        vector<candidate> family;
+                        for (unsigned copies = 2; copies <= MAX_MULT; ++copies) {
+                                family.push_back({ "mult", copies, 0, 0 });
+                        }
+                        ret.push_back(family);
+                } else if (scheme == "rs") {
+                        for (unsigned k : rs_ks) {
+                                vector<candidate> family;
+                                for (double r : redundancies) {
+                                        unsigned m = std::max<unsigned>(lround(k * r), 1);
+                                        if (k + m > RS_MAX_N) {
+                                                break;
+                                        }
+                                        if (family.empty() || family.back().m != m) {
+                                                family.push_back({ "rs", k, m, 0 });
+                                        }
+                                }
+                                ret.push_back(family);
+                        }
+                } else if (scheme == "ldgm" || scheme == "ldgm-gpu") {
+                        for (unsigned k : ldgm_ks) {
+                                for (unsigned c : ldgm_cs) {
+                                        vector<candidate> family;
+                                        for (double r : redundancies) {
+                                                unsigned m = lround(k * r);
+                                                if (m >= LDGM_MIN_KM && m <= LDGM_MAX_KM
+                                                                && k * c <= LDGM_MAX_ROW_WEIGHT * m) {
+                                                        family.push_back({ scheme, k, m, c });
+                                                }
+                                        }
+                                        ret.push_back(family);
+                                }
+                        }
+                }
+        }
+        return ret;
+}
+
+void print_result(ostream &out, const bench_opts &opts, const bench_result &r, bool first)
+{
+        double recovered_pct = r.trials > 0 ? 100.0 * r.recovered / r.trials : 0;
+        char buf[1024];
+        if (opts.format == "text") {
+                snprintf(buf, sizeof buf, "%-22s overhead %6.2f %%, recovered %d/%d (%.2f %%), encode %.3f ms, decode %.3f ms - %s\n",
+                                r.cand.fec_arg().c_str(), r.overhead_pct, r.recovered, r.trials, recovered_pct,
+                                r.encode_ms, r.decode_ms,
+                                !r.meets_target ? "below target" : !r.fits_cpu ? "too slow" : "OK");
+        } else if (opts.format == "json") {
+                snprintf(buf, sizeof buf, "%s{\"fec\": \"%s\", \"scheme\": \"%s\", \"wire_bytes\": %.0f, \"overhead_pct\": %.3f, "
+                                "\"trials\": %d, \"recovered\": %d, \"recovered_pct\": %.3f, \"encode_ms\": %.4f, "
+                                "\"decode_ms\": %.4f, \"meets_target\": %s, \"fits_cpu\": %s, \"recommended\": %s}",
+                                first ? "" : ",\n", r.cand.fec_arg().c_str(), r.cand.scheme.c_str(), r.wire_bytes,
+                                r.overhead_pct, r.trials, r.recovered, recovered_pct, r.encode_ms, r.decode_ms,
+                                r.meets_target ? "true" : "false", r.fits_cpu ? "true" : "false",
+                                r.recommended ? "true" : "false");
+        } else {
+                snprintf(buf, sizeof buf, "%s%s,%s,%.0f,%.3f,%d,%d,%.3f,%.4f,%.4f,%s,%s,%s\n",
+                                first ? "fec,scheme,wire_bytes,overhead_pct,trials,recovered,recovered_pct,"
+                                        "encode_ms,decode_ms,meets_target,fits_cpu,recommended\n" : "",
+                                r.cand.fec_arg().c_str(), r.cand.scheme.c_str(), r.wire_bytes, r.overhead_pct,
+                                r.trials, r.recovered, recovered_pct, r.encode_ms, r.decode_ms,
+                                r.meets_target ? "true" : "false", r.fits_cpu ? "true" : "false",
+                                r.recommended ? "true" : "false");
+        }
+        out << buf << std::flush;
+}
+
+vector<string> split(const string &str, char delim)
+{
+        vector<string> ret;
+        std::istringstream iss(str);
+        string item;
+        while (getline(iss, item, delim)) {
+                ret.push_back(item);
+        }
+        return ret;
+}
+
+void usage(const char *progname)
+{
+        printf("Benchmark of the video FEC schemes selecting the cheapest one for the expected loss.\n\n"
+                        "Usage:\n"
+                        "\t%s [--bitrate=<bps>] [--fps=<f>] [--mtu=<m>] [--loss=<pct>] [--burst=<pkts>]\n"
+                        "\t\t[--target=<pct>] [--trials=<n>] [--cpu=<cores>] [--schemes=<s>[,...]] [--seed=<n>]\n"
+                        "\t\t[--format=text|json|csv] [--output=<file>]\n\n"
+                        "where\n"
+                        "\t--bitrate, --fps - video bitrate (default 1G) and frame rate (default %d) giving the frame size\n"
+                        "\t--mtu            - MTU (default %d)\n"
+                        "\t--loss           - expected packet loss in percent (default %.1f)\n"
+                        "\t--burst          - mean length of the loss bursts in packets (default independent losses)\n"
+                        "\t--target         - required percentage of recovered frames (default %.1f)\n"
+                        "\t--trials         - lossy frames decoded per setting (default %d)\n"
+                        "\t--cpu            - CPU cores available to each of the encoder and the decoder\n"
+                        "\t                   (default %.1f)\n"
+                        "\t--schemes        - schemes to try out of none,mult,rs,ldgm,ldgm-gpu (default all)\n\n"
+                        "Frames of random data are encoded, packetized as by the sender, dropped by the loss model\n"
+                        "and decoded by the actual implementations. Of the settings recovering the target share\n"
+                        "of the frames with encoding and decoding fitting the CPU budget, the one with the fewest\n"
+                        "bytes on the wire (then the least CPU time) is recommended as the -f argument.\n",
+                        progname, DEFAULT_FPS, DEFAULT_MTU, DEFAULT_LOSS, DEFAULT_TARGET, DEFAULT_TRIALS,
+                        DEFAULT_CPU_BUDGET);
+}
+
+bool parse_opts(int argc, char *argv[], bench_opts *opts)
+{
+        for (int i = 1; i < argc; ++i) {
+                string arg = argv[i];
+                string val = arg.find('=') != string::npos ? arg.substr(arg.find('=') + 1) : "";
+                auto opt_is = [&](const char *name) { return arg.compare(0, strlen(name), name) == 0; };
+                if (arg == "--param") { // handled by common_preinit()
+                        i += 1;
+                } else if (opt_is("-V") || opt_is("--verbose")) {
+                        // handled by common_preinit()
+                } else if (opt_is("--bitrate=")) {
+                        opts->bitrate = unit_evaluate(val.c_str());
+                } else if (opt_is("--fps=")) {
+                        opts->fps = atof(val.c_str());
+                } else if (opt_is("--mtu=")) {
+                        opts->mtu = atoi(val.c_str());
+                } else if (opt_is("--loss=")) {
+                        opts->loss = atof(val.c_str());
+                } else if (opt_is("--burst=")) {
+                        opts->burst = atof(val.c_str());
+                } else if (opt_is("--target=")) {
+                        opts->target = atof(val.c_str());
+                } else if (opt_is("--trials=")) {
+                        opts->trials = atoi(val.c_str());
+                } else if (opt_is("--cpu=")) {
+                        opts->cpu_budget = atof(val.c_str());
+                } else if (opt_is("--schemes=")) {
+                        opts->schemes = split(val, ',');
+                } else if (opt_is("--seed=")) {
+                        opts->seed = atoi(val.c_str());
+                } else if (opt_is("--format=") && (val == "text" || val == "json" || val == "csv")) {
+                        opts->format = val;
+                } else if (opt_is("--output=")) {
+                        opts->output = val;
+                } else {
+                        return false;
+                }
+        }
+        return opts->bitrate > 0 && opts->fps > 0 && opts->mtu > HDRS_LEN + (int) sizeof(fec_payload_hdr_t)
+                && opts->loss >= 0 && opts->loss < 100 && opts->target > 0 && opts->target <= 100
+                && opts->trials > 0 && opts->cpu_budget > 0 && opts->frame_size() > 0;
+}
+} // end of anonymous namespace
+
+int main(int argc, char *argv[])
+{
+        bench_opts opts;
+        if (!parse_opts(argc, argv, &opts)) {
+                usage(argv[0]);
+                return argc == 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) ? 0 : 1;
+        }
+        log_level = LOG_LEVEL_WARNING;
+        struct init_data *init = common_preinit(argc, argv); // loads ldgm_gpu if built as a module
+        if (init == nullptr) {
+                return 2;
+        }
+
+        std::ofstream out_file;
+        if (!opts.output.empty()) {
+                out_file.open(opts.output);
+        }
+        ostream &out = opts.output.empty() ? std::cout : out_file;
+
+        const size_t frame_size = opts.frame_size();
+        vector<char> data(frame_size);
+        std::mt19937 rng(opts.seed);
+        std::generate(data.begin(), data.end(), [&] { return (char) rng(); });
+        double plain_bytes = wire_bytes(packetize(frame_size, 0, opts.mtu - HDRS_LEN - sizeof(video_payload_hdr_t)),
+                        HDRS_LEN + sizeof(video_payload_hdr_t), 1);
+        const double frame_budget_ms = opts.cpu_budget * 1000.0 / opts.fps;
+        if (opts.format == "text") {
+                out << "Frame " << frame_size << " B (" << format_in_si_units(opts.bitrate) << "bps @ " << opts.fps
+                        << " fps), MTU " << opts.mtu << ", loss " << opts.loss << " %";
+                if (opts.burst > 0) {
+                        out << " in bursts of " << opts.burst << " packets";
+                }
+                out << ", target " << opts.target << " % of frames, CPU budget " << frame_budget_ms << " ms per frame\n\n";
+        }
+
+#ifndef _WIN32
+        // the FEC implementations print to stdout, keep the JSON/CSV clean
+        int stdout_fd = -1;
+        if (opts.format != "text" && opts.output.empty()) {
+                fflush(stdout);
+                stdout_fd = dup(STDOUT_FILENO);
+                dup2(STDERR_FILENO, STDOUT_FILENO);
+        }
+#endif
+        vector<bench_result> results;
+        vector<string> schemes = opts.schemes;
+        for (auto const &scheme : opts.schemes) {
+                if (!scheme_available(scheme)) {
+                        LOG(LOG_LEVEL_WARNING) << "FEC scheme " << scheme << " is not available, skipping.\n";
+                        schemes.erase(std::find(schemes.begin(), schemes.end(), scheme));
+                }
+        }
+        bench_opts available_opts = opts;
+        available_opts.schemes = schemes;
+        for (auto const &family : get_families(available_opts)) {
+                for (auto const &cand : family) {
+                        bench_result res{};
+                        res.cand = cand;
+                        // every setting sees the same loss pattern
+                        loss_model lm(opts.loss, opts.burst, opts.seed);
+                        if (cand.scheme == "none" || cand.scheme == "mult") {
+                                run_plain(opts, frame_size, &lm, &res);
+                        } else if (!run_fec(opts, data, &lm, &res)) {
+                                LOG(LOG_LEVEL_VERBOSE) << "Setting " << cand.fec_arg() << " is not supported, skipping.\n";
+                                continue;
+                        }
+                        res.overhead_pct = 100.0 * (res.wire_bytes / plain_bytes - 1.0);
+                        res.meets_target = 100.0 * res.recovered / res.trials >= opts.target;
+                        res.fits_cpu = res.encode_ms <= frame_budget_ms && res.decode_ms <= frame_budget_ms;
+                        if (opts.format == "text") {
+                                print_result(out, opts, res, results.empty());
+                        }
+                        results.push_back(res);
+                        if (res.meets_target) { // more redundancy would be only more expensive
+                                break;
+                        }
+                }
+        }
+
+#ifndef _WIN32
+        if (stdout_fd != -1) {
+                fflush(stdout);
+                dup2(stdout_fd, STDOUT_FILENO);
+                close(stdout_fd);
+        }
+#endif
+
+        bench_result *best = nullptr;
+        for (auto &r : results) {
+                if (!r.meets_target || !r.fits_cpu) {
+                        continue;
+                }
+                if (best == nullptr || r.wire_bytes < best->wire_bytes * (1.0 - TIE_OVERHEAD)
+                                || (r.wire_bytes <= best->wire_bytes * (1.0 + TIE_OVERHEAD)
+                                        && r.encode_ms + r.decode_ms < best->encode_ms + best->decode_ms)) {
+                        best = &r;
+                }
+        }
+        if (best != nullptr) {
+                best->recommended = true;
+        }
+
+        if (opts.format == "text") {
+                if (best != nullptr) {
+                        out << "\nRecommended: -f V:" << best->cand.fec_arg() << " (overhead " << best->overhead_pct
+                                << " %)\n";
+                } else {
+                        out << "\nNo setting meets the target within the CPU budget.\n";
+                }
+        } else {
+                if (opts.format == "json") {
+                        out << "{\"frame_size\": " << frame_size << ", \"recommended\": "
+                                << (best != nullptr ? "\"" + best->cand.fec_arg() + "\"" : string("null"))
+                                << ", \"results\": [\n";
+                }
+                bool first = true;
+                for (auto const &r : results) {
+                        print_result(out, opts, r, first);
+                        first = false;
+                }
+                if (opts.format == "json") {
+                        out << "\n]}\n";
+                }
+        }
+
+        common_cleanup(init);
+        return best != nullptr ? 0 : 1;
+}
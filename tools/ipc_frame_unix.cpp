@@ -3,6 +3,8 @@
 #include <string.h>
 #include <stdio.h>
 #include <array>
+#include <atomic>
+#include <cstdint>
 #include <string>
 
 #ifndef _WIN32
@@ -11,6 +13,10 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <netinet/in.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#define IPC_FRAME_SHM 1
+#endif
 #define CLOSESOCKET close
 #define INVALID_SOCKET -1
 #define UNLINK unlink
@@ -45,6 +51,110 @@ struct Wsa_guard{
         }
         Wsa_guard& operator=(Wsa_guard&&) = delete; //Make class unmovable and uncopyable
 };
+
+/*
+ * Shared memory transport (Linux only)
+ *
+ * The writer allocates a memfd with a control block followed by
+ * SHM_SLOT_COUNT frame slots and passes the fd to the reader (SCM_RIGHTS)
+ * along with the first header that refers to it. Afterwards, only the
+ * headers are sent through the socket, the header tail carries the slot
+ * index. Slot is FREE -> WRITTEN by the writer and WRITTEN -> FREE by the
+ * reader once it has copied the data out. If there is no free slot (or the
+ * shm cannot be created), the frame is sent inline as before.
+ */
+enum : int32_t {
+        SHM_HDR_FLAGS = 64,       ///< offset of transport fields in the header
+        SHM_HDR_SLOT = 68,
+        SHM_HDR_SLOT_SIZE = 72,
+
+        SHM_FLAG_FRAME = 1 << 0,  ///< frame data is in the shm slot
+        SHM_FLAG_NEW_MAP = 1 << 1,///< message carries the new shm fd
+};
+
+constexpr uint32_t SHM_SLOT_COUNT = 4;
+constexpr uint32_t SHM_SLOT_FREE = 0;
+constexpr uint32_t SHM_SLOT_WRITTEN = 1;
+constexpr size_t SHM_CTL_SIZE = 4096;
+
+struct Shm_ctl{
+        std::atomic<uint32_t> slot_state[SHM_SLOT_COUNT];
+};
+static_assert(sizeof(Shm_ctl) <= SHM_CTL_SIZE, "shm control block too big");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shm needs lock-free atomics");
+
+struct Shm_map{
+        Shm_map() = default;
+        Shm_map(const Shm_map&) = delete;
+        Shm_map& operator=(const Shm_map&) = delete;
+        ~Shm_map(){ reset(); }
+
+        void reset(){
+#ifdef IPC_FRAME_SHM
+                if(addr)
+                        munmap(addr, map_size());
+                if(fd != -1)
+                        close(fd);
+#endif
+                addr = nullptr;
+                fd = -1;
+                slot_size = 0;
+        }
+
+        size_t map_size() const { return SHM_CTL_SIZE + SHM_SLOT_COUNT * slot_size; }
+        Shm_ctl *ctl() const { return static_cast<Shm_ctl *>(addr); }
+        char *slot(uint32_t idx) const {
+                return static_cast<char *>(addr) + SHM_CTL_SIZE + idx * slot_size;
+        }
+
+        void *addr = nullptr;
+        int fd = -1;
+        size_t slot_size = 0;
+};
+
+#ifdef IPC_FRAME_SHM
+bool shm_map_fd(Shm_map& map, int fd, size_t slot_size){
+        map.reset();
+        map.fd = fd;
+        map.slot_size = slot_size;
+        void *addr = mmap(nullptr, map.map_size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(addr == MAP_FAILED){
+                map.reset();
+                return false;
+        }
+        map.addr = addr;
+        return true;
+}
+
+bool shm_create(Shm_map& map, size_t min_slot_size){
+        const size_t page = sysconf(_SC_PAGESIZE);
+        size_t slot_size = (min_slot_size + page - 1) / page * page;
+        int fd = memfd_create("ug_ipc_frame", MFD_CLOEXEC);
+        if(fd == -1)
+                return false;
+        if(ftruncate(fd, SHM_CTL_SIZE + SHM_SLOT_COUNT * slot_size) == -1){
+                close(fd);
+                return false;
+        }
+        if(!shm_map_fd(map, fd, slot_size))
+                return false;
+        for(auto& state : map.ctl()->slot_state){
+                state.store(SHM_SLOT_FREE, std::memory_order_relaxed);
+        }
+        return true;
+}
+
+int32_t hdr_get(const char *hdr, int off){
+        int32_t val;
+        memcpy(&val, hdr + off, sizeof val);
+        return val;
+}
+
+void hdr_set(char *hdr, int off, int32_t val){
+        memcpy(hdr + off, &val, sizeof val);
+}
+#endif
+
 } //anon namespace
 
 
@@ -53,6 +163,7 @@ struct Ipc_frame_reader{
         fd_t listen_fd;
         fd_t data_fd;
         std::string path;
+        Shm_map shm;
 };
 
 Ipc_frame_reader *ipc_frame_reader_new(const char *path){
@@ -138,6 +249,7 @@ static bool try_accept(struct Ipc_frame_reader *reader){
                 return false;
 
         reader->data_fd = accept(reader->listen_fd, nullptr, 0);
+        reader->shm.reset();
         return true;
 }
 
@@ -152,11 +264,87 @@ bool ipc_frame_reader_is_connected(struct Ipc_frame_reader *reader){
         return reader->data_fd != INVALID_SOCKET || try_accept(reader);
 }
 
+#ifdef IPC_FRAME_SHM
+/**
+ * Reads the header, if a shm fd is attached, it is stored to recv_fd
+ */
+static size_t read_header(fd_t fd, char *dst, int *recv_fd){
+        size_t bytes_read = 0;
+
+        while(bytes_read < IPC_FRAME_HEADER_LEN){
+                struct iovec iov = { dst + bytes_read, IPC_FRAME_HEADER_LEN - bytes_read };
+                alignas(struct cmsghdr) char cbuf[CMSG_SPACE(sizeof(int))];
+                struct msghdr msg{};
+                msg.msg_iov = &iov;
+                msg.msg_iovlen = 1;
+                msg.msg_control = cbuf;
+                msg.msg_controllen = sizeof cbuf;
+
+                ssize_t read_now = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+                if(read_now <= 0)
+                        break;
+
+                for(auto *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)){
+                        if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS){
+                                if(*recv_fd != -1)
+                                        close(*recv_fd);
+                                memcpy(recv_fd, CMSG_DATA(c), sizeof(int));
+                        }
+                }
+
+                bytes_read += read_now;
+        }
+
+        return bytes_read;
+}
+
+static bool read_shm_frame(Ipc_frame_reader *reader, const char *header_buf,
+                int recv_fd, Ipc_frame *dst)
+{
+        int32_t flags = hdr_get(header_buf, SHM_HDR_FLAGS);
+        if(flags & SHM_FLAG_NEW_MAP){
+                int32_t slot_size = hdr_get(header_buf, SHM_HDR_SLOT_SIZE);
+                if(recv_fd == -1 || slot_size <= 0){
+                        if(recv_fd != -1)
+                                close(recv_fd);
+                        return false;
+                }
+                if(!shm_map_fd(reader->shm, recv_fd, slot_size)) // closes fd on failure
+                        return false;
+        } else if(recv_fd != -1){
+                close(recv_fd);
+        }
+
+        uint32_t slot = hdr_get(header_buf, SHM_HDR_SLOT);
+        if(!reader->shm.addr || slot >= SHM_SLOT_COUNT || dst->header.data_len < 0
+                        || (size_t) dst->header.data_len > reader->shm.slot_size)
+                return false;
+
+        auto& state = reader->shm.ctl()->slot_state[slot];
+        if(state.load(std::memory_order_acquire) != SHM_SLOT_WRITTEN)
+                return false;
+
+        memcpy(dst->data, reader->shm.slot(slot), dst->header.data_len);
+        state.store(SHM_SLOT_FREE, std::memory_order_release);
+
+        return true;
+}
+#endif
+
 static bool do_frame_read(Ipc_frame_reader *reader, Ipc_frame *dst){
         char header_buf[IPC_FRAME_HEADER_LEN];
 
+#ifdef IPC_FRAME_SHM
+        int recv_fd = -1;
+        if(read_header(reader->data_fd, header_buf, &recv_fd) != IPC_FRAME_HEADER_LEN){
+                if(recv_fd != -1)
+                        close(recv_fd);
+                return false;
+        }
+#else
         if(blocking_read(reader->data_fd, header_buf, IPC_FRAME_HEADER_LEN) != IPC_FRAME_HEADER_LEN)
                 return false;
+#endif
 
         if(!ipc_frame_parse_header(&dst->header, header_buf))
                 return false;
@@ -164,6 +352,14 @@ static bool do_frame_read(Ipc_frame_reader *reader, Ipc_frame *dst){
         if(!ipc_frame_reserve(dst, dst->header.data_len))
                 return false;
 
+#ifdef IPC_FRAME_SHM
+        if(hdr_get(header_buf, SHM_HDR_FLAGS) & SHM_FLAG_FRAME){
+                return read_shm_frame(reader, header_buf, recv_fd, dst);
+        }
+        if(recv_fd != -1)
+                close(recv_fd);
+#endif
+
         int read_data = blocking_read(reader->data_fd, dst->data, dst->header.data_len);
 
         return read_data == dst->header.data_len;
@@ -181,6 +377,9 @@ bool ipc_frame_reader_read(Ipc_frame_reader *reader, Ipc_frame *dst){
 
 struct Ipc_frame_writer{
         fd_t data_fd;
+        Shm_map shm;
+        bool shm_sent = false; ///< reader has already received shm fd
+        bool shm_failed = false;
 };
 
 Ipc_frame_writer *ipc_frame_writer_new(const char *path){
@@ -230,6 +429,68 @@ void block_write(fd_t fd, void *buf, size_t size){
         }
 }
 
+#ifdef IPC_FRAME_SHM
+/// @returns free slot index or -1 if the frame needs to be sent inline
+int shm_get_slot(Ipc_frame_writer *writer, size_t len){
+        if(writer->shm_failed)
+                return -1;
+
+        if(!writer->shm.addr || len > writer->shm.slot_size){
+                if(!shm_create(writer->shm, len)){
+                        writer->shm_failed = true;
+                        return -1;
+                }
+                writer->shm_sent = false;
+        }
+
+        for(uint32_t i = 0; i < SHM_SLOT_COUNT; i++){
+                if(writer->shm.ctl()->slot_state[i].load(std::memory_order_acquire) == SHM_SLOT_FREE)
+                        return i;
+        }
+        return -1;
+}
+
+bool shm_write(Ipc_frame_writer *writer, const Ipc_frame *f, char *header){
+        int slot = shm_get_slot(writer, f->header.data_len);
+        if(slot < 0)
+                return false;
+
+        memcpy(writer->shm.slot(slot), f->data, f->header.data_len);
+        writer->shm.ctl()->slot_state[slot].store(SHM_SLOT_WRITTEN, std::memory_order_release);
+
+        int32_t flags = SHM_FLAG_FRAME;
+        struct msghdr msg{};
+        alignas(struct cmsghdr) char cbuf[CMSG_SPACE(sizeof(int))];
+        if(!writer->shm_sent){
+                flags |= SHM_FLAG_NEW_MAP;
+                hdr_set(header, SHM_HDR_SLOT_SIZE, writer->shm.slot_size);
+                msg.msg_control = cbuf;
+                msg.msg_controllen = sizeof cbuf;
+                auto *c = CMSG_FIRSTHDR(&msg);
+                c->cmsg_level = SOL_SOCKET;
+                c->cmsg_type = SCM_RIGHTS;
+                c->cmsg_len = CMSG_LEN(sizeof(int));
+                memcpy(CMSG_DATA(c), &writer->shm.fd, sizeof(int));
+        }
+        hdr_set(header, SHM_HDR_FLAGS, flags);
+        hdr_set(header, SHM_HDR_SLOT, slot);
+
+        struct iovec iov = { header, IPC_FRAME_HEADER_LEN };
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        ssize_t ret = sendmsg(writer->data_fd, &msg, MSG_NOSIGNAL);
+        if(ret <= 0){
+                writer->shm.ctl()->slot_state[slot].store(SHM_SLOT_FREE, std::memory_order_relaxed);
+                return true; // errno set
+        }
+        writer->shm_sent = true;
+        if(ret < IPC_FRAME_HEADER_LEN)
+                block_write(writer->data_fd, header + ret, IPC_FRAME_HEADER_LEN - ret);
+
+        return true;
+}
+#endif
+
 } //anon namespace
 
 bool ipc_frame_writer_write(struct Ipc_frame_writer *writer, const struct Ipc_frame *f){
@@ -238,6 +499,10 @@ bool ipc_frame_writer_write(struct Ipc_frame_writer *writer, const struct Ipc_fr
         ipc_frame_write_header(&f->header, header.data());
 
         errno = 0;
+#ifdef IPC_FRAME_SHM
+        if(shm_write(writer, f, header.data()))
+                return errno == 0;
+#endif
         block_write(writer->data_fd, header.data(), header.size());
         block_write(writer->data_fd, f->data, f->header.data_len);
 
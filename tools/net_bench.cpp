@@ -0,0 +1,613 @@
+/**
+ * @file   tools/net_bench.cpp
+ * @brief  loopback benchmark of the video RTP sender and receiver
+ *
+ * Built and run by "make net-bench" (see usage() for options). Frames from
+ * video_pattern_generator are sent with tx_send() and received with
+ * rtp_recv_r() -> pbuf -> decode_video_frame() into the dummy display for
+ * every combination of the requested MTUs, FEC and encryption settings.
+ * Both sides run in one process over localhost by default, the tx and rx
+ * modes allow placing them eg. to the ends of a netns veth pair.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "debug.h"
+#include "host.h"
+#include "module.h"
+#include "pdb.h"
+#include "rtp/pbuf.h"
+#include "rtp/rtp.h"
+#include "rtp/rtp_callback.h"
+#include "rtp/rtp_types.h" // BUFNUM_BITS
+#include "rtp/video_decoders.h"
+#include "transmit.h"
+#include "tv.h"
+#include "types.h"
+#include "utils/metrics.h"
+#include "utils/video_pattern_generator.hpp"
+#include "video.h"
+#include "video_display.h"
+
+using std::atomic;
+using std::cerr;
+using std::ostream;
+using std::string;
+using std::vector;
+
+#define DEFAULT_PORT 15004
+#define DEFAULT_DURATION 5 ///< s per configuration
+#define DRAIN_TIME_MS 500 ///< receiving continues after the sender finished
+#define RX_IDLE_TIMEOUT_S 5 ///< rx mode ends when nothing is received for this time
+#define SEND_TIMES_RING (1 << 12) ///< frames in flight the latency is tracked for
+#define RECV_BUF_SIZE (64 * 1024 * 1024)
+#define SEND_BUF_SIZE (8 * 1024 * 1024)
+
+namespace {
+enum bench_mode { MODE_LOOPBACK, MODE_TX, MODE_RX };
+
+struct bench_opts {
+        enum bench_mode mode = MODE_LOOPBACK;
+        string addr = "localhost";
+        int port = DEFAULT_PORT;
+        struct video_desc desc{1920, 1080, UYVY, 60, PROGRESSIVE, 1};
+        string pattern = "bars";
+        double duration = DEFAULT_DURATION;
+        vector<int> mtus{1500, 9000};
+        vector<string> fecs{"none"};
+        vector<string> encryptions{"none"};
+        string format = "text";
+        string output;
+};
+
+struct bench_config {
+        int mtu;
+        string fec;
+        string encryption;
+};
+
+struct bench_result {
+        bench_config config;
+        double duration; ///< s, sender active time (rx: first to last frame)
+        long long frames_sent;
+        long long frames_received; ///< complete or timed-out out of pbuf
+        long long frames_displayed;
+        long long frames_dropped; ///< dropped or corrupted by the decoder
+        double tx_packets;
+        double tx_bytes;
+        double rx_packets;
+        double rx_expected;
+        double cpu_s; ///< whole process
+        double tx_cpu_s; ///< sending thread
+        double rx_cpu_s; ///< receiving thread (without decoder threads)
+        vector<double> latencies_ms; ///< tx_send() start to frame leaving pbuf
+};
+
+/// @returns CPU time of the process in seconds
+double process_cpu_time()
+{
+#ifndef _WIN32
+        struct rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#else
+        return 0;
+#endif
+}
+
+/// @returns CPU time of the calling thread in seconds
+double thread_cpu_time()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+        struct timespec ts{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+        return 0;
+#endif
+}
+
+double counter(const char *name, const char *fmt, uint32_t ssrc)
+{
+        char labels[128];
+        snprintf(labels, sizeof labels, fmt, ssrc);
+        return metric_value(metric_counter(name, "", labels));
+}
+
+double video_frames(const char *result)
+{
+        char labels[64];
+        snprintf(labels, sizeof labels, "result=\"%s\"", result);
+        return metric_value(metric_counter("ug_video_frames_total", "", labels));
+}
+
+/// send start times of the frames indexed by buffer ID (loopback mode only)
+struct send_times {
+        struct entry {
+                atomic<uint32_t> buffer_id{UINT32_MAX};
+                atomic<time_ns_t> time{0};
+        };
+        entry ring[SEND_TIMES_RING];
+
+        void store(uint32_t id, time_ns_t t) {
+                entry &e = ring[id % SEND_TIMES_RING];
+                e.time.store(t, std::memory_order_relaxed);
+                e.buffer_id.store(id, std::memory_order_release);
+        }
+        time_ns_t load(uint32_t id) const {
+                const entry &e = ring[id % SEND_TIMES_RING];
+                return e.buffer_id.load(std::memory_order_acquire) == id ? e.time.load(std::memory_order_relaxed) : 0;
+        }
+};
+
+struct receiver {
+        receiver(struct module *m, struct display *d, const char *e, const send_times *s) :
+                root(m), display(d), encryption(e), sent(s) {}
+        struct module *root;
+        struct display *display;
+        const char *encryption;
+        const send_times *sent; ///< NULL if not in the same process
+        struct rtp *session = nullptr;
+        struct pdb *participants = nullptr;
+        uint32_t ssrc = 0; ///< sender SSRC, 0 until the first frame
+        long long frames = 0;
+        time_ns_t first_frame = 0;
+        time_ns_t last_frame = 0;
+        vector<double> latencies_ms;
+        struct vcodec_state *vcodec = nullptr;
+};
+
+void destroy_vcodec(void *state)
+{
+        auto *vcodec = static_cast<struct vcodec_state *>(state);
+        video_decoder_destroy(vcodec->decoder);
+        free(vcodec);
+}
+
+int decode_frame(struct coded_data *cdata, void *udata, struct pbuf_stats *stats)
+{
+        auto *r = static_cast<receiver *>(udata);
+        time_ns_t now = get_time_in_ns();
+        if (r->sent != nullptr && cdata != nullptr) {
+                const auto *hdr = reinterpret_cast<const uint32_t *>(cdata->data->data);
+                uint32_t buffer_id = ntohl(hdr[0]) & ((1U << BUFNUM_BITS) - 1);
+                if (time_ns_t sent = r->sent->load(buffer_id)) {
+                        r->latencies_ms.push_back((now - sent) / 1e6);
+                }
+        }
+        r->frames += 1;
+        if (r->first_frame == 0) {
+                r->first_frame = now;
+        }
+        r->last_frame = now;
+        return decode_video_frame(cdata, r->vcodec, stats);
+}
+
+/// receives until should_stop is set or (if stop_on_idle) nothing is received for RX_IDLE_TIMEOUT_S
+void receiver_loop(receiver *r, const atomic<bool> *should_stop, bool stop_on_idle, double *cpu_s)
+{
+        double cpu_start = thread_cpu_time();
+        time_ns_t last_data = get_time_in_ns();
+        while (!*should_stop) {
+                struct timeval timeout = { 0, 1000 };
+                time_ns_t now = get_time_in_ns();
+                if (rtp_recv_r(r->session, &timeout, 0)) {
+                        last_data = now;
+                } else if (stop_on_idle && r->frames > 0 && now - last_data > RX_IDLE_TIMEOUT_S * NS_IN_SEC) {
+                        break;
+                }
+                pdb_iter_t it;
+                for (struct pdb_e *cp = pdb_iter_init(r->participants, &it); cp != nullptr; cp = pdb_iter_next(&it)) {
+                        if (cp->decoder_state == nullptr && !pbuf_is_empty(cp->playout_buffer)) {
+                                auto *vcodec = static_cast<struct vcodec_state *>(calloc(1, sizeof(struct vcodec_state)));
+                                vcodec->decoder = video_decoder_init(r->root, VIDEO_NORMAL, r->display, r->encryption);
+                                if (vcodec->decoder == nullptr) {
+                                        LOG(LOG_LEVEL_FATAL) << "Cannot initialize video decoder!\n";
+                                        free(vcodec);
+                                        exit(EXIT_FAILURE);
+                                }
+                                cp->decoder_state = vcodec;
+                                cp->decoder_state_deleter = destroy_vcodec;
+                                pbuf_set_playout_delay(cp->playout_buffer, 0); // measure network and reassembly only
+                                r->ssrc = cp->ssrc;
+                        }
+                        if (cp->decoder_state == nullptr) {
+                                continue;
+                        }
+                        r->vcodec = static_cast<struct vcodec_state *>(cp->decoder_state);
+                        now = get_time_in_ns();
+                        while (pbuf_decode(cp->playout_buffer, now, decode_frame, r)) {
+                        }
+                        pbuf_remove(cp->playout_buffer, now);
+                }
+                pdb_iter_done(&it);
+        }
+        *cpu_s = thread_cpu_time() - cpu_start;
+}
+
+struct rtp *create_session(const string &addr, int rx_port, int tx_port, struct pdb *participants)
+{
+        struct rtp *session = rtp_init(addr.c_str(), rx_port, tx_port, 255, 1000, FALSE, rtp_recv_callback,
+                        (uint8_t *) participants, 0, true);
+        if (session == nullptr) {
+                return nullptr;
+        }
+        rtp_set_option(session, RTP_OPT_WEAK_VALIDATION, TRUE);
+        rtp_set_option(session, RTP_OPT_PROMISC, TRUE);
+        if (!rtp_set_recv_buf(session, RECV_BUF_SIZE)) {
+                LOG(LOG_LEVEL_WARNING) << "Cannot set receive buffer to " << RECV_BUF_SIZE << " B (see net.core.rmem_max).\n";
+        }
+        rtp_set_send_buf(session, SEND_BUF_SIZE);
+        if (participants != nullptr) {
+                pdb_add(participants, rtp_my_ssrc(session));
+        }
+        return session;
+}
+
+/// sends frames at the requested frame rate for the duration
+void sender_loop(const bench_opts &opts, struct tx *tx, struct rtp *session, send_times *sent, bench_result *res)
+{
+        video_pattern_generator_t gen = video_pattern_generator_create(opts.pattern, opts.desc.width, opts.desc.height,
+                        opts.desc.color_spec, 0);
+        if (gen == nullptr) {
+                LOG(LOG_LEVEL_FATAL) << "Cannot create pattern " << opts.pattern << "!\n";
+                exit(EXIT_FAILURE);
+        }
+        struct video_frame *frame = vf_alloc_desc(opts.desc);
+        double cpu_start = thread_cpu_time();
+        time_ns_t start = get_time_in_ns();
+        time_ns_t end = start + (time_ns_t) (opts.duration * NS_IN_SEC);
+        time_ns_t now = start;
+        for (long long i = 0; now < end; ++i) {
+                time_ns_t next = start + (time_ns_t) (i * NS_IN_SEC / opts.desc.fps);
+                if (next > now) {
+                        std::this_thread::sleep_for(std::chrono::nanoseconds(next - now));
+                }
+                frame->tiles[0].data = video_pattern_generator_next_frame(gen);
+                if (sent != nullptr) {
+                        sent->store(tx_get_buffer_id(tx), get_time_in_ns());
+                }
+                tx_send(tx, frame, session);
+                res->frames_sent += 1;
+                now = get_time_in_ns();
+        }
+        res->duration = (now - start) / (double) NS_IN_SEC;
+        res->tx_cpu_s = thread_cpu_time() - cpu_start;
+        frame->tiles[0].data = nullptr;
+        vf_free(frame);
+        video_pattern_generator_destroy(gen);
+}
+
+bool run_config(const bench_opts &opts, const bench_config &config, struct module *root, struct display *display,
+                bench_result *res)
+{
+        *res = {};
+        res->config = config;
+        const char *fec = config.fec == "none" ? nullptr : config.fec.c_str();
+        const char *encryption = config.encryption == "none" ? nullptr : config.encryption.c_str();
+        double displayed_before = video_frames("displayed");
+        double dropped_before = video_frames("dropped");
+        double cpu_start = process_cpu_time();
+
+        send_times sent;
+        receiver r{root, display, encryption, opts.mode == MODE_LOOPBACK ? &sent : nullptr};
+        atomic<bool> rx_stop{false};
+        std::thread rx_thread;
+        if (opts.mode != MODE_TX) {
+                volatile int delay_ms = 0;
+                r.participants = pdb_init(&delay_ms);
+                r.session = create_session(opts.addr, opts.port, opts.port + 2, r.participants);
+                if (r.session == nullptr) {
+                        pdb_destroy(&r.participants);
+                        return false;
+                }
+                rx_thread = std::thread(receiver_loop, &r, &rx_stop, opts.mode == MODE_RX, &res->rx_cpu_s);
+        }
+        uint32_t tx_ssrc = 0;
+        if (opts.mode != MODE_RX) {
+                volatile int delay_ms = 0;
+                struct pdb *participants = pdb_init(&delay_ms); // RTCP of the receiver
+                struct rtp *session = create_session(opts.addr, opts.port + 2, opts.port, participants);
+                struct tx *tx = session == nullptr ? nullptr
+                        : tx_init(root, config.mtu, TX_MEDIA_VIDEO, fec, encryption, RATE_UNLIMITED);
+                if (tx != nullptr) {
+                        tx_ssrc = rtp_my_ssrc(session);
+                        sender_loop(opts, tx, session, opts.mode == MODE_LOOPBACK ? &sent : nullptr, res);
+                        module_done(CAST_MODULE(tx));
+                }
+                if (session != nullptr) {
+                        rtp_done(session);
+                }
+                pdb_destroy(&participants);
+                if (tx == nullptr) {
+                        rx_stop = true;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_TIME_MS));
+                rx_stop = true;
+        }
+        if (rx_thread.joinable()) {
+                rx_thread.join();
+                rtp_done(r.session);
+                pdb_destroy(&r.participants); // destroys the decoders
+        }
+        res->cpu_s = process_cpu_time() - cpu_start;
+        if (opts.mode != MODE_RX && tx_ssrc == 0) {
+                return false;
+        }
+
+        if (opts.mode != MODE_RX) {
+                res->tx_packets = counter("ug_tx_packets_total", "media=\"video\",ssrc=\"0x%08" PRIx32 "\"", tx_ssrc);
+                res->tx_bytes = counter("ug_tx_bytes_total", "media=\"video\",ssrc=\"0x%08" PRIx32 "\"", tx_ssrc);
+        }
+        if (opts.mode != MODE_TX) {
+                uint32_t ssrc = opts.mode == MODE_LOOPBACK ? tx_ssrc : r.ssrc;
+                res->rx_packets = counter("ug_rx_packets_received_total", "ssrc=\"0x%08" PRIx32 "\"", ssrc);
+                res->rx_expected = counter("ug_rx_packets_expected_total", "ssrc=\"0x%08" PRIx32 "\"", ssrc);
+                res->frames_received = r.frames;
+                res->latencies_ms = std::move(r.latencies_ms);
+                if (opts.mode == MODE_RX) {
+                        res->duration = (r.last_frame - r.first_frame) / (double) NS_IN_SEC;
+                }
+        }
+        res->frames_displayed = video_frames("displayed") - displayed_before;
+        res->frames_dropped = video_frames("dropped") - dropped_before;
+        return true;
+}
+
+double percentile(const vector<double> &sorted, double pct)
+{
+        if (sorted.empty()) {
+                return 0;
+        }
+        size_t idx = (size_t) (sorted.size() * pct / 100 + 0.5);
+        return sorted[std::min(sorted.size() - 1, idx > 0 ? idx - 1 : 0)];
+}
+
+void print_result(ostream &out, const bench_opts &opts, bench_result &r, bool first)
+{
+        std::sort(r.latencies_ms.begin(), r.latencies_ms.end());
+        double duration = std::max(r.duration, 1e-9);
+        double gbits = r.tx_bytes * 8 / 1e9;
+        double loss_pct = r.rx_expected > 0 ? 100.0 * (r.rx_expected - r.rx_packets) / r.rx_expected : 0;
+        // CPU per Gbit relates to the sent data, in rx mode to the received packets of the sent size
+        if (opts.mode == MODE_RX && r.rx_packets > 0) {
+                gbits = r.rx_packets * r.config.mtu * 8 / 1e9;
+        }
+        auto per_gbit = [&](double cpu) { return gbits > 0 ? cpu / gbits : 0; };
+        const char *mode = opts.mode == MODE_LOOPBACK ? "loopback" : opts.mode == MODE_TX ? "tx" : "rx";
+        char buf[2048];
+        if (opts.format == "text") {
+                snprintf(buf, sizeof buf, "%s mtu=%d fec=%s encryption=%s: %.2f s, %lld/%lld frames sent/received"
+                                " (%lld displayed, %lld dropped)\n"
+                                "\ttx %.0f pkt/s %.3f Gbit/s, rx %.0f pkt/s, loss %.4f %%\n"
+                                "\tCPU per Gbit: %.3f s (tx thread %.3f s, rx thread %.3f s)\n"
+                                "\tlatency tx->pbuf: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+                                mode, r.config.mtu, r.config.fec.c_str(), r.config.encryption == "none" ? "none" : "yes",
+                                r.duration, r.frames_sent, r.frames_received, r.frames_displayed, r.frames_dropped,
+                                r.tx_packets / duration, r.tx_bytes * 8 / duration / 1e9, r.rx_packets / duration, loss_pct,
+                                per_gbit(r.cpu_s), per_gbit(r.tx_cpu_s), per_gbit(r.rx_cpu_s),
+                                percentile(r.latencies_ms, 50), percentile(r.latencies_ms, 90),
+                                percentile(r.latencies_ms, 99), r.latencies_ms.empty() ? 0 : r.latencies_ms.back());
+        } else {
+                const char *fmt = opts.format == "json"
+                        ? "%s{\"mode\": \"%s\", \"mtu\": %d, \"fec\": \"%s\", \"encryption\": %s, \"duration_s\": %.3f, "
+                          "\"frames_sent\": %lld, \"frames_received\": %lld, \"frames_displayed\": %lld, \"frames_dropped\": %lld, "
+                          "\"tx_pps\": %.0f, \"tx_gbps\": %.4f, \"rx_pps\": %.0f, \"loss_pct\": %.4f, "
+                          "\"cpu_s_per_gbit\": %.4f, \"tx_cpu_s_per_gbit\": %.4f, \"rx_cpu_s_per_gbit\": %.4f, "
+                          "\"latency_p50_ms\": %.3f, \"latency_p90_ms\": %.3f, \"latency_p99_ms\": %.3f, \"latency_max_ms\": %.3f}"
+                        : "%s%s,%d,%s,%s,%.3f,%lld,%lld,%lld,%lld,%.0f,%.4f,%.0f,%.4f,%.4f,%.4f,%.4f,%.3f,%.3f,%.3f,%.3f\n";
+                const char *prefix = opts.format == "json" ? (first ? "" : ",\n")
+                        : first ? "mode,mtu,fec,encryption,duration_s,frames_sent,frames_received,frames_displayed,"
+                                "frames_dropped,tx_pps,tx_gbps,rx_pps,loss_pct,cpu_s_per_gbit,tx_cpu_s_per_gbit,"
+                                "rx_cpu_s_per_gbit,latency_p50_ms,latency_p90_ms,latency_p99_ms,latency_max_ms\n" : "";
+                snprintf(buf, sizeof buf, fmt, prefix, mode, r.config.mtu, r.config.fec.c_str(),
+                                r.config.encryption == "none" ? "false" : "true", r.duration,
+                                r.frames_sent, r.frames_received, r.frames_displayed, r.frames_dropped,
+                                r.tx_packets / duration, r.tx_bytes * 8 / duration / 1e9, r.rx_packets / duration, loss_pct,
+                                per_gbit(r.cpu_s), per_gbit(r.tx_cpu_s), per_gbit(r.rx_cpu_s),
+                                percentile(r.latencies_ms, 50), percentile(r.latencies_ms, 90),
+                                percentile(r.latencies_ms, 99), r.latencies_ms.empty() ? 0 : r.latencies_ms.back());
+        }
+        out << buf << std::flush;
+}
+
+vector<string> split(const string &str, char delim)
+{
+        vector<string> ret;
+        std::istringstream iss(str);
+        string item;
+        while (getline(iss, item, delim)) {
+                ret.push_back(item);
+        }
+        return ret;
+}
+
+void usage(const char *progname)
+{
+        printf("Loopback benchmark of the video RTP sender and receiver.\n\n"
+                        "Usage:\n"
+                        "\t%s [--mode=loopback|tx|rx] [--addr=<host>] [--port=<p>] [--size=<w>x<h>] [--codec=<c>]\n"
+                        "\t\t[--fps=<f>] [--pattern=<p>] [--duration=<s>] [--mtu=<m>[,...]] [--fec=<f>[;...]]\n"
+                        "\t\t[--encryption=<key>|none[;...]] [--format=text|json|csv] [--output=<file>]\n\n"
+                        "where\n"
+                        "\t--mode       - loopback runs both sides in one process (default); tx and rx run only the\n"
+                        "\t               sender or the receiver, eg. in two network namespaces connected by veth\n"
+                        "\t               (latency is measured only in loopback)\n"
+                        "\t--addr       - peer address (default localhost), --port RTP port of the receiver (default %d,\n"
+                        "\t               the sender uses port + 2)\n"
+                        "\t--size       - frame size (default 1920x1080), --codec pixel format (default UYVY),\n"
+                        "\t               --fps frame rate (default 60), --pattern video_pattern_generator pattern\n"
+                        "\t--duration   - sending time per configuration (default %d s)\n"
+                        "\t--mtu, --fec, --encryption - lists of values, every combination is measured\n"
+                        "\t               (defaults 1500,9000 ; none ; none), FEC as for -f, eg. \"rs:200:240;ldgm:1500:1\"\n\n"
+                        "Reported CPU time per sent Gbit is of the whole process and of the sending and receiving\n"
+                        "threads (the decoder threads are included only in the former). Latency is measured from\n"
+                        "tx_send() start to the frame leaving the playout buffer (playout delay set to zero).\n",
+                        progname, DEFAULT_PORT, DEFAULT_DURATION);
+}
+
+bool parse_opts(int argc, char *argv[], bench_opts *opts)
+{
+        for (int i = 1; i < argc; ++i) {
+                string arg = argv[i];
+                string val = arg.find('=') != string::npos ? arg.substr(arg.find('=') + 1) : "";
+                auto opt_is = [&](const char *name) { return arg.compare(0, strlen(name), name) == 0; };
+                if (arg == "--param") { // handled by common_preinit()
+                        i += 1;
+                } else if (opt_is("-V") || opt_is("--verbose")) {
+                        // handled by common_preinit()
+                } else if (opt_is("--mode=")) {
+                        if (val != "loopback" && val != "tx" && val != "rx") {
+                                return false;
+                        }
+                        opts->mode = val == "loopback" ? MODE_LOOPBACK : val == "tx" ? MODE_TX : MODE_RX;
+                } else if (opt_is("--addr=")) {
+                        opts->addr = val;
+                } else if (opt_is("--port=")) {
+                        opts->port = atoi(val.c_str());
+                } else if (opt_is("--size=")) {
+                        if (sscanf(val.c_str(), "%ux%u", &opts->desc.width, &opts->desc.height) != 2) {
+                                return false;
+                        }
+                } else if (opt_is("--codec=")) {
+                        opts->desc.color_spec = get_codec_from_name(val.c_str());
+                        if (opts->desc.color_spec == VIDEO_CODEC_NONE) {
+                                return false;
+                        }
+                } else if (opt_is("--fps=")) {
+                        opts->desc.fps = atof(val.c_str());
+                } else if (opt_is("--pattern=")) {
+                        opts->pattern = val;
+                } else if (opt_is("--duration=")) {
+                        opts->duration = atof(val.c_str());
+                } else if (opt_is("--mtu=")) {
+                        opts->mtus.clear();
+                        for (auto const &m : split(val, ',')) {
+                                opts->mtus.push_back(atoi(m.c_str()));
+                        }
+                } else if (opt_is("--fec=")) {
+                        opts->fecs = split(val, ';');
+                } else if (opt_is("--encryption=")) {
+                        opts->encryptions = split(val, ';');
+                } else if (opt_is("--format=") && (val == "text" || val == "json" || val == "csv")) {
+                        opts->format = val;
+                } else if (opt_is("--output=")) {
+                        opts->output = val;
+                } else {
+                        return false;
+                }
+        }
+        return opts->desc.fps > 0 && opts->duration > 0 && !opts->mtus.empty() && !opts->fecs.empty()
+                && !opts->encryptions.empty();
+}
+} // end of anonymous namespace
+
+int main(int argc, char *argv[])
+{
+        bench_opts opts;
+        if (!parse_opts(argc, argv, &opts)) {
+                usage(argv[0]);
+                return argc == 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) ? 0 : 1;
+        }
+        log_level = LOG_LEVEL_WARNING;
+        struct init_data *init = common_preinit(argc, argv);
+        if (init == nullptr) {
+                return 2;
+        }
+        struct module root;
+        init_root_module(&root);
+        struct display *display = nullptr;
+        if (opts.mode != MODE_TX && initialize_video_display(&root, "dummy", "", 0, nullptr, &display) != 0) {
+                LOG(LOG_LEVEL_FATAL) << "Cannot initialize the dummy display!\n";
+                return 1;
+        }
+
+        std::ofstream out_file;
+        if (!opts.output.empty()) {
+                out_file.open(opts.output);
+        }
+        ostream &out = opts.output.empty() ? std::cout : out_file;
+        if (opts.format == "json") {
+                out << "[\n";
+        }
+        int ret = 0;
+        bool first = true;
+        for (int mtu : opts.mtus) {
+                for (auto const &fec : opts.fecs) {
+                        for (auto const &encryption : opts.encryptions) {
+                                bench_result res;
+                                if (!run_config(opts, { mtu, fec, encryption }, &root, display, &res)) {
+                                        cerr << "Configuration mtu=" << mtu << " fec=" << fec << " failed!\n";
+                                        ret = 1;
+                                        continue;
+                                }
+                                print_result(out, opts, res, first);
+                                first = false;
+                        }
+                }
+        }
+        if (opts.format == "json") {
+                out << "\n]\n";
+        }
+
+        if (display != nullptr) {
+                display_put_frame(display, nullptr, PUTF_BLOCKING); // poisoned pill
+                display_done(display);
+        }
+        module_done(&root);
+        common_cleanup(init);
+        return ret;
+}